@@ -40,6 +40,7 @@ fn main() {
         "LCB_BUILD_LIBUV",
         "LIBCOUCHBASE_STATIC",
         "LCB_DUMP_PACKETS",
+        "LCB_NO_HTTP_COMPRESSION",
     ];
 
     for flag in env_flags.iter().filter(|flag| env::var(flag).is_ok()) {
@@ -51,6 +52,14 @@ fn main() {
         build_cfg.define("LIBCOUCHBASE_STATIC", "ON");
     }
 
+    if cfg!(feature = "no-tracing") {
+        build_cfg.define("LCB_NO_TRACING", "ON");
+    }
+
+    if cfg!(feature = "no-metrics") {
+        build_cfg.define("LCB_NO_METRICS", "ON");
+    }
+
     if cfg!(target_os = "windows") {
         build_cfg.define("CMAKE_C_FLAGS_DEBUG", "/MDd /Zi /Od /Ob0");
         build_cfg.define("CMAKE_CXX_FLAGS_DEBUG", "/MDd /Zi /Od /Ob0");
@@ -104,6 +113,10 @@ fn main() {
             println!("cargo:rustc-link-lib=dylib=stdc++");
             println!("cargo:rustc-link-lib=dylib=gcc");
         }
+        // zlib decompresses the HTTP responses, unless the build opts out of it
+        if !cfg!(target_os = "windows") && env::var("LCB_NO_HTTP_COMPRESSION").is_err() {
+            println!("cargo:rustc-link-lib=dylib=z");
+        }
         println!("cargo:rustc-link-lib=static=couchbase");
     } else {
         println!("cargo:rustc-link-lib=dylib=couchbase");
@@ -1 +1,2 @@
-#include "libcouchbase/include/libcouchbase/couchbase.h"
\ No newline at end of file
+#include "libcouchbase/include/libcouchbase/couchbase.h"
+#include "libcouchbase/include/libcouchbase/pktfwd.h"
\ No newline at end of file
@@ -10,6 +10,7 @@ IF(UNIX)
     CHECK_FUNCTION_EXISTS(setitimer HAVE_SETITIMER)
     CHECK_SYMBOL_EXISTS(htonll arpa/inet.h HAVE_HTONLL)
     CHECK_SYMBOL_EXISTS(res_search "netinet/in.h;resolv.h" HAVE_RES_SEARCH)
+    CHECK_SYMBOL_EXISTS(res_nsearch "netinet/in.h;resolv.h" HAVE_RES_NSEARCH)
     CHECK_INCLUDE_FILES(dlfcn.h HAVE_DLFCN_H)
     CHECK_INCLUDE_FILES(netdb.h HAVE_NETDB_H)
     CHECK_INCLUDE_FILES(stdint.h HAVE_STDINT_H)
@@ -7,9 +7,11 @@ SET(LCB_UTILS_SRC
     src/gethrtime.c
     src/list.c
     src/logging.c
-    src/ringbuffer.c)
+    src/ringbuffer.c
+    src/timerwheel.c)
 
 SET(LCB_UTILS_CXXSRC
+    src/logging-async.cc
     src/strcodecs/base64.cc)
 
 # lcbio
@@ -37,8 +39,10 @@ FILE(GLOB LCB_TRACING_SRC src/tracing/*.cc)
 
 SET(LCB_METRICS_SRC
     src/metrics/caching_meter.cc
+    src/metrics/compact_histogram.cc
     src/metrics/metrics.cc
-    src/metrics/metrics-internal.cc)
+    src/metrics/metrics-internal.cc
+    src/metrics/openmetrics_meter.cc)
 if (LCB_USE_HDR_HISTOGRAM)
     LIST(APPEND LCB_METRICS_SRC src/metrics/logging_meter.cc)
 endif()
@@ -55,6 +59,7 @@ SET(LCB_CORE_CXXSRC
     src/bucketconfig/bc_http.cc
     src/bucketconfig/bc_static.cc
     src/bucketconfig/confmon.cc
+    src/bucketconfig/shared_config.cc
     src/cntl.cc
     src/collections.cc
     src/connspec.cc
@@ -64,12 +69,16 @@ SET(LCB_CORE_CXXSRC
     src/docreq/docreq.cc
     src/dump.cc
     src/errmap.cc
+    src/flightrec.cc
     src/getconfig.cc
     src/handler.cc
     src/hostlist.cc
+    src/hotkeys.cc
     src/http/http.cc
     src/http/http_io.cc
+    src/http/inflate.cc
     src/instance.cc
+    src/instance_pool.cc
     src/iometrics.cc
     src/lcbht/lcbht.cc
     src/mcserver/mcserver.cc
@@ -79,22 +88,28 @@ SET(LCB_CORE_CXXSRC
     src/n1ql/n1ql.cc
     src/n1ql/query_handle.cc
     src/n1ql/query_utils.cc
+    src/nearcache.cc
     src/newconfig.cc
     src/nodeinfo.cc
     src/operations/cbflush.cc
     src/operations/counter.cc
     src/operations/durability-seqno.cc
     src/operations/durability.cc
+    src/operations/durable_batch.cc
     src/operations/exists.cc
     src/operations/get.cc
     src/operations/get_replica.cc
+    src/operations/multi.cc
     src/operations/observe-seqno.cc
     src/operations/observe.cc
     src/operations/ping.cc
     src/operations/pktfwd.cc
+    src/operations/range_scan.cc
     src/operations/remove.cc
+    src/operations/respbatch.cc
     src/operations/stats.cc
     src/operations/store.cc
+    src/operations/submitq.cc
     src/operations/subdoc.cc
     src/operations/touch.cc
     src/operations/unlock.cc
@@ -104,6 +119,7 @@ SET(LCB_CORE_CXXSRC
     src/search/search.cc
     src/search/search_handle.cc
     src/settings.cc
+    src/timings.cc
     src/utilities.cc
     src/views/view.cc
     src/views/view_handle.cc
@@ -67,6 +67,14 @@ extern "C" {
         void *context;
         int (*username)(void *context, int id, const char **result, unsigned int *len);
         int (*password)(cbsasl_conn_t *conn, void *context, int id, cbsasl_secret_t **psecret);
+        /*
+         * Optional cache of the SCRAM salted password (may be NULL). Called with
+         * CBSASL_CB_SALTED_PASSWORD_GET to look up the password derived for the
+         * salt and iteration count (SASL_OK and *len set on a hit), and with
+         * CBSASL_CB_SALTED_PASSWORD_SET to store a newly derived one.
+         */
+        int (*salted_password)(void *context, int id, cbsasl_auth_mechanism_t mech, const char *salt,
+                               unsigned int saltlen, unsigned int itcount, unsigned char *buf, unsigned int *len);
     } cbsasl_callbacks_t;
 
     typedef cbsasl_error_t (*cbsasl_init_fn)(void);
@@ -90,6 +98,9 @@ extern "C" {
         int (*get_password)(cbsasl_conn_t *conn, void *context, int id,
                             cbsasl_secret_t **psecret);
         void *get_password_ctx;
+        int (*salted_password)(void *context, int id, cbsasl_auth_mechanism_t mech, const char *salt,
+                               unsigned int saltlen, unsigned int itcount, unsigned char *buf, unsigned int *len);
+        void *salted_password_ctx;
         char *nonce; // client nonce for SCRAM-SHA authentication
         char *client_first_message_bare; // for SCRAM-SHA authentication
         unsigned char *saltedpassword; // for SCRAM-SHA authentication
@@ -225,6 +236,8 @@ extern "C" {
 #define CBSASL_CB_AUTHNAME 2
 #define CBSASL_CB_PASS 3
 #define CBSASL_CB_LIST_END 4
+#define CBSASL_CB_SALTED_PASSWORD_GET 5
+#define CBSASL_CB_SALTED_PASSWORD_SET 6
 
     CBSASL_PUBLIC_API
     cbsasl_error_t cbsasl_client_new(const char *service,
@@ -111,7 +111,9 @@ static void row_callback(lcb_INSTANCE *instance, int type, const lcb_RESPANALYTI
     }
     printf("%.*s\n", (int)nrow, row);
     if (lcb_respanalytics_is_final(resp)) {
-        printf("\n");
+        size_t stored = 0, ignored = 0, failed = 0;
+        lcb_respanalytics_ingest_stats(resp, &stored, &ignored, &failed);
+        printf("\x1b[1mINGESTED:\x1b[0m %d stored, %d ignored, %d failed\n\n", (int)stored, (int)ignored, (int)failed);
     }
 }
 
@@ -151,6 +153,8 @@ int main(int argc, char *argv[])
         lcb_INGEST_OPTIONS *opts;
         lcb_ingest_options_create(&opts);
         lcb_ingest_options_method(opts, LCB_INGEST_METHOD_UPSERT);
+        /* at most 64 upserts in flight, the rows wait on the socket meanwhile */
+        lcb_ingest_options_max_concurrency(opts, 64);
         lcb_cmdanalytics_ingest_options(cmd, opts);
 
         check(lcb_analytics(instance, &idx, cmd), "schedule analytics query");
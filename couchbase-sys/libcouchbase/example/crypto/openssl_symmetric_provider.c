@@ -161,10 +161,9 @@ static lcb_STATUS osp_verify_signature(struct lcbcrypto_PROVIDER *provider, cons
     return LCB_ERR_INVALID_ARGUMENT;
 }
 
-static lcb_STATUS osp_encrypt(struct lcbcrypto_PROVIDER *provider, const uint8_t *input, size_t input_len,
-                              const uint8_t *iv, size_t iv_len, uint8_t **output, size_t *output_len)
+static lcb_STATUS osp_encrypt_ctx(EVP_CIPHER_CTX *ctx, const uint8_t *input, size_t input_len, const uint8_t *iv,
+                                  size_t iv_len, uint8_t **output, size_t *output_len)
 {
-    EVP_CIPHER_CTX *ctx;
     const EVP_CIPHER *cipher;
     int rc, len, block_len, out_len;
     uint8_t *out;
@@ -173,14 +172,9 @@ static lcb_STATUS osp_encrypt(struct lcbcrypto_PROVIDER *provider, const uint8_t
         return LCB_ERR_INVALID_ARGUMENT;
     }
 
-    ctx = EVP_CIPHER_CTX_new();
-    if (!ctx) {
-        return LCB_ERR_INVALID_ARGUMENT;
-    }
     cipher = EVP_aes_256_cbc();
     rc = EVP_EncryptInit_ex(ctx, cipher, NULL, common_aes256_key, iv);
     if (rc != 1) {
-        EVP_CIPHER_CTX_free(ctx);
         return LCB_ERR_INVALID_ARGUMENT;
     }
     block_len = EVP_CIPHER_block_size(cipher);
@@ -188,27 +182,23 @@ static lcb_STATUS osp_encrypt(struct lcbcrypto_PROVIDER *provider, const uint8_t
     rc = EVP_EncryptUpdate(ctx, out, &len, input, input_len);
     if (rc != 1) {
         free(out);
-        EVP_CIPHER_CTX_free(ctx);
         return LCB_ERR_INVALID_ARGUMENT;
     }
     out_len = len;
     rc = EVP_EncryptFinal_ex(ctx, out + len, &len);
     if (rc != 1) {
         free(out);
-        EVP_CIPHER_CTX_free(ctx);
         return LCB_ERR_INVALID_ARGUMENT;
     }
     out_len += len;
-    EVP_CIPHER_CTX_free(ctx);
     *output = out;
     *output_len = out_len;
     return LCB_SUCCESS;
 }
 
-static lcb_STATUS osp_decrypt(struct lcbcrypto_PROVIDER *provider, const uint8_t *input, size_t input_len,
-                              const uint8_t *iv, size_t iv_len, uint8_t **output, size_t *output_len)
+static lcb_STATUS osp_decrypt_ctx(EVP_CIPHER_CTX *ctx, const uint8_t *input, size_t input_len, const uint8_t *iv,
+                                  size_t iv_len, uint8_t **output, size_t *output_len)
 {
-    EVP_CIPHER_CTX *ctx;
     const EVP_CIPHER *cipher;
     int rc, len, out_len;
     uint8_t *out;
@@ -217,49 +207,113 @@ static lcb_STATUS osp_decrypt(struct lcbcrypto_PROVIDER *provider, const uint8_t
         return LCB_ERR_INVALID_ARGUMENT;
     }
 
-    ctx = EVP_CIPHER_CTX_new();
-    if (!ctx) {
-        return LCB_ERR_INVALID_ARGUMENT;
-    }
     cipher = EVP_aes_256_cbc();
     rc = EVP_DecryptInit_ex(ctx, cipher, NULL, common_aes256_key, iv);
     if (rc != 1) {
-        EVP_CIPHER_CTX_free(ctx);
         return LCB_ERR_INVALID_ARGUMENT;
     }
     out = calloc(input_len, sizeof(uint8_t));
     rc = EVP_DecryptUpdate(ctx, out, &len, input, input_len);
     if (rc != 1) {
         free(out);
-        EVP_CIPHER_CTX_free(ctx);
         return LCB_ERR_INVALID_ARGUMENT;
     }
     out_len = len;
     rc = EVP_DecryptFinal_ex(ctx, out + len, &len);
     if (rc != 1) {
         free(out);
-        EVP_CIPHER_CTX_free(ctx);
         return LCB_ERR_INVALID_ARGUMENT;
     }
     out_len += len;
-    EVP_CIPHER_CTX_free(ctx);
     *output = out;
     *output_len = out_len;
     return LCB_SUCCESS;
 }
 
+static lcb_STATUS osp_encrypt(struct lcbcrypto_PROVIDER *provider, const uint8_t *input, size_t input_len,
+                              const uint8_t *iv, size_t iv_len, uint8_t **output, size_t *output_len)
+{
+    EVP_CIPHER_CTX *ctx;
+    lcb_STATUS rc;
+
+    ctx = EVP_CIPHER_CTX_new();
+    if (!ctx) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    rc = osp_encrypt_ctx(ctx, input, input_len, iv, iv_len, output, output_len);
+    EVP_CIPHER_CTX_free(ctx);
+    (void)provider;
+    return rc;
+}
+
+static lcb_STATUS osp_decrypt(struct lcbcrypto_PROVIDER *provider, const uint8_t *input, size_t input_len,
+                              const uint8_t *iv, size_t iv_len, uint8_t **output, size_t *output_len)
+{
+    EVP_CIPHER_CTX *ctx;
+    lcb_STATUS rc;
+
+    ctx = EVP_CIPHER_CTX_new();
+    if (!ctx) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    rc = osp_decrypt_ctx(ctx, input, input_len, iv, iv_len, output, output_len);
+    EVP_CIPHER_CTX_free(ctx);
+    (void)provider;
+    return rc;
+}
+
+/* The batch functions set up a single cipher context for all the fields of the document. A provider could as well
+ * split the items between worker threads here, as long as all of them are done when it returns. */
+static lcb_STATUS osp_encrypt_batch(struct lcbcrypto_PROVIDER *provider, lcbcrypto_BATCHITEM *items, size_t items_num)
+{
+    EVP_CIPHER_CTX *ctx;
+    size_t ii;
+
+    ctx = EVP_CIPHER_CTX_new();
+    if (!ctx) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    for (ii = 0; ii < items_num; ii++) {
+        items[ii].status = osp_encrypt_ctx(ctx, items[ii].input, items[ii].input_len, items[ii].iv, items[ii].iv_len,
+                                           &items[ii].output, &items[ii].output_len);
+    }
+    EVP_CIPHER_CTX_free(ctx);
+    (void)provider;
+    return LCB_SUCCESS;
+}
+
+static lcb_STATUS osp_decrypt_batch(struct lcbcrypto_PROVIDER *provider, lcbcrypto_BATCHITEM *items, size_t items_num)
+{
+    EVP_CIPHER_CTX *ctx;
+    size_t ii;
+
+    ctx = EVP_CIPHER_CTX_new();
+    if (!ctx) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    for (ii = 0; ii < items_num; ii++) {
+        items[ii].status = osp_decrypt_ctx(ctx, items[ii].input, items[ii].input_len, items[ii].iv, items[ii].iv_len,
+                                           &items[ii].output, &items[ii].output_len);
+    }
+    EVP_CIPHER_CTX_free(ctx);
+    (void)provider;
+    return LCB_SUCCESS;
+}
+
 lcbcrypto_PROVIDER *osp_create()
 {
     lcbcrypto_PROVIDER *provider = calloc(1, sizeof(lcbcrypto_PROVIDER));
-    provider->version = 1;
+    provider->version = 2;
     provider->destructor = osp_free;
-    provider->v.v1.release_bytes = osp_release_bytes;
-    provider->v.v1.generate_iv = osp_generate_iv;
-    provider->v.v1.sign = osp_sign;
-    provider->v.v1.verify_signature = osp_verify_signature;
-    provider->v.v1.encrypt = osp_encrypt;
-    provider->v.v1.decrypt = osp_decrypt;
-    provider->v.v1.get_key_id = osp_get_key_id;
+    provider->v.v2.release_bytes = osp_release_bytes;
+    provider->v.v2.generate_iv = osp_generate_iv;
+    provider->v.v2.sign = osp_sign;
+    provider->v.v2.verify_signature = osp_verify_signature;
+    provider->v.v2.encrypt = osp_encrypt;
+    provider->v.v2.decrypt = osp_decrypt;
+    provider->v.v2.get_key_id = osp_get_key_id;
+    provider->v.v2.encrypt_batch = osp_encrypt_batch;
+    provider->v.v2.decrypt_batch = osp_decrypt_batch;
     return provider;
 }
 
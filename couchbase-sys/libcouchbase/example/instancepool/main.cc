@@ -15,14 +15,12 @@
  *   limitations under the License.
  */
 
-#include "pool.h"
+#include <libcouchbase/couchbase.h>
+#include <pthread.h>
 #include <stdio.h>
-#include <vector>
 #include <cstring>
 #include <cstdlib>
 
-using namespace lcb;
-
 extern "C" {
 static void get_callback(lcb_INSTANCE *instance, int, const lcb_RESPBASE *rb)
 {
@@ -39,31 +37,17 @@ static void get_callback(lcb_INSTANCE *instance, int, const lcb_RESPBASE *rb)
 }
 }
 
-class MyPool : public Pool
-{
-  public:
-    MyPool(const lcb_CREATEOPTS *opts, size_t items) : Pool(opts, items) {}
-
-  protected:
-    void initialize(lcb_INSTANCE *instance)
-    {
-        // We override the initialize function to set the proper callback we
-        // care about
-        fprintf(stderr, "Initializing %p\n", instance);
-        lcb_install_callback(instance, LCB_CALLBACK_GET, get_callback);
-    }
-};
-
 extern "C" {
 static void *pthr_func(void *arg)
 {
-    Pool *pool = reinterpret_cast< Pool * >(arg);
+    lcb_INSTANCE_POOL *pool = reinterpret_cast< lcb_INSTANCE_POOL * >(arg);
     lcb_CMDGET *gcmd;
     lcb_cmdget_create(&gcmd);
     lcb_cmdget_key(gcmd, "foo", 3);
 
-    // Get an instance to use
-    lcb_INSTANCE *instance = pool->pop();
+    // Get an instance to use. A thread gets the instance it used last if it
+    // is free, without taking a lock
+    lcb_INSTANCE *instance = lcb_instance_pool_acquire(pool);
 
     // Issue the command
     lcb_get(instance, NULL, gcmd);
@@ -73,7 +57,7 @@ static void *pthr_func(void *arg)
     lcb_wait(instance, LCB_WAIT_DEFAULT);
 
     // Release back to pool
-    pool->push(instance);
+    lcb_instance_pool_release(pool, instance);
 
     return NULL;
 }
@@ -84,7 +68,7 @@ int main(int argc, char *argv[])
 {
     lcb_CREATEOPTS *options = NULL;
     pthread_t workers[NUM_WORKERS];
-    Pool *pool;
+    lcb_INSTANCE_POOL *pool;
     lcb_STATUS err;
 
     lcb_createopts_create(&options, LCB_TYPE_BUCKET);
@@ -95,9 +79,20 @@ int main(int argc, char *argv[])
         lcb_createopts_credentials(options, argv[3], strlen(argv[3]), argv[2], strlen(argv[2]));
     }
 
-    pool = new MyPool(options, 5);
+    err = lcb_instance_pool_create(&pool, options, 5);
+    if (err != LCB_SUCCESS) {
+        fprintf(stderr, "Couldn't create the pool: %s\n", lcb_strerror_short(err));
+        exit(EXIT_FAILURE);
+    }
+
+    // Set the callbacks we care about on every instance
+    for (size_t ii = 0; ii < lcb_instance_pool_size(pool); ii++) {
+        lcb_INSTANCE *instance = lcb_instance_pool_get(pool, ii);
+        fprintf(stderr, "Initializing %p\n", instance);
+        lcb_install_callback(instance, LCB_CALLBACK_GET, get_callback);
+    }
 
-    err = pool->connect();
+    err = lcb_instance_pool_connect(pool);
     if (err != LCB_SUCCESS) {
         fprintf(stderr, "Couldn't connect all instances: %s\n", lcb_strerror_short(err));
         exit(EXIT_FAILURE);
@@ -112,7 +107,7 @@ int main(int argc, char *argv[])
         pthread_join(workers[ii], &unused);
     }
 
-    delete pool;
+    lcb_instance_pool_destroy(pool);
 
     lcb_createopts_destroy(options);
     return 0;
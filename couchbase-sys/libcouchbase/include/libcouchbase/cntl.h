@@ -1326,11 +1326,1193 @@ typedef enum {
  */
 #define LCB_CNTL_ENABLE_OP_METRICS 0x67
 
+/**
+ * @brief Share read buffers between all sockets of the instance.
+ *
+ * By default every connection keeps its own pool of idle read buffers. If
+ * this is set to a non-zero value, all connections of the instance allocate
+ * their read buffers from one size-classed pool instead, which keeps at most
+ * this many bytes of idle buffers. Only connections created after the setting
+ * is changed are affected.
+ *
+ * Use `read_pool_size` in the connection string.
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @volatile
+ */
+#define LCB_CNTL_READ_POOL_SIZE 0x68
+
+/**
+ * @brief Coalesce implicit flushes within an event loop iteration.
+ *
+ * By default every scheduling context (e.g. every operation scheduled
+ * outside of lcb_sched_enter() and lcb_sched_leave()) flushes the pipelines
+ * it added packets to. If this is enabled, the flush is deferred to the end
+ * of the current iteration of the event loop instead, so that all packets
+ * scheduled until then are written to each server at once.
+ *
+ * @see LCB_CNTL_FLUSH_COALESCE_DELAY and LCB_CNTL_FLUSH_COALESCE_BYTES to
+ * bound how long and how much data may be deferred.
+ *
+ * Use `flush_coalesce` in the connection string.
+ *
+ * @cntl_arg_both{int* (as boolean)}
+ * @volatile
+ */
+#define LCB_CNTL_FLUSH_COALESCE 0x69
+
+/**
+ * @brief Maximum time a coalesced flush may be deferred.
+ *
+ * The default of 0 flushes at the end of the current event loop iteration.
+ * Only used if @ref LCB_CNTL_FLUSH_COALESCE is enabled.
+ *
+ * Use `flush_coalesce_delay` in the connection string.
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @volatile
+ */
+#define LCB_CNTL_FLUSH_COALESCE_DELAY 0x6a
+
+/**
+ * @brief Number of deferred bytes after which pipelines are flushed right away.
+ *
+ * Once the packets scheduled since the last flush amount to at least this
+ * many bytes, they are flushed without waiting for the end of the event loop
+ * iteration. Only used if @ref LCB_CNTL_FLUSH_COALESCE is enabled.
+ *
+ * Use `flush_coalesce_bytes` in the connection string.
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @volatile
+ */
+#define LCB_CNTL_FLUSH_COALESCE_BYTES 0x6b
+
+/**
+ * @brief Write to all sockets at the end of the event loop iteration.
+ *
+ * With event-based I/O plugins, flushing a connection normally registers
+ * interest in its socket becoming writable, and writes once the plugin reports
+ * it. If this is enabled, all connections sharing the I/O plugin which have
+ * been flushed during an iteration of the event loop are written to directly at
+ * the end of that iteration instead, saving the watcher updates and the extra
+ * event loop round trip. A connection only waits for its socket once a write
+ * would have blocked.
+ *
+ * This has no effect on completion-based plugins, which already start writing
+ * when the connection is flushed. The number of calls into the plugin is
+ * counted in the `io_send_calls`, `io_recv_calls` and `io_watch_calls` fields
+ * of the server metrics (use `metrics` in the connection string).
+ *
+ * Use `io_batch_writes` in the connection string.
+ *
+ * @cntl_arg_both{int* (as boolean)}
+ * @volatile
+ */
+#define LCB_CNTL_IO_BATCH_WRITES 0x6c
+
+/**
+ * @brief Resolve collection IDs from the collection manifest
+ *
+ * By default the ID of every collection is looked up with its own `GET_CID`
+ * request the first time it is used. If this is enabled, the first lookup
+ * fetches the whole manifest of the bucket with `GET_COLLECTIONS_MANIFEST`
+ * and loads all of its collections into the cache at once. Operations which
+ * miss the cache while the request is in flight wait for it instead of sending
+ * requests of their own.
+ *
+ * An unknown collection reported by the server reloads the manifest once,
+ * unless the manifest uid sent along with the error is not newer than the one
+ * already loaded.
+ *
+ * Use `collections_manifest` in the connection string.
+ *
+ * @cntl_arg_both{int* (as boolean)}
+ * @volatile
+ */
+#define LCB_CNTL_COLLECTIONS_MANIFEST 0x6d
+
+/**
+ * @brief Skip compression of values which do not compress well
+ *
+ * Values are grouped into classes by datatype and by the prefix of their key
+ * (up to the first ':', '_', '-', '.' or '/'). If this is enabled, the library
+ * keeps track of the ratio snappy achieves for each class, and stops
+ * compressing values of classes whose average ratio is worse than
+ * @ref LCB_CNTL_COMPRESSION_MIN_RATIO. Every 64th value of such a class is
+ * still compressed, so that the class is picked up again once its values
+ * become compressible.
+ *
+ * With @ref LCB_CNTL_ENABLE_OP_METRICS, the bytes saved by, and the nanoseconds spent on,
+ * every compressed value are reported to the meter as
+ * `db.couchbase.compression.saved` and `db.couchbase.compression.duration`,
+ * and the size of every skipped value as `db.couchbase.compression.skipped`.
+ *
+ * Use `compression_adaptive` in the connection string.
+ *
+ * @cntl_arg_both{int* (as boolean)}
+ * @volatile
+ */
+#define LCB_CNTL_COMPRESSION_ADAPTIVE 0x6e
+
+/**
+ * @brief Resume TLS sessions of earlier connections
+ *
+ * If this is enabled (the default), the session (or session ticket) negotiated
+ * with a node is remembered for its host and port, and offered again by the
+ * next TLS connection to the same endpoint. This includes reconnects of KV
+ * sockets as well as the sockets opened by the HTTP connection pool, which
+ * then skip the full handshake if the server accepts the session.
+ *
+ * Use `ssl_session_cache` in the connection string.
+ *
+ * @cntl_arg_both{int* (as boolean)}
+ * @volatile
+ */
+#define LCB_CNTL_SSL_SESSION_CACHE 0x6f
+
+/**
+ * @brief Limit the rate at which retried operations are sent to a node
+ *
+ * At most this many operations are sent from the retry queue to a single node
+ * within each @ref LCB_CNTL_RETRY_INTERVAL. Operations which are due once the
+ * budget of their node is spent are sent in the next interval instead, which
+ * does not count as an additional attempt. This keeps the retries of a
+ * failover (e.g. not-my-vbucket replies for a whole node) from delaying fresh
+ * operations scheduled to the new master. The default of 0 disables the limit.
+ *
+ * The size of the retry queue and the age of its oldest operation are
+ * reported in @ref lcb_METRICS, and, with @ref LCB_CNTL_ENABLE_OP_METRICS,
+ * recorded on every flush of the queue as `db.couchbase.retry_queue.depth`
+ * and `db.couchbase.retry_queue.age` (microseconds).
+ *
+ * Use `retry_budget` in the connection string.
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @volatile
+ */
+#define LCB_CNTL_RETRY_BUDGET 0x70
+
+/**
+ * @brief Retry not-my-vbucket replies once the vBucket has moved
+ *
+ * If this is enabled, an operation rejected with not-my-vbucket is not retried
+ * after @ref LCB_CNTL_RETRY_NMV_INTERVAL (or immediately, see
+ * @ref LCB_CNTL_RETRY_NMV_IMM) while the current configuration still maps its
+ * vBucket to the node which rejected it. Instead it waits until a
+ * configuration which maps the vBucket to another node is applied, and is sent
+ * to the new master right away. An operation for which no such configuration
+ * arrives fails once its timeout is reached.
+ *
+ * If the reply carried a configuration which already moved the vBucket, the
+ * operation is retried immediately.
+ *
+ * Use `retry_nmv_on_config` in the connection string.
+ *
+ * @cntl_arg_both{int* (as boolean)}
+ * @volatile
+ */
+#define LCB_CNTL_RETRY_NMV_ON_CONFIG 0x71
+
+/**
+ * @brief Maximum number of prepared statements kept by the query cache
+ *
+ * Once the cache is full, the least recently used statement is evicted, and
+ * has to be prepared again the next time it is executed. Lowering the limit
+ * evicts statements right away. The default is 5000. If the cache is shared
+ * (see @ref LCB_CNTL_QUERY_CACHE_SHARE), the limit applies to all instances
+ * sharing it.
+ *
+ * Use `query_cache_size` in the connection string.
+ *
+ * @cntl_arg_both{lcb_SIZE*}
+ * @volatile
+ */
+#define LCB_CNTL_QUERY_CACHE_SIZE 0x72
+
+/**
+ * @brief Share the prepared statement cache of another instance
+ *
+ * The argument is the `lcb_INSTANCE*` whose cache this instance should use
+ * from now on, instead of its own. This allows several instances connected to
+ * the same cluster (e.g. one per IO thread) to prepare each statement only
+ * once. The cache is safe to use from instances running on different threads,
+ * and lives until the last instance using it is destroyed.
+ *
+ * @cntl_arg_setonly{lcb_INSTANCE*}
+ * @volatile
+ */
+#define LCB_CNTL_QUERY_CACHE_SHARE 0x73
+
+/**
+ * @brief Number of idle connections to keep open to every query node
+ *
+ * The HTTP socket pool opens this many connections to the query service of
+ * every node as soon as a configuration is received, and opens another one
+ * whenever a query takes one of them, so that queries do not have to wait for
+ * TCP (and TLS) handshakes. These connections are not closed after
+ * @ref LCB_CNTL_HTTP_POOL_TIMEOUT, nor limited by @ref LCB_CNTL_HTTP_POOLSIZE.
+ * The default of 0 keeps no connections open beyond what the pool settings
+ * allow.
+ *
+ * Queries (and search and analytics requests) are sent to the node with the
+ * fewest requests in flight. The number of requests which found an idle
+ * connection (`hits`), and which had to wait for one (`misses`), are reported
+ * for every host in the `pools` section of lcb_diag(), along with the
+ * percentiles of the time it took to obtain a connection (`lease_latency`).
+ *
+ * Use `query_pool_target` in the connection string.
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @volatile
+ */
+#define LCB_CNTL_QUERY_POOL_TARGET 0x74
+
+/**
+ * @brief Number of idle connections to keep open to every search node
+ *
+ * The same as @ref LCB_CNTL_QUERY_POOL_TARGET, for the search service.
+ *
+ * Use `search_pool_target` in the connection string.
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @volatile
+ */
+#define LCB_CNTL_SEARCH_POOL_TARGET 0x75
+
+/**
+ * @brief Fraction of operations to trace
+ *
+ * A value between 0 (exclusive) and 1 (the default). Each operation which was
+ * not given a parent span is traced with this probability, and no span at all
+ * is created for the others. This keeps the cost of tracing bounded at high
+ * operation rates, at the price of the threshold logging tracer only seeing
+ * slow operations among the sampled ones.
+ *
+ * Use `tracing_sample_rate` in the connection string.
+ *
+ * @cntl_arg_both{float*}
+ * @volatile
+ */
+#define LCB_CNTL_TRACING_SAMPLE_RATE 0x76
+
+/**
+ * @brief Interval of the health probes of the data connections, in microseconds
+ *
+ * When set, each open data connection which has not read anything for a full
+ * interval is sent a NOOP, and its round trip time is recorded in a fixed
+ * per-node structure (see lcb_health_probe()). Busy connections are not
+ * probed, and no connections are opened for the probes. Unlike lcb_ping(), no
+ * report is built. The round trip times also seed the delay of hedged gets
+ * until enough get latencies were recorded, and hedged gets skip replicas
+ * whose last probe timed out.
+ *
+ * The default is 0, which disables probing.
+ *
+ * Use `health_probe_interval` in the connection string.
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @volatile
+ */
+#define LCB_CNTL_HEALTH_PROBE_INTERVAL 0x77
+
+/** @brief Counters of the prepared statement cache */
+typedef struct {
+    lcb_SIZE size;     /**< Number of statements in the cache */
+    lcb_U64 hits;      /**< Executions which found the plan of their statement in the cache */
+    lcb_U64 misses;    /**< Executions which had to prepare their statement */
+    lcb_U64 prepares;  /**< PREPARE requests sent to the query service */
+    lcb_U64 evictions; /**< Statements evicted because the cache was full */
+    lcb_U64 joined;    /**< Executions which waited for the PREPARE of their statement already in flight */
+} lcb_QUERY_CACHE_STATS;
+
+/**
+ * @brief Get the counters of the prepared statement cache
+ *
+ * The counters start when the cache is created, and are not reset by
+ * @ref LCB_CNTL_QUERY_CLEARACHE. If the cache is shared (see
+ * @ref LCB_CNTL_QUERY_CACHE_SHARE), they count the statements of all
+ * instances sharing it. Frequent evictions mean that
+ * @ref LCB_CNTL_QUERY_CACHE_SIZE is too small for the statements in use.
+ *
+ * @cntl_arg_getonly{lcb_QUERY_CACHE_STATS*}
+ * @volatile
+ */
+#define LCB_CNTL_QUERY_CACHE_STATS 0x78
+
+/**
+ * @brief Lifetime of resolved host addresses, in microseconds
+ *
+ * Host names are resolved on helper threads, so that a slow DNS server does
+ * not block the event loop, and the addresses are kept for this long so that
+ * the following connections to the same host (including those of the HTTP
+ * services) skip the lookup. The record TTLs are not available through the
+ * system resolver, so a fixed lifetime is used instead. Cached addresses are
+ * dropped as soon as a connection to them fails.
+ *
+ * The default is 10 seconds. 0 resolves the host of every new connection.
+ *
+ * Use `dns_cache_ttl` in the connection string.
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @volatile
+ */
+#define LCB_CNTL_DNS_CACHE_TTL 0x79
+
+/**
+ * @brief Delay between parallel connection attempts, in microseconds
+ *
+ * When a host resolves to several addresses, or a bootstrap list has several
+ * hosts, the next one is tried if the previous connection has not completed
+ * within this delay, without abandoning the attempts already in flight
+ * ("Happy Eyeballs", RFC 8305). The first connection to complete is used and
+ * the others are closed. Addresses alternate between IPv6 and IPv4, starting
+ * with the family of the first address returned by the resolver.
+ *
+ * The default is 250 milliseconds. 0 tries the addresses one at a time,
+ * moving on only once a connection has failed.
+ *
+ * Use `connect_attempt_delay` in the connection string.
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @volatile
+ */
+#define LCB_CNTL_CONNECT_ATTEMPT_DELAY 0x7a
+
+/**
+ * @brief Number of data connections to each node
+ *
+ * A single connection serializes all the operations to a node, so that large
+ * values or slow operations delay everything queued behind them. With more
+ * than one connection, key-based operations are spread across the connections
+ * of their node by vBucket: the operations on a key always use the same
+ * connection and are therefore still executed in order. Operations which are
+ * not bound to a key (e.g. statistics and pings) use the first connection.
+ * The connections are established when they are first used.
+ *
+ * Buckets without vBuckets (memcached buckets) always use the first
+ * connection. A new value is applied with the next cluster configuration.
+ *
+ * The default is 1, the maximum is 16.
+ *
+ * Use `kv_connections_per_node` in the connection string.
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @volatile
+ */
+#define LCB_CNTL_KV_CONNECTIONS_PER_NODE 0x7b
+
+/**
+ * @brief Size from which packets yield to smaller ones, in bytes
+ *
+ * A large upsert delays every operation queued behind it on the same
+ * connection until it has been written. Packets (header, key and value) of at
+ * least this size are therefore only placed in the send queue once everything
+ * scheduled before them has been written, so that smaller packets scheduled
+ * meanwhile go first. A packet being written is never interrupted, and
+ * operations on the same document keep their order.
+ *
+ * This only applies to connections which negotiated out-of-order execution
+ * (see @ref LCB_CNTL_ENABLE_UNORDERED_EXECUTION). The per-server metrics
+ * (@ref LCB_CNTL_METRICS) count the held packets and the packets which were
+ * sent ahead of them.
+ *
+ * The default is 1 megabyte. 0 sends the packets in the order they were
+ * scheduled. A new value applies to the connections established afterwards.
+ *
+ * Use `large_value_threshold` in the connection string.
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @volatile
+ */
+#define LCB_CNTL_LARGE_VALUE_THRESHOLD 0x7c
+
+/**
+ * @brief Age at which kept HTTP connections are replaced, in microseconds
+ *
+ * The connections kept open by @ref LCB_CNTL_QUERY_POOL_TARGET (and the other
+ * pool targets) are never closed for being idle, so a server or a middlebox
+ * may close them first, and the next request would find a dead socket. Idle
+ * kept connections are checked at this interval (or the one of
+ * @ref LCB_CNTL_HTTP_POOL_TIMEOUT, if shorter), and the ones which were closed
+ * by the peer, or have been idle for this long, are replaced by new
+ * connections. The number of replaced connections is reported as `refreshed`
+ * in the `pools` section of lcb_diag().
+ *
+ * The default of 0 only replaces connections which were closed by the peer.
+ *
+ * Use `http_pool_refresh` in the connection string.
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @volatile
+ */
+#define LCB_CNTL_HTTP_POOL_REFRESH 0x7d
+
+/**
+ * @brief Number of idle connections to keep open to every analytics node
+ *
+ * The same as @ref LCB_CNTL_QUERY_POOL_TARGET, for the analytics service.
+ *
+ * Use `analytics_pool_target` in the connection string.
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @volatile
+ */
+#define LCB_CNTL_ANALYTICS_POOL_TARGET 0x7e
+
+/**
+ * @brief Write the records of the console logger from a background thread
+ *
+ * Records are formatted by the thread which logs them, and queued for a
+ * background thread which writes them to the console logger's file, so that
+ * verbose logging does not stall the event loop on stdio. If the queue (4096
+ * records) is full, records are dropped rather than waiting, and counted in
+ * @ref LCB_CNTL_CONLOGGER_DROPPED. Turning this off waits for the queued
+ * records to be written.
+ *
+ * Like the other console logger settings, this applies to the whole process,
+ * and the first argument to lcb_cntl() may be `NULL`. It may also be enabled
+ * with the `LCB_LOGASYNC` environment variable.
+ *
+ * Use `console_log_async` in the connection string.
+ *
+ * @cntl_arg_both{int* (as boolean)}
+ * @volatile
+ */
+#define LCB_CNTL_CONLOGGER_ASYNC 0x7f
+
+/**
+ * @brief Maximum records per second of each subsystem of the console logger
+ *
+ * Every subsystem (the name in parentheses in each record, e.g. `lcbio_mgr`)
+ * may log this many records per second, with bursts of as many. Further
+ * records are suppressed and counted in @ref LCB_CNTL_CONLOGGER_DROPPED, and
+ * the next record of the subsystem which is logged tells how many were
+ * suppressed before it. The default of 0 does not limit logging.
+ *
+ * This applies to the whole process. It may also be set with the
+ * `LCB_LOGRATE` environment variable.
+ *
+ * Use `console_log_rate` in the connection string.
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @volatile
+ */
+#define LCB_CNTL_CONLOGGER_RATE 0x80
+
+/**
+ * @brief Number of console logger records suppressed or dropped
+ *
+ * The total of the records suppressed by @ref LCB_CNTL_CONLOGGER_RATE, and
+ * dropped because the queue of @ref LCB_CNTL_CONLOGGER_ASYNC was full, since
+ * the start of the process.
+ *
+ * @cntl_arg_getonly{lcb_U64*}
+ * @volatile
+ */
+#define LCB_CNTL_CONLOGGER_DROPPED 0x81
+
+/**
+ * @brief Upper bound for the size of the data buffer blocks, in bytes
+ *
+ * The buffers which hold the outgoing packets of every data connection are
+ * allocated in blocks whose size follows the size of the packets. This bounds
+ * the size of the blocks: a lower value uses less memory for idle buffers, a
+ * higher one needs fewer allocations for large values. Packets larger than
+ * half a block are always allocated separately.
+ *
+ * The default of 0 uses the built-in bound of 256 kilobytes. A new value
+ * applies to the existing connections as well; blocks which are in use are
+ * released once their packets have been sent.
+ *
+ * Use `netbuf_block_max` in the connection string.
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @volatile
+ */
+#define LCB_CNTL_NETBUF_BLOCK_MAX 0x82
+
+/**
+ * @brief Apply a group of tuning settings at once
+ *
+ * Sets all the settings of a profile together, while the instance is running.
+ * If one of them is rejected, the ones already set are reverted, so either
+ * the whole profile applies or nothing changes. The settings take effect on
+ * the existing connections and pools (see the individual settings).
+ *
+ * The argument is the name of a built-in profile:
+ *
+ * - `default`: the defaults of the library.
+ * - `low-latency`: no write coalescing, small values sent uncompressed, small
+ *   packets overtake large ones (@ref LCB_CNTL_LARGE_VALUE_THRESHOLD), more
+ *   pooled HTTP connections and short retry intervals.
+ * - `bulk-throughput`: coalesced and batched writes, larger read chunks and
+ *   buffer blocks, packets sent in order.
+ * - `memory-constrained`: small read chunks and buffer blocks, no pooled HTTP
+ *   connections.
+ *
+ * Each profile sets `read_chunk_size`, `compression_min_size`,
+ * `flush_coalesce`, `flush_coalesce_delay`, `flush_coalesce_bytes`,
+ * `io_batch_writes`, `http_poolsize`, `large_value_threshold`,
+ * `netbuf_block_max` and `retry_interval`. Alternatively the argument may be
+ * a custom profile, as a list of `key:value` pairs separated by commas (e.g.
+ * `read_chunk_size:65536,flush_coalesce:true`), of settings which take
+ * numbers, booleans or intervals.
+ *
+ * Getting the setting returns the argument of the last profile applied
+ * successfully, or `NULL`. Settings changed individually afterwards are not
+ * reflected.
+ *
+ * Use `tuning_profile` in the connection string. Options which follow it in
+ * the connection string override the profile.
+ *
+ * @cntl_arg_both{const char*}
+ * @volatile
+ */
+#define LCB_CNTL_TUNING_PROFILE 0x83
+
+/**
+ * @brief Share the cluster map with other instances of the process
+ *
+ * Instances which set the same group name share their configuration: the
+ * newest cluster map one of them receives is kept by the group, and the
+ * others load it from there instead of fetching it themselves. Background
+ * polling (@ref LCB_CNTL_CONFIG_POLL_INTERVAL) is done by one member of the
+ * group per interval, the others only pick up what it found.
+ *
+ * This is meant for processes which run many instances against the same
+ * bucket, e.g. one per thread. The group name must only be shared by
+ * instances connected to the same bucket of the same cluster; configurations
+ * of another bucket than the one of the instance are neither shared nor
+ * applied.
+ *
+ * Setting `NULL` leaves the group. Getting the setting returns the name of the
+ * group, or `NULL`.
+ *
+ * Use `shared_config` in the connection string.
+ *
+ * @cntl_arg_both{const char*}
+ * @volatile
+ */
+#define LCB_CNTL_SHARED_CONFIG 0x84
+
+/**
+ * @brief Poll the event loop for a while before blocking in lcb_wait()
+ *
+ * When set, lcb_wait() first runs non-blocking iterations of the event loop
+ * (see lcb_tick_nowait()) for up to this amount of time, and only blocks in
+ * the I/O plugin if operations are still pending then. Responses which arrive
+ * within that time are handled without the latency of waking up a blocked
+ * thread, at the cost of keeping a CPU busy while waiting.
+ *
+ * On Linux the value is also set as `SO_BUSY_POLL` on the KV sockets, so
+ * that the kernel polls the device for them as well. Raising it above the
+ * `net.core.busy_read` sysctl requires `CAP_NET_ADMIN`; if that fails the
+ * option is only logged and the loop still spins.
+ *
+ * The I/O plugin must support lcb_tick_nowait(), otherwise lcb_wait() blocks
+ * right away. The default is `0`, which disables spinning.
+ *
+ * @cntl_arg_both{lcb_U32*}
+ *
+ * The value for this option is a time value. See the top of this header
+ * in respect to how to specify this.
+ *
+ * Use `wait_spin` in the connection string.
+ *
+ * @volatile
+ */
+#define LCB_CNTL_WAIT_SPIN 0x85
+
+/**
+ * @brief Maximum number of documents kept by the near cache
+ *
+ * Gets scheduled with lcb_cmdget_near_cache() are answered from a cache of
+ * recently read documents, without contacting the cluster. Mutations of a
+ * document through this instance (stores, removals, counters, touches and
+ * sub-document mutations) drop its cached value, while mutations through
+ * other clients are only seen once the value expires, see
+ * LCB_CNTL_NEAR_CACHE_TTL. The least recently used documents are evicted
+ * when the cache is full.
+ *
+ * The default is `0`, which disables the cache. See `near_cache_hits` and
+ * `near_cache_misses` of LCB_CNTL_METRICS for its hit ratio.
+ *
+ * Use `near_cache_size` in the connection string.
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @volatile
+ */
+#define LCB_CNTL_NEAR_CACHE_SIZE 0x86
+
+/**
+ * @brief How long the near cache serves a document after reading it
+ *
+ * This bounds how stale a value read with lcb_cmdget_near_cache() can be if
+ * the document is mutated by another client. `0` keeps values until they are
+ * evicted or mutated through this instance. The default is 1 second.
+ *
+ * Keys found missing are remembered for between half of this and all of it,
+ * see LCB_CNTL_NEGATIVE_CACHE_SIZE.
+ *
+ * @cntl_arg_both{lcb_U32*}
+ *
+ * The value for this option is a time value. See the top of this header
+ * in respect to how to specify this.
+ *
+ * Use `near_cache_ttl` in the connection string.
+ *
+ * @volatile
+ */
+#define LCB_CNTL_NEAR_CACHE_TTL 0x87
+
+/**
+ * @brief Share one request between identical gets in flight
+ *
+ * If this is enabled, a get for a key which is already being read by an
+ * earlier get of this instance is not sent again. It waits for the reply of
+ * the earlier get instead, which is passed to the callbacks of both. This
+ * turns bursts of reads of the same key (e.g. after the application was
+ * restarted) into a single request per key.
+ *
+ * Only gets without lcb_cmdget_expiry(), lcb_cmdget_locktime() and
+ * lcb_cmdget_hedge() are shared, and those that join an earlier get share
+ * its timeout as well. See `gets_coalesced` of LCB_CNTL_METRICS for how many
+ * requests were saved. Disabled by default.
+ *
+ * Use `get_coalesce` in the connection string.
+ *
+ * @cntl_arg_both{int* (as boolean)}
+ * @volatile
+ */
+#define LCB_CNTL_GET_COALESCE 0x88
+
+/**
+ * @brief Number of missing keys remembered by the near cache
+ *
+ * Gets scheduled with lcb_cmdget_near_cache() and exists checks scheduled
+ * with lcb_cmdexists_near_cache() fail with @ref LCB_ERR_DOCUMENT_NOT_FOUND
+ * without contacting the cluster if the key was recently found missing. The
+ * keys are kept in counting Bloom filters of 8 bytes per key, so a small
+ * fraction of other keys (about 2% when full) is reported missing as well.
+ *
+ * Mutations of a document through this instance make its key present again,
+ * while documents created by other clients are only seen once the key aged
+ * out, see LCB_CNTL_NEAR_CACHE_TTL. This suits probes which tolerate stale
+ * answers, such as deduplication checks.
+ *
+ * The default is `0`, which disables remembering missing keys. See
+ * `negative_cache_hits` of LCB_CNTL_METRICS for how many probes it answered.
+ *
+ * Use `negative_cache_size` in the connection string.
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @volatile
+ */
+#define LCB_CNTL_NEGATIVE_CACHE_SIZE 0x89
+
+/**
+ * @brief Skip touches which would not move the expiry by much
+ *
+ * Gets with an expiry (get-and-touch) of a document whose expiry this
+ * instance refreshed to the same value, by a get-and-touch or a touch, less
+ * than this long ago are sent as plain gets. For session stores which touch
+ * the same documents on every request, this saves most of the writes of the
+ * touches, at the cost of documents expiring up to this much earlier than
+ * requested. Any other mutation of a document through this instance makes its
+ * next get-and-touch go through. Up to 1024 documents are remembered.
+ *
+ * The default is `0`, which sends every touch. See `touches_skipped` of
+ * LCB_CNTL_METRICS for how many were skipped.
+ *
+ * Use `touch_skip_window` in the connection string.
+ *
+ * @cntl_arg_both{lcb_U32*}
+ *
+ * The value for this option is a time value. See the top of this header
+ * in respect to how to specify this.
+ *
+ * @volatile
+ */
+#define LCB_CNTL_TOUCH_SKIP_WINDOW 0x8a
+
+/**
+ * @brief Server group (availability zone) to prefer for reads
+ *
+ * Replica reads with @ref LCB_REPLICA_MODE_ANY try a replica in this server
+ * group first, and query, search, analytics and view requests are sent to
+ * nodes of this group when any of them runs the service. Other nodes are
+ * used when none of the group is available. This keeps reads within the
+ * availability zone of the application, avoiding the latency and transfer
+ * cost of crossing zones.
+ *
+ * The group of a node is the `serverGroup` of its entry in the cluster
+ * configuration, as configured in the "Server Groups" section of the cluster.
+ * The default is no preference.
+ *
+ * Use `preferred_server_group` in the connection string.
+ *
+ * @cntl_arg_get_and_set{`const char**`, `const char*`}
+ * @volatile
+ */
+#define LCB_CNTL_PREFERRED_SERVER_GROUP 0x8b
+
+/**
+ * @brief Maximum number of bytes of KV operations in flight
+ *
+ * An operation is in flight from the moment it is scheduled until its
+ * response has been delivered, counting the size of its request. Once the
+ * operations of all nodes together reach this size, new key-value operations
+ * fail right away with @ref LCB_ERR_CLIENT_OVERLOADED instead of queueing
+ * more data behind a slow node. See lcb_set_overload_callback() to learn when
+ * the limit is reached and when enough operations have completed again.
+ *
+ * The default is `0`, which does not limit the operations in flight.
+ *
+ * Use `kv_inflight_bytes_max` in the connection string.
+ *
+ * @cntl_arg_both{lcb_SIZE*}
+ * @see LCB_CNTL_KV_PIPELINE_INFLIGHT_BYTES_MAX
+ * @volatile
+ */
+#define LCB_CNTL_KV_INFLIGHT_BYTES_MAX 0x8c
+
+/**
+ * @brief Maximum number of KV operations in flight
+ *
+ * Like @ref LCB_CNTL_KV_INFLIGHT_BYTES_MAX, but limits the number of
+ * operations rather than their size. The default is `0`, which does not limit
+ * the operations in flight.
+ *
+ * Use `kv_inflight_ops_max` in the connection string.
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @volatile
+ */
+#define LCB_CNTL_KV_INFLIGHT_OPS_MAX 0x8d
+
+/**
+ * @brief Maximum number of bytes of KV operations in flight on one connection
+ *
+ * Like @ref LCB_CNTL_KV_INFLIGHT_BYTES_MAX, but applies to the operations of
+ * each data connection on its own, so that a single slow node cannot take the
+ * whole budget of the instance. The default is `0`, which does not limit the
+ * operations in flight.
+ *
+ * Use `kv_pipeline_inflight_bytes_max` in the connection string.
+ *
+ * @cntl_arg_both{lcb_SIZE*}
+ * @volatile
+ */
+#define LCB_CNTL_KV_PIPELINE_INFLIGHT_BYTES_MAX 0x8e
+
+/**
+ * @brief Maximum number of KV operations in flight on one connection
+ *
+ * Like @ref LCB_CNTL_KV_PIPELINE_INFLIGHT_BYTES_MAX, but limits the number of
+ * operations rather than their size. The default is `0`, which does not limit
+ * the operations in flight.
+ *
+ * Use `kv_pipeline_inflight_ops_max` in the connection string.
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @volatile
+ */
+#define LCB_CNTL_KV_PIPELINE_INFLIGHT_OPS_MAX 0x8f
+
+/**
+ * @brief Low watermark of the KV operations in flight, in percent of the limits
+ *
+ * Once operations have been rejected with @ref LCB_ERR_CLIENT_OVERLOADED, the
+ * overload callback (see lcb_set_overload_callback()) is invoked again when
+ * the operations in flight dropped below this share of each of the limits
+ * set with @ref LCB_CNTL_KV_INFLIGHT_BYTES_MAX and related settings. The
+ * default is `50`.
+ *
+ * Use `kv_inflight_low_watermark` in the connection string.
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @volatile
+ */
+#define LCB_CNTL_KV_INFLIGHT_LOW_WATERMARK 0x90
+
+/**
+ * @brief Fail requests to unhealthy nodes fast
+ *
+ * Enables a circuit breaker for each data connection and for each node of the
+ * query, search, analytics, view and management services. A breaker opens
+ * once enough of the recent requests to its endpoint timed out or failed
+ * because of the connection (see @ref LCB_CNTL_CIRCUIT_BREAKER_ERROR_THRESHOLD
+ * and @ref LCB_CNTL_CIRCUIT_BREAKER_VOLUME_THRESHOLD), which happens when a
+ * node stops answering while its socket stays open. While it is open:
+ *
+ * - key-value operations for the node fail right away with
+ *   @ref LCB_ERR_CIRCUIT_BREAKER_OPEN instead of waiting for the operation
+ *   timeout,
+ * - replica reads with @ref LCB_REPLICA_MODE_ANY try the other replicas first,
+ * - HTTP requests are sent to other nodes of the service, and fail with
+ *   @ref LCB_ERR_CIRCUIT_BREAKER_OPEN when no other node is available.
+ *
+ * After @ref LCB_CNTL_CIRCUIT_BREAKER_SLEEP_WINDOW a few requests are let
+ * through again, and the breaker closes as soon as one of them succeeds.
+ * The state of the breakers is part of the report of lcb_diag(), and the
+ * `circuit_breaker_opened` and `packets_rejected` fields of LCB_CNTL_METRICS
+ * count how often they opened and how many operations they failed.
+ *
+ * The default is disabled.
+ *
+ * Use `circuit_breaker` in the connection string.
+ *
+ * @cntl_arg_both{int* (as a boolean)}
+ * @volatile
+ */
+#define LCB_CNTL_CIRCUIT_BREAKER 0x91
+
+/**
+ * @brief Percentage of failed requests which opens a circuit breaker
+ *
+ * See @ref LCB_CNTL_CIRCUIT_BREAKER. The default is `50`.
+ *
+ * Use `circuit_breaker_error_threshold` in the connection string.
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @volatile
+ */
+#define LCB_CNTL_CIRCUIT_BREAKER_ERROR_THRESHOLD 0x92
+
+/**
+ * @brief Minimum number of requests within the rolling window for a circuit breaker to open
+ *
+ * See @ref LCB_CNTL_CIRCUIT_BREAKER. The default is `20`.
+ *
+ * Use `circuit_breaker_volume_threshold` in the connection string.
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @volatile
+ */
+#define LCB_CNTL_CIRCUIT_BREAKER_VOLUME_THRESHOLD 0x93
+
+/**
+ * @brief How long an open circuit breaker rejects all requests
+ *
+ * See @ref LCB_CNTL_CIRCUIT_BREAKER. The default is 5 seconds.
+ *
+ * Use `circuit_breaker_sleep_window` in the connection string.
+ *
+ * @cntl_arg_both{lcb_U32* (microseconds)}
+ * @volatile
+ */
+#define LCB_CNTL_CIRCUIT_BREAKER_SLEEP_WINDOW 0x94
+
+/**
+ * @brief Period over which the failed requests are counted by a circuit breaker
+ *
+ * See @ref LCB_CNTL_CIRCUIT_BREAKER. The default is 1 minute.
+ *
+ * Use `circuit_breaker_rolling_window` in the connection string.
+ *
+ * @cntl_arg_both{lcb_U32* (microseconds)}
+ * @volatile
+ */
+#define LCB_CNTL_CIRCUIT_BREAKER_ROLLING_WINDOW 0x95
+
+/**
+ * @brief Number of events kept by the flight recorder
+ *
+ * The flight recorder keeps the latest events of the instance in a ring of
+ * compact records, for the post-mortem of latency incidents: packets
+ * scheduled, written, completed, failed and retried, cluster maps applied,
+ * and the connections to the servers opened, negotiated, failed and closed.
+ * Each event takes 24 bytes.
+ *
+ * The events are written by lcb_dump() with LCB_DUMP_FLIGHTREC, or by
+ * lcb_dump_flight_recorder(), which may be called from a signal handler.
+ *
+ * The default is `4096`. `0` disables the recorder.
+ *
+ * Use `flight_recorder_size` in the connection string.
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @volatile
+ */
+#define LCB_CNTL_FLIGHT_RECORDER_SIZE 0x96
+
+/**
+ * @brief Number of finished spans buffered by the OTLP exporter
+ *
+ * Spans reported to a tracer created with lcbtrace_otlp_new() are copied into
+ * a bounded buffer, which the export thread drains. Spans finished while the
+ * buffer is full are dropped and counted, see lcbtrace_otlp_stats(), so that
+ * a slow collector never delays the operations.
+ *
+ * Read when the tracer is created. The default is `2048`.
+ *
+ * Use `tracing_export_queue_size` in the connection string.
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @volatile
+ */
+#define LCB_CNTL_TRACING_EXPORT_QUEUE_SIZE 0x97
+
+/**
+ * @brief Maximum number of spans in one export of the OTLP exporter
+ *
+ * The export thread wakes up as soon as this many spans are buffered. Read
+ * when the tracer is created. The default is `512`.
+ *
+ * Use `tracing_export_batch_size` in the connection string.
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @volatile
+ */
+#define LCB_CNTL_TRACING_EXPORT_BATCH_SIZE 0x98
+
+/**
+ * @brief Maximum time a span waits in the buffer of the OTLP exporter
+ *
+ * Partial batches are exported at this interval. Read when the tracer is
+ * created. The default is `5` seconds.
+ *
+ * Use `tracing_export_interval` in the connection string.
+ *
+ * @cntl_arg_both{lcb_U32* (microseconds)}
+ * @volatile
+ */
+#define LCB_CNTL_TRACING_EXPORT_INTERVAL 0x99
+
+/**
+ * @brief Collect the kernel statistics of the KV sockets
+ *
+ * Has the kernel timestamp the data of the KV sockets (`SO_TIMESTAMPING`),
+ * to tell how long the replies waited in the socket before being read
+ * (`rx_kernel_us` of the lcb_IOMETRICS of the server), and how long the
+ * requests waited after being written before being handed to the network
+ * device (`tx_kernel_us`). The bytes in the kernel send queue are sampled
+ * after each write (`send_queue_bytes`). Subtracting these from the latency
+ * of an operation leaves the time spent on the network and by the server.
+ *
+ * This costs one or two more system calls for each read and write, and only
+ * applies to the connections made afterwards, on Linux, with event-based
+ * plugins and without TLS. The metrics must be enabled, see `metrics`.
+ *
+ * The default is `false`.
+ *
+ * Use `kernel_io_stats` in the connection string.
+ *
+ * @cntl_arg_both{int* (as boolean)}
+ * @volatile
+ */
+#define LCB_CNTL_KERNEL_IO_STATS 0x9A
+
+/**
+ * @brief How long a data connection may read nothing while operations are pending
+ *
+ * A connection to a node which went away without closing it (power loss,
+ * network partition) stays open until its operations time out one by one,
+ * or until TCP gives up on it. With this setting, once a data connection has
+ * operations waiting for their replies but has read nothing for this long, a
+ * NOOP is sent through it. If nothing is read for this long again, the
+ * connection is closed and a new one is opened: the operations which were
+ * not written yet are sent again on the new connection, and those which
+ * were written fail with @ref LCB_ERR_NETWORK, for the retry strategy to
+ * decide on. The `idle_probes` and `idle_reconnects` fields of
+ * LCB_CNTL_METRICS count how often this happened.
+ *
+ * A dead connection is thus detected within two to three times this value.
+ * It should be longer than the slowest expected operation, and shorter than
+ * the operation timeout. Only applies to the connections made afterwards.
+ *
+ * The default is `0`, which disables the detection.
+ *
+ * Use `kv_idle_timeout` in the connection string.
+ *
+ * @cntl_arg_both{lcb_U32* (microseconds)}
+ * @see LCB_CNTL_TCP_USER_TIMEOUT
+ * @volatile
+ */
+#define LCB_CNTL_KV_IDLE_TIMEOUT 0x9B
+
+/**
+ * @brief How long the written data may stay unacknowledged before TCP closes the connection
+ *
+ * Sets `TCP_USER_TIMEOUT` on the sockets, so that the kernel closes a
+ * connection whose peer stopped acknowledging the data, instead of
+ * retransmitting it for up to about 15 minutes. Linux only, rounded to
+ * milliseconds, and only applies to the connections made afterwards.
+ *
+ * The default is `0`, which leaves the system default.
+ *
+ * Use `tcp_user_timeout` in the connection string.
+ *
+ * @cntl_arg_both{lcb_U32* (microseconds)}
+ * @volatile
+ */
+#define LCB_CNTL_TCP_USER_TIMEOUT 0x9C
+
+/**
+ * @brief Number of nodes asked for the cluster map at once during the bootstrap
+ *
+ * While the library has no configuration yet, the CCCP provider connects to
+ * this many nodes of the connection string at once, instead of waiting up to
+ * @ref LCB_CNTL_CONFIG_NODE_TIMEOUT for each of them in turn. The first
+ * configuration received is used, and the other requests are cancelled, so
+ * that an unreachable first node does not delay the bootstrap. The later
+ * configuration updates still use one node at a time.
+ *
+ * The default is `1`, i.e. the nodes are tried one after another.
+ *
+ * Use `bootstrap_parallelism` in the connection string.
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @volatile
+ */
+#define LCB_CNTL_BOOTSTRAP_PARALLELISM 0x9D
+
+/**
+ * Makes lcb_destroy() and lcb_destroy_async() return in bounded time.
+ *
+ * The pending commands are failed at once with @ref LCB_ERR_REQUEST_CANCELED
+ * rather than waiting for their sockets to drain, and the connections are
+ * reset (`SO_LINGER` with a zero timeout) instead of lingering to flush
+ * unsent data. The event loop is not run even if @ref LCB_CNTL_SYNCDESTROY
+ * is enabled, so with lcb_destroy_async() the destroy callback may still be
+ * invoked once the I/O plugin has released the closed sockets.
+ *
+ * Use `fast_dtor` in the connection string.
+ *
+ * @cntl_arg_both{`int*` (as a boolean)}
+ * @volatile
+ */
+#define LCB_CNTL_FASTDESTROY 0x9E
+
+/**
+ * Ask for compressed responses to query, search and analytics requests.
+ *
+ * The requests offer `Accept-Encoding: gzip, deflate`, and the bodies which
+ * come back compressed are decompressed as they are read, before reaching
+ * the row parsers or the HTTP callback. This trades some CPU for a large
+ * cut in the bytes of big JSON results over slow or metered links. The
+ * `http_bytes_compressed` and `http_bytes_decompressed` fields of
+ * LCB_CNTL_METRICS count the bytes on either side. Requests which set
+ * `Accept-Encoding` themselves receive the body as it was sent.
+ *
+ * Has no effect if the library was built with `LCB_NO_HTTP_COMPRESSION`, or
+ * without zlib.
+ *
+ * The default is `false`.
+ *
+ * Use `http_compression` in the connection string.
+ *
+ * @cntl_arg_both{`int*` (as a boolean)}
+ * @volatile
+ */
+#define LCB_CNTL_HTTP_COMPRESSION 0x9F
+
+/**
+ * @brief Number of hot keys reported
+ *
+ * Tracks the keys, vBuckets and servers the KV operations of the instance
+ * access most, so that a key saturating the node of its vBucket is noticed
+ * on the client. The keys are counted per collection with the SpaceSaving
+ * algorithm, in 8 counters per key reported: memory stays bounded by the
+ * number of counters, and each operation costs a hash lookup and a heap
+ * update. Counts are halved every 65536 operations, so that they follow the
+ * recent traffic.
+ *
+ * The report is part of the JSON of lcb_diag(), under `hot_keys`: the hottest
+ * keys with their estimated accesses (at most `error` above the real ones),
+ * the hottest vBuckets, the accesses of each server, and the `skew`, i.e. the
+ * accesses of the busiest server in percent of the mean. If operation metrics
+ * are enabled (see LCB_CNTL_ENABLE_OP_METRICS), the same values are passed to
+ * the meter at the end of each window, as `db.couchbase.kv.hot_key`,
+ * `db.couchbase.kv.hot_vbucket` and `db.couchbase.kv.node_skew`. Note that the
+ * hot keys become tags of the meter.
+ *
+ * The default is `0`, which disables the tracker.
+ *
+ * Use `hot_keys` in the connection string.
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @volatile
+ */
+#define LCB_CNTL_HOT_KEYS 0xA0
+
+/**
+ * @brief Interval of the idle trims, in microseconds
+ *
+ * After a burst of operations the buffers of the pipelines, the segments kept
+ * by the read allocators and the idle pooled connections stay allocated, so
+ * that a brief spike leaves the process at its peak memory usage. When set,
+ * every interval the library frees what was left over by a burst:
+ *
+ * - the idle buffer blocks of each pipeline beyond the first one
+ * - the pooled read segments beyond 64KB, per connection (or in the shared
+ *   pool of LCB_CNTL_READ_POOL_SIZE)
+ * - the idle connections of the HTTP and KV pools beyond the number kept
+ *   open for their host
+ *
+ * Each of them is only trimmed once it was not used for a full interval, so
+ * that steady traffic keeps its buffers and connections. The bytes and
+ * connections freed are counted in `bytes_trimmed` and `sockets_trimmed` of
+ * LCB_CNTL_METRICS, and the blocks freed of each pipeline are part of
+ * lcb_dump(). If operation metrics are enabled (see
+ * LCB_CNTL_ENABLE_OP_METRICS), the bytes held by the idle buffers and the
+ * bytes freed are passed to the meter on every trim, as
+ * `db.couchbase.memory.idle` and `db.couchbase.memory.trimmed`.
+ *
+ * The default is 0, which disables the trims.
+ *
+ * Use `idle_trim_interval` in the connection string.
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @volatile
+ */
+#define LCB_CNTL_IDLE_TRIM_INTERVAL 0xA1
+
+/**
+ * @brief How long coalesced upserts are held back, in microseconds
+ *
+ * Upserts flagged with lcb_cmdstore_coalesce() wait this long before they are
+ * sent, and later upserts of the same key replace them in the meantime.
+ * Longer windows save more writes of frequently updated keys, at the cost of
+ * delaying each of them by up to the window.
+ *
+ * The default is `0`, which only coalesces the upserts scheduled before the
+ * library returns to the event loop, e.g. those of a single batch.
+ *
+ * Use `write_coalesce_window` in the connection string.
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @volatile
+ */
+#define LCB_CNTL_WRITE_COALESCE_WINDOW 0xA2
+
+/**
+ * @brief Longest interval between background configuration polls, in microseconds
+ *
+ * When set above @ref LCB_CNTL_CONFIG_POLL_INTERVAL, the interval adapts to
+ * how often the cluster topology changes. While every node notifies the
+ * configuration changes by itself, the interval doubles after each poll which
+ * found nothing new, up to this value. It drops back to
+ * @ref LCB_CNTL_CONFIG_POLL_INTERVAL as soon as a new configuration arrives or
+ * a response hints at an outdated one (e.g. NOT_MY_VBUCKET). The polls are
+ * also spread by up to 10% so that instances started together do not poll
+ * the cluster at the same time.
+ *
+ * The default is `0`, which polls at the fixed @ref LCB_CNTL_CONFIG_POLL_INTERVAL.
+ *
+ * Use `config_poll_max_interval` in the connection string.
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @volatile
+ */
+#define LCB_CNTL_CONFIG_POLL_MAX_INTERVAL 0xA3
+
 /**
  * This is not a command, but rather an indicator of the last item.
  * @internal
  */
-#define LCB_CNTL__MAX 0x68
+#define LCB_CNTL__MAX 0xA4
 /**@}*/
 
 #ifdef __cplusplus
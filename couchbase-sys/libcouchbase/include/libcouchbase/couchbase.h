@@ -317,6 +317,45 @@ LIBCOUCHBASE_API lcb_STATUS lcb_createopts_tracer(lcb_CREATEOPTS *options, lcbtr
 LIBCOUCHBASE_API
 lcb_STATUS lcb_create(lcb_INSTANCE **instance, const lcb_CREATEOPTS *options);
 
+/**
+ * @brief Create an instance like another one, without repeating its expensive setup
+ *
+ * The new instance is created from the connection string and the credentials
+ * of the template, as they were when the template was created. Instead of
+ * being built again, these parts are taken from the template:
+ *
+ * - the TLS context, so the certificates and the trust store are not
+ *   loaded again
+ * - the hosts found through DNS SRV
+ * - the error map downloaded so far
+ * - the collection IDs resolved so far, if both instances use the same bucket
+ *
+ * These parts are copied. The two instances share no mutable state, so they
+ * may be used from different threads. The template must not be in use while
+ * it is being copied.
+ *
+ * Settings changed with lcb_cntl() on the template after it was created are
+ * not carried over.
+ *
+ * @param[out] instance Where the new instance is stored
+ * @param tmpl The instance to start from, which may or may not be connected
+ * @param options Optional. Only the I/O plugin, the bucket, the authenticator,
+ *        the tracer and the meter are used; the other options come from the
+ *        template.
+ * @return LCB_SUCCESS on success
+ *
+ * @code{.c}
+ * lcb_INSTANCE *shards[16];
+ * lcb_create(&shards[0], options);
+ * for (ii = 1; ii < 16; ii++) {
+ *     lcb_create_from_template(&shards[ii], shards[0], NULL);
+ * }
+ * @endcode
+ * @uncommitted
+ */
+LIBCOUCHBASE_API
+lcb_STATUS lcb_create_from_template(lcb_INSTANCE **instance, const lcb_INSTANCE *tmpl, const lcb_CREATEOPTS *options);
+
 /**
  * @brief Schedule the initial connection
  * This function will schedule the initial connection for the handle. This
@@ -492,6 +531,7 @@ typedef enum {
     LCB_CALLBACK_COLLECTIONS_GET_MANIFEST, /**< lcb_getmanifest() */
     LCB_CALLBACK_GETCID,                   /**< lcb_getcid() */
     LCB_CALLBACK_EXISTS,                   /**< lcb_exists() */
+    LCB_CALLBACK_RANGESCAN,                /**< lcb_range_scan() */
     LCB_CALLBACK__MAX                      /* Number of callbacks */
 } lcb_CALLBACK_TYPE;
 
@@ -592,6 +632,159 @@ lcb_RESPCALLBACK lcb_install_callback(lcb_INSTANCE *instance, int cbtype, lcb_RE
 LIBCOUCHBASE_API
 lcb_RESPCALLBACK lcb_get_callback(lcb_INSTANCE *instance, int cbtype);
 
+/**
+ * @uncommitted
+ *
+ * Callback which provides the buffer a compressed value is inflated into.
+ *
+ * By default, values of get and get-replica responses which arrive compressed
+ * are inflated into a buffer owned by the library, which is only valid until
+ * the operation callback returns. If this callback is installed, it is asked
+ * for the destination buffer first, so that the value can be inflated straight
+ * into memory owned by the application (and kept after the callback).
+ *
+ * @param instance the handle
+ * @param cookie the cookie of the operation
+ * @param nbytes the size of the inflated value
+ * @return a buffer of at least `nbytes` bytes, which the library never frees.
+ * The value of the response points to it if the value could be inflated.
+ * Return `NULL` to use the buffer of the library instead.
+ */
+typedef void *(*lcb_inflate_callback)(lcb_INSTANCE *instance, void *cookie, size_t nbytes);
+
+/**
+ * @uncommitted
+ *
+ * Install the callback which provides buffers for inflated values.
+ * @param instance the handle
+ * @param callback the new callback, or `NULL` to only query the current one
+ * @return the previous callback
+ */
+LIBCOUCHBASE_API
+lcb_inflate_callback lcb_set_inflate_callback(lcb_INSTANCE *instance, lcb_inflate_callback callback);
+
+/**
+ * @uncommitted
+ *
+ * Callback notified when the budget for KV operations in flight is exhausted
+ * and when it is available again, see @ref LCB_CNTL_KV_INFLIGHT_BYTES_MAX.
+ *
+ * @param instance the handle
+ * @param overloaded non-zero when an operation was rejected with
+ * @ref LCB_ERR_CLIENT_OVERLOADED for the first time (high watermark), zero
+ * once the operations in flight dropped below @ref LCB_CNTL_KV_INFLIGHT_LOW_WATERMARK
+ * of the limits (low watermark).
+ */
+typedef void (*lcb_overload_callback)(lcb_INSTANCE *instance, int overloaded);
+
+/**
+ * @uncommitted
+ *
+ * Install the callback for the budget of KV operations in flight.
+ * @param instance the handle
+ * @param callback the new callback, or `NULL` to only query the current one
+ * @return the previous callback
+ */
+LIBCOUCHBASE_API
+lcb_overload_callback lcb_set_overload_callback(lcb_INSTANCE *instance, lcb_overload_callback callback);
+
+/**
+ * @uncommitted
+ *
+ * Callback which receives the value of a get scheduled with
+ * lcb_cmdget_stream_value() piece by piece, as it is read from the socket.
+ *
+ * This avoids buffering very large documents whole, in the library and then
+ * in the application: each chunk is only valid until the callback returns.
+ * The chunks arrive in order, and once the last one was passed the get
+ * callback is invoked as usual, with an empty value. Values which arrive
+ * compressed are passed inflated, in a single chunk.
+ *
+ * If the get fails, which may happen after some chunks were passed (e.g. if
+ * the connection is lost), the get callback reports the error and the chunks
+ * received so far should be discarded.
+ *
+ * @param instance the handle
+ * @param cookie the cookie of the operation
+ * @param chunk the next bytes of the value
+ * @param nchunk the number of bytes
+ */
+typedef void (*lcb_value_sink_callback)(lcb_INSTANCE *instance, void *cookie, const char *chunk, size_t nchunk);
+
+/**
+ * @uncommitted
+ *
+ * Install the callback receiving the values streamed by lcb_cmdget_stream_value().
+ * @param instance the handle
+ * @param callback the new callback, or `NULL` to only query the current one
+ * @return the previous callback
+ */
+LIBCOUCHBASE_API
+lcb_value_sink_callback lcb_set_value_sink_callback(lcb_INSTANCE *instance, lcb_value_sink_callback callback);
+
+/**
+ * @uncommitted
+ *
+ * Responses gathered while one read from a socket was processed, see
+ * lcb_set_batch_callback().
+ */
+typedef struct lcb_RESPBATCH_ lcb_RESPBATCH;
+
+/**
+ * @uncommitted
+ *
+ * Callback which receives the responses read from a socket at once, instead
+ * of one operation callback per response.
+ *
+ * Once installed, the successful get, store, remove, touch and unlock
+ * responses found in a read buffer are collected, and passed to this callback
+ * together after the whole buffer was processed. This saves the per-response
+ * work of the application (e.g. waking up whoever waits for the results) when
+ * many responses arrive in the same read. Failed operations, responses of
+ * other types, values which had to be inflated and operations completed
+ * outside of a read (e.g. timeouts) are still passed to the operation
+ * callbacks, with their full error context.
+ *
+ * The batch and the values of its responses are only valid until the callback
+ * returns, use lcb_respbatch_backbuf() to keep a value.
+ *
+ * @param instance the handle
+ * @param batch the responses, in the order they were read
+ */
+typedef void (*lcb_batch_callback)(lcb_INSTANCE *instance, const lcb_RESPBATCH *batch);
+
+/**
+ * @uncommitted
+ *
+ * Install the callback receiving batches of responses.
+ * @param instance the handle
+ * @param callback the new callback, or `NULL` to only query the current one
+ * @return the previous callback
+ */
+LIBCOUCHBASE_API
+lcb_batch_callback lcb_set_batch_callback(lcb_INSTANCE *instance, lcb_batch_callback callback);
+
+/** @uncommitted @return the number of responses in the batch */
+LIBCOUCHBASE_API size_t lcb_respbatch_size(const lcb_RESPBATCH *batch);
+/**
+ * @uncommitted
+ * The accessors of the responses in a batch take the index of the response,
+ * and return LCB_ERR_INVALID_ARGUMENT if it is out of range.
+ * @param[out] type the operation of the response, e.g. @ref LCB_CALLBACK_GET
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_respbatch_type(const lcb_RESPBATCH *batch, size_t index, lcb_CALLBACK_TYPE *type);
+LIBCOUCHBASE_API lcb_STATUS lcb_respbatch_cookie(const lcb_RESPBATCH *batch, size_t index, void **cookie);
+LIBCOUCHBASE_API lcb_STATUS lcb_respbatch_cas(const lcb_RESPBATCH *batch, size_t index, uint64_t *cas);
+/** @uncommitted The value of a get, empty for the other operations */
+LIBCOUCHBASE_API lcb_STATUS lcb_respbatch_value(const lcb_RESPBATCH *batch, size_t index, const char **value,
+                                                size_t *value_len);
+/** @uncommitted The flags of the document of a get, zero for the other operations */
+LIBCOUCHBASE_API lcb_STATUS lcb_respbatch_flags(const lcb_RESPBATCH *batch, size_t index, uint32_t *flags);
+LIBCOUCHBASE_API lcb_STATUS lcb_respbatch_datatype(const lcb_RESPBATCH *batch, size_t index, uint8_t *datatype);
+/** @uncommitted The mutation token of a store, remove or touch, if the server returned one */
+LIBCOUCHBASE_API lcb_STATUS lcb_respbatch_mutation_token(const lcb_RESPBATCH *batch, size_t index,
+                                                         lcb_MUTATION_TOKEN *token);
+
 /**
  * Returns the type of the callback as a string.
  * This function is helpful for debugging and demonstrative processes.
@@ -694,6 +887,13 @@ LIBCOUCHBASE_API lcb_STATUS lcb_respget_datatype(const lcb_RESPGET *resp, uint8_
 LIBCOUCHBASE_API lcb_STATUS lcb_respget_flags(const lcb_RESPGET *resp, uint32_t *flags);
 LIBCOUCHBASE_API lcb_STATUS lcb_respget_key(const lcb_RESPGET *resp, const char **key, size_t *key_len);
 LIBCOUCHBASE_API lcb_STATUS lcb_respget_value(const lcb_RESPGET *resp, const char **value, size_t *value_len);
+/**
+ * @volatile
+ *
+ * @return nonzero if the value of a get scheduled with lcb_cmdget_hedge() was
+ * read from a replica, and thus may not reflect the latest mutation
+ */
+LIBCOUCHBASE_API int lcb_respget_is_replica(const lcb_RESPGET *resp);
 
 typedef struct lcb_CMDGET_ lcb_CMDGET;
 
@@ -706,6 +906,67 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdget_key(lcb_CMDGET *cmd, const char *key, siz
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdget_expiry(lcb_CMDGET *cmd, uint32_t expiration);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdget_locktime(lcb_CMDGET *cmd, uint32_t duration);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdget_timeout(lcb_CMDGET *cmd, uint32_t timeout);
+/**
+ * @volatile
+ *
+ * @brief Read from the replicas if the active node is slow to reply
+ *
+ * The get is sent to the active node only. If it has not replied within
+ * `delay` microseconds, the key is also read from every replica, and the
+ * first value to arrive is passed to the callback (see lcb_respget_is_replica()).
+ * Replies which arrive after that are dropped. Errors of the replicas are
+ * only reported if the active node fails as well.
+ *
+ * With a `delay` of 0 the 95th percentile of the latencies of recent gets of
+ * the instance is used, so that only the slowest gets cause replica reads.
+ *
+ * Cannot be combined with lcb_cmdget_expiry() or lcb_cmdget_locktime(). Buckets
+ * without replicas read from the active node only.
+ *
+ * @param cmd the command
+ * @param delay microseconds to wait for the active node, or 0
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdget_hedge(lcb_CMDGET *cmd, uint32_t delay);
+/**
+ * @volatile
+ *
+ * @brief Accept a recently read value from the near cache
+ *
+ * If the near cache is enabled (see LCB_CNTL_NEAR_CACHE_SIZE) and holds the
+ * document, the callback is invoked with the cached value from the event loop,
+ * without contacting the cluster. Otherwise the get is sent as usual, and
+ * its value is cached for later gets. Likewise, keys recently found missing
+ * fail with @ref LCB_ERR_DOCUMENT_NOT_FOUND right away if the near cache
+ * remembers them, see LCB_CNTL_NEGATIVE_CACHE_SIZE.
+ *
+ * The value may be stale by up to LCB_CNTL_NEAR_CACHE_TTL if the document
+ * is mutated by another client. Mutations through the same instance drop it
+ * from the cache. Ignored if combined with lcb_cmdget_expiry() or
+ * lcb_cmdget_locktime().
+ *
+ * @param cmd the command
+ * @param enable nonzero to read from the near cache
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdget_near_cache(lcb_CMDGET *cmd, int enable);
+/**
+ * @uncommitted
+ *
+ * @brief Pass the value to the value sink as it is read
+ *
+ * The value is handed to the callback installed with
+ * lcb_set_value_sink_callback() in chunks, without being buffered whole, and
+ * the get callback receives an empty value. Meant for very large documents.
+ * Without a value sink, the value is returned by the get callback as usual.
+ * How much of the value may be buffered before it is passed on is bounded
+ * by @ref LCB_CNTL_READ_CHUNKSIZE.
+ *
+ * Excludes the near cache (lcb_cmdget_near_cache()), the coalescing of gets
+ * and the reads from the replicas (lcb_cmdget_hedge()).
+ *
+ * @param cmd the command
+ * @param enable nonzero to stream the value
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdget_stream_value(lcb_CMDGET *cmd, int enable);
 /**
  * @internal Internal: This should never be used and is not supported.
  */
@@ -717,6 +978,32 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdget_on_behalf_of_extra_privilege(lcb_CMDGET *
                                                                     size_t privilege_len);
 
 LIBCOUCHBASE_API lcb_STATUS lcb_get(lcb_INSTANCE *instance, void *cookie, const lcb_CMDGET *cmd);
+
+/**
+ * Invoked once every command of a multi-key operation has completed, after the
+ * last per-key callback.
+ *
+ * @param instance the handle to lcb
+ * @param cookie the cookie passed to the multi-key operation
+ * @param nsuccess the number of commands which succeeded
+ * @param nfailure the number of commands which failed
+ * @param first_error the status of the first command which failed, or LCB_SUCCESS
+ */
+typedef void (*lcb_MULTI_CALLBACK)(lcb_INSTANCE *instance, void *cookie, size_t nsuccess, size_t nfailure,
+                                   lcb_STATUS first_error);
+
+/**
+ * @uncommitted
+ * Schedule several get commands at once, see lcb_counter_multi(). The
+ * commands complete through the LCB_CALLBACK_GET callback.
+ *
+ * This suits get-and-touch (see lcb_cmdget_expiry()) of the few documents a
+ * request of a session store reads, see also LCB_CNTL_TOUCH_SKIP_WINDOW. The
+ * near cache (lcb_cmdget_near_cache()) and coalescing of gets do not apply to
+ * the commands.
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_get_multi(lcb_INSTANCE *instance, void *cookie, const lcb_CMDGET *const *cmds,
+                                          void *const *cookies, size_t ncmds, lcb_MULTI_CALLBACK callback);
 /**@}*/
 
 /**
@@ -790,6 +1077,22 @@ typedef enum {
     LCB_REPLICA_MODE_IDX0 = 0x02,
     LCB_REPLICA_MODE_IDX1 = 0x03,
     LCB_REPLICA_MODE_IDX2 = 0x04,
+    /**
+     * Read the active copy and all replicas at once, and return the copy with
+     * the highest CAS in a single (final) response. The command completes as
+     * soon as a copy has at least the CAS of lcb_cmdgetreplica_min_cas(), or
+     * once lcb_cmdgetreplica_quorum() copies were read, without waiting for
+     * the slower nodes. Offline replicas are skipped.
+     */
+    LCB_REPLICA_MODE_FRESHEST = 0x05,
+    /**
+     * Read a single copy, from whichever of the active node and the online
+     * replicas is expected to answer first: the one with the lowest moving
+     * average of read latencies times the number of requests waiting for it.
+     * Meant for reads which tolerate stale data and should stay away from
+     * busy nodes.
+     */
+    LCB_REPLICA_MODE_FASTEST = 0x06,
     LCB_REPLICA_MODE__MAX
 } lcb_REPLICA_MODE;
 
@@ -817,6 +1120,18 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdgetreplica_collection(lcb_CMDGETREPLICA *cmd,
                                                          const char *collection, size_t collection_len);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdgetreplica_key(lcb_CMDGETREPLICA *cmd, const char *key, size_t key_len);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdgetreplica_timeout(lcb_CMDGETREPLICA *cmd, uint32_t timeout);
+/**
+ * For LCB_REPLICA_MODE_FRESHEST, complete the command as soon as a copy has
+ * at least this CAS, e.g. the one returned by a mutation the application
+ * wants to read back. Zero (the default) only uses the quorum.
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdgetreplica_min_cas(lcb_CMDGETREPLICA *cmd, uint64_t cas);
+/**
+ * For LCB_REPLICA_MODE_FRESHEST, the number of copies which are read before
+ * the one with the highest CAS is returned. Zero (the default) stands for a
+ * majority of the copies which were asked.
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdgetreplica_quorum(lcb_CMDGETREPLICA *cmd, uint32_t quorum);
 /**
  * @internal Internal: This should never be used and is not supported.
  */
@@ -849,6 +1164,21 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdexists_collection(lcb_CMDEXISTS *cmd, const c
                                                      const char *collection, size_t collection_len);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdexists_key(lcb_CMDEXISTS *cmd, const char *key, size_t key_len);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdexists_timeout(lcb_CMDEXISTS *cmd, uint32_t timeout);
+/**
+ * @volatile
+ *
+ * @brief Accept that a recently missing key is still missing
+ *
+ * If the near cache remembers missing keys (see LCB_CNTL_NEGATIVE_CACHE_SIZE)
+ * and the key was found missing recently, the callback is invoked with
+ * @ref LCB_ERR_DOCUMENT_NOT_FOUND from the event loop, without contacting the
+ * cluster. Otherwise the check is sent as usual, and the key is remembered if
+ * it is missing.
+ *
+ * @param cmd the command
+ * @param enable nonzero to accept answers of the near cache
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdexists_near_cache(lcb_CMDEXISTS *cmd, int enable);
 /**
  * @internal Internal: This should never be used and is not supported.
  */
@@ -861,6 +1191,112 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdexists_on_behalf_of_extra_privilege(lcb_CMDEX
 
 LIBCOUCHBASE_API lcb_STATUS lcb_exists(lcb_INSTANCE *instance, void *cookie, const lcb_CMDEXISTS *cmd);
 
+/**
+ * @ingroup lcb-kv-api
+ * @defgroup lcb-range-scan Range Scan
+ * @brief Read every document of a collection over the KV protocol
+ * @addtogroup lcb-range-scan
+ * @{
+ */
+
+/**
+ * @uncommitted
+ * @brief Scan a range of keys of a collection
+ *
+ * The scan runs on every vBucket of the bucket, using the range scan commands
+ * of the data service (Couchbase Server 7.2 and newer). Each node runs at most
+ * lcb_cmdrangescan_concurrency() vBucket scans at a time, and starts the scan
+ * of its next vBucket as soon as one completes.
+ *
+ * The documents are passed to the ::LCB_CALLBACK_RANGESCAN callback in
+ * batches, as the nodes return them. The items of a response are only valid
+ * within the callback. After the last batch the callback is invoked once more
+ * with lcb_resprangescan_is_final() set, and the status of the whole scan: if
+ * the scan of a vBucket fails, the scan does not start any other vBucket, and
+ * reports the first error there.
+ *
+ * By default the whole collection is scanned, lcb_cmdrangescan_range() limits
+ * the scan to the keys between two terms (both inclusive).
+ *
+ * @par Request
+ * @code{.c}
+ * lcb_CMDRANGESCAN *cmd;
+ * lcb_cmdrangescan_create(&cmd);
+ * lcb_cmdrangescan_collection(cmd, "inventory", strlen("inventory"), "airline", strlen("airline"));
+ * lcb_range_scan(instance, cookie, cmd);
+ * lcb_cmdrangescan_destroy(cmd);
+ * @endcode
+ *
+ * @par Response
+ * @code{.c}
+ * lcb_install_callback(instance, LCB_CALLBACK_RANGESCAN, scan_callback);
+ * void scan_callback(lcb_INSTANCE *instance, int cbtype, const lcb_RESPBASE *rb)
+ * {
+ *     const lcb_RESPRANGESCAN *resp = (const lcb_RESPRANGESCAN *)rb;
+ *     size_t ii;
+ *     for (ii = 0; ii < lcb_resprangescan_item_count(resp); ii++) {
+ *         const char *key, *value;
+ *         size_t nkey, nvalue;
+ *         lcb_resprangescan_item_key(resp, ii, &key, &nkey);
+ *         lcb_resprangescan_item_value(resp, ii, &value, &nvalue);
+ *     }
+ *     if (lcb_resprangescan_is_final(resp)) {
+ *         printf("Scan finished: %s\n", lcb_strerror_short(lcb_resprangescan_status(resp)));
+ *     }
+ * }
+ * @endcode
+ */
+typedef struct lcb_RESPRANGESCAN_ lcb_RESPRANGESCAN;
+
+LIBCOUCHBASE_API lcb_STATUS lcb_resprangescan_status(const lcb_RESPRANGESCAN *resp);
+LIBCOUCHBASE_API lcb_STATUS lcb_resprangescan_error_context(const lcb_RESPRANGESCAN *resp,
+                                                            const lcb_KEY_VALUE_ERROR_CONTEXT **ctx);
+LIBCOUCHBASE_API lcb_STATUS lcb_resprangescan_cookie(const lcb_RESPRANGESCAN *resp, void **cookie);
+/** @return nonzero for the last response of the scan, which has no items */
+LIBCOUCHBASE_API int lcb_resprangescan_is_final(const lcb_RESPRANGESCAN *resp);
+/** The vBucket which the items of the response belong to */
+LIBCOUCHBASE_API lcb_STATUS lcb_resprangescan_vbucket(const lcb_RESPRANGESCAN *resp, uint16_t *vbucket);
+LIBCOUCHBASE_API size_t lcb_resprangescan_item_count(const lcb_RESPRANGESCAN *resp);
+/* The accessors below return LCB_ERR_INVALID_ARGUMENT if `index` is out of range */
+LIBCOUCHBASE_API lcb_STATUS lcb_resprangescan_item_key(const lcb_RESPRANGESCAN *resp, size_t index, const char **key,
+                                                       size_t *key_len);
+/** The value is empty if the scan was for keys only, see lcb_cmdrangescan_key_only() */
+LIBCOUCHBASE_API lcb_STATUS lcb_resprangescan_item_value(const lcb_RESPRANGESCAN *resp, size_t index,
+                                                         const char **value, size_t *value_len);
+LIBCOUCHBASE_API lcb_STATUS lcb_resprangescan_item_cas(const lcb_RESPRANGESCAN *resp, size_t index, uint64_t *cas);
+LIBCOUCHBASE_API lcb_STATUS lcb_resprangescan_item_flags(const lcb_RESPRANGESCAN *resp, size_t index,
+                                                         uint32_t *flags);
+LIBCOUCHBASE_API lcb_STATUS lcb_resprangescan_item_expiry(const lcb_RESPRANGESCAN *resp, size_t index,
+                                                          uint32_t *expiry);
+LIBCOUCHBASE_API lcb_STATUS lcb_resprangescan_item_seqno(const lcb_RESPRANGESCAN *resp, size_t index,
+                                                         uint64_t *seqno);
+LIBCOUCHBASE_API lcb_STATUS lcb_resprangescan_item_datatype(const lcb_RESPRANGESCAN *resp, size_t index,
+                                                            uint8_t *datatype);
+
+typedef struct lcb_CMDRANGESCAN_ lcb_CMDRANGESCAN;
+
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdrangescan_create(lcb_CMDRANGESCAN **cmd);
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdrangescan_destroy(lcb_CMDRANGESCAN *cmd);
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdrangescan_parent_span(lcb_CMDRANGESCAN *cmd, lcbtrace_SPAN *span);
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdrangescan_collection(lcb_CMDRANGESCAN *cmd, const char *scope, size_t scope_len,
+                                                        const char *collection, size_t collection_len);
+/** Scan the keys from `start` to `end`, both inclusive. Neither may be empty. */
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdrangescan_range(lcb_CMDRANGESCAN *cmd, const char *start, size_t start_len,
+                                                   const char *end, size_t end_len);
+/** Return only the keys of the documents (default: false) */
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdrangescan_key_only(lcb_CMDRANGESCAN *cmd, int key_only);
+/** Maximum number of vBuckets each node scans at a time (default: 2) */
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdrangescan_concurrency(lcb_CMDRANGESCAN *cmd, uint32_t concurrency);
+/** Maximum number of items a node returns at once for a vBucket (default: 50) */
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdrangescan_batch_item_limit(lcb_CMDRANGESCAN *cmd, uint32_t limit);
+/** Maximum number of bytes a node returns at once for a vBucket (default: 15000) */
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdrangescan_batch_byte_limit(lcb_CMDRANGESCAN *cmd, uint32_t limit);
+/** Timeout of each request of the scan, not of the scan as a whole */
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdrangescan_timeout(lcb_CMDRANGESCAN *cmd, uint32_t timeout);
+LIBCOUCHBASE_API lcb_STATUS lcb_range_scan(lcb_INSTANCE *instance, void *cookie, const lcb_CMDRANGESCAN *cmd);
+
+/**@} (Group: Range Scan) */
+
 /**
  * @ingroup lcb-kv-api
  * @defgroup lcb-store Create/Update
@@ -997,6 +1433,49 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_collection(lcb_CMDSTORE *cmd, const cha
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_key(lcb_CMDSTORE *cmd, const char *key, size_t key_len);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_value(lcb_CMDSTORE *cmd, const char *value, size_t value_len);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_value_iov(lcb_CMDSTORE *cmd, const lcb_IOV *value, size_t value_len);
+/**
+ * @volatile
+ *
+ * Set the value of the document without copying it.
+ *
+ * Unlike lcb_cmdstore_value_iov(), the buffers are written to the socket as
+ * they are. They are owned by the application and must stay valid (and
+ * unmodified) until the lcb_pktflushed_callback is invoked with the cookie
+ * of the operation, which happens exactly once for each successful
+ * lcb_store(), possibly before it returns. The IOV array itself is copied.
+ *
+ * @param cmd the command structure
+ * @param value the buffers the value consists of
+ * @param value_len the number of buffers
+ * @return LCB_ERR_INVALID_ARGUMENT if there are no buffers
+ * @see lcb_set_pktflushed_callback
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_value_iov_nocopy(lcb_CMDSTORE *cmd, const lcb_IOV *value, size_t value_len);
+/**
+ * @volatile
+ *
+ * Set the value of the document to a region of a file, without reading it
+ * into memory first.
+ *
+ * The region is mapped read-only, and the pages are written to the socket
+ * from the mapping like the buffers of lcb_cmdstore_value_iov_nocopy(), so
+ * that large values do not have to be staged on the heap. The mapping is
+ * held by the library and released once every packet using it has been
+ * flushed: the descriptor may be closed as soon as this function returns.
+ * The lcb_pktflushed_callback is invoked as for lcb_cmdstore_value_iov_nocopy(),
+ * there is nothing to release for the application though. The file must not
+ * be truncated while the value is being written.
+ *
+ * Only available on POSIX systems.
+ *
+ * @param cmd the command structure
+ * @param fd descriptor of a regular file, opened for reading
+ * @param offset offset of the value in the file
+ * @param length size of the value, which must not extend past the end of the file
+ * @return LCB_ERR_INVALID_ARGUMENT if the region is empty or cannot be mapped,
+ * LCB_ERR_SDK_FEATURE_UNAVAILABLE if files cannot be mapped on this platform
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_value_file(lcb_CMDSTORE *cmd, int fd, uint64_t offset, size_t length);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_expiry(lcb_CMDSTORE *cmd, uint32_t expiration);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_preserve_expiry(lcb_CMDSTORE *cmd, int should_preserve);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_cas(lcb_CMDSTORE *cmd, uint64_t cas);
@@ -1005,6 +1484,29 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_datatype(lcb_CMDSTORE *cmd, uint8_t dat
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_durability(lcb_CMDSTORE *cmd, lcb_DURABILITY_LEVEL level);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_durability_observe(lcb_CMDSTORE *cmd, int persist_to, int replicate_to);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_timeout(lcb_CMDSTORE *cmd, uint32_t timeout);
+/**
+ * @volatile
+ *
+ * @brief Let later upserts of the same key replace this one before it is sent
+ *
+ * The upsert is held back for LCB_CNTL_WRITE_COALESCE_WINDOW. Upserts of the
+ * same key with this flag which are scheduled in the meantime replace its
+ * value, so that only the last one is sent. Its reply, including the CAS of
+ * the final value, is passed to the callbacks of all of them. Meant for keys
+ * which are overwritten many times per second where only the latest value
+ * matters, such as presence or last-seen timestamps. See `upserts_coalesced`
+ * of LCB_CNTL_METRICS for how many writes were saved.
+ *
+ * Only applies to upserts without a CAS, lcb_cmdstore_durability() or
+ * lcb_cmdstore_durability_observe(). An upsert only replaces a held back one
+ * with the same options (timeout, expiry, flags, datatype, preserve expiry and
+ * impersonation), otherwise the held back one is sent right away. The timeout
+ * of the upserts counts from when the first of them was scheduled.
+ *
+ * @param cmd the command, which must be an upsert
+ * @param enable nonzero to coalesce the upsert
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_coalesce(lcb_CMDSTORE *cmd, int enable);
 /**
  * @internal Internal: This should never be used and is not supported.
  */
@@ -1015,6 +1517,75 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_on_behalf_of(lcb_CMDSTORE *cmd, const c
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_on_behalf_of_extra_privilege(lcb_CMDSTORE *cmd, const char *privilege,
                                                                       size_t privilege_len);
 LIBCOUCHBASE_API lcb_STATUS lcb_store(lcb_INSTANCE *instance, void *cookie, const lcb_CMDSTORE *cmd);
+
+/**
+ * A group of synchronously durable writes which are submitted together and
+ * share their durability level and deadline.
+ */
+typedef struct lcb_DURABLEBATCH_ lcb_DURABLEBATCH;
+
+/**
+ * Invoked once every write of the batch has completed, after the last store
+ * callback. The batch is freed once this returns.
+ *
+ * @param instance the handle to lcb
+ * @param cookie the cookie passed to lcb_durablebatch_submit()
+ * @param nsuccess the number of writes which succeeded
+ * @param nfailure the number of writes which failed
+ * @param first_error the status of the first write which failed, or LCB_SUCCESS
+ */
+typedef void (*lcb_DURABLEBATCH_CALLBACK)(lcb_INSTANCE *instance, void *cookie, size_t nsuccess, size_t nfailure,
+                                          lcb_STATUS first_error);
+
+/**
+ * @uncommitted
+ * Create a batch of durable writes.
+ *
+ * Every write added to the batch is sent with `level`, and all of them are
+ * scheduled with the same start time and timeout when the batch is submitted.
+ * The timeout (and therefore the durability timeout sent to the server) is
+ * checked against @ref LCB_CNTL_PERSISTENCE_TIMEOUT_FLOOR once for the batch
+ * instead of once per write.
+ *
+ * @param instance the handle to lcb, with @ref LCB_CNTL_ENABLE_DURABLE_WRITE set
+ * @param[out] batch the new batch
+ * @param level the durability level of all writes in the batch
+ * @param timeout the timeout of the batch in microseconds, or 0 for the operation timeout
+ * @return LCB_ERR_UNSUPPORTED_OPERATION if durable writes are not enabled
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_durablebatch_create(lcb_INSTANCE *instance, lcb_DURABLEBATCH **batch,
+                                                    lcb_DURABILITY_LEVEL level, uint32_t timeout);
+/**
+ * @uncommitted
+ * Destroy a batch which has not been submitted.
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_durablebatch_destroy(lcb_DURABLEBATCH *batch);
+/**
+ * @uncommitted
+ * Add a write to the batch. The command is copied, so it may be destroyed
+ * once this returns. Its durability level and timeout are replaced by those of
+ * the batch, and it must not request observe based durability.
+ *
+ * @param batch the batch
+ * @param cookie passed to the store callback of this write
+ * @param cmd the write
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_durablebatch_store(lcb_DURABLEBATCH *batch, void *cookie, const lcb_CMDSTORE *cmd);
+/**
+ * @uncommitted
+ * Schedule all writes of the batch.
+ *
+ * The store callback is invoked for each write as usual. Writes which cannot
+ * be scheduled are completed with their error right away, so once this
+ * returns LCB_SUCCESS the batch belongs to the library and `callback` is
+ * guaranteed to be invoked (possibly before this returns).
+ *
+ * @param batch the batch, which must contain at least one write
+ * @param cookie passed to `callback`
+ * @param callback invoked once all writes completed, may be NULL
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_durablebatch_submit(lcb_DURABLEBATCH *batch, void *cookie,
+                                                    lcb_DURABLEBATCH_CALLBACK callback);
 /**@}*/
 
 /**
@@ -1228,6 +1799,28 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdcounter_on_behalf_of_extra_privilege(lcb_CMDC
                                                                         size_t privilege_len);
 LIBCOUCHBASE_API lcb_STATUS lcb_counter(lcb_INSTANCE *instance, void *cookie, const lcb_CMDCOUNTER *cmd);
 
+/**
+ * @uncommitted
+ * Schedule several counter commands at once.
+ *
+ * The commands are ordered by the server they map to and scheduled within a
+ * single scheduling context, so each server pipeline gets its packets as one
+ * contiguous group and is flushed once. Every command completes through the
+ * LCB_CALLBACK_COUNTER callback with its cookie from `cookies` as usual;
+ * commands which cannot be scheduled are completed with their error right
+ * away. Once this returns LCB_SUCCESS, `callback` is guaranteed to be invoked
+ * (possibly before this returns).
+ *
+ * @param instance the handle to lcb
+ * @param cookie passed to `callback`
+ * @param cmds the commands, copied before this returns
+ * @param cookies the cookie of each command, may be NULL
+ * @param ncmds the number of commands, at least one
+ * @param callback invoked once all commands completed, may be NULL
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_counter_multi(lcb_INSTANCE *instance, void *cookie, const lcb_CMDCOUNTER *const *cmds,
+                                              void *const *cookies, size_t ncmds, lcb_MULTI_CALLBACK callback);
+
 /**@} (Group: Counter) */
 
 /* @ingroup lcb-kv-api
@@ -1389,6 +1982,13 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdtouch_on_behalf_of(lcb_CMDTOUCH *cmd, const c
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdtouch_on_behalf_of_extra_privilege(lcb_CMDTOUCH *cmd, const char *privilege,
                                                                       size_t privilege_len);
 LIBCOUCHBASE_API lcb_STATUS lcb_touch(lcb_INSTANCE *instance, void *cookie, const lcb_CMDTOUCH *cmd);
+/**
+ * @uncommitted
+ * Schedule several touch commands at once, see lcb_counter_multi(). The
+ * commands complete through the LCB_CALLBACK_TOUCH callback.
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_touch_multi(lcb_INSTANCE *instance, void *cookie, const lcb_CMDTOUCH *const *cmds,
+                                            void *const *cookies, size_t ncmds, lcb_MULTI_CALLBACK callback);
 
 /**@} (Group: Touch) */
 /**@} (Group: KV API) */
@@ -1471,6 +2071,40 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdping_encode_json(lcb_CMDPING *cmd, int enable
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdping_timeout(lcb_CMDPING *cmd, uint32_t timeout);
 LIBCOUCHBASE_API lcb_STATUS lcb_ping(lcb_INSTANCE *instance, void *cookie, const lcb_CMDPING *cmd);
 
+/**
+ * Health of a data node, as seen by the probes of its idle connection
+ * (see @ref LCB_CNTL_HEALTH_PROBE_INTERVAL).
+ */
+typedef struct {
+    /** Outcome of the last probe, LCB_PING_STATUS_INVALID if none completed yet */
+    lcb_PING_STATUS status;
+    /** Moving average of the round trip times (each new one weighs 1/8), in nanoseconds */
+    uint64_t rtt_ewma;
+    /** Round trip time of the last successful probe, in nanoseconds */
+    uint64_t last_rtt;
+    /** When the last probe completed, as returned by lcb_nstime() */
+    uint64_t last_probe;
+    /** Number of probes which completed */
+    uint32_t nprobes;
+    /** Number of probes which failed or timed out */
+    uint32_t nfailures;
+} lcb_HEALTH_PROBE;
+
+/**
+ * @volatile
+ * Get the results of the health probes of a data node.
+ *
+ * This only copies a fixed structure, and is cheap enough to be called before
+ * every request. Nodes which are busy are not probed, so `last_probe` may be
+ * old while the node is healthy.
+ *
+ * @param instance the library handle
+ * @param index the index of the node in the current configuration
+ * @param[out] probe the results
+ * @return LCB_ERR_NO_CONFIGURATION without a configuration, LCB_ERR_INVALID_ARGUMENT if the index is out of range
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_health_probe(lcb_INSTANCE *instance, size_t index, lcb_HEALTH_PROBE *probe);
+
 typedef struct lcb_RESPDIAG_ lcb_RESPDIAG;
 
 LIBCOUCHBASE_API lcb_STATUS lcb_respdiag_status(const lcb_RESPDIAG *resp);
@@ -1988,7 +2622,8 @@ void lcb_sched_enter(lcb_INSTANCE *instance);
  * limiting the number of calls to this function is not possible (for example,
  * if the legacy API is being used, or you wish to use implicit scheduling) then
  * the flushing may be decoupled from this function - see the documentation for
- * lcb_sched_flush().
+ * lcb_sched_flush(), or deferred to the end of the current loop iteration - see
+ * @ref LCB_CNTL_FLUSH_COALESCE.
  *
  * @param instance the instance
  */
@@ -2105,6 +2740,103 @@ LIBCOUCHBASE_API
 void lcb_destroy_async(lcb_INSTANCE *instance, const void *arg);
 /**@} (Group: Destroy) */
 
+/**
+ * @ingroup lcb-public-api
+ * @defgroup lcb-instance-pool Instance Pool
+ * @brief Share a set of instances between threads
+ *
+ * @details
+ * An instance may only be used by one thread at a time. A pool holds several
+ * instances created with the same options, which threads acquire for one or
+ * more synchronous operations (lcb_wait()) and release afterwards.
+ *
+ * - A thread gets the instance it used last whenever that one is free, so
+ *   that an instance (and its buffers) stays on one thread.
+ * - Acquiring and releasing a free instance takes no lock. Threads only block
+ *   when all instances are in use.
+ * - The instances share the cluster map (see @ref LCB_CNTL_SHARED_CONFIG):
+ *   at most one of them polls for configuration changes per interval, and
+ *   any newer configuration an instance receives is applied to the others
+ *   when they are acquired next.
+ *
+ * @code{.c}
+ * lcb_INSTANCE_POOL *pool;
+ * lcb_instance_pool_create(&pool, options, 8);
+ * for (size_t ii = 0; ii < lcb_instance_pool_size(pool); ii++) {
+ *     lcb_install_callback(lcb_instance_pool_get(pool, ii), LCB_CALLBACK_GET, get_callback);
+ * }
+ * lcb_instance_pool_connect(pool);
+ *
+ * // in any thread
+ * lcb_INSTANCE *instance = lcb_instance_pool_acquire(pool);
+ * lcb_get(instance, cookie, cmd);
+ * lcb_wait(instance, LCB_WAIT_DEFAULT);
+ * lcb_instance_pool_release(pool, instance);
+ * @endcode
+ *
+ * @addtogroup lcb-instance-pool
+ * @{
+ */
+typedef struct lcb_INSTANCE_POOL_ lcb_INSTANCE_POOL;
+
+/**
+ * @uncommitted
+ * Create a pool of instances.
+ *
+ * @param[out] pool the new pool
+ * @param options the options every instance is created with. They must not
+ * name an IO plugin instance (lcb_createopts_io()), as each instance needs its
+ * own event loop
+ * @param size the number of instances
+ */
+LIBCOUCHBASE_API
+lcb_STATUS lcb_instance_pool_create(lcb_INSTANCE_POOL **pool, const lcb_CREATEOPTS *options, size_t size);
+
+/** @uncommitted @return the number of instances in the pool */
+LIBCOUCHBASE_API
+size_t lcb_instance_pool_size(const lcb_INSTANCE_POOL *pool);
+
+/**
+ * @uncommitted
+ * Get an instance of the pool to configure it (e.g. install callbacks) before
+ * lcb_instance_pool_connect(). This does not acquire the instance.
+ */
+LIBCOUCHBASE_API
+lcb_INSTANCE *lcb_instance_pool_get(lcb_INSTANCE_POOL *pool, size_t index);
+
+/**
+ * @uncommitted
+ * Bootstrap all instances of the pool, and wait for them to be ready.
+ *
+ * @return the bootstrap error of the first instance which failed
+ */
+LIBCOUCHBASE_API
+lcb_STATUS lcb_instance_pool_connect(lcb_INSTANCE_POOL *pool);
+
+/**
+ * @uncommitted
+ * Acquire an instance for the exclusive use of the calling thread, blocking
+ * until one is released if all of them are in use.
+ */
+LIBCOUCHBASE_API
+lcb_INSTANCE *lcb_instance_pool_acquire(lcb_INSTANCE_POOL *pool);
+
+/**
+ * @uncommitted
+ * Release an instance acquired with lcb_instance_pool_acquire(). It must not
+ * have operations in flight.
+ */
+LIBCOUCHBASE_API
+void lcb_instance_pool_release(lcb_INSTANCE_POOL *pool, lcb_INSTANCE *instance);
+
+/**
+ * @uncommitted
+ * Destroy the pool and all of its instances. No instance may be acquired.
+ */
+LIBCOUCHBASE_API
+void lcb_instance_pool_destroy(lcb_INSTANCE_POOL *pool);
+/**@} (Group: Instance Pool) */
+
 /** @internal */
 #define LCB_DATATYPE_JSON 0x01
 
@@ -2466,6 +3198,21 @@ LIBCOUCHBASE_API lcb_STATUS lcb_respanalytics_handle(const lcb_RESPANALYTICS *re
 LIBCOUCHBASE_API lcb_STATUS lcb_respanalytics_error_context(const lcb_RESPANALYTICS *resp,
                                                             const lcb_ANALYTICS_ERROR_CONTEXT **ctx);
 LIBCOUCHBASE_API int lcb_respanalytics_is_final(const lcb_RESPANALYTICS *resp);
+/**
+ * Progress of the ingestion of the rows (see @ref lcb_cmdanalytics_ingest_options). Each row
+ * response carries the counts of the mutations completed so far, and the final one, which is
+ * delivered once all of them have completed, the totals.
+ *
+ * Unless the errors are ignored (@ref lcb_ingest_options_ignore_error), the first failed
+ * mutation stops the ingestion of the rows which follow, and the final response has its status.
+ *
+ * @param resp the analytics response
+ * @param stored rows which were stored
+ * @param ignored rows which the data converter skipped
+ * @param failed rows which could not be stored
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_respanalytics_ingest_stats(const lcb_RESPANALYTICS *resp, size_t *stored,
+                                                           size_t *ignored, size_t *failed);
 LIBCOUCHBASE_API lcb_STATUS lcb_respanalytics_deferred_handle_extract(const lcb_RESPANALYTICS *resp,
                                                                       lcb_DEFERRED_HANDLE **handle);
 LIBCOUCHBASE_API lcb_STATUS lcb_deferred_handle_destroy(lcb_DEFERRED_HANDLE *handle);
@@ -2474,6 +3221,38 @@ LIBCOUCHBASE_API lcb_STATUS lcb_deferred_handle_status(lcb_DEFERRED_HANDLE *hand
 LIBCOUCHBASE_API lcb_STATUS lcb_deferred_handle_callback(lcb_DEFERRED_HANDLE *handle, lcb_ANALYTICS_CALLBACK callback);
 LIBCOUCHBASE_API lcb_STATUS lcb_deferred_handle_poll(lcb_INSTANCE *instance, void *cookie, lcb_DEFERRED_HANDLE *handle);
 
+/**
+ * @uncommitted
+ * Get the number of partitions of a deferred result.
+ *
+ * If the status of a finished deferred query lists the partitions of its
+ * result, lcb_deferred_handle_poll() fetches them in parallel, each over its
+ * own (pooled) connection, and passes their rows to the callback of the
+ * handle. The final callback is invoked once all partitions have been
+ * received, with the first error of any partition, and a row of the form
+ * `{"status":"...","partitions":[<metadata of each partition>]}`.
+ *
+ * @param handle the deferred handle
+ * @param[out] count the number of partitions, 0 if the result is fetched as one stream
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_deferred_handle_partitions(lcb_DEFERRED_HANDLE *handle, size_t *count);
+
+/**
+ * @uncommitted
+ * Whether the rows of a partitioned result are delivered in the order of the
+ * partitions (the default). Rows of a partition which arrive before all the
+ * previous partitions are complete are held in memory until then. If set to
+ * zero, rows are delivered as soon as they arrive.
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_deferred_handle_ordered(lcb_DEFERRED_HANDLE *handle, int ordered);
+
+/**
+ * @uncommitted
+ * How many partitions of a partitioned result are fetched at the same time.
+ * The default of 0 fetches all of them at once.
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_deferred_handle_parallelism(lcb_DEFERRED_HANDLE *handle, size_t parallelism);
+
 typedef struct lcb_CMDANALYTICS_ lcb_CMDANALYTICS;
 
 typedef struct lcb_INGEST_OPTIONS_ lcb_INGEST_OPTIONS;
@@ -2512,6 +3291,13 @@ LIBCOUCHBASE_API lcb_STATUS lcb_ingest_options_expiry(lcb_INGEST_OPTIONS *option
 LIBCOUCHBASE_API lcb_STATUS lcb_ingest_options_ignore_error(lcb_INGEST_OPTIONS *options, int flag);
 LIBCOUCHBASE_API lcb_STATUS lcb_ingest_options_data_converter(lcb_INGEST_OPTIONS *options,
                                                               lcb_INGEST_DATACONVERTER_CALLBACK callback);
+/**
+ * Most mutations of the ingested rows awaiting their response at the same
+ * time. The window adapts to the load of the cluster below this limit, and
+ * the row stream of the query is paused while it is full. The default of 0
+ * means 256.
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_ingest_options_max_concurrency(lcb_INGEST_OPTIONS *options, uint32_t num);
 
 LIBCOUCHBASE_API lcb_STATUS lcb_ingest_dataconverter_param_cookie(lcb_INGEST_PARAM *param, void **cookie);
 LIBCOUCHBASE_API lcb_STATUS lcb_ingest_dataconverter_param_row(lcb_INGEST_PARAM *param, const char **row,
@@ -2673,6 +3459,37 @@ LIBCOUCHBASE_API lcb_STATUS lcb_analytics(lcb_INSTANCE *instance, void *cookie,
  */
 LIBCOUCHBASE_API lcb_STATUS lcb_analytics_cancel(lcb_INSTANCE *instance, lcb_ANALYTICS_HANDLE *handle);
 
+/**
+ * @volatile
+ *
+ * Stop reading the HTTP response of a analytics query in progress.
+ *
+ * Rows which have already been received from the network may still be
+ * delivered to the callback after this call; no further data is read from
+ * the socket until lcb_analytics_resume() is called. This allows applications
+ * which hand rows over to a slower consumer to bound the amount of buffered
+ * data.
+ *
+ * @param instance the instance
+ * @param handle the handle to the analytics query
+ * @return LCB_SUCCESS if successful, LCB_ERR_INVALID_ARGUMENT if the request
+ *  has already been cancelled.
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_analytics_pause(lcb_INSTANCE *instance, lcb_ANALYTICS_HANDLE *handle);
+
+/**
+ * @volatile
+ *
+ * Resume reading the HTTP response of a analytics query previously paused with
+ * lcb_analytics_pause().
+ *
+ * @param instance the instance
+ * @param handle the handle to the analytics query
+ * @return LCB_SUCCESS if successful, LCB_ERR_INVALID_ARGUMENT if the request
+ *  has already been cancelled.
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_analytics_resume(lcb_INSTANCE *instance, lcb_ANALYTICS_HANDLE *handle);
+
 /** @} */
 
 /**
@@ -2752,6 +3569,28 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdsearch_payload(lcb_CMDSEARCH *cmd, const char
  */
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdsearch_handle(lcb_CMDSEARCH *cmd, lcb_SEARCH_HANDLE **handle);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdsearch_timeout(lcb_CMDSEARCH *cmd, uint32_t timeout);
+
+/**
+ * @uncommitted
+ * Only pass the given member of each hit to the callback.
+ *
+ * Once a member has been registered, every hit is reduced to the registered
+ * members while it is split out of the response, and the members which are
+ * not needed (such as `locations`, `fragments` or `explanation`) are skipped
+ * without being parsed. Nested members are given as dotted paths, e.g.
+ * `fields.title` keeps only the `title` stored field.
+ *
+ * @code{.c}
+ * lcb_cmdsearch_project(cmd, "id", 2);
+ * lcb_cmdsearch_project(cmd, "score", 5);
+ * lcb_cmdsearch_project(cmd, "fields.title", 12);
+ * @endcode
+ *
+ * @param cmd the command
+ * @param path the member to keep
+ * @param path_len the length of the path
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdsearch_project(lcb_CMDSEARCH *cmd, const char *path, size_t path_len);
 /**
  * @internal Internal: This should never be used and is not supported.
  */
@@ -2777,6 +3616,37 @@ LIBCOUCHBASE_API lcb_STATUS lcb_search(lcb_INSTANCE *instance, void *cookie, con
  * @return LCB_SUCCESS if successful, otherwise an error.
  */
 LIBCOUCHBASE_API lcb_STATUS lcb_search_cancel(lcb_INSTANCE *instance, lcb_SEARCH_HANDLE *handle);
+
+/**
+ * @volatile
+ *
+ * Stop reading the HTTP response of a full-text query in progress.
+ *
+ * Rows which have already been received from the network may still be
+ * delivered to the callback after this call; no further data is read from
+ * the socket until lcb_search_resume() is called. This allows applications
+ * which hand rows over to a slower consumer to bound the amount of buffered
+ * data.
+ *
+ * @param instance the instance
+ * @param handle the handle to the full-text query
+ * @return LCB_SUCCESS if successful, LCB_ERR_INVALID_ARGUMENT if the request
+ *  has already been cancelled.
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_search_pause(lcb_INSTANCE *instance, lcb_SEARCH_HANDLE *handle);
+
+/**
+ * @volatile
+ *
+ * Resume reading the HTTP response of a full-text query previously paused with
+ * lcb_search_pause().
+ *
+ * @param instance the instance
+ * @param handle the handle to the full-text query
+ * @return LCB_SUCCESS if successful, LCB_ERR_INVALID_ARGUMENT if the request
+ *  has already been cancelled.
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_search_resume(lcb_INSTANCE *instance, lcb_SEARCH_HANDLE *handle);
 /** @} */
 
 /**
@@ -3121,6 +3991,25 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdquery_timeout(lcb_CMDQUERY *cmd, uint32_t tim
  */
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdquery_preserve_expiry(lcb_CMDQUERY *cmd, int preserve_expiry);
 
+/**
+ * @uncommitted
+ * Stop the query once this many rows have been delivered.
+ *
+ * After the last wanted row, the connection to the query service is closed
+ * (the server would otherwise keep streaming the rest of the results), rows
+ * which were already received are dropped, and the final callback is invoked
+ * with LCB_SUCCESS. Its metadata contains only the fields which precede the
+ * results (such as `requestID` and `signature`), as the trailer with `status`
+ * and `metrics` is never received.
+ *
+ * The statement is sent unchanged, so a `LIMIT` clause is still worth adding
+ * where possible, to save the server from producing rows nobody reads.
+ *
+ * @param cmd the command
+ * @param max_rows the number of rows to deliver, or 0 (the default) for all
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdquery_max_rows(lcb_CMDQUERY *cmd, size_t max_rows);
+
 /**
  * @internal Internal: This should never be used and is not supported.
  */
@@ -3167,6 +4056,37 @@ LIBCOUCHBASE_API lcb_STATUS lcb_query(lcb_INSTANCE *instance, void *cookie, cons
  * @endcode
  */
 LIBCOUCHBASE_API lcb_STATUS lcb_query_cancel(lcb_INSTANCE *instance, lcb_QUERY_HANDLE *handle);
+
+/**
+ * @volatile
+ *
+ * Stop reading the HTTP response of a N1QL query in progress.
+ *
+ * Rows which have already been received from the network may still be
+ * delivered to the callback after this call; no further data is read from
+ * the socket until lcb_query_resume() is called. This allows applications
+ * which hand rows over to a slower consumer to bound the amount of buffered
+ * data.
+ *
+ * @param instance the instance
+ * @param handle the handle to the N1QL query
+ * @return LCB_SUCCESS if successful, LCB_ERR_INVALID_ARGUMENT if the request
+ *  has already been cancelled.
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_query_pause(lcb_INSTANCE *instance, lcb_QUERY_HANDLE *handle);
+
+/**
+ * @volatile
+ *
+ * Resume reading the HTTP response of a N1QL query previously paused with
+ * lcb_query_pause().
+ *
+ * @param instance the instance
+ * @param handle the handle to the N1QL query
+ * @return LCB_SUCCESS if successful, LCB_ERR_INVALID_ARGUMENT if the request
+ *  has already been cancelled.
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_query_resume(lcb_INSTANCE *instance, lcb_QUERY_HANDLE *handle);
 /** @} */
 
 /**
@@ -3255,6 +4175,34 @@ LIBCOUCHBASE_API lcb_STATUS lcb_respsubdoc_result_status(const lcb_RESPSUBDOC *r
 LIBCOUCHBASE_API lcb_STATUS lcb_respsubdoc_result_value(const lcb_RESPSUBDOC *resp, size_t index, const char **value,
                                                         size_t *value_len);
 
+/**
+ * Result of one spec, as decoded by lcb_respsubdoc_results()
+ */
+typedef struct {
+    lcb_STATUS status;
+    /** Offset of the value from the start of the response body, 0 if there is no value */
+    uint32_t offset;
+    /** Length of the value, only non-zero if #status is ::LCB_SUCCESS */
+    uint32_t length;
+} lcb_SUBDOC_RESULT;
+
+/**
+ * Decodes the results of all the specs in a single pass over the response,
+ * instead of one lcb_respsubdoc_result_status()/lcb_respsubdoc_result_value()
+ * call per spec. Meant for wide lookups, with a fixed array of as many entries
+ * as the server allows specs (16).
+ *
+ * @param resp the response
+ * @param results receives the result of the spec at each index
+ * @param nresults number of entries in `results`. Results past it are skipped.
+ * @param body set to the response body, which the offsets of the values are
+ *  relative to. It is only valid within the callback (see lcb_respsubdoc_backbuf())
+ * @return the number of entries written, i.e. the lesser of `nresults` and
+ *  lcb_respsubdoc_result_size()
+ */
+LIBCOUCHBASE_API size_t lcb_respsubdoc_results(const lcb_RESPSUBDOC *resp, lcb_SUBDOC_RESULT *results,
+                                               size_t nresults, const char **body);
+
 /**
  * @private
  * @return non-zero if if the fetched document is a tombstone.
@@ -3309,6 +4257,34 @@ LIBCOUCHBASE_API lcb_STATUS lcb_subdocspecs_remove(lcb_SUBDOCSPECS *operations,
 LIBCOUCHBASE_API lcb_STATUS lcb_subdocspecs_get_count(lcb_SUBDOCSPECS *operations, size_t index, uint32_t flags,
                                                       const char *path, size_t path_len);
 
+/**
+ * Specs which were validated and encoded once, to be used by any number of
+ * commands.
+ */
+typedef struct lcb_SUBDOCTEMPLATE_ lcb_SUBDOCTEMPLATE;
+
+/**
+ * @uncommitted
+ * Compile specs into a template.
+ *
+ * The opcodes, flags and paths of the specs are validated and serialized
+ * into the layout of the request body once. Commands using the template
+ * (see lcb_cmdsubdoc_template()) then only copy the serialized form and, for
+ * mutations, append the values, instead of encoding every spec again.
+ *
+ * @param[out] tpl the new template
+ * @param operations the specs. They are copied and may be destroyed afterwards
+ * @return LCB_ERR_UNKNOWN_SUBDOC_COMMAND, LCB_ERR_OPTIONS_CONFLICT or
+ * LCB_ERR_SUBDOC_PATH_INVALID if the specs could not be scheduled
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_subdoctemplate_create(lcb_SUBDOCTEMPLATE **tpl, const lcb_SUBDOCSPECS *operations);
+/**
+ * @uncommitted
+ * Destroy a template. Commands which use it keep a reference of their own, so
+ * this is safe while they are still scheduled.
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_subdoctemplate_destroy(lcb_SUBDOCTEMPLATE *tpl);
+
 typedef struct lcb_CMDSUBDOC_ lcb_CMDSUBDOC;
 
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdsubdoc_create(lcb_CMDSUBDOC **cmd);
@@ -3319,6 +4295,19 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdsubdoc_collection(lcb_CMDSUBDOC *cmd, const c
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdsubdoc_key(lcb_CMDSUBDOC *cmd, const char *key, size_t key_len);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdsubdoc_cas(lcb_CMDSUBDOC *cmd, uint64_t cas);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdsubdoc_specs(lcb_CMDSUBDOC *cmd, const lcb_SUBDOCSPECS *operations);
+/**
+ * @uncommitted
+ * Use the specs of a template instead of lcb_cmdsubdoc_specs().
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdsubdoc_template(lcb_CMDSUBDOC *cmd, const lcb_SUBDOCTEMPLATE *tpl);
+/**
+ * @uncommitted
+ * Replace the value of the spec at `index` of the template used by a
+ * mutation. Specs whose value is not replaced use the value they had when the
+ * template was created.
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdsubdoc_template_value(lcb_CMDSUBDOC *cmd, size_t index, const char *value,
+                                                         size_t value_len);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdsubdoc_expiry(lcb_CMDSUBDOC *cmd, uint32_t expiration);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdsubdoc_preserve_expiry(lcb_CMDSUBDOC *cmd, int should_preserve);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdsubdoc_durability(lcb_CMDSUBDOC *cmd, lcb_DURABILITY_LEVEL level);
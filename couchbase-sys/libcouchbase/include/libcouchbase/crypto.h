@@ -53,6 +53,22 @@ typedef struct lcbcrypto_SIGV {
     size_t len;          /**< length of the data in bytes */
 } lcbcrypto_SIGV;
 
+/**
+ * Field to encrypt or decrypt, in a batch of fields handed to a crypto-provider at once.
+ *
+ * @see lcbcrypto_PROVIDER
+ * @uncommitted
+ */
+typedef struct lcbcrypto_BATCHITEM {
+    const uint8_t *input; /**< data to encrypt or decrypt */
+    size_t input_len;     /**< length of the data in bytes */
+    const uint8_t *iv;    /**< initialization vector, or NULL */
+    size_t iv_len;        /**< length of the initialization vector in bytes */
+    uint8_t *output;      /**< result, set by the provider. The library releases it with release_bytes */
+    size_t output_len;    /**< length of the result in bytes, set by the provider */
+    lcb_STATUS status;    /**< status of the item, set by the provider */
+} lcbcrypto_BATCHITEM;
+
 struct lcbcrypto_PROVIDER;
 /**
  * Crypto-provider interface.
@@ -65,7 +81,7 @@ struct lcbcrypto_PROVIDER;
  * @committed
  */
 typedef struct lcbcrypto_PROVIDER {
-    uint16_t version;                                        /**< version of the structure, current value is 1 */
+    uint16_t version;                                        /**< version of the structure, 1 or 2 */
     int16_t _refcnt;                                         /**< reference counter */
     uint64_t flags;                                          /**< provider-specific flags */
     void *cookie;                                            /**< opaque pointer (e.g. pointer to wrapper instance) */
@@ -91,6 +107,33 @@ typedef struct lcbcrypto_PROVIDER {
             /** returns key identifier, associated with the crypto-provider */
             const char *(*get_key_id)(struct lcbcrypto_PROVIDER *provider);
         } v1;
+        /**
+         * Version 2 adds optional functions which process all the fields of a document which use the provider in a
+         * single call, so that the provider may keep its cipher context across them, or hand them to worker threads.
+         * The items may be processed in any order, but all of them must be done when the function returns.
+         * The other members are the same as in version 1.
+         *
+         * @uncommitted
+         */
+        struct {
+            void (*release_bytes)(struct lcbcrypto_PROVIDER *provider, void *bytes);
+            lcb_STATUS (*generate_iv)(struct lcbcrypto_PROVIDER *provider, uint8_t **iv, size_t *iv_len);
+            lcb_STATUS (*sign)(struct lcbcrypto_PROVIDER *provider, const lcbcrypto_SIGV *inputs, size_t input_num,
+                               uint8_t **sig, size_t *sig_len);
+            lcb_STATUS (*verify_signature)(struct lcbcrypto_PROVIDER *provider, const lcbcrypto_SIGV *inputs,
+                                           size_t input_num, uint8_t *sig, size_t sig_len);
+            lcb_STATUS (*encrypt)(struct lcbcrypto_PROVIDER *provider, const uint8_t *input, size_t input_len,
+                                  const uint8_t *iv, size_t iv_len, uint8_t **output, size_t *output_len);
+            lcb_STATUS (*decrypt)(struct lcbcrypto_PROVIDER *provider, const uint8_t *input, size_t input_len,
+                                  const uint8_t *iv, size_t iv_len, uint8_t **output, size_t *output_len);
+            const char *(*get_key_id)(struct lcbcrypto_PROVIDER *provider);
+            /** encrypt several fields, or NULL to use encrypt for each of them */
+            lcb_STATUS (*encrypt_batch)(struct lcbcrypto_PROVIDER *provider, lcbcrypto_BATCHITEM *items,
+                                        size_t items_num);
+            /** decrypt several fields, or NULL to use decrypt for each of them */
+            lcb_STATUS (*decrypt_batch)(struct lcbcrypto_PROVIDER *provider, lcbcrypto_BATCHITEM *items,
+                                        size_t items_num);
+        } v2;
     } v;
 } lcbcrypto_PROVIDER;
 
@@ -206,6 +249,9 @@ LIBCOUCHBASE_API void lcbcrypto_unref(lcbcrypto_PROVIDER *provider);
  * The function will remove original content of the field, and rename it using @ref LCBCRYPTO_DEFAULT_FIELD_PREFIX, or
  * custom prefix, specified in the command.
  *
+ * All the fields are encrypted before any of them is encoded, and the fields using a provider with `encrypt_batch`
+ * are passed to it in a single call.
+ *
  * See full example in @ref example/crypto/openssl_symmetric_encrypt.c
  *
  * @param instance the handle
@@ -240,6 +286,9 @@ LIBCOUCHBASE_API lcb_STATUS lcbcrypto_encrypt_fields(lcb_INSTANCE *instance, lcb
  * The function will remove original content of the field, and rename it using @ref LCBCRYPTO_DEFAULT_FIELD_PREFIX, or
  * custom prefix, specified in the command.
  *
+ * All the fields are decrypted before any of them is parsed, and the fields using a provider with `decrypt_batch`
+ * are passed to it in a single call.
+ *
  * See full example in @ref example/crypto/openssl_symmetric_decrypt.c
  *
  * @param instance the handle
@@ -24,12 +24,51 @@ extern "C" {
 
 struct lcb_METRICS_st;
 
+/**
+ * Number of buckets of the histograms of lcb_IOMETRICS. Bucket `i` counts the
+ * values of bit length `i`, i.e. 0 for the first bucket, and the values in
+ * `[2^(i-1), 2^i)` for the others, except for the last one which counts all
+ * the values from `2^(LCB_IOMETRICS_NBUCKETS - 2)` up.
+ */
+#define LCB_IOMETRICS_NBUCKETS 24
+
 typedef struct lcb_IOMETRICS_st {
     const char *hostport;
     lcb_SIZE io_close;
     lcb_SIZE io_error;
     lcb_SIZE bytes_sent;
     lcb_SIZE bytes_received;
+    /** Number of calls into the I/O plugin to send data */
+    lcb_SIZE io_send_calls;
+    /** Number of calls into the I/O plugin to receive data */
+    lcb_SIZE io_recv_calls;
+    /** Number of socket watcher updates (event-based plugins only) */
+    lcb_SIZE io_watch_calls;
+    /** Number of calls to send data which would have blocked (event-based plugins only) */
+    lcb_SIZE io_send_eagain;
+    /** Number of calls to receive data which would have blocked (event-based plugins only) */
+    lcb_SIZE io_recv_eagain;
+    /** Histogram of the bytes written by each call to send data which wrote any */
+    lcb_SIZE send_bytes[LCB_IOMETRICS_NBUCKETS];
+    /** Histogram of the bytes read by each call to receive data which read any */
+    lcb_SIZE recv_bytes[LCB_IOMETRICS_NBUCKETS];
+    /** Histogram of the calls to receive data made for each readable event (event-based plugins only) */
+    lcb_SIZE recv_calls_per_event[LCB_IOMETRICS_NBUCKETS];
+    /**
+     * Histogram of the bytes in the kernel send queue of the socket after each
+     * write, see @ref LCB_CNTL_KERNEL_IO_STATS
+     */
+    lcb_SIZE send_queue_bytes[LCB_IOMETRICS_NBUCKETS];
+    /**
+     * Histogram of the microseconds the received data waited in the kernel
+     * before being read, see @ref LCB_CNTL_KERNEL_IO_STATS
+     */
+    lcb_SIZE rx_kernel_us[LCB_IOMETRICS_NBUCKETS];
+    /**
+     * Histogram of the microseconds between a write and its last byte being
+     * handed to the network device, see @ref LCB_CNTL_KERNEL_IO_STATS
+     */
+    lcb_SIZE tx_kernel_us[LCB_IOMETRICS_NBUCKETS];
 } lcb_IOMETRICS;
 
 typedef struct lcb_SERVERMETRICS_st {
@@ -62,14 +101,121 @@ typedef struct lcb_SERVERMETRICS_st {
 
     /** Number of NOT_MY_VBUCKET replies received */
     lcb_SIZE packets_nmv;
+
+    /**
+     * Number of packets held back by @ref LCB_CNTL_LARGE_VALUE_THRESHOLD until
+     * the packets before them are flushed: the large packets, and the packets
+     * for the same documents scheduled after them. Subset of packets_queued
+     */
+    lcb_SIZE packets_held;
+
+    /** Number of bytes in the held packets. Subset of bytes_queued */
+    lcb_SIZE bytes_held;
+
+    /** Number of packets which were sent ahead of held packets */
+    lcb_SIZE packets_overtaking;
+
+    /** Number of times the circuit breaker of a connection to this server opened, see LCB_CNTL_CIRCUIT_BREAKER */
+    lcb_SIZE circuit_breaker_opened;
+
+    /** Number of operations which failed because the circuit breaker was open */
+    lcb_SIZE packets_rejected;
+
+    /** Number of NOOPs sent because nothing was read while operations were pending, see LCB_CNTL_KV_IDLE_TIMEOUT */
+    lcb_SIZE idle_probes;
+
+    /** Number of connections closed because they read nothing after such a NOOP */
+    lcb_SIZE idle_reconnects;
+
+    /** Number of packets sent again on the new connection because the previous one was closed before writing them */
+    lcb_SIZE packets_replayed;
 } lcb_SERVERMETRICS;
 
+/** Number of vBuckets counted by lcb_METRICS::vbuckets, the most a bucket has */
+#define LCB_VBUCKETMETRICS_MAX 1024
+
+/** Counters of the KV operations of a vBucket, e.g. to follow a rebalance */
+typedef struct lcb_VBUCKETMETRICS_st {
+    /** Number of operations which were answered */
+    lcb_SIZE ops;
+
+    /** Number of NOT_MY_VBUCKET replies received, i.e. times the vBucket was found to have moved */
+    lcb_SIZE nmv;
+
+    /** Number of times an operation entered the retry queue */
+    lcb_SIZE retries;
+
+    /** Sum of the latencies of the answered operations in microseconds, including their retries */
+    lcb_U64 latency_sum_us;
+
+    /** Highest latency of an answered operation in microseconds */
+    lcb_U64 latency_max_us;
+} lcb_VBUCKETMETRICS;
+
 typedef struct lcb_METRICS_st {
     lcb_SIZE nservers;
     const lcb_SERVERMETRICS **servers;
 
     /** Number of times a packet entered the retry queue */
     lcb_SIZE packets_retried;
+
+    /** Number of operations in the retry queue, as of its last flush */
+    lcb_SIZE retryq_depth;
+
+    /** Microseconds since the oldest operation in the retry queue was
+     * scheduled, as of its last flush */
+    lcb_U64 retryq_age;
+
+    /** Number of times an operation was held back by @ref LCB_CNTL_RETRY_BUDGET */
+    lcb_SIZE retries_deferred;
+
+    /** Number of gets which were read from the replicas, see lcb_cmdget_hedge() */
+    lcb_SIZE gets_hedged;
+
+    /** Number of hedged gets which were answered by a replica first */
+    lcb_SIZE hedges_won;
+
+    /** Number of gets which were answered by the near cache, see lcb_cmdget_near_cache() */
+    lcb_SIZE near_cache_hits;
+
+    /** Number of gets which could have been answered by the near cache, but were sent */
+    lcb_SIZE near_cache_misses;
+
+    /** Number of gets which were answered by the reply of an identical get, see LCB_CNTL_GET_COALESCE */
+    lcb_SIZE gets_coalesced;
+
+    /** Number of gets and exists checks which the near cache answered as missing */
+    lcb_SIZE negative_cache_hits;
+
+    /** Most operations which were waiting for the instance to bootstrap at once */
+    lcb_SIZE deferred_high_water;
+
+    /** Number of gets with an expiry which were sent without touching, see LCB_CNTL_TOUCH_SKIP_WINDOW */
+    lcb_SIZE touches_skipped;
+
+    /** Number of compressed bytes of HTTP response bodies, see LCB_CNTL_HTTP_COMPRESSION */
+    lcb_SIZE http_bytes_compressed;
+
+    /** Number of bytes these bodies were decompressed into */
+    lcb_SIZE http_bytes_decompressed;
+
+    /** Number of bytes of idle buffers freed after a quiet period, see LCB_CNTL_IDLE_TRIM_INTERVAL */
+    lcb_SIZE bytes_trimmed;
+
+    /** Number of idle pooled connections closed after a quiet period */
+    lcb_SIZE sockets_trimmed;
+
+    /** Number of upserts whose value was replaced by a later one before being sent, see lcb_cmdstore_coalesce() */
+    lcb_SIZE upserts_coalesced;
+
+    /**
+     * Counters of each vBucket by ID. The array has no pointers, so that
+     * copying the first `nvbuckets` entries takes a snapshot of them
+     */
+    const lcb_VBUCKETMETRICS *vbuckets;
+
+    /** Number of entries of `vbuckets` which may be non-zero, i.e. the highest vBucket ID counted plus one */
+    lcb_SIZE nvbuckets;
 } lcb_METRICS;
 
 #ifdef __cplusplus
@@ -346,6 +346,27 @@ typedef int (*lcb_ioE_chkclosed_fn)(lcb_io_opt_t iops, lcb_socket_t sock, int fl
 /** Enable/Disable TCP Keepalive */
 #define LCB_IO_CNTL_TCP_KEEPALIVE 2
 
+/** Microseconds to busy poll the device on reads, SO_BUSY_POLL (use an int, Linux only) */
+#define LCB_IO_CNTL_BUSY_POLL 3
+
+/**
+ * Generate kernel timestamps, SO_TIMESTAMPING (use an int holding the SOF_TIMESTAMPING_* flags, Linux only, see
+ * @ref LCB_CNTL_KERNEL_IO_STATS)
+ */
+#define LCB_IO_CNTL_TIMESTAMPING 4
+
+/**
+ * Milliseconds the written data may stay unacknowledged before the connection is closed, TCP_USER_TIMEOUT (use an
+ * int, Linux only, see @ref LCB_CNTL_TCP_USER_TIMEOUT)
+ */
+#define LCB_IO_CNTL_TCP_USER_TIMEOUT 5
+
+/**
+ * Reset the connection when the socket is closed rather than lingering to send the remaining data, SO_LINGER with
+ * a zero timeout (use an int as a boolean, setting only, see @ref LCB_CNTL_FASTDESTROY)
+ */
+#define LCB_IO_CNTL_ABORTIVE_CLOSE 6
+
 /**
  * @brief Execute a specificied operation on a socket.
  * @param iops The iops
@@ -904,7 +925,11 @@ typedef enum {
     LCB_IO_OPS_LIBEV = 0x04,
     LCB_IO_OPS_SELECT = 0x05,
     LCB_IO_OPS_WINIOCP = 0x06,
-    LCB_IO_OPS_LIBUV = 0x07
+    LCB_IO_OPS_LIBUV = 0x07,
+    /** Completion-based io_uring plugin, only available on Linux. See lcb_create_uring_io_opts() */
+    LCB_IO_OPS_URING = 0x08,
+    /** Event-based plugin using epoll on Linux and kqueue on BSD/macOS. See lcb_create_epoll_io_opts() */
+    LCB_IO_OPS_EPOLL = 0x09
 } lcb_io_ops_type_t;
 
 /** @brief IO Creation for builtin plugins */
@@ -970,6 +995,64 @@ lcb_STATUS lcb_create_io_ops(lcb_io_opt_t *op, const struct lcb_create_io_ops_st
 LIBCOUCHBASE_API
 lcb_STATUS lcb_destroy_io_ops(lcb_io_opt_t op);
 
+/**
+ * @volatile
+ *
+ * Handle which lets another thread interrupt an event loop blocked in
+ * lcb_wakeup_run(). This allows an application to block in the real event
+ * loop (shared by all instances created with the same `lcb_io_opt_t` via
+ * lcb_createopts_io()) rather than polling with lcb_tick_nowait().
+ */
+typedef struct lcb_WAKEUP_st lcb_WAKEUP;
+
+/**
+ * @volatile
+ *
+ * Create a wakeup handle on the given I/O plugin. Only event-based plugins are
+ * supported; LCB_ERR_UNSUPPORTED_OPERATION is returned otherwise (and on
+ * Windows).
+ */
+LIBCOUCHBASE_API
+lcb_STATUS lcb_wakeup_create(lcb_io_opt_t io, lcb_WAKEUP **wakeup);
+
+/**
+ * @volatile
+ *
+ * Make a current (or the next) call to lcb_wakeup_run() return. This is the
+ * only wakeup function which may be called from a thread other than the one
+ * running the event loop.
+ */
+LIBCOUCHBASE_API
+lcb_STATUS lcb_wakeup_signal(lcb_WAKEUP *wakeup);
+
+/**
+ * @volatile
+ *
+ * Same as lcb_wakeup_signal(), but must be called on the thread running the
+ * event loop (e.g. from an operation callback). The loop returns once the
+ * current event has been handled, without writing to the wakeup handle.
+ */
+LIBCOUCHBASE_API
+void lcb_wakeup_stop(lcb_WAKEUP *wakeup);
+
+/**
+ * @volatile
+ *
+ * Run the event loop until lcb_wakeup_signal() is called. Signals received
+ * while the loop is driven elsewhere (e.g. by lcb_wait()) do not interrupt
+ * that loop but cause the next call to this function to return immediately.
+ */
+LIBCOUCHBASE_API
+void lcb_wakeup_run(lcb_WAKEUP *wakeup);
+
+/**
+ * @volatile
+ *
+ * Release the wakeup handle. Must be called before the I/O plugin is destroyed.
+ */
+LIBCOUCHBASE_API
+void lcb_wakeup_destroy(lcb_WAKEUP *wakeup);
+
 #ifdef __cplusplus
 }
 #endif
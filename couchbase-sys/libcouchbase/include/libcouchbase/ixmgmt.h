@@ -258,6 +258,57 @@ LCB_DEPRECATED2(LIBCOUCHBASE_API lcb_STATUS lcb_n1x_watchbuild(lcb_INSTANCE *ins
                                                                const lcb_CMDN1XWATCH *cmd),
                 "lcb_http must be used directly");
 
+/**
+ * @volatile
+ *
+ * Command for lcb_n1x_buildall()
+ */
+typedef struct {
+    /**
+     * Indexes to build, selected as for lcb_n1x_list(). An empty spec selects
+     * the deferred indexes of all keyspaces.
+     */
+    lcb_N1XSPEC spec;
+
+    /**
+     * Maximum amount of time to wait for all the indexes to be online
+     * (microseconds). Default is 5 minutes.
+     */
+    lcb_U32 timeout;
+
+    /**
+     * Delay before the first check of the indexes (microseconds). It doubles
+     * after every check which finds indexes still building, up to
+     * max_interval. Default is 500 milliseconds.
+     */
+    lcb_U32 interval;
+
+    /** Longest delay between two checks (microseconds). Default is 10 seconds */
+    lcb_U32 max_interval;
+
+    /**
+     * Callback invoked once all the indexes are online, or on error or
+     * timeout. The specs of the response are those of the indexes which are
+     * online.
+     */
+    lcb_N1XMGMTCALLBACK callback;
+} lcb_CMDN1XBUILDALL;
+
+/**
+ * @volatile
+ *
+ * Build all the deferred indexes selected by the spec and wait until they
+ * are online. This is lcb_n1x_startbuild() followed by lcb_n1x_watchbuild(),
+ * with the indexes of each keyspace built by a single `BUILD INDEX`
+ * statement, all keyspaces at once, and the state of all the indexes still
+ * building fetched by a single query at every check.
+ *
+ * If no index is waiting to be built, the callback receives LCB_SUCCESS and
+ * no specs.
+ */
+LIBCOUCHBASE_API
+lcb_STATUS lcb_n1x_buildall(lcb_INSTANCE *instance, const void *cookie, const lcb_CMDN1XBUILDALL *cmd);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
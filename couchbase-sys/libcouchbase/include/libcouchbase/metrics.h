@@ -224,6 +224,55 @@ lcb_STATUS lcbmetrics_meter_cookie(const lcbmetrics_METER *meter, void **cookie)
 LIBCOUCHBASE_API
 void lcbmetrics_meter_destroy(const lcbmetrics_METER *meter);
 
+/**
+ * @volatile
+ * @brief Allocate a meter which may be scraped in the OpenMetrics text format.
+ *
+ * Every recorder of the meter is a histogram of the recorded values, with
+ * buckets bounded by the powers of 4 up to 4^20. The values are those passed
+ * by the library, i.e. nanoseconds for the operation latencies and for their
+ * breakdown. Recording only updates atomic counters, so that the meter may be
+ * shared by instances running on different threads, and rendered with
+ * @ref lcbmetrics_openmetrics_render from yet another one without delaying
+ * their IO.
+ *
+ * Pass the meter to @ref lcb_createopts_meter, and deallocate it with
+ * @ref lcbmetrics_meter_destroy once every instance using it was destroyed.
+ *
+ * @param meter points to the allocated meter.
+ * @return LCB_SUCCESS if allocated successfully.
+ */
+LIBCOUCHBASE_API
+lcb_STATUS lcbmetrics_openmetrics_create(lcbmetrics_METER **meter);
+
+/**
+ * @brief Receives the text rendered by @ref lcbmetrics_openmetrics_render.
+ *
+ * @param cookie the cookie passed to @ref lcbmetrics_openmetrics_render.
+ * @param text the exposition, terminated by `# EOF`, valid during the call only.
+ * @param ntext the length of the text.
+ */
+typedef void (*lcbmetrics_OPENMETRICS_CALLBACK)(void *cookie, const char *text, size_t ntext);
+
+/**
+ * @volatile
+ * @brief Render the histograms of a meter in the OpenMetrics text format.
+ *
+ * Safe to call from any thread, e.g. the one serving the scrape endpoint.
+ * Metric and label names are those of the library with the characters
+ * OpenMetrics does not allow replaced by `_`, e.g.
+ * `db_couchbase_operations_bucket{db_couchbase_service="kv",db_operation="get",le="1024"}`.
+ *
+ * @param meter a meter allocated with @ref lcbmetrics_openmetrics_create.
+ * @param callback invoked once with the text, before the function returns.
+ * @param cookie passed to the callback.
+ * @return LCB_ERR_INVALID_ARGUMENT if the meter was not allocated with
+ *  @ref lcbmetrics_openmetrics_create.
+ */
+LIBCOUCHBASE_API
+lcb_STATUS lcbmetrics_openmetrics_render(const lcbmetrics_METER *meter, lcbmetrics_OPENMETRICS_CALLBACK callback,
+                                         void *cookie);
+
 /** @} (Group: Operation Metrics) */
 
 #ifdef __cplusplus
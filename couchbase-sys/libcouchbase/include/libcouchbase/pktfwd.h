@@ -52,6 +52,10 @@ typedef struct {
      * lcb_pktflushed_callback to be invoked to signal that the buffer is no
      * longer needed and may be released back to the application.
      *
+     * With LCB_KV_IOV, the packet is sent straight from the buffers as long as
+     * the header, extras and key are all found in the first one. Otherwise
+     * they are copied, while the value is still sent from the buffers.
+     *
      * @warning
      * The first 24 bytes of the buffer (i.e. the memcached header)
      * **will be modified**. Currently this is used to modify the `opaque` field
@@ -215,6 +219,90 @@ lcb_pktfwd_callback lcb_set_pktfwd_callback(lcb_INSTANCE *instance, lcb_pktfwd_c
 LIBCOUCHBASE_API
 lcb_pktflushed_callback lcb_set_pktflushed_callback(lcb_INSTANCE *instance, lcb_pktflushed_callback callback);
 
+/**
+ * @name Submitting From Other Threads
+ *
+ * @details
+ *
+ * An instance may only be used from the thread running its event loop. A
+ * submission queue lets other threads hand packets to the instance without
+ * any further synchronization: lcb_submitq_push() appends the packet to a
+ * lock-free queue and signals the event loop, which then forwards all queued
+ * packets with lcb_pktfwd3() in a single scheduling context.
+ *
+ * Responses are delivered through the lcb_pktfwd_callback (and buffers
+ * through the lcb_pktflushed_callback) on the event loop thread, as for
+ * packets passed to lcb_pktfwd3() directly. If forwarding a queued packet
+ * fails, the lcb_pktfwd_callback is invoked with the error and an empty
+ * response, preceded by the lcb_pktflushed_callback unless the packet was
+ * copied.
+ *
+ * The queue is only serviced by event-based I/O plugins.
+ *
+ * @{
+ */
+
+/** @volatile */
+typedef struct lcb_SUBMITQ_st lcb_SUBMITQ;
+
+/**
+ * @volatile
+ *
+ * Create a submission queue for the instance. Must be called on the thread
+ * running the instance's event loop.
+ *
+ * @param instance the handle
+ * @param[out] queue the new queue
+ * @return LCB_SUCCESS on success, LCB_ERR_UNSUPPORTED_OPERATION if the I/O
+ * plugin is completion-based
+ */
+LIBCOUCHBASE_API
+lcb_STATUS lcb_submitq_create(lcb_INSTANCE *instance, lcb_SUBMITQ **queue);
+
+/**
+ * @volatile
+ *
+ * Queue a packet for forwarding. This may be called from any thread.
+ *
+ * The command is copied, and so is the packet itself if lcb_VALBUF::vtype is
+ * LCB_KV_COPY. Otherwise the buffers must remain valid until the
+ * lcb_pktflushed_callback has been invoked for `cookie`.
+ *
+ * @param queue the queue
+ * @param cookie a pointer to be passed to the callbacks for this packet
+ * @param cmd the packet, see lcb_pktfwd3()
+ * @return LCB_SUCCESS if the packet has been queued
+ */
+LIBCOUCHBASE_API
+lcb_STATUS lcb_submitq_push(lcb_SUBMITQ *queue, const void *cookie, const lcb_CMDPKTFWD *cmd);
+
+/**
+ * @volatile
+ *
+ * Forward all packets queued so far. This happens automatically once the
+ * event loop runs, but may be called on the event loop thread to submit the
+ * packets right away.
+ *
+ * @param queue the queue
+ * @return the number of packets taken from the queue
+ */
+LIBCOUCHBASE_API
+lcb_SIZE lcb_submitq_drain(lcb_SUBMITQ *queue);
+
+/**
+ * @volatile
+ *
+ * Forward the packets still queued and release the queue. Must be called on
+ * the event loop thread before the instance is destroyed, and only once no
+ * other thread pushes to the queue anymore.
+ *
+ * @param queue the queue
+ */
+LIBCOUCHBASE_API
+void lcb_submitq_destroy(lcb_SUBMITQ *queue);
+
+/**@}*/
+
 /**
  * @name Response Buffer Handling
  *
@@ -253,6 +341,44 @@ void lcb_backbuf_ref(lcb_BACKBUF buf);
  */
 LIBCOUCHBASE_API
 void lcb_backbuf_unref(lcb_BACKBUF buf);
+
+/**
+ * @volatile
+ *
+ * Pin the network buffer holding the value of a get response, so that the
+ * pointer returned by lcb_respget_value() stays valid after the callback
+ * returns and the value does not need to be copied.
+ *
+ * @param resp the response, only valid inside the callback
+ * @param[out] buf the pinned buffer, release it with lcb_backbuf_unref()
+ * @return LCB_SUCCESS if the buffer has been pinned,
+ *  LCB_ERR_UNSUPPORTED_OPERATION if the value does not live in the network
+ *  buffer (e.g. because it has been decompressed)
+ */
+LIBCOUCHBASE_API
+lcb_STATUS lcb_respget_backbuf(const lcb_RESPGET *resp, lcb_BACKBUF *buf);
+
+/** @volatile Same as lcb_respget_backbuf(), for replica reads */
+LIBCOUCHBASE_API
+lcb_STATUS lcb_respgetreplica_backbuf(const lcb_RESPGETREPLICA *resp, lcb_BACKBUF *buf);
+
+/**
+ * @volatile
+ * Same as lcb_respget_backbuf(), keeps all values returned by
+ * lcb_respsubdoc_result_value() valid.
+ */
+LIBCOUCHBASE_API
+lcb_STATUS lcb_respsubdoc_backbuf(const lcb_RESPSUBDOC *resp, lcb_BACKBUF *buf);
+
+/**
+ * @volatile
+ * Same as lcb_respget_backbuf(), for the value of the response at `index` in
+ * a batch passed to the lcb_batch_callback. Values in a batch always live in
+ * the network buffer, LCB_ERR_UNSUPPORTED_OPERATION is only returned if the
+ * response has no value.
+ */
+LIBCOUCHBASE_API
+lcb_STATUS lcb_respbatch_backbuf(const lcb_RESPBATCH *batch, size_t index, lcb_BACKBUF *buf);
 /**@}*/
 
 /**@}*/
@@ -294,6 +294,27 @@ static int cntl_impl(lcb_io_opt_t io, lcb_socket_t sock, int mode, int option, v
             return cntl_getset_impl(io, sock, mode, IPPROTO_TCP, TCP_NODELAY, sizeof(int), arg);
         case LCB_IO_CNTL_TCP_KEEPALIVE:
             return cntl_getset_impl(io, sock, mode, SOL_SOCKET, SO_KEEPALIVE, sizeof(int), arg);
+#ifdef SO_BUSY_POLL
+        case LCB_IO_CNTL_BUSY_POLL:
+            return cntl_getset_impl(io, sock, mode, SOL_SOCKET, SO_BUSY_POLL, sizeof(int), arg);
+#endif
+#ifdef SO_TIMESTAMPING
+        case LCB_IO_CNTL_TIMESTAMPING:
+            return cntl_getset_impl(io, sock, mode, SOL_SOCKET, SO_TIMESTAMPING, sizeof(int), arg);
+#endif
+#ifdef TCP_USER_TIMEOUT
+        case LCB_IO_CNTL_TCP_USER_TIMEOUT:
+            return cntl_getset_impl(io, sock, mode, IPPROTO_TCP, TCP_USER_TIMEOUT, sizeof(int), arg);
+#endif
+        case LCB_IO_CNTL_ABORTIVE_CLOSE:
+            if (mode == LCB_IO_CNTL_SET) {
+                struct linger lg;
+                lg.l_onoff = *(int *)arg != 0;
+                lg.l_linger = 0;
+                return cntl_getset_impl(io, sock, mode, SOL_SOCKET, SO_LINGER, sizeof(lg), &lg);
+            }
+            LCB_IOPS_ERRNO(io) = ENOTSUP;
+            return -1;
         default:
             LCB_IOPS_ERRNO(io) = ENOTSUP;
             return -1;
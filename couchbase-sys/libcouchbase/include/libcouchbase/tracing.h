@@ -54,6 +54,11 @@ typedef struct lcbtrace_SPAN_Cdummy lcbtrace_SPAN;
  */
 #define LCBTRACE_F_EXTERNAL 0x02
 
+/**
+ * Flag of the tracers created by @ref lcbtrace_otlp_new.
+ */
+#define LCBTRACE_F_OTLP 0x04
+
 /**
  * Service the span is associated with.  Used in threshold logging tracer
  */
@@ -127,6 +132,56 @@ LIBCOUCHBASE_API lcbtrace_TRACER *lcbtrace_new(lcb_INSTANCE *instance, lcb_U64 f
  */
 LIBCOUCHBASE_API void lcbtrace_destroy(lcbtrace_TRACER *tracer);
 
+/**
+ * @brief Receives a batch of spans encoded by the OTLP exporter.
+ *
+ * Invoked on the export thread of the tracer, never on the thread of the
+ * instance, so that the callback may block on the network.
+ *
+ * @param cookie the cookie passed to @ref lcbtrace_otlp_new.
+ * @param payload an `ExportTraceServiceRequest` protobuf message, ready to be
+ *  sent to an OpenTelemetry collector (e.g. with `POST /v1/traces` and
+ *  `Content-Type: application/x-protobuf`), valid during the call only.
+ * @param npayload the size of the message.
+ * @param nspans the number of spans in the message.
+ */
+typedef void (*lcbtrace_OTLP_CALLBACK)(void *cookie, const void *payload, size_t npayload, size_t nspans);
+
+/**
+ * @volatile
+ * @brief Create a tracer which exports the spans in batches in the OTLP format.
+ *
+ * Finishing a span only copies it into a bounded buffer, without locking nor
+ * allocating. A background thread encodes the buffered spans and passes them
+ * to @p callback whenever @ref LCB_CNTL_TRACING_EXPORT_BATCH_SIZE spans are
+ * waiting, or every @ref LCB_CNTL_TRACING_EXPORT_INTERVAL. Spans finished
+ * while the buffer (@ref LCB_CNTL_TRACING_EXPORT_QUEUE_SIZE) is full are
+ * dropped. Use @ref LCB_CNTL_TRACING_SAMPLE_RATE to trace a fraction of the
+ * operations only.
+ *
+ * Install it with @ref lcb_set_tracer, after which it is destroyed along with
+ * the instance. Destroying the tracer exports the remaining spans and stops
+ * the thread.
+ *
+ * @param instance the instance whose settings size the exporter.
+ * @param callback receives the encoded batches.
+ * @param cookie passed to the callback.
+ * @return the tracer, or NULL if the arguments are invalid.
+ */
+LIBCOUCHBASE_API lcbtrace_TRACER *lcbtrace_otlp_new(lcb_INSTANCE *instance, lcbtrace_OTLP_CALLBACK callback,
+                                                    void *cookie);
+
+/**
+ * @volatile
+ * @brief Get the number of spans passed to the callback and dropped so far.
+ *
+ * @param tracer a tracer created by @ref lcbtrace_otlp_new.
+ * @param exported set to the number of spans passed to the callback, may be NULL.
+ * @param dropped set to the number of spans dropped because the buffer was full, may be NULL.
+ * @return LCB_ERR_INVALID_ARGUMENT if the tracer was not created by @ref lcbtrace_otlp_new.
+ */
+LIBCOUCHBASE_API lcb_STATUS lcbtrace_otlp_stats(const lcbtrace_TRACER *tracer, lcb_U64 *exported, lcb_U64 *dropped);
+
 typedef enum {
     LCBTRACE_REF_NONE = 0,
     LCBTRACE_REF_CHILD_OF = 1,
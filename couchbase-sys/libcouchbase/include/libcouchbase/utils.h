@@ -226,7 +226,7 @@ typedef enum lcb_timeunit_t lcb_timeunit_t;
  * there is any results available..
  *
  * @param instance the handle to lcb
- * @return Status of the operation.
+ * @return Status of the operation, LCB_ERR_SDK_FEATURE_UNAVAILABLE if the library was built with `LCB_NO_METRICS`.
  * @committed
  */
 LIBCOUCHBASE_API
@@ -283,6 +283,8 @@ typedef enum {
     LCB_DUMP_BUFINFO = 0x04,
     /** Dump various metrics information */
     LCB_DUMP_METRICS = 0x08,
+    /** Dump the latest events of the flight recorder, see LCB_CNTL_FLIGHT_RECORDER_SIZE */
+    LCB_DUMP_FLIGHTREC = 0x10,
     /** Dump everything */
     LCB_DUMP_ALL = 0xff
 } lcb_DUMPFLAGS;
@@ -304,6 +306,27 @@ typedef enum {
 LIBCOUCHBASE_API
 void lcb_dump(lcb_INSTANCE *instance, FILE *fp, lcb_U32 flags);
 
+/**
+ * @volatile
+ * @brief Write the latest events of the flight recorder to a file descriptor.
+ *
+ * The events are those kept for LCB_DUMP_FLIGHTREC, oldest first, one line
+ * each: how long ago the event happened, its type (`enqueue`, `written`,
+ * `complete`, `fail`, `retry`, `config`, `connect`, `ready`, `sock_error` or
+ * `close`), the index of the server, and the opcode, vbucket and opaque of the
+ * packet if any.
+ *
+ * Unlike lcb_dump(), this function neither allocates nor uses stdio, and may
+ * be called from a signal handler or from another thread while the instance
+ * is running, e.g. to capture a latency incident as it happens. It must not
+ * race with lcb_destroy() or with a change of LCB_CNTL_FLIGHT_RECORDER_SIZE.
+ *
+ * @param instance the handle to dump
+ * @param fd the file descriptor the dump is written to
+ */
+LIBCOUCHBASE_API
+void lcb_dump_flight_recorder(lcb_INSTANCE *instance, int fd);
+
 /** Volatile histogram APIs, used by pillowfight and others */
 struct lcb_histogram_st;
 typedef struct lcb_histogram_st lcb_HISTOGRAM;
@@ -332,6 +355,14 @@ void lcb_histogram_destroy(lcb_HISTOGRAM *hg);
 LIBCOUCHBASE_API
 void lcb_histogram_record(lcb_HISTOGRAM *hg, lcb_U64 duration);
 
+/**
+ * @volatile
+ * Remove all entries from a histogram structure
+ * @param hg the histogram
+ */
+LIBCOUCHBASE_API
+void lcb_histogram_reset(lcb_HISTOGRAM *hg);
+
 typedef void (*lcb_HISTOGRAM_CALLBACK)(const void *cookie, lcb_timeunit_t timeunit, lcb_U32 min, lcb_U32 max,
                                        lcb_U32 total, lcb_U32 maxtotal);
 
@@ -358,6 +389,40 @@ void lcb_histogram_read(const lcb_HISTOGRAM *hg, const void *cookie, lcb_HISTOGR
 LIBCOUCHBASE_API
 void lcb_histogram_print(lcb_HISTOGRAM *hg, FILE *stream);
 
+/**
+ * Called by lcb_get_node_timings() for every node and opcode which completed
+ * operations since timings were enabled. The histogram is empty if none
+ * completed since the previous call.
+ *
+ * @param instance the handle to lcb
+ * @param cookie the cookie passed to lcb_get_node_timings()
+ * @param node the `host:port` of the node
+ * @param opcode the memcached opcode of the operations
+ * @param histogram the latencies of the interval, which may be inspected with
+ *        lcb_histogram_read() or lcb_histogram_print() during the callback
+ */
+typedef void (*lcb_node_timings_callback)(lcb_INSTANCE *instance, const void *cookie, const char *node, lcb_U8 opcode,
+                                          const lcb_HISTOGRAM *histogram);
+
+/**
+ * @uncommitted
+ * Get the latencies of each node and opcode since the previous call.
+ *
+ * While timings are enabled (see lcb_enable_timings()), every KV operation is
+ * recorded both in the histogram returned by lcb_get_timings() and in a
+ * histogram of the node and opcode it was executed with. This hands each of
+ * the latter to the callback and then clears it, so that consecutive calls
+ * report consecutive intervals. Histograms of nodes which left the cluster
+ * map are dropped with the node.
+ *
+ * @param instance the handle to lcb
+ * @param cookie a cookie that will be present in all of the callbacks
+ * @param callback Callback to invoke for each node and opcode
+ * @return LCB_ERR_DOCUMENT_NOT_FOUND if timings are not enabled
+ */
+LIBCOUCHBASE_API
+lcb_STATUS lcb_get_node_timings(lcb_INSTANCE *instance, const void *cookie, lcb_node_timings_callback callback);
+
 /**
  * @defgroup lcb-collections-api Collections Management
  * @brief Managing collections in the bucket
@@ -400,6 +465,35 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdgetcid_collection(lcb_CMDGETCID *cmd, const c
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdgetcid_timeout(lcb_CMDGETCID *cmd, uint32_t timeout);
 
 LIBCOUCHBASE_API lcb_STATUS lcb_getcid(lcb_INSTANCE *instance, void *cookie, const lcb_CMDGETCID *cmd);
+
+/**
+ * Resolve the IDs of several collections of one scope ahead of their first use.
+ *
+ * A `GET_CID` request is scheduled for every collection which is not in the
+ * collection cache yet, so that operations on it do not have to wait for the
+ * lookup later on. Every request is answered through the LCB_CALLBACK_GETCID
+ * callback with the given cookie, and successful answers are added to the
+ * cache, just as they are for lcb_getcid().
+ *
+ * @param instance the instance
+ * @param cookie the cookie passed to the callback of every request
+ * @param scope name of the scope, or NULL for the default scope
+ * @param scope_len length of the scope name
+ * @param collections names of the collections
+ * @param collections_len lengths of the collection names
+ * @param ncollections number of collections
+ * @param[out] nscheduled if not NULL, receives the number of requests (i.e.
+ *  callbacks) which were scheduled. Zero if all collections were known
+ * @return LCB_SUCCESS, or the error which prevented scheduling. In the latter
+ *  case no requests are sent, unless the call was made between
+ *  lcb_sched_enter() and lcb_sched_leave()
+ *
+ * @uncommitted
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_collection_prefetch(lcb_INSTANCE *instance, void *cookie, const char *scope,
+                                                    size_t scope_len, const char *const *collections,
+                                                    const size_t *collections_len, size_t ncollections,
+                                                    size_t *nscheduled);
 /** @} */
 
 /**
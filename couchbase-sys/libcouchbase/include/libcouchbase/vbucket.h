@@ -110,6 +110,7 @@ typedef struct {
     char *alt_hostname;         /**< selected alternative hostname for the node */
     lcbvb_SERVICES alt_svc;     /**< selected alternative plain services */
     lcbvb_SERVICES alt_svc_ssl; /**< selected alternative SSL Services */
+    char *server_group;         /**< Server group (availability zone) of the node, or NULL */
 } lcbvb_SERVER;
 
 /**@volatile. ABI/API compatibility not guaranteed between versions */
@@ -172,6 +173,7 @@ typedef struct lcbvb_CONFIG_st {
     int *randbuf;               /* Used for random server selection */
     uint64_t caps;              /**< Bucket capabilities */
     uint64_t ccaps;             /**< Cluster capabilities */
+    lcbvb_CONTINUUM *ketama_tree; /* continuum in Eytzinger (BFS) order, from index 1 */
 } lcbvb_CONFIG;
 
 #define LCBVB_BUCKET_NAME(cfg) (cfg)->bname
@@ -234,6 +236,20 @@ int lcbvb_load_json(lcbvb_CONFIG *vbc, const char *data);
 LIBCOUCHBASE_API
 int lcbvb_load_json_ex(lcbvb_CONFIG *vbc, const char *data, const char *source, char **network);
 
+/**
+ * @uncommitted
+ *
+ * Extract the revision of a configuration without parsing it. This is much
+ * cheaper than lcbvb_load_json(), and allows to drop payloads whose revision
+ * is already known.
+ * @param data the JSON text of the configuration
+ * @param[out] revepoch the value of `revEpoch`, or -1 if missing
+ * @param[out] revid the value of `rev`, or -1 if missing
+ * @return 0 on success, -1 if the text is not a JSON object
+ */
+LIBCOUCHBASE_API
+int lcbvb_get_json_revision(const char *data, int64_t *revepoch, int64_t *revid);
+
 /**@brief Serialize the current config as a JSON string.
  * @volatile
  * Serialize the current configuration as a JSON string. The string returned is
@@ -242,6 +258,35 @@ int lcbvb_load_json_ex(lcbvb_CONFIG *vbc, const char *data, const char *source,
 LIBCOUCHBASE_API
 char *lcbvb_save_json(lcbvb_CONFIG *vbc);
 
+/** First bytes of the output of lcbvb_save_binary() */
+#define LCBVB_BINARY_MAGIC "LCBVBIN"
+
+/**
+ * @uncommitted
+ *
+ * Serialize the current config in a compact binary form, which can be
+ * loaded without parsing the vBucket maps. The format is meant for local
+ * caches, and is only readable by the same library version on hosts of the
+ * same byte order.
+ * @param vbc the configuration
+ * @param[out] nbuf the size of the returned buffer
+ * @return a buffer to be freed with free(), or NULL on allocation failure
+ */
+LIBCOUCHBASE_API
+char *lcbvb_save_binary(lcbvb_CONFIG *vbc, lcb_SIZE *nbuf);
+
+/**
+ * @uncommitted
+ *
+ * Load a configuration serialized with lcbvb_save_binary()
+ * @param vbc a new configuration object returned via lcbvb_create()
+ * @param buf the buffer, which is not referenced after this call returns
+ * @param nbuf the size of the buffer
+ * @return 0 on success, -1 on error. See lcbvb_get_error()
+ */
+LIBCOUCHBASE_API
+int lcbvb_load_binary(lcbvb_CONFIG *vbc, const void *buf, lcb_SIZE nbuf);
+
 /**
  * @committed
  * @brief Return a string indicating why parsing the configuration failed
@@ -360,6 +405,23 @@ int lcbvb_map_key(lcbvb_CONFIG *cfg, const void *key, lcb_SIZE n, int *vbid, int
 LIBCOUCHBASE_API
 int lcbvb_k2vb(lcbvb_CONFIG *cfg, const void *key, lcb_SIZE n);
 
+/**
+ * @uncommitted
+ *
+ * Map several keys at once. This is equivalent to calling lcbvb_map_key()
+ * for each key, but the distribution type is only checked once.
+ * @param cfg The configuration object
+ * @param keys Array of `n` keys
+ * @param nkeys Array of `n` key lengths
+ * @param n Number of keys
+ * @param[out] vbids Will contain the vBucket of each key. May be NULL
+ * @param[out] srvixs Will contain the server index of each key
+ * @return 0 for now
+ */
+LIBCOUCHBASE_API
+int lcbvb_map_keys_batch(lcbvb_CONFIG *cfg, const void *const *keys, const lcb_SIZE *nkeys, lcb_SIZE n, int *vbids,
+                         int *srvixs);
+
 /**
  * @uncommitted
  * Determines if a given server index is either a master or a replica for a
@@ -468,6 +530,17 @@ const char *lcbvb_get_hostport(lcbvb_CONFIG *cfg, unsigned ix, lcbvb_SVCTYPE typ
 LIBCOUCHBASE_API
 const char *lcbvb_get_hostname(const lcbvb_CONFIG *cfg, unsigned ix);
 
+/**
+ * @brief Get the server group of a node
+ *
+ * @param cfg the configuration
+ * @param ix the index of the server to look up
+ * @return the name of the server group, or NULL if the index is out of bounds
+ * or the configuration does not list the group of the node
+ */
+LIBCOUCHBASE_API
+const char *lcbvb_get_server_group(const lcbvb_CONFIG *cfg, unsigned ix);
+
 /**
  * Function to return the URL prefix for a REST service.
  *
@@ -506,6 +579,19 @@ int lcbvb_get_randhost(const lcbvb_CONFIG *cfg, lcbvb_SVCTYPE type, lcbvb_SVCMOD
 LIBCOUCHBASE_API
 int lcbvb_get_randhost_ex(const lcbvb_CONFIG *cfg, lcbvb_SVCTYPE type, lcbvb_SVCMODE mode, int *used);
 
+/**
+ * Get random node, preferring the nodes of a server group
+ *
+ * Like lcbvb_get_randhost_ex(), but if any of the remaining nodes with the
+ * service belongs to `group`, one of those is returned.
+ *
+ * @param group the server group to prefer, or NULL for no preference
+ * @return a server index, or -1 if no server remains
+ */
+LIBCOUCHBASE_API
+int lcbvb_get_randhost_group(const lcbvb_CONFIG *cfg, lcbvb_SVCTYPE type, lcbvb_SVCMODE mode, int *used,
+                             const char *group);
+
 /** @brief Structure representing changes between two configurations */
 typedef struct {
     /** List of strings of servers added (via `host:data_port`) */
@@ -214,6 +214,19 @@ typedef enum {
     PROTOCOL_BINARY_RESPONSE_SYNC_WRITE_AMBIGUOUS = 0xa3,
     PROTOCOL_BINARY_RESPONSE_SYNC_WRITE_RE_COMMIT_IN_PROGRESS = 0xa4,
 
+    /*
+     * Range scan specific responses.
+     */
+
+    /** The range scan was cancelled */
+    PROTOCOL_BINARY_RESPONSE_RANGE_SCAN_CANCELLED = 0xa5,
+    /** The range scan has more items, to be read by another continue */
+    PROTOCOL_BINARY_RESPONSE_RANGE_SCAN_MORE = 0xa6,
+    /** The range scan returned all of its items */
+    PROTOCOL_BINARY_RESPONSE_RANGE_SCAN_COMPLETE = 0xa7,
+    /** The vbucket uuid of the snapshot requirements does not match */
+    PROTOCOL_BINARY_RESPONSE_RANGE_SCAN_VB_UUID_NOT_EQUAL = 0xa8,
+
     /*
      * Sub-document specific responses.
      */
@@ -398,6 +411,11 @@ typedef enum {
     /* Subdoc additions for Spock: */
     PROTOCOL_BINARY_CMD_SUBDOC_GET_COUNT = 0xd2,
 
+    /* Range scan commands */
+    PROTOCOL_BINARY_CMD_RANGE_SCAN_CREATE = 0xda,
+    PROTOCOL_BINARY_CMD_RANGE_SCAN_CONTINUE = 0xdb,
+    PROTOCOL_BINARY_CMD_RANGE_SCAN_CANCEL = 0xdc,
+
     /* get error code mappings */
     PROTOCOL_BINARY_CMD_GET_ERROR_MAP = 0xfe,
 
@@ -0,0 +1,45 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LIBCOUCHBASE_EPOLL_IO_OPTS_H
+#define LIBCOUCHBASE_EPOLL_IO_OPTS_H 1
+
+#include <libcouchbase/couchbase.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Create an instance of an event based I/O handler which uses the native
+ * readiness notification of the system: epoll(7) on Linux, kqueue(2) on BSD
+ * and macOS. Unlike the select(2) plugin it has no limit on the value of the
+ * file descriptors, and its cost does not grow with the number of sockets.
+ *
+ * @param version must be 0
+ * @param io set to the new I/O handler on success
+ * @param arg unused
+ * @return status of the operation
+ */
+LIBCOUCHBASE_API
+lcb_STATUS lcb_create_epoll_io_opts(int version, lcb_io_opt_t *io, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,627 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/**
+ * Event-based I/O plugin on top of the readiness notification of the kernel:
+ * epoll(7) on Linux, kqueue(2) on BSD and macOS.
+ *
+ * Unlike the select(2) plugin, the set of watched sockets lives in the kernel.
+ * A socket is only (re)registered when the library changes the events it
+ * waits for, so a loop iteration costs one wait system call no matter how
+ * many sockets are open, and there is no FD_SETSIZE limit.
+ *
+ * The registrations are level-triggered: the library does not always read a
+ * socket until it would block (see LCB_CNTL_READ_CHUNKSIZE), and would miss
+ * the rest of the data with edge-triggered ones.
+ *
+ * Timers are kept in a sorted list like in the select(2) plugin. On Linux the
+ * earliest one is armed on a timerfd watched by the epoll descriptor, which
+ * gives them the precision of the clock rather than the milliseconds of the
+ * epoll_wait(2) timeout.
+ */
+
+#define LCB_IOPS_V12_NO_DEPRECATE
+
+#include "internal.h"
+#include "epoll_io_opts.h"
+#include <libcouchbase/plugins/io/bsdio-inl.c>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+typedef struct epoll_event ep_RESULT;
+#else
+#include <sys/types.h>
+#include <sys/event.h>
+#include <sys/time.h>
+typedef struct kevent ep_RESULT;
+#endif
+
+/** Maximum number of notifications fetched by one wait */
+#define EP_MAX_RESULTS 64
+
+typedef struct ep_EVENT ep_EVENT;
+struct ep_EVENT {
+    lcb_list_t list;
+    lcb_socket_t sock;
+    short flags;
+    /** socket and flags registered with the kernel */
+    lcb_socket_t ksock;
+    short kflags;
+    void *cb_data;
+    lcb_ioE_callback handler;
+};
+
+typedef struct ep_TIMER ep_TIMER;
+struct ep_TIMER {
+    lcb_list_t list;
+    int active;
+    hrtime_t exptime;
+    void *cb_data;
+    lcb_ioE_callback handler;
+};
+
+typedef struct {
+    /** epoll or kqueue descriptor */
+    int pfd;
+    /** timerfd, or -1 if the timers use the timeout of the wait */
+    int tfd;
+    /** deadline the timerfd is armed for, 0 if it is not armed */
+    hrtime_t tfd_exptime;
+    lcb_list_t events;
+    lcb_list_t timers;
+    /** number of events with a non-zero set of flags */
+    unsigned nwatched;
+    int event_loop;
+    /** notifications of the last wait; those of freed events are cleared */
+    ep_RESULT results[EP_MAX_RESULTS];
+    int nresults;
+    int iresult;
+} ep_LOOP;
+
+#ifdef __linux__
+static int backend_init(ep_LOOP *io)
+{
+    struct epoll_event ee;
+
+    io->pfd = epoll_create1(EPOLL_CLOEXEC);
+    if (io->pfd == -1) {
+        return -1;
+    }
+    io->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (io->tfd != -1) {
+        memset(&ee, 0, sizeof(ee));
+        ee.events = EPOLLIN;
+        /* the loop itself stands for the timerfd in the notifications */
+        ee.data.ptr = io;
+        if (epoll_ctl(io->pfd, EPOLL_CTL_ADD, io->tfd, &ee) != 0) {
+            close(io->tfd);
+            io->tfd = -1;
+        }
+    }
+    return 0;
+}
+
+static int backend_apply(ep_LOOP *io, ep_EVENT *ev)
+{
+    struct epoll_event ee;
+    int op;
+
+    memset(&ee, 0, sizeof(ee));
+    if (ev->ksock != INVALID_SOCKET && (ev->ksock != ev->sock || ev->flags == 0)) {
+        /* fails if the socket was closed already, which removed it anyway */
+        epoll_ctl(io->pfd, EPOLL_CTL_DEL, ev->ksock, &ee);
+        ev->ksock = INVALID_SOCKET;
+        ev->kflags = 0;
+    }
+    if (ev->flags == 0 || (ev->ksock == ev->sock && ev->kflags == ev->flags)) {
+        return 0;
+    }
+
+    if (ev->flags & LCB_READ_EVENT) {
+        ee.events |= EPOLLIN;
+    }
+    if (ev->flags & LCB_WRITE_EVENT) {
+        ee.events |= EPOLLOUT;
+    }
+    ee.data.ptr = ev;
+    op = ev->ksock == INVALID_SOCKET ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+    if (epoll_ctl(io->pfd, op, ev->sock, &ee) != 0) {
+        if (op == EPOLL_CTL_MOD && errno == ENOENT) {
+            op = EPOLL_CTL_ADD;
+        } else if (op == EPOLL_CTL_ADD && errno == EEXIST) {
+            op = EPOLL_CTL_MOD;
+        } else {
+            return -1;
+        }
+        if (epoll_ctl(io->pfd, op, ev->sock, &ee) != 0) {
+            return -1;
+        }
+    }
+    ev->ksock = ev->sock;
+    ev->kflags = ev->flags;
+    return 0;
+}
+
+static int arm_timerfd(ep_LOOP *io, hrtime_t deadline, hrtime_t now)
+{
+    struct itimerspec its;
+    hrtime_t delta = deadline - now;
+
+    if (io->tfd_exptime != 0 && io->tfd_exptime <= deadline) {
+        /* it fires first, and will be armed again then */
+        return 0;
+    }
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = (time_t)(delta / LCB_S2NS(1));
+    its.it_value.tv_nsec = (long)(delta % LCB_S2NS(1));
+    if (timerfd_settime(io->tfd, 0, &its, NULL) != 0) {
+        return -1;
+    }
+    io->tfd_exptime = deadline;
+    return 0;
+}
+
+static int backend_wait(ep_LOOP *io, hrtime_t deadline, hrtime_t now)
+{
+    int timeout = -1;
+    int ret;
+
+    if (deadline != 0) {
+        if (deadline <= now) {
+            timeout = 0;
+        } else if (io->tfd == -1 || arm_timerfd(io, deadline, now) != 0) {
+            /* round up, so that the timers are not run too early */
+            timeout = (int)LCB_NS2MS(deadline - now + LCB_MS2NS(1) - 1);
+        }
+    }
+    ret = epoll_wait(io->pfd, io->results, EP_MAX_RESULTS, timeout);
+    if (ret == -1 && errno == EINTR) {
+        return 0;
+    }
+    return ret;
+}
+
+static void drain_timer(ep_LOOP *io)
+{
+    uint64_t expirations;
+    ssize_t nr = read(io->tfd, &expirations, sizeof(expirations));
+    (void)nr;
+    io->tfd_exptime = 0;
+}
+
+static void *result_ptr(ep_RESULT *res)
+{
+    return res->data.ptr;
+}
+
+static void clear_result(ep_RESULT *res)
+{
+    res->data.ptr = NULL;
+}
+
+static short result_flags(ep_RESULT *res)
+{
+    short which = 0;
+    if (res->events & (EPOLLIN | EPOLLHUP)) {
+        which |= LCB_READ_EVENT;
+    }
+    if (res->events & (EPOLLOUT | EPOLLHUP)) {
+        which |= LCB_WRITE_EVENT;
+    }
+    if (res->events & EPOLLERR) {
+        which = LCB_ERROR_EVENT | LCB_RW_EVENT; /** It should error */
+    }
+    return which;
+}
+
+#else /* kqueue */
+
+static int backend_init(ep_LOOP *io)
+{
+    io->tfd = -1;
+    io->pfd = kqueue();
+    if (io->pfd == -1) {
+        return -1;
+    }
+    fcntl(io->pfd, F_SETFD, FD_CLOEXEC);
+    return 0;
+}
+
+static int kq_change(ep_LOOP *io, lcb_socket_t sock, short filter, unsigned short flags, ep_EVENT *ev)
+{
+    struct kevent kev;
+    EV_SET(&kev, sock, filter, flags, 0, 0, ev);
+    return kevent(io->pfd, &kev, 1, NULL, 0, NULL);
+}
+
+static int backend_apply(ep_LOOP *io, ep_EVENT *ev)
+{
+    short add = ev->flags;
+    short del = ev->kflags;
+
+    if (ev->ksock == ev->sock) {
+        add &= ~ev->kflags;
+        del &= ~ev->flags;
+    }
+    /* deleting fails if the socket was closed already, which removed it anyway */
+    if (del & LCB_READ_EVENT) {
+        kq_change(io, ev->ksock, EVFILT_READ, EV_DELETE, NULL);
+    }
+    if (del & LCB_WRITE_EVENT) {
+        kq_change(io, ev->ksock, EVFILT_WRITE, EV_DELETE, NULL);
+    }
+    ev->kflags &= ~del;
+    if (ev->kflags == 0) {
+        ev->ksock = INVALID_SOCKET;
+    }
+    if (add == 0) {
+        return 0;
+    }
+
+    if ((add & LCB_READ_EVENT) && kq_change(io, ev->sock, EVFILT_READ, EV_ADD, ev) != 0) {
+        return -1;
+    }
+    if ((add & LCB_WRITE_EVENT) && kq_change(io, ev->sock, EVFILT_WRITE, EV_ADD, ev) != 0) {
+        return -1;
+    }
+    ev->ksock = ev->sock;
+    ev->kflags = ev->flags;
+    return 0;
+}
+
+static int backend_wait(ep_LOOP *io, hrtime_t deadline, hrtime_t now)
+{
+    struct timespec ts, *tsp = NULL;
+    int ret;
+
+    if (deadline != 0) {
+        hrtime_t delta = deadline > now ? deadline - now : 0;
+        ts.tv_sec = (time_t)(delta / LCB_S2NS(1));
+        ts.tv_nsec = (long)(delta % LCB_S2NS(1));
+        tsp = &ts;
+    }
+    ret = kevent(io->pfd, NULL, 0, io->results, EP_MAX_RESULTS, tsp);
+    if (ret == -1 && errno == EINTR) {
+        return 0;
+    }
+    return ret;
+}
+
+static void drain_timer(ep_LOOP *io)
+{
+    (void)io;
+}
+
+static void *result_ptr(ep_RESULT *res)
+{
+    return (void *)res->udata;
+}
+
+static void clear_result(ep_RESULT *res)
+{
+    res->udata = NULL;
+}
+
+static short result_flags(ep_RESULT *res)
+{
+    if ((res->flags & EV_ERROR) || ((res->flags & EV_EOF) && res->fflags != 0)) {
+        return LCB_ERROR_EVENT | LCB_RW_EVENT; /** It should error */
+    }
+    return res->filter == EVFILT_READ ? LCB_READ_EVENT : LCB_WRITE_EVENT;
+}
+#endif
+
+static int timer_cmp_asc(lcb_list_t *a, lcb_list_t *b)
+{
+    ep_TIMER *ta = LCB_LIST_ITEM(a, ep_TIMER, list);
+    ep_TIMER *tb = LCB_LIST_ITEM(b, ep_TIMER, list);
+    if (ta->exptime > tb->exptime) {
+        return 1;
+    } else if (ta->exptime < tb->exptime) {
+        return -1;
+    } else {
+        return 0;
+    }
+}
+
+static void set_flags(ep_LOOP *io, ep_EVENT *ev, short flags)
+{
+    if (ev->flags == 0 && flags != 0) {
+        io->nwatched++;
+    } else if (ev->flags != 0 && flags == 0) {
+        io->nwatched--;
+    }
+    ev->flags = flags;
+}
+
+static void *ep_event_new(lcb_io_opt_t iops)
+{
+    ep_LOOP *io = iops->v.v2.cookie;
+    ep_EVENT *ret = calloc(1, sizeof(ep_EVENT));
+    if (ret != NULL) {
+        ret->sock = INVALID_SOCKET;
+        ret->ksock = INVALID_SOCKET;
+        lcb_list_append(&io->events, &ret->list);
+    }
+    return ret;
+}
+
+static int ep_event_update(lcb_io_opt_t iops, lcb_socket_t sock, void *event, short flags, void *cb_data,
+                           lcb_ioE_callback handler)
+{
+    ep_LOOP *io = iops->v.v2.cookie;
+    ep_EVENT *ev = event;
+    ev->sock = sock;
+    ev->handler = handler;
+    ev->cb_data = cb_data;
+    set_flags(io, ev, flags & LCB_RW_EVENT);
+    if (backend_apply(io, ev) != 0) {
+        iops->v.v3.error = errno;
+        return -1;
+    }
+    return 0;
+}
+
+static void ep_event_cancel(lcb_io_opt_t iops, lcb_socket_t sock, void *event)
+{
+    ep_LOOP *io = iops->v.v2.cookie;
+    ep_EVENT *ev = event;
+    set_flags(io, ev, 0);
+    ev->cb_data = NULL;
+    ev->handler = NULL;
+    backend_apply(io, ev);
+    (void)sock;
+}
+
+static void ep_event_free(lcb_io_opt_t iops, void *event)
+{
+    ep_LOOP *io = iops->v.v2.cookie;
+    ep_EVENT *ev = event;
+    int ii;
+
+    ep_event_cancel(iops, ev->sock, ev);
+    /* the loop might be dispatching the notifications of the last wait */
+    for (ii = io->iresult; ii < io->nresults; ii++) {
+        if (result_ptr(&io->results[ii]) == ev) {
+            clear_result(&io->results[ii]);
+        }
+    }
+    lcb_list_delete(&ev->list);
+    free(ev);
+}
+
+static void *ep_timer_new(lcb_io_opt_t iops)
+{
+    ep_TIMER *ret = calloc(1, sizeof(ep_TIMER));
+    (void)iops;
+    return ret;
+}
+
+static void ep_timer_cancel(lcb_io_opt_t iops, void *timer)
+{
+    ep_TIMER *tm = timer;
+    if (tm->active) {
+        tm->active = 0;
+        lcb_list_delete(&tm->list);
+    }
+    (void)iops;
+}
+
+static void ep_timer_free(lcb_io_opt_t iops, void *timer)
+{
+    ep_timer_cancel(iops, timer);
+    free(timer);
+}
+
+static int ep_timer_schedule(lcb_io_opt_t iops, void *timer, lcb_U32 usec, void *cb_data, lcb_ioE_callback handler)
+{
+    ep_TIMER *tm = timer;
+    ep_LOOP *io = iops->v.v2.cookie;
+    lcb_assert(!tm->active);
+    tm->exptime = gethrtime() + (usec * (hrtime_t)1000);
+    tm->cb_data = cb_data;
+    tm->handler = handler;
+    tm->active = 1;
+    lcb_list_add_sorted(&io->timers, &tm->list, timer_cmp_asc);
+    return 0;
+}
+
+static void ep_stop_loop(struct lcb_io_opt_st *iops)
+{
+    ep_LOOP *io = iops->v.v2.cookie;
+    io->event_loop = 0;
+}
+
+static ep_TIMER *pop_next_timer(ep_LOOP *io, hrtime_t now)
+{
+    ep_TIMER *ret;
+
+    if (LCB_LIST_IS_EMPTY(&io->timers)) {
+        return NULL;
+    }
+
+    ret = LCB_LIST_ITEM(io->timers.next, ep_TIMER, list);
+    if (ret->exptime > now) {
+        return NULL;
+    }
+    lcb_list_shift(&io->timers);
+    ret->active = 0;
+    return ret;
+}
+
+static void run_loop(ep_LOOP *io, int is_tick)
+{
+    io->event_loop = !is_tick;
+    do {
+        hrtime_t now = gethrtime();
+        hrtime_t deadline = 0;
+        ep_TIMER *tm;
+        int ret;
+
+        if (!LCB_LIST_IS_EMPTY(&io->timers)) {
+            deadline = LCB_LIST_ITEM(io->timers.next, ep_TIMER, list)->exptime;
+        } else if (io->nwatched == 0) {
+            io->event_loop = 0;
+            return;
+        }
+        if (is_tick) {
+            /* only handle what is ready */
+            deadline = now;
+        }
+
+        ret = backend_wait(io, deadline, now);
+        if (ret == -1) {
+            return;
+        }
+        io->nresults = ret;
+        io->iresult = 0;
+
+        /** Always invoke the pending timers */
+        now = gethrtime();
+        while ((tm = pop_next_timer(io, now))) {
+            tm->handler(-1, 0, tm->cb_data);
+        }
+
+        for (; io->iresult < io->nresults; io->iresult++) {
+            ep_RESULT *res = &io->results[io->iresult];
+            ep_EVENT *ev = result_ptr(res);
+            short which;
+
+            if ((void *)ev == (void *)io) {
+                drain_timer(io);
+                continue;
+            }
+            if (ev == NULL || ev->flags == 0) {
+                continue;
+            }
+            /* only report what is watched, which a callback might have changed since the wait */
+            which = result_flags(res) & (ev->flags | LCB_ERROR_EVENT);
+            if (which != 0) {
+                ev->handler(ev->sock, which, ev->cb_data);
+            }
+        }
+        io->nresults = 0;
+    } while (io->event_loop);
+}
+
+static void ep_run_loop(struct lcb_io_opt_st *iops)
+{
+    run_loop(iops->v.v2.cookie, 0);
+}
+
+static void ep_tick_loop(struct lcb_io_opt_st *iops)
+{
+    run_loop(iops->v.v2.cookie, 1);
+}
+
+static void ep_destroy_iops(struct lcb_io_opt_st *iops)
+{
+    ep_LOOP *io = iops->v.v2.cookie;
+    lcb_list_t *nn, *ii;
+
+    if (io->event_loop != 0) {
+        fprintf(stderr, "WARN: libcouchbase(plugin-epoll): the event loop might be still active, but it still try to "
+                        "free resources\n");
+    }
+    LCB_LIST_SAFE_FOR(ii, nn, &io->events)
+    {
+        ep_event_free(iops, LCB_LIST_ITEM(ii, ep_EVENT, list));
+    }
+    lcb_assert(LCB_LIST_IS_EMPTY(&io->events));
+    LCB_LIST_SAFE_FOR(ii, nn, &io->timers)
+    {
+        ep_timer_free(iops, LCB_LIST_ITEM(ii, ep_TIMER, list));
+    }
+    lcb_assert(LCB_LIST_IS_EMPTY(&io->timers));
+    if (io->tfd != -1) {
+        close(io->tfd);
+    }
+    close(io->pfd);
+    free(io);
+    free(iops);
+}
+
+static void procs2_ep_callback(int version, lcb_loop_procs *loop_procs, lcb_timer_procs *timer_procs,
+                               lcb_bsd_procs *bsd_procs, lcb_ev_procs *ev_procs,
+                               lcb_completion_procs *completion_procs, lcb_iomodel_t *iomodel)
+{
+    ev_procs->create = ep_event_new;
+    ev_procs->destroy = ep_event_free;
+    ev_procs->watch = ep_event_update;
+    ev_procs->cancel = ep_event_cancel;
+
+    timer_procs->create = ep_timer_new;
+    timer_procs->destroy = ep_timer_free;
+    timer_procs->schedule = ep_timer_schedule;
+    timer_procs->cancel = ep_timer_cancel;
+
+    loop_procs->start = ep_run_loop;
+    loop_procs->stop = ep_stop_loop;
+    loop_procs->tick = ep_tick_loop;
+
+    *iomodel = LCB_IOMODEL_EVENT;
+    wire_lcb_bsd_impl2(bsd_procs, version);
+    (void)completion_procs;
+}
+
+LIBCOUCHBASE_API
+lcb_STATUS lcb_create_epoll_io_opts(int version, lcb_io_opt_t *io, void *arg)
+{
+    lcb_io_opt_t ret;
+    ep_LOOP *cookie;
+
+    if (version != 0) {
+        return LCB_ERR_PLUGIN_VERSION_MISMATCH;
+    }
+    ret = calloc(1, sizeof(*ret));
+    cookie = calloc(1, sizeof(*cookie));
+    if (ret == NULL || cookie == NULL) {
+        free(ret);
+        free(cookie);
+        return LCB_ERR_NO_MEMORY;
+    }
+    if (backend_init(cookie) != 0) {
+        free(ret);
+        free(cookie);
+        return LCB_ERR_SDK_INTERNAL;
+    }
+    lcb_list_init(&cookie->events);
+    lcb_list_init(&cookie->timers);
+
+    /* setup io iops! */
+    ret->version = 3;
+    ret->dlhandle = NULL;
+    ret->destructor = ep_destroy_iops;
+
+    /* consider that struct isn't allocated by the library,
+     * `need_cleanup' flag might be set in lcb_create() */
+    ret->v.v3.need_cleanup = 0;
+    ret->v.v3.get_procs = procs2_ep_callback;
+    ret->v.v3.cookie = cookie;
+
+    /* For backwards compatibility */
+    wire_lcb_bsd_impl(ret);
+
+    *io = ret;
+    (void)arg;
+    return LCB_SUCCESS;
+}
@@ -58,6 +58,8 @@ typedef struct {
     lcb_ioC_read2_callback callback;
 } my_tcp_t;
 
+struct my_write_st;
+
 /**
  * Wrapper for lcb_sockdata_t
  */
@@ -84,14 +86,65 @@ typedef struct {
         int write;
     } pending;
 
+    /**
+     * Writes started while the uv_write of the socket is in flight. They are
+     * sent together in a single uv_write once it completes.
+     */
+    struct my_write_st *wbatch;
+
 } my_sockdata_t;
 
 typedef struct {
-    uv_write_t w;
     lcb_ioC_write2_callback callback;
+    void *arg;
+} my_write_cb_t;
+
+/**
+ * A uv_write, which carries the buffers and callbacks of one or more
+ * write2 calls
+ */
+typedef struct my_write_st {
+    uv_write_t w;
     my_sockdata_t *sock;
+
+    uv_buf_t *bufs;
+    unsigned nbufs;
+    unsigned bufs_cap;
+
+    my_write_cb_t *cbs;
+    unsigned ncbs;
+    unsigned cbs_cap;
+
+    /** Next descriptor in the free list */
+    struct my_write_st *next;
 } my_write_t;
 
+typedef struct my_uvreq_st {
+    union {
+        uv_connect_t conn;
+        uv_idle_t idle;
+    } uvreq;
+
+    union {
+        lcb_io_connect_cb conn;
+        generic_callback_t cb_;
+    } cb;
+
+    my_sockdata_t *socket;
+
+    /** Next descriptor in the free list */
+    struct my_uvreq_st *next;
+} my_uvreq_t;
+
+struct my_timer_st;
+
+/**
+ * Maximum number of descriptors of each kind kept in the free lists of the
+ * iops, rather than freed, so that the event loop does not go through the
+ * heap for every write, connection and timer
+ */
+#define LCBUV_FREELIST_MAX 256
+
 typedef struct {
     struct lcb_io_opt_st base;
     uv_loop_t *loop;
@@ -107,28 +160,27 @@ typedef struct {
 
     /** for 0.8 only, whether to stop */
     int do_stop;
+
+    /** Released descriptors, for reuse */
+    struct {
+        my_write_t *writes;
+        my_uvreq_t *reqs;
+        struct my_timer_st *timers;
+        unsigned nwrites;
+        unsigned nreqs;
+        unsigned ntimers;
+    } freelist;
 } my_iops_t;
 
-typedef struct {
+typedef struct my_timer_st {
     uv_timer_t uvt;
     v0_callback_t callback;
     void *cb_arg;
     my_iops_t *parent;
-} my_timer_t;
-
-typedef struct {
-    union {
-        uv_connect_t conn;
-        uv_idle_t idle;
-    } uvreq;
-
-    union {
-        lcb_io_connect_cb conn;
-        generic_callback_t cb_;
-    } cb;
 
-    my_sockdata_t *socket;
-} my_uvreq_t;
+    /** Next timer in the free list, once closed */
+    struct my_timer_st *next;
+} my_timer_t;
 
 /******************************************************************************
  ******************************************************************************
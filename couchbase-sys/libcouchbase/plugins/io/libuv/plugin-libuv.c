@@ -19,12 +19,20 @@
 #include <libcouchbase/plugins/io/bsdio-inl.c>
 
 static my_uvreq_t *alloc_uvreq(my_sockdata_t *sock, generic_callback_t callback);
+static void release_uvreq(my_iops_t *io, my_uvreq_t *uvr);
 static void set_last_error(my_iops_t *io, int error);
 static void socket_closed_callback(uv_handle_t *handle);
 
 static void wire_iops2(int version, lcb_loop_procs *loop, lcb_timer_procs *timer, lcb_bsd_procs *bsd, lcb_ev_procs *ev,
                        lcb_completion_procs *iocp, lcb_iomodel_t *model);
 
+static void free_write(my_write_t *w)
+{
+    free(w->bufs);
+    free(w->cbs);
+    free(w);
+}
+
 static void decref_iops(my_iops_t *io)
 {
     lcb_assert(io->iops_refcount);
@@ -32,6 +40,22 @@ static void decref_iops(my_iops_t *io)
         return;
     }
 
+    while (io->freelist.writes) {
+        my_write_t *w = io->freelist.writes;
+        io->freelist.writes = w->next;
+        free_write(w);
+    }
+    while (io->freelist.reqs) {
+        my_uvreq_t *uvr = io->freelist.reqs;
+        io->freelist.reqs = uvr->next;
+        free(uvr);
+    }
+    while (io->freelist.timers) {
+        my_timer_t *timer = io->freelist.timers;
+        io->freelist.timers = timer->next;
+        free(timer);
+    }
+
     memset(io, 0xff, sizeof(*io));
     free(io);
 }
@@ -241,6 +265,9 @@ static void socket_closed_callback(uv_handle_t *handle)
     my_sockdata_t *sock = PTR_FROM_FIELD(my_sockdata_t, handle, tcp);
     my_iops_t *io = (my_iops_t *)sock->base.parent;
 
+    /* batches are sent (or failed) when the write before them completes */
+    lcb_assert(sock->wbatch == NULL);
+
     if (sock->pending.read) {
         CbREQ (&sock->tcp)(&sock->base, -1, sock->rdarg);
     }
@@ -291,15 +318,16 @@ static int cntl_socket(lcb_io_opt_t iobase, lcb_sockdata_t *sockbase, int mode,
 static void connect_callback(uv_connect_t *req, int status)
 {
     my_uvreq_t *uvr = (my_uvreq_t *)req;
+    my_iops_t *io = (my_iops_t *)uvr->socket->base.parent;
 
-    set_last_error((my_iops_t *)uvr->socket->base.parent, status);
+    set_last_error(io, status);
 
     if (uvr->cb.conn) {
         uvr->cb.conn(&uvr->socket->base, status);
     }
 
     decref_sock(uvr->socket);
-    free(uvr);
+    release_uvreq(io, uvr);
 }
 
 static int start_connect(lcb_io_opt_t iobase, lcb_sockdata_t *sockbase, const struct sockaddr *name,
@@ -333,7 +361,7 @@ static int start_connect(lcb_io_opt_t iobase, lcb_sockdata_t *sockbase, const st
             set_last_error(io, ret);
         }
 
-        free(uvr);
+        release_uvreq(io, uvr);
 
     } else {
         incref_sock(sock);
@@ -359,36 +387,157 @@ static int start_connect(lcb_io_opt_t iobase, lcb_sockdata_t *sockbase, const st
  ** Write Functions                                                          **
  ******************************************************************************
  ******************************************************************************/
+static my_write_t *alloc_write(my_iops_t *io, my_sockdata_t *sock)
+{
+    my_write_t *w = io->freelist.writes;
+    if (w) {
+        io->freelist.writes = w->next;
+        io->freelist.nwrites--;
+    } else {
+        w = (my_write_t *)calloc(1, sizeof(*w));
+        if (!w) {
+            return NULL;
+        }
+    }
+    w->sock = sock;
+    w->nbufs = 0;
+    w->ncbs = 0;
+    w->next = NULL;
+    return w;
+}
+
+static void release_write(my_iops_t *io, my_write_t *w)
+{
+    if (io->freelist.nwrites == LCBUV_FREELIST_MAX) {
+        free_write(w);
+        return;
+    }
+    w->next = io->freelist.writes;
+    io->freelist.writes = w;
+    io->freelist.nwrites++;
+}
+
+/**
+ * Adds the buffers and the callback of a write2 call to a write. The buffers
+ * are copied, as the array belongs to the caller.
+ */
+static int append_write(my_write_t *w, struct lcb_iovec_st *iov, lcb_size_t niov, void *uarg,
+                        lcb_ioC_write2_callback callback)
+{
+    lcb_size_t ii;
+
+    if (w->nbufs + niov > w->bufs_cap) {
+        unsigned cap = w->bufs_cap ? w->bufs_cap : 4;
+        uv_buf_t *bufs;
+        while (cap < w->nbufs + niov) {
+            cap *= 2;
+        }
+        bufs = (uv_buf_t *)realloc(w->bufs, cap * sizeof(*bufs));
+        if (!bufs) {
+            return -1;
+        }
+        w->bufs = bufs;
+        w->bufs_cap = cap;
+    }
+    if (w->ncbs == w->cbs_cap) {
+        unsigned cap = w->cbs_cap ? w->cbs_cap * 2 : 2;
+        my_write_cb_t *cbs = (my_write_cb_t *)realloc(w->cbs, cap * sizeof(*cbs));
+        if (!cbs) {
+            return -1;
+        }
+        w->cbs = cbs;
+        w->cbs_cap = cap;
+    }
+
+    for (ii = 0; ii < niov; ii++) {
+        w->bufs[w->nbufs++] = uv_buf_init((char *)iov[ii].iov_base, (lcb_uvbuf_len_t)iov[ii].iov_len);
+    }
+    w->cbs[w->ncbs].callback = callback;
+    w->cbs[w->ncbs].arg = uarg;
+    w->ncbs++;
+    return 0;
+}
+
+static void write2_callback(uv_write_t *req, int status);
+
+static int submit_write(my_write_t *w)
+{
+    return uv_write(&w->w, (uv_stream_t *)&w->sock->tcp, w->bufs, w->nbufs, write2_callback);
+}
+
+static void complete_write(my_iops_t *io, my_write_t *w, int status)
+{
+    unsigned ii;
+    for (ii = 0; ii < w->ncbs; ii++) {
+        w->cbs[ii].callback(&w->sock->base, status, w->cbs[ii].arg);
+    }
+    release_write(io, w);
+}
+
 static void write2_callback(uv_write_t *req, int status)
 {
     my_write_t *mw = (my_write_t *)req;
     my_sockdata_t *sock = mw->sock;
+    my_iops_t *io = (my_iops_t *)sock->base.parent;
+    my_write_t *batch = sock->wbatch;
+    int batch_status = 0;
 
     if (status != 0) {
-        set_last_error((my_iops_t *)sock->base.parent, status);
+        set_last_error(io, status);
     }
 
-    mw->callback(&sock->base, status, mw->w.data);
-    free(mw);
+    /* Send what the socket accumulated meanwhile before the callbacks add to it */
+    sock->wbatch = NULL;
+    if (batch) {
+        batch_status = submit_write(batch);
+        if (batch_status == 0) {
+            SOCK_INCR_PENDING(sock, write);
+        }
+    }
+
+    SOCK_DECR_PENDING(sock, write);
+    complete_write(io, mw, status);
+
+    if (batch && batch_status != 0) {
+        set_last_error(io, batch_status);
+        complete_write(io, batch, batch_status);
+    }
 }
 
+/**
+ * Only one uv_write is in flight per socket: the writes started meanwhile are
+ * batched, and sent with a single uv_write once it completes.
+ */
 static int start_write2(lcb_io_opt_t iobase, lcb_sockdata_t *sockbase, struct lcb_iovec_st *iov, lcb_size_t niov,
                         void *uarg, lcb_ioC_write2_callback callback)
 {
-    my_write_t *w;
+    my_iops_t *io = (my_iops_t *)iobase;
     my_sockdata_t *sd = (my_sockdata_t *)sockbase;
+    my_write_t *w;
     int ret;
 
-    w = (my_write_t *)calloc(1, sizeof(*w));
-    w->w.data = uarg;
-    w->callback = callback;
-    w->sock = sd;
+    w = sd->wbatch ? sd->wbatch : alloc_write(io, sd);
+    if (!w || append_write(w, iov, niov, uarg, callback) != 0) {
+        if (w && w->ncbs == 0) {
+            sd->wbatch = NULL;
+            release_write(io, w);
+        }
+        io->base.v.v1.error = ENOMEM;
+        return -1;
+    }
+
+    if (sd->pending.write) {
+        sd->wbatch = w;
+        return 0;
+    }
 
-    ret = uv_write(&w->w, (uv_stream_t *)&sd->tcp, (uv_buf_t *)iov, niov, write2_callback);
+    ret = submit_write(w);
 
     if (ret != 0) {
-        free(w);
-        set_last_error((my_iops_t *)iobase, -1);
+        release_write(io, w);
+        set_last_error(io, -1);
+    } else {
+        SOCK_INCR_PENDING(sd, write);
     }
 
     return ret;
@@ -515,9 +664,16 @@ static UVC_TIMER_CB(timer_cb)
 static void *create_timer(lcb_io_opt_t iobase)
 {
     my_iops_t *io = (my_iops_t *)iobase;
-    my_timer_t *timer = (my_timer_t *)calloc(1, sizeof(*timer));
-    if (!timer) {
-        return NULL;
+    my_timer_t *timer = io->freelist.timers;
+    if (timer) {
+        io->freelist.timers = timer->next;
+        io->freelist.ntimers--;
+        memset(timer, 0, sizeof(*timer));
+    } else {
+        timer = (my_timer_t *)calloc(1, sizeof(*timer));
+        if (!timer) {
+            return NULL;
+        }
     }
 
     timer->parent = io;
@@ -553,9 +709,18 @@ static void delete_timer(lcb_io_opt_t iobase, void *timer_opaque)
 static void timer_close_cb(uv_handle_t *handle)
 {
     my_timer_t *timer = (my_timer_t *)handle;
-    decref_iops(timer->parent);
+    my_iops_t *io = timer->parent;
+
     memset(timer, 0xff, sizeof(*timer));
-    free(timer);
+    if (io->freelist.ntimers < LCBUV_FREELIST_MAX) {
+        /* the handle is closed, create_timer initializes it again */
+        timer->next = io->freelist.timers;
+        io->freelist.timers = timer;
+        io->freelist.ntimers++;
+    } else {
+        free(timer);
+    }
+    decref_iops(io);
 }
 
 static void destroy_timer(lcb_io_opt_t io, void *timer_opaque)
@@ -566,16 +731,35 @@ static void destroy_timer(lcb_io_opt_t io, void *timer_opaque)
 
 static my_uvreq_t *alloc_uvreq(my_sockdata_t *sock, generic_callback_t callback)
 {
-    my_uvreq_t *ret = (my_uvreq_t *)calloc(1, sizeof(*ret));
-    if (!ret) {
-        sock->base.parent->v.v1.error = ENOMEM;
-        return NULL;
+    my_iops_t *io = (my_iops_t *)sock->base.parent;
+    my_uvreq_t *ret = io->freelist.reqs;
+    if (ret) {
+        io->freelist.reqs = ret->next;
+        io->freelist.nreqs--;
+        memset(ret, 0, sizeof(*ret));
+    } else {
+        ret = (my_uvreq_t *)calloc(1, sizeof(*ret));
+        if (!ret) {
+            sock->base.parent->v.v1.error = ENOMEM;
+            return NULL;
+        }
     }
     ret->socket = sock;
     ret->cb.cb_ = callback;
     return ret;
 }
 
+static void release_uvreq(my_iops_t *io, my_uvreq_t *uvr)
+{
+    if (io->freelist.nreqs == LCBUV_FREELIST_MAX) {
+        free(uvr);
+        return;
+    }
+    uvr->next = io->freelist.reqs;
+    io->freelist.reqs = uvr;
+    io->freelist.nreqs++;
+}
+
 static void set_last_error(my_iops_t *io, int error)
 {
     io->base.v.v1.error = uvc_last_errno(io->loop, error);
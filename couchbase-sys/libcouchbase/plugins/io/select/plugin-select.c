@@ -239,12 +239,12 @@ static void run_loop(sel_LOOP *io, int is_tick)
         }
 
         has_timers = get_next_timeout(io, &tmo, now);
-        if (has_timers) {
-            t = &tmo;
-        } else if (is_tick) {
-            /* do not wait forever on tick */
+        if (is_tick) {
+            /* only handle what is ready, like the other plugins */
             tmo.tv_sec = 0;
-            tmo.tv_usec = LCB_MS2US(100);
+            tmo.tv_usec = 0;
+            t = &tmo;
+        } else if (has_timers) {
             t = &tmo;
         }
 
@@ -0,0 +1,864 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2020 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/**
+ * Completion-based I/O plugin on top of io_uring(7).
+ *
+ * Reads, writes and connects are queued as submission entries while the
+ * library runs its callbacks, and the whole batch is submitted by the same
+ * io_uring_enter(2) call which waits for the next completions. With many
+ * sockets this replaces the readiness notification and the recvmsg/sendmsg
+ * call per socket of the event-based plugins with a single system call per
+ * loop iteration.
+ *
+ * The ring is driven through the raw system calls, so there is no dependency
+ * on liburing.
+ */
+
+#define LCB_IOPS_V12_NO_DEPRECATE
+
+#include "internal.h"
+#include "uring_io_opts.h"
+
+#include <linux/io_uring.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+/** Number of submission queue entries, the completion queue is twice as large */
+#define UR_RING_ENTRIES 256
+
+/** Maximum number of buffers passed to a single read */
+#define UR_MAXIOV 32
+
+typedef struct ur_SOCKET ur_SOCKET;
+
+typedef enum { UR_OP_CONNECT, UR_OP_READ, UR_OP_WRITE } ur_OPTYPE;
+
+typedef struct {
+    lcb_list_t list; /* in ur_SOCKET::ops while in flight */
+    ur_OPTYPE type;
+    ur_SOCKET *sock;
+} ur_OP;
+
+typedef struct {
+    ur_OP op;
+    struct msghdr msg;
+    lcb_ioC_write2_callback callback;
+    void *uarg;
+    struct iovec iov[1];
+} ur_WRITE;
+
+struct ur_SOCKET {
+    lcb_sockdata_t base;
+    /** One reference for the library, and one for each operation in flight */
+    unsigned refcount;
+    int closed;
+    lcb_list_t ops;
+
+    ur_OP connop;
+    struct sockaddr_storage peer;
+    lcb_io_connect_cb conncb;
+
+    ur_OP rdop;
+    struct msghdr rdmsg;
+    struct iovec rdiov[UR_MAXIOV];
+    lcb_ioC_read2_callback rdcb;
+    void *rdarg;
+};
+
+typedef struct {
+    lcb_list_t list;
+    int active;
+    hrtime_t exptime;
+    void *cb_data;
+    lcb_ioE_callback handler;
+} ur_TIMER;
+
+typedef struct {
+    int fd;
+    /* Submission queue, `tail` is published to `ktail` on submit */
+    unsigned *khead;
+    unsigned *ktail;
+    unsigned *array;
+    unsigned mask;
+    unsigned entries;
+    unsigned tail;
+    struct io_uring_sqe *sqes;
+    /* Completion queue */
+    unsigned *cq_khead;
+    unsigned *cq_ktail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void *sq_map;
+    size_t sq_mapsz;
+    void *cq_map;
+    size_t cq_mapsz;
+    size_t sqes_mapsz;
+} ur_RING;
+
+typedef struct {
+    ur_RING ring;
+    lcb_list_t timers;
+    /** Number of operations whose completion is still outstanding */
+    unsigned ninflight;
+    int event_loop;
+} ur_LOOP;
+
+#define UR_LOOP(iops) ((ur_LOOP *)(iops)->v.v3.cookie)
+
+static int ur_setup(unsigned entries, struct io_uring_params *params)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int ur_enter(ur_RING *r, unsigned wait_nr, struct __kernel_timespec *ts)
+{
+    struct io_uring_getevents_arg arg;
+    unsigned to_submit;
+    int rv;
+
+    memset(&arg, 0, sizeof(arg));
+    arg.sigmask_sz = _NSIG / 8;
+    arg.ts = (lcb_U64)(uintptr_t)ts;
+
+    __atomic_store_n(r->ktail, r->tail, __ATOMIC_RELEASE);
+    to_submit = r->tail - __atomic_load_n(r->khead, __ATOMIC_ACQUIRE);
+
+    rv = (int)syscall(__NR_io_uring_enter, r->fd, to_submit, wait_nr, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                      &arg, sizeof(arg));
+    if (rv < 0 && (errno == ETIME || errno == EINTR || errno == EBUSY || errno == EAGAIN)) {
+        /* Timed out, interrupted, or completions must be reaped first */
+        rv = 0;
+    }
+    return rv;
+}
+
+static void ur_ring_close(ur_RING *r)
+{
+    if (r->sqes) {
+        munmap(r->sqes, r->sqes_mapsz);
+    }
+    if (r->cq_map && r->cq_map != r->sq_map) {
+        munmap(r->cq_map, r->cq_mapsz);
+    }
+    if (r->sq_map) {
+        munmap(r->sq_map, r->sq_mapsz);
+    }
+    if (r->fd >= 0) {
+        close(r->fd);
+    }
+}
+
+static int ur_ring_open(ur_RING *r)
+{
+    struct io_uring_params params;
+    char *sq, *cq;
+
+    memset(r, 0, sizeof(*r));
+    memset(&params, 0, sizeof(params));
+    r->fd = ur_setup(UR_RING_ENTRIES, &params);
+    if (r->fd < 0) {
+        return -1;
+    }
+
+    /* Overflowed completions must not be dropped, and the loop needs to wait
+     * with a timeout without consuming a submission entry */
+    if (!(params.features & IORING_FEAT_NODROP) || !(params.features & IORING_FEAT_EXT_ARG)) {
+        close(r->fd);
+        r->fd = -1;
+        errno = ENOSYS;
+        return -1;
+    }
+
+    r->sq_mapsz = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    r->cq_mapsz = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cq_mapsz > r->sq_mapsz) {
+            r->sq_mapsz = r->cq_mapsz;
+        }
+        r->cq_mapsz = r->sq_mapsz;
+    }
+
+    r->sq_map = mmap(NULL, r->sq_mapsz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_map == MAP_FAILED) {
+        r->sq_map = NULL;
+        goto GT_ERR;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        r->cq_map = r->sq_map;
+    } else {
+        r->cq_map =
+            mmap(NULL, r->cq_mapsz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+        if (r->cq_map == MAP_FAILED) {
+            r->cq_map = NULL;
+            goto GT_ERR;
+        }
+    }
+    r->sqes_mapsz = params.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_mapsz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) {
+        r->sqes = NULL;
+        goto GT_ERR;
+    }
+
+    sq = r->sq_map;
+    r->khead = (unsigned *)(sq + params.sq_off.head);
+    r->ktail = (unsigned *)(sq + params.sq_off.tail);
+    r->array = (unsigned *)(sq + params.sq_off.array);
+    r->mask = *(unsigned *)(sq + params.sq_off.ring_mask);
+    r->entries = params.sq_entries;
+    r->tail = *r->ktail;
+
+    cq = r->cq_map;
+    r->cq_khead = (unsigned *)(cq + params.cq_off.head);
+    r->cq_ktail = (unsigned *)(cq + params.cq_off.tail);
+    r->cq_mask = *(unsigned *)(cq + params.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    return 0;
+
+GT_ERR:
+    ur_ring_close(r);
+    r->fd = -1;
+    return -1;
+}
+
+/**
+ * Get the next free submission entry. If the queue is full, the queued
+ * entries are submitted first.
+ */
+static struct io_uring_sqe *ur_get_sqe(ur_RING *r)
+{
+    struct io_uring_sqe *sqe;
+    unsigned idx;
+
+    if (r->tail - __atomic_load_n(r->khead, __ATOMIC_ACQUIRE) >= r->entries) {
+        if (ur_enter(r, 0, NULL) < 0) {
+            return NULL;
+        }
+        if (r->tail - __atomic_load_n(r->khead, __ATOMIC_ACQUIRE) >= r->entries) {
+            errno = EAGAIN;
+            return NULL;
+        }
+    }
+
+    idx = r->tail & r->mask;
+    sqe = &r->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    r->array[idx] = idx;
+    r->tail++;
+    return sqe;
+}
+
+static void set_last_error(lcb_io_opt_t iops, int error)
+{
+    LCB_IOPS_ERRNO(iops) = error;
+}
+
+/******************************************************************************
+ ******************************************************************************
+ ** Socket Functions                                                         **
+ ******************************************************************************
+ ******************************************************************************/
+
+static void sock_unref(ur_SOCKET *sock)
+{
+    lcb_assert(sock->refcount);
+    if (--sock->refcount) {
+        return;
+    }
+    if (sock->base.socket != INVALID_SOCKET) {
+        close(sock->base.socket);
+    }
+    free(sock);
+}
+
+static int op_submit(ur_SOCKET *sock, ur_OP *op, struct io_uring_sqe *sqe)
+{
+    ur_LOOP *io = UR_LOOP(sock->base.parent);
+
+    sqe->user_data = (lcb_U64)(uintptr_t)op;
+    op->sock = sock;
+    lcb_list_append(&sock->ops, &op->list);
+    sock->refcount++;
+    io->ninflight++;
+    return 0;
+}
+
+static void op_finish(ur_OP *op)
+{
+    ur_LOOP *io = UR_LOOP(op->sock->base.parent);
+    lcb_list_delete(&op->list);
+    io->ninflight--;
+}
+
+static lcb_sockdata_t *ur_socket(lcb_io_opt_t iops, int domain, int type, int protocol)
+{
+    ur_SOCKET *sock;
+    lcb_socket_t fd = socket(domain, type | SOCK_CLOEXEC, protocol);
+
+    if (fd == INVALID_SOCKET) {
+        set_last_error(iops, errno);
+        return NULL;
+    }
+
+    sock = calloc(1, sizeof(*sock));
+    if (sock == NULL) {
+        close(fd);
+        set_last_error(iops, ENOMEM);
+        return NULL;
+    }
+
+    sock->base.socket = fd;
+    sock->base.parent = iops;
+    sock->refcount = 1;
+    lcb_list_init(&sock->ops);
+    return &sock->base;
+}
+
+static unsigned int ur_close(lcb_io_opt_t iops, lcb_sockdata_t *sd)
+{
+    ur_SOCKET *sock = (ur_SOCKET *)sd;
+    ur_LOOP *io = UR_LOOP(iops);
+    lcb_list_t *ll;
+
+    lcb_assert(!sock->closed);
+    sock->closed = 1;
+
+    /* The callbacks of the cancelled operations are still invoked, and the
+     * descriptor is closed once the last of them has completed */
+    LCB_LIST_FOR(ll, &sock->ops)
+    {
+        struct io_uring_sqe *sqe = ur_get_sqe(&io->ring);
+        if (sqe == NULL) {
+            /* Fall back to waking them up through the socket itself */
+            shutdown(sock->base.socket, SHUT_RDWR);
+            break;
+        }
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = (lcb_U64)(uintptr_t)LCB_LIST_ITEM(ll, ur_OP, list);
+        sqe->user_data = 0;
+    }
+    sock_unref(sock);
+    return 0;
+}
+
+static int ur_connect(lcb_io_opt_t iops, lcb_sockdata_t *sd, const struct sockaddr *dst, unsigned int naddr,
+                      lcb_io_connect_cb callback)
+{
+    ur_SOCKET *sock = (ur_SOCKET *)sd;
+    ur_LOOP *io = UR_LOOP(iops);
+    struct io_uring_sqe *sqe;
+
+    if (naddr > sizeof(sock->peer)) {
+        set_last_error(iops, EINVAL);
+        return -1;
+    }
+    if ((sqe = ur_get_sqe(&io->ring)) == NULL) {
+        set_last_error(iops, errno);
+        return -1;
+    }
+
+    memcpy(&sock->peer, dst, naddr);
+    sock->conncb = callback;
+    sqe->opcode = IORING_OP_CONNECT;
+    sqe->fd = sock->base.socket;
+    sqe->addr = (lcb_U64)(uintptr_t)&sock->peer;
+    sqe->off = naddr;
+    sock->connop.type = UR_OP_CONNECT;
+    return op_submit(sock, &sock->connop, sqe);
+}
+
+static int ur_read2(lcb_io_opt_t iops, lcb_sockdata_t *sd, lcb_IOV *iov, lcb_SIZE niov, void *uarg,
+                    lcb_ioC_read2_callback callback)
+{
+    ur_SOCKET *sock = (ur_SOCKET *)sd;
+    ur_LOOP *io = UR_LOOP(iops);
+    struct io_uring_sqe *sqe;
+    lcb_SIZE ii;
+
+    if ((sqe = ur_get_sqe(&io->ring)) == NULL) {
+        set_last_error(iops, errno);
+        return -1;
+    }
+
+    if (niov > UR_MAXIOV) {
+        niov = UR_MAXIOV;
+    }
+    for (ii = 0; ii < niov; ii++) {
+        sock->rdiov[ii].iov_base = iov[ii].iov_base;
+        sock->rdiov[ii].iov_len = iov[ii].iov_len;
+    }
+    memset(&sock->rdmsg, 0, sizeof(sock->rdmsg));
+    sock->rdmsg.msg_iov = sock->rdiov;
+    sock->rdmsg.msg_iovlen = niov;
+    sock->rdcb = callback;
+    sock->rdarg = uarg;
+
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = sock->base.socket;
+    sqe->addr = (lcb_U64)(uintptr_t)&sock->rdmsg;
+    sqe->len = 1;
+    sock->rdop.type = UR_OP_READ;
+    return op_submit(sock, &sock->rdop, sqe);
+}
+
+static int write_submit(ur_SOCKET *sock, ur_WRITE *w)
+{
+    struct io_uring_sqe *sqe = ur_get_sqe(&UR_LOOP(sock->base.parent)->ring);
+    if (sqe == NULL) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = sock->base.socket;
+    sqe->addr = (lcb_U64)(uintptr_t)&w->msg;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    return op_submit(sock, &w->op, sqe);
+}
+
+static int ur_write2(lcb_io_opt_t iops, lcb_sockdata_t *sd, lcb_IOV *iov, lcb_SIZE niov, void *uarg,
+                     lcb_ioC_write2_callback callback)
+{
+    ur_SOCKET *sock = (ur_SOCKET *)sd;
+    ur_WRITE *w;
+    lcb_SIZE ii;
+
+    w = malloc(sizeof(*w) + (niov ? niov - 1 : 0) * sizeof(w->iov[0]));
+    if (w == NULL) {
+        set_last_error(iops, ENOMEM);
+        return -1;
+    }
+    for (ii = 0; ii < niov; ii++) {
+        w->iov[ii].iov_base = iov[ii].iov_base;
+        w->iov[ii].iov_len = iov[ii].iov_len;
+    }
+    memset(&w->msg, 0, sizeof(w->msg));
+    w->msg.msg_iov = w->iov;
+    w->msg.msg_iovlen = niov;
+    w->callback = callback;
+    w->uarg = uarg;
+    w->op.type = UR_OP_WRITE;
+
+    if (write_submit(sock, w) != 0) {
+        set_last_error(iops, errno);
+        free(w);
+        return -1;
+    }
+    return 0;
+}
+
+/** Advance the buffers of a write past `nw` bytes, returns nonzero if any are left */
+static int write_advance(ur_WRITE *w, size_t nw)
+{
+    struct msghdr *msg = &w->msg;
+    while (msg->msg_iovlen && nw >= msg->msg_iov->iov_len) {
+        nw -= msg->msg_iov->iov_len;
+        msg->msg_iov++;
+        msg->msg_iovlen--;
+    }
+    if (msg->msg_iovlen) {
+        msg->msg_iov->iov_base = (char *)msg->msg_iov->iov_base + nw;
+        msg->msg_iov->iov_len -= nw;
+    }
+    return msg->msg_iovlen != 0;
+}
+
+static void op_complete(lcb_io_opt_t iops, ur_OP *op, int res)
+{
+    ur_SOCKET *sock = op->sock;
+
+    op_finish(op);
+    if (res < 0) {
+        set_last_error(iops, -res);
+    }
+
+    switch (op->type) {
+        case UR_OP_CONNECT:
+            sock->conncb(&sock->base, res < 0 ? -1 : 0);
+            break;
+
+        case UR_OP_READ:
+            sock->rdcb(&sock->base, res < 0 ? -1 : res, sock->rdarg);
+            break;
+
+        case UR_OP_WRITE: {
+            ur_WRITE *w = (ur_WRITE *)op;
+            int status = res < 0 ? -1 : 0;
+
+            /* Stream sockets may accept only part of the buffers */
+            if (res > 0 && write_advance(w, (size_t)res)) {
+                if (!sock->closed && write_submit(sock, w) == 0) {
+                    break;
+                }
+                set_last_error(iops, sock->closed ? ECANCELED : errno);
+                status = -1;
+            } else if (res == 0 && w->msg.msg_iovlen) {
+                set_last_error(iops, EPIPE);
+                status = -1;
+            }
+            w->callback(&sock->base, status, w->uarg);
+            free(w);
+            break;
+        }
+    }
+    sock_unref(sock);
+}
+
+static int ur_nameinfo(lcb_io_opt_t iops, lcb_sockdata_t *sd, struct lcb_nameinfo_st *ni)
+{
+    socklen_t len;
+
+    len = (socklen_t)*ni->local.len;
+    getsockname(sd->socket, ni->local.name, &len);
+    *ni->local.len = (int)len;
+
+    len = (socklen_t)*ni->remote.len;
+    getpeername(sd->socket, ni->remote.name, &len);
+    *ni->remote.len = (int)len;
+
+    (void)iops;
+    return 0;
+}
+
+static int ur_is_closed(lcb_io_opt_t iops, lcb_sockdata_t *sd, int flags)
+{
+    char buf = 0;
+    ssize_t rv;
+
+GT_RETRY:
+    rv = recv(sd->socket, &buf, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (rv == 1) {
+        return (flags & LCB_IO_SOCKCHECK_PEND_IS_ERROR) ? LCB_IO_SOCKCHECK_STATUS_CLOSED : LCB_IO_SOCKCHECK_STATUS_OK;
+    } else if (rv == 0) {
+        return LCB_IO_SOCKCHECK_STATUS_CLOSED;
+    } else if (errno == EINTR) {
+        goto GT_RETRY;
+    } else if (errno == EAGAIN) {
+        return LCB_IO_SOCKCHECK_STATUS_OK;
+    }
+    (void)iops;
+    return LCB_IO_SOCKCHECK_STATUS_CLOSED;
+}
+
+static int ur_cntl(lcb_io_opt_t iops, lcb_sockdata_t *sd, int mode, int option, void *arg)
+{
+    int level, optname, rv;
+    socklen_t len = sizeof(int);
+    struct linger lg;
+
+    switch (option) {
+        case LCB_IO_CNTL_TCP_NODELAY:
+            level = IPPROTO_TCP;
+            optname = TCP_NODELAY;
+            break;
+        case LCB_IO_CNTL_TCP_KEEPALIVE:
+            level = SOL_SOCKET;
+            optname = SO_KEEPALIVE;
+            break;
+#ifdef SO_BUSY_POLL
+        case LCB_IO_CNTL_BUSY_POLL:
+            level = SOL_SOCKET;
+            optname = SO_BUSY_POLL;
+            break;
+#endif
+#ifdef TCP_USER_TIMEOUT
+        case LCB_IO_CNTL_TCP_USER_TIMEOUT:
+            level = IPPROTO_TCP;
+            optname = TCP_USER_TIMEOUT;
+            break;
+#endif
+        case LCB_IO_CNTL_ABORTIVE_CLOSE:
+            if (mode != LCB_IO_CNTL_SET) {
+                set_last_error(iops, ENOTSUP);
+                return -1;
+            }
+            lg.l_onoff = *(int *)arg != 0;
+            lg.l_linger = 0;
+            level = SOL_SOCKET;
+            optname = SO_LINGER;
+            arg = &lg;
+            len = sizeof(lg);
+            break;
+        default:
+            set_last_error(iops, ENOTSUP);
+            return -1;
+    }
+
+    if (mode == LCB_IO_CNTL_GET) {
+        rv = getsockopt(sd->socket, level, optname, arg, &len);
+    } else {
+        rv = setsockopt(sd->socket, level, optname, arg, len);
+    }
+    if (rv != 0) {
+        set_last_error(iops, errno);
+    }
+    return rv;
+}
+
+/******************************************************************************
+ ******************************************************************************
+ ** Timer Functions                                                          **
+ ******************************************************************************
+ ******************************************************************************/
+
+static int timer_cmp_asc(lcb_list_t *a, lcb_list_t *b)
+{
+    ur_TIMER *ta = LCB_LIST_ITEM(a, ur_TIMER, list);
+    ur_TIMER *tb = LCB_LIST_ITEM(b, ur_TIMER, list);
+    if (ta->exptime > tb->exptime) {
+        return 1;
+    } else if (ta->exptime < tb->exptime) {
+        return -1;
+    } else {
+        return 0;
+    }
+}
+
+static void *ur_timer_new(lcb_io_opt_t iops)
+{
+    (void)iops;
+    return calloc(1, sizeof(ur_TIMER));
+}
+
+static void ur_timer_cancel(lcb_io_opt_t iops, void *timer)
+{
+    ur_TIMER *tm = timer;
+    if (tm->active) {
+        tm->active = 0;
+        lcb_list_delete(&tm->list);
+    }
+    (void)iops;
+}
+
+static void ur_timer_free(lcb_io_opt_t iops, void *timer)
+{
+    ur_timer_cancel(iops, timer);
+    free(timer);
+}
+
+static int ur_timer_schedule(lcb_io_opt_t iops, void *timer, lcb_U32 usec, void *cb_data, lcb_ioE_callback handler)
+{
+    ur_TIMER *tm = timer;
+    ur_LOOP *io = UR_LOOP(iops);
+
+    lcb_assert(!tm->active);
+    tm->exptime = gethrtime() + (usec * (hrtime_t)1000);
+    tm->cb_data = cb_data;
+    tm->handler = handler;
+    tm->active = 1;
+    lcb_list_add_sorted(&io->timers, &tm->list, timer_cmp_asc);
+    return 0;
+}
+
+static ur_TIMER *pop_next_timer(ur_LOOP *io, hrtime_t now)
+{
+    ur_TIMER *ret;
+
+    if (LCB_LIST_IS_EMPTY(&io->timers)) {
+        return NULL;
+    }
+    ret = LCB_LIST_ITEM(io->timers.next, ur_TIMER, list);
+    if (ret->exptime > now) {
+        return NULL;
+    }
+    lcb_list_shift(&io->timers);
+    ret->active = 0;
+    return ret;
+}
+
+static int get_next_timeout(ur_LOOP *io, struct __kernel_timespec *ts, hrtime_t now)
+{
+    ur_TIMER *first;
+    hrtime_t delta = 0;
+
+    if (LCB_LIST_IS_EMPTY(&io->timers)) {
+        return 0;
+    }
+    first = LCB_LIST_ITEM(io->timers.next, ur_TIMER, list);
+    if (now < first->exptime) {
+        delta = first->exptime - now;
+    }
+    ts->tv_sec = (long long)(delta / 1000000000);
+    ts->tv_nsec = (long long)(delta % 1000000000);
+    return 1;
+}
+
+/******************************************************************************
+ ******************************************************************************
+ ** Event Loop Functions                                                     **
+ ******************************************************************************
+ ******************************************************************************/
+
+static void reap_completions(lcb_io_opt_t iops)
+{
+    ur_RING *r = &UR_LOOP(iops)->ring;
+    unsigned head = *r->cq_khead;
+
+    while (head != __atomic_load_n(r->cq_ktail, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe *cqe = &r->cqes[head & r->cq_mask];
+        ur_OP *op = (ur_OP *)(uintptr_t)cqe->user_data;
+        int res = cqe->res;
+
+        /* Release the entry before the callback, which may submit more */
+        __atomic_store_n(r->cq_khead, ++head, __ATOMIC_RELEASE);
+        if (op) {
+            op_complete(iops, op, res);
+        }
+    }
+}
+
+static void run_loop(lcb_io_opt_t iops, int is_tick)
+{
+    ur_LOOP *io = UR_LOOP(iops);
+
+    io->event_loop = !is_tick;
+    do {
+        struct __kernel_timespec ts;
+        int has_timers = get_next_timeout(io, &ts, gethrtime());
+        ur_TIMER *tm;
+
+        if (io->ninflight == 0 && !has_timers) {
+            /* Cancellations might still be queued */
+            ur_enter(&io->ring, 0, NULL);
+            io->event_loop = 0;
+            return;
+        }
+
+        if (ur_enter(&io->ring, is_tick ? 0 : 1, has_timers ? &ts : NULL) < 0) {
+            io->event_loop = 0;
+            return;
+        }
+        reap_completions(iops);
+
+        if (has_timers) {
+            hrtime_t now = gethrtime();
+            while ((tm = pop_next_timer(io, now))) {
+                tm->handler(-1, 0, tm->cb_data);
+            }
+        }
+    } while (io->event_loop);
+}
+
+static void ur_run_loop(lcb_io_opt_t iops)
+{
+    run_loop(iops, 0);
+}
+
+static void ur_tick_loop(lcb_io_opt_t iops)
+{
+    run_loop(iops, 1);
+}
+
+static void ur_stop_loop(lcb_io_opt_t iops)
+{
+    UR_LOOP(iops)->event_loop = 0;
+}
+
+static void ur_destroy_iops(lcb_io_opt_t iops)
+{
+    ur_LOOP *io = UR_LOOP(iops);
+    lcb_list_t *nn, *ii;
+
+    if (io->event_loop != 0) {
+        fprintf(stderr, "WARN: libcouchbase(plugin-uring): the event loop might be still active, but it still try to "
+                        "free resources\n");
+    }
+    LCB_LIST_SAFE_FOR(ii, nn, &io->timers)
+    {
+        ur_timer_free(iops, LCB_LIST_ITEM(ii, ur_TIMER, list));
+    }
+    ur_ring_close(&io->ring);
+    free(io);
+    free(iops);
+}
+
+static void procs2_uring_callback(int version, lcb_loop_procs *loop_procs, lcb_timer_procs *timer_procs,
+                                  lcb_bsd_procs *bsd_procs, lcb_ev_procs *ev_procs,
+                                  lcb_completion_procs *completion_procs, lcb_iomodel_t *iomodel)
+{
+    timer_procs->create = ur_timer_new;
+    timer_procs->destroy = ur_timer_free;
+    timer_procs->schedule = ur_timer_schedule;
+    timer_procs->cancel = ur_timer_cancel;
+
+    loop_procs->start = ur_run_loop;
+    loop_procs->stop = ur_stop_loop;
+    loop_procs->tick = ur_tick_loop;
+
+    *iomodel = LCB_IOMODEL_COMPLETION;
+    completion_procs->socket = ur_socket;
+    completion_procs->close = ur_close;
+    completion_procs->connect = ur_connect;
+    completion_procs->read2 = ur_read2;
+    completion_procs->write2 = ur_write2;
+    completion_procs->nameinfo = ur_nameinfo;
+    completion_procs->is_closed = ur_is_closed;
+    completion_procs->cntl = ur_cntl;
+
+    /** Stuff we don't use */
+    completion_procs->read = NULL;
+    completion_procs->write = NULL;
+    completion_procs->wballoc = NULL;
+    completion_procs->wbfree = NULL;
+    completion_procs->serve = NULL;
+
+    (void)version;
+    (void)bsd_procs;
+    (void)ev_procs;
+}
+
+LIBCOUCHBASE_API
+lcb_STATUS lcb_create_uring_io_opts(int version, lcb_io_opt_t *io, void *arg)
+{
+    lcb_io_opt_t ret;
+    ur_LOOP *cookie;
+
+    if (version != 0) {
+        return LCB_ERR_PLUGIN_VERSION_MISMATCH;
+    }
+    ret = calloc(1, sizeof(*ret));
+    cookie = calloc(1, sizeof(*cookie));
+    if (ret == NULL || cookie == NULL) {
+        free(ret);
+        free(cookie);
+        return LCB_ERR_NO_MEMORY;
+    }
+    if (ur_ring_open(&cookie->ring) != 0) {
+        free(ret);
+        free(cookie);
+        return LCB_ERR_UNSUPPORTED_OPERATION;
+    }
+    lcb_list_init(&cookie->timers);
+
+    ret->version = 3;
+    ret->dlhandle = NULL;
+    ret->destructor = ur_destroy_iops;
+    ret->v.v3.need_cleanup = 0;
+    ret->v.v3.get_procs = procs2_uring_callback;
+    ret->v.v3.cookie = cookie;
+
+    *io = ret;
+    (void)arg;
+    return LCB_SUCCESS;
+}
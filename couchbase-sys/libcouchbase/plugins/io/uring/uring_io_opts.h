@@ -0,0 +1,44 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2020 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LIBCOUCHBASE_URING_IO_OPTS_H
+#define LIBCOUCHBASE_URING_IO_OPTS_H 1
+
+#include <libcouchbase/couchbase.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Create an instance of a completion-based I/O handler which uses an
+ * io_uring(7) submission/completion queue pair (Linux 5.11 or newer).
+ *
+ * @param version must be 0
+ * @param io set to the new I/O handler on success
+ * @param arg unused
+ * @return status of the operation. LCB_ERR_UNSUPPORTED_OPERATION is returned
+ * if the kernel does not provide io_uring, or a version of it which is too old.
+ */
+LIBCOUCHBASE_API
+lcb_STATUS lcb_create_uring_io_opts(int version, lcb_io_opt_t *io, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -21,7 +21,9 @@
 #include "internal.h"
 #include "auth-priv.h"
 #include "http/http.h"
+#include "http/http-priv.h"
 #include <list>
+#include <deque>
 #include "defer.h"
 
 #include "analytics_handle.hh"
@@ -93,12 +95,165 @@ lcb_STATUS lcb_analytics(lcb_INSTANCE *instance, void *cookie, const lcb_CMDANAL
     return analytics_execute(instance, cmd);
 }
 
+namespace
+{
+/**
+ * Fetches the partitions of a deferred result, each with its own analytics
+ * request, and merges their rows into the callback of the deferred handle.
+ */
+struct DeferredFetch {
+    struct Partition {
+        DeferredFetch *parent;
+        std::string handle;
+        std::string meta;
+        std::deque<std::string> rows; /**< rows held back by an ordered merge */
+        bool done;
+    };
+
+    DeferredFetch(lcb_INSTANCE *instance_, void *cookie_, const lcb_DEFERRED_HANDLE *handle)
+        : instance(instance_), cookie(cookie_), callback(handle->callback), ordered(handle->ordered),
+          parallelism(handle->parallelism ? handle->parallelism : handle->partitions.size())
+    {
+        partitions.reserve(handle->partitions.size());
+        for (const auto &partition : handle->partitions) {
+            partitions.push_back(Partition{this, partition, std::string(), std::deque<std::string>(), false});
+        }
+    }
+
+    static void partition_callback(lcb_INSTANCE *, int, const lcb_RESPANALYTICS *resp)
+    {
+        auto *partition = reinterpret_cast<Partition *>(resp->cookie);
+        partition->parent->on_response(*partition, resp);
+    }
+
+    /** Start partitions until as many as allowed are running */
+    void start_next()
+    {
+        while (running < parallelism && started < partitions.size()) {
+            Partition &partition = partitions[started++];
+            lcb_DEFERRED_HANDLE_ handle{"success", partition.handle, partition_callback, {}, true, 0};
+            auto *req = new lcb_ANALYTICS_HANDLE_(instance, &partition, &handle);
+            lcb_STATUS err = analytics_schedule(instance, req);
+            if (err != LCB_SUCCESS) {
+                req->clear_callback();
+                req->unref();
+                partition.done = true;
+                set_error(err, 0, nullptr, 0);
+                continue;
+            }
+            running++;
+        }
+    }
+
+    void on_response(Partition &partition, const lcb_RESPANALYTICS *resp)
+    {
+        if ((resp->rflags & LCB_RESP_F_FINAL) == 0) {
+            if (!ordered || &partition == &partitions[next]) {
+                forward(resp->row, resp->nrow, resp->htresp);
+            } else {
+                partition.rows.emplace_back(resp->row, resp->nrow);
+            }
+            return;
+        }
+
+        partition.meta.assign(resp->row, resp->nrow);
+        partition.done = true;
+        running--;
+        if (resp->ctx.rc != LCB_SUCCESS) {
+            set_error(resp->ctx.rc, resp->ctx.first_error_code, resp->ctx.first_error_message,
+                      resp->ctx.first_error_message_len);
+        }
+        start_next();
+        maybe_finish();
+    }
+
+    void forward(const char *row, size_t nrow, const lcb_RESPHTTP *htresp)
+    {
+        lcb_RESPANALYTICS resp{};
+        resp.cookie = cookie;
+        resp.row = row;
+        resp.nrow = nrow;
+        resp.htresp = htresp;
+        callback(instance, LCB_CALLBACK_ANALYTICS, &resp);
+    }
+
+    void set_error(lcb_STATUS err, uint32_t code, const char *message, size_t nmessage)
+    {
+        if (rc == LCB_SUCCESS) {
+            rc = err;
+            first_error_code = code;
+            if (message) {
+                first_error_message.assign(message, nmessage);
+            }
+        }
+    }
+
+    /** Deliver held back rows of the partitions in order, and the final response once all are done */
+    void maybe_finish()
+    {
+        for (; next < partitions.size(); next++) {
+            Partition &partition = partitions[next];
+            while (!partition.rows.empty()) {
+                forward(partition.rows.front().c_str(), partition.rows.front().size(), nullptr);
+                partition.rows.pop_front();
+            }
+            if (!partition.done) {
+                return;
+            }
+        }
+
+        std::string meta(rc == LCB_SUCCESS ? R"({"status":"success","partitions":[)"
+                                           : R"({"status":"errors","partitions":[)");
+        for (size_t ii = 0; ii < partitions.size(); ii++) {
+            meta.append(ii ? "," : "").append(partitions[ii].meta.empty() ? "null" : partitions[ii].meta);
+        }
+        meta.append("]}");
+
+        lcb_RESPANALYTICS resp{};
+        resp.cookie = cookie;
+        resp.rflags = LCB_RESP_F_FINAL;
+        resp.row = meta.c_str();
+        resp.nrow = meta.size();
+        resp.ctx.rc = rc;
+        resp.ctx.first_error_code = first_error_code;
+        resp.ctx.first_error_message = first_error_message.c_str();
+        resp.ctx.first_error_message_len = first_error_message.size();
+        callback(instance, LCB_CALLBACK_ANALYTICS, &resp);
+        delete this;
+    }
+
+    lcb_INSTANCE *instance;
+    void *cookie;
+    lcb_ANALYTICS_CALLBACK callback;
+    bool ordered;
+    size_t parallelism;
+    std::vector<Partition> partitions;
+    size_t started{0}; /**< partitions which were started */
+    size_t running{0}; /**< partitions which were started, but are not done */
+    size_t next{0};    /**< first partition which is not done, for the ordered merge */
+    lcb_STATUS rc{LCB_SUCCESS};
+    uint32_t first_error_code{0};
+    std::string first_error_message;
+};
+} // namespace
+
 LIBCOUCHBASE_API lcb_STATUS lcb_deferred_handle_poll(lcb_INSTANCE *instance, void *cookie, lcb_DEFERRED_HANDLE *handle)
 {
     if (handle->callback == nullptr || handle->handle.empty()) {
         return LCB_ERR_INVALID_ARGUMENT;
     }
 
+    if (!handle->partitions.empty()) {
+        auto *fetch = new DeferredFetch(instance, cookie, handle);
+        fetch->start_next();
+        if (fetch->running == 0) {
+            lcb_STATUS err = fetch->rc;
+            delete fetch;
+            return err;
+        }
+        return LCB_SUCCESS;
+    }
+
     auto *req = new lcb_ANALYTICS_HANDLE_(instance, cookie, handle);
     lcb_STATUS err = analytics_schedule(instance, req);
     if (err != LCB_SUCCESS) {
@@ -116,3 +271,25 @@ LIBCOUCHBASE_API lcb_STATUS lcb_analytics_cancel(lcb_INSTANCE * /* instance */,
     }
     return LCB_SUCCESS;
 }
+
+LIBCOUCHBASE_API lcb_STATUS lcb_analytics_pause(lcb_INSTANCE * /* instance */, lcb_ANALYTICS_HANDLE *handle)
+{
+    if (handle == nullptr || handle->is_cancelled()) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    if (handle->http_request() != nullptr) {
+        handle->http_request()->pause();
+    }
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_analytics_resume(lcb_INSTANCE * /* instance */, lcb_ANALYTICS_HANDLE *handle)
+{
+    if (handle == nullptr || handle->is_cancelled()) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    if (handle->http_request() != nullptr) {
+        handle->http_request()->resume();
+    }
+    return LCB_SUCCESS;
+}
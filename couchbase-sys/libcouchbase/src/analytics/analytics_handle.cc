@@ -39,8 +39,8 @@ static void doc_callback(lcb_INSTANCE *, int, const lcb_RESPSTORE *rb)
 
     q->ref();
 
-    q->n_awaiting_response--;
-    dreq->ready = 1;
+    dreq->docresp.ctx.rc = lcb_respstore_status(rb);
+    q->complete(dreq, dreq->docresp.ctx.rc);
 
     q->check();
 
@@ -52,6 +52,12 @@ static lcb_STATUS cb_op_schedule(lcb::docreq::Queue *q, lcb::docreq::DocRequest
     auto *req = reinterpret_cast<IngestRequest *>(dreq);
     lcb_ANALYTICS_HANDLE_ *areq = req->request_;
 
+    /* The requests which do not return LCB_SUCCESS are completed right away, without a response */
+    if (areq->ingest_aborted()) {
+        req->skipped = true;
+        return LCB_ERR_REQUEST_CANCELED;
+    }
+
     lcb_STORE_OPERATION op = LCB_STORE_UPSERT;
     switch (areq->ingest_options().method) {
         case LCB_INGEST_METHOD__MAX:
@@ -79,7 +85,8 @@ static lcb_STATUS cb_op_schedule(lcb::docreq::Queue *q, lcb::docreq::DocRequest
             break;
         case LCB_INGEST_STATUS_IGNORE:
             /* assume that the user hasn't allocated anything */
-            return LCB_SUCCESS;
+            req->ignored = true;
+            return LCB_ERR_NO_COMMANDS;
         default:
             return LCB_ERR_SDK_INTERNAL;
     }
@@ -109,11 +116,36 @@ static lcb_STATUS cb_op_schedule(lcb::docreq::Queue *q, lcb::docreq::DocRequest
 static void cb_doc_ready(lcb::docreq::Queue *q, lcb::docreq::DocRequest *req_base)
 {
     auto *req = (IngestRequest *)req_base;
-    /* TODO: check if we should ignore errors */
-    delete req;
 
     if (q->parent) {
-        reinterpret_cast<lcb_ANALYTICS_HANDLE_ *>(q->parent)->unref();
+        auto *areq = reinterpret_cast<lcb_ANALYTICS_HANDLE_ *>(q->parent);
+        areq->ingest_done(req);
+        delete req;
+        areq->unref();
+        return;
+    }
+    delete req;
+}
+
+void lcb_ANALYTICS_HANDLE_::ingest_done(const IngestRequest *req)
+{
+    if (req->skipped) {
+        return;
+    }
+    if (req->ignored) {
+        ingest_ignored_++;
+        return;
+    }
+    lcb_STATUS rc = req->docresp.ctx.rc;
+    if (rc == LCB_SUCCESS) {
+        ingest_stored_++;
+        return;
+    }
+    ingest_failed_++;
+    if (ingest_rc_ == LCB_SUCCESS) {
+        ingest_rc_ = rc;
+        lcb_log(LOGARGS(this, WARN), LOGFMT "Failed to ingest row: %s%s", LOGID(this), lcb_strerror_short(rc),
+                ingest_options_.ignore_errors ? "" : ". Not ingesting further rows");
     }
 }
 
@@ -234,7 +266,9 @@ lcb_ANALYTICS_HANDLE_::lcb_ANALYTICS_HANDLE_(lcb_INSTANCE *obj, void *user_cooki
         document_queue_->cb_schedule = cb_op_schedule;
         document_queue_->cb_ready = cb_doc_ready;
         document_queue_->cb_throttle = cb_docq_throttle;
-        // TODO: docq->max_pending_response;
+        if (ingest_options().max_concurrency) {
+            document_queue_->max_pending_response = ingest_options().max_concurrency;
+        }
         lcb_aspend_add(&instance_->pendops, LCB_PENDTYPE_COUNTER, nullptr);
     }
     if (cmd->want_impersonation()) {
@@ -286,14 +320,14 @@ lcb_STATUS lcb_ANALYTICS_HANDLE_::issue_htreq(const std::string &body)
 
     span_ = lcb::trace::start_http_span_with_statement(instance_->settings, this, statement_);
     lcb_cmdhttp_parent_span(htcmd, span_);
+    if (priority_) {
+        htcmd->set_header("Analytics-Priority", "-1");
+    }
 
     lcb_STATUS rc = lcb_http(instance_, this, htcmd);
     lcb_cmdhttp_destroy(htcmd);
     if (rc == LCB_SUCCESS) {
         http_request_->set_callback(reinterpret_cast<lcb_RESPCALLBACK>(chunk_callback));
-        if (priority_) {
-            http_request_->add_header("Analytics-Priority", "-1");
-        }
     }
     return rc;
 }
@@ -367,6 +401,9 @@ void lcb_ANALYTICS_HANDLE_::invoke_row(lcb_RESPANALYTICS *resp, bool is_last)
 {
     resp->cookie = cookie_;
     resp->htresp = http_response_;
+    resp->ingest_stored = ingest_stored_;
+    resp->ingest_ignored = ingest_ignored_;
+    resp->ingest_failed = ingest_failed_;
 
     if (resp->htresp != nullptr) {
         resp->ctx.http_response_code = resp->htresp->ctx.response_code;
@@ -454,6 +491,10 @@ void lcb_ANALYTICS_HANDLE_::invoke_row(lcb_RESPANALYTICS *resp, bool is_last)
             }
         }
 
+        if (resp->ctx.rc == LCB_SUCCESS && ingest_aborted()) {
+            resp->ctx.rc = ingest_rc_;
+        }
+
         if (span_ != nullptr) {
             lcb::trace::finish_http_span(span_, this);
             span_ = nullptr;
@@ -34,6 +34,10 @@
 struct IngestRequest : lcb::docreq::DocRequest {
     lcb_ANALYTICS_HANDLE *request_{nullptr};
     std::string row;
+    /** The data converter skipped the row */
+    bool ignored{false};
+    /** The row was not ingested because of an earlier failure */
+    bool skipped{false};
 };
 
 /**
@@ -128,6 +132,18 @@ struct lcb_ANALYTICS_HANDLE_ : lcb::jsparse::Parser::Actions {
         return ingest_options_;
     }
 
+    /**
+     * Account for an ingested row once its mutation has completed
+     * @param req the row
+     */
+    void ingest_done(const IngestRequest *req);
+
+    /** @return whether a failed mutation stopped the ingestion */
+    bool ingest_aborted() const
+    {
+        return ingest_rc_ != LCB_SUCCESS && !ingest_options_.ignore_errors;
+    }
+
     lcbtrace_SPAN *span() const
     {
         return span_;
@@ -264,6 +280,11 @@ struct lcb_ANALYTICS_HANDLE_ : lcb::jsparse::Parser::Actions {
 
     lcb_INGEST_OPTIONS ingest_options_{};
     lcb::docreq::Queue *document_queue_{nullptr};
+    std::size_t ingest_stored_{0};
+    std::size_t ingest_ignored_{0};
+    std::size_t ingest_failed_{0};
+    /** Status of the first failed mutation */
+    lcb_STATUS ingest_rc_{LCB_SUCCESS};
     unsigned refcount{1};
 
     lcbtrace_SPAN *parent_span_{nullptr};
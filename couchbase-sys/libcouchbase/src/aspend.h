@@ -18,12 +18,7 @@
 #ifndef LCB_ASPEND_H
 #define LCB_ASPEND_H
 
-#ifdef __cplusplus
-#include <set>
-typedef std::set< void * > lcb_ASPEND_SETTYPE;
-#else
-typedef void lcb_ASPEND_SETTYPE;
-#endif
+#include "list.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -42,6 +37,9 @@ extern "C" {
  *
  * An exception to this rule is the special LCB_PENDTYPE_COUNTER which does
  * not associate a specific pointer with it.
+ *
+ * Items embed an lcb_ASPEND_ITEM, which links them into the queue of their
+ * type, so that adding and removing them neither allocates nor searches.
  */
 
 /** Pending item type */
@@ -52,9 +50,15 @@ typedef enum {
     LCB_PENDTYPE_MAX
 } lcb_ASPENDTYPE;
 
+/** Hook of a pending item, embedded in the item itself */
+typedef struct {
+    lcb_list_t link; /**< Unlinked (NULL) unless the item is pending */
+    void *owner;     /**< The item, e.g. the lcb_http_request_t */
+} lcb_ASPEND_ITEM;
+
 /** Items for pending operations */
 typedef struct {
-    lcb_ASPEND_SETTYPE *items[LCB_PENDTYPE_MAX];
+    lcb_list_t items[LCB_PENDTYPE_MAX]; /**< lcb_ASPEND_ITEM::link of the pending items of each type */
     unsigned count;
 } lcb_ASPEND;
 
@@ -71,12 +75,20 @@ void lcb_aspend_init(lcb_ASPEND *ops);
 void lcb_aspend_cleanup(lcb_ASPEND *ops);
 
 /**
- * Add an opaque pointer of a given type to a pending queue
+ * Initialize the hook of an item which is not pending
+ * @param item The hook
+ * @param owner The item the hook is embedded in
+ */
+void lcb_aspend_item_init(lcb_ASPEND_ITEM *item, void *owner);
+
+/**
+ * Add an item of a given type to a pending queue
  * @param ops
  * @param type The type of pointer to add
- * @param item The item to add
+ * @param item The hook of the item to add. Adding an item which is already
+ * pending has no effect.
  */
-void lcb_aspend_add(lcb_ASPEND *ops, lcb_ASPENDTYPE type, const void *item);
+void lcb_aspend_add(lcb_ASPEND *ops, lcb_ASPENDTYPE type, lcb_ASPEND_ITEM *item);
 
 /**
  * Remove an item from the queue and decrement the pending count
@@ -84,12 +96,12 @@ void lcb_aspend_add(lcb_ASPEND *ops, lcb_ASPENDTYPE type, const void *item);
  * @param type The type of item to remove
  * @param item The item to remove
  *
- * @attention If the item is not found inside the queue then the count is
+ * @attention If the item is not pending then the count is
  * _not_ decremented. An exception to this rule is the LCB_PENDTYPE_COUNTER
  * type which does not have a pointer associated with it. In this case the
  * counter is always decremented.
  */
-void lcb_aspend_del(lcb_ASPEND *ops, lcb_ASPENDTYPE type, const void *item);
+void lcb_aspend_del(lcb_ASPEND *ops, lcb_ASPENDTYPE type, lcb_ASPEND_ITEM *item);
 
 /**
  * Determine whether there are pending items in any of the queues
@@ -97,6 +109,16 @@ void lcb_aspend_del(lcb_ASPEND *ops, lcb_ASPENDTYPE type, const void *item);
  */
 #define lcb_aspend_pending(ops) ((ops)->count > 0)
 
+/**
+ * Iterate over the pending items of a type
+ * @param pos lcb_list_t pointer for the current position
+ * @param n lcb_list_t pointer for the next position, the current item may be removed
+ */
+#define LCB_ASPEND_FOR(pos, n, ops, type) LCB_LIST_SAFE_FOR(pos, n, &(ops)->items[type])
+
+/** @return the item of a position of LCB_ASPEND_FOR() */
+#define LCB_ASPEND_OWNER(pos) (LCB_LIST_ITEM(pos, lcb_ASPEND_ITEM, link)->owner)
+
 #ifdef __cplusplus
 }
 #endif
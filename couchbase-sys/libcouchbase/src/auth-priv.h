@@ -22,6 +22,7 @@
 #ifdef __cplusplus
 #include <string>
 #include <map>
+#include <mutex>
 
 struct lcbauth_CREDENTIALS_ {
     void hostname(std::string hostname)
@@ -205,6 +206,20 @@ class Authenticator
         return LCB_SUCCESS;
     }
 
+    /**
+     * Looks up the SCRAM salted password derived for these credentials, so
+     * that only the first handshake with a given salt and iteration count pays
+     * for the PBKDF2 derivation.
+     * @param mech the cbsasl mechanism
+     * @param salt the salt sent by the server (base64)
+     * @return true and the salted password in out if it is cached
+     */
+    bool scram_salted_password(const std::string &user, const std::string &pass, int mech, const std::string &salt,
+                               unsigned itcount, std::string &out) const;
+    /** Stores the salted password derived for these credentials */
+    void scram_salted_password(const std::string &user, const std::string &pass, int mech, const std::string &salt,
+                               unsigned itcount, const std::string &salted) const;
+
   private:
     size_t refcount_{1};
 
@@ -214,6 +229,14 @@ class Authenticator
     lcbauth_MODE mode_{LCBAUTH_MODE_CLASSIC};
     void *cookie_{nullptr};
     void (*callback_)(lcbauth_CREDENTIALS *){nullptr};
+
+    struct ScramEntry {
+        std::string password;
+        std::string salted;
+    };
+    /* user, mechanism, salt and iteration count to salted password; not copied with the authenticator */
+    mutable std::map<std::string, ScramEntry> scram_cache_{};
+    mutable std::mutex scram_mutex_{};
 };
 } // namespace lcb
 #endif
@@ -112,6 +112,43 @@ lcbauth_CREDENTIALS Authenticator::credentials_for(lcbauth_SERVICE service, lcba
     return creds;
 }
 
+/** Bounds the SCRAM cache, which only grows when the servers rotate salts */
+#define SCRAM_CACHE_MAX 64
+
+static std::string scram_key(const std::string &user, int mech, const std::string &salt, unsigned itcount)
+{
+    std::string key(user);
+    key += '\0';
+    key += std::to_string(mech);
+    key += '\0';
+    key += salt;
+    key += '\0';
+    key += std::to_string(itcount);
+    return key;
+}
+
+bool Authenticator::scram_salted_password(const std::string &user, const std::string &pass, int mech,
+                                          const std::string &salt, unsigned itcount, std::string &out) const
+{
+    std::lock_guard<std::mutex> guard(scram_mutex_);
+    const auto it = scram_cache_.find(scram_key(user, mech, salt, itcount));
+    if (it == scram_cache_.end() || it->second.password != pass) {
+        return false;
+    }
+    out = it->second.salted;
+    return true;
+}
+
+void Authenticator::scram_salted_password(const std::string &user, const std::string &pass, int mech,
+                                          const std::string &salt, unsigned itcount, const std::string &salted) const
+{
+    std::lock_guard<std::mutex> guard(scram_mutex_);
+    if (scram_cache_.size() >= SCRAM_CACHE_MAX) {
+        scram_cache_.clear();
+    }
+    scram_cache_[scram_key(user, mech, salt, itcount)] = ScramEntry{pass, salted};
+}
+
 void lcbauth_ref(lcb_AUTHENTICATOR *auth)
 {
     auth->incref();
@@ -18,6 +18,9 @@
 #define LCB_BOOTSTRAP_DEFINE_STRUCT 1
 #include "internal.h"
 #include "defer.h"
+#include "bucketconfig/shared_config.h"
+#include "lcbio/resolve.h"
+#include "rnd.h"
 
 #define LOGARGS(instance, lvl) instance->settings, "bootstrap", LCB_LOG_##lvl, __FILE__, __LINE__
 
@@ -37,13 +40,8 @@ void Bootstrap::config_callback(EventType event, ConfigInfo *info)
     lcb_INSTANCE *instance = parent;
 
     if (event != CLCONFIG_EVENT_GOT_NEW_CONFIG) {
-        if (event == CLCONFIG_EVENT_PROVIDERS_CYCLED && !LCBT_VBCONFIG(instance)) {
-            if (parent->confmon->get_last_error() == LCB_ERR_CONNECTION_REFUSED) {
-                initial_error(LCB_ERR_NO_MATCHING_SERVER,
-                              "Unable to bootstrap, check ports and cluster encryption setting");
-            } else {
-                initial_error(LCB_ERR_NO_MATCHING_SERVER, "No more bootstrap providers remain");
-            }
+        if (event == CLCONFIG_EVENT_PROVIDERS_CYCLED && !LCBT_VBCONFIG(instance) && !refresh_srv()) {
+            providers_cycled();
         }
         return;
     }
@@ -88,6 +86,10 @@ void Bootstrap::config_callback(EventType event, ConfigInfo *info)
     }
     lcb_update_vbconfig(instance, info);
 
+    if (state >= S_BOOTSTRAPPED && info->get_origin() != CLCONFIG_FILE) {
+        tighten_poll();
+    }
+
     if (state < S_BOOTSTRAPPED) {
         state = S_BOOTSTRAPPED;
         lcb_aspend_del(&instance->pendops, LCB_PENDTYPE_COUNTER, nullptr);
@@ -141,6 +143,12 @@ void Bootstrap::config_callback(EventType event, ConfigInfo *info)
 
         // See if we can enable background polling.
         check_bgpoll();
+
+        if (info->get_origin() == CLCONFIG_FILE) {
+            /* Operations are dispatched with the cached configuration right
+             * away, but it still has to be confirmed by the cluster */
+            tmpoll.signal();
+        }
     }
 
     lcb_maybe_breakout(instance);
@@ -163,20 +171,107 @@ void Bootstrap::clconfig_lsn(EventType e, ConfigInfo *i)
 
 void Bootstrap::check_bgpoll()
 {
-    if (parent->cur_configinfo == nullptr || parent->cur_configinfo->get_origin() != lcb::clconfig::CLCONFIG_CCCP ||
-        LCBT_SETTING(parent, config_poll_interval) == 0) {
+    bool polled = false;
+    if (parent->cur_configinfo != nullptr) {
+        lcb::clconfig::Method origin = parent->cur_configinfo->get_origin();
+        /* configurations loaded from a shared group were polled by another member */
+        polled = origin == lcb::clconfig::CLCONFIG_CCCP ||
+                 (origin == lcb::clconfig::CLCONFIG_PHONY && parent->shared_config != nullptr);
+    }
+    if (!polled || LCBT_SETTING(parent, config_poll_interval) == 0) {
         tmpoll.cancel();
     } else {
-        tmpoll.rearm(LCBT_SETTING(parent, config_poll_interval));
+        tmpoll.rearm(poll_delay());
     }
 }
 
 void Bootstrap::bgpoll()
 {
-    bootstrap(BS_REFRESH_ALWAYS);
+    lcb::clconfig::SharedMember *shared = parent->shared_config;
+    lcb_U32 interval = std::max(poll_interval, LCBT_SETTING(parent, config_poll_interval));
+    if (shared != nullptr && !shared->group()->claim_poll(interval)) {
+        /* another member of the group polled recently */
+        shared->sync();
+    } else {
+        bootstrap(BS_REFRESH_ALWAYS);
+    }
+    backoff_poll();
     check_bgpoll();
 }
 
+/**
+ * Time until the next background poll. With an adaptive interval, it is
+ * spread by up to a tenth either way, so that the instances started together
+ * do not keep polling the cluster at the same time.
+ */
+lcb_U32 Bootstrap::poll_delay()
+{
+    lcb_U32 base = LCBT_SETTING(parent, config_poll_interval);
+    if (LCBT_SETTING(parent, config_poll_max_interval) <= base) {
+        return base;
+    }
+    lcb_U32 interval = std::max(poll_interval, base);
+    lcb_U32 jitter = interval / 10;
+    if (jitter == 0) {
+        return interval;
+    }
+    return interval - jitter + lcb_next_rand32() % (2 * jitter + 1);
+}
+
+static bool all_servers_push_config(lcb_INSTANCE *instance)
+{
+    mc_CMDQUEUE *cq = &instance->cmdq;
+    if (cq->npipelines == 0) {
+        return false;
+    }
+    for (unsigned ii = 0; ii < cq->npipelines; ii++) {
+        if (!static_cast<lcb::Server *>(cq->pipelines[ii])->supports_config_push()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Doubles the poll interval after a poll which found the configuration
+ * unchanged, as long as every node notifies the changes. The polls are then
+ * only a safety net for lost notifications.
+ */
+void Bootstrap::backoff_poll()
+{
+    lcb_U32 base = LCBT_SETTING(parent, config_poll_interval);
+    lcb_U32 max = LCBT_SETTING(parent, config_poll_max_interval);
+    if (max <= base || !all_servers_push_config(parent)) {
+        poll_interval = base;
+        return;
+    }
+    uint64_t next = std::max<uint64_t>(poll_interval, base) * 2;
+    if (next > max) {
+        next = max;
+    }
+    if (poll_interval != next) {
+        lcb_log(LOGARGS(parent, DEBUG), "Configuration stable, next background polls in %ums",
+                (unsigned)(next / 1000));
+    }
+    poll_interval = next;
+}
+
+/**
+ * Resets the poll interval once the configuration changed or is suspected
+ * stale (e.g. after NOT_MY_VBUCKET), and brings the next poll forward.
+ */
+void Bootstrap::tighten_poll()
+{
+    lcb_U32 base = LCBT_SETTING(parent, config_poll_interval);
+    if (poll_interval <= base) {
+        return;
+    }
+    poll_interval = base;
+    if (tmpoll.is_armed()) {
+        check_bgpoll();
+    }
+}
+
 /**
  * This it the initial bootstrap timeout handler. This timeout pins down the
  * instance. It is only scheduled during the initial bootstrap and is only
@@ -195,6 +290,74 @@ void Bootstrap::timer_dispatch()
     }
 }
 
+void Bootstrap::providers_cycled()
+{
+    if (parent->confmon->get_last_error() == LCB_ERR_CONNECTION_REFUSED) {
+        initial_error(LCB_ERR_NO_MATCHING_SERVER, "Unable to bootstrap, check ports and cluster encryption setting");
+    } else {
+        initial_error(LCB_ERR_NO_MATCHING_SERVER, "No more bootstrap providers remain");
+    }
+}
+
+/**
+ * When none of the hosts found through DNS SRV could be bootstrapped from,
+ * query the records again (off the loop) before giving up: the cluster may
+ * have been re-addressed, e.g. by a rolling upgrade.
+ *
+ * @return true if the query was started, and the bootstrap goes on from
+ * srv_callback()
+ */
+bool Bootstrap::refresh_srv()
+{
+    const char *name = LCBT_SETTING(parent, srv_name);
+    if (name == nullptr || srv_pending || parent->settings->resolver == nullptr) {
+        return false;
+    }
+    if (!parent->settings->resolver->resolve_srv(name, srv_callback, this)) {
+        return false;
+    }
+    lcb_log(LOGARGS(parent, INFO), "No bootstrap host from DNS SRV responded. Querying \"%s\" again", name);
+    srv_pending = true;
+    return true;
+}
+
+void Bootstrap::srv_callback(void *arg, lcb_STATUS rc, const lcb::Hostlist &hosts)
+{
+    auto *self = static_cast<Bootstrap *>(arg);
+    lcb_INSTANCE *instance = self->parent;
+    self->srv_pending = false;
+    if (self->state != S_INITIAL_PRE || !self->tm.is_armed()) {
+        /* bootstrapped or failed meanwhile */
+        return;
+    }
+
+    bool changed = false;
+    if (rc == LCB_SUCCESS) {
+        changed = hosts.size() != instance->mc_nodes->size();
+        for (size_t ii = 0; ii < hosts.size() && !changed; ii++) {
+            changed = !instance->mc_nodes->exists(hosts[ii]);
+        }
+    }
+    if (!changed) {
+        lcb_log(LOGARGS(instance, INFO), "DNS SRV records unchanged (%s)", lcb_strerror_short(rc));
+        self->providers_cycled();
+        return;
+    }
+
+    lcb_log(LOGARGS(instance, INFO), "DNS SRV records changed. Bootstrapping from %u new hosts",
+            (unsigned)hosts.size());
+    instance->mc_nodes->assign(hosts);
+    clconfig::Provider *cccp = instance->confmon->get_provider(clconfig::CLCONFIG_CCCP);
+    if (cccp != nullptr && cccp->enabled) {
+        cccp->configure_nodes(*instance->mc_nodes);
+    }
+    unsigned options = BS_REFRESH_INITIAL;
+    if (instance->settings->bucket) {
+        options |= BS_REFRESH_OPEN_BUCKET;
+    }
+    instance->confmon->start(options);
+}
+
 void Bootstrap::initial_error(lcb_STATUS err, const char *errinfo)
 {
     parent->last_error = parent->confmon->get_last_error();
@@ -220,7 +383,7 @@ void Bootstrap::initial_error(lcb_STATUS err, const char *errinfo)
 
 Bootstrap::Bootstrap(lcb_INSTANCE *instance)
     : parent(instance), tm(parent->iotable, this), tmpoll(parent->iotable, this), last_refresh(0), errcounter(0),
-      state(S_INITIAL_PRE)
+      srv_pending(false), poll_interval(0), state(S_INITIAL_PRE)
 {
     parent->confmon->add_listener(this);
 }
@@ -252,6 +415,9 @@ lcb_STATUS Bootstrap::bootstrap(unsigned options)
     if (options & BS_REFRESH_THROTTLE) {
         /* Refresh throttle requested. This is not true if options == ALWAYS */
         hrtime_t next_ts;
+
+        /* Something looked outdated, do not wait for long between polls */
+        tighten_poll();
         unsigned errthresh = LCBT_SETTING(parent, weird_things_threshold);
 
         if (options & BS_REFRESH_INCRERR) {
@@ -303,6 +469,9 @@ lcb_STATUS Bootstrap::bootstrap(unsigned options)
 
 Bootstrap::~Bootstrap()
 {
+    if (parent->settings->resolver != nullptr) {
+        parent->settings->resolver->cancel(this);
+    }
     tm.release();
     tmpoll.release();
     parent->confmon->remove_listener(this);
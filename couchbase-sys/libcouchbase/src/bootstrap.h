@@ -72,8 +72,14 @@ class Bootstrap : lcb::clconfig::Listener
 
     inline void config_callback(lcb::clconfig::EventType, lcb::clconfig::ConfigInfo *);
     inline void initial_error(lcb_STATUS, const char *);
+    void providers_cycled();
+    bool refresh_srv();
+    static void srv_callback(void *arg, lcb_STATUS rc, const lcb::Hostlist &hosts);
     void timer_dispatch();
     void bgpoll();
+    lcb_U32 poll_delay();
+    void backoff_poll();
+    void tighten_poll();
 
     lcb_INSTANCE *parent;
 
@@ -108,6 +114,16 @@ class Bootstrap : lcb::clconfig::Listener
      */
     unsigned errcounter;
 
+    /** Whether the SRV records of the bootstrap hosts are being queried again */
+    bool srv_pending;
+
+    /**
+     * Current interval of the background polls, in microseconds. It grows from
+     * @ref LCB_CNTL_CONFIG_POLL_INTERVAL up to @ref LCB_CNTL_CONFIG_POLL_MAX_INTERVAL
+     * while the configuration is stable.
+     */
+    lcb_U32 poll_interval;
+
     enum State {
         /** Initial 'blank' state */
         S_INITIAL_PRE = 0,
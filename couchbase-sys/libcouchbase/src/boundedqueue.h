@@ -0,0 +1,111 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2024 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCB_BOUNDEDQUEUE_H
+#define LCB_BOUNDEDQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace lcb
+{
+
+/**
+ * Bounded multi-producer, single-consumer queue (D. Vyukov). Each cell carries
+ * a sequence number telling whether it is free for the producer of a given
+ * position, or holds the item of that position for the consumer. Items are
+ * filled in place, so that the queue never allocates once constructed.
+ */
+template <typename T>
+class BoundedQueue
+{
+  public:
+    explicit BoundedQueue(std::size_t capacity) : cells_(capacity)
+    {
+        for (std::size_t ii = 0; ii < capacity; ii++) {
+            cells_[ii].seq.store(ii, std::memory_order_relaxed);
+        }
+    }
+
+    std::size_t capacity() const
+    {
+        return cells_.size();
+    }
+
+    /** @return the cell to fill for a new item, or NULL if the queue is full */
+    T *claim(std::size_t &pos)
+    {
+        if (cells_.empty()) {
+            return nullptr;
+        }
+        pos = head_.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell &cell = cells_[pos % cells_.size()];
+            std::size_t seq = cell.seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    return &cell.item;
+                }
+            } else if (diff < 0) {
+                return nullptr;
+            } else {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /** Hand the item claimed at @p pos over to the consumer */
+    void publish(std::size_t pos)
+    {
+        cells_[pos % cells_.size()].seq.store(pos + 1, std::memory_order_release);
+    }
+
+    /** Consumer side: @return the oldest item, or NULL if there is none */
+    T *front()
+    {
+        if (cells_.empty()) {
+            return nullptr;
+        }
+        Cell &cell = cells_[tail_ % cells_.size()];
+        if (cell.seq.load(std::memory_order_acquire) != tail_ + 1) {
+            return nullptr;
+        }
+        return &cell.item;
+    }
+
+    void pop()
+    {
+        cells_[tail_ % cells_.size()].seq.store(tail_ + cells_.size(), std::memory_order_release);
+        tail_++;
+    }
+
+  private:
+    struct Cell {
+        std::atomic<std::size_t> seq;
+        T item;
+    };
+    std::vector<Cell> cells_;
+    std::atomic<std::size_t> head_{0};
+    std::size_t tail_{0}; /* only used by the consumer */
+};
+
+} // namespace lcb
+
+#endif /* LCB_BOUNDEDQUEUE_H */
@@ -32,12 +32,14 @@
 #include "mc/compress.h"
 
 #include <stdio.h>
+#include <vector>
 
 #define LOGFMT CTX_LOGFMT
 #define LOGID(p) CTX_LOGID(p->ioctx)
 #define LOGARGS(cccp, lvl) cccp->parent->settings, "cccp", LCB_LOG_##lvl, __FILE__, __LINE__
 
 struct CccpCookie;
+struct CccpRacer;
 
 using namespace lcb::clconfig;
 
@@ -53,6 +55,8 @@ struct CccpProvider : public Provider {
      */
     void stop_current_request(bool is_clean);
     lcb_STATUS schedule_next_request(lcb_STATUS err, bool can_rollover, bool skip_if_push_supported);
+    void request_from_server(lcb::Server *server);
+    lcb::Server *least_loaded_server() const;
     lcb_STATUS expect_config_with_version(const lcb_host_t *origin, config_version version);
     lcb_STATUS mcio_error(lcb_STATUS err);
     void on_timeout()
@@ -60,8 +64,14 @@ struct CccpProvider : public Provider {
         mcio_error(LCB_ERR_TIMEOUT);
     }
     lcb_STATUS update(const char *host, const std::string &config_json);
+    bool is_stale(const std::string &config_json) const;
     void request_config();
+    bool read_config(lcbio_CTX *ctx, lcb_STATUS &err, std::string &config_json);
+    void on_config(const std::string &hoststr, const std::string &jsonstr);
     void on_io_read();
+    void start_racers();
+    void cancel_racers();
+    void racer_done(CccpRacer *racer, lcb_STATUS err, const std::string &config_json);
 
     bool pause() override;
     void configure_nodes(const lcb::Hostlist &) override;
@@ -85,10 +95,16 @@ struct CccpProvider : public Provider {
         Provider::enable();
     }
 
+    // Whether the provider itself (rather than one of the racers) is waiting for a config.
+    bool has_current_request() const
+    {
+        return creq != nullptr || cmdcookie != nullptr || ioctx != nullptr;
+    }
+
     // Whether there is a pending CCCP config request.
     bool has_pending_request() const
     {
-        return creq != nullptr || cmdcookie != nullptr || ioctx != nullptr;
+        return has_current_request() || !racers.empty();
     }
 
     lcb::Hostlist *nodes;
@@ -106,6 +122,11 @@ struct CccpProvider : public Provider {
      * provider will make new request if the expected version is newer than the current one.
      */
     config_version expected_config_version{-1, -1};
+    /* The node which notified about expected_config_version, and so is sure to have it */
+    lcb_host_t expected_origin{};
+    bool has_expected_origin{false};
+    /* Extra connections to the next nodes while there is no config yet, see LCB_CNTL_BOOTSTRAP_PARALLELISM */
+    std::vector<CccpRacer *> racers;
 };
 
 struct CccpCookie {
@@ -129,9 +150,34 @@ struct CccpCookie {
     }
 };
 
+/**
+ * Fetches the config from one more node during the bootstrap, alongside the
+ * request of the provider. Whichever gets a config first wins, and the others
+ * are cancelled.
+ */
+struct CccpRacer {
+    CccpRacer(CccpProvider *parent_, const lcb_host_t &host_)
+        : parent(parent_), host(host_), timer(parent_->parent->iot, this)
+    {
+    }
+    ~CccpRacer();
+
+    void on_timeout()
+    {
+        parent->racer_done(this, LCB_ERR_TIMEOUT, std::string());
+    }
+
+    CccpProvider *parent;
+    lcb_host_t host;
+    lcb::io::ConnectionRequest *creq{};
+    lcbio_CTX *ioctx{};
+    lcb::io::Timer<CccpRacer, &CccpRacer::on_timeout> timer;
+};
+
 static void io_error_handler(lcbio_CTX *, lcb_STATUS);
 static void io_read_handler(lcbio_CTX *, unsigned nr);
 static void on_connected(lcbio_SOCKET *, void *, lcb_STATUS, lcbio_OSERR);
+static void put_config_request(lcbio_CTX *ctx);
 
 static void pooled_close_cb(lcbio_SOCKET *sock, int reusable, void *arg)
 {
@@ -175,6 +221,10 @@ lcb_STATUS CccpProvider::expect_config_with_version(const lcb_host_t *origin, co
     auto previous_expected = expected_config_version;
     if (expected_config_version < requested) {
         expected_config_version = requested;
+        has_expected_origin = origin != nullptr;
+        if (origin != nullptr) {
+            expected_origin = *origin;
+        }
     }
     if (current < expected_config_version) {
         /*
@@ -193,9 +243,15 @@ lcb_STATUS CccpProvider::expect_config_with_version(const lcb_host_t *origin, co
             return LCB_SUCCESS;
         }
         /*
-         * Request new configuration immediately
+         * Request new configuration immediately. Every node sends the notification, so the first one starts the
+         * request, and it goes to the node which would answer it the soonest rather than to the one which sent it.
          */
-        return schedule_next_request(LCB_SUCCESS, /* can_rollover */ true, /* skip_if_push_supported */ false);
+        lcb::Server *server = least_loaded_server();
+        if (server == nullptr) {
+            return schedule_next_request(LCB_SUCCESS, /* can_rollover */ true, /* skip_if_push_supported */ false);
+        }
+        request_from_server(server);
+        return LCB_SUCCESS;
     } else {
         /*
          * The config provider already seen this revision and probably already applied it and using as the current.
@@ -229,6 +285,10 @@ lcb_STATUS CccpProvider::schedule_next_request(lcb_STATUS err, bool can_rollover
     lcb_host_t *next_host = nodes->next(can_rollover, skip_if_push_supported);
     if (!next_host) {
         timer.cancel();
+        if (!racers.empty()) {
+            /* the remaining nodes are being tried already */
+            return LCB_SUCCESS;
+        }
         parent->provider_failed(this, err);
         return err;
     }
@@ -260,27 +320,172 @@ lcb_STATUS CccpProvider::schedule_next_request(lcb_STATUS err, bool can_rollover
             return LCB_SUCCESS;
         }
 
-        cmdcookie = new CccpCookie(this);
-        lcb_log(LOGARGS(this, TRACE), "Re-Issuing CCCP Command on server struct %p (" LCB_HOST_FMT ")", (void *)server,
-                LCB_HOST_ARG(this->parent->settings, next_host));
-        timer.rearm(settings().config_node_timeout);
-        if (settings().bucket && settings().bucket[0] != '\0' && !server->selected_bucket) {
-            cmdcookie->incref();
-            instance->select_bucket(cmdcookie, server);
-        }
-        cmdcookie->incref();
-        instance->request_config(cmdcookie, server, parent->get_current_version());
+        request_from_server(server);
 
     } else {
         /* initiate new connection */
         lcb_log(LOGARGS(this, INFO), "Requesting connection to node " LCB_HOST_FMT " for CCCP configuration",
                 LCB_HOST_ARG(this->parent->settings, next_host));
         creq = instance->memd_sockpool->get(*next_host, settings().config_node_timeout, on_connected, this);
+        if (parent->get_config() == nullptr) {
+            start_racers();
+        }
     }
 
     return LCB_SUCCESS;
 }
 
+void CccpProvider::request_from_server(lcb::Server *server)
+{
+    cmdcookie = new CccpCookie(this);
+    lcb_log(LOGARGS(this, TRACE), "Re-Issuing CCCP Command on server struct %p (" LCB_HOST_FMT ")", (void *)server,
+            LCB_HOST_ARG(this->parent->settings, &server->get_host()));
+    timer.rearm(settings().config_node_timeout);
+    if (settings().bucket && settings().bucket[0] != '\0' && !server->selected_bucket) {
+        cmdcookie->incref();
+        instance->select_bucket(cmdcookie, server);
+    }
+    cmdcookie->incref();
+    instance->request_config(cmdcookie, server, parent->get_current_version());
+}
+
+/** @return the connected node with the fewest operations in flight, or nullptr if none is connected */
+lcb::Server *CccpProvider::least_loaded_server() const
+{
+    lcb::Server *best = nullptr;
+    for (unsigned ii = 0; ii < instance->cmdq.npipelines; ii++) {
+        auto *server = static_cast<lcb::Server *>(instance->cmdq.pipelines[ii]);
+        if (server == nullptr || !server->is_connected() || !server->has_valid_host()) {
+            continue;
+        }
+        if (best == nullptr || server->inflight_ops < best->inflight_ops) {
+            best = server;
+        }
+    }
+    return best;
+}
+
+static void racer_error_handler(lcbio_CTX *ctx, lcb_STATUS err)
+{
+    auto *racer = reinterpret_cast<CccpRacer *>(lcbio_ctx_data(ctx));
+    racer->parent->racer_done(racer, err, std::string());
+}
+
+static void racer_read_handler(lcbio_CTX *ctx, unsigned)
+{
+    auto *racer = reinterpret_cast<CccpRacer *>(lcbio_ctx_data(ctx));
+    lcb_STATUS err = LCB_SUCCESS;
+    std::string config_json;
+    if (racer->parent->read_config(ctx, err, config_json)) {
+        racer->parent->racer_done(racer, err, config_json);
+    }
+}
+
+static void racer_connected(lcbio_SOCKET *sock, void *data, lcb_STATUS err, lcbio_OSERR)
+{
+    auto *racer = reinterpret_cast<CccpRacer *>(data);
+    lcb_settings *settings = racer->parent->parent->settings;
+    racer->creq = nullptr;
+
+    if (err != LCB_SUCCESS) {
+        if (sock) {
+            lcb::io::Pool::discard(sock);
+        }
+        racer->parent->racer_done(racer, err, std::string());
+        return;
+    }
+
+    if (lcbio_protoctx_get(sock, LCBIO_PROTOCTX_SESSINFO) == nullptr) {
+        racer->creq = lcb::SessionRequest::start(sock, settings, settings->config_node_timeout, racer_connected, racer,
+                                                 /* fetch_config */ true);
+        return;
+    }
+
+    lcbio_CTXPROCS ioprocs{};
+    ioprocs.cb_err = racer_error_handler;
+    ioprocs.cb_read = racer_read_handler;
+    racer->ioctx = lcbio_ctx_new(sock, racer, &ioprocs, "bc_cccp_race");
+    sock->service = LCBIO_SERVICE_CFG;
+
+    std::string config = lcb::SessionInfo::get(sock)->take_config();
+    if (config.empty()) {
+        put_config_request(racer->ioctx);
+        racer->timer.rearm(settings->config_node_timeout);
+    } else {
+        racer->parent->racer_done(racer, LCB_SUCCESS, config);
+    }
+}
+
+CccpRacer::~CccpRacer()
+{
+    lcb::io::ConnectionRequest::cancel(&creq);
+    if (ioctx) {
+        bool is_clean = false;
+        lcbio_ctx_close(ioctx, pooled_close_cb, &is_clean);
+    }
+    timer.release();
+}
+
+/** Connect to further nodes, so that up to LCB_CNTL_BOOTSTRAP_PARALLELISM of them are tried at once */
+void CccpProvider::start_racers()
+{
+    while (racers.size() + 1 < settings().bootstrap_parallelism) {
+        lcb_host_t *host = nodes->next(/* wrap */ false);
+        if (host == nullptr) {
+            return;
+        }
+        lcb_log(LOGARGS(this, INFO), "Requesting connection to node " LCB_HOST_FMT " for CCCP configuration (parallel)",
+                LCB_HOST_ARG(this->parent->settings, host));
+        auto *racer = new CccpRacer(this, *host);
+        racers.push_back(racer);
+        racer->creq = instance->memd_sockpool->get(*host, settings().config_node_timeout, racer_connected, racer);
+    }
+}
+
+void CccpProvider::cancel_racers()
+{
+    for (auto *racer : racers) {
+        delete racer;
+    }
+    racers.clear();
+}
+
+void CccpProvider::racer_done(CccpRacer *racer, lcb_STATUS err, const std::string &config_json)
+{
+    std::string hoststr(racer->host.host);
+
+    if (err == LCB_SUCCESS) {
+        lcb_log(LOGARGS(this, DEBUG), "Got configuration from " LCB_HOST_FMT " first, cancelling the other requests",
+                LCB_HOST_ARG(this->parent->settings, &racer->host));
+        /* the connection which got the config may serve the data service later */
+        if (racer->ioctx) {
+            bool is_clean = true;
+            lcbio_ctx_close(racer->ioctx, pooled_close_cb, &is_clean);
+            racer->ioctx = nullptr;
+        }
+        cancel_racers();
+        on_config(hoststr, config_json);
+        return;
+    }
+
+    lcb_log(LOGARGS(this, WARN), "Could not get configuration from " LCB_HOST_FMT ": %s",
+            LCB_HOST_ARG(this->parent->settings, &racer->host), lcb_strerror_short(err));
+    for (auto it = racers.begin(); it != racers.end(); ++it) {
+        if (*it == racer) {
+            racers.erase(it);
+            break;
+        }
+    }
+    delete racer;
+
+    if (has_current_request()) {
+        start_racers();
+    } else {
+        /* the provider ran out of nodes earlier, and fails once the last racer did */
+        schedule_next_request(err, /* can_rollover */ false, /* skip_if_push_supported */ false);
+    }
+}
+
 lcb_STATUS CccpProvider::mcio_error(lcb_STATUS err)
 {
     if (err != LCB_ERR_UNSUPPORTED_OPERATION) {
@@ -290,6 +495,7 @@ lcb_STATUS CccpProvider::mcio_error(lcb_STATUS err)
     stop_current_request(err == LCB_ERR_UNSUPPORTED_OPERATION);
     if (err == LCB_ERR_PROTOCOL_ERROR && LCBT_SETTING(instance, conntype) == LCB_TYPE_CLUSTER) {
         lcb_log(LOGARGS(this, WARN), LOGFMT "Failed to bootstrap using CCCP", LOGID(this));
+        cancel_racers();
         timer.cancel();
         parent->provider_failed(this, err);
         return err;
@@ -321,13 +527,55 @@ lcb_STATUS lcb::clconfig::schedule_get_config(Provider *provider)
                                                                         /* skip_if_push_supported */ false);
 }
 
+/**
+ * Check whether the configuration would be rejected by Confmon anyway, because its revision is not newer than
+ * the current one. Only the revision is extracted, so that the identical configurations attached to every
+ * NOT_MY_VBUCKET during rebalance do not have to be parsed.
+ */
+bool CccpProvider::is_stale(const std::string &config_json) const
+{
+    const ConfigInfo *current = parent->get_config();
+    if (current == nullptr || current->vbc->bname == nullptr || current->vbc->revid < 0) {
+        /* cluster-level configurations are always replaced by bucket ones */
+        return false;
+    }
+
+    int64_t epoch, revision;
+    if (lcbvb_get_json_revision(config_json.c_str(), &epoch, &revision) != 0 || revision < 0) {
+        return false;
+    }
+    if (epoch > current->vbc->revepoch || revision > current->vbc->revid) {
+        return false;
+    }
+    lcb_log(LOGARGS(this, TRACE),
+            LOGFMT "Not parsing configuration with rev=%" PRId64 ":%" PRId64 ", current is %" PRId64 ":%" PRId64,
+            LOGID(this), epoch, revision, current->vbc->revepoch, current->vbc->revid);
+    return true;
+}
+
 lcb_STATUS CccpProvider::update(const char *host, const std::string &config_json)
 {
     if (config_json.empty()) {
         // ignore empty payloads, in case of brief mode
         parent->stop();
+        if (has_expected_origin && parent->get_current_version() < expected_config_version) {
+            /* the node asked may not have applied the notified configuration yet, unlike the one which notified */
+            has_expected_origin = false;
+            lcb::Server *server = instance->find_server(expected_origin);
+            if (server != nullptr && server->is_connected()) {
+                request_from_server(server);
+            }
+        }
+        return LCB_SUCCESS;
+    }
+    if (is_stale(config_json)) {
+        parent->provider_got_stale_config(this);
+        if (parent->get_current_version() < expected_config_version) {
+            return schedule_next_request(LCB_SUCCESS, /* can_rollover */ true, /* skip_if_push_supported */ false);
+        }
         return LCB_SUCCESS;
     }
+
     lcbvb_CONFIG *vbc;
     int rv;
     ConfigInfo *new_config;
@@ -419,7 +667,8 @@ static void on_connected(lcbio_SOCKET *sock, void *data, lcb_STATUS err, lcbio_O
     }
 
     if (lcbio_protoctx_get(sock, LCBIO_PROTOCTX_SESSINFO) == nullptr) {
-        cccp->creq = lcb::SessionRequest::start(sock, settings, settings->config_node_timeout, on_connected, cccp);
+        cccp->creq = lcb::SessionRequest::start(sock, settings, settings->config_node_timeout, on_connected, cccp,
+                                                /* fetch_config */ true);
         return;
     }
 
@@ -427,7 +676,14 @@ static void on_connected(lcbio_SOCKET *sock, void *data, lcb_STATUS err, lcbio_O
     ioprocs.cb_read = io_read_handler;
     cccp->ioctx = lcbio_ctx_new(sock, data, &ioprocs, "bc_cccp");
     sock->service = LCBIO_SERVICE_CFG;
-    cccp->request_config();
+
+    std::string config = lcb::SessionInfo::get(sock)->take_config();
+    if (config.empty()) {
+        cccp->request_config();
+    } else {
+        lcb_log(LOGARGS(cccp, TRACE), "Using cluster map fetched during negotiation");
+        cccp->on_config(lcbio_get_host(sock)->host, config);
+    }
 }
 
 lcb_STATUS CccpProvider::refresh(unsigned options)
@@ -446,6 +702,7 @@ bool CccpProvider::pause()
         return true;
     }
 
+    cancel_racers();
     stop_current_request(false);
     timer.cancel();
     return true;
@@ -453,6 +710,7 @@ bool CccpProvider::pause()
 
 CccpProvider::~CccpProvider()
 {
+    cancel_racers();
     stop_current_request(false);
 
     if (config) {
@@ -506,20 +764,24 @@ static void io_read_handler(lcbio_CTX *ioctx, unsigned)
     reinterpret_cast<CccpProvider *>(lcbio_ctx_data(ioctx))->on_io_read();
 }
 
-void CccpProvider::on_io_read()
+/**
+ * Read the response to GET_CLUSTER_CONFIG
+ * @return false if more data is needed, otherwise the config or the error is set
+ */
+bool CccpProvider::read_config(lcbio_CTX *ctx, lcb_STATUS &err, std::string &config_json)
 {
     unsigned required;
 
 #define return_error(e)                                                                                                \
-    resp.release(ioctx);                                                                                               \
-    mcio_error(e);                                                                                                     \
-    return
+    resp.release(ctx);                                                                                                 \
+    err = e;                                                                                                           \
+    return true
 
     lcb::MemcachedResponse resp;
-    if (!resp.load(ioctx, &required)) {
-        lcbio_ctx_rwant(ioctx, required);
-        lcbio_ctx_schedule(ioctx);
-        return;
+    if (!resp.load(ctx, &required)) {
+        lcbio_ctx_rwant(ctx, required);
+        lcbio_ctx_schedule(ctx);
+        return false;
     }
 
     if (resp.status() != PROTOCOL_BINARY_RESPONSE_SUCCESS) {
@@ -528,7 +790,7 @@ void CccpProvider::on_io_read()
             value.assign(resp.value(), resp.vallen());
         }
         lcb_log(LOGARGS(this, WARN), LOGFMT "CCCP Packet responded with 0x%02x; nkey=%d, cmd=0x%x, seq=0x%x, value=%s",
-                LOGID(this), resp.status(), resp.keylen(), resp.opcode(), resp.opaque(), value.c_str());
+                CTX_LOGID(ctx), resp.status(), resp.keylen(), resp.opcode(), resp.opaque(), value.c_str());
 
         if (settings().bucket == nullptr) {
             switch (resp.status()) {
@@ -555,10 +817,31 @@ void CccpProvider::on_io_read()
         return_error(LCB_ERR_PROTOCOL_ERROR);
     }
 
-    auto jsonstr = resp.inflated_value();
+    config_json = resp.inflated_value();
+    resp.release(ctx);
+    return true;
+
+#undef return_error
+}
+
+void CccpProvider::on_io_read()
+{
+    lcb_STATUS err = LCB_SUCCESS;
+    std::string jsonstr;
+    if (!read_config(ioctx, err, jsonstr)) {
+        return;
+    }
+    if (err != LCB_SUCCESS) {
+        mcio_error(err);
+        return;
+    }
     std::string hoststr(lcbio_get_host(lcbio_ctx_sock(ioctx))->host);
+    on_config(hoststr, jsonstr);
+}
 
-    resp.release(ioctx);
+void CccpProvider::on_config(const std::string &hoststr, const std::string &jsonstr)
+{
+    cancel_racers();
     stop_current_request(true);
 
     lcb_STATUS err = update(hoststr.c_str(), jsonstr.c_str());
@@ -568,8 +851,15 @@ void CccpProvider::on_io_read()
     } else {
         schedule_next_request(LCB_ERR_PROTOCOL_ERROR, /* can_rollover */ false, /* skip_if_push_supported */ false);
     }
+}
 
-#undef return_error
+static void put_config_request(lcbio_CTX *ctx)
+{
+    lcb::MemcachedRequest req(PROTOCOL_BINARY_CMD_GET_CLUSTER_CONFIG);
+    req.opaque(0xF00D);
+    lcbio_ctx_put(ctx, req.data(), req.size());
+    lcbio_ctx_rwant(ctx, 24);
+    lcbio_ctx_schedule(ctx);
 }
 
 void CccpProvider::request_config()
@@ -577,11 +867,7 @@ void CccpProvider::request_config()
     lcb_log(LOGARGS(this, TRACE), "Attempting to retrieve cluster map via CCCP (timeout=%uus)",
             settings().config_node_timeout);
 
-    lcb::MemcachedRequest req(PROTOCOL_BINARY_CMD_GET_CLUSTER_CONFIG);
-    req.opaque(0xF00D);
-    lcbio_ctx_put(ioctx, req.data(), req.size());
-    lcbio_ctx_rwant(ioctx, 24);
-    lcbio_ctx_schedule(ioctx);
+    put_config_request(ioctx);
     timer.rearm(settings().config_node_timeout);
 }
 
@@ -602,6 +888,11 @@ void CccpProvider::dump(FILE *fp) const
     } else {
         fprintf(fp, "CCCP does not have a dedicated connection\n");
     }
+    for (const auto *racer : racers) {
+        lcb_settings *dummy = nullptr;
+        fprintf(fp, "CCCP PARALLEL REQUEST: " LCB_HOST_FMT " (%s)\n", LCB_HOST_ARG(dummy, &racer->host),
+                racer->ioctx ? "connected" : "connecting");
+    }
 
     for (size_t ii = 0; ii < nodes->size(); ii++) {
         const lcb_host_t &curhost = (*nodes)[ii];
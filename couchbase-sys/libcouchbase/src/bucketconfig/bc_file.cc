@@ -22,6 +22,11 @@
 #include <fstream>
 #include <istream>
 #include <cstring>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 #define CONFIG_CACHE_MAGIC "{{{fb85b563d0a8f65fa8d3d58f1b3a0708}}}"
 
@@ -31,12 +36,101 @@
 
 using namespace lcb::clconfig;
 
+namespace
+{
+/** Contents of the cache file, memory-mapped where possible */
+class CacheFile
+{
+  public:
+    CacheFile() = default;
+    CacheFile(const CacheFile &) = delete;
+    CacheFile &operator=(const CacheFile &) = delete;
+    ~CacheFile()
+    {
+#ifndef _WIN32
+        if (map_ != MAP_FAILED) {
+            munmap(map_, size_);
+        }
+#endif
+    }
+
+    /** @return false on failure, with errno set */
+    bool open(const std::string &path)
+    {
+        struct stat st {
+        };
+#ifndef _WIN32
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        if (fstat(fd, &st) != 0) {
+            int save_errno = errno;
+            close(fd);
+            errno = save_errno;
+            return false;
+        }
+        mtime_ = st.st_mtime;
+        size_ = static_cast<size_t>(st.st_size);
+        if (size_ > 0) {
+            map_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        int save_errno = errno;
+        close(fd);
+        if (size_ > 0 && map_ == MAP_FAILED) {
+            errno = save_errno;
+            return false;
+        }
+        data_ = static_cast<const char *>(map_);
+#else
+        std::ifstream ifs(path.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
+        if (!ifs.is_open() || !ifs.good() || stat(path.c_str(), &st) != 0) {
+            return false;
+        }
+        mtime_ = st.st_mtime;
+        size_ = static_cast<size_t>(ifs.tellg());
+        buf_.resize(size_);
+        ifs.seekg(0, std::ios::beg);
+        ifs.read(buf_.data(), size_);
+        data_ = buf_.data();
+#endif
+        return true;
+    }
+
+    const char *data() const
+    {
+        return data_;
+    }
+
+    size_t size() const
+    {
+        return size_;
+    }
+
+    time_t mtime() const
+    {
+        return mtime_;
+    }
+
+  private:
+    const char *data_{nullptr};
+    size_t size_{0};
+    time_t mtime_{0};
+#ifndef _WIN32
+    void *map_{MAP_FAILED};
+#else
+    std::vector<char> buf_;
+#endif
+};
+} // namespace
+
 struct FileProvider : Provider, Listener {
     explicit FileProvider(Confmon *parent_);
     ~FileProvider() override;
 
     enum Status { CACHE_ERROR, NO_CHANGES, UPDATED };
     Status load_cache();
+    bool parse_cache(lcbvb_CONFIG *vbc, const CacheFile &file);
     void reload_cache();
     void maybe_remove_file() const
     {
@@ -62,15 +156,49 @@ struct FileProvider : Provider, Listener {
     bool do_not_cache_cluster{true};
 };
 
+/**
+ * Parse the cache, either in the binary format, or as JSON followed by
+ * CONFIG_CACHE_MAGIC as written by older versions.
+ */
+bool FileProvider::parse_cache(lcbvb_CONFIG *vbc, const CacheFile &file)
+{
+    if (file.size() >= sizeof(LCBVB_BINARY_MAGIC) &&
+        memcmp(file.data(), LCBVB_BINARY_MAGIC, sizeof(LCBVB_BINARY_MAGIC)) == 0) {
+        if (lcbvb_load_binary(vbc, file.data(), file.size()) != 0) {
+            lcb_log(LOGARGS(this, ERROR), LOGFMT "Couldn't load configuration: %s", LOGID(this),
+                    lcbvb_get_error(vbc));
+            maybe_remove_file();
+            return false;
+        }
+        return true;
+    }
+
+    std::string json(file.data(), file.size());
+    size_t end = json.find(CONFIG_CACHE_MAGIC);
+    if (end == std::string::npos) {
+        lcb_log(LOGARGS(this, ERROR), LOGFMT "Couldn't find magic", LOGID(this));
+        maybe_remove_file();
+        return false;
+    }
+    json.resize(end); // Stop parsing at MAGIC
+
+    if (lcbvb_load_json(vbc, json.c_str()) != 0) {
+        lcb_log(LOGARGS(this, ERROR), LOGFMT "Couldn't parse configuration", LOGID(this));
+        lcb_log_badconfig(LOGARGS(this, ERROR), vbc, json.c_str());
+        maybe_remove_file();
+        return false;
+    }
+    return true;
+}
+
 FileProvider::Status FileProvider::load_cache()
 {
     if (filename.empty()) {
         return CACHE_ERROR;
     }
 
-    std::ifstream ifs(filename.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
-
-    if (!ifs.is_open() || !ifs.good()) {
+    CacheFile file;
+    if (!file.open(filename)) {
         int save_errno = last_errno = errno;
         lcb_log(LOGARGS(this, WARN),
                 LOGFMT "Couldn't open config cache for reading (%s). Proceed to next configuration provider.",
@@ -78,35 +206,15 @@ FileProvider::Status FileProvider::load_cache()
         return CACHE_ERROR;
     }
 
-    struct stat st {
-    };
-    if (stat(filename.c_str(), &st)) {
-        last_errno = errno;
-        return CACHE_ERROR;
-    }
-
-    if (last_mtime == st.st_mtime) {
+    if (last_mtime == file.mtime()) {
         lcb_log(LOGARGS(this, DEBUG), LOGFMT "Modification time too old", LOGID(this));
         return NO_CHANGES;
     }
 
-    size_t fsize = ifs.tellg();
-    if (!fsize) {
+    if (!file.size()) {
         lcb_log(LOGARGS(this, WARN), LOGFMT "File '%s' is empty", LOGID(this), filename.c_str());
         return CACHE_ERROR;
     }
-    ifs.seekg(0, std::ios::beg);
-    std::vector<char> buf(fsize);
-    ifs.read(&buf[0], fsize);
-    buf.push_back(0); // NUL termination
-
-    char *end = std::strstr(&buf[0], CONFIG_CACHE_MAGIC);
-    if (end == nullptr) {
-        lcb_log(LOGARGS(this, ERROR), LOGFMT "Couldn't find magic", LOGID(this));
-        maybe_remove_file();
-        return CACHE_ERROR;
-    }
-    *end = '\0'; // Stop parsing at MAGIC
 
     lcbvb_CONFIG *vbc = lcbvb_create();
     if (vbc == nullptr) {
@@ -115,10 +223,7 @@ FileProvider::Status FileProvider::load_cache()
 
     Status status = CACHE_ERROR;
 
-    if (lcbvb_load_json(vbc, &buf[0]) != 0) {
-        lcb_log(LOGARGS(this, ERROR), LOGFMT "Couldn't parse configuration", LOGID(this));
-        lcb_log_badconfig(LOGARGS(this, ERROR), vbc, &buf[0]);
-        maybe_remove_file();
+    if (!parse_cache(vbc, file)) {
         goto GT_DONE;
     }
 
@@ -151,7 +256,7 @@ FileProvider::Status FileProvider::load_cache()
     }
 
     config = ConfigInfo::create(vbc, CLCONFIG_FILE, filename);
-    last_mtime = st.st_mtime;
+    last_mtime = file.mtime();
 
     status = UPDATED;
     vbc = nullptr;
@@ -169,13 +274,15 @@ void FileProvider::write_cache(lcbvb_CONFIG *cfg)
         return;
     }
 
-    std::ofstream ofs(filename.c_str(), std::ios::trunc);
+    std::ofstream ofs(filename.c_str(), std::ios::trunc | std::ios::binary);
     if (ofs.good()) {
         lcb_log(LOGARGS(this, INFO), LOGFMT "Writing configuration to file", LOGID(this));
-        char *json = lcbvb_save_json(cfg);
-        ofs << json;
-        ofs << CONFIG_CACHE_MAGIC;
-        free(json);
+        lcb_SIZE nbuf = 0;
+        char *buf = lcbvb_save_binary(cfg, &nbuf);
+        if (buf != nullptr) {
+            ofs.write(buf, static_cast<std::streamsize>(nbuf));
+            free(buf);
+        }
     } else {
         int save_errno = errno;
         lcb_log(LOGARGS(this, ERROR), LOGFMT "Couldn't open file for writing: %s", LOGID(this), strerror(save_errno));
@@ -342,6 +342,15 @@ struct Confmon {
      */
     void provider_got_config(Provider *which, ConfigInfo *config);
 
+    /**
+     * Same as provider_got_config() for a configuration which the provider
+     * found to be no newer than the current one, without having parsed it.
+     * Listeners are notified as if the comparison had found no changes.
+     *
+     * @param which the provider which received the configuration
+     */
+    void provider_got_stale_config(Provider *which);
+
     /**
      * Dump information about the monitor
      * @param fp the file to which information should be written
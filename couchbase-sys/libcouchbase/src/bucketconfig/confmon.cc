@@ -277,6 +277,14 @@ void Confmon::provider_got_config(Provider *, ConfigInfo *config_)
     stop();
 }
 
+void Confmon::provider_got_stale_config(Provider *)
+{
+    if (config) {
+        invoke_listeners(CLCONFIG_EVENT_GOT_ANY_CONFIG, config);
+    }
+    stop();
+}
+
 void Confmon::do_next_provider()
 {
     state &= ~CONFMON_S_ITERGRACE;
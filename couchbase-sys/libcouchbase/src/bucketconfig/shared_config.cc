@@ -0,0 +1,172 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "internal.h"
+#include "shared_config.h"
+
+#include <map>
+
+#define LOGARGS(instance, lvl) (instance)->settings, "sharedcfg", LCB_LOG_##lvl, __FILE__, __LINE__
+
+using namespace lcb::clconfig;
+
+namespace
+{
+std::mutex registry_mutex;
+std::map<std::string, SharedGroup *> registry;
+} // namespace
+
+SharedGroup *SharedGroup::get(const std::string &name)
+{
+    std::lock_guard<std::mutex> guard(registry_mutex);
+    auto it = registry.find(name);
+    if (it != registry.end()) {
+        it->second->ref();
+        return it->second;
+    }
+    auto *group = new SharedGroup(name);
+    registry[name] = group;
+    return group;
+}
+
+SharedGroup *SharedGroup::create()
+{
+    return new SharedGroup(std::string());
+}
+
+void SharedGroup::ref()
+{
+    refcount_.fetch_add(1);
+}
+
+void SharedGroup::unref()
+{
+    if (name_.empty()) {
+        if (refcount_.fetch_sub(1) == 1) {
+            delete this;
+        }
+        return;
+    }
+    /* named groups may be found again until they are out of the registry */
+    std::lock_guard<std::mutex> guard(registry_mutex);
+    if (refcount_.fetch_sub(1) == 1) {
+        registry.erase(name_);
+        delete this;
+    }
+}
+
+uint64_t SharedGroup::publish(lcbvb_CONFIG *vbc)
+{
+    config_version version{vbc->revepoch, vbc->revid};
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (generation_.load(std::memory_order_relaxed) != 0 && !(version_ < version)) {
+        return 0;
+    }
+    lcb_SIZE nbuf = 0;
+    char *buf = lcbvb_save_binary(vbc, &nbuf);
+    if (buf == nullptr) {
+        return 0;
+    }
+    config_.assign(buf, nbuf);
+    free(buf);
+    version_ = version;
+    return generation_.fetch_add(1, std::memory_order_release) + 1;
+}
+
+uint64_t SharedGroup::fetch(std::string &buf)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    buf = config_;
+    return generation_.load(std::memory_order_relaxed);
+}
+
+bool SharedGroup::claim_poll(uint32_t interval)
+{
+    hrtime_t now = gethrtime();
+    uint64_t last = last_poll_.load(std::memory_order_relaxed);
+    /* leave some slack so that the member due first wins over the others */
+    if (last != 0 && now - last < LCB_US2NS(interval) * 9 / 10) {
+        return false;
+    }
+    return last_poll_.compare_exchange_strong(last, now, std::memory_order_relaxed);
+}
+
+SharedMember::SharedMember(lcb_INSTANCE *instance, SharedGroup *group) : instance_(instance), group_(group)
+{
+    instance_->confmon->add_listener(this);
+    if (instance_->cur_configinfo != nullptr && is_own_bucket(instance_->cur_configinfo->vbc)) {
+        uint64_t generation = group_->publish(instance_->cur_configinfo->vbc);
+        if (generation != 0) {
+            generation_ = generation;
+        }
+    }
+}
+
+SharedMember::~SharedMember()
+{
+    instance_->confmon->remove_listener(this);
+    group_->unref();
+}
+
+void SharedMember::sync()
+{
+    if (group_->generation() == generation_) {
+        return;
+    }
+    std::string buf;
+    generation_ = group_->fetch(buf);
+
+    lcbvb_CONFIG *vbc = lcbvb_create();
+    if (vbc == nullptr) {
+        return;
+    }
+    if (lcbvb_load_binary(vbc, buf.data(), buf.size()) != 0) {
+        lcb_log(LOGARGS(instance_, WARN), "Couldn't load the configuration of shared group \"%s\"",
+                group_->name().c_str());
+        lcbvb_destroy(vbc);
+        return;
+    }
+    if (!is_own_bucket(vbc)) {
+        lcb_log(LOGARGS(instance_, WARN), "Shared group \"%s\" has the configuration of another bucket",
+                group_->name().c_str());
+        lcbvb_destroy(vbc);
+        return;
+    }
+    ConfigInfo *info = ConfigInfo::create(vbc, CLCONFIG_PHONY, "shared:" + group_->name());
+    instance_->confmon->do_set_next(info, false);
+    info->decref();
+}
+
+void SharedMember::clconfig_lsn(EventType event, ConfigInfo *info)
+{
+    if (event == CLCONFIG_EVENT_GOT_NEW_CONFIG && info->get_origin() != CLCONFIG_PHONY && is_own_bucket(info->vbc)) {
+        /* the group now has the configuration of this instance */
+        uint64_t generation = group_->publish(info->vbc);
+        if (generation != 0) {
+            generation_ = generation;
+        }
+    }
+}
+
+bool SharedMember::is_own_bucket(const lcbvb_CONFIG *vbc) const
+{
+    const char *bucket = instance_->settings->bucket;
+    if (bucket == nullptr || vbc->bname == nullptr) {
+        return bucket == nullptr && vbc->bname == nullptr;
+    }
+    return strcmp(bucket, vbc->bname) == 0;
+}
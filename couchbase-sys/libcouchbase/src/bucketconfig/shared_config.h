@@ -0,0 +1,138 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCB_SHARED_CONFIG_H
+#define LCB_SHARED_CONFIG_H
+
+#include "clconfig.h"
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+namespace lcb
+{
+namespace clconfig
+{
+
+/**
+ * Cluster map shared by a group of instances of the process, which are
+ * usually driven by different threads.
+ *
+ * The group keeps the newest configuration any of its members received,
+ * serialized with lcbvb_save_binary(), so that members catch up by loading
+ * it rather than by fetching and parsing the JSON configuration themselves.
+ * The background polling (@ref LCB_CNTL_CONFIG_POLL_INTERVAL) is also shared:
+ * at most one member per interval asks the cluster, the others only load
+ * what it found.
+ *
+ * Groups are reference counted, and named groups are found by name through a
+ * process-wide registry.
+ */
+class SharedGroup
+{
+  public:
+    /** @return the group called `name`, created if needed, with a new reference */
+    static SharedGroup *get(const std::string &name);
+
+    /** @return a new group which is not in the registry, e.g. for a pool */
+    static SharedGroup *create();
+
+    void ref();
+    void unref();
+
+    const std::string &name() const
+    {
+        return name_;
+    }
+
+    /**
+     * Keep `vbc` if it is newer than the configuration of the group.
+     * @return the new generation, or 0 if `vbc` was not newer
+     */
+    uint64_t publish(lcbvb_CONFIG *vbc);
+
+    /** @return the generation of the configuration, bumped on every update */
+    uint64_t generation() const
+    {
+        return generation_.load(std::memory_order_acquire);
+    }
+
+    /**
+     * Copy the configuration of the group.
+     * @return its generation, 0 if the group has no configuration yet
+     */
+    uint64_t fetch(std::string &buf);
+
+    /**
+     * @param interval the polling interval in microseconds
+     * @return true if the caller should poll the cluster, which is the case
+     * for one caller once `interval` has passed since the last poll
+     */
+    bool claim_poll(uint32_t interval);
+
+  private:
+    explicit SharedGroup(std::string name) : name_(std::move(name)) {}
+
+    std::string name_;
+    std::atomic<size_t> refcount_{1};
+    std::atomic<uint64_t> last_poll_{0};
+
+    std::mutex mutex_;
+    std::string config_;
+    config_version version_{0, 0};
+    std::atomic<uint64_t> generation_{0};
+};
+
+/**
+ * Membership of an instance in a group. It publishes the configurations the
+ * instance receives, and applies those of the group to the instance.
+ */
+class SharedMember : public Listener
+{
+  public:
+    /** Join `group`, taking over the reference of the caller */
+    SharedMember(lcb_INSTANCE *instance, SharedGroup *group);
+    ~SharedMember() override;
+
+    SharedGroup *group() const
+    {
+        return group_;
+    }
+
+    /**
+     * Apply the configuration of the group if it changed since the last call.
+     * Must be called on the thread driving the instance.
+     */
+    void sync();
+
+    void clconfig_lsn(EventType event, ConfigInfo *info) override;
+
+  private:
+    /** @return true if `vbc` is a configuration of the bucket of the instance */
+    bool is_own_bucket(const lcbvb_CONFIG *vbc) const;
+
+    lcb_INSTANCE *instance_;
+    SharedGroup *group_;
+    uint64_t generation_{0};
+};
+
+} // namespace clconfig
+} // namespace lcb
+
+#endif /* LCB_SHARED_CONFIG_H */
@@ -78,6 +78,10 @@ CALLBACK_ACCESSOR(lcb_set_bootstrap_callback, lcb_bootstrap_callback, bootstrap)
 CALLBACK_ACCESSOR(lcb_set_pktfwd_callback, lcb_pktfwd_callback, pktfwd)
 CALLBACK_ACCESSOR(lcb_set_pktflushed_callback, lcb_pktflushed_callback, pktflushed)
 CALLBACK_ACCESSOR(lcb_set_open_callback, lcb_open_callback, open)
+CALLBACK_ACCESSOR(lcb_set_inflate_callback, lcb_inflate_callback, inflate)
+CALLBACK_ACCESSOR(lcb_set_overload_callback, lcb_overload_callback, overload)
+CALLBACK_ACCESSOR(lcb_set_value_sink_callback, lcb_value_sink_callback, value_sink)
+CALLBACK_ACCESSOR(lcb_set_batch_callback, lcb_batch_callback, batch)
 
 LIBCOUCHBASE_API
 lcb_RESPCALLBACK lcb_install_callback(lcb_INSTANCE *instance, int cbtype, lcb_RESPCALLBACK cb)
@@ -145,6 +149,8 @@ const char *lcb_strcbtype(int cbtype)
             return "NOOP";
         case LCB_CALLBACK_EXISTS:
             return "EXISTS";
+        case LCB_CALLBACK_RANGESCAN:
+            return "RANGESCAN";
         default:
             return "UNKNOWN";
     }
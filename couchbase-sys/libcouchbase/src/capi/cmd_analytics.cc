@@ -112,6 +112,21 @@ LIBCOUCHBASE_API int lcb_respanalytics_is_final(const lcb_RESPANALYTICS *resp)
     return resp->rflags & LCB_RESP_F_FINAL;
 }
 
+LIBCOUCHBASE_API lcb_STATUS lcb_respanalytics_ingest_stats(const lcb_RESPANALYTICS *resp, size_t *stored,
+                                                           size_t *ignored, size_t *failed)
+{
+    if (stored) {
+        *stored = resp->ingest_stored;
+    }
+    if (ignored) {
+        *ignored = resp->ingest_ignored;
+    }
+    if (failed) {
+        *failed = resp->ingest_failed;
+    }
+    return LCB_SUCCESS;
+}
+
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdanalytics_create(lcb_CMDANALYTICS **cmd)
 {
     *cmd = new lcb_CMDANALYTICS();
@@ -286,6 +301,12 @@ LIBCOUCHBASE_API lcb_STATUS lcb_ingest_options_data_converter(lcb_INGEST_OPTIONS
     return LCB_SUCCESS;
 }
 
+LIBCOUCHBASE_API lcb_STATUS lcb_ingest_options_max_concurrency(lcb_INGEST_OPTIONS *options, uint32_t num)
+{
+    options->max_concurrency = num;
+    return LCB_SUCCESS;
+}
+
 LIBCOUCHBASE_API lcb_STATUS lcb_respanalytics_deferred_handle_extract(const lcb_RESPANALYTICS *resp,
                                                                       lcb_DEFERRED_HANDLE **handle)
 {
@@ -303,11 +324,22 @@ LIBCOUCHBASE_API lcb_STATUS lcb_respanalytics_deferred_handle_extract(const lcb_
     }
     Json::Value status = payload["status"];
     Json::Value value = payload["handle"];
-    if (status.isString() && value.isString()) {
-        *handle = new lcb_DEFERRED_HANDLE_{status.asString(), value.asString(), nullptr};
-        return LCB_SUCCESS;
+    if (!status.isString() || !value.isString()) {
+        return LCB_ERR_INVALID_ARGUMENT;
     }
-    return LCB_ERR_INVALID_ARGUMENT;
+    std::vector<std::string> partitions;
+    const Json::Value &jpartitions = payload["partitions"];
+    if (jpartitions.isArray()) {
+        for (const auto &partition : jpartitions) {
+            const Json::Value &phandle = partition.isObject() ? partition["handle"] : partition;
+            if (!phandle.isString()) {
+                return LCB_ERR_INVALID_ARGUMENT;
+            }
+            partitions.emplace_back(phandle.asString());
+        }
+    }
+    *handle = new lcb_DEFERRED_HANDLE_{status.asString(), value.asString(), nullptr, std::move(partitions), true, 0};
+    return LCB_SUCCESS;
 }
 
 LIBCOUCHBASE_API lcb_STATUS lcb_deferred_handle_destroy(lcb_DEFERRED_HANDLE *handle)
@@ -339,6 +371,33 @@ LIBCOUCHBASE_API lcb_STATUS lcb_deferred_handle_callback(lcb_DEFERRED_HANDLE *ha
     return LCB_ERR_INVALID_ARGUMENT;
 }
 
+LIBCOUCHBASE_API lcb_STATUS lcb_deferred_handle_partitions(lcb_DEFERRED_HANDLE *handle, size_t *count)
+{
+    if (handle == nullptr) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    *count = handle->partitions.size();
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_deferred_handle_ordered(lcb_DEFERRED_HANDLE *handle, int ordered)
+{
+    if (handle == nullptr) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    handle->ordered = ordered != 0;
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_deferred_handle_parallelism(lcb_DEFERRED_HANDLE *handle, size_t parallelism)
+{
+    if (handle == nullptr) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    handle->parallelism = parallelism;
+    return LCB_SUCCESS;
+}
+
 LIBCOUCHBASE_API lcb_STATUS lcb_errctx_analytics_rc(const lcb_ANALYTICS_ERROR_CONTEXT *ctx)
 {
     return ctx->rc;
@@ -48,6 +48,7 @@ struct lcb_INGEST_OPTIONS_ {
     lcb_INGEST_METHOD method{LCB_INGEST_METHOD_NONE};
     std::uint32_t exptime{0};
     bool ignore_errors{false};
+    std::uint32_t max_concurrency{0};
     lcb_INGEST_DATACONVERTER_CALLBACK data_converter{default_data_converter};
 };
 
@@ -80,12 +81,21 @@ struct lcb_RESPANALYTICS_ {
     std::size_t nrow;
     const lcb_RESPHTTP *htresp;
     lcb_ANALYTICS_HANDLE *handle;
+    std::size_t ingest_stored;
+    std::size_t ingest_ignored;
+    std::size_t ingest_failed;
 };
 
 struct lcb_DEFERRED_HANDLE_ {
     std::string status;
     std::string handle;
     lcb_ANALYTICS_CALLBACK callback;
+    /** Handles of the partitions of the result, if the server reported them */
+    std::vector<std::string> partitions;
+    /** Whether rows of the partitions are delivered in partition order */
+    bool ordered;
+    /** How many partitions are fetched at the same time (0 for all of them) */
+    std::size_t parallelism;
 };
 
 struct lcb_CMDANALYTICS_ {
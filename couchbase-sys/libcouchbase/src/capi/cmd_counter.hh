@@ -180,6 +180,17 @@ struct lcb_CMDCOUNTER_ {
         return cookie_;
     }
 
+    /* Used by lcb_counter_multi() to route the responses through its own callback */
+    void treat_cookie_as_callback(bool value)
+    {
+        cookie_is_callback_ = value;
+    }
+
+    bool is_cookie_callback() const
+    {
+        return cookie_is_callback_;
+    }
+
     lcb_STATUS on_behalf_of(std::string user)
     {
         impostor_ = std::move(user);
@@ -216,6 +227,7 @@ struct lcb_CMDCOUNTER_ {
     std::chrono::nanoseconds start_time_{0};
     lcbtrace_SPAN *parent_span_{nullptr};
     void *cookie_{nullptr};
+    bool cookie_is_callback_{false};
     std::string key_{};
     bool initialize_if_does_not_exist_{false};
     lcb_DURABILITY_LEVEL durability_level_{LCB_DURABILITYLEVEL_NONE};
@@ -137,6 +137,18 @@ struct lcb_CMDEXISTS_ {
         return extra_privileges_;
     }
 
+    lcb_STATUS near_cache(bool enable)
+    {
+        near_cache_ = enable;
+        return LCB_SUCCESS;
+    }
+
+    /** @return whether the key may be reported missing by the near cache, see LCB_CNTL_NEGATIVE_CACHE_SIZE */
+    bool near_cache() const
+    {
+        return near_cache_;
+    }
+
     bool want_impersonation() const
     {
         return !impostor_.empty();
@@ -156,6 +168,7 @@ struct lcb_CMDEXISTS_ {
     std::string key_{};
     std::string impostor_{};
     std::vector<std::string> extra_privileges_{};
+    bool near_cache_{false};
 };
 
 /**
@@ -29,6 +29,7 @@ enum class get_mode {
     normal,
     with_touch,
     with_lock,
+    hedged,
 };
 /**
  * @private
@@ -59,6 +60,54 @@ struct lcb_CMDGET_ {
         return LCB_SUCCESS;
     }
 
+    lcb_STATUS hedge(std::uint32_t delay)
+    {
+        if (mode_ != get_mode::normal && mode_ != get_mode::hedged) {
+            return LCB_ERR_INVALID_ARGUMENT;
+        }
+        mode_ = get_mode::hedged;
+        hedge_delay_ = std::chrono::microseconds(delay);
+        return LCB_SUCCESS;
+    }
+
+    bool hedged() const
+    {
+        return mode_ == get_mode::hedged;
+    }
+
+    /**
+     * @return the time to wait for the active node before reading from the
+     * replicas, or zero if it should be derived from recent get latencies
+     */
+    std::uint32_t hedge_delay_in_microseconds() const
+    {
+        return static_cast<std::uint32_t>(hedge_delay_.count());
+    }
+
+    lcb_STATUS near_cache(bool enable)
+    {
+        near_cache_ = enable;
+        return LCB_SUCCESS;
+    }
+
+    /** @return whether the value may be read from the near cache, see LCB_CNTL_NEAR_CACHE_SIZE */
+    bool near_cache() const
+    {
+        return near_cache_ && (mode_ == get_mode::normal || mode_ == get_mode::hedged);
+    }
+
+    lcb_STATUS stream_value(bool enable)
+    {
+        stream_value_ = enable;
+        return LCB_SUCCESS;
+    }
+
+    /** @return whether the value is passed to the value sink as it is read, see lcb_set_value_sink_callback() */
+    bool stream_value() const
+    {
+        return stream_value_ && !cookie_is_callback_;
+    }
+
     bool with_touch() const
     {
         return mode_ == get_mode::with_touch;
@@ -212,11 +261,14 @@ struct lcb_CMDGET_ {
     std::chrono::nanoseconds start_time_{0};
     std::uint32_t expiry_{0};
     std::uint32_t lock_time_{0};
+    std::chrono::microseconds hedge_delay_{0};
     lcbtrace_SPAN *parent_span_{nullptr};
     void *cookie_{nullptr};
     std::string key_{};
     get_mode mode_{get_mode::normal};
     bool cookie_is_callback_{false};
+    bool near_cache_{false};
+    bool stream_value_{false};
     std::string impostor_{};
     std::vector<std::string> extra_privileges_{};
 };
@@ -237,6 +289,7 @@ struct lcb_RESPGET_ {
     void *bufh;
     std::uint8_t datatype;  /**< @internal */
     std::uint32_t itmflags; /**< User-defined flags for the item */
+    int is_replica;         /**< Whether a hedged get was answered by a replica */
 };
 
 #endif // LIBCOUCHBASE_CAPI_GET_HH
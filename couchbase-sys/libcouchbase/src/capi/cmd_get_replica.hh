@@ -30,6 +30,8 @@ enum class get_replica_mode {
     any,
     all,
     select,
+    freshest,
+    fastest,
 };
 
 /**
@@ -66,7 +68,31 @@ struct lcb_CMDGETREPLICA_ {
 
     bool need_get_active() const
     {
-        return mode_ == get_replica_mode::all;
+        return mode_ == get_replica_mode::all || mode_ == get_replica_mode::freshest;
+    }
+
+    lcb_STATUS min_cas(std::uint64_t cas)
+    {
+        min_cas_ = cas;
+        return LCB_SUCCESS;
+    }
+
+    /** With get_replica_mode::freshest, a copy with at least this CAS completes the command */
+    std::uint64_t min_cas() const
+    {
+        return min_cas_;
+    }
+
+    lcb_STATUS quorum(std::uint32_t quorum)
+    {
+        quorum_ = quorum;
+        return LCB_SUCCESS;
+    }
+
+    /** With get_replica_mode::freshest, the number of copies to read, 0 for a majority */
+    std::uint32_t quorum() const
+    {
+        return quorum_;
     }
 
     lcb_STATUS key(std::string key)
@@ -192,6 +218,8 @@ struct lcb_CMDGETREPLICA_ {
     std::string key_{};
     get_replica_mode mode_{get_replica_mode::any};
     int select_index_{0};
+    std::uint64_t min_cas_{0};
+    std::uint32_t quorum_{0};
     std::string impostor_{};
     std::vector<std::string> extra_privileges_{};
 };
@@ -45,6 +45,14 @@
  */
 #define LCB_CMDHTTP_F_NOUPASS (1 << 18)
 
+/**
+ * @internal
+ * Do not copy lcb_CMDHTTP::body. The caller keeps the buffer unchanged until
+ * the request is finished (or cancelled), so that retries and redirects can
+ * resend it.
+ */
+#define LCB_CMDHTTP_F_BORROWBODY (1 << 19)
+
 /**
  * Structure for performing an HTTP request.
  * Note that the key and nkey fields indicate the _path_ for the API
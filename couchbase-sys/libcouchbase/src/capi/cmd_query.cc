@@ -232,17 +232,11 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdquery_consistency_tokens(lcb_CMDQUERY *cmd, l
     if (rc != LCB_SUCCESS) {
         return rc;
     }
-    std::size_t keyspace_len = strlen(keyspace);
-
-    auto vbmax = static_cast<std::uint16_t>(vbc->nvb);
-    for (std::uint16_t ii = 0; ii < vbmax; ++ii) {
-        lcb_KEYBUF kb;
-        kb.type = LCB_KV_VBID;
-        kb.vbid = ii;
-        const lcb_MUTATION_TOKEN *mt = lcb_get_mutation_token(instance, &kb, &rc);
-        if (rc == LCB_SUCCESS && mt != nullptr) {
-            cmd->consistency_token_for_keyspace(keyspace, keyspace_len, mt);
-        }
+
+    std::size_t ntokens = 0;
+    const lcb_MUTATION_TOKEN *tokens = lcb_get_mutation_tokens(instance, &ntokens, &rc);
+    if (rc == LCB_SUCCESS && tokens != nullptr) {
+        cmd->consistency_tokens_for_keyspace(keyspace, strlen(keyspace), tokens, ntokens);
     }
     return LCB_SUCCESS;
 }
@@ -273,6 +267,11 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdquery_preserve_expiry(lcb_CMDQUERY *cmd, int
     return cmd->preserve_expiry(preserve_expiry);
 }
 
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdquery_max_rows(lcb_CMDQUERY *cmd, size_t max_rows)
+{
+    return cmd->max_rows(max_rows);
+}
+
 LIBCOUCHBASE_API lcb_STATUS lcb_errctx_query_rc(const lcb_QUERY_ERROR_CONTEXT *ctx)
 {
     return ctx->rc;
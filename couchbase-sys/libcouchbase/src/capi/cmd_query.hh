@@ -25,6 +25,7 @@
 #include "contrib/lcb-jsoncpp/lcb-jsoncpp.h"
 #include "collection_qualifier.hh"
 #include "jsparse/parser.h"
+#include "n1ql/mutation_state.hh"
 
 /**
  * @private
@@ -200,12 +201,25 @@ struct lcb_CMDQUERY_ {
             return LCB_ERR_INVALID_ARGUMENT;
         }
         root_["scan_consistency"] = "at_plus";
-        auto &vb = root_["scan_vectors"][std::string(keyspace, keyspace_len)][std::to_string(token->vbid_)];
-        vb[0] = static_cast<Json::UInt64>(token->seqno_);
-        vb[1] = std::to_string(token->uuid_);
+        mutation_state_.add(keyspace, keyspace_len, *token);
         return LCB_SUCCESS;
     }
 
+    /** Be consistent with each token of `tokens`, indexed by vBucket (see lcb_INSTANCE::dcpinfo) */
+    lcb_STATUS consistency_tokens_for_keyspace(const char *keyspace, size_t keyspace_len,
+                                               const lcb_MUTATION_TOKEN *tokens, std::size_t ntokens)
+    {
+        root_["scan_consistency"] = "at_plus";
+        mutation_state_.add_all(keyspace, keyspace_len, tokens, ntokens);
+        return LCB_SUCCESS;
+    }
+
+    /** The "scan_vectors" of the query, which are not part of root() */
+    const MutationState &mutation_state() const
+    {
+        return mutation_state_;
+    }
+
     lcb_STATUS preserve_expiry(bool preserve_expiry)
     {
         root_["preserve_expiry"] = preserve_expiry;
@@ -320,7 +334,14 @@ struct lcb_CMDQUERY_ {
 
     lcb_STATUS encode_payload()
     {
-        query_ = Json::FastWriter().write(root_);
+        if (mutation_state_.empty() || !root_.isMember("scan_vectors")) {
+            query_ = Json::FastWriter().write(root_);
+            mutation_state_.splice_scan_vectors(query_);
+        } else {
+            Json::Value merged = root_;
+            mutation_state_.merge_into(merged["scan_vectors"]);
+            query_ = Json::FastWriter().write(merged);
+        }
         return LCB_SUCCESS;
     }
 
@@ -331,6 +352,7 @@ struct lcb_CMDQUERY_ {
             return LCB_ERR_INVALID_ARGUMENT;
         }
         root_ = value;
+        mutation_state_.clear();
         return LCB_SUCCESS;
     }
 
@@ -417,6 +439,7 @@ struct lcb_CMDQUERY_ {
         timeout_ = std::chrono::milliseconds::zero();
         parent_span_ = nullptr;
         root_.clear();
+        mutation_state_.clear();
         scope_.clear();
         scope_qualifier_.clear();
         query_.clear();
@@ -439,6 +462,17 @@ struct lcb_CMDQUERY_ {
         cookie_ = cookie;
     }
 
+    lcb_STATUS max_rows(std::size_t limit)
+    {
+        max_rows_ = limit;
+        return LCB_SUCCESS;
+    }
+
+    std::size_t max_rows() const
+    {
+        return max_rows_;
+    }
+
     lcb_STATUS on_behalf_of(std::string user)
     {
         impostor_ = std::move(user);
@@ -466,8 +500,10 @@ struct lcb_CMDQUERY_ {
     bool prepare_statement_{false};
     bool query_is_json_{false};
     bool use_multi_bucket_authentication_{false};
+    std::size_t max_rows_{0};
 
     Json::Value root_{};
+    MutationState mutation_state_{};
     /**Query to be placed in the POST request. The library will not perform
      * any conversions or validation on this string, so it is up to the user
      * (or wrapping library) to ensure that the string is well formed.
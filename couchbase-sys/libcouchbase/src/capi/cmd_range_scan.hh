@@ -0,0 +1,200 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LIBCOUCHBASE_CAPI_RANGE_SCAN_HH
+#define LIBCOUCHBASE_CAPI_RANGE_SCAN_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "collection_qualifier.hh"
+#include "key_value_error_context.hh"
+
+/**
+ * @private
+ */
+struct lcb_CMDRANGESCAN_ {
+    lcb_STATUS collection(lcb::collection_qualifier collection)
+    {
+        collection_ = std::move(collection);
+        return LCB_SUCCESS;
+    }
+
+    lcb_STATUS range(std::string start, std::string end)
+    {
+        start_ = std::move(start);
+        end_ = std::move(end);
+        return LCB_SUCCESS;
+    }
+
+    lcb_STATUS key_only(bool key_only)
+    {
+        key_only_ = key_only;
+        return LCB_SUCCESS;
+    }
+
+    lcb_STATUS concurrency(std::uint32_t concurrency)
+    {
+        concurrency_ = concurrency;
+        return LCB_SUCCESS;
+    }
+
+    lcb_STATUS batch_item_limit(std::uint32_t limit)
+    {
+        batch_item_limit_ = limit;
+        return LCB_SUCCESS;
+    }
+
+    lcb_STATUS batch_byte_limit(std::uint32_t limit)
+    {
+        batch_byte_limit_ = limit;
+        return LCB_SUCCESS;
+    }
+
+    lcb_STATUS parent_span(lcbtrace_SPAN *parent_span)
+    {
+        parent_span_ = parent_span;
+        return LCB_SUCCESS;
+    }
+
+    lcb_STATUS timeout_in_microseconds(std::uint32_t timeout)
+    {
+        timeout_ = std::chrono::microseconds(timeout);
+        return LCB_SUCCESS;
+    }
+
+    const lcb::collection_qualifier &collection() const
+    {
+        return collection_;
+    }
+
+    lcb::collection_qualifier &collection()
+    {
+        return collection_;
+    }
+
+    /** Range scans have no key, this is only used to pick a node to resolve the collection */
+    const std::string &key() const
+    {
+        return key_;
+    }
+
+    const std::string &start() const
+    {
+        return start_;
+    }
+
+    const std::string &end() const
+    {
+        return end_;
+    }
+
+    bool key_only() const
+    {
+        return key_only_;
+    }
+
+    std::uint32_t concurrency() const
+    {
+        return concurrency_;
+    }
+
+    std::uint32_t batch_item_limit() const
+    {
+        return batch_item_limit_;
+    }
+
+    std::uint32_t batch_byte_limit() const
+    {
+        return batch_byte_limit_;
+    }
+
+    std::uint64_t timeout_or_default_in_nanoseconds(std::uint64_t default_timeout) const
+    {
+        if (timeout_ > std::chrono::microseconds::zero()) {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(timeout_).count();
+        }
+        return default_timeout;
+    }
+
+    lcbtrace_SPAN *parent_span() const
+    {
+        return parent_span_;
+    }
+
+    void cookie(void *cookie)
+    {
+        cookie_ = cookie;
+    }
+
+    void *cookie()
+    {
+        return cookie_;
+    }
+
+  private:
+    lcb::collection_qualifier collection_{};
+    std::chrono::microseconds timeout_{0};
+    lcbtrace_SPAN *parent_span_{nullptr};
+    void *cookie_{nullptr};
+    std::string key_{};
+    /* the whole collection: from the smallest to the largest UTF-8 encoded code point */
+    std::string start_{"\x00", 1};
+    std::string end_{"\xf4\x8f\xbf\xbf"};
+    bool key_only_{false};
+    std::uint32_t concurrency_{2};
+    std::uint32_t batch_item_limit_{50};
+    std::uint32_t batch_byte_limit_{15000};
+};
+
+/**
+ * @private
+ * Document returned by a range scan. The key and the value point into the
+ * packet received from the server.
+ */
+struct lcb_RANGESCAN_ITEM {
+    const char *key{nullptr};
+    std::size_t nkey{0};
+    const char *value{nullptr};
+    std::size_t nvalue{0};
+    std::uint32_t flags{0};
+    std::uint32_t expiry{0};
+    std::uint64_t seqno{0};
+    std::uint64_t cas{0};
+    std::uint8_t datatype{0};
+};
+
+/**
+ * @private
+ */
+struct lcb_RESPRANGESCAN_ {
+    lcb_KEY_VALUE_ERROR_CONTEXT ctx{};
+    /**
+     Application-defined pointer passed as the `cookie` parameter when
+     scheduling the command.
+     */
+    void *cookie;
+    /** Response specific flags. see ::lcb_RESPFLAGS */
+    std::uint16_t rflags;
+    std::uint16_t vbucket;
+    std::vector<lcb_RANGESCAN_ITEM> items{};
+};
+
+#endif // LIBCOUCHBASE_CAPI_RANGE_SCAN_HH
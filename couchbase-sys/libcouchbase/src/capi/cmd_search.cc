@@ -103,6 +103,11 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdsearch_on_behalf_of(lcb_CMDSEARCH *cmd, const
     return cmd->on_behalf_of(std::string(data, data_len));
 }
 
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdsearch_project(lcb_CMDSEARCH *cmd, const char *path, size_t path_len)
+{
+    return cmd->project(std::string(path, path_len));
+}
+
 LIBCOUCHBASE_API lcb_STATUS lcb_errctx_search_rc(const lcb_SEARCH_ERROR_CONTEXT *ctx)
 {
     return ctx->rc;
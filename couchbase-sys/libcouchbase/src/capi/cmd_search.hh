@@ -23,6 +23,8 @@
 #include <string>
 #include <chrono>
 
+#include <jsparse/parser.h>
+
 /**
  * @private
  */
@@ -179,6 +181,20 @@ struct lcb_CMDSEARCH_ {
         return LCB_SUCCESS;
     }
 
+    lcb_STATUS project(std::string path)
+    {
+        if (path.empty()) {
+            return LCB_ERR_INVALID_ARGUMENT;
+        }
+        projection_.add(path);
+        return LCB_SUCCESS;
+    }
+
+    const lcb::jsparse::Projection &projection() const
+    {
+        return projection_;
+    }
+
     bool want_impersonation() const
     {
         return !impostor_.empty();
@@ -198,6 +214,7 @@ struct lcb_CMDSEARCH_ {
     lcb_SEARCH_CALLBACK callback_{nullptr};
     lcb_SEARCH_HANDLE **handle_{nullptr};
     std::string impostor_{};
+    lcb::jsparse::Projection projection_{};
 };
 
 #endif // LIBCOUCHBASE_CAPI_SEARCH_HH
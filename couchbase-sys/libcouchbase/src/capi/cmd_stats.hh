@@ -20,6 +20,8 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <string>
+#include <vector>
 
 #include "key_value_error_context.hh"
 
@@ -62,6 +64,8 @@ struct lcb_CMDSTATS_ {
     lcb_U32 timeout;
     /** Parent tracing span */
     lcbtrace_SPAN *pspan;
+    /** Age (in microseconds) up to which cached statistics are reused, see lcb_cmdstats_max_age() */
+    lcb_U32 max_age;
 };
 
 /**
@@ -71,6 +75,41 @@ struct lcb_CMDSTATS_ {
  */
 #define LCB_CMDSTATS_F_KV (1 << 16)
 
+/**
+ * Collect the statistics of each server and deliver them in a single
+ * response per server, see lcb_cmdstats_aggregate()
+ */
+#define LCB_CMDSTATS_F_AGGREGATE (1 << 17)
+
+namespace lcb
+{
+/**
+ * Statistics of one server, with all keys and values packed into a single
+ * buffer
+ */
+struct StatsTable {
+    struct Entry {
+        std::size_t key_offset;
+        std::size_t key_length;
+        std::size_t value_offset;
+        std::size_t value_length;
+    };
+
+    void add(const char *key, std::size_t nkey, const char *value, std::size_t nvalue)
+    {
+        Entry entry{buffer.size(), nkey, buffer.size() + nkey, nvalue};
+        buffer.append(key, nkey);
+        buffer.append(value, nvalue);
+        entries.push_back(entry);
+    }
+
+    std::string buffer{};
+    std::vector<Entry> entries{};
+    /** When the server finished sending the statistics */
+    std::uint64_t collected{0};
+};
+} // namespace lcb
+
 /**
  * @private
  */
@@ -87,6 +126,8 @@ struct lcb_RESPSTATS_ {
     const char *server;
     const char *value; /**< The value, if any, for the given statistic */
     lcb_SIZE nvalue;   /**< Length of value */
+    /** All statistics of the server, if the command was aggregated */
+    const lcb::StatsTable *table{nullptr};
 };
 
 #endif // LIBCOUCHBASE_CAPI_STATS_HH
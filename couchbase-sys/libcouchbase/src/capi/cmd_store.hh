@@ -21,10 +21,17 @@
 #include <cstddef>
 #include <cstdint>
 #include <chrono>
+#include <memory>
+#include <vector>
 
 #include "key_value_error_context.hh"
 #include "collection_qualifier.hh"
 
+namespace lcb
+{
+class MappedValue;
+} // namespace lcb
+
 enum class durability_mode {
     none,
     poll,
@@ -239,15 +246,59 @@ struct lcb_CMDSTORE_ {
     lcb_STATUS value(std::string value)
     {
         value_ = std::move(value);
+        borrowed_value_.clear();
+        value_mapping_.reset();
+        return LCB_SUCCESS;
+    }
+
+    /**
+     * Reference the value without copying it. The buffers are owned by the
+     * application until the lcb_pktflushed_callback fires for this command.
+     */
+    lcb_STATUS value_nocopy(const lcb_IOV *iov, std::size_t iov_len)
+    {
+        value_.clear();
+        borrowed_value_.assign(iov, iov + iov_len);
+        value_mapping_.reset();
+        return LCB_SUCCESS;
+    }
+
+    /**
+     * Reference a region of a file mapped into memory as the value. The
+     * mapping lives on as long as copies of the command or packets which
+     * have not been flushed yet reference it.
+     */
+    lcb_STATUS value_mapping(std::shared_ptr<lcb::MappedValue> mapping, const lcb_IOV &iov)
+    {
+        value_.clear();
+        borrowed_value_.assign(1, iov);
+        value_mapping_ = std::move(mapping);
         return LCB_SUCCESS;
     }
 
+    const std::shared_ptr<lcb::MappedValue> &value_mapping() const
+    {
+        return value_mapping_;
+    }
+
+    bool value_is_borrowed() const
+    {
+        return !borrowed_value_.empty();
+    }
+
+    const std::vector<lcb_IOV> &borrowed_value() const
+    {
+        return borrowed_value_;
+    }
+
     lcb_STATUS value(const lcb_IOV *iov, std::size_t iov_len)
     {
         std::size_t total_size = 0;
         for (std::size_t i = 0; i < iov_len; ++i) {
             total_size += iov[i].iov_len;
         }
+        borrowed_value_.clear();
+        value_mapping_.reset();
         value_.reserve(total_size);
         for (std::size_t i = 0; i < iov_len; ++i) {
             if (iov[i].iov_len > 0 && iov[i].iov_base != nullptr) {
@@ -372,6 +423,34 @@ struct lcb_CMDSTORE_ {
         return preserve_expiry_;
     }
 
+    lcb_STATUS coalesce(bool enable)
+    {
+        if (operation_ != LCB_STORE_UPSERT) {
+            return LCB_ERR_INVALID_ARGUMENT;
+        }
+        coalesce_ = enable;
+        return LCB_SUCCESS;
+    }
+
+    bool coalesce() const
+    {
+        /* a CAS or durability requirement only holds for the value it comes with */
+        return coalesce_ && cas_ == 0 && durability_mode_ != durability_mode::poll &&
+               !has_sync_durability_requirements() && !cookie_is_callback_;
+    }
+
+    /**
+     * @return whether this upsert, held back to be coalesced, may be replaced
+     * by @p other, i.e. whether they only differ in their value
+     */
+    bool coalesces_with(const lcb_CMDSTORE_ &other) const
+    {
+        return timeout_ == other.timeout_ && expiry_ == other.expiry_ && flags_ == other.flags_ &&
+               json_ == other.json_ && compressed_ == other.compressed_ &&
+               preserve_expiry_ == other.preserve_expiry_ && impostor_ == other.impostor_ &&
+               extra_privileges_ == other.extra_privileges_;
+    }
+
     lcb_STATUS on_behalf_of(std::string user)
     {
         impostor_ = std::move(user);
@@ -409,6 +488,8 @@ struct lcb_CMDSTORE_ {
     std::uint32_t expiry_{0};
     std::string key_{};
     std::string value_{};
+    std::vector<lcb_IOV> borrowed_value_{};
+    std::shared_ptr<lcb::MappedValue> value_mapping_{};
     std::uint64_t cas_{0};
     std::uint32_t flags_{0};
     durability_mode durability_mode_{durability_mode::none};
@@ -419,6 +500,7 @@ struct lcb_CMDSTORE_ {
     bool compressed_{false};
     bool cookie_is_callback_{false};
     bool preserve_expiry_{false};
+    bool coalesce_{false};
     std::string impostor_{};
     std::vector<std::string> extra_privileges_{};
 };
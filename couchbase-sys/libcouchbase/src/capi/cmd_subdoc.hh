@@ -21,6 +21,7 @@
 #include <cstddef>
 #include <cstdint>
 #include <chrono>
+#include <memory>
 
 #include "key_value_error_context.hh"
 
@@ -231,6 +232,29 @@ struct lcb_SUBDOCSPECS_ {
     std::vector<subdoc_spec> specs_{};
 };
 
+/**
+ * The encoded form of a lcb_SUBDOCSPECS: the spec headers and paths of a
+ * multi lookup or mutation, serialized once so that commands only have to
+ * supply the key and (for mutations) the values.
+ */
+struct subdoc_template {
+    lcb_SUBDOCSPECS_ specs{};
+    /** LCB_SDMULTI_MODE_LOOKUP or LCB_SDMULTI_MODE_MUTATE */
+    unsigned mode{0};
+    /** Spec headers and paths, in the order and layout of the request body (minus the values) */
+    std::string blob{};
+    /** Mutations only. The end of each spec in `blob`, and where its value length has to be written */
+    struct segment {
+        std::size_t end;
+        std::size_t value_length_offset;
+    };
+    std::vector<segment> segments{};
+};
+
+struct lcb_SUBDOCTEMPLATE_ {
+    std::shared_ptr<const subdoc_template> compiled{};
+};
+
 struct lcb_CMDSUBDOC_ {
     const char *operation_name() const
     {
@@ -281,7 +305,7 @@ struct lcb_CMDSUBDOC_ {
 
     const lcb_SUBDOCSPECS &specs() const
     {
-        return specs_;
+        return template_ ? template_->specs : specs_;
     }
 
     lcb_STATUS specs(const lcb_SUBDOCSPECS *operations)
@@ -290,6 +314,46 @@ struct lcb_CMDSUBDOC_ {
             return LCB_ERR_INVALID_ARGUMENT;
         }
         specs_ = *operations;
+        template_.reset();
+        template_values_.clear();
+        return LCB_SUCCESS;
+    }
+
+    const std::shared_ptr<const subdoc_template> &compiled_specs() const
+    {
+        return template_;
+    }
+
+    lcb_STATUS compiled_specs(const lcb_SUBDOCTEMPLATE *tpl)
+    {
+        if (tpl == nullptr || !tpl->compiled) {
+            return LCB_ERR_INVALID_ARGUMENT;
+        }
+        template_ = tpl->compiled;
+        specs_ = {};
+        template_values_.clear();
+        template_values_.reserve(template_->specs.specs().size());
+        for (const auto &spec : template_->specs.specs()) {
+            template_values_.emplace_back(spec.value());
+        }
+        return LCB_SUCCESS;
+    }
+
+    /**
+     * The values of a templated mutation. They start out as the values of
+     * the template's specs, and may be replaced per command.
+     */
+    const std::vector<std::string> &template_values() const
+    {
+        return template_values_;
+    }
+
+    lcb_STATUS template_value(std::size_t index, std::string value)
+    {
+        if (!template_ || template_->mode != LCB_SDMULTI_MODE_MUTATE || index >= template_values_.size()) {
+            return LCB_ERR_INVALID_ARGUMENT;
+        }
+        template_values_[index] = std::move(value);
         return LCB_SUCCESS;
     }
 
@@ -476,6 +540,8 @@ struct lcb_CMDSUBDOC_ {
     lcb_DURABILITY_LEVEL durability_level_{LCB_DURABILITYLEVEL_NONE};
     subdoc_options options_{};
     lcb_SUBDOCSPECS_ specs_{};
+    std::shared_ptr<const subdoc_template> template_{};
+    std::vector<std::string> template_values_{};
     bool preserve_expiry_{false};
     std::string impostor_{};
     std::vector<std::string> extra_privileges_{};
@@ -520,7 +586,31 @@ struct lcb_RESPSUBDOC_ {
     /** Use with lcb_backbuf_ref/unref */
     void *bufh;
     std::size_t nres;
+
+    /**
+     * Returns the result of the spec at `index` (which must be less than
+     * `nres`). The response is only parsed up to the requested spec, so
+     * callers which look at the first few results skip the work for the rest.
+     * Specs the server did not report (mutations only report those with a
+     * value or an error) are successful and empty.
+     */
+    const lcb_SDENTRY &result(std::size_t index) const;
+
+    /**
+     * Decodes the results of the first `nout` specs in one pass, independently
+     * of result(). See lcb_respsubdoc_results()
+     */
+    std::size_t results(lcb_SUBDOC_RESULT *out, std::size_t nout, const char **body) const;
+
+    /** Results are parsed into `inline_res` unless there are more specs than the server allows */
+    static const std::size_t INLINE_RESULTS = 16;
+    mutable lcb_SDENTRY inline_res[INLINE_RESULTS];
+    /** Used instead of `inline_res` if `nres` exceeds INLINE_RESULTS */
     lcb_SDENTRY *res;
+    /** Number of results which are known, i.e. parsed or skipped by the server */
+    mutable std::size_t nparsed;
+    /** Offset into the response body at which parsing continues */
+    mutable std::size_t parse_offset;
 };
 
 #endif // LIBCOUCHBASE_CAPI_SUBDOC_HH
@@ -131,6 +131,17 @@ struct lcb_CMDTOUCH_ {
         return cookie_;
     }
 
+    /* Used by lcb_touch_multi() to route the responses through its own callback */
+    void treat_cookie_as_callback(bool value)
+    {
+        cookie_is_callback_ = value;
+    }
+
+    bool is_cookie_callback() const
+    {
+        return cookie_is_callback_;
+    }
+
     lcb_STATUS on_behalf_of(std::string user)
     {
         impostor_ = std::move(user);
@@ -165,6 +176,7 @@ struct lcb_CMDTOUCH_ {
     std::uint32_t expiry_{0};
     lcbtrace_SPAN *parent_span_{nullptr};
     void *cookie_{nullptr};
+    bool cookie_is_callback_{false};
     std::string key_{};
     std::string impostor_{};
     std::vector<std::string> extra_privileges_{};
@@ -262,7 +262,8 @@ struct lcb_CMDVIEW_ {
      *
      * Setting this value will attempt to throttle the number of get requests,
      * so that no more than this number of requests will be in progress at any
-     * given time.
+     * given time. Below this limit, the number of requests in progress adapts
+     * to the response times and temporary failures of the cluster.
      */
     std::uint32_t max_concurrent_documents_{0};
     bool include_documents_{false};
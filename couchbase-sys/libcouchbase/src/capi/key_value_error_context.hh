@@ -22,8 +22,19 @@
 #include <cstdint>
 #include <string>
 
+namespace lcb
+{
+class Server;
+} // namespace lcb
+
 /**
  * @private
+ *
+ * The bucket, scope, collection and endpoint are only formatted when first
+ * read, from the server and collection ID recorded by the response handler.
+ * The source is only valid while the response is being delivered, so a
+ * context which outlives the callback must be materialized before it is
+ * copied.
  */
 struct lcb_KEY_VALUE_ERROR_CONTEXT_ {
     lcb_STATUS rc;
@@ -31,12 +42,23 @@ struct lcb_KEY_VALUE_ERROR_CONTEXT_ {
     std::uint32_t opaque;
     std::uint64_t cas;
     std::string key{};
-    std::string bucket{};
-    std::string collection{};
-    std::string scope{};
+    mutable std::string bucket{};
+    mutable std::string collection{};
+    mutable std::string scope{};
     std::string ref{};
     std::string context{};
-    std::string endpoint{};
+    mutable std::string endpoint{};
+
+    struct deferred_fields {
+        lcb_INSTANCE *instance{nullptr};
+        const lcb::Server *server{nullptr};
+        std::uint32_t collection_id{0};
+        bool has_collection_id{false};
+    };
+    mutable deferred_fields deferred{};
+
+    /** Format the deferred fields, if any, and forget their source */
+    void materialize() const;
 };
 
 #endif // LIBCOUCHBASE_CAPI_KEY_VALUE_ERROR_CONTEXT_HH
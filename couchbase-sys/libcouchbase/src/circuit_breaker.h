@@ -0,0 +1,151 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2024 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCB_CIRCUIT_BREAKER_H
+#define LCB_CIRCUIT_BREAKER_H
+
+#include "settings.h"
+
+#include <cstdint>
+
+/**
+ * @file
+ * @brief Circuit breaker of an endpoint, see LCB_CNTL_CIRCUIT_BREAKER
+ */
+
+namespace lcb
+{
+
+/**
+ * Outcomes of the recent requests to one endpoint, used to fail new requests
+ * fast while the endpoint is unhealthy.
+ *
+ * The breaker is closed while the endpoint is healthy. It opens once at least
+ * `circuit_breaker_volume_threshold` requests completed within the rolling
+ * window and `circuit_breaker_error_threshold` percent of them failed. Once
+ * the sleep window has passed it is half-open and lets a few canary requests
+ * through: a success of one of them closes the breaker again, a failure opens
+ * it for another sleep window.
+ */
+class CircuitBreaker
+{
+  public:
+    enum State { CLOSED, OPEN, HALF_OPEN };
+
+    /** Number of requests let through while half-open */
+    static constexpr std::uint32_t max_canaries = 3;
+
+    State state(hrtime_t now, const lcb_settings &settings) const
+    {
+        if (!open_) {
+            return CLOSED;
+        }
+        if (now < opened_at_ + LCB_US2NS(settings.circuit_breaker_sleep_window)) {
+            return OPEN;
+        }
+        return HALF_OPEN;
+    }
+
+    static const char *state_name(State state)
+    {
+        switch (state) {
+            case OPEN:
+                return "open";
+            case HALF_OPEN:
+                return "half_open";
+            default:
+                return "closed";
+        }
+    }
+
+    /** Whether a request would currently be let through, see admit() */
+    bool allows(const lcb_settings &settings) const
+    {
+        return !open_ || (canaries_ < max_canaries && state(gethrtime(), settings) == HALF_OPEN);
+    }
+
+    /** Whether to send a request, which counts as a canary while half-open */
+    bool admit(const lcb_settings &settings)
+    {
+        if (!allows(settings)) {
+            return false;
+        }
+        if (open_) {
+            canaries_++;
+        }
+        return true;
+    }
+
+    void record_success()
+    {
+        if (!open_) {
+            total_++;
+        } else if (canaries_) {
+            open_ = false;
+            total_ = 0;
+            failed_ = 0;
+            window_start_ = 0;
+        }
+    }
+
+    /**
+     * @param nfailed the number of requests which timed out or failed because of
+     *  the connection
+     * @return true if the breaker opened because of them
+     */
+    bool record_failures(std::uint32_t nfailed, hrtime_t now, const lcb_settings &settings)
+    {
+        if (open_) {
+            if (canaries_) {
+                /* a canary failed, sleep again */
+                opened_at_ = now;
+                canaries_ = 0;
+            }
+            return false;
+        }
+        if (window_start_ == 0) {
+            /* the successes so far count towards the first window */
+            window_start_ = now;
+        } else if (now - window_start_ >= LCB_US2NS(settings.circuit_breaker_rolling_window)) {
+            window_start_ = now;
+            total_ = 0;
+            failed_ = 0;
+        }
+        total_ += nfailed;
+        failed_ += nfailed;
+        if (total_ < settings.circuit_breaker_volume_threshold ||
+            std::uint64_t(failed_) * 100 < std::uint64_t(total_) * settings.circuit_breaker_error_threshold) {
+            return false;
+        }
+        open_ = true;
+        opened_at_ = now;
+        canaries_ = 0;
+        return true;
+    }
+
+  private:
+    bool open_{false};
+    std::uint32_t canaries_{0};
+    std::uint32_t total_{0};
+    std::uint32_t failed_{0};
+    hrtime_t window_start_{0};
+    hrtime_t opened_at_{0};
+};
+
+} // namespace lcb
+
+#endif
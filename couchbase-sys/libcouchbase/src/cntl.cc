@@ -17,11 +17,13 @@
 
 #include "internal.h"
 #include "bucketconfig/clconfig.h"
+#include "bucketconfig/shared_config.h"
 #include "contrib/lcb-jsoncpp/lcb-jsoncpp.h"
 #include <lcbio/iotable.h>
 #include <mcserver/negotiate.h>
 #include <lcbio/ssl.h>
 #include "n1ql/query_utils.hh"
+#include "n1ql/query_cache.hh"
 
 #define LOGARGS(instance, lvl) instance->settings, "cntl", LCB_LOG_##lvl, __FILE__, __LINE__
 
@@ -117,6 +119,8 @@ static std::uint32_t *get_timeout_field(lcb_INSTANCE *instance, int cmd)
             return &settings->retry_nmv_interval;
         case LCB_CNTL_CONFIG_POLL_INTERVAL:
             return &settings->config_poll_interval;
+        case LCB_CNTL_CONFIG_POLL_MAX_INTERVAL:
+            return &settings->config_poll_max_interval;
         case LCB_CNTL_TRACING_ORPHANED_QUEUE_FLUSH_INTERVAL:
             return &settings->tracer_orphaned_queue_flush_interval;
         case LCB_CNTL_TRACING_THRESHOLD_QUEUE_FLUSH_INTERVAL:
@@ -135,6 +139,26 @@ static std::uint32_t *get_timeout_field(lcb_INSTANCE *instance, int cmd)
             return &settings->persistence_timeout_floor;
         case LCB_CNTL_OP_METRICS_FLUSH_INTERVAL:
             return &settings->op_metrics_flush_interval;
+        case LCB_CNTL_FLUSH_COALESCE_DELAY:
+            return &settings->flush_coalesce_delay;
+        case LCB_CNTL_WAIT_SPIN:
+            return &settings->wait_spin;
+        case LCB_CNTL_NEAR_CACHE_TTL:
+            return &settings->near_cache_ttl;
+        case LCB_CNTL_TOUCH_SKIP_WINDOW:
+            return &settings->touch_skip_window;
+        case LCB_CNTL_WRITE_COALESCE_WINDOW:
+            return &settings->write_coalesce_window;
+        case LCB_CNTL_CIRCUIT_BREAKER_SLEEP_WINDOW:
+            return &settings->circuit_breaker_sleep_window;
+        case LCB_CNTL_CIRCUIT_BREAKER_ROLLING_WINDOW:
+            return &settings->circuit_breaker_rolling_window;
+        case LCB_CNTL_TRACING_EXPORT_INTERVAL:
+            return &settings->tracer_export_interval;
+        case LCB_CNTL_KV_IDLE_TIMEOUT:
+            return &settings->kv_idle_timeout;
+        case LCB_CNTL_TCP_USER_TIMEOUT:
+            return &settings->tcp_user_timeout;
         default:
             return nullptr;
     }
@@ -205,6 +229,8 @@ HANDLER(http_poolsz_handler){RETURN_GET_SET(std::size_t, instance->http_sockpool
 
 HANDLER(http_pooltmo_handler){RETURN_GET_SET(uint32_t, instance->http_sockpool->get_options().tmoidle)}
 
+HANDLER(http_pool_refresh_handler){RETURN_GET_SET(uint32_t, instance->http_sockpool->get_options().tmrefresh)}
+
 HANDLER(http_refresh_config_handler){RETURN_GET_SET(int, LCBT_SETTING(instance, refresh_on_hterr))}
 
 HANDLER(compmode_handler){RETURN_GET_SET(int, LCBT_SETTING(instance, compressopts))}
@@ -272,6 +298,22 @@ HANDLER(enable_tracing_handler)
 HANDLER(enable_errmap_handler){RETURN_GET_SET(int, LCBT_SETTING(instance, use_errmap))}
 
 HANDLER(enable_op_metrics_handler){RETURN_GET_SET(int, LCBT_SETTING(instance, op_metrics_enabled))}
+HANDLER(flush_coalesce_handler){RETURN_GET_SET(int, LCBT_SETTING(instance, flush_coalesce))}
+HANDLER(flush_coalesce_bytes_handler){RETURN_GET_SET(lcb_U32, LCBT_SETTING(instance, flush_coalesce_bytes))}
+HANDLER(io_batch_writes_handler){RETURN_GET_SET(int, LCBT_SETTING(instance, io_batch_writes))}
+
+HANDLER(collections_manifest_handler){RETURN_GET_SET(int, LCBT_SETTING(instance, collections_manifest))}
+
+HANDLER(comp_adaptive_handler){RETURN_GET_SET(int, LCBT_SETTING(instance, compress_adaptive))}
+
+HANDLER(ssl_session_cache_handler){RETURN_GET_SET(int, LCBT_SETTING(instance, ssl_session_cache))}
+
+HANDLER(retry_budget_handler){RETURN_GET_SET(lcb_U32, LCBT_SETTING(instance, retry_budget))}
+
+HANDLER(bootstrap_parallelism_handler){RETURN_GET_SET(lcb_U32, LCBT_SETTING(instance, bootstrap_parallelism))}
+HANDLER(fastdtor_handler){RETURN_GET_SET(int, LCBT_SETTING(instance, fastdtor))}
+
+HANDLER(nmv_retry_on_config_handler){RETURN_GET_SET(int, LCBT_SETTING(instance, nmv_retry_on_config))}
 
 HANDLER(tracing_orphaned_queue_size_handler){
     RETURN_GET_SET(std::uint32_t, LCBT_SETTING(instance, tracer_orphaned_queue_size))}
@@ -518,6 +560,27 @@ HANDLER(allocfactory_handler)
     return LCB_SUCCESS;
 }
 
+HANDLER(read_pool_size_handler)
+{
+    auto *val = reinterpret_cast<lcb_U32 *>(arg);
+    if (mode == LCB_CNTL_SET) {
+        lcb_settings *settings = instance->settings;
+        if (settings->read_pool) {
+            /* sockets which already use the old pool keep their reference */
+            settings->read_pool->a_release(settings->read_pool);
+            settings->read_pool = nullptr;
+        }
+        settings->read_pool_size = *val;
+        if (*val) {
+            settings->read_pool = rdb_poolalloc_new(*val);
+        }
+    } else {
+        *val = LCBT_SETTING(instance, read_pool_size);
+    }
+    (void)cmd;
+    return LCB_SUCCESS;
+}
+
 HANDLER(console_log_handler)
 {
     std::uint32_t level;
@@ -552,12 +615,15 @@ HANDLER(console_fp_handler)
     if (mode == LCB_CNTL_GET) {
         *(FILE **)arg = logger->fp;
     } else if (mode == LCB_CNTL_SET) {
+        /* the caller may close the previous file once this returns */
+        lcb_conlog_flush();
         logger->fp = *(FILE **)arg;
     } else if (mode == CNTL__MODE_SETSTRING) {
         FILE *fp = fopen(reinterpret_cast<const char *>(arg), "w");
         if (!fp) {
             return LCB_ERR_INVALID_ARGUMENT;
         } else {
+            lcb_conlog_flush();
             logger->fp = fp;
         }
     }
@@ -566,6 +632,105 @@ HANDLER(console_fp_handler)
     return LCB_SUCCESS;
 }
 
+HANDLER(console_async_handler)
+{
+    auto *logger = (struct lcb_CONSOLELOGGER *)lcb_console_logger;
+    if (mode == LCB_CNTL_SET) {
+        int async = *(int *)arg;
+        if (logger->async && !async) {
+            logger->async = 0;
+            lcb_conlog_flush();
+        }
+        logger->async = async ? 1 : 0;
+    } else if (mode == LCB_CNTL_GET) {
+        *(int *)arg = logger->async;
+    }
+    (void)cmd;
+    (void)instance;
+    return LCB_SUCCESS;
+}
+
+HANDLER(console_rate_handler)
+{
+    auto *logger = (struct lcb_CONSOLELOGGER *)lcb_console_logger;
+    (void)instance;
+    RETURN_GET_SET(lcb_U32, logger->rate)
+}
+
+HANDLER(console_dropped_handler)
+{
+    if (mode != LCB_CNTL_GET) {
+        return LCB_ERR_CONTROL_UNSUPPORTED_MODE;
+    }
+    *reinterpret_cast<lcb_U64 *>(arg) = lcb_conlog_dropped();
+    (void)cmd;
+    (void)instance;
+    return LCB_SUCCESS;
+}
+
+HANDLER(netbuf_block_max_handler)
+{
+    if (mode == LCB_CNTL_SET) {
+        lcb_U32 val = *reinterpret_cast<lcb_U32 *>(arg);
+        mc_CMDQUEUE *cq = &instance->cmdq;
+        LCBT_SETTING(instance, netbuf_block_max) = val;
+        for (unsigned ii = 0; ii < MCREQ_NPIPELINES_ALL(cq); ii++) {
+            if (cq->pipelines[ii]) {
+                netbuf_set_maxalloc(&cq->pipelines[ii]->nbmgr, val);
+            }
+        }
+        return LCB_SUCCESS;
+    }
+    RETURN_GET_ONLY(lcb_U32, LCBT_SETTING(instance, netbuf_block_max))
+}
+
+static lcb_STATUS apply_tuning_profile(lcb_INSTANCE *instance, const char *profile);
+
+HANDLER(tuning_profile_handler)
+{
+    if (mode == LCB_CNTL_SET) {
+        const char *profile = reinterpret_cast<const char *>(arg);
+        if (profile == nullptr) {
+            return LCB_ERR_CONTROL_INVALID_ARGUMENT;
+        }
+        lcb_STATUS rc = apply_tuning_profile(instance, profile);
+        if (rc == LCB_SUCCESS) {
+            free(LCBT_SETTING(instance, tuning_profile));
+            LCBT_SETTING(instance, tuning_profile) = lcb_strdup(profile);
+        }
+        return rc;
+    } else if (mode == LCB_CNTL_GET) {
+        *reinterpret_cast<const char **>(arg) = LCBT_SETTING(instance, tuning_profile);
+        (void)cmd;
+        return LCB_SUCCESS;
+    }
+    return LCB_ERR_CONTROL_UNSUPPORTED_MODE;
+}
+
+HANDLER(shared_config_handler)
+{
+    using lcb::clconfig::SharedGroup;
+    using lcb::clconfig::SharedMember;
+    if (mode == LCB_CNTL_SET) {
+        const char *name = reinterpret_cast<const char *>(arg);
+        delete instance->shared_config;
+        instance->shared_config = nullptr;
+        if (name != nullptr && *name != '\0') {
+            instance->shared_config = new SharedMember(instance, SharedGroup::get(name));
+        }
+        return LCB_SUCCESS;
+    } else if (mode == LCB_CNTL_GET) {
+        const char *name = nullptr;
+        if (instance->shared_config != nullptr && !instance->shared_config->group()->name().empty()) {
+            name = instance->shared_config->group()->name().c_str();
+        }
+        *reinterpret_cast<const char **>(arg) = name;
+        (void)cmd;
+        return LCB_SUCCESS;
+    }
+    return LCB_ERR_CONTROL_UNSUPPORTED_MODE;
+}
+
 HANDLER(reinit_spec_handler)
 {
     if (mode == LCB_CNTL_GET) {
@@ -647,6 +812,79 @@ HANDLER(mutation_tokens_supported_handler)
     return LCB_SUCCESS;
 }
 
+HANDLER(n1ql_cache_size_handler)
+{
+    if (mode == LCB_CNTL_SET) {
+        lcb_SIZE size = *reinterpret_cast<lcb_SIZE *>(arg);
+        if (size == 0) {
+            return LCB_ERR_CONTROL_INVALID_ARGUMENT;
+        }
+        instance->n1ql_cache->set_max_size(size);
+    } else {
+        *reinterpret_cast<lcb_SIZE *>(arg) = instance->n1ql_cache->max_size();
+    }
+    (void)cmd;
+    return LCB_SUCCESS;
+}
+
+HANDLER(n1ql_cache_share_handler)
+{
+    if (mode != LCB_CNTL_SET) {
+        return LCB_ERR_CONTROL_UNSUPPORTED_MODE;
+    }
+    auto *other = reinterpret_cast<lcb_INSTANCE *>(arg);
+    if (other == nullptr) {
+        return LCB_ERR_CONTROL_INVALID_ARGUMENT;
+    }
+    if (other->n1ql_cache != instance->n1ql_cache) {
+        lcb_QUERY_CACHE *cache = lcb_n1qlcache_share(other->n1ql_cache);
+        lcb_n1qlcache_destroy(instance->n1ql_cache);
+        instance->n1ql_cache = cache;
+    }
+    (void)cmd;
+    return LCB_SUCCESS;
+}
+
+HANDLER(n1ql_cache_stats_handler)
+{
+    if (mode != LCB_CNTL_GET) {
+        return LCB_ERR_CONTROL_UNSUPPORTED_MODE;
+    }
+    *reinterpret_cast<lcb_QUERY_CACHE_STATS *>(arg) = instance->n1ql_cache->stats();
+    (void)cmd;
+    return LCB_SUCCESS;
+}
+
+HANDLER(n1ql_pool_target_handler)
+{
+    if (mode == LCB_CNTL_SET) {
+        LCBT_SETTING(instance, n1ql_pool_target) = *reinterpret_cast<lcb_U32 *>(arg);
+        lcb_update_http_pool_targets(instance);
+        return LCB_SUCCESS;
+    }
+    RETURN_GET_SET(lcb_U32, LCBT_SETTING(instance, n1ql_pool_target))
+}
+
+HANDLER(fts_pool_target_handler)
+{
+    if (mode == LCB_CNTL_SET) {
+        LCBT_SETTING(instance, fts_pool_target) = *reinterpret_cast<lcb_U32 *>(arg);
+        lcb_update_http_pool_targets(instance);
+        return LCB_SUCCESS;
+    }
+    RETURN_GET_SET(lcb_U32, LCBT_SETTING(instance, fts_pool_target))
+}
+
+HANDLER(cbas_pool_target_handler)
+{
+    if (mode == LCB_CNTL_SET) {
+        LCBT_SETTING(instance, cbas_pool_target) = *reinterpret_cast<lcb_U32 *>(arg);
+        lcb_update_http_pool_targets(instance);
+        return LCB_SUCCESS;
+    }
+    RETURN_GET_SET(lcb_U32, LCBT_SETTING(instance, cbas_pool_target))
+}
+
 HANDLER(n1ql_cache_clear_handler)
 {
     if (mode != LCB_CNTL_SET) {
@@ -731,6 +969,78 @@ HANDLER(comp_min_ratio_handler)
     RETURN_GET_SET(float, LCBT_SETTING(instance, compress_min_ratio))
 }
 
+HANDLER(tracing_sample_rate_handler)
+{
+    if (mode == LCB_CNTL_SET) {
+        float val = *reinterpret_cast<float *>(arg);
+        if (val > 1 || val <= 0) {
+            return LCB_ERR_CONTROL_INVALID_ARGUMENT;
+        }
+    }
+    RETURN_GET_SET(float, LCBT_SETTING(instance, tracer_sample_rate))
+}
+
+HANDLER(health_probe_handler)
+{
+    if (mode == LCB_CNTL_SET) {
+        LCBT_SETTING(instance, health_probe_interval) = *reinterpret_cast<std::uint32_t *>(arg);
+        lcb_health_probe_schedule(instance);
+        return LCB_SUCCESS;
+    }
+    RETURN_GET_SET(std::uint32_t, LCBT_SETTING(instance, health_probe_interval))
+}
+
+HANDLER(idle_trim_handler)
+{
+    if (mode == LCB_CNTL_SET) {
+        LCBT_SETTING(instance, idle_trim_interval) = *reinterpret_cast<std::uint32_t *>(arg);
+        lcb_idle_trim_schedule(instance);
+        return LCB_SUCCESS;
+    }
+    RETURN_GET_SET(std::uint32_t, LCBT_SETTING(instance, idle_trim_interval))
+}
+
+HANDLER(dns_cache_ttl_handler)
+{
+    RETURN_GET_SET(std::uint32_t, LCBT_SETTING(instance, dns_cache_ttl))
+}
+
+HANDLER(connect_attempt_delay_handler)
+{
+    RETURN_GET_SET(std::uint32_t, LCBT_SETTING(instance, connect_attempt_delay))
+}
+
+HANDLER(kv_connections_per_node_handler)
+{
+    if (mode == LCB_CNTL_SET) {
+        std::uint32_t val = *reinterpret_cast<std::uint32_t *>(arg);
+        if (val < 1 || val > LCB_MAX_KV_CONNECTIONS_PER_NODE) {
+            return LCB_ERR_CONTROL_INVALID_ARGUMENT;
+        }
+    }
+    RETURN_GET_SET(std::uint32_t, LCBT_SETTING(instance, kv_connections_per_node))
+}
+
+HANDLER(large_value_threshold_handler)
+{
+    RETURN_GET_SET(std::uint32_t, LCBT_SETTING(instance, large_value_threshold))
+}
+
+HANDLER(near_cache_size_handler)
+{
+    RETURN_GET_SET(std::uint32_t, LCBT_SETTING(instance, near_cache_size))
+}
+
+HANDLER(get_coalesce_handler)
+{
+    RETURN_GET_SET(int, LCBT_SETTING(instance, get_coalesce))
+}
+
+HANDLER(negative_cache_size_handler)
+{
+    RETURN_GET_SET(std::uint32_t, LCBT_SETTING(instance, negative_cache_size))
+}
+
 HANDLER(network_handler)
 {
     if (mode == LCB_CNTL_SET) {
@@ -747,6 +1057,98 @@ HANDLER(network_handler)
     return LCB_SUCCESS;
 }
 
+HANDLER(preferred_server_group_handler)
+{
+    if (mode == LCB_CNTL_SET) {
+        const char *val = reinterpret_cast<const char *>(arg);
+        free(LCBT_SETTING(instance, preferred_server_group));
+        LCBT_SETTING(instance, preferred_server_group) = nullptr;
+        if (val && *val) {
+            LCBT_SETTING(instance, preferred_server_group) = lcb_strdup(val);
+        }
+    } else {
+        *(const char **)arg = LCBT_SETTING(instance, preferred_server_group);
+    }
+    (void)cmd;
+    return LCB_SUCCESS;
+}
+
+HANDLER(kv_inflight_bytes_max_handler)
+{
+    RETURN_GET_SET(lcb_SIZE, LCBT_SETTING(instance, kv_inflight_bytes_max))
+}
+
+HANDLER(kv_inflight_ops_max_handler)
+{
+    RETURN_GET_SET(std::uint32_t, LCBT_SETTING(instance, kv_inflight_ops_max))
+}
+
+HANDLER(kv_pipeline_inflight_bytes_max_handler)
+{
+    RETURN_GET_SET(lcb_SIZE, LCBT_SETTING(instance, kv_pipeline_inflight_bytes_max))
+}
+
+HANDLER(kv_pipeline_inflight_ops_max_handler)
+{
+    RETURN_GET_SET(std::uint32_t, LCBT_SETTING(instance, kv_pipeline_inflight_ops_max))
+}
+
+HANDLER(kv_inflight_low_watermark_handler)
+{
+    if (mode == LCB_CNTL_SET && *reinterpret_cast<std::uint32_t *>(arg) > 100) {
+        return LCB_ERR_CONTROL_INVALID_ARGUMENT;
+    }
+    RETURN_GET_SET(std::uint32_t, LCBT_SETTING(instance, kv_inflight_low_watermark))
+}
+
+HANDLER(circuit_breaker_handler)
+{
+    RETURN_GET_SET(int, LCBT_SETTING(instance, circuit_breaker))
+}
+
+HANDLER(circuit_breaker_error_threshold_handler)
+{
+    if (mode == LCB_CNTL_SET && *reinterpret_cast<std::uint32_t *>(arg) > 100) {
+        return LCB_ERR_CONTROL_INVALID_ARGUMENT;
+    }
+    RETURN_GET_SET(std::uint32_t, LCBT_SETTING(instance, circuit_breaker_error_threshold))
+}
+
+HANDLER(circuit_breaker_volume_threshold_handler)
+{
+    RETURN_GET_SET(std::uint32_t, LCBT_SETTING(instance, circuit_breaker_volume_threshold))
+}
+
+HANDLER(flight_recorder_size_handler)
+{
+    RETURN_GET_SET(std::uint32_t, LCBT_SETTING(instance, flight_recorder_size))
+}
+
+HANDLER(kernel_io_stats_handler)
+{
+    RETURN_GET_SET(int, LCBT_SETTING(instance, kernel_io_stats))
+}
+
+HANDLER(http_compression_handler)
+{
+    RETURN_GET_SET(int, LCBT_SETTING(instance, http_compression))
+}
+
+HANDLER(hot_keys_handler)
+{
+    RETURN_GET_SET(std::uint32_t, LCBT_SETTING(instance, hot_keys))
+}
+
+HANDLER(tracing_export_queue_size_handler)
+{
+    RETURN_GET_SET(std::uint32_t, LCBT_SETTING(instance, tracer_export_queue_size))
+}
+
+HANDLER(tracing_export_batch_size_handler)
+{
+    RETURN_GET_SET(std::uint32_t, LCBT_SETTING(instance, tracer_export_batch_size))
+}
+
 HANDLER(durable_write_handler){RETURN_GET_SET(int, LCBT_SETTING(instance, enable_durable_write))}
 
 HANDLER(unordered_execution_handler)
@@ -860,6 +1262,66 @@ static ctl_handler handlers[] = {
     enable_errmap_handler,                /* LCB_CNTL_ENABLE_ERRMAP */
     timeout_common,                       /* LCB_CNTL_OP_METRICS_FLUSH_INTERVAL */
     enable_op_metrics_handler,            /* LCB_CNTL_ENABLE_OP_METRICS */
+    read_pool_size_handler,               /* LCB_CNTL_READ_POOL_SIZE */
+    flush_coalesce_handler,               /* LCB_CNTL_FLUSH_COALESCE */
+    timeout_common,                       /* LCB_CNTL_FLUSH_COALESCE_DELAY */
+    flush_coalesce_bytes_handler,         /* LCB_CNTL_FLUSH_COALESCE_BYTES */
+    io_batch_writes_handler,              /* LCB_CNTL_IO_BATCH_WRITES */
+    collections_manifest_handler,         /* LCB_CNTL_COLLECTIONS_MANIFEST */
+    comp_adaptive_handler,                /* LCB_CNTL_COMPRESSION_ADAPTIVE */
+    ssl_session_cache_handler,            /* LCB_CNTL_SSL_SESSION_CACHE */
+    retry_budget_handler,                 /* LCB_CNTL_RETRY_BUDGET */
+    nmv_retry_on_config_handler,          /* LCB_CNTL_RETRY_NMV_ON_CONFIG */
+    n1ql_cache_size_handler,              /* LCB_CNTL_QUERY_CACHE_SIZE */
+    n1ql_cache_share_handler,             /* LCB_CNTL_QUERY_CACHE_SHARE */
+    n1ql_pool_target_handler,             /* LCB_CNTL_QUERY_POOL_TARGET */
+    fts_pool_target_handler,              /* LCB_CNTL_SEARCH_POOL_TARGET */
+    tracing_sample_rate_handler,          /* LCB_CNTL_TRACING_SAMPLE_RATE */
+    health_probe_handler,                 /* LCB_CNTL_HEALTH_PROBE_INTERVAL */
+    n1ql_cache_stats_handler,             /* LCB_CNTL_QUERY_CACHE_STATS */
+    dns_cache_ttl_handler,                /* LCB_CNTL_DNS_CACHE_TTL */
+    connect_attempt_delay_handler,        /* LCB_CNTL_CONNECT_ATTEMPT_DELAY */
+    kv_connections_per_node_handler,      /* LCB_CNTL_KV_CONNECTIONS_PER_NODE */
+    large_value_threshold_handler,        /* LCB_CNTL_LARGE_VALUE_THRESHOLD */
+    http_pool_refresh_handler,            /* LCB_CNTL_HTTP_POOL_REFRESH */
+    cbas_pool_target_handler,             /* LCB_CNTL_ANALYTICS_POOL_TARGET */
+    console_async_handler,                /* LCB_CNTL_CONLOGGER_ASYNC */
+    console_rate_handler,                 /* LCB_CNTL_CONLOGGER_RATE */
+    console_dropped_handler,              /* LCB_CNTL_CONLOGGER_DROPPED */
+    netbuf_block_max_handler,             /* LCB_CNTL_NETBUF_BLOCK_MAX */
+    tuning_profile_handler,               /* LCB_CNTL_TUNING_PROFILE */
+    shared_config_handler,                /* LCB_CNTL_SHARED_CONFIG */
+    timeout_common,                       /* LCB_CNTL_WAIT_SPIN */
+    near_cache_size_handler,              /* LCB_CNTL_NEAR_CACHE_SIZE */
+    timeout_common,                       /* LCB_CNTL_NEAR_CACHE_TTL */
+    get_coalesce_handler,                 /* LCB_CNTL_GET_COALESCE */
+    negative_cache_size_handler,          /* LCB_CNTL_NEGATIVE_CACHE_SIZE */
+    timeout_common,                       /* LCB_CNTL_TOUCH_SKIP_WINDOW */
+    preferred_server_group_handler,       /* LCB_CNTL_PREFERRED_SERVER_GROUP */
+    kv_inflight_bytes_max_handler,        /* LCB_CNTL_KV_INFLIGHT_BYTES_MAX */
+    kv_inflight_ops_max_handler,          /* LCB_CNTL_KV_INFLIGHT_OPS_MAX */
+    kv_pipeline_inflight_bytes_max_handler, /* LCB_CNTL_KV_PIPELINE_INFLIGHT_BYTES_MAX */
+    kv_pipeline_inflight_ops_max_handler, /* LCB_CNTL_KV_PIPELINE_INFLIGHT_OPS_MAX */
+    kv_inflight_low_watermark_handler,    /* LCB_CNTL_KV_INFLIGHT_LOW_WATERMARK */
+    circuit_breaker_handler,              /* LCB_CNTL_CIRCUIT_BREAKER */
+    circuit_breaker_error_threshold_handler, /* LCB_CNTL_CIRCUIT_BREAKER_ERROR_THRESHOLD */
+    circuit_breaker_volume_threshold_handler, /* LCB_CNTL_CIRCUIT_BREAKER_VOLUME_THRESHOLD */
+    timeout_common,                       /* LCB_CNTL_CIRCUIT_BREAKER_SLEEP_WINDOW */
+    timeout_common,                       /* LCB_CNTL_CIRCUIT_BREAKER_ROLLING_WINDOW */
+    flight_recorder_size_handler,         /* LCB_CNTL_FLIGHT_RECORDER_SIZE */
+    tracing_export_queue_size_handler,    /* LCB_CNTL_TRACING_EXPORT_QUEUE_SIZE */
+    tracing_export_batch_size_handler,    /* LCB_CNTL_TRACING_EXPORT_BATCH_SIZE */
+    timeout_common,                       /* LCB_CNTL_TRACING_EXPORT_INTERVAL */
+    kernel_io_stats_handler,              /* LCB_CNTL_KERNEL_IO_STATS */
+    timeout_common,                       /* LCB_CNTL_KV_IDLE_TIMEOUT */
+    timeout_common,                       /* LCB_CNTL_TCP_USER_TIMEOUT */
+    bootstrap_parallelism_handler,        /* LCB_CNTL_BOOTSTRAP_PARALLELISM */
+    fastdtor_handler,                     /* LCB_CNTL_FASTDESTROY */
+    http_compression_handler,             /* LCB_CNTL_HTTP_COMPRESSION */
+    hot_keys_handler,                     /* LCB_CNTL_HOT_KEYS */
+    idle_trim_handler,                    /* LCB_CNTL_IDLE_TRIM_INTERVAL */
+    timeout_common,                       /* LCB_CNTL_WRITE_COALESCE_WINDOW */
+    timeout_common,                       /* LCB_CNTL_CONFIG_POLL_MAX_INTERVAL */
     nullptr
 };
 /* clang-format on */
@@ -1071,6 +1533,7 @@ static cntl_OPCODESTRS stropcode_map[] = {
     {"select_bucket", LCB_CNTL_SELECT_BUCKET, convert_intbool},
     {"tcp_keepalive", LCB_CNTL_TCP_KEEPALIVE, convert_intbool},
     {"config_poll_interval", LCB_CNTL_CONFIG_POLL_INTERVAL, convert_timevalue},
+    {"config_poll_max_interval", LCB_CNTL_CONFIG_POLL_MAX_INTERVAL, convert_timevalue},
     {"ipv6", LCB_CNTL_IP6POLICY, convert_ipv6},
     {"metrics", LCB_CNTL_METRICS, convert_intbool},
     {"log_redaction", LCB_CNTL_LOG_REDACTION, convert_intbool},
@@ -1101,8 +1564,198 @@ static cntl_OPCODESTRS stropcode_map[] = {
     {"enable_errmap", LCB_CNTL_ENABLE_ERRMAP, convert_intbool},
     {"operation_metrics_flush_interval", LCB_CNTL_OP_METRICS_FLUSH_INTERVAL, convert_timevalue},
     {"enable_operation_metrics", LCB_CNTL_ENABLE_OP_METRICS, convert_intbool},
+    {"read_pool_size", LCB_CNTL_READ_POOL_SIZE, convert_u32},
+    {"flush_coalesce", LCB_CNTL_FLUSH_COALESCE, convert_intbool},
+    {"flush_coalesce_delay", LCB_CNTL_FLUSH_COALESCE_DELAY, convert_timevalue},
+    {"flush_coalesce_bytes", LCB_CNTL_FLUSH_COALESCE_BYTES, convert_u32},
+    {"io_batch_writes", LCB_CNTL_IO_BATCH_WRITES, convert_intbool},
+    {"collections_manifest", LCB_CNTL_COLLECTIONS_MANIFEST, convert_intbool},
+    {"compression_adaptive", LCB_CNTL_COMPRESSION_ADAPTIVE, convert_intbool},
+    {"ssl_session_cache", LCB_CNTL_SSL_SESSION_CACHE, convert_intbool},
+    {"retry_budget", LCB_CNTL_RETRY_BUDGET, convert_u32},
+    {"retry_nmv_on_config", LCB_CNTL_RETRY_NMV_ON_CONFIG, convert_intbool},
+    {"query_cache_size", LCB_CNTL_QUERY_CACHE_SIZE, convert_SIZE},
+    {"query_pool_target", LCB_CNTL_QUERY_POOL_TARGET, convert_u32},
+    {"search_pool_target", LCB_CNTL_SEARCH_POOL_TARGET, convert_u32},
+    {"tracing_sample_rate", LCB_CNTL_TRACING_SAMPLE_RATE, convert_float},
+    {"health_probe_interval", LCB_CNTL_HEALTH_PROBE_INTERVAL, convert_timevalue},
+    {"dns_cache_ttl", LCB_CNTL_DNS_CACHE_TTL, convert_timevalue},
+    {"connect_attempt_delay", LCB_CNTL_CONNECT_ATTEMPT_DELAY, convert_timevalue},
+    {"kv_connections_per_node", LCB_CNTL_KV_CONNECTIONS_PER_NODE, convert_u32},
+    {"large_value_threshold", LCB_CNTL_LARGE_VALUE_THRESHOLD, convert_u32},
+    {"http_pool_refresh", LCB_CNTL_HTTP_POOL_REFRESH, convert_timevalue},
+    {"analytics_pool_target", LCB_CNTL_ANALYTICS_POOL_TARGET, convert_u32},
+    {"console_log_async", LCB_CNTL_CONLOGGER_ASYNC, convert_intbool},
+    {"console_log_rate", LCB_CNTL_CONLOGGER_RATE, convert_u32},
+    {"netbuf_block_max", LCB_CNTL_NETBUF_BLOCK_MAX, convert_u32},
+    {"tuning_profile", LCB_CNTL_TUNING_PROFILE, convert_passthru},
+    {"shared_config", LCB_CNTL_SHARED_CONFIG, convert_passthru},
+    {"wait_spin", LCB_CNTL_WAIT_SPIN, convert_timevalue},
+    {"near_cache_size", LCB_CNTL_NEAR_CACHE_SIZE, convert_u32},
+    {"near_cache_ttl", LCB_CNTL_NEAR_CACHE_TTL, convert_timevalue},
+    {"get_coalesce", LCB_CNTL_GET_COALESCE, convert_intbool},
+    {"negative_cache_size", LCB_CNTL_NEGATIVE_CACHE_SIZE, convert_u32},
+    {"touch_skip_window", LCB_CNTL_TOUCH_SKIP_WINDOW, convert_timevalue},
+    {"preferred_server_group", LCB_CNTL_PREFERRED_SERVER_GROUP, convert_passthru},
+    {"kv_inflight_bytes_max", LCB_CNTL_KV_INFLIGHT_BYTES_MAX, convert_SIZE},
+    {"kv_inflight_ops_max", LCB_CNTL_KV_INFLIGHT_OPS_MAX, convert_u32},
+    {"kv_pipeline_inflight_bytes_max", LCB_CNTL_KV_PIPELINE_INFLIGHT_BYTES_MAX, convert_SIZE},
+    {"kv_pipeline_inflight_ops_max", LCB_CNTL_KV_PIPELINE_INFLIGHT_OPS_MAX, convert_u32},
+    {"kv_inflight_low_watermark", LCB_CNTL_KV_INFLIGHT_LOW_WATERMARK, convert_u32},
+    {"circuit_breaker", LCB_CNTL_CIRCUIT_BREAKER, convert_intbool},
+    {"circuit_breaker_error_threshold", LCB_CNTL_CIRCUIT_BREAKER_ERROR_THRESHOLD, convert_u32},
+    {"circuit_breaker_volume_threshold", LCB_CNTL_CIRCUIT_BREAKER_VOLUME_THRESHOLD, convert_u32},
+    {"circuit_breaker_sleep_window", LCB_CNTL_CIRCUIT_BREAKER_SLEEP_WINDOW, convert_timevalue},
+    {"circuit_breaker_rolling_window", LCB_CNTL_CIRCUIT_BREAKER_ROLLING_WINDOW, convert_timevalue},
+    {"flight_recorder_size", LCB_CNTL_FLIGHT_RECORDER_SIZE, convert_u32},
+    {"tracing_export_queue_size", LCB_CNTL_TRACING_EXPORT_QUEUE_SIZE, convert_u32},
+    {"tracing_export_batch_size", LCB_CNTL_TRACING_EXPORT_BATCH_SIZE, convert_u32},
+    {"tracing_export_interval", LCB_CNTL_TRACING_EXPORT_INTERVAL, convert_timevalue},
+    {"kernel_io_stats", LCB_CNTL_KERNEL_IO_STATS, convert_intbool},
+    {"kv_idle_timeout", LCB_CNTL_KV_IDLE_TIMEOUT, convert_timevalue},
+    {"tcp_user_timeout", LCB_CNTL_TCP_USER_TIMEOUT, convert_timevalue},
+    {"bootstrap_parallelism", LCB_CNTL_BOOTSTRAP_PARALLELISM, convert_u32},
+    {"fast_dtor", LCB_CNTL_FASTDESTROY, convert_intbool},
+    {"http_compression", LCB_CNTL_HTTP_COMPRESSION, convert_intbool},
+    {"hot_keys", LCB_CNTL_HOT_KEYS, convert_u32},
+    {"idle_trim_interval", LCB_CNTL_IDLE_TRIM_INTERVAL, convert_timevalue},
+    {"write_coalesce_window", LCB_CNTL_WRITE_COALESCE_WINDOW, convert_timevalue},
     {nullptr, -1}};
 
+struct tuning_PARAM {
+    const char *key;
+    const char *value;
+};
+
+struct tuning_PROFILE {
+    const char *name;
+    tuning_PARAM params[10];
+};
+
+/* Every profile sets the same keys, so that switching between them does not depend on the previous profile */
+static const tuning_PROFILE tuning_profiles[] = {
+    {"default",
+     {{"read_chunk_size", "0"},
+      {"compression_min_size", "32"},
+      {"flush_coalesce", "false"},
+      {"flush_coalesce_delay", "0"},
+      {"flush_coalesce_bytes", "65536"},
+      {"io_batch_writes", "false"},
+      {"http_poolsize", "1"},
+      {"large_value_threshold", "1048576"},
+      {"netbuf_block_max", "0"},
+      {"retry_interval", "10ms"}}},
+    {"low-latency",
+     {{"read_chunk_size", "0"},
+      {"compression_min_size", "1024"},
+      {"flush_coalesce", "false"},
+      {"flush_coalesce_delay", "0"},
+      {"flush_coalesce_bytes", "65536"},
+      {"io_batch_writes", "false"},
+      {"http_poolsize", "4"},
+      {"large_value_threshold", "65536"},
+      {"netbuf_block_max", "65536"},
+      {"retry_interval", "1ms"}}},
+    {"bulk-throughput",
+     {{"read_chunk_size", "262144"},
+      {"compression_min_size", "32"},
+      {"flush_coalesce", "true"},
+      {"flush_coalesce_delay", "500us"},
+      {"flush_coalesce_bytes", "262144"},
+      {"io_batch_writes", "true"},
+      {"http_poolsize", "8"},
+      {"large_value_threshold", "0"},
+      {"netbuf_block_max", "1048576"},
+      {"retry_interval", "50ms"}}},
+    {"memory-constrained",
+     {{"read_chunk_size", "16384"},
+      {"compression_min_size", "32"},
+      {"flush_coalesce", "true"},
+      {"flush_coalesce_delay", "0"},
+      {"flush_coalesce_bytes", "16384"},
+      {"io_batch_writes", "false"},
+      {"http_poolsize", "0"},
+      {"large_value_threshold", "1048576"},
+      {"netbuf_block_max", "16384"},
+      {"retry_interval", "10ms"}}},
+};
+
+/**
+ * Apply all the settings of a tuning profile, or none of them. The profile is
+ * either the name of one of tuning_profiles, or a list of `key:value` pairs
+ * separated by commas. Only settings whose current value can be read back
+ * (numbers, booleans and intervals) may be part of a profile.
+ */
+static lcb_STATUS apply_tuning_profile(lcb_INSTANCE *instance, const char *profile)
+{
+    std::vector<std::pair<std::string, std::string>> params;
+    for (const auto &builtin : tuning_profiles) {
+        if (strcmp(builtin.name, profile) == 0) {
+            for (const auto &param : builtin.params) {
+                params.emplace_back(param.key, param.value);
+            }
+            break;
+        }
+    }
+    if (params.empty()) {
+        std::string spec(profile);
+        std::size_t pos = 0;
+        while (pos <= spec.size()) {
+            std::size_t end = spec.find(',', pos);
+            if (end == std::string::npos) {
+                end = spec.size();
+            }
+            std::string item = spec.substr(pos, end - pos);
+            std::size_t sep = item.find(':');
+            if (sep == std::string::npos || sep == 0) {
+                return LCB_ERR_CONTROL_INVALID_ARGUMENT;
+            }
+            params.emplace_back(item.substr(0, sep), item.substr(sep + 1));
+            pos = end + 1;
+        }
+    }
+
+    struct change {
+        int opcode;
+        u_STRCONVERT value;
+        u_STRCONVERT saved;
+    };
+    std::vector<change> changes;
+    for (const auto &param : params) {
+        const cntl_OPCODESTRS *ctl = stropcode_map;
+        while (ctl->key && param.first != ctl->key) {
+            ctl++;
+        }
+        if (ctl->key == nullptr || ctl->opcode < 0 ||
+            (ctl->converter != convert_u32 && ctl->converter != convert_SIZE && ctl->converter != convert_intbool &&
+             ctl->converter != convert_timevalue && ctl->converter != convert_float)) {
+            return LCB_ERR_CONTROL_INVALID_ARGUMENT;
+        }
+        change chg{};
+        chg.opcode = ctl->opcode;
+        lcb_STATUS rc = ctl->converter(param.second.c_str(), &chg.value);
+        if (rc != LCB_SUCCESS) {
+            return rc;
+        }
+        rc = lcb_cntl(instance, LCB_CNTL_GET, chg.opcode, &chg.saved);
+        if (rc != LCB_SUCCESS) {
+            return rc;
+        }
+        changes.push_back(chg);
+    }
+
+    for (std::size_t ii = 0; ii < changes.size(); ii++) {
+        lcb_STATUS rc = lcb_cntl(instance, LCB_CNTL_SET, changes[ii].opcode, &changes[ii].value);
+        if (rc != LCB_SUCCESS) {
+            while (ii-- > 0) {
+                lcb_cntl(instance, LCB_CNTL_SET, changes[ii].opcode, &changes[ii].saved);
+            }
+            return rc;
+        }
+    }
+    return LCB_SUCCESS;
+}
+
 #define CNTL_NUM_HANDLERS (sizeof(handlers) / sizeof(handlers[0]))
 
 static lcb_STATUS wrap_return(lcb_INSTANCE *instance, lcb_STATUS retval)
@@ -18,7 +18,9 @@
 #include "internal.h"
 #include "collections.h"
 #include "mcserver/negotiate.h"
+#include "contrib/lcb-jsoncpp/lcb-jsoncpp.h"
 
+#include <cstring>
 #include <string>
 
 #include "capi/cmd_getcid.hh"
@@ -26,45 +28,220 @@
 
 #define LOGARGS(instance, lvl) (instance)->settings, "c9smgmt", LCB_LOG_##lvl, __FILE__, __LINE__
 
+namespace
+{
+const char default_name[] = "_default";
+const std::size_t ndefault_name = sizeof(default_name) - 1;
+
+void normalize(const char *&name, std::size_t &nname)
+{
+    if (name == nullptr || nname == 0) {
+        name = default_name;
+        nname = ndefault_name;
+    }
+}
+
+void split_spec(const std::string &path, const char *&scope, std::size_t &nscope, const char *&collection,
+                std::size_t &ncollection)
+{
+    std::size_t dot = path.find('.');
+    if (dot == std::string::npos) {
+        scope = nullptr;
+        nscope = 0;
+        collection = path.c_str();
+        ncollection = path.size();
+    } else {
+        scope = path.c_str();
+        nscope = dot;
+        collection = path.c_str() + dot + 1;
+        ncollection = path.size() - dot - 1;
+    }
+}
+
+/** FNV-1a over "scope.collection", without building the string */
+std::uint64_t hash_spec(const char *scope, std::size_t nscope, const char *collection, std::size_t ncollection)
+{
+    std::uint64_t hash = 14695981039346656037ULL;
+    for (std::size_t ii = 0; ii < nscope; ii++) {
+        hash = (hash ^ static_cast<unsigned char>(scope[ii])) * 1099511628211ULL;
+    }
+    hash = (hash ^ static_cast<unsigned char>('.')) * 1099511628211ULL;
+    for (std::size_t ii = 0; ii < ncollection; ii++) {
+        hash = (hash ^ static_cast<unsigned char>(collection[ii])) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+std::size_t hash_cid(std::uint32_t cid)
+{
+    return static_cast<std::size_t>((cid * 0x9E3779B97F4A7C15ULL) >> 32U);
+}
+} // namespace
+
 namespace lcb
 {
 CollectionCache::CollectionCache()
 {
-    static const std::string default_collection("_default._default");
-    put(default_collection, 0);
+    put(nullptr, 0, nullptr, 0, 0);
+}
+
+const CollectionCache::Entry *CollectionCache::find(const char *scope, std::size_t nscope, const char *collection,
+                                                    std::size_t ncollection, std::uint64_t hash) const
+{
+    if (by_name_.empty()) {
+        return nullptr;
+    }
+    std::size_t mask = by_name_.size() - 1;
+    for (std::size_t pos = hash & mask; by_name_[pos] != 0; pos = (pos + 1) & mask) {
+        const Entry &entry = entries_[by_name_[pos] - 1];
+        if (entry.hash == hash && entry.nscope == nscope && entry.spec.size() == nscope + 1 + ncollection &&
+            memcmp(entry.spec.data(), scope, nscope) == 0 &&
+            memcmp(entry.spec.data() + nscope + 1, collection, ncollection) == 0) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+void CollectionCache::index(std::uint32_t ix)
+{
+    std::size_t mask = by_name_.size() - 1;
+    std::size_t pos = entries_[ix].hash & mask;
+    while (by_name_[pos] != 0) {
+        pos = (pos + 1) & mask;
+    }
+    by_name_[pos] = ix + 1;
+
+    pos = hash_cid(entries_[ix].cid) & mask;
+    while (by_id_[pos] != 0) {
+        pos = (pos + 1) & mask;
+    }
+    by_id_[pos] = ix + 1;
+}
+
+void CollectionCache::assign(const CollectionCache &other)
+{
+    entries_ = other.entries_;
+    by_name_ = other.by_name_;
+    by_id_ = other.by_id_;
+    manifest_uid_ = other.manifest_uid_;
+    has_manifest_ = other.has_manifest_;
 }
 
-std::string CollectionCache::id_to_name(uint32_t cid)
+void CollectionCache::rebuild(std::size_t nslots)
 {
-    std::map<uint32_t, std::string>::const_iterator pos = cache_i2n.find(cid);
-    if (pos != cache_i2n.end()) {
-        return pos->second;
+    by_name_.assign(nslots, 0);
+    by_id_.assign(nslots, 0);
+    for (std::uint32_t ii = 0; ii < entries_.size(); ii++) {
+        index(ii);
+    }
+}
+
+std::string CollectionCache::id_to_name(uint32_t cid) const
+{
+    if (by_id_.empty()) {
+        return "";
+    }
+    std::size_t mask = by_id_.size() - 1;
+    for (std::size_t pos = hash_cid(cid) & mask; by_id_[pos] != 0; pos = (pos + 1) & mask) {
+        const Entry &entry = entries_[by_id_[pos] - 1];
+        if (entry.cid == cid) {
+            return entry.spec;
+        }
     }
     return "";
 }
 
-bool CollectionCache::get(const std::string &path, uint32_t *cid)
+bool CollectionCache::get(const char *scope, std::size_t nscope, const char *collection, std::size_t ncollection,
+                          uint32_t *cid) const
 {
-    std::map<std::string, uint32_t>::const_iterator pos = cache_n2i.find(path);
-    if (pos != cache_n2i.end()) {
-        *cid = pos->second;
-        return true;
+    normalize(scope, nscope);
+    normalize(collection, ncollection);
+    const Entry *entry = find(scope, nscope, collection, ncollection, hash_spec(scope, nscope, collection, ncollection));
+    if (entry == nullptr) {
+        return false;
+    }
+    *cid = entry->cid;
+    return true;
+}
+
+bool CollectionCache::get(const std::string &path, uint32_t *cid) const
+{
+    const char *scope, *collection;
+    std::size_t nscope, ncollection;
+    split_spec(path, scope, nscope, collection, ncollection);
+    return get(scope, nscope, collection, ncollection, cid);
+}
+
+void CollectionCache::put(const char *scope, std::size_t nscope, const char *collection, std::size_t ncollection,
+                          uint32_t cid)
+{
+    normalize(scope, nscope);
+    normalize(collection, ncollection);
+    std::uint64_t hash = hash_spec(scope, nscope, collection, ncollection);
+    const Entry *existing = find(scope, nscope, collection, ncollection, hash);
+    if (existing != nullptr) {
+        if (existing->cid != cid) {
+            /* the ID index is keyed on the old value */
+            entries_[existing - entries_.data()].cid = cid;
+            rebuild(by_name_.size());
+        }
+        return;
+    }
+
+    Entry entry{std::string(), nscope, hash, cid};
+    entry.spec.reserve(nscope + 1 + ncollection);
+    entry.spec.append(scope, nscope).append(1, '.').append(collection, ncollection);
+    entries_.push_back(std::move(entry));
+
+    /* keep the load factor at or below one half, so probe sequences stay short */
+    if (entries_.size() * 2 > by_name_.size()) {
+        rebuild(by_name_.empty() ? 16 : by_name_.size() * 2);
+    } else {
+        index(static_cast<std::uint32_t>(entries_.size() - 1));
     }
-    return false;
 }
 
 void CollectionCache::put(const std::string &path, uint32_t cid)
 {
-    cache_n2i[path] = cid;
-    cache_i2n[cid] = path;
+    const char *scope, *collection;
+    std::size_t nscope, ncollection;
+    split_spec(path, scope, nscope, collection, ncollection);
+    put(scope, nscope, collection, ncollection, cid);
+}
+
+lcb_STATUS CollectionCache::load_manifest(const char *json, std::size_t njson)
+{
+    Json::Value manifest;
+    if (!Json::Reader().parse(json, json + njson, manifest) || !manifest.isObject() || !manifest["uid"].isString() ||
+        !manifest["scopes"].isArray()) {
+        return LCB_ERR_PROTOCOL_ERROR;
+    }
+
+    entries_.clear();
+    by_name_.clear();
+    by_id_.clear();
+    for (const auto &scope : manifest["scopes"]) {
+        const std::string &scope_name = scope["name"].asString();
+        for (const auto &collection : scope["collections"]) {
+            const std::string &collection_name = collection["name"].asString();
+            put(scope_name.c_str(), scope_name.size(), collection_name.c_str(), collection_name.size(),
+                static_cast<uint32_t>(strtoul(collection["uid"].asCString(), nullptr, 16)));
+        }
+    }
+    manifest_uid_ = strtoull(manifest["uid"].asCString(), nullptr, 16);
+    has_manifest_ = true;
+    return LCB_SUCCESS;
 }
 
 void CollectionCache::erase(uint32_t cid)
 {
-    auto pos = cache_i2n.find(cid);
-    if (pos != cache_i2n.end()) {
-        cache_n2i.erase(pos->second);
-        cache_i2n.erase(pos);
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+        if (it->cid == cid) {
+            entries_.erase(it);
+            rebuild(by_name_.size());
+            return;
+        }
     }
 }
 } // namespace lcb
@@ -96,13 +273,118 @@ lcb_STATUS collcache_get(lcb_INSTANCE *instance, const char *scope, size_t nscop
         return LCB_ERR_UNSUPPORTED_OPERATION;
     }
 
-    std::string spec = collcache_build_spec(scope, nscope, collection, ncollection);
-    if (instance->collcache->get(spec, cid)) {
+    if (instance->collcache->get(scope, nscope, collection, ncollection, cid)) {
         return LCB_SUCCESS;
     }
     return LCB_ERR_COLLECTION_NOT_FOUND;
 }
 
+namespace
+{
+struct ManifestCtx : mc_REQDATAEX {
+    explicit ManifestCtx(lcb_INSTANCE *instance_) : mc_REQDATAEX(nullptr, proctable, gethrtime()), instance(instance_)
+    {
+    }
+
+    lcb_INSTANCE *instance;
+    static mc_REQDATAPROCS proctable;
+};
+
+void manifest_done(lcb_INSTANCE *instance, lcb_STATUS rc)
+{
+    lcb::CollectionCache *cache = instance->collcache;
+    std::vector<std::function<void(lcb_STATUS)>> waiters;
+    waiters.swap(cache->manifest_waiters);
+    cache->manifest_pending = false;
+    for (auto &waiter : waiters) {
+        waiter(rc);
+    }
+}
+
+void handle_manifest(mc_PIPELINE *, mc_PACKET *pkt, lcb_CALLBACK_TYPE, lcb_STATUS, const void *arg)
+{
+    auto *ctx = static_cast<ManifestCtx *>(pkt->u_rdata.exdata);
+    const auto *resp = static_cast<const lcb_RESPGETMANIFEST *>(arg);
+    lcb_INSTANCE *instance = ctx->instance;
+    lcb_STATUS rc = resp->ctx.rc;
+    if (rc == LCB_SUCCESS) {
+        rc = instance->collcache->load_manifest(resp->value, resp->nvalue);
+    }
+    if (rc == LCB_SUCCESS) {
+        lcb_log(LOGARGS(instance, DEBUG), "Loaded %u collections from manifest",
+                (unsigned)instance->collcache->size());
+    } else {
+        lcb_log(LOGARGS(instance, WARN), "Failed to load collection manifest, rc: %s", lcb_strerror_short(rc));
+    }
+    delete ctx;
+    manifest_done(instance, rc);
+}
+
+void handle_manifest_schedfail(mc_PACKET *pkt)
+{
+    auto *ctx = static_cast<ManifestCtx *>(pkt->u_rdata.exdata);
+    lcb_INSTANCE *instance = ctx->instance;
+    delete ctx;
+    manifest_done(instance, LCB_ERR_SHEDULE_FAILURE);
+}
+} // namespace
+
+mc_REQDATAPROCS ManifestCtx::proctable = {handle_manifest, handle_manifest_schedfail};
+
+lcb_STATUS collcache_fetch_manifest(lcb_INSTANCE *instance, std::function<void(lcb_STATUS)> waiter)
+{
+    lcb::CollectionCache *cache = instance->collcache;
+    if (cache->manifest_pending) {
+        cache->manifest_waiters.emplace_back(std::move(waiter));
+        return LCB_SUCCESS;
+    }
+
+    mc_CMDQUEUE *cq = &instance->cmdq;
+    if (cq->config == nullptr) {
+        return LCB_ERR_NO_CONFIGURATION;
+    }
+    if (cq->npipelines < 1) {
+        return LCB_ERR_NO_MATCHING_SERVER;
+    }
+    mc_PIPELINE *pl = cq->pipelines[0];
+    mc_PACKET *pkt = mcreq_allocate_packet(pl);
+    if (!pkt) {
+        return LCB_ERR_NO_MEMORY;
+    }
+    mcreq_reserve_header(pl, pkt, MCREQ_PKT_BASESIZE);
+    pkt->flags |= MCREQ_F_NOCID;
+
+    protocol_binary_request_header hdr{};
+    hdr.request.magic = PROTOCOL_BINARY_REQ;
+    hdr.request.opcode = PROTOCOL_BINARY_CMD_COLLECTIONS_GET_MANIFEST;
+    hdr.request.datatype = PROTOCOL_BINARY_RAW_BYTES;
+    hdr.request.opaque = pkt->opaque;
+    memcpy(SPAN_BUFFER(&pkt->kh_span), hdr.bytes, sizeof(hdr.bytes));
+
+    pkt->u_rdata.exdata = new ManifestCtx(instance);
+    pkt->u_rdata.exdata->deadline =
+        pkt->u_rdata.exdata->start + LCB_US2NS(LCBT_SETTING(instance, operation_timeout));
+    pkt->flags |= MCREQ_F_REQEXT;
+
+    cache->manifest_pending = true;
+    cache->manifest_waiters.emplace_back(std::move(waiter));
+    LCB_SCHED_ADD(instance, pl, pkt)
+    return LCB_SUCCESS;
+}
+
+bool collcache_manifest_outdated(lcb_INSTANCE *instance, const char *body, size_t nbody)
+{
+    uint64_t known;
+    if (!instance->collcache->manifest_uid(&known) || body == nullptr || nbody == 0) {
+        return true;
+    }
+    Json::Value error;
+    if (!Json::Reader().parse(body, body + nbody, error) || !error.isObject() || !error["manifest_uid"].isString()) {
+        return true;
+    }
+    return strtoull(error["manifest_uid"].asCString(), nullptr, 16) > known;
+}
+
 lcb_STATUS collcache_get(lcb_INSTANCE *instance, lcb::collection_qualifier &collection)
 {
     uint32_t collection_id;
@@ -302,3 +584,60 @@ lcb_STATUS lcb_getcid(lcb_INSTANCE *instance, void *cookie, const lcb_CMDGETCID
     LCB_SCHED_ADD(instance, pl, pkt)
     return LCB_SUCCESS;
 }
+
+LIBCOUCHBASE_API
+lcb_STATUS lcb_collection_prefetch(lcb_INSTANCE *instance, void *cookie, const char *scope, size_t scope_len,
+                                   const char *const *collections, const size_t *collections_len, size_t ncollections,
+                                   size_t *nscheduled)
+{
+    if (nscheduled) {
+        *nscheduled = 0;
+    }
+    if (ncollections && (collections == nullptr || collections_len == nullptr)) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    if (LCBT_SETTING(instance, conntype) != LCB_TYPE_BUCKET || !LCBT_SETTING(instance, use_collections)) {
+        return LCB_ERR_UNSUPPORTED_OPERATION;
+    }
+    if (scope == nullptr || scope_len == 0) {
+        scope = "_default";
+        scope_len = strlen(scope);
+    }
+
+    lcb_CMDGETCID cmd{};
+    cmd.scope = scope;
+    cmd.nscope = scope_len;
+
+    bool own_ctx = !instance->cmdq.ctxenter;
+    if (own_ctx) {
+        lcb_sched_enter(instance);
+    }
+    size_t count = 0;
+    for (size_t ii = 0; ii < ncollections; ii++) {
+        uint32_t cid;
+        if (instance->collcache->get(scope, scope_len, collections[ii], collections_len[ii], &cid)) {
+            continue;
+        }
+        cmd.collection = collections[ii];
+        cmd.ncollection = collections_len[ii];
+        lcb_STATUS rc = lcb_getcid(instance, cookie, &cmd);
+        if (rc != LCB_SUCCESS) {
+            if (own_ctx) {
+                lcb_sched_fail(instance);
+            }
+            return rc;
+        }
+        count++;
+    }
+    if (own_ctx) {
+        if (count) {
+            lcb_sched_leave(instance);
+        } else {
+            lcb_sched_fail(instance);
+        }
+    }
+    if (nscheduled) {
+        *nscheduled = count;
+    }
+    return LCB_SUCCESS;
+}
@@ -19,7 +19,10 @@
 #define LCB_COLLECTIONS_H
 
 #ifdef __cplusplus
+#include <functional>
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "capi/cmd_getcid.hh"
 #include "capi/collection_qualifier.hh"
@@ -27,23 +30,82 @@
 
 namespace lcb
 {
+/**
+ * Maps "scope.collection" names to collection IDs and back.
+ *
+ * Entries live in a dense vector, indexed by two open-addressing tables (one
+ * on the name, one on the ID), so the lookup done for every KV operation only
+ * hashes the scope and collection in place and never builds a spec string.
+ */
 class CollectionCache
 {
-    std::map<std::string, uint32_t> cache_n2i{};
-    std::map<uint32_t, std::string> cache_i2n{};
+    struct Entry {
+        /** "scope.collection", normalized to "_default" for empty names */
+        std::string spec;
+        std::size_t nscope;
+        std::uint64_t hash;
+        std::uint32_t cid;
+    };
+
+    std::vector<Entry> entries_{};
+    /** Slots hold an index into entries_ plus one, zero is an empty slot */
+    std::vector<std::uint32_t> by_name_{};
+    std::vector<std::uint32_t> by_id_{};
+
+    const Entry *find(const char *scope, std::size_t nscope, const char *collection, std::size_t ncollection,
+                      std::uint64_t hash) const;
+    void rebuild(std::size_t nslots);
+    void index(std::uint32_t ix);
 
   public:
     CollectionCache();
 
     ~CollectionCache() = default;
 
-    bool get(const std::string &path, uint32_t *cid);
+    bool get(const char *scope, std::size_t nscope, const char *collection, std::size_t ncollection,
+             uint32_t *cid) const;
+
+    bool get(const std::string &path, uint32_t *cid) const;
+
+    void put(const char *scope, std::size_t nscope, const char *collection, std::size_t ncollection, uint32_t cid);
 
     void put(const std::string &path, uint32_t cid);
 
-    std::string id_to_name(uint32_t cid);
+    std::string id_to_name(uint32_t cid) const;
 
     void erase(uint32_t cid);
+
+    /** Replace the entries with those of another cache, but not its waiters */
+    void assign(const CollectionCache &other);
+
+    std::size_t size() const
+    {
+        return entries_.size();
+    }
+
+    /**
+     * Replace all entries with the collections listed in a
+     * GET_COLLECTIONS_MANIFEST response
+     */
+    lcb_STATUS load_manifest(const char *json, std::size_t njson);
+
+    /** Whether a manifest has been loaded, and if so the uid it had */
+    bool manifest_uid(std::uint64_t *uid) const
+    {
+        *uid = manifest_uid_;
+        return has_manifest_;
+    }
+
+    /**
+     * Functions waiting for the manifest request in flight, if any. They are
+     * invoked with the status of the request once it completes
+     */
+    std::vector<std::function<void(lcb_STATUS)>> manifest_waiters{};
+    bool manifest_pending{false};
+
+  private:
+    std::uint64_t manifest_uid_{0};
+    bool has_manifest_{false};
 };
 } // namespace lcb
 typedef lcb::CollectionCache lcb_COLLCACHE;
@@ -53,6 +115,22 @@ lcb_STATUS collcache_get(lcb_INSTANCE *instance, const char *scope, size_t nscop
 lcb_STATUS collcache_get(lcb_INSTANCE *instance, lcb::collection_qualifier &collection);
 std::string collcache_build_spec(const char *scope, size_t nscope, const char *collection, size_t ncollection);
 
+/**
+ * Run `waiter` once the collection manifest has been (re)loaded into the
+ * cache. Requests are coalesced, so that only one GET_COLLECTIONS_MANIFEST is
+ * in flight however many operations wait for it.
+ * @return an error if the request could not be scheduled, in which case
+ * `waiter` is not invoked
+ */
+lcb_STATUS collcache_fetch_manifest(lcb_INSTANCE *instance, std::function<void(lcb_STATUS)> waiter);
+
+/**
+ * Whether the body of an unknown collection or scope error refers to a newer
+ * manifest than the one in the cache. This is also the case if nothing has
+ * been loaded yet, or if the body does not carry a `manifest_uid`
+ */
+bool collcache_manifest_outdated(lcb_INSTANCE *instance, const char *body, size_t nbody);
+
 template <typename Command, typename Operation, typename Destructor>
 struct GetCidCtx : mc_REQDATAEX {
     std::string path_;
@@ -135,7 +213,7 @@ lcb_STATUS collcache_resolve(lcb_INSTANCE *instance, Command cmd, Operation op,
     if (idx < 0) {
         return LCB_ERR_NO_MATCHING_SERVER;
     }
-    mc_PIPELINE *pl = cq->pipelines[idx];
+    mc_PIPELINE *pl = mcreq_queue_pipeline(cq, idx, vbid);
     mc_PACKET *pkt = mcreq_allocate_packet(pl);
     if (!pkt) {
         return LCB_ERR_NO_MEMORY;
@@ -175,6 +253,26 @@ lcb_STATUS collcache_resolve(lcb_INSTANCE *instance, std::shared_ptr<Command> cm
         return LCB_ERR_UNSUPPORTED_OPERATION;
     }
 
+    if (LCBT_SETTING(instance, collections_manifest)) {
+        return collcache_fetch_manifest(instance, [instance, cmd, scheduler](lcb_STATUS rc) {
+            if (rc == LCB_ERR_SHEDULE_FAILURE) {
+                scheduler(rc, nullptr, cmd);
+                return;
+            }
+            lcb_RESPGETCID resp{};
+            resp.cookie = cmd->cookie();
+            resp.ctx.rc = rc;
+            resp.ctx.key = cmd->collection().spec();
+            resp.ctx.scope = cmd->collection().scope();
+            resp.ctx.collection = cmd->collection().collection();
+            if (rc == LCB_SUCCESS) {
+                resp.ctx.rc = collcache_get(instance, cmd->collection());
+                resp.collection_id = cmd->collection().collection_id();
+            }
+            scheduler(rc, &resp, cmd);
+        });
+    }
+
     const std::string &spec = cmd->collection().spec();
 
     mc_CMDQUEUE *cq = &instance->cmdq;
@@ -188,7 +286,7 @@ lcb_STATUS collcache_resolve(lcb_INSTANCE *instance, std::shared_ptr<Command> cm
     if (idx < 0) {
         return LCB_ERR_NO_MATCHING_SERVER;
     }
-    mc_PIPELINE *pl = cq->pipelines[idx];
+    mc_PIPELINE *pl = mcreq_queue_pipeline(cq, idx, vbid);
     mc_PACKET *pkt = mcreq_allocate_packet(pl);
     if (!pkt) {
         return LCB_ERR_NO_MEMORY;
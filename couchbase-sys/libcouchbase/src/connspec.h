@@ -189,6 +189,10 @@ class LCB_CLASS_EXPORT Connspec
     {
         m_hosts.clear();
     }
+    void bucket(const std::string &name)
+    {
+        m_bucket = name;
+    }
     void add_host(const Spechost &host)
     {
         m_hosts.push_back(host);
@@ -232,7 +236,30 @@ class LCB_CLASS_EXPORT Connspec
 #define LCB_SPECSCHEME_SRV_SSL "couchbases+dnssrv://"
 
 // Standalone functionality:
-lcb_STATUS dnssrv_query(const char *name, Hostlist &hostlist);
+struct SrvRecord {
+    std::string target;
+    lcb_U16 port;
+    lcb_U16 priority;
+    lcb_U16 weight;
+};
+
+/**
+ * Sorts SRV records by priority, and orders the records of each priority
+ * randomly, in proportion to their weights (RFC 2782).
+ */
+void dnssrv_order(std::vector<SrvRecord> &records);
+
+/**
+ * Appends the targets of the SRV records of @p name to @p hostlist, in the
+ * order of dnssrv_order(). Answers are cached (process-wide) for the lowest
+ * TTL of their records. The query itself blocks, but for a bounded time.
+ *
+ * @param use_cache false to always query the name servers
+ */
+lcb_STATUS dnssrv_query(const char *name, Hostlist &hostlist, bool use_cache = true);
+
+/** @return the name of the SRV records of the bootstrap host @p addr */
+std::string dnssrv_name(const char *addr, bool is_ssl);
 
 Hostlist *dnssrv_getbslist(const char *addr, bool is_ssl, lcb_STATUS &errout);
 
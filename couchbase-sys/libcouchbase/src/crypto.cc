@@ -18,6 +18,8 @@
 #include "internal.h"
 #include "strcodecs/strcodecs.h"
 
+#include <vector>
+
 #define LOGARGS(instance, lvl) instance->settings, "crypto", LCB_LOG_##lvl, __FILE__, __LINE__
 
 void lcbcrypto_ref(lcbcrypto_PROVIDER *provider)
@@ -35,7 +37,7 @@ void lcbcrypto_unref(lcbcrypto_PROVIDER *provider)
 
 void lcbcrypto_register(lcb_INSTANCE *instance, const char *name, lcbcrypto_PROVIDER *provider)
 {
-    if (provider->version != 1) {
+    if (provider->version != 1 && provider->version != 2) {
         lcb_log(LOGARGS(instance, ERROR), "Unsupported version for \"%s\" crypto provider, ignoring", name);
         return;
     }
@@ -61,7 +63,7 @@ static bool lcbcrypto_is_valid(lcbcrypto_PROVIDER *provider)
     if (!(provider && provider->_refcnt > 0)) {
         return false;
     }
-    if (provider->version != 1) {
+    if (provider->version != 1 && provider->version != 2) {
         return false;
     }
     if (provider->v.v1.sign && provider->v.v1.verify_signature == nullptr) {
@@ -84,6 +86,9 @@ static bool lcbcrypto_is_valid(lcbcrypto_PROVIDER *provider)
 #define PROVIDER_DECRYPT(provider, ctext, nctext, iv, niv, ptext, nptext)                                              \
     (provider)->v.v1.decrypt((provider), (ctext), (nctext), (iv), (niv), (ptext), (nptext))
 
+#define PROVIDER_ENCRYPT_BATCH(provider) ((provider)->version >= 2 ? (provider)->v.v2.encrypt_batch : nullptr)
+#define PROVIDER_DECRYPT_BATCH(provider) ((provider)->version >= 2 ? (provider)->v.v2.decrypt_batch : nullptr)
+
 #define PROVIDER_GET_KEY_ID(provider) (provider)->v.v1.get_key_id((provider))
 
 #define PROVIDER_RELEASE_BYTES(provider, bytes)                                                                        \
@@ -97,6 +102,131 @@ static lcbcrypto_PROVIDER *lcb_get_provider(const lcb_st *instance, const std::s
     return provider_iterator != (*instance->crypto).end() ? provider_iterator->second : nullptr;
 }
 
+namespace
+{
+/**
+ * Field of a document on its way through its crypto-provider. The fields are
+ * prepared first, then all of them are passed to the providers, and only then
+ * are the results merged back into the document.
+ */
+struct CryptoField {
+    CryptoField(lcbcrypto_FIELDSPEC *spec_, lcbcrypto_PROVIDER *provider_) : spec(spec_), provider(provider_) {}
+    CryptoField(const CryptoField &) = delete;
+    CryptoField(CryptoField &&other) noexcept
+        : spec(other.spec), provider(other.provider), input(std::move(other.input)), iv(other.iv), niv(other.niv),
+          provider_iv(other.provider_iv), output(other.output), noutput(other.noutput)
+    {
+        other.iv = nullptr;
+        other.output = nullptr;
+    }
+    ~CryptoField()
+    {
+        if (provider_iv) {
+            PROVIDER_RELEASE_BYTES(provider, iv)
+        } else {
+            free(iv);
+        }
+        PROVIDER_RELEASE_BYTES(provider, output)
+    }
+
+    lcbcrypto_FIELDSPEC *spec;
+    lcbcrypto_PROVIDER *provider;
+    /** plain text to encrypt, or cipher text to decrypt */
+    std::string input;
+    std::uint8_t *iv{nullptr};
+    std::size_t niv{0};
+    /** whether the IV was allocated by the provider rather than by the base64 decoder */
+    bool provider_iv{false};
+    std::uint8_t *output{nullptr};
+    std::size_t noutput{0};
+};
+} // namespace
+
+/**
+ * Encrypt or decrypt the fields. The fields of a provider with a batch
+ * function are passed to it in a single call, the others one by one.
+ */
+static lcb_STATUS crypto_run(std::vector<CryptoField> &fields, bool encrypt)
+{
+    std::vector<bool> done(fields.size(), false);
+    std::vector<lcbcrypto_BATCHITEM> items;
+    std::vector<size_t> indexes;
+
+    for (size_t ii = 0; ii < fields.size(); ii++) {
+        if (done[ii]) {
+            continue;
+        }
+        lcbcrypto_PROVIDER *provider = fields[ii].provider;
+        auto batch = encrypt ? PROVIDER_ENCRYPT_BATCH(provider) : PROVIDER_DECRYPT_BATCH(provider);
+        if (batch == nullptr) {
+            CryptoField &field = fields[ii];
+            const auto *input = reinterpret_cast<const std::uint8_t *>(field.input.data());
+            lcb_STATUS rc;
+            if (encrypt) {
+                rc = PROVIDER_ENCRYPT(provider, input, field.input.size(), field.iv, field.niv, &field.output,
+                                      &field.noutput);
+            } else {
+                rc = PROVIDER_DECRYPT(provider, input, field.input.size(), field.iv, field.niv, &field.output,
+                                      &field.noutput);
+            }
+            if (rc != LCB_SUCCESS) {
+                return rc;
+            }
+            continue;
+        }
+
+        items.clear();
+        indexes.clear();
+        for (size_t jj = ii; jj < fields.size(); jj++) {
+            if (done[jj] || fields[jj].provider != provider) {
+                continue;
+            }
+            done[jj] = true;
+            lcbcrypto_BATCHITEM item{};
+            item.input = reinterpret_cast<const std::uint8_t *>(fields[jj].input.data());
+            item.input_len = fields[jj].input.size();
+            item.iv = fields[jj].iv;
+            item.iv_len = fields[jj].niv;
+            items.push_back(item);
+            indexes.push_back(jj);
+        }
+        lcb_STATUS rc = batch(provider, items.data(), items.size());
+        for (size_t kk = 0; kk < items.size(); kk++) {
+            CryptoField &field = fields[indexes[kk]];
+            field.output = items[kk].output;
+            field.noutput = items[kk].output_len;
+            if (rc == LCB_SUCCESS) {
+                rc = items[kk].status;
+            }
+        }
+        if (rc != LCB_SUCCESS) {
+            return rc;
+        }
+    }
+    return LCB_SUCCESS;
+}
+
+static bool base64_encode(const std::uint8_t *src, std::size_t nsrc, std::string &dst)
+{
+    dst.resize((nsrc / 3 + 1) * 4 + 1);
+    if (lcb_base64_encode(reinterpret_cast<const char *>(src), nsrc, &dst[0], dst.size()) < 0) {
+        return false;
+    }
+    dst.resize((nsrc + 2) / 3 * 4);
+    return true;
+}
+
+static bool base64_decode(const std::string &src, std::string &dst)
+{
+    dst.resize(src.size() * 3 / 4 + 3);
+    std::ptrdiff_t rc = lcb_base64_decode(src.c_str(), src.size(), &dst[0], dst.size());
+    if (rc < 0) {
+        return false;
+    }
+    dst.resize(rc);
+    return true;
+}
+
 lcb_STATUS lcbcrypto_encrypt_fields(lcb_INSTANCE *instance, lcbcrypto_CMDENCRYPT *cmd)
 {
     cmd->out = nullptr;
@@ -106,124 +236,113 @@ lcb_STATUS lcbcrypto_encrypt_fields(lcb_INSTANCE *instance, lcbcrypto_CMDENCRYPT
     if (!lcb::jsparse::parse_json(cmd->doc, cmd->ndoc, jdoc)) {
         return LCB_ERR_INVALID_ARGUMENT;
     }
-    bool changed = false;
     std::string prefix = (cmd->prefix == nullptr) ? LCBCRYPTO_DEFAULT_FIELD_PREFIX : cmd->prefix;
+    std::vector<CryptoField> fields;
+    fields.reserve(cmd->nfields);
     for (size_t ii = 0; ii < cmd->nfields; ii++) {
-        lcbcrypto_FIELDSPEC *field = cmd->fields + ii;
-        lcb_STATUS rc;
+        lcbcrypto_FIELDSPEC *spec = cmd->fields + ii;
 
-        if (field->name == nullptr) {
+        if (spec->name == nullptr) {
             lcb_log(LOGARGS(instance, WARN), "field name cannot be nullptr");
             return LCB_ERR_INVALID_ARGUMENT;
         }
 
-        lcbcrypto_PROVIDER *provider = lcb_get_provider(instance, field->alg);
+        lcbcrypto_PROVIDER *provider = lcb_get_provider(instance, spec->alg);
         if (!lcbcrypto_is_valid(provider)) {
             lcb_log(LOGARGS(instance, WARN), "Invalid crypto provider");
             return LCB_ERR_INVALID_ARGUMENT;
         }
 
-        if (jdoc.isMember(field->name)) {
-            Json::Value encrypted;
-            int ret;
-
-            std::uint8_t *iv = nullptr;
-            char *biv = nullptr;
-            size_t niv = 0;
-            std::size_t nbiv = 0;
-            if (PROVIDER_NEED_IV(provider)) {
-                rc = PROVIDER_GENERATE_IV(provider, &iv, &niv);
-                if (rc != LCB_SUCCESS) {
-                    PROVIDER_RELEASE_BYTES(provider, iv)
-                    lcb_log(LOGARGS(instance, WARN), "Unable to generate IV");
-                    return rc;
-                }
-                ret = lcb_base64_encode2(reinterpret_cast<char *>(iv), niv, &biv, &nbiv);
-                if (ret < 0) {
-                    free(biv);
-                    PROVIDER_RELEASE_BYTES(provider, iv)
-                    lcb_log(LOGARGS(instance, WARN), "Unable to encode IV as Base64 string");
-                    return LCB_ERR_INVALID_ARGUMENT;
-                }
-                encrypted["iv"] = biv;
-            }
-
-            std::string contents = Json::FastWriter().write(jdoc[field->name]);
-            const auto *ptext = reinterpret_cast<const std::uint8_t *>(contents.c_str());
-            std::uint8_t *ctext = nullptr;
-            size_t nptext = contents.size(), nctext = 0;
-            rc = PROVIDER_ENCRYPT(provider, ptext, nptext, iv, niv, &ctext, &nctext);
-            PROVIDER_RELEASE_BYTES(provider, iv)
+        if (!jdoc.isMember(spec->name)) {
+            continue;
+        }
+        fields.emplace_back(spec, provider);
+        CryptoField &field = fields.back();
+        if (PROVIDER_NEED_IV(provider)) {
+            field.provider_iv = true;
+            lcb_STATUS rc = PROVIDER_GENERATE_IV(provider, &field.iv, &field.niv);
             if (rc != LCB_SUCCESS) {
-                PROVIDER_RELEASE_BYTES(provider, ctext)
-                lcb_log(LOGARGS(instance, WARN), "Unable to encrypt field");
+                lcb_log(LOGARGS(instance, WARN), "Unable to generate IV");
                 return rc;
             }
-            char *btext = nullptr;
-            std::size_t nbtext = 0;
-            ret = lcb_base64_encode2(reinterpret_cast<char *>(ctext), nctext, &btext, &nbtext);
-            PROVIDER_RELEASE_BYTES(provider, ctext)
-            if (ret < 0) {
-                free(btext);
-                lcb_log(LOGARGS(instance, WARN), "Unable to encode encrypted field as Base64 string");
+        }
+        field.input = Json::FastWriter().write(jdoc[spec->name]);
+        jdoc.removeMember(spec->name);
+    }
+    if (fields.empty()) {
+        return LCB_SUCCESS;
+    }
+
+    lcb_STATUS rc = crypto_run(fields, true);
+    if (rc != LCB_SUCCESS) {
+        lcb_log(LOGARGS(instance, WARN), "Unable to encrypt field");
+        return rc;
+    }
+
+    for (auto &field : fields) {
+        lcbcrypto_PROVIDER *provider = field.provider;
+        Json::Value encrypted;
+
+        std::string biv;
+        if (field.iv) {
+            if (!base64_encode(field.iv, field.niv, biv)) {
+                lcb_log(LOGARGS(instance, WARN), "Unable to encode IV as Base64 string");
                 return LCB_ERR_INVALID_ARGUMENT;
             }
-            encrypted["ciphertext"] = btext;
-            std::string kid = PROVIDER_GET_KEY_ID(provider);
-            encrypted["kid"] = kid;
-
-            if (PROVIDER_NEED_SIGN(provider)) {
-                lcbcrypto_SIGV parts[4] = {};
-                size_t nparts = 0;
-                std::uint8_t *sig = nullptr;
-                size_t nsig = 0;
-
-                parts[nparts].data = reinterpret_cast<const std::uint8_t *>(kid.c_str());
-                parts[nparts].len = kid.size();
-                nparts++;
-                parts[nparts].data = reinterpret_cast<const std::uint8_t *>(field->alg);
-                parts[nparts].len = strlen(field->alg);
-                nparts++;
-                if (biv) {
-                    parts[nparts].data = reinterpret_cast<const std::uint8_t *>(biv);
-                    parts[nparts].len = nbiv;
-                    nparts++;
-                }
-                parts[nparts].data = reinterpret_cast<const std::uint8_t *>(btext);
-                parts[nparts].len = nbtext;
+            encrypted["iv"] = biv;
+        }
+        std::string btext;
+        if (!base64_encode(field.output, field.noutput, btext)) {
+            lcb_log(LOGARGS(instance, WARN), "Unable to encode encrypted field as Base64 string");
+            return LCB_ERR_INVALID_ARGUMENT;
+        }
+        encrypted["ciphertext"] = btext;
+        std::string kid = PROVIDER_GET_KEY_ID(provider);
+        encrypted["kid"] = kid;
+
+        if (PROVIDER_NEED_SIGN(provider)) {
+            lcbcrypto_SIGV parts[4] = {};
+            size_t nparts = 0;
+            std::uint8_t *sig = nullptr;
+            size_t nsig = 0;
+
+            parts[nparts].data = reinterpret_cast<const std::uint8_t *>(kid.c_str());
+            parts[nparts].len = kid.size();
+            nparts++;
+            parts[nparts].data = reinterpret_cast<const std::uint8_t *>(field.spec->alg);
+            parts[nparts].len = strlen(field.spec->alg);
+            nparts++;
+            if (field.iv) {
+                parts[nparts].data = reinterpret_cast<const std::uint8_t *>(biv.c_str());
+                parts[nparts].len = biv.size();
                 nparts++;
+            }
+            parts[nparts].data = reinterpret_cast<const std::uint8_t *>(btext.c_str());
+            parts[nparts].len = btext.size();
+            nparts++;
 
-                rc = PROVIDER_SIGN(provider, parts, nparts, &sig, &nsig);
-                if (rc != LCB_SUCCESS) {
-                    PROVIDER_RELEASE_BYTES(provider, sig)
-                    lcb_log(LOGARGS(instance, WARN), "Unable to sign encrypted field");
-                    return rc;
-                }
-                char *bsig = nullptr;
-                std::size_t nbsig = 0;
-                ret = lcb_base64_encode2(reinterpret_cast<char *>(sig), nsig, &bsig, &nbsig);
+            rc = PROVIDER_SIGN(provider, parts, nparts, &sig, &nsig);
+            if (rc != LCB_SUCCESS) {
                 PROVIDER_RELEASE_BYTES(provider, sig)
-                if (ret < 0) {
-                    free(bsig);
-                    lcb_log(LOGARGS(instance, WARN), "Unable to encode signature as Base64 string");
-                    return LCB_ERR_INVALID_ARGUMENT;
-                }
-                encrypted["sig"] = bsig;
-                free(bsig);
+                lcb_log(LOGARGS(instance, WARN), "Unable to sign encrypted field");
+                return rc;
+            }
+            std::string bsig;
+            bool encoded = base64_encode(sig, nsig, bsig);
+            PROVIDER_RELEASE_BYTES(provider, sig)
+            if (!encoded) {
+                lcb_log(LOGARGS(instance, WARN), "Unable to encode signature as Base64 string");
+                return LCB_ERR_INVALID_ARGUMENT;
             }
-            free(biv);
-            free(btext);
-            encrypted["alg"] = field->alg;
-            jdoc[prefix + field->name] = encrypted;
-            jdoc.removeMember(field->name);
-            changed = true;
+            encrypted["sig"] = bsig;
         }
+        encrypted["alg"] = field.spec->alg;
+        jdoc[prefix + field.spec->name] = encrypted;
     }
-    if (changed) {
-        std::string doc = Json::FastWriter().write(jdoc);
-        cmd->out = lcb_strdup(doc.c_str());
-        cmd->nout = strlen(cmd->out);
-    }
+
+    std::string doc = Json::FastWriter().write(jdoc);
+    cmd->out = lcb_strdup(doc.c_str());
+    cmd->nout = strlen(cmd->out);
     return LCB_SUCCESS;
 }
 
@@ -241,23 +360,24 @@ lcb_STATUS lcbcrypto_decrypt_fields(lcb_INSTANCE *instance, lcbcrypto_CMDDECRYPT
         return LCB_ERR_INVALID_ARGUMENT;
     }
 
-    bool changed = false;
     std::string prefix = (cmd->prefix == nullptr) ? LCBCRYPTO_DEFAULT_FIELD_PREFIX : cmd->prefix;
+    std::vector<CryptoField> fields;
+    fields.reserve(cmd->nfields);
 
     for (size_t ii = 0; ii < cmd->nfields; ii++) {
-        lcbcrypto_FIELDSPEC *field = cmd->fields + ii;
+        lcbcrypto_FIELDSPEC *spec = cmd->fields + ii;
 
-        if (field->name == nullptr) {
+        if (spec->name == nullptr) {
             lcb_log(LOGARGS(instance, WARN), "field name cannot be nullptr");
             return LCB_ERR_INVALID_ARGUMENT;
         }
-        lcbcrypto_PROVIDER *provider = lcb_get_provider(instance, field->alg);
+        lcbcrypto_PROVIDER *provider = lcb_get_provider(instance, spec->alg);
         if (!lcbcrypto_is_valid(provider)) {
             lcb_log(LOGARGS(instance, WARN), "Invalid crypto provider");
             return LCB_ERR_INVALID_ARGUMENT;
         }
 
-        std::string name = prefix + field->name;
+        std::string name = prefix + spec->name;
         if (!jdoc.isMember(name)) {
             continue;
         }
@@ -289,9 +409,6 @@ lcb_STATUS lcbcrypto_decrypt_fields(lcb_INSTANCE *instance, lcbcrypto_CMDDECRYPT
             nbiv = strlen(biv);
         }
 
-        int ret;
-        lcb_STATUS rc;
-
         Json::Value &jctext = encrypted["ciphertext"];
         if (!jctext.isString()) {
             lcb_log(LOGARGS(instance, WARN), "Expected encrypted field \"ciphertext\" to be a JSON string");
@@ -305,12 +422,8 @@ lcb_STATUS lcbcrypto_decrypt_fields(lcb_INSTANCE *instance, lcbcrypto_CMDDECRYPT
                 lcb_log(LOGARGS(instance, WARN), "Expected signature field \"sig\" to be a JSON string");
                 return LCB_ERR_INVALID_ARGUMENT;
             }
-            std::uint8_t *sig = nullptr;
-            std::size_t nsig = 0;
-            const std::string &bsig = jsig.asString();
-            ret = lcb_base64_decode2(bsig.c_str(), bsig.size(), reinterpret_cast<char **>(&sig), &nsig);
-            if (ret < 0) {
-                PROVIDER_RELEASE_BYTES(provider, sig)
+            std::string sig;
+            if (!base64_decode(jsig.asString(), sig)) {
                 lcb_log(LOGARGS(instance, WARN), "Unable to decode signature as Base64 string");
                 return LCB_ERR_INVALID_ARGUMENT;
             }
@@ -333,59 +446,50 @@ lcb_STATUS lcbcrypto_decrypt_fields(lcb_INSTANCE *instance, lcbcrypto_CMDDECRYPT
             parts[nparts].len = btext.size();
             nparts++;
 
-            rc = PROVIDER_VERIFY_SIGNATURE(provider, parts, nparts, sig, nsig);
-            free(sig);
+            lcb_STATUS rc = PROVIDER_VERIFY_SIGNATURE(provider, parts, nparts, reinterpret_cast<std::uint8_t *>(&sig[0]),
+                                                      sig.size());
             if (rc != LCB_SUCCESS) {
                 lcb_log(LOGARGS(instance, WARN), "Signature verification for encrypted field \"ciphertext\" failed");
                 return rc;
             }
         }
 
-        std::uint8_t *ctext = nullptr;
-        std::size_t nctext = 0;
-        ret = lcb_base64_decode2(btext.c_str(), btext.size(), reinterpret_cast<char **>(&ctext), &nctext);
-        if (ret < 0) {
+        fields.emplace_back(spec, provider);
+        CryptoField &field = fields.back();
+        if (!base64_decode(btext, field.input)) {
             lcb_log(LOGARGS(instance, WARN), "Unable to decode encrypted field \"ciphertext\" as Base64 string");
             return LCB_ERR_INVALID_ARGUMENT;
         }
-
-        std::uint8_t *iv = nullptr;
-        std::size_t niv = 0;
         if (biv) {
-            ret = lcb_base64_decode2(biv, nbiv, reinterpret_cast<char **>(&iv), &niv);
-            if (ret < 0) {
-                free(ctext);
+            if (lcb_base64_decode2(biv, nbiv, reinterpret_cast<char **>(&field.iv), &field.niv) < 0) {
                 lcb_log(LOGARGS(instance, WARN), "Unable to decode IV field \"iv\" as Base64 string");
                 return LCB_ERR_INVALID_ARGUMENT;
             }
         }
+        jdoc.removeMember(name);
+    }
+    if (fields.empty()) {
+        return LCB_SUCCESS;
+    }
 
-        std::uint8_t *ptext = nullptr;
-        size_t nptext = 0;
-        rc = PROVIDER_DECRYPT(provider, ctext, nctext, iv, niv, &ptext, &nptext);
-        free(ctext);
-        if (rc != LCB_SUCCESS) {
-            PROVIDER_RELEASE_BYTES(provider, ptext)
-            lcb_log(LOGARGS(instance, WARN), "Unable to decrypt encrypted field");
-            return rc;
-        }
+    lcb_STATUS rc = crypto_run(fields, false);
+    if (rc != LCB_SUCCESS) {
+        lcb_log(LOGARGS(instance, WARN), "Unable to decrypt encrypted field");
+        return rc;
+    }
+
+    for (auto &field : fields) {
         Json::Value frag;
-        char *json = reinterpret_cast<char *>(ptext);
-        bool valid_json = lcb::jsparse::parse_json(json, nptext, frag);
-        PROVIDER_RELEASE_BYTES(provider, ptext)
-        if (!valid_json) {
+        if (!lcb::jsparse::parse_json(reinterpret_cast<const char *>(field.output), field.noutput, frag)) {
             lcb_log(LOGARGS(instance, WARN), "Result of decryption is not valid JSON");
             return LCB_ERR_INVALID_ARGUMENT;
         }
-        jdoc[name.substr(prefix.size())] = frag;
-        jdoc.removeMember(name);
-        changed = true;
-    }
-    if (changed) {
-        std::string doc = Json::FastWriter().write(jdoc);
-        cmd->out = lcb_strdup(doc.c_str());
-        cmd->nout = strlen(cmd->out);
+        jdoc[field.spec->name] = frag;
     }
+
+    std::string doc = Json::FastWriter().write(jdoc);
+    cmd->out = lcb_strdup(doc.c_str());
+    cmd->nout = strlen(cmd->out);
     return LCB_SUCCESS;
 }
 
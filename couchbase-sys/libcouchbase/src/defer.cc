@@ -20,12 +20,15 @@
 
 namespace lcb
 {
-lcb_STATUS defer_operation(lcb_INSTANCE *instance, std::function<void(lcb_STATUS)> operation)
+lcb_STATUS defer_operation(lcb_INSTANCE *instance, DeferredOperation operation)
 {
     if (instance == nullptr || instance->deferred_operations == nullptr) {
         return LCB_ERR_INVALID_ARGUMENT;
     }
-    instance->deferred_operations->emplace_back(std::move(operation));
+    instance->deferred_operations->push(std::move(operation));
+    if (instance->settings->metrics) {
+        instance->settings->metrics->deferred_high_water = instance->deferred_operations->high_water();
+    }
     return LCB_SUCCESS;
 }
 
@@ -39,8 +42,7 @@ void execute_deferred_operations(lcb_INSTANCE *instance)
     }
 
     while (instance->has_deferred_operations()) {
-        auto operation = instance->deferred_operations->front();
-        instance->deferred_operations->pop_front();
+        DeferredOperation operation = instance->deferred_operations->pop();
         operation(LCB_SUCCESS);
     }
 }
@@ -51,9 +53,13 @@ void cancel_deferred_operations(lcb_INSTANCE *instance)
         return;
     }
     while (instance->has_deferred_operations()) {
-        auto operation = instance->deferred_operations->front();
-        instance->deferred_operations->pop_front();
+        DeferredOperation operation = instance->deferred_operations->pop();
         operation(LCB_ERR_REQUEST_CANCELED);
     }
 }
 } // namespace lcb
+
+bool lcb_st::has_deferred_operations() const
+{
+    return deferred_operations != nullptr && !deferred_operations->empty();
+}
@@ -19,11 +19,235 @@
 #define LCB_DEFER_H
 
 #ifdef __cplusplus
-#include <functional>
+#include <libcouchbase/couchbase.h>
+
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace lcb
 {
-lcb_STATUS defer_operation(lcb_INSTANCE *instance, std::function<void(lcb_STATUS)> operation);
+/**
+ * A `void(lcb_STATUS)` callable, like std::function, but stored inline when
+ * it is no larger than inline_size. The lambdas deferred by the operations
+ * only capture the instance and the command, so they never allocate.
+ */
+class DeferredOperation
+{
+  public:
+    static constexpr std::size_t inline_size = 4 * sizeof(void *);
+
+    DeferredOperation() = default;
+
+    template <typename Fn, typename = typename std::enable_if<
+                               !std::is_same<typename std::decay<Fn>::type, DeferredOperation>::value>::type>
+    DeferredOperation(Fn &&fn) // NOLINT(google-explicit-constructor)
+    {
+        using F = typename std::decay<Fn>::type;
+        using fits_inline = std::integral_constant<bool, sizeof(F) <= inline_size && alignof(F) <= alignof(Storage) &&
+                                                             std::is_nothrow_move_constructible<F>::value>;
+        store<F>(std::forward<Fn>(fn), fits_inline());
+    }
+
+    DeferredOperation(DeferredOperation &&other) noexcept
+    {
+        take(other);
+    }
+
+    DeferredOperation &operator=(DeferredOperation &&other) noexcept
+    {
+        if (this != &other) {
+            reset();
+            take(other);
+        }
+        return *this;
+    }
+
+    DeferredOperation(const DeferredOperation &) = delete;
+    DeferredOperation &operator=(const DeferredOperation &) = delete;
+
+    ~DeferredOperation()
+    {
+        reset();
+    }
+
+    void operator()(lcb_STATUS status)
+    {
+        ops_->invoke(&storage_, status);
+    }
+
+    explicit operator bool() const
+    {
+        return ops_ != nullptr;
+    }
+
+    /** @return whether the callable is stored inline */
+    bool is_inline() const
+    {
+        return ops_ != nullptr && ops_->relocate != nullptr;
+    }
+
+    void reset()
+    {
+        if (ops_ != nullptr) {
+            ops_->destroy(&storage_);
+            ops_ = nullptr;
+        }
+    }
+
+  private:
+    using Storage = typename std::aligned_storage<inline_size, alignof(std::max_align_t)>::type;
+
+    struct Ops {
+        void (*invoke)(void *storage, lcb_STATUS status);
+        /** Move into other storage and destroy the source, nullptr if the callable is boxed */
+        void (*relocate)(void *dst, void *src);
+        void (*destroy)(void *storage);
+    };
+
+    template <typename F>
+    struct Inline {
+        static void invoke(void *storage, lcb_STATUS status)
+        {
+            (*static_cast<F *>(storage))(status);
+        }
+        static void relocate(void *dst, void *src)
+        {
+            new (dst) F(std::move(*static_cast<F *>(src)));
+            static_cast<F *>(src)->~F();
+        }
+        static void destroy(void *storage)
+        {
+            static_cast<F *>(storage)->~F();
+        }
+        static constexpr Ops ops{invoke, relocate, destroy};
+    };
+
+    template <typename F>
+    struct Boxed {
+        static void invoke(void *storage, lcb_STATUS status)
+        {
+            (**static_cast<F **>(storage))(status);
+        }
+        static void destroy(void *storage)
+        {
+            delete *static_cast<F **>(storage);
+        }
+        static constexpr Ops ops{invoke, nullptr, destroy};
+    };
+
+    template <typename F, typename Fn>
+    void store(Fn &&fn, std::true_type /* fits inline */)
+    {
+        new (&storage_) F(std::forward<Fn>(fn));
+        ops_ = &Inline<F>::ops;
+    }
+
+    template <typename F, typename Fn>
+    void store(Fn &&fn, std::false_type /* fits inline */)
+    {
+        *reinterpret_cast<F **>(&storage_) = new F(std::forward<Fn>(fn));
+        ops_ = &Boxed<F>::ops;
+    }
+
+    void take(DeferredOperation &other) noexcept
+    {
+        ops_ = other.ops_;
+        if (ops_ == nullptr) {
+            return;
+        }
+        if (ops_->relocate != nullptr) {
+            ops_->relocate(&storage_, &other.storage_);
+        } else {
+            std::memcpy(&storage_, &other.storage_, sizeof(void *));
+        }
+        other.ops_ = nullptr;
+    }
+
+    Storage storage_;
+    const Ops *ops_{nullptr};
+};
+
+template <typename F>
+constexpr DeferredOperation::Ops DeferredOperation::Inline<F>::ops;
+
+template <typename F>
+constexpr DeferredOperation::Ops DeferredOperation::Boxed<F>::ops;
+
+/**
+ * Operations scheduled before the instance is bootstrapped, in order. They are
+ * kept in a ring of slots allocated on first use, which only grows (to twice
+ * its size) when a burst of operations fills it, so queueing an operation
+ * usually does not allocate.
+ */
+class DeferredQueue
+{
+  public:
+    static constexpr std::size_t initial_capacity = 64;
+
+    void push(DeferredOperation operation)
+    {
+        if (size_ == slots_.size()) {
+            grow();
+        }
+        slots_[(head_ + size_) % slots_.size()] = std::move(operation);
+        size_++;
+        if (size_ > high_water_) {
+            high_water_ = size_;
+        }
+    }
+
+    /** Remove the oldest operation, the queue must not be empty */
+    DeferredOperation pop()
+    {
+        DeferredOperation operation(std::move(slots_[head_]));
+        head_ = (head_ + 1) % slots_.size();
+        size_--;
+        return operation;
+    }
+
+    bool empty() const
+    {
+        return size_ == 0;
+    }
+
+    std::size_t size() const
+    {
+        return size_;
+    }
+
+    std::size_t capacity() const
+    {
+        return slots_.size();
+    }
+
+    /** @return the most operations queued at once */
+    std::size_t high_water() const
+    {
+        return high_water_;
+    }
+
+  private:
+    void grow()
+    {
+        std::vector<DeferredOperation> slots(slots_.empty() ? initial_capacity : slots_.size() * 2);
+        for (std::size_t ii = 0; ii < size_; ii++) {
+            slots[ii] = std::move(slots_[(head_ + ii) % slots_.size()]);
+        }
+        slots_.swap(slots);
+        head_ = 0;
+    }
+
+    std::vector<DeferredOperation> slots_{};
+    std::size_t head_{0};
+    std::size_t size_{0};
+    std::size_t high_water_{0};
+};
+
+lcb_STATUS defer_operation(lcb_INSTANCE *instance, DeferredOperation operation);
 void execute_deferred_operations(lcb_INSTANCE *instance);
 void cancel_deferred_operations(lcb_INSTANCE *instance);
 } // namespace lcb
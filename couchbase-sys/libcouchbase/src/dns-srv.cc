@@ -3,10 +3,39 @@
 #include "config.h"
 #include "hostlist.h"
 #include "connspec.h"
+#include "rnd.h"
+#include "settings.h"
 
-#ifndef _WIN32
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <mutex>
 #include <string>
 
+/* Answers are cached process-wide, so that instances created in a row (or
+ * on several threads) share one lookup, for the lowest TTL of the records
+ * but no longer than this. */
+#define LCB_SRV_CACHE_MAX_TTL 300
+/* Seconds to wait for each attempt, and number of attempts, of a query */
+#define LCB_SRV_QUERY_TIMEOUT 2
+#define LCB_SRV_QUERY_ATTEMPTS 2
+
+using lcb::SrvRecord;
+
+namespace
+{
+struct SrvCacheEntry {
+    std::vector<SrvRecord> records;
+    hrtime_t expires;
+};
+std::mutex srv_cache_mutex;
+std::map<std::string, SrvCacheEntry> srv_cache;
+} // namespace
+
+static lcb_STATUS srv_lookup(const char *name, std::vector<SrvRecord> &records, lcb_U32 &ttl);
+
+#ifndef _WIN32
+
 #ifdef HAVE_ARPA_NAMESER_H
 #include <arpa/nameser.h>
 #if defined(__NAMESER) && __NAMESER < 19991006
@@ -22,7 +51,7 @@
 
 #define LCB_NSRESSZ 4096
 
-lcb_STATUS lcb::dnssrv_query(const char *name, lcb::Hostlist &hostlist)
+static lcb_STATUS srv_lookup(const char *name, std::vector<SrvRecord> &records, lcb_U32 &ttl)
 {
     ns_msg msg;
 
@@ -30,7 +59,21 @@ lcb_STATUS lcb::dnssrv_query(const char *name, lcb::Hostlist &hostlist)
     lcb_U16 dns_rv;
 
     std::vector<unsigned char> pkt(LCB_NSRESSZ);
+#ifdef HAVE_RES_NSEARCH
+    /* A private resolver state is thread safe, and bounds the time spent on
+     * unresponsive name servers, which res_search() retries for a long time */
+    struct __res_state state;
+    memset(&state, 0, sizeof(state));
+    if (res_ninit(&state) != 0) {
+        return LCB_ERR_NAMESERVER;
+    }
+    state.retrans = LCB_SRV_QUERY_TIMEOUT;
+    state.retry = LCB_SRV_QUERY_ATTEMPTS;
+    nresp = res_nsearch(&state, name, ns_c_in, ns_t_srv, &pkt[0], pkt.size());
+    res_nclose(&state);
+#else
     nresp = res_search(name, ns_c_in, ns_t_srv, &pkt[0], pkt.size());
+#endif
     if (nresp < 0) {
         return LCB_ERR_UNKNOWN_HOST;
     }
@@ -80,11 +123,12 @@ lcb_STATUS lcb::dnssrv_query(const char *name, lcb::Hostlist &hostlist)
         do_get16(srv_port);
 #undef do_get_16
 
-        (void)srv_prio;
-        (void)srv_weight; /* Handle these in the future */
         std::vector<char> dname(NS_MAXDNAME + 1);
-        ns_name_uncompress(ns_msg_base(msg), ns_msg_end(msg), rdata, &dname[0], NS_MAXDNAME);
-        hostlist.add(&dname[0], srv_port);
+        if (ns_name_uncompress(ns_msg_base(msg), ns_msg_end(msg), rdata, &dname[0], NS_MAXDNAME) < 0) {
+            continue;
+        }
+        records.push_back(SrvRecord{&dname[0], srv_port, srv_prio, srv_weight});
+        ttl = std::min(ttl, (lcb_U32)ns_rr_ttl(rr));
     }
     return LCB_SUCCESS;
 }
@@ -94,7 +138,7 @@ lcb_STATUS lcb::dnssrv_query(const char *name, lcb::Hostlist &hostlist)
 #include <windns.h>
 #define CAN_SRV_LOOKUP
 /* Implement via DnsQuery() */
-lcb_STATUS lcb::dnssrv_query(const char *addr, Hostlist &hs)
+static lcb_STATUS srv_lookup(const char *addr, std::vector<SrvRecord> &records, lcb_U32 &ttl)
 {
     DNS_STATUS status;
     PDNS_RECORDA root, cur;
@@ -108,7 +152,8 @@ lcb_STATUS lcb::dnssrv_query(const char *addr, Hostlist &hs)
         if(cur->wType == DNS_TYPE_SRV) {
             // Use the ASCII version of the DNS lookup structure
             const DNS_SRV_DATAA *srv = &cur->Data.SRV;
-            hs.add(srv->pNameTarget, srv->wPort);
+            records.push_back(SrvRecord{srv->pNameTarget, srv->wPort, srv->wPriority, srv->wWeight});
+            ttl = std::min(ttl, (lcb_U32)cur->dwTtl);
         }
     }
     DnsRecordListFree(root, DnsFreeRecordList);
@@ -118,23 +163,93 @@ lcb_STATUS lcb::dnssrv_query(const char *addr, Hostlist &hs)
 #endif /* !WIN32 */
 
 #ifndef CAN_SRV_LOOKUP
-lcb_STATUS lcb::dnssrv_query(const char *, Hostlist &)
+static lcb_STATUS srv_lookup(const char *, std::vector<SrvRecord> &, lcb_U32 &)
 {
     return LCB_ERR_SDK_FEATURE_UNAVAILABLE;
 }
 #endif
 
+void lcb::dnssrv_order(std::vector<SrvRecord> &records)
+{
+    std::stable_sort(records.begin(), records.end(),
+                     [](const SrvRecord &a, const SrvRecord &b) { return a.priority < b.priority; });
+
+    /* RFC 2782: within a priority, pick each next record with a probability
+     * proportional to its weight, records of weight 0 having a small chance */
+    for (auto group = records.begin(); group != records.end();) {
+        auto group_end = std::find_if(group, records.end(),
+                                      [group](const SrvRecord &rec) { return rec.priority != group->priority; });
+        for (auto cur = group; cur != group_end; ++cur) {
+            lcb_U32 total = 0;
+            for (auto it = cur; it != group_end; ++it) {
+                total += it->weight + 1u;
+            }
+            lcb_U32 pick = lcb_next_rand32() % total;
+            auto chosen = cur;
+            for (; chosen + 1 != group_end; ++chosen) {
+                if (pick < chosen->weight + 1u) {
+                    break;
+                }
+                pick -= chosen->weight + 1u;
+            }
+            std::iter_swap(cur, chosen);
+        }
+        group = group_end;
+    }
+}
+
+lcb_STATUS lcb::dnssrv_query(const char *name, Hostlist &hostlist, bool use_cache)
+{
+    std::vector<SrvRecord> records;
+    hrtime_t now = gethrtime();
+    bool cached = false;
+
+    if (use_cache) {
+        std::lock_guard<std::mutex> guard(srv_cache_mutex);
+        auto it = srv_cache.find(name);
+        if (it != srv_cache.end() && it->second.expires > now) {
+            records = it->second.records;
+            cached = true;
+        }
+    }
+
+    if (!cached) {
+        lcb_U32 ttl = LCB_SRV_CACHE_MAX_TTL;
+        lcb_STATUS rc = srv_lookup(name, records, ttl);
+        std::lock_guard<std::mutex> guard(srv_cache_mutex);
+        if (rc != LCB_SUCCESS || records.empty()) {
+            srv_cache.erase(name);
+            return rc;
+        }
+        if (ttl > 0) {
+            srv_cache[name] = SrvCacheEntry{records, now + LCB_S2NS(ttl)};
+        } else {
+            srv_cache.erase(name);
+        }
+    }
+
+    dnssrv_order(records);
+    for (const auto &rec : records) {
+        hostlist.add(rec.target.c_str(), rec.port);
+    }
+    return LCB_SUCCESS;
+}
+
 #define SVCNAME_PLAIN "_couchbase._tcp."
 #define SVCNAME_SSL "_couchbases._tcp."
 
+std::string lcb::dnssrv_name(const char *addr, bool is_ssl)
+{
+    std::string ss(is_ssl ? SVCNAME_SSL : SVCNAME_PLAIN);
+    ss.append(addr);
+    return ss;
+}
+
 lcb::Hostlist *lcb::dnssrv_getbslist(const char *addr, bool is_ssl, lcb_STATUS &errp)
 {
-    std::string ss;
     auto *ret = new Hostlist();
-    ss.append(is_ssl ? SVCNAME_SSL : SVCNAME_PLAIN);
-    ss.append(addr);
 
-    errp = dnssrv_query(ss.c_str(), *ret);
+    errp = dnssrv_query(dnssrv_name(addr, is_ssl).c_str(), *ret);
     if (errp != LCB_SUCCESS) {
         delete ret;
         return nullptr;
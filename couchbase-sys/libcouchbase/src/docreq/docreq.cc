@@ -26,6 +26,8 @@ static void invoke_pending(Queue *);
 
 #define DOCQ_DELAY_US 200000
 
+#define LOGARGS(q, lvl) (q)->instance->settings, "docreq", LCB_LOG_##lvl, __FILE__, __LINE__
+
 Queue::Queue(lcb_INSTANCE *instance_)
     : instance(instance_), timer(lcbio_timer_new(instance->iotable, this, docreq_handler))
 {
@@ -53,15 +55,19 @@ void Queue::cancel()
 }
 
 /* Calling this function ensures that the request will be scheduled in due
- * time. This may be done at the next event loop iteration, or after a delay
- * depending on how many items are actually found within the queue. */
+ * time. As long as the window of pending responses is not full, this is done
+ * at the next event loop iteration, so that all the requests added by the
+ * rows of a chunk (or released by the responses of an iteration) are sent as
+ * a single batch. Otherwise the responses poke the queue as they arrive, and
+ * the delay only serves as a fallback. */
 static void docq_poke(Queue *q)
 {
-    if (q->n_awaiting_response < q->max_pending_response) {
+    if (q->n_awaiting_schedule && q->n_awaiting_response < q->limit()) {
+        lcbio_async_signal(q->timer);
         if (q->n_awaiting_schedule > q->min_batch_size) {
-            lcbio_async_signal(q->timer);
             q->cb_throttle(q, 0);
         }
+        return;
     }
 
     if (!lcbio_timer_armed(q->timer)) {
@@ -84,13 +90,14 @@ static void docreq_handler(void *arg)
     auto *q = reinterpret_cast<Queue *>(arg);
     sllist_iterator iter;
     lcb_INSTANCE *instance = q->instance;
+    hrtime_t now = gethrtime();
 
     lcb_sched_enter(instance);
     SLLIST_ITERFOR(&q->pending_gets, &iter)
     {
         DocRequest *cont = SLLIST_ITEM(iter.cur, DocRequest, slnode);
 
-        if (q->n_awaiting_response > q->max_pending_response) {
+        if (q->n_awaiting_response >= q->limit()) {
             lcbio_timer_rearm(q->timer, DOCQ_DELAY_US);
             q->cb_throttle(q, 1);
             break;
@@ -104,6 +111,7 @@ static void docreq_handler(void *arg)
 
         } else {
             lcb_STATUS rc;
+            cont->start = now;
             rc = q->cb_schedule(q, cont);
             if (rc != LCB_SUCCESS) {
                 cont->docresp.ctx.rc = rc;
@@ -169,3 +177,57 @@ void Queue::check()
     lcb_assert(refcount > 0);
     docq_poke(this);
 }
+
+void Queue::complete(DocRequest *dreq, lcb_STATUS rc)
+{
+    n_awaiting_response--;
+    dreq->ready = 1;
+    adapt(rc, dreq->start, gethrtime());
+}
+
+void Queue::adapt(lcb_STATUS rc, hrtime_t start, hrtime_t now)
+{
+    hrtime_t rtt = now - start;
+    bool congested;
+
+    switch (rc) {
+        case LCB_ERR_TEMPORARY_FAILURE:
+        case LCB_ERR_RATE_LIMITED:
+        case LCB_ERR_TIMEOUT:
+            congested = true;
+            break;
+        default:
+            if (min_rtt == 0 || rtt < min_rtt) {
+                min_rtt = rtt;
+            }
+            /* Requests are queued behind each other on the server; ignore
+             * small absolute increases on fast networks */
+            congested = rtt > 4 * min_rtt + LCB_MS2NS(1);
+            break;
+    }
+
+    if (congested) {
+        /* Responses to requests sent before the last backoff do not reflect
+         * the current window */
+        if (start < last_backoff) {
+            return;
+        }
+        window = std::max(window / 2, static_cast<unsigned>(min_window));
+        ssthresh = window;
+        n_acked = 0;
+        last_backoff = now;
+        lcb_log(LOGARGS(this, DEBUG), "(DQ=%p) Backing off to %u pending documents (status=%s, rtt=%uus)",
+                static_cast<void *>(this), window, lcb_strerror_short(rc), static_cast<unsigned>(rtt / 1000));
+        return;
+    }
+
+    if (rc != LCB_SUCCESS || window >= max_pending_response) {
+        return;
+    }
+    if (window < ssthresh) {
+        window++;
+    } else if (++n_acked >= window) {
+        window++;
+        n_acked = 0;
+    }
+}
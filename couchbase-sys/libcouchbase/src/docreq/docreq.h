@@ -29,6 +29,9 @@
 
 #include "capi/cmd_get.hh"
 
+#include <algorithm>
+#include <climits>
+
 namespace lcb
 {
 namespace docreq
@@ -48,6 +51,28 @@ struct Queue {
     }
     void cancel();
     void check();
+
+    /**
+     * Record the response to a request scheduled by the queue. To be called
+     * by the response callback before check().
+     * @param dreq the request
+     * @param rc the status of the response
+     */
+    void complete(DocRequest *dreq, lcb_STATUS rc);
+
+    /**
+     * Adapt the window to a response.
+     * @param rc the status of the response
+     * @param start when its request was scheduled
+     * @param now when it arrived
+     */
+    void adapt(lcb_STATUS rc, hrtime_t start, hrtime_t now);
+
+    /** @return how many responses may be awaited at this time */
+    unsigned limit() const
+    {
+        return std::min(window, max_pending_response);
+    }
     bool has_pending() const
     {
         return n_awaiting_response || n_awaiting_schedule;
@@ -85,9 +110,23 @@ struct Queue {
     unsigned n_awaiting_schedule{0};
     unsigned n_awaiting_response{0};
 
-    static const int default_max_pending_docreq{10};
+    static const int default_max_pending_docreq{256};
     unsigned max_pending_response{default_max_pending_docreq};
 
+    /* The window of awaited responses adapts in the manner of TCP congestion
+     * control. It grows by one per response until ssthresh (slow start), then
+     * by one per window of responses. It is halved when the cluster pushes
+     * back, either with temporary failures or with response times far above
+     * the fastest one seen, at most once per round trip.
+     * max_pending_response is the hard limit. */
+    static const int default_initial_window{8};
+    static const int min_window{2};
+    unsigned window{default_initial_window};
+    unsigned ssthresh{UINT_MAX};
+    unsigned n_acked{0};
+    hrtime_t min_rtt{0};
+    hrtime_t last_backoff{0};
+
     static const int default_min_sched_size{5};
     unsigned min_batch_size{default_min_sched_size};
     unsigned cancelled{false};
@@ -103,6 +142,8 @@ struct DocRequest {
     /* To be filled in by the subclass */
     lcb_IOV docid;
     unsigned ready;
+    /* When the request was scheduled */
+    hrtime_t start;
 };
 
 } // namespace docreq
@@ -63,7 +63,7 @@ void lcb_dump(lcb_INSTANCE *instance, FILE *fp, lcb_U32 flags)
     }
 
     fprintf(fp, "=== BEGIN PIPELINE DUMP ===\n");
-    for (ii = 0; ii < instance->cmdq.npipelines; ii++) {
+    for (ii = 0; ii < MCREQ_NPIPELINES_ALL(&instance->cmdq); ii++) {
         auto *server = static_cast<lcb::Server *>(instance->cmdq.pipelines[ii]);
         fprintf(fp, "** [%u] SERVER %s:%s\n", ii, server->curhost->host, server->curhost->port);
         if (server->connctx) {
@@ -99,4 +99,10 @@ void lcb_dump(lcb_INSTANCE *instance, FILE *fp, lcb_U32 flags)
     fprintf(fp, "=== BEGIN CONFMON DUMP ===\n");
     instance->confmon->dump(fp);
     fprintf(fp, "=== END CONFMON DUMP ===\n");
+
+    if (flags & LCB_DUMP_FLIGHTREC) {
+        lcb_flight_recorder_dump(instance, fp);
+    } else {
+        fprintf(fp, "=== NOT DUMPING FLIGHT RECORDER. LCB_DUMP_FLIGHTREC not passed\n");
+    }
 }
@@ -121,6 +121,7 @@ ErrorMap::ParseStatus ErrorMap::parse(const char *s, size_t n, std::string &errm
     }
 
     if (revJson.asUInt() <= revision) {
+        outdated = false;
         return NOT_UPDATED;
     }
 
@@ -156,7 +157,7 @@ ErrorMap::ParseStatus ErrorMap::parse(const char *s, size_t n, std::string &errm
         for (const auto &jj : attrs) {
             ErrorAttribute attr = getAttribute(jj.asString());
             if (attr != INVALID_ATTRIBUTE) {
-                error.attributes.insert(attr);
+                error.addAttribute(attr);
             }
         }
         if (error.hasAttribute(AUTO_RETRY)) {
@@ -169,22 +170,55 @@ ErrorMap::ParseStatus ErrorMap::parse(const char *s, size_t n, std::string &errm
                 return PARSE_ERROR;
             }
         }
-        errors.insert(MapType::value_type(ec, error));
+        add(error);
     }
 
+    version = verJson.asUInt();
+    revision = revJson.asUInt();
+    outdated = false;
     return UPDATED;
 }
 
+void ErrorMap::add(const Error &error)
+{
+    const Error &inserted = errors.insert(MapType::value_type(error.code, error)).first->second;
+    std::unique_ptr<const Error *[]> &page = pages[inserted.code / PAGE_SIZE];
+    if (!page) {
+        page.reset(new const Error *[PAGE_SIZE]());
+    }
+    page[inserted.code % PAGE_SIZE] = &inserted;
+}
+
+void ErrorMap::assign(const ErrorMap &other)
+{
+    errors.clear();
+    for (auto &page : pages) {
+        page.reset();
+    }
+    for (const auto &entry : other.errors) {
+        Error error;
+        error.code = entry.second.code;
+        error.shortname = entry.second.shortname;
+        error.description = entry.second.description;
+        error.attributes = entry.second.attributes;
+        if (entry.second.retry.specptr != nullptr) {
+            /* the reference counts are not atomic, and the instances may live in different threads */
+            error.retry.specptr = entry.second.retry.specptr->clone();
+        }
+        add(error);
+    }
+    version = other.version;
+    revision = other.revision;
+}
+
 const Error &ErrorMap::getError(uint16_t code) const
 {
     static const Error invalid;
-    auto it = errors.find(code);
-
-    if (it != errors.end()) {
-        return it->second;
-    } else {
-        return invalid;
+    const std::unique_ptr<const Error *[]> &page = pages[code / PAGE_SIZE];
+    if (page && page[code % PAGE_SIZE] != nullptr) {
+        return *page[code % PAGE_SIZE];
     }
+    return invalid;
 }
 
 ErrorMap *lcb_errmap_new()
@@ -292,6 +326,7 @@ LIBCOUCHBASE_API lcb_STATUS lcb_errctx_kv_key(const lcb_KEY_VALUE_ERROR_CONTEXT
 LIBCOUCHBASE_API lcb_STATUS lcb_errctx_kv_bucket(const lcb_KEY_VALUE_ERROR_CONTEXT *ctx, const char **bucket,
                                                  size_t *bucket_len)
 {
+    ctx->materialize();
     *bucket = ctx->bucket.c_str();
     *bucket_len = ctx->bucket.size();
     return LCB_SUCCESS;
@@ -300,6 +335,7 @@ LIBCOUCHBASE_API lcb_STATUS lcb_errctx_kv_bucket(const lcb_KEY_VALUE_ERROR_CONTE
 LIBCOUCHBASE_API lcb_STATUS lcb_errctx_kv_collection(const lcb_KEY_VALUE_ERROR_CONTEXT *ctx, const char **collection,
                                                      size_t *collection_len)
 {
+    ctx->materialize();
     *collection = ctx->collection.c_str();
     *collection_len = ctx->collection.size();
     return LCB_SUCCESS;
@@ -308,6 +344,7 @@ LIBCOUCHBASE_API lcb_STATUS lcb_errctx_kv_collection(const lcb_KEY_VALUE_ERROR_C
 LIBCOUCHBASE_API lcb_STATUS lcb_errctx_kv_scope(const lcb_KEY_VALUE_ERROR_CONTEXT *ctx, const char **scope,
                                                 size_t *scope_len)
 {
+    ctx->materialize();
     *scope = ctx->scope.c_str();
     *scope_len = ctx->scope.size();
     return LCB_SUCCESS;
@@ -331,6 +368,7 @@ LIBCOUCHBASE_API lcb_STATUS lcb_errctx_kv_ref(const lcb_KEY_VALUE_ERROR_CONTEXT
 LIBCOUCHBASE_API lcb_STATUS lcb_errctx_kv_endpoint(const lcb_KEY_VALUE_ERROR_CONTEXT *ctx, const char **endpoint,
                                                    size_t *endpoint_len)
 {
+    ctx->materialize();
     *endpoint = ctx->endpoint.c_str();
     *endpoint_len = ctx->endpoint.size();
     return LCB_SUCCESS;
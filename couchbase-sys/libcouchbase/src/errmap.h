@@ -20,9 +20,10 @@
 
 #ifdef __cplusplus
 #include <map>
-#include <set>
+#include <memory>
 #include <string>
 #include <cmath>
+#include <cstdint>
 
 namespace Json
 {
@@ -137,6 +138,8 @@ enum ErrorAttribute {
         INVALID_ATTRIBUTE
 };
 
+static_assert(INVALID_ATTRIBUTE <= 32, "error attributes must fit in the attribute bitset");
+
 class RetrySpec
 {
   public:
@@ -175,6 +178,14 @@ class RetrySpec
         refcount++;
     }
 
+    /** @return a copy which is not shared, e.g. with the error map of another instance */
+    RetrySpec *clone() const
+    {
+        auto *spec = new RetrySpec(*this);
+        spec->refcount = 1;
+        return spec;
+    }
+
     void unref()
     {
         if (!--refcount) {
@@ -225,10 +236,11 @@ struct Error {
     uint16_t code;
     std::string shortname;
     std::string description;
-    std::set<ErrorAttribute> attributes;
+    /** Bitset of the ErrorAttribute values */
+    uint32_t attributes;
     SpecWrapper retry;
 
-    Error() : code(-1) {}
+    Error() : code(-1), attributes(0) {}
 
     bool isValid() const
     {
@@ -237,7 +249,12 @@ struct Error {
 
     bool hasAttribute(ErrorAttribute attr) const
     {
-        return attributes.find(attr) != attributes.end();
+        return (attributes & (1U << attr)) != 0;
+    }
+
+    void addAttribute(ErrorAttribute attr)
+    {
+        attributes |= 1U << attr;
     }
 
     RetrySpec *getRetrySpec() const;
@@ -281,13 +298,39 @@ class ErrorMap
         return !errors.empty();
     }
 
+    /** Replace the errors with those of another map, without sharing anything with it */
+    void assign(const ErrorMap &other);
+
+    /**
+     * Whether the map should be fetched again by the next connection. The map is only fetched once per instance,
+     * unless a server sends a status the map does not know, which hints at a newer map.
+     */
+    bool isOutdated() const
+    {
+        return outdated;
+    }
+    void markOutdated()
+    {
+        outdated = true;
+    }
+
   private:
     static const uint32_t MAX_VERSION;
     ErrorMap(const ErrorMap &);
+    void add(const Error &error);
     typedef std::map<uint16_t, Error> MapType;
     MapType errors;
+
+    /**
+     * Two-level index of the errors by code (upper and lower byte), so that
+     * looking up the status of every failed response does not walk the map.
+     * Pages are only allocated for the ranges the server defines.
+     */
+    static const size_t PAGE_SIZE = 256;
+    std::unique_ptr<const Error *[]> pages[PAGE_SIZE];
     uint32_t revision{0};
     uint32_t version{0};
+    bool outdated{false};
 };
 
 } // namespace errmap
@@ -0,0 +1,284 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2024 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "internal.h"
+#include "flightrec.h"
+
+#include <cerrno>
+#include <cstring>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+using lcb::FlightRecorder;
+
+std::size_t FlightRecorder::snapshot(Event *out, std::size_t nout) const
+{
+    std::uint64_t head = recorded();
+    std::uint64_t seq = head > capacity_ ? head - capacity_ : 0;
+    if (head - seq > nout) {
+        seq = head - nout;
+    }
+    std::size_t nread = 0;
+    for (; seq < head; seq++) {
+        out[nread] = events_[seq % capacity_];
+        if (!overwritten(seq)) {
+            nread++;
+        }
+    }
+    return nread;
+}
+
+void FlightRecorder::dump(emit_fn emit, void *arg) const
+{
+    hrtime_t now = gethrtime();
+    std::uint64_t head = recorded();
+    std::uint64_t seq = head > capacity_ ? head - capacity_ : 0;
+    char line[160];
+    for (; seq < head; seq++) {
+        Event event = events_[seq % capacity_];
+        if (overwritten(seq)) {
+            continue;
+        }
+        emit(arg, line, format(event, now, line, sizeof(line)));
+    }
+}
+
+const char *FlightRecorder::type_name(std::uint8_t type)
+{
+    switch (type) {
+        case LCB_FLIGHT_PKT_ENQUEUE:
+            return "enqueue";
+        case LCB_FLIGHT_PKT_WRITTEN:
+            return "written";
+        case LCB_FLIGHT_PKT_COMPLETE:
+            return "complete";
+        case LCB_FLIGHT_PKT_FAIL:
+            return "fail";
+        case LCB_FLIGHT_PKT_RETRY:
+            return "retry";
+        case LCB_FLIGHT_CONFIG:
+            return "config";
+        case LCB_FLIGHT_SOCK_CONNECT:
+            return "connect";
+        case LCB_FLIGHT_SOCK_READY:
+            return "ready";
+        case LCB_FLIGHT_SOCK_ERROR:
+            return "sock_error";
+        case LCB_FLIGHT_SOCK_CLOSE:
+            return "close";
+        default:
+            return "unknown";
+    }
+}
+
+namespace
+{
+/** Appends to a fixed buffer without allocating or calling into stdio, so that dumps are async-signal-safe */
+class LineWriter
+{
+  public:
+    LineWriter(char *buf, std::size_t nbuf) : buf_(buf), nbuf_(nbuf) {}
+
+    LineWriter &str(const char *s)
+    {
+        for (; *s != '\0'; s++) {
+            chr(*s);
+        }
+        return *this;
+    }
+
+    LineWriter &num(std::uint64_t value, std::size_t width = 1)
+    {
+        char digits[20];
+        std::size_t ndigits = 0;
+        do {
+            digits[ndigits++] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (value != 0);
+        for (; width > ndigits; width--) {
+            chr('0');
+        }
+        while (ndigits != 0) {
+            chr(digits[--ndigits]);
+        }
+        return *this;
+    }
+
+    LineWriter &hex(std::uint8_t value)
+    {
+        static const char alphabet[] = "0123456789abcdef";
+        chr(alphabet[value >> 4]);
+        chr(alphabet[value & 0xf]);
+        return *this;
+    }
+
+    LineWriter &chr(char c)
+    {
+        if (len_ < nbuf_) {
+            buf_[len_++] = c;
+        }
+        return *this;
+    }
+
+    std::size_t finish()
+    {
+        if (len_ == nbuf_ && nbuf_ != 0) {
+            len_--;
+        }
+        return chr('\n').len_;
+    }
+
+  private:
+    char *buf_;
+    std::size_t nbuf_;
+    std::size_t len_{0};
+};
+} // namespace
+
+std::size_t FlightRecorder::format(const Event &event, hrtime_t now, char *buf, std::size_t nbuf)
+{
+    LineWriter line(buf, nbuf);
+    /* how long before the dump the event happened, in seconds */
+    hrtime_t age = now > event.time ? LCB_NS2US(now - event.time) : 0;
+    line.chr('-').num(age / 1000000).chr('.').num(age % 1000000, 6).str("s ").str(type_name(event.type));
+    if (event.server >= 0) {
+        line.str(" srv=").num(static_cast<std::uint64_t>(event.server));
+    }
+    switch (event.type) {
+        case LCB_FLIGHT_PKT_ENQUEUE:
+        case LCB_FLIGHT_PKT_WRITTEN:
+        case LCB_FLIGHT_PKT_COMPLETE:
+        case LCB_FLIGHT_PKT_FAIL:
+        case LCB_FLIGHT_PKT_RETRY:
+            line.str(" op=0x").hex(event.opcode).str(" vb=").num(event.vbucket).str(" opaque=").num(event.opaque);
+            break;
+        default:
+            break;
+    }
+    switch (event.type) {
+        case LCB_FLIGHT_PKT_ENQUEUE:
+        case LCB_FLIGHT_PKT_WRITTEN:
+            line.str(" size=").num(event.value);
+            break;
+        case LCB_FLIGHT_PKT_COMPLETE:
+            line.str(" status=0x").hex(event.value >> 8).hex(event.value & 0xff);
+            break;
+        case LCB_FLIGHT_CONFIG:
+            line.str(" rev=").num(event.value);
+            break;
+        case LCB_FLIGHT_PKT_FAIL:
+        case LCB_FLIGHT_PKT_RETRY:
+        case LCB_FLIGHT_SOCK_ERROR:
+            line.str(" err=").str(lcb_strerror_short(static_cast<lcb_STATUS>(event.value)));
+            break;
+        default:
+            break;
+    }
+    return line.finish();
+}
+
+void lcb_flight_record(lcb_INSTANCE *instance, lcb_FLIGHTEVENT type, const mc_PIPELINE *pipeline,
+                       const mc_PACKET *packet, uint32_t value)
+{
+    if (instance == nullptr || instance->destroying) {
+        return;
+    }
+    std::uint32_t capacity = LCBT_SETTING(instance, flight_recorder_size);
+    lcb_FLIGHTREC *recorder = instance->flightrec;
+    if (recorder == nullptr || recorder->capacity() != capacity) {
+        /* allocated on first use, and again once resized */
+        delete recorder;
+        instance->flightrec = recorder = capacity ? new lcb_FLIGHTREC(capacity) : nullptr;
+        if (recorder == nullptr) {
+            return;
+        }
+    }
+
+    FlightRecorder::Event event{};
+    event.time = gethrtime();
+    event.type = static_cast<std::uint8_t>(type);
+    event.server = pipeline ? static_cast<std::int16_t>(pipeline->index) : -1;
+    event.value = value;
+    if (packet) {
+        protocol_binary_request_header hdr;
+        mcreq_read_hdr(packet, &hdr);
+        event.opcode = hdr.request.opcode;
+        event.vbucket = ntohs(hdr.request.vbucket);
+        event.opaque = packet->opaque;
+    }
+    recorder->record(event);
+}
+
+void lcb_flight_recorder_destroy(lcb_FLIGHTREC *recorder)
+{
+    delete recorder;
+}
+
+static void emit_file(void *arg, const char *line, std::size_t nline)
+{
+    fwrite(line, 1, nline, static_cast<FILE *>(arg));
+}
+
+void lcb_flight_recorder_dump(lcb_INSTANCE *instance, FILE *fp)
+{
+    const lcb_FLIGHTREC *recorder = instance->flightrec;
+    if (recorder == nullptr) {
+        fprintf(fp, "=== FLIGHT RECORDER DISABLED OR EMPTY\n");
+        return;
+    }
+    fprintf(fp, "=== BEGIN FLIGHT RECORDER DUMP (%" PRIu64 " events recorded, last %u kept) ===\n",
+            recorder->recorded(), static_cast<unsigned>(recorder->capacity()));
+    recorder->dump(emit_file, fp);
+    fprintf(fp, "=== END FLIGHT RECORDER DUMP ===\n");
+}
+
+static void emit_fd(void *arg, const char *line, std::size_t nline)
+{
+    int fd = *static_cast<int *>(arg);
+    while (nline != 0) {
+#ifdef _WIN32
+        int nw = _write(fd, line, static_cast<unsigned>(nline));
+#else
+        ssize_t nw = write(fd, line, nline);
+#endif
+        if (nw < 0 && errno == EINTR) {
+            continue;
+        }
+        if (nw <= 0) {
+            return;
+        }
+        line += nw;
+        nline -= static_cast<std::size_t>(nw);
+    }
+}
+
+LIBCOUCHBASE_API
+void lcb_dump_flight_recorder(lcb_INSTANCE *instance, int fd)
+{
+    if (instance == nullptr || instance->flightrec == nullptr) {
+        return;
+    }
+    static const char header[] = "=== BEGIN FLIGHT RECORDER DUMP ===\n";
+    static const char footer[] = "=== END FLIGHT RECORDER DUMP ===\n";
+    emit_fd(&fd, header, sizeof(header) - 1);
+    instance->flightrec->dump(emit_fd, &fd);
+    emit_fd(&fd, footer, sizeof(footer) - 1);
+}
@@ -0,0 +1,121 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2024 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCB_FLIGHTREC_H
+#define LCB_FLIGHTREC_H
+
+#include "config.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+/**
+ * @file
+ * @brief Flight recorder of the KV pipeline, see LCB_CNTL_FLIGHT_RECORDER_SIZE
+ */
+
+namespace lcb
+{
+
+/**
+ * Ring of the latest events of an instance, kept for the post-mortem of
+ * latency incidents. Events are written by the thread running the event loop
+ * only, and may be read concurrently from another thread or from a signal
+ * handler: reading neither locks nor allocates, and drops the events which
+ * were overwritten while they were being copied.
+ */
+class FlightRecorder
+{
+  public:
+    /** Fixed-size record of an event, see lcb_FLIGHTEVENT for the types */
+    struct Event {
+        hrtime_t time;
+        std::uint32_t opaque;
+        /** Size of the packet, status of the response, error code or config revision */
+        std::uint32_t value;
+        std::uint16_t vbucket;
+        /** Index of the server, or -1 */
+        std::int16_t server;
+        std::uint8_t type;
+        std::uint8_t opcode;
+    };
+
+    /** Receives a formatted line of a dump, see dump() */
+    typedef void (*emit_fn)(void *arg, const char *line, std::size_t nline);
+
+    explicit FlightRecorder(std::size_t capacity) : capacity_(capacity), events_(new Event[capacity]) {}
+
+    std::size_t capacity() const
+    {
+        return capacity_;
+    }
+
+    /** @return the number of events recorded so far, including overwritten ones */
+    std::uint64_t recorded() const
+    {
+        return head_.load(std::memory_order_acquire);
+    }
+
+    void record(const Event &event)
+    {
+        std::uint64_t seq = head_.load(std::memory_order_relaxed);
+        events_[seq % capacity_] = event;
+        head_.store(seq + 1, std::memory_order_release);
+    }
+
+    /**
+     * Copy the retained events, oldest first
+     * @return the number of events written to @p out, at most @p nout
+     */
+    std::size_t snapshot(Event *out, std::size_t nout) const;
+
+    /**
+     * Format the retained events, oldest first, one line each. Safe to call
+     * from a signal handler as long as @p emit is.
+     */
+    void dump(emit_fn emit, void *arg) const;
+
+    /**
+     * Format one event, terminated by a newline
+     * @return the length of the line, which is truncated to @p nbuf
+     */
+    static std::size_t format(const Event &event, hrtime_t now, char *buf, std::size_t nbuf);
+
+    static const char *type_name(std::uint8_t type);
+
+  private:
+    /** @return whether the slot of @p seq may have been overwritten since it was copied */
+    bool overwritten(std::uint64_t seq) const
+    {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return head_.load(std::memory_order_relaxed) - seq >= capacity_;
+    }
+
+    const std::size_t capacity_;
+    std::unique_ptr<Event[]> events_;
+    std::atomic<std::uint64_t> head_{0};
+};
+
+} // namespace lcb
+
+struct lcb_FLIGHTREC_st : lcb::FlightRecorder {
+    using FlightRecorder::FlightRecorder;
+};
+
+#endif /* LCB_FLIGHTREC_H */
@@ -15,6 +15,8 @@
  *   limitations under the License.
  */
 
+#include <initializer_list>
+
 #include "internal.h"
 #include "packetutils.h"
 #include "mc/mcreq.h"
@@ -164,6 +166,11 @@ lcb_STATUS lcb_map_error(lcb_INSTANCE *instance, int in)
             return LCB_ERR_RATE_LIMITED;
         case PROTOCOL_BINARY_SCOPE_SIZE_LIMIT_EXCEEDED:
             return LCB_ERR_QUOTA_LIMITED;
+        case PROTOCOL_BINARY_RESPONSE_RANGE_SCAN_MORE:
+        case PROTOCOL_BINARY_RESPONSE_RANGE_SCAN_COMPLETE:
+            return LCB_SUCCESS; /* the scan continues or is done, see the status itself */
+        case PROTOCOL_BINARY_RESPONSE_RANGE_SCAN_CANCELLED:
+            return LCB_ERR_REQUEST_CANCELED;
         default:
             if (instance != nullptr) {
                 return instance->callbacks.errmap(instance, in);
@@ -265,9 +272,8 @@ void init_resp(lcb_INSTANCE *instance, mc_PIPELINE *pipeline, const MemcachedRes
     resp->ctx.status_code = mc_resp->status();
     resp->ctx.cas = mc_resp->cas();
     resp->ctx.opaque = mc_resp->opaque();
-    if (instance) {
-        resp->ctx.bucket.assign(LCBT_VBCONFIG(instance)->bname, LCBT_VBCONFIG(instance)->bname_len);
-    }
+    resp->ctx.deferred.instance = instance;
+    resp->ctx.deferred.server = static_cast<const lcb::Server *>(pipeline);
     resp->cookie = const_cast<void *>(MCREQ_PKT_COOKIE(req));
     const char *key = nullptr;
     size_t key_len = 0;
@@ -275,21 +281,36 @@ void init_resp(lcb_INSTANCE *instance, mc_PIPELINE *pipeline, const MemcachedRes
     if (key != nullptr) {
         resp->ctx.key.assign(key, key_len);
     }
+}
 
-    const auto *server = static_cast<lcb::Server *>(pipeline);
-    const lcb_host_t *remote = server->curhost;
+void lcb_KEY_VALUE_ERROR_CONTEXT_::materialize() const
+{
+    if (deferred.instance != nullptr) {
+        bucket.assign(LCBT_VBCONFIG(deferred.instance)->bname, LCBT_VBCONFIG(deferred.instance)->bname_len);
+        if (deferred.has_collection_id) {
+            std::string collection_path = deferred.instance->collcache->id_to_name(deferred.collection_id);
+            size_t dot = collection_path.find('.');
+            if (dot != std::string::npos) {
+                scope = collection_path.substr(0, dot);
+                collection = collection_path.substr(dot + 1);
+            }
+        }
+    }
+    const lcb_host_t *remote = deferred.server != nullptr ? deferred.server->curhost : nullptr;
     if (remote) {
-        resp->ctx.endpoint.reserve(sizeof(remote->host) + sizeof(remote->port) + 3);
+        endpoint.clear();
+        endpoint.reserve(sizeof(remote->host) + sizeof(remote->port) + 3);
         if (remote->ipv6) {
-            resp->ctx.endpoint.append("[");
+            endpoint.append("[");
         }
-        resp->ctx.endpoint.append(remote->host);
+        endpoint.append(remote->host);
         if (remote->ipv6) {
-            resp->ctx.endpoint.append("]");
+            endpoint.append("]");
         }
-        resp->ctx.endpoint.append(":");
-        resp->ctx.endpoint.append(remote->port);
+        endpoint.append(":");
+        endpoint.append(remote->port);
     }
+    deferred = deferred_fields{};
 }
 
 /**
@@ -342,20 +363,16 @@ template <typename T>
 void invoke_callback(const mc_PACKET *pkt, lcb_INSTANCE *instance, T *resp, lcb_CALLBACK_TYPE cbtype)
 {
     if (instance != nullptr) {
-        std::string collection_path = instance->collcache->id_to_name(mcreq_get_cid(instance, pkt, NULL));
-        if (!collection_path.empty()) {
-            size_t dot = collection_path.find('.');
-            if (dot != std::string::npos) {
-                resp->ctx.scope = collection_path.substr(0, dot);
-                resp->ctx.collection = collection_path.substr(dot + 1);
-            }
-        }
+        /* the names are looked up by materialize(), if the application asks for them */
+        resp->ctx.deferred.instance = instance;
+        resp->ctx.deferred.collection_id = mcreq_get_cid(instance, pkt, nullptr);
+        resp->ctx.deferred.has_collection_id = true;
     }
     if (!(pkt->flags & MCREQ_F_INVOKED)) {
         resp->cookie = const_cast<void *>(MCREQ_PKT_COOKIE(pkt));
         const auto *base = reinterpret_cast<const lcb_RESPBASE *>(resp);
         if ((pkt->flags & MCREQ_F_PRIVCALLBACK) == 0) {
-            if (instance != nullptr) {
+            if (instance != nullptr && !lcb_respbatch_add(instance, cbtype, resp)) {
                 find_callback(instance, cbtype)(instance, cbtype, base);
             }
         } else {
@@ -370,15 +387,57 @@ void invoke_callback(const mc_PACKET *pkt, mc_PIPELINE *pipeline, T *resp, lcb_C
     invoke_callback(pkt, get_instance(pipeline), cbtype, resp);
 }
 
+/** Values larger than this are inflated into a buffer of their own, instead of the one kept by the instance */
+#define LCB_INFLATE_BUF_MAX (1024 * 1024)
+
+/**
+ * Find the buffer to inflate a value of `nbytes` into. This is the buffer of
+ * the application if it installed lcb_inflate_callback, otherwise the buffer
+ * kept by the instance, or a new one if that is in use or the value is large.
+ * @param[out] freeptr set to the buffer which must be passed to
+ * release_inflated() after the callback, and left alone if the buffer belongs
+ * to the application
+ */
+static void *reserve_inflated(lcb_INSTANCE *o, void *cookie, size_t nbytes, void **freeptr)
+{
+    if (o->callbacks.inflate) {
+        void *dst = o->callbacks.inflate(o, cookie, nbytes);
+        if (dst) {
+            return dst;
+        }
+    }
+    if (o->inflate_busy || nbytes > LCB_INFLATE_BUF_MAX) {
+        return *freeptr = malloc(nbytes);
+    }
+    if (o->ninflate_buf < nbytes) {
+        free(o->inflate_buf);
+        o->ninflate_buf = 0;
+        if ((o->inflate_buf = static_cast<char *>(malloc(nbytes))) == nullptr) {
+            return nullptr;
+        }
+        o->ninflate_buf = nbytes;
+    }
+    o->inflate_busy = 1;
+    return *freeptr = o->inflate_buf;
+}
+
+static void release_inflated(lcb_INSTANCE *o, void *freeptr)
+{
+    if (freeptr != nullptr && freeptr == o->inflate_buf) {
+        o->inflate_busy = 0;
+    } else {
+        free(freeptr);
+    }
+}
+
 /**
  * Optionally decompress an incoming payload.
  * @param o The instance
  * @param resp The response received
  * @param[out] bytes pointer to the final payload
  * @param[out] nbytes pointer to the size of the final payload
- * @param[out] freeptr pointer to free. This should be initialized to `nullptr`.
- * If temporary dynamic storage is required this will be set to the allocated
- * pointer upon return. Otherwise it will be set to nullptr. In any case it must
+ * @param[out] freeptr pointer to release. This should be initialized to `nullptr`,
+ * and must be passed to release_inflated() once the callback has returned.
  */
 template <typename T>
 static void maybe_decompress(lcb_INSTANCE *o, const MemcachedResponse *respkt, T *rescmd, void **freeptr)
@@ -395,7 +454,14 @@ static void maybe_decompress(lcb_INSTANCE *o, const MemcachedResponse *respkt, T
     if (respkt->datatype() & PROTOCOL_BINARY_DATATYPE_COMPRESSED) {
         if (LCBT_SETTING(o, compressopts) & LCB_COMPRESS_IN) {
             /* if we inflate, we don't set the flag */
-            mcreq_inflate_value(respkt->value(), respkt->vallen(), &rescmd->value, &rescmd->nvalue, freeptr);
+            size_t nbytes = 0;
+            if (mcreq_inflated_length(respkt->value(), respkt->vallen(), &nbytes) == 0) {
+                void *dst = reserve_inflated(o, rescmd->cookie, nbytes, freeptr);
+                if (dst && mcreq_inflate_into(respkt->value(), respkt->vallen(), dst) == 0) {
+                    rescmd->value = static_cast<const char *>(dst);
+                    rescmd->nvalue = nbytes;
+                }
+            }
 
         } else {
             /* user doesn't want inflation. signal it's compressed */
@@ -427,15 +493,34 @@ static void H_get(mc_PIPELINE *pipeline, mc_PACKET *request, MemcachedResponse *
 
     void *freeptr = nullptr;
     maybe_decompress(o, response, &resp, &freeptr);
+    if ((request->flags & MCREQ_F_STREAMVALUE) && o != nullptr && o->callbacks.value_sink != nullptr &&
+        resp.ctx.rc == LCB_SUCCESS && resp.nvalue > 0) {
+        /* the reply was read whole, e.g. because it was short or compressed */
+        o->callbacks.value_sink(o, resp.cookie, static_cast<const char *>(resp.value), resp.nvalue);
+        resp.value = nullptr;
+        resp.nvalue = 0;
+        resp.bufh = nullptr;
+    }
+    if ((request->flags & MCREQ_F_NEARCACHE) && o != nullptr &&
+        (resp.ctx.rc == LCB_SUCCESS || resp.ctx.rc == LCB_ERR_DOCUMENT_NOT_FOUND)) {
+        lcb_near_cache_store(o, request, &resp);
+    }
+    if (o != nullptr && resp.ctx.rc == LCB_SUCCESS && response->opcode() == PROTOCOL_BINARY_CMD_GAT) {
+        lcb_near_cache_touched(o, request);
+    }
     lcb::trace::finish_kv_span(pipeline, request, response);
     TRACE_GET_END(o, request, response, &resp);
-    record_kv_op_latency("get", o, request);
+    record_kv_op_latency(METRICS_KV_OP_GET, o, request);
+    if (o->get_latency && response->opcode() == PROTOCOL_BINARY_CMD_GET &&
+        (resp.ctx.rc == LCB_SUCCESS || resp.ctx.rc == LCB_ERR_DOCUMENT_NOT_FOUND)) {
+        lcb_get_latency_record(o, lcb_settings_now(o->settings) - MCREQ_PKT_RDATA(request)->start);
+    }
     if (request->flags & MCREQ_F_REQEXT) {
         request->u_rdata.exdata->procs->handler(pipeline, request, LCB_CALLBACK_GET, resp.ctx.rc, &resp);
     } else {
         invoke_callback(request, o, &resp, LCB_CALLBACK_GET);
     }
-    free(freeptr);
+    release_inflated(o, freeptr);
 }
 
 static void H_exists(mc_PIPELINE *pipeline, mc_PACKET *request, MemcachedResponse *response, lcb_STATUS immerr)
@@ -461,9 +546,13 @@ static void H_exists(mc_PIPELINE *pipeline, mc_PACKET *request, MemcachedRespons
             resp.seqno = lcb_ntohll(resp.seqno);
         }
     }
+    if ((request->flags & MCREQ_F_NEARCACHE) && root != nullptr &&
+        (resp.ctx.rc == LCB_ERR_DOCUMENT_NOT_FOUND || (resp.ctx.rc == LCB_SUCCESS && resp.deleted))) {
+        lcb_near_cache_store_missing(root, request);
+    }
     lcb::trace::finish_kv_span(pipeline, request, response);
     TRACE_EXISTS_END(root, request, response, &resp);
-    record_kv_op_latency("exists", root, request);
+    record_kv_op_latency(METRICS_KV_OP_EXISTS, root, request);
     invoke_callback(request, root, &resp, LCB_CALLBACK_EXISTS);
 }
 
@@ -490,31 +579,7 @@ static void H_getreplica(mc_PIPELINE *pipeline, mc_PACKET *request, MemcachedRes
 
     maybe_decompress(instance, response, &resp, &freeptr);
     rd->procs->handler(pipeline, request, LCB_CALLBACK_GETREPLICA, resp.ctx.rc, &resp);
-    free(freeptr);
-}
-
-static int lcb_sdresult_next(const lcb_RESPSUBDOC *resp, lcb_SDENTRY *ent, size_t *iter);
-
-static void lcb_sdresult_parse(lcb_RESPSUBDOC *resp, lcb_CALLBACK_TYPE type)
-{
-    std::vector<lcb_SDENTRY> results;
-    size_t iter = 0, oix = 0;
-    lcb_SDENTRY ent;
-    results.resize(resp->nres);
-
-    while (lcb_sdresult_next(resp, &ent, &iter)) {
-        size_t index = oix++;
-        if (type == LCB_CALLBACK_SDMUTATE) {
-            index = ent.index;
-        }
-        results[index] = ent;
-    }
-    if (resp->nres) {
-        resp->res = (lcb_SDENTRY *)calloc(resp->nres, sizeof(lcb_SDENTRY));
-        for (size_t ii = 0; ii < resp->nres; ii++) {
-            resp->res[ii] = results[ii];
-        }
-    }
+    release_inflated(instance, freeptr);
 }
 
 static void H_subdoc(mc_PIPELINE *pipeline, mc_PACKET *request, MemcachedResponse *response, lcb_STATUS immerr)
@@ -525,6 +590,7 @@ static void H_subdoc(mc_PIPELINE *pipeline, mc_PACKET *request, MemcachedRespons
     init_resp(o, pipeline, response, request, immerr, &resp);
     resp.rflags |= LCB_RESP_F_FINAL;
     resp.res = nullptr;
+    resp.bufh = response->bufseg();
 
     /* For mutations, add the mutation token */
     switch (response->opcode()) {
@@ -547,7 +613,9 @@ static void H_subdoc(mc_PIPELINE *pipeline, mc_PACKET *request, MemcachedRespons
         if (resp.ctx.rc == LCB_SUCCESS) {
             resp.responses = response;
             resp.nres = MCREQ_PKT_RDATA(request)->nsubreq;
-            lcb_sdresult_parse(&resp, cbtype);
+            if (resp.nres > lcb_RESPSUBDOC::INLINE_RESULTS) {
+                resp.res = (lcb_SDENTRY *)calloc(resp.nres, sizeof(lcb_SDENTRY));
+            }
         } else {
             handle_error_info(response, resp);
         }
@@ -556,7 +624,6 @@ static void H_subdoc(mc_PIPELINE *pipeline, mc_PACKET *request, MemcachedRespons
         resp.rflags |= LCB_RESP_F_SDSINGLE;
         if (resp.ctx.rc == LCB_SUCCESS || LCB_ERROR_IS_SUBDOC(resp.ctx.rc)) {
             resp.responses = response;
-            lcb_sdresult_parse(&resp, cbtype);
         } else {
             handle_error_info(response, resp);
         }
@@ -564,9 +631,9 @@ static void H_subdoc(mc_PIPELINE *pipeline, mc_PACKET *request, MemcachedRespons
     lcb::trace::finish_kv_span(pipeline, request, response);
 
     if (cbtype == LCB_CALLBACK_SDLOOKUP) {
-        record_kv_op_latency("lookup_in", o, request);
+        record_kv_op_latency(METRICS_KV_OP_LOOKUP_IN, o, request);
     } else {
-        record_kv_op_latency("mutate_in", o, request);
+        record_kv_op_latency(METRICS_KV_OP_MUTATE_IN, o, request);
     }
 
     invoke_callback(request, o, &resp, cbtype);
@@ -687,6 +754,97 @@ static int lcb_sdresult_next(const lcb_RESPSUBDOC *resp, lcb_SDENTRY *ent, size_
     }
 }
 
+const lcb_SDENTRY &lcb_RESPSUBDOC_::result(size_t index) const
+{
+    lcb_SDENTRY *results = res ? res : inline_res;
+    const auto *response = reinterpret_cast<const MemcachedResponse *>(responses);
+    bool is_mutation = response->opcode() == PROTOCOL_BINARY_CMD_SUBDOC_MULTI_MUTATION;
+
+    while (nparsed <= index) {
+        lcb_SDENTRY ent{};
+        if (!lcb_sdresult_next(this, &ent, &parse_offset)) {
+            /* The remaining (mutation) specs have no result of their own */
+            nparsed = nres;
+            break;
+        }
+        size_t ix = is_mutation ? ent.index : nparsed;
+        if (ix >= nres) {
+            continue;
+        }
+        results[ix] = ent;
+        nparsed = std::max(nparsed, ix + 1);
+    }
+    return results[index];
+}
+
+std::size_t lcb_RESPSUBDOC_::results(lcb_SUBDOC_RESULT *out, std::size_t nout, const char **body) const
+{
+    const auto *response = reinterpret_cast<const MemcachedResponse *>(responses);
+    *body = nullptr;
+    if (response == nullptr || nres == 0) {
+        return 0;
+    }
+    std::size_t n = std::min(nres, nout);
+    const char *begin = response->value();
+    const char *end = begin + response->vallen();
+    const char *buf = begin;
+    *body = begin;
+
+    if (response->opcode() == PROTOCOL_BINARY_CMD_SUBDOC_MULTI_LOOKUP) {
+        /* status (2), length (4), value: one entry per spec, in order */
+        std::size_t ii = 0;
+        for (; ii < n && end - buf >= 6; ++ii) {
+            uint16_t rc;
+            uint32_t vlen;
+            memcpy(&rc, buf, 2);
+            memcpy(&vlen, buf + 2, 4);
+            vlen = ntohl(vlen);
+            out[ii].status = lcb_map_error(nullptr, ntohs(rc));
+            if (out[ii].status == LCB_SUCCESS) {
+                out[ii].offset = static_cast<uint32_t>(buf + 6 - begin);
+                out[ii].length = vlen;
+            } else {
+                out[ii].offset = 0;
+                out[ii].length = 0;
+            }
+            buf += 6 + vlen;
+        }
+        /* A truncated body leaves nothing to decode for the remaining specs */
+        for (; ii < n; ++ii) {
+            out[ii] = lcb_SUBDOC_RESULT{LCB_ERR_PROTOCOL_ERROR, 0, 0};
+        }
+        return n;
+    }
+
+    /* index (1), status (2), and length (4) and value on success: only for the
+     * specs with a value or an error, the others are successful and empty */
+    for (std::size_t ii = 0; ii < n; ++ii) {
+        out[ii] = lcb_SUBDOC_RESULT{LCB_SUCCESS, 0, 0};
+    }
+    while (end - buf >= 3) {
+        uint8_t index = *reinterpret_cast<const uint8_t *>(buf);
+        uint16_t rc;
+        memcpy(&rc, buf + 1, 2);
+        rc = ntohs(rc);
+        buf += 3;
+        lcb_SUBDOC_RESULT ent{lcb_map_error(nullptr, rc), 0, 0};
+        if (rc == PROTOCOL_BINARY_RESPONSE_SUCCESS) {
+            if (end - buf < 4) {
+                break;
+            }
+            uint32_t vlen;
+            memcpy(&vlen, buf, 4);
+            ent.offset = static_cast<uint32_t>(buf + 4 - begin);
+            ent.length = ntohl(vlen);
+            buf += 4 + ent.length;
+        }
+        if (index < n) {
+            out[index] = ent;
+        }
+    }
+    return n;
+}
+
 static void H_delete(mc_PIPELINE *pipeline, mc_PACKET *packet, MemcachedResponse *response, lcb_STATUS immerr)
 {
     lcb_INSTANCE *root = get_instance(pipeline);
@@ -697,7 +855,7 @@ static void H_delete(mc_PIPELINE *pipeline, mc_PACKET *packet, MemcachedResponse
     handle_mutation_token(root, response, packet, &resp.mt);
     lcb::trace::finish_kv_span(pipeline, packet, response);
     TRACE_REMOVE_END(root, packet, response, &resp);
-    record_kv_op_latency("remove", root, packet);
+    record_kv_op_latency(METRICS_KV_OP_REMOVE, root, packet);
     invoke_callback(packet, root, &resp, LCB_CALLBACK_REMOVE);
 }
 
@@ -861,7 +1019,7 @@ static void H_arithmetic(mc_PIPELINE *pipeline, mc_PACKET *request, MemcachedRes
     resp.ctx.cas = response->cas();
     lcb::trace::finish_kv_span(pipeline, request, response);
     TRACE_ARITHMETIC_END(root, request, response, &resp);
-    record_kv_op_latency("arithmetic", root, request);
+    record_kv_op_latency(METRICS_KV_OP_ARITHMETIC, root, request);
     invoke_callback(request, root, &resp, LCB_CALLBACK_COUNTER);
 }
 
@@ -891,6 +1049,13 @@ static void H_stats(mc_PIPELINE *pipeline, mc_PACKET *request, MemcachedResponse
     exdata->procs->handler(pipeline, request, LCB_CALLBACK_STATS, resp.ctx.rc, &resp);
 }
 
+static void H_range_scan(mc_PIPELINE *pipeline, mc_PACKET *request, MemcachedResponse *response, lcb_STATUS immerr)
+{
+    /* the scan needs the raw status (and may be called for several frames of
+     * the same continue), so it gets the response itself */
+    request->u_rdata.exdata->procs->handler(pipeline, request, LCB_CALLBACK_RANGESCAN, immerr, response);
+}
+
 static void H_collections_get_manifest(mc_PIPELINE *pipeline, mc_PACKET *request, MemcachedResponse *response,
                                        lcb_STATUS immerr)
 {
@@ -901,7 +1066,12 @@ static void H_collections_get_manifest(mc_PIPELINE *pipeline, mc_PACKET *request
     resp.rflags |= LCB_RESP_F_FINAL;
     resp.value = response->value();
     resp.nvalue = response->vallen();
-    invoke_callback(request, root, &resp, LCB_CALLBACK_COLLECTIONS_GET_MANIFEST);
+    if (request->flags & MCREQ_F_REQEXT) {
+        request->u_rdata.exdata->procs->handler(pipeline, request, LCB_CALLBACK_COLLECTIONS_GET_MANIFEST,
+                                                resp.ctx.rc, &resp);
+    } else {
+        invoke_callback(request, root, &resp, LCB_CALLBACK_COLLECTIONS_GET_MANIFEST);
+    }
 }
 
 static void H_collections_get_cid(mc_PIPELINE *pipeline, mc_PACKET *request, MemcachedResponse *response,
@@ -928,6 +1098,11 @@ static void H_collections_get_cid(mc_PIPELINE *pipeline, mc_PACKET *request, Mem
         }
     }
 
+    if (resp.ctx.key.empty() && (request->flags & MCREQ_F_HASVALUE)) {
+        /* the spec is sent as the body of the request */
+        resp.ctx.key.assign(SPAN_BUFFER(&request->u_value.single), request->u_value.single.size);
+    }
+
     if (request->flags & MCREQ_F_REQEXT) {
         if (!resp.ctx.key.empty()) {
             auto dot = resp.ctx.key.find('.');
@@ -938,6 +1113,9 @@ static void H_collections_get_cid(mc_PIPELINE *pipeline, mc_PACKET *request, Mem
         }
         request->u_rdata.exdata->procs->handler(pipeline, request, LCB_CALLBACK_GETCID, resp.ctx.rc, &resp);
     } else {
+        if (resp.ctx.rc == LCB_SUCCESS && !resp.ctx.key.empty()) {
+            root->collcache->put(resp.ctx.key, resp.collection_id);
+        }
         invoke_callback(request, root, &resp, LCB_CALLBACK_GETCID);
     }
 }
@@ -960,9 +1138,12 @@ static void H_touch(mc_PIPELINE *pipeline, mc_PACKET *request, MemcachedResponse
     init_resp(root, pipeline, response, request, immerr, &resp);
     handle_error_info(response, resp);
     resp.rflags |= LCB_RESP_F_FINAL;
+    if (root != nullptr && resp.ctx.rc == LCB_SUCCESS) {
+        lcb_near_cache_touched(root, request);
+    }
     lcb::trace::finish_kv_span(pipeline, request, response);
     TRACE_TOUCH_END(root, request, response, &resp);
-    record_kv_op_latency("touch", root, request);
+    record_kv_op_latency(METRICS_KV_OP_TOUCH, root, request);
     invoke_callback(request, root, &resp, LCB_CALLBACK_TOUCH);
 }
 
@@ -975,7 +1156,7 @@ static void H_unlock(mc_PIPELINE *pipeline, mc_PACKET *request, MemcachedRespons
     resp.rflags |= LCB_RESP_F_FINAL;
     lcb::trace::finish_kv_span(pipeline, request, response);
     TRACE_UNLOCK_END(root, request, response, &resp);
-    record_kv_op_latency("unlock", root, request);
+    record_kv_op_latency(METRICS_KV_OP_UNLOCK, root, request);
     invoke_callback(request, root, &resp, LCB_CALLBACK_UNLOCK);
 }
 
@@ -1007,7 +1188,7 @@ static void H_select_bucket(mc_PIPELINE *pipeline, mc_PACKET *request, Memcached
     }
 }
 
-static void record_metrics(mc_PIPELINE *pipeline, mc_PACKET *req, MemcachedResponse *)
+static void record_metrics(mc_PIPELINE *pipeline, mc_PACKET *req, MemcachedResponse *res)
 {
     lcb_INSTANCE *instance = get_instance(pipeline);
     if (instance == nullptr) {
@@ -1016,14 +1197,54 @@ static void record_metrics(mc_PIPELINE *pipeline, mc_PACKET *req, MemcachedRespo
     if (
 #ifdef HAVE_DTRACE
         1
+#elif defined(LCB_NO_METRICS)
+        METRICS_KV_BREAKDOWN_ENABLED(instance->settings)
 #else
-        instance->kv_timings
+        instance->kv_timings || METRICS_KV_BREAKDOWN_ENABLED(instance->settings)
 #endif
     ) {
-        MCREQ_PKT_RDATA(req)->dispatch = gethrtime();
+        MCREQ_PKT_RDATA(req)->dispatch = lcb_settings_now(instance->settings);
+    }
+    TRACE_KV_DISPATCH(instance, pipeline, req, res);
+    lcb_flight_record(instance, LCB_FLIGHT_PKT_COMPLETE, pipeline, req, res->status());
+    lcb_VBUCKETMETRICS *vbm = lcb_metrics_packet_vbucket(instance->settings, req);
+    if (vbm) {
+        lcb_U64 latency = LCB_NS2US(lcb_settings_now(instance->settings) - MCREQ_PKT_RDATA(req)->start);
+        vbm->ops++;
+        vbm->latency_sum_us += latency;
+        vbm->latency_max_us = std::max(vbm->latency_max_us, latency);
     }
+#ifndef LCB_NO_METRICS
     if (instance->kv_timings) {
-        lcb_histogram_record(instance->kv_timings, MCREQ_PKT_RDATA(req)->dispatch - MCREQ_PKT_RDATA(req)->start);
+        hrtime_t latency = MCREQ_PKT_RDATA(req)->dispatch - MCREQ_PKT_RDATA(req)->start;
+        lcb_histogram_record(instance->kv_timings, latency);
+
+        /* the timings of a node are kept by the first connection of its group */
+        auto *server = static_cast<lcb::Server *>(pipeline);
+        if (pipeline->slot != pipeline->index && pipeline->parent != nullptr) {
+            server = instance->get_server(pipeline->index);
+        }
+        std::vector<lcb_HISTOGRAM *> &op_timings = server->op_timings;
+        if (op_timings.empty()) {
+            op_timings.resize(0x100);
+        }
+        lcb_HISTOGRAM *&histogram = op_timings[res->opcode()];
+        if (histogram == nullptr) {
+            histogram = lcb_histogram_create();
+        }
+        if (histogram != nullptr) {
+            lcb_histogram_record(histogram, latency);
+        }
+    }
+#endif
+    if ((res->opcode() == PROTOCOL_BINARY_CMD_GET || res->opcode() == PROTOCOL_BINARY_CMD_GET_REPLICA) &&
+        pipeline->parent != nullptr && pipeline != pipeline->parent->fallback) {
+        /* failed reads count as well, so that replicas which time out are avoided */
+        auto *server = static_cast<lcb::Server *>(pipeline);
+        if (pipeline->slot != pipeline->index) {
+            server = instance->get_server(pipeline->index);
+        }
+        server->record_read_latency(lcb_settings_now(instance->settings) - MCREQ_PKT_RDATA(req)->start);
     }
 }
 
@@ -1036,94 +1257,119 @@ static void dispatch_ufwd_error(mc_PIPELINE *pipeline, mc_PACKET *req, lcb_STATU
     instance->callbacks.pktfwd(instance, MCREQ_PKT_COOKIE(req), immerr, &resp);
 }
 
-int mcreq_dispatch_response(mc_PIPELINE *pipeline, mc_PACKET *req, MemcachedResponse *res, lcb_STATUS immerr)
-{
-    record_metrics(pipeline, req, res);
+typedef void (*response_handler)(mc_PIPELINE *, mc_PACKET *, MemcachedResponse *, lcb_STATUS);
 
+/**
+ * Response handlers, indexed by opcode. Unknown opcodes have no handler. The
+ * table is filled once, so that dispatching a response is a single load
+ * instead of a walk through a switch over the sparse opcode space.
+ */
+struct HandlerTable {
+    response_handler handlers[0x100]{};
+
+    HandlerTable()
+    {
+        set({PROTOCOL_BINARY_CMD_GET, PROTOCOL_BINARY_CMD_GAT, PROTOCOL_BINARY_CMD_GET_LOCKED}, H_get);
+        set({PROTOCOL_BINARY_CMD_ADD, PROTOCOL_BINARY_CMD_REPLACE, PROTOCOL_BINARY_CMD_SET,
+             PROTOCOL_BINARY_CMD_APPEND, PROTOCOL_BINARY_CMD_PREPEND},
+            H_store);
+        set({PROTOCOL_BINARY_CMD_INCREMENT, PROTOCOL_BINARY_CMD_DECREMENT}, H_arithmetic);
+        set({PROTOCOL_BINARY_CMD_SUBDOC_GET, PROTOCOL_BINARY_CMD_SUBDOC_EXISTS,
+             PROTOCOL_BINARY_CMD_SUBDOC_ARRAY_ADD_UNIQUE, PROTOCOL_BINARY_CMD_SUBDOC_ARRAY_PUSH_FIRST,
+             PROTOCOL_BINARY_CMD_SUBDOC_ARRAY_PUSH_LAST, PROTOCOL_BINARY_CMD_SUBDOC_ARRAY_INSERT,
+             PROTOCOL_BINARY_CMD_SUBDOC_DICT_ADD, PROTOCOL_BINARY_CMD_SUBDOC_DICT_UPSERT,
+             PROTOCOL_BINARY_CMD_SUBDOC_REPLACE, PROTOCOL_BINARY_CMD_SUBDOC_DELETE, PROTOCOL_BINARY_CMD_SUBDOC_COUNTER,
+             PROTOCOL_BINARY_CMD_SUBDOC_GET_COUNT, PROTOCOL_BINARY_CMD_SUBDOC_MULTI_LOOKUP,
+             PROTOCOL_BINARY_CMD_SUBDOC_MULTI_MUTATION},
+            H_subdoc);
+        set({PROTOCOL_BINARY_CMD_OBSERVE}, H_observe);
+        set({PROTOCOL_BINARY_CMD_GET_REPLICA}, H_getreplica);
+        set({PROTOCOL_BINARY_CMD_UNLOCK_KEY}, H_unlock);
+        set({PROTOCOL_BINARY_CMD_DELETE}, H_delete);
+        set({PROTOCOL_BINARY_CMD_TOUCH}, H_touch);
+        set({PROTOCOL_BINARY_CMD_OBSERVE_SEQNO}, H_observe_seqno);
+        set({PROTOCOL_BINARY_CMD_STAT}, H_stats);
+        set({PROTOCOL_BINARY_CMD_NOOP}, H_noop);
+        set({PROTOCOL_BINARY_CMD_GET_CLUSTER_CONFIG}, H_config);
+        set({PROTOCOL_BINARY_CMD_SELECT_BUCKET}, H_select_bucket);
+        set({PROTOCOL_BINARY_CMD_COLLECTIONS_GET_MANIFEST}, H_collections_get_manifest);
+        set({PROTOCOL_BINARY_CMD_COLLECTIONS_GET_CID}, H_collections_get_cid);
+        set({PROTOCOL_BINARY_CMD_GET_META}, H_exists);
+        set({PROTOCOL_BINARY_CMD_RANGE_SCAN_CREATE, PROTOCOL_BINARY_CMD_RANGE_SCAN_CONTINUE,
+             PROTOCOL_BINARY_CMD_RANGE_SCAN_CANCEL},
+            H_range_scan);
+    }
+
+    void set(std::initializer_list<std::uint8_t> opcodes, response_handler handler)
+    {
+        for (auto opcode : opcodes) {
+            handlers[opcode] = handler;
+        }
+    }
+};
+
+static const HandlerTable handler_table;
+
+static int dispatch_response(mc_PIPELINE *pipeline, mc_PACKET *req, MemcachedResponse *res, lcb_STATUS immerr)
+{
     if (req->flags & MCREQ_F_UFWD) {
         dispatch_ufwd_error(pipeline, req, immerr);
         return 0;
     }
 
-#define INVOKE_OP(handler)                                                                                             \
-    handler(pipeline, req, res, immerr);                                                                               \
-    return 0;                                                                                                          \
-    break
-
-    switch (res->opcode()) {
-        case PROTOCOL_BINARY_CMD_GET:
-        case PROTOCOL_BINARY_CMD_GAT:
-        case PROTOCOL_BINARY_CMD_GET_LOCKED:
-            INVOKE_OP(H_get);
+    response_handler handler = handler_table.handlers[res->opcode()];
+    if (handler == nullptr) {
+        fprintf(stderr, "COUCHBASE: Received unknown opcode=0x%x\n", res->opcode());
+        return -1;
+    }
+    handler(pipeline, req, res, immerr);
+    return 0;
+}
 
+/** @return whether the opcode may change the value or the expiry of a document */
+static bool invalidates_near_cache(std::uint8_t opcode)
+{
+    switch (opcode) {
+        case PROTOCOL_BINARY_CMD_SET:
         case PROTOCOL_BINARY_CMD_ADD:
         case PROTOCOL_BINARY_CMD_REPLACE:
-        case PROTOCOL_BINARY_CMD_SET:
         case PROTOCOL_BINARY_CMD_APPEND:
         case PROTOCOL_BINARY_CMD_PREPEND:
-            INVOKE_OP(H_store);
-
+        case PROTOCOL_BINARY_CMD_DELETE:
         case PROTOCOL_BINARY_CMD_INCREMENT:
         case PROTOCOL_BINARY_CMD_DECREMENT:
-            INVOKE_OP(H_arithmetic);
-
-        case PROTOCOL_BINARY_CMD_SUBDOC_GET:
-        case PROTOCOL_BINARY_CMD_SUBDOC_EXISTS:
-        case PROTOCOL_BINARY_CMD_SUBDOC_ARRAY_ADD_UNIQUE:
-        case PROTOCOL_BINARY_CMD_SUBDOC_ARRAY_PUSH_FIRST:
-        case PROTOCOL_BINARY_CMD_SUBDOC_ARRAY_PUSH_LAST:
-        case PROTOCOL_BINARY_CMD_SUBDOC_ARRAY_INSERT:
+        case PROTOCOL_BINARY_CMD_TOUCH:
+        case PROTOCOL_BINARY_CMD_GAT:
         case PROTOCOL_BINARY_CMD_SUBDOC_DICT_ADD:
         case PROTOCOL_BINARY_CMD_SUBDOC_DICT_UPSERT:
-        case PROTOCOL_BINARY_CMD_SUBDOC_REPLACE:
         case PROTOCOL_BINARY_CMD_SUBDOC_DELETE:
+        case PROTOCOL_BINARY_CMD_SUBDOC_REPLACE:
+        case PROTOCOL_BINARY_CMD_SUBDOC_ARRAY_PUSH_LAST:
+        case PROTOCOL_BINARY_CMD_SUBDOC_ARRAY_PUSH_FIRST:
+        case PROTOCOL_BINARY_CMD_SUBDOC_ARRAY_INSERT:
+        case PROTOCOL_BINARY_CMD_SUBDOC_ARRAY_ADD_UNIQUE:
         case PROTOCOL_BINARY_CMD_SUBDOC_COUNTER:
-        case PROTOCOL_BINARY_CMD_SUBDOC_GET_COUNT:
-        case PROTOCOL_BINARY_CMD_SUBDOC_MULTI_LOOKUP:
         case PROTOCOL_BINARY_CMD_SUBDOC_MULTI_MUTATION:
-            INVOKE_OP(H_subdoc);
-
-        case PROTOCOL_BINARY_CMD_OBSERVE:
-            INVOKE_OP(H_observe);
-
-        case PROTOCOL_BINARY_CMD_GET_REPLICA:
-            INVOKE_OP(H_getreplica);
-
-        case PROTOCOL_BINARY_CMD_UNLOCK_KEY:
-            INVOKE_OP(H_unlock);
-
-        case PROTOCOL_BINARY_CMD_DELETE:
-            INVOKE_OP(H_delete);
-
-        case PROTOCOL_BINARY_CMD_TOUCH:
-            INVOKE_OP(H_touch);
-
-        case PROTOCOL_BINARY_CMD_OBSERVE_SEQNO:
-            INVOKE_OP(H_observe_seqno);
-
-        case PROTOCOL_BINARY_CMD_STAT:
-            INVOKE_OP(H_stats);
-
-        case PROTOCOL_BINARY_CMD_NOOP:
-            INVOKE_OP(H_noop);
-
-        case PROTOCOL_BINARY_CMD_GET_CLUSTER_CONFIG:
-            INVOKE_OP(H_config);
-
-        case PROTOCOL_BINARY_CMD_SELECT_BUCKET:
-            INVOKE_OP(H_select_bucket);
-
-        case PROTOCOL_BINARY_CMD_COLLECTIONS_GET_MANIFEST:
-            INVOKE_OP(H_collections_get_manifest);
+            return true;
+        default:
+            return false;
+    }
+}
 
-        case PROTOCOL_BINARY_CMD_COLLECTIONS_GET_CID:
-            INVOKE_OP(H_collections_get_cid);
+int mcreq_dispatch_response(mc_PIPELINE *pipeline, mc_PACKET *req, MemcachedResponse *res, lcb_STATUS immerr)
+{
+    lcb_INSTANCE *instance = get_instance(pipeline);
+    if (instance != nullptr && instance->near_cache != nullptr && invalidates_near_cache(res->opcode())) {
+        /* even failed mutations may have been applied, e.g. if they timed out */
+        lcb_near_cache_invalidate(instance, req);
+    }
 
-        case PROTOCOL_BINARY_CMD_GET_META:
-            INVOKE_OP(H_exists);
+    record_metrics(pipeline, req, res);
+    int rv = dispatch_response(pipeline, req, res, immerr);
 
-        default:
-            fprintf(stderr, "COUCHBASE: Received unknown opcode=0x%x\n", res->opcode());
-            return -1;
+    instance = get_instance(pipeline);
+    if (instance != nullptr && METRICS_KV_ENABLED(instance->settings)) {
+        record_kv_op_breakdown(instance, req, LCB_US2NS(res->duration()), lcb_settings_now(instance->settings));
     }
+    return rv;
 }
@@ -0,0 +1,291 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "internal.h"
+#include "hotkeys.h"
+#include "collections.h"
+#include "metrics/metrics-internal.h"
+#include "contrib/lcb-jsoncpp/lcb-jsoncpp.h"
+
+#include <algorithm>
+#include <cstring>
+
+using lcb::HotKeys;
+
+bool HotKeys::record(std::uint32_t cid, const char *key, std::size_t nkey, int vbid, int server)
+{
+    if (vbid >= 0) {
+        if (static_cast<std::size_t>(vbid) >= vbuckets_.size()) {
+            vbuckets_.resize(vbid + 1);
+        }
+        vbuckets_[vbid]++;
+    }
+    if (server >= 0) {
+        if (static_cast<std::size_t>(server) >= servers_.size()) {
+            servers_.resize(server + 1);
+        }
+        servers_[server]++;
+    }
+
+    scratch_.assign(reinterpret_cast<const char *>(&cid), sizeof(cid));
+    scratch_.append(key, nkey);
+    auto it = index_.find(scratch_);
+    if (it != index_.end()) {
+        heap_[it->second].count++;
+        sift_down(it->second);
+    } else if (heap_.size() < capacity_) {
+        it = index_.emplace(scratch_, heap_.size()).first;
+        heap_.push_back(Counter{&it->first, &it->second, 1, 0});
+        sift_up(heap_.size() - 1);
+    } else if (capacity_ != 0) {
+        /* the key takes over the smallest counter, which may have counted it before it was evicted */
+        Counter &min = heap_.front();
+        index_.erase(index_.find(*min.id));
+        it = index_.emplace(scratch_, 0).first;
+        min.id = &it->first;
+        min.pos = &it->second;
+        min.error = min.count;
+        min.count++;
+        sift_down(0);
+    }
+    return ++since_decay_ >= window;
+}
+
+void HotKeys::decay()
+{
+    for (auto &counter : heap_) {
+        counter.count /= 2;
+        counter.error /= 2;
+    }
+    for (auto &count : vbuckets_) {
+        count /= 2;
+    }
+    for (auto &count : servers_) {
+        count /= 2;
+    }
+    since_decay_ = 0;
+}
+
+std::vector<HotKeys::Key> HotKeys::top_keys() const
+{
+    std::vector<const Counter *> counters;
+    counters.reserve(heap_.size());
+    for (const auto &counter : heap_) {
+        counters.push_back(&counter);
+    }
+    std::size_t ntop = std::min(top_, counters.size());
+    std::partial_sort(counters.begin(), counters.begin() + ntop, counters.end(),
+                      [](const Counter *a, const Counter *b) { return a->count > b->count; });
+
+    std::vector<Key> keys;
+    for (std::size_t ii = 0; ii < ntop && counters[ii]->count != 0; ii++) {
+        const std::string &id = *counters[ii]->id;
+        Key key{};
+        std::memcpy(&key.cid, id.data(), sizeof(key.cid));
+        key.key = id.substr(sizeof(key.cid));
+        key.count = counters[ii]->count;
+        key.error = counters[ii]->error;
+        keys.push_back(std::move(key));
+    }
+    return keys;
+}
+
+std::vector<std::pair<int, std::uint64_t>> HotKeys::top_vbuckets() const
+{
+    std::vector<std::pair<int, std::uint64_t>> vbuckets;
+    for (std::size_t ii = 0; ii < vbuckets_.size(); ii++) {
+        if (vbuckets_[ii] != 0) {
+            vbuckets.emplace_back(static_cast<int>(ii), vbuckets_[ii]);
+        }
+    }
+    std::size_t ntop = std::min(top_, vbuckets.size());
+    std::partial_sort(vbuckets.begin(), vbuckets.begin() + ntop, vbuckets.end(),
+                      [](const std::pair<int, std::uint64_t> &a, const std::pair<int, std::uint64_t> &b) {
+                          return a.second > b.second;
+                      });
+    vbuckets.resize(ntop);
+    return vbuckets;
+}
+
+std::uint64_t HotKeys::skew() const
+{
+    std::uint64_t total = 0, busiest = 0;
+    for (auto count : servers_) {
+        total += count;
+        busiest = std::max(busiest, count);
+    }
+    if (total == 0) {
+        return 0;
+    }
+    return busiest * 100 * servers_.size() / total;
+}
+
+void HotKeys::sift_up(std::size_t pos)
+{
+    while (pos != 0) {
+        std::size_t parent = (pos - 1) / 2;
+        if (heap_[parent].count <= heap_[pos].count) {
+            break;
+        }
+        swap(parent, pos);
+        pos = parent;
+    }
+}
+
+void HotKeys::sift_down(std::size_t pos)
+{
+    for (;;) {
+        std::size_t smallest = pos;
+        for (std::size_t child = 2 * pos + 1; child <= 2 * pos + 2 && child < heap_.size(); child++) {
+            if (heap_[child].count < heap_[smallest].count) {
+                smallest = child;
+            }
+        }
+        if (smallest == pos) {
+            break;
+        }
+        swap(smallest, pos);
+        pos = smallest;
+    }
+}
+
+void HotKeys::swap(std::size_t a, std::size_t b)
+{
+    std::swap(heap_[a], heap_[b]);
+    *heap_[a].pos = a;
+    *heap_[b].pos = b;
+}
+
+/** Pass the hot keys, vBuckets and the skew of the servers of the window which ended to the meter */
+static void report_hot_keys(lcb_INSTANCE *instance, const lcb_HOTKEYS *hot_keys)
+{
+    lcb_settings *settings = instance->settings;
+    if (!settings->op_metrics_enabled || settings->meter == nullptr) {
+        return;
+    }
+    const lcbmetrics_METER *meter = settings->meter;
+    for (const auto &key : hot_keys->top_keys()) {
+        std::string cid = std::to_string(key.cid);
+        lcbmetrics_TAG tags[3] = {{METRICS_SVC_TAG_NAME, "kv"},
+                                  {METRICS_COLLECTION_ID_TAG_NAME, cid.c_str()},
+                                  {METRICS_DOCUMENT_TAG_NAME, key.key.c_str()}};
+        const lcbmetrics_VALUERECORDER *recorder =
+            meter->value_recorder_(meter, METRICS_KV_HOT_KEY_METER_NAME, tags, 3);
+        if (recorder) {
+            recorder->record_value_(recorder, key.count);
+        }
+    }
+    for (const auto &vbucket : hot_keys->top_vbuckets()) {
+        std::string vbid = std::to_string(vbucket.first);
+        lcbmetrics_TAG tags[2] = {{METRICS_SVC_TAG_NAME, "kv"}, {METRICS_VBUCKET_TAG_NAME, vbid.c_str()}};
+        const lcbmetrics_VALUERECORDER *recorder =
+            meter->value_recorder_(meter, METRICS_KV_HOT_VBUCKET_METER_NAME, tags, 2);
+        if (recorder) {
+            recorder->record_value_(recorder, vbucket.second);
+        }
+    }
+    lcbmetrics_TAG tags[1] = {{METRICS_SVC_TAG_NAME, "kv"}};
+    const lcbmetrics_VALUERECORDER *recorder = meter->value_recorder_(meter, METRICS_KV_NODE_SKEW_METER_NAME, tags, 1);
+    if (recorder) {
+        recorder->record_value_(recorder, hot_keys->skew());
+    }
+}
+
+void lcb_hot_keys_record(lcb_INSTANCE *instance, const lcb_KEYBUF *key, unsigned nhdr, uint32_t cid, int vbid,
+                         int server)
+{
+    if (instance->destroying) {
+        return;
+    }
+    std::uint32_t top = LCBT_SETTING(instance, hot_keys);
+    lcb_HOTKEYS *hot_keys = instance->hot_keys;
+    if (hot_keys == nullptr || hot_keys->top() != top) {
+        /* allocated on first use, and again once resized */
+        delete hot_keys;
+        instance->hot_keys = hot_keys = top ? new lcb_HOTKEYS(top) : nullptr;
+        if (hot_keys == nullptr) {
+            return;
+        }
+    }
+
+    const char *bytes = static_cast<const char *>(key->contig.bytes);
+    std::size_t nbytes = key->contig.nbytes;
+    if (key->type != LCB_KV_COPY) {
+        bytes += nhdr;
+        nbytes -= nhdr;
+    }
+    if (hot_keys->record(LCBT_SETTING(instance, use_collections) ? cid : 0, bytes, nbytes, vbid, server)) {
+        report_hot_keys(instance, hot_keys);
+        hot_keys->decay();
+    }
+}
+
+void lcb_hot_keys_destroy(lcb_HOTKEYS *hot_keys)
+{
+    delete hot_keys;
+}
+
+void lcb_hot_keys_diag(lcb_INSTANCE *instance, Json::Value &root)
+{
+    const lcb_HOTKEYS *hot_keys = instance->hot_keys;
+    if (hot_keys == nullptr) {
+        return;
+    }
+    Json::Value report(Json::objectValue);
+    Json::Value keys(Json::arrayValue);
+    for (const auto &key : hot_keys->top_keys()) {
+        Json::Value entry;
+        entry["key"] = key.key;
+        entry["collection_id"] = key.cid;
+        if (instance->collcache != nullptr) {
+            std::string name = instance->collcache->id_to_name(key.cid);
+            if (!name.empty()) {
+                entry["collection"] = name;
+            }
+        }
+        entry["count"] = (Json::Value::UInt64)key.count;
+        entry["error"] = (Json::Value::UInt64)key.error;
+        keys.append(entry);
+    }
+    report["keys"] = keys;
+
+    Json::Value vbuckets(Json::arrayValue);
+    for (const auto &vbucket : hot_keys->top_vbuckets()) {
+        Json::Value entry;
+        entry["vbucket"] = vbucket.first;
+        entry["count"] = (Json::Value::UInt64)vbucket.second;
+        vbuckets.append(entry);
+    }
+    report["vbuckets"] = vbuckets;
+
+    Json::Value servers(Json::arrayValue);
+    const std::vector<std::uint64_t> &counts = hot_keys->servers();
+    for (std::size_t ii = 0; ii < counts.size() && ii < instance->cmdq.npipelines; ii++) {
+        const auto *server = static_cast<const lcb::Server *>(instance->cmdq.pipelines[ii]);
+        Json::Value entry;
+        if (server->curhost->ipv6) {
+            entry["remote"] = "[" + std::string(server->curhost->host) + "]:" + std::string(server->curhost->port);
+        } else {
+            entry["remote"] = std::string(server->curhost->host) + ":" + std::string(server->curhost->port);
+        }
+        entry["count"] = (Json::Value::UInt64)counts[ii];
+        servers.append(entry);
+    }
+    report["servers"] = servers;
+    report["skew"] = (Json::Value::UInt64)hot_keys->skew();
+    root["hot_keys"] = report;
+}
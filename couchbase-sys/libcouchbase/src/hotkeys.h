@@ -0,0 +1,144 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCB_HOTKEYS_H
+#define LCB_HOTKEYS_H
+
+#include "config.h"
+#include <libcouchbase/couchbase.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * @file
+ * @brief Hot key tracker of the KV operations, see LCB_CNTL_HOT_KEYS
+ */
+
+namespace lcb
+{
+
+/**
+ * Most frequently accessed keys, vBuckets and servers of the KV operations.
+ *
+ * The keys are counted with the SpaceSaving algorithm: a fixed number of
+ * counters is kept in a min-heap, and a key without a counter takes over the
+ * smallest one, inheriting its count as the error of the estimate. Every key
+ * accessed more often than the operations divided by the number of counters
+ * is guaranteed to have one. All counts are halved every `window` operations,
+ * so that the report follows the recent traffic. Memory is bounded by the
+ * number of counters (and of vBuckets and servers), and each operation costs
+ * a hash lookup and a logarithmic heap update.
+ */
+class HotKeys
+{
+  public:
+    /** Counters kept per key reported, the slack makes the estimates of the top ones exact in practice */
+    static constexpr std::size_t counters_per_key = 8;
+    /** Operations after which all counts are halved */
+    static constexpr std::uint64_t window = 65536;
+
+    struct Key {
+        std::uint32_t cid;
+        std::string key;
+        /** Estimated accesses, at most `error` above the real count */
+        std::uint64_t count;
+        std::uint64_t error;
+    };
+
+    explicit HotKeys(std::size_t top) : top_(top), capacity_(top * counters_per_key) {}
+
+    /** @return the number of keys and vBuckets reported */
+    std::size_t top() const
+    {
+        return top_;
+    }
+
+    /**
+     * Count an access to `key` of the collection `cid`, which is mapped to
+     * `vbid` on the server with the index `server` (either may be negative)
+     * @return whether a window ended, in which case the caller reports the
+     * hot keys and calls decay()
+     */
+    bool record(std::uint32_t cid, const char *key, std::size_t nkey, int vbid, int server);
+
+    /** Halve all the counts, ending the window */
+    void decay();
+
+    /** @return the hottest keys, hottest first */
+    std::vector<Key> top_keys() const;
+
+    /** @return the hottest vBuckets and their accesses, hottest first */
+    std::vector<std::pair<int, std::uint64_t>> top_vbuckets() const;
+
+    /** @return the accesses of each server by index */
+    const std::vector<std::uint64_t> &servers() const
+    {
+        return servers_;
+    }
+
+    /**
+     * @return the accesses of the busiest server in percent of the mean over
+     * the servers, 100 when the load is even, or 0 if nothing was counted
+     */
+    std::uint64_t skew() const;
+
+  private:
+    struct Counter {
+        /** Key of the index, the collection ID followed by the document key */
+        const std::string *id;
+        /** Position of the counter in the heap, as kept by the index */
+        std::size_t *pos;
+        std::uint64_t count;
+        std::uint64_t error;
+    };
+
+    void sift_up(std::size_t pos);
+    void sift_down(std::size_t pos);
+    void swap(std::size_t a, std::size_t b);
+
+    const std::size_t top_;
+    const std::size_t capacity_;
+    /** Min-heap on the count */
+    std::vector<Counter> heap_{};
+    std::unordered_map<std::string, std::size_t> index_{};
+    /** Reused to look up keys without allocating */
+    std::string scratch_{};
+    std::vector<std::uint64_t> vbuckets_{};
+    std::vector<std::uint64_t> servers_{};
+    std::uint64_t since_decay_{0};
+};
+
+} // namespace lcb
+
+struct lcb_HOTKEYS_st : lcb::HotKeys {
+    using HotKeys::HotKeys;
+};
+
+namespace Json
+{
+class Value;
+}
+
+/** Add the hot keys, vBuckets and servers to the report of lcb_diag() */
+void lcb_hot_keys_diag(lcb_INSTANCE *instance, Json::Value &root);
+
+#endif /* LCB_HOTKEYS_H */
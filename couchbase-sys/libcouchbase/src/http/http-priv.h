@@ -25,6 +25,9 @@
 #include <lcbht/lcbht.h>
 #include "contrib/http_parser/http_parser.h"
 #include "http.h"
+#include "inflate.h"
+#include "aspend.h"
+#include <memory>
 #include <string>
 #include <vector>
 #include <set>
@@ -34,11 +37,15 @@ namespace lcb
 namespace http
 {
 
-// Simple object for header key and value
-struct Header {
-    std::string key{};
-    std::string value{};
-    Header(const std::string &key_, const std::string &value_) : key(key_), value(value_) {}
+/** Headers set by the library itself. See ::header_names for the strings */
+enum HeaderName {
+    HEADER_USER_AGENT,
+    HEADER_CONNECTION,
+    HEADER_ACCEPT,
+    HEADER_AUTHORIZATION,
+    HEADER_CONTENT_LENGTH,
+    HEADER_CONTENT_TYPE,
+    HEADER__MAX
 };
 
 struct Request {
@@ -155,13 +162,10 @@ struct Request {
      */
     void add_header(const std::string &key, const std::string &value)
     {
-        request_headers.push_back(Header(key, value));
+        add_header(key.c_str(), key.size(), value.c_str(), value.size());
     }
-
-    // Helper methods to populate request buffer
-    inline void add_to_preamble(const char *);
-    inline void add_to_preamble(const std::string &);
-    inline void add_to_preamble(const Header &);
+    void add_header(HeaderName name, const char *value, size_t nvalue);
+    void add_header(const char *key, size_t nkey, const char *value, size_t nvalue);
 
     /**
      * Starts the IO on the current request. This really belongs in submit(),
@@ -199,6 +203,9 @@ struct Request {
     /** Called by finish() to refresh the config, if necessary */
     void maybe_refresh_config(lcb_STATUS rc);
 
+    /** Account the outcome of the request to the circuit breaker of its endpoint, see LCB_CNTL_CIRCUIT_BREAKER */
+    void record_breaker_outcome(lcb_STATUS rc);
+
     /** Finish this request, invoking the final callback if necessary */
     void finish(lcb_STATUS rc);
 
@@ -247,12 +254,21 @@ struct Request {
     std::string peer;       /**< host:port */
     bool ipv6{};
 
+    /** Link into the pending HTTP requests of the instance */
+    lcb_ASPEND_ITEM pending{};
+
     std::string pending_redirect; /**< New redirected URL */
 
-    const std::vector<char> body; /**< Input body (for POST/PUT) */
+    /**
+     * Input body (for POST/PUT). This points either to ::body_copy, or, if
+     * the command had LCB_CMDHTTP_F_BORROWBODY, to the caller's buffer
+     */
+    const char *body;
+    size_t nbody;
+    std::string body_copy;
 
     /** Request buffer (excluding body). Reassembled from inputs */
-    std::vector<char> preamble;
+    std::string preamble;
 
     struct http_parser_url url_info {
     };                                /**< Parser info for the URL */
@@ -310,17 +326,20 @@ struct Request {
          */
         NOLCB = 1 << 2
     };
-    int status;                          /**< OR'd flags of ::State */
-    std::vector<Header> request_headers; /**< List of request headers */
+    int status; /**< OR'd flags of ::State */
 
     /**
-     * Response headers for callback (array of char*). Buffers are mapped to
-     * ::response_headers
+     * Request headers, already formatted as `key: value\r\n` lines, so that
+     * submit() only has to copy them into the ::preamble
      */
-    std::vector<const char *> response_headers_clist;
+    std::string request_headers;
 
-    /** Backing buffers for response headers */
-    std::vector<lcb::htparse::MimeHeader> response_headers;
+    /**
+     * Response headers for callback (array of char*). The strings are owned by
+     * the current response of ::parser, which leaves them untouched until it
+     * is reset for the next request.
+     */
+    std::vector<const char *> response_headers_clist;
 
     /** Callback to invoke */
     lcb_RESPCALLBACK callback;
@@ -334,6 +353,13 @@ struct Request {
     /** HTTP Protocol parser */
     lcb::htparse::Parser *parser;
 
+    /** Whether the library offered compressed responses, see LCB_CNTL_HTTP_COMPRESSION */
+    bool accept_compressed{false};
+    /** Decompressor of the body of the current response, if it is compressed */
+    std::unique_ptr<Inflater> inflater;
+    /** Decompressed bytes of the last chunk of the body */
+    std::string inflated;
+
     /** overrides default timeout if nonzero */
     const uint32_t user_timeout;
 
@@ -238,6 +238,8 @@ void Request::finish_or_retry(lcb_STATUS rc)
         return;
     }
 
+    record_breaker_outcome(rc);
+
     // Reassemble URL:
     lcb_log(LOGARGS(this, DEBUG), LOGFMT "Retrying request on new node %s. Reason: 0x%02x (%s)", LOGID(this), nextnode,
             rc, lcb_strerror_short(rc));
@@ -298,7 +300,7 @@ void Request::init_resp(lcb_RESPHTTP *res)
     res->ctx.path = url.c_str() + url_info.field_data[UF_PATH].off;
     res->ctx.path_len = url_info.field_data[UF_PATH].len;
     res->_htreq = static_cast<lcb_HTTP_HANDLE *>(this);
-    if (!response_headers.empty()) {
+    if (!response_headers_clist.empty()) {
         res->headers = &response_headers_clist[0];
     }
     res->ctx.response_code = htres.status;
@@ -330,10 +332,11 @@ void Request::finish(lcb_STATUS error)
 
     TRACE_HTTP_END(this, error, parser->get_cur_response().status);
     status |= FINISHED;
+    record_breaker_outcome(error);
 
     if (!(status & NOLCB)) {
         /* Remove from wait queue */
-        lcb_aspend_del(&instance->pendops, LCB_PENDTYPE_HTTP, this);
+        lcb_aspend_del(&instance->pendops, LCB_PENDTYPE_HTTP, &pending);
         /* Break out from the loop (must be called after aspend_del) */
         lcb_maybe_breakout(instance);
     }
@@ -346,20 +349,24 @@ void Request::finish(lcb_STATUS error)
     decref();
 }
 
-void Request::add_to_preamble(const char *s)
-{
-    preamble.insert(preamble.end(), s, s + strlen(s));
-}
-void Request::add_to_preamble(const std::string &s)
+#define HEADER_NAME(s) {s, sizeof(s) - 1}
+static const struct {
+    const char *name;
+    size_t len;
+} header_names[HEADER__MAX] = {
+    HEADER_NAME("User-Agent"),    HEADER_NAME("Connection"),     HEADER_NAME("Accept"),
+    HEADER_NAME("Authorization"), HEADER_NAME("Content-Length"), HEADER_NAME("Content-Type"),
+};
+#undef HEADER_NAME
+
+void Request::add_header(HeaderName name, const char *value, size_t nvalue)
 {
-    preamble.insert(preamble.end(), s.c_str(), s.c_str() + s.size());
+    add_header(header_names[name].name, header_names[name].len, value, nvalue);
 }
-void Request::add_to_preamble(const Header &header)
+
+void Request::add_header(const char *key, size_t nkey, const char *value, size_t nvalue)
 {
-    add_to_preamble(header.key);
-    add_to_preamble(": ");
-    add_to_preamble(header.value);
-    add_to_preamble("\r\n");
+    request_headers.append(key, nkey).append(": ", 2).append(value, nvalue).append("\r\n", 2);
 }
 
 lcb_STATUS Request::submit()
@@ -375,42 +382,37 @@ lcb_STATUS Request::submit()
         return LCB_ERR_VALUE_TOO_LARGE;
     }
 
-    preamble.clear();
-
     strncpy(reqhost.host, host.c_str(), host.size());
     strncpy(reqhost.port, port.c_str(), port.size());
     reqhost.host[host.size()] = '\0';
     reqhost.port[port.size()] = '\0';
     reqhost.ipv6 = ipv6;
 
-    // Add the HTTP verb (e.g. "GET ") [note, the string contains a trailing space]
-    add_to_preamble(method_strings[method]);
-
-    // Add the path
+    static const char http_version[] = " HTTP/1.1\r\nHost: ";
+    const char *verb = method_strings[method];
+    const size_t nverb = strlen(verb);
     const char *url_s = url.c_str();
     size_t path_off = url_info.field_data[UF_PATH].off;
     size_t path_len = url.size() - path_off;
-    preamble.insert(preamble.end(), url_s + path_off, url_s + path_off + path_len);
-    lcb_log(LOGARGS(this, TRACE), LOGFMT "%s %s. Body=%lu bytes", LOGID(this), method_strings[method], url.c_str(),
-            (unsigned long int)body.size());
+    lcb_log(LOGARGS(this, TRACE), LOGFMT "%s %s. Body=%lu bytes", LOGID(this), verb, url.c_str(),
+            (unsigned long int)nbody);
 
-    add_to_preamble(" HTTP/1.1\r\n");
+    // Size the buffer up front, so that building it takes a single allocation
+    preamble.clear();
+    preamble.reserve(nverb + path_len + sizeof(http_version) - 1 + host.size() + 1 + port.size() + 2 +
+                     request_headers.size() + 2);
+
+    // The HTTP verb (e.g. "GET ") [note, the string contains a trailing space]
+    // and the path
+    preamble.append(verb, nverb).append(url_s + path_off, path_len);
 
     // Add the Host: header manually. If redirected to a different host then
     // we need to recalculate this, so don't make this part of the
     // global headers (which are typically not cleared)
-    add_to_preamble("Host: ");
-    add_to_preamble(host);
-    add_to_preamble(":");
-    add_to_preamble(port);
-    add_to_preamble("\r\n");
+    preamble.append(http_version, sizeof(http_version) - 1).append(host).append(1, ':').append(port).append("\r\n", 2);
 
     // Add the rest of the headers
-    std::vector<Header>::const_iterator ii = request_headers.begin();
-    for (; ii != request_headers.end(); ++ii) {
-        add_to_preamble(*ii);
-    }
-    add_to_preamble("\r\n");
+    preamble.append(request_headers).append("\r\n", 2);
     // If there is a body, it is appended in the IO stage
 
     rc = start_io(reqhost);
@@ -423,7 +425,6 @@ lcb_STATUS Request::submit()
         } else {
             parser = new lcb::htparse::Parser(instance->settings);
         }
-        response_headers.clear();
         response_headers_clist.clear();
         TRACE_HTTP_BEGIN(this);
     }
@@ -544,6 +545,64 @@ static lcbvb_SVCTYPE httype2svctype(unsigned httype)
     }
 }
 
+int lcb_select_http_node(lcb_INSTANCE *instance, lcbvb_SVCTYPE svc, const int *used)
+{
+    lcbvb_CONFIG *vbc = LCBT_VBCONFIG(instance);
+    const lcbvb_SVCMODE mode = LCBT_SETTING_SVCMODE(instance);
+    const char *group = LCBT_SETTING(instance, preferred_server_group);
+    int best = -1;
+    bool best_local = false;
+    size_t best_load = 0;
+    unsigned nbest = 0;
+
+    for (size_t ii = 0; ii < LCBVB_NSERVERS(vbc); ++ii) {
+        if (used && used[ii]) {
+            continue;
+        }
+        const char *hp = lcbvb_get_hostport(vbc, ii, svc, mode);
+        if (hp == nullptr) {
+            continue;
+        }
+        const char *node_group = lcbvb_get_server_group(vbc, ii);
+        bool local = group != nullptr && node_group != nullptr && strcmp(group, node_group) == 0;
+        if (best_local && !local) {
+            continue;
+        }
+        size_t load = instance->http_sockpool->in_flight(hp);
+        if (best == -1 || (local && !best_local) || load < best_load) {
+            best = static_cast<int>(ii);
+            best_local = local;
+            best_load = load;
+            nbest = 1;
+        } else if (load == best_load && lcb_next_rand32() % ++nbest == 0) {
+            /* every one of the equally loaded nodes is picked with the same probability */
+            best = static_cast<int>(ii);
+        }
+    }
+    return best;
+}
+
+/** Whether the circuit breaker of the HTTP endpoint `hostport` lets requests through */
+static bool http_breaker_allows(lcb_INSTANCE *instance, const char *hostport)
+{
+    auto it = instance->http_breakers->find(hostport);
+    return it == instance->http_breakers->end() || it->second.allows(*instance->settings);
+}
+
+void Request::record_breaker_outcome(lcb_STATUS rc)
+{
+    if (!LCBT_SETTING(instance, circuit_breaker) || !is_data_request() || peer.empty() ||
+        rc == LCB_ERR_REQUEST_CANCELED) {
+        return;
+    }
+    lcb::CircuitBreaker &breaker = (*instance->http_breakers)[peer];
+    if ((lcb_error_flags(rc) & LCB_ERROR_FLAG_NETWORK) == 0) {
+        breaker.record_success();
+    } else if (breaker.record_failures(1, gethrtime(), *instance->settings)) {
+        lcb_log(LOGARGS(this, WARN), LOGFMT "Circuit breaker of %s opened", LOGID(this), peer.c_str());
+    }
+}
+
 const char *Request::get_api_node(lcb_STATUS &rc)
 {
     if (!is_data_request()) {
@@ -566,12 +625,37 @@ const char *Request::get_api_node(lcb_STATUS &rc)
     }
     used_nodes.resize(LCBVB_NSERVERS(vbc));
 
-    int ix = lcbvb_get_randhost_ex(vbc, svc, mode, &used_nodes[0]);
+    /* Nodes whose circuit breaker is open are skipped as if they had been tried */
+    std::vector<int> candidates(used_nodes);
+    bool rejected = false;
+    if (LCBT_SETTING(instance, circuit_breaker) && !instance->http_breakers->empty()) {
+        for (size_t ii = 0; ii < candidates.size(); ++ii) {
+            const char *hp = candidates[ii] ? nullptr : lcbvb_get_hostport(vbc, ii, svc, mode);
+            if (hp != nullptr && !http_breaker_allows(instance, hp)) {
+                candidates[ii] = 1;
+                rejected = true;
+            }
+        }
+    }
+
+    int ix;
+    if (svc == LCBVB_SVCTYPE_QUERY || svc == LCBVB_SVCTYPE_SEARCH || svc == LCBVB_SVCTYPE_ANALYTICS) {
+        ix = lcb_select_http_node(instance, svc, &candidates[0]);
+    } else {
+        ix = lcbvb_get_randhost_group(vbc, svc, mode, &candidates[0], LCBT_SETTING(instance, preferred_server_group));
+    }
     if (ix < 0) {
-        rc = LCB_ERR_UNSUPPORTED_OPERATION;
+        rc = rejected ? LCB_ERR_CIRCUIT_BREAKER_OPEN : LCB_ERR_UNSUPPORTED_OPERATION;
         return nullptr;
     }
     used_nodes[ix] = 1;
+    if (LCBT_SETTING(instance, circuit_breaker)) {
+        auto it = instance->http_breakers->find(lcbvb_get_hostport(vbc, ix, svc, mode));
+        if (it != instance->http_breakers->end()) {
+            /* counts as a canary if the breaker is half-open */
+            it->second.admit(*instance->settings);
+        }
+    }
     return lcbvb_get_resturl(vbc, ix, svc, mode);
 }
 
@@ -693,13 +777,33 @@ lcb_STATUS Request::setup_inputs(const lcb_CMDHTTP *cmd)
     if (instance->settings->client_string) {
         ua.append(" ").append(instance->settings->client_string);
     }
-    add_header("User-Agent", ua);
+    add_header(HEADER_USER_AGENT, ua.c_str(), ua.size());
 
     if (instance->http_sockpool->get_options().maxidle == 0 || !is_data_request()) {
-        add_header("Connection", "close");
+        add_header(HEADER_CONNECTION, "close", 5);
+    }
+
+    add_header(HEADER_ACCEPT, "application/json", 16);
+    if (LCBT_SETTING(instance, http_compression) && Inflater::accepted_encodings() != nullptr) {
+        switch (reqtype) {
+            case LCB_HTTP_TYPE_QUERY:
+            case LCB_HTTP_TYPE_SEARCH:
+            case LCB_HTTP_TYPE_ANALYTICS:
+                accept_compressed = true;
+                break;
+            default:
+                break;
+        }
+        // Bodies the application asked to be encoded are passed on as they are
+        for (const auto &header : cmd->headers_) {
+            if (strcasecmp(header.first.c_str(), "Accept-Encoding") == 0) {
+                accept_compressed = false;
+            }
+        }
+        if (accept_compressed) {
+            add_header("Accept-Encoding", Inflater::accepted_encodings());
+        }
     }
-
-    add_header("Accept", "application/json");
     if (!username.empty()) {
         char auth[256];
         std::string upassbuf;
@@ -707,15 +811,17 @@ lcb_STATUS Request::setup_inputs(const lcb_CMDHTTP *cmd)
         if (lcb_base64_encode(upassbuf.c_str(), upassbuf.size(), auth, sizeof(auth)) == -1) {
             return LCB_ERR_INVALID_ARGUMENT;
         }
-        add_header("Authorization", std::string("Basic ") + auth);
+        std::string value("Basic ");
+        value.append(auth);
+        add_header(HEADER_AUTHORIZATION, value.c_str(), value.size());
     }
 
-    if (!body.empty()) {
+    if (nbody) {
         char lenbuf[64];
-        snprintf(lenbuf, sizeof(lenbuf), "%lu", (unsigned long int)body.size());
-        add_header("Content-Length", lenbuf);
+        int nlen = snprintf(lenbuf, sizeof(lenbuf), "%lu", (unsigned long int)nbody);
+        add_header(HEADER_CONTENT_LENGTH, lenbuf, nlen);
         if (cmd->content_type) {
-            add_header("Content-Type", cmd->content_type);
+            add_header(HEADER_CONTENT_TYPE, cmd->content_type, strlen(cmd->content_type));
         }
     }
 
@@ -723,14 +829,19 @@ lcb_STATUS Request::setup_inputs(const lcb_CMDHTTP *cmd)
 }
 
 Request::Request(lcb_INSTANCE *instance_, const void *cookie, const lcb_CMDHTTP *cmd)
-    : instance(instance_), body(cmd->body, cmd->body + cmd->nbody), method(cmd->method),
+    : instance(instance_), body(cmd->body), nbody(cmd->nbody), method(cmd->method),
       chunked(cmd->cmdflags & LCB_CMDHTTP_F_STREAM), paused(false), command_cookie(cookie), refcount(1), redircount(0),
       span(nullptr), passed_data(false), last_vbcrev(-1), reqtype(cmd->type), status(ONGOING),
       callback(lcb_find_callback(instance, LCB_CALLBACK_HTTP)), io(instance->iotable), ioctx(nullptr), timer(nullptr),
       parser(nullptr), user_timeout(cmd->cmdflags & LCB_CMDHTTP_F_CASTMO ? cmd->cas : 0)
 {
+    lcb_aspend_item_init(&pending, this);
+    if (nbody && !(cmd->cmdflags & LCB_CMDHTTP_F_BORROWBODY)) {
+        body_copy.assign(cmd->body, cmd->nbody);
+        body = body_copy.c_str();
+    }
     for (const auto &pair : cmd->headers_) {
-        request_headers.emplace_back(Header(pair.first, pair.second));
+        add_header(pair.first, pair.second);
     }
 }
 
@@ -777,7 +888,7 @@ Request *Request::create(lcb_INSTANCE *instance, const void *cookie, const lcb_C
         if (cmd->reqhandle) {
             *cmd->reqhandle = static_cast<lcb_HTTP_HANDLE *>(req);
         }
-        lcb_aspend_add(&instance->pendops, LCB_PENDTYPE_HTTP, req);
+        lcb_aspend_add(&instance->pendops, LCB_PENDTYPE_HTTP, &req->pending);
         return req;
     } else {
         // Do not call finish() as we don't want a callback
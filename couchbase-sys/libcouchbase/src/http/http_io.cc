@@ -34,13 +34,11 @@ using namespace lcb::http;
 
 void Request::assign_response_headers(const lcb::htparse::Response &resp)
 {
-    response_headers.assign(resp.headers.begin(), resp.headers.end());
     response_headers_clist.clear();
-
-    std::vector<lcb::htparse::MimeHeader>::const_iterator ii;
-    for (ii = response_headers.begin(); ii != response_headers.end(); ++ii) {
-        response_headers_clist.push_back(ii->key.c_str());
-        response_headers_clist.push_back(ii->value.c_str());
+    response_headers_clist.reserve(resp.headers.size() * 2 + 1);
+    for (const auto &header : resp.headers) {
+        response_headers_clist.push_back(header.key.c_str());
+        response_headers_clist.push_back(header.value.c_str());
     }
     response_headers_clist.push_back(nullptr);
 }
@@ -53,15 +51,18 @@ unsigned Request::handle_parse_chunked(const char *buf, unsigned nbuf)
 
     do {
         const char *rbody;
-        unsigned nused = -1, nbody = -1;
+        unsigned nused = -1, nrbody = -1;
         unsigned oldstate = res.state;
 
-        parse_state = parser->parse_ex(buf, nbuf, &nused, &nbody, &rbody);
+        parse_state = parser->parse_ex(buf, nbuf, &nused, &nrbody, &rbody);
         diff = oldstate ^ parse_state;
 
         /* Got headers now for the first time */
         if (diff & Parser::S_HEADER) {
             assign_response_headers(res);
+            if (accept_compressed) {
+                inflater.reset(Inflater::create(res.get_header_value("Content-Encoding")));
+            }
             if (res.status >= 300 && res.status <= 400) {
                 const char *redir = res.get_header_value("Location");
                 if (redir != nullptr) {
@@ -76,18 +77,32 @@ unsigned Request::handle_parse_chunked(const char *buf, unsigned nbuf)
             return parse_state;
         }
 
-        if (nbody) {
+        if (nrbody && inflater) {
+            inflated.clear();
+            if (!inflater->feed(rbody, nrbody, inflated)) {
+                lcb_log(LOGARGS(this, ERR), LOGFMT "Could not decompress the body of the response", LOGID(this));
+                return parse_state | Parser::S_ERROR;
+            }
+            if (instance->settings->metrics) {
+                instance->settings->metrics->http_bytes_compressed += nrbody;
+                instance->settings->metrics->http_bytes_decompressed += inflated.size();
+            }
+            rbody = inflated.c_str();
+            nrbody = static_cast<unsigned>(inflated.size());
+        }
+
+        if (nrbody) {
             if (chunked) {
                 lcb_RESPHTTP htresp{};
                 init_resp(&htresp);
                 htresp.ctx.body = rbody;
-                htresp.ctx.body_len = nbody;
+                htresp.ctx.body_len = nrbody;
                 htresp.ctx.rc = LCB_SUCCESS;
                 passed_data = true;
                 callback(instance, LCB_CALLBACK_HTTP, (const lcb_RESPBASE *)&htresp);
 
             } else {
-                res.body.append(rbody, nbody);
+                res.body.append(rbody, nrbody);
             }
         }
 
@@ -233,6 +248,11 @@ static void request_timed_out(void *arg)
     (reinterpret_cast<Request *>(arg))->finish(LCB_ERR_TIMEOUT);
 }
 
+static void release_body(void *arg)
+{
+    reinterpret_cast<Request *>(arg)->decref();
+}
+
 static void on_connected(lcbio_SOCKET *sock, void *arg, lcb_STATUS err, lcbio_OSERR syserr)
 {
     auto *req = reinterpret_cast<Request *>(arg);
@@ -255,9 +275,14 @@ static void on_connected(lcbio_SOCKET *sock, void *arg, lcb_STATUS err, lcbio_OS
     procs.cb_read = io_read;
     req->ioctx = lcbio_ctx_new(sock, arg, &procs, "mgmt/capi");
     sock->service = service;
-    lcbio_ctx_put(req->ioctx, &req->preamble[0], req->preamble.size());
-    if (!req->body.empty()) {
-        lcbio_ctx_put(req->ioctx, &req->body[0], req->body.size());
+    lcbio_ctx_put(req->ioctx, req->preamble.c_str(), req->preamble.size());
+    if (req->nbody) {
+        /* The body is written straight from the request, which is kept alive until it is no longer referenced */
+        lcb_IOV iov;
+        iov.iov_base = const_cast<char *>(req->body);
+        iov.iov_len = req->nbody;
+        req->incref();
+        lcbio_ctx_putv_nocopy(req->ioctx, &iov, 1, release_body, req);
     }
     lcbio_ctx_rwant(req->ioctx, 1);
     lcbio_ctx_schedule(req->ioctx);
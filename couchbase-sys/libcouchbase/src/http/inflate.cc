@@ -0,0 +1,141 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include "inflate.h"
+
+#include <cstring>
+
+#ifndef LCB_NO_HTTP_COMPRESSION
+#include <zlib.h>
+#endif
+
+using namespace lcb::http;
+
+#ifdef LCB_NO_HTTP_COMPRESSION
+
+const char *Inflater::accepted_encodings()
+{
+    return nullptr;
+}
+
+Inflater *Inflater::create(const char *)
+{
+    return nullptr;
+}
+
+Inflater::Inflater(bool deflate) : deflate_(deflate) {}
+
+Inflater::~Inflater() = default;
+
+bool Inflater::feed(const char *, std::size_t, std::string &)
+{
+    return false;
+}
+
+#else
+
+/* Adding 32 to the window bits detects the gzip and zlib headers alike */
+#define WBITS_AUTO (15 + 32)
+#define WBITS_RAW (-15)
+
+const char *Inflater::accepted_encodings()
+{
+    return "gzip, deflate";
+}
+
+Inflater *Inflater::create(const char *encoding)
+{
+    if (encoding == nullptr) {
+        return nullptr;
+    }
+    bool deflate;
+    if (strcasecmp(encoding, "gzip") == 0 || strcasecmp(encoding, "x-gzip") == 0) {
+        deflate = false;
+    } else if (strcasecmp(encoding, "deflate") == 0) {
+        deflate = true;
+    } else {
+        return nullptr;
+    }
+    auto *inflater = new Inflater(deflate);
+    if (inflater->stream_ == nullptr) {
+        delete inflater;
+        return nullptr;
+    }
+    return inflater;
+}
+
+Inflater::Inflater(bool deflate) : deflate_(deflate)
+{
+    stream_ = new z_stream();
+    if (inflateInit2(stream_, WBITS_AUTO) != Z_OK) {
+        delete stream_;
+        stream_ = nullptr;
+    }
+}
+
+Inflater::~Inflater()
+{
+    if (stream_ != nullptr) {
+        inflateEnd(stream_);
+        delete stream_;
+    }
+}
+
+bool Inflater::feed(const char *buf, std::size_t nbuf, std::string &out)
+{
+    /* Anything after the end of the compressed stream is ignored */
+    if (done_) {
+        return true;
+    }
+
+    stream_->next_in = reinterpret_cast<Bytef *>(const_cast<char *>(buf));
+    stream_->avail_in = static_cast<uInt>(nbuf);
+
+    for (;;) {
+        char chunk[16384];
+        stream_->next_out = reinterpret_cast<Bytef *>(chunk);
+        stream_->avail_out = sizeof(chunk);
+
+        int rc = inflate(stream_, Z_NO_FLUSH);
+        if (rc == Z_DATA_ERROR && deflate_ && !raw_ && stream_->total_out == 0) {
+            /* Some servers send `deflate` without the zlib header */
+            raw_ = true;
+            if (inflateReset2(stream_, WBITS_RAW) != Z_OK) {
+                return false;
+            }
+            stream_->next_in = reinterpret_cast<Bytef *>(const_cast<char *>(buf));
+            stream_->avail_in = static_cast<uInt>(nbuf);
+            continue;
+        }
+        out.append(chunk, sizeof(chunk) - stream_->avail_out);
+
+        if (rc == Z_STREAM_END) {
+            done_ = true;
+            return true;
+        }
+        if (rc != Z_OK && rc != Z_BUF_ERROR) {
+            return false;
+        }
+        /* The output only fills up if more of it is pending, otherwise the input is used up */
+        if (stream_->avail_out != 0) {
+            return true;
+        }
+    }
+}
+
+#endif
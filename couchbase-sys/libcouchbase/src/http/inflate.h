@@ -0,0 +1,80 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCB_HTTP_INFLATE_H
+#define LCB_HTTP_INFLATE_H
+
+#include <cstddef>
+#include <string>
+
+struct z_stream_s;
+
+namespace lcb
+{
+namespace http
+{
+
+/**
+ * Streaming decompression of a response body sent with one of the encodings
+ * offered in `Accept-Encoding`, see LCB_CNTL_HTTP_COMPRESSION. The body is
+ * decompressed chunk by chunk as it is read, so that the parsers of the rows
+ * are fed as before.
+ */
+class Inflater
+{
+  public:
+    /**
+     * @return the value of the `Accept-Encoding` header, or nullptr if the
+     * library was built with LCB_NO_HTTP_COMPRESSION
+     */
+    static const char *accepted_encodings();
+
+    /**
+     * @param encoding the value of the `Content-Encoding` header of the response
+     * @return the decompressor of the body, or nullptr if the body is not
+     * encoded in one of the accepted encodings
+     */
+    static Inflater *create(const char *encoding);
+
+    ~Inflater();
+
+    /**
+     * Decompress the next bytes of the body
+     * @param buf the compressed bytes
+     * @param nbuf their number
+     * @param out the decompressed bytes are appended to it
+     * @return false if the body is corrupt
+     */
+    bool feed(const char *buf, std::size_t nbuf, std::string &out);
+
+    Inflater(const Inflater &) = delete;
+    Inflater &operator=(const Inflater &) = delete;
+
+  private:
+    explicit Inflater(bool deflate);
+
+    z_stream_s *stream_{nullptr};
+    /** `deflate` may be sent without the zlib wrapper */
+    bool deflate_;
+    bool raw_{false};
+    bool done_{false};
+};
+
+} // namespace http
+} // namespace lcb
+
+#endif /* LCB_HTTP_INFLATE_H */
@@ -23,12 +23,15 @@
 #include "rnd.h"
 #include "http/http.h"
 #include "bucketconfig/clconfig.h"
+#include "bucketconfig/shared_config.h"
 #include "metrics/caching_meter.hh"
+#include "metrics/metrics-internal.h"
 #ifdef LCB_USE_HDR_HISTOGRAM
 #include "metrics/logging_meter.hh"
 #endif
 #include <lcbio/iotable.h>
 #include <lcbio/ssl.h>
+#include <lcbio/resolve.h>
 #include "defer.h"
 
 #define LOGARGS(obj, lvl) (obj)->settings, "instance", LCB_LOG_##lvl, __FILE__, __LINE__
@@ -206,7 +209,8 @@ lcb_STATUS lcb_st::process_dns_srv(Connspec &spec)
 
     const Spechost &host = spec.hosts().front();
     lcb_STATUS rc = LCB_ERR_SDK_INTERNAL;
-    Hostlist *hl = dnssrv_getbslist(host.hostname.c_str(), spec.sslopts() & LCB_SSL_ENABLED, rc);
+    bool is_ssl = spec.sslopts() & LCB_SSL_ENABLED;
+    Hostlist *hl = dnssrv_getbslist(host.hostname.c_str(), is_ssl, rc);
 
     if (hl == nullptr) {
         lcb_log(LOGARGS(this, INFO), "DNS SRV lookup failed: %s. Ignore this if not relying on DNS SRV records",
@@ -218,6 +222,8 @@ lcb_STATUS lcb_st::process_dns_srv(Connspec &spec)
         }
     }
 
+    free(settings->srv_name);
+    settings->srv_name = lcb_strdup(dnssrv_name(host.hostname.c_str(), is_ssl).c_str());
     spec.clear_hosts();
     for (size_t ii = 0; ii < hl->size(); ++ii) {
         const lcb_host_t &src = (*hl)[ii];
@@ -313,7 +319,7 @@ static lcb_STATUS init_providers(lcb_INSTANCE *obj, const Connspec &spec)
     return LCB_SUCCESS;
 }
 
-static lcb_STATUS setup_ssl(lcb_INSTANCE *obj, const Connspec &params)
+static lcb_STATUS setup_ssl(lcb_INSTANCE *obj, const Connspec &params, const lcb_INSTANCE *tmpl)
 {
     char optbuf[4096];
     long env_policy = -1;
@@ -368,8 +374,14 @@ static lcb_STATUS setup_ssl(lcb_INSTANCE *obj, const Connspec &params)
             lcb_log(LOGARGS(obj, ERR), "SSL key have to be specified with certificate");
             return LCB_ERR_INVALID_ARGUMENT;
         }
-        settings->ssl_ctx = lcbio_ssl_new(settings->truststorepath, settings->certpath, settings->keypath,
-                                          settings->sslopts & LCB_SSL_NOVERIFY, &err, settings);
+        if (tmpl != nullptr && tmpl->settings->ssl_ctx != nullptr) {
+            /* loading the trust store is what takes the longest */
+            settings->ssl_ctx = lcbio_ssl_share(tmpl->settings->ssl_ctx);
+            err = LCB_ERR_NO_MEMORY;
+        } else {
+            settings->ssl_ctx = lcbio_ssl_new(settings->truststorepath, settings->certpath, settings->keypath,
+                                              settings->sslopts & LCB_SSL_NOVERIFY, &err, settings);
+        }
         if (!settings->ssl_ctx) {
             return err;
         }
@@ -443,29 +455,19 @@ GT_DONE:
     return err;
 }
 
-LIBCOUCHBASE_API
-lcb_STATUS lcb_create(lcb_INSTANCE **instance, const lcb_CREATEOPTS *options)
+/**
+ * Create an instance from a parsed connection string, either for lcb_create(), or for lcb_create_from_template(), in
+ * which case the SSL context, the DNS SRV hosts, the credentials, the error map and the collections are taken from
+ * the template.
+ */
+static lcb_STATUS create_instance(lcb_INSTANCE **instance, Connspec &spec, lcb_INSTANCE_TYPE type,
+                                  const lcb_CREATEOPTS *options, const lcb_INSTANCE *tmpl)
 {
-    Connspec spec;
-    struct lcb_io_opt_st *io_priv = nullptr;
-    lcb_INSTANCE_TYPE type = LCB_TYPE_BUCKET;
+    struct lcb_io_opt_st *io_priv = options ? options->io : nullptr;
     lcb_INSTANCE *obj = nullptr;
-    lcb_STATUS err;
+    lcb_STATUS err = LCB_SUCCESS;
     lcb_settings *settings;
 
-    if (options) {
-        io_priv = options->io;
-        type = options->type;
-        err = spec.load(*options);
-    } else {
-        const char *errmsg;
-        const char *default_connstr = "couchbase://";
-        err = spec.parse(default_connstr, strlen(default_connstr), &errmsg);
-    }
-    if (err != LCB_SUCCESS) {
-        goto GT_DONE;
-    }
-
     {
         // Warn users if they attempt to use Capella without TLS being enabled.
         bool is_capella = false;
@@ -489,8 +491,11 @@ lcb_STATUS lcb_create(lcb_INSTANCE **instance, const lcb_CREATEOPTS *options)
         err = LCB_ERR_NO_MEMORY;
         goto GT_DONE;
     }
+    /* before any failure, lcb_destroy() walks the pending lists */
+    lcb_aspend_init(&obj->pendops);
     obj->crypto = new std::map<std::string, lcbcrypto_PROVIDER *>();
-    obj->deferred_operations = new std::list<std::function<void(lcb_STATUS)>>();
+    obj->deferred_operations = new lcb::DeferredQueue();
+    obj->http_breakers = new std::map<std::string, lcb::CircuitBreaker>();
     if (!(settings = lcb_settings_new())) {
         err = LCB_ERR_NO_MEMORY;
         goto GT_DONE;
@@ -512,6 +517,9 @@ lcb_STATUS lcb_create(lcb_INSTANCE **instance, const lcb_CREATEOPTS *options)
     if (options != nullptr && options->auth != nullptr) {
         lcbauth_unref(settings->auth);
         settings->auth = lcbauth_clone(options->auth);
+    } else if (tmpl != nullptr) {
+        lcbauth_unref(settings->auth);
+        settings->auth = lcbauth_clone(tmpl->settings->auth);
     } else {
         if (!spec.username().empty()) {
             settings->auth->set_mode(LCBAUTH_MODE_RBAC);
@@ -559,6 +567,7 @@ lcb_STATUS lcb_create(lcb_INSTANCE **instance, const lcb_CREATEOPTS *options)
 
     obj->cmdq.cqdata = obj;
     obj->iotable = lcbio_table_new(io_priv);
+    settings->resolver = new io::Resolver(obj->iotable, settings);
     obj->memd_sockpool = new io::Pool(settings, obj->iotable);
     obj->http_sockpool = new io::Pool(settings, obj->iotable);
 
@@ -577,10 +586,9 @@ lcb_STATUS lcb_create(lcb_INSTANCE **instance, const lcb_CREATEOPTS *options)
     obj->retryq = new RetryQueue(&obj->cmdq, obj->iotable, obj->settings);
     obj->n1ql_cache = lcb_n1qlcache_create();
     lcb_initialize_packet_handlers(obj);
-    lcb_aspend_init(&obj->pendops);
     obj->collcache = new lcb::CollectionCache();
 
-    if ((err = setup_ssl(obj, spec)) != LCB_SUCCESS) {
+    if ((err = setup_ssl(obj, spec, tmpl)) != LCB_SUCCESS) {
         goto GT_DONE;
     }
 
@@ -591,14 +599,28 @@ lcb_STATUS lcb_create(lcb_INSTANCE **instance, const lcb_CREATEOPTS *options)
         goto GT_DONE;
     }
 
-    if ((err = obj->process_dns_srv(spec)) != LCB_SUCCESS) {
-        goto GT_DONE;
+    if (tmpl == nullptr) {
+        if ((err = obj->process_dns_srv(spec)) != LCB_SUCCESS) {
+            goto GT_DONE;
+        }
+    } else if (tmpl->settings->srv_name != nullptr) {
+        /* the hosts of the records are already in the connection string of the template */
+        free(settings->srv_name);
+        settings->srv_name = lcb_strdup(tmpl->settings->srv_name);
     }
+    obj->connspec = new Connspec(spec);
 
     obj->populate_nodes(spec);
     if ((err = init_providers(obj, spec)) != LCB_SUCCESS) {
         goto GT_DONE;
     }
+    if (tmpl != nullptr) {
+        settings->errmap->assign(*tmpl->settings->errmap);
+        if (tmpl->settings->bucket != nullptr && settings->bucket != nullptr &&
+            strcmp(tmpl->settings->bucket, settings->bucket) == 0) {
+            obj->collcache->assign(*tmpl->collcache);
+        }
+    }
     if (settings->use_tracing) {
         if (options && options->tracer) {
             settings->tracer = options->tracer;
@@ -625,6 +647,41 @@ GT_DONE:
     return err;
 }
 
+LIBCOUCHBASE_API
+lcb_STATUS lcb_create(lcb_INSTANCE **instance, const lcb_CREATEOPTS *options)
+{
+    Connspec spec;
+    lcb_INSTANCE_TYPE type = LCB_TYPE_BUCKET;
+    lcb_STATUS err;
+
+    if (options) {
+        type = options->type;
+        err = spec.load(*options);
+    } else {
+        const char *errmsg;
+        const char *default_connstr = "couchbase://";
+        err = spec.parse(default_connstr, strlen(default_connstr), &errmsg);
+    }
+    if (err != LCB_SUCCESS) {
+        *instance = nullptr;
+        return err;
+    }
+    return create_instance(instance, spec, type, options, nullptr);
+}
+
+LIBCOUCHBASE_API
+lcb_STATUS lcb_create_from_template(lcb_INSTANCE **instance, const lcb_INSTANCE *tmpl, const lcb_CREATEOPTS *options)
+{
+    if (instance == nullptr || tmpl == nullptr || tmpl->connspec == nullptr) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    Connspec spec(*tmpl->connspec);
+    if (options != nullptr && options->bucket != nullptr && options->bucket_len != 0) {
+        spec.bucket(std::string(options->bucket, options->bucket_len));
+    }
+    return create_instance(instance, spec, static_cast<lcb_INSTANCE_TYPE>(tmpl->settings->conntype), options, tmpl);
+}
+
 LIBCOUCHBASE_API
 int lcb_is_redacting_logs(lcb_INSTANCE *instance)
 {
@@ -667,8 +724,7 @@ void lcb_destroy(lcb_INSTANCE *instance)
     }
 
     lcb_ASPEND *po = &instance->pendops;
-    lcb_ASPEND_SETTYPE::iterator it;
-    lcb_ASPEND_SETTYPE *pendq;
+    lcb_list_t *pos, *next;
 
     DESTROY(delete, bs_state)
     DESTROY(delete, ht_nodes)
@@ -676,21 +732,33 @@ void lcb_destroy(lcb_INSTANCE *instance)
 
     lcb::cancel_deferred_operations(instance);
     delete instance->deferred_operations;
+    DESTROY(lcb_pending_stores_destroy, pending_stores)
+    DESTROY(lcb_near_cache_destroy, near_cache)
+    DESTROY(lcbio_timer_destroy, flush_timer)
+    DESTROY(lcbio_timer_destroy, health_timer)
+    DESTROY(lcbio_timer_destroy, trim_timer)
 
-    if ((pendq = po->items[LCB_PENDTYPE_DURABILITY])) {
-        std::vector<void *> dsets(pendq->begin(), pendq->end());
+    {
+        std::vector<void *> dsets;
+        LCB_ASPEND_FOR(pos, next, po, LCB_PENDTYPE_DURABILITY)
+        {
+            dsets.push_back(LCB_ASPEND_OWNER(pos));
+        }
         for (auto &dset : dsets) {
             lcbdur_destroy(dset);
         }
-        pendq->clear();
     }
 
-    for (size_t ii = 0; ii < LCBT_NSERVERS(instance); ++ii) {
-        instance->get_server(ii)->close();
+    for (size_t ii = 0; ii < MCREQ_NPIPELINES_ALL(&instance->cmdq); ++ii) {
+        instance->get_server(ii)->close(instance->settings && instance->settings->fastdtor);
     }
 
-    if ((pendq = po->items[LCB_PENDTYPE_HTTP])) {
-        std::vector<void *> requests(pendq->begin(), pendq->end());
+    {
+        std::vector<void *> requests;
+        LCB_ASPEND_FOR(pos, next, po, LCB_PENDTYPE_HTTP)
+        {
+            requests.push_back(LCB_ASPEND_OWNER(pos));
+        }
         for (void *request : requests) {
             auto *htreq = reinterpret_cast<http::Request *>(request);
             htreq->finish(LCB_ERR_REQUEST_CANCELED);
@@ -698,6 +766,7 @@ void lcb_destroy(lcb_INSTANCE *instance)
     }
 
     DESTROY(delete, retryq)
+    DESTROY(delete, shared_config)
     DESTROY(delete, confmon)
     DESTROY(do_pool_shutdown, memd_sockpool)
     DESTROY(do_pool_shutdown, http_sockpool)
@@ -706,7 +775,7 @@ void lcb_destroy(lcb_INSTANCE *instance)
 
     if (instance->cmdq.pipelines) {
         unsigned ii;
-        for (ii = 0; ii < instance->cmdq.npipelines; ii++) {
+        for (ii = 0; ii < MCREQ_NPIPELINES_ALL(&instance->cmdq); ii++) {
             auto *server = static_cast<lcb::Server *>(instance->cmdq.pipelines[ii]);
             if (server) {
                 server->instance = nullptr;
@@ -716,20 +785,37 @@ void lcb_destroy(lcb_INSTANCE *instance)
     }
     mcreq_queue_cleanup(&instance->cmdq);
     DESTROY(delete, collcache)
+    DESTROY(free, inflate_buf)
+    DESTROY(lcb_get_latency_destroy, get_latency)
+    DESTROY(lcb_inflight_gets_destroy, inflight_gets)
+    DESTROY(lcb_inflight_prepares_destroy, inflight_prepares)
+    DESTROY(lcb_value_maps_destroy, value_maps)
+    DESTROY(lcb_stats_cache_destroy, stats_cache)
+    DESTROY(lcb_respbatch_destroy, respbatch)
+    DESTROY(lcb_hot_keys_destroy, hot_keys)
     if (instance->cur_configinfo) {
         instance->cur_configinfo->decref();
         instance->cur_configinfo = nullptr;
     }
     instance->cmdq.config = nullptr;
     instance->cmdq.cqdata = nullptr;
+    DESTROY(lcb_flight_recorder_destroy, flightrec)
     lcb_aspend_cleanup(po);
 
+    if (instance->settings && instance->settings->resolver) {
+        /* connections still resolving keep a reference, but are never notified */
+        instance->settings->resolver->shutdown();
+        instance->settings->resolver->unref();
+        instance->settings->resolver = nullptr;
+    }
+
     if (instance->settings && instance->settings->tracer) {
         lcbtrace_destroy(instance->settings->tracer);
         instance->settings->tracer = nullptr;
     }
 
-    if (instance->iotable && instance->iotable->refcount > 1 && instance->settings && instance->settings->syncdtor) {
+    if (instance->iotable && instance->iotable->refcount > 1 && instance->settings && instance->settings->syncdtor &&
+        !instance->settings->fastdtor) {
         /* create an async object */
         SYNCDTOR sd;
         sd.table = instance->iotable;
@@ -763,6 +849,10 @@ void lcb_destroy(lcb_INSTANCE *instance)
     }
     delete instance->crypto;
     instance->crypto = nullptr;
+    delete instance->http_breakers;
+    instance->http_breakers = nullptr;
+    delete instance->connspec;
+    instance->connspec = nullptr;
 
     delete[] instance->dcpinfo;
     memset(instance, 0xff, sizeof(*instance));
@@ -823,7 +913,7 @@ lcb_STATUS lcb_open(lcb_INSTANCE *instance, const char *bucket, size_t bucket_le
     instance->settings->conntype = LCB_TYPE_BUCKET;
     instance->settings->bucket = (char *)calloc(bucket_len + 1, sizeof(char));
     memcpy(instance->settings->bucket, bucket, bucket_len);
-    for (unsigned ii = 0; ii < instance->cmdq.npipelines; ii++) {
+    for (unsigned ii = 0; ii < MCREQ_NPIPELINES_ALL(&instance->cmdq); ii++) {
         auto *server = static_cast<lcb::Server *>(instance->cmdq.pipelines[ii]);
         if (!server->selected_bucket && server->connctx) {
             lcb::MemcachedRequest req(PROTOCOL_BINARY_CMD_SELECT_BUCKET);
@@ -867,37 +957,55 @@ void lcb_aspend_init(lcb_ASPEND *ops)
 {
     unsigned ii;
     for (ii = 0; ii < LCB_PENDTYPE_MAX; ++ii) {
-        ops->items[ii] = new lcb_ASPEND_SETTYPE();
+        lcb_list_init(&ops->items[ii]);
     }
     ops->count = 0;
 }
 
-void lcb_aspend_add(lcb_ASPEND *ops, lcb_ASPENDTYPE type, const void *item)
+void lcb_aspend_item_init(lcb_ASPEND_ITEM *item, void *owner)
+{
+    item->link.next = item->link.prev = nullptr;
+    item->owner = owner;
+}
+
+void lcb_aspend_add(lcb_ASPEND *ops, lcb_ASPENDTYPE type, lcb_ASPEND_ITEM *item)
 {
-    ops->count++;
     if (type == LCB_PENDTYPE_COUNTER) {
+        ops->count++;
+        return;
+    }
+    if (item->link.next != nullptr) {
         return;
     }
-    ops->items[type]->insert(const_cast<void *>(item));
+    ops->count++;
+    lcb_list_append(&ops->items[type], &item->link);
 }
 
-void lcb_aspend_del(lcb_ASPEND *ops, lcb_ASPENDTYPE type, const void *item)
+void lcb_aspend_del(lcb_ASPEND *ops, lcb_ASPENDTYPE type, lcb_ASPEND_ITEM *item)
 {
     if (type == LCB_PENDTYPE_COUNTER) {
         ops->count--;
         return;
     }
-    if (ops->items[type]->erase(const_cast<void *>(item)) != 0) {
+    if (item->link.next != nullptr) {
+        lcb_list_delete(&item->link);
         ops->count--;
     }
 }
 
 void lcb_aspend_cleanup(lcb_ASPEND *ops)
 {
+    /* the items are owned by their operations, only unlink them */
     unsigned ii;
     for (ii = 0; ii < LCB_PENDTYPE_MAX; ii++) {
-        delete ops->items[ii];
+        lcb_list_t *pos, *next;
+        LCB_LIST_SAFE_FOR(pos, next, &ops->items[ii])
+        {
+            lcb_list_delete(pos);
+        }
+        lcb_list_init(&ops->items[ii]);
     }
+    ops->count = 0;
 }
 
 LIBCOUCHBASE_API
@@ -905,10 +1013,31 @@ void lcb_sched_enter(lcb_INSTANCE *instance)
 {
     mcreq_sched_enter(&instance->cmdq);
 }
+static void deferred_flush_cb(void *arg)
+{
+    auto *instance = static_cast<lcb_INSTANCE *>(arg);
+    instance->flush_deferred = 0;
+    lcb_sched_flush(instance);
+}
+
 LIBCOUCHBASE_API
 void lcb_sched_leave(lcb_INSTANCE *instance)
 {
-    mcreq_sched_leave(&instance->cmdq, LCBT_SETTING(instance, sched_implicit_flush));
+    if (!LCBT_SETTING(instance, sched_implicit_flush) || !LCBT_SETTING(instance, flush_coalesce)) {
+        mcreq_sched_leave(&instance->cmdq, LCBT_SETTING(instance, sched_implicit_flush));
+        return;
+    }
+
+    instance->flush_deferred += mcreq_sched_leave_deferred(&instance->cmdq);
+    if (instance->flush_timer == nullptr) {
+        instance->flush_timer = lcbio_timer_new(instance->iotable, instance, deferred_flush_cb);
+    }
+    if (instance->flush_deferred >= LCBT_SETTING(instance, flush_coalesce_bytes)) {
+        lcbio_timer_disarm(instance->flush_timer);
+        deferred_flush_cb(instance);
+    } else if (!lcbio_timer_armed(instance->flush_timer)) {
+        lcbio_timer_rearm(instance->flush_timer, LCBT_SETTING(instance, flush_coalesce_delay));
+    }
 }
 LIBCOUCHBASE_API
 void lcb_sched_fail(lcb_INSTANCE *instance)
@@ -916,6 +1045,149 @@ void lcb_sched_fail(lcb_INSTANCE *instance)
     mcreq_sched_fail(&instance->cmdq);
 }
 
+static bool inflight_reached(std::uint64_t value, std::uint64_t limit)
+{
+    return limit != 0 && value >= limit;
+}
+
+static bool inflight_drained(std::uint64_t value, std::uint64_t limit, std::uint32_t percent)
+{
+    return limit == 0 || value * 100 <= limit * percent;
+}
+
+int lcb_kv_overloaded(lcb_INSTANCE *instance, const mc_PIPELINE *pipeline)
+{
+    const lcb_settings *settings = instance->settings;
+    bool reached = inflight_reached(pipeline->inflight_bytes, settings->kv_pipeline_inflight_bytes_max) ||
+                   inflight_reached(pipeline->inflight_ops, settings->kv_pipeline_inflight_ops_max);
+    if (!reached && (settings->kv_inflight_bytes_max || settings->kv_inflight_ops_max)) {
+        std::uint64_t nbytes;
+        std::uint32_t nops;
+        mcreq_queue_inflight(&instance->cmdq, &nbytes, &nops);
+        reached = inflight_reached(nbytes, settings->kv_inflight_bytes_max) ||
+                  inflight_reached(nops, settings->kv_inflight_ops_max);
+    }
+    if (reached && !instance->overloaded) {
+        instance->overloaded = 1;
+        lcb_log(LOGARGS(instance, WARN), "Too many KV operations in flight on SRV=%p, rejecting new ones",
+                (void *)pipeline);
+        if (instance->callbacks.overload) {
+            instance->callbacks.overload(instance, 1);
+        }
+    }
+    return reached;
+}
+
+void lcb_kv_overload_check(lcb_INSTANCE *instance)
+{
+    if (!instance->overloaded) {
+        return;
+    }
+    const lcb_settings *settings = instance->settings;
+    std::uint32_t percent = settings->kv_inflight_low_watermark;
+    const mc_CMDQUEUE *cq = &instance->cmdq;
+    if (cq->pipelines) {
+        for (unsigned ii = 0; ii < cq->_npipelines_ex; ii++) {
+            const mc_PIPELINE *pipeline = cq->pipelines[ii];
+            if (pipeline == nullptr) {
+                continue;
+            }
+            if (!inflight_drained(pipeline->inflight_bytes, settings->kv_pipeline_inflight_bytes_max, percent) ||
+                !inflight_drained(pipeline->inflight_ops, settings->kv_pipeline_inflight_ops_max, percent)) {
+                return;
+            }
+        }
+    }
+    std::uint64_t nbytes;
+    std::uint32_t nops;
+    mcreq_queue_inflight(cq, &nbytes, &nops);
+    if (!inflight_drained(nbytes, settings->kv_inflight_bytes_max, percent) ||
+        !inflight_drained(nops, settings->kv_inflight_ops_max, percent)) {
+        return;
+    }
+    instance->overloaded = 0;
+    lcb_log(LOGARGS(instance, INFO), "KV operations in flight below the low watermark, accepting new ones");
+    if (instance->callbacks.overload) {
+        instance->callbacks.overload(instance, 0);
+    }
+}
+
+/** Idle blocks kept by each pool of a pipeline when trimming */
+#define IDLE_TRIM_KEEP_BLOCKS 1
+/** Bytes of idle read segments kept by each allocator when trimming */
+#define IDLE_TRIM_KEEP_BYTES 65536
+
+/**
+ * Frees the buffers and closes the pooled connections left over by a burst of
+ * operations, once the pipelines, read allocators and pools they belong to
+ * were quiet for a full interval. See LCB_CNTL_IDLE_TRIM_INTERVAL
+ */
+static void idle_trim_tick(void *arg)
+{
+    auto *instance = static_cast<lcb_INSTANCE *>(arg);
+    lcb_settings *settings = instance->settings;
+    if (settings->idle_trim_interval == 0) {
+        return;
+    }
+
+    lcb_SIZE trimmed = 0, idle = 0;
+    mc_CMDQUEUE *cq = &instance->cmdq;
+    if (cq->config) {
+        for (unsigned ii = 0; ii < MCREQ_NPIPELINES_ALL(cq); ii++) {
+            auto *server = static_cast<lcb::Server *>(cq->pipelines[ii]);
+            trimmed += netbuf_trim(&server->nbmgr, IDLE_TRIM_KEEP_BLOCKS);
+            trimmed += netbuf_trim(&server->reqpool, IDLE_TRIM_KEEP_BLOCKS);
+            idle += netbuf_get_idle_size(&server->nbmgr) + netbuf_get_idle_size(&server->reqpool);
+            if (server->connctx && settings->read_pool == nullptr) {
+                trimmed += rdb_trim(server->connctx->ior.avail.allocator, IDLE_TRIM_KEEP_BYTES);
+            }
+        }
+    }
+    if (settings->read_pool) {
+        trimmed += rdb_trim(settings->read_pool, IDLE_TRIM_KEEP_BYTES);
+    }
+    lcb_SIZE closed = instance->http_sockpool->trim() + instance->memd_sockpool->trim();
+
+    if (trimmed || closed) {
+        lcb_log(LOGARGS(instance, DEBUG), "Trimmed %lu bytes of idle buffers and %lu idle connections",
+                (unsigned long)trimmed, (unsigned long)closed);
+    }
+    if (settings->metrics) {
+        settings->metrics->bytes_trimmed += trimmed;
+        settings->metrics->sockets_trimmed += closed;
+    }
+    if (settings->op_metrics_enabled && settings->meter) {
+        const lcbmetrics_VALUERECORDER *recorder;
+        recorder = settings->meter->value_recorder_(settings->meter, METRICS_MEMORY_IDLE_METER_NAME, nullptr, 0);
+        if (recorder) {
+            recorder->record_value_(recorder, idle);
+        }
+        recorder = settings->meter->value_recorder_(settings->meter, METRICS_MEMORY_TRIMMED_METER_NAME, nullptr, 0);
+        if (recorder) {
+            recorder->record_value_(recorder, trimmed);
+        }
+    }
+    lcbio_timer_rearm(instance->trim_timer, settings->idle_trim_interval);
+}
+
+void lcb_idle_trim_schedule(lcb_INSTANCE *instance)
+{
+    std::uint32_t interval = LCBT_SETTING(instance, idle_trim_interval);
+    if (interval == 0) {
+        if (instance->trim_timer) {
+            lcbio_timer_disarm(instance->trim_timer);
+        }
+        return;
+    }
+    if (instance->iotable == nullptr) {
+        return;
+    }
+    if (instance->trim_timer == nullptr) {
+        instance->trim_timer = lcbio_timer_new(instance->iotable, instance, idle_trim_tick);
+    }
+    lcbio_timer_rearm(instance->trim_timer, interval);
+}
+
 LIBCOUCHBASE_API
 int lcb_supports_feature(int n)
 {
@@ -1025,11 +1297,16 @@ LCB_INTERNAL_API lcb_STATUS lcb_is_collection_valid(lcb_INSTANCE *instance, cons
 LIBCOUCHBASE_API
 lcb_STATUS lcb_enable_timings(lcb_INSTANCE *instance)
 {
+#ifdef LCB_NO_METRICS
+    (void)instance;
+    return LCB_ERR_SDK_FEATURE_UNAVAILABLE;
+#else
     if (instance->kv_timings != nullptr) {
         return LCB_ERR_DOCUMENT_EXISTS;
     }
     instance->kv_timings = lcb_histogram_create();
     return instance->kv_timings == nullptr ? LCB_ERR_NO_MEMORY : LCB_SUCCESS;
+#endif
 }
 
 LIBCOUCHBASE_API
@@ -1040,6 +1317,18 @@ lcb_STATUS lcb_disable_timings(lcb_INSTANCE *instance)
     }
     lcb_histogram_destroy(instance->kv_timings);
     instance->kv_timings = nullptr;
+    for (size_t ii = 0; ii < MCREQ_NPIPELINES_ALL(&instance->cmdq); ii++) {
+        lcb::Server *server = instance->get_server(ii);
+        if (server == nullptr) {
+            continue;
+        }
+        for (auto *histogram : server->op_timings) {
+            if (histogram != nullptr) {
+                lcb_histogram_destroy(histogram);
+            }
+        }
+        server->op_timings.clear();
+    }
     return LCB_SUCCESS;
 }
 
@@ -1071,6 +1360,31 @@ lcb_STATUS lcb_get_timings(lcb_INSTANCE *instance, const void *cookie, lcb_timin
     return LCB_SUCCESS;
 }
 
+LIBCOUCHBASE_API
+lcb_STATUS lcb_get_node_timings(lcb_INSTANCE *instance, const void *cookie, lcb_node_timings_callback callback)
+{
+    if (!instance->kv_timings) {
+        return LCB_ERR_DOCUMENT_NOT_FOUND;
+    }
+    for (size_t ii = 0; ii < LCBT_NSERVERS(instance); ii++) {
+        lcb::Server *server = instance->get_server(ii);
+        if (server == nullptr || !server->has_valid_host()) {
+            continue;
+        }
+        const lcb_host_t &host = server->get_host();
+        std::string node(host.ipv6 ? "[" : "");
+        node.append(host.host).append(host.ipv6 ? "]:" : ":").append(host.port);
+        for (size_t opcode = 0; opcode < server->op_timings.size(); opcode++) {
+            lcb_HISTOGRAM *histogram = server->op_timings[opcode];
+            if (histogram != nullptr) {
+                callback(instance, cookie, node.c_str(), static_cast<lcb_U8>(opcode), histogram);
+                lcb_histogram_reset(histogram);
+            }
+        }
+    }
+    return LCB_SUCCESS;
+}
+
 LCB_INTERNAL_API
 const char *lcb_strerror_short(lcb_STATUS error)
 {
@@ -0,0 +1,207 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/**
+ * Pool of instances shared between threads.
+ *
+ * Each instance lives in a slot with a busy flag, which threads claim with a
+ * compare-and-swap, trying the slot they used last first. Threads only take
+ * the mutex to sleep when every slot is busy.
+ *
+ * The instances are members of a private shared configuration group (see
+ * LCB_CNTL_SHARED_CONFIG), and catch up with its cluster map whenever they
+ * are acquired, i.e. on the thread which is about to use them.
+ */
+
+#include "internal.h"
+#include "bucketconfig/shared_config.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace
+{
+struct Slot {
+    std::atomic<bool> busy{false};
+    lcb_INSTANCE *instance{nullptr};
+    /* keep the flags of different slots on different cache lines */
+    char pad[64 - sizeof(std::atomic<bool>) - sizeof(lcb_INSTANCE *)];
+};
+
+/** The slot this thread acquired last, for the pool with this id */
+struct Affinity {
+    uint64_t pool_id;
+    size_t slot;
+};
+thread_local Affinity affinity{0, 0};
+
+std::atomic<uint64_t> next_pool_id{1};
+} // namespace
+
+struct lcb_INSTANCE_POOL_ {
+    explicit lcb_INSTANCE_POOL_(size_t size) : slots(new Slot[size]), nslots(size) {}
+
+    ~lcb_INSTANCE_POOL_()
+    {
+        for (size_t ii = 0; ii < nslots; ii++) {
+            if (slots[ii].instance != nullptr) {
+                lcb_destroy(slots[ii].instance);
+            }
+        }
+        delete[] slots;
+        group->unref();
+    }
+
+    bool try_claim(size_t idx)
+    {
+        bool expected = false;
+        return !slots[idx].busy.load() && slots[idx].busy.compare_exchange_strong(expected, true);
+    }
+
+    /** @return the index of the slot claimed, or nslots if all are busy */
+    size_t claim_any()
+    {
+        size_t start = affinity.pool_id == id ? affinity.slot : std::hash<std::thread::id>()(std::this_thread::get_id());
+        for (size_t ii = 0; ii < nslots; ii++) {
+            size_t idx = (start + ii) % nslots;
+            if (try_claim(idx)) {
+                return idx;
+            }
+        }
+        return nslots;
+    }
+
+    lcb_INSTANCE *acquire()
+    {
+        size_t idx = claim_any();
+        if (idx == nslots) {
+            std::unique_lock<std::mutex> lock(mutex);
+            waiters.fetch_add(1);
+            /* pairs with release() clearing the flag before checking waiters */
+            while ((idx = claim_any()) == nslots) {
+                released.wait(lock);
+            }
+            waiters.fetch_sub(1);
+        }
+        affinity.pool_id = id;
+        affinity.slot = idx;
+
+        lcb_INSTANCE *instance = slots[idx].instance;
+        if (instance->shared_config != nullptr) {
+            instance->shared_config->sync();
+        }
+        return instance;
+    }
+
+    void release(lcb_INSTANCE *instance)
+    {
+        size_t idx = affinity.pool_id == id ? affinity.slot : 0;
+        if (slots[idx].instance != instance) {
+            for (idx = 0; idx < nslots && slots[idx].instance != instance; idx++) {
+            }
+            if (idx == nslots) {
+                return;
+            }
+        }
+        slots[idx].busy.store(false);
+        if (waiters.load() > 0) {
+            std::lock_guard<std::mutex> guard(mutex);
+            released.notify_one();
+        }
+    }
+
+    Slot *slots;
+    size_t nslots;
+    uint64_t id{next_pool_id.fetch_add(1)};
+    lcb::clconfig::SharedGroup *group{lcb::clconfig::SharedGroup::create()};
+
+    std::atomic<size_t> waiters{0};
+    std::mutex mutex;
+    std::condition_variable released;
+};
+
+LIBCOUCHBASE_API
+lcb_STATUS lcb_instance_pool_create(lcb_INSTANCE_POOL **pool, const lcb_CREATEOPTS *options, size_t size)
+{
+    if (pool == nullptr || size == 0 || (options != nullptr && options->io != nullptr)) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    auto *res = new lcb_INSTANCE_POOL(size);
+    for (size_t ii = 0; ii < size; ii++) {
+        lcb_STATUS rc = lcb_create(&res->slots[ii].instance, options);
+        if (rc != LCB_SUCCESS) {
+            delete res;
+            return rc;
+        }
+        res->group->ref();
+        res->slots[ii].instance->shared_config =
+            new lcb::clconfig::SharedMember(res->slots[ii].instance, res->group);
+    }
+    *pool = res;
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API
+size_t lcb_instance_pool_size(const lcb_INSTANCE_POOL *pool)
+{
+    return pool->nslots;
+}
+
+LIBCOUCHBASE_API
+lcb_INSTANCE *lcb_instance_pool_get(lcb_INSTANCE_POOL *pool, size_t index)
+{
+    return index < pool->nslots ? pool->slots[index].instance : nullptr;
+}
+
+LIBCOUCHBASE_API
+lcb_STATUS lcb_instance_pool_connect(lcb_INSTANCE_POOL *pool)
+{
+    for (size_t ii = 0; ii < pool->nslots; ii++) {
+        lcb_INSTANCE *instance = pool->slots[ii].instance;
+        lcb_STATUS rc = lcb_connect(instance);
+        if (rc != LCB_SUCCESS) {
+            return rc;
+        }
+        lcb_wait(instance, LCB_WAIT_DEFAULT);
+        rc = lcb_get_bootstrap_status(instance);
+        if (rc != LCB_SUCCESS) {
+            return rc;
+        }
+    }
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API
+lcb_INSTANCE *lcb_instance_pool_acquire(lcb_INSTANCE_POOL *pool)
+{
+    return pool->acquire();
+}
+
+LIBCOUCHBASE_API
+void lcb_instance_pool_release(lcb_INSTANCE_POOL *pool, lcb_INSTANCE *instance)
+{
+    pool->release(instance);
+}
+
+LIBCOUCHBASE_API
+void lcb_instance_pool_destroy(lcb_INSTANCE_POOL *pool)
+{
+    delete pool;
+}
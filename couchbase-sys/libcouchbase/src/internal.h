@@ -71,10 +71,12 @@ struct Spechost;
 class RetryQueue;
 class Bootstrap;
 class CollectionCache;
+class DeferredQueue;
 namespace clconfig
 {
 struct Confmon;
 class ConfigInfo;
+class SharedMember;
 } // namespace clconfig
 } // namespace lcb
 extern "C" {
@@ -93,9 +95,22 @@ struct lcb_callback_st {
     lcb_pktfwd_callback pktfwd;
     lcb_pktflushed_callback pktflushed;
     lcb_open_callback open;
+    lcb_inflate_callback inflate;
+    lcb_overload_callback overload;
+    lcb_value_sink_callback value_sink;
+    lcb_batch_callback batch;
 };
 
 struct lcb_GUESSVB_st;
+typedef struct lcb_GETLATENCY_st lcb_GETLATENCY;
+typedef struct lcb_NEARCACHE_st lcb_NEARCACHE;
+typedef struct lcb_FLIGHTREC_st lcb_FLIGHTREC;
+typedef struct lcb_HOTKEYS_st lcb_HOTKEYS;
+typedef struct lcb_INFLIGHTGETS_st lcb_INFLIGHTGETS;
+typedef struct lcb_INFLIGHTPREPARES_st lcb_INFLIGHTPREPARES;
+typedef struct lcb_VALUEMAPS_st lcb_VALUEMAPS;
+typedef struct lcb_PENDINGSTORES_st lcb_PENDINGSTORES;
+typedef struct lcb_STATSCACHE_st lcb_STATSCACHE;
 
 #ifdef __cplusplus
 #include <string>
@@ -104,12 +119,14 @@ typedef lcb::RetryQueue lcb_RETRYQ;
 typedef lcb::clconfig::Confmon *lcb_pCONFMON;
 typedef lcb::clconfig::ConfigInfo *lcb_pCONFIGINFO;
 typedef lcb::Bootstrap lcb_BOOTSTRAP;
+typedef lcb::clconfig::SharedMember *lcb_pSHAREDCONFIG;
 #else
 typedef struct lcb_SCRATCHBUF *lcb_pSCRATCHBUF;
 typedef struct lcb_RETRYQ_st lcb_RETRYQ;
 typedef struct lcb_CONFMON_st *lcb_pCONFMON;
 typedef struct lcb_CONFIGINFO_st *lcb_pCONFIGINFO;
 typedef struct lcb_BOOTSTRAP_st lcb_BOOTSTRAP;
+typedef struct lcb_SHAREDCONFIG_st *lcb_pSHAREDCONFIG;
 #endif
 
 struct lcb_st {
@@ -120,6 +137,7 @@ struct lcb_st {
     hostlist_t ht_nodes;              /**< List of current management endpoints */
     lcb_pCONFIGINFO cur_configinfo;   /**< Pointer to current config */
     lcb_BOOTSTRAP *bs_state;          /**< Bootstrapping state */
+    lcb_pSHAREDCONFIG shared_config;  /**< Group sharing the cluster map, see LCB_CNTL_SHARED_CONFIG */
     struct lcb_callback_st callbacks; /**< Callback table */
     lcb_HISTOGRAM *kv_timings;        /**< Histogram object (for timing) */
     lcb_ASPEND pendops;               /**< Pending asynchronous requests */
@@ -135,15 +153,47 @@ struct lcb_st {
     lcb_QUERY_CACHE *n1ql_cache;
     lcb_MUTATION_TOKEN *dcpinfo; /**< Mapping of known vbucket to {uuid,seqno} info */
     lcbio_pTIMER dtor_timer;     /**< Asynchronous destruction timer */
+    lcbio_pTIMER flush_timer;    /**< Deferred flush, see LCB_CNTL_FLUSH_COALESCE */
+    lcbio_pTIMER health_timer;   /**< Probes of idle connections, see LCB_CNTL_HEALTH_PROBE_INTERVAL */
+    lcbio_pTIMER trim_timer;     /**< Frees memory left over by bursts, see LCB_CNTL_IDLE_TRIM_INTERVAL */
+    lcb_SIZE flush_deferred;     /**< Bytes scheduled since the last deferred flush */
     lcb_BTYPE btype;             /**< Type of the bucket */
     lcb_COLLCACHE *collcache;    /**< Collection cache */
+    char *inflate_buf;           /**< Reused for values inflated for a callback */
+    lcb_SIZE ninflate_buf;       /**< Size of inflate_buf */
+    int inflate_busy;            /**< Whether inflate_buf holds the value of a running callback */
+    lcb_GETLATENCY *get_latency; /**< Recent get latencies, for adaptively hedged gets */
+    lcb_NEARCACHE *near_cache;   /**< Recently read documents, see LCB_CNTL_NEAR_CACHE_SIZE */
+    /** Gets which identical ones may join, see LCB_CNTL_GET_COALESCE */
+    lcb_INFLIGHTGETS *inflight_gets;
+    /** PREPAREs in flight which other executions of their statement wait for */
+    lcb_INFLIGHTPREPARES *inflight_prepares;
+    lcb_VALUEMAPS *value_maps;   /**< Files mapped for values being written, see lcb_cmdstore_value_file() */
+    /** Upserts held back to be coalesced, see lcb_cmdstore_coalesce() */
+    lcb_PENDINGSTORES *pending_stores;
+    lcb_STATSCACHE *stats_cache; /**< Aggregated statistics, see lcb_cmdstats_max_age() */
+    lcb_FLIGHTREC *flightrec;    /**< Latest events, see LCB_CNTL_FLIGHT_RECORDER_SIZE */
+    lcb_RESPBATCH *respbatch;    /**< Responses of the current read, see lcb_set_batch_callback() */
+    lcb_HOTKEYS *hot_keys;       /**< Most accessed keys, see LCB_CNTL_HOT_KEYS */
+    /** Latency recorders of the KV operations, looked up from the meter on first use */
+    const lcbmetrics_VALUERECORDER *kv_op_recorders[METRICS_KV_OP__MAX];
+    /** Recorders of the parts of KV latencies, see record_kv_op_breakdown() */
+    const lcbmetrics_VALUERECORDER *kv_phase_recorders[METRICS_KV_PHASE__MAX];
     int destroying;              /**< Are we in lcb_destroy() ?*/
+    /** Whether operations were rejected since the last low watermark, see lcb_kv_overloaded() */
+    int overloaded;
 
 #ifdef __cplusplus
     typedef std::map<std::string, lcbcrypto_PROVIDER *> lcb_ProviderMap;
     lcb_ProviderMap *crypto;
 
-    std::list<std::function<void(lcb_STATUS)>> *deferred_operations;
+    lcb::DeferredQueue *deferred_operations;
+
+    /** Circuit breakers of the HTTP endpoints by host:port, see LCB_CNTL_CIRCUIT_BREAKER */
+    std::map<std::string, lcb::CircuitBreaker> *http_breakers;
+
+    /** Connection string the instance was created from, with the DNS SRV hosts, see lcb_create_from_template() */
+    lcb::Connspec *connspec;
 
     lcb_settings *getSettings()
     {
@@ -161,10 +211,7 @@ struct lcb_st {
     {
         return static_cast<lcb::Server *>(cmdq.pipelines[index]);
     }
-    bool has_deferred_operations() const
-    {
-        return deferred_operations != nullptr && !deferred_operations->empty();
-    }
+    bool has_deferred_operations() const;
     lcb::Server *find_server(const lcb_host_t &host) const;
     lcb_STATUS request_config(void *cookie_, lcb::Server *server, lcb::clconfig::config_version current_version);
     lcb_STATUS select_bucket(void *cookie, lcb::Server *server);
@@ -231,6 +278,23 @@ void lcb_maybe_breakout(lcb_INSTANCE *instance);
 
 void lcb_update_vbconfig(lcb_INSTANCE *instance, lcb_pCONFIGINFO config);
 
+/**
+ * Apply LCB_CNTL_QUERY_POOL_TARGET and LCB_CNTL_SEARCH_POOL_TARGET to the
+ * nodes of the current configuration, opening the missing connections.
+ */
+void lcb_update_http_pool_targets(lcb_INSTANCE *instance);
+
+/**
+ * Select the node for a query, search or analytics request: the one with the fewest
+ * requests in flight (according to the HTTP socket pool), picking randomly
+ * between equally loaded nodes. Nodes of the preferred server group (see
+ * LCB_CNTL_PREFERRED_SERVER_GROUP) are picked over all others.
+ *
+ * @param used nodes to skip, indexed like the servers of the configuration
+ * @return the index of the node, or -1 if no node has the service
+ */
+int lcb_select_http_node(lcb_INSTANCE *instance, lcbvb_SVCTYPE svc, const int *used);
+
 lcb_STATUS lcb_iops_cntl_handler(int mode, lcb_INSTANCE *instance, int cmd, void *arg);
 
 /**
@@ -283,6 +347,92 @@ void lcb_vbguess_newconfig(lcb_INSTANCE *instance, lcbvb_CONFIG *cfg, struct lcb
 int lcb_vbguess_remap(lcb_INSTANCE *instance, int vbid, int bad);
 #define lcb_vbguess_destroy(p) free(p)
 
+void lcb_get_latency_record(lcb_INSTANCE *instance, hrtime_t latency);
+void lcb_get_latency_destroy(lcb_GETLATENCY *latency);
+/** Cache the value of a get sent with lcb_cmdget_near_cache(), or that the document is missing */
+void lcb_near_cache_store(lcb_INSTANCE *instance, const mc_PACKET *request, const lcb_RESPGET *resp);
+/** Remember that the document of a get or exists check is missing, see LCB_CNTL_NEGATIVE_CACHE_SIZE */
+void lcb_near_cache_store_missing(lcb_INSTANCE *instance, const mc_PACKET *request);
+/** Drop the cached value of the document of a mutation, whether it succeeded or not */
+void lcb_near_cache_invalidate(lcb_INSTANCE *instance, const mc_PACKET *request);
+/** Remember the expiry a get-and-touch or touch set, see LCB_CNTL_TOUCH_SKIP_WINDOW */
+void lcb_near_cache_touched(lcb_INSTANCE *instance, const mc_PACKET *request);
+void lcb_near_cache_destroy(lcb_NEARCACHE *cache);
+void lcb_inflight_gets_destroy(lcb_INFLIGHTGETS *inflight);
+void lcb_inflight_prepares_destroy(lcb_INFLIGHTPREPARES *inflight);
+
+/** Drop the mapping of a file referenced by a packet whose value @p value is not needed anymore */
+void lcb_value_maps_release(lcb_INSTANCE *instance, const void *value);
+void lcb_value_maps_destroy(lcb_VALUEMAPS *maps);
+/** Fail the upserts still held back with LCB_ERR_REQUEST_CANCELED */
+void lcb_pending_stores_destroy(lcb_PENDINGSTORES *pending);
+void lcb_stats_cache_destroy(lcb_STATSCACHE *cache);
+
+/**
+ * Start collecting the responses of a read for the batch callback, if installed.
+ * @return non-zero if the batch was started, and must be passed on with lcb_respbatch_flush()
+ */
+int lcb_respbatch_begin(lcb_INSTANCE *instance);
+/** Add a response to the current batch, @return zero if it must be passed to its operation callback instead */
+int lcb_respbatch_add(lcb_INSTANCE *instance, lcb_CALLBACK_TYPE type, const void *resp);
+/** Pass the responses collected since lcb_respbatch_begin() to the batch callback */
+void lcb_respbatch_flush(lcb_INSTANCE *instance);
+void lcb_respbatch_destroy(lcb_RESPBATCH *batch);
+
+/** Events kept by the flight recorder, see LCB_CNTL_FLIGHT_RECORDER_SIZE */
+typedef enum {
+    LCB_FLIGHT_PKT_ENQUEUE = 1, /**< Packet scheduled, the value is its size */
+    LCB_FLIGHT_PKT_WRITTEN,     /**< Packet written to the socket, the value is its size */
+    LCB_FLIGHT_PKT_COMPLETE,    /**< Response received, the value is its status */
+    LCB_FLIGHT_PKT_FAIL,        /**< Packet failed without response, the value is the error */
+    LCB_FLIGHT_PKT_RETRY,       /**< Packet placed into the retry queue, the value is the error */
+    LCB_FLIGHT_CONFIG,          /**< Cluster map applied, the value is its revision */
+    LCB_FLIGHT_SOCK_CONNECT,    /**< Connecting to a server */
+    LCB_FLIGHT_SOCK_READY,      /**< Connection to a server negotiated */
+    LCB_FLIGHT_SOCK_ERROR,      /**< Connection to a server failed, the value is the error */
+    LCB_FLIGHT_SOCK_CLOSE       /**< Connection to a server closed */
+} lcb_FLIGHTEVENT;
+
+/**
+ * Record an event in the flight recorder of the instance, which is allocated
+ * on first use. @p pipeline and @p packet may be NULL
+ */
+void lcb_flight_record(lcb_INSTANCE *instance, lcb_FLIGHTEVENT type, const mc_PIPELINE *pipeline,
+                       const mc_PACKET *packet, uint32_t value);
+void lcb_flight_recorder_destroy(lcb_FLIGHTREC *recorder);
+/**
+ * Count an access to a key in the hot key tracker of the instance, which is
+ * allocated on first use, see LCB_CNTL_HOT_KEYS
+ * @param nhdr the size of the header preceding the key in @p key, if any
+ */
+void lcb_hot_keys_record(lcb_INSTANCE *instance, const lcb_KEYBUF *key, unsigned nhdr, uint32_t cid, int vbid,
+                         int server);
+void lcb_hot_keys_destroy(lcb_HOTKEYS *hot_keys);
+/**
+ * @return the counters of the vBucket @p packet was routed by, NULL if the
+ * metrics are disabled or the packet has no key, see lcb_METRICS::vbuckets
+ */
+lcb_VBUCKETMETRICS *lcb_metrics_packet_vbucket(lcb_settings *settings, const mc_PACKET *packet);
+/** Write the events of the flight recorder for lcb_dump() */
+void lcb_flight_recorder_dump(lcb_INSTANCE *instance, FILE *fp);
+/** (Re)arms or stops the health probes according to LCB_CNTL_HEALTH_PROBE_INTERVAL */
+void lcb_health_probe_schedule(lcb_INSTANCE *instance);
+/** (Re)arms or stops the idle trims according to LCB_CNTL_IDLE_TRIM_INTERVAL */
+void lcb_idle_trim_schedule(lcb_INSTANCE *instance);
+/**
+ * Whether a new KV operation for @p pipeline would exceed the budget of
+ * operations in flight, see LCB_CNTL_KV_INFLIGHT_BYTES_MAX. Signals the high
+ * watermark to the overload callback the first time it does
+ */
+int lcb_kv_overloaded(lcb_INSTANCE *instance, const mc_PIPELINE *pipeline);
+/** Signals the low watermark once the operations in flight drained below it */
+void lcb_kv_overload_check(lcb_INSTANCE *instance);
+/**
+ * Whether the circuit breaker of @p pipeline rejects a new KV operation, see
+ * LCB_CNTL_CIRCUIT_BREAKER. Otherwise the operation may count as a canary
+ */
+int lcb_kv_circuit_open(lcb_INSTANCE *instance, mc_PIPELINE *pipeline);
+
 LCB_INTERNAL_API uint32_t lcb_durability_timeout(lcb_INSTANCE *instance, uint32_t tmo_us);
 LCB_INTERNAL_API lcb_STATUS lcb_is_collection_valid(lcb_INSTANCE *instance, const char *scope, size_t scope_len,
                                                     const char *collection, size_t collection_len);
@@ -317,6 +467,24 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdstats_destroy(lcb_CMDSTATS *cmd);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdstats_parent_span(lcb_CMDSTATS *cmd, lcbtrace_SPAN *span);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdstats_key(lcb_CMDSTATS *cmd, const char *key, size_t key_len);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdstats_is_keystats(lcb_CMDSTATS *cmd, int val);
+/**
+ * @uncommitted
+ *
+ * Deliver the statistics of each server in a single response as soon as that
+ * server has sent all of them, instead of one response per statistic. A slow
+ * server then only delays its own response, read the statistics with
+ * lcb_respstats_nstats() and lcb_respstats_stat(). The final response still
+ * follows the last server.
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdstats_aggregate(lcb_CMDSTATS *cmd, int val);
+/**
+ * @uncommitted
+ *
+ * Reuse the aggregated statistics of a server if they were received less
+ * than `max_age` microseconds ago, instead of asking the server again. Only
+ * valid together with lcb_cmdstats_aggregate().
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdstats_max_age(lcb_CMDSTATS *cmd, uint32_t max_age);
 
 typedef struct lcb_RESPSTATS_ lcb_RESPSTATS;
 LIBCOUCHBASE_API lcb_STATUS lcb_respstats_status(const lcb_RESPSTATS *resp);
@@ -326,6 +494,11 @@ LIBCOUCHBASE_API lcb_STATUS lcb_respstats_cookie(const lcb_RESPSTATS *resp, void
 LIBCOUCHBASE_API lcb_STATUS lcb_respstats_key(const lcb_RESPSTATS *resp, const char **key, size_t *key_len);
 LIBCOUCHBASE_API lcb_STATUS lcb_respstats_value(const lcb_RESPSTATS *resp, const char **value, size_t *value_len);
 LIBCOUCHBASE_API lcb_STATUS lcb_respstats_server(const lcb_RESPSTATS *resp, const char **server, size_t *server_len);
+/** @uncommitted Number of statistics in a response of an aggregated command, 0 for the final one */
+LIBCOUCHBASE_API lcb_STATUS lcb_respstats_nstats(const lcb_RESPSTATS *resp, size_t *nstats);
+/** @uncommitted Statistic at `index` of a response of an aggregated command */
+LIBCOUCHBASE_API lcb_STATUS lcb_respstats_stat(const lcb_RESPSTATS *resp, size_t index, const char **key,
+                                               size_t *key_len, const char **value, size_t *value_len);
 
 /**
  * @uncommitted
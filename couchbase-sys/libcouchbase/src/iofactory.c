@@ -25,6 +25,14 @@
 LIBCOUCHBASE_API lcb_STATUS lcb_create_libevent_io_opts(int, lcb_io_opt_t *, void *);
 #endif
 
+#ifdef LCB_EMBED_PLUGIN_EPOLL
+#include "plugins/io/epoll/epoll_io_opts.h"
+#endif
+
+#ifdef LCB_EMBED_PLUGIN_URING
+#include "plugins/io/uring/uring_io_opts.h"
+#endif
+
 typedef lcb_STATUS (*create_func_t)(int version, lcb_io_opt_t *io, void *cookie);
 
 #ifdef _WIN32
@@ -35,6 +43,15 @@ lcb_STATUS lcb_iocp_new_iops(int, lcb_io_opt_t *, void *);
 #define DEFAULT_IOPS LCB_IO_OPS_LIBEVENT
 #endif
 
+/** Plugin used if the default one cannot be loaded */
+#ifdef LCB_EMBED_PLUGIN_EPOLL
+#define FALLBACK_IOPS LCB_IO_OPS_EPOLL
+#define FALLBACK_CREATE lcb_create_epoll_io_opts
+#else
+#define FALLBACK_IOPS LCB_IO_OPS_SELECT
+#define FALLBACK_CREATE lcb_create_select_io_opts
+#endif
+
 typedef struct {
     /** The "base" name of the plugin */
     const char *base;
@@ -103,6 +120,15 @@ static plugin_info builtin_plugins[] = {BUILTIN_CORE("select", LCB_IO_OPS_SELECT
                                         BUILTIN_DL("libev", LCB_IO_OPS_LIBEV),
                                         BUILTIN_DL("libuv", LCB_IO_OPS_LIBUV),
 
+#ifdef LCB_EMBED_PLUGIN_EPOLL
+                                        BUILTIN_CORE("epoll", LCB_IO_OPS_EPOLL, lcb_create_epoll_io_opts),
+                                        BUILTIN_CORE("kqueue", LCB_IO_OPS_EPOLL, lcb_create_epoll_io_opts),
+#endif
+
+#ifdef LCB_EMBED_PLUGIN_URING
+                                        BUILTIN_CORE("uring", LCB_IO_OPS_URING, lcb_create_uring_io_opts),
+#endif
+
                                         {NULL, LCB_IO_OPS_INVALID, NULL, NULL, NULL, {0}, {0}}};
 
 /**
@@ -339,7 +365,8 @@ static lcb_STATUS generate_options(plugin_info *pi, const struct lcb_create_io_o
             options_from_info(ours, pip);
 
             /* if the plugin is dynamically loadable, we need to
-             * fallback to select(2) plugin in case we cannot find the
+             * fallback to a builtin plugin (epoll/kqueue, or select(2)
+             * where they are not available) in case we cannot find the
              * create function */
             if (ours->version == 1) {
                 struct plugin_st plugin;
@@ -360,10 +387,10 @@ static lcb_STATUS generate_options(plugin_info *pi, const struct lcb_create_io_o
                 }
                 if (ret != LCB_SUCCESS) {
                     if (type) {
-                        *type = LCB_IO_OPS_SELECT;
+                        *type = FALLBACK_IOPS;
                     }
                     ours->version = 2;
-                    ours->v.v2.create = lcb_create_select_io_opts;
+                    ours->v.v2.create = FALLBACK_CREATE;
                     ours->v.v2.cookie = NULL;
                 }
             }
@@ -43,7 +43,23 @@ class Metrics : public lcb_METRICS
     std::vector<MetricsEntry *> entries;
     std::vector<lcb_SERVERMETRICS *> raw_entries;
 
-    Metrics() : lcb_METRICS_st() {}
+    lcb_VBUCKETMETRICS vbucket_entries[LCB_VBUCKETMETRICS_MAX]{};
+
+    Metrics() : lcb_METRICS_st()
+    {
+        vbuckets = vbucket_entries;
+    }
+
+    lcb_VBUCKETMETRICS *get_vbucket(unsigned vbid)
+    {
+        if (vbid >= LCB_VBUCKETMETRICS_MAX) {
+            return nullptr;
+        }
+        if (vbid >= nvbuckets) {
+            nvbuckets = vbid + 1;
+        }
+        return &vbucket_entries[vbid];
+    }
 
     ~Metrics()
     {
@@ -99,12 +115,57 @@ lcb_SERVERMETRICS *lcb_metrics_getserver(lcb_METRICS *metrics, const char *h, co
     return Metrics::from(metrics)->get(h, p, c);
 }
 
+lcb_VBUCKETMETRICS *lcb_metrics_getvbucket(lcb_METRICS *metrics, unsigned vbid)
+{
+    return Metrics::from(metrics)->get_vbucket(vbid);
+}
+
+lcb_VBUCKETMETRICS *lcb_metrics_packet_vbucket(lcb_settings *settings, const mc_PACKET *packet)
+{
+    if (settings->metrics == nullptr) {
+        return nullptr;
+    }
+    protocol_binary_request_header hdr;
+    mcreq_read_hdr(packet, &hdr);
+    if (hdr.request.keylen == 0) {
+        /* not routed by its vBucket, e.g. a NOOP */
+        return nullptr;
+    }
+    return lcb_metrics_getvbucket(settings->metrics, ntohs(hdr.request.vbucket));
+}
+
+static void dump_histogram(const char *name, const lcb_SIZE *histogram, FILE *fp)
+{
+    fprintf(fp, "%s:", name);
+    for (unsigned ii = 0; ii < LCB_IOMETRICS_NBUCKETS; ii++) {
+        if (histogram[ii] == 0) {
+            continue;
+        }
+        /* lower bound of the bucket */
+        unsigned long long bound = ii == 0 ? 0 : 1ULL << (ii - 1);
+        fprintf(fp, " %s%llu:%lu", ii == LCB_IOMETRICS_NBUCKETS - 1 ? ">=" : "", bound,
+                (unsigned long int)histogram[ii]);
+    }
+    fprintf(fp, "\n");
+}
+
 void lcb_metrics_dumpio(const lcb_IOMETRICS *metrics, FILE *fp)
 {
     fprintf(fp, "Bytes sent: %lu\n", (unsigned long int)metrics->bytes_sent);
     fprintf(fp, "Bytes received: %lu\n", (unsigned long int)metrics->bytes_received);
     fprintf(fp, "IO Close: %lu\n", (unsigned long int)metrics->io_close);
     fprintf(fp, "IO Error: %lu\n", (unsigned long int)metrics->io_error);
+    fprintf(fp, "IO Send calls: %lu\n", (unsigned long int)metrics->io_send_calls);
+    fprintf(fp, "IO Recv calls: %lu\n", (unsigned long int)metrics->io_recv_calls);
+    fprintf(fp, "IO Watch calls: %lu\n", (unsigned long int)metrics->io_watch_calls);
+    fprintf(fp, "IO Send EAGAIN: %lu\n", (unsigned long int)metrics->io_send_eagain);
+    fprintf(fp, "IO Recv EAGAIN: %lu\n", (unsigned long int)metrics->io_recv_eagain);
+    dump_histogram("Bytes per send", metrics->send_bytes, fp);
+    dump_histogram("Bytes per recv", metrics->recv_bytes, fp);
+    dump_histogram("Recv calls per event", metrics->recv_calls_per_event, fp);
+    dump_histogram("Send queue bytes", metrics->send_queue_bytes, fp);
+    dump_histogram("RX kernel us", metrics->rx_kernel_us, fp);
+    dump_histogram("TX kernel us", metrics->tx_kernel_us, fp);
 }
 
 void lcb_metrics_dumpserver(const lcb_SERVERMETRICS *metrics, FILE *fp)
@@ -112,17 +173,27 @@ void lcb_metrics_dumpserver(const lcb_SERVERMETRICS *metrics, FILE *fp)
     lcb_metrics_dumpio(&metrics->iometrics, fp);
     fprintf(fp, "Packets queued: %lu\n", (unsigned long int)metrics->packets_queued);
     fprintf(fp, "Bytes queued: %lu\n", (unsigned long int)metrics->bytes_queued);
+    fprintf(fp, "Packets held: %lu\n", (unsigned long int)metrics->packets_held);
+    fprintf(fp, "Bytes held: %lu\n", (unsigned long int)metrics->bytes_held);
+    fprintf(fp, "Packets overtaking: %lu\n", (unsigned long int)metrics->packets_overtaking);
     fprintf(fp, "Packets sent: %lu\n", (unsigned long int)metrics->packets_sent);
     fprintf(fp, "Packets received: %lu\n", (unsigned long int)metrics->packets_read);
     fprintf(fp, "Packets errored: %lu\n", (unsigned long int)metrics->packets_errored);
     fprintf(fp, "Packets NMV: %lu\n", (unsigned long int)metrics->packets_nmv);
     fprintf(fp, "Packets timeout: %lu\n", (unsigned long int)metrics->packets_timeout);
-    fprintf(fp, "Packets orphaned: %lu", (unsigned long int)metrics->packets_ownerless);
+    fprintf(fp, "Packets orphaned: %lu\n", (unsigned long int)metrics->packets_ownerless);
+    fprintf(fp, "Circuit breaker opened: %lu\n", (unsigned long int)metrics->circuit_breaker_opened);
+    fprintf(fp, "Packets rejected: %lu\n", (unsigned long int)metrics->packets_rejected);
+    fprintf(fp, "Idle probes: %lu\n", (unsigned long int)metrics->idle_probes);
+    fprintf(fp, "Idle reconnects: %lu\n", (unsigned long int)metrics->idle_reconnects);
+    fprintf(fp, "Packets replayed: %lu", (unsigned long int)metrics->packets_replayed);
 }
 
 void lcb_metrics_reset_pipeline_gauges(lcb_SERVERMETRICS *metrics)
 {
     metrics->packets_queued = 0;
     metrics->bytes_queued = 0;
+    metrics->packets_held = 0;
+    metrics->bytes_held = 0;
 }
 }
@@ -28,10 +28,9 @@
 #define DECLARE_JSONSL_CALLBACK(name)                                                                                  \
     static void name(jsonsl_t, jsonsl_action_t, struct jsonsl_state_st *, const char *)
 
-DECLARE_JSONSL_CALLBACK(row_pop_callback);
+DECLARE_JSONSL_CALLBACK(rowset_pop_callback);
 DECLARE_JSONSL_CALLBACK(initial_push_callback);
 DECLARE_JSONSL_CALLBACK(initial_pop_callback);
-DECLARE_JSONSL_CALLBACK(meta_header_complete_callback);
 DECLARE_JSONSL_CALLBACK(trailer_pop_callback);
 
 using namespace lcb::jsparse;
@@ -99,65 +98,47 @@ static Parser *get_ctx(jsonsl_t jsn)
     return reinterpret_cast<Parser *>(jsn->data);
 }
 
-static void meta_header_complete_callback(jsonsl_t jsn, jsonsl_action_t, struct jsonsl_state_st *state,
-                                          const jsonsl_char_t *)
+static void report_error(Parser *ctx)
 {
-    Parser *ctx = get_ctx(jsn);
-    ctx->meta_buf.append(ctx->current_buf.c_str(), state->pos_begin);
+    ctx->have_error = 1;
 
-    ctx->header_len = state->pos_begin;
-    jsn->action_callback_PUSH = nullptr;
+    /* invoke the callback */
+    if (ctx->actions) {
+        ctx->actions->JSPARSE_on_error(ctx->current_buf);
+        ctx->actions = nullptr;
+    }
 }
 
-static void row_pop_callback(jsonsl_t jsn, jsonsl_action_t, struct jsonsl_state_st *state, const jsonsl_char_t *)
+/**
+ * Called when jsonsl is resumed at the closing bracket of the row set. The
+ * rows themselves have already been split out by scan_rows().
+ */
+static void rowset_pop_callback(jsonsl_t jsn, jsonsl_action_t, struct jsonsl_state_st *state, const jsonsl_char_t *)
 {
     Parser *ctx = get_ctx(jsn);
-    const char *rowbuf;
-    size_t szdummy;
 
-    if (ctx->have_error) {
+    if (ctx->have_error || state->data != JOBJ_ROWSET) {
         return;
     }
 
     ctx->keep_pos = jsn->pos;
     ctx->last_row_endpos = jsn->pos;
 
-    if (state->data == JOBJ_ROWSET) {
-        jsn->action_callback_POP = trailer_pop_callback;
-        jsn->action_callback_PUSH = nullptr;
-        if (ctx->rowcount == 0) {
-            /* Emulate what meta_header_complete callback does. */
-
-            /* While the entire meta is available to us, the _closing_ part
-             * of the meta is handled in a different callback. */
-            ctx->meta_buf.append(ctx->current_buf.c_str(), jsn->pos);
-            ctx->header_len = jsn->pos;
-        }
-        return;
-    }
+    jsn->action_callback_POP = trailer_pop_callback;
+    jsn->action_callback_PUSH = nullptr;
+    if (ctx->rowcount == 0) {
+        /* Emulate what emit_row() does for the first row. */
 
-    ctx->rowcount++;
-    if (!ctx->actions) {
-        return;
+        /* While the entire meta is available to us, the _closing_ part
+         * of the meta is handled in a different callback. */
+        ctx->meta_buf.append(ctx->current_buf.c_str(), jsn->pos);
+        ctx->header_len = jsn->pos;
     }
-
-    rowbuf = ctx->get_buffer_region(state->pos_begin, -1, &szdummy);
-    Row dt{};
-    dt.row.iov_base = (void *)rowbuf;
-    dt.row.iov_len = jsn->pos - state->pos_begin + (state->type == JSONSL_T_SPECIAL ? 0 : 1);
-    ctx->actions->JSPARSE_on_row(dt);
 }
 
 static int parse_error_callback(jsonsl_t jsn, jsonsl_error_t, struct jsonsl_state_st *, jsonsl_char_t *)
 {
-    Parser *ctx = get_ctx(jsn);
-    ctx->have_error = 1;
-
-    /* invoke the callback */
-    if (ctx->actions) {
-        ctx->actions->JSPARSE_on_error(ctx->current_buf);
-        ctx->actions = nullptr;
-    }
+    report_error(get_ctx(jsn));
     return 0;
 }
 
@@ -231,18 +212,306 @@ static void initial_push_callback(jsonsl_t jsn, jsonsl_action_t, struct jsonsl_s
     }
 
     if (state->type == JSONSL_T_LIST && match == JSONSL_MATCH_POSSIBLE) {
-        /* we have a match, e.g. "rows:[]" */
-        jsn->action_callback_POP = row_pop_callback;
-        jsn->action_callback_PUSH = meta_header_complete_callback;
+        /* we have a match, e.g. "rows:[]". Hand the rows over to scan_rows() */
         state->data = JOBJ_ROWSET;
+        ctx->scanning_rows = 1;
+        ctx->scan_pos = jsn->pos + 1;
+        jsonsl_stop(jsn);
+    }
+}
+
+namespace
+{
+/*
+ * Word-at-a-time helpers for scan_rows(). A word is loaded with memcpy, so
+ * neither alignment nor byte order matters: they only tell whether any of
+ * its bytes is interesting, and the caller then looks at the bytes one by one.
+ */
+const lcb_U64 ONES = 0x0101010101010101ULL;
+const lcb_U64 HIGHS = 0x8080808080808080ULL;
+
+inline bool has_byte(lcb_U64 word, lcb_U8 c)
+{
+    word ^= ONES * c;
+    return ((word - ONES) & ~word & HIGHS) != 0;
+}
+
+inline lcb_U64 load_word(const char *p)
+{
+    lcb_U64 word;
+    memcpy(&word, p, sizeof(word));
+    return word;
+}
+
+/** Number of leading bytes which cannot end or escape a string */
+size_t skip_string_bytes(const char *p, size_t n)
+{
+    size_t ii = 0;
+    for (; ii + sizeof(lcb_U64) <= n; ii += sizeof(lcb_U64)) {
+        lcb_U64 word = load_word(p + ii);
+        if (has_byte(word, '"') || has_byte(word, '\\')) {
+            break;
+        }
+    }
+    return ii;
+}
+
+/**
+ * Number of leading bytes which cannot open a string or open or close a
+ * container. Masking out bits 0x26 maps all of '{', '}', '[' and ']' to 0x59,
+ * so a single comparison finds them (along with a few harmless false positives
+ * such as 'Y', 'y' and '_').
+ */
+size_t skip_container_bytes(const char *p, size_t n)
+{
+    const lcb_U64 mask = ONES * 0xD9;
+    size_t ii = 0;
+    for (; ii + sizeof(lcb_U64) <= n; ii += sizeof(lcb_U64)) {
+        lcb_U64 word = load_word(p + ii);
+        if (has_byte(word, '"') || has_byte(word & mask, 0x59)) {
+            break;
+        }
+    }
+    return ii;
+}
+} // namespace
+
+void Parser::emit_row(size_t endpos)
+{
+    scan_need_comma = 1;
+    rowcount++;
+    keep_pos = endpos;
+    last_row_endpos = endpos;
+    if (!actions) {
+        return;
+    }
+
+    const char *rowbuf;
+    if (row_begin >= rows_data_pos) {
+        rowbuf = rows_data + (row_begin - rows_data_pos);
+    } else {
+        /* The row started in an earlier chunk, so finish it in current_buf */
+        size_t nused = endpos - rows_data_pos;
+        if (rows_data_copied < nused) {
+            current_buf.append(rows_data + rows_data_copied, nused - rows_data_copied);
+            rows_data_copied = nused;
+        }
+        rowbuf = current_buf.c_str() + (row_begin - min_pos);
+    }
+
+    Row dt{};
+    dt.row.iov_base = const_cast<char *>(rowbuf);
+    dt.row.iov_len = endpos - row_begin;
+    actions->JSPARSE_on_row(dt);
+}
+
+void Parser::fail_rows()
+{
+    /* Make the whole chunk available to the error callback and the postmortem */
+    if (rows_data_copied < rows_data_len) {
+        current_buf.append(rows_data + rows_data_copied, rows_data_len - rows_data_copied);
+        rows_data_copied = rows_data_len;
+    }
+    report_error(this);
+}
+
+/**
+ * Splits the rows out of the current chunk (rows_data). Rows are not validated
+ * beyond their strings and brackets.
+ *
+ * @return the absolute position of the closing bracket of the row set, or 0
+ * if it has not been received yet (or the rows are malformed).
+ */
+size_t Parser::scan_rows()
+{
+    const char *data = rows_data;
+    size_t ii = scan_pos - rows_data_pos;
+
+    for (; ii < rows_data_len && !have_error && !stopped; ii++) {
+        char c;
+
+        if (scan_in_string) {
+            if (scan_in_escape) {
+                scan_in_escape = 0;
+                continue;
+            }
+            ii += skip_string_bytes(data + ii, rows_data_len - ii);
+            if (ii == rows_data_len) {
+                break;
+            }
+            c = data[ii];
+            if (c == '\\') {
+                scan_in_escape = 1;
+            } else if (c == '"') {
+                scan_in_string = 0;
+                if (scan_stack.empty()) {
+                    emit_row(rows_data_pos + ii + 1);
+                }
+            }
+            continue;
+        }
+
+        if (!scan_stack.empty()) {
+            ii += skip_container_bytes(data + ii, rows_data_len - ii);
+            if (ii == rows_data_len) {
+                break;
+            }
+            c = data[ii];
+            switch (c) {
+                case '"':
+                    scan_in_string = 1;
+                    break;
+                case '{':
+                case '[':
+                    scan_stack.push_back(c);
+                    break;
+                case '}':
+                case ']':
+                    if (scan_stack.back() != (c == '}' ? '{' : '[')) {
+                        fail_rows();
+                        break;
+                    }
+                    scan_stack.erase(scan_stack.size() - 1);
+                    if (scan_stack.empty()) {
+                        emit_row(rows_data_pos + ii + 1);
+                    }
+                    break;
+                default:
+                    break;
+            }
+            continue;
+        }
+
+        /* between rows, or within a number or literal */
+        c = data[ii];
+        if (scan_in_scalar) {
+            if (c != ',' && c != ']' && c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+                continue;
+            }
+            scan_in_scalar = 0;
+            emit_row(rows_data_pos + ii);
+        }
+
+        switch (c) {
+            case ' ':
+            case '\t':
+            case '\n':
+            case '\r':
+                break;
+            case ',':
+                if (!scan_need_comma) {
+                    fail_rows();
+                }
+                scan_need_comma = 0;
+                scan_had_comma = 1;
+                break;
+            case ']':
+                if (scan_had_comma) {
+                    fail_rows();
+                    break;
+                }
+                scan_pos = rows_data_pos + ii;
+                return scan_pos;
+            default:
+                if (scan_need_comma || c == '}') {
+                    fail_rows();
+                    break;
+                }
+                if (rowcount == 0) {
+                    /* Nothing has been trimmed from current_buf yet */
+                    meta_buf.append(current_buf.c_str(), std::min(current_buf.size(), rows_data_pos));
+                    meta_buf.append(data, ii);
+                    header_len = rows_data_pos + ii;
+                }
+                scan_had_comma = 0;
+                row_begin = rows_data_pos + ii;
+                if (c == '{' || c == '[') {
+                    scan_stack.push_back(c);
+                } else if (c == '"') {
+                    scan_in_string = 1;
+                } else {
+                    scan_in_scalar = 1;
+                }
+                break;
+        }
+    }
+    scan_pos = rows_data_pos + ii;
+    return 0;
+}
+
+/**
+ * Runs scan_rows() over a chunk of the row set, and resumes jsonsl if the end
+ * of the row set was found.
+ *
+ * @param buffered whether the chunk is already part of current_buf. If it is
+ * not, rows which lie entirely within it are passed as slices of the chunk
+ * itself, and only what is still needed afterwards (a partial row, or the
+ * trailer) is copied into current_buf.
+ */
+void Parser::feed_rows(const char *data, size_t pos, size_t ndata, bool buffered)
+{
+    rows_data = data;
+    rows_data_pos = pos;
+    rows_data_len = ndata;
+    rows_data_copied = buffered ? ndata : 0;
+
+    size_t rowset_end = scan_rows();
+
+    if (stopped) {
+        rows_data = nullptr;
+        rows_data_len = 0;
+        rows_data_copied = 0;
+        return;
+    }
+
+    if (rows_data_copied < ndata) {
+        /* current_buf holds [min_pos, pos + rows_data_copied) */
+        if (keep_pos >= pos + rows_data_copied) {
+            current_buf.clear();
+            min_pos = keep_pos;
+            current_buf.append(data + (keep_pos - pos), ndata - (keep_pos - pos));
+        } else {
+            current_buf.append(data + rows_data_copied, ndata - rows_data_copied);
+        }
+    }
+    rows_data = nullptr;
+    rows_data_len = 0;
+    rows_data_copied = 0;
+
+    if (rowset_end) {
+        /* Resume jsonsl at the closing bracket, as if it had seen an empty row set */
+        scanning_rows = 0;
+        jsn->stopfl = 0;
+        jsn->pos = rowset_end;
+        jsn->tok_last = 0;
+        jsn->action_callback_POP = rowset_pop_callback;
+        jsn->action_callback_PUSH = nullptr;
+        jsonsl_feed(jsn, current_buf.c_str() + (rowset_end - min_pos), min_pos + current_buf.size() - rowset_end);
     }
 }
 
 void Parser::feed(const char *data_, size_t ndata)
 {
-    size_t old_len = current_buf.size();
-    current_buf.append(data_, ndata);
-    jsonsl_feed(jsn, current_buf.c_str() + old_len, ndata);
+    if (stopped) {
+        return;
+    }
+    if (scanning_rows) {
+        if (have_error) {
+            current_buf.append(data_, ndata);
+        } else {
+            feed_rows(data_, min_pos + current_buf.size(), ndata, false);
+        }
+    } else {
+        size_t old_len = current_buf.size();
+        current_buf.append(data_, ndata);
+        jsonsl_feed(jsn, current_buf.c_str() + old_len, ndata);
+
+        if (scanning_rows && !have_error) {
+            /* jsonsl stopped at the row set, and the rest of the chunk is already buffered */
+            size_t end = min_pos + current_buf.size();
+            feed_rows(current_buf.c_str() + (scan_pos - min_pos), scan_pos, end - scan_pos, true);
+        }
+    }
 
     /* Do we need to cut off some bytes? */
     if (keep_pos > min_pos) {
@@ -269,8 +538,10 @@ const char *Parser::jprstr_for_mode(Mode mode)
 
 Parser::Parser(Mode mode_, Parser::Actions *actions_)
     : jsn(jsonsl_new(512)), jsn_rdetails(jsonsl_new(32)), jpr(jsonsl_jpr_new(jprstr_for_mode(mode_), nullptr)),
-      mode(mode_), have_error(0), initialized(0), meta_complete(0), rowcount(0), min_pos(0), keep_pos(0), header_len(0),
-      last_row_endpos(0), cxx_data(), actions(actions_)
+      mode(mode_), have_error(0), initialized(0), meta_complete(0), stopped(0), rowcount(0), scanning_rows(0), scan_in_string(0),
+      scan_in_escape(0), scan_in_scalar(0), scan_need_comma(0), scan_had_comma(0), scan_pos(0), row_begin(0), rows_data(nullptr),
+      rows_data_pos(0), rows_data_len(0), rows_data_copied(0), min_pos(0),
+      keep_pos(0), header_len(0), last_row_endpos(0), cxx_data(), actions(actions_)
 {
 
     jsonsl_jpr_match_state_init(jsn, &jpr, 1);
@@ -290,6 +561,20 @@ Parser::Parser(Mode mode_, Parser::Actions *actions_)
     jsonsl_enable_all_callbacks(jsn);
 }
 
+void Parser::stop()
+{
+    if (stopped) {
+        return;
+    }
+    stopped = 1;
+    if (!meta_complete && rowcount) {
+        /* The header ends with the opening bracket of the row set */
+        meta_buf.resize(header_len);
+        meta_buf.append("]}");
+        meta_complete = 1;
+    }
+}
+
 void Parser::get_postmortem(lcb_IOV &out) const
 {
     if (meta_complete) {
@@ -448,3 +733,161 @@ bool lcb::jsparse::parse_json_strict(const std::string &s, Json::Value &root)
 {
     return parse_json_strict(s.c_str(), s.size(), root);
 }
+
+namespace
+{
+size_t skip_whitespace(const char *s, size_t n, size_t pos)
+{
+    while (pos < n && (s[pos] == ' ' || s[pos] == '\t' || s[pos] == '\n' || s[pos] == '\r')) {
+        pos++;
+    }
+    return pos;
+}
+
+/**
+ * @return the position just past the JSON value starting at pos, or
+ * std::string::npos if it is truncated. Values are not validated beyond their
+ * strings and brackets.
+ */
+size_t skip_value(const char *s, size_t n, size_t pos)
+{
+    if (pos >= n) {
+        return std::string::npos;
+    }
+    if (s[pos] == '"') {
+        for (size_t ii = pos + 1; ii < n; ii++) {
+            ii += skip_string_bytes(s + ii, n - ii);
+            if (ii == n) {
+                break;
+            }
+            if (s[ii] == '\\') {
+                ii++;
+            } else if (s[ii] == '"') {
+                return ii + 1;
+            }
+        }
+        return std::string::npos;
+    }
+    if (s[pos] == '{' || s[pos] == '[') {
+        size_t depth = 0;
+        for (size_t ii = pos; ii < n; ii++) {
+            ii += skip_container_bytes(s + ii, n - ii);
+            if (ii == n) {
+                break;
+            }
+            switch (s[ii]) {
+                case '"': {
+                    size_t end = skip_value(s, n, ii);
+                    if (end == std::string::npos) {
+                        return end;
+                    }
+                    ii = end - 1;
+                    break;
+                }
+                case '{':
+                case '[':
+                    depth++;
+                    break;
+                case '}':
+                case ']':
+                    if (--depth == 0) {
+                        return ii + 1;
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+        return std::string::npos;
+    }
+    while (pos < n && s[pos] != ',' && s[pos] != '}' && s[pos] != ']' && s[pos] != ' ' && s[pos] != '\t' &&
+           s[pos] != '\n' && s[pos] != '\r') {
+        pos++;
+    }
+    return pos;
+}
+} // namespace
+
+Projection::Match Projection::match(const std::string &path) const
+{
+    Match ret = MATCH_NONE;
+    for (const auto &candidate : paths) {
+        if (candidate == path) {
+            return MATCH_EXACT;
+        }
+        if (candidate.size() > path.size() && candidate[path.size()] == '.' && candidate.compare(0, path.size(), path) == 0) {
+            ret = MATCH_PREFIX;
+        }
+    }
+    return ret;
+}
+
+size_t Projection::project_object(const char *s, size_t n, size_t pos, const std::string &prefix,
+                                  std::string &out) const
+{
+    const size_t npos = std::string::npos;
+    if (pos >= n || s[pos] != '{') {
+        return npos;
+    }
+    out.append(1, '{');
+    bool first = true;
+    pos = skip_whitespace(s, n, pos + 1);
+    if (pos < n && s[pos] == '}') {
+        out.append(1, '}');
+        return pos + 1;
+    }
+
+    while (true) {
+        size_t key_begin = pos;
+        size_t key_end = pos < n && s[pos] == '"' ? skip_value(s, n, pos) : npos;
+        if (key_end == npos) {
+            return npos;
+        }
+        std::string path(prefix);
+        path.append(s + key_begin + 1, key_end - key_begin - 2);
+        pos = skip_whitespace(s, n, key_end);
+        if (pos >= n || s[pos] != ':') {
+            return npos;
+        }
+        size_t value_begin = skip_whitespace(s, n, pos + 1);
+        size_t value_end;
+
+        Match m = match(path);
+        if (m == MATCH_NONE || (m == MATCH_PREFIX && (value_begin >= n || s[value_begin] != '{'))) {
+            value_end = skip_value(s, n, value_begin);
+        } else {
+            out.append(first ? "" : ",").append(s + key_begin, key_end - key_begin).append(1, ':');
+            first = false;
+            if (m == MATCH_PREFIX) {
+                value_end = project_object(s, n, value_begin, path + ".", out);
+            } else {
+                value_end = skip_value(s, n, value_begin);
+                if (value_end != npos) {
+                    out.append(s + value_begin, value_end - value_begin);
+                }
+            }
+        }
+        if (value_end == npos) {
+            return npos;
+        }
+
+        pos = skip_whitespace(s, n, value_end);
+        if (pos >= n) {
+            return npos;
+        }
+        if (s[pos] == '}') {
+            out.append(1, '}');
+            return pos + 1;
+        }
+        if (s[pos] != ',') {
+            return npos;
+        }
+        pos = skip_whitespace(s, n, pos + 1);
+    }
+}
+
+bool Projection::project(const char *s, size_t n, std::string &out) const
+{
+    out.clear();
+    return project_object(s, n, skip_whitespace(s, n, 0), std::string(), out) != std::string::npos;
+}
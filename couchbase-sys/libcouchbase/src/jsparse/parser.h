@@ -21,6 +21,7 @@
 #include "contrib/jsonsl/jsonsl.h"
 #include "contrib/lcb-jsoncpp/lcb-jsoncpp.h"
 #include <string>
+#include <vector>
 
 namespace lcb
 {
@@ -34,6 +35,37 @@ bool parse_json_strict(const std::string &s, Json::Value &root);
 
 struct Parser;
 
+/**
+ * Members to keep when projecting JSON objects. Paths are dotted member names
+ * (e.g. "fields.title"). Members whose path was added are copied whole,
+ * objects on the way to such a path are projected in turn, and everything else
+ * is skipped over without being parsed.
+ */
+struct Projection {
+    void add(const std::string &path)
+    {
+        paths.push_back(path);
+    }
+
+    bool empty() const
+    {
+        return paths.empty();
+    }
+
+    /**
+     * Copy the kept members of the object in `s` into `out`
+     * @return false if `s` is not a complete JSON object
+     */
+    bool project(const char *s, size_t n, std::string &out) const;
+
+  private:
+    enum Match { MATCH_NONE, MATCH_EXACT, MATCH_PREFIX };
+    Match match(const std::string &path) const;
+    size_t project_object(const char *s, size_t n, size_t pos, const std::string &prefix, std::string &out) const;
+
+    std::vector<std::string> paths;
+};
+
 struct Row {
     lcb_IOV docid{};
     lcb_IOV key{};
@@ -111,9 +143,24 @@ struct Parser {
      */
     void get_postmortem(lcb_IOV &out) const;
 
+    /**
+     * Stop parsing. No more callbacks are invoked, and the remainder of the
+     * current chunk, as well as anything fed afterwards, is discarded. This may
+     * be called from within JSPARSE_on_row().
+     *
+     * If rows were received, the metadata (see get_postmortem()) becomes the
+     * header of the response with an empty row set, e.g.
+     * `{"requestID":"...","results":[]}`, as its trailer never arrives.
+     */
+    void stop();
+
     inline const char *get_buffer_region(size_t pos, size_t desired, size_t *actual) const;
     inline void combine_meta();
     inline static const char *jprstr_for_mode(Mode);
+    inline void feed_rows(const char *data, size_t pos, size_t ndata, bool buffered);
+    inline size_t scan_rows();
+    inline void emit_row(size_t endpos);
+    inline void fail_rows();
 
     jsonsl_t jsn;            /**< Parser for the row itself */
     jsonsl_t jsn_rdetails;   /**< Parser for the row details */
@@ -128,8 +175,33 @@ struct Parser {
     lcb_U8 have_error;
     lcb_U8 initialized;
     lcb_U8 meta_complete;
+    lcb_U8 stopped; /**< see stop() */
     unsigned rowcount;
 
+    /**
+     * Row splitter state. Once jsonsl has found the opening bracket of the
+     * row set, it is paused and the rows are split out by scan_rows(), which
+     * only tracks the strings and brackets needed to find where each row ends.
+     * jsonsl is resumed at the closing bracket to parse the trailer.
+     *
+     * While splitting rows, chunks are scanned where they were passed to
+     * feed() (typically the socket's read buffer), and only copied into
+     * current_buf if some of their bytes are still needed after the call.
+     */
+    lcb_U8 scanning_rows;
+    lcb_U8 scan_in_string;
+    lcb_U8 scan_in_escape;
+    lcb_U8 scan_in_scalar;
+    lcb_U8 scan_need_comma; /**< a row was just emitted */
+    lcb_U8 scan_had_comma;  /**< a comma was seen, and no row followed it yet */
+    std::string scan_stack; /**< opening brackets of the current row */
+    size_t scan_pos;        /**< absolute position of the next byte to scan */
+    size_t row_begin;       /**< absolute position of the current row */
+    const char *rows_data;   /**< chunk being scanned */
+    size_t rows_data_pos;    /**< absolute position of rows_data */
+    size_t rows_data_len;    /**< length of rows_data */
+    size_t rows_data_copied; /**< leading bytes of rows_data already in current_buf */
+
     /* absolute position offset corresponding to the first byte in current_buf */
     size_t min_pos;
 
@@ -19,9 +19,13 @@
 #include "connect.h"
 #include "ioutils.h"
 #include "iotable.h"
+#include "resolve.h"
 #include "settings.h"
 #include "timer-cxx.h"
 #include "rnd.h"
+#include "trace.h"
+
+#include <algorithm>
 
 using namespace lcb::io;
 
@@ -56,6 +60,18 @@ namespace lcb
 {
 namespace io
 {
+struct Connstart;
+
+/** A connect() in flight to one of the addresses of a host (Event only) */
+struct ConnAttempt {
+    Connstart *parent;
+    addrinfo *ai;
+    lcb_socket_t fd;
+    void *event;
+    bool watching; /* whether the event is active */
+    bool retried;  /* whether EINVAL was retried */
+};
+
 struct Connstart : ConnectionRequest {
     Connstart(lcbio_TABLE *, lcb_settings *, const lcb_host_t *, uint32_t, lcbio_CONNDONE_cb, void *);
 
@@ -72,6 +88,14 @@ struct Connstart : ConnectionRequest {
     void notify_error(lcb_STATUS err);
     bool ensure_sock();
     void clear_sock();
+    void resolved(int eai);
+    static void resolve_cb(void *arg, int eai, const std::shared_ptr<AddrList> &result);
+    void E_start_next();
+    int E_try(ConnAttempt *attempt, short events);
+    void E_step(ConnAttempt *attempt, short events);
+    void E_win(ConnAttempt *attempt);
+    void E_drop(ConnAttempt *attempt);
+    void E_drop_attempts();
 
     lcbio_CONNDONE_cb user_handler;
     void *user_arg;
@@ -81,11 +105,20 @@ struct Connstart : ConnectionRequest {
     void *event;
     bool ev_active;   /* whether the event pointer is active (Event only) */
     bool in_uhandler; /* Whether we're inside the user-defined handler */
-    addrinfo *ai_root;
+    Resolver *resolver;
+    int family;
+    bool resolving;    /* whether the resolver will invoke resolve_cb */
+    bool from_cache;   /* whether addrs were cached by the resolver */
+    std::shared_ptr<AddrList> addrs;
     addrinfo *ai;
+    std::vector<addrinfo *> order;       /* addresses, alternating between families (Event only) */
+    size_t next_addr;                    /* index in order of the next address to try */
+    std::vector<ConnAttempt *> attempts; /* connects in flight (Event only) */
     State state;
     lcb_STATUS last_error;
+    hrtime_t start;
     Timer<Connstart, &Connstart::handler> timer;
+    Timer<Connstart, &Connstart::E_start_next> stagger_timer;
 };
 } // namespace io
 } // namespace lcb
@@ -99,9 +132,9 @@ void Connstart::unwatch()
     }
 }
 
-static void try_enable_sockopt(lcbio_SOCKET *sock, int cntl)
+static void try_enable_sockopt(lcbio_SOCKET *sock, int cntl, int value = 1)
 {
-    lcb_STATUS rv = lcbio_enable_sockopt(sock, cntl);
+    lcb_STATUS rv = lcbio_set_sockopt(sock, cntl, value);
     if (rv == LCB_SUCCESS) {
         lcb_log(LOGARGS(sock, DEBUG), CSLOGFMT "Successfully set %s", CSLOGID(sock), lcbio_strsockopt(cntl));
     } else {
@@ -118,6 +151,8 @@ void Connstart::handler()
 {
     lcb_STATUS err;
 
+    stagger_timer.cancel();
+    E_drop_attempts();
     if (sock && event) {
         unwatch();
         sock->io->E_event_destroy(event);
@@ -164,10 +199,20 @@ void Connstart::handler()
             if (sock->settings->tcp_keepalive) {
                 try_enable_sockopt(sock, LCB_IO_CNTL_TCP_KEEPALIVE);
             }
+            if (sock->settings->tcp_user_timeout) {
+                /* rounded up, as 0 would restore the system default */
+                try_enable_sockopt(sock, LCB_IO_CNTL_TCP_USER_TIMEOUT,
+                                   (int)((sock->settings->tcp_user_timeout + 999) / 1000));
+            }
         } else {
             lcb_log(LOGARGS_T(ERR), CSLOGFMT "Failed to establish connection: %s, os errno=%u", CSLOGID_T(),
                     lcb_strerror_short(err), syserr);
+            if (from_cache) {
+                /* the node may have moved, look it up again next time */
+                resolver->invalidate(&sock->info->ep_remote, family);
+            }
         }
+        TRACE_SOCKET_CONNECT(sock, err, gethrtime() - start);
     }
 
     /** Handler section */
@@ -182,12 +227,16 @@ GT_DTOR:
 Connstart::~Connstart()
 {
     timer.release();
+    stagger_timer.release();
+    if (resolver) {
+        if (resolving) {
+            resolver->cancel(this);
+        }
+        resolver->unref();
+    }
     if (sock) {
         lcbio_unref(sock)
     }
-    if (ai_root) {
-        freeaddrinfo(ai_root);
-    }
 }
 
 void Connstart::state_signal(State next_state, lcb_STATUS err)
@@ -253,32 +302,17 @@ bool Connstart::ensure_sock()
         return false;
     }
 
-    if (io->is_E()) {
-        if (sock->u.fd != INVALID_SOCKET) {
-            /* already have one? */
-            return true;
-        }
+    if (sock->u.sd) {
+        return true;
+    }
 
-        while (sock->u.fd == INVALID_SOCKET && ai != nullptr) {
-            sock->u.fd = lcbio_E_ai2sock(io, &ai, &errtmp);
-            if (sock->u.fd != INVALID_SOCKET) {
-                lcb_log(LOGARGS_T(DEBUG), CSLOGFMT "Created new socket with FD=%d", CSLOGID_T(), sock->u.fd);
-                return true;
-            }
-        }
-    } else {
+    while (sock->u.sd == nullptr && ai != nullptr) {
+        sock->u.sd = lcbio_C_ai2sock(io, &ai, &errtmp);
         if (sock->u.sd) {
+            sock->u.sd->lcbconn = const_cast<lcbio_SOCKET *>(sock);
+            sock->u.sd->parent = IOT_ARG(io);
             return true;
         }
-
-        while (sock->u.sd == nullptr && ai != nullptr) {
-            sock->u.sd = lcbio_C_ai2sock(io, &ai, &errtmp);
-            if (sock->u.sd) {
-                sock->u.sd->lcbconn = const_cast<lcbio_SOCKET *>(sock);
-                sock->u.sd->parent = IOT_ARG(io);
-                return true;
-            }
-        }
     }
 
     if (ai == nullptr) {
@@ -299,89 +333,154 @@ void Connstart::clear_sock()
         return;
     }
 
-    if (iot->is_E()) {
-        unwatch();
-        iot->E_close(sock->u.fd);
-        sock->u.fd = INVALID_SOCKET;
-    } else {
-        if (sock->u.sd) {
-            iot->C_close(sock->u.sd);
-            sock->u.sd = nullptr;
-        }
+    if (sock->u.sd) {
+        iot->C_close(sock->u.sd);
+        sock->u.sd = nullptr;
     }
 }
 
-static void E_conncb(lcb_socket_t, short events, void *arg)
+static void E_attempt_cb(lcb_socket_t, short events, void *arg)
 {
-    auto *cs = reinterpret_cast<Connstart *>(arg);
-    lcbio_SOCKET *s = cs->sock;
-    lcbio_TABLE *io = s->io;
-    int retry_once = 0;
-    lcbio_CSERR connstatus;
-    addrinfo *ai = nullptr;
-
-GT_NEXTSOCK:
-    if (!cs->ensure_sock()) {
-        cs->notify_error(LCB_ERR_CONNECT_ERROR);
-        return;
-    }
-
-    if (events & LCB_ERROR_EVENT) {
-        socklen_t errlen = sizeof(int);
-        int sockerr = 0;
-        getsockopt(s->u.fd, SOL_SOCKET, SO_ERROR, (char *)&sockerr, &errlen);
-        lcbio_mksyserr(sockerr, &cs->syserr);
-        lcb_log(LOGARGS(s, TRACE), CSLOGFMT "Received ERROR_EVENT, sockerr=%d, syserr=%d", CSLOGID(s), sockerr,
-                (int)cs->syserr);
-        cs->clear_sock();
-        goto GT_NEXTSOCK;
+    auto *attempt = reinterpret_cast<ConnAttempt *>(arg);
+    attempt->parent->E_step(attempt, events);
+}
 
-    } else {
-        ai = cs->ai;
+/**
+ * Starts connecting to the next address. If the connect does not complete
+ * right away, the following address is tried after connect_attempt_delay
+ * (RFC 8305), or as soon as this one fails.
+ */
+void Connstart::E_start_next()
+{
+    lcbio_TABLE *io = sock->io;
 
-    GT_CONNECT:
-        int rv = io->E_connect(s->u.fd, ai->ai_addr, ai->ai_addrlen);
+    while (next_addr < order.size()) {
+        addrinfo *cur = order[next_addr++];
+        lcb_socket_t fd = io->E_socket(cur);
+        if (fd == INVALID_SOCKET) {
+            lcbio_mksyserr(io->get_errno(), &syserr);
+            continue;
+        }
+        lcb_log(LOGARGS_T(DEBUG), CSLOGFMT "Created new socket with FD=%d (address %u of %u)", CSLOGID_T(), fd,
+                (unsigned)next_addr, (unsigned)order.size());
+
+        auto *attempt = new ConnAttempt{this, cur, fd, io->E_event_create(), false, false};
+        attempts.push_back(attempt);
+        int rv = E_try(attempt, 0);
+        if (rv > 0) {
+            E_win(attempt);
+            return;
+        }
         if (rv == 0) {
-            cs->unwatch();
-            cs->notify_success();
+            uint32_t delay = sock->settings->connect_attempt_delay;
+            if (delay && next_addr < order.size()) {
+                stagger_timer.rearm(delay);
+            }
             return;
         }
+        E_drop(attempt);
     }
 
-    connstatus = lcbio_mkcserr(io->get_errno());
-    lcbio_mksyserr(io->get_errno(), &cs->syserr);
+    if (attempts.empty()) {
+        notify_error(LCB_ERR_CONNECT_ERROR);
+    }
+}
 
-    switch (connstatus) {
+/** @return 1 if the attempt connected, 0 if it is in progress, -1 if it failed */
+int Connstart::E_try(ConnAttempt *attempt, short events)
+{
+    lcbio_TABLE *io = sock->io;
 
-        case LCBIO_CSERR_INTR:
-            goto GT_CONNECT;
+    if (events & LCB_ERROR_EVENT) {
+        socklen_t errlen = sizeof(int);
+        int sockerr = 0;
+        getsockopt(attempt->fd, SOL_SOCKET, SO_ERROR, (char *)&sockerr, &errlen);
+        lcbio_mksyserr(sockerr, &syserr);
+        lcb_log(LOGARGS_T(TRACE), CSLOGFMT "Received ERROR_EVENT, sockerr=%d, syserr=%d", CSLOGID_T(), sockerr,
+                (int)syserr);
+        return -1;
+    }
 
-        case LCBIO_CSERR_CONNECTED:
-            cs->unwatch();
-            cs->notify_success();
-            return;
+    for (;;) {
+        if (io->E_connect(attempt->fd, attempt->ai->ai_addr, attempt->ai->ai_addrlen) == 0) {
+            return 1;
+        }
+        lcbio_mksyserr(io->get_errno(), &syserr);
+
+        switch (lcbio_mkcserr(io->get_errno())) {
+            case LCBIO_CSERR_INTR:
+                continue;
+
+            case LCBIO_CSERR_CONNECTED:
+                return 1;
+
+            case LCBIO_CSERR_BUSY:
+                lcb_log(LOGARGS_T(TRACE), CSLOGFMT "Scheduling I/O watcher for asynchronous connection completion.",
+                        CSLOGID_T());
+                io->E_event_watch(attempt->fd, attempt->event, LCB_WRITE_EVENT, attempt, E_attempt_cb);
+                attempt->watching = true;
+                return 0;
+
+            case LCBIO_CSERR_EINVAL:
+                if (!attempt->retried) {
+                    attempt->retried = true;
+                    continue;
+                }
+                /* fallthrough */
+
+            case LCBIO_CSERR_EFAIL:
+            default:
+                lcb_log(LOGARGS_T(TRACE), CSLOGFMT "connect() failed. errno=%d [%s]", CSLOGID_T(), IOT_ERRNO(io),
+                        strerror(IOT_ERRNO(io)));
+                return -1;
+        }
+    }
+}
 
-        case LCBIO_CSERR_BUSY:
-            lcb_log(LOGARGS(s, TRACE), CSLOGFMT "Scheduling I/O watcher for asynchronous connection completion.",
-                    CSLOGID(s));
-            io->E_event_watch(s->u.fd, cs->event, LCB_WRITE_EVENT, cs, E_conncb);
-            cs->ev_active = true;
-            return;
+void Connstart::E_step(ConnAttempt *attempt, short events)
+{
+    int rv = E_try(attempt, events);
+    if (rv > 0) {
+        E_win(attempt);
+    } else if (rv < 0) {
+        /* don't wait for the delay, the next address may be the good one */
+        E_drop(attempt);
+        stagger_timer.cancel();
+        E_start_next();
+    }
+}
 
-        case LCBIO_CSERR_EINVAL:
-            if (!retry_once) {
-                retry_once = 1;
-                goto GT_CONNECT;
-            }
-            /* fallthrough */
+/** The first connected attempt becomes the socket, the others are closed */
+void Connstart::E_win(ConnAttempt *attempt)
+{
+    attempts.erase(std::find(attempts.begin(), attempts.end(), attempt));
+    sock->u.fd = attempt->fd;
+    event = attempt->event;
+    ev_active = attempt->watching;
+    delete attempt;
+
+    stagger_timer.cancel();
+    E_drop_attempts();
+    unwatch();
+    notify_success();
+}
 
-        case LCBIO_CSERR_EFAIL:
-        default:
-            /* close the current socket and try again */
-            lcb_log(LOGARGS(s, TRACE), CSLOGFMT "connect() failed. errno=%d [%s]", CSLOGID(s), IOT_ERRNO(io),
-                    strerror(IOT_ERRNO(io)));
-            cs->clear_sock();
-            goto GT_NEXTSOCK;
+void Connstart::E_drop(ConnAttempt *attempt)
+{
+    lcbio_TABLE *io = sock->io;
+    if (attempt->watching) {
+        io->E_event_cancel(attempt->fd, attempt->event);
+    }
+    io->E_event_destroy(attempt->event);
+    io->E_close(attempt->fd);
+    attempts.erase(std::find(attempts.begin(), attempts.end(), attempt));
+    delete attempt;
+}
+
+void Connstart::E_drop_attempts()
+{
+    while (!attempts.empty()) {
+        E_drop(attempts.back());
     }
 }
 
@@ -471,12 +570,10 @@ ConnectionRequest *lcbio_connect(lcbio_TABLE *iot, lcb_settings *settings, const
 Connstart::Connstart(lcbio_TABLE *iot_, lcb_settings *settings_, const lcb_host_t *dest, uint32_t timeout,
                      lcbio_CONNDONE_cb handler_, void *arg)
     : user_handler(handler_), user_arg(arg), sock(nullptr), syserr(0), event(nullptr), ev_active(false),
-      in_uhandler(false), ai_root(nullptr), ai(nullptr), state(CS_PENDING), last_error(LCB_SUCCESS), timer(iot_, this)
+      in_uhandler(false), resolver(settings_->resolver), family(AF_UNSPEC), resolving(false), from_cache(false),
+      ai(nullptr), next_addr(0), state(CS_PENDING), last_error(LCB_SUCCESS), start(gethrtime()), timer(iot_, this),
+      stagger_timer(iot_, this)
 {
-
-    addrinfo hints{};
-    int rv;
-
     sock = reinterpret_cast<lcbio_SOCKET *>(calloc(1, sizeof(*sock)));
 
     /** Initialize the socket first */
@@ -493,38 +590,176 @@ Connstart::Connstart(lcbio_TABLE *iot_, lcb_settings *settings_, const lcb_host_
 
     if (iot_->is_E()) {
         sock->u.fd = INVALID_SOCKET;
-        event = iot_->E_event_create();
     }
 
     timer.rearm(timeout);
     lcb_log(LOGARGS_T(INFO), CSLOGFMT "Starting. Timeout=%uus", CSLOGID_T(), timeout);
 
     /** Hostname lookup: */
-    memset(&hints, 0, sizeof(hints));
-    hints.ai_flags = AI_PASSIVE;
-    hints.ai_socktype = SOCK_STREAM;
     if (settings_->ipv6 == LCB_IPV6_DISABLED) {
-        hints.ai_family = AF_INET;
+        family = AF_INET;
     } else if (settings_->ipv6 == LCB_IPV6_ONLY) {
-        hints.ai_family = AF_INET6;
+        family = AF_INET6;
+    }
+
+    int eai;
+    if (resolver) {
+        resolver->ref();
+        if (!resolver->resolve(dest, family, resolve_cb, this, &eai, &addrs, &from_cache)) {
+            resolving = true;
+            lcb_log(LOGARGS_T(DEBUG), CSLOGFMT "Resolving %s asynchronously", CSLOGID_T(), dest->host);
+            return;
+        }
     } else {
-        hints.ai_family = AF_UNSPEC;
+        /* no instance, e.g. the socket tests */
+        addrinfo hints{};
+        addrinfo *res = nullptr;
+        hints.ai_flags = AI_PASSIVE;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_family = family;
+        if ((eai = getaddrinfo(dest->host, dest->port, &hints, &res)) == 0) {
+            addrs = std::make_shared<AddrList>(res);
+            freeaddrinfo(res);
+        }
     }
+    resolved(eai);
+}
 
-    if ((rv = getaddrinfo(dest->host, dest->port, &hints, &ai_root))) {
-        const char *errstr = rv != EAI_SYSTEM ? gai_strerror(rv) : "";
-        lcb_log(LOGARGS_T(ERR), CSLOGFMT "Couldn't look up %s (%s) [EAI=%d]", CSLOGID_T(), dest->host, errstr, rv);
+void Connstart::resolve_cb(void *arg, int eai, const std::shared_ptr<AddrList> &result)
+{
+    auto *cs = static_cast<Connstart *>(arg);
+    cs->resolving = false;
+    cs->addrs = result;
+    cs->resolved(eai);
+}
+
+void Connstart::resolved(int eai)
+{
+    const lcb_host_t *dest = &sock->info->ep_remote;
+    if (eai != 0) {
+        const char *errstr = eai != EAI_SYSTEM ? gai_strerror(eai) : "";
+        lcb_log(LOGARGS_T(ERR), CSLOGFMT "Couldn't look up %s (%s) [EAI=%d]", CSLOGID_T(), dest->host, errstr, eai);
         notify_error(LCB_ERR_UNKNOWN_HOST);
+        return;
+    }
+
+    ai = addrs->head();
+    if (from_cache) {
+        lcb_log(LOGARGS_T(TRACE), CSLOGFMT "Using cached addresses of %s", CSLOGID_T(), dest->host);
+    }
+
+    /** Figure out how to connect */
+    if (sock->io->is_E()) {
+        /* RFC 8305: alternate between the families, starting with the preferred one */
+        std::vector<addrinfo *> others;
+        for (addrinfo *cur = ai; cur != nullptr; cur = cur->ai_next) {
+            (cur->ai_family == ai->ai_family ? order : others).push_back(cur);
+        }
+        for (size_t ii = 0; ii < others.size(); ii++) {
+            order.insert(order.begin() + std::min(order.size(), 2 * ii + 1), others[ii]);
+        }
+        E_start_next();
     } else {
-        ai = ai_root;
+        C_connect();
+    }
+}
 
-        /** Figure out how to connect */
-        if (iot_->is_E()) {
-            E_conncb(-1, LCB_WRITE_EVENT, this);
-        } else {
-            C_connect();
+namespace lcb
+{
+namespace io
+{
+/**
+ * Connects to the hosts of a list in parallel, starting the next one after
+ * connect_attempt_delay or as soon as the previous one fails. The first
+ * connection wins and the other attempts are cancelled.
+ */
+struct HostRace : ConnectionRequest {
+    struct Child {
+        HostRace *parent;
+        ConnectionRequest *req;
+    };
+
+    HostRace(lcbio_TABLE *iot_, lcb_settings *settings_, std::vector<lcb_host_t> hosts_, uint32_t timeout_,
+             lcbio_CONNDONE_cb handler_, void *arg_)
+        : iot(iot_), settings(settings_), hosts(std::move(hosts_)), timeout(timeout_), user_handler(handler_),
+          user_arg(arg_), timer(iot_, this)
+    {
+    }
+
+    ~HostRace() override
+    {
+        timer.release();
+    }
+
+    void cancel() override
+    {
+        if (in_uhandler) {
+            return;
+        }
+        drop_children();
+        delete this;
+    }
+
+    void start_next();
+    void drop_children();
+    static void child_done(lcbio_SOCKET *sock, void *arg, lcb_STATUS err, lcbio_OSERR syserr);
+
+    lcbio_TABLE *iot;
+    lcb_settings *settings;
+    std::vector<lcb_host_t> hosts;
+    size_t next_host{0};
+    uint32_t timeout;
+    lcbio_CONNDONE_cb user_handler;
+    void *user_arg;
+    std::vector<Child *> children;
+    bool in_uhandler{false};
+    Timer<HostRace, &HostRace::start_next> timer;
+};
+} // namespace io
+} // namespace lcb
+
+void HostRace::start_next()
+{
+    if (next_host == hosts.size()) {
+        return;
+    }
+    auto *child = new Child{this, nullptr};
+    children.push_back(child);
+    child->req = lcbio_connect(iot, settings, &hosts[next_host++], timeout, child_done, child);
+    if (next_host < hosts.size()) {
+        timer.rearm(settings->connect_attempt_delay);
+    }
+}
+
+void HostRace::drop_children()
+{
+    timer.cancel();
+    for (auto *child : children) {
+        child->req->cancel();
+        delete child;
+    }
+    children.clear();
+}
+
+void HostRace::child_done(lcbio_SOCKET *sock, void *arg, lcb_STATUS err, lcbio_OSERR syserr)
+{
+    auto *child = reinterpret_cast<Child *>(arg);
+    HostRace *race = child->parent;
+    race->children.erase(std::find(race->children.begin(), race->children.end(), child));
+    delete child;
+
+    if (sock == nullptr && (!race->children.empty() || race->next_host < race->hosts.size())) {
+        if (race->children.empty()) {
+            race->timer.cancel();
+            race->start_next();
         }
+        return;
     }
+
+    race->drop_children();
+    race->in_uhandler = true;
+    race->user_handler(sock, race->user_arg, err, syserr);
+    delete race;
 }
 
 ConnectionRequest *lcbio_connect_hl(lcbio_TABLE *iot, lcb_settings *settings, lcb::Hostlist *hl, int rollover,
@@ -533,14 +768,26 @@ ConnectionRequest *lcbio_connect_hl(lcbio_TABLE *iot, lcb_settings *settings, lc
     const lcb_host_t *cur;
     unsigned ii = 0, hlmax = hl->size();
 
-    while ((cur = hl->next(rollover)) && ii++ < hlmax) {
-        ConnectionRequest *ret = lcbio_connect(iot, settings, cur, timeout, handler, arg);
-        if (ret) {
-            return ret;
+    if (settings->connect_attempt_delay == 0 || hlmax < 2) {
+        while ((cur = hl->next(rollover)) && ii++ < hlmax) {
+            ConnectionRequest *ret = lcbio_connect(iot, settings, cur, timeout, handler, arg);
+            if (ret) {
+                return ret;
+            }
         }
+        return nullptr;
     }
 
-    return nullptr;
+    std::vector<lcb_host_t> hosts;
+    while ((cur = hl->next(rollover)) && ii++ < hlmax) {
+        hosts.push_back(*cur);
+    }
+    if (hosts.empty()) {
+        return nullptr;
+    }
+    auto *race = new HostRace(iot, settings, std::move(hosts), timeout, handler, arg);
+    race->start_next();
+    return race;
 }
 
 void lcbio_shutdown(lcbio_SOCKET *s)
@@ -567,6 +814,7 @@ void lcbio__destroy(lcbio_SOCKET *s)
     if (s->info) {
         free(s->info);
     }
+    lcbio_kstats_free(s);
     lcbio_table_unref(s->io);
     lcb_settings_unref(s->settings);
     free(s);
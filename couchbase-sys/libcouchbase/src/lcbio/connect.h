@@ -98,6 +98,8 @@ typedef enum {
 const char *lcbio_svcstr(lcbio_SERVICE service);
 
 /** @brief Core socket structure */
+typedef struct lcbio_KSTATS lcbio_KSTATS;
+
 typedef struct lcbio_SOCKET {
     lcbio_pTABLE io;
     lcb_settings *settings;
@@ -114,6 +116,7 @@ typedef struct lcbio_SOCKET {
     hrtime_t atime;
     lcbio_SERVICE service;
     lcb_U64 id;
+    lcbio_KSTATS *kstats; /**< set if the kernel statistics are enabled, see lcbio_kstats_enable() */
 } lcbio_SOCKET;
 
 /**
@@ -178,10 +181,11 @@ lcbio_pCONNSTART lcbio_connect(lcbio_pTABLE iot, lcb_settings *settings, const l
                                lcbio_CONNDONE_cb handler, void *arg);
 
 /**
- * Wraps `lcb_connect()` by traversing a list of hosts. This will cycle through
- * each host in the list until a connection has been successful. Currently
- * this will not intercept the handler but will catch any hostname lookup
- * failures.
+ * Wraps `lcb_connect()` by traversing a list of hosts. Unless
+ * lcb_settings::connect_attempt_delay is zero, the hosts are raced: the next
+ * one is tried once the delay has passed or the previous attempt has failed,
+ * and the first connection wins. Otherwise only the next host of the list is
+ * connected to.
  *
  * @param iot
  * @param settings
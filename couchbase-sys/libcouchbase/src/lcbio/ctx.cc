@@ -30,6 +30,12 @@
             ctx->sock->metrics->metric += n;                                                                           \
         }                                                                                                              \
     } while (0)
+#define CTX_RECORD_METRIC(ctx, histogram, value)                                                                       \
+    do {                                                                                                               \
+        if (ctx->sock && ctx->sock->metrics) {                                                                         \
+            lcbio_histogram_add(ctx->sock->metrics->histogram, value);                                                 \
+        }                                                                                                              \
+    } while (0)
 
 #define LOGARGS(c, lvl) (c)->sock->settings, "ioctx", LCB_LOG_##lvl, __FILE__, __LINE__
 
@@ -78,7 +84,11 @@ lcbio_CTX *lcbio_ctx_new(lcbio_SOCKET *sock, void *data, const lcbio_CTXPROCS *p
     sock->service = LCBIO_SERVICE_UNSPEC;
     sock->atime = LCB_NS2US(gethrtime());
 
-    rdb_init(&ctx->ior, sock->settings->allocator_factory());
+    if (sock->settings->read_pool) {
+        rdb_init(&ctx->ior, rdb_poolalloc_ref(sock->settings->read_pool));
+    } else {
+        rdb_init(&ctx->ior, sock->settings->allocator_factory());
+    }
     lcbio_ref(sock);
 
     if (IOT_IS_EVENT(ctx->io)) {
@@ -95,6 +105,23 @@ lcbio_CTX *lcbio_ctx_new(lcbio_SOCKET *sock, void *data, const lcbio_CTXPROCS *p
     return ctx;
 }
 
+static void wref_free(lcbio__WREF *wref)
+{
+    wref->release(wref->arg);
+    delete[] wref->iov;
+    delete wref;
+}
+
+/** Releases the output of lcbio_ctx_putv_nocopy() which has not been written yet */
+static void release_wrefs(lcbio_CTX *ctx)
+{
+    while (ctx->wrefs) {
+        lcbio__WREF *wref = ctx->wrefs;
+        ctx->wrefs = wref->next;
+        wref_free(wref);
+    }
+}
+
 static void free_ctx(lcbio_CTX *ctx)
 {
     rdb_cleanup(&ctx->ior);
@@ -103,6 +130,7 @@ static void free_ctx(lcbio_CTX *ctx)
         ringbuffer_destruct(&ctx->output->rb);
         delete ctx->output;
     }
+    release_wrefs(ctx);
     if (ctx->procs.cb_flush_ready) {
         /* dtor */
         ctx->procs.cb_flush_ready(ctx);
@@ -110,6 +138,14 @@ static void free_ctx(lcbio_CTX *ctx)
     delete ctx;
 }
 
+static void wbatch_remove(lcbio_CTX *ctx)
+{
+    if (ctx->wbatched) {
+        lcb_list_delete(&ctx->wbnode);
+        ctx->wbatched = 0;
+    }
+}
+
 static void deactivate_watcher(lcbio_CTX *ctx)
 {
     if (ctx->evactive && ctx->event) {
@@ -123,6 +159,7 @@ void lcbio_ctx_close_ex(lcbio_CTX *ctx, lcbio_CTXCLOSE_cb cb, void *arg, lcbio_C
     unsigned oldrc;
     ctx->state = ES_DETACHED;
     lcb_assert(ctx->sock);
+    wbatch_remove(ctx);
 
     if (ctx->event) {
         deactivate_watcher(ctx);
@@ -146,7 +183,7 @@ void lcbio_ctx_close_ex(lcbio_CTX *ctx, lcbio_CTXCLOSE_cb cb, void *arg, lcbio_C
                        ctx->err == LCB_SUCCESS && /* no socket errors */
                        ctx->rdwant == 0 &&        /* no expected input */
                        ctx->wwant == 0 &&         /* no expected output */
-                       (ctx->output == nullptr || ctx->output->rb.nbytes == 0);
+                       (ctx->output == nullptr || ctx->output->rb.nbytes == 0) && ctx->wrefs == nullptr;
         cb(ctx->sock, reusable, arg);
     }
 
@@ -160,6 +197,7 @@ void lcbio_ctx_close_ex(lcbio_CTX *ctx, lcbio_CTXCLOSE_cb cb, void *arg, lcbio_C
         delete ctx->output;
         ctx->output = nullptr;
     }
+    release_wrefs(ctx);
 
     ctx->fd = INVALID_SOCKET;
     ctx->sd = nullptr;
@@ -182,10 +220,29 @@ void lcbio_ctx_close(lcbio_CTX *ctx, lcbio_CTXCLOSE_cb cb, void *arg)
     lcbio_ctx_close_ex(ctx, cb, arg, nullptr, nullptr);
 }
 
+static void free_copy(void *arg)
+{
+    free(arg);
+}
+
 void lcbio_ctx_put(lcbio_CTX *ctx, const void *buf, unsigned nbuf)
 {
     lcbio__EASYRB *erb = ctx->output;
 
+    if (ctx->wrefs) {
+        /* The ring buffer is written first, so the data has to queue behind the referenced buffers */
+        lcb_IOV iov;
+        iov.iov_base = malloc(nbuf);
+        iov.iov_len = nbuf;
+        if (!iov.iov_base) {
+            lcbio_ctx_senderr(ctx, LCB_ERR_NO_MEMORY);
+            return;
+        }
+        memcpy(iov.iov_base, buf, nbuf);
+        lcbio_ctx_putv_nocopy(ctx, &iov, 1, free_copy, iov.iov_base);
+        return;
+    }
+
     if (!erb) {
         erb = new lcbio__EASYRB{};
         ctx->output = erb;
@@ -205,6 +262,32 @@ void lcbio_ctx_put(lcbio_CTX *ctx, const void *buf, unsigned nbuf)
     ringbuffer_write(&erb->rb, buf, nbuf);
 }
 
+void lcbio_ctx_putv_nocopy(lcbio_CTX *ctx, const lcb_IOV *iov, unsigned niov, lcbio_CTXRELEASE_cb release, void *arg)
+{
+    auto *wref = new lcbio__WREF{};
+    wref->parent = ctx;
+    wref->iov = new lcb_IOV[niov];
+    for (unsigned ii = 0; ii < niov; ++ii) {
+        /* empty buffers would never be advanced past */
+        if (iov[ii].iov_len) {
+            wref->iov[wref->niov++] = iov[ii];
+            wref->nbytes += iov[ii].iov_len;
+        }
+    }
+    wref->release = release;
+    wref->arg = arg;
+    if (wref->niov == 0) {
+        wref_free(wref);
+        return;
+    }
+
+    lcbio__WREF **tail = &ctx->wrefs;
+    while (*tail) {
+        tail = &(*tail)->next;
+    }
+    *tail = wref;
+}
+
 void lcbio_ctx_rwant(lcbio_CTX *ctx, unsigned n)
 {
     ctx->rdwant = n;
@@ -262,18 +345,72 @@ static void send_io_error(lcbio_CTX *ctx, lcbio_IOSTATUS status)
     lcbio_ctx_senderr(ctx, rc);
 }
 
-static void E_handler(lcb_socket_t sock, short which, void *arg)
+/** Writes the output of lcbio_ctx_putv_nocopy(), releasing the buffers which are written */
+static lcbio_IOSTATUS E_wrefs_write(lcbio_CTX *ctx)
+{
+    lcbio_TABLE *iot = ctx->io;
+    while (ctx->wrefs) {
+        lcbio__WREF *wref = ctx->wrefs;
+        while (wref->cur < wref->niov) {
+            unsigned niov = wref->niov - wref->cur;
+            lcb_ssize_t nw = IOT_V0IO(iot).sendv(IOT_ARG(iot), CTX_FD(ctx), wref->iov + wref->cur,
+                                                 niov <= RWINL_IOVSIZE ? niov : RWINL_IOVSIZE);
+            CTX_INCR_METRIC(ctx, io_send_calls, 1);
+            if (nw == -1) {
+                switch (IOT_ERRNO(iot)) {
+                    case EINTR:
+                        continue;
+                    case EWOULDBLOCK:
+                    case C_EAGAIN:
+                        CTX_INCR_METRIC(ctx, io_send_eagain, 1);
+                        return LCBIO_PENDING;
+                    default:
+                        ctx->sock->last_error = IOT_ERRNO(iot);
+                        return LCBIO_IOERR;
+                }
+            }
+            CTX_INCR_METRIC(ctx, bytes_sent, nw);
+            CTX_RECORD_METRIC(ctx, send_bytes, nw);
+            if (ctx->sock->kstats) {
+                lcbio_kstats_sent(ctx->sock, nw);
+            }
+            while (nw > 0) {
+                lcb_IOV *cur = &wref->iov[wref->cur];
+                if ((size_t)nw >= cur->iov_len) {
+                    nw -= cur->iov_len;
+                    wref->cur++;
+                } else {
+                    cur->iov_base = static_cast<char *>(cur->iov_base) + nw;
+                    cur->iov_len -= nw;
+                    nw = 0;
+                }
+            }
+        }
+        ctx->wrefs = wref->next;
+        wref_free(wref);
+    }
+    return LCBIO_COMPLETED;
+}
+
+static void E_handle_event(lcbio_CTX *ctx, short which)
 {
-    auto *ctx = static_cast<lcbio_CTX *>(arg);
     lcbio_IOSTATUS status;
-    (void)sock;
+
+    if (ctx->sock->kstats) {
+        lcbio_kstats_event(ctx->sock, which);
+    }
 
     if (which & LCB_READ_EVENT) {
         unsigned nb;
+        lcb_IOMETRICS *metrics = ctx->sock->metrics;
+        lcb_SIZE ncalls = metrics ? metrics->io_recv_calls : 0;
         status = lcbio_E_rdb_slurp(ctx, &ctx->ior);
         nb = rdb_get_nused(&ctx->ior);
+        if (metrics) {
+            lcbio_histogram_add(metrics->recv_calls_per_event, metrics->io_recv_calls - ncalls);
+        }
 
-        ctx->sock->atime = LCB_NS2US(gethrtime());
+        ctx->sock->atime = LCB_NS2US(lcb_settings_now(ctx->sock->settings));
         if (nb >= ctx->rdwant) {
             invoke_read_cb(ctx, nb);
             if (E_free_detached(ctx)) {
@@ -288,15 +425,20 @@ static void E_handler(lcb_socket_t sock, short which, void *arg)
     }
 
     if (which & LCB_WRITE_EVENT) {
+        ctx->wblocked = 0;
         if (ctx->wwant) {
             ctx->wwant = 0;
             ctx->procs.cb_flush_ready(ctx);
             if (ctx->err) {
                 return;
             }
-        } else if (ctx->output) {
-            status = lcbio_E_rb_write(ctx, &ctx->output->rb);
-            /** Metrics are logged by E_rb_write */
+            ctx->wblocked = ctx->wwant;
+        } else if (ctx->output || ctx->wrefs) {
+            status = ctx->output ? lcbio_E_rb_write(ctx, &ctx->output->rb) : LCBIO_COMPLETED;
+            if (status == LCBIO_COMPLETED && ctx->wrefs) {
+                status = E_wrefs_write(ctx);
+            }
+            /** Metrics are logged by E_rb_write and E_wrefs_write */
             if (!LCBIO_IS_OK(status)) {
                 send_io_error(ctx, status);
                 return;
@@ -307,6 +449,19 @@ static void E_handler(lcb_socket_t sock, short which, void *arg)
     lcbio_ctx_schedule(ctx);
 }
 
+static void E_handler(lcb_socket_t sock, short which, void *arg)
+{
+    auto *ctx = static_cast<lcbio_CTX *>(arg);
+    /* the context (and its socket) might be gone once the event is handled */
+    lcb_settings *settings = lcb_settings_ref2(ctx->sock->settings);
+    (void)sock;
+
+    lcb_settings_now_hold(settings);
+    E_handle_event(ctx, which);
+    lcb_settings_now_release(settings);
+    lcb_settings_unref(settings);
+}
+
 static void invoke_entered_errcb(lcbio_CTX *ctx, lcb_STATUS err)
 {
     ctx->err = err;
@@ -323,6 +478,7 @@ static void Cw_handler(lcb_sockdata_t *sd, int status, void *arg)
 
     ctx->npending--;
     CTX_INCR_METRIC(ctx, bytes_sent, erb->rb.nbytes);
+    CTX_RECORD_METRIC(ctx, send_bytes, erb->rb.nbytes);
 
     if (!ctx->output) {
         ctx->output = erb;
@@ -342,6 +498,26 @@ static void Cw_handler(lcb_sockdata_t *sd, int status, void *arg)
     }
 }
 
+static void Cw_ref_handler(lcb_sockdata_t *sd, int status, void *arg)
+{
+    auto *wref = static_cast<lcbio__WREF *>(arg);
+    lcbio_CTX *ctx = wref->parent;
+    (void)sd;
+
+    ctx->npending--;
+    CTX_INCR_METRIC(ctx, bytes_sent, wref->nbytes);
+    CTX_RECORD_METRIC(ctx, send_bytes, wref->nbytes);
+    wref_free(wref);
+
+    if (ctx->state == ES_ACTIVE && status) {
+        invoke_entered_errcb(ctx, convert_lcberr(ctx, LCBIO_IOERR));
+    }
+
+    if (ctx->state != ES_ACTIVE && ctx->npending == 0) {
+        free_ctx(ctx);
+    }
+}
+
 static void C_schedule(lcbio_CTX *ctx);
 
 static void Cr_handler(lcb_sockdata_t *sd, lcb_ssize_t nr, void *arg)
@@ -351,9 +527,12 @@ static void Cr_handler(lcb_sockdata_t *sd, lcb_ssize_t nr, void *arg)
     ctx->npending--;
 
     if (ctx->state == ES_ACTIVE) {
-        ctx->sock->atime = LCB_NS2US(gethrtime());
+        lcb_settings *settings = lcb_settings_ref2(ctx->sock->settings);
+        lcb_settings_now_hold(settings);
+        ctx->sock->atime = LCB_NS2US(lcb_settings_now(settings));
         if (nr > 0) {
             unsigned total;
+            CTX_RECORD_METRIC(ctx, recv_bytes, nr);
             rdb_rdend(&ctx->ior, nr);
             total = rdb_get_nused(&ctx->ior);
             if (total >= ctx->rdwant) {
@@ -390,6 +569,8 @@ static void Cr_handler(lcb_sockdata_t *sd, lcb_ssize_t nr, void *arg)
             ctx->rdwant = 0;
             invoke_entered_errcb(ctx, err);
         }
+        lcb_settings_now_release(settings);
+        lcb_settings_unref(settings);
     }
 
     if (ctx->state != ES_ACTIVE && ctx->npending == 0) {
@@ -411,6 +592,7 @@ static void C_schedule(lcbio_CTX *ctx)
         ringbuffer_get_iov(&ctx->output->rb, RINGBUFFER_READ, iov);
         niov = iov[1].iov_len ? 2 : 1;
         rv = IOT_V1(io).write2(IOT_ARG(io), sd, iov, niov, ctx->output, Cw_handler);
+        CTX_INCR_METRIC(ctx, io_send_calls, 1);
         if (rv) {
             send_io_error(ctx, LCBIO_IOERR);
             return;
@@ -429,6 +611,21 @@ static void C_schedule(lcbio_CTX *ctx)
         }
     }
 
+    while (ctx->wrefs) {
+        /* the buffers are referenced until the write completes */
+        lcbio__WREF *wref = ctx->wrefs;
+        ctx->wrefs = wref->next;
+        wref->next = nullptr;
+        rv = IOT_V1(io).write2(IOT_ARG(io), sd, wref->iov, wref->niov, wref, Cw_ref_handler);
+        CTX_INCR_METRIC(ctx, io_send_calls, 1);
+        if (rv) {
+            wref_free(wref);
+            send_io_error(ctx, LCBIO_IOERR);
+            return;
+        }
+        ctx->npending++;
+    }
+
     if (ctx->wwant) {
         ctx->wwant = 0;
         ctx->procs.cb_flush_ready(ctx);
@@ -445,6 +642,7 @@ static void C_schedule(lcbio_CTX *ctx)
         }
 
         rv = IOT_V1(io).read2(IOT_ARG(io), sd, iov, niov, ctx, Cr_handler);
+        CTX_INCR_METRIC(ctx, io_recv_calls, 1);
         if (rv) {
             send_io_error(ctx, LCBIO_IOERR);
         } else {
@@ -454,6 +652,65 @@ static void C_schedule(lcbio_CTX *ctx)
     }
 }
 
+static void E_wbatch_drain(lcb_socket_t, short, void *arg)
+{
+    auto *io = static_cast<lcbio_TABLE *>(arg);
+    lcb_list_t pending;
+    lcb_list_t *ll;
+
+    io->timer.cancel(IOT_ARG(io), io->wbatch_timer);
+
+    /* Contexts scheduled by the callbacks below are flushed in the next batch */
+    lcb_list_init(&pending);
+    while ((ll = LCB_LIST_HEAD(&io->wbatch)) != nullptr) {
+        lcb_list_delete(ll);
+        lcb_list_append(&pending, ll);
+    }
+
+    while ((ll = LCB_LIST_HEAD(&pending)) != nullptr) {
+        lcbio_CTX *ctx = LCB_LIST_ITEM(ll, lcbio_CTX, wbnode);
+        wbatch_remove(ctx);
+        if (!ctx->wwant || ctx->err) {
+            continue;
+        }
+
+        ctx->wwant = 0;
+        ctx->entered++;
+        ctx->procs.cb_flush_ready(ctx);
+        ctx->entered--;
+
+        if (E_free_detached(ctx)) {
+            continue;
+        }
+        /* Asked again, so the socket buffer is full */
+        ctx->wblocked = ctx->wwant;
+        lcbio_ctx_schedule(ctx);
+    }
+}
+
+/** @return whether the flush of the context has been deferred to the end of the iteration */
+static bool E_wbatch_add(lcbio_CTX *ctx)
+{
+    lcbio_TABLE *io = ctx->io;
+
+    if (!ctx->sock->settings->io_batch_writes || ctx->wblocked) {
+        return false;
+    }
+    if (ctx->wbatched) {
+        return true;
+    }
+
+    if (io->wbatch_timer == nullptr) {
+        io->wbatch_timer = io->timer.create(IOT_ARG(io));
+    }
+    if (LCB_LIST_IS_EMPTY(&io->wbatch)) {
+        io->timer.schedule(IOT_ARG(io), io->wbatch_timer, 0, io, E_wbatch_drain);
+    }
+    lcb_list_append(&io->wbatch, &ctx->wbnode);
+    ctx->wbatched = 1;
+    return true;
+}
+
 static void E_schedule(lcbio_CTX *ctx)
 {
     lcbio_TABLE *io = ctx->io;
@@ -462,7 +719,7 @@ static void E_schedule(lcbio_CTX *ctx)
     if (ctx->rdwant) {
         which |= LCB_READ_EVENT;
     }
-    if (ctx->wwant || (ctx->output && ctx->output->rb.nbytes)) {
+    if ((ctx->wwant && !E_wbatch_add(ctx)) || (ctx->output && ctx->output->rb.nbytes) || ctx->wrefs) {
         which |= LCB_WRITE_EVENT;
     }
 
@@ -472,6 +729,7 @@ static void E_schedule(lcbio_CTX *ctx)
     }
 
     IOT_V0EV(io).watch(IOT_ARG(io), CTX_FD(ctx), ctx->event, which, ctx, E_handler);
+    CTX_INCR_METRIC(ctx, io_watch_calls, 1);
     ctx->evactive = 1;
 }
 
@@ -497,8 +755,13 @@ static int E_put_ex(lcbio_CTX *ctx, lcb_IOV *iov, unsigned niov, unsigned nb)
 
 GT_WRITE_AGAIN:
     nw = IOT_V0IO(iot).sendv(IOT_ARG(iot), fd, iov, niov <= RWINL_IOVSIZE ? niov : RWINL_IOVSIZE);
+    CTX_INCR_METRIC(ctx, io_send_calls, 1);
     if (nw > 0) {
         CTX_INCR_METRIC(ctx, bytes_sent, nw);
+        CTX_RECORD_METRIC(ctx, send_bytes, nw);
+        if (ctx->sock->kstats) {
+            lcbio_kstats_sent(ctx->sock, nw);
+        }
         ctx->procs.cb_flush_done(ctx, nb, nw);
         return 1;
 
@@ -510,6 +773,7 @@ GT_WRITE_AGAIN:
 
             case C_EAGAIN:
             case EWOULDBLOCK:
+                CTX_INCR_METRIC(ctx, io_send_eagain, 1);
                 nw = 0;
                 /* indicate zero bytes were written, but don't send an error */
                 goto GT_WRITE0;
@@ -539,6 +803,7 @@ static void Cw_ex_handler(lcb_sockdata_t *sd, int status, void *wdata)
     ctx->npending--;
 
     CTX_INCR_METRIC(ctx, bytes_sent, nflushed);
+    CTX_RECORD_METRIC(ctx, send_bytes, nflushed);
     ctx->entered = 1;
     ctx->procs.cb_flush_done(ctx, nflushed, nflushed);
     ctx->entered = 0;
@@ -557,6 +822,7 @@ static int C_put_ex(lcbio_CTX *ctx, lcb_IOV *iov, unsigned niov, unsigned nb)
     lcbio_TABLE *iot = ctx->io;
     lcb_sockdata_t *sd = CTX_SD(ctx);
     int status = IOT_V1(iot).write2(IOT_ARG(iot), sd, iov, niov, (void *)(uintptr_t)nb, Cw_ex_handler);
+    CTX_INCR_METRIC(ctx, io_send_calls, 1);
     if (status) {
         /** error! */
         lcbio_OSERR saverr = IOT_ERRNO(iot);
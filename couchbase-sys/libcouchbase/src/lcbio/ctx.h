@@ -123,6 +123,24 @@ typedef struct {
     lcbio_pCTX parent;
 } lcbio__EASYRB;
 
+/** Invoked once the buffers passed to lcbio_ctx_putv_nocopy() are no longer referenced */
+typedef void (*lcbio_CTXRELEASE_cb)(void *arg);
+
+/**
+ * Output written from the caller's buffers, see lcbio_ctx_putv_nocopy().
+ * @private
+ */
+typedef struct lcbio__WREF {
+    struct lcbio__WREF *next;
+    lcbio_pCTX parent;
+    lcb_IOV *iov;    /**< copy of the IOV array, advanced as the buffers are written */
+    unsigned niov;
+    unsigned cur;    /**< first buffer which is not completely written */
+    unsigned nbytes; /**< total size, for the metrics */
+    lcbio_CTXRELEASE_cb release;
+    void *arg;
+} lcbio__WREF;
+
 /**
  * @brief Context for socket I/O
  *
@@ -137,11 +155,14 @@ typedef struct lcbio_CTX {
     void *event;           /**< event pointer for E-model I/O */
     lcb_sockdata_t *sd;    /**< cached SD for C-model I/O */
     lcbio__EASYRB *output; /**< for lcbio_ctx_put() */
+    lcbio__WREF *wrefs;    /**< for lcbio_ctx_putv_nocopy(), written after output */
     lcb_socket_t fd;       /**< cached FD for E-model I/O */
     char evactive;         /**< watcher is active for E-model I/O */
     char wwant;            /**< flag for lcbio_ctx_put_ex */
     char state;            /**< internal state */
     char entered;          /**< inside event handler */
+    char wbatched;         /**< flush is deferred to the end of the loop iteration */
+    char wblocked;         /**< last write would have blocked, wait for the socket */
     unsigned npending;     /**< reference count on pending I/O */
     unsigned rdwant;       /**< number of remaining bytes to read */
     lcb_STATUS err;        /**< pending error */
@@ -149,6 +170,7 @@ typedef struct lcbio_CTX {
     lcbio_pASYNC as_err;   /**< async error handler */
     lcbio_CTXPROCS procs;  /**< callbacks */
     const char *subsys;    /**< Informational description of connection */
+    lcb_list_t wbnode;     /**< node in the I/O table's write batch */
 } lcbio_CTX;
 
 /**@name Creating and Closing
@@ -245,6 +267,24 @@ void lcbio_ctx_schedule(lcbio_CTX *ctx);
  */
 void lcbio_ctx_put(lcbio_CTX *ctx, const void *buf, unsigned nbuf);
 
+/**
+ * @brief Add output data to be written from the caller's buffers.
+ *
+ * Like lcbio_ctx_put(), except that the data is not copied: the buffers are
+ * written to the network as they are, after any data which was added before.
+ * The buffers must therefore remain valid and unmodified until `release` is
+ * invoked with `arg`, which happens once they are written or once the context
+ * is closed (whichever comes first). The IOV array itself is copied.
+ *
+ * @param ctx
+ * @param iov the buffers to write
+ * @param niov number of elements in the array
+ * @param release invoked once the buffers are no longer referenced
+ * @param arg argument for `release`
+ */
+void lcbio_ctx_putv_nocopy(lcbio_CTX *ctx, const lcb_IOV *iov, unsigned niov, lcbio_CTXRELEASE_cb release,
+                           void *arg);
+
 /**
  * Invoke the lcbio_CTXPROCS#cb_flush_ready()
  * callback when a flush may be invoked. Note that the
@@ -289,6 +329,12 @@ void lcbio_ctx_put(lcbio_CTX *ctx, const void *buf, unsigned nbuf);
  * checked by the lcbio_ctx_schedule() function. When the event handler is invoked, the
  * flush_ready() callback is invoked as well - typically in a loop until an
  * `EWOULDBLOCK` is received on the socket itself.
+ *
+ * If @ref LCB_CNTL_IO_BATCH_WRITES is enabled, lcbio_ctx_schedule() does not
+ * wait for the socket to become writable. Instead the flush_ready() callback
+ * of every context sharing the I/O table is invoked at the end of the current
+ * loop iteration, writing directly to the sockets. Only a socket whose last
+ * write would have blocked falls back to waiting for the write event.
  */
 void lcbio_ctx_wwant(lcbio_CTX *ctx);
 
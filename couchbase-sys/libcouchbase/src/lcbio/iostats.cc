@@ -0,0 +1,242 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2024 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/**
+ * Histograms of lcb_IOMETRICS, and the kernel statistics of the sockets (see
+ * LCB_CNTL_KERNEL_IO_STATS).
+ *
+ * With SO_TIMESTAMPING, the kernel stamps the received data when it arrives,
+ * which tells how long the data waited before the instance read it. The
+ * stamp is read by peeking at the socket before draining it, so that the
+ * plugin keeps doing the actual reads. It also reports on the error queue
+ * of the socket when the last byte of each write was handed to the device,
+ * keyed by its offset in the stream.
+ */
+
+#include "config.h"
+#include "connect.h"
+#include "ioutils.h"
+#include "iotable.h"
+#include "settings.h"
+
+#include <cstdlib>
+
+#ifdef __linux__
+#include <sys/socket.h>
+#endif
+#if defined(__linux__) && defined(SO_TIMESTAMPING)
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <netinet/in.h>
+#include <sys/ioctl.h>
+#include <ctime>
+#define LCBIO_HAVE_KSTATS 1
+#endif
+
+/** Number of writes waiting for their timestamp which are remembered */
+#define KSTATS_NSENDS 32
+
+struct lcbio_KSTATS {
+    /** Bytes written since the timestamps were enabled, i.e. the key of the next byte */
+    lcb_U32 offset;
+    /** Ring of the writes waiting for their timestamp */
+    struct {
+        lcb_U32 key; /* offset of the last byte */
+        lcb_U64 time;
+    } sends[KSTATS_NSENDS];
+    unsigned head;
+    unsigned count;
+};
+
+void lcbio_histogram_add(lcb_SIZE *histogram, lcb_U64 value)
+{
+    unsigned bucket = 0;
+#if defined(__GNUC__) || defined(__clang__)
+    if (value != 0) {
+        bucket = 64 - __builtin_clzll(value);
+    }
+#else
+    for (; value != 0; value >>= 1) {
+        bucket++;
+    }
+#endif
+    histogram[bucket < LCB_IOMETRICS_NBUCKETS ? bucket : LCB_IOMETRICS_NBUCKETS - 1]++;
+}
+
+#ifdef LCBIO_HAVE_KSTATS
+/** The software timestamps are taken from the real time clock */
+static lcb_U64 realtime_us(const struct timespec *ts)
+{
+    return (lcb_U64)ts->tv_sec * 1000000 + ts->tv_nsec / 1000;
+}
+
+static lcb_U64 now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return realtime_us(&ts);
+}
+
+static const struct scm_timestamping *find_timestamps(struct msghdr *msg)
+{
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING) {
+            return reinterpret_cast<const struct scm_timestamping *>(CMSG_DATA(cmsg));
+        }
+    }
+    return nullptr;
+}
+
+static const struct sock_extended_err *find_error(struct msghdr *msg)
+{
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+        if ((cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) ||
+            (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)) {
+            return reinterpret_cast<const struct sock_extended_err *>(CMSG_DATA(cmsg));
+        }
+    }
+    return nullptr;
+}
+
+static void record_delay(lcb_SIZE *histogram, lcb_U64 from, lcb_U64 to)
+{
+    lcbio_histogram_add(histogram, to > from ? to - from : 0);
+}
+
+/** Match the timestamps on the error queue with the writes they were requested for */
+static void drain_errqueue(lcbio_SOCKET *sock)
+{
+    lcbio_KSTATS *kstats = sock->kstats;
+    for (;;) {
+        char control[256];
+        struct msghdr msg = {};
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(sock->u.fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1) {
+            return;
+        }
+
+        const struct sock_extended_err *err = find_error(&msg);
+        const struct scm_timestamping *tss = find_timestamps(&msg);
+        if (err == nullptr || tss == nullptr || err->ee_origin != SO_EE_ORIGIN_TIMESTAMPING ||
+            err->ee_info != SCM_TSTAMP_SND) {
+            continue;
+        }
+        /* the writes merged into the segment of a later one have no timestamp of their own */
+        while (kstats->count > 0) {
+            auto &send = kstats->sends[kstats->head];
+            auto distance = static_cast<lcb_S32>(send.key - err->ee_data);
+            if (distance > 0) {
+                break;
+            }
+            if (distance == 0 && sock->metrics) {
+                record_delay(sock->metrics->tx_kernel_us, send.time, realtime_us(&tss->ts[0]));
+            }
+            kstats->head = (kstats->head + 1) % KSTATS_NSENDS;
+            kstats->count--;
+        }
+    }
+}
+
+/** Peek at the first byte waiting on the socket for the time it arrived */
+static void peek_rx_timestamp(lcbio_SOCKET *sock)
+{
+    char byte;
+    struct iovec iov = {&byte, sizeof(byte)};
+    char control[256];
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (recvmsg(sock->u.fd, &msg, MSG_PEEK | MSG_DONTWAIT) <= 0) {
+        return;
+    }
+    const struct scm_timestamping *tss = find_timestamps(&msg);
+    if (tss != nullptr && (tss->ts[0].tv_sec != 0 || tss->ts[0].tv_nsec != 0)) {
+        record_delay(sock->metrics->rx_kernel_us, realtime_us(&tss->ts[0]), now_us());
+    }
+}
+#endif
+
+lcb_STATUS lcbio_kstats_enable(lcbio_SOCKET *sock)
+{
+#ifdef LCBIO_HAVE_KSTATS
+    /* the timestamps are read from the descriptor, and the offsets must be those of the stream */
+    if (!IOT_IS_EVENT(sock->io) || sock->metrics == nullptr || lcbio_protoctx_get(sock, LCBIO_PROTOCTX_SSL)) {
+        return LCB_ERR_UNSUPPORTED_OPERATION;
+    }
+    if (sock->kstats != nullptr) {
+        return LCB_SUCCESS;
+    }
+    int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE |
+                SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+    lcb_STATUS rc = lcbio_set_sockopt(sock, LCB_IO_CNTL_TIMESTAMPING, flags);
+    if (rc != LCB_SUCCESS) {
+        return rc;
+    }
+    sock->kstats = static_cast<lcbio_KSTATS *>(calloc(1, sizeof(*sock->kstats)));
+    return sock->kstats ? LCB_SUCCESS : LCB_ERR_NO_MEMORY;
+#else
+    (void)sock;
+    return LCB_ERR_UNSUPPORTED_OPERATION;
+#endif
+}
+
+void lcbio_kstats_event(lcbio_SOCKET *sock, short which)
+{
+#ifdef LCBIO_HAVE_KSTATS
+    drain_errqueue(sock);
+    if ((which & LCB_READ_EVENT) && sock->metrics) {
+        peek_rx_timestamp(sock);
+    }
+#else
+    (void)sock;
+    (void)which;
+#endif
+}
+
+void lcbio_kstats_sent(lcbio_SOCKET *sock, size_t nbytes)
+{
+#ifdef LCBIO_HAVE_KSTATS
+    lcbio_KSTATS *kstats = sock->kstats;
+    kstats->offset += static_cast<lcb_U32>(nbytes);
+    if (kstats->count == KSTATS_NSENDS) {
+        /* forget the oldest write rather than the latest */
+        kstats->head = (kstats->head + 1) % KSTATS_NSENDS;
+        kstats->count--;
+    }
+    auto &send = kstats->sends[(kstats->head + kstats->count) % KSTATS_NSENDS];
+    send.key = kstats->offset - 1;
+    send.time = now_us();
+    kstats->count++;
+
+    int queued = 0;
+    if (sock->metrics && ioctl(sock->u.fd, TIOCOUTQ, &queued) == 0) {
+        lcbio_histogram_add(sock->metrics->send_queue_bytes, static_cast<lcb_U64>(queued));
+    }
+#else
+    (void)sock;
+    (void)nbytes;
+#endif
+}
+
+void lcbio_kstats_free(lcbio_SOCKET *sock)
+{
+    free(sock->kstats);
+    sock->kstats = nullptr;
+}
@@ -21,6 +21,7 @@
 #include <string.h>
 #include "iotable.h"
 #include "connect.h" /* prototypes for iotable functions */
+#include "timer-ng.h"
 
 #define GET_23_FIELD(iops, fld) ((iops)->version == 2 ? (iops)->v.v2.fld : (iops)->v.v3.fld)
 
@@ -195,6 +196,7 @@ lcbio_TABLE *lcbio_table_new(lcb_io_opt_t io)
     lcbio_TABLE *table = calloc(1, sizeof(*table));
     table->p = io;
     table->refcount = 1;
+    lcb_list_init(&table->wbatch);
 
     if (io->version == 2) {
         io->v.v2.iot = table;
@@ -270,6 +272,13 @@ void lcbio_table_unref(lcbio_TABLE *table)
         return;
     }
 
+    if (table->wbatch_timer) {
+        table->timer.cancel(table->p, table->wbatch_timer);
+        table->timer.destroy(table->p, table->wbatch_timer);
+        table->wbatch_timer = NULL;
+    }
+    lcbio_timermux_destroy(table);
+
     if (table->dtor) {
         table->dtor(table);
         return;
@@ -19,6 +19,7 @@
 #define LCB_IOTABLE_H
 
 #include <libcouchbase/couchbase.h>
+#include "list.h"
 
 /**
  * @file
@@ -77,6 +78,13 @@ typedef struct lcbio_TABLE {
     unsigned refcount;
     void (*dtor)(void *);
 
+    /** Contexts flushing once the current loop iteration is done, see lcbio_ctx_wwant() */
+    lcb_list_t wbatch;
+    /** Plugin timer draining `wbatch`, created on first use */
+    void *wbatch_timer;
+    /** Multiplexer of the lcbio_TIMER objects, created on first use */
+    struct lcbio_TIMERMUX *tmux;
+
 #ifdef __cplusplus
     bool is_E() const
     {
@@ -192,6 +200,21 @@ typedef struct lcbio_TABLE {
 
 } lcbio_TABLE;
 
+/** Invoked on the loop thread after lcb_wakeup_signal() has been called */
+typedef void (*lcbio_WAKEUP_HANDLER)(void *arg);
+
+/**
+ * Create a wakeup handle on an existing table. Rather than stopping the loop,
+ * the handle invokes `handler` whenever it was signalled, independently of
+ * who is driving the loop.
+ * @param iot the table, a reference is taken for the lifetime of the handle
+ * @param handler the function to invoke
+ * @param arg the argument passed to `handler`
+ * @param[out] wakeup the new handle, released with lcb_wakeup_destroy()
+ * @return LCB_ERR_UNSUPPORTED_OPERATION for completion-based tables
+ */
+lcb_STATUS lcbio_wakeup_new(lcbio_TABLE *iot, lcbio_WAKEUP_HANDLER handler, void *arg, lcb_WAKEUP **wakeup);
+
 #ifdef __cplusplus
 }
 #endif
@@ -268,10 +268,14 @@ int lcbio_is_netclosed(lcbio_SOCKET *sock, int flags)
 }
 
 lcb_STATUS lcbio_enable_sockopt(lcbio_SOCKET *s, int cntl)
+{
+    return lcbio_set_sockopt(s, cntl, 1);
+}
+
+lcb_STATUS lcbio_set_sockopt(lcbio_SOCKET *s, int cntl, int value)
 {
     lcbio_pTABLE iot = s->io;
     int rv;
-    int value = 1;
 
     if (!iot->has_cntl()) {
         return LCB_ERR_UNSUPPORTED_OPERATION;
@@ -295,6 +299,14 @@ const char *lcbio_strsockopt(int cntl)
             return "TCP_KEEPALIVE";
         case LCB_IO_CNTL_TCP_NODELAY:
             return "TCP_NODELAY";
+        case LCB_IO_CNTL_BUSY_POLL:
+            return "SO_BUSY_POLL";
+        case LCB_IO_CNTL_TIMESTAMPING:
+            return "SO_TIMESTAMPING";
+        case LCB_IO_CNTL_TCP_USER_TIMEOUT:
+            return "TCP_USER_TIMEOUT";
+        case LCB_IO_CNTL_ABORTIVE_CLOSE:
+            return "SO_LINGER";
         default:
             return "FIXME: Unknown option";
     }
@@ -319,6 +331,10 @@ lcbio_pSSLCTX lcbio_ssl_new__fallback(const char *, const char *, const char *,
 
 #ifdef LCB_NO_SSL
 void lcbio_ssl_free(lcbio_pSSLCTX) {}
+lcbio_pSSLCTX lcbio_ssl_share(lcbio_pSSLCTX)
+{
+    return nullptr;
+}
 lcb_STATUS lcbio_ssl_apply(lcbio_SOCKET *, lcbio_pSSLCTX)
 {
     return LCB_ERR_SDK_FEATURE_UNAVAILABLE;
@@ -331,6 +347,10 @@ lcb_STATUS lcbio_ssl_get_error(lcbio_SOCKET *)
 {
     return LCB_SUCCESS;
 }
+int lcbio_ssl_resumed(lcbio_SOCKET *)
+{
+    return 0;
+}
 void lcbio_ssl_global_init(void) {}
 lcb_STATUS lcbio_sslify_if_needed(lcbio_SOCKET *, lcb_settings *)
 {
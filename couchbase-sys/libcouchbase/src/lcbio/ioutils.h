@@ -93,10 +93,39 @@ int lcbio_is_netclosed(lcbio_SOCKET *sock, int flags);
  */
 lcb_STATUS lcbio_enable_sockopt(lcbio_SOCKET *sock, int cntl);
 
+/**
+ * Set an option on a socket
+ * @param sock The socket
+ * @param cntl The option (LCB_IO_CNTL_xxx)
+ * @param value The value of the option
+ * @return
+ */
+lcb_STATUS lcbio_set_sockopt(lcbio_SOCKET *sock, int cntl, int value);
+
 const char *lcbio_strsockopt(int cntl);
 
 void lcbio__load_socknames(lcbio_SOCKET *sock);
 
+/** Count a value in a histogram of lcb_IOMETRICS, see LCB_IOMETRICS_NBUCKETS */
+void lcbio_histogram_add(lcb_SIZE *histogram, lcb_U64 value);
+
+/**
+ * Have the kernel timestamp the data of the socket, and sample its send
+ * queue, into the metrics of the socket (see LCB_CNTL_KERNEL_IO_STATS)
+ * @param sock a socket with metrics
+ * @return LCB_ERR_UNSUPPORTED_OPERATION if the platform, the plugin or the
+ *  socket (e.g. with TLS) does not allow it
+ */
+lcb_STATUS lcbio_kstats_enable(lcbio_SOCKET *sock);
+
+/** Collect the timestamps available on an event of a socket with kernel statistics */
+void lcbio_kstats_event(lcbio_SOCKET *sock, short which);
+
+/** Remember when @p nbytes were written to a socket with kernel statistics */
+void lcbio_kstats_sent(lcbio_SOCKET *sock, size_t nbytes);
+
+void lcbio_kstats_free(lcbio_SOCKET *sock);
+
 #ifdef _WIN32
 #define lcbio_syserrno GetLastError()
 #else
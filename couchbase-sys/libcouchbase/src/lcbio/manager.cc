@@ -22,6 +22,7 @@
 #include "iotable.h"
 #include "internal.h"
 #include "mcserver/negotiate.h"
+#include "metrics/compact_histogram.hh"
 
 #define LOGARGS(mgr, lvl) mgr->settings, "lcbio_mgr", LCB_LOG_##lvl, __FILE__, __LINE__
 
@@ -37,6 +38,14 @@ struct PoolHost {
     inline void connection_available();
     inline void start_new_connection(uint32_t timeout);
 
+    /** Open connections until there are PoolHost::target idle (or pending) ones */
+    void replenish(uint32_t timeout)
+    {
+        while (num_idle() + num_pending() < target) {
+            start_new_connection(timeout);
+        }
+    }
+
     void ref()
     {
         refcount++;
@@ -84,6 +93,14 @@ struct PoolHost {
     lcb::io::Timer<PoolHost, &PoolHost::connection_available> async;
     unsigned n_total; /* number of total connections */
     unsigned refcount;
+    unsigned target{0};     /* number of idle connections to keep open */
+    uint32_t tmconnect{0};  /* connection timeout for replenish() on refresh */
+    lcb_U64 n_hits{0};      /* requests served by an idle connection */
+    lcb_U64 n_misses{0};    /* requests which had to wait for a connection */
+    lcb_U64 n_refreshed{0}; /* kept connections replaced on refresh */
+    lcb_U64 n_trimmed{0};   /* idle connections closed by Pool::trim() */
+    lcb_U64 n_trimcheck{0}; /* n_hits + n_misses as of the previous Pool::trim() */
+    lcb::metrics::CompactHistogram lease_latency{}; /* time to serve a request, in microseconds */
 };
 } // namespace io
 } // namespace lcb
@@ -100,6 +117,7 @@ struct PoolConnInfo : lcbio_PROTOCTX, CinfoNode {
     inline ~PoolConnInfo();
     inline void on_idle_timeout();
     inline void on_connected(lcbio_SOCKET *sock, lcb_STATUS err);
+    inline void set_idle();
 
     void set_leased()
     {
@@ -123,6 +141,7 @@ struct PoolConnInfo : lcbio_PROTOCTX, CinfoNode {
     lcbio_SOCKET *sock;
     lcbio_pCONNSTART cs;
     lcb::io::Timer<PoolConnInfo, &PoolConnInfo::on_idle_timeout> idle_timer;
+    hrtime_t idle_since{0};
 
     enum State { PENDING, IDLE, LEASED };
     State state;
@@ -139,7 +158,7 @@ namespace io
 struct PoolRequest : ReqNode, ConnectionRequest {
     PoolRequest(PoolHost *host_, lcbio_CONNDONE_cb cb, void *cbarg)
         : host(host_), callback(cb), arg(cbarg), timer(host->parent->io, this), state(PENDING), sock(nullptr),
-          err(LCB_SUCCESS)
+          err(LCB_SUCCESS), start(gethrtime())
     {
     }
 
@@ -180,6 +199,7 @@ struct PoolRequest : ReqNode, ConnectionRequest {
     State state;
     lcbio_SOCKET *sock;
     lcb_STATUS err;
+    hrtime_t start;
 };
 } // namespace io
 } // namespace lcb
@@ -308,6 +328,28 @@ void Pool::toJSON(hrtime_t now, Json::Value &node)
     lcbio_MGR::HostMap::const_iterator it;
     for (it = ht.begin(); it != ht.end(); ++it) {
         const PoolHost *host = it->second;
+        Json::Value &stats = node["pools"][host->key];
+        stats["idle"] = (Json::Value::UInt64)host->num_idle();
+        stats["pending"] = (Json::Value::UInt64)host->num_pending();
+        stats["leased"] = (Json::Value::UInt64)host->num_leased();
+        stats["target"] = host->target;
+        stats["hits"] = (Json::Value::UInt64)host->n_hits;
+        stats["misses"] = (Json::Value::UInt64)host->n_misses;
+        stats["refreshed"] = (Json::Value::UInt64)host->n_refreshed;
+        stats["trimmed"] = (Json::Value::UInt64)host->n_trimmed;
+
+        lcb::metrics::HistogramSnapshot latency;
+        host->lease_latency.collect(latency);
+        Json::Value percentiles;
+        percentiles["50.0"] = Json::Int64(latency.value_at_percentile(50.0));
+        percentiles["90.0"] = Json::Int64(latency.value_at_percentile(90.0));
+        percentiles["99.0"] = Json::Int64(latency.value_at_percentile(99.0));
+        percentiles["99.9"] = Json::Int64(latency.value_at_percentile(99.9));
+        percentiles["100.0"] = Json::Int64(latency.value_at_percentile(100.0));
+        Json::Value &lease = stats["lease_latency"];
+        lease["total_count"] = Json::Int64(latency.total_count());
+        lease["percentiles_us"] = percentiles;
+
         lcb_list_t *llcur;
         LCB_LIST_FOR(llcur, (lcb_list_t *)&host->ll_idle)
         {
@@ -326,6 +368,7 @@ void PoolRequest::invoke()
         PoolConnInfo *info = PoolConnInfo::from_sock(sock);
         info->set_leased();
         state = ASSIGNED;
+        host->lease_latency.record(LCB_NS2US(gethrtime() - start));
         lcb_log(LOGARGS(info->parent->parent, DEBUG), HE_LOGFMT "Assigning R=%p SOCKET=%p, SOCK=%016" PRIx64,
                 HE_LOGID(info->parent), (void *)this, (void *)sock, sock->id);
     }
@@ -383,13 +426,12 @@ void PoolConnInfo::on_connected(lcbio_SOCKET *sock_, lcb_STATUS err)
         delete this;
 
     } else {
-        state = IDLE;
         sock = sock_;
         lcbio_ref(sock);
         lcbio_protoctx_add(sock, this);
 
         lcb_clist_append(&parent->ll_idle, this);
-        idle_timer.rearm(parent->parent->options.maxidle);
+        set_idle();
         parent->connection_available();
     }
 }
@@ -448,6 +490,66 @@ PoolHost::PoolHost(Pool *parent_, std::string key_)
     parent->ref();
 }
 
+PoolHost *Pool::get_host(const std::string &key)
+{
+    auto m = ht.find(key);
+    if (m != ht.end()) {
+        return m->second;
+    }
+    auto *he = new PoolHost(this, key);
+    ht.insert(std::make_pair(key, he));
+    return he;
+}
+
+void Pool::set_target(const std::string &key, unsigned target, uint32_t timeout)
+{
+    PoolHost *he = get_host(key);
+    if (he->target != target) {
+        lcb_log(LOGARGS(this, DEBUG), HE_LOGFMT "Keeping %u idle connections open", HE_LOGID(he), target);
+    }
+    he->target = target;
+    he->tmconnect = timeout;
+    he->replenish(timeout);
+}
+
+void Pool::clear_targets()
+{
+    for (auto &it : ht) {
+        it.second->target = 0;
+    }
+}
+
+size_t Pool::trim()
+{
+    size_t closed = 0;
+    for (auto &it : ht) {
+        PoolHost *he = it.second;
+        lcb_U64 requested = he->n_hits + he->n_misses;
+        if (requested != he->n_trimcheck) {
+            he->n_trimcheck = requested;
+            continue;
+        }
+        while (he->num_idle() > he->target) {
+            /* The connection which has been idle for the longest time */
+            PoolConnInfo *info = PoolConnInfo::from_llnode(LCB_LIST_HEAD((lcb_list_t *)&he->ll_idle));
+            lcb_log(LOGARGS(this, DEBUG), HE_LOGFMT "Closing idle connection after a quiet period", HE_LOGID(he));
+            he->n_trimmed++;
+            closed++;
+            lcbio_unref(info->sock)
+        }
+    }
+    return closed;
+}
+
+size_t Pool::in_flight(const std::string &key) const
+{
+    auto m = ht.find(key);
+    if (m == ht.end()) {
+        return 0;
+    }
+    return m->second->num_leased() + m->second->num_requests();
+}
+
 ConnectionRequest *Pool::get(const lcb_host_t &dest, uint32_t timeout, lcbio_CONNDONE_cb cb, void *cbarg)
 {
     PoolHost *he;
@@ -460,13 +562,7 @@ ConnectionRequest *Pool::get(const lcb_host_t &dest, uint32_t timeout, lcbio_CON
         key.append(dest.host).append(":").append(dest.port);
     }
 
-    auto m = ht.find(key);
-    if (m == ht.end()) {
-        he = new PoolHost(this, key);
-        ht.insert(std::make_pair(key, he));
-    } else {
-        he = m->second;
-    }
+    he = get_host(key);
 
     auto *req = new PoolRequest(he, cb, cbarg);
 
@@ -489,12 +585,15 @@ GT_POPAGAIN:
         }
 
         req->set_ready(info);
+        he->n_hits++;
         lcb_log(LOGARGS(this, DEBUG),
                 HE_LOGFMT "Found ready connection in pool. Reusing socket and not creating new connection",
                 HE_LOGID(he));
+        he->replenish(timeout);
 
     } else {
         req->set_pending(timeout);
+        he->n_misses++;
 
         lcb_clist_append(&he->requests, req);
         if (he->num_pending() < he->num_requests()) {
@@ -526,8 +625,56 @@ void PoolRequest::cancel()
     delete this;
 }
 
+/**
+ * Mark the connection as idle and arm its idle timer. Connections which may be
+ * kept open for the target of the host are checked every Options::tmrefresh,
+ * if that is sooner than Options::tmoidle.
+ */
+void PoolConnInfo::set_idle()
+{
+    const Pool::Options &opts = parent->parent->options;
+    uint32_t interval = opts.tmoidle;
+    if (parent->target && opts.tmoidle && opts.tmrefresh && opts.tmrefresh < interval) {
+        interval = opts.tmrefresh;
+    }
+    state = IDLE;
+    idle_since = gethrtime();
+    idle_timer.rearm(interval);
+}
+
 void PoolConnInfo::on_idle_timeout()
 {
+    const Pool::Options &opts = parent->parent->options;
+    uint32_t idle = LCB_NS2US(gethrtime() - idle_since);
+
+    if (parent->num_idle() <= parent->target && opts.tmoidle) {
+        bool closed = lcbio_is_netclosed(sock, LCB_IO_SOCKCHECK_PEND_IS_ERROR) == LCB_IO_SOCKCHECK_STATUS_CLOSED;
+        if (!closed && (opts.tmrefresh == 0 || idle < opts.tmrefresh)) {
+            uint32_t interval = opts.tmoidle;
+            if (opts.tmrefresh && opts.tmrefresh - idle < interval) {
+                interval = opts.tmrefresh - idle;
+            }
+            idle_timer.rearm(interval);
+            return;
+        }
+
+        /* Replace the connection. Deleting it may drop the last reference to the host */
+        PoolHost *he = parent;
+        lcb_log(LOGARGS(he->parent, DEBUG), HE_LOGFMT "Replacing %s idle connection", HE_LOGID(he),
+                closed ? "closed" : "stale");
+        he->ref();
+        he->n_refreshed++;
+        lcbio_unref(sock)
+        he->replenish(he->tmconnect);
+        he->unref();
+        return;
+    }
+
+    if (idle < opts.tmoidle) {
+        /* A kept connection became surplus before its idle timeout */
+        idle_timer.rearm(opts.tmoidle - idle);
+        return;
+    }
     lcb_log(LOGARGS(parent->parent, DEBUG), HE_LOGFMT "Idle connection expired", HE_LOGID(parent));
     lcbio_unref(sock)
 }
@@ -546,16 +693,15 @@ void Pool::put(lcbio_SOCKET *sock)
     he = info->parent;
     mgr = he->parent;
 
-    if (he->num_idle() >= mgr->options.maxidle) {
+    if (he->num_idle() >= mgr->options.maxidle && he->num_idle() >= he->target) {
         lcb_log(LOGARGS(mgr, INFO), HE_LOGFMT "Closing idle connection. Too many in quota", HE_LOGID(he));
         lcbio_unref(info->sock) return;
     }
 
     lcb_log(LOGARGS(mgr, DEBUG), HE_LOGFMT "Placing socket back into the pool. I=%p,C=%p", HE_LOGID(he), (void *)info,
             (void *)sock);
-    info->idle_timer.rearm(mgr->options.tmoidle);
     lcb_clist_append(&he->ll_idle, info);
-    info->state = PoolConnInfo::IDLE;
+    info->set_idle();
 }
 
 void Pool::discard(lcbio_SOCKET *sock)
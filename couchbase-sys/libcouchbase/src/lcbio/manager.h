@@ -148,7 +148,7 @@ class Pool
     inline void unref();
 
     struct Options {
-        Options() : maxtotal(0), maxidle(0), tmoidle(0) {}
+        Options() : maxtotal(0), maxidle(0), tmoidle(0), tmrefresh(0) {}
 
         /** Maximum *total* number of connections opened by the pool. If this
          * number is exceeded, the pool will black hole future requests until
@@ -166,6 +166,14 @@ class Pool
          * connections. In microseconds
          */
         uint32_t tmoidle;
+
+        /**
+         * The amount of time after which an idle connection kept open for
+         * the target of its host (see set_target()) is closed and replaced
+         * by a new one, so that it is not closed by the server (or a
+         * middlebox) while idle. In microseconds, 0 never replaces them.
+         */
+        uint32_t tmrefresh;
     };
 
     void set_options(const Options &opts)
@@ -178,9 +186,50 @@ class Pool
         return options;
     }
 
+    /**
+     * Keep at least this many idle connections open to a host. Missing
+     * connections are opened right away (pre-warming the pool), and whenever
+     * a request takes one of the idle connections. Idle connections are not
+     * closed by the idle timeout (see Options::tmoidle) while there are no more
+     * than this many of them. Instead they are checked every
+     * Options::tmrefresh (or Options::tmoidle, if sooner), and replaced if they
+     * were closed by the peer or have been idle for Options::tmrefresh.
+     *
+     * @param key the host, as "host:port" (or "[host]:port" for IPv6)
+     * @param target the number of idle connections, 0 to stop keeping any
+     * @param timeout connection timeout for new connections
+     */
+    void set_target(const std::string &key, unsigned target, uint32_t timeout);
+
+    /** Set the target of every host to zero, see set_target() */
+    void clear_targets();
+
+    /**
+     * Close the idle connections of each host beyond its target (see
+     * set_target()), unless connections were requested from the host since
+     * the previous call. This frees the connections of a burst once it is
+     * over, without waiting for their idle timeout (see Options::tmoidle).
+     *
+     * @return the number of connections closed
+     */
+    size_t trim();
+
+    /**
+     * @return the number of connections to the host which are in use, plus the
+     * number of requests which are waiting for one
+     */
+    size_t in_flight(const std::string &key) const;
+
+    /**
+     * Appends the endpoints of the pool to the service lists in @p node, and
+     * the pooling statistics of every host to `node["pools"]`. These include
+     * the percentiles of the time it took get() to hand out a connection.
+     */
     void toJSON(hrtime_t now, Json::Value &node);
 
   private:
+    inline PoolHost *get_host(const std::string &key);
+
     friend struct PoolRequest;
     friend struct PoolConnInfo;
     friend struct PoolHost;
@@ -0,0 +1,389 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include "resolve.h"
+#include "iotable.h"
+#include "connspec.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <system_error>
+#include <thread>
+
+using namespace lcb::io;
+
+/** Maximum number of concurrent lookups of an instance */
+#define RESOLVER_MAX_THREADS 4
+/** Helper threads exit after being idle for this long */
+#define RESOLVER_IDLE_SECONDS 30
+/** The cache is purged of expired entries when it grows beyond this */
+#define RESOLVER_CACHE_MAX 1024
+
+namespace
+{
+struct Job {
+    std::string key;
+    std::string host;
+    std::string port;
+    int family;
+    bool srv; /* SRV query of host, rather than an address lookup */
+};
+
+struct Done {
+    std::string key;
+    int eai;
+    addrinfo *res;
+    lcb_STATUS rc;
+    lcb::Hostlist *hosts;
+};
+} // namespace
+
+/**
+ * State shared with the helper threads. The threads are detached, so that
+ * destroying an instance never waits for a resolver which does not answer;
+ * the last one to exit frees this.
+ */
+struct lcbio_RESOLVER_st::Shared {
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<Job> jobs;
+    std::vector<Done> done;
+    lcb_WAKEUP *wakeup{nullptr};
+    bool stopped{false};
+    unsigned nthreads{0};
+    unsigned nidle{0};
+};
+
+AddrList::AddrList(const addrinfo *res)
+{
+    size_t count = 0;
+    for (const addrinfo *cur = res; cur != nullptr; cur = cur->ai_next) {
+        count++;
+    }
+    ai_.resize(count);
+    addrs_.resize(count);
+
+    size_t ii = 0;
+    for (const addrinfo *cur = res; cur != nullptr; cur = cur->ai_next, ii++) {
+        addrinfo &dst = ai_[ii];
+        dst = *cur;
+        dst.ai_canonname = nullptr;
+        memcpy(&addrs_[ii], cur->ai_addr, cur->ai_addrlen);
+        dst.ai_addr = reinterpret_cast<sockaddr *>(&addrs_[ii]);
+        dst.ai_next = ii + 1 < count ? &ai_[ii + 1] : nullptr;
+    }
+}
+
+static int lookup(const char *host, const char *port, int family, int flags, addrinfo **res)
+{
+    addrinfo hints{};
+    hints.ai_flags = AI_PASSIVE | flags;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_family = family;
+    return getaddrinfo(host, port, &hints, res);
+}
+
+static void worker(std::shared_ptr<lcbio_RESOLVER_st::Shared> shared)
+{
+    std::unique_lock<std::mutex> lock(shared->mutex);
+    while (!shared->stopped) {
+        if (shared->jobs.empty()) {
+            shared->nidle++;
+            bool woken = shared->cond.wait_for(lock, std::chrono::seconds(RESOLVER_IDLE_SECONDS),
+                                               [&shared] { return shared->stopped || !shared->jobs.empty(); });
+            shared->nidle--;
+            if (!woken) {
+                break;
+            }
+            continue;
+        }
+
+        Job job = std::move(shared->jobs.front());
+        shared->jobs.pop_front();
+        lock.unlock();
+
+        addrinfo *res = nullptr;
+        int eai = 0;
+        lcb_STATUS rc = LCB_SUCCESS;
+        lcb::Hostlist *hosts = nullptr;
+        if (job.srv) {
+            hosts = new lcb::Hostlist();
+            rc = lcb::dnssrv_query(job.host.c_str(), *hosts, false);
+        } else {
+            eai = lookup(job.host.c_str(), job.port.c_str(), job.family, 0, &res);
+        }
+
+        lock.lock();
+        if (shared->stopped) {
+            if (res != nullptr) {
+                freeaddrinfo(res);
+            }
+            delete hosts;
+            break;
+        }
+        shared->done.push_back(Done{std::move(job.key), eai, res, rc, hosts});
+        lcb_wakeup_signal(shared->wakeup);
+    }
+    shared->nthreads--;
+}
+
+lcbio_RESOLVER_st::lcbio_RESOLVER_st(lcbio_TABLE *iot, lcb_settings *settings)
+    : settings_(settings), shared_(std::make_shared<Shared>())
+{
+    if (lcbio_wakeup_new(iot, deliver, this, &wakeup_) != LCB_SUCCESS) {
+        /* completion-based table: every lookup is synchronous */
+        wakeup_ = nullptr;
+    }
+    shared_->wakeup = wakeup_;
+}
+
+lcbio_RESOLVER_st::~lcbio_RESOLVER_st()
+{
+    shutdown();
+}
+
+std::string lcbio_RESOLVER_st::make_key(const lcb_host_t *host, int family)
+{
+    std::string key(host->host);
+    key += '\0';
+    key += host->port;
+    key += '\0';
+    key += std::to_string(family);
+    return key;
+}
+
+bool lcbio_RESOLVER_st::resolve(const lcb_host_t *host, int family, Callback cb, void *arg, int *eai,
+                                std::shared_ptr<AddrList> *addrs, bool *cached)
+{
+    std::string key = make_key(host, family);
+    hrtime_t now = gethrtime();
+    *cached = false;
+
+    auto it = cache_.find(key);
+    if (it != cache_.end()) {
+        if (it->second.expires > now) {
+            *cached = true;
+            *eai = 0;
+            *addrs = it->second.addrs;
+            return true;
+        }
+        cache_.erase(it);
+    }
+
+    /* Numeric addresses are converted without asking the resolver */
+    addrinfo *res = nullptr;
+    *eai = lookup(host->host, host->port, family, AI_NUMERICHOST, &res);
+    if (*eai == 0) {
+        addrs->reset(new AddrList(res));
+        freeaddrinfo(res);
+        return true;
+    }
+
+    if (wakeup_ != nullptr) {
+        std::vector<Waiter> &waiters = pending_[key];
+        waiters.push_back(Waiter{cb, arg});
+        if (waiters.size() > 1) {
+            /* already being looked up */
+            return false;
+        }
+        if (start_job(key, host->host, host->port, family, false)) {
+            return false;
+        }
+        pending_.erase(key);
+    }
+
+    res = nullptr;
+    *eai = lookup(host->host, host->port, family, 0, &res);
+    if (*eai == 0) {
+        addrs->reset(new AddrList(res));
+        freeaddrinfo(res);
+        store(key, *addrs);
+    }
+    return true;
+}
+
+/** Hand a job to a helper thread. @return false if no thread can run it */
+bool lcbio_RESOLVER_st::start_job(const std::string &key, const std::string &host, const std::string &port,
+                                  int family, bool srv)
+{
+    std::lock_guard<std::mutex> guard(shared_->mutex);
+    shared_->jobs.push_back(Job{key, host, port, family, srv});
+    if (shared_->nidle > 0) {
+        shared_->cond.notify_one();
+        return true;
+    }
+    if (shared_->nthreads < RESOLVER_MAX_THREADS) {
+        try {
+            std::thread(worker, shared_).detach();
+            shared_->nthreads++;
+        } catch (const std::system_error &) {
+            /* fall back to a synchronous lookup if no thread can take it */
+        }
+    }
+    if (shared_->nthreads > 0) {
+        return true;
+    }
+    shared_->jobs.pop_back();
+    return false;
+}
+
+bool lcbio_RESOLVER_st::resolve_srv(const std::string &name, SrvCallback cb, void *arg)
+{
+    if (wakeup_ == nullptr) {
+        return false;
+    }
+    /* cannot collide with the keys of make_key(), which contain two NULs */
+    std::string key = "srv";
+    key += '\0';
+    key += name;
+
+    std::vector<SrvWaiter> &waiters = pending_srv_[key];
+    waiters.push_back(SrvWaiter{cb, arg});
+    if (waiters.size() > 1 || start_job(key, name, std::string(), 0, true)) {
+        return true;
+    }
+    pending_srv_.erase(key);
+    return false;
+}
+
+void lcbio_RESOLVER_st::store(const std::string &key, const std::shared_ptr<AddrList> &addrs)
+{
+    if (settings_->dns_cache_ttl == 0) {
+        return;
+    }
+    hrtime_t now = gethrtime();
+    if (cache_.size() >= RESOLVER_CACHE_MAX) {
+        for (auto it = cache_.begin(); it != cache_.end();) {
+            if (it->second.expires <= now) {
+                it = cache_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        if (cache_.size() >= RESOLVER_CACHE_MAX) {
+            cache_.clear();
+        }
+    }
+    cache_[key] = CacheEntry{addrs, now + LCB_US2NS(settings_->dns_cache_ttl)};
+}
+
+void lcbio_RESOLVER_st::cancel(void *arg)
+{
+    for (auto &pending : pending_) {
+        for (auto &waiter : pending.second) {
+            if (waiter.arg == arg) {
+                /* the lookup itself keeps running for the others, and the cache */
+                waiter.cb = nullptr;
+            }
+        }
+    }
+    for (auto &pending : pending_srv_) {
+        for (auto &waiter : pending.second) {
+            if (waiter.arg == arg) {
+                waiter.cb = nullptr;
+            }
+        }
+    }
+}
+
+void lcbio_RESOLVER_st::invalidate(const lcb_host_t *host, int family)
+{
+    cache_.erase(make_key(host, family));
+}
+
+void lcbio_RESOLVER_st::deliver(void *arg)
+{
+    auto *self = static_cast<lcbio_RESOLVER_st *>(arg);
+    std::vector<Done> done;
+    {
+        std::lock_guard<std::mutex> guard(self->shared_->mutex);
+        done.swap(self->shared_->done);
+    }
+
+    self->ref();
+    for (auto &result : done) {
+        if (result.hosts != nullptr) {
+            std::unique_ptr<lcb::Hostlist> hosts(result.hosts);
+            auto pending = self->pending_srv_.find(result.key);
+            if (pending == self->pending_srv_.end()) {
+                continue;
+            }
+            std::vector<SrvWaiter> waiters;
+            waiters.swap(pending->second);
+            self->pending_srv_.erase(pending);
+            for (const auto &waiter : waiters) {
+                if (waiter.cb != nullptr) {
+                    waiter.cb(waiter.arg, result.rc, *hosts);
+                }
+            }
+            continue;
+        }
+
+        std::shared_ptr<AddrList> addrs;
+        if (result.eai == 0) {
+            addrs = std::make_shared<AddrList>(result.res);
+            freeaddrinfo(result.res);
+            self->store(result.key, addrs);
+        }
+
+        auto pending = self->pending_.find(result.key);
+        if (pending == self->pending_.end()) {
+            continue;
+        }
+        std::vector<Waiter> waiters;
+        waiters.swap(pending->second);
+        self->pending_.erase(pending);
+        for (const auto &waiter : waiters) {
+            if (waiter.cb != nullptr) {
+                waiter.cb(waiter.arg, result.eai, addrs);
+            }
+        }
+    }
+    self->unref();
+}
+
+void lcbio_RESOLVER_st::shutdown()
+{
+    if (wakeup_ == nullptr) {
+        return;
+    }
+
+    std::vector<Done> done;
+    {
+        std::lock_guard<std::mutex> guard(shared_->mutex);
+        shared_->stopped = true;
+        shared_->jobs.clear();
+        shared_->wakeup = nullptr;
+        done.swap(shared_->done);
+    }
+    shared_->cond.notify_all();
+    for (auto &result : done) {
+        if (result.res != nullptr) {
+            freeaddrinfo(result.res);
+        }
+        delete result.hosts;
+    }
+    lcb_wakeup_destroy(wakeup_);
+    wakeup_ = nullptr;
+    pending_.clear();
+    pending_srv_.clear();
+    cache_.clear();
+}
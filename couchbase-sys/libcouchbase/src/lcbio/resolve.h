@@ -0,0 +1,184 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCBIO_RESOLVE_H
+#define LCBIO_RESOLVE_H
+
+#include "connect.h"
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @file
+ * Asynchronous hostname resolution with an address cache.
+ *
+ * getaddrinfo() blocks, and a resolver which does not answer stalls the event
+ * loop, and with it every operation of the instance, for the whole resolver
+ * timeout. The lookups of names are therefore run on helper threads, and their
+ * results are delivered on the loop thread through a wakeup handle
+ * (lcbio_wakeup_new()). Numeric addresses are converted inline, as are all
+ * lookups on tables which cannot watch a descriptor (completion-based plugins)
+ * or when the wakeup handle cannot be created.
+ *
+ * Successful lookups are cached for LCB_CNTL_DNS_CACHE_TTL, so that the data
+ * connections and the HTTP pool of an instance reuse them. getaddrinfo() does
+ * not report the TTL of the records, hence the fixed lifetime; an entry is
+ * also dropped as soon as none of its addresses could be connected to.
+ *
+ * The helper threads also run the DNS SRV queries which refresh the bootstrap
+ * hosts (see lcb::dnssrv_query()).
+ */
+
+namespace lcb
+{
+struct Hostlist;
+
+namespace io
+{
+
+/** An immutable list of addresses, in the form of an addrinfo chain */
+class AddrList
+{
+  public:
+    explicit AddrList(const addrinfo *res);
+    AddrList(const AddrList &) = delete;
+    AddrList &operator=(const AddrList &) = delete;
+
+    addrinfo *head()
+    {
+        return ai_.empty() ? nullptr : &ai_[0];
+    }
+
+  private:
+    std::vector<addrinfo> ai_;
+    std::vector<sockaddr_storage> addrs_;
+};
+
+} // namespace io
+} // namespace lcb
+
+/** The resolver of an instance, see lcb_settings::resolver */
+struct lcbio_RESOLVER_st {
+    /**
+     * Invoked on the loop thread when an asynchronous lookup is done
+     * @param arg the argument passed to resolve()
+     * @param eai zero, or the error returned by getaddrinfo()
+     * @param addrs the addresses if eai is zero
+     */
+    typedef void (*Callback)(void *arg, int eai, const std::shared_ptr<lcb::io::AddrList> &addrs);
+
+    /**
+     * Invoked on the loop thread when an SRV query is done
+     * @param arg the argument passed to resolve_srv()
+     * @param rc the result of lcb::dnssrv_query()
+     * @param hosts the targets of the records, owned by the resolver
+     */
+    typedef void (*SrvCallback)(void *arg, lcb_STATUS rc, const lcb::Hostlist &hosts);
+
+    lcbio_RESOLVER_st(lcbio_TABLE *iot, lcb_settings *settings);
+    ~lcbio_RESOLVER_st();
+
+    /**
+     * Resolve a host.
+     * @param host the host and port to look up
+     * @param family AF_INET, AF_INET6 or AF_UNSPEC
+     * @param cb the callback to invoke if the lookup is asynchronous
+     * @param arg the argument of the callback, also used by cancel()
+     * @param[out] eai the result of a synchronous lookup
+     * @param[out] addrs the addresses of a synchronous lookup
+     * @param[out] cached set if the addresses came from the cache
+     * @return true if the lookup completed synchronously, false if cb will be
+     *  invoked later
+     */
+    bool resolve(const lcb_host_t *host, int family, Callback cb, void *arg, int *eai,
+                 std::shared_ptr<lcb::io::AddrList> *addrs, bool *cached);
+
+    /**
+     * Query the SRV records of a name on a helper thread, bypassing the cache
+     * of lcb::dnssrv_query().
+     * @return false if the query cannot be asynchronous, in which case cb is
+     *  never invoked
+     */
+    bool resolve_srv(const std::string &name, SrvCallback cb, void *arg);
+
+    /** Ensures that the callback (or SrvCallback) is not invoked for arg */
+    void cancel(void *arg);
+
+    /** Drops the cached addresses of a host, e.g. because none could be connected to */
+    void invalidate(const lcb_host_t *host, int family);
+
+    /**
+     * Stops delivering results. Lookups still running are abandoned, and their
+     * callbacks are never invoked. Called when the instance is destroyed.
+     */
+    void shutdown();
+
+    void ref()
+    {
+        refcount_++;
+    }
+
+    void unref()
+    {
+        if (--refcount_ == 0) {
+            delete this;
+        }
+    }
+
+    struct Shared;
+
+  private:
+    static void deliver(void *arg);
+    static std::string make_key(const lcb_host_t *host, int family);
+    void store(const std::string &key, const std::shared_ptr<lcb::io::AddrList> &addrs);
+
+    bool start_job(const std::string &key, const std::string &host, const std::string &port, int family,
+                   bool srv);
+
+    struct Waiter {
+        Callback cb;
+        void *arg;
+    };
+    struct SrvWaiter {
+        SrvCallback cb;
+        void *arg;
+    };
+    struct CacheEntry {
+        std::shared_ptr<lcb::io::AddrList> addrs;
+        hrtime_t expires;
+    };
+
+    lcb_settings *settings_;
+    lcb_WAKEUP *wakeup_{nullptr};
+    std::shared_ptr<Shared> shared_;
+    std::unordered_map<std::string, CacheEntry> cache_;
+    std::unordered_map<std::string, std::vector<Waiter>> pending_;
+    std::unordered_map<std::string, std::vector<SrvWaiter>> pending_srv_;
+    unsigned refcount_{1};
+};
+
+namespace lcb
+{
+namespace io
+{
+typedef lcbio_RESOLVER_st Resolver;
+} // namespace io
+} // namespace lcb
+
+#endif
@@ -58,7 +58,9 @@ static INLINE lcbio_IOSTATUS lcbio_E_rdb_slurp(lcbio_CTX *ctx, rdb_IOROPE *ior)
         niov = rdb_rdstart(ior, (nb_IOV *)iov, RWINL_IOVSIZE);
     GT_READ:
         rv = IOT_V0IO(iot).recvv(IOT_ARG(iot), CTX_FD(ctx), iov, niov);
+        CTX_INCR_METRIC(ctx, io_recv_calls, 1);
         if (rv > 0) {
+            CTX_RECORD_METRIC(ctx, recv_bytes, rv);
 #ifdef LCB_DUMP_PACKETS
             {
                 char *b64 = NULL;
@@ -76,6 +78,7 @@ static INLINE lcbio_IOSTATUS lcbio_E_rdb_slurp(lcbio_CTX *ctx, rdb_IOROPE *ior)
             switch (IOT_ERRNO(iot)) {
                 case EWOULDBLOCK:
                 case C_EAGAIN:
+                    CTX_INCR_METRIC(ctx, io_recv_eagain, 1);
                     return LCBIO_PENDING;
                 case EINTR:
                     goto GT_READ;
@@ -105,12 +108,14 @@ static INLINE lcbio_IOSTATUS lcbio_E_rb_write(lcbio_CTX *ctx, ringbuffer_t *buf)
         niov = iov[1].iov_len ? 2 : 1;
 #endif
         nw = IOT_V0IO(iot).sendv(IOT_ARG(iot), CTX_FD(ctx), iov, niov);
+        CTX_INCR_METRIC(ctx, io_send_calls, 1);
         if (nw == -1) {
             switch (IOT_ERRNO(iot)) {
                 case EINTR:
                     break;
                 case EWOULDBLOCK:
                 case C_EAGAIN:
+                    CTX_INCR_METRIC(ctx, io_send_eagain, 1);
                     return LCBIO_PENDING;
                 default:
                     ctx->sock->last_error = IOT_ERRNO(iot);
@@ -129,6 +134,10 @@ static INLINE lcbio_IOSTATUS lcbio_E_rb_write(lcbio_CTX *ctx, ringbuffer_t *buf)
 #endif
             ringbuffer_consumed(buf, nw);
             CTX_INCR_METRIC(ctx, bytes_sent, nw);
+            CTX_RECORD_METRIC(ctx, send_bytes, nw);
+            if (ctx->sock->kstats) {
+                lcbio_kstats_sent(ctx->sock, nw);
+            }
         }
     }
     return LCBIO_COMPLETED;
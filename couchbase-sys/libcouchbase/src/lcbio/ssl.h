@@ -86,6 +86,15 @@ lcbio_pSSLCTX lcbio_ssl_new(const char *tsfile, const char *cafile, const char *
  */
 void lcbio_ssl_free(lcbio_pSSLCTX ctx);
 
+/**
+ * Create a context using the same OpenSSL context (certificates, trust store
+ * and verification policy) as another one, without loading them again. The TLS
+ * session cache is not shared, so that the two may be used from different
+ * threads. Free it with lcbio_ssl_free() as well.
+ * @return the new context, or NULL on error
+ */
+lcbio_pSSLCTX lcbio_ssl_share(lcbio_pSSLCTX ctx);
+
 /**
  * Apply the SSL settings to a given socket.
  *
@@ -117,6 +126,15 @@ int lcbio_ssl_check(lcbio_SOCKET *sock);
 LCB_INTERNAL_API
 lcb_STATUS lcbio_ssl_get_error(lcbio_SOCKET *sock);
 
+/**
+ * Check whether the handshake of an SSL socket resumed a cached session
+ * @param sock the socket
+ * @return true if the session was resumed, false for a full handshake (or if
+ * the handshake has not completed yet)
+ */
+LCB_INTERNAL_API
+int lcbio_ssl_resumed(lcbio_SOCKET *sock);
+
 /**
  * @brief
  * Initialize any application-level globals needed for SSL support
@@ -63,6 +63,13 @@ extern "C" {
  * Timers are not persistent, meaning that once they are fired they will enter
  * an inactive state.
  *
+ * The timers of an I/O table share a single timer of the I/O plugin, which
+ * is scheduled for the earliest deadline (see lcbio_TIMERMUX). Arming and
+ * disarming a timer only touches a heap, and calls into the plugin only if
+ * the earliest deadline moves closer. Timers due at the same time run in the
+ * order they were armed, and a timer armed while others are being run waits
+ * for the next iteration of the event loop, as with plugin timers.
+ *
  * @addtogroup lcbio-timers
  * @{
  */
@@ -81,14 +88,22 @@ typedef enum {
 typedef void (*lcbio_TIMER_cb)(void *);
 
 typedef struct lcbio_TIMER {
-    void *event;
     void *data;
     lcbio_TIMER_cb callback;
     uint32_t usec_;
     lcbio_TIMERSTATE state;
     lcbio_pTABLE io;
+    hrtime_t deadline; /**< When the timer is due, if armed */
+    lcb_U64 seqno;     /**< Order in which timers due at the same time run */
+    size_t index;      /**< Position in the heap of the multiplexer, if armed */
 } lcbio_TIMER, lcbio_ASYNC;
 
+/**
+ * @private
+ * Destroy the timer multiplexer of an I/O table, once it has no timers left
+ */
+void lcbio_timermux_destroy(lcbio_pTABLE iot);
+
 /**
  * @brief Creates a new timer object.
  *
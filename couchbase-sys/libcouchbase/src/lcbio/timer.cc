@@ -19,27 +19,132 @@
 #include "iotable.h"
 #include "timer-ng.h"
 
+#include <vector>
+
 #define TMR_IS_DESTROYED(timer) ((timer)->state & LCBIO_TIMER_S_DESTROYED)
 #define TMR_IS_ARMED(timer) ((timer)->state & LCBIO_TIMER_S_ARMED)
 
+/**
+ * Armed timers of an I/O table, in a binary heap ordered by deadline (and by
+ * the order they were armed in). A single plugin timer is scheduled for the
+ * earliest of them.
+ */
+struct lcbio_TIMERMUX {
+    explicit lcbio_TIMERMUX(lcbio_TABLE *io_) : io(io_), event(io_->timer.create(IOT_ARG(io_))) {}
+
+    ~lcbio_TIMERMUX()
+    {
+        if (scheduled) {
+            io->timer.cancel(io->p, event);
+        }
+        io->timer.destroy(io->p, event);
+    }
+
+    static bool before(const lcbio_TIMER *a, const lcbio_TIMER *b)
+    {
+        return a->deadline < b->deadline || (a->deadline == b->deadline && a->seqno < b->seqno);
+    }
+
+    void place(lcbio_TIMER *timer, size_t ix)
+    {
+        heap[ix] = timer;
+        timer->index = ix;
+    }
+
+    void sift_up(size_t ix)
+    {
+        lcbio_TIMER *timer = heap[ix];
+        while (ix > 0 && before(timer, heap[(ix - 1) / 2])) {
+            place(heap[(ix - 1) / 2], ix);
+            ix = (ix - 1) / 2;
+        }
+        place(timer, ix);
+    }
+
+    void sift_down(size_t ix)
+    {
+        lcbio_TIMER *timer = heap[ix];
+        for (;;) {
+            size_t child = ix * 2 + 1;
+            if (child >= heap.size()) {
+                break;
+            }
+            if (child + 1 < heap.size() && before(heap[child + 1], heap[child])) {
+                child++;
+            }
+            if (!before(heap[child], timer)) {
+                break;
+            }
+            place(heap[child], ix);
+            ix = child;
+        }
+        place(timer, ix);
+    }
+
+    void push(lcbio_TIMER *timer)
+    {
+        heap.push_back(timer);
+        sift_up(heap.size() - 1);
+    }
+
+    void remove(lcbio_TIMER *timer)
+    {
+        size_t ix = timer->index;
+        lcbio_TIMER *last = heap.back();
+        heap.pop_back();
+        if (last != timer) {
+            place(last, ix);
+            sift_down(ix);
+            sift_up(last->index);
+        }
+    }
+
+    /**
+     * Make sure the plugin timer fires no later than the earliest deadline.
+     * It is left alone if it fires earlier, and then rescheduled by dispatch().
+     */
+    void reschedule()
+    {
+        if (dispatching || heap.empty()) {
+            return;
+        }
+        hrtime_t deadline = heap.front()->deadline;
+        if (scheduled && scheduled_for <= deadline) {
+            return;
+        }
+        hrtime_t now = gethrtime();
+        lcb_U32 usec = deadline > now ? static_cast<lcb_U32>((deadline - now + 999) / 1000) : 0;
+        if (scheduled) {
+            io->timer.cancel(io->p, event);
+        }
+        io->timer.schedule(io->p, event, usec, this, dispatch);
+        scheduled = true;
+        scheduled_for = deadline;
+    }
+
+    static void dispatch(lcb_socket_t, short, void *arg);
+
+    lcbio_TABLE *io;
+    void *event;
+    std::vector<lcbio_TIMER *> heap{};
+    lcb_U64 next_seqno{0};
+    /** Whether `event` is scheduled, and for when */
+    bool scheduled{false};
+    hrtime_t scheduled_for{0};
+    bool dispatching{false};
+};
+
 static void destroy_timer(lcbio_TIMER *timer)
 {
-    if (timer->event) {
-        timer->io->timer.destroy(timer->io->p, timer->event);
-    }
     lcbio_table_unref(timer->io);
     delete timer;
 }
 
-static void timer_callback(lcb_socket_t sock, short which, void *arg)
+static void timer_callback(lcbio_TIMER *timer)
 {
-    auto *timer = static_cast<lcbio_TIMER *>(arg);
-
-    lcb_assert(TMR_IS_ARMED(timer));
     lcb_assert(!TMR_IS_DESTROYED(timer));
     timer->state = static_cast<lcbio_TIMERSTATE>(timer->state | LCBIO_TIMER_S_ENTERED);
 
-    lcbio_timer_disarm(timer);
     timer->callback(timer->data);
 
     if (TMR_IS_DESTROYED(timer)) {
@@ -47,9 +152,44 @@ static void timer_callback(lcb_socket_t sock, short which, void *arg)
     } else {
         timer->state = static_cast<lcbio_TIMERSTATE>(timer->state & ~LCBIO_TIMER_S_ENTERED);
     }
+}
+
+void lcbio_TIMERMUX::dispatch(lcb_socket_t, short, void *arg)
+{
+    auto *mux = static_cast<lcbio_TIMERMUX *>(arg);
+    lcbio_TABLE *io = mux->io;
 
-    (void)sock;
-    (void)which;
+    /* Timers armed by the callbacks below wait for the next iteration */
+    lcb_U64 last_seqno = mux->next_seqno;
+    /* The plugin decides when a deadline has come, as with one timer each */
+    hrtime_t now = gethrtime();
+    if (now < mux->scheduled_for) {
+        now = mux->scheduled_for;
+    }
+    /* some plugins keep firing until the timer is cancelled */
+    io->timer.cancel(io->p, mux->event);
+    mux->scheduled = false;
+    mux->dispatching = true;
+    lcbio_table_ref(io);
+
+    while (!mux->heap.empty()) {
+        lcbio_TIMER *timer = mux->heap.front();
+        if (timer->deadline > now || timer->seqno >= last_seqno) {
+            break;
+        }
+        lcbio_timer_disarm(timer);
+        timer_callback(timer);
+    }
+
+    mux->dispatching = false;
+    mux->reschedule();
+    lcbio_table_unref(io);
+}
+
+void lcbio_timermux_destroy(lcbio_TABLE *io)
+{
+    delete io->tmux;
+    io->tmux = nullptr;
 }
 
 lcbio_TIMER *lcbio_timer_new(lcbio_TABLE *io, void *data, lcbio_TIMER_cb callback)
@@ -59,7 +199,9 @@ lcbio_TIMER *lcbio_timer_new(lcbio_TABLE *io, void *data, lcbio_TIMER_cb callbac
     ret->callback = callback;
     ret->data = data;
     ret->io = io;
-    ret->event = io->timer.create(IOT_ARG(io));
+    if (io->tmux == nullptr) {
+        io->tmux = new lcbio_TIMERMUX(io);
+    }
     lcbio_table_ref(io);
     return ret;
 }
@@ -81,18 +223,23 @@ void lcbio_timer_disarm(lcbio_TIMER *timer)
     }
 
     timer->state = static_cast<lcbio_TIMERSTATE>(timer->state & ~LCBIO_TIMER_S_ARMED);
-    timer->io->timer.cancel(timer->io->p, timer->event);
+    /* the plugin timer stays scheduled, it finds nothing due and moves on */
+    timer->io->tmux->remove(timer);
 }
 
 void lcbio_timer_rearm(lcbio_TIMER *timer, uint32_t usec)
 {
+    lcbio_TIMERMUX *mux = timer->io->tmux;
     if (TMR_IS_ARMED(timer)) {
-        lcbio_timer_disarm(timer);
+        mux->remove(timer);
     }
 
     timer->usec_ = usec;
-    timer->io->timer.schedule(timer->io->p, timer->event, usec, timer, timer_callback);
+    timer->deadline = gethrtime() + static_cast<hrtime_t>(usec) * 1000;
+    timer->seqno = mux->next_seqno++;
     timer->state = static_cast<lcbio_TIMERSTATE>(timer->state | LCBIO_TIMER_S_ARMED);
+    mux->push(timer);
+    mux->reschedule();
 }
 
 void lcbio_async_signal(lcbio_TIMER *timer)
@@ -109,7 +256,7 @@ void lcbio_timer_dump(lcbio_TIMER *timer, FILE *fp)
 {
     fprintf(fp, "~~ DUMP TIMER BEGIN ~~\n");
     fprintf(fp, "TIMER=%p\n", (void *)timer);
-    fprintf(fp, "INNER PTR=%p\n", timer->event);
+    fprintf(fp, "DEADLINE: %llu\n", (unsigned long long)timer->deadline);
     fprintf(fp, "USERDATA=%p\n", timer->data);
     fprintf(fp, "ACTIVE: %s\n", (timer->state & LCBIO_TIMER_S_ARMED) ? "YES" : "NO");
     fprintf(fp, "INTERVAL: %lu\n", (unsigned long)timer->usec_);
@@ -0,0 +1,253 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2020 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/**
+ * Wakeup handles allow a foreign thread to interrupt an event loop which is
+ * blocked inside lcb_wakeup_run(). The handle is a self-pipe (or an eventfd
+ * on Linux) whose read side is watched by the I/O plugin like any socket.
+ */
+
+#include "config.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include "iotable.h"
+#include "connect.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+#endif
+
+struct lcb_WAKEUP_st {
+    lcbio_pTABLE iot;
+    void *event;
+    int rfd;
+    int wfd;
+    /** Set while lcb_wakeup_run() is blocking in the loop */
+    int armed;
+    /** Set if a signal arrived while the loop was run by someone else */
+    int pending;
+    /** If set, invoked for each signal instead of stopping the loop */
+    lcbio_WAKEUP_HANDLER handler;
+    void *arg;
+};
+
+#ifndef _WIN32
+static void drain_fd(int fd)
+{
+    char buf[64];
+    while (read(fd, buf, sizeof(buf)) > 0) {
+        /* keep going until EAGAIN */
+    }
+}
+
+static void wakeup_handler(lcb_socket_t sock, short which, void *arg)
+{
+    lcb_WAKEUP *wakeup = (lcb_WAKEUP *)arg;
+    drain_fd(wakeup->rfd);
+    (void)sock;
+    (void)which;
+
+    if (wakeup->handler) {
+        wakeup->handler(wakeup->arg);
+        return;
+    }
+    if (wakeup->armed) {
+        IOT_STOP(wakeup->iot);
+    } else {
+        /* The loop is currently driven by e.g. lcb_wait(); do not interrupt it,
+         * but make sure the next lcb_wakeup_run() returns right away. */
+        wakeup->pending = 1;
+    }
+}
+
+static int set_nonblocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL);
+    if (flags == -1) {
+        return -1;
+    }
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+static int open_fds(lcb_WAKEUP *wakeup)
+{
+#ifdef __linux__
+    int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd != -1) {
+        wakeup->rfd = wakeup->wfd = fd;
+        return 0;
+    }
+#endif
+    {
+        int fds[2];
+        if (pipe(fds) != 0) {
+            return -1;
+        }
+        if (set_nonblocking(fds[0]) != 0 || set_nonblocking(fds[1]) != 0) {
+            close(fds[0]);
+            close(fds[1]);
+            return -1;
+        }
+        wakeup->rfd = fds[0];
+        wakeup->wfd = fds[1];
+    }
+    return 0;
+}
+#endif
+
+static lcb_STATUS wakeup_new(lcbio_pTABLE iot, lcbio_WAKEUP_HANDLER handler, void *arg, lcb_WAKEUP **wakeup)
+{
+#ifdef _WIN32
+    (void)iot;
+    (void)handler;
+    (void)arg;
+    (void)wakeup;
+    return LCB_ERR_UNSUPPORTED_OPERATION;
+#else
+    lcb_WAKEUP *res;
+
+    if (!IOT_IS_EVENT(iot)) {
+        /* completion-based plugins have no way to watch an arbitrary descriptor */
+        return LCB_ERR_UNSUPPORTED_OPERATION;
+    }
+
+    res = calloc(1, sizeof(*res));
+    if (res == NULL) {
+        return LCB_ERR_NO_MEMORY;
+    }
+    res->iot = iot;
+    res->handler = handler;
+    res->arg = arg;
+
+    if (open_fds(res) != 0) {
+        free(res);
+        return LCB_ERR_SDK_INTERNAL;
+    }
+
+    res->event = IOT_V0EV(res->iot).create(IOT_ARG(res->iot));
+    IOT_V0EV(res->iot).watch(IOT_ARG(res->iot), res->rfd, res->event, LCB_READ_EVENT, res, wakeup_handler);
+    *wakeup = res;
+    return LCB_SUCCESS;
+#endif
+}
+
+LIBCOUCHBASE_API
+lcb_STATUS lcb_wakeup_create(lcb_io_opt_t io, lcb_WAKEUP **wakeup)
+{
+#ifdef _WIN32
+    (void)io;
+    (void)wakeup;
+    return LCB_ERR_UNSUPPORTED_OPERATION;
+#else
+    lcbio_pTABLE iot;
+    lcb_STATUS rc;
+
+    if (io == NULL || wakeup == NULL) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+
+    iot = lcbio_table_new(io);
+    if (iot == NULL) {
+        return LCB_ERR_NO_MEMORY;
+    }
+    rc = wakeup_new(iot, NULL, NULL, wakeup);
+    if (rc != LCB_SUCCESS) {
+        lcbio_table_unref(iot);
+    }
+    return rc;
+#endif
+}
+
+lcb_STATUS lcbio_wakeup_new(lcbio_pTABLE iot, lcbio_WAKEUP_HANDLER handler, void *arg, lcb_WAKEUP **wakeup)
+{
+    lcb_STATUS rc = wakeup_new(iot, handler, arg, wakeup);
+    if (rc == LCB_SUCCESS) {
+        lcbio_table_ref(iot);
+    }
+    return rc;
+}
+
+LIBCOUCHBASE_API
+lcb_STATUS lcb_wakeup_signal(lcb_WAKEUP *wakeup)
+{
+#ifdef _WIN32
+    (void)wakeup;
+    return LCB_ERR_UNSUPPORTED_OPERATION;
+#else
+    ssize_t rv;
+#ifdef __linux__
+    uint64_t one = 1;
+    if (wakeup->rfd == wakeup->wfd) {
+        rv = write(wakeup->wfd, &one, sizeof(one));
+    } else
+#endif
+    {
+        char one_byte = 1;
+        rv = write(wakeup->wfd, &one_byte, 1);
+    }
+    if (rv < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+        /* a full pipe means a wakeup is already queued */
+        return LCB_ERR_SDK_INTERNAL;
+    }
+    return LCB_SUCCESS;
+#endif
+}
+
+LIBCOUCHBASE_API
+void lcb_wakeup_stop(lcb_WAKEUP *wakeup)
+{
+    if (wakeup->armed) {
+        IOT_STOP(wakeup->iot);
+    } else {
+        wakeup->pending = 1;
+    }
+}
+
+LIBCOUCHBASE_API
+void lcb_wakeup_run(lcb_WAKEUP *wakeup)
+{
+    if (wakeup->pending) {
+        wakeup->pending = 0;
+        return;
+    }
+    wakeup->armed = 1;
+    IOT_START(wakeup->iot);
+    wakeup->armed = 0;
+}
+
+LIBCOUCHBASE_API
+void lcb_wakeup_destroy(lcb_WAKEUP *wakeup)
+{
+    if (wakeup == NULL) {
+        return;
+    }
+#ifndef _WIN32
+    IOT_V0EV(wakeup->iot).cancel(IOT_ARG(wakeup->iot), wakeup->rfd, wakeup->event);
+    IOT_V0EV(wakeup->iot).destroy(IOT_ARG(wakeup->iot), wakeup->event);
+    close(wakeup->rfd);
+    if (wakeup->wfd != wakeup->rfd) {
+        close(wakeup->wfd);
+    }
+#endif
+    lcbio_table_unref(wakeup->iot);
+    free(wakeup);
+}
@@ -0,0 +1,313 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/**
+ * Rate limiting and asynchronous output of the console logger.
+ *
+ * Records are formatted by the logging thread (only once they passed the
+ * level and rate checks) into the slots of a bounded lock-free queue, and
+ * written out by a background thread, so that the event loop never waits for
+ * stdio. When the queue is full, records are dropped and counted rather than
+ * blocking the caller.
+ */
+
+#include "settings.h"
+#include "logging.h"
+#include "boundedqueue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#define flockfile(x) (void)0
+#define funlockfile(x) (void)0
+#endif
+
+/** Number of records the queue holds */
+#define CONLOG_QUEUE_SIZE 4096
+/** Records up to this size (including the prefix) are kept inline */
+#define CONLOG_INLINE_SIZE 480
+/** Number of subsystems which are rate limited separately */
+#define CONLOG_MAX_SUBSYS 64
+/** The writer thread flushes its files and sleeps after this long without records */
+#define CONLOG_IDLE_MS 50
+
+namespace
+{
+struct Record {
+    FILE *fp;
+    size_t len;
+    char *heap; /* set if the record did not fit in text */
+    char text[CONLOG_INLINE_SIZE];
+};
+
+class Writer
+{
+  public:
+    ~Writer()
+    {
+        {
+            std::lock_guard<std::mutex> guard(mutex_);
+            stopped_ = true;
+        }
+        cond_.notify_all();
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+    }
+
+    int enqueue(FILE *fp, const char *prefix, const char *fmt, va_list ap)
+    {
+        start();
+        size_t pos;
+        Record *rec = queue_.claim(pos);
+        if (rec == nullptr) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return -1;
+        }
+
+        va_list aq;
+        va_copy(aq, ap);
+        size_t nprefix = strlen(prefix);
+        int nmsg = vsnprintf(nullptr, 0, fmt, aq);
+        va_end(aq);
+        if (nmsg < 0) {
+            nmsg = 0;
+        }
+
+        rec->fp = fp;
+        rec->len = nprefix + nmsg + 1;
+        rec->heap = nullptr;
+        char *buf = rec->text;
+        if (rec->len + 1 > sizeof(rec->text)) {
+            buf = rec->heap = static_cast<char *>(malloc(rec->len + 1));
+        }
+        if (buf == nullptr) {
+            rec->len = 0;
+        } else {
+            memcpy(buf, prefix, nprefix);
+            vsnprintf(buf + nprefix, nmsg + 1, fmt, ap);
+            buf[rec->len - 1] = '\n';
+        }
+        queue_.publish(pos);
+        pending_.fetch_add(1);
+
+        /* pairs with run() setting sleeping_ before checking pending_ */
+        if (sleeping_.load()) {
+            std::lock_guard<std::mutex> guard(mutex_);
+            cond_.notify_all();
+        }
+        return 0;
+    }
+
+    void flush()
+    {
+        if (!running_.load()) {
+            return;
+        }
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.notify_all();
+        drained_.wait(lock, [this] { return pending_.load(std::memory_order_acquire) == 0 || stopped_; });
+    }
+
+    lcb_U64 dropped() const
+    {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+  private:
+    void start()
+    {
+        std::call_once(started_, [this] {
+            thread_ = std::thread(&Writer::run, this);
+            running_.store(true);
+        });
+    }
+
+    void run()
+    {
+        std::vector<FILE *> written;
+        for (;;) {
+            Record *rec = queue_.front();
+            if (rec != nullptr) {
+                const char *text = rec->heap ? rec->heap : rec->text;
+                flockfile(rec->fp);
+                fwrite(text, 1, rec->len, rec->fp);
+                funlockfile(rec->fp);
+                if (std::find(written.begin(), written.end(), rec->fp) == written.end()) {
+                    written.push_back(rec->fp);
+                }
+                free(rec->heap);
+                queue_.pop();
+                pending_.fetch_sub(1, std::memory_order_release);
+                continue;
+            }
+
+            for (FILE *fp : written) {
+                fflush(fp);
+            }
+            written.clear();
+
+            std::unique_lock<std::mutex> lock(mutex_);
+            drained_.notify_all();
+            if (pending_.load(std::memory_order_acquire) != 0) {
+                continue;
+            }
+            if (stopped_) {
+                break;
+            }
+            sleeping_.store(true);
+            cond_.wait_for(lock, std::chrono::milliseconds(CONLOG_IDLE_MS),
+                           [this] { return stopped_ || pending_.load() != 0; });
+            sleeping_.store(false);
+        }
+    }
+
+    lcb::BoundedQueue<Record> queue_{CONLOG_QUEUE_SIZE};
+    std::atomic<size_t> pending_{0};
+    std::atomic<lcb_U64> dropped_{0};
+    std::atomic<bool> sleeping_{false};
+    std::atomic<bool> running_{false};
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::condition_variable drained_;
+    std::once_flag started_;
+    std::thread thread_;
+    bool stopped_{false};
+};
+
+/**
+ * Token bucket of a subsystem. The state packs the time of the last refill
+ * (milliseconds since the first use, upper 40 bits) and the number of tokens
+ * (lower 24 bits), so that it is updated with a single compare-and-swap.
+ */
+struct Bucket {
+    std::atomic<const char *> subsys{nullptr};
+    std::atomic<lcb_U64> state{0};
+    std::atomic<lcb_U64> suppressed{0};
+};
+
+#define BUCKET_TOKEN_BITS 24
+#define BUCKET_TOKEN_MASK ((1ULL << BUCKET_TOKEN_BITS) - 1)
+
+Bucket buckets[CONLOG_MAX_SUBSYS];
+std::atomic<lcb_U64> limited_total{0};
+const std::chrono::steady_clock::time_point limiter_epoch = std::chrono::steady_clock::now();
+
+Writer &writer()
+{
+    static Writer instance;
+    return instance;
+}
+
+Bucket *find_bucket(const char *subsys)
+{
+    /* subsystem names are literals, so their addresses identify them */
+    size_t start = (reinterpret_cast<uintptr_t>(subsys) >> 3) % CONLOG_MAX_SUBSYS;
+    for (size_t ii = 0; ii < CONLOG_MAX_SUBSYS; ii++) {
+        Bucket &bucket = buckets[(start + ii) % CONLOG_MAX_SUBSYS];
+        const char *cur = bucket.subsys.load(std::memory_order_acquire);
+        if (cur == subsys) {
+            return &bucket;
+        }
+        if (cur == nullptr) {
+            if (bucket.subsys.compare_exchange_strong(cur, subsys, std::memory_order_acq_rel) || cur == subsys) {
+                return &bucket;
+            }
+        }
+    }
+    return nullptr;
+}
+} // namespace
+
+LCB_INTERNAL_API
+int lcb_conlog_admit(const char *subsys, lcb_U32 rate, lcb_U64 *suppressed)
+{
+    *suppressed = 0;
+    if (rate == 0) {
+        return 1;
+    }
+    Bucket *bucket = find_bucket(subsys);
+    if (bucket == nullptr) {
+        /* too many subsystems, these ones are not limited */
+        return 1;
+    }
+
+    lcb_U64 burst = rate < BUCKET_TOKEN_MASK ? rate : BUCKET_TOKEN_MASK;
+    lcb_U64 now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() -
+                                                                          limiter_epoch)
+                      .count() +
+                  1;
+    lcb_U64 state = bucket->state.load(std::memory_order_relaxed);
+    for (;;) {
+        lcb_U64 last = state >> BUCKET_TOKEN_BITS;
+        lcb_U64 tokens = state & BUCKET_TOKEN_MASK;
+        if (last == 0) {
+            /* first use: full bucket */
+            tokens = burst;
+            last = now;
+        } else if (now > last) {
+            lcb_U64 added = (now - last) * rate / 1000;
+            if (added > 0) {
+                tokens = tokens + added < burst ? tokens + added : burst;
+                /* keep the time of the fractional token */
+                last += added * 1000 / rate;
+            }
+        }
+        bool admit = tokens > 0;
+        if (admit) {
+            tokens--;
+        }
+        lcb_U64 next = (last << BUCKET_TOKEN_BITS) | tokens;
+        if (bucket->state.compare_exchange_weak(state, next, std::memory_order_relaxed)) {
+            if (!admit) {
+                bucket->suppressed.fetch_add(1, std::memory_order_relaxed);
+                limited_total.fetch_add(1, std::memory_order_relaxed);
+                return 0;
+            }
+            *suppressed = bucket->suppressed.exchange(0, std::memory_order_relaxed);
+            return 1;
+        }
+    }
+}
+
+LCB_INTERNAL_API
+int lcb_conlog_enqueue(FILE *fp, const char *prefix, const char *fmt, va_list ap)
+{
+    return writer().enqueue(fp, prefix, fmt, ap);
+}
+
+LCB_INTERNAL_API
+void lcb_conlog_flush(void)
+{
+    writer().flush();
+}
+
+LCB_INTERNAL_API
+lcb_U64 lcb_conlog_dropped(void)
+{
+    return limited_total.load(std::memory_order_relaxed) + writer().dropped();
+}
@@ -78,7 +78,8 @@ static hrtime_t start_time = 0;
 static void console_log(const lcb_LOGGER *procs, uint64_t iid, const char *subsys, lcb_LOG_SEVERITY severity,
                         const char *srcfile, int srcline, const char *fmt, va_list ap);
 
-static struct lcb_CONSOLELOGGER console_logprocs = {{console_log, NULL}, NULL, LCB_LOG_INFO /* Minimum severity */};
+static struct lcb_CONSOLELOGGER console_logprocs = {
+    {console_log, NULL}, NULL, LCB_LOG_INFO /* Minimum severity */, 0 /* Synchronous */, 0 /* No rate limit */};
 
 lcb_LOGGER *lcb_console_logger = &console_logprocs.base;
 
@@ -114,10 +115,16 @@ static void console_log(const lcb_LOGGER *procs, uint64_t iid, const char *subsy
     FILE *fp;
     hrtime_t now;
     struct lcb_CONSOLELOGGER *vprocs = (struct lcb_CONSOLELOGGER *)procs;
+    lcb_U64 suppressed = 0;
+    char prefix[256];
+    int nprefix;
 
     if ((int)severity < vprocs->minlevel) {
         return;
     }
+    if (!lcb_conlog_admit(subsys, vprocs->rate, &suppressed)) {
+        return;
+    }
 
     if (!start_time) {
         start_time = gethrtime();
@@ -130,11 +137,21 @@ static void console_log(const lcb_LOGGER *procs, uint64_t iid, const char *subsy
 
     fp = vprocs->fp ? vprocs->fp : stderr;
 
-    flockfile(fp);
-    fprintf(fp, "%lums ", (unsigned long)(now - start_time) / 1000000);
+    nprefix = snprintf(prefix, sizeof(prefix), "%lums [I%" PRIx64 "] {%" THREAD_ID_FMT "} [%s] (%s - L:%d) ",
+                       (unsigned long)(now - start_time) / 1000000, iid, GET_THREAD_ID(), level_to_string(severity),
+                       subsys, srcline);
+    if (suppressed && nprefix > 0 && (size_t)nprefix < sizeof(prefix)) {
+        snprintf(prefix + nprefix, sizeof(prefix) - nprefix, "(%" PRIu64 " suppressed) ", suppressed);
+    }
+
+    if (vprocs->async) {
+        /* a full queue drops the record, which is counted */
+        lcb_conlog_enqueue(fp, prefix, fmt, ap);
+        return;
+    }
 
-    fprintf(fp, "[I%" PRIx64 "] {%" THREAD_ID_FMT "} [%s] (%s - L:%d) ", iid, GET_THREAD_ID(),
-            level_to_string(severity), subsys, srcline);
+    flockfile(fp);
+    fputs(prefix, fp);
     vfprintf(fp, fmt, ap);
     fprintf(fp, "\n");
     funlockfile(fp);
@@ -214,6 +231,16 @@ lcb_LOGGER *lcb_init_console_logger(void)
     /** The "lowest" level we can expose is WARN, e.g. ERROR-1 */
     lvl = LCB_LOG_ERROR - lvl;
     console_logprocs.minlevel = lvl;
+
+    if (lcb_getenv_boolean("LCB_LOGASYNC")) {
+        console_logprocs.async = 1;
+    }
+    if (lcb_getenv_nonempty("LCB_LOGRATE", vbuf, sizeof(vbuf))) {
+        unsigned rate = 0;
+        if (sscanf(vbuf, "%u", &rate) == 1) {
+            console_logprocs.rate = rate;
+        }
+    }
     return lcb_console_logger;
 }
 
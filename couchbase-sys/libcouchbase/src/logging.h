@@ -51,8 +51,38 @@ struct lcb_CONSOLELOGGER {
     struct lcb_LOGGER_ base;
     FILE *fp;
     int minlevel;
+    /** Whether records are written by a background thread, see LCB_CNTL_CONLOGGER_ASYNC */
+    int async;
+    /** Records per second and subsystem, 0 for no limit, see LCB_CNTL_CONLOGGER_RATE */
+    lcb_U32 rate;
 };
 
+/**
+ * Token bucket check of the console logger's rate limit for a subsystem.
+ * @param subsys the subsystem, a string literal (its address identifies it)
+ * @param rate records per second allowed, 0 for no limit
+ * @param[out] suppressed number of records of the subsystem suppressed since
+ *  the previous admitted one
+ * @return nonzero if the record may be logged
+ */
+LCB_INTERNAL_API
+int lcb_conlog_admit(const char *subsys, lcb_U32 rate, lcb_U64 *suppressed);
+
+/**
+ * Formats a record into the queue of the background writer thread.
+ * @return 0, or -1 if the queue is full and the record was dropped
+ */
+LCB_INTERNAL_API
+int lcb_conlog_enqueue(FILE *fp, const char *prefix, const char *fmt, va_list ap);
+
+/** Waits until the background writer has written every queued record */
+LCB_INTERNAL_API
+void lcb_conlog_flush(void);
+
+/** @return the number of console records rate limited or dropped */
+LCB_INTERNAL_API
+lcb_U64 lcb_conlog_dropped(void);
+
 /**
  * Log a message via the installed logger. The parameters correlate to the
  * arguments passed to the lcb_logging_callback function.
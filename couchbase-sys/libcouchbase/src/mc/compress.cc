@@ -17,7 +17,9 @@
 
 #include "mcreq.h"
 #include "compress.h"
+#include "metrics/metrics-internal.h"
 
+#include <cstring>
 #include <snappy.h>
 #include <snappy-sinksource.h>
 
@@ -82,70 +84,168 @@ class FragBufSource : public snappy::Source
     unsigned int idx;
 };
 
+struct lcb_COMPRESSPOLICY_st {
+    struct Class {
+        /** Running average of compressed_bytes / original_bytes */
+        float ratio;
+        std::uint32_t nsamples;
+        /** Values skipped since the last sample */
+        std::uint32_t nskipped;
+    };
+    Class classes[LCB_COMPRESS_NCLASSES];
+};
+
+lcb_COMPRESSPOLICY *mcreq_compress_policy_new(void)
+{
+    return new lcb_COMPRESSPOLICY();
+}
+
+void mcreq_compress_policy_destroy(lcb_COMPRESSPOLICY *policy)
+{
+    delete policy;
+}
+
+static lcb_COMPRESSPOLICY::Class *classify(lcb_COMPRESSPOLICY *policy, const char *key, std::size_t nkey, int is_json)
+{
+    static const std::size_t max_prefix = 32;
+    std::size_t nprefix = 0;
+    for (std::size_t ii = 0; ii < nkey && ii < max_prefix; ii++) {
+        char ch = key[ii];
+        if (ch == ':' || ch == '_' || ch == '-' || ch == '.' || ch == '/') {
+            nprefix = ii;
+            break;
+        }
+    }
+    /* keys without a short prefix are only classified by datatype */
+    std::uint32_t hash = is_json ? 0x811c9dc5U : 0x050c5d1fU;
+    for (std::size_t ii = 0; ii < nprefix; ii++) {
+        hash = (hash ^ static_cast<unsigned char>(key[ii])) * 0x01000193U;
+    }
+    return &policy->classes[hash % LCB_COMPRESS_NCLASSES];
+}
+
+static void record_compression(lcb_settings *settings, const char *name, std::uint64_t value)
+{
+    if (settings->op_metrics_enabled && settings->meter) {
+        auto recorder = settings->meter->value_recorder_(settings->meter, name, nullptr, 0);
+        if (recorder) {
+            recorder->record_value_(recorder, value);
+        }
+    }
+}
+
+/** Give back the part of the value span beyond `used` bytes */
+static void trim_value_span(mc_PIPELINE *pl, nb_SPAN *span, std::size_t used)
+{
+    if (used < span->size) {
+        nb_SPAN trailspan = *span;
+        trailspan.offset += used;
+        trailspan.size = span->size - used;
+        netbuf_mblock_release(&pl->nbmgr, &trailspan);
+        span->size = used;
+    }
+}
+
 int mcreq_compress_value(mc_PIPELINE *pl, mc_PACKET *pkt, const lcb_VALBUF *vbuf, lcb_settings *settings,
-                         int *should_compress)
+                         const char *key, size_t nkey, int is_json, int *should_compress)
 {
     std::size_t origsize = 0;
-    snappy::Source *source;
+    bool contig;
     switch (vbuf->vtype) {
         case LCB_KV_COPY:
         case LCB_KV_CONTIG:
+            contig = true;
             origsize = vbuf->u_buf.contig.nbytes;
-            if (origsize < settings->compress_min_size) {
-                *should_compress = 0;
-                mcreq_reserve_value(pl, pkt, vbuf);
-                return 0;
-            }
-            source = new snappy::ByteArraySource(static_cast<const char *>(vbuf->u_buf.contig.bytes),
-                                                 vbuf->u_buf.contig.nbytes);
             break;
 
         case LCB_KV_IOV:
         case LCB_KV_IOVCOPY:
+            contig = false;
             if (vbuf->u_buf.multi.total_length == 0) {
                 for (unsigned int ii = 0; ii < vbuf->u_buf.multi.niov; ii++) {
                     origsize += vbuf->u_buf.multi.iov[ii].iov_len;
                 }
+            } else {
+                origsize = vbuf->u_buf.multi.total_length;
             }
-            if (origsize == 0 || origsize < settings->compress_min_size) {
-                *should_compress = 0;
-                mcreq_reserve_value(pl, pkt, vbuf);
-                return 0;
-            }
-            source = new FragBufSource(&vbuf->u_buf.multi);
             break;
 
         default:
             return -1;
     }
+    if (origsize == 0 || origsize < settings->compress_min_size) {
+        *should_compress = 0;
+        mcreq_reserve_value(pl, pkt, vbuf);
+        return 0;
+    }
 
-    std::size_t maxsize = snappy::MaxCompressedLength(source->Available());
+    lcb_COMPRESSPOLICY::Class *klass = nullptr;
+    if (settings->compress_adaptive) {
+        if (settings->compress_policy == nullptr) {
+            settings->compress_policy = mcreq_compress_policy_new();
+        }
+        klass = classify(settings->compress_policy, key, nkey, is_json);
+        if (klass->nsamples >= LCB_COMPRESS_MIN_SAMPLES && klass->ratio > settings->compress_min_ratio &&
+            ++klass->nskipped < LCB_COMPRESS_RESAMPLE_INTERVAL) {
+            record_compression(settings, METRICS_COMPRESSION_SKIPPED_METER_NAME, origsize);
+            *should_compress = 0;
+            mcreq_reserve_value(pl, pkt, vbuf);
+            return 0;
+        }
+    }
+
+    /* compress straight into the packet, the span is large enough for the raw value as well */
+    std::size_t maxsize = snappy::MaxCompressedLength(origsize);
     if (mcreq_reserve_value2(pl, pkt, maxsize) != LCB_SUCCESS) {
-        delete source;
         return -1;
     }
     nb_SPAN *outspan = &pkt->u_value.single;
-    snappy::UncheckedByteArraySink sink(SPAN_BUFFER(outspan));
+    char *out = SPAN_BUFFER(outspan);
+    std::size_t compsize = 0;
+
+    hrtime_t start = gethrtime();
+    if (contig) {
+        snappy::RawCompress(static_cast<const char *>(vbuf->u_buf.contig.bytes), origsize, out, &compsize);
+    } else {
+        FragBufSource source(&vbuf->u_buf.multi);
+        snappy::UncheckedByteArraySink sink(out);
+        snappy::Compress(&source, &sink);
+        compsize = sink.CurrentDestination() - out;
+    }
+    record_compression(settings, METRICS_COMPRESSION_DURATION_METER_NAME, gethrtime() - start);
 
-    Compress(source, &sink);
-    std::size_t compsize = sink.CurrentDestination() - SPAN_BUFFER(outspan);
-    delete source;
+    float ratio = compsize ? (float)compsize / origsize : 1;
+    if (klass) {
+        /* exponential moving average, weighing the last eight samples most */
+        klass->ratio = klass->nsamples ? klass->ratio + (ratio - klass->ratio) / 8 : ratio;
+        if (klass->nsamples < LCB_COMPRESS_MIN_SAMPLES) {
+            klass->nsamples++;
+        }
+        klass->nskipped = 0;
+    }
 
-    if (compsize == 0 || (((float)compsize / origsize) > settings->compress_min_ratio)) {
-        netbuf_mblock_release(&pl->nbmgr, outspan);
+    if (compsize == 0 || ratio > settings->compress_min_ratio) {
+        record_compression(settings, METRICS_COMPRESSION_SAVED_METER_NAME, 0);
         *should_compress = 0;
-        mcreq_reserve_value(pl, pkt, vbuf);
+        if (vbuf->vtype == LCB_KV_COPY) {
+            memcpy(out, vbuf->u_buf.contig.bytes, origsize);
+        } else if (vbuf->vtype == LCB_KV_IOVCOPY) {
+            for (unsigned int ii = 0; ii < vbuf->u_buf.multi.niov; ii++) {
+                memcpy(out, vbuf->u_buf.multi.iov[ii].iov_base, vbuf->u_buf.multi.iov[ii].iov_len);
+                out += vbuf->u_buf.multi.iov[ii].iov_len;
+            }
+        } else {
+            /* the value is referenced rather than copied */
+            netbuf_mblock_release(&pl->nbmgr, outspan);
+            mcreq_reserve_value(pl, pkt, vbuf);
+            return 0;
+        }
+        trim_value_span(pl, outspan, origsize);
         return 0;
     }
 
-    if (compsize < maxsize) {
-        /* chop off some bytes? */
-        nb_SPAN trailspan = *outspan;
-        trailspan.offset += compsize;
-        trailspan.size = maxsize - compsize;
-        netbuf_mblock_release(&pl->nbmgr, &trailspan);
-        outspan->size = compsize;
-    }
+    record_compression(settings, METRICS_COMPRESSION_SAVED_METER_NAME, origsize - compsize);
+    trim_value_span(pl, outspan, compsize);
     return 0;
 }
 
@@ -167,3 +267,14 @@ int mcreq_inflate_value(const void *compressed, size_t ncompressed, const void *
     *nbytes = compsize;
     return 0;
 }
+
+int mcreq_inflated_length(const void *compressed, size_t ncompressed, size_t *nbytes)
+{
+    return snappy::GetUncompressedLength(static_cast<const char *>(compressed), ncompressed, nbytes) ? 0 : -1;
+}
+
+int mcreq_inflate_into(const void *compressed, size_t ncompressed, void *dst)
+{
+    return snappy::RawUncompress(static_cast<const char *>(compressed), ncompressed, static_cast<char *>(dst)) ? 0
+                                                                                                                : -1;
+}
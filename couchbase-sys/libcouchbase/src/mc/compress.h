@@ -30,11 +30,36 @@ extern "C" {
  * @param pkt The packet which hosts the value
  * @param vbuf The user input to be compressed
  * @param settings The instance settings
+ * @param key The key of the document, used to classify the value if
+ * `compress_adaptive` is set
+ * @param nkey The size of the key
+ * @param is_json Whether the value is JSON, also used to classify it
  * @param should_compress The pointer, which stores zero if the value is not compressed
  * @return 0 if successful, nonzero on error.
  */
 int mcreq_compress_value(mc_PIPELINE *pl, mc_PACKET *pkt, const lcb_VALBUF *vbuf, lcb_settings *settings,
-                         int *should_compress);
+                         const char *key, size_t nkey, int is_json, int *should_compress);
+
+/**
+ * @name Adaptive compression
+ *
+ * Values are grouped into classes by datatype and by the prefix of their key
+ * (everything before the first ':', '_', '-', '.' or '/'). Each class keeps a
+ * running average of the ratio snappy achieved on it. Once a class has been
+ * sampled enough, its values are no longer compressed while the average stays
+ * above `compress_min_ratio`, except for every LCB_COMPRESS_RESAMPLE_INTERVAL'th
+ * value, which is compressed anyway so that the class can recover.
+ * @{
+ */
+#define LCB_COMPRESS_NCLASSES 256
+#define LCB_COMPRESS_MIN_SAMPLES 8
+#define LCB_COMPRESS_RESAMPLE_INTERVAL 64
+
+typedef struct lcb_COMPRESSPOLICY_st lcb_COMPRESSPOLICY;
+
+lcb_COMPRESSPOLICY *mcreq_compress_policy_new(void);
+void mcreq_compress_policy_destroy(lcb_COMPRESSPOLICY *policy);
+/**@}*/
 
 /**
  * Inflate a compressed value
@@ -49,6 +74,20 @@ int mcreq_compress_value(mc_PIPELINE *pl, mc_PACKET *pkt, const lcb_VALBUF *vbuf
  */
 int mcreq_inflate_value(const void *compressed, size_t ncompressed, const void **bytes, size_t *nbytes, void **freeptr);
 
+/**
+ * Determine the size of an inflated value, e.g. to provide the buffer for
+ * mcreq_inflate_into()
+ * @return 0 if successful, nonzero if the value is not valid snappy data
+ */
+int mcreq_inflated_length(const void *compressed, size_t ncompressed, size_t *nbytes);
+
+/**
+ * Inflate a compressed value into a buffer of at least the size returned by
+ * mcreq_inflated_length()
+ * @return 0 if successful, nonzero on error.
+ */
+int mcreq_inflate_into(const void *compressed, size_t ncompressed, void *dst);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,89 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2024 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCB_MC_ENCODER_HH
+#define LCB_MC_ENCODER_HH
+
+#include "mcreq.h"
+
+#include <cstdint>
+#include <cstring>
+
+namespace lcb
+{
+namespace mc
+{
+
+/**
+ * Header encoder for requests whose opcode and extras length are known at
+ * compile time.
+ *
+ * The constant part of the header (magic, opcode, extras length, datatype) is
+ * laid out once per instantiation. Encoding a packet patches the per-request
+ * fields into a copy of that prototype, appends the extras and writes the
+ * result into the packet with a single copy.
+ *
+ * Only usable for packets without flexible framing extras; those continue to
+ * go through the generic path in the operation modules.
+ */
+template <std::uint8_t Opcode, std::uint8_t Extlen>
+class RequestEncoder
+{
+  public:
+    static constexpr std::size_t header_size = sizeof(protocol_binary_request_header);
+    static constexpr std::size_t size = header_size + Extlen;
+
+    /**
+     * @param pkt the packet returned by mcreq_basic_packet()
+     * @param hdr the header mapped by mcreq_basic_packet(). It is completed on
+     *  return so that it may still be passed to the tracing probes.
+     * @param nvalue the size of the value already reserved for the packet
+     * @param cas the CAS, in network byte order
+     * @param extras exactly `Extlen` bytes of extras, in network byte order
+     */
+    static void encode(mc_PACKET *pkt, protocol_binary_request_header &hdr, std::uint32_t nvalue, std::uint64_t cas,
+                       const void *extras)
+    {
+        std::uint8_t buf[size];
+        std::memcpy(buf, prototype, header_size);
+        std::memcpy(buf + 2, &hdr.request.keylen, sizeof(hdr.request.keylen));
+        std::memcpy(buf + 6, &hdr.request.vbucket, sizeof(hdr.request.vbucket));
+        std::uint32_t bodylen = htonl(Extlen + ntohs(hdr.request.keylen) + nvalue);
+        std::memcpy(buf + 8, &bodylen, sizeof(bodylen));
+        std::memcpy(buf + 12, &pkt->opaque, sizeof(pkt->opaque));
+        std::memcpy(buf + 16, &cas, sizeof(cas));
+        if (Extlen != 0) {
+            std::memcpy(buf + header_size, extras, Extlen);
+        }
+        std::memcpy(hdr.bytes, buf, header_size);
+        std::memcpy(SPAN_BUFFER(&pkt->kh_span), buf, size);
+    }
+
+  private:
+    static constexpr std::uint8_t prototype[header_size] = {
+        PROTOCOL_BINARY_REQ, Opcode, 0, 0, Extlen, PROTOCOL_BINARY_RAW_BYTES, 0, 0, 0, 0, 0, 0,
+        0,                   0,      0, 0, 0,      0,                         0, 0, 0, 0, 0, 0,
+    };
+};
+
+template <std::uint8_t Opcode, std::uint8_t Extlen>
+constexpr std::uint8_t RequestEncoder<Opcode, Extlen>::prototype[];
+
+} // namespace mc
+} // namespace lcb
+
+#endif
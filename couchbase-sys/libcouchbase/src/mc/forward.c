@@ -108,7 +108,7 @@ lcb_STATUS mc_forward_packet(mc_CMDQUEUE *cq, mc_IOVINFO *info, mc_PACKET **pkt_
         if (srvix < 0 || (unsigned)srvix >= cq->npipelines) {
             return LCB_ERR_NO_MATCHING_SERVER;
         }
-        pl = cq->pipelines[srvix];
+        pl = mcreq_queue_pipeline(cq, srvix, vbid);
         hdr.request.vbucket = htons(vbid);
 
     } else {
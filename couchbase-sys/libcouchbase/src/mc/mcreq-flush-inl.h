@@ -16,6 +16,8 @@
  */
 
 #include "mcreq.h"
+#include "internal.h"
+#include "trace.h"
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -23,6 +25,7 @@ extern "C" {
 typedef struct {
     mc_PIPELINE *pl;
     hrtime_t now;
+    hrtime_t flushed;
 } mc__FLUSHINFO;
 
 /**
@@ -40,7 +43,11 @@ typedef struct {
  */
 static unsigned int mcreq_flush_iov_fill(mc_PIPELINE *pipeline, nb_IOV *iov, int niov, int *nused)
 {
-    return netbuf_start_flush(&pipeline->nbmgr, iov, niov, nused);
+    unsigned int nb = netbuf_start_flush(&pipeline->nbmgr, iov, niov, nused);
+    if (nb == 0 && mcreq_release_held(pipeline)) {
+        nb = netbuf_start_flush(&pipeline->nbmgr, iov, niov, nused);
+    }
+    return nb;
 }
 
 static nb_SIZE mcreq__pktflush_callback(void *p, nb_SIZE hint, void *arg)
@@ -62,6 +69,11 @@ static nb_SIZE mcreq__pktflush_callback(void *p, nb_SIZE hint, void *arg)
     /** Packet is flushed */
     lcb_assert((pkt->flags & MCREQ_F_FLUSHED) == 0);
     pkt->flags |= MCREQ_F_FLUSHED;
+    if (info->flushed) {
+        MCREQ_PKT_RDATA(pkt)->flushed = info->flushed;
+    }
+    TRACE_KV_PACKET_WRITTEN(info->pl->parent->cqdata, info->pl, pkt, pktsize);
+    lcb_flight_record((lcb_INSTANCE *)info->pl->parent->cqdata, LCB_FLIGHT_PKT_WRITTEN, info->pl, pkt, pktsize);
 
     if (pkt->flags & MCREQ_F_INVOKED) {
         mcreq_packet_done(info->pl, pkt);
@@ -83,14 +95,17 @@ static nb_SIZE mcreq__pktflush_callback(void *p, nb_SIZE hint, void *arg)
  *
  * @param now if present, will reset the start time of each traversed packet
  *        to the value passed.
+ * @param flushed if present, recorded as the time each completely written
+ *        packet was flushed at.
  *
  * This is a thin wrapper around netbuf_end_flush (and optionally
  * nebtuf_reset_flush())
  */
-static void mcreq_flush_done_ex(mc_PIPELINE *pl, unsigned nflushed, unsigned expected, lcb_U64 now)
+static void mcreq_flush_done_ex(mc_PIPELINE *pl, unsigned nflushed, unsigned expected, lcb_U64 now,
+                                lcb_U64 flushed)
 {
     if (nflushed) {
-        mc__FLUSHINFO info = {pl, now};
+        mc__FLUSHINFO info = {pl, now, flushed};
         netbuf_end_flush2(&pl->nbmgr, nflushed, mcreq__pktflush_callback, offsetof(mc_PACKET, sl_flushq), &info);
     }
     if (nflushed < expected) {
@@ -101,7 +116,7 @@ static void mcreq_flush_done_ex(mc_PIPELINE *pl, unsigned nflushed, unsigned exp
 /* Mainly for tests */
 static void mcreq_flush_done(mc_PIPELINE *pl, unsigned nflushed, unsigned expected)
 {
-    mcreq_flush_done_ex(pl, nflushed, expected, 0);
+    mcreq_flush_done_ex(pl, nflushed, expected, 0, 0);
 }
 
 #ifdef __cplusplus
@@ -17,8 +17,10 @@
 
 #include "mcreq.h"
 #include "compress.h"
+#include "slab.h"
 #include "sllist-inl.h"
 #include "internal.h"
+#include "trace.h"
 
 #define LOGARGS(pipeline, lvl)                                                                                         \
     ((lcb_INSTANCE *)((pipeline)->parent->cqdata))->settings, "mcreq", LCB_LOG_##lvl, __FILE__, __LINE__
@@ -222,6 +224,114 @@ lcb_STATUS mcreq_reserve_value(mc_PIPELINE *pipeline, mc_PACKET *packet, const l
     return LCB_SUCCESS;
 }
 
+/** Initial size of mc_PIPELINE::byopaque */
+#define MCREQ_INDEX_MINSLOTS 64
+/** Larger indexes are freed once empty, rather than kept for the next burst */
+#define MCREQ_INDEX_KEEPSLOTS 4096
+
+/** Place the packet in the first free slot from the one of its opaque */
+static void index_place(mc_PACKET **slots, uint32_t nslots, mc_PACKET *pkt)
+{
+    uint32_t ii = pkt->opaque & (nslots - 1);
+    while (slots[ii]) {
+        ii = (ii + 1) & (nslots - 1);
+    }
+    slots[ii] = pkt;
+}
+
+static void index_add(mc_PIPELINE *pipeline, mc_PACKET *pkt)
+{
+    /* at least half of the slots stay free, for the probes to stay short */
+    if ((pipeline->nindexed + 1) * 2 > pipeline->nslots) {
+        uint32_t nslots = pipeline->nslots ? pipeline->nslots * 2 : MCREQ_INDEX_MINSLOTS;
+        mc_PACKET **slots = calloc(nslots, sizeof(*slots));
+        if (slots) {
+            for (uint32_t ii = 0; ii < pipeline->nslots; ii++) {
+                if (pipeline->byopaque[ii]) {
+                    index_place(slots, nslots, pipeline->byopaque[ii]);
+                }
+            }
+            free(pipeline->byopaque);
+            pipeline->byopaque = slots;
+            pipeline->nslots = nslots;
+        }
+        lcb_assert(pipeline->nindexed < pipeline->nslots);
+    }
+    index_place(pipeline->byopaque, pipeline->nslots, pkt);
+    pipeline->nindexed++;
+}
+
+static mc_PACKET *index_find(const mc_PIPELINE *pipeline, uint32_t opaque)
+{
+    uint32_t mask = pipeline->nslots - 1;
+    if (pipeline->nslots == 0) {
+        return NULL;
+    }
+    for (uint32_t ii = opaque & mask; pipeline->byopaque[ii]; ii = (ii + 1) & mask) {
+        if (pipeline->byopaque[ii]->opaque == opaque) {
+            return pipeline->byopaque[ii];
+        }
+    }
+    return NULL;
+}
+
+static void index_remove(mc_PIPELINE *pipeline, const mc_PACKET *pkt)
+{
+    mc_PACKET **slots = pipeline->byopaque;
+    uint32_t mask = pipeline->nslots - 1;
+    uint32_t hole = pkt->opaque & mask;
+    while (slots[hole] != pkt) {
+        hole = (hole + 1) & mask;
+    }
+    /* move back the packets after the hole which may not be found past it, so that no tombstone is needed */
+    for (uint32_t ii = (hole + 1) & mask; slots[ii]; ii = (ii + 1) & mask) {
+        uint32_t home = slots[ii]->opaque & mask;
+        if (((ii - home) & mask) >= ((ii - hole) & mask)) {
+            slots[hole] = slots[ii];
+            hole = ii;
+        }
+    }
+    slots[hole] = NULL;
+
+    if (--pipeline->nindexed == 0 && pipeline->nslots > MCREQ_INDEX_KEEPSLOTS) {
+        free(pipeline->byopaque);
+        pipeline->byopaque = NULL;
+        pipeline->nslots = 0;
+    }
+}
+
+/** Append to mc_PIPELINE::requests */
+static void requests_append(mc_PIPELINE *pipeline, mc_PACKET *pkt)
+{
+    sllist_root *reqs = &pipeline->requests;
+    pkt->slprev = SLLIST_IS_EMPTY(reqs) ? &reqs->first_prev : reqs->last;
+    sllist_append(reqs, &pkt->slnode);
+}
+
+/** Unlink the packet at the iterator from mc_PIPELINE::requests. The iteration may go on */
+static void requests_unlink(mc_PIPELINE *pipeline, sllist_iterator *iter)
+{
+    sllist_iter_remove(&pipeline->requests, iter);
+    if (iter->next) {
+        SLLIST_ITEM(iter->next, mc_PACKET, slnode)->slprev = iter->prev;
+    }
+}
+
+static void requests_iter_remove(mc_PIPELINE *pipeline, sllist_iterator *iter)
+{
+    index_remove(pipeline, SLLIST_ITEM(iter->cur, mc_PACKET, slnode));
+    requests_unlink(pipeline, iter);
+}
+
+/** Iterator at the packet, as if the list had been walked up to it */
+static void requests_iter_at(mc_PACKET *pkt, sllist_iterator *iter)
+{
+    iter->cur = &pkt->slnode;
+    iter->prev = pkt->slprev;
+    iter->next = pkt->slnode.next;
+    iter->removed = 0;
+}
+
 static int pkt_tmo_compar(sllist_node *a, sllist_node *b)
 {
     mc_PACKET *pa, *pb;
@@ -245,9 +355,23 @@ static int pkt_tmo_compar(sllist_node *a, sllist_node *b)
 void mcreq_reenqueue_packet(mc_PIPELINE *pipeline, mc_PACKET *packet)
 {
     sllist_root *reqs = &pipeline->requests;
+    sllist_iterator iter;
+
     mcreq_enqueue_packet(pipeline, packet);
-    sllist_remove(reqs, &packet->slnode);
-    sllist_insert_sorted(reqs, &packet->slnode, pkt_tmo_compar);
+    /* the enqueued packet may be a copy with another collection prefix */
+    packet = SLLIST_ITEM(reqs->last, mc_PACKET, slnode);
+    requests_iter_at(packet, &iter);
+    requests_unlink(pipeline, &iter);
+    SLLIST_ITERFOR(reqs, &iter)
+    {
+        if (pkt_tmo_compar(&packet->slnode, iter.cur) <= 0) {
+            sllist_insert(reqs, iter.prev, &packet->slnode);
+            packet->slprev = iter.prev;
+            SLLIST_ITEM(iter.cur, mc_PACKET, slnode)->slprev = &packet->slnode;
+            return;
+        }
+    }
+    requests_append(pipeline, packet);
 }
 
 static mc_PACKET *check_collection_id(mc_PIPELINE *pipeline, mc_PACKET *packet)
@@ -331,15 +455,12 @@ static mc_PACKET *check_collection_id(mc_PIPELINE *pipeline, mc_PACKET *packet)
     return packet;
 }
 
-void mcreq_enqueue_packet(mc_PIPELINE *pipeline, mc_PACKET *packet)
+/* Place the buffers of the packet into the send queue */
+static void pipeline_push(mc_PIPELINE *pipeline, mc_PACKET *packet)
 {
-    packet = check_collection_id(pipeline, packet);
-
     nb_SPAN *vspan = &packet->u_value.single;
-    sllist_append(&pipeline->requests, &packet->slnode);
 
     netbuf_enqueue_span(&pipeline->nbmgr, &packet->kh_span, packet);
-    MC_INCR_METRIC(pipeline, bytes_queued, packet->kh_span.size);
 
     if (!(packet->flags & MCREQ_F_HASVALUE)) {
         goto GT_ENQUEUE_PDU;
@@ -349,24 +470,91 @@ void mcreq_enqueue_packet(mc_PIPELINE *pipeline, mc_PACKET *packet)
         lcb_FRAGBUF *multi = &packet->u_value.multi;
         for (unsigned int ii = 0; ii < multi->niov; ii++) {
             netbuf_enqueue(&pipeline->nbmgr, (nb_IOV *)multi->iov + ii, packet);
-            MC_INCR_METRIC(pipeline, bytes_queued, multi->iov[ii].iov_len);
         }
 
     } else if (vspan->size) {
-        MC_INCR_METRIC(pipeline, bytes_queued, vspan->size);
         netbuf_enqueue_span(&pipeline->nbmgr, vspan, packet);
     }
 
 GT_ENQUEUE_PDU:
     netbuf_pdu_enqueue(&pipeline->nbmgr, packet, offsetof(mc_PACKET, sl_flushq));
+}
+
+/* Whether a held packet targets the same document, which must then wait as well */
+static int held_has_key(mc_PIPELINE *pipeline, const mc_PACKET *packet)
+{
+    const char *key, *hkey;
+    size_t nkey, nhkey;
+    sllist_node *ll;
+
+    mcreq_get_key(packet, &key, &nkey);
+    if (nkey == 0) {
+        return 0;
+    }
+    SLLIST_ITERBASIC(&pipeline->held, ll)
+    {
+        const mc_PACKET *held = SLLIST_ITEM(ll, mc_PACKET, sl_flushq);
+        mcreq_get_key(held, &hkey, &nhkey);
+        if (nhkey == nkey && memcmp(hkey, key, nkey) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void mcreq_enqueue_packet(mc_PIPELINE *pipeline, mc_PACKET *packet)
+{
+    uint32_t size;
+
+    packet = check_collection_id(pipeline, packet);
+    size = mcreq_get_size(packet);
+
+    requests_append(pipeline, packet);
+    index_add(pipeline, packet);
+    lcb_tw_add(&pipeline->timeouts, &packet->twnode, MCREQ_PKT_RDATA(packet)->deadline);
+    pipeline->inflight_bytes += size;
+    pipeline->inflight_ops++;
+    MC_INCR_METRIC(pipeline, bytes_queued, size);
     MC_INCR_METRIC(pipeline, packets_queued, 1);
+    TRACE_KV_ENQUEUE(pipeline->parent->cqdata, pipeline, packet, size);
+    lcb_flight_record((lcb_INSTANCE *)pipeline->parent->cqdata, LCB_FLIGHT_PKT_ENQUEUE, pipeline, packet, size);
+
+    if ((pipeline->large_threshold && size >= pipeline->large_threshold) ||
+        (!SLLIST_IS_EMPTY(&pipeline->held) && held_has_key(pipeline, packet))) {
+        sllist_append(&pipeline->held, &packet->sl_flushq);
+        MC_INCR_METRIC(pipeline, packets_held, 1);
+        MC_INCR_METRIC(pipeline, bytes_held, size);
+        return;
+    }
+    if (!SLLIST_IS_EMPTY(&pipeline->held)) {
+        MC_INCR_METRIC(pipeline, packets_overtaking, 1);
+    }
+    pipeline_push(pipeline, packet);
+}
+
+int mcreq_release_held(mc_PIPELINE *pipeline)
+{
+    mc_PACKET *packet;
+
+    if (SLLIST_IS_EMPTY(&pipeline->held)) {
+        return 0;
+    }
+    packet = SLLIST_ITEM(SLLIST_FIRST(&pipeline->held), mc_PACKET, sl_flushq);
+    sllist_remove_head(&pipeline->held);
+
+    if (pipeline->metrics) {
+        pipeline->metrics->packets_held--;
+        pipeline->metrics->bytes_held -= mcreq_get_size(packet);
+    }
+    pipeline_push(pipeline, packet);
+    return 1;
 }
 
 void mcreq_wipe_packet(mc_PIPELINE *pipeline, mc_PACKET *packet)
 {
     if (!(packet->flags & MCREQ_F_KEY_NOCOPY)) {
         if ((packet->flags & MCREQ_F_DETACHED)) {
-            free(SPAN_BUFFER(&packet->kh_span));
+            mcreq_slab_free(SPAN_BUFFER(&packet->kh_span));
         } else {
             netbuf_mblock_release(&pipeline->nbmgr, &packet->kh_span);
         }
@@ -385,7 +573,7 @@ void mcreq_wipe_packet(mc_PIPELINE *pipeline, mc_PACKET *packet)
     }
 
     if (packet->flags & MCREQ_F_DETACHED) {
-        free(SPAN_BUFFER(&packet->u_value.single));
+        mcreq_slab_free(SPAN_BUFFER(&packet->u_value.single));
     } else {
         netbuf_mblock_release(&pipeline->nbmgr, &packet->u_value.single);
     }
@@ -410,6 +598,8 @@ mc_PACKET *mcreq_allocate_packet(mc_PIPELINE *pipeline)
     ret->opaque = pipeline->parent->seq++;
     ret->u_rdata.reqdata.span = NULL;
     ret->u_rdata.reqdata.deadline = 0;
+    ret->u_rdata.reqdata.flushed = 0;
+    memset(&ret->twnode, 0, sizeof ret->twnode);
     return ret;
 }
 
@@ -426,7 +616,7 @@ void mcreq_release_packet(mc_PIPELINE *pipeline, mc_PACKET *packet)
             sllist_iter_remove(&epkt->data, &iter);
             d->dtorfn(d);
         }
-        free(epkt);
+        mcreq_slab_free(epkt);
         return;
     }
 
@@ -439,17 +629,26 @@ void mcreq_release_packet(mc_PIPELINE *pipeline, mc_PACKET *packet)
 
 #define MCREQ_DETACH_WIPESRC 1
 
-mc_PACKET *mcreq_renew_packet(const mc_PACKET *src)
+mc_PACKET *mcreq_renew_packet(mc_PIPELINE *pipeline, const mc_PACKET *src)
 {
     char *kdata, *vdata;
     unsigned nvdata;
     mc_PACKET *dst;
-    mc_EXPACKET *edst = calloc(1, sizeof(*edst));
+    mc_EXPACKET *edst;
+    mc_SLAB *slab = NULL;
+
+    if (pipeline) {
+        slab = pipeline->slab;
+    } else if (src->flags & MCREQ_F_DETACHED) {
+        slab = mcreq_slab_of(src);
+    }
 
+    edst = mcreq_slab_alloc(slab, sizeof(*edst));
+    memset(edst, 0, sizeof(*edst));
     dst = &edst->base;
     *dst = *src;
 
-    kdata = malloc(src->kh_span.size);
+    kdata = mcreq_slab_alloc(slab, src->kh_span.size + ((src->flags & MCREQ_F_NOCID) ? 0 : MCREQ_CID_SLACK));
     memcpy(kdata, SPAN_BUFFER(&src->kh_span), src->kh_span.size);
     CREATE_STANDALONE_SPAN(&dst->kh_span, kdata, src->kh_span.size);
 
@@ -458,6 +657,8 @@ mc_PACKET *mcreq_renew_packet(const mc_PACKET *src)
     dst->alloc_parent = NULL;
     dst->sl_flushq.next = NULL;
     dst->slnode.next = NULL;
+    dst->slprev = NULL;
+    memset(&dst->twnode, 0, sizeof dst->twnode);
     dst->retries = src->retries;
 
     if (src->flags & MCREQ_F_HASVALUE) {
@@ -466,7 +667,7 @@ mc_PACKET *mcreq_renew_packet(const mc_PACKET *src)
             unsigned offset = 0;
 
             nvdata = src->u_value.multi.total_length;
-            vdata = malloc(nvdata);
+            vdata = mcreq_slab_alloc(slab, nvdata);
             for (unsigned ii = 0; ii < src->u_value.multi.niov; ii++) {
                 const lcb_IOV *iov = src->u_value.multi.iov + ii;
 
@@ -486,20 +687,25 @@ mc_PACKET *mcreq_renew_packet(const mc_PACKET *src)
 
                 lcb_SIZE n_inflated;
                 const void *inflated;
+                void *freeptr = NULL;
                 int rv;
 
-                vdata = NULL;
-                rv =
-                    mcreq_inflate_value(SPAN_BUFFER(origspan), origspan->size, &inflated, &n_inflated, (void **)&vdata);
+                rv = mcreq_inflate_value(SPAN_BUFFER(origspan), origspan->size, &inflated, &n_inflated, &freeptr);
 
-                lcb_assert(vdata == inflated);
+                lcb_assert(freeptr == inflated);
 
                 if (rv != 0) {
                     /* TODO: log error details when snappy will be enabled */
-                    free(edst);
+                    mcreq_slab_free(kdata);
+                    mcreq_slab_free(edst);
                     return NULL;
                 }
+                /* The inflated buffer comes from malloc, move it into the slab so
+                 * the packet's buffers can all be released the same way */
                 nvdata = n_inflated;
+                vdata = mcreq_slab_alloc(slab, nvdata);
+                memcpy(vdata, inflated, nvdata);
+                free(freeptr);
                 hdr.request.datatype &= ~PROTOCOL_BINARY_DATATYPE_COMPRESSED;
                 uint16_t keylen;
                 uint8_t ffext = 0;
@@ -514,12 +720,12 @@ mc_PACKET *mcreq_renew_packet(const mc_PACKET *src)
 
             } else {
                 nvdata = origspan->size;
-                vdata = malloc(nvdata);
+                vdata = mcreq_slab_alloc(slab, nvdata);
                 memcpy(vdata, SPAN_BUFFER(origspan), nvdata);
             }
         }
 
-        /* Declare the value as a standalone malloc'd span */
+        /* Declare the value as a standalone slab allocated span */
         CREATE_STANDALONE_SPAN(&dst->u_value.single, vdata, nvdata);
     }
 
@@ -581,6 +787,17 @@ void mcreq_map_key(mc_CMDQUEUE *queue, const lcb_KEYBUF *key, unsigned nhdr, int
     lcbvb_map_key(queue->config, hk, nhk, vbid, srvix);
 }
 
+mc_PIPELINE *mcreq_queue_pipeline(mc_CMDQUEUE *queue, int srvix, int vbid)
+{
+    if (srvix < 0 || srvix >= (int)queue->npipelines) {
+        return NULL;
+    }
+    if (queue->groupsize > 1) {
+        srvix += (vbid % queue->groupsize) * queue->npipelines;
+    }
+    return queue->pipelines[srvix];
+}
+
 uint16_t mcreq_get_key_size(protocol_binary_request_header *hdr)
 {
     if (hdr->request.magic == PROTOCOL_BINARY_AREQ) {
@@ -605,16 +822,23 @@ lcb_STATUS mcreq_basic_packet(mc_CMDQUEUE *queue, const lcb_KEYBUF *key, uint32_
     }
 
     mcreq_map_key(queue, key, sizeof(*req) + extlen + ffextlen, &vb, &srvix);
-    if (srvix > -1 && srvix < (int)queue->npipelines) {
-        *pipeline = queue->pipelines[srvix];
-
-    } else {
+    *pipeline = mcreq_queue_pipeline(queue, srvix, vb);
+    if (*pipeline == NULL) {
         if ((options & MCREQ_BASICPACKET_F_FALLBACKOK) && queue->fallback) {
             *pipeline = queue->fallback;
         } else {
             return LCB_ERR_NO_MATCHING_SERVER;
         }
     }
+    if (queue->cqdata) {
+        lcb_INSTANCE *instance = (lcb_INSTANCE *)queue->cqdata;
+        if (lcb_kv_overloaded(instance, *pipeline)) {
+            return LCB_ERR_CLIENT_OVERLOADED;
+        }
+        if (lcb_kv_circuit_open(instance, *pipeline)) {
+            return LCB_ERR_CIRCUIT_BREAKER_OPEN;
+        }
+    }
 
     *packet = mcreq_allocate_packet(*pipeline);
     if (*packet == NULL) {
@@ -622,8 +846,13 @@ lcb_STATUS mcreq_basic_packet(mc_CMDQUEUE *queue, const lcb_KEYBUF *key, uint32_
     }
 
     mcreq_reserve_key(*pipeline, *packet, sizeof(*req) + extlen + ffextlen, key, collection_id);
+    if (queue->cqdata && key->type != LCB_KV_VBID) {
+        lcb_hot_keys_record((lcb_INSTANCE *)queue->cqdata, key, sizeof(*req) + extlen + ffextlen, collection_id, vb,
+                            srvix);
+    }
 
     nkey = (*packet)->kh_span.size - PKT_HDRSIZE(*packet);
+    TRACE_KV_MAP_KEY(queue->cqdata, *packet, vb, (*pipeline)->index, nkey);
 
     if (ffextlen) {
         req->request.magic = PROTOCOL_BINARY_AREQ;
@@ -679,8 +908,19 @@ static void mcreq_set_cid_field(mc_PACKET *packet, uint32_t cid)
         req.request.keylen = htons(new_key_length);
     }
 
+    lcb_assert(IS_STANDALONE_SPAN(&old_span));
+    if (old_span.size + diff <= mcreq_slab_capacity(header_and_key)) {
+        // the block has room (see MCREQ_CID_SLACK), move the key behind the new collection id
+        memmove(key + collection_id_length, key + old_collection_id_length, key_length - old_collection_id_length);
+        memcpy(key, collection_id, collection_id_length);
+        memcpy(header_and_key, req.bytes, sizeof(req.bytes));
+        packet->kh_span.size = old_span.size + diff;
+        packet->flags |= MCREQ_F_HASCID;
+        return;
+    }
+
     // copy old header fields, with only collection id updated
-    char *new_header_and_key = malloc(old_span.size + diff);
+    char *new_header_and_key = mcreq_slab_alloc(mcreq_slab_of(header_and_key), old_span.size + diff);
     CREATE_STANDALONE_SPAN(&packet->kh_span, new_header_and_key, old_span.size + diff);
 
     const char *ptr = header_and_key;
@@ -692,8 +932,7 @@ static void mcreq_set_cid_field(mc_PACKET *packet, uint32_t cid)
     memcpy(new_header_and_key + header_size + collection_id_length, ptr, key_length - old_collection_id_length);
 
     // deallocate the old span
-    lcb_assert(IS_STANDALONE_SPAN(&old_span));
-    free(SPAN_BUFFER(&old_span));
+    mcreq_slab_free(SPAN_BUFFER(&old_span));
 
     packet->flags |= MCREQ_F_HASCID;
 }
@@ -701,7 +940,9 @@ static void mcreq_set_cid_field(mc_PACKET *packet, uint32_t cid)
 mc_PACKET *mcreq_set_cid(mc_PIPELINE *pipeline, mc_PACKET *packet, uint32_t cid)
 {
     if ((packet->flags & MCREQ_F_DETACHED) == 0) {
-        mc_PACKET *copy = mcreq_renew_packet(packet);
+        mc_PACKET *copy = mcreq_renew_packet(pipeline, packet);
+        /* the copy owns its buffers, the user's ones are not referenced anymore */
+        mcreq_packet_bufdone(pipeline, packet);
         mcreq_wipe_packet(pipeline, packet);
         mcreq_release_packet(pipeline, packet);
         packet = copy;
@@ -809,8 +1050,14 @@ uint32_t mcreq_get_size(const mc_PACKET *packet)
 
 void mcreq_pipeline_cleanup(mc_PIPELINE *pipeline)
 {
+    free(pipeline->byopaque);
+    pipeline->byopaque = NULL;
+    pipeline->nslots = 0;
     netbuf_cleanup(&pipeline->nbmgr);
     netbuf_cleanup(&pipeline->reqpool);
+    /* Detached packets still in flight keep it alive until they are released */
+    mcreq_slab_unref(pipeline->slab);
+    pipeline->slab = NULL;
 }
 
 int mcreq_pipeline_init(mc_PIPELINE *pipeline)
@@ -819,56 +1066,75 @@ int mcreq_pipeline_init(mc_PIPELINE *pipeline)
 
     /* Initialize all members to 0 */
     memset(&pipeline->requests, 0, sizeof pipeline->requests);
+    pipeline->byopaque = NULL;
+    pipeline->nslots = 0;
+    pipeline->nindexed = 0;
+    lcb_tw_init(&pipeline->timeouts, gethrtime());
     pipeline->parent = NULL;
     pipeline->flush_start = NULL;
     pipeline->index = 0;
+    pipeline->slot = 0;
     memset(&pipeline->ctxqueued, 0, sizeof pipeline->ctxqueued);
+    pipeline->inflight_bytes = 0;
+    pipeline->inflight_ops = 0;
     pipeline->buf_done_callback = NULL;
     pipeline->collections = MCREQ_COLLECTIONS_UNKNOWN;
+    pipeline->large_threshold = 0;
+    memset(&pipeline->held, 0, sizeof pipeline->held);
 
     netbuf_default_settings(&settings);
 
-    /** Initialize datapool */
+    /** Initialize datapool, whose span sizes depend on the workload */
+    settings.data_adaptive = 1;
     netbuf_init(&pipeline->nbmgr, &settings);
 
     /** Initialize request pool */
+    settings.data_adaptive = 0;
     settings.data_basealloc = sizeof(mc_PACKET) * 32;
     netbuf_init(&pipeline->reqpool, &settings);
 
+    pipeline->slab = mcreq_slab_new();
     pipeline->metrics = NULL;
     return 0;
 }
 
 void mcreq_queue_add_pipelines(mc_CMDQUEUE *queue, mc_PIPELINE *const *pipelines, unsigned npipelines,
-                               lcbvb_CONFIG *config)
+                               unsigned groupsize, lcbvb_CONFIG *config)
 {
+    unsigned ntotal = npipelines * groupsize;
+
     lcb_assert(queue->pipelines == NULL);
+    lcb_assert(groupsize > 0);
     queue->npipelines = npipelines;
-    queue->_npipelines_ex = queue->npipelines;
-    queue->pipelines = malloc(sizeof(*pipelines) * (npipelines + 1));
+    queue->groupsize = groupsize;
+    queue->_npipelines_ex = ntotal;
+    queue->pipelines = malloc(sizeof(*pipelines) * (ntotal + 1));
     queue->config = config;
 
-    memcpy(queue->pipelines, pipelines, sizeof(*pipelines) * npipelines);
+    memcpy(queue->pipelines, pipelines, sizeof(*pipelines) * ntotal);
 
     free(queue->scheds);
-    queue->scheds = calloc(npipelines + 1, sizeof(char));
+    queue->scheds = calloc(ntotal + 1, sizeof(char));
 
-    for (unsigned ii = 0; ii < npipelines; ii++) {
+    for (unsigned ii = 0; ii < ntotal; ii++) {
         pipelines[ii]->parent = queue;
-        pipelines[ii]->index = ii;
+        pipelines[ii]->index = ii % npipelines;
+        pipelines[ii]->slot = ii;
     }
 
     if (queue->fallback) {
         queue->fallback->index = npipelines;
-        queue->pipelines[queue->npipelines] = queue->fallback;
+        queue->fallback->slot = ntotal;
+        queue->pipelines[ntotal] = queue->fallback;
         queue->_npipelines_ex++;
     }
 }
 
-mc_PIPELINE **mcreq_queue_take_pipelines(mc_CMDQUEUE *queue, unsigned *count)
+mc_PIPELINE **mcreq_queue_take_pipelines(mc_CMDQUEUE *queue, unsigned *count, unsigned *groupsize)
 {
     mc_PIPELINE **ret = queue->pipelines;
     *count = queue->npipelines;
+    *groupsize = queue->groupsize;
     queue->pipelines = NULL;
     queue->npipelines = 0;
     return ret;
@@ -881,9 +1147,27 @@ int mcreq_queue_init(mc_CMDQUEUE *queue)
     queue->scheds = NULL;
     queue->fallback = NULL;
     queue->npipelines = 0;
+    queue->groupsize = 1;
     return 0;
 }
 
+void mcreq_queue_inflight(const mc_CMDQUEUE *queue, uint64_t *nbytes, uint32_t *nops)
+{
+    unsigned ii;
+    *nbytes = 0;
+    *nops = 0;
+    if (!queue->pipelines) {
+        return;
+    }
+    for (ii = 0; ii < queue->_npipelines_ex; ii++) {
+        const mc_PIPELINE *pipeline = queue->pipelines[ii];
+        if (pipeline) {
+            *nbytes += pipeline->inflight_bytes;
+            *nops += pipeline->inflight_ops;
+        }
+    }
+}
+
 void mcreq_queue_cleanup(mc_CMDQUEUE *queue)
 {
     if (queue->fallback) {
@@ -903,8 +1187,9 @@ void mcreq_sched_enter(mc_CMDQUEUE *queue)
     queue->ctxenter = 1;
 }
 
-static void queuectx_leave(mc_CMDQUEUE *queue, int success, int flush)
+static lcb_SIZE queuectx_leave(mc_CMDQUEUE *queue, int success, int flush)
 {
+    lcb_SIZE nbytes = 0;
     if (queue->ctxenter) {
         queue->ctxenter = 0;
     }
@@ -925,6 +1210,7 @@ static void queuectx_leave(mc_CMDQUEUE *queue, int success, int flush)
             ll_next = ll->next;
 
             if (success) {
+                nbytes += mcreq_get_size(pkt);
                 mcreq_enqueue_packet(pipeline, pkt);
             } else {
                 if (lcbtrace_span_should_finish(MCREQ_PKT_RDATA(pkt)->span)) {
@@ -937,6 +1223,7 @@ static void queuectx_leave(mc_CMDQUEUE *queue, int success, int flush)
                         rd->procs->fail_dtor(pkt);
                     }
                 }
+                mcreq_packet_bufdone(pipeline, pkt);
                 mcreq_wipe_packet(pipeline, pkt);
                 mcreq_release_packet(pipeline, pkt);
             }
@@ -949,6 +1236,7 @@ static void queuectx_leave(mc_CMDQUEUE *queue, int success, int flush)
         }
         queue->scheds[ii] = 0;
     }
+    return nbytes;
 }
 
 void mcreq_sched_leave(mc_CMDQUEUE *queue, int do_flush)
@@ -956,6 +1244,11 @@ void mcreq_sched_leave(mc_CMDQUEUE *queue, int do_flush)
     queuectx_leave(queue, 1, do_flush);
 }
 
+lcb_SIZE mcreq_sched_leave_deferred(mc_CMDQUEUE *queue)
+{
+    return queuectx_leave(queue, 1, 0);
+}
+
 void mcreq_sched_fail(mc_CMDQUEUE *queue)
 {
     queuectx_leave(queue, 0, 0);
@@ -964,32 +1257,50 @@ void mcreq_sched_fail(mc_CMDQUEUE *queue)
 void mcreq_sched_add(mc_PIPELINE *pipeline, mc_PACKET *pkt)
 {
     mc_CMDQUEUE *cq = pipeline->parent;
-    if (MCREQ_PKT_RDATA(pkt)->deadline == 0) {
+    mc_REQDATA *rd = MCREQ_PKT_RDATA(pkt);
+    if (rd->deadline == 0) {
+        /* the deadline is absolute, like the ones set by the operations */
         lcb_INSTANCE *instance = (lcb_INSTANCE *)pipeline->parent->cqdata;
-        MCREQ_PKT_RDATA(pkt)->deadline = instance ? LCBT_SETTING(instance, operation_timeout) : LCB_DEFAULT_TIMEOUT;
+        rd->start = gethrtime();
+        rd->deadline =
+            rd->start + LCB_US2NS(instance ? LCBT_SETTING(instance, operation_timeout) : LCB_DEFAULT_TIMEOUT);
     }
-    lcb_assert(pipeline->index >= 0 && pipeline->index < (int)cq->_npipelines_ex);
-    if (!cq->scheds[pipeline->index]) {
-        cq->scheds[pipeline->index] = 1;
+    lcb_assert(pipeline->slot >= 0 && pipeline->slot < (int)cq->_npipelines_ex);
+    if (!cq->scheds[pipeline->slot]) {
+        cq->scheds[pipeline->slot] = 1;
     }
     sllist_append(&pipeline->ctxqueued, &pkt->slnode);
+    TRACE_KV_SCHEDULE(cq->cqdata, pipeline, pkt);
     mcreq_rearm_timeout(pipeline);
 }
 
+/** Account for a packet which was just removed from mc_PIPELINE::requests */
+static void inflight_remove(mc_PIPELINE *pipeline, const mc_PACKET *packet)
+{
+    uint32_t size;
+    if (SLLIST_IS_EMPTY(&pipeline->requests)) {
+        pipeline->inflight_bytes = 0;
+        pipeline->inflight_ops = 0;
+        return;
+    }
+    size = mcreq_get_size(packet);
+    pipeline->inflight_bytes -= size < pipeline->inflight_bytes ? size : pipeline->inflight_bytes;
+    if (pipeline->inflight_ops) {
+        pipeline->inflight_ops--;
+    }
+}
+
 static mc_PACKET *pipeline_find(mc_PIPELINE *pipeline, lcb_uint32_t opaque, int do_remove)
 {
-    sllist_iterator iter;
-    SLLIST_ITERFOR(&pipeline->requests, &iter)
-    {
-        mc_PACKET *pkt = SLLIST_ITEM(iter.cur, mc_PACKET, slnode);
-        if (pkt->opaque == opaque) {
-            if (do_remove) {
-                sllist_iter_remove(&pipeline->requests, &iter);
-            }
-            return pkt;
-        }
+    mc_PACKET *pkt = index_find(pipeline, opaque);
+    if (pkt && do_remove) {
+        sllist_iterator iter;
+        requests_iter_at(pkt, &iter);
+        requests_iter_remove(pipeline, &iter);
+        lcb_tw_remove(&pkt->twnode);
+        inflight_remove(pipeline, pkt);
     }
-    return NULL;
+    return pkt;
 }
 
 mc_PACKET *mcreq_pipeline_find(mc_PIPELINE *pipeline, lcb_uint32_t opaque)
@@ -1002,32 +1313,37 @@ mc_PACKET *mcreq_pipeline_remove(mc_PIPELINE *pipeline, lcb_uint32_t opaque)
     return pipeline_find(pipeline, opaque, 1);
 }
 
-void mcreq_packet_done(mc_PIPELINE *pipeline, mc_PACKET *pkt)
+void mcreq_packet_bufdone(mc_PIPELINE *pipeline, const mc_PACKET *pkt)
 {
-    lcb_assert(pkt->flags & MCREQ_F_FLUSHED);
-    lcb_assert(pkt->flags & MCREQ_F_INVOKED);
-    if (pkt->flags & MCREQ_UBUF_FLAGS) {
-        void *kbuf, *vbuf;
-        const void *cookie;
+    void *kbuf, *vbuf;
 
-        cookie = MCREQ_PKT_COOKIE(pkt);
-        if (pkt->flags & MCREQ_F_KEY_NOCOPY) {
-            kbuf = SPAN_BUFFER(&pkt->kh_span);
-        } else {
-            kbuf = NULL;
-        }
-        if (pkt->flags & MCREQ_F_VALUE_NOCOPY) {
-            if (pkt->flags & MCREQ_F_VALUE_IOV) {
-                vbuf = pkt->u_value.multi.iov->iov_base;
-            } else {
-                vbuf = SPAN_SABUFFER_NC(&pkt->u_value.single);
-            }
+    if (!(pkt->flags & MCREQ_UBUF_FLAGS) || pipeline->buf_done_callback == NULL) {
+        return;
+    }
+
+    if (pkt->flags & MCREQ_F_KEY_NOCOPY) {
+        kbuf = SPAN_BUFFER(&pkt->kh_span);
+    } else {
+        kbuf = NULL;
+    }
+    if (pkt->flags & MCREQ_F_VALUE_NOCOPY) {
+        if (pkt->flags & MCREQ_F_VALUE_IOV) {
+            vbuf = pkt->u_value.multi.iov->iov_base;
         } else {
-            vbuf = NULL;
+            vbuf = SPAN_SABUFFER_NC(&pkt->u_value.single);
         }
-
-        pipeline->buf_done_callback(pipeline, cookie, kbuf, vbuf);
+    } else {
+        vbuf = NULL;
     }
+
+    pipeline->buf_done_callback(pipeline, MCREQ_PKT_COOKIE(pkt), kbuf, vbuf);
+}
+
+void mcreq_packet_done(mc_PIPELINE *pipeline, mc_PACKET *pkt)
+{
+    lcb_assert(pkt->flags & MCREQ_F_FLUSHED);
+    lcb_assert(pkt->flags & MCREQ_F_INVOKED);
+    mcreq_packet_bufdone(pipeline, pkt);
     mcreq_wipe_packet(pipeline, pkt);
     mcreq_release_packet(pipeline, pkt);
 }
@@ -1041,23 +1357,45 @@ void mcreq_reset_timeouts(mc_PIPELINE *pl, lcb_U64 nstime)
         hrtime_t old_timeout = (MCREQ_PKT_RDATA(pkt)->deadline - MCREQ_PKT_RDATA(pkt)->start);
         MCREQ_PKT_RDATA(pkt)->start = nstime;
         MCREQ_PKT_RDATA(pkt)->deadline = nstime + old_timeout;
+        lcb_tw_remove(&pkt->twnode);
+        lcb_tw_add(&pl->timeouts, &pkt->twnode, MCREQ_PKT_RDATA(pkt)->deadline);
     }
 }
 
 unsigned mcreq_pipeline_timeout(mc_PIPELINE *pl, lcb_STATUS err, mcreq_pktfail_fn failcb, void *cbarg, hrtime_t now)
 {
     sllist_iterator iter;
+    lcb_list_t expired;
     unsigned count = 0;
 
+    if (now && lcb_tw_expire(&pl->timeouts, now, &expired) == 0) {
+        return 0;
+    }
+
     SLLIST_ITERFOR(&pl->requests, &iter)
     {
         mc_PACKET *pkt = SLLIST_ITEM(iter.cur, mc_PACKET, slnode);
         mc_REQDATA *rd = MCREQ_PKT_RDATA(pkt);
         if (now == 0 || rd->deadline <= now) {
-            sllist_iter_remove(&pl->requests, &iter);
+            requests_iter_remove(pl, &iter);
+            lcb_tw_remove(&pkt->twnode);
+            inflight_remove(pl, pkt);
             failcb(pl, pkt, err, cbarg);
             mcreq_packet_handled(pl, pkt);
             count++;
+            /* Packets usually expire in the order they were sent, so stop as
+             * soon as everything the wheel handed out has been failed */
+            if (now && LCB_LIST_IS_EMPTY(&expired)) {
+                break;
+            }
+        }
+    }
+    if (now) {
+        /* The deadline was moved after the packet had been enqueued */
+        lcb_list_t *ll;
+        while ((ll = lcb_list_shift(&expired)) != NULL) {
+            mc_PACKET *pkt = LCB_LIST_ITEM(ll, mc_PACKET, twnode.ll);
+            lcb_tw_add(&pl->timeouts, &pkt->twnode, MCREQ_PKT_RDATA(pkt)->deadline);
         }
     }
     return count;
@@ -1078,7 +1416,9 @@ void mcreq_iterwipe(mc_CMDQUEUE *queue, mc_PIPELINE *src, mcreq_iterwipe_fn call
         mc_PACKET *orig = SLLIST_ITEM(iter.cur, mc_PACKET, slnode);
         rv = callback(queue, src, orig, arg);
         if (rv == MCREQ_REMOVE_PACKET) {
-            sllist_iter_remove(&src->requests, &iter);
+            requests_iter_remove(src, &iter);
+            lcb_tw_remove(&orig->twnode);
+            inflight_remove(src, orig);
         }
     }
 }
@@ -1105,7 +1445,9 @@ static void do_fallback_flush(mc_PIPELINE *pipeline)
     {
         mc_PACKET *pkt = SLLIST_ITEM(iter.cur, mc_PACKET, slnode);
         fpl->handler(pipeline->parent, pkt);
-        sllist_iter_remove(&pipeline->requests, &iter);
+        requests_iter_remove(pipeline, &iter);
+        lcb_tw_remove(&pkt->twnode);
+        inflight_remove(pipeline, pkt);
         mcreq_packet_handled(pipeline, pkt);
     }
 }
@@ -1119,6 +1461,7 @@ void mcreq_set_fallback_handler(mc_CMDQUEUE *cq, mcreq_fallback_cb handler)
     mcreq_pipeline_init(cq->fallback);
     cq->fallback->parent = cq;
     cq->fallback->index = cq->npipelines;
+    cq->fallback->slot = MCREQ_NPIPELINES_ALL(cq);
     ((mc_FALLBACKPL *)cq->fallback)->handler = handler;
     cq->fallback->flush_start = do_fallback_flush;
 }
@@ -1218,4 +1561,5 @@ void mcreq_dump_chain(const mc_PIPELINE *pipeline, FILE *fp, mcreq_payload_dump_
         const mc_PACKET *pkt = SLLIST_ITEM(ll, mc_PACKET, slnode);
         mcreq_dump_packet(pkt, fp, dumpfn);
     }
+    mcreq_slab_dump(pipeline->slab, fp ? fp : stderr);
 }
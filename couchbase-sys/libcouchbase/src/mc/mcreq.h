@@ -25,6 +25,7 @@
 #include "netbuf/netbuf.h"
 #include "sllist.h"
 #include "config.h"
+#include "timerwheel.h"
 #include "packetutils.h"
 
 #ifdef __cplusplus
@@ -150,6 +151,12 @@ typedef struct mc_REQDATA {
      * Used for metrics/tracing. Might be zero, when tracing is not enabled.
      */
     hrtime_t dispatch;
+    /**
+     * Time when the packet was completely written to the socket. Only recorded
+     * while latencies are broken down (see METRICS_KV_BREAKDOWN_ENABLED),
+     * zero otherwise.
+     */
+    hrtime_t flushed;
     lcbtrace_SPAN *span;
     uint32_t nsubreq; /* number of subrequests */
 } mc_REQDATA;
@@ -196,13 +203,14 @@ typedef struct mc_REQDATAEX {
      * Used for metrics/tracing. Might be zero, when tracing is not enabled.
      */
     hrtime_t dispatch;
+    hrtime_t flushed; /**< Time when the packet was completely written, see mc_REQDATA */
     lcbtrace_SPAN *span;
     uint32_t nsubreq;             /* number of subrequests */
     const mc_REQDATAPROCS *procs; /**< Common routines for the packet */
 
 #ifdef __cplusplus
     mc_REQDATAEX(void *cookie_, const mc_REQDATAPROCS &procs_, hrtime_t start_)
-        : cookie(cookie_), start(start_), dispatch(0), span(NULL), nsubreq(0), procs(&procs_)
+        : cookie(cookie_), start(start_), dispatch(0), flushed(0), span(NULL), nsubreq(0), procs(&procs_)
     {
         deadline = start_ + LCB_DEFAULT_TIMEOUT;
     }
@@ -301,6 +309,17 @@ typedef enum {
      * collection id is prepended to the key
      */
     MCREQ_F_HASCID = 1u << 12u,
+
+    /**
+     * The reply is remembered by the near cache, see lcb_cmdget_near_cache()
+     */
+    MCREQ_F_NEARCACHE = 1u << 13u,
+
+    /**
+     * The value of the reply is passed to the value sink as it is read, see
+     * lcb_cmdget_stream_value()
+     */
+    MCREQ_F_STREAMVALUE = 1u << 14u,
 } mcreq_flags;
 
 typedef enum {
@@ -344,6 +363,9 @@ typedef struct mc_packet_st {
     /** Node in the linked list for logical command ordering */
     sllist_node slnode;
 
+    /** Node before slnode while in mc_PIPELINE#requests, so that the packet is unlinked without a walk */
+    sllist_node *slprev;
+
     /**
      * Node in the linked list for actual output ordering.
      * @see netbuf_end_flush2(), netbuf_pdu_enqueue()
@@ -373,6 +395,9 @@ typedef struct mc_packet_st {
 
     /** Allocation data for the PACKET structure itself */
     nb_MBLOCK *alloc_parent;
+
+    /** Node in mc_PIPELINE#timeouts, linked while the packet is in `requests` */
+    lcb_TWNODE twnode;
 } mc_PACKET;
 
 /**
@@ -406,6 +431,23 @@ typedef struct mc_pipeline_st {
     /** List of requests. Newer requests are appended at the end */
     sllist_root requests;
 
+    /** Deadlines of the packets in `requests`, see mcreq_pipeline_timeout() */
+    lcb_TIMERWHEEL timeouts;
+
+    /**
+     * Packets of `requests` by opaque, for the replies which arrive out of
+     * order. Open addressing starting at the opaque modulo `nslots`: as the
+     * opaques are handed out in sequence, the packets in flight mostly take
+     * consecutive slots.
+     */
+    struct mc_packet_st **byopaque;
+
+    /** Size of `byopaque`, a power of two, 0 until the first packet */
+    uint32_t nslots;
+
+    /** Number of packets in `byopaque` */
+    uint32_t nindexed;
+
     /** Parent command queue */
     struct mc_cmdqueue_st *parent;
 
@@ -418,6 +460,13 @@ typedef struct mc_pipeline_st {
     /** Index of this server within the configuration map */
     int index;
 
+    /**
+     * Position of this pipeline within mc_CMDQUEUE::pipelines. This is the
+     * same as `index` unless the pipeline is an additional member of a
+     * group (see mc_CMDQUEUE::groupsize) or the fallback pipeline
+     */
+    int slot;
+
     /**
      * Intermediate queue where pending packets are placed. Moved to
      * the `requests` list when mcreq_sched_leave() is called
@@ -436,18 +485,46 @@ typedef struct mc_pipeline_st {
     /** Allocator for packet structures */
     nb_MGR reqpool;
 
+    /** Allocator for detached packets and their buffers, see mcreq_renew_packet() */
+    struct mc_slab_st *slab;
+
     mcreq_collections_support collections;
 
     /** Optional metrics structure for server */
     struct lcb_SERVERMETRICS_st *metrics;
+
+    /**
+     * Packets of at least this many bytes are only placed in the send queue
+     * once everything before them has been flushed, so that smaller packets
+     * scheduled meanwhile are sent first. Zero keeps the packets in order; it
+     * must stay zero unless the server executes requests out of order.
+     */
+    uint32_t large_threshold;
+
+    /**
+     * Large packets waiting for the send queue (see large_threshold), linked
+     * through mc_PACKET::sl_flushq. They are already part of `requests`
+     */
+    sllist_root held;
+
+    /** Total size of the packets in `requests`, see mcreq_queue_inflight() */
+    uint64_t inflight_bytes;
+
+    /** Number of packets in `requests` */
+    uint32_t inflight_ops;
 } mc_PIPELINE;
 
 typedef struct mc_cmdqueue_st {
-    /** Indexed pipelines, i.e. server map target */
+    /**
+     * Indexed pipelines, i.e. server map target. The first `npipelines`
+     * entries are the primary pipelines of each server, followed by the
+     * additional members of each group (member `m` of server `ix` is at
+     * `m * npipelines + ix`) and finally by the fallback pipeline
+     */
     mc_PIPELINE **pipelines;
 
     /**
-     * Small array of size npipelines, for mcreq_sched_enter()/mcreq_sched_leave()
+     * Small array of size _npipelines_ex, for mcreq_sched_enter()/mcreq_sched_leave()
      * stuff. See those functions for usage
      */
     char *scheds;
@@ -457,10 +534,17 @@ typedef struct mc_cmdqueue_st {
      */
     unsigned ctxenter;
 
-    /** Number of pipelines in the queue */
+    /** Number of pipelines in the queue, i.e. the number of servers */
     unsigned npipelines;
 
-    /** Number of pipelines, with fallback included */
+    /**
+     * Number of pipelines (connections) for each server. Keyed packets are
+     * spread across the members of a group by their vBucket, so that the
+     * ordering of the operations on a key is preserved.
+     */
+    unsigned groupsize;
+
+    /** Number of pipelines, with group members and fallback included */
     unsigned _npipelines_ex;
 
     /** Sequence number for pipeline. Incremented for each new packet */
@@ -523,10 +607,14 @@ typedef struct mc_epkt_datum {
 
 /**
  * Detatches the packet src belonging to the given pipeline. A detached
- * packet has all its data allocated via malloc and does not belong to
- * any particular buffer. This is typically used for relocation or retries
- * where it is impractical to affect the in-order netbuf allocator.
+ * packet has all its data allocated from the pipeline's slab (see @ref mcslab)
+ * and does not belong to any particular buffer. This is typically used for
+ * relocation or retries where it is impractical to affect the in-order netbuf
+ * allocator.
  *
+ * @param pipeline the pipeline whose slab should be used for the copy. If
+ *  NULL, a detached `src` is copied into the slab it has been allocated from
+ *  and any other packet is allocated directly.
  * @param src the source packet to copy
  * @return a new packet structure. You should still clear the packet's data
  * with wipe_packet/release_packet but you may pass NULL as the pipeline
@@ -547,7 +635,7 @@ typedef struct mc_epkt_datum {
  * "state flags" which indicate if a packet has been flushed and/or handled. If
  * calling this function to retry a packet, ensure to clear these state flags.
  */
-mc_PACKET *mcreq_renew_packet(const mc_PACKET *src);
+mc_PACKET *mcreq_renew_packet(mc_PIPELINE *pipeline, const mc_PACKET *src);
 
 /**
  * Associates a datum with the packet. The packet must be a standalone packet,
@@ -619,6 +707,15 @@ lcb_STATUS mcreq_reserve_value2(mc_PIPELINE *pipeline, mc_PACKET *packet, lcb_si
  */
 void mcreq_enqueue_packet(mc_PIPELINE *pipeline, mc_PACKET *packet);
 
+/**
+ * Move the oldest packet held back by mc_PIPELINE::large_threshold into the
+ * send queue. This is called by mcreq_flush_iov_fill() once everything else
+ * has been flushed.
+ * @param pipeline the pipeline
+ * @return nonzero if a packet was moved
+ */
+int mcreq_release_held(mc_PIPELINE *pipeline);
+
 /**
  * Like enqueue packet, except it will also inspect the packet's timeout field
  * and if necessary, restructure the command inside the request list so that
@@ -651,6 +748,21 @@ void mcreq_wipe_packet(mc_PIPELINE *pipeline, mc_PACKET *packet);
  */
 void mcreq_map_key(mc_CMDQUEUE *queue, const lcb_KEYBUF *key, unsigned nhdr, int *vbid, int *srvix);
 
+/**
+ * Get the pipeline which carries a vBucket on a given server. When servers
+ * have more than one pipeline (see mc_CMDQUEUE::groupsize) the member is
+ * selected by the vBucket, so that all the packets of a key use the same
+ * connection.
+ * @param queue The command queue
+ * @param srvix The index of the server, as returned by mcreq_map_key()
+ * @param vbid The vBucket of the packet
+ * @return the pipeline, or NULL if the server index is not valid
+ */
+mc_PIPELINE *mcreq_queue_pipeline(mc_CMDQUEUE *queue, int srvix, int vbid);
+
+/** Total number of server pipelines in the queue, group members included */
+#define MCREQ_NPIPELINES_ALL(queue) ((queue)->npipelines * (queue)->groupsize)
+
 /**If the packet's vbucket does not have a master node, use the fallback pipeline
  * and let it be handled by the handler installed via mcreq_set_fallback_handler()
  */
@@ -705,6 +817,17 @@ uint32_t mcreq_get_size(const mc_PACKET *packet);
 
 uint32_t mcreq_get_cid(lcb_INSTANCE *instance, const mc_PACKET *packet, int *cid_set);
 
+/**
+ * Room for the longest LEB128 encoded collection ID, added to the header and
+ * key of packets copied by mcreq_renew_packet() so that mcreq_set_cid() can
+ * rewrite the ID of a detached packet in place.
+ */
+#define MCREQ_CID_SLACK 5
+
+/**
+ * Set the collection ID of a packet, detaching it first if needed.
+ * @return the packet to use from now on
+ */
 mc_PACKET *mcreq_set_cid(mc_PIPELINE *pipeline, mc_PACKET *packet, uint32_t cid);
 
 /**
@@ -725,25 +848,38 @@ void mcreq_pipeline_cleanup(mc_PIPELINE *pipeline);
 /**
  * Set the pipelines that this queue will manage
  * @param queue the queue to take the pipelines
- * @param pipelines an array of pipeline pointers. The array is copied
- * @param npipelines number of pipelines in the queue
+ * @param pipelines an array of `npipelines * groupsize` pipeline pointers,
+ *        laid out as mc_CMDQUEUE::pipelines. The array is copied
+ * @param npipelines number of servers in the queue
+ * @param groupsize number of pipelines for each server
  * @param config the configuration handle. The configuration is _not_ owned
  *        and _not_ copied and the caller must ensure it remains valid
  *        until it is replaces.
  */
 void mcreq_queue_add_pipelines(mc_CMDQUEUE *queue, mc_PIPELINE *const *pipelines, unsigned npipelines,
-                               lcbvb_CONFIG *config);
+                               unsigned groupsize, lcbvb_CONFIG *config);
 
 /**
  * Set the arra
  * @param queue the queue
- * @param count a pointer to the number of pipelines within the queue
- * @return the pipeline array.
+ * @param count a pointer to the number of servers within the queue
+ * @param groupsize a pointer to the number of pipelines for each server
+ * @return the pipeline array, of `count * groupsize` entries.
  *
  * When this function completes another call to add_pipelines must be performed
  * in order for the queue to function properly.
  */
-mc_PIPELINE **mcreq_queue_take_pipelines(mc_CMDQUEUE *queue, unsigned *count);
+mc_PIPELINE **mcreq_queue_take_pipelines(mc_CMDQUEUE *queue, unsigned *count, unsigned *groupsize);
+
+/**
+ * Sum the packets which are in flight on the pipelines of the queue, i.e.
+ * enqueued and not yet handled. Packets of pipelines no longer part of the
+ * queue are not counted.
+ * @param queue the queue
+ * @param[out] nbytes the total size of the packets
+ * @param[out] nops the number of packets
+ */
+void mcreq_queue_inflight(const mc_CMDQUEUE *queue, uint64_t *nbytes, uint32_t *nops);
 
 int mcreq_queue_init(mc_CMDQUEUE *queue);
 
@@ -777,6 +913,19 @@ void mcreq_sched_enter(struct mc_cmdqueue_st *queue);
  */
 void mcreq_sched_leave(struct mc_cmdqueue_st *queue, int do_flush);
 
+/**
+ * @brief successfully exit a scheduling scope without flushing
+ *
+ * Like mcreq_sched_leave(), for callers which flush the pipelines themselves
+ * at a later point, e.g. once for everything scheduled during an iteration of
+ * the event loop.
+ *
+ * @param queue
+ * @return the number of bytes placed in the pipelines' output queues
+ * @volatile
+ */
+lcb_SIZE mcreq_sched_leave_deferred(struct mc_cmdqueue_st *queue);
+
 /**
  * @brief destroy all operations within the scheduling scope
  * All operations enqueued since the last call to mcreq_sched_enter() will
@@ -786,7 +935,8 @@ void mcreq_sched_leave(struct mc_cmdqueue_st *queue, int do_flush);
 void mcreq_sched_fail(struct mc_cmdqueue_st *queue);
 
 /**
- * Find a packet with the given opaque value
+ * Find a packet with the given opaque value. Takes constant time, whatever
+ * the order of the replies.
  */
 mc_PACKET *mcreq_pipeline_find(mc_PIPELINE *pipeline, uint32_t opaque);
 
@@ -847,6 +997,15 @@ void mcreq_iterwipe(mc_CMDQUEUE *queue, mc_PIPELINE *src, mcreq_iterwipe_fn call
  */
 void mcreq_packet_done(mc_PIPELINE *pipeline, mc_PACKET *pkt);
 
+/**
+ * Invoke the pipeline's buf_done_callback if the packet references any user
+ * allocated buffers. This is done by mcreq_packet_done(), and must be done
+ * explicitly whenever such a packet is released (or copied) in another way.
+ * @param pipeline the pipeline
+ * @param pkt the packet whose buffers are not needed anymore
+ */
+void mcreq_packet_bufdone(mc_PIPELINE *pipeline, const mc_PACKET *pkt);
+
 /**
  * @brief Indicate that the packet was handled
  * @param pipeline the pipeline
@@ -901,7 +1060,9 @@ unsigned mcreq_pipeline_fail(mc_PIPELINE *pipeline, lcb_STATUS err, mcreq_pktfai
 /**
  * Fail out all commands in the pipeline which are older than a specified
  * interval. This is similar to the pipeline_fail() function except that commands
- * which are newer than the threshold are still kept
+ * which are newer than the threshold are still kept. The expired packets are
+ * found through mc_PIPELINE#timeouts, so the pipeline is only scanned when
+ * some packets have actually expired.
  *
  * @param pipeline the pipeline to fail out
  * @param err the error to provide to the handlers (usually LCB_ERR_TIMEOUT)
@@ -953,6 +1114,13 @@ typedef void (*mcreq_payload_dump_fn)(const void *data, unsigned size, FILE *fp)
  */
 void mcreq_dump_packet(const mc_PACKET *pkt, FILE *fp, mcreq_payload_dump_fn dumpfn);
 
+/**
+ * Dumps all packets of the pipeline, followed by the counters of its slab
+ * @param pipeline the pipeline to dump
+ * @param fp The file to write to
+ * @param dumpfn If specified, this function is called to handle the packets'
+ *  header and payload body
+ */
 void mcreq_dump_chain(const mc_PIPELINE *pipeline, FILE *fp, mcreq_payload_dump_fn dumpfn);
 
 #define mcreq_write_hdr(pkt, hdr) memcpy(SPAN_BUFFER(&(pkt)->kh_span), (hdr)->bytes, sizeof((hdr)->bytes))
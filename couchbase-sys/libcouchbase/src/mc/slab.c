@@ -0,0 +1,188 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2020 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include "slab.h"
+#include <stdlib.h>
+#include <libcouchbase/assert.h>
+
+/** Header preceding every block; a union to keep the payload aligned */
+typedef union {
+    struct {
+        mc_SLAB *slab;
+        /** Size class, MCREQ_SLAB_NCLASSES for oversized blocks */
+        size_t cls;
+    } h;
+    double align_;
+} mc_SLABHDR;
+
+typedef struct mc_slabfree_st {
+    struct mc_slabfree_st *next;
+} mc_SLABFREE;
+
+struct mc_slab_st {
+    /** One reference for the owner, and one for each outstanding block */
+    unsigned refcount;
+    /** Set once the owner released the slab; blocks are no longer cached */
+    int closed;
+    mc_SLABFREE *freelist[MCREQ_SLAB_NCLASSES];
+    mc_SLABSTATS stats;
+};
+
+#define HDR_OF(ptr) (((mc_SLABHDR *)(ptr)) - 1)
+#define CLASS_SIZE(cls) ((size_t)MCREQ_SLAB_MINSIZE << (cls))
+
+static size_t size_class(size_t size)
+{
+    size_t cls = 0;
+    while (cls < MCREQ_SLAB_NCLASSES && CLASS_SIZE(cls) < size) {
+        cls++;
+    }
+    return cls;
+}
+
+static void clear_freelists(mc_SLAB *slab)
+{
+    for (size_t ii = 0; ii < MCREQ_SLAB_NCLASSES; ii++) {
+        mc_SLABFREE *cur = slab->freelist[ii];
+        while (cur) {
+            mc_SLABFREE *next = cur->next;
+            free(HDR_OF(cur));
+            cur = next;
+        }
+        slab->freelist[ii] = NULL;
+    }
+    slab->stats.cached_bytes = 0;
+}
+
+static void slab_decref(mc_SLAB *slab)
+{
+    lcb_assert(slab->refcount > 0);
+    if (--slab->refcount == 0) {
+        clear_freelists(slab);
+        free(slab);
+    }
+}
+
+mc_SLAB *mcreq_slab_new(void)
+{
+    mc_SLAB *slab = calloc(1, sizeof(*slab));
+    if (slab) {
+        slab->refcount = 1;
+    }
+    return slab;
+}
+
+void mcreq_slab_unref(mc_SLAB *slab)
+{
+    if (slab == NULL) {
+        return;
+    }
+    lcb_assert(!slab->closed);
+    slab->closed = 1;
+    clear_freelists(slab);
+    slab_decref(slab);
+}
+
+void *mcreq_slab_alloc(mc_SLAB *slab, size_t size)
+{
+    mc_SLABHDR *hdr;
+    size_t cls = size_class(size);
+
+    if (slab && cls < MCREQ_SLAB_NCLASSES && slab->freelist[cls]) {
+        mc_SLABFREE *blk = slab->freelist[cls];
+        slab->freelist[cls] = blk->next;
+        slab->stats.cached_bytes -= CLASS_SIZE(cls);
+        slab->stats.reused++;
+        hdr = HDR_OF(blk);
+    } else {
+        hdr = malloc(sizeof(*hdr) + (cls < MCREQ_SLAB_NCLASSES ? CLASS_SIZE(cls) : size));
+        if (hdr == NULL) {
+            return NULL;
+        }
+        hdr->h.slab = slab;
+        hdr->h.cls = cls;
+        if (slab && cls == MCREQ_SLAB_NCLASSES) {
+            slab->stats.oversized++;
+        }
+    }
+
+    if (slab) {
+        slab->refcount++;
+        slab->stats.allocs++;
+        slab->stats.outstanding++;
+    }
+    return hdr + 1;
+}
+
+void mcreq_slab_free(void *ptr)
+{
+    mc_SLABHDR *hdr;
+    mc_SLAB *slab;
+
+    if (ptr == NULL) {
+        return;
+    }
+    hdr = HDR_OF(ptr);
+    slab = hdr->h.slab;
+    if (slab == NULL) {
+        free(hdr);
+        return;
+    }
+
+    slab->stats.frees++;
+    slab->stats.outstanding--;
+    if (!slab->closed && hdr->h.cls < MCREQ_SLAB_NCLASSES &&
+        slab->stats.cached_bytes + CLASS_SIZE(hdr->h.cls) <= MCREQ_SLAB_MAXCACHE) {
+        mc_SLABFREE *blk = ptr;
+        blk->next = slab->freelist[hdr->h.cls];
+        slab->freelist[hdr->h.cls] = blk;
+        slab->stats.cached_bytes += CLASS_SIZE(hdr->h.cls);
+    } else {
+        free(hdr);
+    }
+    slab_decref(slab);
+}
+
+mc_SLAB *mcreq_slab_of(const void *ptr)
+{
+    return HDR_OF(ptr)->h.slab;
+}
+
+size_t mcreq_slab_capacity(const void *ptr)
+{
+    size_t cls = HDR_OF(ptr)->h.cls;
+    return cls < MCREQ_SLAB_NCLASSES ? CLASS_SIZE(cls) : 0;
+}
+
+const mc_SLABSTATS *mcreq_slab_stats(const mc_SLAB *slab)
+{
+    return &slab->stats;
+}
+
+void mcreq_slab_dump(const mc_SLAB *slab, FILE *fp)
+{
+    if (slab == NULL) {
+        return;
+    }
+    fprintf(fp, "Slab @%p\n", (void *)slab);
+    fprintf(fp, "  Allocations: %lu (reused=%lu, oversized=%lu)\n", slab->stats.allocs, slab->stats.reused,
+            slab->stats.oversized);
+    fprintf(fp, "  Frees: %lu\n", slab->stats.frees);
+    fprintf(fp, "  Outstanding: %lu\n", slab->stats.outstanding);
+    fprintf(fp, "  Cached: %lu bytes\n", (unsigned long)slab->stats.cached_bytes);
+}
@@ -0,0 +1,142 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2020 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCB_MCSLAB_H
+#define LCB_MCSLAB_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file
+ * @brief Size-classed freelist allocator for detached packets
+ *
+ * @defgroup mcslab Detached Packet Slabs
+ * @addtogroup mcslab
+ * @{
+ *
+ * Detached packets (see mcreq_renew_packet()) and the key and value buffers
+ * copied for them are allocated outside of the pipeline's netbuf pools, since
+ * they may outlive the pipeline and are usually freed in a different order
+ * than they were allocated. Retries (e.g. on NOT_MY_VBUCKET during a rebalance)
+ * allocate and free those at a high rate, so each pipeline keeps freelists of
+ * recently released blocks, bucketed into power-of-two size classes.
+ *
+ * Every block carries a small header pointing to the slab it was allocated
+ * from, so it can be released without knowing its pipeline. The slab is
+ * reference counted by its owner and by every outstanding block, and therefore
+ * stays valid until the last block allocated from it has been released, even
+ * if the pipeline itself is already gone.
+ */
+
+/** Size of the smallest size class */
+#define MCREQ_SLAB_MINSIZE 64
+
+/** Number of size classes, each one twice as large as the previous one */
+#define MCREQ_SLAB_NCLASSES 10
+
+/** Blocks larger than the largest class are allocated (and freed) directly */
+#define MCREQ_SLAB_MAXSIZE (MCREQ_SLAB_MINSIZE << (MCREQ_SLAB_NCLASSES - 1))
+
+/** Maximum number of bytes kept on the freelists of a single slab */
+#define MCREQ_SLAB_MAXCACHE (256 * 1024)
+
+typedef struct {
+    /** Number of blocks handed out */
+    unsigned long allocs;
+    /** Number of those served from a freelist */
+    unsigned long reused;
+    /** Number of those larger than the largest class */
+    unsigned long oversized;
+    /** Number of blocks released */
+    unsigned long frees;
+    /** Number of blocks currently allocated */
+    unsigned long outstanding;
+    /** Number of bytes kept on the freelists */
+    size_t cached_bytes;
+} mc_SLABSTATS;
+
+typedef struct mc_slab_st mc_SLAB;
+
+/**
+ * Create a new slab, owned by the caller.
+ * @return the slab, or NULL if out of memory
+ */
+mc_SLAB *mcreq_slab_new(void);
+
+/**
+ * Release the owner's reference to the slab. The freelists are freed right
+ * away, the slab itself once the last outstanding block has been released.
+ * @param slab the slab, may be NULL
+ */
+void mcreq_slab_unref(mc_SLAB *slab);
+
+/**
+ * Allocate a block of at least `size` bytes.
+ * @param slab the slab to allocate from. If NULL, the block is allocated
+ *  directly, but can still be released with mcreq_slab_free()
+ * @param size the number of bytes needed
+ * @return the block, or NULL if out of memory
+ */
+void *mcreq_slab_alloc(mc_SLAB *slab, size_t size);
+
+/**
+ * Release a block allocated with mcreq_slab_alloc().
+ * @param ptr the block, may be NULL
+ */
+void mcreq_slab_free(void *ptr);
+
+/**
+ * Get the slab a block has been allocated from
+ * @param ptr the block
+ * @return the slab, or NULL if it has been allocated directly
+ */
+mc_SLAB *mcreq_slab_of(const void *ptr);
+
+/**
+ * Get the number of bytes a block can hold, which may be more than requested
+ * as blocks are rounded up to their size class
+ * @param ptr the block
+ * @return the capacity, or 0 if it is not known (blocks larger than
+ *  MCREQ_SLAB_MAXSIZE)
+ */
+size_t mcreq_slab_capacity(const void *ptr);
+
+/**
+ * Get the counters of a slab
+ * @param slab the slab
+ * @return the counters
+ */
+const mc_SLABSTATS *mcreq_slab_stats(const mc_SLAB *slab);
+
+/**
+ * Print the counters of a slab
+ * @param slab the slab, may be NULL
+ * @param fp the file to print to
+ */
+void mcreq_slab_dump(const mc_SLAB *slab, FILE *fp);
+
+/**@}*/
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* LCB_MCSLAB_H */
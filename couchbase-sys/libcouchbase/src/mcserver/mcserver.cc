@@ -24,6 +24,7 @@
 #include "negotiate.h"
 #include "bucketconfig/clconfig.h"
 #include "mc/mcreq-flush-inl.h"
+#include "trace.h"
 #include <lcbio/ssl.h>
 #include <include/memcached/protocol_binary.h>
 #include "ctx-log-inl.h"
@@ -62,6 +63,7 @@ static void on_flush_ready(lcbio_CTX *ctx)
         if (!nb) {
             return;
         }
+        TRACE_KV_FLUSH_START(server->instance, server, nb);
 #ifdef LCB_DUMP_PACKETS
         {
             char *b64 = nullptr;
@@ -80,14 +82,19 @@ static void on_flush_done(lcbio_CTX *ctx, unsigned expected, unsigned actual)
 {
     Server *server = Server::get(ctx);
     lcb_U64 now = 0;
+    lcb_U64 flushed = 0;
     if (server->settings->readj_ts_wait) {
-        now = gethrtime();
+        now = lcb_settings_now(server->settings);
+    }
+    if (METRICS_KV_BREAKDOWN_ENABLED(server->settings)) {
+        flushed = now ? now : lcb_settings_now(server->settings);
     }
 
 #ifdef LCB_DUMP_PACKETS
     lcb_log(LOGARGS(server, TRACE), LOGFMT "pkt,snd,flush: expected=%u, actual=%u", LOGID(server), expected, actual);
 #endif
-    mcreq_flush_done_ex(server, actual, expected, now);
+    TRACE_KV_FLUSH_DONE(server->instance, server, expected, actual);
+    mcreq_flush_done_ex(server, actual, expected, now, flushed);
     server->check_closed();
 }
 
@@ -113,7 +120,7 @@ void Server::flush()
 LIBCOUCHBASE_API
 void lcb_sched_flush(lcb_INSTANCE *instance)
 {
-    for (size_t ii = 0; ii < LCBT_NSERVERS(instance); ii++) {
+    for (size_t ii = 0; ii < MCREQ_NPIPELINES_ALL(&instance->cmdq); ii++) {
         Server *server = instance->get_server(ii);
 
         if (!server->has_pending()) {
@@ -142,6 +149,10 @@ bool Server::handle_nmv(MemcachedResponse &resinfo, mc_PACKET *oldpkt)
 
     mcreq_read_hdr(oldpkt, &hdr);
     vbid = ntohs(hdr.request.vbucket);
+    lcb_VBUCKETMETRICS *vbm = lcb_metrics_packet_vbucket(settings, oldpkt);
+    if (vbm) {
+        vbm->nmv++;
+    }
     lcb_log(LOGARGS_T(WARN), LOGFMT "NOT_MY_VBUCKET. Packet=%p (S=%u). VBID=%u, has_config=%s", LOGID_T(),
             (void *)oldpkt, oldpkt->opaque, vbid, resinfo.vallen() ? "yes" : "no");
 
@@ -178,9 +189,9 @@ bool Server::handle_nmv(MemcachedResponse &resinfo, mc_PACKET *oldpkt)
     }
 
     /** Reschedule the packet again .. */
-    mc_PACKET *newpkt = mcreq_renew_packet(oldpkt);
+    mc_PACKET *newpkt = mcreq_renew_packet(this, oldpkt);
     newpkt->flags &= ~MCREQ_STATE_FLAGS;
-    instance->retryq->nmvadd((mc_EXPACKET *)newpkt);
+    instance->retryq->nmvadd((mc_EXPACKET *)newpkt, *curhost);
     return true;
 }
 
@@ -267,7 +278,7 @@ bool Server::handle_unknown_collection(MemcachedResponse &resp, mc_PACKET *oldpk
     }
 
     if (req.request.opcode == PROTOCOL_BINARY_CMD_COLLECTIONS_GET_CID) {
-        mc_PACKET *newpkt = mcreq_renew_packet(oldpkt);
+        mc_PACKET *newpkt = mcreq_renew_packet(this, oldpkt);
         newpkt->flags &= ~MCREQ_STATE_FLAGS;
         instance->retryq->ucadd((mc_EXPACKET *)newpkt, LCB_ERR_TIMEOUT, orig_status);
         return true;
@@ -282,13 +293,41 @@ bool Server::handle_unknown_collection(MemcachedResponse &resp, mc_PACKET *oldpk
                 "UNKNOWN_COLLECTION. Packet=%p (M=0x%x, S=%u, OP=0x%x), CID=%u, collections=%d (set=%d). Retrying",
                 LOGID_T(), (void *)oldpkt, (int)req.request.magic, oldpkt->opaque, (int)req.request.opcode,
                 (unsigned)cid, (int)collections, cid_set);
-        mc_PACKET *newpkt = mcreq_renew_packet(oldpkt);
+        mc_PACKET *newpkt = mcreq_renew_packet(this, oldpkt);
         newpkt->flags &= ~MCREQ_STATE_FLAGS;
         instance->retryq->ucadd((mc_EXPACKET *)newpkt, LCB_ERR_TIMEOUT, orig_status);
         return true;
     }
     std::string name = instance->collcache->id_to_name(cid);
 
+    if (settings->collections_manifest) {
+        lcb_log(LOGARGS_T(WARN), LOGFMT "UNKNOWN_COLLECTION. Packet=%p (M=0x%x, S=%u, OP=0x%x), CID=%u, CNAME=%s",
+                LOGID_T(), (void *)oldpkt, (int)req.request.magic, oldpkt->opaque, (int)req.request.opcode,
+                (unsigned)cid, name.c_str());
+        mc_PIPELINE *pipeline{this};
+        mc_PACKET *newpkt = mcreq_renew_packet(this, oldpkt);
+        lcb_INSTANCE *root = instance;
+        auto reschedule = [root, pipeline, newpkt, name, orig_status](lcb_STATUS) {
+            mc_PACKET *pkt = newpkt;
+            uint32_t newcid;
+            if ((pkt->flags & MCREQ_F_NOCID) == 0 && root->collcache->get(name, &newcid)) {
+                pkt = mcreq_set_cid(pipeline, pkt, newcid);
+            }
+            pkt->flags &= ~MCREQ_STATE_FLAGS;
+            root->retryq->ucadd((mc_EXPACKET *)pkt, LCB_ERR_TIMEOUT, orig_status);
+        };
+        if (!collcache_manifest_outdated(instance, resp.value(), resp.vallen())) {
+            /* the cache is as recent as the server, but the packet may have been encoded before it was loaded */
+            reschedule(LCB_SUCCESS);
+            return true;
+        }
+        lcb_STATUS rc = collcache_fetch_manifest(instance, reschedule);
+        if (rc != LCB_SUCCESS) {
+            reschedule(rc);
+        }
+        return true;
+    }
+
     packet_wrapper wrapper;
     mcreq_get_key(oldpkt, (const char **)&wrapper.key.contig.bytes, &wrapper.key.contig.nbytes);
 
@@ -296,7 +335,7 @@ bool Server::handle_unknown_collection(MemcachedResponse &resp, mc_PACKET *oldpk
             LOGID_T(), (void *)oldpkt, (int)req.request.magic, oldpkt->opaque, (int)req.request.opcode, (unsigned)cid,
             name.c_str());
     wrapper.assign_name(name);
-    wrapper.pkt = mcreq_renew_packet(oldpkt);
+    wrapper.pkt = mcreq_renew_packet(this, oldpkt);
     wrapper.instance = instance;
     wrapper.timeout = LCB_NS2US(MCREQ_PKT_RDATA(wrapper.pkt)->deadline - now);
     mc_PIPELINE *pipeline{this};
@@ -363,6 +402,8 @@ static bool is_fastpath_error(uint16_t rc)
         case PROTOCOL_BINARY_RATE_LIMITED_MAX_CONNECTIONS:
         case PROTOCOL_BINARY_RATE_LIMITED_MAX_COMMANDS:
         case PROTOCOL_BINARY_SCOPE_SIZE_LIMIT_EXCEEDED:
+        case PROTOCOL_BINARY_RESPONSE_RANGE_SCAN_MORE:
+        case PROTOCOL_BINARY_RESPONSE_RANGE_SCAN_COMPLETE:
             return true;
         default:
             if (rc >= 0xc0 && rc <= 0xcc) {
@@ -402,6 +443,10 @@ int Server::handle_unknown_error(const mc_PACKET *request, const MemcachedRespon
     if (!err.isValid() || err.hasAttribute(errmap::SPECIAL_HANDLING)) {
         lcb_log(LOGARGS_T(ERR), LOGFMT "Received error not in error map or requires special handling! " PKTFMT,
                 LOGID_T(), PKTARGS(mcresp));
+        if (!err.isValid()) {
+            /* the server may know a newer map, which the reconnection fetches */
+            settings->errmap->markOutdated();
+        }
         lcbio_ctx_senderr(connctx, LCB_ERR_PROTOCOL_ERROR);
         return ERRMAP_HANDLE_DISCONN;
     } else {
@@ -439,7 +484,7 @@ int Server::handle_unknown_error(const mc_PACKET *request, const MemcachedRespon
     if (err.hasAttribute(errmap::AUTO_RETRY)) {
         errmap::RetrySpec *spec = err.getRetrySpec();
 
-        mc_PACKET *newpkt = mcreq_renew_packet(request);
+        mc_PACKET *newpkt = mcreq_renew_packet(this, request);
         newpkt->flags &= ~MCREQ_STATE_FLAGS;
         instance->retryq->add((mc_EXPACKET *)newpkt, newerr ? newerr : LCB_ERR_GENERIC,
                               static_cast<protocol_binary_response_status>(mcresp.status()), spec);
@@ -521,7 +566,7 @@ void Server::handle_config_only(const mc_PACKET *oldpkt)
         instance->confmon->do_next_provider();
     }
 
-    mc_PACKET *newpkt = mcreq_renew_packet(oldpkt);
+    mc_PACKET *newpkt = mcreq_renew_packet(this, oldpkt);
     newpkt->flags &= ~MCREQ_STATE_FLAGS;
     instance->retryq->config_only_add((mc_EXPACKET *)newpkt);
 }
@@ -554,12 +599,77 @@ void Server::handle_server_request(const MemcachedResponse &request)
  * When a complete packet is not available, PKT_READ_PARTIAL will be returned
  * and the `on_read()` loop will exit, scheduling any required pending I/O.
  */
+bool Server::wants_streaming(const MemcachedResponse &mcresp)
+{
+    if (instance == nullptr || instance->callbacks.value_sink == nullptr ||
+        mcresp.status() != PROTOCOL_BINARY_RESPONSE_SUCCESS ||
+        (mcresp.datatype() & PROTOCOL_BINARY_DATATYPE_COMPRESSED)) {
+        return false;
+    }
+    if (mcresp.res.response.magic != PROTOCOL_BINARY_RES && mcresp.res.response.magic != PROTOCOL_BINARY_ARES) {
+        return false;
+    }
+    switch (mcresp.opcode()) {
+        case PROTOCOL_BINARY_CMD_GET:
+        case PROTOCOL_BINARY_CMD_GAT:
+        case PROTOCOL_BINARY_CMD_GET_LOCKED:
+            break;
+        default:
+            return false;
+    }
+    const mc_PACKET *request = mcreq_pipeline_find(this, mcresp.opaque());
+    return request != nullptr && (request->flags & MCREQ_F_STREAMVALUE) && !(request->flags & MCREQ_F_UFWD);
+}
+
+/**
+ * Pass the bytes of the streamed value which have been read to the value
+ * sink, without waiting for the rest. Once the whole value was passed, the
+ * reply is dispatched.
+ */
+Server::ReadState Server::stream_value(lcbio_CTX *ctx, rdb_IOROPE *ior)
+{
+    /* the request may have timed out since the last chunk, the rest of the value is dropped then */
+    mc_PACKET *request = mcreq_pipeline_find(this, streamed.header.response.opaque);
+    while (streamed.remaining > 0 && rdb_get_nused(ior) > 0) {
+        unsigned nchunk = std::min(rdb_get_contigsize(ior), streamed.remaining);
+        if (request != nullptr) {
+            instance->callbacks.value_sink(instance, const_cast<void *>(MCREQ_PKT_COOKIE(request)),
+                                           rdb_get_consolidated(ior, nchunk), nchunk);
+        }
+        rdb_consumed(ior, nchunk);
+        streamed.remaining -= nchunk;
+    }
+    if (streamed.remaining > 0) {
+        lcbio_ctx_rwant(ctx, 1);
+        return PKT_READ_PARTIAL;
+    }
+
+    streamed.ctx = nullptr;
+    request = mcreq_pipeline_remove(this, streamed.header.response.opaque);
+    if (request == nullptr) {
+        MC_INCR_METRIC(this, packets_ownerless, 1);
+        return PKT_READ_COMPLETE;
+    }
+    /* the reply is dispatched without its value */
+    MemcachedResponse mcresp;
+    mcresp.res = streamed.header;
+    mcresp.res.response.bodylen = htonl(static_cast<std::uint32_t>(streamed.prefix.size()));
+    mcresp.payload = streamed.prefix.empty() ? nullptr : &streamed.prefix[0];
+    mcreq_dispatch_response(this, request, &mcresp, LCB_SUCCESS);
+    mcreq_packet_handled(this, request);
+    return PKT_READ_COMPLETE;
+}
+
 Server::ReadState Server::try_read(lcbio_CTX *ctx, rdb_IOROPE *ior)
 {
     MemcachedResponse mcresp;
     mc_PACKET *request;
     unsigned pktsize = 24, is_last = 1;
 
+    if (streamed.ctx == ctx) {
+        return stream_value(ctx, ior);
+    }
+
 #define RETURN_NEED_MORE(n)                                                                                            \
     if (has_pending()) {                                                                                               \
         lcbio_ctx_rwant(ctx, n);                                                                                       \
@@ -589,9 +699,35 @@ Server::ReadState Server::try_read(lcbio_CTX *ctx, rdb_IOROPE *ior)
     rdb_copyread(ior, mcresp.hdrbytes(), mcresp.hdrsize());
 
     pktsize += mcresp.bodylen();
+    if (rdb_get_nused(ior) < pktsize && wants_streaming(mcresp)) {
+        /* hand the value over as it arrives rather than buffering it whole */
+        unsigned prefixlen = mcresp.ffextlen() + mcresp.extlen() + mcresp.keylen();
+        if (rdb_get_nused(ior) < mcresp.hdrsize() + prefixlen) {
+            RETURN_NEED_MORE(mcresp.hdrsize() + prefixlen);
+        }
+        rdb_consumed(ior, mcresp.hdrsize());
+        streamed.prefix.resize(prefixlen);
+        if (prefixlen) {
+            rdb_copyread(ior, &streamed.prefix[0], prefixlen);
+            rdb_consumed(ior, prefixlen);
+        }
+        streamed.header = mcresp.res;
+        streamed.remaining = mcresp.bodylen() - prefixlen;
+        streamed.ctx = ctx;
+        if (settings->circuit_breaker) {
+            breaker.record_success();
+        }
+        return stream_value(ctx, ior);
+    }
     if (rdb_get_nused(ior) < pktsize) {
+        /* Read the rest of a large packet right behind what we already have, so it
+         * does not need to be consolidated once complete */
+        if (pktsize > ior->rdsize) {
+            rdb_rdreserve(ior, pktsize);
+        }
         RETURN_NEED_MORE(pktsize);
     }
+    TRACE_KV_RESPONSE_READ(instance, this, mcresp, pktsize);
 
     if (mcresp.res.response.magic == PROTOCOL_BINARY_SREQ) {
         /*
@@ -604,8 +740,11 @@ Server::ReadState Server::try_read(lcbio_CTX *ctx, rdb_IOROPE *ior)
         return PKT_READ_COMPLETE;
     }
 
-    /* Find the packet */
-    if (mcresp.opcode() == PROTOCOL_BINARY_CMD_STAT && mcresp.keylen() != 0) {
+    /* Find the packet. Both STAT and RANGE_SCAN_CONTINUE may answer with
+     * several frames, of which only the last one completes the request */
+    if ((mcresp.opcode() == PROTOCOL_BINARY_CMD_STAT && mcresp.keylen() != 0) ||
+        (mcresp.opcode() == PROTOCOL_BINARY_CMD_RANGE_SCAN_CONTINUE &&
+         mcresp.status() == PROTOCOL_BINARY_RESPONSE_SUCCESS)) {
         is_last = 0;
         request = mcreq_pipeline_find(this, mcresp.opaque());
     } else {
@@ -613,6 +752,10 @@ Server::ReadState Server::try_read(lcbio_CTX *ctx, rdb_IOROPE *ior)
         request = mcreq_pipeline_remove(this, mcresp.opaque());
     }
 
+    if (request && settings->circuit_breaker) {
+        breaker.record_success();
+    }
+
     if (!request) {
         if (mcresp.opcode() == PROTOCOL_BINARY_CMD_SELECT_BUCKET) {
             rdb_consumed(ior, pktsize);
@@ -649,7 +792,7 @@ Server::ReadState Server::try_read(lcbio_CTX *ctx, rdb_IOROPE *ior)
     auto status = static_cast<protocol_binary_response_status>(mcresp.status());
     if (is_warmup_issue(status)) {
         DO_ASSIGN_PAYLOAD()
-        mc_PACKET *newpkt = mcreq_renew_packet(request);
+        mc_PACKET *newpkt = mcreq_renew_packet(this, request);
         newpkt->flags &= ~MCREQ_STATE_FLAGS;
         instance->retryq->add((mc_EXPACKET *)newpkt, lcb_map_error(instance, status), status, nullptr);
         DO_SWALLOW_PAYLOAD()
@@ -740,8 +883,14 @@ static void on_read(lcbio_CTX *ctx, unsigned)
         return;
     }
 
+    server->nread++;
+    lcb_INSTANCE *instance = server->instance;
+    int batched = lcb_respbatch_begin(instance);
     while (server->try_read(ctx, ior) == Server::PKT_READ_COMPLETE)
         ;
+    if (batched) {
+        lcb_respbatch_flush(instance);
+    }
     lcbio_ctx_schedule(ctx);
     lcb_maybe_breakout(server->instance);
 }
@@ -769,18 +918,51 @@ bool Server::maybe_retry_packet(mc_PACKET *pkt, lcb_STATUS err, protocol_binary_
         return false;
     }
 
-    mc_PACKET *newpkt = mcreq_renew_packet(pkt);
+    mc_PACKET *newpkt = mcreq_renew_packet(this, pkt);
     newpkt->flags &= ~MCREQ_STATE_FLAGS;
     // TODO: Load the 4th argument from the error map
     instance->retryq->add((mc_EXPACKET *)newpkt, err, status, nullptr);
     return true;
 }
 
+/**
+ * Retry a packet which was never written to the current connection, whatever
+ * the retry strategy says, as the server cannot have executed it.
+ */
+bool Server::maybe_replay_packet(mc_PACKET *pkt)
+{
+    if (pkt->flags & MCREQ_F_FLUSHED) {
+        return false;
+    }
+    if (lcbvb_get_distmode(parent->config) != LCBVB_DIST_VBUCKET) {
+        return false;
+    }
+    protocol_binary_request_header hdr;
+    mcreq_read_hdr(pkt, &hdr);
+    if (hdr.request.opcode == PROTOCOL_BINARY_CMD_NOOP) {
+        return false; /* the probes are not routed by vBucket */
+    }
+
+    mc_PACKET *newpkt = mcreq_renew_packet(this, pkt);
+    newpkt->flags &= ~MCREQ_STATE_FLAGS;
+    instance->retryq->add((mc_EXPACKET *)newpkt, LCB_ERR_NETWORK, PROTOCOL_BINARY_RESPONSE_UNSPECIFIED, nullptr);
+    MC_INCR_METRIC(this, packets_replayed, 1);
+    return true;
+}
+
 static void fail_callback(mc_PIPELINE *pipeline, mc_PACKET *pkt, lcb_STATUS err, void *)
 {
     static_cast<Server *>(pipeline)->purge_single(pkt, err);
 }
 
+static void replay_callback(mc_PIPELINE *pipeline, mc_PACKET *pkt, lcb_STATUS err, void *)
+{
+    auto *server = static_cast<Server *>(pipeline);
+    if (!server->maybe_replay_packet(pkt)) {
+        server->purge_single(pkt, err);
+    }
+}
+
 static const char *opcode_name(uint8_t code)
 {
     switch (code) {
@@ -872,6 +1054,12 @@ static const char *opcode_name(uint8_t code)
             return "get_error_map";
         case PROTOCOL_BINARY_CMD_GET_META:
             return "exists";
+        case PROTOCOL_BINARY_CMD_RANGE_SCAN_CREATE:
+            return "range_scan_create";
+        case PROTOCOL_BINARY_CMD_RANGE_SCAN_CONTINUE:
+            return "range_scan_continue";
+        case PROTOCOL_BINARY_CMD_RANGE_SCAN_CANCEL:
+            return "range_scan_cancel";
         default:
             return "unknown";
     }
@@ -897,6 +1085,7 @@ void Server::purge_single(mc_PACKET *pkt, lcb_STATUS err)
             err = tmperr;
         }
     }
+    lcb_flight_record(instance, LCB_FLIGHT_PKT_FAIL, this, pkt, err);
 
     protocol_binary_request_header hdr;
     memcpy(hdr.bytes, SPAN_BUFFER(&pkt->kh_span), sizeof(hdr.bytes));
@@ -944,18 +1133,26 @@ void Server::purge_single(mc_PACKET *pkt, lcb_STATUS err)
     lcb_assert(rv == 0);
 }
 
-int Server::purge(lcb_STATUS error, hrtime_t now, RefreshPolicy policy)
+int Server::purge(lcb_STATUS error, hrtime_t now, RefreshPolicy policy, bool replay_unsent)
 {
     int affected;
+    unsigned nfailed;
 
     if (now) {
-        affected = (int)mcreq_pipeline_timeout(this, error, fail_callback, nullptr, now);
+        nfailed = mcreq_pipeline_timeout(this, error, fail_callback, nullptr, now);
+        affected = (int)nfailed;
 
     } else {
-        mcreq_pipeline_fail(this, error, fail_callback, nullptr);
+        nfailed = mcreq_pipeline_fail(this, error, replay_unsent ? replay_callback : fail_callback, nullptr);
         affected = -1;
     }
 
+    if (nfailed && error != LCB_ERR_REQUEST_CANCELED && settings->circuit_breaker &&
+        breaker.record_failures(nfailed, now ? now : gethrtime(), *settings)) {
+        MC_INCR_METRIC(this, circuit_breaker_opened, 1);
+        lcb_log(LOGARGS_T(WARN), LOGFMT "Circuit breaker opened after %u failed operations", LOGID_T(), nfailed);
+    }
+
     MC_INCR_METRIC(this, packets_errored, affected);
     if (policy == REFRESH_NEVER) {
         return affected;
@@ -978,26 +1175,14 @@ static void flush_errdrain(mc_PIPELINE *pipeline)
 
 uint32_t Server::next_timeout() const
 {
-    hrtime_t now, expiry, diff, min = 0;
-    mc_PACKET *pkt = nullptr;
+    hrtime_t now, expiry, diff;
 
-    sllist_iterator iter;
-    SLLIST_ITERFOR(const_cast<sllist_root *>(&requests), &iter)
-    {
-        mc_PACKET *p = SLLIST_ITEM(iter.cur, mc_PACKET, slnode);
-        hrtime_t deadline = MCREQ_PKT_RDATA(p)->deadline;
-        if (pkt == nullptr || deadline < min) {
-            min = deadline;
-            pkt = p;
-        }
-    }
-
-    if (!pkt) {
+    expiry = lcb_tw_next(const_cast<lcb_TIMERWHEEL *>(&timeouts));
+    if (!expiry) {
         return default_timeout();
     }
 
     now = gethrtime();
-    expiry = MCREQ_PKT_RDATA(pkt)->deadline;
     if (expiry <= now) {
         diff = 0;
     } else {
@@ -1018,6 +1203,19 @@ void mcreq_rearm_timeout(mc_PIPELINE *pipeline)
     }
 }
 
+int lcb_kv_circuit_open(lcb_INSTANCE *instance, mc_PIPELINE *pipeline)
+{
+    if (!LCBT_SETTING(instance, circuit_breaker) || pipeline == instance->cmdq.fallback) {
+        return 0;
+    }
+    auto *server = static_cast<Server *>(pipeline);
+    if (server->breaker.admit(*instance->settings)) {
+        return 0;
+    }
+    MC_INCR_METRIC(server, packets_rejected, 1);
+    return 1;
+}
+
 static void timeout_server(void *arg)
 {
     reinterpret_cast<Server *>(arg)->io_timeout();
@@ -1041,6 +1239,50 @@ void Server::io_timeout()
     lcb_maybe_breakout(instance);
 }
 
+static void idle_server(void *arg)
+{
+    reinterpret_cast<Server *>(arg)->idle_tick();
+}
+
+/**
+ * Looks for a dead connection every LCB_CNTL_KV_IDLE_TIMEOUT: after a whole
+ * interval without reads while operations were pending, a NOOP is sent, and
+ * if nothing is read during the next interval either, the connection is
+ * replaced.
+ */
+void Server::idle_tick()
+{
+    std::uint32_t interval = settings->kv_idle_timeout;
+    if (interval == 0 || connctx == nullptr || state != S_CLEAN) {
+        return; /* rearmed by the next connection */
+    }
+
+    bool pending = has_pending();
+    bool stalled = pending && idle_pending && nread == idle_nread;
+    idle_pending = pending;
+    idle_nread = nread;
+    if (!stalled) {
+        idle_ticks = 0;
+    } else if (idle_ticks++ == 0) {
+        lcb_log(LOGARGS_T(DEBUG), LOGFMT "Nothing read for %u ms with operations pending. Probing", LOGID_T(),
+                interval / 1000);
+        MC_INCR_METRIC(this, idle_probes, 1);
+        if (!probe_pending) {
+            mcreq_sched_enter(parent);
+            send_probe(gethrtime());
+            mcreq_sched_leave(parent, 1);
+        }
+    } else {
+        lcb_log(LOGARGS_T(WARN), LOGFMT "Nothing read for %u ms after probing. Assuming the connection is dead",
+                LOGID_T(), interval / 1000 * 2);
+        MC_INCR_METRIC(this, idle_reconnects, 1);
+        idle_ticks = 0;
+        socket_failed(LCB_ERR_NETWORK, true);
+        return;
+    }
+    lcbio_timer_rearm(idle_timer, interval);
+}
+
 bool Server::maybe_reconnect_on_fake_timeout(lcb_STATUS err)
 {
     if (err != LCB_ERR_TIMEOUT) {
@@ -1128,6 +1370,9 @@ void Server::handle_connected(lcbio_SOCKET *sock, lcb_STATUS err, lcbio_OSERR sy
             sessinfo->has_feature(PROTOCOL_BINARY_FEATURE_GET_CLUSTER_CONFIG_WITH_KNOWN_VERSION);
         collections = sessinfo->has_feature(PROTOCOL_BINARY_FEATURE_COLLECTIONS) ? MCREQ_COLLECTIONS_SUPPORTED
                                                                                  : MCREQ_COLLECTIONS_UNSUPPORTTED;
+        large_threshold = sessinfo->has_feature(PROTOCOL_BINARY_FEATURE_UNORDERED_EXECUTION)
+                              ? settings->large_value_threshold
+                              : 0;
         lcb_log(
             LOGARGS_T(TRACE),
             R"(<%s:%s> (SRV=%p) Got new KV connection (collections=%s, json=%s, snappy=%s, mt=%s, durability=%s, config_push=%s, config_ver=%s, bucket=%s "%s"%s%s))",
@@ -1146,6 +1391,17 @@ void Server::handle_connected(lcbio_SOCKET *sock, lcb_STATUS err, lcbio_OSERR sy
     procs.cb_flush_ready = on_flush_ready;
     connctx = lcbio_ctx_new(sock, this, &procs, "memcached");
     sock->service = LCBIO_SERVICE_KV;
+    lcb_flight_record(instance, LCB_FLIGHT_SOCK_READY, this, nullptr, 0);
+    if (settings->wait_spin) {
+        /* have the kernel poll the device too while lcb_wait() spins */
+        lcb_STATUS rc = lcbio_set_sockopt(sock, LCB_IO_CNTL_BUSY_POLL, (int)settings->wait_spin);
+        lcb_log(LOGARGS_T(DEBUG), LOGFMT "%s SO_BUSY_POLL=%u", LOGID_T(), rc == LCB_SUCCESS ? "Set" : "Couldn't set",
+                settings->wait_spin);
+    }
+    if (settings->kernel_io_stats) {
+        lcb_STATUS rc = lcbio_kstats_enable(sock);
+        lcb_log(LOGARGS_T(DEBUG), LOGFMT "Kernel IO statistics: %s", LOGID_T(), lcb_strerror_short(rc));
+    }
     flush_start = (mcreq_flushstart_fn)mcserver_flush;
     if (try_to_select_bucket) {
         bucket.assign(settings->bucket, strlen(settings->bucket));
@@ -1157,19 +1413,26 @@ void Server::handle_connected(lcbio_SOCKET *sock, lcb_STATUS err, lcbio_OSERR sy
     }
     uint32_t tmo = next_timeout();
     lcbio_timer_rearm(io_timer, tmo);
+    if (settings->kv_idle_timeout) {
+        idle_pending = false;
+        idle_ticks = 0;
+        lcbio_timer_rearm(idle_timer, settings->kv_idle_timeout);
+    }
     flush();
 }
 
 void Server::connect()
 {
+    lcb_flight_record(instance, LCB_FLIGHT_SOCK_CONNECT, this, nullptr, 0);
     connreq = instance->memd_sockpool->get(*curhost, default_timeout(), on_connected, this);
     flush_start = flush_noop;
     state = Server::S_CLEAN;
 }
 
-static void buf_done_cb(mc_PIPELINE *pl, const void *cookie, void *, void *)
+static void buf_done_cb(mc_PIPELINE *pl, const void *cookie, void *, void *vbuf)
 {
     auto *server = static_cast<Server *>(pl);
+    lcb_value_maps_release(server->instance, vbuf);
     server->instance->callbacks.pktflushed(server->instance, cookie);
 }
 
@@ -1179,6 +1442,8 @@ Server::Server(lcb_INSTANCE *instance_, int ix)
       mutation_tokens(0), new_durability(-1), selected_bucket(0), connctx(nullptr), curhost(new lcb_host_t())
 {
     mcreq_pipeline_init(this);
+    netbuf_set_maxalloc(&nbmgr, settings->netbuf_block_max);
+    idle_timer = lcbio_timer_new(instance_->iotable, this, idle_server);
     flush_start = (mcreq_flushstart_fn)server_connect;
     buf_done_callback = buf_done_cb;
     index = ix;
@@ -1213,7 +1478,7 @@ Server::~Server()
     if (this->instance) {
         unsigned ii;
         mc_CMDQUEUE *cmdq = &this->instance->cmdq;
-        for (ii = 0; ii < cmdq->npipelines; ii++) {
+        for (ii = 0; ii < MCREQ_NPIPELINES_ALL(cmdq); ii++) {
             auto *server = static_cast<lcb::Server *>(cmdq->pipelines[ii]);
             if (server == this) {
                 cmdq->pipelines[ii] = nullptr;
@@ -1229,8 +1494,16 @@ Server::~Server()
     if (io_timer) {
         lcbio_timer_destroy(io_timer);
     }
+    if (idle_timer) {
+        lcbio_timer_destroy(idle_timer);
+    }
 
     delete curhost;
+    for (auto *histogram : op_timings) {
+        if (histogram != nullptr) {
+            lcb_histogram_destroy(histogram);
+        }
+    }
     lcb_settings_unref(settings);
 }
 
@@ -1253,21 +1526,30 @@ static void on_error(lcbio_CTX *ctx, lcb_STATUS err)
 /**Handle a socket error. This function will close the current connection
  * and trigger a failout of any pending commands.
  * This function triggers a configuration refresh */
-void Server::socket_failed(lcb_STATUS err)
+void Server::socket_failed(lcb_STATUS err, bool replay_unsent)
 {
     if (check_closed()) {
         return;
     }
 
-    purge(err, 0, REFRESH_ALWAYS);
+    lcb_flight_record(instance, LCB_FLIGHT_SOCK_ERROR, this, nullptr, err);
+    purge(err, 0, REFRESH_ALWAYS, replay_unsent);
     lcb_maybe_breakout(instance);
     start_errored_ctx(S_ERRDRAIN);
 }
 
-void Server::close()
+void Server::close(bool abortive)
 {
     /* Should never be called twice */
     lcb_assert(state != Server::S_CLOSED);
+    lcb_flight_record(instance, LCB_FLIGHT_SOCK_CLOSE, this, nullptr, 0);
+    if (abortive) {
+        purge(LCB_ERR_REQUEST_CANCELED);
+        if (connctx != nullptr) {
+            /* nothing is left to deliver, so do not let the kernel hold on to the unsent data */
+            lcbio_set_sockopt(lcbio_ctx_sock(connctx), LCB_IO_CNTL_ABORTIVE_CLOSE, 1);
+        }
+    }
     start_errored_ctx(S_CLOSED);
 }
 
@@ -1289,6 +1571,10 @@ void Server::start_errored_ctx(State next_state)
         lcbio_timer_destroy(io_timer);
         io_timer = nullptr;
     }
+    if (next_state == Server::S_CLOSED && idle_timer != nullptr) {
+        lcbio_timer_destroy(idle_timer);
+        idle_timer = nullptr;
+    }
 
     if (ctx == nullptr) {
         if (next_state == Server::S_CLOSED) {
@@ -1344,6 +1630,7 @@ void Server::finalize_errored_ctx()
     /* Always close the existing context. */
     lcbio_ctx_close(connctx, close_cb, nullptr);
     connctx = nullptr;
+    streamed.ctx = nullptr;
 
     /**Marks any unflushed data inside this server as being already flushed. This
      * should be done within error handling. If subsequent data is flushed on this
@@ -18,12 +18,17 @@
 #ifndef LCB_MCSERVER_H
 #define LCB_MCSERVER_H
 #include <libcouchbase/couchbase.h>
+#include <libcouchbase/utils.h>
 #include <lcbio/lcbio.h>
 #include <lcbio/timer-ng.h>
 #include <mc/mcreq.h>
 #include <netbuf/netbuf.h>
 
 #ifdef __cplusplus
+#include "circuit_breaker.h"
+#include <string>
+#include <vector>
+
 namespace lcb
 {
 
@@ -48,8 +53,11 @@ class Server : public mc_PIPELINE
      * Close the server. The resources of the server may still continue to persist
      * internally for a bit until all callbacks have been delivered and all buffers
      * flushed and/or failed.
+     *
+     * @param abortive whether to fail the pending commands right away and to
+     * reset the connection rather than letting it drain, see LCB_CNTL_FASTDESTROY
      */
-    void close();
+    void close(bool abortive = false);
 
     /**
      * Schedule a flush and potentially flush some immediate data on the server.
@@ -198,12 +206,17 @@ class Server : public mc_PIPELINE
     bool check_closed();
     void start_errored_ctx(State next_state);
     void finalize_errored_ctx();
-    void socket_failed(lcb_STATUS);
+    /**
+     * Fail the connection, and connect again
+     * @param replay_unsent whether the packets not written yet are sent again instead of failing
+     */
+    void socket_failed(lcb_STATUS, bool replay_unsent = false);
     void io_timeout();
+    void idle_tick();
 
     enum RefreshPolicy { REFRESH_ALWAYS, REFRESH_ONFAILED, REFRESH_NEVER };
 
-    int purge(lcb_STATUS error, hrtime_t now, RefreshPolicy policy);
+    int purge(lcb_STATUS error, hrtime_t now, RefreshPolicy policy, bool replay_unsent = false);
 
     void connect();
 
@@ -212,6 +225,10 @@ class Server : public mc_PIPELINE
     enum ReadState { PKT_READ_COMPLETE, PKT_READ_PARTIAL, PKT_READ_ABORT };
 
     ReadState try_read(lcbio_CTX *ctx, rdb_IOROPE *ior);
+    /** @return whether the value of the reply should be passed to the value sink as it is read */
+    bool wants_streaming(const MemcachedResponse &mcresp);
+    /** Pass what was read of the value being streamed to the value sink */
+    ReadState stream_value(lcbio_CTX *ctx, rdb_IOROPE *ior);
     int handle_unknown_error(const mc_PACKET *request, const MemcachedResponse &resinfo, lcb_STATUS &newerr);
     bool handle_nmv(MemcachedResponse &resinfo, mc_PACKET *oldpkt);
     bool handle_unknown_collection(MemcachedResponse &resinfo, mc_PACKET *oldpkt);
@@ -220,6 +237,7 @@ class Server : public mc_PIPELINE
     void handle_config_only(const mc_PACKET *oldpkt);
 
     bool maybe_retry_packet(mc_PACKET *pkt, lcb_STATUS err, protocol_binary_response_status status);
+    bool maybe_replay_packet(mc_PACKET *pkt);
     bool maybe_reconnect_on_fake_timeout(lcb_STATUS received_error);
 
     /** Disable */
@@ -230,6 +248,9 @@ class Server : public mc_PIPELINE
     /** IO/Operation timer */
     lcbio_pTIMER io_timer;
 
+    /** Detection of the dead connections, see LCB_CNTL_KV_IDLE_TIMEOUT */
+    lcbio_pTIMER idle_timer{nullptr};
+
     /** Pointer back to the instance */
     lcb_INSTANCE *instance;
 
@@ -262,6 +283,55 @@ class Server : public mc_PIPELINE
     /** Request for current connection */
     lcb_host_t *curhost;
     std::string bucket{}; /** non-empty if bucket has been selected */
+
+    /**
+     * Latencies of each opcode since the last lcb_get_node_timings(), indexed
+     * by opcode. Only allocated while timings are enabled.
+     */
+    std::vector<lcb_HISTOGRAM *> op_timings{};
+
+    /** Reply whose value is being streamed, see lcb_cmdget_stream_value() */
+    struct {
+        /** Connection the value is read from, or NULL if no value is being streamed */
+        const lcbio_CTX *ctx{nullptr};
+        /** Header of the reply */
+        protocol_binary_response_header header{};
+        /** Framing extras, extras and key of the reply */
+        std::string prefix{};
+        /** Bytes of the value which have not been read yet */
+        std::uint32_t remaining{0};
+    } streamed;
+
+    /** Results of the health probes, see LCB_CNTL_HEALTH_PROBE_INTERVAL */
+    lcb_HEALTH_PROBE probe{LCB_PING_STATUS_INVALID};
+    /** Number of read events, so the probes can tell whether the connection was idle */
+    std::uint64_t nread{0};
+    /** Value of nread when the probes last looked at the connection */
+    std::uint64_t probe_nread{0};
+    /** Whether a probe is in flight */
+    bool probe_pending{false};
+
+    /** Send a NOOP through the pipeline, whose reply updates the probe results */
+    void send_probe(hrtime_t now);
+
+    /** Value of nread at the previous idle_tick() */
+    std::uint64_t idle_nread{0};
+    /** Whether operations were pending at the previous idle_tick() */
+    bool idle_pending{false};
+    /** Number of consecutive idle_tick() intervals without reads while operations were pending */
+    unsigned idle_ticks{0};
+
+    /** Add the latency of a read to read_latency_ewma */
+    void record_read_latency(std::uint64_t latency)
+    {
+        read_latency_ewma = read_latency_ewma ? (read_latency_ewma * 7 + latency) / 8 : latency;
+    }
+
+    /** Moving average of the latency of the reads from this node, see LCB_REPLICA_MODE_FASTEST */
+    std::uint64_t read_latency_ewma{0};
+
+    /** Fails operations fast while this connection keeps failing, see LCB_CNTL_CIRCUIT_BREAKER */
+    CircuitBreaker breaker{};
 };
 } // namespace lcb
 #endif /* __cplusplus */
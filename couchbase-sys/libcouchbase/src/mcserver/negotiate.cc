@@ -31,6 +31,7 @@
 #include "negotiate.h"
 #include "ctx-log-inl.h"
 #include "auth-priv.h"
+#include "trace.h"
 
 using namespace lcb;
 
@@ -64,26 +65,30 @@ class lcb::SessionRequestImpl : public SessionRequest
     }
 
     bool setup(const lcbio_NAMEINFO &nistrs, const lcb_host_t &host, const lcb::Authenticator &auth);
+    bool new_sasl_client();
     void start(lcbio_SOCKET *sock);
-    void send_list_mechs() const;
+    void send_list_mechs();
+    void maybe_send_speculative_auth();
+    void authenticated();
     std::string generate_agent_json() const;
     bool send_hello();
     bool send_step(const lcb::MemcachedResponse &packet);
     bool check_auth(const lcb::MemcachedResponse &packet);
     bool read_hello(const lcb::MemcachedResponse &packet);
-    void send_auth(const char *sasl_data, unsigned ndata) const;
+    void send_auth(const char *sasl_data, unsigned ndata);
     void handle_read(lcbio_CTX *ioctx);
     bool maybe_select_bucket();
+    void send_get_config();
 
     enum MechStatus { MECH_UNAVAILABLE, MECH_NOT_NEEDED, MECH_OK };
     MechStatus set_chosen_mech(std::string &mechlist, const char **data, unsigned int *ndata);
-    bool request_errmap() const;
+    bool request_errmap();
     bool update_errmap(const lcb::MemcachedResponse &packet);
 
     SessionRequestImpl(lcbio_CONNDONE_cb callback, void *data, uint32_t timeout, lcbio_TABLE *iot,
-                       lcb_settings *settings_)
+                       lcb_settings *settings_, bool fetch_config_)
         : ctx(nullptr), cb(callback), cbdata(data), timer(lcbio_timer_new(iot, this, timeout_handler)),
-          last_err(LCB_SUCCESS), info(nullptr), settings(settings_)
+          last_err(LCB_SUCCESS), info(nullptr), settings(settings_), fetch_config(fetch_config_)
     {
 
         if (timeout) {
@@ -185,7 +190,21 @@ class lcb::SessionRequestImpl : public SessionRequest
     SessionInfo *info;
     lcb_settings *settings;
     lcb_host_t host_{};
-    bool expecting_error_map{false};
+    bool fetch_config;
+
+    /*
+     * Everything the protocol allows is pipelined: HELLO, GET_ERROR_MAP,
+     * SASL_LIST_MECHS and, when the mechanism is known in advance, SASL_AUTH go
+     * in the first flight; SELECT_BUCKET and GET_CLUSTER_CONFIG follow the last
+     * SASL message without waiting for its response. The responses come back in
+     * order, so negotiation is complete once authenticated and nothing is
+     * outstanding.
+     */
+    unsigned outstanding{0};        /* requests sent and not yet responded to */
+    bool is_authenticated{false};   /* SASL done, or not needed */
+    bool select_sent{false};        /* SELECT_BUCKET (and maybe GET_CLUSTER_CONFIG) sent */
+    bool speculative_auth{false};   /* SASL_AUTH sent before SASL_LIST_MECHS returned */
+    bool discard_auth{false};       /* the speculative SASL_AUTH used the wrong mechanism */
 };
 
 static void handle_read(lcbio_CTX *ioctx, unsigned)
@@ -217,19 +236,56 @@ static int sasl_get_password(cbsasl_conn_t *conn, void *context, int id, cbsasl_
     return SASL_OK;
 }
 
+static int sasl_salted_password(void *context, int id, cbsasl_auth_mechanism_t mech, const char *salt,
+                                unsigned int saltlen, unsigned int itcount, unsigned char *buf, unsigned int *len)
+{
+    SessionRequestImpl *ctx = SessionRequestImpl::get(context);
+    if (ctx == nullptr || ctx->settings->auth == nullptr) {
+        return SASL_BADPARAM;
+    }
+
+    const lcb::Authenticator &auth = *ctx->settings->auth;
+    std::string pass(reinterpret_cast<const char *>(ctx->u_auth.secret.data), ctx->u_auth.secret.len);
+    std::string saltstr(salt, saltlen);
+    if (id == CBSASL_CB_SALTED_PASSWORD_SET) {
+        auth.scram_salted_password(ctx->username, pass, mech, saltstr, itcount,
+                                   std::string(reinterpret_cast<const char *>(buf), *len));
+        return SASL_OK;
+    }
+
+    std::string salted;
+    if (id != CBSASL_CB_SALTED_PASSWORD_GET ||
+        !auth.scram_salted_password(ctx->username, pass, mech, saltstr, itcount, salted) || salted.size() > *len) {
+        return SASL_FAIL;
+    }
+    memcpy(buf, salted.data(), salted.size());
+    *len = static_cast<unsigned int>(salted.size());
+    return SASL_OK;
+}
+
 SessionInfo::SessionInfo() : lcbio_PROTOCTX()
 {
     lcbio_PROTOCTX::id = LCBIO_PROTOCTX_SESSINFO;
     lcbio_PROTOCTX::dtor = (void (*)(lcbio_PROTOCTX *))cleanup_negotiated;
 }
 
-bool SessionRequestImpl::setup(const lcbio_NAMEINFO &nistrs, const lcb_host_t &host, const lcb::Authenticator &auth)
+bool SessionRequestImpl::new_sasl_client()
 {
     cbsasl_callbacks_t sasl_callbacks;
     sasl_callbacks.context = this;
     sasl_callbacks.username = sasl_get_username;
     sasl_callbacks.password = sasl_get_password;
+    sasl_callbacks.salted_password = sasl_salted_password;
+
+    if (sasl_client) {
+        cbsasl_dispose(&sasl_client);
+    }
+    cbsasl_error_t saslerr = cbsasl_client_new("couchbase", host_.host, nullptr, nullptr, &sasl_callbacks, 0, &sasl_client);
+    return saslerr == SASL_OK;
+}
 
+bool SessionRequestImpl::setup(const lcbio_NAMEINFO &, const lcb_host_t &host, const lcb::Authenticator &auth)
+{
     // Get the credentials
     host_ = host;
     auto creds = auth.credentials_for(LCBAUTH_SERVICE_KEY_VALUE, LCBAUTH_REASON_NEW_OPERATION, host_.host, host_.port,
@@ -248,9 +304,7 @@ bool SessionRequestImpl::setup(const lcbio_NAMEINFO &nistrs, const lcb_host_t &h
         }
     }
 
-    cbsasl_error_t saslerr =
-        cbsasl_client_new("couchbase", host.host, nistrs.local, nistrs.remote, &sasl_callbacks, 0, &sasl_client);
-    return saslerr == SASL_OK;
+    return new_sasl_client();
 }
 
 static void timeout_handler(void *arg)
@@ -341,7 +395,7 @@ SessionRequestImpl::MechStatus SessionRequestImpl::set_chosen_mech(std::string &
 /**
  * Given the specific mechanisms, send the auth packet to the server.
  */
-void SessionRequestImpl::send_auth(const char *sasl_data, unsigned ndata) const
+void SessionRequestImpl::send_auth(const char *sasl_data, unsigned ndata)
 {
     lcb::MemcachedRequest hdr(PROTOCOL_BINARY_CMD_SASL_AUTH);
     hdr.sizes(0, info->mech.size(), ndata);
@@ -350,6 +404,54 @@ void SessionRequestImpl::send_auth(const char *sasl_data, unsigned ndata) const
     lcbio_ctx_put(ctx, info->mech.c_str(), info->mech.size());
     lcbio_ctx_put(ctx, sasl_data, ndata);
     lcbio_ctx_rwant(ctx, 24);
+    outstanding++;
+}
+
+/**
+ * If the mechanism is known before the server lists them (because it is
+ * forced, or it is the one negotiated by the previous connection), send
+ * SASL_AUTH right away. SASL_LIST_MECHS is still sent, and if the server turns
+ * out not to offer the mechanism, the response to this SASL_AUTH is ignored.
+ */
+void SessionRequestImpl::maybe_send_speculative_auth()
+{
+    std::string mechlist;
+    if (settings->sasl_mech_force && strchr(settings->sasl_mech_force, ' ') == nullptr) {
+        mechlist = settings->sasl_mech_force;
+    } else if (settings->sasl_mech_force == nullptr) {
+        mechlist = settings->sasl_mech_last;
+    }
+    if (mechlist.empty()) {
+        return;
+    }
+
+    const char *data = nullptr;
+    unsigned int ndata = 0;
+    if (set_chosen_mech(mechlist, &data, &ndata) != MECH_OK) {
+        // the mechanism was refused locally, e.g. PLAIN without TLS, let the server list decide
+        last_err = LCB_SUCCESS;
+        new_sasl_client();
+        info->mech.clear();
+        return;
+    }
+    lcb_log(LOGARGS(this, DEBUG), LOGFMT "Sending SASL_AUTH with %s before the server lists the mechanisms",
+            LOGID(this), info->mech.c_str());
+    send_auth(data, ndata);
+    speculative_auth = true;
+}
+
+/** Whether the space separated list of mechanisms contains mech */
+static bool has_mech(const std::string &mechlist, const std::string &mech)
+{
+    size_t pos = 0;
+    while ((pos = mechlist.find(mech, pos)) != std::string::npos) {
+        size_t end = pos + mech.size();
+        if ((pos == 0 || mechlist[pos - 1] == ' ') && (end == mechlist.size() || mechlist[end] == ' ')) {
+            return true;
+        }
+        pos = end;
+    }
+    return false;
 }
 
 bool SessionRequestImpl::send_step(const lcb::MemcachedResponse &packet)
@@ -371,6 +473,10 @@ bool SessionRequestImpl::send_step(const lcb::MemcachedResponse &packet)
     lcbio_ctx_put(ctx, info->mech.c_str(), info->mech.size());
     lcbio_ctx_put(ctx, step_data, ndata);
     lcbio_ctx_rwant(ctx, 24);
+    outstanding++;
+
+    // This is the last message of all the supported mechanisms, no need to wait for the result
+    maybe_select_bucket();
     return true;
 }
 
@@ -539,14 +645,16 @@ bool SessionRequestImpl::send_hello()
             agent.c_str(), fstr.c_str());
 
     lcbio_ctx_rwant(ctx, 24);
+    outstanding++;
     return true;
 }
 
-void SessionRequestImpl::send_list_mechs() const
+void SessionRequestImpl::send_list_mechs()
 {
     lcb::MemcachedRequest req(PROTOCOL_BINARY_CMD_SASL_LIST_MECHS);
     lcbio_ctx_put(ctx, req.data(), req.size());
     LCBIO_CTX_RSCHEDULE(ctx, 24);
+    outstanding++;
 }
 
 bool SessionRequestImpl::read_hello(const lcb::MemcachedResponse &packet)
@@ -570,7 +678,7 @@ bool SessionRequestImpl::read_hello(const lcb::MemcachedResponse &packet)
     return true;
 }
 
-bool SessionRequestImpl::request_errmap() const
+bool SessionRequestImpl::request_errmap()
 {
     lcb::MemcachedRequest hdr(PROTOCOL_BINARY_CMD_GET_ERROR_MAP);
     uint16_t version = htons(1);
@@ -580,6 +688,7 @@ bool SessionRequestImpl::request_errmap() const
     lcbio_ctx_put(ctx, hdr.data(), hdr.size());
     lcbio_ctx_put(ctx, p, 2);
     lcbio_ctx_rwant(ctx, 24);
+    outstanding++;
     return true;
 }
 
@@ -604,6 +713,9 @@ bool SessionRequestImpl::update_errmap(const lcb::MemcachedResponse &packet)
 // Returns true if sending the SELECT_BUCKET command, false otherwise.
 bool SessionRequestImpl::maybe_select_bucket()
 {
+    if (select_sent) {
+        return false;
+    }
     if (settings->conntype != LCB_TYPE_BUCKET || settings->bucket == nullptr) {
         return false;
     }
@@ -625,9 +737,33 @@ bool SessionRequestImpl::maybe_select_bucket()
     info->bucket_name_.assign(settings->bucket);
     lcbio_ctx_put(ctx, info->bucket_name_.data(), info->bucket_name_.size());
     LCBIO_CTX_RSCHEDULE(ctx, 24);
+    outstanding++;
+    select_sent = true;
+
+    if (fetch_config) {
+        send_get_config();
+    }
     return true;
 }
 
+/** Fetches the configuration of the bucket in the same flight as SELECT_BUCKET, see SessionInfo::take_config() */
+void SessionRequestImpl::send_get_config()
+{
+    lcb::MemcachedRequest req(PROTOCOL_BINARY_CMD_GET_CLUSTER_CONFIG);
+    lcbio_ctx_put(ctx, req.data(), req.size());
+    LCBIO_CTX_RSCHEDULE(ctx, 24);
+    outstanding++;
+}
+
+void SessionRequestImpl::authenticated()
+{
+    is_authenticated = true;
+    if (!info->mech.empty() && info->mech.size() < sizeof(settings->sasl_mech_last)) {
+        strcpy(settings->sasl_mech_last, info->mech.c_str());
+    }
+    maybe_select_bucket();
+}
+
 static bool isUnsupported(uint16_t status)
 {
     return status == PROTOCOL_BINARY_RESPONSE_NOT_SUPPORTED || status == PROTOCOL_BINARY_RESPONSE_UNKNOWN_COMMAND ||
@@ -651,6 +787,10 @@ GT_NEXT_PACKET:
         return;
     }
     const uint16_t status = resp.status();
+    TRACE_KV_NEGOTIATE(this, host_, resp);
+    if (outstanding > 0) {
+        outstanding--;
+    }
 
     switch (resp.opcode()) {
         case PROTOCOL_BINARY_CMD_SASL_LIST_MECHS: {
@@ -658,20 +798,44 @@ GT_NEXT_PACKET:
             unsigned int nmechlist_data;
             std::string mechs(resp.value(), resp.vallen());
 
+            if (speculative_auth) {
+                speculative_auth = false;
+                if (has_mech(mechs, info->mech)) {
+                    // SASL_AUTH is already on its way
+                    break;
+                }
+                lcb_log(LOGARGS(this, DEBUG), LOGFMT "Server does not offer %s, ignoring its SASL_AUTH response",
+                        LOGID(this), info->mech.c_str());
+                discard_auth = true;
+                info->mech.clear();
+                if (!new_sasl_client()) {
+                    set_error(LCB_ERR_SDK_INTERNAL, "Couldn't start SASL client");
+                    break;
+                }
+            }
+
             MechStatus mechrc = set_chosen_mech(mechs, &mechlist_data, &nmechlist_data);
             if (mechrc == MECH_OK) {
                 send_auth(mechlist_data, nmechlist_data);
+                if (info->mech == MECH_PLAIN) {
+                    // PLAIN is done in one message
+                    maybe_select_bucket();
+                }
             } else if (mechrc == MECH_UNAVAILABLE) {
                 // Do nothing - error already set
             } else {
-                completed = !maybe_select_bucket();
+                authenticated();
             }
             break;
         }
 
         case PROTOCOL_BINARY_CMD_SASL_AUTH: {
+            if (discard_auth) {
+                discard_auth = false;
+                break;
+            }
             if (status == PROTOCOL_BINARY_RESPONSE_SUCCESS) {
-                completed = !maybe_select_bucket();
+                authenticated();
                 break;
             } else if (status == PROTOCOL_BINARY_RESPONSE_AUTH_CONTINUE) {
                 send_step(resp);
@@ -684,7 +848,7 @@ GT_NEXT_PACKET:
 
         case PROTOCOL_BINARY_CMD_SASL_STEP: {
             if (status == PROTOCOL_BINARY_RESPONSE_SUCCESS && check_auth(resp)) {
-                completed = !maybe_select_bucket();
+                authenticated();
             } else {
                 lcb_log(LOGARGS(this, WARN), LOGFMT "SASL auth failed with STATUS=0x%x", LOGID(this), status);
                 set_error(LCB_ERR_AUTHENTICATION_FAILURE, "SASL Step failed", &resp);
@@ -711,13 +875,13 @@ GT_NEXT_PACKET:
             }
 
             if (settings->keypath) {
-                completed = !expecting_error_map && !maybe_select_bucket();
+                // authenticated with the client certificate
+                authenticated();
             }
             break;
         }
 
         case PROTOCOL_BINARY_CMD_GET_ERROR_MAP: {
-            expecting_error_map = false;
             if (status == PROTOCOL_BINARY_RESPONSE_SUCCESS) {
                 update_errmap(resp);
             } else if (isUnsupported(status)) {
@@ -727,18 +891,23 @@ GT_NEXT_PACKET:
                         status);
                 set_error(LCB_ERR_PROTOCOL_ERROR, "GET_ERRMAP response unexpected", &resp);
             }
-            if (settings->keypath) {
-                completed = !maybe_select_bucket();
+            break;
+        }
+
+        case PROTOCOL_BINARY_CMD_GET_CLUSTER_CONFIG: {
+            if (status == PROTOCOL_BINARY_RESPONSE_SUCCESS && resp.vallen() > 0) {
+                info->config_ = resp.inflated_value();
+            } else {
+                // not fatal, the caller will request it again and handle the error
+                lcb_log(LOGARGS(this, DEBUG), LOGFMT "Pipelined GET_CLUSTER_CONFIG failed (0x%x)", LOGID(this),
+                        status);
             }
-            // Note, there is no explicit state transition here. LIST_MECHS is
-            // pipelined after this request.
             break;
         }
 
         case PROTOCOL_BINARY_CMD_SELECT_BUCKET: {
             switch (status) {
                 case PROTOCOL_BINARY_RESPONSE_SUCCESS:
-                    completed = true;
                     info->selected = true;
                     break;
 
@@ -785,6 +954,7 @@ GT_NEXT_PACKET:
 
     // Once there is no more any dependencies on the buffers, we can succeed
     // or fail the request, potentially destroying the underlying connection
+    completed = is_authenticated && outstanding == 0;
     if (has_error()) {
         fail();
     } else if (completed) {
@@ -832,14 +1002,17 @@ void SessionRequestImpl::start(lcbio_SOCKET *sock)
     }
 
     send_hello();
-    if (settings->use_errmap) {
+    if (settings->use_errmap && (!settings->errmap->isLoaded() || settings->errmap->isOutdated())) {
         request_errmap();
-        expecting_error_map = true;
+    } else if (settings->use_errmap) {
+        lcb_log(LOGARGS(this, TRACE), LOGFMT "Using error map revision %u fetched by another connection", LOGID(this),
+                (unsigned)settings->errmap->getRevision());
     } else {
         lcb_log(LOGARGS(this, TRACE), LOGFMT "GET_ERRORMAP disabled", LOGID(this));
     }
     if (!settings->keypath) {
         send_list_mechs();
+        maybe_send_speculative_auth();
     }
     LCBIO_CTX_RSCHEDULE(ctx, 24);
 }
@@ -860,9 +1033,9 @@ SessionRequestImpl::~SessionRequestImpl()
 }
 
 SessionRequest *SessionRequest::start(lcbio_SOCKET *sock, lcb_settings_st *settings, uint32_t tmo,
-                                      lcbio_CONNDONE_cb callback, void *data)
+                                      lcbio_CONNDONE_cb callback, void *data, bool fetch_config)
 {
-    auto *sreq = new SessionRequestImpl(callback, data, tmo, sock->io, settings);
+    auto *sreq = new SessionRequestImpl(callback, data, tmo, sock->io, settings, fetch_config);
     sreq->start(sock);
     return sreq;
 }
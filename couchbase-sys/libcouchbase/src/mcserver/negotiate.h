@@ -54,6 +54,8 @@ class SessionRequest : public lcb::io::ConnectionRequest
      * @param tmo Time in microseconds to wait until the negotiation is done
      * @param callback A callback to invoke when a result has been received
      * @param data User-defined pointer passed to the callback
+     * @param fetch_config Whether to also fetch the bucket configuration, see
+     * SessionInfo::take_config()
      * @return A new handle which may be cancelled via mc_sessreq_cancel(). As with
      * other cancellable requests, once this handle is cancelled a callback will
      * not be received for it, and once the callback is received the handle may not
@@ -72,7 +74,7 @@ class SessionRequest : public lcb::io::ConnectionRequest
      * @see LCBIO_CONNREQ_MKGENERIC
      */
     static SessionRequest *start(lcbio_SOCKET *sock, lcb_settings_st *settings, uint32_t tmo,
-                                 lcbio_CONNDONE_cb callback, void *data);
+                                 lcbio_CONNDONE_cb callback, void *data, bool fetch_config = false);
 
     /**
      * @brief Cancel a pending SASL negotiation request
@@ -117,6 +119,18 @@ class SessionInfo : public lcbio_PROTOCTX
     bool selected_bucket() const;
     const std::string &bucket_name() const;
 
+    /**
+     * @brief Get the configuration fetched along with SELECT_BUCKET
+     * @return the configuration (JSON), or an empty string if it was not
+     * requested or could not be fetched. It is only returned once.
+     */
+    std::string take_config()
+    {
+        std::string config;
+        config.swap(config_);
+        return config;
+    }
+
   private:
     SessionInfo();
     friend class lcb::SessionRequestImpl;
@@ -125,6 +139,7 @@ class SessionInfo : public lcbio_PROTOCTX
     std::vector<uint16_t> server_features;
     bool selected{false};
     std::string bucket_name_{};
+    std::string config_{};
 };
 
 } // namespace lcb
@@ -16,7 +16,7 @@
 
 #include "internal.h"
 #include "caching_meter.hh"
-#include <sstream>
+#include <cstdint>
 
 using namespace lcb::metrics;
 
@@ -46,7 +46,7 @@ CachingMeter::CachingMeter(const lcbmetrics_METER *base) : base_(base) {}
 CachingMeter::~CachingMeter()
 {
     for (auto &item : valueRecorders_) {
-        lcbmetrics_valuerecorder_destroy(item.second);
+        lcbmetrics_valuerecorder_destroy(item.second.recorder);
     }
 }
 
@@ -63,23 +63,57 @@ const lcbmetrics_METER *CachingMeter::wrap()
     return wrapper_;
 }
 
-const lcbmetrics_VALUERECORDER *CachingMeter::findValueRecorder(const char *name, const lcbmetrics_TAG *tags,
-                                                                size_t ntags)
+std::size_t CachingMeter::hash(const char *name, const lcbmetrics_TAG *tags, size_t ntags)
 {
-    std::stringstream lkpNameBuilder;
-    lkpNameBuilder << name << ";";
+    /* FNV-1a, with a separator after every string so that "ab","c" and "a","bc" differ */
+    std::uint64_t h = 14695981039346656037ULL;
+    auto mix = [&h](const char *s) {
+        for (; *s != '\0'; ++s) {
+            h = (h ^ static_cast<unsigned char>(*s)) * 1099511628211ULL;
+        }
+        h = (h ^ 0xffU) * 1099511628211ULL;
+    };
+    mix(name);
     for (size_t i = 0; i < ntags; ++i) {
-        lkpNameBuilder << tags[i].key << "=" << tags[i].value;
+        mix(tags[i].key);
+        mix(tags[i].value);
     }
+    return static_cast<std::size_t>(h);
+}
 
-    auto lkpName = lkpNameBuilder.str();
-    auto it = valueRecorders_.find(lkpName);
-    if (it != valueRecorders_.end()) {
-        return it->second;
+bool CachingMeter::Entry::matches(const char *name_, const lcbmetrics_TAG *tags_, size_t ntags_) const
+{
+    if (ntags_ != tags.size() || name != name_) {
+        return false;
     }
+    for (size_t i = 0; i < ntags_; ++i) {
+        if (tags[i].first != tags_[i].key || tags[i].second != tags_[i].value) {
+            return false;
+        }
+    }
+    return true;
+}
 
+const lcbmetrics_VALUERECORDER *CachingMeter::findValueRecorder(const char *name, const lcbmetrics_TAG *tags,
+                                                                size_t ntags)
+{
+    std::size_t key = hash(name, tags, ntags);
+    auto range = valueRecorders_.equal_range(key);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second.matches(name, tags, ntags)) {
+            return it->second.recorder;
+        }
+    }
+
+    Entry entry;
+    entry.name = name;
+    entry.tags.reserve(ntags);
+    for (size_t i = 0; i < ntags; ++i) {
+        entry.tags.emplace_back(tags[i].key, tags[i].value);
+    }
     auto recorder = base_->value_recorder_(base_, name, tags, ntags);
-    valueRecorders_.emplace(lkpName, recorder);
+    entry.recorder = recorder;
+    valueRecorders_.emplace(key, std::move(entry));
 
     return recorder;
 }
@@ -19,7 +19,10 @@
 
 #include "metrics/metrics-internal.h"
 #include <libcouchbase/metrics.h>
+#include <string>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace lcb
 {
@@ -37,9 +40,21 @@ class CachingMeter
     const lcbmetrics_VALUERECORDER *findValueRecorder(const char *name, const lcbmetrics_TAG *tags, size_t ntags);
 
   protected:
+    /** A recorder of the base meter, with the name and tags it was created for */
+    struct Entry {
+        std::string name;
+        std::vector<std::pair<std::string, std::string>> tags;
+        const lcbmetrics_VALUERECORDER *recorder;
+
+        bool matches(const char *name, const lcbmetrics_TAG *tags, size_t ntags) const;
+    };
+
+    static std::size_t hash(const char *name, const lcbmetrics_TAG *tags, size_t ntags);
+
     lcbmetrics_METER *wrapper_{nullptr};
     const lcbmetrics_METER *base_;
-    std::unordered_map<std::string, const lcbmetrics_VALUERECORDER *> valueRecorders_;
+    /** Keyed by the hash of the name and tags, so that lookups do not allocate */
+    std::unordered_multimap<std::size_t, Entry> valueRecorders_;
 };
 
 } // namespace metrics
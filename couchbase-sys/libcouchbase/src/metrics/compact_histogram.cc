@@ -0,0 +1,87 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "metrics/compact_histogram.hh"
+
+#include <algorithm>
+#include <cmath>
+
+namespace lcb
+{
+namespace metrics
+{
+
+constexpr unsigned CompactHistogram::sub_bucket_bits;
+constexpr std::size_t CompactHistogram::nbuckets;
+
+void CompactHistogram::collect(HistogramSnapshot &snapshot) const
+{
+    for (std::size_t ii = 0; ii < nbuckets; ii++) {
+        std::uint32_t count = counts_[ii].load(std::memory_order_relaxed);
+        snapshot.counts_[ii] += count;
+        snapshot.total_ += count;
+    }
+    snapshot.max_ = std::max(snapshot.max_, max_.load(std::memory_order_relaxed));
+}
+
+void CompactHistogram::drain(HistogramSnapshot &snapshot)
+{
+    for (std::size_t ii = 0; ii < nbuckets; ii++) {
+        std::uint32_t count = counts_[ii].exchange(0, std::memory_order_relaxed);
+        snapshot.counts_[ii] += count;
+        snapshot.total_ += count;
+    }
+    snapshot.max_ = std::max(snapshot.max_, max_.exchange(0, std::memory_order_relaxed));
+}
+
+void CompactHistogram::reset()
+{
+    for (auto &count : counts_) {
+        count.store(0, std::memory_order_relaxed);
+    }
+    max_.store(0, std::memory_order_relaxed);
+}
+
+void HistogramSnapshot::merge(const HistogramSnapshot &other)
+{
+    for (std::size_t ii = 0; ii < counts_.size(); ii++) {
+        counts_[ii] += other.counts_[ii];
+    }
+    total_ += other.total_;
+    max_ = std::max(max_, other.max_);
+}
+
+std::uint64_t HistogramSnapshot::value_at_percentile(double percentile) const
+{
+    if (total_ == 0) {
+        return 0;
+    }
+    auto rank = static_cast<std::uint64_t>(std::ceil(percentile / 100.0 * static_cast<double>(total_)));
+    rank = std::max<std::uint64_t>(1, std::min(rank, total_));
+
+    std::uint64_t seen = 0;
+    for (std::size_t ii = 0; ii < counts_.size(); ii++) {
+        seen += counts_[ii];
+        if (seen >= rank) {
+            return std::min(CompactHistogram::upper_bound(ii), max_);
+        }
+    }
+    return max_;
+}
+
+} // namespace metrics
+} // namespace lcb
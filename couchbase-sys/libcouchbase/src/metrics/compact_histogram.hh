@@ -0,0 +1,165 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCB_COMPACT_HISTOGRAM_HH
+#define LCB_COMPACT_HISTOGRAM_HH
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace lcb
+{
+namespace metrics
+{
+
+class HistogramSnapshot;
+
+/**
+ * Log-linear histogram small enough to keep one per operation, node and
+ * collection (4KB, against over 100KB for an HdrHistogram of the same range).
+ *
+ * Each power of two is split into 32 buckets of equal width, so that a value
+ * is known to within about 3% (two significant figures). Values below 64 are
+ * exact, and those of 2^36 (about 68 seconds) and above share the last bucket.
+ *
+ * Values may be recorded from any thread. They are read through snapshots,
+ * which may be merged to aggregate histograms.
+ */
+class CompactHistogram
+{
+  public:
+    /** Buckets per power of two are 2^sub_bucket_bits */
+    static constexpr unsigned sub_bucket_bits = 5;
+    static constexpr std::size_t nbuckets = 1024;
+
+    static std::size_t bucket_of(std::uint64_t value)
+    {
+        const std::uint64_t half = std::uint64_t(1) << sub_bucket_bits;
+        if (value < 2 * half) {
+            return static_cast<std::size_t>(value);
+        }
+        /* index of the highest bit set */
+#if defined(__GNUC__) || defined(__clang__)
+        unsigned msb = 63 - __builtin_clzll(value);
+#else
+        unsigned msb = 0;
+        for (std::uint64_t rest = value >> 1; rest != 0; rest >>= 1) {
+            msb++;
+        }
+#endif
+        unsigned shift = msb - sub_bucket_bits;
+        std::size_t index = shift * half + static_cast<std::size_t>(value >> shift);
+        return index < nbuckets ? index : nbuckets - 1;
+    }
+
+    static std::uint64_t lower_bound(std::size_t index)
+    {
+        const std::size_t half = std::size_t(1) << sub_bucket_bits;
+        if (index < 2 * half) {
+            return index;
+        }
+        unsigned shift = static_cast<unsigned>(index / half - 1);
+        return static_cast<std::uint64_t>(index - shift * half) << shift;
+    }
+
+    /** @return the highest value of the bucket at @p index */
+    static std::uint64_t upper_bound(std::size_t index)
+    {
+        if (index + 1 == nbuckets) {
+            return UINT64_MAX;
+        }
+        return lower_bound(index + 1) - 1;
+    }
+
+    void record(std::uint64_t value)
+    {
+        counts_[bucket_of(value)].fetch_add(1, std::memory_order_relaxed);
+        std::uint64_t max = max_.load(std::memory_order_relaxed);
+        while (value > max && !max_.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    /** Add the values recorded so far to @p snapshot */
+    void collect(HistogramSnapshot &snapshot) const;
+
+    /**
+     * Move the values recorded so far to @p snapshot, without losing those
+     * recorded concurrently
+     */
+    void drain(HistogramSnapshot &snapshot);
+
+    void reset();
+
+  private:
+    std::atomic<std::uint32_t> counts_[nbuckets]{};
+    std::atomic<std::uint64_t> max_{0};
+};
+
+/**
+ * Counts of a CompactHistogram (or of several, merged) at some point, see
+ * CompactHistogram::collect() and CompactHistogram::drain()
+ */
+class HistogramSnapshot
+{
+  public:
+    HistogramSnapshot() : counts_(CompactHistogram::nbuckets) {}
+
+    void merge(const HistogramSnapshot &other);
+
+    std::uint64_t total_count() const
+    {
+        return total_;
+    }
+
+    /** @return the highest value recorded, exactly */
+    std::uint64_t max() const
+    {
+        return max_;
+    }
+
+    /**
+     * @return the highest value of the bucket holding the given percentile
+     * (between 0 and 100), i.e. an upper bound within 3% of it, or 0 if empty
+     */
+    std::uint64_t value_at_percentile(double percentile) const;
+
+    /** Invoke @p fn(lower, upper, count) for every bucket with values, lowest first */
+    template <typename Fn>
+    void for_each(Fn fn) const
+    {
+        for (std::size_t ii = 0; ii < counts_.size(); ii++) {
+            if (counts_[ii] != 0) {
+                std::uint64_t upper = CompactHistogram::upper_bound(ii);
+                fn(CompactHistogram::lower_bound(ii), upper < max_ ? upper : max_, counts_[ii]);
+            }
+        }
+    }
+
+  private:
+    friend class CompactHistogram;
+
+    std::vector<std::uint64_t> counts_;
+    std::uint64_t total_{0};
+    std::uint64_t max_{0};
+};
+
+} // namespace metrics
+} // namespace lcb
+
+#endif // LCB_COMPACT_HISTOGRAM_HH
@@ -14,7 +14,6 @@
  *   limitations under the License.
  */
 
-#include <contrib/HdrHistogram_c/src/hdr_histogram.h>
 #include "internal.h"
 #include "logging_meter.hh"
 
@@ -136,20 +135,10 @@ LoggingValueRecorder &LoggingMeter::findValueRecorder(const char *svcName, const
     return recorder;
 }
 
-LoggingValueRecorder::LoggingValueRecorder() : wrapper_(nullptr), histogram_(nullptr)
-{
-    hdr_init(/* minimum - 1 ns*/ 1,
-             /* maximum - 30 s*/ 30e9,
-             /* significant figures */ 3,
-             /* pointer */ &histogram_);
-}
+LoggingValueRecorder::LoggingValueRecorder() : wrapper_(nullptr) {}
 
 LoggingValueRecorder::~LoggingValueRecorder()
 {
-    if (histogram_ != nullptr) {
-        hdr_close(histogram_);
-        histogram_ = nullptr;
-    }
     delete wrapper_;
 }
 
@@ -168,19 +157,19 @@ const lcbmetrics_VALUERECORDER *LoggingValueRecorder::wrap()
 
 void LoggingValueRecorder::recordValue(std::uint64_t value)
 {
-    hdr_record_value(histogram_, value);
+    histogram_.record(value);
 }
 
 Json::Value LoggingValueRecorder::flush()
 {
-    auto total_count = histogram_->total_count;
-    auto val_500 = hdr_value_at_percentile(histogram_, 50.0);
-    auto val_900 = hdr_value_at_percentile(histogram_, 90.0);
-    auto val_990 = hdr_value_at_percentile(histogram_, 99.0);
-    auto val_999 = hdr_value_at_percentile(histogram_, 99.9);
-    auto val_1000 = hdr_value_at_percentile(histogram_, 100.0);
-
-    hdr_reset(histogram_);
+    HistogramSnapshot snapshot;
+    histogram_.drain(snapshot);
+    auto total_count = snapshot.total_count();
+    auto val_500 = snapshot.value_at_percentile(50.0);
+    auto val_900 = snapshot.value_at_percentile(90.0);
+    auto val_990 = snapshot.value_at_percentile(99.0);
+    auto val_999 = snapshot.value_at_percentile(99.9);
+    auto val_1000 = snapshot.value_at_percentile(100.0);
 
     Json::Value percentiles;
     percentiles["50.0"] = Json::Int64(val_500);
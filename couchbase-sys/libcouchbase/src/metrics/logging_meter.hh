@@ -17,6 +17,7 @@
 #ifndef LCB_LOGGINGMETER_H
 #define LCB_LOGGINGMETER_H
 
+#include "metrics/compact_histogram.hh"
 #include "metrics/metrics-internal.h"
 #include "settings.h"
 #include "lcbio/timer-cxx.h"
@@ -46,7 +47,7 @@ class LoggingValueRecorder
 
   protected:
     lcbmetrics_VALUERECORDER *wrapper_;
-    struct hdr_histogram *histogram_;
+    CompactHistogram histogram_;
 };
 
 class LoggingMeter
@@ -18,44 +18,97 @@
 #include "internal.h"
 #include "capi/cmd_store.hh"
 
-const char *op_name_from_store_operation(lcb_STORE_OPERATION operation)
+#ifndef LCB_NO_METRICS
+static const char *kv_op_names[METRICS_KV_OP__MAX] = {
+    "get", "exists", "lookup_in", "mutate_in", "remove", "insert", "replace",
+    "append", "prepend", "upsert", "arithmetic", "touch", "unlock", "unknown",
+};
+
+static lcb_METRICS_KV_OP kv_op_from_store_operation(lcb_STORE_OPERATION operation)
 {
     switch (operation) {
         case LCB_STORE_INSERT:
-            return "insert";
+            return METRICS_KV_OP_INSERT;
         case LCB_STORE_REPLACE:
-            return "replace";
+            return METRICS_KV_OP_REPLACE;
         case LCB_STORE_APPEND:
-            return "append";
+            return METRICS_KV_OP_APPEND;
         case LCB_STORE_PREPEND:
-            return "prepend";
+            return METRICS_KV_OP_PREPEND;
         case LCB_STORE_UPSERT:
-            return "upsert";
+            return METRICS_KV_OP_UPSERT;
         default:
-            return "unknown";
+            return METRICS_KV_OP_UNKNOWN;
     }
 }
 
+#endif
+
 void record_op_latency(const char *op, const char *svc, lcb_settings_st *settings, hrtime_t start)
 {
     if (settings->op_metrics_enabled && settings->meter) {
         lcbmetrics_TAG tags[2] = {{METRICS_SVC_TAG_NAME, svc ? svc : ""}, {METRICS_OP_TAG_NAME, op ? op : ""}};
         auto recorder = settings->meter->value_recorder_(settings->meter, METRICS_OPS_METER_NAME, tags, 2);
         if (recorder) {
-            recorder->record_value_(recorder, gethrtime() - start);
+            recorder->record_value_(recorder, lcb_settings_now(settings) - start);
         }
     }
 }
 
-void record_kv_op_latency(const char *op, lcb_INSTANCE *instance, mc_PACKET *request)
+#ifndef LCB_NO_METRICS
+void record_kv_op_latency(lcb_METRICS_KV_OP op, lcb_INSTANCE *instance, mc_PACKET *request)
+{
+    lcb_settings *settings = instance->settings;
+    if (!METRICS_KV_ENABLED(settings)) {
+        return;
+    }
+    const lcbmetrics_VALUERECORDER *&recorder = instance->kv_op_recorders[op];
+    if (recorder == nullptr) {
+        lcbmetrics_TAG tags[2] = {{METRICS_SVC_TAG_NAME, "kv"}, {METRICS_OP_TAG_NAME, kv_op_names[op]}};
+        recorder = settings->meter->value_recorder_(settings->meter, METRICS_OPS_METER_NAME, tags, 2);
+    }
+    if (recorder) {
+        recorder->record_value_(recorder, lcb_settings_now(settings) - MCREQ_PKT_RDATA(request)->start);
+    }
+}
+
+void record_kv_op_breakdown(lcb_INSTANCE *instance, mc_PACKET *request, hrtime_t server_duration, hrtime_t done)
 {
-    record_op_latency(op, "kv", instance->settings, MCREQ_PKT_RDATA(request)->start);
+    static const char *phase_names[METRICS_KV_PHASE__MAX] = {METRICS_KV_QUEUE_METER_NAME, METRICS_KV_NETWORK_METER_NAME,
+                                                             METRICS_KV_SERVER_METER_NAME,
+                                                             METRICS_KV_CALLBACK_METER_NAME};
+
+    lcb_settings *settings = instance->settings;
+    if (!METRICS_KV_ENABLED(settings)) {
+        return;
+    }
+    const mc_REQDATA *rdata = MCREQ_PKT_RDATA(request);
+    if (rdata->flushed == 0 || rdata->flushed < rdata->start || rdata->dispatch < rdata->flushed ||
+        done < rdata->dispatch) {
+        return; /* written before the breakdown was enabled */
+    }
+
+    hrtime_t wire = rdata->dispatch - rdata->flushed;
+    hrtime_t phases[METRICS_KV_PHASE__MAX] = {rdata->flushed - rdata->start,
+                                              wire > server_duration ? wire - server_duration : 0, server_duration,
+                                              done - rdata->dispatch};
+    lcbmetrics_TAG tags[1] = {{METRICS_SVC_TAG_NAME, "kv"}};
+    for (size_t ii = 0; ii < METRICS_KV_PHASE__MAX; ii++) {
+        const lcbmetrics_VALUERECORDER *&recorder = instance->kv_phase_recorders[ii];
+        if (recorder == nullptr) {
+            recorder = settings->meter->value_recorder_(settings->meter, phase_names[ii], tags, 1);
+        }
+        if (recorder) {
+            recorder->record_value_(recorder, phases[ii]);
+        }
+    }
 }
 
 void record_kv_op_latency_store(lcb_INSTANCE *instance, mc_PACKET *request, lcb_RESPSTORE *response)
 {
-    record_kv_op_latency(op_name_from_store_operation(response->op), instance, request);
+    record_kv_op_latency(kv_op_from_store_operation(response->op), instance, request);
 }
+#endif
 
 void record_http_op_latency(const char *op, const char *svc, lcb_INSTANCE *instance, hrtime_t start)
 {
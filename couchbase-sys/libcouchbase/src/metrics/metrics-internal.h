@@ -24,6 +24,48 @@
 #define METRICS_OPS_METER_NAME "db.couchbase.operations"
 #define METRICS_SVC_TAG_NAME "db.couchbase.service"
 #define METRICS_OP_TAG_NAME "db.operation"
+/** Bytes saved by every compressed value, zero when the result was discarded */
+#define METRICS_COMPRESSION_SAVED_METER_NAME "db.couchbase.compression.saved"
+/** Nanoseconds spent compressing each value */
+#define METRICS_COMPRESSION_DURATION_METER_NAME "db.couchbase.compression.duration"
+/** Size of every value the adaptive policy did not try to compress */
+#define METRICS_COMPRESSION_SKIPPED_METER_NAME "db.couchbase.compression.skipped"
+/** Number of operations in the retry queue, recorded on every flush */
+#define METRICS_RETRYQ_DEPTH_METER_NAME "db.couchbase.retry_queue.depth"
+/** Microseconds since the oldest operation in the retry queue was scheduled */
+#define METRICS_RETRYQ_AGE_METER_NAME "db.couchbase.retry_queue.age"
+/** Bytes held by the idle buffers of the pipelines, recorded on every idle trim */
+#define METRICS_MEMORY_IDLE_METER_NAME "db.couchbase.memory.idle"
+/** Bytes of idle buffers freed by every idle trim */
+#define METRICS_MEMORY_TRIMMED_METER_NAME "db.couchbase.memory.trimmed"
+#define METRICS_KV_QUEUE_METER_NAME "db.couchbase.kv.queue"
+#define METRICS_KV_NETWORK_METER_NAME "db.couchbase.kv.network"
+#define METRICS_KV_SERVER_METER_NAME "db.couchbase.kv.server"
+#define METRICS_KV_CALLBACK_METER_NAME "db.couchbase.kv.callback"
+#define METRICS_KV_HOT_KEY_METER_NAME "db.couchbase.kv.hot_key"
+#define METRICS_KV_HOT_VBUCKET_METER_NAME "db.couchbase.kv.hot_vbucket"
+#define METRICS_KV_NODE_SKEW_METER_NAME "db.couchbase.kv.node_skew"
+#define METRICS_COLLECTION_ID_TAG_NAME "db.couchbase.collection_id"
+#define METRICS_DOCUMENT_TAG_NAME "db.couchbase.document"
+#define METRICS_VBUCKET_TAG_NAME "db.couchbase.vbucket"
+
+/** Whether the KV operations are recorded by the meter, never in builds with LCB_NO_METRICS */
+#ifdef LCB_NO_METRICS
+#define METRICS_KV_ENABLED(settings) 0
+#else
+#define METRICS_KV_ENABLED(settings) ((settings)->op_metrics_enabled && (settings)->meter != NULL)
+#endif
+
+/**
+ * Whether the time KV packets are written is recorded, so that their latency
+ * can be broken down into time spent in the pipeline, on the network, in the
+ * server and in the callback
+ */
+#ifdef LCB_NO_TRACING
+#define METRICS_KV_BREAKDOWN_ENABLED(settings) METRICS_KV_ENABLED(settings)
+#else
+#define METRICS_KV_BREAKDOWN_ENABLED(settings) ((settings)->tracer != NULL || METRICS_KV_ENABLED(settings))
+#endif
 
 struct lcbmetrics_VALUERECORDER_ {
     void *cookie_;
@@ -37,8 +79,75 @@ struct lcbmetrics_METER_ {
     lcbmetrics_VALUE_RECORDER_CALLBACK value_recorder_;
 };
 
-void record_kv_op_latency(const char *op, lcb_INSTANCE *instance, mc_PACKET *request);
+/**
+ * KV operations whose latency is recorded. The recorder of each is looked up
+ * from the meter once per instance and kept in lcb_INSTANCE::kv_op_recorders.
+ */
+typedef enum {
+    METRICS_KV_OP_GET = 0,
+    METRICS_KV_OP_EXISTS,
+    METRICS_KV_OP_LOOKUP_IN,
+    METRICS_KV_OP_MUTATE_IN,
+    METRICS_KV_OP_REMOVE,
+    METRICS_KV_OP_INSERT,
+    METRICS_KV_OP_REPLACE,
+    METRICS_KV_OP_APPEND,
+    METRICS_KV_OP_PREPEND,
+    METRICS_KV_OP_UPSERT,
+    METRICS_KV_OP_ARITHMETIC,
+    METRICS_KV_OP_TOUCH,
+    METRICS_KV_OP_UNLOCK,
+    METRICS_KV_OP_UNKNOWN,
+    METRICS_KV_OP__MAX
+} lcb_METRICS_KV_OP;
+
+#ifdef LCB_NO_METRICS
+/* the KV operations are not metered in this build, so that the hot path carries no hooks */
+static inline void record_kv_op_latency(lcb_METRICS_KV_OP op, lcb_INSTANCE *instance, mc_PACKET *request)
+{
+    (void)op;
+    (void)instance;
+    (void)request;
+}
+#else
+void record_kv_op_latency(lcb_METRICS_KV_OP op, lcb_INSTANCE *instance, mc_PACKET *request);
+#endif
+
+/** The parts of a KV operation's latency, see record_kv_op_breakdown() */
+typedef enum {
+    METRICS_KV_PHASE_QUEUE = 0,
+    METRICS_KV_PHASE_NETWORK,
+    METRICS_KV_PHASE_SERVER,
+    METRICS_KV_PHASE_CALLBACK,
+    METRICS_KV_PHASE__MAX
+} lcb_METRICS_KV_PHASE;
+
+/**
+ * Record how long the request waited in the pipeline until it was written,
+ * how long it was on the network (not counting the server duration reported
+ * by the server), how long it was in the server and how long the callback took
+ * @param server_duration the server duration in nanoseconds, zero if unknown
+ * @param done when the callback returned
+ */
+#ifdef LCB_NO_METRICS
+static inline void record_kv_op_breakdown(lcb_INSTANCE *instance, mc_PACKET *request, hrtime_t server_duration,
+                                          hrtime_t done)
+{
+    (void)instance;
+    (void)request;
+    (void)server_duration;
+    (void)done;
+}
+static inline void record_kv_op_latency_store(lcb_INSTANCE *instance, mc_PACKET *request, lcb_RESPSTORE *response)
+{
+    (void)instance;
+    (void)request;
+    (void)response;
+}
+#else
+void record_kv_op_breakdown(lcb_INSTANCE *instance, mc_PACKET *request, hrtime_t server_duration, hrtime_t done);
 void record_kv_op_latency_store(lcb_INSTANCE *instance, mc_PACKET *request, lcb_RESPSTORE *response);
+#endif
 void record_http_op_latency(const char *op, const char *svc, lcb_INSTANCE *instance, hrtime_t start);
 
 #endif // LCB_METRICS_INTERNAL_H
@@ -0,0 +1,198 @@
+/*
+ *     Copyright 2024 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "internal.h"
+#include "openmetrics_meter.hh"
+
+#include <vector>
+
+using namespace lcb::metrics;
+
+extern "C" {
+static void omm_destructor(const lcbmetrics_METER *wrapper)
+{
+    if (wrapper != nullptr && wrapper->cookie_ != nullptr) {
+        auto *meter = reinterpret_cast<OpenMetricsMeter *>(wrapper->cookie_);
+        delete meter;
+    }
+}
+
+static const lcbmetrics_VALUERECORDER *omm_find_value_recorder(const lcbmetrics_METER *wrapper, const char *name,
+                                                               const lcbmetrics_TAG *tags, size_t ntags)
+{
+    if (wrapper == nullptr || wrapper->cookie_ == nullptr) {
+        return nullptr;
+    }
+
+    auto *meter = reinterpret_cast<OpenMetricsMeter *>(wrapper->cookie_);
+    return meter->findValueRecorder(name, tags, ntags);
+}
+
+static void omvr_record_value(const lcbmetrics_VALUERECORDER *wrapper, uint64_t value)
+{
+    if (wrapper == nullptr || wrapper->cookie_ == nullptr) {
+        return;
+    }
+
+    reinterpret_cast<OpenMetricsHistogram *>(wrapper->cookie_)->record(value);
+}
+}
+
+constexpr std::size_t OpenMetricsHistogram::nbuckets;
+
+void OpenMetricsHistogram::render(const std::string &name, const std::string &labels, std::string &out) const
+{
+    std::uint64_t total = 0;
+    for (std::size_t ii = 0; ii <= nbuckets; ii++) {
+        total += counts_[ii].load(std::memory_order_relaxed);
+        out.append(name).append("_bucket{").append(labels).append("le=\"");
+        out.append(ii < nbuckets ? std::to_string(upper_bound(ii)) : "+Inf");
+        out.append("\"} ").append(std::to_string(total)).append("\n");
+    }
+
+    std::string braced;
+    if (!labels.empty()) {
+        braced.append("{").append(labels, 0, labels.size() - 1).append("}");
+    }
+    out.append(name).append("_count").append(braced).append(" ").append(std::to_string(total)).append("\n");
+    out.append(name).append("_sum").append(braced).append(" ");
+    out.append(std::to_string(sum_.load(std::memory_order_relaxed))).append("\n");
+}
+
+const lcbmetrics_METER *OpenMetricsMeter::wrap()
+{
+    if (wrapper_ != nullptr) {
+        return wrapper_;
+    }
+
+    wrapper_ = new lcbmetrics_METER();
+    wrapper_->cookie_ = this;
+    wrapper_->destructor_ = omm_destructor;
+    wrapper_->value_recorder_ = omm_find_value_recorder;
+    return wrapper_;
+}
+
+const OpenMetricsMeter *OpenMetricsMeter::unwrap(const lcbmetrics_METER *meter)
+{
+    if (meter == nullptr || meter->destructor_ != omm_destructor) {
+        return nullptr;
+    }
+    return reinterpret_cast<const OpenMetricsMeter *>(meter->cookie_);
+}
+
+std::string OpenMetricsMeter::sanitize(const char *name)
+{
+    std::string sanitized(name);
+    for (std::size_t ii = 0; ii < sanitized.size(); ii++) {
+        char c = sanitized[ii];
+        bool allowed = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || (ii > 0 && c >= '0' && c <= '9');
+        if (!allowed) {
+            sanitized[ii] = '_';
+        }
+    }
+    return sanitized;
+}
+
+const lcbmetrics_VALUERECORDER *OpenMetricsMeter::findValueRecorder(const char *name, const lcbmetrics_TAG *tags,
+                                                                    size_t ntags)
+{
+    std::string labels;
+    for (size_t ii = 0; ii < ntags; ++ii) {
+        labels.append(sanitize(tags[ii].key)).append("=\"");
+        for (const char *c = tags[ii].value; *c != '\0'; c++) {
+            switch (*c) {
+                case '\\':
+                    labels.append("\\\\");
+                    break;
+                case '"':
+                    labels.append("\\\"");
+                    break;
+                case '\n':
+                    labels.append("\\n");
+                    break;
+                default:
+                    labels.push_back(*c);
+            }
+        }
+        labels.append("\",");
+    }
+
+    OpenMetricsHistogram *histogram;
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        auto &slot = histograms_[sanitize(name)][labels];
+        if (!slot) {
+            slot.reset(new OpenMetricsHistogram());
+        }
+        histogram = slot.get();
+    }
+
+    lcbmetrics_VALUERECORDER *recorder = nullptr;
+    lcbmetrics_valuerecorder_create(&recorder, histogram);
+    lcbmetrics_valuerecorder_record_value_callback(recorder, omvr_record_value);
+    return recorder;
+}
+
+std::string OpenMetricsMeter::render() const
+{
+    struct Series {
+        const std::string *name;
+        const std::string *labels;
+        const OpenMetricsHistogram *histogram;
+    };
+    /* histograms are never removed and map nodes do not move, so only the lookup needs the lock */
+    std::vector<Series> series;
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        for (const auto &metric : histograms_) {
+            for (const auto &labelled : metric.second) {
+                series.push_back({&metric.first, &labelled.first, labelled.second.get()});
+            }
+        }
+    }
+
+    std::string out;
+    const std::string *previous = nullptr;
+    for (const auto &item : series) {
+        if (item.name != previous) {
+            out.append("# TYPE ").append(*item.name).append(" histogram\n");
+            previous = item.name;
+        }
+        item.histogram->render(*item.name, *item.labels, out);
+    }
+    out.append("# EOF\n");
+    return out;
+}
+
+LIBCOUCHBASE_API
+lcb_STATUS lcbmetrics_openmetrics_create(lcbmetrics_METER **meter)
+{
+    *meter = const_cast<lcbmetrics_METER *>((new OpenMetricsMeter())->wrap());
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API
+lcb_STATUS lcbmetrics_openmetrics_render(const lcbmetrics_METER *meter, lcbmetrics_OPENMETRICS_CALLBACK callback,
+                                         void *cookie)
+{
+    const OpenMetricsMeter *openmetrics = OpenMetricsMeter::unwrap(meter);
+    if (openmetrics == nullptr || callback == nullptr) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    std::string text = openmetrics->render();
+    callback(cookie, text.c_str(), text.size());
+    return LCB_SUCCESS;
+}
@@ -0,0 +1,113 @@
+/*
+ *     Copyright 2024 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCB_OPENMETRICSMETER_HH
+#define LCB_OPENMETRICSMETER_HH
+
+#include "metrics/metrics-internal.h"
+#include <libcouchbase/metrics.h>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace lcb
+{
+namespace metrics
+{
+
+/**
+ * Histogram of the values of one recorder. Buckets are bounded by the powers
+ * of 4, so that the bucket of a value follows from its bit length.
+ */
+class OpenMetricsHistogram
+{
+  public:
+    /** Number of finite buckets, the last one bounded by 4^(nbuckets - 1) */
+    static constexpr std::size_t nbuckets = 21;
+
+    static std::size_t bucket_of(std::uint64_t value)
+    {
+        if (value <= 1) {
+            return 0;
+        }
+        /* bit length of value - 1, i.e. ceil(log2(value)) */
+#if defined(__GNUC__) || defined(__clang__)
+        std::size_t bits = 64 - __builtin_clzll(value - 1);
+#else
+        std::size_t bits = 0;
+        for (std::uint64_t rest = value - 1; rest != 0; rest >>= 1) {
+            bits++;
+        }
+#endif
+        std::size_t index = (bits + 1) / 2;
+        return index < nbuckets ? index : nbuckets;
+    }
+
+    static std::uint64_t upper_bound(std::size_t index)
+    {
+        return std::uint64_t(1) << (2 * index);
+    }
+
+    void record(std::uint64_t value)
+    {
+        counts_[bucket_of(value)].fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    /** Append the samples of the histogram, labelled with `labels` (empty or ending with a comma) */
+    void render(const std::string &name, const std::string &labels, std::string &out) const;
+
+  private:
+    /** The last one counts the values above every bound */
+    std::atomic<std::uint64_t> counts_[nbuckets + 1]{};
+    std::atomic<std::uint64_t> sum_{0};
+};
+
+/**
+ * Meter keeping a histogram per name and set of tags, which may be rendered
+ * in the OpenMetrics text format from any thread, see lcbmetrics_openmetrics_create()
+ */
+class OpenMetricsMeter
+{
+  public:
+    const lcbmetrics_METER *wrap();
+
+    /** @return a new recorder, which may be destroyed while the histogram lives on with the meter */
+    const lcbmetrics_VALUERECORDER *findValueRecorder(const char *name, const lcbmetrics_TAG *tags, size_t ntags);
+
+    std::string render() const;
+
+    /** @return the meter wrapped by @p meter, or nullptr if it is of another kind */
+    static const OpenMetricsMeter *unwrap(const lcbmetrics_METER *meter);
+
+    /** Replace the characters not allowed in metric and label names */
+    static std::string sanitize(const char *name);
+
+  protected:
+    lcbmetrics_METER *wrapper_{nullptr};
+    /** Guards the maps only, the histograms are updated without it */
+    mutable std::mutex mutex_;
+    /** Histograms by name and by rendered labels, ordered so that the samples of a metric are contiguous */
+    std::map<std::string, std::map<std::string, std::unique_ptr<OpenMetricsHistogram>>> histograms_;
+};
+
+} // namespace metrics
+} // namespace lcb
+
+#endif // LCB_OPENMETRICSMETER_HH
@@ -70,4 +70,19 @@
 LIBCOUCHBASE_API
 const lcb_MUTATION_TOKEN *lcb_get_mutation_token(lcb_INSTANCE *instance, const lcb_KEYBUF *kb, lcb_STATUS *errp);
 
+/**
+ * @volatile
+ *
+ * Retrieves the last mutation token of every vBucket at once, as an array
+ * indexed by vBucket ID. The entries of the vBuckets which were not mutated
+ * are zeroed.
+ *
+ * @param instance the instance
+ * @param[out] ntokens set to the number of entries
+ * @param[out] errp Set to an error if this function returns NULL
+ * @return The mutation tokens if successful, otherwise NULL.
+ */
+LIBCOUCHBASE_API
+const lcb_MUTATION_TOKEN *lcb_get_mutation_tokens(lcb_INSTANCE *instance, size_t *ntokens, lcb_STATUS *errp);
+
 #endif // LIBCOUCHBASE_MUTATION_TOKEN_HH
@@ -17,6 +17,7 @@
 #define NOMINMAX
 #include <libcouchbase/ixmgmt.h>
 #include <string>
+#include <map>
 #include <set>
 #include <algorithm>
 
@@ -469,27 +470,51 @@ class ListIndexCtx_BuildIndex : public ListIndexCtx
   public:
     inline void invoke(lcb_INSTANCE *instance, lcb_RESPN1XMGMT *resp) override;
     inline lcb_STATUS try_build(lcb_INSTANCE *instance);
+    inline void build_done(lcb_INSTANCE *instance, lcb_RESPN1XMGMT *resp);
+
+    // Called once all the BUILD INDEX statements have completed
+    virtual void built(lcb_INSTANCE *instance, lcb_RESPN1XMGMT *resp)
+    {
+        finish(instance, resp);
+    }
+
+  private:
+    // Statements in flight, one for each keyspace
+    size_t m_nbuilds{0};
+    lcb_STATUS m_rc{LCB_SUCCESS};
 };
 
 static void cb_build_submitted(lcb_INSTANCE *instance, int, const lcb_RESPQUERY *resp)
 {
-    auto *ctx = reinterpret_cast<ListIndexCtx *>(resp->cookie);
+    auto *ctx = reinterpret_cast<ListIndexCtx_BuildIndex *>(resp->cookie);
 
     if (resp->rflags & LCB_RESP_F_FINAL) {
         lcb_RESPN1XMGMT w_resp{};
         if ((w_resp.rc = resp->ctx.rc) == LCB_SUCCESS) {
             w_resp.rc = get_n1ql_error(resp->row, resp->nrow);
         }
-        ctx->finish(instance, &w_resp);
+        w_resp.inner = resp;
+        ctx->build_done(instance, &w_resp);
+    }
+}
+
+static bool is_deferred(const lcb_N1XSPEC *spec)
+{
+    if (spec->nstate == 0) {
+        return false;
     }
+    string state(spec->state, spec->nstate);
+    return state == "pending" || state == "deferred";
 }
 
 lcb_STATUS ListIndexCtx_BuildIndex::try_build(lcb_INSTANCE *instance)
 {
-    vector<IndexSpec *> pending;
+    // All the indexes of a keyspace are built by the same statement, and the
+    // statements of the keyspaces are issued at once
+    std::map<string, vector<IndexSpec *>> pending;
     for (auto spec : specs) {
-        if (strncmp(spec->state, "pending", spec->nstate) == 0 || strncmp(spec->state, "deferred", spec->nstate) == 0) {
-            pending.push_back(spec);
+        if (is_deferred(spec)) {
+            pending[string(spec->keyspace, spec->nkeyspace)].push_back(spec);
         }
     }
 
@@ -497,34 +522,63 @@ lcb_STATUS ListIndexCtx_BuildIndex::try_build(lcb_INSTANCE *instance)
         return LCB_ERR_DOCUMENT_NOT_FOUND;
     }
 
-    string ss;
-    ss = "BUILD INDEX ON `";
-
-    ss.append(pending[0]->keyspace, pending[0]->nkeyspace).append("`");
-    ss += '(';
-    for (size_t ii = 0; ii < pending.size(); ++ii) {
-        ss += '`';
-        ss.append(pending[ii]->name, pending[ii]->nname);
-        ss += '`';
-        if (ii + 1 < pending.size()) {
-            ss += ',';
+    vector<IndexSpec *> building;
+    for (auto &keyspace : pending) {
+        const vector<IndexSpec *> &indexes = keyspace.second;
+        string ss;
+        ss = "BUILD INDEX ON `";
+
+        ss.append(keyspace.first).append("`");
+        ss += '(';
+        for (size_t ii = 0; ii < indexes.size(); ++ii) {
+            ss += '`';
+            ss.append(indexes[ii]->name, indexes[ii]->nname);
+            ss += '`';
+            if (ii + 1 < indexes.size()) {
+                ss += ',';
+            }
+        }
+        ss += ')';
+
+        lcb_STATUS rc =
+            dispatch_common<ListIndexCtx_BuildIndex>(instance, cookie, callback, cb_build_submitted, ss, this);
+        if (rc != LCB_SUCCESS) {
+            if (m_nbuilds == 0) {
+                return rc;
+            }
+            // The statements already in flight complete the operation
+            m_rc = rc;
+            break;
         }
+        m_nbuilds++;
+        building.insert(building.end(), indexes.begin(), indexes.end());
     }
-    ss += ')';
 
-    lcb_STATUS rc = dispatch_common<ListIndexCtx_BuildIndex>(instance, cookie, callback, cb_build_submitted, ss, this);
+    std::set<IndexSpec *> to_remove(specs.begin(), specs.end());
+    for (auto &ii : building) {
+        to_remove.erase(ii);
+    }
 
-    if (rc == LCB_SUCCESS) {
-        std::set<IndexSpec *> to_remove(specs.begin(), specs.end());
-        for (auto &ii : pending) {
-            to_remove.erase(ii);
-        }
+    std::for_each(to_remove.begin(), to_remove.end(), my_delete<IndexSpec *>);
 
-        std::for_each(to_remove.begin(), to_remove.end(), my_delete<IndexSpec *>);
+    specs = building;
+    return LCB_SUCCESS;
+}
 
-        specs = pending;
+void ListIndexCtx_BuildIndex::build_done(lcb_INSTANCE *instance, lcb_RESPN1XMGMT *resp)
+{
+    if (resp->rc != LCB_SUCCESS && m_rc == LCB_SUCCESS) {
+        m_rc = resp->rc;
     }
-    return rc;
+    if (--m_nbuilds != 0) {
+        return;
+    }
+    if (resp->rc == LCB_SUCCESS && m_rc != LCB_SUCCESS) {
+        // The statement which failed is not this one
+        resp->rc = m_rc;
+        resp->inner = nullptr;
+    }
+    built(instance, resp);
 }
 
 void ListIndexCtx_BuildIndex::invoke(lcb_INSTANCE *instance, lcb_RESPN1XMGMT *resp)
@@ -550,6 +604,8 @@ struct WatchIndexCtx : public IndexOpCtx {
     // Interval timer
     lcbio_pTIMER m_timer;
     uint32_t m_interval;
+    // The interval doubles after every check, up to this
+    uint32_t m_max_interval;
     uint64_t m_tsend;
     lcb_INSTANCE *m_instance;
     std::map<std::string, IndexSpec *> m_defspend;
@@ -559,7 +615,7 @@ struct WatchIndexCtx : public IndexOpCtx {
     inline void reschedule();
     inline lcb_STATUS do_poll();
     inline lcb_STATUS load_defs(const lcb_CMDN1XWATCH *);
-    inline WatchIndexCtx(lcb_INSTANCE *, const void *, const lcb_CMDN1XWATCH *);
+    inline WatchIndexCtx(lcb_INSTANCE *, const void *, const lcb_CMDN1XWATCH *, uint32_t max_interval);
     inline ~WatchIndexCtx();
     inline void finish(lcb_STATUS rc, const lcb_RESPN1XMGMT *);
 };
@@ -567,24 +623,24 @@ struct WatchIndexCtx : public IndexOpCtx {
 static void cb_watchix_tm(void *arg)
 {
     auto *ctx = reinterpret_cast<WatchIndexCtx *>(arg);
-    uint64_t now = lcb_nstime();
-    if (now >= ctx->m_tsend) {
-        ctx->finish(LCB_ERR_TIMEOUT, nullptr);
-    } else {
-        ctx->do_poll();
+    lcb_STATUS rc = ctx->do_poll();
+    if (rc != LCB_SUCCESS) {
+        ctx->finish(rc, nullptr);
     }
 }
 
 #define DEFAULT_WATCH_TIMEOUT LCB_S2US(30)
 #define DEFAULT_WATCH_INTERVAL LCB_MS2US(500)
 
-WatchIndexCtx::WatchIndexCtx(lcb_INSTANCE *instance, const void *cookie_, const lcb_CMDN1XWATCH *cmd)
+WatchIndexCtx::WatchIndexCtx(lcb_INSTANCE *instance, const void *cookie_, const lcb_CMDN1XWATCH *cmd,
+                             uint32_t max_interval)
     : IndexOpCtx(), m_instance(instance)
 {
     uint64_t now = lcb_nstime();
     uint32_t timeout = cmd->timeout ? cmd->timeout : DEFAULT_WATCH_TIMEOUT;
     m_interval = cmd->interval ? cmd->interval : DEFAULT_WATCH_INTERVAL;
     m_interval = std::min(m_interval, timeout);
+    m_max_interval = std::max(m_interval, max_interval);
     m_tsend = now + LCB_US2NS(timeout);
 
     this->callback = cmd->callback;
@@ -703,13 +759,15 @@ void WatchIndexCtx::finish(lcb_STATUS rc, const lcb_RESPN1XMGMT *resp)
 
 void WatchIndexCtx::reschedule()
 {
-    // Next interval!
+    // Next interval! The last check happens at the deadline
     uint64_t now = lcb_nstime();
-    if (now + LCB_US2NS(m_interval) >= m_tsend) {
+    if (now >= m_tsend) {
         finish(LCB_ERR_TIMEOUT, nullptr);
-    } else {
-        lcbio_timer_rearm(m_timer, m_interval);
+        return;
     }
+    uint64_t remaining = LCB_NS2US(m_tsend - now);
+    lcbio_timer_rearm(m_timer, static_cast<uint32_t>(std::min<uint64_t>(m_interval, remaining)));
+    m_interval = static_cast<uint32_t>(std::min<uint64_t>(uint64_t(m_interval) * 2, m_max_interval));
 }
 
 static void cb_watch_gotlist(lcb_INSTANCE *, int, const lcb_RESPN1XMGMT *resp)
@@ -720,19 +778,41 @@ static void cb_watch_gotlist(lcb_INSTANCE *, int, const lcb_RESPN1XMGMT *resp)
 
 lcb_STATUS WatchIndexCtx::do_poll()
 {
-    lcb_CMDN1XMGMT cmd;
-    memset(&cmd, 0, sizeof cmd);
-    cmd.callback = cb_watch_gotlist;
     lcb_log(LOGARGS(this, DEBUG), LOGFMT "Will check for index readiness of %lu indexes. %lu completed", LOGID(this),
             (unsigned long int)m_defspend.size(), (unsigned long int)m_defsok.size());
 
-    return do_index_list(m_instance, this, &cmd, nullptr);
+    // A single query fetches the state of all the indexes still pending,
+    // and of those only
+    std::map<string, vector<string>> names;
+    for (auto &ii : m_defspend) {
+        const IndexSpec *spec = ii.second;
+        names[string(spec->keyspace, spec->nkeyspace)].push_back(string(spec->name, spec->nname));
+    }
+
+    string ss;
+    ss = "SELECT idx.name, idx.keyspace_id, idx.namespace_id, idx.state, idx.`using`, idx.is_primary"
+         " FROM system:indexes idx WHERE";
+    for (auto it = names.begin(); it != names.end(); ++it) {
+        if (it != names.begin()) {
+            ss.append(" OR");
+        }
+        ss.append(" (keyspace_id=").append(Json::valueToQuotedString(it->first.c_str())).append(" AND name IN [");
+        for (size_t ii = 0; ii < it->second.size(); ++ii) {
+            if (ii != 0) {
+                ss += ',';
+            }
+            ss.append(Json::valueToQuotedString(it->second[ii].c_str()));
+        }
+        ss.append("])");
+    }
+
+    return dispatch_common<ListIndexCtx>(m_instance, this, cb_watch_gotlist, cb_index_list, ss);
 }
 
-LIBCOUCHBASE_API
-lcb_STATUS lcb_n1x_watchbuild(lcb_INSTANCE *instance, const void *cookie, const lcb_CMDN1XWATCH *cmd)
+static lcb_STATUS start_watch(lcb_INSTANCE *instance, const void *cookie, const lcb_CMDN1XWATCH *cmd,
+                              uint32_t max_interval)
 {
-    auto *ctx = new WatchIndexCtx(instance, cookie, cmd);
+    auto *ctx = new WatchIndexCtx(instance, cookie, cmd, max_interval);
     lcb_STATUS rc = ctx->load_defs(cmd);
     if (rc != LCB_SUCCESS) {
         delete ctx;
@@ -746,6 +826,89 @@ lcb_STATUS lcb_n1x_watchbuild(lcb_INSTANCE *instance, const void *cookie, const
     return LCB_SUCCESS;
 }
 
+LIBCOUCHBASE_API
+lcb_STATUS lcb_n1x_watchbuild(lcb_INSTANCE *instance, const void *cookie, const lcb_CMDN1XWATCH *cmd)
+{
+    return start_watch(instance, cookie, cmd, 0);
+}
+
+#define DEFAULT_BUILDALL_TIMEOUT LCB_S2US(300)
+#define DEFAULT_BUILDALL_MAX_INTERVAL LCB_S2US(10)
+
+class BuildAllIndexCtx : public ListIndexCtx_BuildIndex
+{
+  public:
+    explicit BuildAllIndexCtx(const lcb_CMDN1XBUILDALL *cmd)
+    {
+        uint32_t timeout = cmd->timeout ? cmd->timeout : DEFAULT_BUILDALL_TIMEOUT;
+        m_tsend = lcb_nstime() + LCB_US2NS(timeout);
+        m_interval = cmd->interval;
+        m_max_interval = cmd->max_interval ? cmd->max_interval : DEFAULT_BUILDALL_MAX_INTERVAL;
+    }
+
+    void invoke(lcb_INSTANCE *instance, lcb_RESPN1XMGMT *resp) override
+    {
+        if (resp->rc == LCB_SUCCESS) {
+            resp->rc = try_build(instance);
+            if (resp->rc == LCB_SUCCESS) {
+                return;
+            }
+            if (resp->rc == LCB_ERR_DOCUMENT_NOT_FOUND) {
+                // Nothing to build
+                std::for_each(specs.begin(), specs.end(), my_delete<IndexSpec *>);
+                specs.clear();
+                resp->rc = LCB_SUCCESS;
+            }
+        }
+        finish(instance, resp);
+    }
+
+    void built(lcb_INSTANCE *instance, lcb_RESPN1XMGMT *resp) override
+    {
+        uint64_t now = lcb_nstime();
+        if (resp->rc == LCB_SUCCESS && now >= m_tsend) {
+            resp->rc = LCB_ERR_TIMEOUT;
+        }
+        if (resp->rc != LCB_SUCCESS) {
+            finish(instance, resp);
+            return;
+        }
+
+        // The watch takes over the callback, and the rest of the timeout
+        lcb_CMDN1XWATCH wcmd{};
+        wcmd.specs = reinterpret_cast<const lcb_N1XSPEC *const *>(specs.data());
+        wcmd.nspec = specs.size();
+        wcmd.timeout = std::max<uint32_t>(1, static_cast<uint32_t>(LCB_NS2US(m_tsend - now)));
+        wcmd.interval = m_interval;
+        wcmd.callback = callback;
+        if ((resp->rc = start_watch(instance, cookie, &wcmd, m_max_interval)) != LCB_SUCCESS) {
+            finish(instance, resp);
+            return;
+        }
+        delete this;
+    }
+
+  private:
+    uint64_t m_tsend;
+    uint32_t m_interval;
+    uint32_t m_max_interval;
+};
+
+LIBCOUCHBASE_API
+lcb_STATUS lcb_n1x_buildall(lcb_INSTANCE *instance, const void *cookie, const lcb_CMDN1XBUILDALL *cmd)
+{
+    lcb_CMDN1XMGMT list_cmd{};
+    list_cmd.spec = cmd->spec;
+    list_cmd.callback = cmd->callback;
+
+    auto *ctx = new BuildAllIndexCtx(cmd);
+    lcb_STATUS rc = do_index_list(instance, cookie, &list_cmd, ctx);
+    if (rc != LCB_SUCCESS) {
+        delete ctx;
+    }
+    return rc;
+}
+
 void IndexSpec::load_json(const char *s, size_t n)
 {
     Json::Value root;
@@ -0,0 +1,211 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LIBCOUCHBASE_N1QL_MUTATION_STATE_HH
+#define LIBCOUCHBASE_N1QL_MUTATION_STATE_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <libcouchbase/couchbase.h>
+#include "contrib/lcb-jsoncpp/lcb-jsoncpp.h"
+
+/**
+ * The mutation tokens an at_plus query has to be consistent with, i.e. its
+ * "scan_vectors". Each keyspace keeps one slot per vBucket, so adding a token
+ * replaces an older one of the same vBucket, and the vectors are written
+ * straight into the request body instead of being built as a JSON tree.
+ */
+class MutationState
+{
+  public:
+    /** Slots allocated up front for each keyspace, as many as the usual number of vBuckets */
+    static constexpr std::size_t default_vbuckets = 1024;
+
+    /** Keep `token` unless the state has a newer one for its vBucket */
+    void add(const char *keyspace, std::size_t keyspace_len, const lcb_MUTATION_TOKEN &token)
+    {
+        Keyspace &ks = keyspace_for(keyspace, keyspace_len);
+        if (token.vbid_ >= ks.vbuckets.size()) {
+            ks.vbuckets.resize(token.vbid_ + 1U);
+        }
+        Slot &slot = ks.vbuckets[token.vbid_];
+        if (slot.seqno == 0) {
+            ks.used++;
+        } else if (slot.seqno >= token.seqno_) {
+            return;
+        }
+        slot.uuid = token.uuid_;
+        slot.seqno = token.seqno_;
+    }
+
+    /**
+     * Add every token of `tokens`, an array indexed by vBucket as
+     * lcb_INSTANCE::dcpinfo. Empty entries are skipped.
+     */
+    void add_all(const char *keyspace, std::size_t keyspace_len, const lcb_MUTATION_TOKEN *tokens,
+                 std::size_t ntokens)
+    {
+        for (std::size_t ii = 0; ii < ntokens; ii++) {
+            if (tokens[ii].seqno_ != 0 || tokens[ii].uuid_ != 0) {
+                lcb_MUTATION_TOKEN token = tokens[ii];
+                token.vbid_ = static_cast<std::uint16_t>(ii);
+                add(keyspace, keyspace_len, token);
+            }
+        }
+    }
+
+    bool empty() const
+    {
+        return keyspaces_.empty();
+    }
+
+    void clear()
+    {
+        keyspaces_.clear();
+    }
+
+    /** Append the "scan_vectors" member (name included) to `out` */
+    void write_scan_vectors(std::string &out) const
+    {
+        std::size_t nslots = 0;
+        for (const auto &ks : keyspaces_) {
+            nslots += ks.used;
+        }
+        /* "vbid":[seqno,"uuid"], at most 5 + 20 + 20 characters of digits */
+        out.reserve(out.size() + 20 + nslots * 56);
+        out += "\"scan_vectors\":{";
+        bool first_keyspace = true;
+        for (const auto &ks : keyspaces_) {
+            if (!first_keyspace) {
+                out += ',';
+            }
+            first_keyspace = false;
+            out += Json::valueToQuotedString(ks.name.c_str());
+            out += ":{";
+            bool first_slot = true;
+            for (std::size_t vbid = 0; vbid < ks.vbuckets.size(); vbid++) {
+                const Slot &slot = ks.vbuckets[vbid];
+                if (slot.seqno == 0) {
+                    continue;
+                }
+                if (!first_slot) {
+                    out += ',';
+                }
+                first_slot = false;
+                out += '"';
+                append_number(out, vbid);
+                out += "\":[";
+                append_number(out, slot.seqno);
+                out += ",\"";
+                append_number(out, slot.uuid);
+                out += "\"]";
+            }
+            out += '}';
+        }
+        out += '}';
+    }
+
+    /** Insert the "scan_vectors" member into `body`, see splice_member() */
+    void splice_scan_vectors(std::string &body) const
+    {
+        if (!empty()) {
+            std::string member;
+            write_scan_vectors(member);
+            splice_member(body, member);
+        }
+    }
+
+    /**
+     * Insert a serialized member (`"name":value`) into `body`, a serialized
+     * JSON object with or without a trailing newline.
+     */
+    static void splice_member(std::string &body, const std::string &member)
+    {
+        std::size_t end = body.find_last_of('}');
+        if (end == std::string::npos || end == 0) {
+            return;
+        }
+        std::size_t last = body.find_last_not_of(" \t\r\n", end - 1);
+        std::string tail = body.substr(end);
+        body.resize(end);
+        if (last != std::string::npos && body[last] != '{') {
+            body += ',';
+        }
+        body += member;
+        body += tail;
+    }
+
+    /** Merge the vectors into an existing "scan_vectors" member of a JSON tree */
+    void merge_into(Json::Value &scan_vectors) const
+    {
+        for (const auto &ks : keyspaces_) {
+            Json::Value &vectors = scan_vectors[ks.name];
+            for (std::size_t vbid = 0; vbid < ks.vbuckets.size(); vbid++) {
+                const Slot &slot = ks.vbuckets[vbid];
+                if (slot.seqno == 0) {
+                    continue;
+                }
+                Json::Value &vb = vectors[std::to_string(vbid)];
+                vb[0] = static_cast<Json::UInt64>(slot.seqno);
+                vb[1] = std::to_string(slot.uuid);
+            }
+        }
+    }
+
+  private:
+    struct Slot {
+        std::uint64_t uuid;
+        std::uint64_t seqno; /**< 0 if the slot is empty */
+    };
+
+    struct Keyspace {
+        std::string name;
+        std::vector<Slot> vbuckets;
+        std::size_t used;
+    };
+
+    Keyspace &keyspace_for(const char *name, std::size_t name_len)
+    {
+        for (auto &ks : keyspaces_) {
+            if (ks.name.size() == name_len && ks.name.compare(0, name_len, name, name_len) == 0) {
+                return ks;
+            }
+        }
+        keyspaces_.push_back(Keyspace{std::string(name, name_len), std::vector<Slot>(default_vbuckets, Slot{0, 0}), 0});
+        return keyspaces_.back();
+    }
+
+    static void append_number(std::string &out, std::uint64_t value)
+    {
+        char buf[20];
+        char *end = buf + sizeof(buf);
+        char *pos = end;
+        do {
+            *--pos = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (value != 0);
+        out.append(pos, end);
+    }
+
+    /** Usually a single keyspace, the bucket of the instance */
+    std::vector<Keyspace> keyspaces_{};
+};
+
+#endif // LIBCOUCHBASE_N1QL_MUTATION_STATE_HH
@@ -25,7 +25,13 @@ lcb_QUERY_CACHE *lcb_n1qlcache_create(void)
 
 void lcb_n1qlcache_destroy(lcb_QUERY_CACHE *cache)
 {
-    delete cache;
+    cache->unref();
+}
+
+lcb_QUERY_CACHE *lcb_n1qlcache_share(lcb_QUERY_CACHE *cache)
+{
+    cache->ref();
+    return cache;
 }
 
 void lcb_n1qlcache_clear(lcb_QUERY_CACHE *cache)
@@ -30,6 +30,7 @@ typedef struct lcb_QUERY_CACHE_ lcb_QUERY_CACHE;
 
 lcb_QUERY_CACHE *lcb_n1qlcache_create(void);
 void lcb_n1qlcache_destroy(lcb_QUERY_CACHE *);
+lcb_QUERY_CACHE *lcb_n1qlcache_share(lcb_QUERY_CACHE *);
 void lcb_n1qlcache_clear(lcb_QUERY_CACHE *);
 
 #ifdef __cplusplus
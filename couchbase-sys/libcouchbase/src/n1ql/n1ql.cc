@@ -20,6 +20,7 @@
 #include <libcouchbase/couchbase.h>
 #include "internal.h"
 #include "http/http.h"
+#include "http/http-priv.h"
 #include "logging.h"
 
 #include "query_handle.hh"
@@ -93,9 +94,9 @@ static lcb_STATUS query_schedule(lcb_INSTANCE *instance, lcb_QUERY_HANDLE_ *req)
             return LCB_ERR_INVALID_ARGUMENT;
         }
 
-        const Plan *cached = req->cache().get_entry(req->statement());
-        if (cached != nullptr) {
-            lcb_STATUS rc = req->apply_plan(*cached);
+        Plan cached;
+        if (req->cache().get_entry(req->statement(), cached)) {
+            lcb_STATUS rc = req->apply_plan(cached);
             if (rc != LCB_SUCCESS) {
                 return rc;
             }
@@ -176,3 +177,25 @@ LIBCOUCHBASE_API lcb_STATUS lcb_query_cancel(lcb_INSTANCE * /* instance */, lcb_
     }
     return LCB_SUCCESS;
 }
+
+LIBCOUCHBASE_API lcb_STATUS lcb_query_pause(lcb_INSTANCE * /* instance */, lcb_QUERY_HANDLE *handle)
+{
+    if (handle == nullptr || handle->is_cancelled()) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    if (handle->http_request() != nullptr) {
+        handle->http_request()->pause();
+    }
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_query_resume(lcb_INSTANCE * /* instance */, lcb_QUERY_HANDLE *handle)
+{
+    if (handle == nullptr || handle->is_cancelled()) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    if (handle->http_request() != nullptr) {
+        handle->http_request()->resume();
+    }
+    return LCB_SUCCESS;
+}
@@ -19,44 +19,139 @@
 #define LIBCOUCHBASE_N1QL_QUERY_CACHE_HH
 
 #include <cstddef>
+#include <cstring>
+#include <memory>
 #include <cstdint>
 #include <chrono>
 #include <string>
-#include <map>
-#include <list>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
 
+#include <libcouchbase/couchbase.h>
 #include "contrib/lcb-jsoncpp/lcb-jsoncpp.h"
 
 class Plan
 {
+  public:
+    /**
+     * The serialized form of the members of a request body which are the same
+     * for every execution of a statement (e.g. "query_context" or
+     * "scan_consistency"), together with the plan itself.
+     */
+    struct BodyTemplate {
+        Json::Value constants; /**< the members serialized into prefix */
+        std::string prefix;    /**< "{" followed by the plan and the constants */
+    };
+
   private:
     friend struct lcb_QUERY_CACHE_;
-    std::string key;
     std::string planstr;
-    explicit Plan(std::string k) : key(std::move(k)) {}
+    std::shared_ptr<const BodyTemplate> tmpl;
+
+    /**
+     * Members which usually differ between executions of the same statement,
+     * and are therefore serialized every time instead of being kept in the
+     * template.
+     */
+    static bool is_per_execution(const char *name, const char *end)
+    {
+        static const char *const names[] = {"timeout", "client_context_id", "args", "creds"};
+        if (end > name && *name == '$') {
+            return true; // named parameter
+        }
+        for (const char *ii : names) {
+            if (strlen(ii) == static_cast<size_t>(end - name) && memcmp(ii, name, end - name) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static bool is_statement(const char *name, const char *end)
+    {
+        return end - name == 9 && memcmp(name, "statement", 9) == 0;
+    }
+
+    static void append_member(std::string &out, const char *name, const char *end, const Json::Value &value)
+    {
+        out += ',';
+        out += Json::valueToQuotedString(std::string(name, end).c_str());
+        out += ':';
+        out += Json::FastWriter().write(value);
+    }
+
+    /** @return true if the constant members of body are the ones in tmpl */
+    bool template_matches(const Json::Value &body) const
+    {
+        if (!tmpl) {
+            return false;
+        }
+        Json::ArrayIndex nconstants = 0;
+        for (auto ii = body.begin(); ii != body.end(); ++ii) {
+            const char *end = nullptr;
+            const char *name = ii.memberName(&end);
+            if (is_statement(name, end) || is_per_execution(name, end)) {
+                continue;
+            }
+            const Json::Value *cached = tmpl->constants.find(name, end);
+            if (cached == nullptr || !(*cached == *ii)) {
+                return false;
+            }
+            nconstants++;
+        }
+        return nconstants == tmpl->constants.size();
+    }
 
   public:
     /**
      * Applies the plan to the output 'bodystr'. We don't assign the
      * Json::Value directly, as this appears to be horribly slow. On my system
      * an assignment took about 200ms!
-     * @param body The request body (e.g. lcb_QUERY_HANDLE_::json)
+     *
+     * The members which are the same for every execution of the statement are
+     * taken from the serialized template if they did not change, so that only
+     * the parameters, the timeout and the context ID are serialized.
+     *
+     * @param body The request body (e.g. lcb_QUERY_HANDLE_::json). The
+     *  statement itself is left out.
      * @param[out] bodystr the actual request payload
+     * @return a new template if the current one did not match the body, which
+     *  the caller should store in the cache (see lcb_QUERY_CACHE_::set_template)
      */
-    void apply_plan(Json::Value &body, std::string &bodystr) const
+    std::shared_ptr<const BodyTemplate> apply_plan(const Json::Value &body, std::string &bodystr) const
     {
-        body.removeMember("statement");
-        bodystr = Json::FastWriter().write(body);
+        std::shared_ptr<const BodyTemplate> built;
+        const BodyTemplate *use = tmpl.get();
 
-        // Assume bodystr ends with '}'
-        size_t pos = bodystr.rfind('}');
-        bodystr.erase(pos);
+        if (!template_matches(body)) {
+            auto *fresh = new BodyTemplate();
+            fresh->constants = Json::Value(Json::objectValue);
+            fresh->prefix = "{";
+            fresh->prefix += planstr;
+            for (auto ii = body.begin(); ii != body.end(); ++ii) {
+                const char *end = nullptr;
+                const char *name = ii.memberName(&end);
+                if (is_statement(name, end) || is_per_execution(name, end)) {
+                    continue;
+                }
+                fresh->constants[std::string(name, end)] = *ii;
+                append_member(fresh->prefix, name, end, *ii);
+            }
+            built.reset(fresh);
+            use = fresh;
+        }
 
-        if (!body.empty()) {
-            bodystr.append(",");
+        bodystr = use->prefix;
+        for (auto ii = body.begin(); ii != body.end(); ++ii) {
+            const char *end = nullptr;
+            const char *name = ii.memberName(&end);
+            if (is_per_execution(name, end)) {
+                append_member(bodystr, name, end, *ii);
+            }
         }
-        bodystr.append(planstr);
-        bodystr.append("}");
+        bodystr += '}';
+        return built;
     }
 
   private:
@@ -74,6 +169,7 @@ class Plan
             planstr += "\"encoded_plan\":";
             planstr += Json::FastWriter().write(plan["encoded_plan"]);
         }
+        tmpl.reset();
     }
 };
 
@@ -81,16 +177,48 @@ class Plan
  * @private
  */
 // LRU Cache structure..
+//
+// Entries live in the nodes of a hash table, and are linked into the LRU list
+// through pointers embedded in the entries themselves, so each statement costs
+// a single allocation. The cache may be shared by instances running on
+// different threads (see LCB_CNTL_QUERY_CACHE_SHARE), so every access holds
+// the mutex, for as long as a hash lookup, an LRU relink and a copy of the plan
+// take. Plans are returned by value for the same reason.
 struct lcb_QUERY_CACHE_ {
-    ~lcb_QUERY_CACHE_()
+    lcb_QUERY_CACHE_() = default;
+    lcb_QUERY_CACHE_(const lcb_QUERY_CACHE_ &) = delete;
+    lcb_QUERY_CACHE_ &operator=(const lcb_QUERY_CACHE_ &) = delete;
+
+    /** Default maximum number of entries, see LCB_CNTL_QUERY_CACHE_SIZE */
+    static size_t default_max_size()
     {
-        clear();
+        return 5000;
     }
 
-    /** Maximum number of entries in LRU cache. This is fixed at 5000 */
-    static size_t max_size()
+    size_t max_size()
     {
-        return 5000;
+        std::lock_guard<std::mutex> guard(mutex_);
+        return max_size_;
+    }
+
+    /**
+     * Changes the maximum number of entries, evicting the least recently used
+     * entries if there are more than that.
+     * @param n the new maximum, must be greater than zero
+     */
+    void set_max_size(size_t n)
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        max_size_ = n;
+        while (by_name_.size() > max_size_) {
+            evict_lru();
+        }
+    }
+
+    size_t size()
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        return by_name_.size();
     }
 
     /**
@@ -99,70 +227,177 @@ struct lcb_QUERY_CACHE_ {
      * @param json The prepared statement returned by the server
      * @return the newly added plan.
      */
-    const Plan &add_entry(const std::string &key, const Json::Value &json, bool include_encoded_plan = true)
+    Plan add_entry(const std::string &key, const Json::Value &json, bool include_encoded_plan = true)
     {
-        if (lru.size() == max_size()) {
-            // Purge entry from end
-            remove_entry(lru.back()->key);
-        }
-
-        // Remove old entry, if present
-        remove_entry(key);
+        Plan plan;
+        plan.set_plan(json, include_encoded_plan);
 
-        lru.push_front(new Plan(key));
-        by_name[key] = lru.begin();
-        lru.front()->set_plan(json, include_encoded_plan);
-        return *lru.front();
+        std::lock_guard<std::mutex> guard(mutex_);
+        auto res = by_name_.emplace(key, Entry());
+        Entry &ent = res.first->second;
+        if (res.second) {
+            ent.key = &res.first->first;
+            if (by_name_.size() > max_size_) {
+                evict_lru();
+            }
+        } else {
+            // Replace old entry
+            unlink(ent);
+        }
+        ent.plan = plan;
+        link_front(ent);
+        return plan;
     }
 
     /**
      * Gets the entry for a given key
      * @param key The statement (key) to look up
-     * @return a pointer to the plan if present, nullptr if no entry exists for key
+     * @param[out] plan receives a copy of the plan if present
+     * @return false if no entry exists for key
      */
-    const Plan *get_entry(const std::string &key)
+    bool get_entry(const std::string &key, Plan &plan)
     {
-        auto m = by_name.find(key);
-        if (m == by_name.end()) {
-            return nullptr;
+        std::lock_guard<std::mutex> guard(mutex_);
+        auto m = by_name_.find(key);
+        if (m == by_name_.end()) {
+            stats_.misses++;
+            return false;
         }
+        stats_.hits++;
 
-        const Plan *cur = *m->second;
-
+        Entry &ent = m->second;
         // Update LRU:
-        lru.splice(lru.begin(), lru, m->second);
-        // Note, updating of iterators is not required since splice doesn't
-        // invalidate iterators.
-        return cur;
+        if (lru_head_ != &ent) {
+            unlink(ent);
+            link_front(ent);
+        }
+        plan = ent.plan;
+        return true;
+    }
+
+    /**
+     * Stores the body template built by Plan::apply_plan for the given key, so
+     * that later executions of the statement can reuse it. Does nothing if the
+     * entry has been removed in the meantime.
+     */
+    void set_template(const std::string &key, std::shared_ptr<const Plan::BodyTemplate> tmpl)
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        auto m = by_name_.find(key);
+        if (m != by_name_.end()) {
+            m->second.plan.tmpl = std::move(tmpl);
+        }
+    }
+
+    /** Counts a PREPARE request sent to the query service */
+    void count_prepare()
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        stats_.prepares++;
+    }
+
+    /** Counts an execution which waits for a PREPARE already in flight instead of sending its own */
+    void count_prepare_joined()
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        stats_.joined++;
+    }
+
+    /** Returns the counters since the cache was created, see LCB_CNTL_QUERY_CACHE_STATS */
+    lcb_QUERY_CACHE_STATS stats()
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        lcb_QUERY_CACHE_STATS res = stats_;
+        res.size = by_name_.size();
+        return res;
     }
 
     /** Removes an entry with the given key */
     void remove_entry(const std::string &key)
     {
-        auto m = by_name.find(key);
-        if (m == by_name.end()) {
+        std::lock_guard<std::mutex> guard(mutex_);
+        auto m = by_name_.find(key);
+        if (m == by_name_.end()) {
             return;
         }
-        // Remove entry from map
-        auto m2 = m->second;
-        delete *m2;
-        by_name.erase(m);
-        lru.erase(m2);
+        unlink(m->second);
+        by_name_.erase(m);
     }
 
     /** Clears the LRU cache */
     void clear()
     {
-        for (auto &ii : lru) {
-            delete ii;
+        std::lock_guard<std::mutex> guard(mutex_);
+        by_name_.clear();
+        lru_head_ = nullptr;
+        lru_tail_ = nullptr;
+    }
+
+    /** Takes another reference for an instance which shares this cache */
+    void ref()
+    {
+        refcount_++;
+    }
+
+    /** Drops a reference, deleting the cache when the last one is gone */
+    void unref()
+    {
+        if (--refcount_ == 0) {
+            delete this;
         }
-        lru.clear();
-        by_name.clear();
     }
 
   private:
-    std::list<Plan *> lru;
-    std::map<std::string, decltype(lru)::iterator> by_name;
+    struct Entry {
+        Plan plan;
+        const std::string *key{nullptr}; /**< key of the hash table node */
+        Entry *prev{nullptr};
+        Entry *next{nullptr};
+    };
+
+    void link_front(Entry &ent)
+    {
+        ent.prev = nullptr;
+        ent.next = lru_head_;
+        if (lru_head_ != nullptr) {
+            lru_head_->prev = &ent;
+        } else {
+            lru_tail_ = &ent;
+        }
+        lru_head_ = &ent;
+    }
+
+    void unlink(Entry &ent)
+    {
+        if (ent.prev != nullptr) {
+            ent.prev->next = ent.next;
+        } else {
+            lru_head_ = ent.next;
+        }
+        if (ent.next != nullptr) {
+            ent.next->prev = ent.prev;
+        } else {
+            lru_tail_ = ent.prev;
+        }
+        ent.prev = nullptr;
+        ent.next = nullptr;
+    }
+
+    void evict_lru()
+    {
+        Entry *victim = lru_tail_;
+        unlink(*victim);
+        by_name_.erase(by_name_.find(*victim->key));
+        stats_.evictions++;
+    }
+
+    std::mutex mutex_;
+    std::unordered_map<std::string, Entry> by_name_;
+    Entry *lru_head_{nullptr};
+    Entry *lru_tail_{nullptr};
+    size_t max_size_{default_max_size()};
+    lcb_QUERY_CACHE_STATS stats_{};
+    std::atomic<unsigned> refcount_{1};
 };
 
 #endif // LIBCOUCHBASE_N1QL_QUERY_CACHE_HH
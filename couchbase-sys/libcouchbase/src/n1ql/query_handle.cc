@@ -15,8 +15,10 @@
  *   limitations under the License.
  */
 
+#include <algorithm>
 #include <array>
 #include <regex>
+#include <unordered_map>
 
 #include "internal.h"
 #include "logging.h"
@@ -59,23 +61,51 @@ static void chunk_callback(lcb_INSTANCE * /* instance */, int /* cbtype */, cons
     }
 
     req->consume_http_chunk();
+    if (req->row_limit_reached()) {
+        /* Deliver the final response and close the socket, without waiting for the remaining rows */
+        delete req;
+        return;
+    }
     req->clear_http_response();
 }
 
+/**
+ * PREPAREs in flight, by statement. Executions which need the plan of a
+ * statement while it is being prepared wait for that PREPARE instead of
+ * sending their own, so that a plan invalidated under many concurrent
+ * executions is prepared once. The cache may be shared with instances on
+ * other threads, so only the executions of the same instance wait.
+ */
+struct lcb_INFLIGHTPREPARES_st {
+    std::unordered_map<std::string, std::vector<lcb_QUERY_HANDLE_ *>> waiters{};
+};
+
+void lcb_inflight_prepares_destroy(lcb_INFLIGHTPREPARES *inflight)
+{
+    delete inflight;
+}
+
 // Received internally for PREPARE
 static void prepare_rowcb(lcb_INSTANCE *instance, int, const lcb_RESPQUERY *row)
 {
     auto *origreq = reinterpret_cast<lcb_QUERY_HANDLE_ *>(row->cookie);
 
     origreq->cancel_prepare_query();
+    std::vector<lcb_QUERY_HANDLE_ *> waiters = origreq->take_plan_waiters();
 
     if (row->ctx.rc != LCB_SUCCESS || (row->rflags & LCB_RESP_F_FINAL)) {
+        for (auto *waiter : waiters) {
+            waiter->fail_prepared(row, row->ctx.rc);
+        }
         return origreq->fail_prepared(row, row->ctx.rc);
     } else {
         // Insert into cache
         Json::Value prepared;
         if (!lcb::jsparse::parse_json(row->row, row->nrow, prepared)) {
             lcb_log(LOGARGS2(instance, ERROR), LOGFMT "Invalid JSON returned from PREPARE", LOGID(origreq));
+            for (auto *waiter : waiters) {
+                waiter->fail_prepared(row, LCB_ERR_PROTOCOL_ERROR);
+            }
             return origreq->fail_prepared(row, LCB_ERR_PROTOCOL_ERROR);
         }
 
@@ -83,9 +113,15 @@ static void prepare_rowcb(lcb_INSTANCE *instance, int, const lcb_RESPQUERY *row)
         // Insert plan into cache
         lcb_log(LOGARGS2(instance, DEBUG), LOGFMT "Got %sprepared statement. Inserting into cache and reissuing",
                 LOGID(origreq), eps ? "(enhanced) " : "");
-        const Plan &ent = origreq->cache().add_entry(origreq->statement(), prepared, !eps);
+        Plan ent = origreq->cache().add_entry(origreq->statement(), prepared, !eps);
 
-        // Issue the query with the newly prepared plan
+        // Issue the query, and the ones which waited for the PREPARE, with the newly prepared plan
+        for (auto *waiter : waiters) {
+            lcb_STATUS rc = waiter->apply_plan(ent);
+            if (rc != LCB_SUCCESS) {
+                waiter->fail_prepared(row, rc);
+            }
+        }
         lcb_STATUS rc = origreq->apply_plan(ent);
         if (rc != LCB_SUCCESS) {
             return origreq->fail_prepared(row, rc);
@@ -284,7 +320,7 @@ lcb_STATUS lcb_QUERY_HANDLE_::request_address()
     }
     used_nodes.resize(LCBVB_NSERVERS(vbc));
 
-    int ix = lcbvb_get_randhost_ex(vbc, LCBVB_SVCTYPE_QUERY, mode, &used_nodes[0]);
+    int ix = lcb_select_http_node(instance_, LCBVB_SVCTYPE_QUERY, &used_nodes[0]);
     if (ix < 0) {
         /* check if we can reset list of used nodes for this request and start over */
         bool reset_and_retry = false;
@@ -432,18 +468,23 @@ lcb_RETRY_ACTION lcb_QUERY_HANDLE_::has_retriable_error(lcb_STATUS &rc)
     return lcb_query_should_retry(instance_->settings, this, rc, first_error.retry);
 }
 
-lcb_STATUS lcb_QUERY_HANDLE_::issue_htreq(const std::string &body)
+lcb_STATUS lcb_QUERY_HANDLE_::issue_htreq(std::string body)
 {
     lcb_STATUS rc = request_address();
     if (rc != LCB_SUCCESS) {
         return rc;
     }
+    body_ = std::move(body);
+    if (!scan_vectors_.empty()) {
+        MutationState::splice_member(body_, scan_vectors_);
+    }
 
     std::string content_type("application/json");
 
     lcb_CMDHTTP *htcmd;
     lcb_cmdhttp_create(&htcmd, LCB_HTTP_TYPE_QUERY);
-    lcb_cmdhttp_body(htcmd, body.c_str(), body.size());
+    lcb_cmdhttp_body(htcmd, body_.c_str(), body_.size());
+    htcmd->cmdflags |= LCB_CMDHTTP_F_BORROWBODY;
     lcb_cmdhttp_content_type(htcmd, content_type.c_str(), content_type.size());
     lcb_cmdhttp_method(htcmd, LCB_HTTP_METHOD_POST);
     lcb_cmdhttp_streaming(htcmd, true);
@@ -478,13 +519,26 @@ lcb_STATUS lcb_QUERY_HANDLE_::issue_htreq(const std::string &body)
     }
     lcb_log(LOGARGS(this, TRACE),
             LOGFMT "execute query: %.*s, idempotent=%s, timeout=%uus, grace_period=%uus, client_context_id=\"%s\"",
-            LOGID(this), (int)body.size(), body.c_str(), idempotent_ ? "true" : "false", timeout,
+            LOGID(this), (int)body_.size(), body_.c_str(), idempotent_ ? "true" : "false", timeout,
             LCBT_SETTING(instance_, n1ql_grace_period), client_context_id_.c_str());
     return rc;
 }
 
 lcb_STATUS lcb_QUERY_HANDLE_::request_plan()
 {
+    if (instance_->inflight_prepares == nullptr) {
+        instance_->inflight_prepares = new lcb_INFLIGHTPREPARES();
+    }
+    auto &inflight = instance_->inflight_prepares->waiters;
+    auto it = inflight.find(statement_);
+    if (it != inflight.end()) {
+        lcb_log(LOGARGS(this, DEBUG), LOGFMT "Waiting for the PREPARE of the statement in flight", LOGID(this));
+        it->second.push_back(this);
+        awaiting_plan_ = true;
+        cache().count_prepare_joined();
+        return LCB_SUCCESS;
+    }
+
     Json::Value newbody(Json::objectValue);
     newbody["statement"] = "PREPARE " + statement_;
     if (json.isMember("query_context") && json["query_context"].isString()) {
@@ -496,15 +550,65 @@ lcb_STATUS lcb_QUERY_HANDLE_::request_plan()
     newcmd.use_multi_bucket_authentication(use_multi_bucket_authentication_);
     newcmd.root(newbody);
 
-    return lcb_query(instance_, this, &newcmd);
+    cache().count_prepare();
+    lcb_STATUS rc = lcb_query(instance_, this, &newcmd);
+    if (rc == LCB_SUCCESS) {
+        inflight.emplace(statement_, std::vector<lcb_QUERY_HANDLE_ *>());
+        preparing_ = true;
+    }
+    return rc;
+}
+
+std::vector<lcb_QUERY_HANDLE_ *> lcb_QUERY_HANDLE_::take_plan_waiters()
+{
+    std::vector<lcb_QUERY_HANDLE_ *> waiters;
+    if (!preparing_) {
+        return waiters;
+    }
+    preparing_ = false;
+    auto &inflight = instance_->inflight_prepares->waiters;
+    auto it = inflight.find(statement_);
+    if (it != inflight.end()) {
+        waiters = std::move(it->second);
+        inflight.erase(it);
+    }
+    for (auto *waiter : waiters) {
+        waiter->awaiting_plan_ = false;
+    }
+    return waiters;
+}
+
+void lcb_QUERY_HANDLE_::leave_prepare()
+{
+    if (awaiting_plan_) {
+        awaiting_plan_ = false;
+        auto &waiters = instance_->inflight_prepares->waiters[statement_];
+        waiters.erase(std::remove(waiters.begin(), waiters.end(), this), waiters.end());
+        return;
+    }
+
+    // The first of the waiting executions sends the PREPARE, and the others wait for it
+    for (auto *waiter : take_plan_waiters()) {
+        lcb_STATUS rc = LCB_ERR_REQUEST_CANCELED;
+        if (!instance_->destroying) {
+            rc = waiter->request_plan();
+        }
+        if (rc != LCB_SUCCESS) {
+            lcb_RESPQUERY resp{};
+            waiter->fail_prepared(&resp, rc);
+        }
+    }
 }
 
 lcb_STATUS lcb_QUERY_HANDLE_::apply_plan(const Plan &plan)
 {
     lcb_log(LOGARGS(this, DEBUG), LOGFMT "Using prepared plan", LOGID(this));
     std::string bodystr;
-    plan.apply_plan(json, bodystr);
-    return issue_htreq(bodystr);
+    auto tmpl = plan.apply_plan(json_const(), bodystr);
+    if (tmpl) {
+        cache().set_template(statement_, std::move(tmpl));
+    }
+    return issue_htreq(std::move(bodystr));
 }
 
 lcb_QUERY_HANDLE_::lcb_QUERY_HANDLE_(lcb_INSTANCE *obj, void *user_cookie, const lcb_CMDQUERY *cmd)
@@ -522,6 +626,15 @@ lcb_QUERY_HANDLE_::lcb_QUERY_HANDLE_(lcb_INSTANCE *obj, void *user_cookie, const
             return;
         }
     }
+    const MutationState &mutation_state = cmd->mutation_state();
+    if (!mutation_state.empty()) {
+        if (json.isMember("scan_vectors")) {
+            /* the application passed vectors of its own */
+            mutation_state.merge_into(json["scan_vectors"]);
+        } else {
+            mutation_state.write_scan_vectors(scan_vectors_);
+        }
+    }
     if (cmd->has_explicit_scope_qualifier()) {
         json["query_context"] = cmd->scope_qualifier();
     } else if (cmd->has_scope()) {
@@ -578,6 +691,7 @@ lcb_QUERY_HANDLE_::lcb_QUERY_HANDLE_(lcb_INSTANCE *obj, void *user_cookie, const
     if (json.isMember("readonly") && json["readonly"].asBool()) {
         idempotent_ = true;
     }
+    max_rows_ = cmd->max_rows();
     timeout_timer_.rearm(timeout + LCBT_SETTING(obj, n1ql_grace_period));
 
     // Determine if we need to add more credentials.
@@ -630,6 +744,7 @@ lcb_QUERY_HANDLE_::~lcb_QUERY_HANDLE_()
         lcb_query_cancel(instance_, prepare_query_);
         delete prepare_query_;
     }
+    leave_prepare();
     timeout_timer_.release();
     if (backoff_timer_.is_armed()) {
         lcb_aspend_del(&instance_->pendops, LCB_PENDTYPE_COUNTER, nullptr);
@@ -663,9 +778,9 @@ void lcb_QUERY_HANDLE_::on_backoff()
     delete parser_;
     parser_ = new lcb::jsparse::Parser(lcb::jsparse::Parser::MODE_N1QL, this);
     if (use_prepcache()) {
-        const Plan *cached = cache().get_entry(statement_);
-        if (cached != nullptr) {
-            last_error_ = apply_plan(*cached);
+        Plan cached;
+        if (cache().get_entry(statement_, cached)) {
+            last_error_ = apply_plan(cached);
         } else {
             lcb_log(LOGARGS(this, DEBUG), LOGFMT "No cached plan found. Issuing prepare", LOGID(this));
             last_error_ = request_plan();
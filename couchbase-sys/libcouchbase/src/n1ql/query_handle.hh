@@ -21,6 +21,7 @@
 #include <cstddef>
 #include <cstdint>
 #include <chrono>
+#include <vector>
 
 #include <jsparse/parser.h>
 
@@ -57,6 +58,11 @@ struct lcb_QUERY_HANDLE_ : lcb::jsparse::Parser::Actions {
         callback_ = nullptr;
     }
 
+    lcb_HTTP_HANDLE_ *http_request() const
+    {
+        return http_request_;
+    }
+
     void clear_http_request()
     {
         http_request_ = nullptr;
@@ -118,15 +124,15 @@ struct lcb_QUERY_HANDLE_ : lcb::jsparse::Parser::Actions {
 
     /**
      * Issues the HTTP request for the query
-     * @param payload The body to send
+     * @param body The body to send. It is kept in ::body_, which the HTTP
+     *  request refers to instead of copying it
      * @return Error code from lcb's http subsystem
      */
-    lcb_STATUS issue_htreq(const std::string &body);
+    lcb_STATUS issue_htreq(std::string body);
 
     lcb_STATUS issue_htreq()
     {
-        std::string s = Json::FastWriter().write(json);
-        return issue_htreq(s);
+        return issue_htreq(Json::FastWriter().write(json));
     }
 
     void backoff_and_issue_http_request(uint32_t interval)
@@ -186,6 +192,18 @@ struct lcb_QUERY_HANDLE_ : lcb::jsparse::Parser::Actions {
         resp.nrow = row.row.iov_len;
         rows_number_++;
         invoke_row(&resp, false);
+        if (row_limit_reached()) {
+            parser_->stop();
+        }
+    }
+
+    /**
+     * @return true if the application has all the rows it asked for (see
+     *  lcb_cmdquery_max_rows()), and the query should be finished
+     */
+    bool row_limit_reached() const
+    {
+        return max_rows_ != 0 && rows_number_ >= max_rows_;
     }
 
     void JSPARSE_on_error(const std::string &) override
@@ -215,6 +233,18 @@ struct lcb_QUERY_HANDLE_ : lcb::jsparse::Parser::Actions {
         }
     }
 
+    /**
+     * Takes the executions of the statement which wait for the PREPARE of this
+     * one (see request_plan()), and lets later ones send a PREPARE of their own
+     */
+    std::vector<lcb_QUERY_HANDLE_ *> take_plan_waiters();
+
+    /**
+     * Stops waiting for the PREPARE of another execution. If this execution
+     * sent the PREPARE, the executions waiting for it send another one instead
+     */
+    void leave_prepare();
+
     const std::string &statement() const
     {
         return statement_;
@@ -255,6 +285,7 @@ struct lcb_QUERY_HANDLE_ : lcb::jsparse::Parser::Actions {
             prepare_query_->cancel();
             prepare_query_ = nullptr;
         }
+        leave_prepare();
         callback_ = nullptr;
         return LCB_SUCCESS;
     }
@@ -299,12 +330,22 @@ struct lcb_QUERY_HANDLE_ : lcb::jsparse::Parser::Actions {
     std::uint32_t timeout{0};
     // How many rows were received. Used to avoid parsing the meta
     std::size_t rows_number_{0};
+    // Stop after this many rows, unless 0
+    std::size_t max_rows_{0};
 
     /** The PREPARE query itself */
     struct lcb_QUERY_HANDLE_ *prepare_query_{nullptr};
+    /** Whether other executions of the statement may wait for the PREPARE of this one */
+    bool preparing_{false};
+    /** Whether this execution waits for the PREPARE of another one */
+    bool awaiting_plan_{false};
 
     /** Request body as received from the application */
     Json::Value json;
+    /** Serialized body of the current HTTP request */
+    std::string body_;
+    /** Serialized "scan_vectors" member, added to each body by issue_htreq() */
+    std::string scan_vectors_;
     /** String of the original statement. Cached here to avoid jsoncpp lookups */
     std::string statement_;
     std::string client_context_id_;
@@ -0,0 +1,353 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "internal.h"
+#include "nearcache.h"
+#include "capi/cmd_get.hh"
+
+#include <cstring>
+
+using namespace lcb;
+
+std::string NearCache::make_key(std::uint32_t cid, const char *key, std::size_t nkey)
+{
+    std::string result(sizeof(cid) + nkey, '\0');
+    std::memcpy(&result[0], &cid, sizeof(cid));
+    if (nkey) {
+        std::memcpy(&result[sizeof(cid)], key, nkey);
+    }
+    return result;
+}
+
+const NearCache::Entry *NearCache::find(const std::string &key, hrtime_t now, hrtime_t ttl)
+{
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+        return nullptr;
+    }
+    Slot &slot = *it->second;
+    if (!slot.valid) {
+        return nullptr;
+    }
+    if (ttl && now - slot.changed >= ttl) {
+        slot.valid = false;
+        slot.entry.value.clear();
+        return nullptr;
+    }
+    slots_.splice(slots_.begin(), slots_, it->second);
+    return &slot.entry;
+}
+
+NearCache::SlotList::iterator NearCache::touch(const std::string &key, std::size_t capacity)
+{
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+        slots_.splice(slots_.begin(), slots_, it->second);
+        return it->second;
+    }
+    while (!slots_.empty() && slots_.size() >= capacity) {
+        index_.erase(slots_.back().key);
+        slots_.pop_back();
+    }
+    slots_.push_front(Slot{key, Entry{}, 0, false});
+    index_.emplace(key, slots_.begin());
+    return slots_.begin();
+}
+
+void NearCache::reserve(const std::string &key, std::size_t capacity)
+{
+    if (capacity) {
+        touch(key, capacity);
+    }
+}
+
+void NearCache::store(const std::string &key, Entry entry, hrtime_t sent, hrtime_t now, std::size_t capacity)
+{
+    if (capacity == 0) {
+        return;
+    }
+    Slot &slot = *touch(key, capacity);
+    if (slot.changed > sent) {
+        /* stored by a more recent get, or mutated while this one was in flight */
+        return;
+    }
+    slot.entry = std::move(entry);
+    slot.changed = now;
+    slot.valid = true;
+}
+
+void NearCache::invalidate(const std::string &key, hrtime_t now)
+{
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+        return;
+    }
+    Slot &slot = *it->second;
+    slot.valid = false;
+    slot.entry.value.clear();
+    slot.changed = now;
+}
+
+void NegativeFilter::hash(const std::string &key, std::size_t ncounters, std::size_t *ix)
+{
+    /* FNV-1a, split into two hashes for double hashing */
+    std::uint64_t h = 14695981039346656037ULL;
+    for (char c : key) {
+        h ^= static_cast<std::uint8_t>(c);
+        h *= 1099511628211ULL;
+    }
+    std::uint64_t h1 = h & 0xffffffffU;
+    std::uint64_t h2 = (h >> 32U) | 1U;
+    for (std::size_t ii = 0; ii < hashes_per_key; ii++) {
+        ix[ii] = static_cast<std::size_t>((h1 + ii * h2) % ncounters);
+    }
+}
+
+bool NegativeFilter::Generation::contains(const std::size_t *ix) const
+{
+    for (std::size_t ii = 0; ii < hashes_per_key; ii++) {
+        if (counters[ix[ii]] == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool NegativeFilter::contains(const std::string &key, hrtime_t now, hrtime_t ttl) const
+{
+    if (current_.counters.empty()) {
+        return false;
+    }
+    std::size_t ix[hashes_per_key];
+    hash(key, current_.counters.size(), ix);
+    return (fresh(current_, now, ttl) && current_.contains(ix)) ||
+           (fresh(previous_, now, ttl) && previous_.contains(ix));
+}
+
+void NegativeFilter::add(const std::string &key, hrtime_t sent, hrtime_t now, hrtime_t ttl, std::size_t capacity)
+{
+    if (capacity == 0) {
+        return;
+    }
+    auto removed = removed_.find(key);
+    if (removed != removed_.end() && removed->second >= sent) {
+        /* mutated while the request was in flight */
+        return;
+    }
+
+    std::size_t ncounters = capacity * counters_per_key;
+    if (current_.counters.size() != ncounters) {
+        /* first use, or resized */
+        previous_ = Generation();
+        current_.counters.assign(ncounters, 0);
+        current_.nkeys = 0;
+        current_.started = now;
+    } else if (current_.nkeys >= capacity || (ttl && now - current_.started >= ttl / 2)) {
+        previous_ = std::move(current_);
+        current_ = Generation();
+        current_.counters.assign(ncounters, 0);
+        current_.started = now;
+    }
+
+    std::size_t ix[hashes_per_key];
+    hash(key, ncounters, ix);
+    if (current_.contains(ix)) {
+        return;
+    }
+    for (std::size_t ii = 0; ii < hashes_per_key; ii++) {
+        std::uint8_t &counter = current_.counters[ix[ii]];
+        if (counter < UINT8_MAX) {
+            counter++;
+        }
+    }
+    current_.nkeys++;
+}
+
+void NegativeFilter::remove(const std::string &key, hrtime_t now, hrtime_t horizon)
+{
+    if (current_.counters.empty()) {
+        return;
+    }
+    std::size_t ix[hashes_per_key];
+    hash(key, current_.counters.size(), ix);
+    for (Generation *generation : {&current_, &previous_}) {
+        if (generation->counters.empty() || !generation->contains(ix)) {
+            continue;
+        }
+        for (std::size_t ii = 0; ii < hashes_per_key; ii++) {
+            std::uint8_t &counter = generation->counters[ix[ii]];
+            /* saturated counters no longer know how many keys they count */
+            if (counter < UINT8_MAX) {
+                counter--;
+            }
+        }
+    }
+
+    removed_[key] = now;
+    removals_.emplace_back(now, key);
+    std::size_t capacity = current_.counters.size() / counters_per_key;
+    while (!removals_.empty() && (removals_.front().first + horizon < now || removals_.size() > capacity)) {
+        auto it = removed_.find(removals_.front().second);
+        if (it != removed_.end() && it->second == removals_.front().first) {
+            removed_.erase(it);
+        }
+        removals_.pop_front();
+    }
+}
+
+constexpr std::size_t TouchWindow::capacity;
+
+void TouchWindow::record(const std::string &key, std::uint32_t expiry, hrtime_t now, hrtime_t window)
+{
+    if (touched_.size() >= capacity && touched_.find(key) == touched_.end()) {
+        for (auto it = touched_.begin(); it != touched_.end();) {
+            if (now - it->second.when >= window) {
+                it = touched_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        if (touched_.size() >= capacity) {
+            touched_.erase(touched_.begin());
+        }
+    }
+    touched_[key] = Touch{expiry, now};
+}
+
+static void near_cache_deliver(void *arg)
+{
+    auto *cache = static_cast<lcb_NEARCACHE *>(arg);
+    lcb_INSTANCE *instance = cache->instance;
+    std::vector<std::function<void(lcb_STATUS)>> answers;
+    answers.swap(cache->answers);
+    for (const auto &fn : answers) {
+        fn(LCB_SUCCESS);
+        lcb_aspend_del(&instance->pendops, LCB_PENDTYPE_COUNTER, nullptr);
+    }
+    lcb_maybe_breakout(instance);
+}
+
+lcb_NEARCACHE_st::lcb_NEARCACHE_st(lcb_INSTANCE *instance_)
+    : instance(instance_), timer(lcbio_timer_new(instance_->iotable, this, near_cache_deliver))
+{
+}
+
+lcb_NEARCACHE_st::~lcb_NEARCACHE_st()
+{
+    lcbio_timer_destroy(timer);
+}
+
+void lcb_NEARCACHE_st::answer(std::function<void(lcb_STATUS)> fn)
+{
+    answers.emplace_back(std::move(fn));
+    lcb_aspend_add(&instance->pendops, LCB_PENDTYPE_COUNTER, nullptr);
+    lcbio_async_signal(timer);
+}
+
+lcb_NEARCACHE *lcb_near_cache_ensure(lcb_INSTANCE *instance)
+{
+    if (instance->near_cache == nullptr) {
+        instance->near_cache = new lcb_NEARCACHE(instance);
+    }
+    return instance->near_cache;
+}
+
+std::string lcb_near_cache_key(lcb_INSTANCE *instance, std::uint32_t cid, const std::string &key)
+{
+    return NearCache::make_key(LCBT_SETTING(instance, use_collections) ? cid : 0, key.c_str(), key.size());
+}
+
+static std::string near_cache_key(lcb_INSTANCE *instance, const mc_PACKET *packet)
+{
+    const char *key = nullptr;
+    size_t nkey = 0;
+    mcreq_get_key(packet, &key, &nkey);
+    return NearCache::make_key(mcreq_get_cid(instance, packet, nullptr), key, nkey);
+}
+
+void lcb_near_cache_store(lcb_INSTANCE *instance, const mc_PACKET *request, const lcb_RESPGET *resp)
+{
+    lcb_NEARCACHE *cache = instance->near_cache;
+    if (cache == nullptr) {
+        return;
+    }
+    if (resp->ctx.rc == LCB_ERR_DOCUMENT_NOT_FOUND) {
+        lcb_near_cache_store_missing(instance, request);
+        return;
+    }
+    NearCache::Entry entry;
+    entry.value.assign(static_cast<const char *>(resp->value), resp->nvalue);
+    entry.cas = resp->ctx.cas;
+    entry.flags = resp->itmflags;
+    entry.datatype = resp->datatype;
+    cache->entries.store(near_cache_key(instance, request), std::move(entry), MCREQ_PKT_RDATA(request)->start,
+                         lcb_settings_now(instance->settings), LCBT_SETTING(instance, near_cache_size));
+}
+
+void lcb_near_cache_store_missing(lcb_INSTANCE *instance, const mc_PACKET *request)
+{
+    lcb_NEARCACHE *cache = instance->near_cache;
+    if (cache == nullptr) {
+        return;
+    }
+    cache->misses.add(near_cache_key(instance, request), MCREQ_PKT_RDATA(request)->start,
+                      lcb_settings_now(instance->settings), LCB_US2NS(LCBT_SETTING(instance, near_cache_ttl)),
+                      LCBT_SETTING(instance, negative_cache_size));
+}
+
+void lcb_near_cache_invalidate(lcb_INSTANCE *instance, const mc_PACKET *request)
+{
+    lcb_NEARCACHE *cache = instance->near_cache;
+    if (cache == nullptr) {
+        return;
+    }
+    std::string key = near_cache_key(instance, request);
+    hrtime_t now = lcb_settings_now(instance->settings);
+    cache->entries.invalidate(key, now);
+    cache->misses.remove(key, now, LCB_US2NS(LCBT_SETTING(instance, operation_timeout)));
+    cache->touches.forget(key);
+}
+
+void lcb_near_cache_touched(lcb_INSTANCE *instance, const mc_PACKET *request)
+{
+    hrtime_t window = LCB_US2NS(LCBT_SETTING(instance, touch_skip_window));
+    if (window == 0) {
+        return;
+    }
+    protocol_binary_request_header hdr;
+    mcreq_read_hdr(request, &hdr);
+    if (hdr.request.extlen != sizeof(std::uint32_t)) {
+        return;
+    }
+    std::size_t ffextlen = hdr.request.magic == PROTOCOL_BINARY_AREQ ? (hdr.request.keylen & 0xffU) : 0;
+    std::uint32_t expiry;
+    std::memcpy(&expiry, SPAN_BUFFER(&request->kh_span) + sizeof(hdr) + ffextlen, sizeof(expiry));
+    lcb_near_cache_ensure(instance)->touches.record(near_cache_key(instance, request), ntohl(expiry),
+                                                     lcb_settings_now(instance->settings), window);
+}
+
+void lcb_near_cache_destroy(lcb_NEARCACHE *cache)
+{
+    lcb_INSTANCE *instance = cache->instance;
+    std::vector<std::function<void(lcb_STATUS)>> answers;
+    answers.swap(cache->answers);
+    for (const auto &fn : answers) {
+        fn(LCB_ERR_REQUEST_CANCELED);
+        lcb_aspend_del(&instance->pendops, LCB_PENDTYPE_COUNTER, nullptr);
+    }
+    delete cache;
+}
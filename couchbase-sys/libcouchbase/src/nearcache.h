@@ -0,0 +1,232 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCB_NEARCACHE_H
+#define LCB_NEARCACHE_H
+
+#include "config.h"
+#include <lcbio/lcbio.h>
+#include <lcbio/timer-ng.h>
+
+#ifdef __cplusplus
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @file
+ * @brief Near cache of get replies, see LCB_CNTL_NEAR_CACHE_SIZE
+ */
+
+namespace lcb
+{
+
+/**
+ * Least recently used documents read with lcb_cmdget_near_cache(). Besides
+ * the cached values, a slot remembers when it last changed, i.e. when its
+ * value was stored or its document was mutated through the instance. A reply
+ * to a get sent before that is older than what the slot knows, and is not
+ * stored.
+ */
+class NearCache
+{
+  public:
+    struct Entry {
+        std::string value;
+        std::uint64_t cas{0};
+        std::uint32_t flags{0};
+        std::uint8_t datatype{0};
+    };
+
+    /** @return the key of a document of the collection `cid` */
+    static std::string make_key(std::uint32_t cid, const char *key, std::size_t nkey);
+
+    /**
+     * @return the value of `key` if it was stored less than `ttl` ago (or at
+     * any time if `ttl` is zero), otherwise nullptr. The pointer is valid
+     * until the cache is modified.
+     */
+    const Entry *find(const std::string &key, hrtime_t now, hrtime_t ttl);
+
+    /**
+     * Make room for the value of a get about to be sent for `key`, so that
+     * mutations of the document are noticed while the get is in flight.
+     */
+    void reserve(const std::string &key, std::size_t capacity);
+
+    /**
+     * Store the value a get sent at `sent` replied with, unless the slot
+     * changed after that.
+     */
+    void store(const std::string &key, Entry entry, hrtime_t sent, hrtime_t now, std::size_t capacity);
+
+    /** Drop the value of a document which was mutated */
+    void invalidate(const std::string &key, hrtime_t now);
+
+    std::size_t size() const
+    {
+        return index_.size();
+    }
+
+  private:
+    struct Slot {
+        std::string key;
+        Entry entry;
+        hrtime_t changed;
+        bool valid;
+    };
+    using SlotList = std::list<Slot>;
+
+    /** @return the slot of `key`, moved to the front, or a new empty one */
+    SlotList::iterator touch(const std::string &key, std::size_t capacity);
+
+    /** Most recently used first */
+    SlotList slots_{};
+    std::unordered_map<std::string, SlotList::iterator> index_{};
+};
+
+/**
+ * Keys of documents which were recently found missing, see
+ * LCB_CNTL_NEGATIVE_CACHE_SIZE. These are kept in two generations of counting
+ * Bloom filters: keys are added to the current one, which becomes the previous
+ * one once it is half the TTL old or full, so that a key is remembered for
+ * half the TTL to the full TTL. Keys of documents mutated through the
+ * instance are removed again, which at worst makes other keys look present.
+ */
+class NegativeFilter
+{
+  public:
+    /** Counters per key the filters are sized for */
+    static constexpr std::size_t counters_per_key = 8;
+    /** Counters incremented for each key */
+    static constexpr std::size_t hashes_per_key = 4;
+
+    /** @return whether `key` was probably missing less than `ttl` ago */
+    bool contains(const std::string &key, hrtime_t now, hrtime_t ttl) const;
+
+    /**
+     * Remember that a request sent at `sent` found `key` missing, unless the
+     * document was mutated after that.
+     */
+    void add(const std::string &key, hrtime_t sent, hrtime_t now, hrtime_t ttl, std::size_t capacity);
+
+    /**
+     * Forget `key`, as its document was mutated. Requests in flight for up to
+     * `horizon` cannot add it back.
+     */
+    void remove(const std::string &key, hrtime_t now, hrtime_t horizon);
+
+  private:
+    struct Generation {
+        std::vector<std::uint8_t> counters{};
+        std::size_t nkeys{0};
+        hrtime_t started{0};
+
+        bool contains(const std::size_t *ix) const;
+    };
+
+    /** Compute the counters of `key` for filters of `ncounters` */
+    static void hash(const std::string &key, std::size_t ncounters, std::size_t *ix);
+
+    bool fresh(const Generation &generation, hrtime_t now, hrtime_t ttl) const
+    {
+        return !generation.counters.empty() && (ttl == 0 || now - generation.started < ttl);
+    }
+
+    Generation current_{};
+    Generation previous_{};
+    /** Recently removed keys and when, oldest first */
+    std::deque<std::pair<hrtime_t, std::string>> removals_{};
+    std::unordered_map<std::string, hrtime_t> removed_{};
+};
+
+/**
+ * Documents whose expiry was recently refreshed through the instance, see
+ * LCB_CNTL_TOUCH_SKIP_WINDOW. The table is small: once full, entries older
+ * than the window are dropped, and if none are, an arbitrary one.
+ */
+class TouchWindow
+{
+  public:
+    /** Most documents remembered at once */
+    static constexpr std::size_t capacity = 1024;
+
+    /** @return whether `key` was touched with `expiry` less than `window` ago */
+    bool recent(const std::string &key, std::uint32_t expiry, hrtime_t now, hrtime_t window) const
+    {
+        auto it = touched_.find(key);
+        return it != touched_.end() && it->second.expiry == expiry && now - it->second.when < window;
+    }
+
+    /** Remember that `key` was touched with `expiry` */
+    void record(const std::string &key, std::uint32_t expiry, hrtime_t now, hrtime_t window);
+
+    /** Forget `key`, as its document was mutated */
+    void forget(const std::string &key)
+    {
+        touched_.erase(key);
+    }
+
+    std::size_t size() const
+    {
+        return touched_.size();
+    }
+
+  private:
+    struct Touch {
+        std::uint32_t expiry;
+        hrtime_t when;
+    };
+    std::unordered_map<std::string, Touch> touched_{};
+};
+
+} // namespace lcb
+
+/**
+ * Near cache of an instance, allocated once a get or exists command asks for
+ * it, or a document is touched with LCB_CNTL_TOUCH_SKIP_WINDOW set
+ */
+struct lcb_NEARCACHE_st {
+    explicit lcb_NEARCACHE_st(lcb_INSTANCE *instance);
+    ~lcb_NEARCACHE_st();
+
+    /**
+     * Answer a command from the event loop. `fn` is invoked with LCB_SUCCESS,
+     * or with LCB_ERR_REQUEST_CANCELED if the instance is destroyed first.
+     */
+    void answer(std::function<void(lcb_STATUS)> fn);
+
+    lcb_INSTANCE *instance;
+    lcb::NearCache entries{};
+    lcb::NegativeFilter misses{};
+    lcb::TouchWindow touches{};
+    lcbio_pTIMER timer;
+    std::vector<std::function<void(lcb_STATUS)>> answers{};
+};
+
+/** @return the near cache of the instance, allocated if needed */
+lcb_NEARCACHE_st *lcb_near_cache_ensure(lcb_INSTANCE *instance);
+
+/** @return the key of a document for the near cache of the instance */
+std::string lcb_near_cache_key(lcb_INSTANCE *instance, std::uint32_t cid, const std::string &key);
+#endif /* __cplusplus */
+#endif /* LCB_NEARCACHE_H */
@@ -55,6 +55,30 @@ typedef unsigned int nb_SIZE;
 #define NB_DATA_BASEALLOC 32768
 /**@}*/
 
+/**
+ * @name Adaptive Allocation
+ * @{
+ *
+ * In adaptive mode the data pool tracks the sizes of the spans reserved from
+ * it, and periodically resizes its blocks so that a typical block holds
+ * NB_ADAPT_SPANS_PER_BLOCK spans of the 90th percentile size. The number of
+ * idle blocks kept around follows the peak number of blocks in use. Spans
+ * larger than half a block get a dedicated buffer which is freed as soon as
+ * the span is released, rather than inflating (and pinning) a shared block.
+ */
+
+/** @brief Number of reservations between two adaptations */
+#define NB_ADAPT_INTERVAL 512
+/** @brief Number of typical spans a block should be able to hold */
+#define NB_ADAPT_SPANS_PER_BLOCK 32
+/** @brief Lower bound for the adaptive block size */
+#define NB_ADAPT_MIN_BASEALLOC 4096
+/** @brief Upper bound for the adaptive block size */
+#define NB_ADAPT_MAX_BASEALLOC 262144
+/** @brief Minimum number of idle blocks kept in adaptive mode */
+#define NB_ADAPT_MIN_BLOCKS 2
+/**@}*/
+
 typedef struct {
     nb_SIZE sndq_cacheblocks;
     nb_SIZE sndq_basealloc;
@@ -62,6 +86,10 @@ typedef struct {
     nb_SIZE dea_basealloc;
     nb_SIZE data_cacheblocks;
     nb_SIZE data_basealloc;
+    /** Resize data blocks according to the observed span sizes */
+    int data_adaptive;
+    /** Upper bound for the adaptive block size, 0 for NB_ADAPT_MAX_BASEALLOC */
+    nb_SIZE data_maxalloc;
 } nb_SETTINGS;
 
 #ifndef _WIN32
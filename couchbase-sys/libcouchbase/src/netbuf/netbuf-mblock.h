@@ -189,8 +189,40 @@ typedef struct {
      */
     struct netbuf_mblock_dealloc_queue_st *deallocs;
     struct netbuf_mblock_st *parent;
+
+    /**
+     * Set if the block holds a single oversized span reserved in adaptive
+     * mode. Such blocks are kept in the `dedicated` list of the pool and freed once
+     * the span is released.
+     */
+    int dedicated;
 } nb_MBLOCK;
 
+/** @brief Number of buckets in the span size histogram */
+#define NB_MBSTATS_NBUCKETS 16
+
+/**
+ * @brief Allocation counters of a pool
+ *
+ * Bucket `i` of the histogram counts spans of up to `64 << i` bytes, the last
+ * bucket counts all larger spans. The histogram is halved on every adaptation
+ * so it reflects the recent distribution.
+ */
+typedef struct {
+    unsigned long reserved;     /**< Number of spans reserved */
+    unsigned long newblocks;    /**< Number of blocks allocated */
+    unsigned long dedicated;    /**< Number of spans given a dedicated buffer */
+    unsigned long grown;        /**< Number of times the block size was increased */
+    unsigned long shrunk;       /**< Number of times the block size was decreased */
+    unsigned int nactive;       /**< Number of blocks currently holding spans */
+    unsigned int peakactive;    /**< Highest value of nactive since the last adaptation */
+    unsigned int sinceadapt;    /**< Number of spans reserved since the last adaptation */
+    unsigned int sincetrim;     /**< Number of spans reserved since the last netbuf_trim() */
+    unsigned long trimmed;      /**< Number of idle blocks freed by netbuf_trim() */
+    unsigned long trimmedbytes; /**< Number of bytes held by these blocks */
+    unsigned long hist[NB_MBSTATS_NBUCKETS];
+} nb_MBSTATS;
+
 /**
  * @brief pool of nb_MBLOCK structures
  */
@@ -213,6 +245,11 @@ typedef struct netbuf_mblock_st {
     nb_MBLOCK *cacheblocks;
     nb_SIZE ncacheblocks;
 
+    /** Blocks holding a single oversized span, only used in adaptive mode */
+    sllist_root dedicated;
+
+    nb_MBSTATS stats;
+
     struct netbuf_st *mgr;
 } nb_MBPOOL;
 
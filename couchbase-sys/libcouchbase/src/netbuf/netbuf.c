@@ -96,6 +96,7 @@ static nb_MBLOCK *alloc_new_block(nb_MBPOOL *pool, nb_SIZE capacity)
     }
 
     ret->nalloc = pool->basealloc;
+    pool->stats.newblocks++;
 
     while (ret->nalloc < capacity) {
         ret->nalloc *= 2;
@@ -162,8 +163,43 @@ static int reserve_empty_block(nb_MBPOOL *pool, nb_SPAN *span)
     block->deallocs = NULL;
 
     sllist_append(&pool->active, &block->slnode);
+    if (++pool->stats.nactive > pool->stats.peakactive) {
+        pool->stats.peakactive = pool->stats.nactive;
+    }
+    return 0;
+}
+
+#ifndef NETBUF_LIBC_PROXY
+/**
+ * Allocate a block holding nothing but the given span. It is not shared with
+ * other spans, and freed once the span is released.
+ */
+static int reserve_dedicated_block(nb_MBPOOL *pool, nb_SPAN *span)
+{
+    nb_MBLOCK *block = calloc(1, sizeof(*block));
+    if (!block) {
+        return -1;
+    }
+
+    block->root = malloc(span->size);
+    if (!block->root) {
+        free(block);
+        return -1;
+    }
+
+    block->nalloc = span->size;
+    block->wrap = span->size;
+    block->cursor = span->size;
+    block->dedicated = 1;
+
+    span->parent = block;
+    span->offset = 0;
+
+    sllist_append(&pool->dedicated, &block->slnode);
+    pool->stats.dedicated++;
     return 0;
 }
+#endif
 
 /**
  * Attempt to reserve space from the currently active block for the given
@@ -218,6 +254,7 @@ static int mblock_reserve_data(nb_MBPOOL *pool, nb_SPAN *span)
     return 0;
 #endif
 
+    pool->stats.sincetrim++;
     if (SLLIST_IS_EMPTY(&pool->active)) {
         return reserve_empty_block(pool, span);
 
@@ -345,12 +382,19 @@ static INLINE void mblock_release_data(nb_MBPOOL *pool, nb_MBLOCK *block, nb_SIZ
         return;
     }
 
+    if (block->dedicated) {
+        sllist_remove(&pool->dedicated, &block->slnode);
+        mblock_wipe_block(block);
+        return;
+    }
+
     {
         sllist_iterator iter;
         SLLIST_ITERFOR(&pool->active, &iter)
         {
             if (&block->slnode == iter.cur) {
                 sllist_iter_remove(&pool->active, &iter);
+                pool->stats.nactive--;
                 break;
             }
         }
@@ -447,6 +491,10 @@ static void mblock_wipe_block(nb_MBLOCK *block)
 
     if (mblock_is_standalone(block)) {
         free(block);
+    } else {
+        /* Make the cache slot available to alloc_new_block() again */
+        block->root = NULL;
+        block->nalloc = 0;
     }
 }
 
@@ -466,6 +514,7 @@ static void mblock_cleanup(nb_MBPOOL *pool)
 {
     free_blocklist(pool, &pool->active);
     free_blocklist(pool, &pool->avail);
+    free_blocklist(pool, &pool->dedicated);
     free(pool->cacheblocks);
 }
 
@@ -481,9 +530,147 @@ static void mblock_init(nb_MBPOOL *pool)
     }
 }
 
+static unsigned int hist_bucket(nb_SIZE size)
+{
+    unsigned int ii = 0;
+    while (ii < NB_MBSTATS_NBUCKETS - 1 && ((nb_SIZE)64 << ii) < size) {
+        ii++;
+    }
+    return ii;
+}
+
+#ifndef NETBUF_LIBC_PROXY
+/**
+ * Resize the blocks of the pool according to the span sizes reserved since
+ * the last adaptation, and drop idle blocks which no longer fit.
+ */
+static void mblock_adapt(nb_MBPOOL *pool, const nb_SETTINGS *settings)
+{
+    nb_MBSTATS *stats = &pool->stats;
+    unsigned long total = 0, seen = 0;
+    nb_SIZE typical = 0, target = NB_ADAPT_MIN_BASEALLOC;
+    nb_SIZE maxalloc = settings->data_maxalloc ? settings->data_maxalloc : NB_ADAPT_MAX_BASEALLOC;
+    unsigned int ii, maxblocks;
+    sllist_iterator iter;
+
+    for (ii = 0; ii < NB_MBSTATS_NBUCKETS; ii++) {
+        total += stats->hist[ii];
+    }
+    for (ii = 0; ii < NB_MBSTATS_NBUCKETS; ii++) {
+        seen += stats->hist[ii];
+        if (seen * 10 >= total * 9) {
+            typical = (nb_SIZE)64 << ii;
+            break;
+        }
+    }
+
+    while (target < typical * NB_ADAPT_SPANS_PER_BLOCK && target < maxalloc) {
+        target *= 2;
+    }
+    if (target > maxalloc) {
+        target = maxalloc;
+    }
+    if (target > pool->basealloc) {
+        pool->basealloc = target;
+        stats->grown++;
+    } else if (target < pool->basealloc / 2) {
+        /* Shrink gradually, a burst of small spans is no reason to drop everything */
+        pool->basealloc /= 2;
+        stats->shrunk++;
+    }
+
+    maxblocks = stats->peakactive > NB_ADAPT_MIN_BLOCKS ? stats->peakactive : NB_ADAPT_MIN_BLOCKS;
+    if (maxblocks > settings->data_cacheblocks * 2) {
+        maxblocks = settings->data_cacheblocks * 2;
+    }
+    pool->maxblocks = maxblocks;
+
+    SLLIST_ITERFOR(&pool->avail, &iter)
+    {
+        nb_MBLOCK *cur = SLLIST_ITEM(iter.cur, nb_MBLOCK, slnode);
+        if (cur->nalloc != pool->basealloc || pool->curblocks > pool->maxblocks) {
+            sllist_iter_remove(&pool->avail, &iter);
+            pool->curblocks--;
+            mblock_wipe_block(cur);
+        }
+    }
+
+    for (ii = 0; ii < NB_MBSTATS_NBUCKETS; ii++) {
+        stats->hist[ii] /= 2;
+    }
+    stats->peakactive = stats->nactive;
+    stats->sinceadapt = 0;
+}
+#endif
+
+#ifndef NETBUF_LIBC_PROXY
+/**
+ * Free the idle blocks of the pool beyond the first @p keep ones, unless
+ * spans were reserved from it since the previous trim.
+ * @return the number of bytes freed
+ */
+static nb_SIZE mblock_trim(nb_MBPOOL *pool, unsigned int keep)
+{
+    nb_SIZE freed = 0;
+    unsigned int kept = 0;
+    sllist_iterator iter;
+
+    if (pool->stats.sincetrim) {
+        pool->stats.sincetrim = 0;
+        return 0;
+    }
+
+    SLLIST_ITERFOR(&pool->avail, &iter)
+    {
+        nb_MBLOCK *cur = SLLIST_ITEM(iter.cur, nb_MBLOCK, slnode);
+        if (kept < keep) {
+            kept++;
+            continue;
+        }
+        sllist_iter_remove(&pool->avail, &iter);
+        pool->curblocks--;
+        pool->stats.trimmed++;
+        freed += cur->nalloc;
+        mblock_wipe_block(cur);
+    }
+    pool->stats.trimmedbytes += freed;
+    /* The number of idle blocks kept by the next adaptation follows the quiet period, not the burst */
+    pool->stats.peakactive = pool->stats.nactive;
+    return freed;
+}
+#endif
+
+nb_SIZE netbuf_trim(nb_MGR *mgr, unsigned int keep)
+{
+#ifdef NETBUF_LIBC_PROXY
+    /* nothing is pooled */
+    (void)mgr;
+    (void)keep;
+    return 0;
+#else
+    return mblock_trim(&mgr->datapool, keep) + mblock_trim(&mgr->sendq.elempool, keep);
+#endif
+}
+
 int netbuf_mblock_reserve(nb_MGR *mgr, nb_SPAN *span)
 {
-    return mblock_reserve_data(&mgr->datapool, span);
+    nb_MBPOOL *pool = &mgr->datapool;
+
+    pool->stats.reserved++;
+    pool->stats.hist[hist_bucket(span->size)]++;
+
+#ifndef NETBUF_LIBC_PROXY
+    if (mgr->settings.data_adaptive) {
+        if (++pool->stats.sinceadapt >= NB_ADAPT_INTERVAL) {
+            mblock_adapt(pool, &mgr->settings);
+        }
+        if (span->size > pool->basealloc / 2) {
+            return reserve_dedicated_block(pool, span);
+        }
+    }
+#endif
+
+    return mblock_reserve_data(pool, span);
 }
 
 /******************************************************************************
@@ -496,6 +683,17 @@ nb_SIZE netbuf_mblock_get_next_size(const nb_MGR *mgr, int allow_wrap)
     return mblock_get_next_size(&mgr->datapool, allow_wrap);
 }
 
+nb_SIZE netbuf_get_idle_size(const nb_MGR *mgr)
+{
+    nb_SIZE ret = 0;
+    sllist_node *ll;
+    SLLIST_FOREACH(&mgr->datapool.avail, ll)
+    {
+        ret += SLLIST_ITEM(ll, nb_MBLOCK, slnode)->nalloc;
+    }
+    return ret;
+}
+
 unsigned int netbuf_get_niov(nb_MGR *mgr)
 {
     sllist_node *ll;
@@ -682,7 +880,10 @@ void netbuf_end_flush2(nb_MGR *mgr, unsigned int nflushed, nb_getsize_fn callbac
 void netbuf_mblock_release(nb_MGR *mgr, nb_SPAN *span)
 {
 #ifdef NETBUF_LIBC_PROXY
-    free(span->parent);
+    /* every span is its own allocation, giving back its tail does not free anything */
+    if (span->offset == 0) {
+        free(span->parent);
+    }
     (void)mgr;
 #else
     mblock_release_data(&mgr->datapool, span->parent, span->size, span->offset);
@@ -702,6 +903,20 @@ void netbuf_default_settings(nb_SETTINGS *settings)
     settings->dea_cacheblocks = NB_MBDEALLOC_CACHEBLOCKS;
     settings->sndq_basealloc = NB_SNDQ_BASEALLOC;
     settings->sndq_cacheblocks = NB_SNDQ_CACHEBLOCKS;
+    settings->data_adaptive = 0;
+    settings->data_maxalloc = 0;
+}
+
+void netbuf_set_maxalloc(nb_MGR *mgr, nb_SIZE maxalloc)
+{
+    mgr->settings.data_maxalloc = maxalloc;
+#ifndef NETBUF_LIBC_PROXY
+    if (mgr->settings.data_adaptive && maxalloc && mgr->datapool.basealloc > maxalloc) {
+        /* New blocks get the lower size right away */
+        mgr->datapool.basealloc = maxalloc;
+        mgr->datapool.stats.shrunk++;
+    }
+#endif
 }
 
 void netbuf_init(nb_MGR *mgr, const nb_SETTINGS *user_settings)
@@ -803,6 +1018,31 @@ static void dump_sendq(nb_SENDQ *q, FILE *fp)
     }
 }
 
+static void dump_stats(const nb_MGR *mgr, FILE *fp)
+{
+    const nb_MBPOOL *pool = &mgr->datapool;
+    int adaptive = mgr->settings.data_adaptive;
+    const char *indent = "  ";
+    const nb_MBSTATS *stats = &pool->stats;
+    unsigned int ii;
+
+    fprintf(fp, "Data Pool (%s)\n", adaptive ? "adaptive" : "fixed");
+    fprintf(fp, "%sBlock Size: %u, Max Idle Blocks: %u, Idle: %u, Active: %u (peak %u)\n", indent, pool->basealloc,
+            pool->maxblocks, pool->curblocks, stats->nactive, stats->peakactive);
+    fprintf(fp, "%sSpans: %lu, New Blocks: %lu, Dedicated: %lu, Grown: %lu, Shrunk: %lu\n", indent, stats->reserved,
+            stats->newblocks, stats->dedicated, stats->grown, stats->shrunk);
+    fprintf(fp, "%sIdle Bytes: %u, Trimmed Blocks: %lu (%lu bytes)\n", indent, netbuf_get_idle_size(mgr),
+            stats->trimmed, stats->trimmedbytes);
+    fprintf(fp, "%sSpan Sizes:", indent);
+    for (ii = 0; ii < NB_MBSTATS_NBUCKETS; ii++) {
+        if (stats->hist[ii]) {
+            fprintf(fp, " %s%u:%lu", ii == NB_MBSTATS_NBUCKETS - 1 ? ">" : "<=",
+                    (nb_SIZE)64 << (ii == NB_MBSTATS_NBUCKETS - 1 ? ii - 1 : ii), stats->hist[ii]);
+        }
+    }
+    fprintf(fp, "\n");
+}
+
 void netbuf_dump_status(nb_MGR *mgr, FILE *fp)
 {
     sllist_node *ll;
@@ -821,6 +1061,15 @@ void netbuf_dump_status(nb_MGR *mgr, FILE *fp)
         const char *indent = "    ";
         fprintf(fp, "%sBLOCK(AVAIL)=%p; BUF=%p, %uB\n", indent, (void *)block, (void *)block->root, block->nalloc);
     }
+    fprintf(fp, "DEDICATED:\n");
+    SLLIST_FOREACH(&mgr->datapool.dedicated, ll)
+    {
+        nb_MBLOCK *block = SLLIST_ITEM(ll, nb_MBLOCK, slnode);
+        const char *indent = "    ";
+        fprintf(fp, "%sBLOCK(DEDICATED)=%p; BUF=%p, %uB\n", indent, (void *)block, (void *)block->root,
+                block->nalloc);
+    }
+    dump_stats(mgr, fp);
     dump_sendq(&mgr->sendq, fp);
 }
 
@@ -852,6 +1101,10 @@ static int is_pool_clean(const nb_MBPOOL *pool, int is_dealloc)
             }
         }
     }
+    if (!SLLIST_IS_EMPTY(&pool->dedicated)) {
+        printf("MBPOOL %p: Dedicated blocks still in use\n", (void *)pool);
+        ret = 0;
+    }
     return ret;
 }
 
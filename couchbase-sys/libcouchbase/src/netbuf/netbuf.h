@@ -348,12 +348,37 @@ void netbuf_cleanup(nb_MGR *mgr);
  */
 void netbuf_default_settings(nb_SETTINGS *settings);
 
+/**
+ * Change the upper bound of the adaptive data block size of an initialized
+ * manager. Blocks in use are not touched; idle blocks which are too large are
+ * released at the next adaptation.
+ * @param mgr the manager
+ * @param maxalloc the new bound, 0 for the default
+ */
+void netbuf_set_maxalloc(nb_MGR *mgr, nb_SIZE maxalloc);
+
 /**
  * Dump the internal structure of the manager to the screen. Useful for
  * debugging.
  */
 void netbuf_dump_status(nb_MGR *mgr, FILE *fp);
 
+/**
+ * Free the idle blocks of the data and send queue pools beyond the first
+ * @p keep ones of each, so that the memory of a burst is not held while the
+ * manager is quiet. A pool from which spans were reserved since the previous
+ * call is left alone: it is only trimmed once it has been quiet for a full
+ * interval between two calls.
+ *
+ * @param mgr the manager
+ * @param keep the number of idle blocks to keep in each pool
+ * @return the number of bytes freed
+ */
+nb_SIZE netbuf_trim(nb_MGR *mgr, unsigned int keep);
+
+/** @return the number of bytes held by the idle blocks of the data pool */
+nb_SIZE netbuf_get_idle_size(const nb_MGR *mgr);
+
 /**
  * Mark a PDU as being enqueued. This should be called whenever the final IOV
  * for a given PDU has just been enqueued.
@@ -20,6 +20,7 @@
 #include "bucketconfig/clconfig.h"
 #include "vbucket/aliases.h"
 #include "sllist-inl.h"
+#include "trace.h"
 
 #define LOGARGS(instance, lvl) (instance)->settings, "newconfig", LCB_LOG_##lvl, __FILE__, __LINE__
 #define LOG(instance, lvlbase, msg) lcb_log(instance->settings, "newconfig", LCB_LOG_##lvlbase, __FILE__, __LINE__, msg)
@@ -190,7 +191,7 @@ static int iterwipe_cb(mc_CMDQUEUE *cq, mc_PIPELINE *oldpl, mc_PACKET *oldpkt, v
 {
     protocol_binary_request_header hdr;
     auto *srv = static_cast<lcb::Server *>(oldpl);
-    int newix;
+    int newix, vbid;
     auto *instance = (lcb_INSTANCE *)cq->cqdata;
 
     mcreq_read_hdr(oldpkt, &hdr);
@@ -205,24 +206,20 @@ static int iterwipe_cb(mc_CMDQUEUE *cq, mc_PIPELINE *oldpl, mc_PACKET *oldpkt, v
     }
 
     if (LCBVB_DISTTYPE(cq->config) == LCBVB_DIST_VBUCKET) {
-        newix = lcbvb_vbmaster(cq->config, ntohs(hdr.request.vbucket));
+        vbid = ntohs(hdr.request.vbucket);
+        newix = lcbvb_vbmaster(cq->config, vbid);
 
     } else {
         const char *key = nullptr;
         size_t nkey = 0;
-        int tmpid;
 
         /* XXX: We ignore hashkey. This is going away soon, and is probably
          * better than simply failing the items. */
         mcreq_get_key(oldpkt, &key, &nkey);
-        lcbvb_map_key(cq->config, key, nkey, &tmpid, &newix);
+        lcbvb_map_key(cq->config, key, nkey, &vbid, &newix);
     }
 
-    if (newix < 0 || newix > (int)cq->npipelines - 1) {
-        return MCREQ_KEEP_PACKET;
-    }
-
-    mc_PIPELINE *newpl = cq->pipelines[newix];
+    mc_PIPELINE *newpl = mcreq_queue_pipeline(cq, newix, vbid);
     if (newpl == oldpl || newpl == nullptr) {
         return MCREQ_KEEP_PACKET;
     }
@@ -231,38 +228,67 @@ static int iterwipe_cb(mc_CMDQUEUE *cq, mc_PIPELINE *oldpl, mc_PACKET *oldpkt, v
             oldpkt->opaque, SERVER_ARGS((lcb::Server *)oldpl), SERVER_ARGS((lcb::Server *)newpl));
 
     /** Otherwise, copy over the packet and find the new vBucket to map to */
-    mc_PACKET *newpkt = mcreq_renew_packet(oldpkt);
+    mc_PACKET *newpkt = mcreq_renew_packet(newpl, oldpkt);
     newpkt->flags &= ~MCREQ_STATE_FLAGS;
     mcreq_reenqueue_packet(newpl, newpkt);
     mcreq_packet_handled(oldpl, oldpkt);
     return MCREQ_REMOVE_PACKET;
 }
 
+/**
+ * Check whether every current server keeps its index in the new config. This
+ * is the case for most rebalance steps, which only move vBuckets around.
+ */
+static bool same_data_layout(mc_CMDQUEUE *cq, lcbvb_CONFIG *oldconfig, lcbvb_CONFIG *newconfig, unsigned groupsize)
+{
+    if (cq->npipelines != LCBVB_NSERVERS(newconfig) || cq->groupsize != groupsize) {
+        return false;
+    }
+    for (unsigned ii = 0; ii < cq->npipelines; ii++) {
+        auto *cur = static_cast<lcb::Server *>(cq->pipelines[ii]);
+        if (find_new_data_index(oldconfig, newconfig, cur) != static_cast<int>(ii)) {
+            return false;
+        }
+    }
+    return true;
+}
+
 static void replace_config(lcb_INSTANCE *instance, lcbvb_CONFIG *oldconfig, lcbvb_CONFIG *newconfig)
 {
     mc_CMDQUEUE *cq = &instance->cmdq;
     mc_PIPELINE **ppold, **ppnew;
-    unsigned ii, nold, nnew;
+    unsigned ii, nold, nnew, gold, gnew;
 
     lcb_assert(LCBT_VBCONFIG(instance) == newconfig);
 
+    gnew = LCBT_SETTING(instance, kv_connections_per_node);
+    if (same_data_layout(cq, oldconfig, newconfig, gnew)) {
+        /* Nothing to relocate. Packets for moved vBuckets on these servers
+         * are retried when the server responds with NOT_MY_VBUCKET */
+        lcb_log(LOGARGS(instance, DEBUG), "Data nodes unchanged, keeping all %u servers in place", cq->npipelines);
+        cq->config = newconfig;
+        return;
+    }
+
     nnew = LCBVB_NSERVERS(newconfig);
-    ppnew = reinterpret_cast<mc_PIPELINE **>(calloc(nnew, sizeof(*ppnew)));
-    ppold = mcreq_queue_take_pipelines(cq, &nold);
+    ppnew = reinterpret_cast<mc_PIPELINE **>(calloc(nnew * gnew, sizeof(*ppnew)));
+    ppold = mcreq_queue_take_pipelines(cq, &nold, &gold);
 
     /**
      * Determine which existing servers are still part of the new cluster config
-     * and place it inside the new list.
+     * and place it inside the new list. The additional connections of a server
+     * keep their position within its group, unless the group got smaller.
      */
-    for (ii = 0; ii < nold; ii++) {
+    for (ii = 0; ii < nold * gold; ii++) {
         auto *cur = static_cast<lcb::Server *>(ppold[ii]);
-        int newix = find_new_data_index(oldconfig, newconfig, cur);
+        unsigned member = ii / nold;
+        int newix = member < gnew ? find_new_data_index(oldconfig, newconfig, cur) : -1;
         if (newix > -1) {
             cur->set_new_index(newix);
-            ppnew[newix] = cur;
+            ppnew[member * nnew + newix] = cur;
             ppold[ii] = nullptr;
             lcb_log(LOGARGS(instance, INFO), "Reusing server " SERVER_FMT ". OldIndex=%d. NewIndex=%d",
-                    SERVER_ARGS(cur), ii, newix);
+                    SERVER_ARGS(cur), ii % nold, newix);
         }
     }
 
@@ -272,9 +298,9 @@ static void replace_config(lcb_INSTANCE *instance, lcbvb_CONFIG *oldconfig, lcbv
      * this before add_pipelines() is called, so that there are no holes inside
      * ppnew
      */
-    for (ii = 0; ii < nnew; ii++) {
+    for (ii = 0; ii < nnew * gnew; ii++) {
         if (!ppnew[ii]) {
-            ppnew[ii] = new lcb::Server(instance, static_cast<int>(ii));
+            ppnew[ii] = new lcb::Server(instance, static_cast<int>(ii % nnew));
         }
     }
 
@@ -282,13 +308,13 @@ static void replace_config(lcb_INSTANCE *instance, lcbvb_CONFIG *oldconfig, lcbv
      * Once we have all the server structures in place for the new config,
      * transfer the new config along with the new list over to the CQ structure.
      */
-    mcreq_queue_add_pipelines(cq, ppnew, nnew, newconfig);
+    mcreq_queue_add_pipelines(cq, ppnew, nnew, gnew, newconfig);
 
     /**
      * Go through all the servers that are to be removed and relocate commands
      * from their queues into the new queues
      */
-    for (ii = 0; ii < nold; ii++) {
+    for (ii = 0; ii < nold * gold; ii++) {
         if (!ppold[ii]) {
             continue;
         }
@@ -298,7 +324,7 @@ static void replace_config(lcb_INSTANCE *instance, lcbvb_CONFIG *oldconfig, lcbv
         static_cast<lcb::Server *>(ppold[ii])->close();
     }
 
-    for (ii = 0; ii < nnew; ii++) {
+    for (ii = 0; ii < nnew * gnew; ii++) {
         if (static_cast<lcb::Server *>(ppnew[ii])->has_pending()) {
             ppnew[ii]->flush_start(ppnew[ii]);
         }
@@ -330,16 +356,18 @@ void lcb_update_vbconfig(lcb_INSTANCE *instance, lcb_pCONFIGINFO config)
         lcb_vbguess_newconfig(instance, config->vbc, instance->vbguess);
 
         replace_config(instance, old_config->vbc, config->vbc);
+        instance->retryq->remap(old_config->vbc);
         old_config->decref();
     } else {
         size_t nservers = VB_NSERVERS(config->vbc);
+        unsigned groupsize = LCBT_SETTING(instance, kv_connections_per_node);
         std::vector<mc_PIPELINE *> servers;
 
-        for (size_t ii = 0; ii < nservers; ii++) {
-            servers.push_back(new lcb::Server(instance, ii));
+        for (size_t ii = 0; ii < nservers * groupsize; ii++) {
+            servers.push_back(new lcb::Server(instance, ii % nservers));
         }
 
-        mcreq_queue_add_pipelines(q, &servers[0], nservers, config->vbc);
+        mcreq_queue_add_pipelines(q, servers.data(), nservers, groupsize, config->vbc);
     }
 
     /* Update the list of nodes here for server list */
@@ -351,5 +379,40 @@ void lcb_update_vbconfig(lcb_INSTANCE *instance, lcb_pCONFIGINFO config)
         }
     }
 
+    TRACE_CONFIG_APPLIED(instance, config);
+    lcb_flight_record(instance, LCB_FLIGHT_CONFIG, nullptr, nullptr, static_cast<uint32_t>(config->vbc->revid));
+    lcb_update_http_pool_targets(instance);
     lcb_maybe_breakout(instance);
 }
+
+void lcb_update_http_pool_targets(lcb_INSTANCE *instance)
+{
+    lcbvb_CONFIG *vbc = LCBT_VBCONFIG(instance);
+    if (vbc == nullptr) {
+        return;
+    }
+
+    struct {
+        lcbvb_SVCTYPE svc;
+        lcb_U32 target;
+        lcb_U32 timeout;
+    } services[] = {
+        {LCBVB_SVCTYPE_QUERY, LCBT_SETTING(instance, n1ql_pool_target), LCBT_SETTING(instance, n1ql_timeout)},
+        {LCBVB_SVCTYPE_SEARCH, LCBT_SETTING(instance, fts_pool_target), LCBT_SETTING(instance, search_timeout)},
+        {LCBVB_SVCTYPE_ANALYTICS, LCBT_SETTING(instance, cbas_pool_target), LCBT_SETTING(instance, analytics_timeout)},
+    };
+
+    /* Nodes which left the cluster should not keep their connections */
+    instance->http_sockpool->clear_targets();
+    for (const auto &service : services) {
+        if (service.target == 0) {
+            continue;
+        }
+        for (size_t ii = 0; ii < LCBVB_NSERVERS(vbc); ++ii) {
+            const char *hp = lcbvb_get_hostport(vbc, ii, service.svc, LCBT_SETTING_SVCMODE(instance));
+            if (hp) {
+                instance->http_sockpool->set_target(hp, service.target, service.timeout);
+            }
+        }
+    }
+}
@@ -21,6 +21,7 @@
 #include "collections.h"
 #include "trace.h"
 #include "defer.h"
+#include "mc/encoder.hh"
 
 #include "capi/cmd_counter.hh"
 #include "capi/deferred_command_context.hh"
@@ -210,44 +211,53 @@ static lcb_STATUS counter_schedule(lcb_INSTANCE *instance, std::shared_ptr<lcb_C
 
     rdata = &packet->u_rdata.reqdata;
     rdata->cookie = cmd->cookie();
+    if (cmd->is_cookie_callback()) {
+        packet->flags |= MCREQ_F_PRIVCALLBACK;
+    }
     rdata->start = cmd->start_time_or_default_in_nanoseconds(gethrtime());
     rdata->deadline =
         rdata->start + cmd->timeout_or_default_in_nanoseconds(LCB_US2NS(LCBT_SETTING(instance, operation_timeout)));
-    hdr.request.datatype = PROTOCOL_BINARY_RAW_BYTES;
-    hdr.request.cas = 0;
-    hdr.request.opaque = packet->opaque;
-    hdr.request.bodylen = htonl(ffextlen + hdr.request.extlen + mcreq_get_key_size(&hdr));
-
+    std::uint8_t opcode;
     std::uint64_t delta;
     if (cmd->delta() < 0) {
-        hdr.request.opcode = PROTOCOL_BINARY_CMD_DECREMENT;
+        opcode = PROTOCOL_BINARY_CMD_DECREMENT;
         delta = lcb_htonll((std::uint64_t)(cmd->delta() * -1));
     } else {
-        hdr.request.opcode = PROTOCOL_BINARY_CMD_INCREMENT;
+        opcode = PROTOCOL_BINARY_CMD_INCREMENT;
         delta = lcb_htonll(cmd->delta());
     }
-
-    memcpy(SPAN_BUFFER(&packet->kh_span), &hdr, sizeof(hdr));
-    std::size_t offset = sizeof(hdr);
-    if (!framing_extras.empty()) {
-        memcpy(SPAN_BUFFER(&packet->kh_span) + offset, framing_extras.data(), framing_extras.size());
-        offset += framing_extras.size();
-    }
-
-    memcpy(SPAN_BUFFER(&packet->kh_span) + offset, &delta, sizeof(delta));
-    offset += sizeof(delta);
-
     std::uint64_t initial = lcb_htonll(cmd->initial_value());
-    memcpy(SPAN_BUFFER(&packet->kh_span) + offset, &initial, sizeof(initial));
-    offset += sizeof(initial);
-
     std::uint32_t expiry;
     if (cmd->initialize_if_does_not_exist()) {
         expiry = htonl(cmd->expiry());
     } else {
         memset(&expiry, 0xff, sizeof(expiry));
     }
-    memcpy(SPAN_BUFFER(&packet->kh_span) + offset, &expiry, sizeof(expiry));
+
+    std::uint8_t extras[sizeof(delta) + sizeof(initial) + sizeof(expiry)];
+    memcpy(extras, &delta, sizeof(delta));
+    memcpy(extras + sizeof(delta), &initial, sizeof(initial));
+    memcpy(extras + sizeof(delta) + sizeof(initial), &expiry, sizeof(expiry));
+
+    if (framing_extras.empty()) {
+        if (opcode == PROTOCOL_BINARY_CMD_DECREMENT) {
+            lcb::mc::RequestEncoder<PROTOCOL_BINARY_CMD_DECREMENT, sizeof(extras)>::encode(packet, hdr, 0, 0, extras);
+        } else {
+            lcb::mc::RequestEncoder<PROTOCOL_BINARY_CMD_INCREMENT, sizeof(extras)>::encode(packet, hdr, 0, 0, extras);
+        }
+    } else {
+        hdr.request.opcode = opcode;
+        hdr.request.datatype = PROTOCOL_BINARY_RAW_BYTES;
+        hdr.request.cas = 0;
+        hdr.request.opaque = packet->opaque;
+        hdr.request.bodylen = htonl(ffextlen + hdr.request.extlen + mcreq_get_key_size(&hdr));
+
+        memcpy(SPAN_BUFFER(&packet->kh_span), &hdr, sizeof(hdr));
+        std::size_t offset = sizeof(hdr);
+        memcpy(SPAN_BUFFER(&packet->kh_span) + offset, framing_extras.data(), framing_extras.size());
+        offset += framing_extras.size();
+        memcpy(SPAN_BUFFER(&packet->kh_span) + offset, extras, sizeof(extras));
+    }
 
     rdata->span = lcb::trace::start_kv_span(instance->settings, packet, cmd);
     TRACE_ARITHMETIC_BEGIN(instance, &hdr, cmd);
@@ -255,6 +265,18 @@ static lcb_STATUS counter_schedule(lcb_INSTANCE *instance, std::shared_ptr<lcb_C
     return LCB_SUCCESS;
 }
 
+/**
+ * Commands whose cookie is their callback (see lcb_CMDCOUNTER::treat_cookie_as_callback()) have to be completed through
+ * it as well if they fail before being scheduled.
+ */
+static lcb_RESPCALLBACK counter_callback(lcb_INSTANCE *instance, const std::shared_ptr<lcb_CMDCOUNTER> &cmd)
+{
+    if (cmd->is_cookie_callback()) {
+        return *static_cast<lcb_RESPCALLBACK *>(cmd->cookie());
+    }
+    return lcb_find_callback(instance, LCB_CALLBACK_COUNTER);
+}
+
 static lcb_STATUS counter_execute(lcb_INSTANCE *instance, std::shared_ptr<lcb_CMDCOUNTER> cmd)
 {
     if (!LCBT_SETTING(instance, use_collections)) {
@@ -270,7 +292,7 @@ static lcb_STATUS counter_execute(lcb_INSTANCE *instance, std::shared_ptr<lcb_CM
         instance, cmd,
         [instance](lcb_STATUS status, const lcb_RESPGETCID *resp, std::shared_ptr<lcb_CMDCOUNTER> operation) {
             const auto callback_type = LCB_CALLBACK_COUNTER;
-            lcb_RESPCALLBACK operation_callback = lcb_find_callback(instance, callback_type);
+            lcb_RESPCALLBACK operation_callback = counter_callback(instance, operation);
             lcb_RESPCOUNTER response{};
             if (resp != nullptr) {
                 response.ctx = resp->ctx;
@@ -310,7 +332,7 @@ lcb_STATUS lcb_counter(lcb_INSTANCE *instance, void *cookie, const lcb_CMDCOUNTE
         cmd->start_time_in_nanoseconds(gethrtime());
         return lcb::defer_operation(instance, [instance, cmd](lcb_STATUS status) {
             const auto callback_type = LCB_CALLBACK_COUNTER;
-            lcb_RESPCALLBACK operation_callback = lcb_find_callback(instance, callback_type);
+            lcb_RESPCALLBACK operation_callback = counter_callback(instance, cmd);
             lcb_RESPCOUNTER response{};
             response.ctx.key = cmd->key();
             response.cookie = cmd->cookie();
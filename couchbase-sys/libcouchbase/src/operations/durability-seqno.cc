@@ -21,10 +21,33 @@
 
 #include "capi/cmd_observe_seqno.hh"
 
+#include <map>
+#include <memory>
+#include <tuple>
+
 using namespace lcb::durability;
 
 namespace
 {
+/**
+ * A single OBSERVE_SEQNO request sent to one server for one vBucket. Every
+ * pending item on that vBucket (and with the same vBucket UUID) is answered by
+ * the same response, since a seqno at or above an item's mutation seqno covers
+ * all earlier mutations too.
+ */
+struct Probe : public CallbackCookie {
+    Probe(Durset *parent_, lcb_U64 uuid_, lcb_U16 vbid_, lcb_U16 server_index_)
+        : parent(parent_), uuid(uuid_), vbid(vbid_), server_index(server_index_)
+    {
+    }
+
+    Durset *parent;
+    lcb_U64 uuid;
+    lcb_U16 vbid;
+    lcb_U16 server_index;
+    std::vector<Item *> items;
+};
+
 class SeqnoDurset : public Durset
 {
   public:
@@ -34,7 +57,9 @@ class SeqnoDurset : public Durset
 
     lcb_STATUS after_add(Item &item, const lcb_MUTATION_TOKEN *token) override;
 
-    void update(const lcb_RESPOBSEQNO *resp);
+  private:
+    /** Probes of the current sweep. Replaced at the start of each poll */
+    std::vector<std::unique_ptr<Probe>> probes;
 };
 } // namespace
 
@@ -45,16 +70,15 @@ Durset *Durset::createSeqnoDurset(lcb_INSTANCE *instance, const lcb_durability_o
 
 #define ENT_SEQNO(ent) (ent)->reqseqno
 
-static void seqno_callback(lcb_INSTANCE *, int, const lcb_RESPBASE *rb)
+static void update_item(Item *ent, const lcb_RESPOBSEQNO *resp)
 {
-    const lcb_RESPOBSEQNO *resp = (const lcb_RESPOBSEQNO *)rb;
-    int flags = 0;
-    Item *ent = static_cast<Item *>(reinterpret_cast<CallbackCookie *>(resp->cookie));
+    if (ent->done) {
+        return;
+    }
 
-    /* Now, process the response */
     if (resp->ctx.rc != LCB_SUCCESS) {
         ent->res().ctx.rc = resp->ctx.rc;
-        goto GT_TALLY;
+        return;
     }
 
     lcb_U64 seqno_mem, seqno_disk;
@@ -63,7 +87,7 @@ static void seqno_callback(lcb_INSTANCE *, int, const lcb_RESPBASE *rb)
         seqno_mem = seqno_disk = resp->old_seqno;
         if (seqno_mem < ENT_SEQNO(ent)) {
             ent->finish(LCB_ERR_MUTATION_LOST);
-            goto GT_TALLY;
+            return;
         }
     } else {
         seqno_mem = resp->mem_seqno;
@@ -71,21 +95,31 @@ static void seqno_callback(lcb_INSTANCE *, int, const lcb_RESPBASE *rb)
     }
 
     if (seqno_mem < ENT_SEQNO(ent)) {
-        goto GT_TALLY;
+        return;
     }
 
-    flags = Item::UPDATE_REPLICATED;
+    int flags = Item::UPDATE_REPLICATED;
     if (seqno_disk >= ENT_SEQNO(ent)) {
         flags |= Item::UPDATE_PERSISTED;
     }
 
     ent->update(flags, resp->server_index);
+}
+
+static void seqno_callback(lcb_INSTANCE *, int, const lcb_RESPBASE *rb)
+{
+    const lcb_RESPOBSEQNO *resp = (const lcb_RESPOBSEQNO *)rb;
+    Probe *probe = static_cast<Probe *>(reinterpret_cast<CallbackCookie *>(resp->cookie));
+    Durset *dset = probe->parent;
 
-GT_TALLY:
-    if (!--ent->parent->waiting) {
+    for (Item *ent : probe->items) {
+        update_item(ent, resp);
+    }
+
+    if (!--dset->waiting) {
         /* avoid ssertion (wait==0)! */
-        ent->parent->waiting = 1;
-        ent->parent->on_poll_done();
+        dset->waiting = 1;
+        dset->on_poll_done();
     }
 }
 
@@ -94,36 +128,50 @@ lcb_STATUS SeqnoDurset::poll_impl()
     lcb_STATUS ret_err = LCB_ERR_SDK_INTERNAL; /* This should never be returned */
     bool has_ops = false;
 
-    lcb_sched_enter(instance);
+    /* Group the pending items by the probe which answers them */
+    std::map<std::tuple<lcb_U16, lcb_U16, lcb_U64>, Probe *> by_target;
+    probes.clear();
     for (size_t ii = 0; ii < entries.size(); ii++) {
         Item &ent = entries[ii];
         lcb_U16 servers[4];
-        lcb_CMDOBSEQNO cmd = {0};
 
         if (ent.done) {
             continue;
         }
 
-        cmd.uuid = ent.uuid;
-        cmd.vbid = ent.vbid;
-        cmd.cmdflags = LCB_CMD_F_INTERNAL_CALLBACK;
-        ent.callback = seqno_callback;
-
         size_t nservers = ent.prepare(servers);
         if (nservers == 0) {
             ret_err = LCB_ERR_DURABILITY_TOO_MANY;
             continue;
         }
         for (size_t jj = 0; jj < nservers; jj++) {
-            lcb_STATUS err;
-            cmd.server_index = servers[jj];
-            LCB_CMD_SET_TRACESPAN(&cmd, span);
-            err = lcb_observe_seqno3(instance, &ent.callback, &cmd);
-            if (err == LCB_SUCCESS) {
-                waiting++;
-                has_ops = true;
-            } else {
-                ent.res().ctx.rc = ret_err = err;
+            Probe *&probe = by_target[std::make_tuple(ent.vbid, servers[jj], ent.uuid)];
+            if (probe == nullptr) {
+                probes.emplace_back(new Probe(this, ent.uuid, ent.vbid, servers[jj]));
+                probe = probes.back().get();
+                probe->callback = seqno_callback;
+            }
+            probe->items.push_back(&ent);
+        }
+    }
+
+    lcb_sched_enter(instance);
+    for (auto &probe : probes) {
+        lcb_CMDOBSEQNO cmd = {0};
+        cmd.uuid = probe->uuid;
+        cmd.vbid = probe->vbid;
+        cmd.server_index = probe->server_index;
+        cmd.cmdflags = LCB_CMD_F_INTERNAL_CALLBACK;
+        LCB_CMD_SET_TRACESPAN(&cmd, span);
+
+        lcb_STATUS err = lcb_observe_seqno3(instance, &probe->callback, &cmd);
+        if (err == LCB_SUCCESS) {
+            waiting++;
+            has_ops = true;
+        } else {
+            ret_err = err;
+            for (Item *ent : probe->items) {
+                ent->res().ctx.rc = err;
             }
         }
     }
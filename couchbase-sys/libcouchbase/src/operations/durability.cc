@@ -160,6 +160,11 @@ void Item::update(int flags, int srvix)
     bool is_master = lcbvb_vbmaster(LCBT_VBCONFIG(instance), vbid) == srvix;
     const lcb::Server *server = instance->get_server(srvix);
 
+    if (info->server != server || ((flags & UPDATE_PERSISTED) && !info->persisted) ||
+        ((flags & UPDATE_REPLICATED) && !info->exists)) {
+        parent->nprogress++;
+    }
+
     info->clear();
     info->server = server;
 
@@ -246,11 +251,28 @@ void Durset::on_poll_done()
     waiting = 0;
 
     if (nremaining > 0) {
+        adapt_interval();
         switch_state(STATE_OBSPOLL);
     }
     decref();
 }
 
+void Durset::adapt_interval()
+{
+    if (!adaptive_interval) {
+        return;
+    }
+
+    lcb_U32 min_interval = std::max<lcb_U32>(base_interval / 8, 1);
+    lcb_U32 max_interval = base_interval * 4;
+    if (nprogress) {
+        opts.interval = std::max(opts.interval / 2, min_interval);
+    } else {
+        opts.interval = std::min(opts.interval * 2, max_interval);
+    }
+    nprogress = 0;
+}
+
 /**
  * Schedules a single sweep of observe requests.
  * The `initial` parameter determines if this is a retry or if this is the
@@ -371,7 +393,7 @@ lcb_STATUS Durset::MCTX_done(void *cookie_)
     nremaining = entries.size();
     ns_timeout = gethrtime() + LCB_US2NS(opts.timeout);
 
-    lcb_aspend_add(&instance->pendops, LCB_PENDTYPE_DURABILITY, this);
+    lcb_aspend_add(&instance->pendops, LCB_PENDTYPE_DURABILITY, &pending);
     switch_state(STATE_INIT);
     return LCB_SUCCESS;
 }
@@ -392,9 +414,11 @@ void lcbdurctx_set_durstore(lcb_MULTICMD_CTX *mctx, int enabled)
 
 Durset::Durset(lcb_INSTANCE *instance_, const lcb_durability_opts_t *options)
     : MultiCmdContext(), nremaining(0), waiting(0), refcnt(0), next_state(STATE_OBSPOLL), lasterr(LCB_SUCCESS),
-      is_durstore(false), cookie(NULL), ns_timeout(0), timer(NULL), instance(instance_), span(NULL)
+      is_durstore(false), cookie(NULL), ns_timeout(0), timer(NULL), instance(instance_), span(NULL),
+      adaptive_interval(false), base_interval(0), nprogress(0)
 {
     const lcb_DURABILITYOPTSv0 *opts_in = &options->v.v0;
+    lcb_aspend_item_init(&pending, this);
 
     std::memset(&opts, 0, sizeof opts);
 
@@ -412,7 +436,9 @@ Durset::Durset(lcb_INSTANCE *instance_, const lcb_durability_opts_t *options)
 
     if (!opts.interval) {
         opts.interval = LCBT_SETTING(instance, durability_interval);
+        adaptive_interval = true;
     }
+    base_interval = opts.interval;
 
     lcbio_pTABLE io = instance->iotable;
     timer = io->timer.create(io->p);
@@ -477,7 +503,7 @@ Durset::~Durset()
         timer = NULL;
     }
 
-    lcb_aspend_del(&instance->pendops, LCB_PENDTYPE_DURABILITY, this);
+    lcb_aspend_del(&instance->pendops, LCB_PENDTYPE_DURABILITY, &pending);
     lcb_maybe_breakout(instance);
 }
 
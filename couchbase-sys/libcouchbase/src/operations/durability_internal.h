@@ -267,6 +267,14 @@ struct Durset : public MultiCmdContext {
 
     static Durset *createSeqnoDurset(lcb_INSTANCE *, const lcb_durability_opts_t *);
 
+    /**
+     * Adjust the poll interval after a sweep, unless the user supplied one.
+     * Sweeps which observed new persistence/replication halve the interval;
+     * sweeps which observed nothing double it. The result is kept between
+     * 1/8 and 4 times the configured `durability_interval`.
+     */
+    void adapt_interval();
+
     lcb_DURABILITYOPTSv0 opts; /**< Sanitized user options */
     std::vector<Item> entries;
     unsigned nremaining; /**< Number of entries remaining to poll for */
@@ -280,7 +288,11 @@ struct Durset : public MultiCmdContext {
     hrtime_t ns_timeout; /**< Timestamp of next timeout */
     void *timer;
     lcb_INSTANCE *instance;
+    lcb_ASPEND_ITEM pending; /**< Link into the pending durability sets of the instance */
     lcbtrace_SPAN *span;
+    bool adaptive_interval;   /**< Whether opts.interval was derived from settings */
+    lcb_U32 base_interval;    /**< Configured interval the adaptive one is bounded by */
+    unsigned nprogress;       /**< Server states which changed during the current sweep */
 };
 
 } // namespace durability
@@ -0,0 +1,182 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2020 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "internal.h"
+#include "capi/cmd_store.hh"
+
+#include <vector>
+
+#define LOGARGS(instance, lvl) (instance)->settings, "durbatch", LCB_LOG_##lvl, __FILE__, __LINE__
+
+namespace
+{
+/**
+ * One write of the batch. The packet is scheduled with the entry as its
+ * cookie, and `callback` being the first member makes the entry usable as a
+ * private callback (MCREQ_F_PRIVCALLBACK).
+ */
+struct BatchEntry {
+    lcb_RESPCALLBACK callback{nullptr};
+    lcb_DURABLEBATCH *batch{nullptr};
+    void *cookie{nullptr};
+    lcb_CMDSTORE cmd{};
+};
+} // namespace
+
+struct lcb_DURABLEBATCH_ {
+    lcb_INSTANCE *instance{nullptr};
+    lcb_DURABILITY_LEVEL level{LCB_DURABILITYLEVEL_NONE};
+    /** Already adjusted by lcb_durability_timeout() rules, in microseconds */
+    uint32_t timeout{0};
+    std::vector<BatchEntry> entries{};
+
+    void *cookie{nullptr};
+    lcb_DURABLEBATCH_CALLBACK callback{nullptr};
+    bool submitted{false};
+    size_t nremaining{0};
+    size_t nsuccess{0};
+    size_t nfailure{0};
+    lcb_STATUS first_error{LCB_SUCCESS};
+
+    void complete(lcb_STATUS rc)
+    {
+        if (rc == LCB_SUCCESS) {
+            nsuccess++;
+        } else {
+            nfailure++;
+            if (first_error == LCB_SUCCESS) {
+                first_error = rc;
+            }
+        }
+        release();
+    }
+
+    void release()
+    {
+        if (--nremaining == 0) {
+            if (callback) {
+                callback(instance, cookie, nsuccess, nfailure, first_error);
+            }
+            delete this;
+        }
+    }
+};
+
+static void entry_callback(lcb_INSTANCE *instance, int cbtype, const lcb_RESPBASE *rb)
+{
+    auto *resp = const_cast<lcb_RESPSTORE *>(reinterpret_cast<const lcb_RESPSTORE *>(rb));
+    auto *entry = reinterpret_cast<BatchEntry *>(resp->cookie);
+    lcb_DURABLEBATCH *batch = entry->batch;
+
+    resp->cookie = entry->cookie;
+    lcb_RESPCALLBACK user_callback = lcb_find_callback(instance, LCB_CALLBACK_STORE);
+    user_callback(instance, cbtype, rb);
+    batch->complete(resp->ctx.rc);
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_durablebatch_create(lcb_INSTANCE *instance, lcb_DURABLEBATCH **batch,
+                                                    lcb_DURABILITY_LEVEL level, uint32_t timeout)
+{
+    if (level == LCB_DURABILITYLEVEL_NONE) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    if (!LCBT_SETTING(instance, enable_durable_write)) {
+        return LCB_ERR_UNSUPPORTED_OPERATION;
+    }
+
+    auto *res = new lcb_DURABLEBATCH_();
+    res->instance = instance;
+    res->level = level;
+    if (timeout == 0) {
+        timeout = LCBT_SETTING(instance, operation_timeout);
+    }
+    if (timeout < LCBT_SETTING(instance, persistence_timeout_floor)) {
+        lcb_log(LOGARGS(instance, WARN), "Durability timeout of the batch is too low (%uus), using %uus instead",
+                timeout, LCBT_SETTING(instance, persistence_timeout_floor));
+        timeout = LCBT_SETTING(instance, persistence_timeout_floor);
+    }
+    res->timeout = timeout;
+    *batch = res;
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_durablebatch_destroy(lcb_DURABLEBATCH *batch)
+{
+    if (batch->submitted) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    delete batch;
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_durablebatch_store(lcb_DURABLEBATCH *batch, void *cookie, const lcb_CMDSTORE *cmd)
+{
+    if (batch->submitted) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+
+    BatchEntry entry;
+    entry.cmd = *cmd;
+    lcb_STATUS rc = entry.cmd.durability_level(batch->level);
+    if (rc != LCB_SUCCESS) {
+        return rc;
+    }
+    entry.cmd.timeout_in_microseconds(batch->timeout);
+    entry.cmd.treat_cookie_as_callback(true);
+    entry.callback = entry_callback;
+    entry.batch = batch;
+    entry.cookie = cookie;
+    batch->entries.emplace_back(std::move(entry));
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_durablebatch_submit(lcb_DURABLEBATCH *batch, void *cookie,
+                                                    lcb_DURABLEBATCH_CALLBACK callback)
+{
+    if (batch->submitted || batch->entries.empty()) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+
+    lcb_INSTANCE *instance = batch->instance;
+    batch->submitted = true;
+    batch->cookie = cookie;
+    batch->callback = callback;
+    /* Hold one reference until every entry was scheduled, so that entries which complete (or fail) while scheduling
+     * cannot finish the batch early */
+    batch->nremaining = batch->entries.size() + 1;
+
+    /* All entries share the start time, and so the deadline: they expire in the same tick of the pipelines' timer
+     * wheels, and the server gets the same durability timeout for all of them */
+    hrtime_t now = gethrtime();
+    lcb_sched_enter(instance);
+    for (auto &entry : batch->entries) {
+        entry.cmd.start_time_in_nanoseconds(now);
+        lcb_STATUS rc = lcb_store(instance, &entry, &entry.cmd);
+        if (rc != LCB_SUCCESS) {
+            lcb_RESPSTORE resp{};
+            resp.ctx.key = entry.cmd.key();
+            resp.ctx.rc = rc;
+            resp.cookie = entry.cookie;
+            lcb_find_callback(instance, LCB_CALLBACK_STORE)(instance, LCB_CALLBACK_STORE,
+                                                            reinterpret_cast<const lcb_RESPBASE *>(&resp));
+            batch->complete(rc);
+        }
+    }
+    lcb_sched_leave(instance);
+    batch->release();
+    return LCB_SUCCESS;
+}
@@ -19,6 +19,7 @@
 #include "collections.h"
 #include "trace.h"
 #include "defer.h"
+#include "nearcache.h"
 
 #include "capi/cmd_exists.hh"
 
@@ -107,6 +108,11 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdexists_key(lcb_CMDEXISTS *cmd, const char *ke
     return cmd->key(std::string(key, key_len));
 }
 
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdexists_near_cache(lcb_CMDEXISTS *cmd, int enable)
+{
+    return cmd->near_cache(enable != 0);
+}
+
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdexists_on_behalf_of(lcb_CMDEXISTS *cmd, const char *data, size_t data_len)
 {
     return cmd->on_behalf_of(std::string(data, data_len));
@@ -130,6 +136,34 @@ static lcb_STATUS exists_validate(lcb_INSTANCE *instance, const lcb_CMDEXISTS *c
     return LCB_SUCCESS;
 }
 
+/**
+ * @return true if the near cache knows that the key is missing. The callback
+ * is then invoked once the application returns to the event loop.
+ */
+static bool near_cache_lookup(lcb_INSTANCE *instance, const std::shared_ptr<lcb_CMDEXISTS> &cmd)
+{
+    lcb_NEARCACHE *cache = lcb_near_cache_ensure(instance);
+    std::string key = lcb_near_cache_key(instance, cmd->collection().collection_id(), cmd->key());
+    if (!cache->misses.contains(key, lcb_settings_now(instance->settings),
+                                LCB_US2NS(LCBT_SETTING(instance, near_cache_ttl)))) {
+        return false;
+    }
+    cache->answer([instance, cmd](lcb_STATUS rc) {
+        lcb_RESPEXISTS resp{};
+        resp.ctx.rc = rc == LCB_SUCCESS ? LCB_ERR_DOCUMENT_NOT_FOUND : rc;
+        resp.ctx.key = cmd->key();
+        resp.ctx.scope = cmd->collection().scope();
+        resp.ctx.collection = cmd->collection().collection();
+        resp.cookie = cmd->cookie();
+        resp.rflags |= LCB_RESP_F_FINAL;
+        lcb_find_callback(instance, LCB_CALLBACK_EXISTS)(instance, LCB_CALLBACK_EXISTS, (const lcb_RESPBASE *)&resp);
+    });
+    if (instance->settings->metrics) {
+        instance->settings->metrics->negative_cache_hits++;
+    }
+    return true;
+}
+
 static lcb_STATUS exists_schedule(lcb_INSTANCE *instance, std::shared_ptr<lcb_CMDEXISTS> cmd)
 {
     mc_CMDQUEUE *cq = &instance->cmdq;
@@ -139,6 +173,11 @@ static lcb_STATUS exists_schedule(lcb_INSTANCE *instance, std::shared_ptr<lcb_CM
     mc_PACKET *pkt;
     lcb_STATUS err;
 
+    bool near_cache = cmd->near_cache() && LCBT_SETTING(instance, negative_cache_size);
+    if (near_cache && near_cache_lookup(instance, cmd)) {
+        return LCB_SUCCESS;
+    }
+
     std::vector<std::uint8_t> framing_extras;
     if (cmd->want_impersonation()) {
         err = lcb::flexible_framing_extras::encode_impersonate_user(cmd->impostor(), framing_extras);
@@ -162,6 +201,9 @@ static lcb_STATUS exists_schedule(lcb_INSTANCE *instance, std::shared_ptr<lcb_CM
     if (err != LCB_SUCCESS) {
         return err;
     }
+    if (near_cache) {
+        pkt->flags |= MCREQ_F_NEARCACHE;
+    }
 
     hdr.request.opcode = PROTOCOL_BINARY_CMD_GET_META;
     hdr.request.datatype = PROTOCOL_BINARY_RAW_BYTES;
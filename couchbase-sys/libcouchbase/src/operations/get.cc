@@ -16,13 +16,17 @@
  */
 
 #include <memory>
+#include <unordered_map>
 
 #include "internal.h"
 #include "collections.h"
 #include "trace.h"
 #include "defer.h"
+#include "nearcache.h"
+#include "mc/encoder.hh"
 
 #include "capi/cmd_get.hh"
+#include "capi/cmd_get_replica.hh"
 
 LIBCOUCHBASE_API lcb_STATUS lcb_respget_status(const lcb_RESPGET *resp)
 {
@@ -73,6 +77,11 @@ LIBCOUCHBASE_API lcb_STATUS lcb_respget_value(const lcb_RESPGET *resp, const cha
     return LCB_SUCCESS;
 }
 
+LIBCOUCHBASE_API int lcb_respget_is_replica(const lcb_RESPGET *resp)
+{
+    return resp->is_replica;
+}
+
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdget_create(lcb_CMDGET **cmd)
 {
     *cmd = new lcb_CMDGET{};
@@ -124,6 +133,21 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdget_locktime(lcb_CMDGET *cmd, uint32_t durati
     return cmd->with_lock(duration);
 }
 
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdget_hedge(lcb_CMDGET *cmd, uint32_t delay)
+{
+    return cmd->hedge(delay);
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdget_near_cache(lcb_CMDGET *cmd, int enable)
+{
+    return cmd->near_cache(enable != 0);
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdget_stream_value(lcb_CMDGET *cmd, int enable)
+{
+    return cmd->stream_value(enable != 0);
+}
+
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdget_on_behalf_of(lcb_CMDGET *cmd, const char *data, size_t data_len)
 {
     return cmd->on_behalf_of(std::string(data, data_len));
@@ -148,6 +172,443 @@ static lcb_STATUS get_validate(lcb_INSTANCE *instance, const lcb_CMDGET *cmd)
     return LCB_SUCCESS;
 }
 
+/** Latencies of up to 7us have a bucket of their own, larger ones fall into 4 buckets per power of two */
+#define LATENCY_NBUCKETS 128
+/** The counts are halved once this many latencies were recorded, so that old ones fade out */
+#define LATENCY_DECAY 4096
+/** Fewer latencies than this are not enough to derive the hedge delay from */
+#define LATENCY_MIN_SAMPLES 128
+/** Hedge delay used until enough latencies were recorded */
+#define HEDGE_DELAY_COLD LCB_MS2US(10)
+
+struct lcb_GETLATENCY_st {
+    std::uint32_t counts[LATENCY_NBUCKETS]{};
+    std::uint32_t total{0};
+};
+
+static unsigned latency_bucket(std::uint64_t us)
+{
+    if (us < 8) {
+        return static_cast<unsigned>(us);
+    }
+    unsigned octave = 3;
+    while (octave < 63 && (us >> (octave + 1)) != 0) {
+        octave++;
+    }
+    unsigned ix = octave * 4 + static_cast<unsigned>((us >> (octave - 2)) & 3);
+    return ix < LATENCY_NBUCKETS ? ix : LATENCY_NBUCKETS - 1;
+}
+
+static std::uint64_t latency_bucket_max(unsigned ix)
+{
+    if (ix < 8) {
+        return ix;
+    }
+    unsigned octave = ix / 4;
+    return (static_cast<std::uint64_t>(5 + ix % 4) << (octave - 2)) - 1;
+}
+
+void lcb_get_latency_record(lcb_INSTANCE *instance, hrtime_t latency)
+{
+    lcb_GETLATENCY *window = instance->get_latency;
+    window->counts[latency_bucket(LCB_NS2US(latency))]++;
+    if (++window->total == LATENCY_DECAY) {
+        window->total = 0;
+        for (auto &count : window->counts) {
+            count /= 2;
+            window->total += count;
+        }
+    }
+}
+
+void lcb_get_latency_destroy(lcb_GETLATENCY *latency)
+{
+    delete latency;
+}
+
+/**
+ * @return microseconds to wait for the active node before reading from the
+ * replicas: the delay of the command, or else the 95th percentile of recent
+ * get latencies. Until enough of them were recorded, a few round trip times
+ * of the active node's health probes are used, if it was probed.
+ */
+static std::uint32_t hedge_delay(lcb_INSTANCE *instance, const lcb_CMDGET &cmd, const mc_PIPELINE *active)
+{
+    if (cmd.hedge_delay_in_microseconds()) {
+        return cmd.hedge_delay_in_microseconds();
+    }
+    if (instance->get_latency == nullptr) {
+        /* start recording the latencies of all gets */
+        instance->get_latency = new lcb_GETLATENCY();
+    }
+    const lcb_GETLATENCY *window = instance->get_latency;
+    if (window->total < LATENCY_MIN_SAMPLES) {
+        if (active == instance->cmdq.fallback) {
+            return HEDGE_DELAY_COLD;
+        }
+        std::uint64_t rtt = static_cast<const lcb::Server *>(active)->probe.rtt_ewma;
+        if (rtt == 0) {
+            return HEDGE_DELAY_COLD;
+        }
+        return static_cast<std::uint32_t>(std::min<std::uint64_t>(LCB_NS2US(rtt * 4) + 1, HEDGE_DELAY_COLD));
+    }
+    std::uint64_t target = static_cast<std::uint64_t>(window->total) * 95 / 100;
+    std::uint64_t seen = 0;
+    unsigned ix = 0;
+    for (; ix < LATENCY_NBUCKETS - 1; ix++) {
+        seen += window->counts[ix];
+        if (seen > target) {
+            break;
+        }
+    }
+    std::uint64_t delay = latency_bucket_max(ix);
+    return delay > UINT32_MAX ? UINT32_MAX : static_cast<std::uint32_t>(delay ? delay : 1);
+}
+
+/**
+ * Shared by the get sent to the active node and the replica reads started by
+ * the hedge timer. The first successful reply (or the reply of the active
+ * node, if the replicas fail too) is passed to the callback.
+ */
+struct HedgeCookie : mc_REQDATAEX {
+    HedgeCookie(lcb_INSTANCE *instance, std::shared_ptr<lcb_CMDGET> cmd, int vb);
+    ~HedgeCookie()
+    {
+        lcbio_timer_destroy(timer);
+    }
+    void decref()
+    {
+        if (!--remaining) {
+            delete this;
+        }
+    }
+    void arm(std::uint32_t delay)
+    {
+        remaining++;
+        lcbio_timer_rearm(timer, delay);
+    }
+    /** Caller must hold a reference of its own */
+    void disarm()
+    {
+        if (lcbio_timer_armed(timer)) {
+            lcbio_timer_disarm(timer);
+            remaining--;
+        }
+    }
+    void deliver(lcb_RESPGET *resp)
+    {
+        done = true;
+        resp->rflags |= LCB_RESP_F_FINAL;
+        lcb_find_callback(instance, LCB_CALLBACK_GET)(instance, LCB_CALLBACK_GET, (const lcb_RESPBASE *)resp);
+    }
+
+    lcb_INSTANCE *instance;
+    /** Key, collection and impersonation for the replica reads */
+    std::shared_ptr<lcb_CMDGET> cmd;
+    lcbio_pTIMER timer;
+    int vbucket;
+    int remaining{1};
+    unsigned replicas_pending{0};
+    bool active_pending{true};
+    bool done{false};
+    /** Failure of the active node, reported if all replicas fail as well */
+    lcb_RESPGET active_failure{};
+};
+
+static void hedge_replicas(HedgeCookie *hck)
+{
+    lcb_INSTANCE *instance = hck->instance;
+    mc_CMDQUEUE *cq = &instance->cmdq;
+    const lcb_CMDGET &cmd = *hck->cmd;
+
+    std::vector<std::uint8_t> framing_extras;
+    if (cmd.want_impersonation()) {
+        if (lcb::flexible_framing_extras::encode_impersonate_user(cmd.impostor(), framing_extras) != LCB_SUCCESS) {
+            return;
+        }
+        for (const auto &privilege : cmd.extra_privileges()) {
+            if (lcb::flexible_framing_extras::encode_impersonate_users_extra_privilege(privilege, framing_extras) !=
+                LCB_SUCCESS) {
+                return;
+            }
+        }
+    }
+    auto ffextlen = static_cast<std::uint8_t>(framing_extras.size());
+
+    protocol_binary_request_header req{};
+    req.request.magic = framing_extras.empty() ? PROTOCOL_BINARY_REQ : PROTOCOL_BINARY_AREQ;
+    req.request.opcode = PROTOCOL_BINARY_CMD_GET_REPLICA;
+    req.request.datatype = PROTOCOL_BINARY_RAW_BYTES;
+    req.request.vbucket = htons(static_cast<std::uint16_t>(hck->vbucket));
+
+    lcb_KEYBUF keybuf{LCB_KV_COPY, {cmd.key().c_str(), cmd.key().size()}};
+    mcreq_sched_enter(cq);
+    for (unsigned ii = 0; ii < LCBT_NREPLICAS(instance); ii++) {
+        int curix = lcbvb_vbreplica(cq->config, hck->vbucket, ii);
+        if (curix < 0 || (unsigned)curix >= cq->npipelines) {
+            continue;
+        }
+        mc_PIPELINE *pl = cq->pipelines[curix];
+        if (static_cast<lcb::Server *>(pl)->probe.status == LCB_PING_STATUS_TIMEOUT) {
+            /* the last health probe of this replica timed out, it is unlikely to be faster */
+            continue;
+        }
+        mc_PACKET *pkt = mcreq_allocate_packet(pl);
+        if (!pkt) {
+            break;
+        }
+        pkt->u_rdata.exdata = hck;
+        pkt->flags |= MCREQ_F_REQEXT;
+
+        mcreq_reserve_key(pl, pkt, sizeof(req.bytes) + ffextlen, &keybuf, cmd.collection().collection_id());
+        size_t nkey = pkt->kh_span.size - MCREQ_PKT_BASESIZE + pkt->extlen;
+        req.request.keylen = htons((uint16_t)nkey);
+        req.request.bodylen = htonl((uint32_t)nkey + ffextlen);
+        req.request.opaque = pkt->opaque;
+        mcreq_write_hdr(pkt, &req);
+        if (!framing_extras.empty()) {
+            memcpy(SPAN_BUFFER(&pkt->kh_span) + sizeof(req.bytes), framing_extras.data(), framing_extras.size());
+        }
+        mcreq_sched_add(pl, pkt);
+        hck->remaining++;
+        hck->replicas_pending++;
+    }
+    mcreq_sched_leave(cq, 1);
+
+    if (hck->replicas_pending && instance->settings->metrics) {
+        instance->settings->metrics->gets_hedged++;
+    }
+}
+
+static void hedge_timer_callback(void *arg)
+{
+    auto *hck = static_cast<HedgeCookie *>(arg);
+    if (!hck->done) {
+        hedge_replicas(hck);
+    }
+    hck->decref();
+}
+
+static void hedge_callback(mc_PIPELINE *, mc_PACKET *pkt, lcb_CALLBACK_TYPE cbtype, lcb_STATUS err, const void *arg)
+{
+    auto *hck = static_cast<HedgeCookie *>(pkt->u_rdata.exdata);
+    if (cbtype == LCB_CALLBACK_GET) {
+        auto *resp = reinterpret_cast<lcb_RESPGET *>(const_cast<void *>(arg));
+        hck->active_pending = false;
+        hck->disarm();
+        if (!hck->done) {
+            if (err == LCB_SUCCESS || hck->replicas_pending == 0) {
+                hck->deliver(resp);
+            } else {
+                hck->active_failure = *resp;
+            }
+        }
+    } else {
+        const auto *replica_resp = reinterpret_cast<const lcb_RESPGETREPLICA *>(arg);
+        hck->replicas_pending--;
+        if (!hck->done && err == LCB_SUCCESS) {
+            lcb_RESPGET resp{};
+            resp.ctx = replica_resp->ctx;
+            resp.cookie = replica_resp->cookie;
+            resp.value = replica_resp->value;
+            resp.nvalue = replica_resp->nvalue;
+            resp.bufh = replica_resp->bufh;
+            resp.datatype = replica_resp->datatype;
+            resp.itmflags = replica_resp->itmflags;
+            resp.is_replica = 1;
+            if (hck->instance->settings->metrics) {
+                hck->instance->settings->metrics->hedges_won++;
+            }
+            hck->deliver(&resp);
+        } else if (!hck->done && hck->replicas_pending == 0 && !hck->active_pending) {
+            hck->deliver(&hck->active_failure);
+        }
+    }
+    hck->decref();
+}
+
+static void hedge_dtor(mc_PACKET *pkt)
+{
+    /* only the get for the active node is scheduled within the context of the application */
+    auto *hck = static_cast<HedgeCookie *>(pkt->u_rdata.exdata);
+    hck->active_pending = false;
+    hck->disarm();
+    hck->decref();
+}
+
+static const mc_REQDATAPROCS hedge_procs = {hedge_callback, hedge_dtor};
+
+HedgeCookie::HedgeCookie(lcb_INSTANCE *instance_, std::shared_ptr<lcb_CMDGET> cmd_, int vb)
+    : mc_REQDATAEX(cmd_->cookie(), hedge_procs, gethrtime()), instance(instance_), cmd(std::move(cmd_)),
+      timer(lcbio_timer_new(instance_->iotable, this, hedge_timer_callback)), vbucket(vb)
+{
+}
+
+/** @return the key of the document of `cmd`, including its collection */
+static std::string document_key(lcb_INSTANCE *instance, const lcb_CMDGET &cmd)
+{
+    return lcb_near_cache_key(instance, cmd.collection().collection_id(), cmd.key());
+}
+
+static void near_cache_respond(lcb_INSTANCE *instance, lcb_CMDGET &cmd, const lcb::NearCache::Entry *entry,
+                               lcb_STATUS rc)
+{
+    lcb_RESPGET resp{};
+    resp.ctx.rc = rc;
+    resp.ctx.key = cmd.key();
+    resp.ctx.scope = cmd.collection().scope();
+    resp.ctx.collection = cmd.collection().collection();
+    resp.cookie = cmd.cookie();
+    resp.rflags |= LCB_RESP_F_FINAL;
+    if (rc == LCB_SUCCESS) {
+        resp.ctx.cas = entry->cas;
+        resp.value = entry->value.data();
+        resp.nvalue = entry->value.size();
+        resp.itmflags = entry->flags;
+        resp.datatype = entry->datatype;
+    }
+    lcb_find_callback(instance, LCB_CALLBACK_GET)(instance, LCB_CALLBACK_GET, (const lcb_RESPBASE *)&resp);
+}
+
+/**
+ * @return true if the near cache holds the value, or knows that the document
+ * is missing. The callback is then invoked once the application returns to
+ * the event loop.
+ */
+static bool near_cache_lookup(lcb_INSTANCE *instance, const std::shared_ptr<lcb_CMDGET> &cmd)
+{
+    lcb_NEARCACHE *cache = lcb_near_cache_ensure(instance);
+    std::string key = document_key(instance, *cmd);
+    hrtime_t now = lcb_settings_now(instance->settings);
+    hrtime_t ttl = LCB_US2NS(LCBT_SETTING(instance, near_cache_ttl));
+
+    if (LCBT_SETTING(instance, negative_cache_size) && cache->misses.contains(key, now, ttl)) {
+        cache->answer([instance, cmd](lcb_STATUS rc) {
+            near_cache_respond(instance, *cmd, nullptr, rc == LCB_SUCCESS ? LCB_ERR_DOCUMENT_NOT_FOUND : rc);
+        });
+        if (instance->settings->metrics) {
+            instance->settings->metrics->negative_cache_hits++;
+        }
+        return true;
+    }
+
+    std::uint32_t capacity = LCBT_SETTING(instance, near_cache_size);
+    const lcb::NearCache::Entry *entry = capacity ? cache->entries.find(key, now, ttl) : nullptr;
+    if (entry == nullptr) {
+        cache->entries.reserve(key, capacity);
+        if (capacity && instance->settings->metrics) {
+            instance->settings->metrics->near_cache_misses++;
+        }
+        return false;
+    }
+    lcb::NearCache::Entry value = *entry;
+    cache->answer([instance, cmd, value](lcb_STATUS rc) { near_cache_respond(instance, *cmd, &value, rc); });
+    if (instance->settings->metrics) {
+        instance->settings->metrics->near_cache_hits++;
+    }
+    return true;
+}
+
+struct CoalesceCookie;
+
+/** Gets in flight which later gets of the same key may join, see LCB_CNTL_GET_COALESCE */
+struct lcb_INFLIGHTGETS_st {
+    std::unordered_map<std::string, CoalesceCookie *> gets{};
+};
+
+/**
+ * Extended data of a get which identical gets scheduled while it is in flight
+ * wait for. Its reply is passed to the callback once for each of them.
+ */
+struct CoalesceCookie : mc_REQDATAEX {
+    CoalesceCookie(lcb_INSTANCE *instance, std::shared_ptr<lcb_CMDGET> cmd, std::string key);
+    /** Let later gets of the key send a request of their own */
+    void forget()
+    {
+        auto &gets = instance->inflight_gets->gets;
+        auto it = gets.find(key);
+        if (it != gets.end() && it->second == this) {
+            gets.erase(it);
+        }
+    }
+
+    lcb_INSTANCE *instance;
+    std::shared_ptr<lcb_CMDGET> cmd;
+    std::string key;
+    /** Cookies of the gets which joined this one, in the order they were scheduled */
+    std::vector<void *> waiters{};
+};
+
+static void coalesce_callback(mc_PIPELINE *, mc_PACKET *pkt, lcb_CALLBACK_TYPE, lcb_STATUS, const void *arg)
+{
+    auto *cck = static_cast<CoalesceCookie *>(pkt->u_rdata.exdata);
+    lcb_INSTANCE *instance = cck->instance;
+    cck->forget();
+
+    auto *resp = reinterpret_cast<lcb_RESPGET *>(const_cast<void *>(arg));
+    resp->ctx.scope = cck->cmd->collection().scope();
+    resp->ctx.collection = cck->cmd->collection().collection();
+    lcb_RESPCALLBACK callback = lcb_find_callback(instance, LCB_CALLBACK_GET);
+    callback(instance, LCB_CALLBACK_GET, (const lcb_RESPBASE *)resp);
+    for (void *cookie : cck->waiters) {
+        resp->cookie = cookie;
+        callback(instance, LCB_CALLBACK_GET, (const lcb_RESPBASE *)resp);
+    }
+    delete cck;
+}
+
+static void coalesce_dtor(mc_PACKET *pkt)
+{
+    auto *cck = static_cast<CoalesceCookie *>(pkt->u_rdata.exdata);
+    cck->forget();
+    delete cck;
+}
+
+static const mc_REQDATAPROCS coalesce_procs = {coalesce_callback, coalesce_dtor};
+
+CoalesceCookie::CoalesceCookie(lcb_INSTANCE *instance_, std::shared_ptr<lcb_CMDGET> cmd_, std::string key_)
+    : mc_REQDATAEX(cmd_->cookie(), coalesce_procs, gethrtime()), instance(instance_), cmd(std::move(cmd_)),
+      key(std::move(key_))
+{
+}
+
+/** @return true if the get joined an identical one in flight */
+static bool coalesce_join(lcb_INSTANCE *instance, lcb_CMDGET &cmd, const std::string &key)
+{
+    if (instance->inflight_gets == nullptr) {
+        instance->inflight_gets = new lcb_INFLIGHTGETS();
+    }
+    auto it = instance->inflight_gets->gets.find(key);
+    if (it == instance->inflight_gets->gets.end()) {
+        return false;
+    }
+    it->second->waiters.push_back(cmd.cookie());
+    if (instance->settings->metrics) {
+        instance->settings->metrics->gets_coalesced++;
+    }
+    return true;
+}
+
+void lcb_inflight_gets_destroy(lcb_INFLIGHTGETS *inflight)
+{
+    delete inflight;
+}
+
+/** @return true if the expiry of the get-and-touch was refreshed recently, see LCB_CNTL_TOUCH_SKIP_WINDOW */
+static bool touch_recent(lcb_INSTANCE *instance, const lcb_CMDGET &cmd)
+{
+    hrtime_t window = LCB_US2NS(LCBT_SETTING(instance, touch_skip_window));
+    if (window == 0 || instance->near_cache == nullptr ||
+        !instance->near_cache->touches.recent(document_key(instance, cmd), cmd.expiry(),
+                                               lcb_settings_now(instance->settings), window)) {
+        return false;
+    }
+    if (instance->settings->metrics) {
+        instance->settings->metrics->touches_skipped++;
+    }
+    return true;
+}
+
 static lcb_STATUS get_schedule(lcb_INSTANCE *instance, std::shared_ptr<lcb_CMDGET> cmd)
 {
     mc_PIPELINE *pl;
@@ -159,6 +620,22 @@ static lcb_STATUS get_schedule(lcb_INSTANCE *instance, std::shared_ptr<lcb_CMDGE
     protocol_binary_request_header hdr{};
     lcb_STATUS err;
 
+    bool near_cache = cmd->near_cache() && !cmd->is_cookie_callback() && !cmd->stream_value() &&
+                      (LCBT_SETTING(instance, near_cache_size) || LCBT_SETTING(instance, negative_cache_size));
+    if (near_cache && near_cache_lookup(instance, cmd)) {
+        return LCB_SUCCESS;
+    }
+
+    bool coalesce = LCBT_SETTING(instance, get_coalesce) && !cmd->with_lock() && !cmd->with_touch() &&
+                    !cmd->hedged() && !cmd->is_cookie_callback() && !cmd->stream_value();
+    std::string coalesce_key;
+    if (coalesce) {
+        coalesce_key = document_key(instance, *cmd);
+        if (coalesce_join(instance, *cmd, coalesce_key)) {
+            return LCB_SUCCESS;
+        }
+    }
+
     std::vector<std::uint8_t> framing_extras;
     if (cmd->want_impersonation()) {
         err = lcb::flexible_framing_extras::encode_impersonate_user(cmd->impostor(), framing_extras);
@@ -179,7 +656,7 @@ static lcb_STATUS get_schedule(lcb_INSTANCE *instance, std::shared_ptr<lcb_CMDGE
     if (cmd->with_lock()) {
         extlen = 4;
         opcode = PROTOCOL_BINARY_CMD_GET_LOCKED;
-    } else if (cmd->with_touch()) {
+    } else if (cmd->with_touch() && !touch_recent(instance, *cmd)) {
         extlen = 4;
         opcode = PROTOCOL_BINARY_CMD_GAT;
     }
@@ -190,39 +667,71 @@ static lcb_STATUS get_schedule(lcb_INSTANCE *instance, std::shared_ptr<lcb_CMDGE
     if (err != LCB_SUCCESS) {
         return err;
     }
+    if (near_cache) {
+        pkt->flags |= MCREQ_F_NEARCACHE;
+    }
+    if (cmd->stream_value()) {
+        pkt->flags |= MCREQ_F_STREAMVALUE;
+    }
 
-    rdata = &pkt->u_rdata.reqdata;
+    HedgeCookie *hck = nullptr;
+    if (cmd->hedged() && !cmd->is_cookie_callback() && !cmd->stream_value() && LCBT_NREPLICAS(instance) > 0) {
+        hck = new HedgeCookie(instance, cmd, ntohs(hdr.request.vbucket));
+        pkt->u_rdata.exdata = hck;
+        pkt->flags |= MCREQ_F_REQEXT;
+    }
+    if (coalesce) {
+        auto *cck = new CoalesceCookie(instance, cmd, std::move(coalesce_key));
+        instance->inflight_gets->gets[cck->key] = cck;
+        pkt->u_rdata.exdata = cck;
+        pkt->flags |= MCREQ_F_REQEXT;
+    }
+
+    rdata = MCREQ_PKT_RDATA(pkt);
     rdata->cookie = cmd->cookie();
     rdata->start = cmd->start_time_or_default_in_nanoseconds(gethrtime());
     rdata->deadline =
         rdata->start + cmd->timeout_or_default_in_nanoseconds(LCB_US2NS(LCBT_SETTING(instance, operation_timeout)));
 
-    hdr.request.opcode = opcode;
-    hdr.request.datatype = PROTOCOL_BINARY_RAW_BYTES;
-    hdr.request.bodylen = htonl(extlen + ffextlen + mcreq_get_key_size(&hdr));
-    hdr.request.opaque = pkt->opaque;
-    hdr.request.cas = 0;
-
     if (cmd->is_cookie_callback()) {
         pkt->flags |= MCREQ_F_PRIVCALLBACK;
     }
 
-    memcpy(SPAN_BUFFER(&pkt->kh_span), &hdr, sizeof(hdr));
-    std::size_t offset = sizeof(hdr);
-    if (!framing_extras.empty()) {
+    if (framing_extras.empty()) {
+        if (opcode == PROTOCOL_BINARY_CMD_GET_LOCKED) {
+            std::uint32_t lock_expiry = htonl(cmd->lock_time());
+            lcb::mc::RequestEncoder<PROTOCOL_BINARY_CMD_GET_LOCKED, 4>::encode(pkt, hdr, 0, 0, &lock_expiry);
+        } else if (opcode == PROTOCOL_BINARY_CMD_GAT) {
+            std::uint32_t expiry = htonl(cmd->expiry());
+            lcb::mc::RequestEncoder<PROTOCOL_BINARY_CMD_GAT, 4>::encode(pkt, hdr, 0, 0, &expiry);
+        } else {
+            lcb::mc::RequestEncoder<PROTOCOL_BINARY_CMD_GET, 0>::encode(pkt, hdr, 0, 0, nullptr);
+        }
+    } else {
+        hdr.request.opcode = opcode;
+        hdr.request.datatype = PROTOCOL_BINARY_RAW_BYTES;
+        hdr.request.bodylen = htonl(extlen + ffextlen + mcreq_get_key_size(&hdr));
+        hdr.request.opaque = pkt->opaque;
+        hdr.request.cas = 0;
+
+        memcpy(SPAN_BUFFER(&pkt->kh_span), &hdr, sizeof(hdr));
+        std::size_t offset = sizeof(hdr);
         memcpy(SPAN_BUFFER(&pkt->kh_span) + offset, framing_extras.data(), framing_extras.size());
         offset += framing_extras.size();
-    }
-    if (cmd->with_lock()) {
-        std::uint32_t lock_expiry = htonl(cmd->lock_time());
-        memcpy(SPAN_BUFFER(&pkt->kh_span) + offset, &lock_expiry, sizeof(lock_expiry));
-    } else if (cmd->with_touch()) {
-        std::uint32_t expiry = htonl(cmd->expiry());
-        memcpy(SPAN_BUFFER(&pkt->kh_span) + offset, &expiry, sizeof(expiry));
+        if (cmd->with_lock()) {
+            std::uint32_t lock_expiry = htonl(cmd->lock_time());
+            memcpy(SPAN_BUFFER(&pkt->kh_span) + offset, &lock_expiry, sizeof(lock_expiry));
+        } else if (opcode == PROTOCOL_BINARY_CMD_GAT) {
+            std::uint32_t expiry = htonl(cmd->expiry());
+            memcpy(SPAN_BUFFER(&pkt->kh_span) + offset, &expiry, sizeof(expiry));
+        }
     }
 
     rdata->span = lcb::trace::start_kv_span(instance->settings, pkt, cmd);
     LCB_SCHED_ADD(instance, pl, pkt)
+    if (hck) {
+        hck->arm(hedge_delay(instance, *cmd, pl));
+    }
     TRACE_GET_BEGIN(instance, &hdr, cmd);
     return LCB_SUCCESS;
 }
@@ -16,10 +16,13 @@
  */
 
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "internal.h"
 #include "collections.h"
 #include "defer.h"
+#include "rdb/rope.h"
 
 #include "capi/cmd_get.hh"
 #include "capi/cmd_get_replica.hh"
@@ -93,6 +96,10 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdgetreplica_create(lcb_CMDGETREPLICA **cmd, lc
             return (*cmd)->mode(get_replica_mode::any);
         case LCB_REPLICA_MODE_ALL:
             return (*cmd)->mode(get_replica_mode::all);
+        case LCB_REPLICA_MODE_FRESHEST:
+            return (*cmd)->mode(get_replica_mode::freshest);
+        case LCB_REPLICA_MODE_FASTEST:
+            return (*cmd)->mode(get_replica_mode::fastest);
         case LCB_REPLICA_MODE_IDX0:
         case LCB_REPLICA_MODE_IDX1:
         case LCB_REPLICA_MODE_IDX2:
@@ -115,6 +122,16 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdgetreplica_timeout(lcb_CMDGETREPLICA *cmd, ui
     return cmd->timeout_in_microseconds(timeout);
 }
 
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdgetreplica_min_cas(lcb_CMDGETREPLICA *cmd, uint64_t cas)
+{
+    return cmd->min_cas(cas);
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdgetreplica_quorum(lcb_CMDGETREPLICA *cmd, uint32_t quorum)
+{
+    return cmd->quorum(quorum);
+}
+
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdgetreplica_parent_span(lcb_CMDGETREPLICA *cmd, lcbtrace_SPAN *span)
 {
     return cmd->parent_span(span);
@@ -152,6 +169,11 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdgetreplica_on_behalf_of_extra_privilege(lcb_C
 
 struct RGetCookie : mc_REQDATAEX {
     RGetCookie(void *cookie, lcb_INSTANCE *instance, get_replica_mode, int vb);
+    ~RGetCookie()
+    {
+        release_best();
+    }
+
     void decref()
     {
         if (!--remaining) {
@@ -159,12 +181,60 @@ struct RGetCookie : mc_REQDATAEX {
         }
     }
 
+    /**
+     * Keep `resp` as the freshest copy. Its value stays in the network buffer
+     * if possible, and is copied otherwise (e.g. if it was inflated).
+     */
+    void keep_best(const lcb_RESPGETREPLICA *resp)
+    {
+        release_best();
+        /* the copy is delivered after the callback of the response returns */
+        resp->ctx.materialize();
+        best = *resp;
+        has_best = true;
+        auto *seg = static_cast<rdb_ROPESEG *>(resp->bufh);
+        if (seg != nullptr && rdb_seg_contains(seg, resp->value, resp->nvalue)) {
+            rdb_seg_ref(seg);
+            best_seg = seg;
+        } else {
+            best.bufh = nullptr;
+            if (resp->nvalue) {
+                best_value.assign(static_cast<const char *>(resp->value), resp->nvalue);
+                best.value = best_value.data();
+            }
+        }
+    }
+
+    void release_best()
+    {
+        if (best_seg != nullptr) {
+            rdb_seg_unref(best_seg);
+            best_seg = nullptr;
+        }
+    }
+
     unsigned r_cur{0};
+    /** Replica read first by get_replica_mode::any, the others follow it in order */
+    unsigned r_start{0};
     unsigned r_max;
     int remaining{0};
     int vbucket;
     get_replica_mode strategy;
     lcb_INSTANCE *instance;
+
+    /* get_replica_mode::freshest */
+    std::uint64_t min_cas{0};
+    unsigned quorum{0};
+    unsigned nsent{0};
+    unsigned nreplies{0};
+    unsigned nfound{0};
+    bool done{false};
+    /** Pipeline and opaque of each packet, to cancel those still pending once done */
+    std::vector<std::pair<mc_PIPELINE *, std::uint32_t>> packets{};
+    bool has_best{false};
+    lcb_RESPGETREPLICA best{};
+    std::string best_value{};
+    rdb_ROPESEG *best_seg{nullptr};
 };
 
 static void rget_dtor(mc_PACKET *pkt)
@@ -172,6 +242,64 @@ static void rget_dtor(mc_PACKET *pkt)
     static_cast<RGetCookie *>(pkt->u_rdata.exdata)->decref();
 }
 
+/**
+ * Cancel the packets of `rck` which are still waiting for a reply. Only
+ * flushed packets are removed from their pipelines, as the flush of the
+ * others still updates their request data (the cookie), and those are
+ * ignored when they complete instead.
+ */
+static void rget_cancel_pending(RGetCookie *rck, const mc_PACKET *current)
+{
+    for (const auto &entry : rck->packets) {
+        if (entry.second == current->opaque) {
+            continue;
+        }
+        mc_PACKET *pkt = mcreq_pipeline_find(entry.first, entry.second);
+        if (pkt == nullptr || !(pkt->flags & MCREQ_F_FLUSHED) || pkt->u_rdata.exdata != rck) {
+            continue;
+        }
+        mcreq_pipeline_remove(entry.first, entry.second);
+        mcreq_packet_handled(entry.first, pkt);
+        rck->remaining--;
+    }
+    rck->packets.clear();
+}
+
+/**
+ * Handle a reply of the freshest mode: keep the copy with the highest CAS,
+ * and complete once a copy has at least the CAS the application asked for,
+ * once a quorum of copies was found, or once every node replied.
+ */
+static void rget_freshest(RGetCookie *rck, const mc_PACKET *pkt, lcb_RESPGETREPLICA *resp, lcb_RESPCALLBACK callback)
+{
+    if (rck->done) {
+        /* a late reply, the command has already completed */
+        return;
+    }
+    rck->nreplies++;
+    bool complete = rck->nreplies == rck->nsent;
+    if (resp->ctx.rc == LCB_SUCCESS) {
+        rck->nfound++;
+        if (!rck->has_best || resp->ctx.cas > rck->best.ctx.cas) {
+            rck->keep_best(resp);
+        }
+        if ((rck->min_cas && resp->ctx.cas >= rck->min_cas) || rck->nfound >= rck->quorum) {
+            complete = true;
+        }
+    }
+    if (!complete) {
+        return;
+    }
+
+    /* without any copy the last error is returned */
+    lcb_RESPGETREPLICA *final_resp = rck->has_best ? &rck->best : resp;
+    final_resp->rflags |= LCB_RESP_F_FINAL;
+    rck->done = true;
+    callback(rck->instance, LCB_CALLBACK_GETREPLICA, (const lcb_RESPBASE *)final_resp);
+    rck->release_best();
+    rget_cancel_pending(rck, pkt);
+}
+
 static void rget_callback(mc_PIPELINE *pipeline, mc_PACKET *pkt, lcb_CALLBACK_TYPE cbtype, lcb_STATUS err,
                           const void *arg)
 {
@@ -187,6 +315,7 @@ static void rget_callback(mc_PIPELINE *pipeline, mc_PACKET *pkt, lcb_CALLBACK_TY
         active_resp.datatype = get_resp->datatype;
         active_resp.value = get_resp->value;
         active_resp.nvalue = get_resp->nvalue;
+        active_resp.bufh = get_resp->bufh;
         active_resp.itmflags = get_resp->itmflags;
     } else {
         resp = reinterpret_cast<lcb_RESPGETREPLICA *>(const_cast<void *>(arg));
@@ -194,9 +323,12 @@ static void rget_callback(mc_PIPELINE *pipeline, mc_PACKET *pkt, lcb_CALLBACK_TY
 
     auto *rck = static_cast<RGetCookie *>(pkt->u_rdata.exdata);
     /** Figure out what the strategy is.. */
-    if (rck->strategy == get_replica_mode::select || rck->strategy == get_replica_mode::all) {
+    if (rck->strategy == get_replica_mode::freshest) {
+        rget_freshest(rck, pkt, resp, callback);
+    } else if (rck->strategy == get_replica_mode::select || rck->strategy == get_replica_mode::all ||
+               rck->strategy == get_replica_mode::fastest) {
         /** Simplest */
-        if (rck->strategy == get_replica_mode::select || rck->remaining == 1) {
+        if (rck->strategy != get_replica_mode::all || rck->remaining == 1) {
             resp->rflags |= LCB_RESP_F_FINAL;
         }
         callback(instance, LCB_CALLBACK_GETREPLICA, (const lcb_RESPBASE *)resp);
@@ -205,24 +337,22 @@ static void rget_callback(mc_PIPELINE *pipeline, mc_PACKET *pkt, lcb_CALLBACK_TY
         mc_PIPELINE *nextpl = nullptr;
 
         /** FIRST */
-        do {
-            int nextix;
-            rck->r_cur++;
-            nextix = lcbvb_vbreplica(cq->config, rck->vbucket, rck->r_cur);
+        while ((rck->r_cur = (rck->r_cur + 1) % rck->r_max) != rck->r_start) {
+            int nextix = lcbvb_vbreplica(cq->config, rck->vbucket, rck->r_cur);
             if (nextix > -1 && nextix < (int)cq->npipelines) {
                 /* have a valid next index? */
                 nextpl = cq->pipelines[nextix];
                 break;
             }
-        } while (rck->r_cur < rck->r_max);
+        }
 
-        if (err == LCB_SUCCESS || rck->r_cur == rck->r_max || nextpl == nullptr) {
+        if (err == LCB_SUCCESS || nextpl == nullptr) {
             resp->rflags |= LCB_RESP_F_FINAL;
             callback(instance, LCB_CALLBACK_GETREPLICA, (lcb_RESPBASE *)resp);
             /* refcount=1 . Free this now */
             rck->remaining = 1;
         } else if (err != LCB_SUCCESS) {
-            mc_PACKET *newpkt = mcreq_renew_packet(pkt);
+            mc_PACKET *newpkt = mcreq_renew_packet(nextpl, pkt);
             newpkt->flags &= ~MCREQ_STATE_FLAGS;
             mcreq_sched_add(nextpl, newpkt);
             /* Use this, rather than lcb_sched_leave(), because this is being
@@ -243,6 +373,109 @@ RGetCookie::RGetCookie(void *cookie_, lcb_INSTANCE *instance_, get_replica_mode
 {
 }
 
+/** Queued requests beyond this many do not make a node look any busier */
+#define FASTEST_MAX_OUTSTANDING 64
+
+/** Whether the circuit breaker of `pl` lets requests through, see LCB_CNTL_CIRCUIT_BREAKER */
+static bool breaker_allows(lcb_INSTANCE *instance, const mc_PIPELINE *pl)
+{
+    return !LCBT_SETTING(instance, circuit_breaker) ||
+           static_cast<const lcb::Server *>(pl)->breaker.allows(*instance->settings);
+}
+
+/**
+ * Expected wait for a read from `pl`: the moving average of its read
+ * latencies, times the number of requests it still has to answer.
+ */
+static std::uint64_t read_cost(const mc_PIPELINE *pl)
+{
+    unsigned outstanding = 0;
+    sllist_node *nn;
+    SLLIST_ITERBASIC(&pl->requests, nn)
+    {
+        if (++outstanding == FASTEST_MAX_OUTSTANDING) {
+            break;
+        }
+    }
+    return (static_cast<const lcb::Server *>(pl)->read_latency_ewma + 1) * (outstanding + 1);
+}
+
+/**
+ * Pick the node for get_replica_mode::fastest. Returns the replica index, -1
+ * for the active node, or -2 if neither the active node nor any replica is
+ * online. The active node wins ties.
+ */
+static int select_fastest(lcb_INSTANCE *instance, int vbid, int active)
+{
+    mc_CMDQUEUE *cq = &instance->cmdq;
+    int best = -2;
+    std::uint64_t best_cost = 0;
+    if (active > -1 && (unsigned)active < cq->npipelines) {
+        best = -1;
+        best_cost = read_cost(cq->pipelines[active]);
+    }
+    for (unsigned ii = 0; ii < LCBT_NREPLICAS(instance); ii++) {
+        int ix = lcbvb_vbreplica(cq->config, vbid, ii);
+        if (ix < 0 || (unsigned)ix >= cq->npipelines) {
+            continue;
+        }
+        const mc_PIPELINE *pl = cq->pipelines[ix];
+        if (static_cast<const lcb::Server *>(pl)->probe.status == LCB_PING_STATUS_TIMEOUT ||
+            !breaker_allows(instance, pl)) {
+            /* the last health probe of this replica timed out, or its requests keep failing */
+            continue;
+        }
+        std::uint64_t cost = read_cost(pl);
+        if (best == -2 || cost < best_cost) {
+            best = static_cast<int>(ii);
+            best_cost = cost;
+        }
+    }
+    return best;
+}
+
+/**
+ * Pick the replica read first by get_replica_mode::any: the first online one
+ * in the preferred server group if there is any, otherwise the first online
+ * one. Replicas whose circuit breaker is open are only picked if all are.
+ * Returns LCBT_NREPLICAS() if no replica is online.
+ */
+static unsigned select_any(lcb_INSTANCE *instance, int vbid)
+{
+    mc_CMDQUEUE *cq = &instance->cmdq;
+    const char *group = LCBT_SETTING(instance, preferred_server_group);
+    const unsigned none = LCBT_NREPLICAS(instance);
+    unsigned first = none, first_local = none, first_allowed = none;
+    for (unsigned ii = 0; ii < LCBT_NREPLICAS(instance); ii++) {
+        int ix = lcbvb_vbreplica(cq->config, vbid, ii);
+        if (ix < 0) {
+            continue;
+        }
+        bool local = group == nullptr;
+        if (!local) {
+            const char *node_group = lcbvb_get_server_group(cq->config, ix);
+            local = node_group != nullptr && strcmp(node_group, group) == 0;
+        }
+        bool allowed = (unsigned)ix >= cq->npipelines || breaker_allows(instance, cq->pipelines[ix]);
+        if (local && allowed) {
+            return ii;
+        }
+        if (allowed && first_allowed == none) {
+            first_allowed = ii;
+        }
+        if (local && first_local == none) {
+            first_local = ii;
+        }
+        if (first == none) {
+            first = ii;
+        }
+    }
+    if (first_allowed != none) {
+        return first_allowed;
+    }
+    return first_local != none ? first_local : first;
+}
+
 static lcb_STATUS get_replica_validate(lcb_INSTANCE *instance, const lcb_CMDGETREPLICA *cmd)
 {
     if (cmd->key().empty()) {
@@ -271,12 +504,7 @@ static lcb_STATUS get_replica_validate(lcb_INSTANCE *instance, const lcb_CMDGETR
             break;
 
         case get_replica_mode::any:
-            for (r0 = 0; r0 < LCBT_NREPLICAS(instance); r0++) {
-                if (lcbvb_vbreplica(cq->config, vbid, r0) > -1) {
-                    r1 = r0;
-                    break;
-                }
-            }
+            r0 = r1 = select_any(instance, vbid);
             if (r0 == LCBT_NREPLICAS(instance)) {
                 return LCB_ERR_NO_MATCHING_SERVER;
             }
@@ -292,6 +520,18 @@ static lcb_STATUS get_replica_validate(lcb_INSTANCE *instance, const lcb_CMDGETR
                 }
             }
             break;
+
+        case get_replica_mode::freshest:
+            /* offline replicas are skipped, the active copy is read anyway */
+            r0 = 0;
+            r1 = LCBT_NREPLICAS(instance);
+            break;
+
+        case get_replica_mode::fastest:
+            if (select_fastest(instance, vbid, ixtmp) == -2) {
+                return LCB_ERR_NO_MATCHING_SERVER;
+            }
+            break;
     }
 
     if (r1 < r0 || r1 >= cq->npipelines) {
@@ -311,6 +551,8 @@ static lcb_STATUS get_replica_schedule(lcb_INSTANCE *instance, std::shared_ptr<l
     int vbid, ixtmp;
     protocol_binary_request_header req{};
     unsigned r0 = 0, r1 = 0;
+    bool read_replicas = true;
+    bool read_active = cmd->need_get_active();
 
     lcb_KEYBUF keybuf{LCB_KV_COPY, {cmd->key().c_str(), cmd->key().size()}};
     mcreq_map_key(cq, &keybuf, MCREQ_PKT_BASESIZE, &vbid, &ixtmp);
@@ -339,16 +581,30 @@ static lcb_STATUS get_replica_schedule(lcb_INSTANCE *instance, std::shared_ptr<l
             break;
 
         case get_replica_mode::any:
-            for (r0 = 0; r0 < LCBT_NREPLICAS(instance); r0++) {
-                if ((ixtmp = lcbvb_vbreplica(cq->config, vbid, r0)) > -1) {
-                    r1 = r0;
-                    break;
-                }
-            }
+            r0 = r1 = select_any(instance, vbid);
             if (r0 == LCBT_NREPLICAS(instance)) {
                 return LCB_ERR_NO_MATCHING_SERVER;
             }
             break;
+
+        case get_replica_mode::freshest:
+            r0 = 0;
+            r1 = LCBT_NREPLICAS(instance);
+            break;
+
+        case get_replica_mode::fastest: {
+            int best = select_fastest(instance, vbid, ixtmp);
+            if (best == -2) {
+                return LCB_ERR_NO_MATCHING_SERVER;
+            }
+            if (best == -1) {
+                read_replicas = false;
+                read_active = true;
+            } else {
+                r0 = r1 = static_cast<unsigned>(best);
+            }
+            break;
+        }
     }
 
     if (r1 < r0 || r1 >= cq->npipelines) {
@@ -374,6 +630,7 @@ static lcb_STATUS get_replica_schedule(lcb_INSTANCE *instance, std::shared_ptr<l
     rck->start = cmd->start_time_or_default_in_nanoseconds(gethrtime());
     rck->deadline =
         rck->start + cmd->timeout_or_default_in_nanoseconds(LCB_US2NS(LCBT_SETTING(instance, operation_timeout)));
+    rck->min_cas = cmd->min_cas();
 
     /* Initialize the packet */
     req.request.magic = framing_extras.empty() ? PROTOCOL_BINARY_REQ : PROTOCOL_BINARY_AREQ;
@@ -385,41 +642,47 @@ static lcb_STATUS get_replica_schedule(lcb_INSTANCE *instance, std::shared_ptr<l
 
     auto ffextlen = static_cast<std::uint8_t>(framing_extras.size());
 
-    rck->r_cur = r0;
-    do {
-        int curix;
-        mc_PIPELINE *pl;
-        mc_PACKET *pkt;
-
-        curix = lcbvb_vbreplica(cq->config, vbid, r0);
-        /* XXX: this is always expected to be in range. For the FIRST mode
-         * it will seek to the first valid index (checked above), and for the
-         * ALL mode, it will fail if not all replicas are already online
-         * (also checked above) */
-        pl = cq->pipelines[curix];
-        pkt = mcreq_allocate_packet(pl);
-        if (!pkt) {
-            delete rck;
-            return LCB_ERR_NO_MEMORY;
-        }
-
-        pkt->u_rdata.exdata = rck;
-        pkt->flags |= MCREQ_F_REQEXT;
+    rck->r_cur = rck->r_start = r0;
+    if (read_replicas) {
+        do {
+            int curix;
+            mc_PIPELINE *pl;
+            mc_PACKET *pkt;
+
+            curix = lcbvb_vbreplica(cq->config, vbid, r0);
+            /* XXX: this is always expected to be in range. For the FIRST mode
+             * it will seek to the first valid index (checked above), and for the
+             * ALL mode, it will fail if not all replicas are already online
+             * (also checked above). Only the FRESHEST mode skips offline ones */
+            if (curix < 0 && cmd->mode() == get_replica_mode::freshest) {
+                continue;
+            }
+            pl = cq->pipelines[curix];
+            pkt = mcreq_allocate_packet(pl);
+            if (!pkt) {
+                delete rck;
+                return LCB_ERR_NO_MEMORY;
+            }
 
-        mcreq_reserve_key(pl, pkt, sizeof(req.bytes) + ffextlen, &keybuf, cmd->collection().collection_id());
-        size_t nkey = pkt->kh_span.size - MCREQ_PKT_BASESIZE + pkt->extlen;
-        req.request.keylen = htons((uint16_t)nkey);
-        req.request.bodylen = htonl((uint32_t)nkey + framing_extras.size());
-        req.request.opaque = pkt->opaque;
-        rck->remaining++;
-        mcreq_write_hdr(pkt, &req);
-        if (!framing_extras.empty()) {
-            memcpy(SPAN_BUFFER(&pkt->kh_span) + sizeof(req.bytes), framing_extras.data(), framing_extras.size());
-        }
-        mcreq_sched_add(pl, pkt);
-    } while (++r0 < r1);
+            pkt->u_rdata.exdata = rck;
+            pkt->flags |= MCREQ_F_REQEXT;
+
+            mcreq_reserve_key(pl, pkt, sizeof(req.bytes) + ffextlen, &keybuf, cmd->collection().collection_id());
+            size_t nkey = pkt->kh_span.size - MCREQ_PKT_BASESIZE + pkt->extlen;
+            req.request.keylen = htons((uint16_t)nkey);
+            req.request.bodylen = htonl((uint32_t)nkey + framing_extras.size());
+            req.request.opaque = pkt->opaque;
+            rck->remaining++;
+            rck->packets.emplace_back(pl, pkt->opaque);
+            mcreq_write_hdr(pkt, &req);
+            if (!framing_extras.empty()) {
+                memcpy(SPAN_BUFFER(&pkt->kh_span) + sizeof(req.bytes), framing_extras.data(), framing_extras.size());
+            }
+            mcreq_sched_add(pl, pkt);
+        } while (++r0 < r1);
+    }
 
-    if (cmd->need_get_active()) {
+    if (read_active) {
         req.request.opcode = PROTOCOL_BINARY_CMD_GET;
         mc_PIPELINE *pl;
         mc_PACKET *pkt;
@@ -433,6 +696,7 @@ static lcb_STATUS get_replica_schedule(lcb_INSTANCE *instance, std::shared_ptr<l
         pkt->u_rdata.exdata = rck;
         pkt->flags |= MCREQ_F_REQEXT;
         rck->remaining++;
+        rck->packets.emplace_back(pl, pkt->opaque);
         mcreq_write_hdr(pkt, &req);
         if (!framing_extras.empty()) {
             memcpy(SPAN_BUFFER(&pkt->kh_span) + sizeof(req.bytes), framing_extras.data(), framing_extras.size());
@@ -440,6 +704,17 @@ static lcb_STATUS get_replica_schedule(lcb_INSTANCE *instance, std::shared_ptr<l
         mcreq_sched_add(pl, pkt);
     }
 
+    if (cmd->mode() == get_replica_mode::freshest) {
+        rck->nsent = rck->remaining;
+        rck->quorum = rck->nsent / 2 + 1;
+        if (cmd->quorum() && cmd->quorum() < rck->quorum) {
+            rck->quorum = cmd->quorum();
+        }
+    } else {
+        /* only the freshest mode cancels its packets */
+        rck->packets.clear();
+    }
+
     MAYBE_SCHEDLEAVE(instance)
 
     return LCB_SUCCESS;
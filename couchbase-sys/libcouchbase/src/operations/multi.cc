@@ -0,0 +1,213 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2020 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "internal.h"
+#include "collections.h"
+#include "capi/cmd_counter.hh"
+#include "capi/cmd_get.hh"
+#include "capi/cmd_touch.hh"
+
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+template <typename Command>
+struct multi_traits;
+
+template <>
+struct multi_traits<lcb_CMDCOUNTER> {
+    using response = lcb_RESPCOUNTER;
+    static const lcb_CALLBACK_TYPE callback_type = LCB_CALLBACK_COUNTER;
+
+    static lcb_STATUS schedule(lcb_INSTANCE *instance, void *cookie, const lcb_CMDCOUNTER *cmd)
+    {
+        return lcb_counter(instance, cookie, cmd);
+    }
+};
+
+template <>
+struct multi_traits<lcb_CMDGET> {
+    using response = lcb_RESPGET;
+    static const lcb_CALLBACK_TYPE callback_type = LCB_CALLBACK_GET;
+
+    static lcb_STATUS schedule(lcb_INSTANCE *instance, void *cookie, const lcb_CMDGET *cmd)
+    {
+        return lcb_get(instance, cookie, cmd);
+    }
+};
+
+template <>
+struct multi_traits<lcb_CMDTOUCH> {
+    using response = lcb_RESPTOUCH;
+    static const lcb_CALLBACK_TYPE callback_type = LCB_CALLBACK_TOUCH;
+
+    static lcb_STATUS schedule(lcb_INSTANCE *instance, void *cookie, const lcb_CMDTOUCH *cmd)
+    {
+        return lcb_touch(instance, cookie, cmd);
+    }
+};
+
+template <typename Command>
+struct MultiOperation;
+
+/**
+ * One command of a multi-key operation. The packet is scheduled with the
+ * entry as its cookie, and `callback` being the first member makes the entry
+ * usable as a private callback (MCREQ_F_PRIVCALLBACK).
+ */
+template <typename Command>
+struct MultiEntry {
+    lcb_RESPCALLBACK callback{nullptr};
+    MultiOperation<Command> *operation{nullptr};
+    void *cookie{nullptr};
+    /** Index of the server the key maps to, used to group the commands by pipeline */
+    int server_index{-1};
+    Command cmd{};
+};
+
+template <typename Command>
+struct MultiOperation {
+    lcb_INSTANCE *instance{nullptr};
+    std::vector<MultiEntry<Command>> entries{};
+
+    void *cookie{nullptr};
+    lcb_MULTI_CALLBACK callback{nullptr};
+    size_t nremaining{0};
+    size_t nsuccess{0};
+    size_t nfailure{0};
+    lcb_STATUS first_error{LCB_SUCCESS};
+
+    void complete(lcb_STATUS rc)
+    {
+        if (rc == LCB_SUCCESS) {
+            nsuccess++;
+        } else {
+            nfailure++;
+            if (first_error == LCB_SUCCESS) {
+                first_error = rc;
+            }
+        }
+        release();
+    }
+
+    void release()
+    {
+        if (--nremaining == 0) {
+            if (callback) {
+                callback(instance, cookie, nsuccess, nfailure, first_error);
+            }
+            delete this;
+        }
+    }
+};
+
+template <typename Command>
+void entry_callback(lcb_INSTANCE *instance, int cbtype, const lcb_RESPBASE *rb)
+{
+    using Response = typename multi_traits<Command>::response;
+    auto *resp = const_cast<Response *>(reinterpret_cast<const Response *>(rb));
+    auto *entry = reinterpret_cast<MultiEntry<Command> *>(resp->cookie);
+    MultiOperation<Command> *operation = entry->operation;
+
+    resp->cookie = entry->cookie;
+    lcb_find_callback(instance, static_cast<lcb_CALLBACK_TYPE>(cbtype))(instance, cbtype, rb);
+    operation->complete(resp->ctx.rc);
+}
+
+int server_index(lcb_INSTANCE *instance, const std::string &key)
+{
+    if (instance->cmdq.config == nullptr) {
+        return -1;
+    }
+    int vbid = 0;
+    int srvix = -1;
+    lcbvb_map_key(instance->cmdq.config, key.c_str(), key.size(), &vbid, &srvix);
+    return srvix;
+}
+
+template <typename Command>
+lcb_STATUS multi_schedule(lcb_INSTANCE *instance, void *cookie, const Command *const *cmds, void *const *cookies,
+                          size_t ncmds, lcb_MULTI_CALLBACK callback)
+{
+    using traits = multi_traits<Command>;
+    using Response = typename traits::response;
+
+    if (ncmds == 0) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+
+    auto *operation = new MultiOperation<Command>();
+    operation->instance = instance;
+    operation->cookie = cookie;
+    operation->callback = callback;
+    operation->entries.resize(ncmds);
+    for (size_t ii = 0; ii < ncmds; ++ii) {
+        MultiEntry<Command> &entry = operation->entries[ii];
+        entry.cmd = *cmds[ii];
+        entry.cmd.treat_cookie_as_callback(true);
+        entry.callback = entry_callback<Command>;
+        entry.operation = operation;
+        entry.cookie = cookies ? cookies[ii] : nullptr;
+        entry.server_index = server_index(instance, entry.cmd.key());
+    }
+    /* Keep the packets of each pipeline together, so they are allocated and written as one group. The entries do not
+     * move once the first one is scheduled. */
+    std::stable_sort(operation->entries.begin(), operation->entries.end(),
+                     [](const MultiEntry<Command> &a, const MultiEntry<Command> &b) {
+                         return a.server_index < b.server_index;
+                     });
+
+    /* Hold one reference until every entry was scheduled, so that entries which complete (or fail) while scheduling
+     * cannot finish the operation early */
+    operation->nremaining = ncmds + 1;
+    lcb_sched_enter(instance);
+    for (auto &entry : operation->entries) {
+        lcb_STATUS rc = traits::schedule(instance, &entry, &entry.cmd);
+        if (rc != LCB_SUCCESS) {
+            Response resp{};
+            resp.ctx.key = entry.cmd.key();
+            resp.ctx.rc = rc;
+            resp.cookie = entry.cookie;
+            lcb_find_callback(instance, traits::callback_type)(instance, traits::callback_type,
+                                                               reinterpret_cast<const lcb_RESPBASE *>(&resp));
+            operation->complete(rc);
+        }
+    }
+    lcb_sched_leave(instance);
+    operation->release();
+    return LCB_SUCCESS;
+}
+} // namespace
+
+LIBCOUCHBASE_API lcb_STATUS lcb_counter_multi(lcb_INSTANCE *instance, void *cookie, const lcb_CMDCOUNTER *const *cmds,
+                                              void *const *cookies, size_t ncmds, lcb_MULTI_CALLBACK callback)
+{
+    return multi_schedule(instance, cookie, cmds, cookies, ncmds, callback);
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_touch_multi(lcb_INSTANCE *instance, void *cookie, const lcb_CMDTOUCH *const *cmds,
+                                            void *const *cookies, size_t ncmds, lcb_MULTI_CALLBACK callback)
+{
+    return multi_schedule(instance, cookie, cmds, cookies, ncmds, callback);
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_get_multi(lcb_INSTANCE *instance, void *cookie, const lcb_CMDGET *const *cmds,
+                                          void *const *cookies, size_t ncmds, lcb_MULTI_CALLBACK callback)
+{
+    return multi_schedule(instance, cookie, cmds, cookies, ncmds, callback);
+}
@@ -95,3 +95,24 @@ const lcb_MUTATION_TOKEN *lcb_get_mutation_token(lcb_INSTANCE *instance, const l
     *errp = LCB_SUCCESS;
     return existing;
 }
+
+LIBCOUCHBASE_API
+const lcb_MUTATION_TOKEN *lcb_get_mutation_tokens(lcb_INSTANCE *instance, size_t *ntokens, lcb_STATUS *errp)
+{
+    *ntokens = 0;
+    if (!LCBT_VBCONFIG(instance)) {
+        *errp = LCB_ERR_NO_CONFIGURATION;
+        return NULL;
+    }
+    if (LCBT_VBCONFIG(instance)->dtype != LCBVB_DIST_VBUCKET || !LCBT_SETTING(instance, fetch_mutation_tokens)) {
+        *errp = LCB_ERR_UNSUPPORTED_OPERATION;
+        return NULL;
+    }
+    if (!instance->dcpinfo) {
+        *errp = LCB_ERR_DURABILITY_NO_MUTATION_TOKENS;
+        return NULL;
+    }
+    *ntokens = LCBT_VBCONFIG(instance)->nvb;
+    *errp = LCB_SUCCESS;
+    return instance->dcpinfo;
+}
@@ -202,8 +202,7 @@ lcb_STATUS ObserveCtx::MCTX_add_observe(const lcb_CMDOBSERVE *cmd)
     uint8_t ecid[5] = {0}; /* encoded */
 
     if (LCBT_SETTING(instance, use_collections)) {
-        std::string path = collcache_build_spec(cmd->scope, cmd->nscope, cmd->collection, cmd->ncollection);
-        instance->collcache->get(path, &cid);
+        instance->collcache->get(cmd->scope, cmd->nscope, cmd->collection, cmd->ncollection, &cid);
         ncid = leb128_encode(cid, ecid);
     }
 
@@ -16,6 +16,7 @@
  */
 
 #include "internal.h"
+#include "hotkeys.h"
 #include "http/http.h"
 #include "auth-priv.h"
 
@@ -670,6 +671,127 @@ lcb_STATUS lcb_ping(lcb_INSTANCE *instance, void *cookie, const lcb_CMDPING *cmd
     return LCB_SUCCESS;
 }
 
+static void handle_probe(mc_PIPELINE *pipeline, mc_PACKET *req, lcb_CALLBACK_TYPE /* cbtype */, lcb_STATUS err,
+                         const void *)
+{
+    auto *server = static_cast<lcb::Server *>(pipeline);
+    server->probe_pending = false;
+    if (err == LCB_ERR_REQUEST_CANCELED) {
+        return;
+    }
+
+    lcb_HEALTH_PROBE &probe = server->probe;
+    hrtime_t now = gethrtime();
+    probe.nprobes++;
+    probe.last_probe = now;
+    switch (err) {
+        case LCB_SUCCESS:
+            probe.status = LCB_PING_STATUS_OK;
+            probe.last_rtt = now - MCREQ_PKT_RDATA(req)->start;
+            probe.rtt_ewma = probe.rtt_ewma ? (probe.rtt_ewma * 7 + probe.last_rtt) / 8 : probe.last_rtt;
+            break;
+        case LCB_ERR_TIMEOUT:
+            probe.status = LCB_PING_STATUS_TIMEOUT;
+            probe.nfailures++;
+            break;
+        default:
+            probe.status = LCB_PING_STATUS_ERROR;
+            probe.nfailures++;
+            break;
+    }
+    /* the reply of the probe itself does not make the connection busy */
+    server->probe_nread = server->nread;
+}
+
+static void dtor_probe(mc_PACKET *pkt)
+{
+    delete pkt->u_rdata.exdata;
+}
+
+static mc_REQDATAPROCS probe_procs = {handle_probe, dtor_probe};
+
+void lcb::Server::send_probe(hrtime_t now)
+{
+    mc_PACKET *pkt = mcreq_allocate_packet(this);
+    if (!pkt) {
+        return;
+    }
+    auto *exdata = new mc_REQDATAEX(nullptr, probe_procs, now);
+    exdata->deadline = now + LCB_US2NS(default_timeout());
+    pkt->u_rdata.exdata = exdata;
+    pkt->flags |= MCREQ_F_REQEXT;
+
+    protocol_binary_request_header hdr{};
+    hdr.request.magic = PROTOCOL_BINARY_REQ;
+    hdr.request.opaque = pkt->opaque;
+    hdr.request.opcode = PROTOCOL_BINARY_CMD_NOOP;
+    mcreq_reserve_header(this, pkt, MCREQ_PKT_BASESIZE);
+    memcpy(SPAN_BUFFER(&pkt->kh_span), hdr.bytes, sizeof(hdr.bytes));
+    mcreq_sched_add(this, pkt);
+    probe_pending = true;
+}
+
+/**
+ * Sends a NOOP on each open data connection which has not read anything since
+ * the previous tick. Connections which are not open are left alone, as are
+ * busy ones: their replies already show that they are alive.
+ */
+static void health_probe_tick(void *arg)
+{
+    auto *instance = static_cast<lcb_INSTANCE *>(arg);
+    std::uint32_t interval = LCBT_SETTING(instance, health_probe_interval);
+    if (interval == 0) {
+        return;
+    }
+
+    mc_CMDQUEUE *cq = &instance->cmdq;
+    if (cq->config) {
+        hrtime_t now = gethrtime();
+        mcreq_sched_enter(cq);
+        for (unsigned ii = 0; ii < MCREQ_NPIPELINES_ALL(cq); ii++) {
+            auto *server = static_cast<lcb::Server *>(cq->pipelines[ii]);
+            bool idle = server->nread == server->probe_nread;
+            server->probe_nread = server->nread;
+            if (idle && server->is_connected() && !server->probe_pending) {
+                server->send_probe(now);
+            }
+        }
+        mcreq_sched_leave(cq, 1);
+    }
+    lcbio_timer_rearm(instance->health_timer, interval);
+}
+
+void lcb_health_probe_schedule(lcb_INSTANCE *instance)
+{
+    std::uint32_t interval = LCBT_SETTING(instance, health_probe_interval);
+    if (interval == 0) {
+        if (instance->health_timer) {
+            lcbio_timer_disarm(instance->health_timer);
+        }
+        return;
+    }
+    if (instance->iotable == nullptr) {
+        return;
+    }
+    if (instance->health_timer == nullptr) {
+        instance->health_timer = lcbio_timer_new(instance->iotable, instance, health_probe_tick);
+    }
+    lcbio_timer_rearm(instance->health_timer, interval);
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_health_probe(lcb_INSTANCE *instance, size_t index, lcb_HEALTH_PROBE *probe)
+{
+    mc_CMDQUEUE *cq = &instance->cmdq;
+    if (cq->config == nullptr) {
+        return LCB_ERR_NO_CONFIGURATION;
+    }
+    if (index >= cq->npipelines) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    *probe = static_cast<const lcb::Server *>(cq->pipelines[index])->probe;
+    return LCB_SUCCESS;
+}
+
 LIBCOUCHBASE_API lcb_STATUS lcb_respdiag_status(const lcb_RESPDIAG *resp)
 {
     return resp->ctx.rc;
@@ -742,7 +864,7 @@ lcb_STATUS lcb_diag(lcb_INSTANCE *instance, void *cookie, const lcb_CMDDIAG *cmd
 
     size_t ii;
     Json::Value kv;
-    for (ii = 0; ii < instance->cmdq.npipelines; ii++) {
+    for (ii = 0; ii < MCREQ_NPIPELINES_ALL(&instance->cmdq); ii++) {
         auto *server = static_cast<lcb::Server *>(instance->cmdq.pipelines[ii]);
         lcbio_CTX *ctx = server->connctx;
         if (ctx) {
@@ -759,6 +881,10 @@ lcb_STATUS lcb_diag(lcb_INSTANCE *instance, void *cookie, const lcb_CMDDIAG *cmd
             if (!server->bucket.empty()) {
                 endpoint["namespace"] = server->bucket;
             }
+            if (LCBT_SETTING(instance, circuit_breaker)) {
+                endpoint["circuit_breaker"] = lcb::CircuitBreaker::state_name(
+                    server->breaker.state(LCB_US2NS(now), *instance->settings));
+            }
             if (ctx->sock) {
                 if (ctx->sock->info) {
                     endpoint["local"] = ctx->sock->info->ep_local_host_and_port;
@@ -772,13 +898,20 @@ lcb_STATUS lcb_diag(lcb_INSTANCE *instance, void *cookie, const lcb_CMDDIAG *cmd
     }
     instance->memd_sockpool->toJSON(now, root);
     instance->http_sockpool->toJSON(now, root);
+    if (LCBT_SETTING(instance, circuit_breaker)) {
+        /* the endpoints of the HTTP services, whether there are requests to them or not */
+        for (const auto &breaker : *instance->http_breakers) {
+            root["circuit_breakers"][breaker.first] = lcb::CircuitBreaker::state_name(
+                breaker.second.state(LCB_US2NS(now), *instance->settings));
+        }
+    }
     {
         Json::Value cur;
-        lcb_ASPEND_SETTYPE::iterator it;
-        lcb_ASPEND_SETTYPE *pendq;
-        if ((pendq = instance->pendops.items[LCB_PENDTYPE_HTTP])) {
-            for (it = pendq->begin(); it != pendq->end(); ++it) {
-                lcb::http::Request *htreq = reinterpret_cast<lcb::http::Request *>(*it);
+        lcb_list_t *pos, *next;
+        {
+            LCB_ASPEND_FOR(pos, next, &instance->pendops, LCB_PENDTYPE_HTTP)
+            {
+                auto *htreq = reinterpret_cast<lcb::http::Request *>(LCB_ASPEND_OWNER(pos));
                 lcbio_CTX *ctx = htreq->ioctx;
                 if (ctx) {
                     Json::Value endpoint;
@@ -804,6 +937,8 @@ lcb_STATUS lcb_diag(lcb_INSTANCE *instance, void *cookie, const lcb_CMDDIAG *cmd
         }
     }
 
+    lcb_hot_keys_diag(instance, root);
+
     Json::Writer *w;
     if (cmd->options & LCB_PINGOPT_F_JSONPRETTY) {
         w = new Json::StyledWriter();
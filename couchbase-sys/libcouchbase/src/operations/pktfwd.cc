@@ -21,6 +21,9 @@
 #include "mc/forward.h"
 #include "internal.h"
 #include "rdb/rope.h"
+#include "capi/cmd_get.hh"
+#include "capi/cmd_get_replica.hh"
+#include "capi/cmd_subdoc.hh"
 
 LIBCOUCHBASE_API
 lcb_STATUS lcb_pktfwd3(lcb_INSTANCE *instance, const void *cookie, const lcb_CMDPKTFWD *cmd)
@@ -68,6 +71,12 @@ lcb_STATUS lcb_pktfwd3(lcb_INSTANCE *instance, const void *cookie, const lcb_CMD
     packet->u_rdata.reqdata.start = gethrtime();
     packet->u_rdata.reqdata.deadline =
         packet->u_rdata.reqdata.start + LCB_US2NS(LCBT_SETTING(instance, operation_timeout));
+
+    if (cmd->vb.vtype != LCB_KV_COPY && (packet->flags & MCREQ_UBUF_FLAGS) == 0) {
+        /* a fragmented header without a value ends up copied entirely, so
+         * the buffers of the user are already released */
+        instance->callbacks.pktflushed(instance, cookie);
+    }
     return err;
 }
 
@@ -82,3 +91,44 @@ void lcb_backbuf_unref(lcb_BACKBUF buf)
 {
     rdb_seg_unref(buf);
 }
+
+static lcb_STATUS pin_value(void *bufh, const void *value, size_t nvalue, lcb_BACKBUF *buf)
+{
+    auto *seg = reinterpret_cast<rdb_ROPESEG *>(bufh);
+    if (seg == nullptr || !rdb_seg_contains(seg, value, nvalue)) {
+        return LCB_ERR_UNSUPPORTED_OPERATION;
+    }
+    rdb_seg_ref(seg);
+    *buf = seg;
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API
+lcb_STATUS lcb_respget_backbuf(const lcb_RESPGET *resp, lcb_BACKBUF *buf)
+{
+    return pin_value(resp->bufh, resp->value, resp->nvalue, buf);
+}
+
+LIBCOUCHBASE_API
+lcb_STATUS lcb_respgetreplica_backbuf(const lcb_RESPGETREPLICA *resp, lcb_BACKBUF *buf)
+{
+    return pin_value(resp->bufh, resp->value, resp->nvalue, buf);
+}
+
+LIBCOUCHBASE_API
+lcb_STATUS lcb_respsubdoc_backbuf(const lcb_RESPSUBDOC *resp, lcb_BACKBUF *buf)
+{
+    auto *seg = reinterpret_cast<rdb_ROPESEG *>(resp->bufh);
+    if (seg == nullptr) {
+        return LCB_ERR_UNSUPPORTED_OPERATION;
+    }
+    /* All the values lie within the body, which spares parsing each of them */
+    const auto *response = reinterpret_cast<const lcb::MemcachedResponse *>(resp->responses);
+    if (response != nullptr && response->vallen() &&
+        !rdb_seg_contains(seg, response->value(), response->vallen())) {
+        return LCB_ERR_UNSUPPORTED_OPERATION;
+    }
+    rdb_seg_ref(seg);
+    *buf = seg;
+    return LCB_SUCCESS;
+}
@@ -0,0 +1,674 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "internal.h"
+#include "collections.h"
+#include "mc/compress.h"
+#include "strcodecs/strcodecs.h"
+
+#include "capi/cmd_range_scan.hh"
+
+#include <deque>
+
+#define LOGARGS(instance, lvl) (instance)->settings, "rangescan", LCB_LOG_##lvl, __FILE__, __LINE__
+
+/*
+ * A range scan runs the create/continue/cancel commands of the data service
+ * on each vBucket. The vBuckets are queued by the node which is their master
+ * when the scan starts, and each node runs at most `concurrency` of them at a
+ * time: when the scan of a vBucket completes, the next one of the same node
+ * is created from the response handler.
+ *
+ * Every packet of the scan has its own ScanRequest, so that it has its own
+ * deadline, and the scan itself is released once none of them is pending.
+ */
+
+#define RANGE_SCAN_UUID_SIZE 16
+
+lcb_STATUS lcb_map_error(lcb_INSTANCE *instance, int in);
+
+namespace
+{
+struct RangeScan {
+    RangeScan(lcb_INSTANCE *instance_, std::shared_ptr<lcb_CMDRANGESCAN> cmd_) : instance(instance_), cmd(cmd_) {}
+
+    lcb_INSTANCE *instance;
+    std::shared_ptr<lcb_CMDRANGESCAN> cmd;
+    /** Value of RANGE_SCAN_CREATE, the same for every vBucket */
+    std::string create_body{};
+    /** vBuckets which are not started yet, by node */
+    std::vector<std::deque<std::uint16_t>> queued{};
+    /** Number of vBuckets being scanned, by node */
+    std::vector<std::uint32_t> active{};
+    /** Number of packets which are not completed yet */
+    std::size_t pending{0};
+    /** The first error of the scan. Once set, no vBucket is started anymore */
+    lcb_STATUS rc{LCB_SUCCESS};
+    std::uint16_t status_code{0};
+};
+
+struct ScanRequest : mc_REQDATAEX {
+    ScanRequest(const mc_REQDATAPROCS *procs_, RangeScan *scan_, std::uint16_t vbid_, std::size_t node_,
+                const char *uuid_)
+        : mc_REQDATAEX(scan_->cmd->cookie(), *procs_, gethrtime()), scan(scan_), vbid(vbid_), node(node_)
+    {
+        if (uuid_ != nullptr) {
+            memcpy(uuid, uuid_, sizeof(uuid));
+        }
+    }
+
+    RangeScan *scan;
+    std::uint16_t vbid;
+    /** Node which the vBucket was queued on, see RangeScan::active */
+    std::size_t node;
+    char uuid[RANGE_SCAN_UUID_SIZE]{};
+};
+} // namespace
+
+static void scan_handler(mc_PIPELINE *pl, mc_PACKET *pkt, lcb_CALLBACK_TYPE cbtype, lcb_STATUS err, const void *arg);
+static void scan_fail_dtor(mc_PACKET *pkt);
+
+static mc_REQDATAPROCS scan_procs = {scan_handler, scan_fail_dtor};
+
+static lcb_STATUS scan_send(RangeScan *scan, std::uint8_t opcode, std::uint16_t vbid, std::size_t node,
+                            const char *uuid)
+{
+    lcb_INSTANCE *instance = scan->instance;
+    mc_CMDQUEUE *cq = &instance->cmdq;
+    if (cq->config == nullptr) {
+        return LCB_ERR_NO_CONFIGURATION;
+    }
+    mc_PIPELINE *pl = mcreq_queue_pipeline(cq, lcbvb_vbmaster(cq->config, vbid), vbid);
+    if (pl == nullptr) {
+        return LCB_ERR_NO_MATCHING_SERVER;
+    }
+
+    char extras[RANGE_SCAN_UUID_SIZE + 12];
+    std::uint8_t extlen = 0;
+    const std::string *value = nullptr;
+    if (opcode == PROTOCOL_BINARY_CMD_RANGE_SCAN_CREATE) {
+        value = &scan->create_body;
+    } else {
+        memcpy(extras, uuid, RANGE_SCAN_UUID_SIZE);
+        extlen = RANGE_SCAN_UUID_SIZE;
+        if (opcode == PROTOCOL_BINARY_CMD_RANGE_SCAN_CONTINUE) {
+            /* item limit, time limit (none) and byte limit of the batch */
+            std::uint32_t limits[3] = {htonl(scan->cmd->batch_item_limit()), 0,
+                                       htonl(scan->cmd->batch_byte_limit())};
+            memcpy(extras + extlen, limits, sizeof(limits));
+            extlen += sizeof(limits);
+        }
+    }
+
+    mc_PACKET *pkt = mcreq_allocate_packet(pl);
+    if (pkt == nullptr) {
+        return LCB_ERR_NO_MEMORY;
+    }
+    mcreq_reserve_header(pl, pkt, MCREQ_PKT_BASESIZE + extlen);
+    std::size_t nvalue = value ? value->size() : 0;
+    if (nvalue) {
+        mcreq_reserve_value2(pl, pkt, nvalue);
+        memcpy(SPAN_BUFFER(&pkt->u_value.single), value->data(), nvalue);
+    }
+
+    protocol_binary_request_header hdr{};
+    hdr.request.magic = PROTOCOL_BINARY_REQ;
+    hdr.request.opcode = opcode;
+    hdr.request.datatype = nvalue ? PROTOCOL_BINARY_DATATYPE_JSON : PROTOCOL_BINARY_RAW_BYTES;
+    hdr.request.vbucket = htons(vbid);
+    hdr.request.extlen = extlen;
+    hdr.request.bodylen = htonl(extlen + nvalue);
+    hdr.request.opaque = pkt->opaque;
+    mcreq_write_hdr(pkt, &hdr);
+    memcpy(SPAN_BUFFER(&pkt->kh_span) + MCREQ_PKT_BASESIZE, extras, extlen);
+
+    auto *req = new ScanRequest(&scan_procs, scan, vbid, node, uuid);
+    req->deadline =
+        req->start + scan->cmd->timeout_or_default_in_nanoseconds(LCB_US2NS(LCBT_SETTING(instance, operation_timeout)));
+    pkt->u_rdata.exdata = req;
+    pkt->flags |= MCREQ_F_REQEXT | MCREQ_F_NOCID;
+    scan->pending++;
+    mcreq_sched_add(pl, pkt);
+    return LCB_SUCCESS;
+}
+
+static void scan_set_error(RangeScan *scan, lcb_STATUS rc, std::uint16_t status_code = 0)
+{
+    if (scan->rc == LCB_SUCCESS) {
+        scan->rc = rc;
+        scan->status_code = status_code;
+    }
+}
+
+/** Start the scans of the vBuckets of `node` until it has `concurrency` of them */
+static void scan_start_next(RangeScan *scan, std::size_t node)
+{
+    while (scan->rc == LCB_SUCCESS && scan->active[node] < scan->cmd->concurrency() && !scan->queued[node].empty()) {
+        std::uint16_t vbid = scan->queued[node].front();
+        scan->queued[node].pop_front();
+        lcb_STATUS rc = scan_send(scan, PROTOCOL_BINARY_CMD_RANGE_SCAN_CREATE, vbid, node, nullptr);
+        if (rc != LCB_SUCCESS) {
+            scan_set_error(scan, rc);
+            return;
+        }
+        scan->active[node]++;
+    }
+}
+
+static void scan_vbucket_done(RangeScan *scan, const ScanRequest *req)
+{
+    scan->active[req->node]--;
+    scan_start_next(scan, req->node);
+}
+
+/** Ask for the next batch of the vBucket, or cancel its scan if the scan failed */
+static void scan_vbucket_next(RangeScan *scan, const ScanRequest *req)
+{
+    std::uint8_t opcode =
+        scan->rc == LCB_SUCCESS ? PROTOCOL_BINARY_CMD_RANGE_SCAN_CONTINUE : PROTOCOL_BINARY_CMD_RANGE_SCAN_CANCEL;
+    lcb_STATUS rc = scan_send(scan, opcode, req->vbid, req->node, req->uuid);
+    if (rc != LCB_SUCCESS) {
+        scan_set_error(scan, rc);
+    }
+    if (rc != LCB_SUCCESS || opcode == PROTOCOL_BINARY_CMD_RANGE_SCAN_CANCEL) {
+        scan_vbucket_done(scan, req);
+    }
+}
+
+static bool scan_read_leb128(const char *&pos, const char *end, std::uint32_t &value)
+{
+    int n = leb128_decode(reinterpret_cast<const std::uint8_t *>(pos), end - pos, &value);
+    if (n <= 0) {
+        return false;
+    }
+    pos += n;
+    return true;
+}
+
+/**
+ * Parse the items of a RANGE_SCAN_CONTINUE response. Keys only have their
+ * length, documents have their metadata first:
+ * flags(4) expiry(4) seqno(8) cas(8) datatype(1) keylen(leb128) key valuelen(leb128) value
+ */
+static bool scan_parse_items(const char *pos, std::size_t len, bool key_only, std::vector<lcb_RANGESCAN_ITEM> &items)
+{
+    static const std::size_t meta_size = 4 + 4 + 8 + 8 + 1;
+    const char *end = pos + len;
+    while (pos < end) {
+        lcb_RANGESCAN_ITEM item{};
+        if (!key_only) {
+            if (static_cast<std::size_t>(end - pos) < meta_size) {
+                return false;
+            }
+            std::uint32_t u32;
+            std::uint64_t u64;
+            memcpy(&u32, pos, 4);
+            item.flags = ntohl(u32);
+            memcpy(&u32, pos + 4, 4);
+            item.expiry = ntohl(u32);
+            memcpy(&u64, pos + 8, 8);
+            item.seqno = lcb_ntohll(u64);
+            memcpy(&u64, pos + 16, 8);
+            item.cas = lcb_ntohll(u64);
+            item.datatype = static_cast<std::uint8_t>(pos[24]);
+            pos += meta_size;
+        }
+        std::uint32_t n;
+        if (!scan_read_leb128(pos, end, n) || n > static_cast<std::size_t>(end - pos)) {
+            return false;
+        }
+        item.key = pos;
+        item.nkey = n;
+        pos += n;
+        if (!key_only) {
+            if (!scan_read_leb128(pos, end, n) || n > static_cast<std::size_t>(end - pos)) {
+                return false;
+            }
+            item.value = pos;
+            item.nvalue = n;
+            pos += n;
+        }
+        items.push_back(item);
+    }
+    return true;
+}
+
+/** Pass a batch of documents of a vBucket to the application */
+static void scan_deliver(RangeScan *scan, const ScanRequest *req, const lcb::MemcachedResponse *res)
+{
+    lcb_INSTANCE *instance = scan->instance;
+    lcb_RESPRANGESCAN resp{};
+    if (!scan_parse_items(res->value(), res->vallen(), scan->cmd->key_only(), resp.items)) {
+        lcb_log(LOGARGS(instance, ERR), "Invalid items in the range scan of vBucket %d", (int)req->vbid);
+        scan_set_error(scan, LCB_ERR_PROTOCOL_ERROR);
+        return;
+    }
+
+    std::vector<void *> inflated;
+    for (auto &item : resp.items) {
+        std::uint8_t datatype = 0;
+        if (item.datatype & PROTOCOL_BINARY_DATATYPE_JSON) {
+            datatype |= LCB_VALUE_F_JSON;
+        }
+        if (item.datatype & PROTOCOL_BINARY_DATATYPE_COMPRESSED) {
+            void *freeptr = nullptr;
+            const void *bytes;
+            std::size_t nbytes;
+            if ((LCBT_SETTING(instance, compressopts) & LCB_COMPRESS_IN) &&
+                mcreq_inflate_value(item.value, item.nvalue, &bytes, &nbytes, &freeptr) == 0) {
+                item.value = static_cast<const char *>(bytes);
+                item.nvalue = nbytes;
+                inflated.push_back(freeptr);
+            } else {
+                datatype |= LCB_VALUE_F_SNAPPYCOMP;
+            }
+        }
+        item.datatype = datatype;
+    }
+
+    resp.ctx.rc = LCB_SUCCESS;
+    resp.ctx.scope = scan->cmd->collection().scope();
+    resp.ctx.collection = scan->cmd->collection().collection();
+    resp.cookie = scan->cmd->cookie();
+    resp.vbucket = req->vbid;
+    lcb_RESPCALLBACK callback = lcb_find_callback(instance, LCB_CALLBACK_RANGESCAN);
+    callback(instance, LCB_CALLBACK_RANGESCAN, (lcb_RESPBASE *)&resp);
+    for (void *ptr : inflated) {
+        free(ptr);
+    }
+}
+
+static void scan_maybe_finish(RangeScan *scan)
+{
+    if (scan->pending) {
+        return;
+    }
+    lcb_INSTANCE *instance = scan->instance;
+    lcb_RESPRANGESCAN resp{};
+    resp.ctx.rc = scan->rc;
+    resp.ctx.status_code = scan->status_code;
+    resp.ctx.scope = scan->cmd->collection().scope();
+    resp.ctx.collection = scan->cmd->collection().collection();
+    resp.cookie = scan->cmd->cookie();
+    resp.rflags = LCB_RESP_F_FINAL;
+    lcb_RESPCALLBACK callback = lcb_find_callback(instance, LCB_CALLBACK_RANGESCAN);
+    callback(instance, LCB_CALLBACK_RANGESCAN, (lcb_RESPBASE *)&resp);
+    delete scan;
+}
+
+static void scan_handler(mc_PIPELINE * /* pl */, mc_PACKET *pkt, lcb_CALLBACK_TYPE /* cbtype */, lcb_STATUS err,
+                         const void *arg)
+{
+    auto *req = static_cast<ScanRequest *>(pkt->u_rdata.exdata);
+    const auto *res = static_cast<const lcb::MemcachedResponse *>(arg);
+    RangeScan *scan = req->scan;
+    lcb_INSTANCE *instance = scan->instance;
+    std::uint16_t status = res->status();
+
+    /* only the last frame of a continue completes the packet, see Server::try_read() */
+    bool is_last = err != LCB_SUCCESS || res->opcode() != PROTOCOL_BINARY_CMD_RANGE_SCAN_CONTINUE ||
+                   status != PROTOCOL_BINARY_RESPONSE_SUCCESS;
+    if (err == LCB_SUCCESS) {
+        err = lcb_map_error(instance, status);
+    }
+
+    switch (res->opcode()) {
+        case PROTOCOL_BINARY_CMD_RANGE_SCAN_CREATE:
+            if (err == LCB_SUCCESS && res->vallen() == RANGE_SCAN_UUID_SIZE) {
+                memcpy(req->uuid, res->value(), RANGE_SCAN_UUID_SIZE);
+                scan_vbucket_next(scan, req);
+            } else if (err == LCB_ERR_DOCUMENT_NOT_FOUND) {
+                /* no key of the vBucket is in the range */
+                scan_vbucket_done(scan, req);
+            } else {
+                lcb_log(LOGARGS(instance, WARN), "Unable to create the range scan of vBucket %d: %s (0x%x)",
+                        (int)req->vbid, lcb_strerror_short(err), status);
+                scan_set_error(scan, err == LCB_SUCCESS ? LCB_ERR_PROTOCOL_ERROR : err, status);
+                scan_vbucket_done(scan, req);
+            }
+            break;
+
+        case PROTOCOL_BINARY_CMD_RANGE_SCAN_CONTINUE:
+            if (err != LCB_SUCCESS) {
+                lcb_log(LOGARGS(instance, WARN), "Unable to continue the range scan of vBucket %d: %s (0x%x)",
+                        (int)req->vbid, lcb_strerror_short(err), status);
+                scan_set_error(scan, err, status);
+                scan_vbucket_done(scan, req);
+                break;
+            }
+            if (res->vallen() && scan->rc == LCB_SUCCESS) {
+                scan_deliver(scan, req, res);
+            }
+            if (status == PROTOCOL_BINARY_RESPONSE_RANGE_SCAN_MORE) {
+                scan_vbucket_next(scan, req);
+            } else if (status == PROTOCOL_BINARY_RESPONSE_RANGE_SCAN_COMPLETE) {
+                scan_vbucket_done(scan, req);
+            }
+            break;
+
+        default:
+            /* the result of a cancel does not matter */
+            break;
+    }
+
+    if (is_last) {
+        scan->pending--;
+        delete req;
+    }
+    MAYBE_SCHEDLEAVE(instance)
+    scan_maybe_finish(scan);
+}
+
+static void scan_fail_dtor(mc_PACKET *pkt)
+{
+    auto *req = static_cast<ScanRequest *>(pkt->u_rdata.exdata);
+    RangeScan *scan = req->scan;
+    delete req;
+    if (--scan->pending == 0) {
+        delete scan;
+    }
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_resprangescan_status(const lcb_RESPRANGESCAN *resp)
+{
+    return resp->ctx.rc;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_resprangescan_error_context(const lcb_RESPRANGESCAN *resp,
+                                                            const lcb_KEY_VALUE_ERROR_CONTEXT **ctx)
+{
+    *ctx = &resp->ctx;
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_resprangescan_cookie(const lcb_RESPRANGESCAN *resp, void **cookie)
+{
+    *cookie = resp->cookie;
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API int lcb_resprangescan_is_final(const lcb_RESPRANGESCAN *resp)
+{
+    return resp->rflags & LCB_RESP_F_FINAL;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_resprangescan_vbucket(const lcb_RESPRANGESCAN *resp, uint16_t *vbucket)
+{
+    *vbucket = resp->vbucket;
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API size_t lcb_resprangescan_item_count(const lcb_RESPRANGESCAN *resp)
+{
+    return resp->items.size();
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_resprangescan_item_key(const lcb_RESPRANGESCAN *resp, size_t index, const char **key,
+                                                       size_t *key_len)
+{
+    if (index >= resp->items.size()) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    *key = resp->items[index].key;
+    *key_len = resp->items[index].nkey;
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_resprangescan_item_value(const lcb_RESPRANGESCAN *resp, size_t index,
+                                                         const char **value, size_t *value_len)
+{
+    if (index >= resp->items.size()) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    *value = resp->items[index].value;
+    *value_len = resp->items[index].nvalue;
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_resprangescan_item_cas(const lcb_RESPRANGESCAN *resp, size_t index, uint64_t *cas)
+{
+    if (index >= resp->items.size()) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    *cas = resp->items[index].cas;
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_resprangescan_item_flags(const lcb_RESPRANGESCAN *resp, size_t index,
+                                                         uint32_t *flags)
+{
+    if (index >= resp->items.size()) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    *flags = resp->items[index].flags;
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_resprangescan_item_expiry(const lcb_RESPRANGESCAN *resp, size_t index,
+                                                          uint32_t *expiry)
+{
+    if (index >= resp->items.size()) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    *expiry = resp->items[index].expiry;
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_resprangescan_item_seqno(const lcb_RESPRANGESCAN *resp, size_t index,
+                                                         uint64_t *seqno)
+{
+    if (index >= resp->items.size()) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    *seqno = resp->items[index].seqno;
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_resprangescan_item_datatype(const lcb_RESPRANGESCAN *resp, size_t index,
+                                                            uint8_t *datatype)
+{
+    if (index >= resp->items.size()) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    *datatype = resp->items[index].datatype;
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdrangescan_create(lcb_CMDRANGESCAN **cmd)
+{
+    *cmd = new lcb_CMDRANGESCAN{};
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdrangescan_destroy(lcb_CMDRANGESCAN *cmd)
+{
+    delete cmd;
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdrangescan_parent_span(lcb_CMDRANGESCAN *cmd, lcbtrace_SPAN *span)
+{
+    return cmd->parent_span(span);
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdrangescan_collection(lcb_CMDRANGESCAN *cmd, const char *scope, size_t scope_len,
+                                                        const char *collection, size_t collection_len)
+{
+    try {
+        lcb::collection_qualifier qualifier(scope, scope_len, collection, collection_len);
+        return cmd->collection(std::move(qualifier));
+    } catch (const std::invalid_argument &) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdrangescan_range(lcb_CMDRANGESCAN *cmd, const char *start, size_t start_len,
+                                                   const char *end, size_t end_len)
+{
+    if (start == nullptr || start_len == 0 || end == nullptr || end_len == 0) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    return cmd->range(std::string(start, start_len), std::string(end, end_len));
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdrangescan_key_only(lcb_CMDRANGESCAN *cmd, int key_only)
+{
+    return cmd->key_only(key_only != 0);
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdrangescan_concurrency(lcb_CMDRANGESCAN *cmd, uint32_t concurrency)
+{
+    if (concurrency == 0) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    return cmd->concurrency(concurrency);
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdrangescan_batch_item_limit(lcb_CMDRANGESCAN *cmd, uint32_t limit)
+{
+    return cmd->batch_item_limit(limit);
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdrangescan_batch_byte_limit(lcb_CMDRANGESCAN *cmd, uint32_t limit)
+{
+    return cmd->batch_byte_limit(limit);
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdrangescan_timeout(lcb_CMDRANGESCAN *cmd, uint32_t timeout)
+{
+    return cmd->timeout_in_microseconds(timeout);
+}
+
+static std::string scan_base64(const std::string &term)
+{
+    char *buf = nullptr;
+    std::size_t nbuf = 0;
+    std::string out;
+    if (lcb_base64_encode2(term.data(), term.size(), &buf, &nbuf) == 0) {
+        out.assign(buf, nbuf);
+        free(buf);
+    }
+    return out;
+}
+
+static lcb_STATUS range_scan_schedule(lcb_INSTANCE *instance, std::shared_ptr<lcb_CMDRANGESCAN> cmd)
+{
+    mc_CMDQUEUE *cq = &instance->cmdq;
+    lcbvb_CONFIG *vbc = cq->config;
+    if (vbc == nullptr) {
+        return LCB_ERR_NO_CONFIGURATION;
+    }
+
+    auto *scan = new RangeScan(instance, cmd);
+
+    Json::Value body;
+    char cid[16];
+    snprintf(cid, sizeof(cid), "%x", (unsigned)cmd->collection().collection_id());
+    body["collection"] = cid;
+    body["range"]["start"] = scan_base64(cmd->start());
+    body["range"]["end"] = scan_base64(cmd->end());
+    if (cmd->key_only()) {
+        body["key_only"] = true;
+    }
+    scan->create_body = Json::FastWriter().write(body);
+
+    std::size_t nservers = LCBVB_NSERVERS(vbc);
+    scan->queued.resize(nservers);
+    scan->active.resize(nservers, 0);
+    unsigned nvbuckets = lcbvb_get_nvbuckets(vbc);
+    for (unsigned vbid = 0; vbid < nvbuckets; vbid++) {
+        int node = lcbvb_vbmaster(vbc, (int)vbid);
+        if (node < 0 || (std::size_t)node >= nservers) {
+            delete scan;
+            return LCB_ERR_NO_MATCHING_SERVER;
+        }
+        scan->queued[node].push_back((std::uint16_t)vbid);
+    }
+
+    for (std::size_t node = 0; node < nservers; node++) {
+        scan_start_next(scan, node);
+    }
+    if (scan->pending == 0) {
+        /* nothing was scheduled, so there is nobody to report the error */
+        lcb_STATUS rc = scan->rc == LCB_SUCCESS ? LCB_ERR_NO_MATCHING_SERVER : scan->rc;
+        delete scan;
+        return rc;
+    }
+    MAYBE_SCHEDLEAVE(instance)
+    return LCB_SUCCESS;
+}
+
+static lcb_STATUS range_scan_execute(lcb_INSTANCE *instance, std::shared_ptr<lcb_CMDRANGESCAN> cmd)
+{
+    if (!LCBT_SETTING(instance, use_collections)) {
+        /* the default collection has id 0 */
+        return range_scan_schedule(instance, cmd);
+    }
+
+    if (collcache_get(instance, cmd->collection()) == LCB_SUCCESS) {
+        return range_scan_schedule(instance, cmd);
+    }
+
+    return collcache_resolve(
+        instance, cmd,
+        [instance](lcb_STATUS status, const lcb_RESPGETCID *resp, std::shared_ptr<lcb_CMDRANGESCAN> operation) {
+            lcb_RESPCALLBACK operation_callback = lcb_find_callback(instance, LCB_CALLBACK_RANGESCAN);
+            lcb_RESPRANGESCAN response{};
+            if (resp != nullptr) {
+                response.ctx = resp->ctx;
+            }
+            response.ctx.scope = operation->collection().scope();
+            response.ctx.collection = operation->collection().collection();
+            response.cookie = operation->cookie();
+            response.rflags = LCB_RESP_F_FINAL;
+            if (status == LCB_ERR_SHEDULE_FAILURE || resp == nullptr) {
+                response.ctx.rc = LCB_ERR_TIMEOUT;
+                operation_callback(instance, LCB_CALLBACK_RANGESCAN, &response);
+                return;
+            }
+            if (resp->ctx.rc != LCB_SUCCESS) {
+                operation_callback(instance, LCB_CALLBACK_RANGESCAN, &response);
+                return;
+            }
+            response.ctx.rc = range_scan_schedule(instance, operation);
+            if (response.ctx.rc != LCB_SUCCESS) {
+                operation_callback(instance, LCB_CALLBACK_RANGESCAN, &response);
+            }
+        });
+}
+
+LIBCOUCHBASE_API
+lcb_STATUS lcb_range_scan(lcb_INSTANCE *instance, void *cookie, const lcb_CMDRANGESCAN *command)
+{
+    if (LCBT_SETTING(instance, conntype) != LCB_TYPE_BUCKET) {
+        return LCB_ERR_UNSUPPORTED_OPERATION;
+    }
+    if (!LCBT_SETTING(instance, use_collections) && !command->collection().is_default_collection()) {
+        /* only allow default collection when collections disabled for the instance */
+        return LCB_ERR_SDK_FEATURE_UNAVAILABLE;
+    }
+    if (instance->cmdq.config == nullptr) {
+        return LCB_ERR_NO_CONFIGURATION;
+    }
+    if (lcbvb_get_distmode(instance->cmdq.config) != LCBVB_DIST_VBUCKET) {
+        return LCB_ERR_UNSUPPORTED_OPERATION;
+    }
+
+    auto cmd = std::make_shared<lcb_CMDRANGESCAN>(*command);
+    cmd->cookie(cookie);
+    return range_scan_execute(instance, cmd);
+}
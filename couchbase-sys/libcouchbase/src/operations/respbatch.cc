@@ -0,0 +1,244 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <libcouchbase/couchbase.h>
+#include <libcouchbase/pktfwd.h>
+#include "internal.h"
+#include "rdb/rope.h"
+#include "capi/cmd_get.hh"
+#include "capi/cmd_store.hh"
+#include "capi/cmd_remove.hh"
+#include "capi/cmd_touch.hh"
+#include "capi/cmd_unlock.hh"
+
+#include <vector>
+
+struct lcb_RESPBATCH_ {
+    struct Entry {
+        lcb_CALLBACK_TYPE type;
+        void *cookie;
+        std::uint64_t cas;
+        const void *value;
+        std::size_t nvalue;
+        std::uint32_t flags;
+        std::uint8_t datatype;
+        lcb_MUTATION_TOKEN mt;
+        /** Network buffer holding the value, referenced until the callback returns */
+        rdb_ROPESEG *seg;
+    };
+
+    const Entry *at(std::size_t index) const
+    {
+        return index < entries.size() ? &entries[index] : nullptr;
+    }
+
+    void clear()
+    {
+        for (const auto &entry : entries) {
+            if (entry.seg != nullptr) {
+                rdb_seg_unref(entry.seg);
+            }
+        }
+        entries.clear();
+    }
+
+    std::vector<Entry> entries;
+    bool open{false};
+};
+
+int lcb_respbatch_begin(lcb_INSTANCE *instance)
+{
+    if (instance == nullptr || instance->callbacks.batch == nullptr) {
+        return 0;
+    }
+    if (instance->respbatch == nullptr) {
+        instance->respbatch = new lcb_RESPBATCH{};
+    }
+    if (instance->respbatch->open) {
+        /* a read within the batch callback, the outer one passes everything on */
+        return 0;
+    }
+    instance->respbatch->open = true;
+    return 1;
+}
+
+int lcb_respbatch_add(lcb_INSTANCE *instance, lcb_CALLBACK_TYPE type, const void *resp)
+{
+    lcb_RESPBATCH *batch = instance->respbatch;
+    if (batch == nullptr || !batch->open) {
+        return 0;
+    }
+    lcb_RESPBATCH::Entry entry{};
+    entry.type = type;
+    switch (type) {
+        case LCB_CALLBACK_GET: {
+            const auto *rget = static_cast<const lcb_RESPGET *>(resp);
+            if (rget->ctx.rc != LCB_SUCCESS) {
+                return 0;
+            }
+            if (rget->nvalue) {
+                /* inflated values only live until their callback returns */
+                auto *seg = static_cast<rdb_ROPESEG *>(rget->bufh);
+                if (seg == nullptr || !rdb_seg_contains(seg, rget->value, rget->nvalue)) {
+                    return 0;
+                }
+                rdb_seg_ref(seg);
+                entry.seg = seg;
+            }
+            entry.cookie = rget->cookie;
+            entry.cas = rget->ctx.cas;
+            entry.value = rget->value;
+            entry.nvalue = rget->nvalue;
+            entry.flags = rget->itmflags;
+            entry.datatype = rget->datatype;
+            break;
+        }
+        case LCB_CALLBACK_STORE: {
+            const auto *rstore = static_cast<const lcb_RESPSTORE *>(resp);
+            if (rstore->ctx.rc != LCB_SUCCESS) {
+                return 0;
+            }
+            entry.cookie = rstore->cookie;
+            entry.cas = rstore->ctx.cas;
+            entry.mt = rstore->mt;
+            break;
+        }
+        case LCB_CALLBACK_REMOVE: {
+            const auto *rremove = static_cast<const lcb_RESPREMOVE *>(resp);
+            if (rremove->ctx.rc != LCB_SUCCESS) {
+                return 0;
+            }
+            entry.cookie = rremove->cookie;
+            entry.cas = rremove->ctx.cas;
+            entry.mt = rremove->mt;
+            break;
+        }
+        case LCB_CALLBACK_TOUCH: {
+            const auto *rtouch = static_cast<const lcb_RESPTOUCH *>(resp);
+            if (rtouch->ctx.rc != LCB_SUCCESS) {
+                return 0;
+            }
+            entry.cookie = rtouch->cookie;
+            entry.cas = rtouch->ctx.cas;
+            entry.mt = rtouch->mt;
+            break;
+        }
+        case LCB_CALLBACK_UNLOCK: {
+            const auto *runlock = static_cast<const lcb_RESPUNLOCK *>(resp);
+            if (runlock->ctx.rc != LCB_SUCCESS) {
+                return 0;
+            }
+            entry.cookie = runlock->cookie;
+            entry.cas = runlock->ctx.cas;
+            break;
+        }
+        default:
+            return 0;
+    }
+    batch->entries.push_back(entry);
+    return 1;
+}
+
+void lcb_respbatch_flush(lcb_INSTANCE *instance)
+{
+    lcb_RESPBATCH *batch = instance->respbatch;
+    batch->open = false;
+    if (!batch->entries.empty() && instance->callbacks.batch != nullptr) {
+        instance->callbacks.batch(instance, batch);
+    }
+    batch->clear();
+}
+
+void lcb_respbatch_destroy(lcb_RESPBATCH *batch)
+{
+    batch->clear();
+    delete batch;
+}
+
+LIBCOUCHBASE_API size_t lcb_respbatch_size(const lcb_RESPBATCH *batch)
+{
+    return batch->entries.size();
+}
+
+#define BATCH_ENTRY(batch, index)                                                                                      \
+    const lcb_RESPBATCH::Entry *entry = (batch)->at(index);                                                            \
+    if (entry == nullptr) {                                                                                            \
+        return LCB_ERR_INVALID_ARGUMENT;                                                                               \
+    }
+
+LIBCOUCHBASE_API lcb_STATUS lcb_respbatch_type(const lcb_RESPBATCH *batch, size_t index, lcb_CALLBACK_TYPE *type)
+{
+    BATCH_ENTRY(batch, index)
+    *type = entry->type;
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_respbatch_cookie(const lcb_RESPBATCH *batch, size_t index, void **cookie)
+{
+    BATCH_ENTRY(batch, index)
+    *cookie = entry->cookie;
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_respbatch_cas(const lcb_RESPBATCH *batch, size_t index, uint64_t *cas)
+{
+    BATCH_ENTRY(batch, index)
+    *cas = entry->cas;
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_respbatch_value(const lcb_RESPBATCH *batch, size_t index, const char **value,
+                                                size_t *value_len)
+{
+    BATCH_ENTRY(batch, index)
+    *value = static_cast<const char *>(entry->value);
+    *value_len = entry->nvalue;
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_respbatch_flags(const lcb_RESPBATCH *batch, size_t index, uint32_t *flags)
+{
+    BATCH_ENTRY(batch, index)
+    *flags = entry->flags;
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_respbatch_datatype(const lcb_RESPBATCH *batch, size_t index, uint8_t *datatype)
+{
+    BATCH_ENTRY(batch, index)
+    *datatype = entry->datatype;
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_respbatch_mutation_token(const lcb_RESPBATCH *batch, size_t index,
+                                                         lcb_MUTATION_TOKEN *token)
+{
+    BATCH_ENTRY(batch, index)
+    *token = entry->mt;
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_respbatch_backbuf(const lcb_RESPBATCH *batch, size_t index, lcb_BACKBUF *buf)
+{
+    BATCH_ENTRY(batch, index)
+    if (entry->seg == nullptr) {
+        return LCB_ERR_UNSUPPORTED_OPERATION;
+    }
+    rdb_seg_ref(entry->seg);
+    *buf = entry->seg;
+    return LCB_SUCCESS;
+}
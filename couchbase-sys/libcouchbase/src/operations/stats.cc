@@ -16,10 +16,14 @@
  */
 
 #include "internal.h"
+#include "nearcache.h"
 
 #include "capi/cmd_noop.hh"
 #include "capi/cmd_stats.hh"
 
+#include <map>
+#include <memory>
+
 struct BcastCookie : mc_REQDATAEX {
     int remaining;
 
@@ -27,6 +31,8 @@ struct BcastCookie : mc_REQDATAEX {
         : mc_REQDATAEX(cookie_, *procs_, gethrtime()), remaining(0)
     {
     }
+
+    virtual ~BcastCookie() = default;
 };
 
 static void refcnt_dtor_common(mc_PACKET *pkt)
@@ -46,6 +52,105 @@ static const char *make_hp_string(const lcb::Server &server, std::string &out)
     return out.c_str();
 }
 
+/**
+ * Aggregated statistics recently received from the servers, keyed by the
+ * `host:port` of the server and the requested group
+ */
+struct lcb_STATSCACHE_st {
+    std::map<std::pair<std::string, std::string>, std::shared_ptr<const lcb::StatsTable>> tables{};
+};
+
+void lcb_stats_cache_destroy(lcb_STATSCACHE *cache)
+{
+    delete cache;
+}
+
+struct StatsCookie : BcastCookie {
+    StatsCookie(const mc_REQDATAPROCS *procs_, void *cookie_, std::string group_, hrtime_t max_age_)
+        : BcastCookie(procs_, cookie_), group(std::move(group_)), max_age(max_age_)
+    {
+    }
+
+    std::string group;
+    hrtime_t max_age;
+    /** Statistics received so far, by the index of the server */
+    std::map<int, lcb::StatsTable> tables{};
+    lcb_STATUS first_error{LCB_SUCCESS};
+};
+
+static void aggregate_respond(lcb_INSTANCE *instance, StatsCookie *ck, const std::string &server,
+                              const lcb::StatsTable *table, lcb_STATUS err)
+{
+    lcb_RESPCALLBACK callback = lcb_find_callback(instance, LCB_CALLBACK_STATS);
+    lcb_RESPSTATS resp{};
+    resp.ctx.rc = err;
+    resp.cookie = const_cast<void *>(ck->cookie);
+    resp.server = server.c_str();
+    resp.table = table;
+    callback(instance, LCB_CALLBACK_STATS, (lcb_RESPBASE *)&resp);
+
+    if (err != LCB_SUCCESS && ck->first_error == LCB_SUCCESS) {
+        ck->first_error = err;
+    }
+    if (--ck->remaining) {
+        return;
+    }
+    lcb_RESPSTATS final{};
+    final.ctx.rc = ck->first_error;
+    final.cookie = const_cast<void *>(ck->cookie);
+    final.rflags = LCB_RESP_F_CLIENTGEN | LCB_RESP_F_FINAL;
+    callback(instance, LCB_CALLBACK_STATS, (lcb_RESPBASE *)&final);
+    delete ck;
+}
+
+static void aggregate_handler(mc_PIPELINE *pl, mc_PACKET *req, lcb_CALLBACK_TYPE /* cbtype */, lcb_STATUS err,
+                              const void *arg)
+{
+    auto *ck = static_cast<StatsCookie *>(req->u_rdata.exdata);
+    auto *server = static_cast<lcb::Server *>(pl);
+    lcb::StatsTable &table = ck->tables[pl->index];
+
+    if (arg != nullptr) {
+        const auto *resp = static_cast<const lcb_RESPSTATS *>(arg);
+        table.add(resp->ctx.key.c_str(), resp->ctx.key.size(), resp->value ? resp->value : "", resp->nvalue);
+        return;
+    }
+
+    /* the server has sent all of its statistics */
+    lcb_INSTANCE *instance = server->get_instance();
+    std::string hostport;
+    make_hp_string(*server, hostport);
+    auto collected = std::make_shared<lcb::StatsTable>(std::move(table));
+    ck->tables.erase(pl->index);
+    collected->collected = gethrtime();
+    if (err == LCB_SUCCESS && ck->max_age) {
+        if (instance->stats_cache == nullptr) {
+            instance->stats_cache = new lcb_STATSCACHE();
+        }
+        instance->stats_cache->tables[std::make_pair(hostport, ck->group)] = collected;
+    }
+    aggregate_respond(instance, ck, hostport, collected.get(), err);
+}
+
+/** @return the statistics of `server` received less than `max_age` ago, if any */
+static std::shared_ptr<const lcb::StatsTable> stats_cache_lookup(lcb_INSTANCE *instance, const std::string &server,
+                                                                 const std::string &group, hrtime_t max_age)
+{
+    if (instance->stats_cache == nullptr) {
+        return nullptr;
+    }
+    auto &tables = instance->stats_cache->tables;
+    auto it = tables.find(std::make_pair(server, group));
+    if (it == tables.end()) {
+        return nullptr;
+    }
+    if (gethrtime() - it->second->collected >= max_age) {
+        tables.erase(it);
+        return nullptr;
+    }
+    return it->second;
+}
+
 static void stats_handler(mc_PIPELINE *pl, mc_PACKET *req, lcb_CALLBACK_TYPE /* cbtype */, lcb_STATUS err,
                           const void *arg)
 {
@@ -114,6 +219,22 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdstats_is_keystats(lcb_CMDSTATS *cmd, int val)
     return LCB_SUCCESS;
 }
 
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdstats_aggregate(lcb_CMDSTATS *cmd, int val)
+{
+    if (val) {
+        cmd->cmdflags |= LCB_CMDSTATS_F_AGGREGATE;
+    } else {
+        cmd->cmdflags &= ~LCB_CMDSTATS_F_AGGREGATE;
+    }
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdstats_max_age(lcb_CMDSTATS *cmd, uint32_t max_age)
+{
+    cmd->max_age = max_age;
+    return LCB_SUCCESS;
+}
+
 LIBCOUCHBASE_API lcb_STATUS lcb_respstats_status(const lcb_RESPSTATS *resp)
 {
     return resp->ctx.rc;
@@ -153,7 +274,28 @@ LIBCOUCHBASE_API lcb_STATUS lcb_respstats_server(const lcb_RESPSTATS *resp, cons
     return LCB_SUCCESS;
 }
 
+LIBCOUCHBASE_API lcb_STATUS lcb_respstats_nstats(const lcb_RESPSTATS *resp, size_t *nstats)
+{
+    *nstats = resp->table == nullptr ? 0 : resp->table->entries.size();
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_respstats_stat(const lcb_RESPSTATS *resp, size_t index, const char **key,
+                                               size_t *key_len, const char **value, size_t *value_len)
+{
+    if (resp->table == nullptr || index >= resp->table->entries.size()) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    const lcb::StatsTable::Entry &entry = resp->table->entries[index];
+    *key = resp->table->buffer.data() + entry.key_offset;
+    *key_len = entry.key_length;
+    *value = resp->table->buffer.data() + entry.value_offset;
+    *value_len = entry.value_length;
+    return LCB_SUCCESS;
+}
+
 static mc_REQDATAPROCS stats_procs = {stats_handler, refcnt_dtor_common};
+static mc_REQDATAPROCS aggregate_procs = {aggregate_handler, refcnt_dtor_common};
 
 LIBCOUCHBASE_API
 lcb_STATUS lcb_stats(lcb_INSTANCE *instance, void *cookie, const lcb_CMDSTATS *cmd)
@@ -167,6 +309,10 @@ lcb_STATUS lcb_stats(lcb_INSTANCE *instance, void *cookie, const lcb_CMDSTATS *c
     lcb_KEYBUF kbuf_out;
 
     kbuf_out.type = LCB_KV_COPY;
+    bool aggregate = (cmd->cmdflags & LCB_CMDSTATS_F_AGGREGATE) != 0;
+    if (cmd->max_age && !aggregate) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
 
     if (cmd->cmdflags & LCB_CMDSTATS_F_KV) {
         if (kbuf_in->nbytes == 0 || kbuf_in->nbytes > sizeof(ksbuf) - 30) {
@@ -194,7 +340,16 @@ lcb_STATUS lcb_stats(lcb_INSTANCE *instance, void *cookie, const lcb_CMDSTATS *c
         kbuf_out.contig = *kbuf_in;
     }
 
-    auto *ckwrap = new BcastCookie(&stats_procs, cookie);
+    BcastCookie *ckwrap;
+    if (aggregate) {
+        std::string group;
+        if (kbuf_out.contig.nbytes) {
+            group.assign(static_cast<const char *>(kbuf_out.contig.bytes), kbuf_out.contig.nbytes);
+        }
+        ckwrap = new StatsCookie(&aggregate_procs, cookie, std::move(group), LCB_US2NS(cmd->max_age));
+    } else {
+        ckwrap = new BcastCookie(&stats_procs, cookie);
+    }
     ckwrap->deadline =
         ckwrap->start + LCB_US2NS(cmd->timeout ? cmd->timeout : LCBT_SETTING(instance, operation_timeout));
 
@@ -207,6 +362,20 @@ lcb_STATUS lcb_stats(lcb_INSTANCE *instance, void *cookie, const lcb_CMDSTATS *c
             continue;
         }
 
+        if (cmd->max_age) {
+            auto *ck = static_cast<StatsCookie *>(ckwrap);
+            std::string hostport;
+            make_hp_string(*static_cast<lcb::Server *>(pl), hostport);
+            auto table = stats_cache_lookup(instance, hostport, ck->group, ck->max_age);
+            if (table) {
+                ck->remaining++;
+                lcb_near_cache_ensure(instance)->answer([instance, ck, hostport, table](lcb_STATUS rc) {
+                    aggregate_respond(instance, ck, hostport, rc == LCB_SUCCESS ? table.get() : nullptr, rc);
+                });
+                continue;
+            }
+        }
+
         pkt = mcreq_allocate_packet(pl);
         if (!pkt) {
             delete ckwrap;
@@ -20,9 +20,63 @@
 #include "trace.h"
 #include "defer.h"
 #include "durability_internal.h"
+#include "nearcache.h"
 
 #include "capi/cmd_store.hh"
 
+#include <unordered_map>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace lcb
+{
+/** Region of a file mapped read-only, see lcb_cmdstore_value_file() */
+class MappedValue
+{
+  public:
+    MappedValue(void *base, std::size_t length) : base_(base), length_(length) {}
+    MappedValue(const MappedValue &) = delete;
+    MappedValue &operator=(const MappedValue &) = delete;
+
+    ~MappedValue()
+    {
+#ifndef _WIN32
+        munmap(base_, length_);
+#endif
+    }
+
+  private:
+    void *base_;
+    std::size_t length_;
+};
+} // namespace lcb
+
+/** Mappings referenced by packets which have not been released yet, by the address of their value */
+struct lcb_VALUEMAPS_st {
+    std::unordered_multimap<const void *, std::shared_ptr<lcb::MappedValue>> mappings;
+};
+
+void lcb_value_maps_release(lcb_INSTANCE *instance, const void *value)
+{
+    if (instance->value_maps == nullptr || value == nullptr) {
+        return;
+    }
+    auto &mappings = instance->value_maps->mappings;
+    auto it = mappings.find(value);
+    if (it != mappings.end()) {
+        mappings.erase(it);
+    }
+}
+
+void lcb_value_maps_destroy(lcb_VALUEMAPS *maps)
+{
+    delete maps;
+}
+
 LIBCOUCHBASE_API int lcb_mutation_token_is_valid(const lcb_MUTATION_TOKEN *token)
 {
     return token && !(token->uuid_ == 0 && token->seqno_ == 0 && token->vbid_ == 0);
@@ -188,6 +242,47 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_value_iov(lcb_CMDSTORE *cmd, const lcb_
     return cmd->value(value, value_len);
 }
 
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_value_iov_nocopy(lcb_CMDSTORE *cmd, const lcb_IOV *value, size_t value_len)
+{
+    if (value == nullptr || value_len == 0) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    return cmd->value_nocopy(value, value_len);
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_value_file(lcb_CMDSTORE *cmd, int fd, uint64_t offset, size_t length)
+{
+#ifdef _WIN32
+    (void)cmd;
+    (void)fd;
+    (void)offset;
+    (void)length;
+    return LCB_ERR_SDK_FEATURE_UNAVAILABLE;
+#else
+    struct stat st {
+    };
+    if (length == 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || offset > std::uint64_t(st.st_size) ||
+        length > std::uint64_t(st.st_size) - offset) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    /* mappings start on a page boundary */
+    auto pagesize = static_cast<std::uint64_t>(sysconf(_SC_PAGESIZE));
+    std::uint64_t start = offset - offset % pagesize;
+    std::size_t nmapped = length + static_cast<std::size_t>(offset - start);
+    void *base = mmap(nullptr, nmapped, PROT_READ, MAP_SHARED, fd, static_cast<off_t>(start));
+    if (base == MAP_FAILED) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+#ifdef MADV_SEQUENTIAL
+    madvise(base, nmapped, MADV_SEQUENTIAL);
+#endif
+    lcb_IOV iov{};
+    iov.iov_base = static_cast<char *>(base) + (offset - start);
+    iov.iov_len = length;
+    return cmd->value_mapping(std::make_shared<lcb::MappedValue>(base, nmapped), iov);
+#endif
+}
+
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_expiry(lcb_CMDSTORE *cmd, uint32_t expiration)
 {
     return cmd->expiry(expiration);
@@ -198,6 +293,11 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_preserve_expiry(lcb_CMDSTORE *cmd, int
     return cmd->preserve_expiry(should_preserve);
 }
 
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_coalesce(lcb_CMDSTORE *cmd, int enable)
+{
+    return cmd->coalesce(enable != 0);
+}
+
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_cas(lcb_CMDSTORE *cmd, uint64_t cas)
 {
     return cmd->cas(cas);
@@ -374,10 +474,22 @@ static lcb_STATUS store_validate(lcb_INSTANCE *instance, const lcb_CMDSTORE *cmd
     return LCB_SUCCESS;
 }
 
-static lcb_STATUS store_schedule(lcb_INSTANCE *instance, std::shared_ptr<lcb_CMDSTORE> cmd)
+static void coalesce_hold(lcb_INSTANCE *instance, std::shared_ptr<lcb_CMDSTORE> cmd);
+
+/**
+ * @param exdata extended data to attach to the packet, which makes coalesced
+ * upserts be sent rather than held back
+ */
+static lcb_STATUS store_schedule(lcb_INSTANCE *instance, std::shared_ptr<lcb_CMDSTORE> cmd,
+                                 mc_REQDATAEX *exdata = nullptr)
 {
     lcb_STATUS err;
 
+    if (exdata == nullptr && cmd->coalesce() && !instance->destroying) {
+        coalesce_hold(instance, std::move(cmd));
+        return LCB_SUCCESS;
+    }
+
     mc_PIPELINE *pipeline;
     mc_PACKET *packet;
     mc_CMDQUEUE *cq = &instance->cmdq;
@@ -426,8 +538,15 @@ static lcb_STATUS store_schedule(lcb_INSTANCE *instance, std::shared_ptr<lcb_CMD
 
     int should_compress = can_compress(instance, pipeline, cmd->value_is_compressed());
     lcb_VALBUF valuebuf{LCB_KV_COPY, {{cmd->value().c_str(), cmd->value().size()}}};
+    if (cmd->value_is_borrowed()) {
+        valuebuf.vtype = LCB_KV_IOV;
+        valuebuf.u_buf.multi.iov = const_cast<lcb_IOV *>(cmd->borrowed_value().data());
+        valuebuf.u_buf.multi.niov = cmd->borrowed_value().size();
+        valuebuf.u_buf.multi.total_length = 0;
+    }
     if (should_compress) {
-        int rv = mcreq_compress_value(pipeline, packet, &valuebuf, instance->settings, &should_compress);
+        int rv = mcreq_compress_value(pipeline, packet, &valuebuf, instance->settings, cmd->key().c_str(),
+                                      cmd->key().size(), cmd->value_is_json(), &should_compress);
         if (rv != 0) {
             mcreq_release_packet(pipeline, packet);
             return LCB_ERR_NO_MEMORY;
@@ -453,6 +572,9 @@ static lcb_STATUS store_schedule(lcb_INSTANCE *instance, std::shared_ptr<lcb_CMD
         auto *dctx = new DurStoreCtx(instance, persist_to, replicate_to, cmd->cookie());
         packet->u_rdata.exdata = dctx;
         packet->flags |= MCREQ_F_REQEXT;
+    } else if (exdata != nullptr) {
+        packet->u_rdata.exdata = exdata;
+        packet->flags |= MCREQ_F_REQEXT;
     }
     mc_REQDATA *rdata = MCREQ_PKT_RDATA(packet);
     rdata->cookie = cmd->cookie();
@@ -498,13 +620,209 @@ static lcb_STATUS store_schedule(lcb_INSTANCE *instance, std::shared_ptr<lcb_CMD
         packet->flags |= MCREQ_F_REPLACE_SEMANTICS;
     }
     rdata->span = lcb::trace::start_kv_span_with_durability(instance->settings, packet, cmd);
+    bool value_copied = cmd->value_is_borrowed() && !(packet->flags & MCREQ_F_VALUE_NOCOPY);
+    if (cmd->value_mapping() && !value_copied) {
+        /* the packet keeps the mapping until its buffers are released, see lcb_value_maps_release() */
+        if (instance->value_maps == nullptr) {
+            instance->value_maps = new lcb_VALUEMAPS();
+        }
+        instance->value_maps->mappings.emplace(cmd->borrowed_value().front().iov_base, cmd->value_mapping());
+    }
     LCB_SCHED_ADD(instance, pipeline, packet)
 
     TRACE_STORE_BEGIN(instance, &hdr, cmd);
 
+    if (value_copied) {
+        /* the value has been compressed into the pipeline's buffers */
+        instance->callbacks.pktflushed(instance, cmd->cookie());
+    }
+
     return LCB_SUCCESS;
 }
 
+/**
+ * The application owns borrowed values until the packet has been flushed, so
+ * it has to be told if the operation fails before it is ever scheduled.
+ */
+static void release_borrowed_value(lcb_INSTANCE *instance, const std::shared_ptr<lcb_CMDSTORE> &cmd)
+{
+    if (cmd->value_is_borrowed()) {
+        instance->callbacks.pktflushed(instance, cmd->cookie());
+    }
+}
+
+/**
+ * Commands whose cookie is their callback (see lcb_CMDSTORE::treat_cookie_as_callback()) have to be completed through
+ * it as well if they fail before being scheduled.
+ */
+static void invoke_store_callback(lcb_INSTANCE *instance, const std::shared_ptr<lcb_CMDSTORE> &cmd,
+                                  lcb_RESPSTORE *response)
+{
+    const auto callback_type = LCB_CALLBACK_STORE;
+    auto *base = reinterpret_cast<const lcb_RESPBASE *>(response);
+    if (cmd->is_cookie_callback()) {
+        (*static_cast<lcb_RESPCALLBACK *>(cmd->cookie()))(instance, callback_type, base);
+    } else {
+        lcb_find_callback(instance, callback_type)(instance, callback_type, base);
+    }
+}
+
+struct CoalescedStore;
+
+/** Upserts held back to be coalesced, by key, see lcb_cmdstore_coalesce() */
+struct lcb_PENDINGSTORES_st {
+    std::unordered_map<std::string, CoalescedStore *> stores{};
+};
+
+/**
+ * Extended data of an upsert held back for LCB_CNTL_WRITE_COALESCE_WINDOW.
+ * Later upserts of the key replace its command, and its reply is passed to
+ * the callback once for each of them.
+ */
+struct CoalescedStore : mc_REQDATAEX {
+    CoalescedStore(lcb_INSTANCE *instance, std::shared_ptr<lcb_CMDSTORE> cmd, std::string key);
+    ~CoalescedStore()
+    {
+        lcbio_timer_destroy(timer);
+    }
+    /** Let later upserts of the key be held back on their own */
+    void forget()
+    {
+        auto &stores = instance->pending_stores->stores;
+        auto it = stores.find(key);
+        if (it != stores.end() && it->second == this) {
+            stores.erase(it);
+        }
+    }
+    /** Pass @p resp to the callback of the upsert sent and of those it replaced */
+    void respond(lcb_RESPSTORE *resp)
+    {
+        resp->ctx.scope = cmd->collection().scope();
+        resp->ctx.collection = cmd->collection().collection();
+        resp->cookie = cmd->cookie();
+        lcb_RESPCALLBACK callback = lcb_find_callback(instance, LCB_CALLBACK_STORE);
+        callback(instance, LCB_CALLBACK_STORE, (const lcb_RESPBASE *)resp);
+        for (void *waiter : waiters) {
+            resp->cookie = waiter;
+            callback(instance, LCB_CALLBACK_STORE, (const lcb_RESPBASE *)resp);
+        }
+    }
+    /** Complete the upsert and those it replaced without sending it */
+    void fail(lcb_STATUS rc)
+    {
+        lcb_RESPSTORE resp{};
+        resp.ctx.rc = rc;
+        resp.ctx.key = cmd->key();
+        resp.op = LCB_STORE_UPSERT;
+        resp.rflags |= LCB_RESP_F_FINAL;
+        release_borrowed_value(instance, cmd);
+        respond(&resp);
+    }
+
+    lcb_INSTANCE *instance;
+    std::shared_ptr<lcb_CMDSTORE> cmd;
+    std::string key;
+    lcbio_pTIMER timer;
+    /** Cookies of the upserts whose command was replaced, in the order they were scheduled */
+    std::vector<void *> waiters{};
+};
+
+static void coalesced_store_callback(mc_PIPELINE *, mc_PACKET *pkt, lcb_CALLBACK_TYPE, lcb_STATUS, const void *arg)
+{
+    auto *held = static_cast<CoalescedStore *>(pkt->u_rdata.exdata);
+    held->respond(reinterpret_cast<lcb_RESPSTORE *>(const_cast<void *>(arg)));
+    delete held;
+}
+
+static void coalesced_store_dtor(mc_PACKET *pkt)
+{
+    delete static_cast<CoalescedStore *>(pkt->u_rdata.exdata);
+}
+
+static const mc_REQDATAPROCS coalesced_store_procs = {coalesced_store_callback, coalesced_store_dtor};
+
+/** Send the last command of the key, from now on it is pending in its pipeline */
+static void coalesce_send(CoalescedStore *held)
+{
+    lcb_INSTANCE *instance = held->instance;
+    held->forget();
+    lcb_STATUS rc = store_schedule(instance, held->cmd, held);
+    if (rc != LCB_SUCCESS) {
+        held->fail(rc);
+        delete held;
+    }
+    lcb_aspend_del(&instance->pendops, LCB_PENDTYPE_COUNTER, nullptr);
+}
+
+/** Send the last command of the key once the window is over */
+static void coalesce_timer_callback(void *arg)
+{
+    lcb_INSTANCE *instance = static_cast<CoalescedStore *>(arg)->instance;
+    coalesce_send(static_cast<CoalescedStore *>(arg));
+    lcb_maybe_breakout(instance);
+}
+
+CoalescedStore::CoalescedStore(lcb_INSTANCE *instance_, std::shared_ptr<lcb_CMDSTORE> cmd_, std::string key_)
+    : mc_REQDATAEX(cmd_->cookie(), coalesced_store_procs, gethrtime()), instance(instance_), cmd(std::move(cmd_)),
+      key(std::move(key_)), timer(lcbio_timer_new(instance_->iotable, this, coalesce_timer_callback))
+{
+}
+
+/** Hold the upsert back, or let it replace the one of its key which is */
+static void coalesce_hold(lcb_INSTANCE *instance, std::shared_ptr<lcb_CMDSTORE> cmd)
+{
+    if (instance->pending_stores == nullptr) {
+        instance->pending_stores = new lcb_PENDINGSTORES();
+    }
+    std::string key = lcb_near_cache_key(instance, cmd->collection().collection_id(), cmd->key());
+    auto &stores = instance->pending_stores->stores;
+    auto it = stores.find(key);
+    if (it == stores.end()) {
+        /* the timeout counts from now rather than from the end of the window */
+        cmd->start_time_in_nanoseconds(cmd->start_time_or_default_in_nanoseconds(gethrtime()));
+        auto *held = new CoalescedStore(instance, std::move(cmd), key);
+        stores.emplace(std::move(key), held);
+        /* keep lcb_wait() waiting until it is sent */
+        lcb_aspend_add(&instance->pendops, LCB_PENDTYPE_COUNTER, nullptr);
+        lcbio_timer_rearm(held->timer, LCBT_SETTING(instance, write_coalesce_window));
+        return;
+    }
+
+    CoalescedStore *held = it->second;
+    if (!held->cmd->coalesces_with(*cmd)) {
+        /* send the held upsert right away, so that the writes of the key stay in order */
+        lcbio_timer_disarm(held->timer);
+        coalesce_send(held);
+        coalesce_hold(instance, std::move(cmd));
+        return;
+    }
+    /* the replaced value is not going to be written */
+    release_borrowed_value(instance, held->cmd);
+    held->waiters.push_back(held->cmd->cookie());
+    /* nor may it wait any longer than the first upsert would have */
+    cmd->start_time_in_nanoseconds(held->cmd->start_time_or_default_in_nanoseconds(gethrtime()));
+    held->cmd = std::move(cmd);
+    if (instance->settings->metrics) {
+        instance->settings->metrics->upserts_coalesced++;
+    }
+}
+
+void lcb_pending_stores_destroy(lcb_PENDINGSTORES *pending)
+{
+    std::vector<CoalescedStore *> stores;
+    for (auto &entry : pending->stores) {
+        stores.push_back(entry.second);
+    }
+    pending->stores.clear();
+    for (CoalescedStore *held : stores) {
+        lcb_INSTANCE *instance = held->instance;
+        held->fail(LCB_ERR_REQUEST_CANCELED);
+        delete held;
+        lcb_aspend_del(&instance->pendops, LCB_PENDTYPE_COUNTER, nullptr);
+    }
+    delete pending;
+}
+
 static lcb_STATUS store_execute(lcb_INSTANCE *instance, std::shared_ptr<lcb_CMDSTORE> cmd)
 {
     if (!LCBT_SETTING(instance, use_collections)) {
@@ -519,8 +837,6 @@ static lcb_STATUS store_execute(lcb_INSTANCE *instance, std::shared_ptr<lcb_CMDS
     return collcache_resolve(
         instance, cmd,
         [instance](lcb_STATUS status, const lcb_RESPGETCID *resp, std::shared_ptr<lcb_CMDSTORE> operation) {
-            const auto callback_type = LCB_CALLBACK_STORE;
-            lcb_RESPCALLBACK operation_callback = lcb_find_callback(instance, callback_type);
             lcb_RESPSTORE response{};
             if (resp != nullptr) {
                 response.ctx = resp->ctx;
@@ -531,16 +847,19 @@ static lcb_STATUS store_execute(lcb_INSTANCE *instance, std::shared_ptr<lcb_CMDS
             response.cookie = operation->cookie();
             if (status == LCB_ERR_SHEDULE_FAILURE || resp == nullptr) {
                 response.ctx.rc = LCB_ERR_TIMEOUT;
-                operation_callback(instance, callback_type, &response);
+                release_borrowed_value(instance, operation);
+                invoke_store_callback(instance, operation, &response);
                 return;
             }
             if (resp->ctx.rc != LCB_SUCCESS) {
-                operation_callback(instance, callback_type, &response);
+                release_borrowed_value(instance, operation);
+                invoke_store_callback(instance, operation, &response);
                 return;
             }
             response.ctx.rc = store_schedule(instance, operation);
             if (response.ctx.rc != LCB_SUCCESS) {
-                operation_callback(instance, callback_type, &response);
+                release_borrowed_value(instance, operation);
+                invoke_store_callback(instance, operation, &response);
             }
         });
 }
@@ -560,19 +879,19 @@ LIBCOUCHBASE_API lcb_STATUS lcb_store(lcb_INSTANCE *instance, void *cookie, cons
     if (instance->cmdq.config == nullptr) {
         cmd->start_time_in_nanoseconds(gethrtime());
         return lcb::defer_operation(instance, [instance, cmd](lcb_STATUS status) {
-            const auto callback_type = LCB_CALLBACK_STORE;
-            lcb_RESPCALLBACK operation_callback = lcb_find_callback(instance, callback_type);
             lcb_RESPSTORE response{};
             response.ctx.key = cmd->key();
             response.cookie = cmd->cookie();
             if (status == LCB_ERR_REQUEST_CANCELED) {
                 response.ctx.rc = status;
-                operation_callback(instance, callback_type, &response);
+                release_borrowed_value(instance, cmd);
+                invoke_store_callback(instance, cmd, &response);
                 return;
             }
             response.ctx.rc = store_execute(instance, cmd);
             if (response.ctx.rc != LCB_SUCCESS) {
-                operation_callback(instance, callback_type, &response);
+                release_borrowed_value(instance, cmd);
+                invoke_store_callback(instance, cmd, &response);
             }
         });
     }
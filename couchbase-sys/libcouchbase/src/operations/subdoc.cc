@@ -33,7 +33,7 @@ LIBCOUCHBASE_API lcb_STATUS lcb_respsubdoc_result_status(const lcb_RESPSUBDOC *r
     if (index >= resp->nres) {
         return LCB_ERR_OPTIONS_CONFLICT;
     }
-    return resp->res[index].status;
+    return resp->result(index).status;
 }
 
 LIBCOUCHBASE_API lcb_STATUS lcb_respsubdoc_result_value(const lcb_RESPSUBDOC *resp, size_t index, const char **value,
@@ -42,11 +42,18 @@ LIBCOUCHBASE_API lcb_STATUS lcb_respsubdoc_result_value(const lcb_RESPSUBDOC *re
     if (index >= resp->nres) {
         return LCB_ERR_OPTIONS_CONFLICT;
     }
-    *value = (const char *)resp->res[index].value;
-    *value_len = resp->res[index].nvalue;
+    const lcb_SDENTRY &ent = resp->result(index);
+    *value = (const char *)ent.value;
+    *value_len = ent.nvalue;
     return LCB_SUCCESS;
 }
 
+LIBCOUCHBASE_API size_t lcb_respsubdoc_results(const lcb_RESPSUBDOC *resp, lcb_SUBDOC_RESULT *results,
+                                               size_t nresults, const char **body)
+{
+    return resp->results(results, nresults, body);
+}
+
 LIBCOUCHBASE_API lcb_STATUS lcb_respsubdoc_status(const lcb_RESPSUBDOC *resp)
 {
     return resp->ctx.rc;
@@ -374,6 +381,20 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdsubdoc_specs(lcb_CMDSUBDOC *cmd, const lcb_SU
     return cmd->specs(operations);
 }
 
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdsubdoc_template(lcb_CMDSUBDOC *cmd, const lcb_SUBDOCTEMPLATE *tpl)
+{
+    return cmd->compiled_specs(tpl);
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdsubdoc_template_value(lcb_CMDSUBDOC *cmd, size_t index, const char *value,
+                                                         size_t value_len)
+{
+    if (value == nullptr && value_len != 0) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    return cmd->template_value(index, value == nullptr ? std::string() : std::string(value, value_len));
+}
+
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdsubdoc_expiry(lcb_CMDSUBDOC *cmd, uint32_t expiration)
 {
     return cmd->expiry(expiration);
@@ -602,7 +623,12 @@ struct MultiBuilder {
     explicit MultiBuilder(std::shared_ptr<lcb_CMDSUBDOC> cmd) : cmd_(cmd)
     {
         mode_ = infer_mode(cmd_->specs());
-        size_t ebufsz = cmd->specs().specs().size() * (is_lookup() ? 4 : 8);
+        size_t ebufsz;
+        if (cmd_->compiled_specs()) {
+            ebufsz = is_lookup() ? 0 : cmd_->compiled_specs()->blob.size();
+        } else {
+            ebufsz = cmd_->specs().specs().size() * (is_lookup() ? 4 : 8);
+        }
         extra_body_ = new char[ebufsz];
     }
 
@@ -716,8 +742,91 @@ struct MultiBuilder {
         }
         return LCB_SUCCESS;
     }
+
+    /**
+     * Add all specs of a template. Lookups refer to the serialized specs as
+     * they are, mutations copy them to fill in the value lengths.
+     */
+    void add_template(const subdoc_template &tpl, const std::vector<std::string> &values)
+    {
+        if (is_lookup()) {
+            add_iov(tpl.blob);
+            return;
+        }
+
+        memcpy(extra_body_, tpl.blob.data(), tpl.blob.size());
+        bodysz_ = tpl.blob.size();
+        size_t begin = 0;
+        for (size_t ii = 0; ii < tpl.segments.size(); ii++) {
+            const subdoc_template::segment &seg = tpl.segments[ii];
+            uint32_t value_length = htonl(static_cast<uint32_t>(values[ii].size()));
+            memcpy(extra_body_ + seg.value_length_offset, &value_length, sizeof(value_length));
+            add_iov(extra_body_ + begin, seg.end - begin);
+            add_iov(values[ii]);
+            begin = seg.end;
+        }
+    }
 };
 
+/**
+ * Serialize the specs the same way MultiBuilder::add_spec() does, leaving the
+ * value lengths of mutations to be filled in per command.
+ */
+static lcb_STATUS compile_specs(const lcb_SUBDOCSPECS &specs, subdoc_template &tpl)
+{
+    tpl.mode = infer_mode(specs);
+    for (const auto &spec : specs.specs()) {
+        const SubdocCmdTraits::Traits &trait = SubdocCmdTraits::find(spec.opcode());
+        if (!trait.valid()) {
+            return LCB_ERR_UNKNOWN_SUBDOC_COMMAND;
+        }
+        if (trait.mode() != tpl.mode) {
+            return LCB_ERR_OPTIONS_CONFLICT;
+        }
+        if (!trait.chk_allow_empty_path(spec.options()) && spec.path().empty()) {
+            return LCB_ERR_SUBDOC_PATH_INVALID;
+        }
+
+        tpl.blob.push_back(static_cast<char>(trait.opcode));
+        tpl.blob.push_back(static_cast<char>(make_path_flags(spec.options())));
+        uint16_t path_length = htons(static_cast<uint16_t>(spec.path().size()));
+        tpl.blob.append(reinterpret_cast<const char *>(&path_length), sizeof(path_length));
+
+        size_t value_length_offset = tpl.blob.size();
+        if (tpl.mode == LCB_SDMULTI_MODE_MUTATE) {
+            tpl.blob.append(sizeof(uint32_t), '\0');
+        }
+        tpl.blob.append(spec.path());
+        if (tpl.mode == LCB_SDMULTI_MODE_MUTATE) {
+            tpl.segments.push_back({tpl.blob.size(), value_length_offset});
+        }
+    }
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_subdoctemplate_create(lcb_SUBDOCTEMPLATE **tpl, const lcb_SUBDOCSPECS *operations)
+{
+    if (operations == nullptr || operations->specs().empty()) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+
+    auto compiled = std::make_shared<subdoc_template>();
+    compiled->specs = *operations;
+    lcb_STATUS rc = compile_specs(compiled->specs, *compiled);
+    if (rc != LCB_SUCCESS) {
+        return rc;
+    }
+    *tpl = new lcb_SUBDOCTEMPLATE;
+    (*tpl)->compiled = std::move(compiled);
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_subdoctemplate_destroy(lcb_SUBDOCTEMPLATE *tpl)
+{
+    delete tpl;
+    return LCB_SUCCESS;
+}
+
 static lcb_STATUS subdoc_validate(lcb_INSTANCE *instance, const lcb_CMDSUBDOC *cmd)
 {
     if (cmd->key().empty()) {
@@ -754,10 +863,14 @@ static lcb_STATUS subdoc_schedule(lcb_INSTANCE *instance, std::shared_ptr<lcb_CM
 
     lcb_STATUS rc = LCB_SUCCESS;
 
-    for (const auto &spec : cmd->specs().specs()) {
-        rc = ctx.add_spec(spec);
-        if (rc != LCB_SUCCESS) {
-            return rc;
+    if (cmd->compiled_specs()) {
+        ctx.add_template(*cmd->compiled_specs(), cmd->template_values());
+    } else {
+        for (const auto &spec : cmd->specs().specs()) {
+            rc = ctx.add_spec(spec);
+            if (rc != LCB_SUCCESS) {
+                return rc;
+            }
         }
     }
 
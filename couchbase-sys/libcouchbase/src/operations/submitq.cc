@@ -0,0 +1,203 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2020 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "internal.h"
+#include "lcbio/iotable.h"
+#include <libcouchbase/pktfwd.h>
+#include <atomic>
+#include <cstring>
+#include <new>
+
+namespace
+{
+struct SubmitNode {
+    std::atomic<SubmitNode *> next{nullptr};
+    const void *cookie{nullptr};
+    lcb_CMDPKTFWD cmd{};
+};
+} // namespace
+
+/**
+ * Intrusive multi-producer/single-consumer queue (after Dmitry Vyukov).
+ * Producers only swap `head`, the loop thread is the only one to touch `tail`.
+ */
+struct lcb_SUBMITQ_st {
+    lcb_INSTANCE *instance{nullptr};
+    lcb_WAKEUP *wakeup{nullptr};
+    std::atomic<SubmitNode *> head{nullptr};
+    SubmitNode *tail{nullptr};
+    SubmitNode stub{};
+    /** Set once the loop has been signalled, until it starts draining */
+    std::atomic<bool> notified{false};
+};
+
+static void push_node(lcb_SUBMITQ *queue, SubmitNode *node)
+{
+    node->next.store(nullptr, std::memory_order_relaxed);
+    SubmitNode *prev = queue->head.exchange(node, std::memory_order_acq_rel);
+    prev->next.store(node, std::memory_order_release);
+}
+
+static SubmitNode *pop_node(lcb_SUBMITQ *queue)
+{
+    SubmitNode *tail = queue->tail;
+    SubmitNode *next = tail->next.load(std::memory_order_acquire);
+
+    if (tail == &queue->stub) {
+        if (next == nullptr) {
+            return nullptr;
+        }
+        queue->tail = next;
+        tail = next;
+        next = next->next.load(std::memory_order_acquire);
+    }
+    if (next != nullptr) {
+        queue->tail = next;
+        return tail;
+    }
+    if (tail != queue->head.load(std::memory_order_acquire)) {
+        /* A producer is halfway through a push, and signals once it is done */
+        return nullptr;
+    }
+    push_node(queue, &queue->stub);
+    next = tail->next.load(std::memory_order_acquire);
+    if (next != nullptr) {
+        queue->tail = next;
+        return tail;
+    }
+    return nullptr;
+}
+
+static void forward_node(lcb_INSTANCE *instance, SubmitNode *node)
+{
+    lcb_STATUS rc = lcb_pktfwd3(instance, node->cookie, &node->cmd);
+    if (rc != LCB_SUCCESS) {
+        lcb_PKTFWDRESP resp{};
+        if (node->cmd.vb.vtype != LCB_KV_COPY) {
+            instance->callbacks.pktflushed(instance, node->cookie);
+        }
+        instance->callbacks.pktfwd(instance, node->cookie, rc, &resp);
+    }
+    node->~SubmitNode();
+    free(node);
+}
+
+static void submitq_handler(void *arg)
+{
+    lcb_submitq_drain(static_cast<lcb_SUBMITQ *>(arg));
+}
+
+LIBCOUCHBASE_API
+lcb_STATUS lcb_submitq_create(lcb_INSTANCE *instance, lcb_SUBMITQ **queue)
+{
+    if (instance == nullptr || queue == nullptr) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+
+    auto *res = new lcb_SUBMITQ();
+    res->instance = instance;
+    res->head.store(&res->stub, std::memory_order_relaxed);
+    res->tail = &res->stub;
+
+    lcb_STATUS rc = lcbio_wakeup_new(instance->iotable, submitq_handler, res, &res->wakeup);
+    if (rc != LCB_SUCCESS) {
+        delete res;
+        return rc;
+    }
+    *queue = res;
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API
+lcb_STATUS lcb_submitq_push(lcb_SUBMITQ *queue, const void *cookie, const lcb_CMDPKTFWD *cmd)
+{
+    if (queue == nullptr || cmd == nullptr) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+
+    size_t extra = 0;
+    if (cmd->vb.vtype == LCB_KV_COPY) {
+        extra = cmd->vb.u_buf.contig.nbytes;
+    } else if (cmd->vb.vtype == LCB_KV_IOV) {
+        extra = cmd->vb.u_buf.multi.niov * sizeof(lcb_IOV);
+    }
+
+    void *mem = malloc(sizeof(SubmitNode) + extra);
+    if (mem == nullptr) {
+        return LCB_ERR_NO_MEMORY;
+    }
+    auto *node = new (mem) SubmitNode();
+    node->cookie = cookie;
+    node->cmd = *cmd;
+    if (extra) {
+        void *copy = static_cast<void *>(node + 1);
+        if (cmd->vb.vtype == LCB_KV_COPY) {
+            memcpy(copy, cmd->vb.u_buf.contig.bytes, extra);
+            node->cmd.vb.u_buf.contig.bytes = copy;
+        } else {
+            memcpy(copy, cmd->vb.u_buf.multi.iov, extra);
+            node->cmd.vb.u_buf.multi.iov = static_cast<lcb_IOV *>(copy);
+        }
+    }
+
+    push_node(queue, node);
+    if (!queue->notified.exchange(true, std::memory_order_seq_cst)) {
+        return lcb_wakeup_signal(queue->wakeup);
+    }
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API
+lcb_SIZE lcb_submitq_drain(lcb_SUBMITQ *queue)
+{
+    lcb_INSTANCE *instance = queue->instance;
+    lcb_SIZE count = 0;
+    SubmitNode *node;
+
+    /* Reset before looking at the queue, so that packets pushed from now on
+     * signal the loop again */
+    queue->notified.store(false, std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    bool own_ctx = !instance->cmdq.ctxenter;
+    if (own_ctx) {
+        lcb_sched_enter(instance);
+    }
+    while ((node = pop_node(queue)) != nullptr) {
+        forward_node(instance, node);
+        count++;
+    }
+    if (own_ctx) {
+        if (count) {
+            lcb_sched_leave(instance);
+        } else {
+            lcb_sched_fail(instance);
+        }
+    }
+    return count;
+}
+
+LIBCOUCHBASE_API
+void lcb_submitq_destroy(lcb_SUBMITQ *queue)
+{
+    if (queue == nullptr) {
+        return;
+    }
+    lcb_submitq_drain(queue);
+    lcb_wakeup_destroy(queue->wakeup);
+    delete queue;
+}
@@ -19,6 +19,7 @@
 #include "collections.h"
 #include "trace.h"
 #include "defer.h"
+#include "mc/encoder.hh"
 
 #include "capi/cmd_touch.hh"
 
@@ -166,22 +167,27 @@ static lcb_STATUS touch_schedule(lcb_INSTANCE *instance, std::shared_ptr<lcb_CMD
         return err;
     }
 
-    hdr.request.opcode = PROTOCOL_BINARY_CMD_TOUCH;
-    hdr.request.cas = 0;
-    hdr.request.datatype = PROTOCOL_BINARY_RAW_BYTES;
-    hdr.request.opaque = pkt->opaque;
-    hdr.request.bodylen = htonl(hdr.request.extlen + ffextlen + mcreq_get_key_size(&hdr));
-
-    memcpy(SPAN_BUFFER(&pkt->kh_span), &hdr, sizeof(hdr));
-    std::size_t offset = sizeof(hdr);
-    if (!framing_extras.empty()) {
+    std::uint32_t expiry = htonl(cmd->expiry());
+    if (framing_extras.empty()) {
+        lcb::mc::RequestEncoder<PROTOCOL_BINARY_CMD_TOUCH, 4>::encode(pkt, hdr, 0, 0, &expiry);
+    } else {
+        hdr.request.opcode = PROTOCOL_BINARY_CMD_TOUCH;
+        hdr.request.cas = 0;
+        hdr.request.datatype = PROTOCOL_BINARY_RAW_BYTES;
+        hdr.request.opaque = pkt->opaque;
+        hdr.request.bodylen = htonl(hdr.request.extlen + ffextlen + mcreq_get_key_size(&hdr));
+
+        memcpy(SPAN_BUFFER(&pkt->kh_span), &hdr, sizeof(hdr));
+        std::size_t offset = sizeof(hdr);
         memcpy(SPAN_BUFFER(&pkt->kh_span) + offset, framing_extras.data(), framing_extras.size());
         offset += framing_extras.size();
+        memcpy(SPAN_BUFFER(&pkt->kh_span) + offset, &expiry, sizeof(expiry));
     }
-    std::uint32_t expiry = htonl(cmd->expiry());
-    memcpy(SPAN_BUFFER(&pkt->kh_span) + offset, &expiry, sizeof(expiry));
 
     pkt->u_rdata.reqdata.cookie = cmd->cookie();
+    if (cmd->is_cookie_callback()) {
+        pkt->flags |= MCREQ_F_PRIVCALLBACK;
+    }
     pkt->u_rdata.reqdata.start = cmd->start_time_or_default_in_nanoseconds(gethrtime());
     pkt->u_rdata.reqdata.deadline =
         pkt->u_rdata.reqdata.start +
@@ -192,6 +198,18 @@ static lcb_STATUS touch_schedule(lcb_INSTANCE *instance, std::shared_ptr<lcb_CMD
     return LCB_SUCCESS;
 }
 
+/**
+ * Commands whose cookie is their callback (see lcb_CMDTOUCH::treat_cookie_as_callback()) have to be completed through
+ * it as well if they fail before being scheduled.
+ */
+static lcb_RESPCALLBACK touch_callback(lcb_INSTANCE *instance, const std::shared_ptr<lcb_CMDTOUCH> &cmd)
+{
+    if (cmd->is_cookie_callback()) {
+        return *static_cast<lcb_RESPCALLBACK *>(cmd->cookie());
+    }
+    return lcb_find_callback(instance, LCB_CALLBACK_TOUCH);
+}
+
 static lcb_STATUS touch_execute(lcb_INSTANCE *instance, std::shared_ptr<lcb_CMDTOUCH> cmd)
 {
     if (!LCBT_SETTING(instance, use_collections)) {
@@ -207,7 +225,7 @@ static lcb_STATUS touch_execute(lcb_INSTANCE *instance, std::shared_ptr<lcb_CMDT
         instance, cmd,
         [instance](lcb_STATUS status, const lcb_RESPGETCID *resp, std::shared_ptr<lcb_CMDTOUCH> operation) {
             const auto callback_type = LCB_CALLBACK_TOUCH;
-            lcb_RESPCALLBACK operation_callback = lcb_find_callback(instance, callback_type);
+            lcb_RESPCALLBACK operation_callback = touch_callback(instance, operation);
             lcb_RESPTOUCH response{};
             if (resp != nullptr) {
                 response.ctx = resp->ctx;
@@ -249,7 +267,7 @@ lcb_STATUS lcb_touch(lcb_INSTANCE *instance, void *cookie, const lcb_CMDTOUCH *c
         cmd->start_time_in_nanoseconds(gethrtime());
         return lcb::defer_operation(instance, [instance, cmd](lcb_STATUS status) {
             const auto callback_type = LCB_CALLBACK_TOUCH;
-            lcb_RESPCALLBACK operation_callback = lcb_find_callback(instance, callback_type);
+            lcb_RESPCALLBACK operation_callback = touch_callback(instance, cmd);
             lcb_RESPTOUCH response{};
             response.ctx.key = cmd->key();
             response.cookie = cmd->cookie();
@@ -77,6 +77,7 @@ static rdb_ROPESEG *seg_alloc(rdb_ALLOCATOR *abase, unsigned size)
     rdb_ROPESEG *newseg = NULL;
     rdb_BIGALLOC *alloc = (rdb_BIGALLOC *)abase;
 
+    alloc->n_sincetrim++;
     recheck_thresholds(alloc);
     /**
      * If the allocation reaches a certain threshold (for example, for a really
@@ -178,6 +179,33 @@ static void seg_release(rdb_ALLOCATOR *abase, rdb_ROPESEG *seg)
     alloc_decref(abase);
 }
 
+static unsigned trim_pooled(rdb_pALLOCATOR abase, unsigned keep)
+{
+    rdb_BIGALLOC *alloc = (rdb_BIGALLOC *)abase;
+    lcb_list_t *llcur;
+    unsigned pooled = 0, freed = 0;
+
+    if (alloc->n_sincetrim) {
+        alloc->n_sincetrim = 0;
+        return 0;
+    }
+
+    LCB_LIST_FOR(llcur, (lcb_list_t *)&alloc->bufs)
+    {
+        pooled += LCB_LIST_ITEM(llcur, rdb_ROPESEG, llnode)->nalloc;
+    }
+    /* Least recently released segments first */
+    while (pooled > keep && LCB_CLIST_SIZE(&alloc->bufs)) {
+        rdb_ROPESEG *seg = LCB_LIST_ITEM(lcb_clist_pop(&alloc->bufs), rdb_ROPESEG, llnode);
+        pooled -= seg->nalloc;
+        freed += seg->nalloc;
+        free(seg->root);
+        free(seg);
+    }
+    alloc->total_trimmed += freed;
+    return freed;
+}
+
 static void dump_wrap(rdb_pALLOCATOR alloc, FILE *fp)
 {
     rdb_bigalloc_dump((rdb_BIGALLOC *)alloc, fp);
@@ -200,6 +228,7 @@ rdb_ALLOCATOR *rdb_bigalloc_new(void)
     abase->s_realloc = seg_realloc;
     abase->a_release = alloc_decref;
     abase->dump = dump_wrap;
+    abase->a_trim = trim_pooled;
     return &alloc->base;
 }
 
@@ -216,4 +245,5 @@ void rdb_bigalloc_dump(rdb_BIGALLOC *alloc, FILE *fp)
     fprintf(fp, "%sTotalRequests: %u\n", indent, alloc->total_requests);
     fprintf(fp, "%sTotalToobig: %u\n", indent, alloc->total_toobig);
     fprintf(fp, "%sTotalToosmall: %u\n", indent, alloc->total_toosmall);
+    fprintf(fp, "%sTotalTrimmed: %u\n", indent, alloc->total_trimmed);
 }
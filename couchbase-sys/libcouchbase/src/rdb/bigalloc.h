@@ -43,12 +43,14 @@ typedef struct {
     unsigned n_requests;    /* number of requests. Reset every RECHECK_RATE */
     unsigned n_toobig;      /* number of requests > max_blk_alloc */
     unsigned n_toosmall;    /* number of requests < min_blk_alloc */
+    unsigned n_sincetrim;   /* number of requests since the last rdb_trim() */
 
     /** counters updated at the end only */
     unsigned total_malloc;
     unsigned total_requests;
     unsigned total_toobig;
     unsigned total_toosmall;
+    unsigned total_trimmed; /* bytes of pooled segments freed by rdb_trim() */
 } rdb_BIGALLOC;
 
 #define RDB_BIGALLOC_ALLOCSZ_MAX 65536
@@ -0,0 +1,220 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2020 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <stddef.h>
+#include "rope.h"
+#include "poolalloc.h"
+
+#define CLASS_SIZE(cls) ((unsigned)RDB_POOLALLOC_MINSIZE << (cls))
+
+/** @return the size class of a segment of the given size, RDB_POOLALLOC_NCLASSES if too big */
+static unsigned size_class(unsigned size)
+{
+    unsigned cls = 0;
+    while (cls < RDB_POOLALLOC_NCLASSES && CLASS_SIZE(cls) < size) {
+        cls++;
+    }
+    return cls;
+}
+
+static void free_seg(rdb_ROPESEG *seg)
+{
+    free(seg->root);
+    free(seg);
+}
+
+static void alloc_decref(rdb_ALLOCATOR *abase)
+{
+    lcb_list_t *llcur, *llnext;
+    rdb_POOLALLOC *alloc = (rdb_POOLALLOC *)abase;
+    unsigned ii;
+
+    if (--alloc->refcount) {
+        return;
+    }
+
+    for (ii = 0; ii < RDB_POOLALLOC_NCLASSES; ii++) {
+        LCB_LIST_SAFE_FOR(llcur, llnext, (lcb_list_t *)&alloc->bufs[ii])
+        {
+            rdb_ROPESEG *seg = LCB_LIST_ITEM(llcur, rdb_ROPESEG, llnode);
+            lcb_clist_delete(&alloc->bufs[ii], &seg->llnode);
+            free_seg(seg);
+        }
+    }
+    free(alloc);
+}
+
+static rdb_ROPESEG *seg_alloc(rdb_ALLOCATOR *abase, unsigned size)
+{
+    rdb_POOLALLOC *alloc = (rdb_POOLALLOC *)abase;
+    rdb_ROPESEG *newseg;
+    unsigned cls = size_class(size);
+
+    alloc->total_requests++;
+    alloc->sincetrim++;
+    if (cls < RDB_POOLALLOC_NCLASSES && LCB_CLIST_SIZE(&alloc->bufs[cls])) {
+        newseg = LCB_LIST_ITEM(lcb_clist_shift(&alloc->bufs[cls]), rdb_ROPESEG, llnode);
+        alloc->retained -= newseg->nalloc;
+        alloc->total_reused++;
+    } else {
+        newseg = calloc(1, sizeof(*newseg));
+        newseg->nalloc = cls < RDB_POOLALLOC_NCLASSES ? CLASS_SIZE(cls) : size;
+        newseg->root = malloc(newseg->nalloc);
+        if (cls == RDB_POOLALLOC_NCLASSES) {
+            alloc->total_toobig++;
+        }
+    }
+
+    newseg->shflags = RDB_ROPESEG_F_LIB;
+    newseg->allocator = abase;
+    newseg->allocid = RDB_ALLOCATOR_POOLED;
+    newseg->start = 0;
+    newseg->nused = 0;
+    alloc->refcount++;
+    return newseg;
+}
+
+static void buf_reserve(rdb_pALLOCATOR abase, rdb_ROPEBUF *buf, unsigned size)
+{
+    rdb_ROPESEG *newseg, *lastseg;
+
+    lastseg = RDB_SEG_LAST(buf);
+    if (lastseg && RDB_SEG_SPACE(lastseg) + buf->nused >= size) {
+        return;
+    }
+
+    newseg = seg_alloc(abase, size);
+    lcb_list_append(&buf->segments, &newseg->llnode);
+}
+
+static rdb_ROPESEG *seg_realloc(rdb_ALLOCATOR *abase, rdb_ROPESEG *seg, unsigned size)
+{
+    unsigned cls;
+
+    if (seg->nalloc >= size) {
+        return seg;
+    }
+
+    /* Keep the segment in a size class, so it can be pooled once released */
+    cls = size_class(size);
+    seg->nalloc = cls < RDB_POOLALLOC_NCLASSES ? CLASS_SIZE(cls) : size;
+    seg->root = realloc(seg->root, seg->nalloc);
+    (void)abase;
+    return seg;
+}
+
+static void seg_release(rdb_ALLOCATOR *abase, rdb_ROPESEG *seg)
+{
+    rdb_POOLALLOC *alloc = (rdb_POOLALLOC *)abase;
+    unsigned cls = size_class(seg->nalloc);
+
+    if (cls == RDB_POOLALLOC_NCLASSES || CLASS_SIZE(cls) != seg->nalloc) {
+        free_seg(seg);
+    } else if (alloc->retained + seg->nalloc > alloc->max_retained) {
+        alloc->total_discarded++;
+        free_seg(seg);
+    } else {
+        /* Most recently used segments first, they are likely still cached */
+        lcb_clist_prepend(&alloc->bufs[cls], &seg->llnode);
+        alloc->retained += seg->nalloc;
+        if (alloc->retained > alloc->peak_retained) {
+            alloc->peak_retained = alloc->retained;
+        }
+    }
+    alloc_decref(abase);
+}
+
+static unsigned trim_pooled(rdb_pALLOCATOR abase, unsigned keep)
+{
+    rdb_POOLALLOC *alloc = (rdb_POOLALLOC *)abase;
+    unsigned freed = 0;
+    unsigned cls = RDB_POOLALLOC_NCLASSES;
+
+    if (alloc->sincetrim) {
+        alloc->sincetrim = 0;
+        return 0;
+    }
+
+    /* Largest size classes first, and the least recently released segments of each */
+    while (alloc->retained > keep && cls-- > 0) {
+        while (alloc->retained > keep && LCB_CLIST_SIZE(&alloc->bufs[cls])) {
+            rdb_ROPESEG *seg = LCB_LIST_ITEM(lcb_clist_pop(&alloc->bufs[cls]), rdb_ROPESEG, llnode);
+            alloc->retained -= seg->nalloc;
+            freed += seg->nalloc;
+            free_seg(seg);
+        }
+    }
+    alloc->total_trimmed += freed;
+    return freed;
+}
+
+static void dump_wrap(rdb_pALLOCATOR alloc, FILE *fp)
+{
+    rdb_poolalloc_dump((rdb_POOLALLOC *)alloc, fp);
+}
+
+rdb_ALLOCATOR *rdb_poolalloc_new(unsigned max_retained)
+{
+    rdb_ALLOCATOR *abase;
+    rdb_POOLALLOC *alloc = calloc(1, sizeof(*alloc));
+    unsigned ii;
+
+    for (ii = 0; ii < RDB_POOLALLOC_NCLASSES; ii++) {
+        lcb_clist_init(&alloc->bufs[ii]);
+    }
+    alloc->max_retained = max_retained;
+    alloc->refcount = 1;
+
+    abase = &alloc->base;
+    abase->r_reserve = buf_reserve;
+    abase->s_release = seg_release;
+    abase->s_alloc = seg_alloc;
+    abase->s_realloc = seg_realloc;
+    abase->a_release = alloc_decref;
+    abase->dump = dump_wrap;
+    abase->a_trim = trim_pooled;
+    return &alloc->base;
+}
+
+rdb_ALLOCATOR *rdb_poolalloc_ref(rdb_ALLOCATOR *abase)
+{
+    ((rdb_POOLALLOC *)abase)->refcount++;
+    return abase;
+}
+
+void rdb_poolalloc_dump(rdb_POOLALLOC *alloc, FILE *fp)
+{
+    static const char *indent = "  ";
+    unsigned ii;
+
+    fprintf(fp, "POOLALLOC @%p\n", (void *)alloc);
+    fprintf(fp, "%sRetained: %u (peak %u, max %u)\n", indent, alloc->retained, alloc->peak_retained,
+            alloc->max_retained);
+    fprintf(fp, "%sPooled Blocks:", indent);
+    for (ii = 0; ii < RDB_POOLALLOC_NCLASSES; ii++) {
+        if (LCB_CLIST_SIZE(&alloc->bufs[ii])) {
+            fprintf(fp, " %u:%lu", CLASS_SIZE(ii), (unsigned long int)LCB_CLIST_SIZE(&alloc->bufs[ii]));
+        }
+    }
+    fprintf(fp, "\n");
+    fprintf(fp, "%sTotalRequests: %u\n", indent, alloc->total_requests);
+    fprintf(fp, "%sTotalReused: %u\n", indent, alloc->total_reused);
+    fprintf(fp, "%sTotalToobig: %u\n", indent, alloc->total_toobig);
+    fprintf(fp, "%sTotalDiscarded: %u\n", indent, alloc->total_discarded);
+    fprintf(fp, "%sTotalTrimmed: %u\n", indent, alloc->total_trimmed);
+}
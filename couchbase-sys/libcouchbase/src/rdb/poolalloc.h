@@ -0,0 +1,72 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2020 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef RDB_POOLALLOC
+#define RDB_POOLALLOC
+#include "list.h"
+#include <stdio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Size-classed pooled allocator. Unlike the other allocators a single
+ * instance of this allocator is meant to be shared by all the sockets of an
+ * instance (see rdb_poolalloc_ref()), so that idle segments are not retained
+ * by every connection separately.
+ *
+ * Segments are rounded up to a power of two between RDB_POOLALLOC_MINSIZE and
+ * RDB_POOLALLOC_MAXSIZE and kept on a free list per size class once released,
+ * as long as the total number of retained bytes stays below a cap. Larger
+ * segments are allocated to size and never pooled.
+ *
+ * This header file exists for internal use. To create an allocator instance,
+ * refer to rdb_poolalloc_new() in rope.h
+ */
+
+#define RDB_POOLALLOC_MINSIZE 256
+#define RDB_POOLALLOC_NCLASSES 13
+#define RDB_POOLALLOC_MAXSIZE (RDB_POOLALLOC_MINSIZE << (RDB_POOLALLOC_NCLASSES - 1))
+
+typedef struct {
+    rdb_ALLOCATOR base;
+    lcb_clist_t bufs[RDB_POOLALLOC_NCLASSES]; /* pooled segments, per size class */
+    unsigned refcount;        /* owner, users and outstanding segments */
+    unsigned max_retained;    /* maximum number of bytes kept in the pool */
+    unsigned retained;        /* number of bytes currently kept in the pool */
+    unsigned sincetrim;       /* segments handed out since the last rdb_trim() */
+
+    unsigned total_requests;  /* segments handed out */
+    unsigned total_reused;    /* of those, taken from the pool */
+    unsigned total_toobig;    /* of those, bigger than RDB_POOLALLOC_MAXSIZE */
+    unsigned total_discarded; /* released segments freed because the pool was full */
+    unsigned peak_retained;
+    unsigned total_trimmed;   /* bytes of pooled segments freed by rdb_trim() */
+} rdb_POOLALLOC;
+
+/**
+ * Dumps a textual representation of the specified allocator to a FILE
+ * @param alloc
+ * @param fp
+ */
+void rdb_poolalloc_dump(rdb_POOLALLOC *alloc, FILE *fp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -175,13 +175,14 @@ static void try_compact(rdb_ROPESEG *seg)
     seg->start = 0;
 }
 
-static void rope_consolidate(rdb_ROPEBUF *rope, unsigned nr)
+static void rope_consolidate(rdb_ROPEBUF *rope, unsigned nr, int partial)
 {
     rdb_ROPESEG *seg, *newseg;
     lcb_list_t *llcur, *llnext;
 
     seg = RDB_SEG_FIRST(rope);
-    if (seg->nused + RDB_SEG_SPACE(seg) >= nr || nr < 2) {
+    /* When reserving, the following segments need to be merged regardless */
+    if ((!partial && seg->nused + RDB_SEG_SPACE(seg) >= nr) || nr < 2) {
         return;
     }
 
@@ -220,12 +221,26 @@ static void rope_consolidate(rdb_ROPEBUF *rope, unsigned nr)
 
     lcb_list_prepend(&rope->segments, &newseg->llnode);
     rope->nused += newseg->nused;
-    lcb_assert(rope->nused >= nr);
+    lcb_assert(partial || rope->nused >= nr);
 }
 
 void rdb_consolidate(rdb_IOROPE *ior, unsigned nr)
 {
-    rope_consolidate(&ior->recvd, nr);
+    rope_consolidate(&ior->recvd, nr, 0);
+}
+
+void rdb_rdreserve(rdb_IOROPE *ior, unsigned nr)
+{
+    rdb_ROPESEG *first = RDB_SEG_FIRST(&ior->recvd);
+    rdb_ROPESEG *last = RDB_SEG_LAST(&ior->recvd);
+    if (!first || ior->recvd.nused >= nr) {
+        return;
+    }
+    /* Already reading into a segment which is large enough */
+    if (first == last && first->nused + RDB_SEG_SPACE(first) >= nr) {
+        return;
+    }
+    rope_consolidate(&ior->recvd, nr, 1);
 }
 
 void rdb_copyread(rdb_IOROPE *ior, void *tgt, unsigned n)
@@ -316,6 +331,14 @@ void rdb_seg_unref(rdb_ROPESEG *seg)
     SEG_RELEASE(seg);
 }
 
+int rdb_seg_contains(const rdb_ROPESEG *seg, const void *ptr, size_t n)
+{
+    const char *begin = seg->root;
+    const char *end = seg->root + seg->nalloc;
+    const char *p = (const char *)ptr;
+    return p >= begin && p <= end && n <= (size_t)(end - p);
+}
+
 void rdb_init(rdb_IOROPE *ior, rdb_ALLOCATOR *alloc)
 {
     memset(ior, 0, sizeof(*ior));
@@ -405,3 +428,11 @@ void rdb_dump(const rdb_IOROPE *ior, FILE *fp)
         ior->avail.allocator->dump(ior->avail.allocator, fp);
     }
 }
+
+unsigned rdb_trim(rdb_ALLOCATOR *allocator, unsigned keep)
+{
+    if (allocator->a_trim == NULL) {
+        return 0;
+    }
+    return allocator->a_trim(allocator, keep);
+}
@@ -167,6 +167,7 @@ enum rdb_ALLOCID {
     RDB_ALLOCATOR_BIGALLOC = 1,
     RDB_ALLOCATOR_CHUNKED,
     RDB_ALLOCATOR_LIBCALLOC,
+    RDB_ALLOCATOR_POOLED,
 
     /** use constants higher than this for your own allocator(s) */
     RDB_ALLOCATOR_MAX
@@ -242,6 +243,12 @@ typedef struct rdb_ALLOCATOR {
      */
     void (*a_release)(rdb_pALLOCATOR);
     void (*dump)(rdb_pALLOCATOR, FILE *);
+
+    /**
+     * Optional. Frees the idle segments kept by the allocator beyond the given
+     * number of bytes, see rdb_trim()
+     */
+    unsigned (*a_trim)(rdb_pALLOCATOR, unsigned keep);
 } rdb_ALLOCATOR;
 
 /**
@@ -312,6 +319,20 @@ void rdb_consolidate(rdb_IOROPE *ior, unsigned n);
  */
 char *rdb_get_consolidated(rdb_IOROPE *ior, unsigned n);
 
+/**
+ * Ensure that the first n bytes of the rope will be contiguous once they
+ * have been read, without copying them again afterwards.
+ *
+ * Whatever has been received so far is moved into a single segment with
+ * room for n bytes, which subsequent calls to rdb_rdstart() will read into
+ * first. This should be called once the size of an incomplete message is
+ * known, and before the next read is started. Does nothing if n bytes are
+ * already available.
+ * @param ior the IOROPE structure
+ * @param n number of bytes which must be contiguous
+ */
+void rdb_rdreserve(rdb_IOROPE *ior, unsigned n);
+
 /**
  * @}
  */
@@ -366,6 +387,12 @@ void rdb_seg_ref(rdb_ROPESEG *seg);
  */
 void rdb_seg_unref(rdb_ROPESEG *seg);
 
+/**
+ * Check whether the region [ptr, ptr+n) lies entirely within the memory of
+ * this segment, i.e. whether pinning the segment keeps the region valid.
+ */
+int rdb_seg_contains(const rdb_ROPESEG *seg, const void *ptr, size_t n);
+
 /** @private */
 #define rdb_seg_recyclable(seg) (((seg)->shflags & RDB_ROPESEG_F_USER) == 0)
 
@@ -417,6 +444,16 @@ void rdb_seg_unref(rdb_ROPESEG *seg);
  */
 void rdb_copywrite(rdb_IOROPE *ior, void *buf, unsigned nbuf);
 
+/**
+ * Free the idle segments kept by the allocator beyond @p keep bytes, so that
+ * the memory of a burst of reads is not held while the connections are
+ * quiet. Allocators which handed out segments since the previous call are
+ * left alone, they are only trimmed once quiet for a full interval.
+ * @return the number of bytes freed, 0 if the allocator does not pool segments
+ */
+LCB_INTERNAL_API
+unsigned rdb_trim(rdb_ALLOCATOR *allocator, unsigned keep);
+
 /**
  * Allocator APIs
  * Returns the big or "Default" allocator.
@@ -438,6 +475,22 @@ rdb_ALLOCATOR *rdb_chunkalloc_new(unsigned chunksize);
 LCB_INTERNAL_API
 rdb_ALLOCATOR *rdb_libcalloc_new(void);
 
+/**
+ * Returns a size-classed pooled allocator meant to be shared by multiple
+ * ropes. Each rope should be given its own reference via rdb_poolalloc_ref().
+ * The returned reference belongs to the caller, and is dropped via a_release()
+ * @param max_retained the maximum number of bytes of idle segments to keep
+ */
+LCB_INTERNAL_API
+rdb_ALLOCATOR *rdb_poolalloc_new(unsigned max_retained);
+
+/**
+ * Take a new reference to an allocator created by rdb_poolalloc_new(), for
+ * example to pass it to rdb_init()
+ */
+LCB_INTERNAL_API
+rdb_ALLOCATOR *rdb_poolalloc_ref(rdb_ALLOCATOR *pool);
+
 /**
  * Dump information about the iorope structure to a file
  * @param ior The rope structure to dump
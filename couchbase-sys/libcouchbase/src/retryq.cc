@@ -23,6 +23,7 @@
 #include "bucketconfig/clconfig.h"
 #include "sllist-inl.h"
 #include "mc/mcreq.h"
+#include "trace.h"
 
 #define LOGARGS(rq, lvl) (rq)->settings, "retryq", LCB_LOG_##lvl, __FILE__, __LINE__
 #define RETRY_PKT_KEY "retry_queue"
@@ -30,7 +31,7 @@
 using namespace lcb;
 struct SchedNode : lcb_list_t {
 };
-struct TmoNode : lcb_list_t {
+struct TmoNode : lcb_TWNODE {
 };
 
 struct lcb::RetryOp : mc_EPKTDATUM, SchedNode, TmoNode {
@@ -44,6 +45,10 @@ struct lcb::RetryOp : mc_EPKTDATUM, SchedNode, TmoNode {
     lcb_STATUS origerr;
     protocol_binary_response_status origstatus;
     errmap::RetrySpec *spec;
+    /** Waiting for a configuration which moves the vBucket away from nmvhost */
+    bool parked;
+    /** Data host:port of the node which replied with NOT_MY_VBUCKET */
+    std::string nmvhost;
     explicit RetryOp(errmap::RetrySpec *spec);
     ~RetryOp()
     {
@@ -59,7 +64,7 @@ static RetryOp *from_schednode(lcb_list_t *ll)
 }
 static RetryOp *from_tmonode(lcb_list_t *ll)
 {
-    return static_cast<RetryOp *>(static_cast<TmoNode *>(ll));
+    return static_cast<RetryOp *>(static_cast<TmoNode *>(LCB_LIST_ITEM(ll, lcb_TWNODE, ll)));
 }
 template <typename T>
 int list_cmp(const T &a, const T &b)
@@ -110,10 +115,17 @@ void RetryQueue::update_trytime(RetryOp *op, hrtime_t now)
     }
 }
 
-/** Comparison routine for sorting by timeout */
-static int cmpfn_tmo(lcb_list_t *ll_a, lcb_list_t *ll_b)
+std::string RetryQueue::vbmaster_hostport(lcbvb_CONFIG *config, int vbid) const
 {
-    return list_cmp(from_tmonode(ll_a)->deadline, from_tmonode(ll_b)->deadline);
+    if ((unsigned)vbid >= config->nvb) {
+        return std::string();
+    }
+    int ix = lcbvb_vbmaster(config, vbid);
+    if (ix < 0) {
+        return std::string();
+    }
+    const char *hostport = lcbvb_get_hostport(config, ix, LCBVB_SVCTYPE_DATA, LCBT_SETTING_SVCMODE(get_instance()));
+    return hostport ? hostport : std::string();
 }
 
 static int cmpfn_retry(lcb_list_t *ll_a, lcb_list_t *ll_b)
@@ -146,7 +158,7 @@ static void assign_error(RetryOp *op, lcb_STATUS err)
 void RetryQueue::erase(RetryOp *op)
 {
     lcb_list_delete(static_cast<SchedNode *>(op));
-    lcb_list_delete(static_cast<TmoNode *>(op));
+    lcb_tw_remove(static_cast<TmoNode *>(op));
 }
 
 void RetryQueue::fail(RetryOp *op, lcb_STATUS err, hrtime_t now)
@@ -189,13 +201,25 @@ void RetryQueue::schedule(hrtime_t now)
         now = gethrtime();
     }
 
-    /** Figure out which is first */
-    RetryOp *first_tmo = from_tmonode(LCB_LIST_HEAD(&tmoops));
-    RetryOp *first_sched = from_schednode(LCB_LIST_HEAD(&schedops));
+    /** Figure out which is first. Parked operations only wait for their deadline */
+    hrtime_t schednext = 0;
+    lcb_list_t *ll;
+    LCB_LIST_FOR(ll, &schedops)
+    {
+        RetryOp *op = from_schednode(ll);
+        if (!op->parked) {
+            schednext = op->trytime;
+            break;
+        }
+    }
 
-    hrtime_t schednext = first_sched->trytime;
-    hrtime_t tmonext = first_tmo->deadline;
-    hrtime_t selected = schednext > tmonext ? tmonext : schednext;
+    if (schednext && held_until > now && schednext < held_until) {
+        /* Nothing can be sent to some pipeline before its budget is refilled,
+         * don't spin on its operations until then */
+        schednext = held_until;
+    }
+    hrtime_t tmonext = lcb_tw_next(&tmoops);
+    hrtime_t selected = (tmonext && (!schednext || schednext > tmonext)) ? tmonext : schednext;
 
     hrtime_t diff;
     if (selected <= now) {
@@ -209,33 +233,96 @@ void RetryQueue::schedule(hrtime_t now)
     lcbio_timer_rearm(timer, us_interval);
 }
 
+/**
+ * Take one retry from the budget of a pipeline. Budgets are refilled every
+ * retry_interval.
+ * @param refill set to the time the budget is refilled if it has been spent
+ * @return false if the pipeline has had its share of retries for now
+ */
+bool RetryQueue::take_budget(unsigned srvix, hrtime_t now, hrtime_t *refill)
+{
+    if (!settings->retry_budget) {
+        return true;
+    }
+    if (budgets.size() < cq->npipelines) {
+        budgets.resize(cq->npipelines);
+    }
+
+    Budget &budget = budgets[srvix];
+    hrtime_t interval = get_retry_interval();
+    if (now - budget.start >= interval) {
+        budget.start = now;
+        budget.used = 0;
+    }
+    if (budget.used >= settings->retry_budget) {
+        *refill = budget.start + interval;
+        return false;
+    }
+    budget.used++;
+    return true;
+}
+
+void RetryQueue::update_gauges(hrtime_t now)
+{
+    bool record = settings->op_metrics_enabled && settings->meter;
+    if (settings->metrics == nullptr && !record) {
+        return;
+    }
+
+    lcb_list_t *ll;
+    lcb_SIZE depth = 0;
+    hrtime_t oldest = now;
+    LCB_LIST_FOR(ll, &schedops)
+    {
+        hrtime_t start = MCREQ_PKT_RDATA(from_schednode(ll)->pkt)->start;
+        if (start < oldest) {
+            oldest = start;
+        }
+        depth++;
+    }
+    uint64_t age = LCB_NS2US(now - oldest);
+
+    if (settings->metrics) {
+        settings->metrics->retryq_depth = depth;
+        settings->metrics->retryq_age = age;
+    }
+    if (record) {
+        const lcbmetrics_VALUERECORDER *recorder;
+        recorder = settings->meter->value_recorder_(settings->meter, METRICS_RETRYQ_DEPTH_METER_NAME, nullptr, 0);
+        if (recorder) {
+            recorder->record_value_(recorder, depth);
+        }
+        recorder = settings->meter->value_recorder_(settings->meter, METRICS_RETRYQ_AGE_METER_NAME, nullptr, 0);
+        if (recorder) {
+            recorder->record_value_(recorder, age);
+        }
+    }
+}
+
 /**
  * Flush the queue
  * @param rq The queue to flush
  * @param throttle Whether to throttle operations to be retried. If this is
  * set to false then all operations will be attempted (assuming they have
- * not timed out)
+ * not timed out). Either way, no pipeline receives more than its budget
+ * (settings->retry_budget) per retry_interval.
  */
 void RetryQueue::flush(bool throttle)
 {
-    hrtime_t now = gethrtime();
+    hrtime_t now = gethrtime(), refill;
     lcb_list_t *ll, *ll_next;
-    lcb_list_t resched_next;
+    lcb_list_t resched_next, expired, held;
 
     /** Check timeouts first */
-    LCB_LIST_SAFE_FOR(ll, ll_next, &tmoops)
-    {
-        RetryOp *op = from_tmonode(ll);
-        hrtime_t curtmo = op->deadline;
-
-        if (curtmo <= now) {
-            fail(op, LCB_ERR_TIMEOUT, now);
-        } else {
-            break;
-        }
+    lcb_tw_expire(&tmoops, now, &expired);
+    while (!LCB_LIST_IS_EMPTY(&expired)) {
+        /* unlinks the operation from the expired list */
+        fail(from_tmonode(expired.next), LCB_ERR_TIMEOUT, now);
     }
 
     lcb_list_init(&resched_next);
+    lcb_list_init(&held);
+    held_until = 0;
     LCB_LIST_SAFE_FOR(ll, ll_next, &schedops)
     {
         protocol_binary_request_header hdr;
@@ -243,6 +330,10 @@ void RetryQueue::flush(bool throttle)
         hrtime_t curnext;
 
         RetryOp *op = from_schednode(ll);
+        if (op->parked) {
+            /* Would be rejected by the same node again */
+            continue;
+        }
         curnext = op->trytime - TIMEFUZZ_NS;
 
         if (curnext > now && throttle) {
@@ -265,13 +356,23 @@ void RetryQueue::flush(bool throttle)
             if (get_instance()->confmon->is_refreshing() || settings->retry[LCB_RETRY_ON_MISSINGNODE]) {
 
                 lcb_list_delete(static_cast<SchedNode *>(op));
-                lcb_list_delete(static_cast<TmoNode *>(op));
                 lcb_list_append(&resched_next, static_cast<SchedNode *>(op));
                 op->pkt->retries++;
                 update_trytime(op, now);
             } else {
                 fail(op, LCB_ERR_NO_MATCHING_SERVER, now);
             }
+        } else if (!take_budget(srvix, now, &refill)) {
+            /* Fresh operations to this pipeline go first. Holding the retry
+             * back does not count as an attempt, so it keeps its backoff */
+            lcb_list_delete(static_cast<SchedNode *>(op));
+            lcb_list_append(&held, static_cast<SchedNode *>(op));
+            if (!held_until || refill < held_until) {
+                held_until = refill;
+            }
+            if (settings->metrics) {
+                settings->metrics->retries_deferred++;
+            }
         } else {
             int cid_set = 0;
             uint32_t cid = mcreq_get_cid(get_instance(), op->pkt, &cid_set);
@@ -280,20 +381,28 @@ void RetryQueue::flush(bool throttle)
                     "us, deadline_in=%" PRIu64 "us",
                     (void *)op->pkt, op->pkt->retries, cid, cid_set ? "set" : "unset", op->pkt->opaque, srvix,
                     LCB_NS2US(now - op->start), LCB_NS2US(op->deadline - now));
-            mc_PIPELINE *newpl = cq->pipelines[srvix];
+            /* The retry may have a shorter budget than the operation (see
+             * RetrySpec::max_duration), the resent packet must not outlive it */
+            MCREQ_PKT_RDATA(op->pkt)->deadline = op->deadline;
+            mc_PIPELINE *newpl = mcreq_queue_pipeline(cq, srvix, vbid);
             mcreq_enqueue_packet(newpl, op->pkt);
             newpl->flush_start(newpl);
             erase(op);
         }
     }
 
+    /* The held operations were due, so they still go before the rest */
+    while ((ll = lcb_list_pop(&held)) != nullptr) {
+        lcb_list_prepend(&schedops, ll);
+    }
+
     LCB_LIST_SAFE_FOR(ll, ll_next, &resched_next)
     {
         RetryOp *op = from_schednode(ll);
         lcb_list_add_sorted(&schedops, static_cast<SchedNode *>(op), cmpfn_retry);
-        lcb_list_add_sorted(&tmoops, static_cast<TmoNode *>(op), cmpfn_tmo);
     }
 
+    update_gauges(now);
     schedule(now);
 }
 
@@ -312,14 +421,64 @@ void RetryQueue::signal()
     flush(false);
 }
 
+void RetryQueue::remap(lcbvb_CONFIG *oldconfig)
+{
+    lcbvb_CONFIG *newconfig = cq->config;
+    if (empty() || LCBVB_DISTTYPE(oldconfig) != LCBVB_DIST_VBUCKET || LCBVB_DISTTYPE(newconfig) != LCBVB_DIST_VBUCKET) {
+        return;
+    }
+
+    hrtime_t now = gethrtime();
+    lcb_list_t *ll, *ll_next;
+    lcb_list_t moved;
+    unsigned nmoved = 0;
+
+    lcb_list_init(&moved);
+    LCB_LIST_SAFE_FOR(ll, ll_next, &schedops)
+    {
+        protocol_binary_request_header hdr;
+        RetryOp *op = from_schednode(ll);
+
+        mcreq_read_hdr(op->pkt, &hdr);
+        int vbid = ntohs(hdr.request.vbucket);
+        std::string newhost = vbmaster_hostport(newconfig, vbid);
+        if (newhost.empty()) {
+            continue;
+        }
+        if (op->parked) {
+            if (newhost == op->nmvhost) {
+                continue;
+            }
+            op->parked = false;
+        } else if (newhost == vbmaster_hostport(oldconfig, vbid)) {
+            continue;
+        }
+
+        op->trytime = now;
+        lcb_list_delete(static_cast<SchedNode *>(op));
+        lcb_list_append(&moved, static_cast<SchedNode *>(op));
+        nmoved++;
+    }
+
+    if (!nmoved) {
+        return;
+    }
+    LCB_LIST_SAFE_FOR(ll, ll_next, &moved)
+    {
+        lcb_list_add_sorted(&schedops, ll, cmpfn_retry);
+    }
+    lcb_log(LOGARGS(this, DEBUG), "Retrying %u operations whose vBucket master has moved", nmoved);
+    flush(true);
+}
+
 static void op_dtorfn(mc_EPKTDATUM *d)
 {
     delete static_cast<RetryOp *>(d);
 }
 
 RetryOp::RetryOp(errmap::RetrySpec *spec_)
-    : mc_EPKTDATUM(), start(0), deadline(0), trytime(0), pkt(nullptr), origerr(LCB_SUCCESS),
-      origstatus(PROTOCOL_BINARY_RESPONSE_SUCCESS), spec(spec_)
+    : mc_EPKTDATUM(), SchedNode(), TmoNode(), start(0), deadline(0), trytime(0), pkt(nullptr), origerr(LCB_SUCCESS),
+      origstatus(PROTOCOL_BINARY_RESPONSE_SUCCESS), spec(spec_), parked(false)
 {
     mc_EPKTDATUM::dtorfn = op_dtorfn;
     mc_EPKTDATUM::key = RETRY_PKT_KEY;
@@ -361,7 +520,7 @@ void RetryQueue::add(mc_EXPACKET *pkt, const lcb_STATUS err, protocol_binary_res
         /* if there is an old packet associated, we make sure that none
          * of the pipelines use it in the pending/flush queues
          */
-        for (size_t ii = 0; ii < cq->npipelines; ii++) {
+        for (size_t ii = 0; ii < MCREQ_NPIPELINES_ALL(cq); ii++) {
             sllist_iterator iter;
             auto *server = static_cast<lcb::Server *>(cq->pipelines[ii]);
             if (server == nullptr) {
@@ -402,6 +561,15 @@ void RetryQueue::add(mc_EXPACKET *pkt, const lcb_STATUS err, protocol_binary_res
                     sllist_iter_remove(&server->nbmgr.sendq.pdus, &iter);
                 }
             }
+
+            /* check packets held back from the send queue */
+            SLLIST_ITERFOR(&server->held, &iter)
+            {
+                mc_PACKET *el = SLLIST_ITEM(iter.cur, mc_PACKET, sl_flushq);
+                if (el == op->pkt) {
+                    sllist_iter_remove(&server->held, &iter);
+                }
+            }
         }
         /* by setting this flag we allow the caller to release the packet */
         op->pkt->flags |= MCREQ_F_FLUSHED;
@@ -412,7 +580,11 @@ void RetryQueue::add(mc_EXPACKET *pkt, const lcb_STATUS err, protocol_binary_res
     pkt->base.retries++;
     assign_error(op, err);
     hrtime_t now = gethrtime();
-    if (options & RETRY_SCHED_IMM) {
+    op->parked = (options & RETRY_SCHED_PARK) != 0;
+    if (op->parked) {
+        /* only released by remap(), or failed once the deadline is reached */
+        op->trytime = op->deadline;
+    } else if (options & RETRY_SCHED_IMM) {
         op->trytime = now;
     } else if (err == LCB_ERR_NOT_MY_VBUCKET) {
         op->trytime = now + LCB_US2NS(settings->retry_nmv_interval);
@@ -421,7 +593,7 @@ void RetryQueue::add(mc_EXPACKET *pkt, const lcb_STATUS err, protocol_binary_res
     }
 
     lcb_list_add_sorted(&schedops, static_cast<SchedNode *>(op), cmpfn_retry);
-    lcb_list_add_sorted(&tmoops, static_cast<TmoNode *>(op), cmpfn_tmo);
+    lcb_tw_add(&tmoops, static_cast<TmoNode *>(op), op->deadline);
 
     int cid_set = 0;
     uint32_t cid = mcreq_get_cid(get_instance(), op->pkt, &cid_set);
@@ -432,10 +604,16 @@ void RetryQueue::add(mc_EXPACKET *pkt, const lcb_STATUS err, protocol_binary_res
             LCB_NS2US(now - op->start), op->deadline > now ? "+" : "-",
             op->deadline > now ? LCB_NS2US(op->deadline - now) : LCB_NS2US(now - op->deadline), status,
             lcb_strerror_short(err));
+    TRACE_KV_RETRY(get_instance(), op->pkt, err, op->trytime > now ? op->trytime - now : 0);
+    lcb_flight_record(get_instance(), LCB_FLIGHT_PKT_RETRY, nullptr, op->pkt, err);
     schedule();
 
     if (settings->metrics) {
         settings->metrics->packets_retried++;
+        lcb_VBUCKETMETRICS *vbm = lcb_metrics_packet_vbucket(settings, op->pkt);
+        if (vbm) {
+            vbm->retries++;
+        }
     }
 }
 
@@ -462,13 +640,26 @@ bool RetryQueue::empty(bool ignore_cfgreq) const
     return false;
 }
 
-void RetryQueue::nmvadd(mc_EXPACKET *detchpkt)
+void RetryQueue::nmvadd(mc_EXPACKET *detchpkt, const lcb_host_t &origin)
 {
     int flags = 0;
-    if (settings->nmv_retry_imm) {
+    std::string nmvhost;
+    if (settings->nmv_retry_on_config) {
+        protocol_binary_request_header hdr;
+        mcreq_read_hdr(&detchpkt->base, &hdr);
+        nmvhost = origin.ipv6 ? std::string("[") + origin.host + "]:" + origin.port
+                              : std::string(origin.host) + ":" + origin.port;
+        /* The reply may have carried a configuration which already moved the
+         * vBucket, in which case there is nothing to wait for */
+        std::string curhost = vbmaster_hostport(cq->config, ntohs(hdr.request.vbucket));
+        flags = (curhost.empty() || curhost == nmvhost) ? RETRY_SCHED_PARK : RETRY_SCHED_IMM;
+    } else if (settings->nmv_retry_imm) {
         flags = RETRY_SCHED_IMM;
     }
     add(detchpkt, LCB_ERR_NOT_MY_VBUCKET, PROTOCOL_BINARY_RESPONSE_NOT_MY_VBUCKET, nullptr, flags);
+    if (flags & RETRY_SCHED_PARK) {
+        static_cast<RetryOp *>(mcreq_epkt_find(detchpkt, RETRY_PKT_KEY))->nmvhost = nmvhost;
+    }
 }
 
 void RetryQueue::ucadd(mc_EXPACKET *pkt, lcb_STATUS orig_err, protocol_binary_response_status status)
@@ -487,9 +678,17 @@ static void fallback_handler(mc_CMDQUEUE *cq, mc_PACKET *pkt)
     instance->retryq->add_fallback(pkt);
 }
 
+static void fallback_buf_done(mc_PIPELINE *pl, const void *cookie, void *, void *vbuf)
+{
+    /* the fallback copy owns its buffers, the user's ones can be released */
+    auto *instance = reinterpret_cast<lcb_INSTANCE *>(pl->parent->cqdata);
+    lcb_value_maps_release(instance, vbuf);
+    instance->callbacks.pktflushed(instance, cookie);
+}
+
 void RetryQueue::add_fallback(mc_PACKET *pkt)
 {
-    mc_PACKET *copy = mcreq_renew_packet(pkt);
+    mc_PACKET *copy = mcreq_renew_packet(nullptr, pkt);
     add((mc_EXPACKET *)copy, LCB_ERR_NO_MATCHING_SERVER, PROTOCOL_BINARY_RESPONSE_UNSPECIFIED, nullptr,
         RETRY_SCHED_IMM);
 }
@@ -502,6 +701,8 @@ void RetryQueue::reset_timeouts(lcb_U64 now)
         RetryOp *op = from_schednode(ll);
         op->deadline = now + (op->deadline - op->start);
         op->start = now;
+        lcb_tw_remove(static_cast<TmoNode *>(op));
+        lcb_tw_add(&tmoops, static_cast<TmoNode *>(op), op->deadline);
     }
 }
 
@@ -512,9 +713,10 @@ RetryQueue::RetryQueue(mc_CMDQUEUE *cq_, lcbio_pTABLE table, lcb_settings *setti
     timer = lcbio_timer_new(table, this, rq_tick);
 
     lcb_settings_ref(settings);
-    lcb_list_init(&tmoops);
+    lcb_tw_init(&tmoops, gethrtime());
     lcb_list_init(&schedops);
     mcreq_set_fallback_handler(cq, fallback_handler);
+    cq->fallback->buf_done_callback = fallback_buf_done;
 }
 
 RetryQueue::~RetryQueue()
@@ -22,8 +22,11 @@
 #include <lcbio/timer-ng.h>
 #include <mc/mcreq.h>
 #include "list.h"
+#include "timerwheel.h"
 
 #ifdef __cplusplus
+#include <string>
+#include <vector>
 
 /**
  * @file
@@ -84,9 +87,15 @@ class RetryQueue
      * this is provided to allow for different behavior when handling these types
      * of responses.
      *
+     * If settings->nmv_retry_on_config is set, and the current configuration
+     * still maps the vBucket to the node which rejected the packet, the packet
+     * is parked until remap() sees a configuration which moves the vBucket to
+     * another node (or until it times out).
+     *
      * @param detchpkt The new packet
+     * @param origin The node which replied with NOT_MY_VBUCKET
      */
-    void nmvadd(mc_EXPACKET *detchpkt);
+    void nmvadd(mc_EXPACKET *detchpkt, const lcb_host_t &origin);
     void ucadd(mc_EXPACKET *pkt, lcb_STATUS orig_err, protocol_binary_response_status status);
     void config_only_add(mc_EXPACKET *pkt);
 
@@ -100,6 +109,19 @@ class RetryQueue
      */
     void signal();
 
+    /**
+     * @brief Retry operations whose vBucket master was moved by a new configuration
+     *
+     * Operations whose vBucket is still served by the same node keep their
+     * schedule, so that only the operations affected by the change are sent
+     * before their next attempt. Operations parked by nmvadd() are released
+     * once their vBucket is served by a node other than the one which
+     * rejected them.
+     *
+     * @param oldconfig the configuration which was replaced by `cq->config`
+     */
+    void remap(lcbvb_CONFIG *oldconfig);
+
     /**
      * If this packet has been previously retried, this obtains the original error
      * which caused it to be enqueued in the first place. This eliminates spurious
@@ -149,19 +171,32 @@ class RetryQueue
     void schedule(hrtime_t now = 0);
     void flush(bool throttle);
     void update_trytime(RetryOp *op, hrtime_t now = 0);
+    bool take_budget(unsigned srvix, hrtime_t now, hrtime_t *refill);
+    void update_gauges(hrtime_t now);
     hrtime_t get_retry_interval() const;
+    std::string vbmaster_hostport(lcbvb_CONFIG *config, int vbid) const;
     lcb_INSTANCE *get_instance() const
     {
         return reinterpret_cast<lcb_INSTANCE *>(cq->cqdata);
     }
 
-    enum AddOptions { RETRY_SCHED_IMM = 0x01 };
+    enum AddOptions { RETRY_SCHED_IMM = 0x01, RETRY_SCHED_PARK = 0x02 };
     void add(mc_EXPACKET *pkt, lcb_STATUS, protocol_binary_response_status, errmap::RetrySpec *, int options);
 
     /** List of operations in retry ordering. Sorted by 'crtime' */
     lcb_list_t schedops{};
-    /** List of operations in timeout ordering. Ordered by 'start_time' */
-    lcb_list_t tmoops{};
+    /** Operations by deadline */
+    lcb_TIMERWHEEL tmoops{};
+
+    /** Retries sent to a pipeline within the current retry_interval */
+    struct Budget {
+        hrtime_t start{0};
+        uint32_t used{0};
+    };
+    /** Indexed by pipeline, only used if settings->retry_budget is set */
+    std::vector<Budget> budgets;
+    /** Earliest refill of a budget which held back operations in the last flush */
+    hrtime_t held_until{0};
     /** Parent command queue */
     mc_CMDQUEUE *cq;
     lcb_settings *settings;
@@ -21,6 +21,7 @@
 #include <libcouchbase/couchbase.h>
 #include "internal.h"
 #include "http/http.h"
+#include "http/http-priv.h"
 #include "defer.h"
 
 #include "search/search_handle.hh"
@@ -87,3 +88,25 @@ LIBCOUCHBASE_API lcb_STATUS lcb_search_cancel(lcb_INSTANCE * /* instance */, lcb
     }
     return LCB_SUCCESS;
 }
+
+LIBCOUCHBASE_API lcb_STATUS lcb_search_pause(lcb_INSTANCE * /* instance */, lcb_SEARCH_HANDLE *handle)
+{
+    if (handle == nullptr || handle->is_cancelled()) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    if (handle->http_request() != nullptr) {
+        handle->http_request()->pause();
+    }
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_search_resume(lcb_INSTANCE * /* instance */, lcb_SEARCH_HANDLE *handle)
+{
+    if (handle == nullptr || handle->is_cancelled()) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    if (handle->http_request() != nullptr) {
+        handle->http_request()->resume();
+    }
+    return LCB_SUCCESS;
+}
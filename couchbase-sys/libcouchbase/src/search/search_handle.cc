@@ -144,7 +144,7 @@ void lcb_SEARCH_HANDLE_::invoke_last()
 
 lcb_SEARCH_HANDLE_::lcb_SEARCH_HANDLE_(lcb_INSTANCE *instance, void *cookie, const lcb_CMDSEARCH *cmd)
     : lcb::jsparse::Parser::Actions(), parser_(new lcb::jsparse::Parser(lcb::jsparse::Parser::MODE_FTS, this)),
-      cookie_(cookie), callback_(cmd->callback()), instance_(instance)
+      cookie_(cookie), callback_(cmd->callback()), instance_(instance), projection_(cmd->projection())
 {
     std::string content_type("application/json");
 
@@ -43,6 +43,10 @@ struct lcb_SEARCH_HANDLE_ : lcb::jsparse::Parser::Actions {
         lcb_RESPSEARCH resp{};
         resp.row = static_cast<const char *>(datum.row.iov_base);
         resp.nrow = datum.row.iov_len;
+        if (!projection_.empty() && projection_.project(resp.row, resp.nrow, projected_row_)) {
+            resp.row = projected_row_.c_str();
+            resp.nrow = projected_row_.size();
+        }
         rows_number_++;
         invoke_row(&resp);
     }
@@ -81,6 +85,11 @@ struct lcb_SEARCH_HANDLE_ : lcb::jsparse::Parser::Actions {
         callback_ = nullptr;
     }
 
+    lcb_HTTP_HANDLE_ *http_request() const
+    {
+        return http_request_;
+    }
+
     void clear_http_request()
     {
         http_request_ = nullptr;
@@ -153,6 +162,8 @@ struct lcb_SEARCH_HANDLE_ : lcb::jsparse::Parser::Actions {
     lcbtrace_SPAN *span_{nullptr};
     std::string index_name_;
     std::string error_message_;
+    lcb::jsparse::Projection projection_{};
+    std::string projected_row_{};
     std::string client_context_id_{};
     int retries_{0};
 };
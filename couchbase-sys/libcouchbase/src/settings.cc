@@ -16,6 +16,7 @@
  */
 
 #include "settings.h"
+#include "mc/compress.h"
 #include <lcbio/ssl.h>
 #include <rdb/rope.h>
 
@@ -59,15 +60,33 @@ void lcb_default_settings(lcb_settings *settings)
     settings->nmv_retry_imm = LCB_DEFAULT_NVM_RETRY_IMM;
     settings->tcp_nodelay = LCB_DEFAULT_TCP_NODELAY;
     settings->retry_nmv_interval = LCB_DEFAULT_RETRY_NMV_INTERVAL;
+    settings->retry_budget = 0;
+    settings->bootstrap_parallelism = 1;
+    settings->n1ql_pool_target = 0;
+    settings->fts_pool_target = 0;
+    settings->cbas_pool_target = 0;
+    settings->dns_cache_ttl = LCB_DEFAULT_DNS_CACHE_TTL;
+    settings->connect_attempt_delay = LCB_DEFAULT_CONNECT_ATTEMPT_DELAY;
+    settings->kv_connections_per_node = LCB_DEFAULT_KV_CONNECTIONS_PER_NODE;
+    settings->large_value_threshold = LCB_DEFAULT_LARGE_VALUE_THRESHOLD;
+    settings->near_cache_ttl = LCB_DEFAULT_NEAR_CACHE_TTL;
+    settings->kv_inflight_low_watermark = LCB_DEFAULT_KV_INFLIGHT_LOW_WATERMARK;
+    settings->circuit_breaker_error_threshold = LCB_DEFAULT_CIRCUIT_BREAKER_ERROR_THRESHOLD;
+    settings->circuit_breaker_volume_threshold = LCB_DEFAULT_CIRCUIT_BREAKER_VOLUME_THRESHOLD;
+    settings->circuit_breaker_sleep_window = LCB_DEFAULT_CIRCUIT_BREAKER_SLEEP_WINDOW;
+    settings->circuit_breaker_rolling_window = LCB_DEFAULT_CIRCUIT_BREAKER_ROLLING_WINDOW;
+    settings->flight_recorder_size = LCB_DEFAULT_FLIGHT_RECORDER_SIZE;
     settings->vb_noguess = LCB_DEFAULT_VB_NOGUESS;
     settings->vb_noremap = LCB_DEFAULT_VB_NOREMAP;
     settings->select_bucket = LCB_DEFAULT_SELECT_BUCKET;
     settings->tcp_keepalive = LCB_DEFAULT_TCP_KEEPALIVE;
     settings->config_poll_interval = LCB_DEFAULT_CONFIG_POLL_INTERVAL;
+    settings->config_poll_max_interval = 0;
     settings->use_collections = 1;
     settings->log_redaction = 0;
     settings->use_tracing = 1;
     settings->network = nullptr;
+    settings->preferred_server_group = nullptr;
     settings->allow_static_config = 0;
     settings->tracer_orphaned_queue_flush_interval = LCBTRACE_DEFAULT_ORPHANED_QUEUE_FLUSH_INTERVAL;
     settings->tracer_orphaned_queue_size = LCBTRACE_DEFAULT_ORPHANED_QUEUE_SIZE;
@@ -78,6 +97,10 @@ void lcb_default_settings(lcb_settings *settings)
     settings->tracer_threshold[LCBTRACE_THRESHOLD_VIEW] = LCBTRACE_DEFAULT_THRESHOLD_VIEW;
     settings->tracer_threshold[LCBTRACE_THRESHOLD_SEARCH] = LCBTRACE_DEFAULT_THRESHOLD_FTS;
     settings->tracer_threshold[LCBTRACE_THRESHOLD_ANALYTICS] = LCBTRACE_DEFAULT_THRESHOLD_ANALYTICS;
+    settings->tracer_sample_rate = (float)LCBTRACE_DEFAULT_SAMPLE_RATE;
+    settings->tracer_export_queue_size = LCBTRACE_DEFAULT_EXPORT_QUEUE_SIZE;
+    settings->tracer_export_batch_size = LCBTRACE_DEFAULT_EXPORT_BATCH_SIZE;
+    settings->tracer_export_interval = LCBTRACE_DEFAULT_EXPORT_INTERVAL;
     settings->wait_for_config = 0;
     settings->enable_durable_write = 0;
     settings->retry_strategy = lcb_retry_strategy_best_effort;
@@ -85,6 +108,19 @@ void lcb_default_settings(lcb_settings *settings)
     settings->use_errmap = 1;
     settings->op_metrics_flush_interval = LCB_DEFAULT_OP_METRICS_FLUSH_INTERVAL;
     settings->op_metrics_enabled = 1;
+    settings->flush_coalesce = 0;
+    settings->flush_coalesce_delay = LCB_DEFAULT_FLUSH_COALESCE_DELAY;
+    settings->flush_coalesce_bytes = LCB_DEFAULT_FLUSH_COALESCE_BYTES;
+    settings->io_batch_writes = 0;
+    settings->kernel_io_stats = 0;
+    settings->collections_manifest = 0;
+    settings->compress_adaptive = 0;
+    settings->ssl_session_cache = 1;
+    settings->nmv_retry_on_config = 0;
+    settings->http_compression = 0;
+    settings->hot_keys = 0;
+    settings->idle_trim_interval = 0;
+    settings->write_coalesce_window = 0;
 }
 
 LCB_INTERNAL_API
@@ -111,9 +147,15 @@ void lcb_settings_unref(lcb_settings *settings)
     free(settings->keypath);
     free(settings->client_string);
     free(settings->network);
+    free(settings->preferred_server_group);
+    free(settings->srv_name);
+    free(settings->tuning_profile);
 
     lcbauth_unref(settings->auth);
     lcb_errmap_free(settings->errmap);
+    if (settings->read_pool) {
+        settings->read_pool->a_release(settings->read_pool);
+    }
 
     if (settings->ssl_ctx) {
         lcbio_ssl_free(settings->ssl_ctx);
@@ -124,6 +166,7 @@ void lcb_settings_unref(lcb_settings *settings)
     if (settings->meter) {
         lcbmetrics_meter_destroy(settings->meter);
     }
+    mcreq_compress_policy_destroy(settings->compress_policy);
     if (settings->dtorcb) {
         settings->dtorcb(settings->dtorarg);
     }
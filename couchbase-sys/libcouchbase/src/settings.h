@@ -109,14 +109,46 @@
 #define LCBTRACE_DEFAULT_THRESHOLD_VIEW LCB_MS2US(1000)
 #define LCBTRACE_DEFAULT_THRESHOLD_FTS LCB_MS2US(1000)
 #define LCBTRACE_DEFAULT_THRESHOLD_ANALYTICS LCB_MS2US(1000)
+#define LCBTRACE_DEFAULT_SAMPLE_RATE 1.0
+#define LCBTRACE_DEFAULT_EXPORT_QUEUE_SIZE 2048
+#define LCBTRACE_DEFAULT_EXPORT_BATCH_SIZE 512
+#define LCBTRACE_DEFAULT_EXPORT_INTERVAL LCB_MS2US(5000)
 
 #define LCB_DEFAULT_OP_METRICS_FLUSH_INTERVAL LCB_MS2US(600000)
 
+#define LCB_DEFAULT_FLUSH_COALESCE_DELAY 0
+#define LCB_DEFAULT_FLUSH_COALESCE_BYTES 65536
+
 #define LCB_DEFAULT_PERSISTENCE_TIMEOUT_FLOOR 1500000
 
 /* 1 second */
 #define LCB_DEFAULT_HTTP_POOL_TIMEOUT LCB_MS2US(1000)
 
+/* 10 seconds */
+#define LCB_DEFAULT_DNS_CACHE_TTL LCB_MS2US(10000)
+#define LCB_DEFAULT_CONNECT_ATTEMPT_DELAY LCB_MS2US(250)
+
+#define LCB_DEFAULT_KV_CONNECTIONS_PER_NODE 1
+#define LCB_MAX_KV_CONNECTIONS_PER_NODE 16
+
+/* 1 megabyte */
+#define LCB_DEFAULT_LARGE_VALUE_THRESHOLD 1048576
+
+/* 1 second */
+#define LCB_DEFAULT_NEAR_CACHE_TTL LCB_MS2US(1000)
+
+/* Percentage of the in-flight limits, see LCB_CNTL_KV_INFLIGHT_LOW_WATERMARK */
+#define LCB_DEFAULT_KV_INFLIGHT_LOW_WATERMARK 50
+
+/* See LCB_CNTL_CIRCUIT_BREAKER */
+#define LCB_DEFAULT_CIRCUIT_BREAKER_ERROR_THRESHOLD 50
+#define LCB_DEFAULT_CIRCUIT_BREAKER_VOLUME_THRESHOLD 20
+#define LCB_DEFAULT_CIRCUIT_BREAKER_SLEEP_WINDOW LCB_MS2US(5000)
+#define LCB_DEFAULT_CIRCUIT_BREAKER_ROLLING_WINDOW LCB_MS2US(60000)
+
+/* Number of events, see LCB_CNTL_FLIGHT_RECORDER_SIZE */
+#define LCB_DEFAULT_FLIGHT_RECORDER_SIZE 4096
+
 #include "config.h"
 #include <libcouchbase/couchbase.h>
 #include <libcouchbase/metrics.h>
@@ -131,6 +163,7 @@ extern "C" {
 struct lcbio_SSLCTX;
 struct rdb_ALLOCATOR;
 struct lcb_METRICS_st;
+struct lcbio_RESOLVER_st;
 
 /**
  * Stateless setting structure.
@@ -169,6 +202,8 @@ typedef struct lcb_settings_st {
 
     /** Time to wait in between background config polls. 0 disables this */
     lcb_U32 config_poll_interval;
+    /** Longest interval the background polls back off to, fixed interval if not above config_poll_interval */
+    lcb_U32 config_poll_max_interval;
 
     unsigned bc_http_urltype : 4;
 
@@ -177,6 +212,9 @@ typedef struct lcb_settings_st {
     /** Whether lcb_destroy is synchronous. This mode will run the I/O event
      * loop as much as possible until no outstanding events remain.*/
     unsigned syncdtor : 1;
+    /** Whether lcb_destroy cancels the pending commands and resets the
+     * connections instead of draining them */
+    unsigned fastdtor : 1;
     unsigned detailed_neterr : 1;
     unsigned randomize_bootstrap_nodes : 1;
     unsigned conntype : 1;
@@ -212,6 +250,8 @@ typedef struct lcb_settings_st {
 
     char *bucket;
     char *sasl_mech_force;
+    /** Mechanism of the last successful SASL negotiation, tried before the server lists them */
+    char sasl_mech_last[32];
     char *truststorepath;
     char *certpath;
     char *keypath;
@@ -224,6 +264,12 @@ typedef struct lcb_settings_st {
     char *client_string;
     lcb_pERRMAP errmap;
     lcb_U32 retry_nmv_interval;
+    /** Retried operations per node and retry_interval, 0 for no limit */
+    lcb_U32 retry_budget;
+    /** Idle connections to keep open to every query (and search, analytics) node */
+    lcb_U32 n1ql_pool_target;
+    lcb_U32 fts_pool_target;
+    lcb_U32 cbas_pool_target;
     struct lcb_METRICS_st *metrics;
     const lcbmetrics_METER *meter;
     lcbtrace_TRACER *tracer;
@@ -232,11 +278,111 @@ typedef struct lcb_settings_st {
     lcb_U32 tracer_threshold_queue_flush_interval;
     lcb_U32 tracer_threshold_queue_size;
     lcb_U32 tracer_threshold[LCBTRACE_THRESHOLD__MAX];
+    /** Fraction of operations which are traced, unless the caller passed a parent span */
+    float tracer_sample_rate;
+    lcb_U32 tracer_export_queue_size;
+    lcb_U32 tracer_export_batch_size;
+    lcb_U32 tracer_export_interval;
     lcb_U32 compress_min_size;
     float compress_min_ratio;
     char *network; /** network resolution, AKA "Multi Network Configurations" */
     lcb_U32 op_metrics_flush_interval;
     unsigned op_metrics_enabled : 1;
+    /** Maximum number of idle read buffer bytes shared by all sockets, 0 if not shared */
+    lcb_U32 read_pool_size;
+    /** Allocator shared by all sockets if read_pool_size is set */
+    struct rdb_ALLOCATOR *read_pool;
+    /** Defer implicit flushes to the end of the current event loop iteration */
+    unsigned flush_coalesce : 1;
+    /** How long a deferred flush may wait, in microseconds */
+    lcb_U32 flush_coalesce_delay;
+    /** Number of deferred bytes which are flushed right away */
+    lcb_U32 flush_coalesce_bytes;
+    /** How long lcb_wait() polls the event loop before blocking, in microseconds */
+    lcb_U32 wait_spin;
+    /** Write to sockets at the end of the loop iteration instead of waiting for them to become writable */
+    unsigned io_batch_writes : 1;
+    /** Timestamp the data of the KV sockets in the kernel, see LCB_CNTL_KERNEL_IO_STATS */
+    unsigned kernel_io_stats : 1;
+    /** Resolve collection IDs by loading the whole manifest instead of one GET_CID per collection */
+    unsigned collections_manifest : 1;
+    /** Stop compressing classes of values which keep missing compress_min_ratio */
+    unsigned compress_adaptive : 1;
+    /** Offer the TLS session of the previous connection to the same endpoint */
+    unsigned ssl_session_cache : 1;
+    /** Park not-my-vbucket retries until a configuration moves their vBucket */
+    unsigned nmv_retry_on_config : 1;
+    /** Ask for compressed responses to query, search and analytics requests */
+    unsigned http_compression : 1;
+    /** Per-class compression statistics, allocated on first use of compress_adaptive */
+    struct lcb_COMPRESSPOLICY_st *compress_policy;
+    /** Interval of the probes of idle data connections in microseconds, 0 if disabled */
+    lcb_U32 health_probe_interval;
+    /** Interval of the idle trims in microseconds, 0 if disabled */
+    lcb_U32 idle_trim_interval;
+    /** Microseconds coalesced upserts are held back for, see lcb_cmdstore_coalesce() */
+    lcb_U32 write_coalesce_window;
+    /** Lifetime of resolved addresses in microseconds, 0 to resolve every connection */
+    lcb_U32 dns_cache_ttl;
+    /** Hostname resolver of the instance, see lcbio/resolve.h */
+    struct lcbio_RESOLVER_st *resolver;
+    /** Delay before racing the next address of a connection in microseconds, 0 to try them in turn */
+    lcb_U32 connect_attempt_delay;
+    /** Number of data connections to each node, see mc_CMDQUEUE::groupsize */
+    lcb_U32 kv_connections_per_node;
+    /** Size from which packets let smaller ones go first, 0 to send in order, see mc_PIPELINE::large_threshold */
+    lcb_U32 large_value_threshold;
+    /** Name of the DNS SRV records the bootstrap hosts came from, or NULL */
+    char *srv_name;
+    /** Upper bound for the data block size of the pipelines, 0 for the default, see netbuf_set_maxalloc() */
+    lcb_U32 netbuf_block_max;
+    /** Name of the last tuning profile applied, or NULL */
+    char *tuning_profile;
+    /** Number of documents kept by the near cache, 0 if disabled, see lcb_cmdget_near_cache() */
+    lcb_U32 near_cache_size;
+    /** How long the near cache serves a value in microseconds, 0 until it is evicted */
+    lcb_U32 near_cache_ttl;
+    /** Let gets of a key wait for the reply of an earlier get in flight, see LCB_CNTL_GET_COALESCE */
+    unsigned get_coalesce : 1;
+    /** Number of missing keys the near cache remembers, 0 if disabled, see LCB_CNTL_NEGATIVE_CACHE_SIZE */
+    lcb_U32 negative_cache_size;
+    /** Microseconds a touch to the same expiry is skipped for, see LCB_CNTL_TOUCH_SKIP_WINDOW */
+    lcb_U32 touch_skip_window;
+    /** Server group to prefer for replica reads and services, see LCB_CNTL_PREFERRED_SERVER_GROUP */
+    char *preferred_server_group;
+    /** Bytes of KV operations in flight on all connections, 0 for no limit, see lcb_kv_overloaded() */
+    lcb_SIZE kv_inflight_bytes_max;
+    /** Number of KV operations in flight on all connections, 0 for no limit */
+    lcb_U32 kv_inflight_ops_max;
+    /** Bytes of KV operations in flight on each connection, 0 for no limit */
+    lcb_SIZE kv_pipeline_inflight_bytes_max;
+    /** Number of KV operations in flight on each connection, 0 for no limit */
+    lcb_U32 kv_pipeline_inflight_ops_max;
+    /** Percentage of the limits above under which the overload callback is notified again */
+    lcb_U32 kv_inflight_low_watermark;
+    /** Fail requests to endpoints which keep failing, see lcb::CircuitBreaker */
+    unsigned circuit_breaker : 1;
+    /** Percentage of failed requests which opens a circuit breaker */
+    lcb_U32 circuit_breaker_error_threshold;
+    /** Number of requests within the rolling window before a circuit breaker may open */
+    lcb_U32 circuit_breaker_volume_threshold;
+    /** Microseconds an open circuit breaker rejects all requests */
+    lcb_U32 circuit_breaker_sleep_window;
+    /** Microseconds over which a circuit breaker counts the failed requests */
+    lcb_U32 circuit_breaker_rolling_window;
+    /** Number of events kept by the flight recorder, 0 to disable it */
+    lcb_U32 flight_recorder_size;
+    /** Number of hot keys and vBuckets reported, 0 to disable the tracker */
+    lcb_U32 hot_keys;
+    /** Microseconds a data connection with pending operations may read nothing before being probed, 0 if disabled */
+    lcb_U32 kv_idle_timeout;
+    /** TCP_USER_TIMEOUT of the sockets in microseconds, 0 for the system default */
+    lcb_U32 tcp_user_timeout;
+    /** Number of nodes the CCCP provider asks for the first configuration at once */
+    lcb_U32 bootstrap_parallelism;
+    /** Time cached by lcb_settings_now_hold(), valid while now_holds is set */
+    hrtime_t now_cached;
+    unsigned now_holds;
 } lcb_settings;
 
 LCB_INTERNAL_API
@@ -251,6 +397,29 @@ void lcb_settings_unref(lcb_settings *);
 #define lcb_settings_ref(settings) ((void)(settings)->refcount++)
 #define lcb_settings_ref2(settings) ((settings)->refcount++, settings)
 
+/**
+ * Caches the current time until the matching lcb_settings_now_release(), so
+ * that the timestamps taken while handling a single I/O event (the responses
+ * read, their latencies) share one clock read. Calls may be nested.
+ */
+static inline void lcb_settings_now_hold(lcb_settings *settings)
+{
+    if (settings->now_holds++ == 0) {
+        settings->now_cached = gethrtime();
+    }
+}
+
+static inline void lcb_settings_now_release(lcb_settings *settings)
+{
+    settings->now_holds--;
+}
+
+/** @return the time cached by lcb_settings_now_hold(), or else the current time */
+static inline hrtime_t lcb_settings_now(const lcb_settings *settings)
+{
+    return settings->now_holds ? settings->now_cached : gethrtime();
+}
+
 /**
  * Metric functionality. Defined in metrics.h, but retains a global-like
  * setting similar to lcb_settings
@@ -265,6 +434,9 @@ void lcb_metrics_destroy(lcb_METRICS *metrics);
 
 lcb_SERVERMETRICS *lcb_metrics_getserver(lcb_METRICS *metrics, const char *host, const char *port, int create);
 
+/** @return the counters of the vBucket, NULL if its ID is too large to be counted */
+lcb_VBUCKETMETRICS *lcb_metrics_getvbucket(lcb_METRICS *metrics, unsigned vbid);
+
 void lcb_metrics_reset_pipeline_gauges(lcb_SERVERMETRICS *metrics);
 
 #ifdef __cplusplus
@@ -155,6 +155,13 @@ void iotssl_init_common(lcbio_XSSL *xs, lcbio_TABLE *orig, SSL_CTX *sctx)
 void iotssl_destroy_common(lcbio_XSSL *xs)
 {
     free(xs->iops_dummy_);
+    if (SSL_is_init_finished(xs->ssl)) {
+        /* We never send close_notify. Without this, SSL_free() would consider
+         * the connection broken and mark its session as not resumable. Sessions
+         * of connections which failed with a fatal alert have already been
+         * invalidated by OpenSSL itself */
+        SSL_set_shutdown(xs->ssl, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+    }
     SSL_free(xs->ssl);
     lcbio_table_unref(xs->orig);
 }
@@ -267,8 +274,8 @@ static void log_callback(const SSL *ssl, int where, int ret)
             where, SSL_state_string_long(ssl), ret, SSL_alert_type_string_long(ret), SSL_alert_desc_string_long(ret));
 
     if (where == SSL_CB_HANDSHAKE_DONE) {
-        lcb_log(LOGARGS(ssl, LCB_LOG_DEBUG), "sock=%p. Using SSL version %s. Cipher=%s", (void *)sock,
-                SSL_get_version(ssl), SSL_get_cipher_name(ssl));
+        lcb_log(LOGARGS(ssl, LCB_LOG_DEBUG), "sock=%p. Using SSL version %s. Cipher=%s. Resumed=%s", (void *)sock,
+                SSL_get_version(ssl), SSL_get_cipher_name(ssl), SSL_session_reused((SSL *)ssl) ? "yes" : "no");
     }
 }
 
@@ -298,12 +305,93 @@ msg_callback(int write_p, int version, int ctype, const void *buf, size_t n,
 }
 #endif
 
+/** Number of endpoints whose last session is remembered by a context */
+#define LCBIO_SSL_SESSIONS 32
+
+typedef struct {
+    lcb_host_t host;
+    SSL_SESSION *session;
+    /** Value of lcbio_SSLCTX::clock when the entry was last stored or offered */
+    unsigned long used;
+} lcbio_SSLSESSION;
+
 struct lcbio_SSLCTX {
     SSL_CTX *ctx;
+    /** Client-side session cache, keyed by the remote endpoint of the socket */
+    lcbio_SSLSESSION sessions[LCBIO_SSL_SESSIONS];
+    unsigned long clock;
 };
 
 #define LOGARGS_S(settings, lvl) settings, "SSL", lvl, __FILE__, __LINE__
 
+static lcbio_SSLSESSION *find_session(lcbio_pSSLCTX sctx, const lcb_host_t *host)
+{
+    unsigned ii;
+    for (ii = 0; ii < LCBIO_SSL_SESSIONS; ii++) {
+        lcbio_SSLSESSION *ent = sctx->sessions + ii;
+        if (ent->session && lcb_host_equals(&ent->host, host)) {
+            return ent;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Called by OpenSSL for every session (or TLS 1.3 ticket) the server hands
+ * out. The newest one replaces whatever was stored for the endpoint, and the
+ * least recently used entry makes room for endpoints not seen before.
+ */
+static int new_session_callback(SSL *ssl, SSL_SESSION *session)
+{
+    lcbio_SOCKET *sock = SSL_get_app_data(ssl);
+    lcbio_pSSLCTX sctx = SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl));
+    lcbio_SSLSESSION *ent;
+    unsigned ii;
+
+    if (sock == NULL || sock->info == NULL || sctx == NULL || !sock->settings->ssl_session_cache) {
+        return 0;
+    }
+#if OPENSSL_VERSION_NUMBER >= 0x1010100fL
+    if (!SSL_SESSION_is_resumable(session)) {
+        return 0;
+    }
+#endif
+
+    ent = find_session(sctx, &sock->info->ep_remote);
+    if (ent == NULL) {
+        ent = sctx->sessions;
+        for (ii = 1; ii < LCBIO_SSL_SESSIONS && ent->session; ii++) {
+            if (sctx->sessions[ii].session == NULL || sctx->sessions[ii].used < ent->used) {
+                ent = sctx->sessions + ii;
+            }
+        }
+        ent->host = sock->info->ep_remote;
+    }
+    if (ent->session) {
+        SSL_SESSION_free(ent->session);
+    }
+    /* returning 1 keeps the reference OpenSSL passed to us */
+    ent->session = session;
+    ent->used = ++sctx->clock;
+    return 1;
+}
+
+/** Offer the remembered session of the socket's endpoint, if there is one */
+static void resume_session(lcbio_pSSLCTX sctx, lcbio_SOCKET *sock, SSL *ssl)
+{
+    lcbio_SSLSESSION *ent;
+    if (!sock->settings->ssl_session_cache || sock->info == NULL) {
+        return;
+    }
+    ent = find_session(sctx, &sock->info->ep_remote);
+    if (ent == NULL) {
+        return;
+    }
+    if (SSL_set_session(ssl, ent->session) == 1) {
+        ent->used = ++sctx->clock;
+    }
+}
+
 static long decode_ssl_protocol(const char *protocol)
 {
     long disallow = SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3;
@@ -494,6 +582,11 @@ lcbio_pSSLCTX lcbio_ssl_new(const char *tsfile, const char *cafile, const char *
      */
     SSL_CTX_set_mode(ret->ctx, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
     SSL_CTX_set_options(ret->ctx, decode_ssl_protocol(minimum_tls));
+
+    /* Sessions are stored by endpoint in our own table, see new_session_callback() */
+    SSL_CTX_set_app_data(ret->ctx, ret);
+    SSL_CTX_set_session_cache_mode(ret->ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(ret->ctx, new_session_callback);
     return ret;
 
 GT_ERR:
@@ -543,6 +636,7 @@ lcb_STATUS lcbio_ssl_apply(lcbio_SOCKET *sock, lcbio_pSSLCTX sctx)
         /* just for logging */
         sproto->ssl = ((lcbio_XSSL *)new_iot)->ssl;
         SSL_set_app_data(((lcbio_XSSL *)new_iot)->ssl, sock);
+        resume_session(sctx, sock, ((lcbio_XSSL *)new_iot)->ssl);
         return LCB_SUCCESS;
 
     } else {
@@ -561,8 +655,37 @@ lcb_STATUS lcbio_ssl_get_error(lcbio_SOCKET *sock)
     return xs->errcode;
 }
 
+int lcbio_ssl_resumed(lcbio_SOCKET *sock)
+{
+    if (!lcbio_ssl_check(sock)) {
+        return 0;
+    }
+    return SSL_session_reused(((lcbio_XSSL *)sock->io)->ssl);
+}
+
+lcbio_pSSLCTX lcbio_ssl_share(lcbio_pSSLCTX ctx)
+{
+    lcbio_pSSLCTX ret = calloc(1, sizeof(*ret));
+    if (!ret) {
+        return NULL;
+    }
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+    SSL_CTX_up_ref(ctx->ctx);
+#else
+    CRYPTO_add(&ctx->ctx->references, 1, CRYPTO_LOCK_SSL_CTX);
+#endif
+    ret->ctx = ctx->ctx;
+    return ret;
+}
+
 void lcbio_ssl_free(lcbio_pSSLCTX ctx)
 {
+    unsigned ii;
+    for (ii = 0; ii < LCBIO_SSL_SESSIONS; ii++) {
+        if (ctx->sessions[ii].session) {
+            SSL_SESSION_free(ctx->sessions[ii].session);
+        }
+    }
     SSL_CTX_free(ctx->ctx);
     free(ctx);
 }
@@ -17,6 +17,8 @@
 
 #include "ssl_iot_common.h"
 #include <openssl/err.h>
+#include <limits.h>
+#include <string.h>
 /**
  * Event-Style SSL Wrapping.
  *
@@ -28,8 +30,21 @@
  *
  * - SSL_want_read() is true
  * - The wbio is not empty
+ *
+ * The SSL object is connected to the network through a BIO pair, whose
+ * buffers are exposed by BIO_nwrite0() and BIO_nread0(). Encrypted data is
+ * received straight into, and sent straight out of, those buffers. Decrypted
+ * data is read into all the buffers passed to recvv by one call, and the
+ * buffers passed to sendv are encrypted one by one, except small ones which
+ * are gathered into a single record.
  */
 
+/** Size of each of the two buffers of the BIO pair */
+#define ESSL_BIO_SIZE (64 * 1024)
+
+/** Buffers smaller than this are copied together into one TLS record */
+#define ESSL_GATHER_MAX 1024
+
 typedef struct {
     IOTSSL_COMMON_FIELDS
     void *event;          /**< Event pointer (parent->create_event) */
@@ -53,7 +68,6 @@ typedef struct {
 #endif
 
 #define ES_FROM_IOPS(iops) (lcbio_ESSL *)(IOTSSL_FROM_IOPS(iops))
-#define MINIMUM(a, b) a < b ? a : b
 
 static int maybe_error(lcbio_ESSL *es, int rv)
 {
@@ -83,7 +97,11 @@ static void schedule_pending(lcbio_ESSL *es)
         avail |= LCB_READ_EVENT;
     }
 
-    if (SSL_want_read(es->ssl)) {
+    if (BIO_ctrl_get_write_guarantee(es->rbio) == 0) {
+        /* the BIO is full of records waiting for SSL_read(). There is no point
+         * in watching the socket until they have been read */
+        avail |= LCB_READ_EVENT;
+    } else if (SSL_want_read(es->ssl)) {
         /* SSL need data from the network */
         wanted |= LCB_READ_EVENT;
     }
@@ -114,37 +132,22 @@ static void schedule_pending(lcbio_ESSL *es)
 /* Reads encrypted data from the socket into SSL */
 static int read_ssl_data(lcbio_ESSL *es)
 {
-    int nr, total = 0;
+    int total = 0;
     lcbio_pTABLE iot = es->orig;
 
-#if LCB_CAN_OPTIMIZE_SSL_BIO
-    BUF_MEM *rmb;
-
-    /* This block is an optimization over BIO_write to avoid copying the memory
-     * to a temporary buffer and _then_ copying it into the BIO */
-
-    BIO_get_mem_ptr(es->rbio, &rmb);
-#endif
-
     while (1) {
-#if LCB_CAN_OPTIMIZE_SSL_BIO
-        /* I don't know why this is here, but it's found inside BIO_write */
-        BIO_clear_retry_flags(es->rbio);
-        iotssl_bm_reserve(rmb);
-        nr = IOT_V0IO(iot).recv(IOT_ARG(iot), es->fd, rmb->data + rmb->length, rmb->max - rmb->length, 0);
-#else
-#define BUFSZ 4096
-        char buf[BUFSZ];
-        nr = IOT_V0IO(iot).recv(IOT_ARG(iot), es->fd, buf, BUFSZ, 0);
-#endif
+        char *buf;
+        lcb_ssize_t nr;
+        int navail = BIO_nwrite0(es->rbio, &buf);
+        if (navail <= 0) {
+            /* The BIO is full. The socket is read again once SSL_read() has
+             * made room, see schedule_pending() */
+            return 0;
+        }
 
+        nr = IOT_V0IO(iot).recv(IOT_ARG(iot), es->fd, buf, navail, 0);
         if (nr > 0) {
-#if LCB_CAN_OPTIMIZE_SSL_BIO
-            /* Extend the BIO used length */
-            rmb->length += nr;
-#else
-            BIO_write(es->rbio, buf, nr);
-#endif
+            BIO_nwrite(es->rbio, &buf, (int)nr);
             total += nr;
         } else if (nr == 0) {
             es->closed = 1;
@@ -167,31 +170,21 @@ static int read_ssl_data(lcbio_ESSL *es)
 /* Writes encrypted data from SSL over to the network */
 static int flush_ssl_data(lcbio_ESSL *es)
 {
-    BUF_MEM *wmb;
-    char *tmp_p;
-    int tmp_len, nw;
     lcbio_pTABLE iot = es->orig;
 
-    BIO_get_mem_ptr(es->wbio, &wmb);
-    tmp_p = wmb->data;
-    tmp_len = wmb->length;
-
-    /* We use this block of code over BIO_read() as we have no guarantee that
-     * we'll be able to flush all the bytes received from BIO_read(), and
-     * BIO has no way to "put back" some bytes. Thus this block is not an
-     * optimization but a necessity.
-     *
-     * tmp_len is the number of bytes originally inside the BUF_MEM structure.
-     * It is decremented each time we write data from the network.
-     *
-     * The loop here terminates until we get a WOULDBLOCK from the socket or we
-     * have no more data left to write.
-     */
-    while (tmp_len) {
-        nw = IOT_V0IO(iot).send(IOT_ARG(iot), es->fd, tmp_p, tmp_len, 0);
+    /* Bytes are only removed from the BIO once the socket has accepted them,
+     * so whatever is left over is sent by the next call. */
+    while (1) {
+        char *buf;
+        lcb_ssize_t nw;
+        int npending = BIO_nread0(es->wbio, &buf);
+        if (npending <= 0) {
+            break;
+        }
+
+        nw = IOT_V0IO(iot).send(IOT_ARG(iot), es->fd, buf, npending, 0);
         if (nw > 0) {
-            tmp_len -= nw;
-            tmp_p += nw;
+            BIO_nread(es->wbio, &buf, (int)nw);
             continue;
         } else if (nw == 0) {
             return -1;
@@ -207,25 +200,32 @@ static int flush_ssl_data(lcbio_ESSL *es)
         }
     }
 
-/* TODO: This block is inefficient as it results in a bunch of memmove()
- * calls. While we could have done this inline with the send() call this
- * would make future optimization more difficult. */
 GT_WRITE_DONE:
-#if !LCB_CAN_OPTIMIZE_SSL_BIO
-    BIO_get_mem_ptr(es->wbio, &wmb);
-#endif
-    while (wmb->length > (size_t)tmp_len) {
-        char dummy[4096];
-        unsigned to_read = MINIMUM(wmb->length - tmp_len, sizeof dummy);
-        BIO_read(es->wbio, dummy, to_read);
-#if !LCB_CAN_OPTIMIZE_SSL_BIO
-        BIO_get_mem_ptr(es->wbio, &wmb);
-#endif
-    }
     BIO_clear_retry_flags(es->wbio);
     return 0;
 }
 
+/**
+ * SSL_write() which, if the BIO pair fills up, sends the encrypted data to the
+ * network and retries, rather than returning before all of `buf` is encrypted.
+ */
+static int write_ssl_data(lcbio_ESSL *es, const void *buf, int nbuf)
+{
+    int rv;
+    while ((rv = SSL_write(es->ssl, buf, nbuf)) <= 0) {
+        size_t npending = BIO_ctrl_pending(es->wbio);
+        if (SSL_get_error(es->ssl, rv) != SSL_ERROR_WANT_WRITE || npending == 0) {
+            break;
+        }
+        /* On EAGAIN we are woken up by the write watcher, and the caller passes
+         * the same data again */
+        if (flush_ssl_data(es) != 0 || BIO_ctrl_pending(es->wbio) == npending) {
+            break;
+        }
+    }
+    return rv;
+}
+
 /* This is the raw event handler called from the underlying IOPS */
 static void event_handler(lcb_socket_t fd, short which, void *arg)
 {
@@ -358,7 +358,7 @@ static lcb_ssize_t Essl_send(lcb_io_opt_t iops, lcb_socket_t sock, const void *b
         return -1;
     }
 
-    rv = SSL_write(es->ssl, buf, nbuf);
+    rv = write_ssl_data(es, buf, nbuf > INT_MAX ? INT_MAX : (int)nbuf);
     if (rv >= 0) {
         /* still need to schedule data to get flushed to the network */
         SCHEDULE_PENDING_SAFE(es);
@@ -374,14 +374,81 @@ static lcb_ssize_t Essl_send(lcb_io_opt_t iops, lcb_socket_t sock, const void *b
 
 static lcb_ssize_t Essl_recvv(lcb_io_opt_t iops, lcb_socket_t sock, lcb_IOV *iov, lcb_size_t niov)
 {
-    (void)niov;
-    return Essl_recv(iops, sock, iov->iov_base, iov->iov_len, 0);
+    lcb_ssize_t total = 0;
+    lcb_size_t ii;
+
+    /* Like readv(), keep going until the buffers are full or nothing is left */
+    for (ii = 0; ii < niov; ii++) {
+        char *buf = iov[ii].iov_base;
+        lcb_size_t nbuf = iov[ii].iov_len;
+        while (nbuf) {
+            lcb_ssize_t nr = Essl_recv(iops, sock, buf, nbuf, 0);
+            if (nr <= 0) {
+                return total ? total : nr;
+            }
+            buf += nr;
+            nbuf -= nr;
+            total += nr;
+        }
+    }
+    return total;
 }
 
 static lcb_ssize_t Essl_sendv(lcb_io_opt_t iops, lcb_socket_t sock, lcb_IOV *iov, lcb_size_t niov)
 {
-    (void)niov;
-    return Essl_send(iops, sock, iov->iov_base, iov->iov_len, 0);
+    lcbio_ESSL *es = ES_FROM_IOPS(iops);
+    char gathered[SSL3_RT_MAX_PLAIN_LENGTH];
+    lcb_ssize_t total = 0;
+    lcb_size_t ii = 0;
+    int rv = 0;
+    (void)sock;
+
+    if (es->error) {
+        IOTSSL_ERRNO(es) = EINVAL;
+        return -1;
+    }
+
+    while (ii < niov) {
+        const void *buf = iov[ii].iov_base;
+        lcb_size_t nbuf = iov[ii].iov_len, next = ii + 1;
+
+        if (nbuf < ESSL_GATHER_MAX) {
+            /* packet headers, keys and small values would otherwise each
+             * cost a record of their own */
+            for (nbuf = 0, next = ii; next < niov && iov[next].iov_len < ESSL_GATHER_MAX &&
+                                      nbuf + iov[next].iov_len <= sizeof(gathered);
+                 next++) {
+                memcpy(gathered + nbuf, iov[next].iov_base, iov[next].iov_len);
+                nbuf += iov[next].iov_len;
+            }
+            buf = gathered;
+        }
+        if (nbuf) {
+            rv = write_ssl_data(es, buf, nbuf > INT_MAX ? INT_MAX : (int)nbuf);
+            if (rv <= 0) {
+                break;
+            }
+            total += rv;
+            if ((lcb_size_t)rv < nbuf) {
+                break;
+            }
+        }
+        ii = next;
+    }
+
+    if (total) {
+        /* still need to schedule data to get flushed to the network */
+        SCHEDULE_PENDING_SAFE(es);
+        return total;
+    } else if (ii == niov) {
+        return 0;
+    } else if (maybe_error(es, rv)) {
+        IOTSSL_ERRNO(es) = EINVAL;
+        return -1;
+    } else {
+        IOTSSL_ERRNO(es) = EWOULDBLOCK;
+        return -1;
+    }
 }
 
 static void Essl_close(lcb_io_opt_t iops, lcb_socket_t fd)
@@ -397,6 +464,8 @@ static void Essl_dtor(void *arg)
     IOT_V0EV(es->orig).destroy(IOT_ARG(es->orig), es->event);
     lcbio_timer_destroy(es->as_fake);
     iotssl_destroy_common((lcbio_XSSL *)es);
+    /* the other half of the pair has been freed along with the SSL object */
+    BIO_free(es->rbio);
     if (es->entered) {
         /* defer free while inside the handler */
         return;
@@ -420,5 +489,16 @@ lcbio_pTABLE lcbio_Essl_new(lcbio_pTABLE orig, lcb_socket_t fd, SSL_CTX *sctx)
     iot->u_io.v0.io.close = Essl_close;
     iot->dtor = Essl_dtor;
     iotssl_init_common((lcbio_XSSL *)es, orig, sctx);
+    {
+        BIO *internal = NULL, *network = NULL;
+        if (!BIO_new_bio_pair(&internal, ESSL_BIO_SIZE, &network, ESSL_BIO_SIZE)) {
+            es->rbio = NULL;
+            Essl_dtor(es);
+            return NULL;
+        }
+        /* this releases the memory BIOs set up by iotssl_init_common() */
+        SSL_set_bio(es->ssl, internal, internal);
+        es->rbio = es->wbio = network;
+    }
     return iot;
 }
@@ -76,15 +76,13 @@ static int encode_rest(const std::uint8_t *s, std::uint8_t *d, std::size_t num)
  * @param s pointer to the input stream
  * @param d pointer to the output stream
  */
-static int encode_triplet(const std::uint8_t *s, std::uint8_t *d)
+static inline void encode_triplet(const std::uint8_t *s, std::uint8_t *d)
 {
     auto val = static_cast<std::uint32_t>((*s << 16) | (*(s + 1) << 8) | (*(s + 2)));
     d[3] = code[val & 63];
     d[2] = code[(val >> 6) & 63];
     d[1] = code[(val >> 12) & 63];
     d[0] = code[(val >> 18) & 63];
-
-    return 0;
 }
 
 /**
@@ -107,9 +105,7 @@ int lcb_base64_encode(const char *src, std::size_t len, char *dst, std::size_t s
     }
 
     for (ii = 0; ii < triplets; ++ii) {
-        if (encode_triplet(in, out) != 0) {
-            return -1;
-        }
+        encode_triplet(in, out);
         in += 3;
         out += 4;
     }
@@ -131,7 +127,7 @@ int lcb_base64_encode2(const char *src, std::size_t nsrc, char **dst, std::size_
     char *ptr = static_cast<char *>(calloc(len, sizeof(char)));
     int rc = lcb_base64_encode(src, nsrc, ptr, len);
     if (rc == 0) {
-        *ndst = strlen(ptr);
+        *ndst = (nsrc + 2) / 3 * 4;
         *dst = ptr;
     } else {
         free(ptr);
@@ -156,65 +152,75 @@ void lcb_base64_encode_iov(lcb_IOV *iov, unsigned niov, unsigned nb, char **dst,
     ptr = static_cast<char *>(calloc(len, sizeof(char)));
 
     {
-        std::size_t triplets = nsrc / 3;
-        std::size_t rest = nsrc % 3;
         auto *out = (std::uint8_t *)ptr;
-        std::size_t iop, ii;
+        std::size_t remaining = nsrc;
+        /* bytes of a triplet which spans several buffers */
         std::uint8_t triplet[3];
-
-        io = 0;
-        iop = 0;
-
-        for (ii = 0; ii < triplets; ii++) {
-            int tt;
-
-            for (tt = 0; tt < 3; tt++) {
-                if (iop >= iov[io].iov_len) {
-                    io++;
-                    iop = 0;
-                }
-                triplet[tt] = ((const std::uint8_t *)iov[io].iov_base)[iop++];
+        std::size_t ntriplet = 0;
+
+        /* Encode the triplets in place, only those crossing the boundary
+         * between two buffers are gathered first */
+        for (io = 0; io < niov && remaining > 0; io++) {
+            const auto *in = (const std::uint8_t *)iov[io].iov_base;
+            std::size_t nin = iov[io].iov_len < remaining ? iov[io].iov_len : remaining;
+            remaining -= nin;
+
+            while (ntriplet > 0 && ntriplet < 3 && nin > 0) {
+                triplet[ntriplet++] = *in++;
+                nin--;
+            }
+            if (ntriplet == 3) {
+                encode_triplet(triplet, out);
+                out += 4;
+                ntriplet = 0;
+            }
+            for (; nin >= 3; nin -= 3) {
+                encode_triplet(in, out);
+                in += 3;
+                out += 4;
+            }
+            while (nin > 0) {
+                triplet[ntriplet++] = *in++;
+                nin--;
             }
-            encode_triplet(triplet, out);
-            out += 4;
         }
 
-        if (rest > 0) {
-            std::memset(triplet, 0, sizeof(triplet));
-            for (ii = 0; ii < rest; ii++) {
-                if (iop >= iov[io].iov_len) {
-                    io++;
-                    iop = 0;
-                }
-                triplet[ii] = ((const std::uint8_t *)iov[io].iov_base)[iop++];
-            }
-            encode_rest(triplet, out, rest);
+        if (ntriplet > 0) {
+            encode_rest(triplet, out, ntriplet);
+            out += 4;
         }
         *out = '\0';
+        *ndst = (int)(out - (std::uint8_t *)ptr);
     }
 
-    *ndst = strlen(ptr);
     *dst = ptr;
 }
 
-static int code2val(char c)
+/**
+ * Value of each character of the alphabet, -1 for the other characters
+ */
+static const std::int8_t code_val[256] = {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, -1, -1, 63,
+    52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -1, -1, -1,
+    -1, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14,
+    15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, -1,
+    -1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+    41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+};
+
+static inline int code2val(char c)
 {
-    if (c >= 'A' && c <= 'Z') {
-        return c - 'A';
-    }
-    if (c >= 'a' && c <= 'z') {
-        return c - 'a' + 26;
-    }
-    if (c >= '0' && c <= '9') {
-        return c - '0' + 52;
-    }
-    if (c == '+') {
-        return 62;
-    }
-    if (c == '/') {
-        return 63;
-    }
-    return -1;
+    return code_val[static_cast<std::uint8_t>(c)];
 }
 
 std::ptrdiff_t lcb_base64_decode(const char *src, std::size_t nsrc, char *dst, std::size_t ndst)
@@ -231,6 +237,24 @@ std::ptrdiff_t lcb_base64_decode(const char *src, std::size_t nsrc, char *dst, s
         int val, ins;
         lcb_U32 value;
 
+        /* Fast path for a group of 4 characters of the alphabet, which is
+         * everything but the padding and the whitespace */
+        if (offset + 4 <= nsrc && (std::size_t)idx + 3 <= ndst) {
+            int v0 = code2val(src[0]);
+            int v1 = code2val(src[1]);
+            int v2 = code2val(src[2]);
+            int v3 = code2val(src[3]);
+            if ((v0 | v1 | v2 | v3) >= 0) {
+                value = (v0 << 18) | (v1 << 12) | (v2 << 6) | v3;
+                dst[idx++] = (char)(value >> 16);
+                dst[idx++] = (char)(value >> 8);
+                dst[idx++] = (char)(value);
+                src += 4;
+                offset += 4;
+                continue;
+            }
+        }
+
         if (isspace((int)*src)) {
             ++offset;
             ++src;
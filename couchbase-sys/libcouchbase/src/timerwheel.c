@@ -0,0 +1,170 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2020 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "internal.h"
+#include "timerwheel.h"
+
+#define TW_NONE ((lcb_U64)-1)
+#define TW_MASK ((lcb_U64)LCB_TW_SLOTS - 1)
+#define TW_SHIFT(level) (LCB_TW_SLOT_BITS * (level))
+#define TW_MAX_DELTA (((lcb_U64)1 << TW_SHIFT(LCB_TW_LEVELS)) - 1)
+
+void lcb_tw_init(lcb_TIMERWHEEL *tw, hrtime_t now)
+{
+    unsigned ii, jj;
+    for (ii = 0; ii < LCB_TW_LEVELS; ii++) {
+        for (jj = 0; jj < LCB_TW_SLOTS; jj++) {
+            lcb_list_init(&tw->slots[ii][jj]);
+        }
+    }
+    tw->cur = now >> LCB_TW_TICK_BITS;
+    tw->next = TW_NONE;
+    tw->dirty = 0;
+}
+
+/**
+ * Link the node into the slot matching its distance from the current tick.
+ * @return the first tick at which the slot is looked at again
+ */
+static lcb_U64 tw_place(lcb_TIMERWHEEL *tw, lcb_TWNODE *node)
+{
+    lcb_U64 expires = node->expires, delta, pos;
+    unsigned level;
+
+    if (expires <= tw->cur) {
+        lcb_list_append(&tw->slots[0][tw->cur & TW_MASK], &node->ll);
+        return tw->cur;
+    }
+
+    delta = expires - tw->cur;
+    if (delta > TW_MAX_DELTA) {
+        /* keep the real expiry in the node, it is placed again when cascaded */
+        delta = TW_MAX_DELTA;
+        expires = tw->cur + TW_MAX_DELTA;
+    }
+    for (level = 0; level < LCB_TW_LEVELS - 1; level++) {
+        if (delta < ((lcb_U64)1 << TW_SHIFT(level + 1))) {
+            break;
+        }
+    }
+    pos = expires >> TW_SHIFT(level);
+    lcb_list_append(&tw->slots[level][pos & TW_MASK], &node->ll);
+    return pos << TW_SHIFT(level);
+}
+
+void lcb_tw_add(lcb_TIMERWHEEL *tw, lcb_TWNODE *node, hrtime_t deadline)
+{
+    lcb_U64 tick;
+
+    node->expires = (deadline + LCB_TW_TICK_NS - 1) >> LCB_TW_TICK_BITS;
+    tick = tw_place(tw, node);
+    if (!tw->dirty && tick < tw->next) {
+        tw->next = tick;
+    }
+}
+
+void lcb_tw_remove(lcb_TWNODE *node)
+{
+    if (lcb_tw_linked(node)) {
+        lcb_list_delete(&node->ll);
+    }
+}
+
+static lcb_U64 tw_next_tick(lcb_TIMERWHEEL *tw)
+{
+    lcb_U64 best = TW_NONE;
+    unsigned level, ii;
+
+    if (!tw->dirty) {
+        return tw->next;
+    }
+
+    for (level = 0; level < LCB_TW_LEVELS; level++) {
+        unsigned shift = TW_SHIFT(level);
+        /* a slot of this level is only looked at on ticks which are multiples of its span */
+        lcb_U64 pos = (tw->cur + (((lcb_U64)1 << shift) - 1)) >> shift;
+        for (ii = 0; ii < LCB_TW_SLOTS; ii++) {
+            lcb_U64 tick = (pos + ii) << shift;
+            if (tick >= best) {
+                break;
+            }
+            if (!LCB_LIST_IS_EMPTY(&tw->slots[level][(pos + ii) & TW_MASK])) {
+                best = tick;
+                break;
+            }
+        }
+    }
+
+    tw->next = best;
+    tw->dirty = 0;
+    return best;
+}
+
+static void tw_cascade(lcb_TIMERWHEEL *tw, unsigned level, unsigned index)
+{
+    lcb_list_t *slot = &tw->slots[level][index];
+    lcb_list_t *ll;
+
+    while ((ll = lcb_list_shift(slot)) != NULL) {
+        tw_place(tw, LCB_LIST_ITEM(ll, lcb_TWNODE, ll));
+    }
+}
+
+unsigned lcb_tw_expire(lcb_TIMERWHEEL *tw, hrtime_t now, lcb_list_t *expired)
+{
+    lcb_U64 target = now >> LCB_TW_TICK_BITS;
+    unsigned nexpired = 0;
+
+    lcb_list_init(expired);
+    while (tw->cur <= target) {
+        lcb_U64 tick = tw_next_tick(tw);
+        lcb_list_t *slot, *ll;
+        unsigned level;
+
+        if (tick == TW_NONE || tick > target) {
+            /* nothing happens until then, the cached tick stays valid */
+            tw->cur = target + 1;
+            break;
+        }
+
+        tw->cur = tick;
+        for (level = 1; level < LCB_TW_LEVELS; level++) {
+            if (tick & (((lcb_U64)1 << TW_SHIFT(level)) - 1)) {
+                break;
+            }
+            tw_cascade(tw, level, (unsigned)((tick >> TW_SHIFT(level)) & TW_MASK));
+        }
+
+        slot = &tw->slots[0][tick & TW_MASK];
+        while ((ll = lcb_list_shift(slot)) != NULL) {
+            lcb_list_append(expired, ll);
+            nexpired++;
+        }
+        tw->cur = tick + 1;
+        tw->dirty = 1;
+    }
+    return nexpired;
+}
+
+hrtime_t lcb_tw_next(lcb_TIMERWHEEL *tw)
+{
+    lcb_U64 tick = tw_next_tick(tw);
+    if (tick == TW_NONE) {
+        return 0;
+    }
+    return (hrtime_t)tick << LCB_TW_TICK_BITS;
+}
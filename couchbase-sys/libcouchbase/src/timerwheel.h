@@ -0,0 +1,109 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2020 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LIBCOUCHBASE_TIMERWHEEL_H
+#define LIBCOUCHBASE_TIMERWHEEL_H 1
+
+#include "config.h"
+#include "list.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file
+ * Hierarchical timing wheel for deadlines of many concurrent operations.
+ *
+ * Nodes are intrusive, so adding and removing an entry never allocates and
+ * costs O(1). Deadlines are bucketed into ticks of LCB_TW_TICK_NS; entries
+ * never expire before their deadline, and at most one tick after it.
+ *
+ *      lcb_TIMERWHEEL wheel;
+ *      lcb_tw_init(&wheel, gethrtime());
+ *      lcb_tw_add(&wheel, &op->twnode, op->deadline);
+ *
+ *      lcb_list_t expired;
+ *      lcb_tw_expire(&wheel, gethrtime(), &expired);
+ *      while (!LCB_LIST_IS_EMPTY(&expired)) {
+ *          op = LCB_LIST_ITEM(expired.next, my_op, twnode.ll);
+ *          lcb_tw_remove(&op->twnode);
+ *          ...
+ *      }
+ */
+
+/** Bits of nanoseconds per tick, i.e. a tick is roughly one millisecond */
+#define LCB_TW_TICK_BITS 20
+#define LCB_TW_TICK_NS ((hrtime_t)1 << LCB_TW_TICK_BITS)
+#define LCB_TW_SLOT_BITS 6
+#define LCB_TW_SLOTS (1 << LCB_TW_SLOT_BITS)
+/** Four levels cover 2^24 ticks (about 4.9 hours), longer deadlines are cascaded again */
+#define LCB_TW_LEVELS 4
+
+typedef struct {
+    lcb_list_t ll;
+    /** Tick at which this node expires */
+    lcb_U64 expires;
+} lcb_TWNODE;
+
+typedef struct {
+    lcb_list_t slots[LCB_TW_LEVELS][LCB_TW_SLOTS];
+    /** The next tick to be processed */
+    lcb_U64 cur;
+    /** Cached result of lcb_tw_next(), unless `dirty` is set */
+    lcb_U64 next;
+    int dirty;
+} lcb_TIMERWHEEL;
+
+void lcb_tw_init(lcb_TIMERWHEEL *tw, hrtime_t now);
+
+/**
+ * Schedule a node. Deadlines which have already passed expire on the next
+ * call to lcb_tw_expire()
+ * @param tw the wheel
+ * @param node an unlinked node
+ * @param deadline absolute time in nanoseconds
+ */
+void lcb_tw_add(lcb_TIMERWHEEL *tw, lcb_TWNODE *node, hrtime_t deadline);
+
+/**
+ * Unlink a node, either from the wheel or from the list it was expired into.
+ * Does nothing if the node is not linked (i.e. zeroed)
+ */
+void lcb_tw_remove(lcb_TWNODE *node);
+
+#define lcb_tw_linked(node) ((node)->ll.next != NULL)
+
+/**
+ * Move all nodes whose deadline is not later than `now` into `expired`,
+ * which is initialized by this function.
+ * @return the number of expired nodes
+ */
+unsigned lcb_tw_expire(lcb_TIMERWHEEL *tw, hrtime_t now, lcb_list_t *expired);
+
+/**
+ * Earliest time at which lcb_tw_expire() may have something to do. This is
+ * exact for nodes expiring within LCB_TW_SLOTS ticks, and a lower bound for
+ * nodes further away (which then need to be moved to a lower level first).
+ * @return the time in nanoseconds, or 0 if the wheel is empty
+ */
+hrtime_t lcb_tw_next(lcb_TIMERWHEEL *tw);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,91 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2011-2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/* The histograms of lcb_enable_timings() and of the tools, recorded in
+ * nanoseconds. They are compact enough to be kept per node and opcode, see
+ * lcb::metrics::CompactHistogram */
+
+#include "internal.h"
+#include "metrics/compact_histogram.hh"
+
+#include <algorithm>
+
+struct lcb_histogram_st : lcb::metrics::CompactHistogram {
+};
+
+LCB_INTERNAL_API
+lcb_HISTOGRAM *lcb_histogram_create(void)
+{
+    return new lcb_HISTOGRAM();
+}
+
+LCB_INTERNAL_API
+void lcb_histogram_destroy(lcb_HISTOGRAM *hg)
+{
+    delete hg;
+}
+
+LCB_INTERNAL_API
+void lcb_histogram_read(const lcb_HISTOGRAM *hg, const void *cookie, lcb_HISTOGRAM_CALLBACK callback)
+{
+    lcb::metrics::HistogramSnapshot snapshot;
+    hg->collect(snapshot);
+
+    lcb_U32 maxtotal = 0;
+    snapshot.for_each([&maxtotal](std::uint64_t, std::uint64_t, std::uint64_t count) {
+        maxtotal = std::max(maxtotal, static_cast<lcb_U32>(count));
+    });
+    snapshot.for_each([cookie, callback, maxtotal](std::uint64_t lower, std::uint64_t upper, std::uint64_t count) {
+        /* the bounds are 32 bits wide, which takes microseconds above 4 seconds */
+        if (upper <= UINT32_MAX) {
+            callback(cookie, LCB_TIMEUNIT_NSEC, static_cast<lcb_U32>(lower), static_cast<lcb_U32>(upper),
+                     static_cast<lcb_U32>(count), maxtotal);
+        } else {
+            callback(cookie, LCB_TIMEUNIT_USEC, static_cast<lcb_U32>(LCB_NS2US(lower)),
+                     static_cast<lcb_U32>(std::min<std::uint64_t>(LCB_NS2US(upper), UINT32_MAX)),
+                     static_cast<lcb_U32>(count), maxtotal);
+        }
+    });
+}
+
+LCB_INTERNAL_API
+void lcb_histogram_print(lcb_HISTOGRAM *hg, FILE *stream)
+{
+    static const double percentiles[] = {50.0, 75.0, 90.0, 95.0, 99.0, 99.9, 99.99, 100.0};
+    lcb::metrics::HistogramSnapshot snapshot;
+    hg->collect(snapshot);
+
+    fprintf(stream, "Values in microseconds (us)\n\n");
+    fprintf(stream, "%12s %12s\n\n", "Percentile", "Value");
+    for (double percentile : percentiles) {
+        fprintf(stream, "%12.3f %12.3f\n", percentile, snapshot.value_at_percentile(percentile) / 1000.0);
+    }
+    fprintf(stream, "#[Max = %12.3f, Total count = %12" PRIu64 "]\n", snapshot.max() / 1000.0,
+            snapshot.total_count());
+}
+
+LCB_INTERNAL_API
+void lcb_histogram_reset(lcb_HISTOGRAM *hg)
+{
+    hg->reset();
+}
+
+LCB_INTERNAL_API
+void lcb_histogram_record(lcb_HISTOGRAM *hg, lcb_U64 delta)
+{
+    hg->record(delta);
+}
@@ -32,10 +32,18 @@
 /* include the generated probes header and put markers in code */
 #include "probes.h"
 #define TRACE(probe) probe
+/* Only evaluate the arguments of the probe while a tracer is attached to it */
+#define TRACE_IF_ENABLED(enabled, probe)                                                                               \
+    do {                                                                                                               \
+        if (enabled) {                                                                                                 \
+            probe;                                                                                                     \
+        }                                                                                                              \
+    } while (0)
 
 #else
 /* Wrap the probe to allow it to be removed when no systemtap available */
 #define TRACE(probe)
+#define TRACE_IF_ENABLED(enabled, probe)
 #endif
 
 #define TRACE_BEGIN_COMMON(TGT, instance, req, cmd, ...)                                                               \
@@ -112,6 +120,55 @@
 #define TRACE_NEW_CONFIG(instance, config)                                                                             \
     TRACE(LIBCOUCHBASE_NEW_CONFIG(instance, (config)->vbc->revid, (config)->vbc->bname, (config)->vbc->buuid, (config)))
 
+#define TRACE_PKT_OPCODE(pkt) (((const uint8_t *)SPAN_BUFFER(&(pkt)->kh_span))[1])
+
+#define TRACE_KV_MAP_KEY(instance, pkt, vb, srvix, nkey)                                                               \
+    TRACE_IF_ENABLED(LIBCOUCHBASE_KV_MAP_KEY_ENABLED(),                                                                \
+                     LIBCOUCHBASE_KV_MAP_KEY(instance, (pkt)->opaque, vb, srvix, nkey))
+#define TRACE_KV_SCHEDULE(instance, pipeline, pkt)                                                                     \
+    TRACE_IF_ENABLED(LIBCOUCHBASE_KV_SCHEDULE_ENABLED(),                                                               \
+                     LIBCOUCHBASE_KV_SCHEDULE(instance, (pkt)->opaque, mcreq_get_vbucket(pkt), (pipeline)->index,      \
+                                              TRACE_PKT_OPCODE(pkt), mcreq_get_size(pkt), gethrtime()))
+#define TRACE_KV_ENQUEUE(instance, pipeline, pkt, size)                                                                \
+    TRACE_IF_ENABLED(LIBCOUCHBASE_KV_ENQUEUE_ENABLED(),                                                                \
+                     LIBCOUCHBASE_KV_ENQUEUE(instance, (pkt)->opaque, mcreq_get_vbucket(pkt), (pipeline)->index, size, \
+                                             gethrtime()))
+#define TRACE_KV_FLUSH_START(instance, pipeline, nbytes)                                                               \
+    TRACE_IF_ENABLED(LIBCOUCHBASE_KV_FLUSH_START_ENABLED(),                                                            \
+                     LIBCOUCHBASE_KV_FLUSH_START(instance, (pipeline)->index, nbytes, gethrtime()))
+#define TRACE_KV_FLUSH_DONE(instance, pipeline, expected, actual)                                                      \
+    TRACE_IF_ENABLED(LIBCOUCHBASE_KV_FLUSH_DONE_ENABLED(),                                                             \
+                     LIBCOUCHBASE_KV_FLUSH_DONE(instance, (pipeline)->index, expected, actual, gethrtime()))
+#define TRACE_KV_PACKET_WRITTEN(instance, pipeline, pkt, size)                                                         \
+    TRACE_IF_ENABLED(LIBCOUCHBASE_KV_PACKET_WRITTEN_ENABLED(),                                                         \
+                     LIBCOUCHBASE_KV_PACKET_WRITTEN(instance, (pkt)->opaque, (pipeline)->index, size, gethrtime()))
+#define TRACE_KV_RESPONSE_READ(instance, pipeline, mcresp, size)                                                       \
+    TRACE_IF_ENABLED(LIBCOUCHBASE_KV_RESPONSE_READ_ENABLED(),                                                          \
+                     LIBCOUCHBASE_KV_RESPONSE_READ(instance, (mcresp).opaque(), (pipeline)->index, (mcresp).opcode(),  \
+                                                   (mcresp).status(), size, gethrtime()))
+#define TRACE_KV_DISPATCH(instance, pipeline, pkt, mcresp)                                                             \
+    TRACE_IF_ENABLED(LIBCOUCHBASE_KV_DISPATCH_ENABLED(),                                                               \
+                     LIBCOUCHBASE_KV_DISPATCH(instance, (mcresp)->opaque(), (pipeline)->index, (mcresp)->opcode(),     \
+                                              (mcresp)->status(),                                                      \
+                                              MCREQ_PKT_RDATA(pkt)->dispatch - MCREQ_PKT_RDATA(pkt)->start))
+#define TRACE_KV_RETRY(instance, pkt, rc, delay)                                                                       \
+    TRACE_IF_ENABLED(LIBCOUCHBASE_KV_RETRY_ENABLED(),                                                                  \
+                     LIBCOUCHBASE_KV_RETRY(instance, (pkt)->opaque, TRACE_PKT_OPCODE(pkt), (pkt)->retries, rc, delay))
+
+#define TRACE_CONFIG_APPLIED(instance, config)                                                                         \
+    TRACE_IF_ENABLED(LIBCOUCHBASE_CONFIG_APPLIED_ENABLED(),                                                            \
+                     LIBCOUCHBASE_CONFIG_APPLIED(instance, (config)->vbc->revid, (config)->vbc->nsrv,                  \
+                                                 (config)->vbc->nvb, gethrtime()))
+
+#define TRACE_SOCKET_CONNECT(sock, rc, duration)                                                                       \
+    TRACE_IF_ENABLED(LIBCOUCHBASE_SOCKET_CONNECT_ENABLED(),                                                            \
+                     LIBCOUCHBASE_SOCKET_CONNECT((sock)->id, (sock)->info->ep_remote.host,                             \
+                                                 (sock)->info->ep_remote.port, rc, duration))
+#define TRACE_KV_NEGOTIATE(session, endpoint, mcresp)                                                                  \
+    TRACE_IF_ENABLED(LIBCOUCHBASE_KV_NEGOTIATE_ENABLED(),                                                              \
+                     LIBCOUCHBASE_KV_NEGOTIATE(session, (endpoint).host, (endpoint).port, (mcresp).opcode(),          \
+                                               (mcresp).status(), gethrtime()))
+
 #ifdef __clang__
 #pragma GCC diagnostic pop
 #endif /* __clang__ */
@@ -0,0 +1,507 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2024 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/**
+ * Batched export of the finished spans in the OTLP protobuf format.
+ *
+ * Reporting a span copies its identifiers, times, name and tags into the slot
+ * of a bounded lock-free queue, in a compact form. A background thread drains
+ * the queue, encodes the spans as `opentelemetry.proto.trace.v1.Span`
+ * messages, and hands them to the user callback wrapped in an
+ * `ExportTraceServiceRequest`, so that neither the encoding nor the transport
+ * run on the thread of the instance.
+ */
+
+#include "internal.h"
+#include "boundedqueue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/** Spans whose name and tags take up to this many bytes are kept inline */
+#define OTLP_INLINE_SIZE 384
+
+using namespace lcb::trace;
+
+namespace
+{
+/* kinds of the entries of the compact form */
+enum { ENTRY_STRING = 's', ENTRY_UINT64 = 'u', ENTRY_DOUBLE = 'd', ENTRY_BOOL = 'b' };
+
+/* protobuf wire types */
+enum { WIRE_VARINT = 0, WIRE_FIXED64 = 1, WIRE_LEN = 2 };
+
+/* opentelemetry.proto.trace.v1.Span.SpanKind */
+#define OTLP_SPAN_KIND_CLIENT 3
+
+struct ExportedSpan {
+    std::uint64_t trace_id;
+    std::uint64_t span_id;
+    std::uint64_t parent_id;
+    std::uint64_t start;
+    std::uint64_t finish;
+    /** The name, then the tags, see SpanWriter. Empty if the span could not be copied */
+    std::size_t len;
+    char *heap; /* set if the body did not fit in body */
+    char body[OTLP_INLINE_SIZE];
+};
+
+/**
+ * Writes the name and the tags of a span: each entry is a kind, a key and a
+ * value, with the lengths of the strings in 32 bits before them
+ */
+class SpanWriter : public Span::TagVisitor
+{
+  public:
+    explicit SpanWriter(std::string &out) : out_(out) {}
+
+    void name(const char *value)
+    {
+        put_string(value, std::strlen(value));
+    }
+
+    void string(const char *key, const char *value, size_t nvalue) override
+    {
+        out_.push_back(ENTRY_STRING);
+        put_string(key, std::strlen(key));
+        put_string(value, nvalue);
+    }
+
+    void uint64(const char *key, uint64_t value) override
+    {
+        out_.push_back(ENTRY_UINT64);
+        put_string(key, std::strlen(key));
+        out_.append(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+    void real(const char *key, double value) override
+    {
+        out_.push_back(ENTRY_DOUBLE);
+        put_string(key, std::strlen(key));
+        out_.append(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+    void boolean(const char *key, bool value) override
+    {
+        out_.push_back(ENTRY_BOOL);
+        put_string(key, std::strlen(key));
+        out_.push_back(value ? 1 : 0);
+    }
+
+  private:
+    void put_string(const char *value, size_t nvalue)
+    {
+        auto len = static_cast<std::uint32_t>(nvalue);
+        out_.append(reinterpret_cast<const char *>(&len), sizeof(len));
+        out_.append(value, len);
+    }
+
+    std::string &out_;
+};
+
+/** Reads back what SpanWriter wrote */
+class SpanReader
+{
+  public:
+    SpanReader(const char *body, size_t len) : cur_(body), end_(body + len) {}
+
+    bool done() const
+    {
+        return cur_ >= end_;
+    }
+
+    char kind()
+    {
+        return *cur_++;
+    }
+
+    void string(const char *&value, std::uint32_t &nvalue)
+    {
+        std::memcpy(&nvalue, cur_, sizeof(nvalue));
+        value = cur_ + sizeof(nvalue);
+        cur_ = value + nvalue;
+    }
+
+    template <typename T>
+    T scalar()
+    {
+        T value;
+        std::memcpy(&value, cur_, sizeof(value));
+        cur_ += sizeof(value);
+        return value;
+    }
+
+  private:
+    const char *cur_;
+    const char *end_;
+};
+
+void put_varint(std::string &out, std::uint64_t value)
+{
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+void put_key(std::string &out, unsigned field, unsigned wire)
+{
+    put_varint(out, (field << 3) | wire);
+}
+
+void put_bytes(std::string &out, unsigned field, const void *data, size_t ndata)
+{
+    put_key(out, field, WIRE_LEN);
+    put_varint(out, ndata);
+    out.append(static_cast<const char *>(data), ndata);
+}
+
+void put_bytes(std::string &out, unsigned field, const std::string &data)
+{
+    put_bytes(out, field, data.data(), data.size());
+}
+
+void put_fixed64(std::string &out, unsigned field, std::uint64_t value)
+{
+    put_key(out, field, WIRE_FIXED64);
+    for (int ii = 0; ii < 8; ii++) {
+        out.push_back(static_cast<char>(value >> (8 * ii)));
+    }
+}
+
+/** Identifiers are big-endian, and the 64-bit trace identifiers are padded on the left to 128 bits */
+void put_id(std::string &out, unsigned field, std::uint64_t id, size_t width)
+{
+    char buf[16] = {0};
+    for (int ii = 0; ii < 8; ii++) {
+        buf[15 - ii] = static_cast<char>(id >> (8 * ii));
+    }
+    put_bytes(out, field, buf + sizeof(buf) - width, width);
+}
+
+/** Append a KeyValue whose AnyValue was already encoded */
+void put_attribute(std::string &out, unsigned field, const char *key, size_t nkey, const std::string &value)
+{
+    std::string kv;
+    put_bytes(kv, 1, key, nkey);
+    put_bytes(kv, 2, value);
+    put_bytes(out, field, kv);
+}
+
+void put_string_attribute(std::string &out, unsigned field, const char *key, const char *value)
+{
+    std::string any;
+    put_bytes(any, 1, value, std::strlen(value));
+    put_attribute(out, field, key, std::strlen(key), any);
+}
+
+class OtlpExporter
+{
+  public:
+    OtlpExporter(const lcb_settings *settings, lcbtrace_OTLP_CALLBACK callback, void *cookie)
+        : queue_(settings->tracer_export_queue_size),
+          batch_size_(std::max<std::size_t>(1, settings->tracer_export_batch_size)),
+          interval_(std::max<std::uint32_t>(1000, settings->tracer_export_interval)), callback_(callback),
+          cookie_(cookie)
+    {
+        thread_ = std::thread(&OtlpExporter::run, this);
+    }
+
+    ~OtlpExporter()
+    {
+        {
+            std::lock_guard<std::mutex> guard(mutex_);
+            stopped_ = true;
+        }
+        cond_.notify_all();
+        thread_.join();
+        delete wrapper_;
+    }
+
+    lcbtrace_TRACER *wrap();
+
+    void report(Span *span)
+    {
+        std::size_t pos;
+        ExportedSpan *rec = queue_.claim(pos);
+        if (rec == nullptr) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        Span *root = span;
+        while (root->m_parent != nullptr) {
+            root = root->m_parent;
+        }
+        rec->trace_id = root->m_span_id;
+        rec->span_id = span->m_span_id;
+        rec->parent_id = span->m_parent ? span->m_parent->m_span_id : 0;
+        rec->start = span->m_start;
+        rec->finish = span->m_finish;
+
+        /* the scratch buffer keeps its capacity, so that it only grows on the first spans */
+        static thread_local std::string scratch;
+        scratch.clear();
+        SpanWriter writer(scratch);
+        writer.name(span->m_opname);
+        span->visit_tags(writer);
+
+        rec->len = scratch.size();
+        rec->heap = nullptr;
+        char *buf = rec->body;
+        if (rec->len > sizeof(rec->body)) {
+            buf = rec->heap = static_cast<char *>(malloc(rec->len));
+        }
+        if (buf == nullptr) {
+            rec->len = 0;
+        } else {
+            std::memcpy(buf, scratch.data(), rec->len);
+        }
+        queue_.publish(pos);
+
+        /* pairs with run() setting sleeping_ before checking pending_ */
+        if (pending_.fetch_add(1) + 1 >= batch_size_ && sleeping_.load()) {
+            std::lock_guard<std::mutex> guard(mutex_);
+            cond_.notify_all();
+        }
+    }
+
+    std::uint64_t exported() const
+    {
+        return exported_.load(std::memory_order_relaxed);
+    }
+
+    std::uint64_t dropped() const
+    {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+  private:
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            lock.unlock();
+            ExportedSpan *rec;
+            while ((rec = queue_.front()) != nullptr) {
+                if (rec->len == 0) {
+                    dropped_.fetch_add(1, std::memory_order_relaxed);
+                } else {
+                    encode(*rec);
+                }
+                free(rec->heap);
+                queue_.pop();
+                pending_.fetch_sub(1);
+                if (nspans_ >= batch_size_) {
+                    export_batch();
+                }
+            }
+            /* woken up by the interval or by the destructor, so that a partial batch is due */
+            export_batch();
+            lock.lock();
+
+            /* spans reported while the queue was being drained */
+            if (pending_.load() != 0) {
+                continue;
+            }
+            if (stopped_) {
+                break;
+            }
+            sleeping_.store(true);
+            cond_.wait_for(lock, std::chrono::microseconds(interval_),
+                           [this] { return stopped_ || pending_.load() >= batch_size_; });
+            sleeping_.store(false);
+        }
+    }
+
+    void encode(const ExportedSpan &rec)
+    {
+        SpanReader reader(rec.heap ? rec.heap : rec.body, rec.len);
+        const char *name;
+        std::uint32_t nname;
+        reader.string(name, nname);
+
+        span_.clear();
+        put_id(span_, 1, rec.trace_id, 16);
+        put_id(span_, 2, rec.span_id, 8);
+        if (rec.parent_id != 0) {
+            put_id(span_, 4, rec.parent_id, 8);
+        }
+        put_bytes(span_, 5, name, nname);
+        put_key(span_, 6, WIRE_VARINT);
+        put_varint(span_, OTLP_SPAN_KIND_CLIENT);
+        /* the spans are timed in microseconds since the epoch, OTLP wants nanoseconds */
+        put_fixed64(span_, 7, rec.start * 1000);
+        put_fixed64(span_, 8, rec.finish * 1000);
+
+        std::string any;
+        while (!reader.done()) {
+            char kind = reader.kind();
+            const char *key;
+            std::uint32_t nkey;
+            reader.string(key, nkey);
+
+            any.clear();
+            switch (kind) {
+                case ENTRY_STRING: {
+                    const char *value;
+                    std::uint32_t nvalue;
+                    reader.string(value, nvalue);
+                    put_bytes(any, 1, value, nvalue);
+                    break;
+                }
+                case ENTRY_BOOL:
+                    put_key(any, 2, WIRE_VARINT);
+                    put_varint(any, reader.scalar<char>() ? 1 : 0);
+                    break;
+                case ENTRY_UINT64:
+                    put_key(any, 3, WIRE_VARINT);
+                    put_varint(any, reader.scalar<std::uint64_t>());
+                    break;
+                case ENTRY_DOUBLE: {
+                    double value = reader.scalar<double>();
+                    std::uint64_t bits;
+                    std::memcpy(&bits, &value, sizeof(bits));
+                    put_fixed64(any, 4, bits);
+                    break;
+                }
+                default:
+                    lcb_assert(0 && "unknown entry");
+                    return;
+            }
+            put_attribute(span_, 9, key, nkey, any);
+        }
+
+        put_bytes(spans_, 2, span_);
+        nspans_++;
+    }
+
+    void export_batch()
+    {
+        if (nspans_ == 0) {
+            return;
+        }
+
+        std::string scope;
+        put_bytes(scope, 1, "libcouchbase", 12);
+        put_bytes(scope, 2, LCB_VERSION_STRING, std::strlen(LCB_VERSION_STRING));
+        std::string scope_spans;
+        put_bytes(scope_spans, 1, scope);
+        scope_spans.append(spans_);
+
+        std::string resource;
+        put_string_attribute(resource, 1, "telemetry.sdk.name", "libcouchbase");
+        put_string_attribute(resource, 1, "telemetry.sdk.language", "cpp");
+        put_string_attribute(resource, 1, "telemetry.sdk.version", LCB_VERSION_STRING);
+        std::string resource_spans;
+        put_bytes(resource_spans, 1, resource);
+        put_bytes(resource_spans, 2, scope_spans);
+
+        std::string request;
+        put_bytes(request, 1, resource_spans);
+        callback_(cookie_, request.data(), request.size(), nspans_);
+
+        exported_.fetch_add(nspans_, std::memory_order_relaxed);
+        spans_.clear();
+        nspans_ = 0;
+    }
+
+    lcbtrace_TRACER *wrapper_{nullptr};
+    lcb::BoundedQueue<ExportedSpan> queue_;
+    std::size_t batch_size_;
+    std::uint32_t interval_;
+    lcbtrace_OTLP_CALLBACK callback_;
+    void *cookie_;
+    std::atomic<std::size_t> pending_{0};
+    std::atomic<std::uint64_t> exported_{0};
+    std::atomic<std::uint64_t> dropped_{0};
+    std::atomic<bool> sleeping_{false};
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    bool stopped_{false};
+    std::thread thread_;
+
+    /* only used by the export thread */
+    std::string span_;
+    std::string spans_; /* the encoded spans of the batch, as ScopeSpans.spans fields */
+    std::size_t nspans_{0};
+};
+} // namespace
+
+extern "C" {
+static void otlp_destructor(lcbtrace_TRACER *wrapper)
+{
+    if (wrapper != nullptr && wrapper->cookie != nullptr) {
+        delete reinterpret_cast<OtlpExporter *>(wrapper->cookie);
+    }
+}
+
+static void otlp_report(lcbtrace_TRACER *wrapper, lcbtrace_SPAN *span)
+{
+    if (wrapper == nullptr || wrapper->cookie == nullptr) {
+        return;
+    }
+    reinterpret_cast<OtlpExporter *>(wrapper->cookie)->report(span);
+}
+}
+
+lcbtrace_TRACER *OtlpExporter::wrap()
+{
+    if (wrapper_) {
+        return wrapper_;
+    }
+    wrapper_ = new lcbtrace_TRACER();
+    wrapper_->version = 0;
+    wrapper_->flags = LCBTRACE_F_OTLP;
+    wrapper_->cookie = this;
+    wrapper_->destructor = otlp_destructor;
+    wrapper_->v.v0.report = otlp_report;
+    return wrapper_;
+}
+
+LIBCOUCHBASE_API
+lcbtrace_TRACER *lcbtrace_otlp_new(lcb_INSTANCE *instance, lcbtrace_OTLP_CALLBACK callback, void *cookie)
+{
+    if (instance == nullptr || callback == nullptr) {
+        return nullptr;
+    }
+    return (new OtlpExporter(instance->settings, callback, cookie))->wrap();
+}
+
+LIBCOUCHBASE_API
+lcb_STATUS lcbtrace_otlp_stats(const lcbtrace_TRACER *tracer, lcb_U64 *exported, lcb_U64 *dropped)
+{
+    if (tracer == nullptr || tracer->destructor != otlp_destructor || tracer->cookie == nullptr) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    const auto *exporter = reinterpret_cast<const OtlpExporter *>(tracer->cookie);
+    if (exported != nullptr) {
+        *exported = exporter->exported();
+    }
+    if (dropped != nullptr) {
+        *dropped = exporter->dropped();
+    }
+    return LCB_SUCCESS;
+}
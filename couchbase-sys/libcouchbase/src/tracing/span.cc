@@ -24,6 +24,8 @@
 #include "n1ql/query_handle.hh"
 
 typedef enum { TAGVAL_STRING, TAGVAL_UINT64, TAGVAL_DOUBLE, TAGVAL_BOOL } tag_type;
+/** Copied string values up to this length are kept inside the tag itself */
+#define TAGVAL_INLINE_SIZE 24
 typedef struct tag_value {
     sllist_node slnode;
     struct {
@@ -41,8 +43,99 @@ typedef struct tag_value {
         double d;
         int b;
     } v;
+    char inline_value[TAGVAL_INLINE_SIZE];
 } tag_value;
 
+namespace
+{
+/**
+ * Freed blocks of one size, kept per thread so that the spans and tags of
+ * every traced operation are not allocated from the heap
+ */
+template <size_t Size>
+class BlockCache
+{
+  public:
+    ~BlockCache()
+    {
+        for (void *block : blocks_) {
+            ::operator delete(block);
+        }
+    }
+
+    void *get()
+    {
+        if (blocks_.empty()) {
+            return ::operator new(Size);
+        }
+        void *block = blocks_.back();
+        blocks_.pop_back();
+        return block;
+    }
+
+    void put(void *block)
+    {
+        if (blocks_.size() < max_blocks) {
+            blocks_.push_back(block);
+        } else {
+            ::operator delete(block);
+        }
+    }
+
+    static BlockCache &instance()
+    {
+        static thread_local BlockCache cache;
+        return cache;
+    }
+
+  private:
+    static const size_t max_blocks = 1024;
+    std::vector<void *> blocks_;
+};
+
+typedef BlockCache<sizeof(tag_value)> TagCache;
+typedef BlockCache<sizeof(lcb::trace::Span)> SpanCache;
+
+tag_value *tag_alloc()
+{
+    return static_cast<tag_value *>(memset(TagCache::instance().get(), 0, sizeof(tag_value)));
+}
+
+void tag_free(tag_value *val)
+{
+    TagCache::instance().put(val);
+}
+
+/**
+ * @return the LCBTRACE_OP_* constant equal to opname, or nullptr if it is not
+ * one of those, so that the library's own spans do not copy their names
+ */
+const char *intern_operation_name(const char *opname)
+{
+    static const char *names[] = {
+        LCBTRACE_OP_REQUEST_ENCODING, LCBTRACE_OP_DISPATCH_TO_SERVER, LCBTRACE_OP_RESPONSE_DECODING,
+        LCBTRACE_OP_INSERT,           LCBTRACE_OP_APPEND,             LCBTRACE_OP_COUNTER,
+        LCBTRACE_OP_GET,              LCBTRACE_OP_GET_FROM_REPLICA,   LCBTRACE_OP_OBSERVE_CAS,
+        LCBTRACE_OP_OBSERVE_CAS_ROUND, LCBTRACE_OP_OBSERVE_SEQNO,     LCBTRACE_OP_PREPEND,
+        LCBTRACE_OP_REMOVE,           LCBTRACE_OP_REPLACE,            LCBTRACE_OP_TOUCH,
+        LCBTRACE_OP_UNLOCK,           LCBTRACE_OP_UPSERT,             LCBTRACE_OP_EXISTS,
+        LCBTRACE_OP_LOOKUPIN,         LCBTRACE_OP_MUTATEIN,           LCBTRACE_OP_QUERY,
+        LCBTRACE_OP_ANALYTICS,        LCBTRACE_OP_SEARCH,             LCBTRACE_OP_VIEW,
+    };
+    for (const char *name : names) {
+        if (name == opname) {
+            return name;
+        }
+    }
+    for (const char *name : names) {
+        if (strcmp(name, opname) == 0) {
+            return name;
+        }
+    }
+    return nullptr;
+}
+} // namespace
+
 LIBCOUCHBASE_API
 uint64_t lcbtrace_now()
 {
@@ -212,7 +305,7 @@ const char *lcbtrace_span_get_operation(lcbtrace_SPAN *span)
     if (!span) {
         return nullptr;
     }
-    return span->m_opname.c_str();
+    return span->m_opname;
 }
 
 LIBCOUCHBASE_API
@@ -406,6 +499,7 @@ LIBCOUCHBASE_API lcb_STATUS lcbtrace_span_get_is_encode(lcbtrace_SPAN *span, int
     return LCB_SUCCESS;
 }
 
+#ifndef LCB_NO_TRACING
 namespace lcb
 {
 namespace trace
@@ -415,8 +509,16 @@ void finish_kv_span(const mc_PIPELINE *pipeline, const mc_PACKET *request_pkt,
 {
     lcbtrace_SPAN *dispatch_span = MCREQ_PKT_RDATA(request_pkt)->span;
     if (dispatch_span) {
+        uint64_t server_us = 0;
         if (response_pkt != nullptr) {
-            dispatch_span->increment_server(response_pkt->duration());
+            server_us = response_pkt->duration();
+            dispatch_span->increment_server(server_us);
+        }
+        const mc_REQDATA *rdata = MCREQ_PKT_RDATA(request_pkt);
+        if (rdata->flushed != 0 && rdata->flushed >= rdata->start && rdata->dispatch >= rdata->flushed) {
+            uint64_t wire_us = LCB_NS2US(rdata->dispatch - rdata->flushed);
+            dispatch_span->record_breakdown(LCB_NS2US(rdata->flushed - rdata->start),
+                                            wire_us > server_us ? wire_us - server_us : 0);
         }
         auto *server = static_cast<const lcb::Server *>(pipeline);
         dispatch_span->find_outer_or_this()->add_tag(LCBTRACE_TAG_RETRIES, 0, (uint64_t)request_pkt->retries);
@@ -437,13 +539,22 @@ void finish_kv_span(const mc_PIPELINE *pipeline, const mc_PACKET *request_pkt,
 
 } // namespace trace
 } // namespace lcb
+#endif
 
 using namespace lcb::trace;
 
 Span::Span(lcbtrace_TRACER *tracer, const char *opname, uint64_t start, lcbtrace_REF_TYPE ref, lcbtrace_SPAN *other,
            void *external_span)
-    : m_tracer(tracer), m_opname(opname), m_extspan(external_span)
+    : m_tracer(tracer), m_opname(nullptr), m_extspan(external_span)
 {
+    if (opname == nullptr) {
+        opname = "";
+    }
+    m_opname = intern_operation_name(opname);
+    if (m_opname == nullptr) {
+        m_opname_copy.assign(opname);
+        m_opname = m_opname_copy.c_str();
+    }
     if (other != nullptr && ref == LCBTRACE_REF_CHILD_OF) {
         m_parent = other;
     } else {
@@ -464,6 +575,20 @@ Span::Span(lcbtrace_TRACER *tracer, const char *opname, uint64_t start, lcbtrace
     }
 }
 
+void *Span::operator new(size_t size)
+{
+    lcb_assert(size == sizeof(Span));
+    (void)size;
+    return SpanCache::instance().get();
+}
+
+void Span::operator delete(void *ptr)
+{
+    if (ptr != nullptr) {
+        SpanCache::instance().put(ptr);
+    }
+}
+
 Span::~Span()
 {
     if (nullptr != m_extspan) {
@@ -484,7 +609,7 @@ Span::~Span()
             if (val->t == TAGVAL_STRING && val->v.s.need_free) {
                 free(val->v.s.p);
             }
-            free(val);
+            tag_free(val);
         }
     }
 }
@@ -549,6 +674,13 @@ void Span::increment_server(uint64_t server)
     add_tag(LCBTRACE_TAG_PEER_LATENCY, 0, server);
 }
 
+void Span::record_breakdown(uint64_t queue_time, uint64_t network_time)
+{
+    Span *outer = find_outer_or_this();
+    outer->m_last_queue = queue_time;
+    outer->m_last_network = network_time;
+}
+
 lcbtrace_SPAN *Span::find_outer_or_this()
 {
     lcbtrace_SPAN *outer = this;
@@ -620,6 +752,29 @@ void Span::finish(uint64_t now)
     }
 }
 
+void Span::visit_tags(TagVisitor &visitor)
+{
+    sllist_iterator iter;
+    SLLIST_ITERFOR(&m_tags, &iter)
+    {
+        const tag_value *val = SLLIST_ITEM(iter.cur, tag_value, slnode);
+        switch (val->t) {
+            case TAGVAL_STRING:
+                visitor.string(val->key.p, val->v.s.p, val->v.s.l);
+                break;
+            case TAGVAL_UINT64:
+                visitor.uint64(val->key.p, val->v.u64);
+                break;
+            case TAGVAL_DOUBLE:
+                visitor.real(val->key.p, val->v.d);
+                break;
+            case TAGVAL_BOOL:
+                visitor.boolean(val->key.p, val->v.b != 0);
+                break;
+        }
+    }
+}
+
 void Span::add_tag(const char *name, int copy_key, const char *value, int copy_value)
 {
     if (name && value) {
@@ -647,7 +802,7 @@ void Span::add_tag(const char *name, int copy_key, const char *value, size_t val
         m_parent->add_tag(name, copy_key, value, value_len, copy_value);
         return;
     }
-    auto *val = (tag_value *)calloc(1, sizeof(tag_value));
+    auto *val = tag_alloc();
     val->t = TAGVAL_STRING;
     val->key.need_free = copy_key;
     if (copy_key) {
@@ -657,7 +812,11 @@ void Span::add_tag(const char *name, int copy_key, const char *value, size_t val
     }
     val->v.s.need_free = copy_value;
     val->v.s.l = value_len;
-    if (copy_value) {
+    if (copy_value && value_len <= sizeof(val->inline_value)) {
+        val->v.s.need_free = 0;
+        val->v.s.p = val->inline_value;
+        memcpy(val->v.s.p, value, value_len);
+    } else if (copy_value) {
         val->v.s.p = (char *)calloc(value_len, sizeof(char));
         memcpy(val->v.s.p, value, value_len);
     } else {
@@ -678,7 +837,7 @@ void Span::add_tag(const char *name, int copy, uint64_t value)
         m_parent->add_tag(name, copy, value);
         return;
     }
-    auto *val = (tag_value *)calloc(1, sizeof(tag_value));
+    auto *val = tag_alloc();
     val->t = TAGVAL_UINT64;
     val->key.need_free = copy;
     if (copy) {
@@ -696,7 +855,7 @@ void Span::add_tag(const char *name, int copy, double value)
         m_parent->add_tag(name, copy, value);
         return;
     }
-    auto *val = (tag_value *)calloc(1, sizeof(tag_value));
+    auto *val = tag_alloc();
     val->t = TAGVAL_DOUBLE;
     val->key.need_free = copy;
     if (copy) {
@@ -714,7 +873,7 @@ void Span::add_tag(const char *name, int copy, bool value)
         m_parent->add_tag(name, copy, value);
         return;
     }
-    auto *val = (tag_value *)calloc(1, sizeof(tag_value));
+    auto *val = tag_alloc();
     val->t = TAGVAL_BOOL;
     val->key.need_free = copy;
     if (copy) {
@@ -17,6 +17,7 @@
 
 #include "internal.h"
 
+#include <algorithm>
 #include <iostream>
 #include <vector>
 
@@ -77,54 +78,92 @@ lcbtrace_TRACER *ThresholdLoggingTracer::wrap()
     return m_wrapper;
 }
 
-QueueEntry ThresholdLoggingTracer::convert(lcbtrace_SPAN *span)
+static void copy_tag(lcbtrace_SPAN *span, const char *name, char *buf, size_t nbuf)
+{
+    char *value;
+    size_t nvalue;
+    buf[0] = '\0';
+    if (lcbtrace_span_get_tag_str(span, name, &value, &nvalue) == LCB_SUCCESS) {
+        snprintf(buf, nbuf, "%.*s", (int)nvalue, value);
+    }
+}
+
+static void copy_socket(lcbtrace_SPAN *span, const char *address_name, const char *port_name, char *buf, size_t nbuf)
+{
+    char *address, *port;
+    size_t naddress, nport;
+    buf[0] = '\0';
+    if (lcbtrace_span_get_tag_str(span, address_name, &address, &naddress) == LCB_SUCCESS &&
+        lcbtrace_span_get_tag_str(span, port_name, &port, &nport) == LCB_SUCCESS) {
+        snprintf(buf, nbuf, "%.*s:%.*s", (int)naddress, address, (int)nport, port);
+    }
+}
+
+static void record(lcbtrace_SPAN *span, SpanRecord &rec)
+{
+    rec.duration = span->duration();
+    rec.kv = span->service() == LCBTRACE_THRESHOLD_KV;
+    rec.last_server = span->m_last_server;
+    rec.total_server = span->m_total_server;
+    rec.last_queue = span->m_last_queue;
+    rec.last_network = span->m_last_network;
+    rec.encode = span->m_encode;
+    rec.last_dispatch = span->m_last_dispatch;
+    rec.total_dispatch = span->m_total_dispatch;
+    snprintf(rec.operation_name, sizeof(rec.operation_name), "%s", span->m_opname);
+    copy_tag(span, LCBTRACE_TAG_OPERATION_ID, rec.operation_id, sizeof(rec.operation_id));
+    copy_tag(span, LCBTRACE_TAG_LOCAL_ID, rec.local_id, sizeof(rec.local_id));
+    copy_socket(span, LCBTRACE_TAG_LOCAL_ADDRESS, LCBTRACE_TAG_LOCAL_PORT, rec.local_socket, sizeof(rec.local_socket));
+    copy_socket(span, LCBTRACE_TAG_PEER_ADDRESS, LCBTRACE_TAG_PEER_PORT, rec.remote_socket, sizeof(rec.remote_socket));
+}
+
+static Json::Value format(const SpanRecord &rec)
 {
-    QueueEntry orphan;
-    orphan.duration = span->duration();
     Json::Value entry;
-    char *value, *value2;
-    size_t nvalue, nvalue2;
-
-    entry["operation_name"] = std::string(span->m_opname);
-    if (lcbtrace_span_get_tag_str(span, LCBTRACE_TAG_OPERATION_ID, &value, &nvalue) == LCB_SUCCESS) {
-        entry["last_operation_id"] = std::string(value, value + nvalue);
-    }
-    if (lcbtrace_span_get_tag_str(span, LCBTRACE_TAG_LOCAL_ID, &value, &nvalue) == LCB_SUCCESS) {
-        entry["last_local_id"] = std::string(value, value + nvalue);
-    }
-    if (lcbtrace_span_get_tag_str(span, LCBTRACE_TAG_LOCAL_ADDRESS, &value, &nvalue) == LCB_SUCCESS) {
-        if (lcbtrace_span_get_tag_str(span, LCBTRACE_TAG_LOCAL_PORT, &value2, &nvalue2) == LCB_SUCCESS) {
-            std::string address(value, value + nvalue);
-            address.append(":");
-            address.append(value2, nvalue2);
-            entry["last_local_socket"] = address;
-        }
+    entry["operation_name"] = rec.operation_name;
+    if (rec.operation_id[0]) {
+        entry["last_operation_id"] = rec.operation_id;
     }
-    if (lcbtrace_span_get_tag_str(span, LCBTRACE_TAG_PEER_ADDRESS, &value, &nvalue) == LCB_SUCCESS) {
-        if (lcbtrace_span_get_tag_str(span, LCBTRACE_TAG_PEER_PORT, &value2, &nvalue2) == LCB_SUCCESS) {
-            std::string address(value, value + nvalue);
-            address.append(":");
-            address.append(value2, nvalue2);
-            entry["last_remote_socket"] = address;
-        }
+    if (rec.local_id[0]) {
+        entry["last_local_id"] = rec.local_id;
+    }
+    if (rec.local_socket[0]) {
+        entry["last_local_socket"] = rec.local_socket;
     }
-    if (span->service() == LCBTRACE_THRESHOLD_KV) {
-        entry["last_server_duration_us"] = (Json::UInt64)span->m_last_server;
-        entry["total_server_duration_us"] = (Json::UInt64)span->m_total_server;
+    if (rec.remote_socket[0]) {
+        entry["last_remote_socket"] = rec.remote_socket;
     }
-    if (span->m_encode > 0) {
-        entry["encode_duration_us"] = (Json::UInt64)span->m_encode;
+    if (rec.kv) {
+        entry["last_server_duration_us"] = (Json::UInt64)rec.last_server;
+        entry["total_server_duration_us"] = (Json::UInt64)rec.total_server;
+        entry["last_queue_duration_us"] = (Json::UInt64)rec.last_queue;
+        entry["last_network_duration_us"] = (Json::UInt64)rec.last_network;
     }
-    entry["total_duration_us"] = (Json::UInt64)orphan.duration;
-    entry["last_dispatch_duration_us"] = (Json::UInt64)span->m_last_dispatch;
-    entry["total_dispatch_duration_us"] = (Json::UInt64)span->m_total_dispatch;
-    orphan.payload = Json::FastWriter().write(entry);
-    return orphan;
+    if (rec.encode > 0) {
+        entry["encode_duration_us"] = (Json::UInt64)rec.encode;
+    }
+    entry["total_duration_us"] = (Json::UInt64)rec.duration;
+    entry["last_dispatch_duration_us"] = (Json::UInt64)rec.last_dispatch;
+    entry["total_dispatch_duration_us"] = (Json::UInt64)rec.total_dispatch;
+    return entry;
+}
+
+QueueEntry ThresholdLoggingTracer::convert(lcbtrace_SPAN *span)
+{
+    SpanRecord rec;
+    record(span, rec);
+    QueueEntry entry;
+    entry.duration = rec.duration;
+    entry.payload = Json::FastWriter().write(format(rec));
+    return entry;
 }
 
 void ThresholdLoggingTracer::add_orphan(lcbtrace_SPAN *span)
 {
-    m_orphans.push(convert(span));
+    SpanRecord *rec = m_orphans.next();
+    if (rec != nullptr) {
+        record(span, *rec);
+    }
 }
 
 void ThresholdLoggingTracer::check_threshold(lcbtrace_SPAN *span)
@@ -134,16 +173,7 @@ void ThresholdLoggingTracer::check_threshold(lcbtrace_SPAN *span)
             return;
         }
         if (span->duration() > m_settings->tracer_threshold[span->service()]) {
-
-            auto it = m_queues.find(span->service_str());
-            if (it != m_queues.end()) {
-                // found the queue, so push this in.
-                it->second.push(convert(span));
-            } else {
-                // add a new queue, then push this in.
-                auto pr = m_queues.emplace(span->service_str(), FixedSpanQueue{m_threshold_queue_size});
-                pr.first->second.push(convert(span));
-            }
+            m_queues[span->service()].push(convert(span));
         }
     }
 }
@@ -165,7 +195,11 @@ void ThresholdLoggingTracer::flush_queue(FixedSpanQueue &queue, const char *mess
         queue.pop();
     }
     entries["top"] = top;
-    std::string doc = Json::FastWriter().write(entries);
+    log_report(Json::FastWriter().write(entries), message, warn);
+}
+
+void ThresholdLoggingTracer::log_report(std::string doc, const char *message, bool warn)
+{
     if (!doc.empty() && doc[doc.size() - 1] == '\n') {
         doc[doc.size() - 1] = '\0';
     }
@@ -181,14 +215,30 @@ void ThresholdLoggingTracer::do_flush_orphans()
     if (m_orphans.empty()) {
         return;
     }
-    flush_queue(m_orphans, "Orphan responses observed", nullptr, true);
+    std::vector<const SpanRecord *> records;
+    records.reserve(m_orphans.size());
+    m_orphans.drain([&records](const SpanRecord &rec) { records.push_back(&rec); });
+    std::stable_sort(records.begin(), records.end(),
+                     [](const SpanRecord *a, const SpanRecord *b) { return a->duration > b->duration; });
+
+    Json::Value entries;
+    entries["count"] = (Json::UInt)records.size();
+    Json::Value top;
+    for (const SpanRecord *rec : records) {
+        top.append(format(*rec));
+    }
+    entries["top"] = top;
+    log_report(Json::FastWriter().write(entries), "Orphan responses observed", true);
 }
 
 void ThresholdLoggingTracer::do_flush_threshold()
 {
-    for (auto &element : m_queues) {
-        if (!element.second.empty()) {
-            flush_queue(element.second, "Operations over threshold", element.first.c_str());
+    static const char *services[LCBTRACE_THRESHOLD__MAX] = {LCBTRACE_TAG_SERVICE_KV, LCBTRACE_TAG_SERVICE_N1QL,
+                                                            LCBTRACE_TAG_SERVICE_VIEW, LCBTRACE_TAG_SERVICE_SEARCH,
+                                                            LCBTRACE_TAG_SERVICE_ANALYTICS};
+    for (size_t ii = 0; ii < m_queues.size(); ii++) {
+        if (!m_queues[ii].empty()) {
+            flush_queue(m_queues[ii], "Operations over threshold", services[ii]);
         }
     }
 }
@@ -218,7 +268,8 @@ void ThresholdLoggingTracer::flush_threshold()
 ThresholdLoggingTracer::ThresholdLoggingTracer(lcb_INSTANCE *instance)
     : m_wrapper(nullptr), m_settings(instance->settings),
       m_threshold_queue_size(LCBT_SETTING(instance, tracer_threshold_queue_size)),
-      m_orphans(LCBT_SETTING(instance, tracer_orphaned_queue_size)), m_oflush(instance->iotable, this),
+      m_orphans(LCBT_SETTING(instance, tracer_orphaned_queue_size)),
+      m_queues(LCBTRACE_THRESHOLD__MAX, FixedSpanQueue(m_threshold_queue_size)), m_oflush(instance->iotable, this),
       m_tflush(instance->iotable, this)
 {
     lcb_U32 tv = m_settings->tracer_orphaned_queue_flush_interval;
@@ -25,6 +25,7 @@
 
 #include <queue>
 #include <map>
+#include <vector>
 #include <string>
 #include <memory>
 
@@ -46,6 +47,10 @@ class Span
          void *external_span);
     ~Span();
 
+    /** Spans are recycled through a per-thread cache instead of the heap */
+    static void *operator new(size_t size);
+    static void operator delete(void *ptr);
+
     void finish(uint64_t finish);
     uint64_t duration() const
     {
@@ -59,11 +64,23 @@ class Span
     void add_tag(const char *name, int copy, double value);
     void add_tag(const char *name, int copy, bool value);
 
+    /** Receives the tags of a span, see visit_tags() */
+    struct TagVisitor {
+        virtual ~TagVisitor() = default;
+        virtual void string(const char *key, const char *value, size_t nvalue) = 0;
+        virtual void uint64(const char *key, uint64_t value) = 0;
+        virtual void real(const char *key, double value) = 0;
+        virtual void boolean(const char *key, bool value) = 0;
+    };
+    /** Invoke @p visitor on every tag, in the order they were added */
+    void visit_tags(TagVisitor &visitor);
+
     void service(lcbtrace_THRESHOLDOPTS svc);
     lcbtrace_THRESHOLDOPTS service() const;
 
     void increment_dispatch(uint64_t dispatch_time);
     void increment_server(uint64_t server_time);
+    void record_breakdown(uint64_t queue_time, uint64_t network_time);
     lcbtrace_SPAN *find_outer_or_this();
 
     const char *service_str() const;
@@ -81,7 +98,9 @@ class Span
     void should_finish(bool finish);
 
     lcbtrace_TRACER *m_tracer;
-    std::string m_opname;
+    /** Either one of the LCBTRACE_OP_* constants, or m_opname_copy */
+    const char *m_opname;
+    std::string m_opname_copy;
     uint64_t m_span_id;
     uint64_t m_start;
     uint64_t m_finish{0};
@@ -99,6 +118,8 @@ class Span
     uint64_t m_last_dispatch{0};
     uint64_t m_total_server{0};
     uint64_t m_last_server{0};
+    uint64_t m_last_queue{0};
+    uint64_t m_last_network{0};
     uint64_t m_encode{0};
 };
 
@@ -134,6 +155,82 @@ class FixedQueue : private std::priority_queue<T>
     size_t m_capacity;
 };
 
+/**
+ * Keeps the latest `capacity` items, the oldest one is overwritten once full.
+ * All the items are allocated upfront.
+ */
+template <typename T>
+class FixedRing
+{
+  public:
+    explicit FixedRing(size_t capacity) : m_items(capacity) {}
+
+    /** @return the slot to overwrite with the newest item, or NULL if the capacity is 0 */
+    T *next()
+    {
+        if (m_items.empty()) {
+            return nullptr;
+        }
+        T *item = &m_items[m_head];
+        m_head = (m_head + 1) % m_items.size();
+        if (m_size < m_items.size()) {
+            m_size++;
+        }
+        return item;
+    }
+
+    /** Invokes `fn` on the items from the oldest to the newest one, and empties the ring */
+    template <typename F>
+    void drain(F fn)
+    {
+        if (m_size == 0) {
+            return;
+        }
+        size_t first = (m_head + m_items.size() - m_size) % m_items.size();
+        for (size_t ii = 0; ii < m_size; ii++) {
+            fn(m_items[(first + ii) % m_items.size()]);
+        }
+        m_size = 0;
+    }
+
+    bool empty() const
+    {
+        return m_size == 0;
+    }
+
+    size_t size() const
+    {
+        return m_size;
+    }
+
+  private:
+    std::vector<T> m_items;
+    size_t m_head{0};
+    size_t m_size{0};
+};
+
+/**
+ * What is reported about a span, copied out of it without allocating so that it
+ * may be formatted later on.
+ */
+struct SpanRecord {
+    uint64_t duration;
+    uint64_t last_server;
+    uint64_t total_server;
+    uint64_t last_queue;
+    uint64_t last_network;
+    uint64_t encode;
+    uint64_t last_dispatch;
+    uint64_t total_dispatch;
+    bool kv;
+    /** The strings are truncated, and empty if the span has no such tag */
+    char operation_name[48];
+    char operation_id[48];
+    char local_id[48];
+    char local_socket[64];
+    char remote_socket[64];
+};
+
 typedef ReportedSpan QueueEntry;
 typedef FixedQueue<QueueEntry> FixedSpanQueue;
 class ThresholdLoggingTracer
@@ -142,10 +239,13 @@ class ThresholdLoggingTracer
     lcb_settings *m_settings;
     size_t m_threshold_queue_size;
 
-    FixedSpanQueue m_orphans;
-    std::map<std::string, FixedSpanQueue> m_queues;
+    /** Orphans are only formatted when flushed, see do_flush_orphans() */
+    FixedRing<SpanRecord> m_orphans;
+    /** Indexed by lcbtrace_THRESHOLDOPTS */
+    std::vector<FixedSpanQueue> m_queues;
 
     void flush_queue(FixedSpanQueue &queue, const char *message, const char *service, bool warn);
+    void log_report(std::string doc, const char *message, bool warn);
     QueueEntry convert(lcbtrace_SPAN *span);
 
   public:
@@ -164,14 +264,34 @@ class ThresholdLoggingTracer
     lcb::io::Timer<ThresholdLoggingTracer, &ThresholdLoggingTracer::flush_threshold> m_tflush;
 };
 
+/**
+ * Whether an operation without a parent span should be traced, see
+ * LCB_CNTL_TRACING_SAMPLE_RATE
+ */
+inline bool sample_span(const lcb_settings *settings)
+{
+    return settings->tracer_sample_rate >= 1 ||
+           lcb_next_rand32() < static_cast<double>(settings->tracer_sample_rate) * 4294967296.0;
+}
+
 template <typename COMMAND>
 lcbtrace_SPAN *start_kv_span(const lcb_settings *settings, const mc_PACKET *packet, std::shared_ptr<COMMAND> cmd)
 {
+#ifdef LCB_NO_TRACING
+    /* KV operations are never traced in this build, whatever the tracer */
+    (void)settings;
+    (void)packet;
+    (void)cmd;
+    return nullptr;
+#else
     if (settings == nullptr || settings->tracer == nullptr) {
         return nullptr;
     }
     lcbtrace_SPAN *span;
     lcbtrace_SPAN *parent_span = cmd->parent_span();
+    if (parent_span == nullptr && !sample_span(settings)) {
+        return nullptr;
+    }
     if (parent_span != nullptr && parent_span->is_outer() && settings->tracer->flags & LCBTRACE_F_THRESHOLD) {
         span = parent_span;
         span->should_finish(false);
@@ -187,16 +307,22 @@ lcbtrace_SPAN *start_kv_span(const lcb_settings *settings, const mc_PACKET *pack
         span->is_outer(!is_dispatch);
     }
     span->is_dispatch(true);
-    std::string operation_id = std::to_string(packet->opaque);
-    lcbtrace_span_add_tag_str(span, LCBTRACE_TAG_OPERATION_ID, operation_id.c_str());
+    char operation_id[16];
+    snprintf(operation_id, sizeof(operation_id), "%" PRIu32, packet->opaque);
+    lcbtrace_span_add_tag_str(span, LCBTRACE_TAG_OPERATION_ID, operation_id);
     lcbtrace_span_add_system_tags(span, settings, LCBTRACE_THRESHOLD_KV);
     span->add_tag(LCBTRACE_TAG_SCOPE, cmd->collection().scope());
     span->add_tag(LCBTRACE_TAG_COLLECTION, cmd->collection().collection());
     span->add_tag(LCBTRACE_TAG_OPERATION, 0, cmd->operation_name(), 0);
     return span;
+#endif
 }
 
+#ifdef LCB_NO_TRACING
+inline void finish_kv_span(const mc_PIPELINE *, const mc_PACKET *, const MemcachedResponse *) {}
+#else
 void finish_kv_span(const mc_PIPELINE *pipeline, const mc_PACKET *request_pkt, const MemcachedResponse *response_pkt);
+#endif
 
 template <typename COMMAND>
 lcbtrace_SPAN *start_kv_span_with_durability(const lcb_settings *settings, const mc_PACKET *packet,
@@ -217,6 +343,9 @@ lcbtrace_SPAN *start_http_span(const lcb_settings *settings, const COMMAND *cmd)
     }
     lcbtrace_SPAN *span;
     lcbtrace_SPAN *parent_span = cmd->parent_span();
+    if (parent_span == nullptr && !sample_span(settings)) {
+        return nullptr;
+    }
     if (parent_span != nullptr && parent_span->is_outer() && settings->tracer->flags & LCBTRACE_F_THRESHOLD) {
         span = parent_span;
         span->should_finish(false);
@@ -28,6 +28,15 @@
 #include "utilities.h"
 #include "rnd.h"
 
+#if defined(__GNUC__)
+#define JSONSL_API static __attribute__((unused))
+#elif defined(_MSC_VER)
+#define JSONSL_API static __inline
+#else
+#define JSONSL_API static
+#endif
+#include "contrib/jsonsl/jsonsl.c"
+
 #define STRINGIFY_(X) #X
 #define STRINGIFY(X) STRINGIFY_(X)
 #define MAX_AUTHORITY_SIZE 100
@@ -41,6 +50,8 @@
  ** Core Parsing Routines                                                    **
  ******************************************************************************
  ******************************************************************************/
+#define MAX_VB_SERVERS (sizeof(((lcbvb_VBUCKET *)NULL)->servers) / sizeof(int))
+
 static lcbvb_VBUCKET *build_vbmap(lcbvb_CONFIG *cfg, cJSON *cj, unsigned *nitems)
 {
     lcbvb_VBUCKET *vblist = NULL;
@@ -72,7 +83,7 @@ static lcbvb_VBUCKET *build_vbmap(lcbvb_CONFIG *cfg, cJSON *cj, unsigned *nitems
         cvb = vblist + ii;
 
         /* Iterate over each index in the vbucket */
-        for (jj = 0; jj < nservers && jsix; ++jj, jsix = jsix->next) {
+        for (jj = 0; jj < nservers && jj < MAX_VB_SERVERS && jsix; ++jj, jsix = jsix->next) {
             if (jsix->type != cJSON_Number) {
                 goto GT_ERR;
             }
@@ -92,6 +103,251 @@ GT_ERR:
     return NULL;
 }
 
+/**
+ * The vBucket maps make up the bulk of a bucket configuration, so building
+ * a cJSON node for each of their entries is the most expensive part of
+ * loading it. They are instead extracted in a single jsonsl pass, straight
+ * into lcbvb_VBUCKET arrays, and cut out of the text handed to cJSON.
+ *
+ * Anything unexpected within the maps makes the extraction fail, in which
+ * case the whole document is parsed with cJSON and build_vbmap() as before.
+ */
+enum { VBSTREAM_MAP = 0, VBSTREAM_FFMAP, VBSTREAM_NMAPS };
+
+typedef struct {
+    const char *text;
+    lcbvb_VBUCKET *vbs[VBSTREAM_NMAPS];
+    unsigned nvbs[VBSTREAM_NMAPS];
+    unsigned nalloc[VBSTREAM_NMAPS];
+    /** Offsets of the opening and closing brackets of each map */
+    size_t begin[VBSTREAM_NMAPS];
+    size_t end[VBSTREAM_NMAPS];
+    int found[VBSTREAM_NMAPS];
+    /** Map currently being read, or -1 */
+    int cur;
+    /** Set while inside the top-level 'vBucketServerMap' object */
+    int in_vbconfig;
+    /** Last key seen in the root object, and in 'vBucketServerMap' */
+    const char *key[2];
+    size_t nkey[2];
+    int failed;
+} vbSTREAM;
+
+#define VBSTREAM_KEYIS(st, ix, s) ((st)->nkey[ix] == sizeof(s) - 1 && memcmp((st)->key[ix], s, sizeof(s) - 1) == 0)
+
+static void vbstream_fail(jsonsl_t jsn, vbSTREAM *st)
+{
+    st->failed = 1;
+    jsonsl_stop(jsn);
+}
+
+static void vbstream_push(jsonsl_t jsn, jsonsl_action_t action, struct jsonsl_state_st *state, const jsonsl_char_t *at)
+{
+    vbSTREAM *st = jsn->data;
+    (void)action;
+    (void)at;
+
+    if (st->cur == -1) {
+        int ix = -1;
+        if (state->level == 2 && state->type == JSONSL_T_OBJECT && VBSTREAM_KEYIS(st, 0, "vBucketServerMap")) {
+            st->in_vbconfig = 1;
+            return;
+        }
+        if (state->level != 3 || !st->in_vbconfig || state->type != JSONSL_T_LIST) {
+            return;
+        }
+        if (VBSTREAM_KEYIS(st, 1, "vBucketMap")) {
+            ix = VBSTREAM_MAP;
+        } else if (VBSTREAM_KEYIS(st, 1, "vBucketMapForward")) {
+            ix = VBSTREAM_FFMAP;
+        } else {
+            return;
+        }
+        if (st->found[ix]) {
+            vbstream_fail(jsn, st);
+            return;
+        }
+        st->found[ix] = 1;
+        st->begin[ix] = state->pos_begin;
+        st->cur = ix;
+
+    } else if (state->level == 4) {
+        int ix = st->cur;
+        if (state->type != JSONSL_T_LIST) {
+            vbstream_fail(jsn, st);
+            return;
+        }
+        if (st->nvbs[ix] == st->nalloc[ix]) {
+            unsigned nalloc = st->nalloc[ix] ? st->nalloc[ix] * 2 : 1024;
+            lcbvb_VBUCKET *vbs = realloc(st->vbs[ix], nalloc * sizeof(*vbs));
+            if (!vbs) {
+                vbstream_fail(jsn, st);
+                return;
+            }
+            st->vbs[ix] = vbs;
+            st->nalloc[ix] = nalloc;
+        }
+        memset(st->vbs[ix] + st->nvbs[ix], 0, sizeof(*st->vbs[ix]));
+        st->nvbs[ix]++;
+
+    } else if (state->type != JSONSL_T_SPECIAL) {
+        /* Strings, objects, or lists nested too deep */
+        vbstream_fail(jsn, st);
+    }
+}
+
+static void vbstream_pop(jsonsl_t jsn, jsonsl_action_t action, struct jsonsl_state_st *state, const jsonsl_char_t *at)
+{
+    vbSTREAM *st = jsn->data;
+    (void)action;
+    (void)at;
+
+    if (state->type == JSONSL_T_HKEY) {
+        int ix;
+        if (state->level == 2) {
+            ix = 0;
+        } else if (state->level == 3 && st->in_vbconfig) {
+            ix = 1;
+        } else {
+            return;
+        }
+        /* Skip the quotes. Keys with escapes never match, which is fine */
+        st->key[ix] = st->text + state->pos_begin + 1;
+        st->nkey[ix] = jsn->pos - state->pos_begin - 1;
+
+    } else if (st->cur == -1) {
+        if (state->level == 2 && state->type == JSONSL_T_OBJECT) {
+            st->in_vbconfig = 0;
+        }
+
+    } else if (state->level == 3) {
+        st->end[st->cur] = jsn->pos;
+        st->cur = -1;
+
+    } else if (state->level == 5) {
+        struct jsonsl_state_st *parent = jsonsl_last_state(jsn, state);
+        lcbvb_VBUCKET *vb = st->vbs[st->cur] + st->nvbs[st->cur] - 1;
+        size_t jj = parent->nelem - 1;
+
+        if (!(state->special_flags & JSONSL_SPECIALf_NUMERIC) || (state->special_flags & JSONSL_SPECIALf_NUMNOINT)) {
+            vbstream_fail(jsn, st);
+            return;
+        }
+        if (jj < MAX_VB_SERVERS) {
+            vb->servers[jj] = (state->special_flags & JSONSL_SPECIALf_SIGNED) ? -(int)state->nelem : (int)state->nelem;
+        }
+    }
+}
+
+static int vbstream_error(jsonsl_t jsn, jsonsl_error_t err, struct jsonsl_state_st *state, jsonsl_char_t *at)
+{
+    vbSTREAM *st = jsn->data;
+    st->failed = 1;
+    (void)err;
+    (void)state;
+    (void)at;
+    return 0;
+}
+
+static void vbstream_cleanup(vbSTREAM *st)
+{
+    free(st->vbs[VBSTREAM_MAP]);
+    free(st->vbs[VBSTREAM_FFMAP]);
+    memset(st, 0, sizeof(*st));
+    st->cur = -1;
+}
+
+/**
+ * Extract the vBucket maps from a configuration
+ * @param st the state to initialize. vbstream_cleanup() must be called on it
+ * @param data the configuration text
+ * @return a copy of the text with the contents of the maps removed, or NULL
+ * if the maps could not be extracted and the text should be parsed as is
+ */
+static char *vbstream_extract(vbSTREAM *st, const char *data)
+{
+    jsonsl_t jsn;
+    size_t ndata = strlen(data), pos = 0, nout = 0;
+    char *out;
+    int ii, order[VBSTREAM_NMAPS] = {VBSTREAM_MAP, VBSTREAM_FFMAP};
+
+    memset(st, 0, sizeof(*st));
+    st->text = data;
+    st->cur = -1;
+
+    if ((jsn = jsonsl_new(64)) == NULL) {
+        return NULL;
+    }
+    jsn->data = st;
+    jsn->action_callback_PUSH = vbstream_push;
+    jsn->action_callback_POP = vbstream_pop;
+    jsn->error_callback = vbstream_error;
+    jsn->call_OBJECT = 1;
+    jsn->call_LIST = 1;
+    jsn->call_SPECIAL = 1;
+    jsn->call_HKEY = 1;
+    jsn->call_STRING = 1;
+    jsonsl_feed(jsn, data, ndata);
+    jsonsl_destroy(jsn);
+
+    if (st->failed || st->cur != -1 || !st->found[VBSTREAM_MAP]) {
+        vbstream_cleanup(st);
+        return NULL;
+    }
+
+    if ((out = malloc(ndata + 1)) == NULL) {
+        vbstream_cleanup(st);
+        return NULL;
+    }
+    if (st->found[VBSTREAM_FFMAP] && st->begin[VBSTREAM_FFMAP] < st->begin[VBSTREAM_MAP]) {
+        order[0] = VBSTREAM_FFMAP;
+        order[1] = VBSTREAM_MAP;
+    }
+    for (ii = 0; ii < VBSTREAM_NMAPS; ii++) {
+        int ix = order[ii];
+        size_t nchunk;
+        if (!st->found[ix]) {
+            continue;
+        }
+        /* Keep everything up to and including the opening bracket */
+        nchunk = st->begin[ix] + 1 - pos;
+        memcpy(out + nout, data + pos, nchunk);
+        nout += nchunk;
+        pos = st->end[ix];
+    }
+    memcpy(out + nout, data + pos, ndata - pos);
+    nout += ndata - pos;
+    out[nout] = '\0';
+    return out;
+}
+
+/**
+ * Move an extracted map into the configuration, checking its server indexes
+ */
+static lcbvb_VBUCKET *take_vbmap(lcbvb_CONFIG *cfg, vbSTREAM *st, int ix, unsigned *nitems)
+{
+    lcbvb_VBUCKET *vblist = st->vbs[ix];
+    unsigned ii, jj, nservers = cfg->nrepl + 1;
+
+    if (!st->nvbs[ix]) {
+        return NULL;
+    }
+    if (nservers > MAX_VB_SERVERS) {
+        nservers = MAX_VB_SERVERS;
+    }
+    for (ii = 0; ii < st->nvbs[ix]; ii++) {
+        for (jj = 0; jj < nservers; jj++) {
+            if (vblist[ii].servers[jj] > (int)cfg->nsrv - 1) {
+                SET_ERRSTR(cfg, "Invalid vBucket map received from server. Above-bounds vBucket target found");
+                return NULL;
+            }
+        }
+    }
+    st->vbs[ix] = NULL;
+    *nitems = st->nvbs[ix];
+    return vblist;
+}
+
 static void copy_address(char *buf, size_t nbuf, const char *host, lcb_U16 port)
 {
     if (strchr(host, ':')) {
@@ -215,7 +471,7 @@ GT_ERROR:
     return 0;
 }
 
-static int parse_vbucket(lcbvb_CONFIG *cfg, cJSON *cj)
+static int parse_vbucket(lcbvb_CONFIG *cfg, cJSON *cj, vbSTREAM *st)
 {
     cJSON *vbconfig, *vbmap, *ffmap = NULL;
 
@@ -236,12 +492,21 @@ static int parse_vbucket(lcbvb_CONFIG *cfg, cJSON *cj)
 
     get_jarray(vbconfig, "vBucketMapForward", &ffmap);
 
-    if ((cfg->vbuckets = build_vbmap(cfg, vbmap, &cfg->nvb)) == NULL) {
-        goto GT_ERROR;
-    }
-
-    if (ffmap && (cfg->ffvbuckets = build_vbmap(cfg, ffmap, &cfg->nvb)) == NULL) {
-        goto GT_ERROR;
+    if (st->found[VBSTREAM_MAP]) {
+        if ((cfg->vbuckets = take_vbmap(cfg, st, VBSTREAM_MAP, &cfg->nvb)) == NULL) {
+            goto GT_ERROR;
+        }
+        if (st->found[VBSTREAM_FFMAP] &&
+            (cfg->ffvbuckets = take_vbmap(cfg, st, VBSTREAM_FFMAP, &cfg->nvb)) == NULL) {
+            goto GT_ERROR;
+        }
+    } else {
+        if ((cfg->vbuckets = build_vbmap(cfg, vbmap, &cfg->nvb)) == NULL) {
+            goto GT_ERROR;
+        }
+        if (ffmap && (cfg->ffvbuckets = build_vbmap(cfg, ffmap, &cfg->nvb)) == NULL) {
+            goto GT_ERROR;
+        }
     }
 
     if (!cfg->is3x) {
@@ -277,13 +542,30 @@ static int continuum_item_cmp(const void *t1, const void *t2)
     }
 }
 
+/**
+ * Lay out the sorted continuum as an implicit binary search tree, in breadth
+ * first (Eytzinger) order: the children of node k are 2k and 2k+1. The nodes
+ * visited by a search are then close together in memory, and the first few
+ * levels share cache lines.
+ */
+static unsigned ketama_fill_tree(const lcbvb_CONTINUUM *sorted, lcbvb_CONTINUUM *tree, unsigned n, unsigned pos,
+                                 unsigned k)
+{
+    if (k <= n) {
+        pos = ketama_fill_tree(sorted, tree, n, pos, 2 * k);
+        tree[k] = sorted[pos++];
+        pos = ketama_fill_tree(sorted, tree, n, pos, 2 * k + 1);
+    }
+    return pos;
+}
+
 static int update_ketama(lcbvb_CONFIG *cfg)
 {
     char host[MAX_AUTHORITY_SIZE + 10] = "";
     int nhost;
     unsigned pp, hh, ss, nn;
     unsigned char digest[16];
-    lcbvb_CONTINUUM *new_continuum, *old_continuum;
+    lcbvb_CONTINUUM *new_continuum, *old_continuum, *new_tree;
 
     qsort(cfg->servers, cfg->ndatasrv, sizeof(*cfg->servers), server_cmp);
 
@@ -305,10 +587,15 @@ static int update_ketama(lcbvb_CONFIG *cfg)
     }
 
     qsort(new_continuum, pp, sizeof *new_continuum, continuum_item_cmp);
+    new_tree = calloc(pp + 1, sizeof(*new_tree));
+    ketama_fill_tree(new_continuum, new_tree, pp, 0, 1);
+
     old_continuum = cfg->continuum;
     cfg->continuum = new_continuum;
     cfg->ncontinuum = pp;
     free(old_continuum);
+    free(cfg->ketama_tree);
+    cfg->ketama_tree = new_tree;
     return 1;
 }
 
@@ -418,6 +705,11 @@ static int build_server_3x(lcbvb_CONFIG *cfg, lcbvb_SERVER *server, cJSON *js, c
         goto GT_ERR;
     }
 
+    if (get_jstr(js, "serverGroup", &htmp) && !(server->server_group = lcb_strdup(htmp))) {
+        SET_ERRSTR(cfg, "Couldn't allocate memory");
+        goto GT_ERR;
+    }
+
     if (network && *network && strcmp(*network, "default") != 0) {
         cJSON *jaltaddr = cJSON_GetObjectItem(js, "alternateAddresses");
         if (jaltaddr && jaltaddr->type == cJSON_Object) {
@@ -546,6 +838,10 @@ static int build_server_2x(lcbvb_CONFIG *cfg, lcbvb_SERVER *server, cJSON *js)
     if (!build_server_strings(cfg, server)) {
         goto GT_ERR;
     }
+    if (get_jstr(js, "serverGroup", &tmp) && !(server->server_group = lcb_strdup(tmp))) {
+        SET_ERRSTR(cfg, "Couldn't allocate memory");
+        goto GT_ERR;
+    }
     return 1;
 
 GT_ERR:
@@ -587,7 +883,11 @@ static void guess_network(cJSON *jnodes, int nsrv, const char *source, char **ne
     *network = lcb_strdup("default");
 }
 
-int lcbvb_load_json_ex(lcbvb_CONFIG *cfg, const char *data, const char *source, char **network)
+/**
+ * Load a configuration whose vBucket maps, if any, have already been
+ * extracted into `st`. The state is cleaned up in any case.
+ */
+static int load_json(lcbvb_CONFIG *cfg, const char *data, const char *source, char **network, vbSTREAM *st)
 {
     cJSON *cj = NULL, *jnodes_ext = NULL, *jnodes = NULL, *buckets = NULL;
     char *tmp = NULL;
@@ -739,7 +1039,7 @@ int lcbvb_load_json_ex(lcbvb_CONFIG *cfg, const char *data, const char *source,
     cfg->ndatasrv = ii;
 
     if (cfg->dtype == LCBVB_DIST_VBUCKET) {
-        if (!parse_vbucket(cfg, cj)) {
+        if (!parse_vbucket(cfg, cj, st)) {
             SET_ERRSTR(cfg, "Failed to parse vBucket map");
             goto GT_ERROR;
         }
@@ -755,20 +1055,124 @@ int lcbvb_load_json_ex(lcbvb_CONFIG *cfg, const char *data, const char *source,
     cfg->servers = realloc(cfg->servers, sizeof(*cfg->servers) * cfg->nsrv);
     cfg->randbuf = malloc(cfg->nsrv * sizeof(*cfg->randbuf));
     cJSON_Delete(cj);
+    vbstream_cleanup(st);
     return 0;
 
 GT_ERROR:
     if (cj) {
         cJSON_Delete(cj);
     }
+    vbstream_cleanup(st);
     return -1;
 }
 
+int lcbvb_load_json_ex(lcbvb_CONFIG *cfg, const char *data, const char *source, char **network)
+{
+    vbSTREAM st;
+    char *stripped = vbstream_extract(&st, data);
+    int rv = load_json(cfg, stripped ? stripped : data, source, network, &st);
+    free(stripped);
+    return rv;
+}
+
 int lcbvb_load_json(lcbvb_CONFIG *cfg, const char *data)
 {
     return lcbvb_load_json_ex(cfg, data, NULL, NULL);
 }
 
+typedef struct {
+    const char *text;
+    const char *key;
+    size_t nkey;
+    int64_t revepoch;
+    int64_t revid;
+    int is_object;
+    int failed;
+} vbREVPEEK;
+
+static void revpeek_push(jsonsl_t jsn, jsonsl_action_t action, struct jsonsl_state_st *state, const jsonsl_char_t *at)
+{
+    vbREVPEEK *peek = jsn->data;
+    (void)action;
+    (void)at;
+    if (state->level == 1) {
+        peek->is_object = state->type == JSONSL_T_OBJECT;
+        if (!peek->is_object) {
+            jsonsl_stop(jsn);
+        }
+    }
+}
+
+static void revpeek_pop(jsonsl_t jsn, jsonsl_action_t action, struct jsonsl_state_st *state, const jsonsl_char_t *at)
+{
+    vbREVPEEK *peek = jsn->data;
+    (void)action;
+    (void)at;
+
+    if (state->level == 1) {
+        jsonsl_stop(jsn);
+    } else if (state->type == JSONSL_T_HKEY) {
+        peek->key = peek->text + state->pos_begin + 1;
+        peek->nkey = jsn->pos - state->pos_begin - 1;
+    } else if (state->type == JSONSL_T_SPECIAL && (state->special_flags & JSONSL_SPECIALf_NUMERIC) &&
+               !(state->special_flags & JSONSL_SPECIALf_NUMNOINT)) {
+        int64_t value = (int64_t)state->nelem;
+        if (state->special_flags & JSONSL_SPECIALf_SIGNED) {
+            value = -value;
+        }
+        if (peek->nkey == 3 && memcmp(peek->key, "rev", 3) == 0) {
+            peek->revid = value;
+        } else if (peek->nkey == 8 && memcmp(peek->key, "revEpoch", 8) == 0) {
+            peek->revepoch = value;
+        }
+    }
+}
+
+static int revpeek_error(jsonsl_t jsn, jsonsl_error_t err, struct jsonsl_state_st *state, jsonsl_char_t *at)
+{
+    vbREVPEEK *peek = jsn->data;
+    peek->failed = 1;
+    (void)err;
+    (void)state;
+    (void)at;
+    return 0;
+}
+
+int lcbvb_get_json_revision(const char *data, int64_t *revepoch, int64_t *revid)
+{
+    jsonsl_t jsn;
+    vbREVPEEK peek;
+
+    memset(&peek, 0, sizeof(peek));
+    peek.text = data;
+    peek.revepoch = -1;
+    peek.revid = -1;
+
+    if ((jsn = jsonsl_new(64)) == NULL) {
+        return -1;
+    }
+    jsn->data = &peek;
+    jsn->action_callback_PUSH = revpeek_push;
+    jsn->action_callback_POP = revpeek_pop;
+    jsn->error_callback = revpeek_error;
+    jsn->call_OBJECT = 1;
+    jsn->call_LIST = 1;
+    jsn->call_SPECIAL = 1;
+    jsn->call_HKEY = 1;
+    jsn->call_STRING = 1;
+    /* Only the root object and its direct members are of interest */
+    jsn->max_callback_level = 3;
+    jsonsl_feed(jsn, data, strlen(data));
+    jsonsl_destroy(jsn);
+
+    if (peek.failed || !peek.is_object) {
+        return -1;
+    }
+    *revepoch = peek.revepoch;
+    *revid = peek.revid;
+    return 0;
+}
+
 static void replace_hoststr(char **orig, const char *replacement)
 {
     char *match;
@@ -883,11 +1287,13 @@ void lcbvb_destroy(lcbvb_CONFIG *conf)
         free_service_strs(&srv->svc_ssl);
         free(srv->authority);
         free(srv->alt_hostname);
+        free(srv->server_group);
         free_service_strs(&srv->alt_svc);
         free_service_strs(&srv->alt_svc_ssl);
     }
     free(conf->servers);
     free(conf->continuum);
+    free(conf->ketama_tree);
     free(conf->buuid);
     free(conf->bname);
     free(conf->vbuckets);
@@ -973,6 +1379,10 @@ char *lcbvb_save_json(lcbvb_CONFIG *cfg)
 
         tmp = cJSON_CreateString(srv->hostname);
         cJSON_AddItemToObject(sj, "hostname", tmp);
+        if (srv->server_group) {
+            tmp = cJSON_CreateString(srv->server_group);
+            cJSON_AddItemToObject(sj, "serverGroup", tmp);
+        }
         svcs_to_json(&srv->svc, jsvc, 0);
         svcs_to_json(&srv->svc_ssl, jsvc, 1);
 
@@ -1049,6 +1459,130 @@ char *lcbvb_save_json(lcbvb_CONFIG *cfg)
     return ret;
 }
 
+/**
+ * Layout of the binary form. The vBucket tables follow the header as arrays
+ * of lcbvb_VBUCKET, and the remainder of the configuration follows them as
+ * NUL-terminated JSON without the contents of the vBucket maps.
+ */
+typedef struct {
+    char magic[8];
+    lcb_U32 version;
+    /** Written as 0x01020304, to detect files from hosts of a different byte order */
+    lcb_U32 byteorder;
+    lcb_U32 vbsize;
+    lcb_U32 nvb;
+    lcb_U32 nffvb;
+    lcb_U32 njson;
+    int64_t revepoch;
+    int64_t revid;
+} vbBINHDR;
+
+#define VBBIN_VERSION 1
+#define VBBIN_BYTEORDER 0x01020304
+
+char *lcbvb_save_binary(lcbvb_CONFIG *cfg, lcb_SIZE *nbuf)
+{
+    vbBINHDR hdr;
+    vbSTREAM st;
+    char *json, *stripped, *ret, *pos;
+    const char *text;
+    size_t nvbs, nffvbs;
+
+    if ((json = lcbvb_save_json(cfg)) == NULL) {
+        return NULL;
+    }
+    stripped = vbstream_extract(&st, json);
+    vbstream_cleanup(&st);
+    text = stripped ? stripped : json;
+
+    nvbs = cfg->vbuckets ? cfg->nvb : 0;
+    nffvbs = cfg->ffvbuckets ? cfg->nvb : 0;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, LCBVB_BINARY_MAGIC, sizeof(hdr.magic));
+    hdr.version = VBBIN_VERSION;
+    hdr.byteorder = VBBIN_BYTEORDER;
+    hdr.vbsize = sizeof(lcbvb_VBUCKET);
+    hdr.nvb = (lcb_U32)nvbs;
+    hdr.nffvb = (lcb_U32)nffvbs;
+    hdr.njson = (lcb_U32)strlen(text) + 1;
+    hdr.revepoch = cfg->revepoch;
+    hdr.revid = cfg->revid;
+
+    *nbuf = sizeof(hdr) + (nvbs + nffvbs) * sizeof(lcbvb_VBUCKET) + hdr.njson;
+    if ((ret = malloc(*nbuf)) != NULL) {
+        pos = ret;
+        memcpy(pos, &hdr, sizeof(hdr));
+        pos += sizeof(hdr);
+        if (nvbs) {
+            memcpy(pos, cfg->vbuckets, nvbs * sizeof(lcbvb_VBUCKET));
+            pos += nvbs * sizeof(lcbvb_VBUCKET);
+        }
+        if (nffvbs) {
+            memcpy(pos, cfg->ffvbuckets, nffvbs * sizeof(lcbvb_VBUCKET));
+            pos += nffvbs * sizeof(lcbvb_VBUCKET);
+        }
+        memcpy(pos, text, hdr.njson);
+    }
+    free(stripped);
+    free(json);
+    return ret;
+}
+
+static lcbvb_VBUCKET *copy_vbtable(const char *buf, unsigned n)
+{
+    lcbvb_VBUCKET *vbs;
+    if (!n || (vbs = malloc(n * sizeof(*vbs))) == NULL) {
+        return NULL;
+    }
+    memcpy(vbs, buf, n * sizeof(*vbs));
+    return vbs;
+}
+
+int lcbvb_load_binary(lcbvb_CONFIG *cfg, const void *buf, lcb_SIZE nbuf)
+{
+    vbBINHDR hdr;
+    vbSTREAM st;
+    const char *body = (const char *)buf + sizeof(hdr);
+    lcb_U64 ntables;
+
+    if (nbuf < sizeof(hdr)) {
+        SET_ERRSTR(cfg, "Binary configuration is truncated");
+        return -1;
+    }
+    memcpy(&hdr, buf, sizeof(hdr));
+    if (memcmp(hdr.magic, LCBVB_BINARY_MAGIC, sizeof(hdr.magic)) != 0 || hdr.version != VBBIN_VERSION ||
+        hdr.byteorder != VBBIN_BYTEORDER || hdr.vbsize != sizeof(lcbvb_VBUCKET)) {
+        SET_ERRSTR(cfg, "Unsupported binary configuration format");
+        return -1;
+    }
+    ntables = ((lcb_U64)hdr.nvb + hdr.nffvb) * sizeof(lcbvb_VBUCKET);
+    if (nbuf - sizeof(hdr) != ntables + hdr.njson || hdr.njson == 0 || body[ntables + hdr.njson - 1] != '\0' ||
+        (hdr.nffvb && hdr.nffvb != hdr.nvb)) {
+        SET_ERRSTR(cfg, "Binary configuration is truncated");
+        return -1;
+    }
+
+    memset(&st, 0, sizeof(st));
+    st.cur = -1;
+    if (hdr.nvb) {
+        st.found[VBSTREAM_MAP] = 1;
+        st.nvbs[VBSTREAM_MAP] = hdr.nvb;
+        if ((st.vbs[VBSTREAM_MAP] = copy_vbtable(body, hdr.nvb)) == NULL) {
+            return -1;
+        }
+    }
+    if (hdr.nffvb) {
+        st.found[VBSTREAM_FFMAP] = 1;
+        st.nvbs[VBSTREAM_FFMAP] = hdr.nffvb;
+        if ((st.vbs[VBSTREAM_FFMAP] = copy_vbtable(body + hdr.nvb * sizeof(lcbvb_VBUCKET), hdr.nffvb)) == NULL) {
+            vbstream_cleanup(&st);
+            return -1;
+        }
+    }
+    return load_json(cfg, body + ntables, NULL, NULL, &st);
+}
+
 /******************************************************************************
  ******************************************************************************
  ** Mapping Routines                                                         **
@@ -1057,47 +1591,25 @@ char *lcbvb_save_json(lcbvb_CONFIG *cfg)
 
 static int map_ketama(lcbvb_CONFIG *cfg, const void *key, size_t nkey)
 {
-    uint32_t digest, mid, prev;
-    lcbvb_CONTINUUM *beginp, *endp, *midp, *highp, *lowp;
+    const lcbvb_CONTINUUM *tree = cfg->ketama_tree;
+    unsigned n = cfg->ncontinuum, k = 1, found = 0;
+    uint32_t digest;
     lcb_assert(cfg->continuum);
     digest = vb__hash_ketama(key, nkey);
-    beginp = lowp = cfg->continuum;
-    endp = highp = cfg->continuum + cfg->ncontinuum;
-
-    /* divide and conquer array search to find server with next biggest
-     * point after what this key hashes to */
-    while (1) {
-        /* pick the middle point */
-        midp = lowp + (highp - lowp) / 2;
-
-        if (midp == endp) {
-            /* if at the end, roll back to zeroth */
-            return beginp->index;
-            break;
-        }
-
-        mid = midp->point;
-        prev = (midp == beginp) ? 0 : (midp - 1)->point;
-
-        if (digest <= mid && digest > prev) {
-            /* we found nearest server */
-            return midp->index;
-            break;
-        }
 
-        /* adjust the limits */
-        if (mid < digest) {
-            lowp = midp + 1;
-        } else {
-            highp = midp - 1;
-        }
-
-        if (lowp > highp) {
-            return beginp->index;
-            break;
-        }
+    /* find the first point not below the digest. The loop body has no
+     * data-dependent branch: the position of the candidate is kept with a
+     * conditional move, and the descent always goes down to a leaf */
+    while (k <= n) {
+        unsigned right = tree[k].point < digest;
+        found = right ? found : k;
+        k = 2 * k + right;
     }
-    return -1;
+    if (found == 0) {
+        /* past the last point, roll back to zeroth */
+        return cfg->continuum->index;
+    }
+    return tree[found].index;
 }
 
 int lcbvb_k2vb(lcbvb_CONFIG *cfg, const void *k, lcb_SIZE n)
@@ -1220,6 +1732,30 @@ int lcbvb_map_key(lcbvb_CONFIG *cfg, const void *key, lcb_SIZE nkey, int *vbid,
     return 0;
 }
 
+int lcbvb_map_keys_batch(lcbvb_CONFIG *cfg, const void *const *keys, const lcb_SIZE *nkeys, lcb_SIZE n, int *vbids,
+                         int *srvixs)
+{
+    lcb_SIZE ii;
+
+    if (cfg->dtype == LCBVB_DIST_VBUCKET) {
+        for (ii = 0; ii < n; ii++) {
+            int vb = (int)(hash_crc32(keys[ii], nkeys[ii]) % cfg->nvb);
+            srvixs[ii] = cfg->vbuckets[vb].servers[0];
+            if (vbids) {
+                vbids[ii] = vb;
+            }
+        }
+    } else {
+        for (ii = 0; ii < n; ii++) {
+            srvixs[ii] = cfg->dtype == LCBVB_DIST_KETAMA ? map_ketama(cfg, keys[ii], nkeys[ii]) : -1;
+            if (vbids) {
+                vbids[ii] = 0;
+            }
+        }
+    }
+    return 0;
+}
+
 int lcbvb_has_vbucket(lcbvb_CONFIG *vbc, int vbid, int ix)
 {
     unsigned ii;
@@ -1450,10 +1986,27 @@ const char *lcbvb_get_hostname(const lcbvb_CONFIG *cfg, unsigned ix)
     }
 }
 
+LIBCOUCHBASE_API
+const char *lcbvb_get_server_group(const lcbvb_CONFIG *cfg, unsigned ix)
+{
+    if (cfg->nsrv > ix) {
+        return cfg->servers[ix].server_group;
+    } else {
+        return NULL;
+    }
+}
+
 LIBCOUCHBASE_API
 int lcbvb_get_randhost_ex(const lcbvb_CONFIG *cfg, lcbvb_SVCTYPE type, lcbvb_SVCMODE mode, int *used)
 {
-    size_t nn, oix = 0;
+    return lcbvb_get_randhost_group(cfg, type, mode, used, NULL);
+}
+
+LIBCOUCHBASE_API
+int lcbvb_get_randhost_group(const lcbvb_CONFIG *cfg, lcbvb_SVCTYPE type, lcbvb_SVCMODE mode, int *used,
+                             const char *group)
+{
+    size_t nn, oix = 0, nlocal = 0;
 
     if (cfg == NULL) {
         return -1;
@@ -1516,6 +2069,21 @@ int lcbvb_get_randhost_ex(const lcbvb_CONFIG *cfg, lcbvb_SVCTYPE type, lcbvb_SVC
         return -1;
     }
 
+    if (group != NULL && *group) {
+        /* move the candidates of the group to the front */
+        for (nn = 0; nn < oix; nn++) {
+            const char *cur = cfg->servers[cfg->randbuf[nn]].server_group;
+            if (cur != NULL && strcmp(cur, group) == 0) {
+                int tmp = cfg->randbuf[nlocal];
+                cfg->randbuf[nlocal++] = cfg->randbuf[nn];
+                cfg->randbuf[nn] = tmp;
+            }
+        }
+        if (nlocal) {
+            oix = nlocal;
+        }
+    }
+
     nn = lcb_next_rand32();
     nn %= oix;
     return cfg->randbuf[nn];
@@ -1740,6 +2308,9 @@ int lcbvb_genconfig_ex(lcbvb_CONFIG *vb, const char *name, const char *uuid, con
         if (src->eventingpath) {
             dst->eventingpath = lcb_strdup(src->eventingpath);
         }
+        if (src->server_group) {
+            dst->server_group = lcb_strdup(src->server_group);
+        }
 
         copy_service(src->hostname, &src->svc, &dst->svc);
         copy_service(src->hostname, &src->svc_ssl, &dst->svc_ssl);
@@ -176,27 +176,36 @@ static void chunk_callback(lcb_INSTANCE *instance, int, const lcb_RESPHTTP *resp
     req->unref();
 }
 
-static void do_copy_iov(std::string &dstbuf, lcb_IOV *dstiov, const lcb_IOV *srciov)
+static void do_copy_iov(char *&dst, lcb_IOV *dstiov, const lcb_IOV *srciov)
 {
     dstiov->iov_len = srciov->iov_len;
-    dstiov->iov_base = const_cast<char *>(dstbuf.c_str() + dstbuf.size());
-    dstbuf.append(reinterpret_cast<const char *>(srciov->iov_base), srciov->iov_len);
+    dstiov->iov_base = dst;
+    if (srciov->iov_len) {
+        memcpy(dst, srciov->iov_base, srciov->iov_len);
+        dst += srciov->iov_len;
+    }
 }
 
-static VRDocRequest *mk_docreq(const lcb::jsparse::Row *datum)
+VRDocRequest *VRDocRequest::create(const lcb::jsparse::Row *datum)
 {
-    VRDocRequest *dreq;
     size_t extra_alloc = datum->key.iov_len + datum->value.iov_len + datum->geo.iov_len + datum->docid.iov_len;
 
-    dreq = new VRDocRequest();
-    dreq->rowbuf.reserve(extra_alloc);
-    do_copy_iov(dreq->rowbuf, &dreq->key, &datum->key);
-    do_copy_iov(dreq->rowbuf, &dreq->value, &datum->value);
-    do_copy_iov(dreq->rowbuf, &dreq->docid, &datum->docid);
-    do_copy_iov(dreq->rowbuf, &dreq->geo, &datum->geo);
+    void *mem = ::operator new(sizeof(VRDocRequest) + extra_alloc);
+    auto *dreq = new (mem) VRDocRequest();
+    char *rowbuf = reinterpret_cast<char *>(dreq + 1);
+    do_copy_iov(rowbuf, &dreq->key, &datum->key);
+    do_copy_iov(rowbuf, &dreq->value, &datum->value);
+    do_copy_iov(rowbuf, &dreq->docid, &datum->docid);
+    do_copy_iov(rowbuf, &dreq->geo, &datum->geo);
     return dreq;
 }
 
+void VRDocRequest::destroy(VRDocRequest *dreq)
+{
+    dreq->~VRDocRequest();
+    ::operator delete(dreq);
+}
+
 void lcb_VIEW_HANDLE_::JSPARSE_on_row(const lcb::jsparse::Row &datum)
 {
     using lcb::jsparse::Row;
@@ -205,7 +214,7 @@ void lcb_VIEW_HANDLE_::JSPARSE_on_row(const lcb::jsparse::Row &datum)
     }
 
     if (include_docs_ && datum.docid.iov_len && callback_ != nullptr && document_queue_ != nullptr) {
-        document_queue_->add(mk_docreq(&datum));
+        document_queue_->add(VRDocRequest::create(&datum));
         ref();
 
     } else {
@@ -240,9 +249,10 @@ static void doc_callback(lcb_INSTANCE *, int, const lcb_RESPGET *resp)
 
     q->ref();
 
-    q->n_awaiting_response--;
+    q->complete(dreq, resp->ctx.rc);
+    /* the copy is delivered after this callback returns */
+    resp->ctx.materialize();
     dreq->docresp = *resp;
-    dreq->ready = 1;
     dreq->docresp.ctx.key.assign((const char *)dreq->docid.iov_base, dreq->docid.iov_len);
 
     /* Reference the response data, since we might not be invoking this right
@@ -279,7 +289,7 @@ static void cb_doc_ready(lcb::docreq::Queue *q, lcb::docreq::DocRequest *req_bas
         reinterpret_cast<lcb_VIEW_HANDLE_ *>(q->parent)->invoke_row(&resp);
     }
 
-    delete dreq;
+    VRDocRequest::destroy(dreq);
 
     if (q->parent) {
         reinterpret_cast<lcb_VIEW_HANDLE_ *>(q->parent)->unref();
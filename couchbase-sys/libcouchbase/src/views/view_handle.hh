@@ -24,11 +24,18 @@
 #include "capi/cmd_view.hh"
 
 struct VRDocRequest : lcb::docreq::DocRequest {
+    /**
+     * Allocate a request along with a copy of the fields of the row, which
+     * only live as long as the chunk being parsed. The copy is stored right
+     * after the structure, in the same allocation.
+     */
+    static VRDocRequest *create(const lcb::jsparse::Row *datum);
+    static void destroy(VRDocRequest *dreq);
+
     lcb_VIEW_HANDLE *view_request_{nullptr};
     lcb_IOV key;
     lcb_IOV value;
     lcb_IOV geo;
-    std::string rowbuf;
 };
 
 struct lcb_VIEW_HANDLE_ : lcb::jsparse::Parser::Actions {
@@ -31,7 +31,7 @@ static bool has_pending(lcb_INSTANCE *instance)
         return true;
     }
 
-    for (size_t ii = 0; ii < LCBT_NSERVERS(instance); ii++) {
+    for (size_t ii = 0; ii < MCREQ_NPIPELINES_ALL(&instance->cmdq); ii++) {
         if (instance->get_server(ii)->has_pending(!LCBT_SETTING(instance, wait_for_config))) {
             return true;
         }
@@ -47,7 +47,7 @@ static void maybe_reset_timeouts(lcb_INSTANCE *instance)
     }
 
     uint64_t now = lcb_nstime();
-    for (size_t ii = 0; ii < LCBT_NSERVERS(instance); ++ii) {
+    for (size_t ii = 0; ii < MCREQ_NPIPELINES_ALL(&instance->cmdq); ++ii) {
         mcreq_reset_timeouts(instance->get_server(ii), now);
     }
     instance->retryq->reset_timeouts(now);
@@ -55,6 +55,7 @@ static void maybe_reset_timeouts(lcb_INSTANCE *instance)
 
 void lcb_maybe_breakout(lcb_INSTANCE *instance)
 {
+    lcb_kv_overload_check(instance);
     if (!instance->wait) {
         return;
     }
@@ -90,6 +91,24 @@ lcb_STATUS lcb_tick_nowait(lcb_INSTANCE *instance)
     }
 }
 
+/**
+ * Run non-blocking iterations of the event loop until the wait is over or the
+ * spin budget (LCB_CNTL_WAIT_SPIN) is spent.
+ */
+static void spin_wait(lcb_INSTANCE *instance)
+{
+    lcb_io_tick_fn tick = instance->iotable->loop.tick;
+    hrtime_t deadline;
+
+    if (!tick) {
+        return;
+    }
+    deadline = gethrtime() + LCB_US2NS(LCBT_SETTING(instance, wait_spin));
+    do {
+        tick(IOT_ARG(instance->iotable));
+    } while (instance->wait && gethrtime() < deadline);
+}
+
 LIBCOUCHBASE_API
 lcb_STATUS lcb_wait(lcb_INSTANCE *instance, lcb_WAITFLAGS flags)
 {
@@ -105,7 +124,12 @@ lcb_STATUS lcb_wait(lcb_INSTANCE *instance, lcb_WAITFLAGS flags)
     maybe_reset_timeouts(instance);
     instance->last_error = LCB_SUCCESS;
     instance->wait = 1;
-    IOT_START(instance->iotable);
+    if (LCBT_SETTING(instance, wait_spin)) {
+        spin_wait(instance);
+    }
+    if (instance->wait) {
+        IOT_START(instance->iotable);
+    }
     instance->wait = 0;
 
     if (LCBT_VBCONFIG(instance)) {
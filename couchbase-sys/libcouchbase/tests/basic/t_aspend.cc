@@ -0,0 +1,62 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include <gtest/gtest.h>
+#include "internal.h"
+
+#include <vector>
+
+class AspendTest : public ::testing::Test
+{
+};
+
+TEST_F(AspendTest, testAddAndDelete)
+{
+    lcb_ASPEND ops;
+    lcb_aspend_init(&ops);
+    ASSERT_FALSE(lcb_aspend_pending(&ops));
+
+    int owners[3] = {0, 1, 2};
+    lcb_ASPEND_ITEM items[3];
+    for (int ii = 0; ii < 3; ii++) {
+        lcb_aspend_item_init(&items[ii], &owners[ii]);
+        lcb_aspend_add(&ops, LCB_PENDTYPE_HTTP, &items[ii]);
+    }
+    // adding a pending item again has no effect
+    lcb_aspend_add(&ops, LCB_PENDTYPE_HTTP, &items[0]);
+    lcb_aspend_add(&ops, LCB_PENDTYPE_COUNTER, nullptr);
+    ASSERT_EQ(4U, ops.count);
+
+    lcb_aspend_del(&ops, LCB_PENDTYPE_HTTP, &items[1]);
+    lcb_aspend_del(&ops, LCB_PENDTYPE_HTTP, &items[1]);
+    ASSERT_EQ(3U, ops.count);
+
+    std::vector<int> pending;
+    lcb_list_t *pos, *next;
+    LCB_ASPEND_FOR(pos, next, &ops, LCB_PENDTYPE_HTTP)
+    {
+        pending.push_back(*static_cast<int *>(LCB_ASPEND_OWNER(pos)));
+        lcb_aspend_del(&ops, LCB_PENDTYPE_HTTP, LCB_LIST_ITEM(pos, lcb_ASPEND_ITEM, link));
+    }
+    ASSERT_EQ((std::vector<int>{0, 2}), pending);
+    ASSERT_TRUE(lcb_aspend_pending(&ops));
+
+    lcb_aspend_del(&ops, LCB_PENDTYPE_COUNTER, nullptr);
+    ASSERT_FALSE(lcb_aspend_pending(&ops));
+    lcb_aspend_cleanup(&ops);
+}
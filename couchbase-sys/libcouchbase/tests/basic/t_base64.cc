@@ -100,3 +100,58 @@ TEST_F(Base64, testTooSmallOutputBuffer)
     ASSERT_EQ(lcb_base64_encode(plain, strlen(plain), dest, sizeof(dest)), -1);
     ASSERT_EQ(lcb_base64_decode(base64, strlen(base64), dest, sizeof(dest)), -1);
 }
+
+TEST_F(Base64, testEncodeIov)
+{
+    std::string plain("Man is distinguished, not only by his reason, but by this singular passion");
+    char *expected = NULL;
+    size_t nexpected = 0;
+    ASSERT_EQ(0, lcb_base64_encode2(plain.c_str(), plain.size(), &expected, &nexpected));
+
+    // Every split of the input in three buffers, so that triplets cross them
+    for (size_t ii = 0; ii <= plain.size(); ii++) {
+        for (size_t jj = ii; jj <= plain.size(); jj += 7) {
+            lcb_IOV iov[3];
+            iov[0].iov_base = (void *)plain.c_str();
+            iov[0].iov_len = ii;
+            iov[1].iov_base = (void *)(plain.c_str() + ii);
+            iov[1].iov_len = jj - ii;
+            iov[2].iov_base = (void *)(plain.c_str() + jj);
+            iov[2].iov_len = plain.size() - jj;
+
+            char *b64 = NULL;
+            int nb64 = 0;
+            lcb_base64_encode_iov(iov, 3, plain.size(), &b64, &nb64);
+            ASSERT_EQ(nexpected, (size_t)nb64);
+            ASSERT_STREQ(expected, b64);
+            free(b64);
+        }
+    }
+
+    // Only the first bytes
+    lcb_IOV iov[2];
+    iov[0].iov_base = (void *)"fo";
+    iov[0].iov_len = 2;
+    iov[1].iov_base = (void *)"obar";
+    iov[1].iov_len = 4;
+    char *b64 = NULL;
+    int nb64 = 0;
+    lcb_base64_encode_iov(iov, 2, 4, &b64, &nb64);
+    ASSERT_EQ(8, nb64);
+    ASSERT_STREQ("Zm9vYg==", b64);
+    free(b64);
+    free(expected);
+}
+
+TEST_F(Base64, testDecodeInvalid)
+{
+    char dest[64];
+
+    memset(dest, 0, sizeof(dest));
+    ASSERT_EQ(6, lcb_base64_decode("Zm9v\nYmFy", 9, dest, sizeof(dest)));
+    ASSERT_STREQ("foobar", dest);
+
+    ASSERT_EQ(-1, lcb_base64_decode("Zm9vYm*y", 8, dest, sizeof(dest)));
+    ASSERT_EQ(-1, lcb_base64_decode("Zm9vY", 5, dest, sizeof(dest)));
+    ASSERT_EQ(-1, lcb_base64_decode("Zm9v\xc3\xa9mFy", 9, dest, sizeof(dest)));
+}
@@ -0,0 +1,84 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2024 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include <gtest/gtest.h>
+#include "circuit_breaker.h"
+
+using lcb::CircuitBreaker;
+
+class CircuitBreakerTest : public ::testing::Test
+{
+  protected:
+    void SetUp() override
+    {
+        settings = lcb_settings_new();
+        settings->circuit_breaker = 1;
+    }
+
+    void TearDown() override
+    {
+        lcb_settings_unref(settings);
+    }
+
+    lcb_settings *settings{nullptr};
+};
+
+TEST_F(CircuitBreakerTest, testOpensOnErrorRate)
+{
+    CircuitBreaker breaker;
+    hrtime_t now = gethrtime();
+
+    for (unsigned ii = 0; ii < 10; ii++) {
+        breaker.record_success();
+    }
+    /* below the volume threshold */
+    ASSERT_FALSE(breaker.record_failures(5, now, *settings));
+    ASSERT_TRUE(breaker.admit(*settings));
+    /* 10 of 20 failed */
+    ASSERT_TRUE(breaker.record_failures(5, now, *settings));
+    ASSERT_EQ(CircuitBreaker::OPEN, breaker.state(now, *settings));
+    ASSERT_FALSE(breaker.allows(*settings));
+    ASSERT_FALSE(breaker.admit(*settings));
+
+    /* failures of the requests sent before it opened do not extend the sleep */
+    ASSERT_FALSE(breaker.record_failures(1, now + 1, *settings));
+    ASSERT_EQ(CircuitBreaker::OPEN, breaker.state(now, *settings));
+}
+
+TEST_F(CircuitBreakerTest, testHalfOpen)
+{
+    settings->circuit_breaker_volume_threshold = 1;
+    settings->circuit_breaker_sleep_window = 0;
+    CircuitBreaker breaker;
+
+    ASSERT_TRUE(breaker.record_failures(1, gethrtime(), *settings));
+    ASSERT_EQ(CircuitBreaker::HALF_OPEN, breaker.state(gethrtime(), *settings));
+    for (unsigned ii = 0; ii < CircuitBreaker::max_canaries; ii++) {
+        ASSERT_TRUE(breaker.admit(*settings));
+    }
+    ASSERT_FALSE(breaker.admit(*settings));
+
+    /* a failed canary opens it again */
+    breaker.record_failures(1, gethrtime(), *settings);
+    ASSERT_TRUE(breaker.admit(*settings));
+
+    /* a successful one closes it */
+    breaker.record_success();
+    ASSERT_EQ(CircuitBreaker::CLOSED, breaker.state(gethrtime(), *settings));
+    ASSERT_STREQ("closed", CircuitBreaker::state_name(breaker.state(gethrtime(), *settings)));
+}
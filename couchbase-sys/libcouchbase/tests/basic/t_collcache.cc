@@ -0,0 +1,118 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2020 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include <gtest/gtest.h>
+#include "internal.h"
+#include "collections.h"
+
+class CollcacheTests : public ::testing::Test
+{
+};
+
+TEST_F(CollcacheTests, testDefaultCollection)
+{
+    lcb::CollectionCache cache;
+    uint32_t cid = 42;
+    ASSERT_TRUE(cache.get(nullptr, 0, nullptr, 0, &cid));
+    ASSERT_EQ(0, cid);
+    cid = 42;
+    ASSERT_TRUE(cache.get("_default._default", &cid));
+    ASSERT_EQ(0, cid);
+    ASSERT_EQ("_default._default", cache.id_to_name(0));
+}
+
+TEST_F(CollcacheTests, testLookupWithoutSpec)
+{
+    lcb::CollectionCache cache;
+    char name[32];
+    for (uint32_t ii = 1; ii <= 200; ii++) {
+        snprintf(name, sizeof(name), "inventory.c%u", ii);
+        cache.put(name, ii + 7);
+    }
+    ASSERT_EQ(201, cache.size());
+
+    for (uint32_t ii = 1; ii <= 200; ii++) {
+        int nname = snprintf(name, sizeof(name), "c%u", ii);
+        uint32_t cid = 0;
+        ASSERT_TRUE(cache.get("inventory", 9, name, nname, &cid));
+        ASSERT_EQ(ii + 7, cid);
+        ASSERT_EQ(std::string("inventory.") + name, cache.id_to_name(ii + 7));
+    }
+
+    uint32_t cid = 0;
+    ASSERT_FALSE(cache.get("inventory", 9, "c201", 4, &cid));
+    ASSERT_FALSE(cache.get("inventor", 8, "yc1", 3, &cid));
+    ASSERT_FALSE(cache.get("inventory", 9, nullptr, 0, &cid));
+    ASSERT_EQ("", cache.id_to_name(1000));
+}
+
+TEST_F(CollcacheTests, testUpdateAndErase)
+{
+    lcb::CollectionCache cache;
+    uint32_t cid = 0;
+    cache.put("s", 1, "c", 1, 8);
+    cache.put("_default", 8, "c", 1, 9);
+    ASSERT_TRUE(cache.get(nullptr, 0, "c", 1, &cid));
+    ASSERT_EQ(9, cid);
+
+    cache.put("s.c", 10);
+    ASSERT_EQ(3, cache.size());
+    ASSERT_TRUE(cache.get("s", 1, "c", 1, &cid));
+    ASSERT_EQ(10, cid);
+    ASSERT_EQ("s.c", cache.id_to_name(10));
+    ASSERT_EQ("", cache.id_to_name(8));
+
+    cache.erase(10);
+    ASSERT_FALSE(cache.get("s", 1, "c", 1, &cid));
+    ASSERT_EQ("", cache.id_to_name(10));
+    ASSERT_TRUE(cache.get("_default._default", &cid));
+    ASSERT_EQ(0, cid);
+    ASSERT_TRUE(cache.get("_default.c", &cid));
+    ASSERT_EQ(9, cid);
+}
+
+TEST_F(CollcacheTests, testLoadManifest)
+{
+    lcb::CollectionCache cache;
+    uint64_t uid = 42;
+    uint32_t cid = 0;
+    ASSERT_FALSE(cache.manifest_uid(&uid));
+    cache.put("stale.c", 100);
+
+    std::string manifest = R"({"uid":"1f","scopes":[)"
+                           R"({"name":"_default","uid":"0","collections":[{"name":"_default","uid":"0"}]},)"
+                           R"({"name":"inventory","uid":"8","collections":[)"
+                           R"({"name":"hotels","uid":"a"},{"name":"airlines","uid":"1b","maxTTL":10}]}]})";
+    ASSERT_EQ(LCB_SUCCESS, cache.load_manifest(manifest.c_str(), manifest.size()));
+    ASSERT_TRUE(cache.manifest_uid(&uid));
+    ASSERT_EQ(0x1f, uid);
+    ASSERT_EQ(3, cache.size());
+
+    ASSERT_FALSE(cache.get("stale.c", &cid));
+    ASSERT_TRUE(cache.get(nullptr, 0, nullptr, 0, &cid));
+    ASSERT_EQ(0, cid);
+    ASSERT_TRUE(cache.get("inventory", 9, "hotels", 6, &cid));
+    ASSERT_EQ(0xa, cid);
+    ASSERT_TRUE(cache.get("inventory.airlines", &cid));
+    ASSERT_EQ(0x1b, cid);
+    ASSERT_EQ("inventory.airlines", cache.id_to_name(0x1b));
+
+    ASSERT_EQ(LCB_ERR_PROTOCOL_ERROR, cache.load_manifest("{\"uid\":", 7));
+    ASSERT_EQ(LCB_ERR_PROTOCOL_ERROR, cache.load_manifest("[]", 2));
+    ASSERT_TRUE(cache.get("inventory", 9, "hotels", 6, &cid));
+}
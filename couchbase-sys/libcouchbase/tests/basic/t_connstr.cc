@@ -458,3 +458,26 @@ TEST_F(ConnstrTest, testDnsSrvImplicit)
     EXPECT_EQ(LCB_SUCCESS, params.parse("couchbases://1.1.1.1"));
     EXPECT_TRUE(params.can_dnssrv());
 }
+
+TEST_F(ConnstrTest, testDnsSrvOrder)
+{
+    EXPECT_EQ("_couchbases._tcp.example.com", lcb::dnssrv_name("example.com", true));
+    EXPECT_EQ("_couchbase._tcp.example.com", lcb::dnssrv_name("example.com", false));
+
+    // Lower priorities first, every record of a priority kept
+    for (int attempt = 0; attempt < 20; attempt++) {
+        std::vector<lcb::SrvRecord> records = {
+            {"c", 11210, 20, 0}, {"a1", 11210, 10, 50}, {"b", 11210, 15, 0}, {"a2", 11210, 10, 0}, {"a3", 11210, 10, 5},
+        };
+        lcb::dnssrv_order(records);
+        ASSERT_EQ(5, records.size());
+        std::set<std::string> first;
+        for (size_t ii = 0; ii < 3; ii++) {
+            ASSERT_EQ(10, records[ii].priority);
+            first.insert(records[ii].target);
+        }
+        ASSERT_EQ(3, first.size());
+        ASSERT_EQ("b", records[3].target);
+        ASSERT_EQ("c", records[4].target);
+    }
+}
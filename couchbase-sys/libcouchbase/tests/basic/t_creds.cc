@@ -18,6 +18,9 @@
 #include "config.h"
 #include "internal.h"
 #include "auth-priv.h"
+#include "collections.h"
+#include "hostlist.h"
+#include <lcbio/ssl.h>
 #include <gtest/gtest.h>
 #define LIBCOUCHBASE_INTERNAL 1
 #include <libcouchbase/couchbase.h>
@@ -123,3 +126,64 @@ TEST_F(CredsTest, testSharedAuth)
     ASSERT_EQ(1, auth->refcount());
     lcbauth_unref(auth);
 }
+
+TEST_F(CredsTest, testScramCache)
+{
+    lcb::Authenticator auth;
+    std::string salted;
+    ASSERT_FALSE(auth.scram_salted_password("user", "pass", 1, "c2FsdA==", 4096, salted));
+
+    auth.scram_salted_password("user", "pass", 1, "c2FsdA==", 4096, std::string("\x01\x00\x02", 3));
+    ASSERT_TRUE(auth.scram_salted_password("user", "pass", 1, "c2FsdA==", 4096, salted));
+    ASSERT_EQ(std::string("\x01\x00\x02", 3), salted);
+
+    // Any change in the inputs of the derivation is a miss
+    ASSERT_FALSE(auth.scram_salted_password("user", "other", 1, "c2FsdA==", 4096, salted));
+    ASSERT_FALSE(auth.scram_salted_password("other", "pass", 1, "c2FsdA==", 4096, salted));
+    ASSERT_FALSE(auth.scram_salted_password("user", "pass", 2, "c2FsdA==", 4096, salted));
+    ASSERT_FALSE(auth.scram_salted_password("user", "pass", 1, "c2FsdB==", 4096, salted));
+    ASSERT_FALSE(auth.scram_salted_password("user", "pass", 1, "c2FsdA==", 8192, salted));
+
+    // The cache is not shared with copies
+    lcb::Authenticator copy(auth);
+    ASSERT_FALSE(copy.scram_salted_password("user", "pass", 1, "c2FsdA==", 4096, salted));
+}
+
+TEST_F(CredsTest, testCreateFromTemplate)
+{
+    lcb_INSTANCE *tmpl = create("couchbase://host1,host2/default?username=mark&operation_timeout=1.5");
+    tmpl->collcache->put("scope", 5, "coll", 4, 42);
+
+    lcb_INSTANCE *clone;
+    ASSERT_EQ(LCB_SUCCESS, lcb_create_from_template(&clone, tmpl, nullptr));
+    ASSERT_STREQ("default", clone->settings->bucket);
+    ASSERT_EQ(1500000, clone->settings->operation_timeout);
+    ASSERT_EQ(2, clone->mc_nodes->size());
+    ASSERT_NE(tmpl->settings->auth, clone->settings->auth);
+    ASSERT_EQ("mark", clone->settings->auth->username());
+    uint32_t cid = 0;
+    ASSERT_TRUE(clone->collcache->get("scope", 5, "coll", 4, &cid));
+    ASSERT_EQ(42, cid);
+    lcb_destroy(clone);
+
+    // Collections are only copied for the same bucket
+    lcb_CREATEOPTS *crst = nullptr;
+    lcb_createopts_create(&crst, LCB_TYPE_BUCKET);
+    lcb_createopts_bucket(crst, "other", 5);
+    ASSERT_EQ(LCB_SUCCESS, lcb_create_from_template(&clone, tmpl, crst));
+    lcb_createopts_destroy(crst);
+    ASSERT_STREQ("other", clone->settings->bucket);
+    ASSERT_FALSE(clone->collcache->get("scope", 5, "coll", 4, &cid));
+    lcb_destroy(clone);
+
+    lcb_destroy(tmpl);
+
+    if (lcbio_ssl_supported()) {
+        tmpl = create("couchbases://host1/default?ssl=no_verify");
+        ASSERT_EQ(LCB_SUCCESS, lcb_create_from_template(&clone, tmpl, nullptr));
+        ASSERT_NE(nullptr, clone->settings->ssl_ctx);
+        ASSERT_NE(tmpl->settings->ssl_ctx, clone->settings->ssl_ctx);
+        lcb_destroy(tmpl);
+        lcb_destroy(clone);
+    }
+}
@@ -0,0 +1,167 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include <gtest/gtest.h>
+#include <libcouchbase/couchbase.h>
+#include <libcouchbase/crypto.h>
+#include <cstdlib>
+#include <cstring>
+
+/* "Cipher" which flips the bits of the data, enough to check the plumbing */
+static lcb_STATUS flip(const uint8_t *input, size_t input_len, uint8_t **output, size_t *output_len)
+{
+    *output = static_cast<uint8_t *>(malloc(input_len + 1));
+    for (size_t ii = 0; ii < input_len; ii++) {
+        (*output)[ii] = ~input[ii];
+    }
+    *output_len = input_len;
+    return LCB_SUCCESS;
+}
+
+static lcb_STATUS flip_one(lcbcrypto_PROVIDER *, const uint8_t *input, size_t input_len, const uint8_t *, size_t,
+                           uint8_t **output, size_t *output_len)
+{
+    return flip(input, input_len, output, output_len);
+}
+
+static size_t nbatches = 0;
+
+static lcb_STATUS flip_batch(lcbcrypto_PROVIDER *, lcbcrypto_BATCHITEM *items, size_t items_num)
+{
+    nbatches++;
+    for (size_t ii = 0; ii < items_num; ii++) {
+        items[ii].status = flip(items[ii].input, items[ii].input_len, &items[ii].output, &items[ii].output_len);
+    }
+    return LCB_SUCCESS;
+}
+
+static void release_bytes(lcbcrypto_PROVIDER *, void *bytes)
+{
+    free(bytes);
+}
+
+static const char *get_key_id(lcbcrypto_PROVIDER *)
+{
+    return "flipkey";
+}
+
+class CryptoTest : public ::testing::Test
+{
+  protected:
+    void SetUp() override
+    {
+        ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, nullptr));
+        nbatches = 0;
+    }
+
+    void TearDown() override
+    {
+        lcb_destroy(instance);
+    }
+
+    void add_provider(const char *name, bool batch)
+    {
+        lcbcrypto_PROVIDER *provider = static_cast<lcbcrypto_PROVIDER *>(calloc(1, sizeof(lcbcrypto_PROVIDER)));
+        provider->version = batch ? 2 : 1;
+        provider->destructor = [](lcbcrypto_PROVIDER *p) { free(p); };
+        provider->v.v1.release_bytes = release_bytes;
+        provider->v.v1.encrypt = flip_one;
+        provider->v.v1.decrypt = flip_one;
+        provider->v.v1.get_key_id = get_key_id;
+        if (batch) {
+            provider->v.v2.encrypt_batch = flip_batch;
+            provider->v.v2.decrypt_batch = flip_batch;
+        }
+        lcbcrypto_register(instance, name, provider);
+    }
+
+    lcb_INSTANCE *instance{nullptr};
+};
+
+TEST_F(CryptoTest, testBatchRoundTrip)
+{
+    add_provider("FLIP", true);
+    add_provider("FLIP1", false);
+
+    const char *doc = "{\"a\":1,\"b\":\"two\",\"c\":[3],\"d\":4}";
+    lcbcrypto_FIELDSPEC fields[4] = {};
+    fields[0].name = "a";
+    fields[0].alg = "FLIP";
+    fields[1].name = "b";
+    fields[1].alg = "FLIP1";
+    fields[2].name = "c";
+    fields[2].alg = "FLIP";
+    fields[3].name = "missing";
+    fields[3].alg = "FLIP";
+
+    lcbcrypto_CMDENCRYPT ecmd = {};
+    ecmd.doc = doc;
+    ecmd.ndoc = strlen(doc);
+    ecmd.fields = fields;
+    ecmd.nfields = 4;
+    ASSERT_EQ(LCB_SUCCESS, lcbcrypto_encrypt_fields(instance, &ecmd));
+    ASSERT_NE(nullptr, ecmd.out);
+    // Both fields of the batch provider in a single call
+    ASSERT_EQ(1U, nbatches);
+    std::string encrypted(ecmd.out, ecmd.nout);
+    free(ecmd.out);
+    ASSERT_NE(std::string::npos, encrypted.find("\"__crypt_a\""));
+    ASSERT_NE(std::string::npos, encrypted.find("\"__crypt_b\""));
+    ASSERT_NE(std::string::npos, encrypted.find("\"__crypt_c\""));
+    ASSERT_NE(std::string::npos, encrypted.find("\"d\":4"));
+    ASSERT_EQ(std::string::npos, encrypted.find("\"two\""));
+
+    lcbcrypto_CMDDECRYPT dcmd = {};
+    dcmd.doc = encrypted.c_str();
+    dcmd.ndoc = encrypted.size();
+    dcmd.fields = fields;
+    dcmd.nfields = 4;
+    ASSERT_EQ(LCB_SUCCESS, lcbcrypto_decrypt_fields(instance, &dcmd));
+    ASSERT_NE(nullptr, dcmd.out);
+    ASSERT_EQ(2U, nbatches);
+    std::string decrypted(dcmd.out, dcmd.nout);
+    free(dcmd.out);
+    ASSERT_EQ(doc, decrypted);
+
+    lcbcrypto_unregister(instance, "FLIP");
+    lcbcrypto_unregister(instance, "FLIP1");
+}
+
+TEST_F(CryptoTest, testNoChanges)
+{
+    add_provider("FLIP", true);
+
+    const char *doc = "{\"a\":1}";
+    lcbcrypto_FIELDSPEC field = {};
+    field.name = "b";
+    field.alg = "FLIP";
+
+    lcbcrypto_CMDENCRYPT cmd = {};
+    cmd.doc = doc;
+    cmd.ndoc = strlen(doc);
+    cmd.fields = &field;
+    cmd.nfields = 1;
+    ASSERT_EQ(LCB_SUCCESS, lcbcrypto_encrypt_fields(instance, &cmd));
+    ASSERT_EQ(nullptr, cmd.out);
+    ASSERT_EQ(0U, nbatches);
+
+    field.alg = "UNKNOWN";
+    ASSERT_EQ(LCB_ERR_INVALID_ARGUMENT, lcbcrypto_encrypt_fields(instance, &cmd));
+
+    lcbcrypto_unregister(instance, "FLIP");
+}
@@ -132,3 +132,451 @@ TEST_F(CtlTest, testTimeDurationParsing)
 
     lcb_destroy(instance);
 }
+
+TEST_F(CtlTest, testFlushCoalesce)
+{
+    lcb_INSTANCE *instance;
+    ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, nullptr));
+    ASSERT_FALSE(instance == nullptr);
+
+    ASSERT_EQ(0, getSetting< int >(instance, LCB_CNTL_FLUSH_COALESCE));
+    ASSERT_EQ(0, lcb_cntl_getu32(instance, LCB_CNTL_FLUSH_COALESCE_DELAY));
+    ASSERT_EQ(65536, lcb_cntl_getu32(instance, LCB_CNTL_FLUSH_COALESCE_BYTES));
+
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "flush_coalesce", "true"));
+    ASSERT_EQ(1, getSetting< int >(instance, LCB_CNTL_FLUSH_COALESCE));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "flush_coalesce_delay", "50us"));
+    ASSERT_EQ(50, lcb_cntl_getu32(instance, LCB_CNTL_FLUSH_COALESCE_DELAY));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "flush_coalesce_bytes", "1024"));
+    ASSERT_EQ(1024, lcb_cntl_getu32(instance, LCB_CNTL_FLUSH_COALESCE_BYTES));
+
+    lcb_destroy(instance);
+}
+
+TEST_F(CtlTest, testWaitSpin)
+{
+    lcb_INSTANCE *instance;
+    ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, nullptr));
+    ASSERT_FALSE(instance == nullptr);
+
+    ASSERT_EQ(0, lcb_cntl_getu32(instance, LCB_CNTL_WAIT_SPIN));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "wait_spin", "50us"));
+    ASSERT_EQ(50, lcb_cntl_getu32(instance, LCB_CNTL_WAIT_SPIN));
+    ASSERT_EQ(50, instance->settings->wait_spin);
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_setu32(instance, LCB_CNTL_WAIT_SPIN, 0));
+    ASSERT_EQ(0, instance->settings->wait_spin);
+
+    lcb_destroy(instance);
+}
+
+TEST_F(CtlTest, testNearCache)
+{
+    lcb_INSTANCE *instance;
+    ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, nullptr));
+    ASSERT_FALSE(instance == nullptr);
+
+    ASSERT_EQ(0, lcb_cntl_getu32(instance, LCB_CNTL_NEAR_CACHE_SIZE));
+    ASSERT_EQ(LCB_MS2US(1000), lcb_cntl_getu32(instance, LCB_CNTL_NEAR_CACHE_TTL));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "near_cache_size", "4096"));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "near_cache_ttl", "250ms"));
+    ASSERT_EQ(4096, instance->settings->near_cache_size);
+    ASSERT_EQ(LCB_MS2US(250), instance->settings->near_cache_ttl);
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_setu32(instance, LCB_CNTL_NEAR_CACHE_SIZE, 0));
+    ASSERT_EQ(0, lcb_cntl_getu32(instance, LCB_CNTL_NEAR_CACHE_SIZE));
+
+    lcb_destroy(instance);
+}
+
+TEST_F(CtlTest, testNegativeCache)
+{
+    lcb_INSTANCE *instance;
+    ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, nullptr));
+    ASSERT_FALSE(instance == nullptr);
+
+    ASSERT_EQ(0, lcb_cntl_getu32(instance, LCB_CNTL_NEGATIVE_CACHE_SIZE));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "negative_cache_size", "10000"));
+    ASSERT_EQ(10000, instance->settings->negative_cache_size);
+    ASSERT_EQ(10000, lcb_cntl_getu32(instance, LCB_CNTL_NEGATIVE_CACHE_SIZE));
+
+    lcb_destroy(instance);
+}
+
+TEST_F(CtlTest, testTouchSkipWindow)
+{
+    lcb_INSTANCE *instance;
+    ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, nullptr));
+    ASSERT_FALSE(instance == nullptr);
+
+    ASSERT_EQ(0, lcb_cntl_getu32(instance, LCB_CNTL_TOUCH_SKIP_WINDOW));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "touch_skip_window", "250ms"));
+    ASSERT_EQ(LCB_MS2US(250), instance->settings->touch_skip_window);
+    ASSERT_EQ(LCB_MS2US(250), lcb_cntl_getu32(instance, LCB_CNTL_TOUCH_SKIP_WINDOW));
+
+    lcb_destroy(instance);
+}
+
+TEST_F(CtlTest, testPreferredServerGroup)
+{
+    lcb_INSTANCE *instance;
+    ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, nullptr));
+    ASSERT_FALSE(instance == nullptr);
+
+    const char *group = "unset";
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_PREFERRED_SERVER_GROUP, &group));
+    ASSERT_EQ(nullptr, group);
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "preferred_server_group", "Group 1"));
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_PREFERRED_SERVER_GROUP, &group));
+    ASSERT_STREQ("Group 1", group);
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_PREFERRED_SERVER_GROUP, (void *)""));
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_PREFERRED_SERVER_GROUP, &group));
+    ASSERT_EQ(nullptr, group);
+
+    lcb_destroy(instance);
+}
+
+TEST_F(CtlTest, testInflightBudget)
+{
+    lcb_INSTANCE *instance;
+    ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, nullptr));
+    ASSERT_FALSE(instance == nullptr);
+
+    ASSERT_EQ(0, getSetting< lcb_SIZE >(instance, LCB_CNTL_KV_INFLIGHT_BYTES_MAX));
+    ASSERT_EQ(0, getSetting< lcb_U32 >(instance, LCB_CNTL_KV_INFLIGHT_OPS_MAX));
+    ASSERT_EQ(50, getSetting< lcb_U32 >(instance, LCB_CNTL_KV_INFLIGHT_LOW_WATERMARK));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "kv_inflight_bytes_max", "67108864"));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "kv_inflight_ops_max", "10000"));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "kv_pipeline_inflight_bytes_max", "16777216"));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "kv_pipeline_inflight_ops_max", "2500"));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "kv_inflight_low_watermark", "75"));
+    ASSERT_EQ(67108864, getSetting< lcb_SIZE >(instance, LCB_CNTL_KV_INFLIGHT_BYTES_MAX));
+    ASSERT_EQ(10000, getSetting< lcb_U32 >(instance, LCB_CNTL_KV_INFLIGHT_OPS_MAX));
+    ASSERT_EQ(16777216, getSetting< lcb_SIZE >(instance, LCB_CNTL_KV_PIPELINE_INFLIGHT_BYTES_MAX));
+    ASSERT_EQ(2500, getSetting< lcb_U32 >(instance, LCB_CNTL_KV_PIPELINE_INFLIGHT_OPS_MAX));
+    ASSERT_EQ(75, getSetting< lcb_U32 >(instance, LCB_CNTL_KV_INFLIGHT_LOW_WATERMARK));
+    ASSERT_STATUS_EQ(LCB_ERR_CONTROL_INVALID_ARGUMENT, lcb_cntl_string(instance, "kv_inflight_low_watermark", "101"));
+
+    lcb_destroy(instance);
+}
+
+TEST_F(CtlTest, testCircuitBreaker)
+{
+    lcb_INSTANCE *instance;
+    ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, nullptr));
+    ASSERT_FALSE(instance == nullptr);
+
+    ASSERT_EQ(0, getSetting< int >(instance, LCB_CNTL_CIRCUIT_BREAKER));
+    ASSERT_EQ(50, getSetting< lcb_U32 >(instance, LCB_CNTL_CIRCUIT_BREAKER_ERROR_THRESHOLD));
+    ASSERT_EQ(20, getSetting< lcb_U32 >(instance, LCB_CNTL_CIRCUIT_BREAKER_VOLUME_THRESHOLD));
+    ASSERT_EQ(LCB_MS2US(5000), getSetting< lcb_U32 >(instance, LCB_CNTL_CIRCUIT_BREAKER_SLEEP_WINDOW));
+    ASSERT_EQ(LCB_MS2US(60000), getSetting< lcb_U32 >(instance, LCB_CNTL_CIRCUIT_BREAKER_ROLLING_WINDOW));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "circuit_breaker", "true"));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "circuit_breaker_error_threshold", "80"));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "circuit_breaker_volume_threshold", "100"));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "circuit_breaker_sleep_window", "1.5"));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "circuit_breaker_rolling_window", "30"));
+    ASSERT_EQ(1, getSetting< int >(instance, LCB_CNTL_CIRCUIT_BREAKER));
+    ASSERT_EQ(80, getSetting< lcb_U32 >(instance, LCB_CNTL_CIRCUIT_BREAKER_ERROR_THRESHOLD));
+    ASSERT_EQ(100, getSetting< lcb_U32 >(instance, LCB_CNTL_CIRCUIT_BREAKER_VOLUME_THRESHOLD));
+    ASSERT_EQ(LCB_MS2US(1500), getSetting< lcb_U32 >(instance, LCB_CNTL_CIRCUIT_BREAKER_SLEEP_WINDOW));
+    ASSERT_EQ(LCB_MS2US(30000), getSetting< lcb_U32 >(instance, LCB_CNTL_CIRCUIT_BREAKER_ROLLING_WINDOW));
+    ASSERT_STATUS_EQ(LCB_ERR_CONTROL_INVALID_ARGUMENT,
+                     lcb_cntl_string(instance, "circuit_breaker_error_threshold", "101"));
+
+    lcb_destroy(instance);
+}
+
+TEST_F(CtlTest, testFlightRecorderSize)
+{
+    lcb_INSTANCE *instance;
+    ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, nullptr));
+    ASSERT_FALSE(instance == nullptr);
+
+    ASSERT_EQ(4096, getSetting< lcb_U32 >(instance, LCB_CNTL_FLIGHT_RECORDER_SIZE));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "flight_recorder_size", "0"));
+    ASSERT_EQ(0, getSetting< lcb_U32 >(instance, LCB_CNTL_FLIGHT_RECORDER_SIZE));
+
+    lcb_destroy(instance);
+}
+
+TEST_F(CtlTest, testHotKeys)
+{
+    lcb_INSTANCE *instance;
+    ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, nullptr));
+    ASSERT_FALSE(instance == nullptr);
+
+    ASSERT_EQ(0, getSetting< lcb_U32 >(instance, LCB_CNTL_HOT_KEYS));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "hot_keys", "10"));
+    ASSERT_EQ(10, getSetting< lcb_U32 >(instance, LCB_CNTL_HOT_KEYS));
+
+    lcb_destroy(instance);
+}
+
+TEST_F(CtlTest, testTracingExport)
+{
+    lcb_INSTANCE *instance;
+    ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, nullptr));
+    ASSERT_FALSE(instance == nullptr);
+
+    ASSERT_EQ(2048, getSetting< lcb_U32 >(instance, LCB_CNTL_TRACING_EXPORT_QUEUE_SIZE));
+    ASSERT_EQ(512, getSetting< lcb_U32 >(instance, LCB_CNTL_TRACING_EXPORT_BATCH_SIZE));
+    ASSERT_EQ(5000000, getSetting< lcb_U32 >(instance, LCB_CNTL_TRACING_EXPORT_INTERVAL));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "tracing_export_queue_size", "64"));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "tracing_export_batch_size", "16"));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "tracing_export_interval", "0.5"));
+    ASSERT_EQ(64, getSetting< lcb_U32 >(instance, LCB_CNTL_TRACING_EXPORT_QUEUE_SIZE));
+    ASSERT_EQ(16, getSetting< lcb_U32 >(instance, LCB_CNTL_TRACING_EXPORT_BATCH_SIZE));
+    ASSERT_EQ(500000, getSetting< lcb_U32 >(instance, LCB_CNTL_TRACING_EXPORT_INTERVAL));
+
+    lcb_destroy(instance);
+}
+
+TEST_F(CtlTest, testKernelIoStats)
+{
+    lcb_INSTANCE *instance;
+    ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, nullptr));
+    ASSERT_FALSE(instance == nullptr);
+
+    ASSERT_EQ(0, getSetting< int >(instance, LCB_CNTL_KERNEL_IO_STATS));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "kernel_io_stats", "true"));
+    ASSERT_EQ(1, getSetting< int >(instance, LCB_CNTL_KERNEL_IO_STATS));
+
+    lcb_destroy(instance);
+}
+
+TEST_F(CtlTest, testKvIdleTimeout)
+{
+    lcb_INSTANCE *instance;
+    ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, nullptr));
+    ASSERT_FALSE(instance == nullptr);
+
+    ASSERT_EQ(0, getSetting< lcb_U32 >(instance, LCB_CNTL_KV_IDLE_TIMEOUT));
+    ASSERT_EQ(0, getSetting< lcb_U32 >(instance, LCB_CNTL_TCP_USER_TIMEOUT));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "kv_idle_timeout", "0.25"));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "tcp_user_timeout", "10"));
+    ASSERT_EQ(250000, getSetting< lcb_U32 >(instance, LCB_CNTL_KV_IDLE_TIMEOUT));
+    ASSERT_EQ(10000000, getSetting< lcb_U32 >(instance, LCB_CNTL_TCP_USER_TIMEOUT));
+
+    lcb_destroy(instance);
+}
+
+TEST_F(CtlTest, testBootstrapParallelism)
+{
+    lcb_INSTANCE *instance;
+    ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, nullptr));
+    ASSERT_FALSE(instance == nullptr);
+
+    ASSERT_EQ(1, getSetting< lcb_U32 >(instance, LCB_CNTL_BOOTSTRAP_PARALLELISM));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "bootstrap_parallelism", "3"));
+    ASSERT_EQ(3, getSetting< lcb_U32 >(instance, LCB_CNTL_BOOTSTRAP_PARALLELISM));
+
+    lcb_destroy(instance);
+}
+
+TEST_F(CtlTest, testFastDestroy)
+{
+    lcb_INSTANCE *instance;
+    ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, nullptr));
+    ASSERT_FALSE(instance == nullptr);
+
+    ASSERT_EQ(0, getSetting< int >(instance, LCB_CNTL_FASTDESTROY));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "fast_dtor", "true"));
+    ASSERT_EQ(1, getSetting< int >(instance, LCB_CNTL_FASTDESTROY));
+
+    lcb_destroy(instance);
+}
+
+TEST_F(CtlTest, testHttpCompression)
+{
+    lcb_INSTANCE *instance;
+    ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, nullptr));
+    ASSERT_FALSE(instance == nullptr);
+
+    ASSERT_EQ(0, getSetting< int >(instance, LCB_CNTL_HTTP_COMPRESSION));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "http_compression", "true"));
+    ASSERT_EQ(1, getSetting< int >(instance, LCB_CNTL_HTTP_COMPRESSION));
+
+    lcb_destroy(instance);
+}
+
+TEST_F(CtlTest, testGetCoalesce)
+{
+    lcb_INSTANCE *instance;
+    ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, nullptr));
+    ASSERT_FALSE(instance == nullptr);
+
+    ASSERT_EQ(0, getSetting< int >(instance, LCB_CNTL_GET_COALESCE));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "get_coalesce", "true"));
+    ASSERT_EQ(1, getSetting< int >(instance, LCB_CNTL_GET_COALESCE));
+    ASSERT_EQ(1, instance->settings->get_coalesce);
+
+    lcb_destroy(instance);
+}
+
+TEST_F(CtlTest, testTracingSampleRate)
+{
+    lcb_INSTANCE *instance;
+    ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, nullptr));
+    ASSERT_FALSE(instance == nullptr);
+
+    ASSERT_EQ(1.0f, instance->settings->tracer_sample_rate);
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "tracing_sample_rate", "0.25"));
+    ASSERT_EQ(0.25f, instance->settings->tracer_sample_rate);
+    ASSERT_STATUS_EQ(LCB_ERR_CONTROL_INVALID_ARGUMENT, lcb_cntl_string(instance, "tracing_sample_rate", "0"));
+    ASSERT_STATUS_EQ(LCB_ERR_CONTROL_INVALID_ARGUMENT, lcb_cntl_string(instance, "tracing_sample_rate", "1.5"));
+    ASSERT_EQ(0.25f, instance->settings->tracer_sample_rate);
+
+    lcb_destroy(instance);
+}
+
+TEST_F(CtlTest, testHealthProbeInterval)
+{
+    lcb_INSTANCE *instance;
+    ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, nullptr));
+    ASSERT_FALSE(instance == nullptr);
+
+    ASSERT_EQ(0, lcb_cntl_getu32(instance, LCB_CNTL_HEALTH_PROBE_INTERVAL));
+    ASSERT_TRUE(instance->health_timer == nullptr);
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "health_probe_interval", "1.5"));
+    ASSERT_EQ(1500000, lcb_cntl_getu32(instance, LCB_CNTL_HEALTH_PROBE_INTERVAL));
+    ASSERT_TRUE(lcbio_timer_armed(instance->health_timer));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_setu32(instance, LCB_CNTL_HEALTH_PROBE_INTERVAL, 0));
+    ASSERT_FALSE(lcbio_timer_armed(instance->health_timer));
+
+    lcb_HEALTH_PROBE probe;
+    ASSERT_STATUS_EQ(LCB_ERR_NO_CONFIGURATION, lcb_health_probe(instance, 0, &probe));
+
+    lcb_destroy(instance);
+}
+
+TEST_F(CtlTest, testIdleTrimInterval)
+{
+    lcb_INSTANCE *instance;
+    ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, nullptr));
+    ASSERT_FALSE(instance == nullptr);
+
+    ASSERT_EQ(0, lcb_cntl_getu32(instance, LCB_CNTL_IDLE_TRIM_INTERVAL));
+    ASSERT_TRUE(instance->trim_timer == nullptr);
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "idle_trim_interval", "30"));
+    ASSERT_EQ(30000000, lcb_cntl_getu32(instance, LCB_CNTL_IDLE_TRIM_INTERVAL));
+    ASSERT_TRUE(lcbio_timer_armed(instance->trim_timer));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_setu32(instance, LCB_CNTL_IDLE_TRIM_INTERVAL, 0));
+    ASSERT_FALSE(lcbio_timer_armed(instance->trim_timer));
+
+    lcb_destroy(instance);
+}
+
+TEST_F(CtlTest, testWriteCoalesceWindow)
+{
+    lcb_INSTANCE *instance;
+    ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, nullptr));
+    ASSERT_FALSE(instance == nullptr);
+
+    ASSERT_EQ(0, lcb_cntl_getu32(instance, LCB_CNTL_WRITE_COALESCE_WINDOW));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "write_coalesce_window", "5ms"));
+    ASSERT_EQ(LCB_MS2US(5), instance->settings->write_coalesce_window);
+    ASSERT_EQ(LCB_MS2US(5), lcb_cntl_getu32(instance, LCB_CNTL_WRITE_COALESCE_WINDOW));
+
+    lcb_destroy(instance);
+}
+
+TEST_F(CtlTest, testConfigPollMaxInterval)
+{
+    lcb_INSTANCE *instance;
+    ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, nullptr));
+    ASSERT_FALSE(instance == nullptr);
+
+    ASSERT_EQ(0, lcb_cntl_getu32(instance, LCB_CNTL_CONFIG_POLL_MAX_INTERVAL));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "config_poll_max_interval", "60s"));
+    ASSERT_EQ(LCB_S2US(60), instance->settings->config_poll_max_interval);
+    ASSERT_EQ(LCB_S2US(60), lcb_cntl_getu32(instance, LCB_CNTL_CONFIG_POLL_MAX_INTERVAL));
+
+    lcb_destroy(instance);
+}
+
+TEST_F(CtlTest, testDnsCacheTtl)
+{
+    lcb_INSTANCE *instance;
+    ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, nullptr));
+    ASSERT_FALSE(instance == nullptr);
+
+    ASSERT_FALSE(instance->settings->resolver == nullptr);
+    ASSERT_EQ(LCB_DEFAULT_DNS_CACHE_TTL, lcb_cntl_getu32(instance, LCB_CNTL_DNS_CACHE_TTL));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "dns_cache_ttl", "0"));
+    ASSERT_EQ(0, lcb_cntl_getu32(instance, LCB_CNTL_DNS_CACHE_TTL));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_setu32(instance, LCB_CNTL_DNS_CACHE_TTL, 60000000));
+    ASSERT_EQ(60000000, lcb_cntl_getu32(instance, LCB_CNTL_DNS_CACHE_TTL));
+
+    lcb_destroy(instance);
+}
+
+TEST_F(CtlTest, testConnectAttemptDelay)
+{
+    lcb_INSTANCE *instance;
+    ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, nullptr));
+    ASSERT_FALSE(instance == nullptr);
+
+    ASSERT_EQ(LCB_DEFAULT_CONNECT_ATTEMPT_DELAY, lcb_cntl_getu32(instance, LCB_CNTL_CONNECT_ATTEMPT_DELAY));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "connect_attempt_delay", "0.05"));
+    ASSERT_EQ(50000, lcb_cntl_getu32(instance, LCB_CNTL_CONNECT_ATTEMPT_DELAY));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_setu32(instance, LCB_CNTL_CONNECT_ATTEMPT_DELAY, 0));
+    ASSERT_EQ(0, lcb_cntl_getu32(instance, LCB_CNTL_CONNECT_ATTEMPT_DELAY));
+
+    lcb_destroy(instance);
+}
+
+TEST_F(CtlTest, testKvConnectionsPerNode)
+{
+    lcb_INSTANCE *instance;
+    ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, nullptr));
+    ASSERT_FALSE(instance == nullptr);
+
+    ASSERT_EQ(1, lcb_cntl_getu32(instance, LCB_CNTL_KV_CONNECTIONS_PER_NODE));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "kv_connections_per_node", "4"));
+    ASSERT_EQ(4, lcb_cntl_getu32(instance, LCB_CNTL_KV_CONNECTIONS_PER_NODE));
+    ASSERT_STATUS_EQ(LCB_ERR_CONTROL_INVALID_ARGUMENT, lcb_cntl_setu32(instance, LCB_CNTL_KV_CONNECTIONS_PER_NODE, 0));
+    ASSERT_STATUS_EQ(LCB_ERR_CONTROL_INVALID_ARGUMENT, lcb_cntl_setu32(instance, LCB_CNTL_KV_CONNECTIONS_PER_NODE, 17));
+    ASSERT_EQ(4, lcb_cntl_getu32(instance, LCB_CNTL_KV_CONNECTIONS_PER_NODE));
+
+    lcb_destroy(instance);
+}
+
+TEST_F(CtlTest, testTuningProfile)
+{
+    lcb_INSTANCE *instance;
+    ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, nullptr));
+    ASSERT_FALSE(instance == nullptr);
+
+    const char *profile = "unset";
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_TUNING_PROFILE, &profile));
+    ASSERT_TRUE(profile == nullptr);
+
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "tuning_profile", "bulk-throughput"));
+    ASSERT_EQ(262144, lcb_cntl_getu32(instance, LCB_CNTL_READ_CHUNKSIZE));
+    ASSERT_EQ(1048576, lcb_cntl_getu32(instance, LCB_CNTL_NETBUF_BLOCK_MAX));
+    ASSERT_EQ(500, lcb_cntl_getu32(instance, LCB_CNTL_FLUSH_COALESCE_DELAY));
+    ASSERT_EQ(8, getSetting< std::size_t >(instance, LCB_CNTL_HTTP_POOLSIZE));
+    ASSERT_EQ(1, getSetting< int >(instance, LCB_CNTL_FLUSH_COALESCE));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_TUNING_PROFILE, &profile));
+    ASSERT_STREQ("bulk-throughput", profile);
+
+    // A rejected value reverts the settings of the profile which were already applied
+    ASSERT_STATUS_EQ(LCB_ERR_CONTROL_INVALID_ARGUMENT,
+                     lcb_cntl_string(instance, "tuning_profile", "read_chunk_size:1024,kv_connections_per_node:0"));
+    ASSERT_EQ(262144, lcb_cntl_getu32(instance, LCB_CNTL_READ_CHUNKSIZE));
+    ASSERT_STATUS_EQ(LCB_ERR_CONTROL_INVALID_ARGUMENT, lcb_cntl_string(instance, "tuning_profile", "no-such-profile"));
+    ASSERT_STATUS_EQ(LCB_ERR_CONTROL_INVALID_ARGUMENT, lcb_cntl_string(instance, "tuning_profile", "network:external"));
+    ASSERT_STATUS_EQ(LCB_ERR_CONTROL_INVALID_ARGUMENT, lcb_cntl_string(instance, "tuning_profile", "read_chunk_size"));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_TUNING_PROFILE, &profile));
+    ASSERT_STREQ("bulk-throughput", profile);
+
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "tuning_profile", "read_chunk_size:1024,retry_interval:5ms"));
+    ASSERT_EQ(1024, lcb_cntl_getu32(instance, LCB_CNTL_READ_CHUNKSIZE));
+    ASSERT_EQ(5000, lcb_cntl_getu32(instance, LCB_CNTL_RETRY_INTERVAL));
+
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "tuning_profile", "default"));
+    ASSERT_EQ(0, lcb_cntl_getu32(instance, LCB_CNTL_READ_CHUNKSIZE));
+    ASSERT_EQ(0, lcb_cntl_getu32(instance, LCB_CNTL_NETBUF_BLOCK_MAX));
+    ASSERT_EQ(1, getSetting< std::size_t >(instance, LCB_CNTL_HTTP_POOLSIZE));
+
+    lcb_destroy(instance);
+}
@@ -0,0 +1,93 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include <gtest/gtest.h>
+#include <libcouchbase/couchbase.h>
+#include "defer.h"
+
+#include <array>
+#include <memory>
+
+using lcb::DeferredOperation;
+using lcb::DeferredQueue;
+
+class DeferQueueTest : public ::testing::Test
+{
+};
+
+TEST_F(DeferQueueTest, testInlineOperation)
+{
+    auto cmd = std::make_shared<int>(42);
+    lcb_STATUS seen = LCB_ERR_GENERIC;
+    DeferredOperation op([cmd, &seen](lcb_STATUS status) { seen = status; });
+    ASSERT_TRUE(op.is_inline());
+    ASSERT_EQ(2, cmd.use_count());
+
+    DeferredOperation moved(std::move(op));
+    ASSERT_FALSE(op);
+    ASSERT_EQ(2, cmd.use_count());
+    moved(LCB_ERR_REQUEST_CANCELED);
+    ASSERT_EQ(LCB_ERR_REQUEST_CANCELED, seen);
+
+    moved.reset();
+    ASSERT_EQ(1, cmd.use_count());
+}
+
+TEST_F(DeferQueueTest, testBoxedOperation)
+{
+    std::array<char, 128> big{};
+    big[0] = 'x';
+    char seen = 0;
+    DeferredOperation op([big, &seen](lcb_STATUS) { seen = big[0]; });
+    ASSERT_FALSE(op.is_inline());
+    DeferredOperation moved;
+    moved = std::move(op);
+    moved(LCB_SUCCESS);
+    ASSERT_EQ('x', seen);
+}
+
+TEST_F(DeferQueueTest, testOrderAndGrowth)
+{
+    DeferredQueue queue;
+    ASSERT_TRUE(queue.empty());
+    std::vector<int> order;
+    std::size_t count = DeferredQueue::initial_capacity * 2 + 3;
+
+    // wrap around before growing
+    for (int ii = 0; ii < 10; ii++) {
+        queue.push([ii, &order](lcb_STATUS) { order.push_back(-1 - ii); });
+    }
+    for (int ii = 0; ii < 10; ii++) {
+        queue.pop()(LCB_SUCCESS);
+    }
+    for (std::size_t ii = 0; ii < count; ii++) {
+        queue.push([ii, &order](lcb_STATUS) { order.push_back(static_cast<int>(ii)); });
+    }
+    ASSERT_EQ(count, queue.size());
+    ASSERT_EQ(count, queue.high_water());
+    ASSERT_EQ(DeferredQueue::initial_capacity * 4, queue.capacity());
+
+    while (!queue.empty()) {
+        queue.pop()(LCB_SUCCESS);
+    }
+    ASSERT_EQ(10 + count, order.size());
+    for (std::size_t ii = 0; ii < count; ii++) {
+        ASSERT_EQ(static_cast<int>(ii), order[10 + ii]);
+    }
+    ASSERT_EQ(count, queue.high_water());
+}
@@ -0,0 +1,66 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include <gtest/gtest.h>
+#include <libcouchbase/couchbase.h>
+#include "internal.h"
+#include "capi/cmd_analytics.hh"
+
+class DeferredHandleTests : public ::testing::Test
+{
+};
+
+static lcb_STATUS extract(const std::string &payload, lcb_DEFERRED_HANDLE **handle)
+{
+    lcb_RESPANALYTICS resp{};
+    resp.rflags = LCB_RESP_F_FINAL | LCB_RESP_F_EXTDATA;
+    resp.row = payload.c_str();
+    resp.nrow = payload.size();
+    return lcb_respanalytics_deferred_handle_extract(&resp, handle);
+}
+
+TEST_F(DeferredHandleTests, testSingleStream)
+{
+    lcb_DEFERRED_HANDLE *handle = nullptr;
+    ASSERT_EQ(LCB_SUCCESS, extract(R"({"status":"success","handle":"http://h:8095/result/1"})", &handle));
+    size_t count = 42;
+    ASSERT_EQ(LCB_SUCCESS, lcb_deferred_handle_partitions(handle, &count));
+    ASSERT_EQ(0, count);
+    lcb_deferred_handle_destroy(handle);
+}
+
+TEST_F(DeferredHandleTests, testPartitions)
+{
+    lcb_DEFERRED_HANDLE *handle = nullptr;
+    ASSERT_EQ(LCB_SUCCESS, extract(R"({"status":"success","handle":"http://h:8095/result/1",)"
+                                   R"("partitions":["http://h:8095/result/1/0",{"handle":"http://h:8095/result/1/1"}]})",
+                                   &handle));
+    size_t count = 0;
+    ASSERT_EQ(LCB_SUCCESS, lcb_deferred_handle_partitions(handle, &count));
+    ASSERT_EQ(2, count);
+    ASSERT_EQ("http://h:8095/result/1/0", handle->partitions[0]);
+    ASSERT_EQ("http://h:8095/result/1/1", handle->partitions[1]);
+    ASSERT_TRUE(handle->ordered);
+    ASSERT_EQ(LCB_SUCCESS, lcb_deferred_handle_ordered(handle, 0));
+    ASSERT_FALSE(handle->ordered);
+    lcb_deferred_handle_destroy(handle);
+
+    ASSERT_EQ(LCB_ERR_INVALID_ARGUMENT,
+              extract(R"({"status":"success","handle":"http://h:8095/result/1","partitions":[1]})", &handle));
+    ASSERT_EQ(nullptr, handle);
+}
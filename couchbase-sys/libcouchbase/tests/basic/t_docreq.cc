@@ -0,0 +1,105 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include <gtest/gtest.h>
+#include "internal.h"
+#include "docreq/docreq.h"
+
+using lcb::docreq::Queue;
+
+class DocreqTest : public ::testing::Test
+{
+  protected:
+    void SetUp() override
+    {
+        ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, nullptr));
+        q = new Queue(instance);
+    }
+
+    void TearDown() override
+    {
+        q->unref();
+        lcb_destroy(instance);
+    }
+
+    lcb_INSTANCE *instance{nullptr};
+    Queue *q{nullptr};
+};
+
+TEST_F(DocreqTest, testSlowStart)
+{
+    ASSERT_EQ((unsigned)Queue::default_initial_window, q->limit());
+    hrtime_t now = LCB_MS2NS(1000);
+    for (unsigned ii = 0; ii < 10; ii++) {
+        q->adapt(LCB_SUCCESS, now, now + LCB_US2NS(100));
+    }
+    ASSERT_EQ((unsigned)Queue::default_initial_window + 10, q->limit());
+
+    // Never above the limit of the user
+    q->max_pending_response = 20;
+    for (unsigned ii = 0; ii < 10; ii++) {
+        q->adapt(LCB_SUCCESS, now, now + LCB_US2NS(100));
+    }
+    ASSERT_EQ(20U, q->limit());
+}
+
+TEST_F(DocreqTest, testBackoffOnTemporaryFailure)
+{
+    hrtime_t now = LCB_MS2NS(1000);
+    for (unsigned ii = 0; ii < 24; ii++) {
+        q->adapt(LCB_SUCCESS, now, now + LCB_US2NS(100));
+    }
+    ASSERT_EQ(32U, q->limit());
+
+    now += LCB_MS2NS(1);
+    q->adapt(LCB_ERR_TEMPORARY_FAILURE, now, now + LCB_US2NS(100));
+    ASSERT_EQ(16U, q->limit());
+
+    // Other responses to requests sent before the backoff are ignored
+    q->adapt(LCB_ERR_TEMPORARY_FAILURE, now, now + LCB_US2NS(200));
+    ASSERT_EQ(16U, q->limit());
+
+    // Past the threshold the window grows by one per window of responses
+    now += LCB_MS2NS(1);
+    for (unsigned ii = 0; ii < 15; ii++) {
+        q->adapt(LCB_SUCCESS, now, now + LCB_US2NS(100));
+    }
+    ASSERT_EQ(16U, q->limit());
+    q->adapt(LCB_SUCCESS, now, now + LCB_US2NS(100));
+    ASSERT_EQ(17U, q->limit());
+}
+
+TEST_F(DocreqTest, testBackoffOnSlowResponses)
+{
+    hrtime_t now = LCB_MS2NS(1000);
+    q->adapt(LCB_SUCCESS, now, now + LCB_US2NS(500));
+    ASSERT_EQ((unsigned)Queue::default_initial_window + 1, q->limit());
+
+    // Slower, but within the tolerance
+    q->adapt(LCB_SUCCESS, now, now + LCB_MS2NS(2));
+    ASSERT_EQ((unsigned)Queue::default_initial_window + 2, q->limit());
+
+    q->adapt(LCB_SUCCESS, now, now + LCB_MS2NS(10));
+    ASSERT_EQ((unsigned)Queue::default_initial_window / 2 + 1, q->limit());
+
+    // The window does not go below the minimum
+    for (unsigned ii = 1; ii < 10; ii++) {
+        q->adapt(LCB_ERR_TIMEOUT, now + LCB_MS2NS(10 * ii), now + LCB_MS2NS(10 * ii + 1));
+    }
+    ASSERT_EQ((unsigned)Queue::min_window, q->limit());
+}
@@ -0,0 +1,56 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2020 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include <gtest/gtest.h>
+#include <libcouchbase/couchbase.h>
+
+class DurableBatchTests : public ::testing::Test
+{
+};
+
+TEST_F(DurableBatchTests, testValidation)
+{
+    lcb_INSTANCE *instance;
+    lcb_DURABLEBATCH *batch = nullptr;
+    ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, nullptr));
+
+    ASSERT_EQ(LCB_ERR_UNSUPPORTED_OPERATION,
+              lcb_durablebatch_create(instance, &batch, LCB_DURABILITYLEVEL_MAJORITY, 0));
+
+    int enabled = 1;
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_ENABLE_DURABLE_WRITE, &enabled));
+    ASSERT_EQ(LCB_ERR_INVALID_ARGUMENT, lcb_durablebatch_create(instance, &batch, LCB_DURABILITYLEVEL_NONE, 0));
+    ASSERT_EQ(LCB_SUCCESS, lcb_durablebatch_create(instance, &batch, LCB_DURABILITYLEVEL_MAJORITY, 0));
+
+    // nothing to submit yet
+    ASSERT_EQ(LCB_ERR_INVALID_ARGUMENT, lcb_durablebatch_submit(batch, nullptr, nullptr));
+
+    lcb_CMDSTORE *cmd;
+    lcb_cmdstore_create(&cmd, LCB_STORE_UPSERT);
+    lcb_cmdstore_key(cmd, "key", 3);
+    lcb_cmdstore_value(cmd, "value", 5);
+    ASSERT_EQ(LCB_SUCCESS, lcb_durablebatch_store(batch, nullptr, cmd));
+
+    // observe based durability cannot be combined with the level of the batch
+    lcb_cmdstore_durability_observe(cmd, 1, 0);
+    ASSERT_EQ(LCB_ERR_INVALID_ARGUMENT, lcb_durablebatch_store(batch, nullptr, cmd));
+    lcb_cmdstore_destroy(cmd);
+
+    ASSERT_EQ(LCB_SUCCESS, lcb_durablebatch_destroy(batch));
+    lcb_destroy(instance);
+}
@@ -0,0 +1,116 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include <gtest/gtest.h>
+#include <libcouchbase/couchbase.h>
+#include "internal.h"
+
+using namespace lcb::errmap;
+
+class ErrorMapTests : public ::testing::Test
+{
+};
+
+static const char *errmap_json = R"({
+  "version": 1,
+  "revision": 1,
+  "errors": {
+    "1": {"name": "KEY_ENOENT", "desc": "Not Found", "attrs": ["item-only"]},
+    "86": {"name": "ETMPFAIL", "desc": "Temporary failure", "attrs": ["temp", "auto-retry", "retry-now"],
+           "retry": {"strategy": "constant", "interval": 10, "after": 5}},
+    "7ff0": {"name": "DUMMY", "desc": "Dummy", "attrs": ["conn-state-invalidated", "bogus", "rate-limit"]}
+  }
+})";
+
+TEST_F(ErrorMapTests, testLookup)
+{
+    ErrorMap em;
+    ASSERT_FALSE(em.isLoaded());
+    ASSERT_FALSE(em.getError(0x01).isValid());
+
+    std::string errmsg;
+    ASSERT_EQ(ErrorMap::UPDATED, em.parse(errmap_json, strlen(errmap_json), errmsg)) << errmsg;
+    ASSERT_TRUE(em.isLoaded());
+
+    const Error &enoent = em.getError(0x01);
+    ASSERT_TRUE(enoent.isValid());
+    ASSERT_EQ("KEY_ENOENT", enoent.shortname);
+    ASSERT_TRUE(enoent.hasAttribute(CONSTRAINT_FAILURE));
+    ASSERT_FALSE(enoent.hasAttribute(TEMPORARY));
+    ASSERT_EQ(nullptr, enoent.getRetrySpec());
+
+    const Error &tmpfail = em.getError(0x86);
+    ASSERT_TRUE(tmpfail.isValid());
+    ASSERT_TRUE(tmpfail.hasAttribute(TEMPORARY));
+    ASSERT_TRUE(tmpfail.hasAttribute(AUTO_RETRY));
+    ASSERT_TRUE(tmpfail.hasAttribute(RETRY_NOW));
+    ASSERT_FALSE(tmpfail.hasAttribute(RETRY_LATER));
+    ASSERT_NE(nullptr, tmpfail.getRetrySpec());
+    ASSERT_EQ(5000U, tmpfail.getRetrySpec()->after);
+    ASSERT_EQ(10000U, tmpfail.getRetrySpec()->get_next_interval(3));
+
+    const Error &dummy = em.getError(0x7ff0);
+    ASSERT_TRUE(dummy.isValid());
+    ASSERT_TRUE(dummy.hasAttribute(CONN_STATE_INVALIDATED));
+    ASSERT_TRUE(dummy.hasAttribute(ITEM_RATE_LIMIT));
+    ASSERT_FALSE(dummy.hasAttribute(INTERNAL));
+
+    /* codes next to known ones, in allocated and unallocated pages */
+    ASSERT_FALSE(em.getError(0x00).isValid());
+    ASSERT_FALSE(em.getError(0x87).isValid());
+    ASSERT_FALSE(em.getError(0x7fef).isValid());
+    ASSERT_FALSE(em.getError(0x0100).isValid());
+    ASSERT_FALSE(em.getError(0xffff).isValid());
+}
+
+TEST_F(ErrorMapTests, testAssign)
+{
+    ErrorMap em;
+    std::string errmsg;
+    ASSERT_EQ(ErrorMap::UPDATED, em.parse(errmap_json, strlen(errmap_json), errmsg)) << errmsg;
+    ASSERT_EQ(1U, em.getRevision());
+    ASSERT_EQ(ErrorMap::NOT_UPDATED, em.parse(errmap_json, strlen(errmap_json), errmsg));
+
+    ErrorMap copy;
+    copy.assign(em);
+    ASSERT_TRUE(copy.isLoaded());
+    ASSERT_EQ(1U, copy.getRevision());
+    ASSERT_EQ(ErrorMap::NOT_UPDATED, copy.parse(errmap_json, strlen(errmap_json), errmsg));
+
+    const Error &tmpfail = copy.getError(0x86);
+    ASSERT_TRUE(tmpfail.hasAttribute(AUTO_RETRY));
+    ASSERT_NE(nullptr, tmpfail.getRetrySpec());
+    ASSERT_NE(em.getError(0x86).getRetrySpec(), tmpfail.getRetrySpec());
+    ASSERT_EQ(5000U, tmpfail.getRetrySpec()->after);
+    ASSERT_EQ("DUMMY", copy.getError(0x7ff0).shortname);
+    ASSERT_FALSE(copy.getError(0x87).isValid());
+}
+
+TEST_F(ErrorMapTests, testOutdated)
+{
+    ErrorMap em;
+    std::string errmsg;
+    ASSERT_FALSE(em.isOutdated());
+    ASSERT_EQ(ErrorMap::UPDATED, em.parse(errmap_json, strlen(errmap_json), errmsg)) << errmsg;
+
+    em.markOutdated();
+    ASSERT_TRUE(em.isOutdated());
+    // Fetching the map again clears it, even if the server has nothing newer
+    ASSERT_EQ(ErrorMap::NOT_UPDATED, em.parse(errmap_json, strlen(errmap_json), errmsg));
+    ASSERT_FALSE(em.isOutdated());
+}
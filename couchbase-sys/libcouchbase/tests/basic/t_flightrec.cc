@@ -0,0 +1,98 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2024 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include <gtest/gtest.h>
+#include "internal.h"
+#include "flightrec.h"
+
+#include <string>
+#include <vector>
+
+using lcb::FlightRecorder;
+
+class FlightRecorderTest : public ::testing::Test
+{
+  protected:
+    static FlightRecorder::Event make_event(std::uint32_t opaque)
+    {
+        FlightRecorder::Event event{};
+        event.time = 1000000;
+        event.type = LCB_FLIGHT_PKT_ENQUEUE;
+        event.server = 2;
+        event.opcode = 0x01;
+        event.vbucket = 42;
+        event.opaque = opaque;
+        event.value = 64;
+        return event;
+    }
+
+    static void collect(void *arg, const char *line, std::size_t nline)
+    {
+        static_cast<std::vector<std::string> *>(arg)->emplace_back(line, nline);
+    }
+};
+
+TEST_F(FlightRecorderTest, testKeepsLatest)
+{
+    FlightRecorder recorder(4);
+    FlightRecorder::Event events[8];
+    ASSERT_EQ(0, recorder.snapshot(events, 8));
+
+    recorder.record(make_event(1));
+    recorder.record(make_event(2));
+    ASSERT_EQ(2, recorder.snapshot(events, 8));
+    ASSERT_EQ(1, events[0].opaque);
+    ASSERT_EQ(2, events[1].opaque);
+
+    for (std::uint32_t opaque = 3; opaque <= 10; opaque++) {
+        recorder.record(make_event(opaque));
+    }
+    ASSERT_EQ(10, recorder.recorded());
+    /* the oldest slot is the next one written, so it is never trusted */
+    ASSERT_EQ(3, recorder.snapshot(events, 8));
+    ASSERT_EQ(8, events[0].opaque);
+    ASSERT_EQ(9, events[1].opaque);
+    ASSERT_EQ(10, events[2].opaque);
+
+    ASSERT_EQ(1, recorder.snapshot(events, 1));
+    ASSERT_EQ(10, events[0].opaque);
+}
+
+TEST_F(FlightRecorderTest, testDump)
+{
+    FlightRecorder recorder(16);
+    recorder.record(make_event(7));
+    FlightRecorder::Event config{};
+    config.time = 1000000;
+    config.type = LCB_FLIGHT_CONFIG;
+    config.server = -1;
+    config.value = 1234;
+    recorder.record(config);
+
+    std::vector<std::string> lines;
+    recorder.dump(collect, &lines);
+    ASSERT_EQ(2, lines.size());
+    ASSERT_NE(std::string::npos, lines[0].find(" enqueue srv=2 op=0x01 vb=42 opaque=7 size=64\n"));
+    ASSERT_NE(std::string::npos, lines[1].find(" config rev=1234\n"));
+
+    char buf[160];
+    std::size_t nbuf = FlightRecorder::format(make_event(7), 2500000, buf, sizeof(buf));
+    ASSERT_EQ("-0.001500s enqueue srv=2 op=0x01 vb=42 opaque=7 size=64\n", std::string(buf, nbuf));
+    nbuf = FlightRecorder::format(make_event(7), 2500000, buf, 8);
+    ASSERT_EQ("-0.0015\n", std::string(buf, nbuf));
+}
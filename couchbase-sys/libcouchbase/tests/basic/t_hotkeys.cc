@@ -0,0 +1,87 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include <gtest/gtest.h>
+#include "internal.h"
+#include "hotkeys.h"
+
+#include <string>
+
+using lcb::HotKeys;
+
+class HotKeysTest : public ::testing::Test
+{
+  protected:
+    static void access(HotKeys &hot_keys, std::uint32_t cid, const std::string &key, int vbid, int server)
+    {
+        hot_keys.record(cid, key.c_str(), key.size(), vbid, server);
+    }
+};
+
+TEST_F(HotKeysTest, testFindsHottest)
+{
+    HotKeys hot_keys(2);
+    /* many more distinct keys than the 16 counters, with two hot ones in between */
+    for (int ii = 0; ii < 1000; ii++) {
+        access(hot_keys, 8, "cold-" + std::to_string(ii), ii % 64, ii % 4);
+        if (ii % 4 == 0) {
+            access(hot_keys, 8, "hot", 7, 1);
+        }
+        if (ii % 10 == 0) {
+            access(hot_keys, 9, "hot", 7, 1);
+        }
+    }
+
+    auto keys = hot_keys.top_keys();
+    ASSERT_EQ(2, keys.size());
+    ASSERT_EQ("hot", keys[0].key);
+    ASSERT_EQ(8, keys[0].cid);
+    ASSERT_LE(250U, keys[0].count);
+    ASSERT_LE(keys[0].count - keys[0].error, 250U);
+    ASSERT_EQ("hot", keys[1].key);
+    ASSERT_EQ(9, keys[1].cid);
+    ASSERT_LE(100U, keys[1].count);
+
+    auto vbuckets = hot_keys.top_vbuckets();
+    ASSERT_EQ(2, vbuckets.size());
+    ASSERT_EQ(7, vbuckets[0].first);
+    ASSERT_EQ(366U, vbuckets[0].second);
+
+    ASSERT_EQ(4, hot_keys.servers().size());
+    ASSERT_EQ(250U + 250U + 100U, hot_keys.servers()[1]);
+    /* 600 of 1350 accesses on one of 4 servers */
+    ASSERT_EQ(177U, hot_keys.skew());
+}
+
+TEST_F(HotKeysTest, testDecay)
+{
+    HotKeys hot_keys(1);
+    ASSERT_EQ(0U, hot_keys.skew());
+    ASSERT_TRUE(hot_keys.top_keys().empty());
+
+    for (std::uint64_t ii = 1; ii < HotKeys::window; ii++) {
+        ASSERT_FALSE(hot_keys.record(0, ii % 2 ? "odd" : "even", ii % 2 ? 3 : 4, -1, -1));
+    }
+    ASSERT_TRUE(hot_keys.record(0, "odd", 3, -1, -1));
+    hot_keys.decay();
+    auto keys = hot_keys.top_keys();
+    ASSERT_EQ(1, keys.size());
+    ASSERT_EQ(HotKeys::window / 4, keys[0].count);
+    ASSERT_TRUE(hot_keys.top_vbuckets().empty());
+    ASSERT_TRUE(hot_keys.servers().empty());
+}
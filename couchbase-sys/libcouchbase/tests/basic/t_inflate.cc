@@ -0,0 +1,117 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include <gtest/gtest.h>
+#include "http/inflate.h"
+
+#include <memory>
+
+#ifndef LCB_NO_HTTP_COMPRESSION
+#include <zlib.h>
+
+using lcb::http::Inflater;
+
+class InflateTest : public ::testing::Test
+{
+  protected:
+    static std::string rows()
+    {
+        std::string body = "{\"results\":[";
+        for (int ii = 0; ii < 5000; ii++) {
+            body += ii ? "," : "";
+            body += "{\"id\":\"doc-" + std::to_string(ii) + "\",\"type\":\"beer\"}";
+        }
+        return body + "]}";
+    }
+
+    /* windowBits 15 + 16 writes gzip, 15 zlib and -15 raw deflate */
+    static std::string compress(const std::string &in, int window_bits)
+    {
+        z_stream stream{};
+        EXPECT_EQ(Z_OK, deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY));
+        std::string out(deflateBound(&stream, in.size()), '\0');
+        stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(in.data()));
+        stream.avail_in = in.size();
+        stream.next_out = reinterpret_cast<Bytef *>(&out[0]);
+        stream.avail_out = out.size();
+        EXPECT_EQ(Z_STREAM_END, deflate(&stream, Z_FINISH));
+        out.resize(stream.total_out);
+        deflateEnd(&stream);
+        return out;
+    }
+
+    /* Feed the body in chunks, as it would be read from the socket */
+    static bool inflate(Inflater &inflater, const std::string &body, size_t chunk, std::string &out)
+    {
+        for (size_t ii = 0; ii < body.size(); ii += chunk) {
+            if (!inflater.feed(body.data() + ii, std::min(chunk, body.size() - ii), out)) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+TEST_F(InflateTest, testEncodings)
+{
+    ASSERT_STREQ("gzip, deflate", Inflater::accepted_encodings());
+    std::unique_ptr<Inflater> inflater(Inflater::create("GZIP"));
+    ASSERT_TRUE(inflater != nullptr);
+    inflater.reset(Inflater::create("deflate"));
+    ASSERT_TRUE(inflater != nullptr);
+    ASSERT_EQ(nullptr, Inflater::create("identity"));
+    ASSERT_EQ(nullptr, Inflater::create("br"));
+    ASSERT_EQ(nullptr, Inflater::create(nullptr));
+}
+
+TEST_F(InflateTest, testGzipInChunks)
+{
+    std::string body = rows();
+    std::string compressed = compress(body, 15 + 16);
+    ASSERT_LT(compressed.size(), body.size() / 4);
+
+    for (size_t chunk : {size_t(1), size_t(7), size_t(1024), compressed.size()}) {
+        std::unique_ptr<Inflater> inflater(Inflater::create("gzip"));
+        std::string out;
+        ASSERT_TRUE(inflate(*inflater, compressed, chunk, out));
+        ASSERT_EQ(body, out);
+    }
+}
+
+TEST_F(InflateTest, testDeflateWithAndWithoutHeader)
+{
+    std::string body = rows();
+    for (int window_bits : {15, -15}) {
+        std::unique_ptr<Inflater> inflater(Inflater::create("deflate"));
+        std::string out;
+        ASSERT_TRUE(inflate(*inflater, compress(body, window_bits), 4096, out));
+        ASSERT_EQ(body, out);
+    }
+}
+
+TEST_F(InflateTest, testCorruptBody)
+{
+    std::string compressed = compress(rows(), 15 + 16);
+    compressed[compressed.size() / 2] ^= 0x55;
+    compressed[compressed.size() / 2 + 1] ^= 0x55;
+
+    std::unique_ptr<Inflater> inflater(Inflater::create("gzip"));
+    std::string out;
+    ASSERT_FALSE(inflate(*inflater, compressed, 1024, out));
+}
+#endif
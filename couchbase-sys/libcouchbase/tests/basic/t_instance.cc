@@ -0,0 +1,60 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include <gtest/gtest.h>
+#include <libcouchbase/couchbase.h>
+#include <cstdlib>
+#include <string>
+
+#ifdef _WIN32
+#define setenv(k, v, o) SetEnvironmentVariable(k, v)
+#endif
+
+static const char *plugin_env_vars[] = {"LIBCOUCHBASE_EVENT_PLUGIN_NAME", "LIBCOUCHBASE_EVENT_PLUGIN_SYMBOL",
+                                        "LCB_IOPS_NAME", "LCB_IOPS_SYMBOL"};
+
+class InstanceTest : public ::testing::Test
+{
+  protected:
+    void SetUp() override
+    {
+        for (size_t ii = 0; ii < 4; ii++) {
+            const char *value = getenv(plugin_env_vars[ii]);
+            saved_env[ii] = value == nullptr ? "" : value;
+            setenv(plugin_env_vars[ii], "", 1);
+        }
+    }
+
+    void TearDown() override
+    {
+        for (size_t ii = 0; ii < 4; ii++) {
+            setenv(plugin_env_vars[ii], saved_env[ii].c_str(), 1);
+        }
+    }
+
+    std::string saved_env[4];
+};
+
+TEST_F(InstanceTest, testCreateFailure)
+{
+    /* the half built instance is destroyed, and the error returned */
+    setenv("LCB_IOPS_NAME", "bogus", 1);
+    lcb_INSTANCE *instance = nullptr;
+    ASSERT_EQ(LCB_ERR_BAD_ENVIRONMENT, lcb_create(&instance, nullptr));
+    ASSERT_EQ(nullptr, instance);
+}
@@ -0,0 +1,127 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include <gtest/gtest.h>
+#include <libcouchbase/couchbase.h>
+
+#include <atomic>
+#include <map>
+#include <set>
+#include <thread>
+#include <vector>
+
+class InstancePoolTests : public ::testing::Test
+{
+};
+
+TEST_F(InstancePoolTests, testCreate)
+{
+    lcb_INSTANCE_POOL *pool = nullptr;
+    ASSERT_EQ(LCB_ERR_INVALID_ARGUMENT, lcb_instance_pool_create(&pool, nullptr, 0));
+
+    ASSERT_EQ(LCB_SUCCESS, lcb_instance_pool_create(&pool, nullptr, 3));
+    ASSERT_EQ(3U, lcb_instance_pool_size(pool));
+    std::set<lcb_INSTANCE *> instances;
+    for (size_t ii = 0; ii < 3; ii++) {
+        ASSERT_NE(nullptr, lcb_instance_pool_get(pool, ii));
+        instances.insert(lcb_instance_pool_get(pool, ii));
+    }
+    ASSERT_EQ(3U, instances.size());
+    ASSERT_EQ(nullptr, lcb_instance_pool_get(pool, 3));
+    lcb_instance_pool_destroy(pool);
+}
+
+TEST_F(InstancePoolTests, testAffinity)
+{
+    lcb_INSTANCE_POOL *pool = nullptr;
+    ASSERT_EQ(LCB_SUCCESS, lcb_instance_pool_create(&pool, nullptr, 4));
+
+    lcb_INSTANCE *first = lcb_instance_pool_acquire(pool);
+    lcb_instance_pool_release(pool, first);
+    for (size_t ii = 0; ii < 10; ii++) {
+        lcb_INSTANCE *instance = lcb_instance_pool_acquire(pool);
+        ASSERT_EQ(first, instance);
+        lcb_instance_pool_release(pool, instance);
+    }
+
+    // while the instance is used elsewhere, another one is handed out
+    lcb_INSTANCE *other = nullptr;
+    first = lcb_instance_pool_acquire(pool);
+    std::thread([&] {
+        other = lcb_instance_pool_acquire(pool);
+        lcb_instance_pool_release(pool, other);
+    }).join();
+    ASSERT_NE(nullptr, other);
+    ASSERT_NE(first, other);
+    lcb_instance_pool_release(pool, first);
+    lcb_instance_pool_destroy(pool);
+}
+
+TEST_F(InstancePoolTests, testBlocksWhenExhausted)
+{
+    lcb_INSTANCE_POOL *pool = nullptr;
+    ASSERT_EQ(LCB_SUCCESS, lcb_instance_pool_create(&pool, nullptr, 2));
+
+    lcb_INSTANCE *a = lcb_instance_pool_acquire(pool);
+    lcb_INSTANCE *b = lcb_instance_pool_acquire(pool);
+    ASSERT_NE(a, b);
+
+    std::atomic<lcb_INSTANCE *> acquired{nullptr};
+    std::thread waiter([&] { acquired = lcb_instance_pool_acquire(pool); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    ASSERT_EQ(nullptr, acquired.load());
+
+    lcb_instance_pool_release(pool, b);
+    waiter.join();
+    ASSERT_EQ(b, acquired.load());
+    lcb_instance_pool_release(pool, b);
+    lcb_instance_pool_release(pool, a);
+    lcb_instance_pool_destroy(pool);
+}
+
+TEST_F(InstancePoolTests, testExclusive)
+{
+    const size_t nthreads = 8;
+    const size_t niters = 2000;
+    lcb_INSTANCE_POOL *pool = nullptr;
+    ASSERT_EQ(LCB_SUCCESS, lcb_instance_pool_create(&pool, nullptr, 3));
+
+    std::map<lcb_INSTANCE *, std::atomic<int>> users;
+    for (size_t ii = 0; ii < 3; ii++) {
+        users[lcb_instance_pool_get(pool, ii)] = 0;
+    }
+    std::atomic<size_t> overlaps{0};
+    std::vector<std::thread> threads;
+    for (size_t ii = 0; ii < nthreads; ii++) {
+        threads.emplace_back([&] {
+            for (size_t jj = 0; jj < niters; jj++) {
+                lcb_INSTANCE *instance = lcb_instance_pool_acquire(pool);
+                if (users[instance].fetch_add(1) != 0) {
+                    overlaps++;
+                }
+                users[instance].fetch_sub(1);
+                lcb_instance_pool_release(pool, instance);
+            }
+        });
+    }
+    for (auto &thr : threads) {
+        thr.join();
+    }
+    ASSERT_EQ(0U, overlaps.load());
+    lcb_instance_pool_destroy(pool);
+}
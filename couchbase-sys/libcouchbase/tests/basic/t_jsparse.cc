@@ -113,3 +113,136 @@ TEST_F(JsonParseTest, testInvalidJSON)
     ASSERT_TRUE(lcb::jsparse::parse_json(input, meta));
     ASSERT_FALSE(lcb::jsparse::parse_json_strict(input, meta));
 }
+
+TEST_F(JsonParseTest, testRowSplitting)
+{
+    std::string txt = "{\"requestID\": \"x\", \"results\": [ {\"a\": \"}]\\\\\\\"[{\", \"b\": [1, {\"c\": []}]},"
+                      "\"str\\\"ing]\" , 42,true,null ,[[], {}], {\"YyY_\": \"\\\\\"}\n], \"status\": \"success\"}";
+    std::vector<std::string> expected;
+    expected.push_back("{\"a\": \"}]\\\\\\\"[{\", \"b\": [1, {\"c\": []}]}");
+    expected.push_back("\"str\\\"ing]\"");
+    expected.push_back("42");
+    expected.push_back("true");
+    expected.push_back("null");
+    expected.push_back("[[], {}]");
+    expected.push_back("{\"YyY_\": \"\\\\\"}");
+
+    // Whole buffer, then in every chunk size up to a few words
+    for (size_t chunk = txt.size(); chunk > 0; chunk = (chunk == txt.size() ? 19 : chunk - 1)) {
+        Context cx;
+        Parser parser(Parser::MODE_N1QL, &cx);
+        for (size_t ii = 0; ii < txt.size(); ii += chunk) {
+            parser.feed(txt.c_str() + ii, std::min(chunk, txt.size() - ii));
+        }
+        ASSERT_EQ(LCB_SUCCESS, cx.rc);
+        ASSERT_TRUE(cx.received_done);
+        ASSERT_EQ(expected, cx.rows);
+        ASSERT_EQ("{\"requestID\": \"x\", \"results\": [ ], \"status\": \"success\"}", cx.meta);
+    }
+
+    const char *bad[] = {"{\"results\": [{\"a\": 1]]}", "{\"results\": [1 2]}", "{\"results\": [1,]}",
+                         "{\"results\": [,1]}", "{\"results\": [}]}"};
+    for (size_t ii = 0; ii < sizeof(bad) / sizeof(bad[0]); ii++) {
+        ASSERT_TRUE(validateBadParse(bad[ii], strlen(bad[ii]), Parser::MODE_N1QL));
+    }
+}
+
+struct ChunkContext : Context {
+    const char *chunk{nullptr};
+    size_t nchunk{0};
+    size_t in_chunk{0};
+    void JSPARSE_on_row(const Row &row) override
+    {
+        const char *p = static_cast<const char *>(row.row.iov_base);
+        if (p >= chunk && p + row.row.iov_len <= chunk + nchunk) {
+            in_chunk++;
+        }
+        Context::JSPARSE_on_row(row);
+    }
+};
+
+TEST_F(JsonParseTest, testRowsReferenceChunk)
+{
+    std::string header = "{\"results\": [";
+    std::string rows1 = "{\"a\": 1}, {\"b\": 2}, {\"c\":";
+    std::string rows2 = " 3}, {\"d\": 4}], \"status\": \"success\"}";
+
+    ChunkContext cx;
+    Parser parser(Parser::MODE_N1QL, &cx);
+    parser.feed(header);
+    cx.chunk = rows1.c_str();
+    cx.nchunk = rows1.size();
+    parser.feed(rows1);
+    cx.chunk = rows2.c_str();
+    cx.nchunk = rows2.size();
+    parser.feed(rows2);
+
+    ASSERT_EQ(LCB_SUCCESS, cx.rc);
+    ASSERT_TRUE(cx.received_done);
+    std::vector<std::string> expected = {"{\"a\": 1}", "{\"b\": 2}", "{\"c\": 3}", "{\"d\": 4}"};
+    ASSERT_EQ(expected, cx.rows);
+    // Only the row spanning both chunks had to be copied
+    ASSERT_EQ(3, cx.in_chunk);
+    ASSERT_EQ("{\"results\": [], \"status\": \"success\"}", cx.meta);
+}
+
+struct StoppingContext : Context {
+    Parser *parser{nullptr};
+    size_t max_rows{0};
+    void JSPARSE_on_row(const Row &row) override
+    {
+        Context::JSPARSE_on_row(row);
+        if (rows.size() == max_rows) {
+            parser->stop();
+        }
+    }
+};
+
+TEST_F(JsonParseTest, testStop)
+{
+    std::string header = "{\"requestID\": \"42\", \"results\": [";
+    std::string rows1 = "{\"a\": 1}, {\"b\": 2}, {\"c\": 3}, {\"d\":";
+    std::string rows2 = " 4}], \"status\": \"success\"}";
+
+    StoppingContext cx;
+    Parser parser(Parser::MODE_N1QL, &cx);
+    cx.parser = &parser;
+    cx.max_rows = 2;
+    parser.feed(header);
+    parser.feed(rows1);
+    parser.feed(rows2);
+
+    ASSERT_EQ(LCB_SUCCESS, cx.rc);
+    ASSERT_FALSE(cx.received_done);
+    std::vector<std::string> expected = {"{\"a\": 1}", "{\"b\": 2}"};
+    ASSERT_EQ(expected, cx.rows);
+
+    lcb_IOV meta;
+    parser.get_postmortem(meta);
+    ASSERT_EQ("{\"requestID\": \"42\", \"results\": []}", iov2s(meta));
+}
+
+TEST_F(JsonParseTest, testProjection)
+{
+    std::string hit = "{\"index\": \"ix_1\", \"id\": \"doc\\\"1\", \"score\": 0.5, "
+                      "\"locations\": {\"title\": {\"a]\": [{\"pos\": 1}]}}, "
+                      "\"fields\": {\"title\": \"t\", \"body\": [1, {\"x\": \"}\"}]}}";
+
+    Projection projection;
+    projection.add("id");
+    projection.add("score");
+    projection.add("fields.title");
+    projection.add("sort.missing");
+
+    std::string out;
+    ASSERT_TRUE(projection.project(hit.c_str(), hit.size(), out));
+    ASSERT_EQ("{\"id\":\"doc\\\"1\",\"score\":0.5,\"fields\":{\"title\":\"t\"}}", out);
+
+    Projection whole;
+    whole.add("fields");
+    ASSERT_TRUE(whole.project(hit.c_str(), hit.size(), out));
+    ASSERT_EQ("{\"fields\":{\"title\": \"t\", \"body\": [1, {\"x\": \"}\"}]}}", out);
+
+    std::string truncated = hit.substr(0, hit.size() - 2);
+    ASSERT_FALSE(projection.project(truncated.c_str(), truncated.size(), out));
+}
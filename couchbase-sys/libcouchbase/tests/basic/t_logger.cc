@@ -21,6 +21,8 @@
 #include "logging.h"
 #include "internal.h"
 #include <list>
+#include <chrono>
+#include <thread>
 
 using namespace std;
 
@@ -81,3 +83,48 @@ TEST_F(Logger, testLogger)
 
     lcb_logger_destroy(procs.base);
 }
+
+TEST_F(Logger, testConsoleRateLimit)
+{
+    static const char *subsys = "test-ratelimit";
+    lcb_U64 suppressed = 0;
+
+    for (int ii = 0; ii < 5; ii++) {
+        ASSERT_EQ(1, lcb_conlog_admit(subsys, 5, &suppressed));
+        ASSERT_EQ(0, suppressed);
+    }
+    ASSERT_EQ(0, lcb_conlog_admit(subsys, 5, &suppressed));
+    ASSERT_EQ(0, lcb_conlog_admit(subsys, 5, &suppressed));
+
+    // A token is back after 1/5 of a second, and carries the suppressed count
+    std::this_thread::sleep_for(std::chrono::milliseconds(250));
+    ASSERT_EQ(1, lcb_conlog_admit(subsys, 5, &suppressed));
+    ASSERT_EQ(2, suppressed);
+
+    // Zero disables the limit
+    ASSERT_EQ(1, lcb_conlog_admit(subsys, 0, &suppressed));
+}
+
+TEST_F(Logger, testConsoleAsyncCntl)
+{
+    lcb_INSTANCE *instance;
+    lcb_create(&instance, NULL);
+
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "console_log_async", "true"));
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "console_log_rate", "100"));
+    int async = 0;
+    lcb_U32 rate = 0;
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_CONLOGGER_ASYNC, &async));
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_CONLOGGER_RATE, &rate));
+    ASSERT_EQ(1, async);
+    ASSERT_EQ(100, rate);
+
+    lcb_U64 dropped = -1;
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_CONLOGGER_DROPPED, &dropped));
+    ASSERT_NE((lcb_U64)-1, dropped);
+    ASSERT_EQ(LCB_ERR_CONTROL_UNSUPPORTED_MODE, lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_CONLOGGER_DROPPED, &dropped));
+
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "console_log_async", "false"));
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "console_log_rate", "0"));
+    lcb_destroy(instance);
+}
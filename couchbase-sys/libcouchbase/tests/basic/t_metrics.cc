@@ -0,0 +1,280 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include <gtest/gtest.h>
+#include <libcouchbase/couchbase.h>
+#include "internal.h"
+#include "metrics/caching_meter.hh"
+#include "metrics/compact_histogram.hh"
+#include "metrics/openmetrics_meter.hh"
+
+#include <string>
+#include <thread>
+
+class CachingMeterTests : public ::testing::Test
+{
+};
+
+static const lcbmetrics_VALUERECORDER *count_recorders(const lcbmetrics_METER *meter, const char *, const lcbmetrics_TAG *,
+                                                       size_t)
+{
+    void *cookie = nullptr;
+    lcbmetrics_meter_cookie(meter, &cookie);
+    ++*static_cast<int *>(cookie);
+
+    lcbmetrics_VALUERECORDER *recorder = nullptr;
+    lcbmetrics_valuerecorder_create(&recorder, nullptr);
+    return recorder;
+}
+
+TEST_F(CachingMeterTests, testLookup)
+{
+    int created = 0;
+    lcbmetrics_METER *base = nullptr;
+    lcbmetrics_meter_create(&base, &created);
+    lcbmetrics_meter_value_recorder_callback(base, count_recorders);
+    const lcbmetrics_METER *meter = (new lcb::metrics::CachingMeter(base))->wrap();
+
+    lcbmetrics_TAG get[2] = {{METRICS_SVC_TAG_NAME, "kv"}, {METRICS_OP_TAG_NAME, "get"}};
+    lcbmetrics_TAG touch[2] = {{METRICS_SVC_TAG_NAME, "kv"}, {METRICS_OP_TAG_NAME, "touch"}};
+    lcbmetrics_TAG shifted[2] = {{METRICS_SVC_TAG_NAME, "kvg"}, {METRICS_OP_TAG_NAME, "et"}};
+
+    auto *first = meter->value_recorder_(meter, METRICS_OPS_METER_NAME, get, 2);
+    ASSERT_NE(nullptr, first);
+    ASSERT_EQ(first, meter->value_recorder_(meter, METRICS_OPS_METER_NAME, get, 2));
+    ASSERT_EQ(1, created);
+
+    ASSERT_NE(first, meter->value_recorder_(meter, METRICS_OPS_METER_NAME, touch, 2));
+    ASSERT_NE(first, meter->value_recorder_(meter, METRICS_OPS_METER_NAME, shifted, 2));
+    ASSERT_NE(first, meter->value_recorder_(meter, METRICS_OPS_METER_NAME, get, 1));
+    ASSERT_NE(first, meter->value_recorder_(meter, METRICS_RETRYQ_AGE_METER_NAME, get, 2));
+    ASSERT_EQ(5, created);
+
+    ASSERT_EQ(first, meter->value_recorder_(meter, METRICS_OPS_METER_NAME, get, 2));
+    ASSERT_EQ(5, created);
+
+    lcbmetrics_meter_destroy(meter);
+    lcbmetrics_meter_destroy(base);
+}
+
+class OpenMetricsMeterTests : public ::testing::Test
+{
+  protected:
+    static void collect(void *cookie, const char *text, size_t ntext)
+    {
+        static_cast<std::string *>(cookie)->assign(text, ntext);
+    }
+
+    static std::string render(const lcbmetrics_METER *meter)
+    {
+        std::string text;
+        EXPECT_EQ(LCB_SUCCESS, lcbmetrics_openmetrics_render(meter, collect, &text));
+        return text;
+    }
+};
+
+TEST_F(OpenMetricsMeterTests, testBuckets)
+{
+    using lcb::metrics::OpenMetricsHistogram;
+    ASSERT_EQ(0, OpenMetricsHistogram::bucket_of(0));
+    ASSERT_EQ(0, OpenMetricsHistogram::bucket_of(1));
+    ASSERT_EQ(1, OpenMetricsHistogram::bucket_of(2));
+    ASSERT_EQ(1, OpenMetricsHistogram::bucket_of(4));
+    ASSERT_EQ(2, OpenMetricsHistogram::bucket_of(5));
+    ASSERT_EQ(5, OpenMetricsHistogram::bucket_of(1024));
+    ASSERT_EQ(6, OpenMetricsHistogram::bucket_of(1025));
+    ASSERT_EQ(20, OpenMetricsHistogram::bucket_of(OpenMetricsHistogram::upper_bound(20)));
+    ASSERT_EQ(21, OpenMetricsHistogram::bucket_of(OpenMetricsHistogram::upper_bound(20) + 1));
+    ASSERT_EQ(21, OpenMetricsHistogram::bucket_of(UINT64_MAX));
+}
+
+TEST_F(OpenMetricsMeterTests, testRender)
+{
+    lcbmetrics_METER *meter = nullptr;
+    ASSERT_EQ(LCB_SUCCESS, lcbmetrics_openmetrics_create(&meter));
+    ASSERT_EQ("# EOF\n", render(meter));
+
+    lcbmetrics_TAG get[2] = {{METRICS_SVC_TAG_NAME, "kv"}, {METRICS_OP_TAG_NAME, "get"}};
+    lcbmetrics_TAG quoted[1] = {{METRICS_SVC_TAG_NAME, "a\"b"}};
+    auto *recorder = meter->value_recorder_(meter, METRICS_OPS_METER_NAME, get, 2);
+    recorder->record_value_(recorder, 3);
+    recorder->record_value_(recorder, 1000);
+    /* the histogram outlives its recorders */
+    lcbmetrics_valuerecorder_destroy(recorder);
+    recorder = meter->value_recorder_(meter, METRICS_OPS_METER_NAME, get, 2);
+    recorder->record_value_(recorder, 5000000);
+    lcbmetrics_valuerecorder_destroy(recorder);
+    recorder = meter->value_recorder_(meter, METRICS_RETRYQ_DEPTH_METER_NAME, quoted, 1);
+    lcbmetrics_valuerecorder_destroy(recorder);
+
+    std::string text = render(meter);
+    const char *labels = R"(db_couchbase_service="kv",db_operation="get")";
+    ASSERT_NE(std::string::npos, text.find("# TYPE db_couchbase_operations histogram\n"));
+    ASSERT_NE(std::string::npos, text.find(std::string("db_couchbase_operations_bucket{") + labels + R"(,le="1"} 0)"));
+    ASSERT_NE(std::string::npos, text.find(std::string("db_couchbase_operations_bucket{") + labels + R"(,le="4"} 1)"));
+    ASSERT_NE(std::string::npos,
+              text.find(std::string("db_couchbase_operations_bucket{") + labels + R"(,le="1024"} 2)"));
+    ASSERT_NE(std::string::npos,
+              text.find(std::string("db_couchbase_operations_bucket{") + labels + R"(,le="+Inf"} 3)"));
+    ASSERT_NE(std::string::npos, text.find(std::string("db_couchbase_operations_count{") + labels + "} 3\n"));
+    ASSERT_NE(std::string::npos, text.find(std::string("db_couchbase_operations_sum{") + labels + "} 5001003\n"));
+    ASSERT_NE(std::string::npos, text.find(R"(db_couchbase_retry_queue_depth_count{db_couchbase_service="a\"b"} 0)"));
+    ASSERT_EQ(text.size() - 6, text.find("# EOF\n"));
+
+    lcbmetrics_meter_destroy(meter);
+}
+
+TEST_F(OpenMetricsMeterTests, testRenderWhileRecording)
+{
+    lcbmetrics_METER *meter = nullptr;
+    ASSERT_EQ(LCB_SUCCESS, lcbmetrics_openmetrics_create(&meter));
+    lcbmetrics_TAG get[2] = {{METRICS_SVC_TAG_NAME, "kv"}, {METRICS_OP_TAG_NAME, "get"}};
+    auto *recorder = meter->value_recorder_(meter, METRICS_OPS_METER_NAME, get, 2);
+
+    std::thread scraper([meter] {
+        for (int ii = 0; ii < 100; ii++) {
+            render(meter);
+        }
+    });
+    for (std::uint64_t ii = 0; ii < 100000; ii++) {
+        recorder->record_value_(recorder, ii);
+    }
+    scraper.join();
+    ASSERT_NE(std::string::npos,
+              render(meter).find(R"(_count{db_couchbase_service="kv",db_operation="get"} 100000)"));
+
+    lcbmetrics_valuerecorder_destroy(recorder);
+    lcbmetrics_meter_destroy(meter);
+}
+
+TEST_F(OpenMetricsMeterTests, testRejectsOtherMeters)
+{
+    lcbmetrics_METER *meter = nullptr;
+    lcbmetrics_meter_create(&meter, nullptr);
+    ASSERT_EQ(LCB_ERR_INVALID_ARGUMENT, lcbmetrics_openmetrics_render(meter, collect, nullptr));
+    lcbmetrics_meter_destroy(meter);
+}
+
+class CompactHistogramTests : public ::testing::Test
+{
+};
+
+TEST_F(CompactHistogramTests, testBuckets)
+{
+    using lcb::metrics::CompactHistogram;
+    ASSERT_EQ(0, CompactHistogram::bucket_of(0));
+    ASSERT_EQ(63, CompactHistogram::bucket_of(63));
+    ASSERT_EQ(64, CompactHistogram::bucket_of(64));
+    ASSERT_EQ(64, CompactHistogram::bucket_of(65));
+    ASSERT_EQ(65, CompactHistogram::bucket_of(66));
+    for (std::size_t ii = 0; ii + 1 < CompactHistogram::nbuckets; ii++) {
+        ASSERT_EQ(ii, CompactHistogram::bucket_of(CompactHistogram::lower_bound(ii)));
+        ASSERT_EQ(ii, CompactHistogram::bucket_of(CompactHistogram::upper_bound(ii)));
+        ASSERT_EQ(CompactHistogram::upper_bound(ii) + 1, CompactHistogram::lower_bound(ii + 1));
+        /* within two significant figures */
+        ASSERT_LE(CompactHistogram::upper_bound(ii) - CompactHistogram::lower_bound(ii),
+                  CompactHistogram::lower_bound(ii) / 32);
+    }
+    ASSERT_EQ(CompactHistogram::nbuckets - 1, CompactHistogram::bucket_of(std::uint64_t(1) << 36));
+    ASSERT_EQ(CompactHistogram::nbuckets - 1, CompactHistogram::bucket_of(UINT64_MAX));
+    ASSERT_GE(4200, sizeof(CompactHistogram));
+}
+
+TEST_F(CompactHistogramTests, testPercentiles)
+{
+    lcb::metrics::CompactHistogram histogram;
+    for (std::uint64_t ii = 1; ii <= 10000; ii++) {
+        histogram.record(ii * 1000);
+    }
+
+    lcb::metrics::HistogramSnapshot snapshot;
+    histogram.collect(snapshot);
+    ASSERT_EQ(10000, snapshot.total_count());
+    ASSERT_EQ(10000000, snapshot.max());
+    ASSERT_EQ(10000000, snapshot.value_at_percentile(100.0));
+    std::uint64_t median = snapshot.value_at_percentile(50.0);
+    ASSERT_LE(5000000, median);
+    ASSERT_GE(5000000 * 1.04, median);
+    std::uint64_t p99 = snapshot.value_at_percentile(99.0);
+    ASSERT_LE(9900000, p99);
+    ASSERT_GE(9900000 * 1.04, p99);
+
+    std::uint64_t total = 0;
+    snapshot.for_each([&total](std::uint64_t lower, std::uint64_t upper, std::uint64_t count) {
+        EXPECT_LE(lower, upper);
+        total += count;
+    });
+    ASSERT_EQ(10000, total);
+}
+
+TEST_F(CompactHistogramTests, testMergeAndDrain)
+{
+    lcb::metrics::CompactHistogram first;
+    lcb::metrics::CompactHistogram second;
+    std::thread recorder([&first] {
+        for (std::uint64_t ii = 0; ii < 100000; ii++) {
+            first.record(ii);
+        }
+    });
+    for (std::uint64_t ii = 0; ii < 100000; ii++) {
+        second.record(ii + 1000000);
+    }
+    recorder.join();
+
+    lcb::metrics::HistogramSnapshot merged;
+    first.drain(merged);
+    lcb::metrics::HistogramSnapshot other;
+    second.collect(other);
+    merged.merge(other);
+    ASSERT_EQ(200000, merged.total_count());
+    ASSERT_EQ(1099999, merged.max());
+    ASSERT_GT(1000000, merged.value_at_percentile(50.0));
+    ASSERT_LE(1000000, merged.value_at_percentile(50.1));
+
+    lcb::metrics::HistogramSnapshot drained;
+    first.collect(drained);
+    ASSERT_EQ(0, drained.total_count());
+    ASSERT_EQ(0, drained.value_at_percentile(50.0));
+}
+
+class VBucketMetricsTests : public ::testing::Test
+{
+};
+
+TEST_F(VBucketMetricsTests, testCounters)
+{
+    lcb_METRICS *metrics = lcb_metrics_new();
+    ASSERT_EQ(0U, metrics->nvbuckets);
+    ASSERT_NE(nullptr, metrics->vbuckets);
+
+    lcb_VBUCKETMETRICS *vbm = lcb_metrics_getvbucket(metrics, 42);
+    ASSERT_NE(nullptr, vbm);
+    ASSERT_EQ(43U, metrics->nvbuckets);
+    vbm->nmv++;
+    ASSERT_EQ(1U, metrics->vbuckets[42].nmv);
+    ASSERT_EQ(0U, metrics->vbuckets[41].nmv);
+
+    ASSERT_EQ(vbm, lcb_metrics_getvbucket(metrics, 42));
+    ASSERT_NE(nullptr, lcb_metrics_getvbucket(metrics, 7));
+    ASSERT_EQ(43U, metrics->nvbuckets);
+
+    ASSERT_NE(nullptr, lcb_metrics_getvbucket(metrics, LCB_VBUCKETMETRICS_MAX - 1));
+    ASSERT_EQ(nullptr, lcb_metrics_getvbucket(metrics, LCB_VBUCKETMETRICS_MAX));
+    ASSERT_EQ(LCB_VBUCKETMETRICS_MAX, metrics->nvbuckets);
+    lcb_metrics_destroy(metrics);
+}
@@ -0,0 +1,99 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2020 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include <gtest/gtest.h>
+#include <libcouchbase/couchbase.h>
+
+#include <vector>
+
+class MultiTests : public ::testing::Test
+{
+};
+
+namespace
+{
+struct MultiResult {
+    std::vector<std::pair<void *, lcb_STATUS>> responses{};
+    bool completed{false};
+    size_t nsuccess{0};
+    size_t nfailure{0};
+    lcb_STATUS first_error{LCB_SUCCESS};
+};
+
+MultiResult *current_result = nullptr;
+
+void touch_callback(lcb_INSTANCE *, int, const lcb_RESPTOUCH *resp)
+{
+    void *cookie;
+    lcb_resptouch_cookie(resp, &cookie);
+    current_result->responses.emplace_back(cookie, lcb_resptouch_status(resp));
+}
+
+void multi_callback(lcb_INSTANCE *, void *cookie, size_t nsuccess, size_t nfailure, lcb_STATUS first_error)
+{
+    auto *result = static_cast<MultiResult *>(cookie);
+    // the operation completes after the last key
+    ASSERT_EQ(3U, result->responses.size());
+    result->completed = true;
+    result->nsuccess = nsuccess;
+    result->nfailure = nfailure;
+    result->first_error = first_error;
+}
+} // namespace
+
+TEST_F(MultiTests, testAggregatedCompletion)
+{
+    lcb_INSTANCE *instance;
+    ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, nullptr));
+    lcb_install_callback(instance, LCB_CALLBACK_TOUCH, reinterpret_cast<lcb_RESPCALLBACK>(touch_callback));
+
+    MultiResult result;
+    current_result = &result;
+    ASSERT_EQ(LCB_ERR_INVALID_ARGUMENT, lcb_touch_multi(instance, &result, nullptr, nullptr, 0, multi_callback));
+
+    lcb_CMDTOUCH *cmds[3];
+    for (auto &cmd : cmds) {
+        lcb_cmdtouch_create(&cmd);
+        lcb_cmdtouch_expiry(cmd, 60);
+    }
+    lcb_cmdtouch_key(cmds[0], "a", 1);
+    // cmds[1] has no key and fails right away
+    lcb_cmdtouch_key(cmds[2], "c", 1);
+    int cookies[3];
+    void *cookie_ptrs[3] = {&cookies[0], &cookies[1], &cookies[2]};
+
+    ASSERT_EQ(LCB_SUCCESS, lcb_touch_multi(instance, &result, cmds, cookie_ptrs, 3, multi_callback));
+    for (auto &cmd : cmds) {
+        lcb_cmdtouch_destroy(cmd);
+    }
+    ASSERT_EQ(1U, result.responses.size());
+    ASSERT_EQ(&cookies[1], result.responses[0].first);
+    ASSERT_EQ(LCB_ERR_EMPTY_KEY, result.responses[0].second);
+    ASSERT_FALSE(result.completed);
+
+    // without a connection the other two are deferred, and canceled on destroy
+    lcb_destroy(instance);
+    ASSERT_TRUE(result.completed);
+    ASSERT_EQ(&cookies[0], result.responses[1].first);
+    ASSERT_EQ(LCB_ERR_REQUEST_CANCELED, result.responses[1].second);
+    ASSERT_EQ(&cookies[2], result.responses[2].first);
+    ASSERT_EQ(0U, result.nsuccess);
+    ASSERT_EQ(3U, result.nfailure);
+    ASSERT_EQ(LCB_ERR_EMPTY_KEY, result.first_error);
+    current_result = nullptr;
+}
@@ -108,3 +108,48 @@ TEST_F(N1qLStringTests, testAnalyticsPositionalParams)
         R"({"args":["Universe","life","Everything"],"statement":"SELECT 42 AS the_answer WHERE question IN (?, ?, ?) "})",
         std::string(payload, payload_len));
 }
+
+TEST_F(N1qLStringTests, testQueryConsistencyTokens)
+{
+    lcb_CMDQUERY *cmd = nullptr;
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cmdquery_create(&cmd));
+
+    std::string statement = "SELECT 42";
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cmdquery_statement(cmd, statement.c_str(), statement.size()));
+
+    lcb_MUTATION_TOKEN token{};
+    ASSERT_STATUS_EQ(LCB_ERR_INVALID_ARGUMENT, lcb_cmdquery_consistency_token_for_keyspace(cmd, "default", 7, &token));
+
+    // Only the newest token of each vBucket is kept
+    token.uuid_ = 18446744073709551615ULL;
+    token.seqno_ = 7;
+    token.vbid_ = 1023;
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cmdquery_consistency_token_for_keyspace(cmd, "default", 7, &token));
+    token.seqno_ = 5;
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cmdquery_consistency_token_for_keyspace(cmd, "default", 7, &token));
+    token.uuid_ = 3;
+    token.seqno_ = 42;
+    token.vbid_ = 0;
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cmdquery_consistency_token_for_keyspace(cmd, "default", 7, &token));
+    token.seqno_ = 43;
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cmdquery_consistency_token_for_keyspace(cmd, "default", 7, &token));
+
+    const char *payload = nullptr;
+    size_t payload_len = 0;
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cmdquery_encoded_payload(cmd, &payload, &payload_len));
+    ASSERT_EQ(R"({"scan_consistency":"at_plus","statement":"SELECT 42",)"
+              R"("scan_vectors":{"default":{"0":[43,"3"],"1023":[7,"18446744073709551615"]}}})",
+              std::string(payload, payload_len));
+
+    // Vectors passed by the application are merged
+    std::string body = R"({"statement":"SELECT 42","scan_vectors":{"travel-sample":{"3":[1,"2"]}}})";
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cmdquery_payload(cmd, body.c_str(), body.size()));
+    token.vbid_ = 4;
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cmdquery_consistency_token_for_keyspace(cmd, "travel-sample", 13, &token));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cmdquery_encoded_payload(cmd, &payload, &payload_len));
+    ASSERT_EQ(R"({"scan_consistency":"at_plus","scan_vectors":{"travel-sample":{"3":[1,"2"],"4":[43,"3"]}},)"
+              R"("statement":"SELECT 42"})",
+              std::string(payload, payload_len));
+
+    lcb_cmdquery_destroy(cmd);
+}
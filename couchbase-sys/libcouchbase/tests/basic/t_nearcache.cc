@@ -0,0 +1,198 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include <gtest/gtest.h>
+#include "nearcache.h"
+
+using lcb::NearCache;
+using lcb::NegativeFilter;
+using lcb::TouchWindow;
+
+class NearCacheTest : public ::testing::Test
+{
+  protected:
+    static NearCache::Entry entry(const std::string &value, std::uint64_t cas)
+    {
+        NearCache::Entry result;
+        result.value = value;
+        result.cas = cas;
+        return result;
+    }
+};
+
+TEST_F(NearCacheTest, testKeys)
+{
+    ASSERT_NE(NearCache::make_key(0, "key", 3), NearCache::make_key(8, "key", 3));
+    ASSERT_EQ(NearCache::make_key(8, "key", 3), NearCache::make_key(8, "key", 3));
+    ASSERT_EQ(7U, NearCache::make_key(8, "key", 3).size());
+}
+
+TEST_F(NearCacheTest, testStoreAndExpire)
+{
+    NearCache cache;
+    std::string key = NearCache::make_key(0, "key", 3);
+    ASSERT_EQ(nullptr, cache.find(key, 100, 0));
+
+    cache.store(key, entry("value", 42), 90, 100, 16);
+    const NearCache::Entry *found = cache.find(key, 150, 100);
+    ASSERT_NE(nullptr, found);
+    ASSERT_EQ("value", found->value);
+    ASSERT_EQ(42U, found->cas);
+
+    // expired once the TTL has passed since it was stored
+    ASSERT_EQ(nullptr, cache.find(key, 200, 100));
+    cache.store(key, entry("newer", 43), 210, 220, 16);
+    ASSERT_NE(nullptr, cache.find(key, 1000000, 0));
+}
+
+TEST_F(NearCacheTest, testEviction)
+{
+    NearCache cache;
+    std::string a = NearCache::make_key(0, "a", 1);
+    std::string b = NearCache::make_key(0, "b", 1);
+    std::string c = NearCache::make_key(0, "c", 1);
+    cache.store(a, entry("a", 1), 0, 1, 2);
+    cache.store(b, entry("b", 2), 0, 1, 2);
+    ASSERT_NE(nullptr, cache.find(a, 2, 0));
+
+    // b is the least recently used
+    cache.store(c, entry("c", 3), 0, 3, 2);
+    ASSERT_EQ(2U, cache.size());
+    ASSERT_NE(nullptr, cache.find(a, 4, 0));
+    ASSERT_EQ(nullptr, cache.find(b, 4, 0));
+    ASSERT_NE(nullptr, cache.find(c, 4, 0));
+
+    cache.store(b, entry("b", 2), 0, 5, 0);
+    ASSERT_EQ(nullptr, cache.find(b, 6, 0));
+}
+
+TEST_F(NearCacheTest, testInvalidate)
+{
+    NearCache cache;
+    std::string key = NearCache::make_key(0, "key", 3);
+    cache.store(key, entry("value", 42), 0, 10, 16);
+    cache.invalidate(key, 20);
+    ASSERT_EQ(nullptr, cache.find(key, 30, 0));
+
+    // a get sent before the mutation may have read the old value
+    cache.store(key, entry("value", 42), 15, 30, 16);
+    ASSERT_EQ(nullptr, cache.find(key, 40, 0));
+    cache.store(key, entry("mutated", 43), 25, 40, 16);
+    ASSERT_NE(nullptr, cache.find(key, 50, 0));
+    ASSERT_EQ(43U, cache.find(key, 50, 0)->cas);
+}
+
+TEST_F(NearCacheTest, testInvalidateWhileReading)
+{
+    NearCache cache;
+    std::string key = NearCache::make_key(0, "key", 3);
+
+    // the document is mutated while the first get is in flight
+    cache.reserve(key, 16);
+    cache.invalidate(key, 20);
+    cache.store(key, entry("value", 42), 10, 30, 16);
+    ASSERT_EQ(nullptr, cache.find(key, 40, 0));
+
+    // mutations of documents which were never read are not remembered
+    std::string other = NearCache::make_key(0, "other", 5);
+    cache.invalidate(other, 20);
+    ASSERT_EQ(1U, cache.size());
+}
+
+TEST_F(NearCacheTest, testNegativeFilter)
+{
+    NegativeFilter filter;
+    std::string key = NearCache::make_key(0, "missing", 7);
+    std::string other = NearCache::make_key(8, "missing", 7);
+    ASSERT_FALSE(filter.contains(key, 0, 100));
+
+    filter.add(key, 5, 10, 100, 16);
+    ASSERT_TRUE(filter.contains(key, 20, 100));
+    ASSERT_FALSE(filter.contains(other, 20, 100));
+
+    // nothing is remembered without capacity
+    NegativeFilter disabled;
+    disabled.add(key, 5, 10, 100, 0);
+    ASSERT_FALSE(disabled.contains(key, 20, 100));
+}
+
+TEST_F(NearCacheTest, testNegativeFilterAging)
+{
+    NegativeFilter filter;
+    std::string a = NearCache::make_key(0, "a", 1);
+    std::string b = NearCache::make_key(0, "b", 1);
+    filter.add(a, 0, 0, 100, 16);
+
+    // a new generation starts after half the TTL, the old one is still consulted
+    filter.add(b, 60, 60, 100, 16);
+    ASSERT_TRUE(filter.contains(a, 90, 100));
+    ASSERT_TRUE(filter.contains(b, 90, 100));
+
+    // the first generation has expired
+    ASSERT_FALSE(filter.contains(a, 110, 100));
+    ASSERT_TRUE(filter.contains(b, 110, 100));
+    ASSERT_FALSE(filter.contains(b, 170, 100));
+}
+
+TEST_F(NearCacheTest, testNegativeFilterRemove)
+{
+    NegativeFilter filter;
+    std::string key = NearCache::make_key(0, "key", 3);
+    filter.add(key, 0, 10, 1000, 16);
+    filter.remove(key, 20, 100);
+    ASSERT_FALSE(filter.contains(key, 30, 1000));
+
+    // a request sent before the mutation may have found the document missing
+    filter.add(key, 15, 40, 1000, 16);
+    ASSERT_FALSE(filter.contains(key, 50, 1000));
+    filter.add(key, 25, 60, 1000, 16);
+    ASSERT_TRUE(filter.contains(key, 70, 1000));
+}
+
+TEST_F(NearCacheTest, testTouchWindow)
+{
+    TouchWindow touches;
+    std::string key = NearCache::make_key(0, "key", 3);
+    ASSERT_FALSE(touches.recent(key, 60, 0, 100));
+
+    touches.record(key, 60, 10, 100);
+    ASSERT_TRUE(touches.recent(key, 60, 50, 100));
+    // a different expiry still has to be sent to the server
+    ASSERT_FALSE(touches.recent(key, 120, 50, 100));
+    ASSERT_FALSE(touches.recent(key, 60, 110, 100));
+
+    touches.record(key, 60, 110, 100);
+    touches.forget(key);
+    ASSERT_FALSE(touches.recent(key, 60, 120, 100));
+}
+
+TEST_F(NearCacheTest, testTouchWindowCapacity)
+{
+    TouchWindow touches;
+    for (std::size_t ii = 0; ii < TouchWindow::capacity; ii++) {
+        std::string id = std::to_string(ii);
+        touches.record(NearCache::make_key(0, id.c_str(), id.size()), 0, 0, 100);
+    }
+    ASSERT_EQ(TouchWindow::capacity, touches.size());
+
+    // stale entries make room first
+    std::string key = NearCache::make_key(0, "key", 3);
+    touches.record(key, 0, 200, 100);
+    ASSERT_EQ(1, touches.size());
+    ASSERT_TRUE(touches.recent(key, 0, 210, 100));
+}
@@ -456,3 +456,152 @@ TEST_F(NetbufTest, testOutOfOrder)
 
     clean_check(&mgr);
 }
+
+TEST_F(NetbufTest, testAdaptiveSizing)
+{
+    nb_MGR mgr;
+    nb_SETTINGS settings;
+    nb_SPAN span;
+    int ii;
+
+    netbuf_default_settings(&settings);
+    settings.data_adaptive = 1;
+    netbuf_init(&mgr, &settings);
+    ASSERT_EQ(NB_DATA_BASEALLOC, mgr.datapool.basealloc);
+
+    /* Small spans only, the blocks shrink one step per interval */
+    for (ii = 0; ii < NB_ADAPT_INTERVAL; ii++) {
+        span.size = 100;
+        ASSERT_EQ(0, netbuf_mblock_reserve(&mgr, &span));
+        netbuf_mblock_release(&mgr, &span);
+    }
+    ASSERT_EQ(NB_DATA_BASEALLOC / 2, mgr.datapool.basealloc);
+    ASSERT_EQ(1, mgr.datapool.stats.shrunk);
+
+    /* Larger spans grow the blocks right away */
+    for (ii = 0; ii < NB_ADAPT_INTERVAL; ii++) {
+        span.size = 4000;
+        ASSERT_EQ(0, netbuf_mblock_reserve(&mgr, &span));
+        netbuf_mblock_release(&mgr, &span);
+    }
+    ASSERT_EQ(4096 * NB_ADAPT_SPANS_PER_BLOCK, mgr.datapool.basealloc);
+    ASSERT_EQ(1, mgr.datapool.stats.grown);
+    ASSERT_EQ(2 * NB_ADAPT_INTERVAL, mgr.datapool.stats.reserved);
+
+    clean_check(&mgr);
+}
+
+TEST_F(NetbufTest, testAdaptiveMaxAlloc)
+{
+    nb_MGR mgr;
+    nb_SETTINGS settings;
+    nb_SPAN span;
+    int ii;
+
+    netbuf_default_settings(&settings);
+    settings.data_adaptive = 1;
+    netbuf_init(&mgr, &settings);
+
+    /* Lowering the bound applies to the next block */
+    netbuf_set_maxalloc(&mgr, 8192);
+    ASSERT_EQ(8192, mgr.datapool.basealloc);
+
+    /* Spans which would grow the blocks further are bounded */
+    for (ii = 0; ii < NB_ADAPT_INTERVAL; ii++) {
+        span.size = 4000;
+        ASSERT_EQ(0, netbuf_mblock_reserve(&mgr, &span));
+        netbuf_mblock_release(&mgr, &span);
+    }
+    ASSERT_EQ(8192, mgr.datapool.basealloc);
+    ASSERT_EQ(0, mgr.datapool.stats.grown);
+
+    /* Raising it lets them grow again */
+    netbuf_set_maxalloc(&mgr, 0);
+    for (ii = 0; ii < NB_ADAPT_INTERVAL; ii++) {
+        span.size = 4000;
+        ASSERT_EQ(0, netbuf_mblock_reserve(&mgr, &span));
+        netbuf_mblock_release(&mgr, &span);
+    }
+    ASSERT_EQ(4096 * NB_ADAPT_SPANS_PER_BLOCK, mgr.datapool.basealloc);
+
+    clean_check(&mgr);
+}
+
+TEST_F(NetbufTest, testAdaptiveDedicated)
+{
+    nb_MGR mgr;
+    nb_SETTINGS settings;
+    nb_SPAN small, large;
+
+    netbuf_default_settings(&settings);
+    settings.data_adaptive = 1;
+    netbuf_init(&mgr, &settings);
+
+    small.size = 100;
+    ASSERT_EQ(0, netbuf_mblock_reserve(&mgr, &small));
+    large.size = 200 * 1024;
+    ASSERT_EQ(0, netbuf_mblock_reserve(&mgr, &large));
+    ASSERT_NE(small.parent, large.parent);
+    ASSERT_NE(0, large.parent->dedicated);
+    ASSERT_EQ(large.size, large.parent->nalloc);
+    ASSERT_EQ(1, mgr.datapool.stats.dedicated);
+    ASSERT_EQ(1, mgr.datapool.stats.nactive);
+    memset(SPAN_BUFFER(&large), 0xff, large.size);
+
+    /* The shared block keeps being used after the dedicated one */
+    nb_SPAN next;
+    next.size = 100;
+    ASSERT_EQ(0, netbuf_mblock_reserve(&mgr, &next));
+    ASSERT_EQ(small.parent, next.parent);
+
+    netbuf_mblock_release(&mgr, &large);
+    ASSERT_NE(0, SLLIST_IS_EMPTY(&mgr.datapool.dedicated));
+    netbuf_mblock_release(&mgr, &small);
+    netbuf_mblock_release(&mgr, &next);
+
+    clean_check(&mgr);
+}
+
+TEST_F(NetbufTest, testTrim)
+{
+    nb_MGR mgr;
+    nb_SPAN spans[4];
+    unsigned int ii;
+
+    netbuf_init(&mgr, NULL);
+    nb_SIZE blocksize = mgr.datapool.basealloc;
+
+    /* A burst which needs a block per span */
+    for (ii = 0; ii < 4; ii++) {
+        spans[ii].size = blocksize;
+        ASSERT_EQ(0, netbuf_mblock_reserve(&mgr, &spans[ii]));
+    }
+    for (ii = 0; ii < 4; ii++) {
+        netbuf_mblock_release(&mgr, &spans[ii]);
+    }
+    ASSERT_EQ(4, mgr.datapool.curblocks);
+    ASSERT_EQ(4 * blocksize, netbuf_get_idle_size(&mgr));
+
+    /* Spans were reserved since the previous trim */
+    ASSERT_EQ(0, netbuf_trim(&mgr, 1));
+    ASSERT_EQ(4, mgr.datapool.curblocks);
+
+    ASSERT_EQ(3 * blocksize, netbuf_trim(&mgr, 1));
+    ASSERT_EQ(1, mgr.datapool.curblocks);
+    ASSERT_EQ(blocksize, netbuf_get_idle_size(&mgr));
+    ASSERT_EQ(3, mgr.datapool.stats.trimmed);
+    ASSERT_EQ(3 * blocksize, mgr.datapool.stats.trimmedbytes);
+
+    /* The kept block is used again */
+    unsigned long newblocks = mgr.datapool.stats.newblocks;
+    spans[0].size = SMALL_BUF_SIZE;
+    ASSERT_EQ(0, netbuf_mblock_reserve(&mgr, &spans[0]));
+    ASSERT_EQ(newblocks, mgr.datapool.stats.newblocks);
+    netbuf_mblock_release(&mgr, &spans[0]);
+
+    ASSERT_EQ(0, netbuf_trim(&mgr, 0));
+    ASSERT_EQ(blocksize, netbuf_trim(&mgr, 0));
+    ASSERT_EQ(0, netbuf_get_idle_size(&mgr));
+
+    clean_check(&mgr);
+}
@@ -0,0 +1,184 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include <gtest/gtest.h>
+#include <libcouchbase/couchbase.h>
+#include "internal.h"
+#include "n1ql/query_cache.hh"
+#include "jsparse/parser.h"
+
+class QueryCacheTests : public ::testing::Test
+{
+};
+
+static Json::Value prepared(const std::string &name)
+{
+    Json::Value json(Json::objectValue);
+    json["name"] = name;
+    return json;
+}
+
+static std::string planstr(lcb_QUERY_CACHE *cache, const std::string &key)
+{
+    Plan plan;
+    std::string out;
+    if (cache->get_entry(key, plan)) {
+        Json::Value body(Json::objectValue);
+        plan.apply_plan(body, out);
+    }
+    return out;
+}
+
+TEST_F(QueryCacheTests, testEviction)
+{
+    lcb_QUERY_CACHE *cache = lcb_n1qlcache_create();
+    cache->set_max_size(3);
+    cache->add_entry("a", prepared("pa"), false);
+    cache->add_entry("b", prepared("pb"), false);
+    cache->add_entry("c", prepared("pc"), false);
+
+    // Touch "a", so that "b" is the least recently used
+    ASSERT_EQ("{\"prepared\":\"pa\"}", planstr(cache, "a"));
+    cache->add_entry("d", prepared("pd"), false);
+    ASSERT_EQ(3, cache->size());
+    ASSERT_TRUE(planstr(cache, "b").empty());
+    ASSERT_FALSE(planstr(cache, "a").empty());
+    ASSERT_FALSE(planstr(cache, "c").empty());
+
+    // Replacing an entry does not grow the cache
+    cache->add_entry("d", prepared("pd2"), false);
+    ASSERT_EQ(3, cache->size());
+    ASSERT_EQ("{\"prepared\":\"pd2\"}", planstr(cache, "d"));
+
+    // Shrinking evicts right away, "a" was used before "c"
+    cache->set_max_size(1);
+    ASSERT_EQ(1, cache->size());
+    ASSERT_FALSE(planstr(cache, "d").empty());
+
+    cache->remove_entry("d");
+    ASSERT_EQ(0, cache->size());
+    lcb_n1qlcache_destroy(cache);
+}
+
+TEST_F(QueryCacheTests, testSharedBetweenInstances)
+{
+    lcb_INSTANCE *first = nullptr, *second = nullptr;
+    ASSERT_EQ(LCB_SUCCESS, lcb_create(&first, nullptr));
+    ASSERT_EQ(LCB_SUCCESS, lcb_create(&second, nullptr));
+
+    lcb_SIZE size = 0;
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(first, LCB_CNTL_GET, LCB_CNTL_QUERY_CACHE_SIZE, &size));
+    ASSERT_EQ(5000, size);
+    size = 0;
+    ASSERT_NE(LCB_SUCCESS, lcb_cntl(first, LCB_CNTL_SET, LCB_CNTL_QUERY_CACHE_SIZE, &size));
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(first, "query_cache_size", "20000"));
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(first, LCB_CNTL_GET, LCB_CNTL_QUERY_CACHE_SIZE, &size));
+    ASSERT_EQ(20000, size);
+
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(second, LCB_CNTL_SET, LCB_CNTL_QUERY_CACHE_SHARE, first));
+    ASSERT_EQ(first->n1ql_cache, second->n1ql_cache);
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(second, LCB_CNTL_GET, LCB_CNTL_QUERY_CACHE_SIZE, &size));
+    ASSERT_EQ(20000, size);
+
+    first->n1ql_cache->add_entry("SELECT 1", prepared("p1"), false);
+    // The cache outlives the instance it was created by
+    lcb_destroy(first);
+    ASSERT_FALSE(planstr(second->n1ql_cache, "SELECT 1").empty());
+    lcb_destroy(second);
+}
+
+TEST_F(QueryCacheTests, testBodyTemplate)
+{
+    lcb_QUERY_CACHE *cache = lcb_n1qlcache_create();
+    cache->add_entry("SELECT $1", prepared("p1"), false);
+
+    Json::Value body(Json::objectValue);
+    body["statement"] = "SELECT $1";
+    body["query_context"] = "default:`travel`.inventory";
+    body["args"].append(42);
+    body["client_context_id"] = "ccid1";
+    body["timeout"] = "75000000us";
+
+    Plan plan;
+    ASSERT_TRUE(cache->get_entry("SELECT $1", plan));
+    std::string bodystr;
+    auto tmpl = plan.apply_plan(body, bodystr);
+    ASSERT_NE(nullptr, tmpl.get());
+    Json::Value parsed;
+    ASSERT_TRUE(lcb::jsparse::parse_json(bodystr, parsed));
+    ASSERT_EQ("p1", parsed["prepared"].asString());
+    ASSERT_FALSE(parsed.isMember("statement"));
+    ASSERT_EQ(body["query_context"], parsed["query_context"]);
+    ASSERT_EQ(body["args"], parsed["args"]);
+    ASSERT_EQ(body["client_context_id"], parsed["client_context_id"]);
+    cache->set_template("SELECT $1", tmpl);
+
+    // Only the parameters changed, so the template is reused
+    body["args"][0] = 43;
+    body["client_context_id"] = "ccid2";
+    ASSERT_TRUE(cache->get_entry("SELECT $1", plan));
+    ASSERT_EQ(nullptr, plan.apply_plan(body, bodystr).get());
+    ASSERT_TRUE(lcb::jsparse::parse_json(bodystr, parsed));
+    ASSERT_EQ(43, parsed["args"][0].asInt());
+    ASSERT_EQ("ccid2", parsed["client_context_id"].asString());
+
+    // A different option requires a new template
+    body["scan_consistency"] = "request_plus";
+    tmpl = plan.apply_plan(body, bodystr);
+    ASSERT_NE(nullptr, tmpl.get());
+    ASSERT_TRUE(lcb::jsparse::parse_json(bodystr, parsed));
+    ASSERT_EQ("request_plus", parsed["scan_consistency"].asString());
+    ASSERT_EQ(body["query_context"], parsed["query_context"]);
+
+    lcb_n1qlcache_destroy(cache);
+}
+
+TEST_F(QueryCacheTests, testStats)
+{
+    lcb_INSTANCE *instance = nullptr;
+    ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, nullptr));
+    lcb_QUERY_CACHE_STATS stats{};
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_QUERY_CACHE_STATS, &stats));
+    ASSERT_EQ(0, stats.size);
+    ASSERT_EQ(0, stats.hits);
+    ASSERT_NE(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_QUERY_CACHE_STATS, &stats));
+
+    lcb_QUERY_CACHE *cache = instance->n1ql_cache;
+    cache->set_max_size(1);
+    ASSERT_TRUE(planstr(cache, "a").empty());
+    cache->count_prepare();
+    cache->count_prepare_joined();
+    cache->add_entry("a", prepared("pa"), false);
+    ASSERT_FALSE(planstr(cache, "a").empty());
+    cache->add_entry("b", prepared("pb"), false);
+
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_QUERY_CACHE_STATS, &stats));
+    ASSERT_EQ(1, stats.size);
+    ASSERT_EQ(1, stats.hits);
+    ASSERT_EQ(1, stats.misses);
+    ASSERT_EQ(1, stats.prepares);
+    ASSERT_EQ(1, stats.joined);
+    ASSERT_EQ(1, stats.evictions);
+
+    // Clearing drops the statements, not the counters
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_QUERY_CLEARACHE, nullptr));
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_QUERY_CACHE_STATS, &stats));
+    ASSERT_EQ(0, stats.size);
+    ASSERT_EQ(1, stats.evictions);
+    lcb_destroy(instance);
+}
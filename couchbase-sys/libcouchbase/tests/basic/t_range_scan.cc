@@ -0,0 +1,85 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include <gtest/gtest.h>
+#include "internal.h"
+#include "capi/cmd_range_scan.hh"
+
+class RangeScanTest : public ::testing::Test
+{
+};
+
+TEST_F(RangeScanTest, testCommand)
+{
+    lcb_CMDRANGESCAN *cmd;
+    ASSERT_EQ(LCB_SUCCESS, lcb_cmdrangescan_create(&cmd));
+
+    // The whole collection by default
+    ASSERT_EQ(std::string("\x00", 1), cmd->start());
+    ASSERT_EQ(std::string("\xf4\x8f\xbf\xbf"), cmd->end());
+
+    ASSERT_EQ(LCB_ERR_INVALID_ARGUMENT, lcb_cmdrangescan_range(cmd, "", 0, "b", 1));
+    ASSERT_EQ(LCB_ERR_INVALID_ARGUMENT, lcb_cmdrangescan_range(cmd, "a", 1, nullptr, 0));
+    ASSERT_EQ(LCB_SUCCESS, lcb_cmdrangescan_range(cmd, "a", 1, "b", 1));
+    ASSERT_EQ("a", cmd->start());
+    ASSERT_EQ("b", cmd->end());
+
+    ASSERT_EQ(LCB_ERR_INVALID_ARGUMENT, lcb_cmdrangescan_concurrency(cmd, 0));
+    ASSERT_EQ(LCB_SUCCESS, lcb_cmdrangescan_concurrency(cmd, 4));
+    ASSERT_EQ(4U, cmd->concurrency());
+
+    lcb_cmdrangescan_destroy(cmd);
+}
+
+TEST_F(RangeScanTest, testNoConfiguration)
+{
+    lcb_INSTANCE *instance;
+    ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, nullptr));
+
+    lcb_CMDRANGESCAN *cmd;
+    lcb_cmdrangescan_create(&cmd);
+    ASSERT_EQ(LCB_ERR_NO_CONFIGURATION, lcb_range_scan(instance, nullptr, cmd));
+    lcb_cmdrangescan_destroy(cmd);
+    lcb_destroy(instance);
+}
+
+TEST_F(RangeScanTest, testResponseItems)
+{
+    lcb_RESPRANGESCAN resp{};
+    lcb_RANGESCAN_ITEM item{};
+    item.key = "key";
+    item.nkey = 3;
+    item.value = "{}";
+    item.nvalue = 2;
+    item.cas = 42;
+    resp.items.push_back(item);
+
+    ASSERT_EQ(1U, lcb_resprangescan_item_count(&resp));
+    ASSERT_FALSE(lcb_resprangescan_is_final(&resp));
+
+    const char *buf;
+    size_t nbuf;
+    uint64_t cas;
+    ASSERT_EQ(LCB_SUCCESS, lcb_resprangescan_item_key(&resp, 0, &buf, &nbuf));
+    ASSERT_EQ("key", std::string(buf, nbuf));
+    ASSERT_EQ(LCB_SUCCESS, lcb_resprangescan_item_value(&resp, 0, &buf, &nbuf));
+    ASSERT_EQ("{}", std::string(buf, nbuf));
+    ASSERT_EQ(LCB_SUCCESS, lcb_resprangescan_item_cas(&resp, 0, &cas));
+    ASSERT_EQ(42U, cas);
+    ASSERT_EQ(LCB_ERR_INVALID_ARGUMENT, lcb_resprangescan_item_key(&resp, 1, &buf, &nbuf));
+}
@@ -0,0 +1,93 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include <gtest/gtest.h>
+#include <libcouchbase/couchbase.h>
+#include <libcouchbase/pktfwd.h>
+#include "internal.h"
+#include "capi/cmd_store.hh"
+#include "capi/cmd_counter.hh"
+
+#include <vector>
+
+class RespBatchTest : public ::testing::Test
+{
+};
+
+static std::vector<std::pair<void *, std::uint64_t>> batched;
+
+extern "C" {
+static void batch_callback(lcb_INSTANCE *, const lcb_RESPBATCH *batch)
+{
+    for (size_t ii = 0; ii < lcb_respbatch_size(batch); ++ii) {
+        lcb_CALLBACK_TYPE type;
+        void *cookie;
+        std::uint64_t cas;
+        lcb_MUTATION_TOKEN token;
+        lcb_BACKBUF buf;
+        ASSERT_EQ(LCB_SUCCESS, lcb_respbatch_type(batch, ii, &type));
+        ASSERT_EQ(LCB_CALLBACK_STORE, type);
+        ASSERT_EQ(LCB_SUCCESS, lcb_respbatch_cookie(batch, ii, &cookie));
+        ASSERT_EQ(LCB_SUCCESS, lcb_respbatch_cas(batch, ii, &cas));
+        ASSERT_EQ(LCB_SUCCESS, lcb_respbatch_mutation_token(batch, ii, &token));
+        ASSERT_EQ(42U, token.seqno_);
+        /* stores have no value to keep */
+        ASSERT_EQ(LCB_ERR_UNSUPPORTED_OPERATION, lcb_respbatch_backbuf(batch, ii, &buf));
+        batched.emplace_back(cookie, cas);
+    }
+    void *cookie;
+    ASSERT_EQ(LCB_ERR_INVALID_ARGUMENT, lcb_respbatch_cookie(batch, lcb_respbatch_size(batch), &cookie));
+}
+}
+
+TEST_F(RespBatchTest, testCollect)
+{
+    lcb_INSTANCE *instance;
+    ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, nullptr));
+    batched.clear();
+
+    lcb_RESPSTORE ok{};
+    ok.cookie = &ok;
+    ok.ctx.cas = 0xcafe;
+    ok.mt.seqno_ = 42;
+    lcb_RESPSTORE failed{};
+    failed.ctx.rc = LCB_ERR_DOCUMENT_EXISTS;
+    lcb_RESPCOUNTER counter{};
+
+    /* without a batch callback nothing is collected */
+    ASSERT_EQ(0, lcb_respbatch_begin(instance));
+    ASSERT_EQ(0, lcb_respbatch_add(instance, LCB_CALLBACK_STORE, &ok));
+
+    ASSERT_EQ(nullptr, lcb_set_batch_callback(instance, batch_callback));
+    ASSERT_EQ(1, lcb_respbatch_begin(instance));
+    /* a nested read leaves the batch to the outer one */
+    ASSERT_EQ(0, lcb_respbatch_begin(instance));
+    ASSERT_EQ(1, lcb_respbatch_add(instance, LCB_CALLBACK_STORE, &ok));
+    ASSERT_EQ(0, lcb_respbatch_add(instance, LCB_CALLBACK_STORE, &failed));
+    ASSERT_EQ(0, lcb_respbatch_add(instance, LCB_CALLBACK_COUNTER, &counter));
+    ASSERT_EQ(1, lcb_respbatch_add(instance, LCB_CALLBACK_STORE, &ok));
+    ASSERT_TRUE(batched.empty());
+    lcb_respbatch_flush(instance);
+    ASSERT_EQ(2U, batched.size());
+    ASSERT_EQ(static_cast<void *>(&ok), batched[0].first);
+    ASSERT_EQ(0xcafeU, batched[1].second);
+
+    /* once passed on, the batch is closed */
+    ASSERT_EQ(0, lcb_respbatch_add(instance, LCB_CALLBACK_STORE, &ok));
+    lcb_destroy(instance);
+}
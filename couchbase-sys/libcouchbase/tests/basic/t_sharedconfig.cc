@@ -0,0 +1,124 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include <gtest/gtest.h>
+#include <libcouchbase/couchbase.h>
+#include "internal.h"
+#include "bucketconfig/shared_config.h"
+
+using namespace lcb::clconfig;
+
+class SharedConfigTests : public ::testing::Test
+{
+};
+
+static lcbvb_CONFIG *make_config(int64_t revid)
+{
+    lcbvb_CONFIG *vbc = lcbvb_create();
+    EXPECT_EQ(0, lcbvb_genconfig(vbc, 2, 1, 16));
+    vbc->revepoch = 1;
+    vbc->revid = revid;
+    return vbc;
+}
+
+TEST_F(SharedConfigTests, testPublish)
+{
+    SharedGroup *group = SharedGroup::create();
+    std::string buf;
+    ASSERT_EQ(0U, group->generation());
+    ASSERT_EQ(0U, group->fetch(buf));
+    ASSERT_TRUE(buf.empty());
+
+    lcbvb_CONFIG *v2 = make_config(2);
+    lcbvb_CONFIG *v1 = make_config(1);
+    ASSERT_EQ(1U, group->publish(v2));
+    ASSERT_EQ(0U, group->publish(v1));
+    ASSERT_EQ(0U, group->publish(v2));
+    ASSERT_EQ(1U, group->fetch(buf));
+
+    lcbvb_CONFIG *loaded = lcbvb_create();
+    ASSERT_EQ(0, lcbvb_load_binary(loaded, buf.data(), buf.size()));
+    ASSERT_EQ(2, loaded->revid);
+    ASSERT_EQ(16U, loaded->nvb);
+
+    lcbvb_CONFIG *v3 = make_config(3);
+    ASSERT_EQ(2U, group->publish(v3));
+
+    lcbvb_destroy(loaded);
+    lcbvb_destroy(v1);
+    lcbvb_destroy(v2);
+    lcbvb_destroy(v3);
+    group->unref();
+}
+
+TEST_F(SharedConfigTests, testClaimPoll)
+{
+    SharedGroup *group = SharedGroup::create();
+    ASSERT_TRUE(group->claim_poll(LCB_MS2US(500)));
+    ASSERT_FALSE(group->claim_poll(LCB_MS2US(500)));
+    ASSERT_TRUE(group->claim_poll(0));
+    group->unref();
+}
+
+TEST_F(SharedConfigTests, testSync)
+{
+    lcb_INSTANCE *a, *b;
+    ASSERT_EQ(LCB_SUCCESS, lcb_create(&a, nullptr));
+    ASSERT_EQ(LCB_SUCCESS, lcb_create(&b, nullptr));
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(a, "shared_config", "sync-test"));
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(b, LCB_CNTL_SET, LCB_CNTL_SHARED_CONFIG, (void *)"sync-test"));
+    ASSERT_EQ(a->shared_config->group(), b->shared_config->group());
+
+    const char *name = nullptr;
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(b, LCB_CNTL_GET, LCB_CNTL_SHARED_CONFIG, &name));
+    ASSERT_STREQ("sync-test", name);
+
+    // a configuration received by one member is loaded by the others
+    ConfigInfo *info = ConfigInfo::create(make_config(7), CLCONFIG_CCCP, "test");
+    a->confmon->do_set_next(info, false);
+    info->decref();
+    ASSERT_EQ(1U, a->shared_config->group()->generation());
+    ASSERT_EQ(nullptr, b->confmon->get_config());
+
+    b->shared_config->sync();
+    ASSERT_NE(nullptr, b->confmon->get_config());
+    ASSERT_EQ(7, b->confmon->get_config()->vbc->revid);
+    ASSERT_EQ(CLCONFIG_PHONY, b->confmon->get_config()->get_origin());
+
+    // configurations loaded from the group are not published again
+    a->shared_config->sync();
+    ASSERT_EQ(1U, a->shared_config->group()->generation());
+
+    // configurations of other buckets are not shared
+    lcbvb_CONFIG *other = make_config(8);
+    free(other->bname);
+    other->bname = strdup("other");
+    other->bname_len = strlen(other->bname);
+    info = ConfigInfo::create(other, CLCONFIG_CCCP, "test");
+    a->confmon->do_set_next(info, false);
+    info->decref();
+    ASSERT_EQ(1U, a->shared_config->group()->generation());
+
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(b, LCB_CNTL_SET, LCB_CNTL_SHARED_CONFIG, nullptr));
+    ASSERT_EQ(nullptr, b->shared_config);
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(b, LCB_CNTL_GET, LCB_CNTL_SHARED_CONFIG, &name));
+    ASSERT_EQ(nullptr, name);
+
+    lcb_destroy(a);
+    lcb_destroy(b);
+}
@@ -0,0 +1,102 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include <gtest/gtest.h>
+#include <libcouchbase/couchbase.h>
+#include "internal.h"
+#include "collections.h"
+#include "capi/cmd_subdoc.hh"
+
+class SubdocTemplateTests : public ::testing::Test
+{
+};
+
+TEST_F(SubdocTemplateTests, testLookupLayout)
+{
+    lcb_SUBDOCSPECS *specs;
+    lcb_subdocspecs_create(&specs, 2);
+    lcb_subdocspecs_get(specs, 0, 0, "a", 1);
+    lcb_subdocspecs_exists(specs, 1, LCB_SUBDOCSPECS_F_XATTRPATH, "bc", 2);
+
+    lcb_SUBDOCTEMPLATE *tpl;
+    ASSERT_EQ(LCB_SUCCESS, lcb_subdoctemplate_create(&tpl, specs));
+    lcb_subdocspecs_destroy(specs);
+
+    const char expected[] = {'\xc5', '\x00', '\x00', '\x01', 'a', '\xc6', '\x04', '\x00', '\x02', 'b', 'c'};
+    ASSERT_EQ(std::string(expected, sizeof(expected)), tpl->compiled->blob);
+    ASSERT_TRUE(tpl->compiled->segments.empty());
+
+    lcb_CMDSUBDOC *cmd;
+    lcb_cmdsubdoc_create(&cmd);
+    ASSERT_EQ(LCB_SUCCESS, lcb_cmdsubdoc_template(cmd, tpl));
+    // the command keeps the template alive
+    lcb_subdoctemplate_destroy(tpl);
+    ASSERT_EQ(2U, cmd->specs().specs().size());
+    ASSERT_TRUE(cmd->specs().is_lookup());
+    // lookups have no values to replace
+    ASSERT_EQ(LCB_ERR_INVALID_ARGUMENT, lcb_cmdsubdoc_template_value(cmd, 0, "1", 1));
+    lcb_cmdsubdoc_destroy(cmd);
+}
+
+TEST_F(SubdocTemplateTests, testMutationValues)
+{
+    lcb_SUBDOCSPECS *specs;
+    lcb_subdocspecs_create(&specs, 2);
+    lcb_subdocspecs_dict_upsert(specs, 0, 0, "a", 1, "1", 1);
+    lcb_subdocspecs_remove(specs, 1, 0, "b", 1);
+
+    lcb_SUBDOCTEMPLATE *tpl;
+    ASSERT_EQ(LCB_SUCCESS, lcb_subdoctemplate_create(&tpl, specs));
+    lcb_subdocspecs_destroy(specs);
+
+    const char expected[] = {'\xc8', '\x00', '\x00', '\x01', '\x00', '\x00', '\x00', '\x00', 'a',
+                             '\xc9', '\x00', '\x00', '\x01', '\x00', '\x00', '\x00', '\x00', 'b'};
+    ASSERT_EQ(std::string(expected, sizeof(expected)), tpl->compiled->blob);
+    ASSERT_EQ(2U, tpl->compiled->segments.size());
+    ASSERT_EQ(9U, tpl->compiled->segments[0].end);
+    ASSERT_EQ(4U, tpl->compiled->segments[0].value_length_offset);
+
+    lcb_CMDSUBDOC *cmd;
+    lcb_cmdsubdoc_create(&cmd);
+    ASSERT_EQ(LCB_SUCCESS, lcb_cmdsubdoc_template(cmd, tpl));
+    ASSERT_EQ("1", cmd->template_values()[0]);
+    ASSERT_EQ(LCB_SUCCESS, lcb_cmdsubdoc_template_value(cmd, 0, "42", 2));
+    ASSERT_EQ("42", cmd->template_values()[0]);
+    ASSERT_EQ(LCB_ERR_INVALID_ARGUMENT, lcb_cmdsubdoc_template_value(cmd, 2, "1", 1));
+    lcb_cmdsubdoc_destroy(cmd);
+    lcb_subdoctemplate_destroy(tpl);
+}
+
+TEST_F(SubdocTemplateTests, testValidation)
+{
+    lcb_SUBDOCSPECS *specs;
+    lcb_SUBDOCTEMPLATE *tpl = nullptr;
+
+    lcb_subdocspecs_create(&specs, 2);
+    lcb_subdocspecs_get(specs, 0, 0, "a", 1);
+    lcb_subdocspecs_dict_upsert(specs, 1, 0, "b", 1, "1", 1);
+    ASSERT_EQ(LCB_ERR_OPTIONS_CONFLICT, lcb_subdoctemplate_create(&tpl, specs));
+    lcb_subdocspecs_destroy(specs);
+
+    // the second spec is never set
+    lcb_subdocspecs_create(&specs, 2);
+    lcb_subdocspecs_get(specs, 0, 0, "a", 1);
+    ASSERT_EQ(LCB_ERR_UNKNOWN_SUBDOC_COMMAND, lcb_subdoctemplate_create(&tpl, specs));
+    lcb_subdocspecs_destroy(specs);
+    ASSERT_EQ(nullptr, tpl);
+}
@@ -0,0 +1,101 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2020 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include <gtest/gtest.h>
+#include <libcouchbase/couchbase.h>
+#include <libcouchbase/pktfwd.h>
+#include <thread>
+#include <vector>
+
+class SubmitqTests : public ::testing::Test
+{
+};
+
+struct SubmitqResult {
+    size_t failed{0};
+    size_t flushed{0};
+};
+
+extern "C" {
+static void submitq_pktfwd(lcb_INSTANCE *instance, const void *cookie, lcb_STATUS err, lcb_PKTFWDRESP *)
+{
+    auto *res = reinterpret_cast<SubmitqResult *>(const_cast<void *>(lcb_get_cookie(instance)));
+    ASSERT_NE(LCB_SUCCESS, err);
+    ASSERT_EQ(nullptr, cookie);
+    res->failed++;
+}
+static void submitq_pktflushed(lcb_INSTANCE *instance, const void *)
+{
+    auto *res = reinterpret_cast<SubmitqResult *>(const_cast<void *>(lcb_get_cookie(instance)));
+    res->flushed++;
+}
+}
+
+#ifndef _WIN32
+TEST_F(SubmitqTests, testPushFromOtherThreads)
+{
+    lcb_INSTANCE *instance = nullptr;
+    ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, nullptr));
+    SubmitqResult res;
+    lcb_set_cookie(instance, &res);
+    lcb_set_pktfwd_callback(instance, submitq_pktfwd);
+    lcb_set_pktflushed_callback(instance, submitq_pktflushed);
+
+    lcb_SUBMITQ *queue = nullptr;
+    lcb_STATUS rc = lcb_submitq_create(instance, &queue);
+    if (rc == LCB_ERR_UNSUPPORTED_OPERATION) {
+        lcb_destroy(instance);
+        return;
+    }
+    ASSERT_EQ(LCB_SUCCESS, rc);
+
+    const size_t nthreads = 4, npackets = 250;
+    std::vector<std::thread> producers;
+    for (size_t ii = 0; ii < nthreads; ii++) {
+        producers.emplace_back([queue]() {
+            char packet[24] = {};
+            for (size_t jj = 0; jj < npackets; jj++) {
+                lcb_CMDPKTFWD cmd = {0};
+                cmd.vb.vtype = LCB_KV_COPY;
+                cmd.vb.u_buf.contig.bytes = packet;
+                cmd.vb.u_buf.contig.nbytes = sizeof(packet);
+                // No cluster map, so the packets fail once they are forwarded
+                cmd.nomap = 1;
+                lcb_submitq_push(queue, nullptr, &cmd);
+            }
+        });
+    }
+
+    size_t drained = 0;
+    while (drained < nthreads * npackets) {
+        drained += lcb_submitq_drain(queue);
+        std::this_thread::yield();
+    }
+    for (auto &producer : producers) {
+        producer.join();
+    }
+
+    // Copied packets never report a flush
+    ASSERT_EQ(nthreads * npackets, res.failed);
+    ASSERT_EQ(0, res.flushed);
+    ASSERT_EQ(0, lcb_submitq_drain(queue));
+
+    lcb_submitq_destroy(queue);
+    lcb_destroy(instance);
+}
+#endif
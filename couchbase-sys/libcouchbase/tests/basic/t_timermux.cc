@@ -0,0 +1,119 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include <gtest/gtest.h>
+#include <libcouchbase/couchbase.h>
+#include <lcbio/lcbio.h>
+#include <lcbio/iotable.h>
+#include <lcbio/timer-ng.h>
+
+#include <string>
+#include <vector>
+
+class TimerMuxTest : public ::testing::Test
+{
+  protected:
+    void SetUp() override
+    {
+        ASSERT_EQ(LCB_SUCCESS, lcb_create_io_ops(&io, nullptr));
+        iot = lcbio_table_new(io);
+    }
+    void TearDown() override
+    {
+        lcbio_table_unref(iot);
+        lcb_destroy_io_ops(io);
+    }
+    lcb_io_opt_t io{nullptr};
+    lcbio_pTABLE iot{nullptr};
+};
+
+struct Fired {
+    std::string name;
+    std::vector<std::string> *log;
+    lcbio_TIMER *timer;
+    int resignal;
+};
+
+static void record(void *arg)
+{
+    auto *fired = static_cast<Fired *>(arg);
+    fired->log->push_back(fired->name);
+    if (fired->resignal > 0) {
+        fired->resignal--;
+        lcbio_async_signal(fired->timer);
+    }
+}
+
+static void stop(void *arg)
+{
+    IOT_STOP(static_cast<lcbio_pTABLE>(arg));
+}
+
+TEST_F(TimerMuxTest, testOrder)
+{
+    std::vector<std::string> log;
+    Fired late{"late", &log, nullptr, 0};
+    Fired early{"early", &log, nullptr, 0};
+    Fired first{"first", &log, nullptr, 0};
+    Fired second{"second", &log, nullptr, 0};
+    Fired cancelled{"cancelled", &log, nullptr, 0};
+    late.timer = lcbio_timer_new(iot, &late, record);
+    early.timer = lcbio_timer_new(iot, &early, record);
+    first.timer = lcbio_timer_new(iot, &first, record);
+    second.timer = lcbio_timer_new(iot, &second, record);
+    cancelled.timer = lcbio_timer_new(iot, &cancelled, record);
+    lcbio_TIMER *done = lcbio_timer_new(iot, iot, stop);
+
+    lcbio_timer_rearm(late.timer, 20000);
+    lcbio_timer_rearm(early.timer, 10000);
+    // same deadline: in the order they were armed
+    lcbio_async_signal(first.timer);
+    lcbio_async_signal(second.timer);
+    lcbio_timer_rearm(cancelled.timer, 5000);
+    lcbio_timer_disarm(cancelled.timer);
+    ASSERT_FALSE(lcbio_timer_armed(cancelled.timer));
+    // moved later after arming
+    lcbio_timer_rearm(done, 1000);
+    lcbio_timer_rearm(done, 40000);
+
+    IOT_START(iot);
+    ASSERT_EQ((std::vector<std::string>{"first", "second", "early", "late"}), log);
+    ASSERT_FALSE(lcbio_timer_armed(late.timer));
+
+    for (Fired *fired : {&late, &early, &first, &second, &cancelled}) {
+        lcbio_timer_destroy(fired->timer);
+    }
+    lcbio_timer_destroy(done);
+}
+
+TEST_F(TimerMuxTest, testSignalFromCallback)
+{
+    std::vector<std::string> log;
+    Fired again{"again", &log, nullptr, 3};
+    again.timer = lcbio_timer_new(iot, &again, record);
+    lcbio_TIMER *done = lcbio_timer_new(iot, iot, stop);
+
+    // a timer signalled from its own callback runs once per loop iteration
+    lcbio_async_signal(again.timer);
+    lcbio_timer_rearm(done, 10000);
+    IOT_START(iot);
+    ASSERT_EQ(4U, log.size());
+
+    lcbio_timer_destroy(again.timer);
+    lcbio_timer_destroy(done);
+}
@@ -0,0 +1,104 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2020 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "config.h"
+#include <gtest/gtest.h>
+#include <libcouchbase/couchbase.h>
+#include "timerwheel.h"
+#include <vector>
+
+struct tw_item {
+    lcb_TWNODE node;
+    hrtime_t deadline;
+};
+
+class TimerWheel : public ::testing::Test
+{
+};
+
+static const hrtime_t base = LCB_TW_TICK_NS * 1000 + 12345;
+
+TEST_F(TimerWheel, testExpireInOrder)
+{
+    lcb_TIMERWHEEL tw;
+    lcb_tw_init(&tw, base);
+    ASSERT_EQ(0, lcb_tw_next(&tw));
+
+    // Deadlines spanning every level, inserted in inverse order
+    std::vector<tw_item> items(200);
+    for (size_t ii = 0; ii < items.size(); ii++) {
+        items[ii].deadline = base + (hrtime_t)(items.size() - ii) * (items.size() - ii) * 997 * LCB_TW_TICK_NS;
+        memset(&items[ii].node, 0, sizeof(items[ii].node));
+        lcb_tw_add(&tw, &items[ii].node, items[ii].deadline);
+    }
+
+    hrtime_t now = base;
+    size_t nexpired = 0;
+    while (nexpired < items.size()) {
+        hrtime_t next = lcb_tw_next(&tw);
+        ASSERT_NE(0, next);
+        ASSERT_GE(next, now);
+        now = next;
+
+        lcb_list_t expired;
+        lcb_list_t *ll;
+        nexpired += lcb_tw_expire(&tw, now, &expired);
+        LCB_LIST_FOR(ll, &expired)
+        {
+            tw_item *item = LCB_LIST_ITEM(ll, tw_item, node.ll);
+            // never early, and late by one tick at most
+            ASSERT_LE(item->deadline, now);
+            ASSERT_GT(item->deadline + LCB_TW_TICK_NS, now);
+        }
+    }
+    ASSERT_EQ(0, lcb_tw_next(&tw));
+}
+
+TEST_F(TimerWheel, testRemove)
+{
+    lcb_TIMERWHEEL tw;
+    lcb_tw_init(&tw, base);
+
+    tw_item first = {}, second = {};
+    lcb_tw_add(&tw, &first.node, base + LCB_TW_TICK_NS * 10);
+    lcb_tw_add(&tw, &second.node, base + LCB_TW_TICK_NS * 5000);
+    ASSERT_TRUE(lcb_tw_linked(&first.node));
+    lcb_tw_remove(&first.node);
+    ASSERT_FALSE(lcb_tw_linked(&first.node));
+    // removing twice is fine
+    lcb_tw_remove(&first.node);
+
+    lcb_list_t expired;
+    ASSERT_EQ(0, lcb_tw_expire(&tw, base + LCB_TW_TICK_NS * 100, &expired));
+    ASSERT_EQ(1, lcb_tw_expire(&tw, base + LCB_TW_TICK_NS * 6000, &expired));
+    ASSERT_EQ(&second.node.ll, expired.next);
+    lcb_tw_remove(&second.node);
+    ASSERT_TRUE(LCB_LIST_IS_EMPTY(&expired));
+}
+
+TEST_F(TimerWheel, testPastDeadline)
+{
+    lcb_TIMERWHEEL tw;
+    lcb_tw_init(&tw, base);
+
+    lcb_list_t expired;
+    ASSERT_EQ(0, lcb_tw_expire(&tw, base + LCB_TW_TICK_NS * 100, &expired));
+
+    tw_item item = {};
+    lcb_tw_add(&tw, &item.node, base);
+    ASSERT_LE(lcb_tw_next(&tw), base + LCB_TW_TICK_NS * 101);
+    ASSERT_EQ(1, lcb_tw_expire(&tw, base + LCB_TW_TICK_NS * 101, &expired));
+}
@@ -0,0 +1,219 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include <gtest/gtest.h>
+#include <libcouchbase/couchbase.h>
+#include "internal.h"
+
+#include <map>
+
+class SpanTests : public ::testing::Test
+{
+};
+
+TEST_F(SpanTests, testOperationName)
+{
+    std::string name("get");
+    lcbtrace_SPAN *span = lcbtrace_span_start(nullptr, name.c_str(), 0, nullptr);
+    name = "xyz";
+    ASSERT_STREQ(LCBTRACE_OP_GET, lcbtrace_span_get_operation(span));
+    lcbtrace_span_finish(span, 0);
+
+    name = "my_operation";
+    span = lcbtrace_span_start(nullptr, name.c_str(), 0, nullptr);
+    name = "changed_afterwards";
+    ASSERT_STREQ("my_operation", lcbtrace_span_get_operation(span));
+    lcbtrace_span_finish(span, 0);
+}
+
+TEST_F(SpanTests, testStringTags)
+{
+    lcbtrace_SPAN *span = lcbtrace_span_start(nullptr, LCBTRACE_OP_UPSERT, 0, nullptr);
+    std::string shortValue("42");
+    std::string longValue(100, 'x');
+    lcbtrace_span_add_tag_str(span, "short", shortValue.c_str());
+    lcbtrace_span_add_tag_str(span, "long", longValue.c_str());
+    shortValue = "00";
+    longValue.assign(100, 'y');
+
+    char *value = nullptr;
+    size_t nvalue = 0;
+    ASSERT_EQ(LCB_SUCCESS, lcbtrace_span_get_tag_str(span, "short", &value, &nvalue));
+    ASSERT_EQ("42", std::string(value, nvalue));
+    ASSERT_EQ(LCB_SUCCESS, lcbtrace_span_get_tag_str(span, "long", &value, &nvalue));
+    ASSERT_EQ(std::string(100, 'x'), std::string(value, nvalue));
+    lcbtrace_span_finish(span, 0);
+}
+
+TEST_F(SpanTests, testFixedRingKeepsLatest)
+{
+    lcb::trace::FixedRing<int> ring(3);
+    for (int ii = 1; ii <= 5; ii++) {
+        *ring.next() = ii;
+    }
+    ASSERT_EQ(3U, ring.size());
+
+    std::vector<int> items;
+    ring.drain([&items](int item) { items.push_back(item); });
+    ASSERT_EQ((std::vector<int>{3, 4, 5}), items);
+    ASSERT_TRUE(ring.empty());
+
+    lcb::trace::FixedRing<int> disabled(0);
+    ASSERT_EQ(nullptr, disabled.next());
+    ASSERT_TRUE(disabled.empty());
+}
+
+namespace
+{
+struct OtlpCapture {
+    std::vector<std::string> payloads;
+    size_t nspans{0};
+};
+
+void otlp_capture(void *cookie, const void *payload, size_t npayload, size_t nspans)
+{
+    auto *capture = static_cast<OtlpCapture *>(cookie);
+    capture->payloads.emplace_back(static_cast<const char *>(payload), npayload);
+    capture->nspans += nspans;
+}
+
+/** @return the length-delimited fields of a protobuf message, failing on malformed input */
+std::multimap<unsigned, std::string> otlp_fields(const std::string &message)
+{
+    std::multimap<unsigned, std::string> fields;
+    size_t pos = 0;
+    auto varint = [&]() {
+        uint64_t value = 0;
+        for (int shift = 0; pos < message.size(); shift += 7) {
+            auto byte = static_cast<unsigned char>(message[pos++]);
+            value |= uint64_t(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0) {
+                return value;
+            }
+        }
+        ADD_FAILURE() << "truncated varint";
+        return value;
+    };
+    while (pos < message.size()) {
+        uint64_t key = varint();
+        switch (key & 7) {
+            case 0:
+                varint();
+                break;
+            case 1:
+                pos += 8;
+                break;
+            case 2: {
+                uint64_t len = varint();
+                EXPECT_LE(pos + len, message.size());
+                fields.emplace(unsigned(key >> 3), message.substr(pos, len));
+                pos += len;
+                break;
+            }
+            default:
+                ADD_FAILURE() << "unexpected wire type " << (key & 7);
+                return fields;
+        }
+    }
+    EXPECT_EQ(message.size(), pos);
+    return fields;
+}
+
+std::string otlp_field(const std::string &message, unsigned field)
+{
+    auto fields = otlp_fields(message);
+    auto it = fields.find(field);
+    return it == fields.end() ? std::string() : it->second;
+}
+} // namespace
+
+TEST_F(SpanTests, testOtlpExport)
+{
+    lcb_INSTANCE *instance;
+    ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, nullptr));
+    OtlpCapture capture;
+    lcbtrace_TRACER *tracer = lcbtrace_otlp_new(instance, otlp_capture, &capture);
+    ASSERT_NE(nullptr, tracer);
+    ASSERT_EQ(LCBTRACE_F_OTLP, tracer->flags);
+
+    lcbtrace_SPAN *parent = lcbtrace_span_start(tracer, LCBTRACE_OP_GET, 0, nullptr);
+    lcbtrace_REF ref{LCBTRACE_REF_CHILD_OF, parent};
+    lcbtrace_SPAN *child = lcbtrace_span_start(tracer, LCBTRACE_OP_DISPATCH_TO_SERVER, 0, &ref);
+    lcbtrace_span_add_tag_str(child, "db.couchbase.service", "kv");
+    lcbtrace_span_add_tag_uint64(child, "db.couchbase.server_duration", 42);
+    lcbtrace_span_finish(child, 0);
+    lcbtrace_span_finish(parent, 0);
+    lcbtrace_destroy(tracer);
+
+    ASSERT_EQ(2U, capture.nspans);
+    std::vector<std::string> spans;
+    for (const auto &payload : capture.payloads) {
+        std::string resource_spans = otlp_field(payload, 1);
+        ASSERT_NE(std::string::npos, otlp_field(resource_spans, 1).find("libcouchbase"));
+        std::string scope_spans = otlp_field(resource_spans, 2);
+        for (const auto &field : otlp_fields(scope_spans)) {
+            if (field.first == 2) {
+                spans.push_back(field.second);
+            }
+        }
+    }
+    ASSERT_EQ(2U, spans.size());
+
+    const std::string &dispatch = spans[0];
+    const std::string &get = spans[1];
+    ASSERT_EQ(LCBTRACE_OP_DISPATCH_TO_SERVER, otlp_field(dispatch, 5));
+    ASSERT_EQ(LCBTRACE_OP_GET, otlp_field(get, 5));
+    ASSERT_EQ(16U, otlp_field(get, 1).size());
+    ASSERT_EQ(otlp_field(get, 1), otlp_field(dispatch, 1));
+    ASSERT_EQ(otlp_field(get, 2), otlp_field(dispatch, 4));
+    ASSERT_TRUE(otlp_field(get, 4).empty());
+
+    std::map<std::string, std::string> attributes;
+    auto fields = otlp_fields(dispatch);
+    for (auto it = fields.find(9); it != fields.end() && it->first == 9; ++it) {
+        attributes[otlp_field(it->second, 1)] = otlp_field(it->second, 2);
+    }
+    ASSERT_EQ("kv", otlp_field(attributes["db.couchbase.service"], 1));
+    ASSERT_EQ(std::string("\x18\x2a", 2), attributes["db.couchbase.server_duration"]);
+
+    lcb_destroy(instance);
+}
+
+TEST_F(SpanTests, testOtlpDropsWhenFull)
+{
+    lcb_INSTANCE *instance;
+    ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, nullptr));
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "tracing_export_queue_size", "0"));
+    OtlpCapture capture;
+    lcbtrace_TRACER *tracer = lcbtrace_otlp_new(instance, otlp_capture, &capture);
+
+    for (int ii = 0; ii < 3; ii++) {
+        lcbtrace_span_finish(lcbtrace_span_start(tracer, LCBTRACE_OP_UPSERT, 0, nullptr), 0);
+    }
+    lcb_U64 exported = 0, dropped = 0;
+    ASSERT_EQ(LCB_SUCCESS, lcbtrace_otlp_stats(tracer, &exported, &dropped));
+    ASSERT_EQ(0U, exported);
+    ASSERT_EQ(3U, dropped);
+    lcbtrace_destroy(tracer);
+    ASSERT_TRUE(capture.payloads.empty());
+
+    lcbtrace_TRACER *threshold = lcbtrace_new(instance, LCBTRACE_F_THRESHOLD);
+    ASSERT_EQ(LCB_ERR_INVALID_ARGUMENT, lcbtrace_otlp_stats(threshold, &exported, &dropped));
+    lcbtrace_destroy(threshold);
+    lcb_destroy(instance);
+}
@@ -0,0 +1,92 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2020 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include <gtest/gtest.h>
+#include <libcouchbase/couchbase.h>
+#include <lcbio/lcbio.h>
+#include <lcbio/iotable.h>
+#include <thread>
+#include <chrono>
+
+class WakeupTests : public ::testing::Test
+{
+  protected:
+    void SetUp() override
+    {
+        ASSERT_EQ(LCB_SUCCESS, lcb_create_io_ops(&io, nullptr));
+    }
+    void TearDown() override
+    {
+        lcb_destroy_io_ops(io);
+    }
+    lcb_io_opt_t io{nullptr};
+};
+
+#ifndef _WIN32
+TEST_F(WakeupTests, testSignalFromOtherThread)
+{
+    lcb_WAKEUP *wakeup = nullptr;
+    ASSERT_EQ(LCB_SUCCESS, lcb_wakeup_create(io, &wakeup));
+
+    std::thread signaller([wakeup]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        lcb_wakeup_signal(wakeup);
+    });
+    // Blocks until the other thread signals
+    lcb_wakeup_run(wakeup);
+    signaller.join();
+
+    lcb_wakeup_destroy(wakeup);
+}
+
+TEST_F(WakeupTests, testSignalBeforeRun)
+{
+    lcb_WAKEUP *wakeup = nullptr;
+    ASSERT_EQ(LCB_SUCCESS, lcb_wakeup_create(io, &wakeup));
+
+    // Multiple signals collapse into a single wakeup, and must not be lost
+    // when they arrive before the loop runs.
+    ASSERT_EQ(LCB_SUCCESS, lcb_wakeup_signal(wakeup));
+    ASSERT_EQ(LCB_SUCCESS, lcb_wakeup_signal(wakeup));
+    lcb_wakeup_run(wakeup);
+
+    lcb_wakeup_destroy(wakeup);
+}
+
+TEST_F(WakeupTests, testStopFromLoop)
+{
+    lcb_WAKEUP *wakeup = nullptr;
+    ASSERT_EQ(LCB_SUCCESS, lcb_wakeup_create(io, &wakeup));
+
+    // Outside of the loop, the next run returns right away
+    lcb_wakeup_stop(wakeup);
+    lcb_wakeup_run(wakeup);
+
+    // From a callback, the loop returns once it has been handled
+    lcbio_pTABLE iot = lcbio_table_new(io);
+    void *timer = iot->timer.create(IOT_ARG(iot));
+    iot->timer.schedule(
+        IOT_ARG(iot), timer, 1000, wakeup,
+        [](lcb_socket_t, short, void *arg) { lcb_wakeup_stop(static_cast<lcb_WAKEUP *>(arg)); });
+    lcb_wakeup_run(wakeup);
+
+    iot->timer.destroy(IOT_ARG(iot), timer);
+    lcbio_table_unref(iot);
+    lcb_wakeup_destroy(wakeup);
+}
+#endif
@@ -0,0 +1,73 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "bench.h"
+#include "jsparse/parser.h"
+
+using namespace lcb::jsparse;
+
+struct RowCounter : Parser::Actions {
+    size_t nrows{0};
+    bool failed{false};
+
+    void JSPARSE_on_row(const Row &) override
+    {
+        nrows++;
+    }
+    void JSPARSE_on_complete(const std::string &) override {}
+    void JSPARSE_on_error(const std::string &) override
+    {
+        failed = true;
+    }
+};
+
+static std::string query_response(size_t nrows)
+{
+    std::string body = R"({"requestID":"5d9b5a16-0d4e-4a54-b3a4-1a5a7c1c7f3b","signature":{"*":"*"},"results":[)";
+    for (size_t ii = 0; ii < nrows; ii++) {
+        if (ii > 0) {
+            body += ',';
+        }
+        body += R"({"travel-sample":{"id":)" + std::to_string(ii) +
+                R"(,"type":"airline","name":"40-Mile Air","iata":"Q5","icao":"MLA","callsign":"MILE-AIR",)"
+                R"("country":"United States"}})";
+    }
+    body += R"(],"status":"success","metrics":{"elapsedTime":"1.2ms","executionTime":"1.1ms",)"
+            R"("resultCount":)" +
+            std::to_string(nrows) + "}}";
+    return body;
+}
+
+/* Parser::feed() of a query response with 1000 rows, received in chunks of the given size */
+static void BM_ParserFeed(benchmark::State &state)
+{
+    std::string body = query_response(1000);
+    auto nchunk = static_cast<size_t>(state.range(0));
+    for (auto _ : state) {
+        RowCounter actions;
+        Parser parser(Parser::MODE_N1QL, &actions);
+        for (size_t off = 0; off < body.size(); off += nchunk) {
+            parser.feed(body.data() + off, std::min(nchunk, body.size() - off));
+        }
+        if (actions.failed || actions.nrows != 1000) {
+            state.SkipWithError("unexpected parse result");
+            break;
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * body.size());
+}
+BENCHMARK(BM_ParserFeed)->Arg(1460)->Arg(16384);
@@ -0,0 +1,104 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "bench.h"
+#include <ioserver/kvserver.h>
+
+extern "C" {
+static void kvbench_callback(lcb_INSTANCE *, int, const lcb_RESPBASE *rb)
+{
+    const auto *resp = reinterpret_cast<const lcb_RESPGET *>(rb);
+    size_t *nfailed = nullptr;
+    lcb_respget_cookie(resp, reinterpret_cast<void **>(&nfailed));
+    if (lcb_respget_status(resp) != LCB_SUCCESS) {
+        (*nfailed)++;
+    }
+}
+}
+
+/*
+ * Batches of GET (range(0) = 0) or upsert (1) through the whole library against
+ * the in-process KV node, range(1) commands per lcb_wait(), with range(2)
+ * per cent of the commands failed with ETMPFAIL and retried.
+ */
+static void BM_KVServer(benchmark::State &state)
+{
+    LCBTest::KVServer::Options options;
+    options.tmpfail_ratio = static_cast<double>(state.range(2)) / 100;
+    LCBTest::KVServer server(options);
+
+    lcb_INSTANCE *instance = nullptr;
+    lcb_CREATEOPTS *crst = nullptr;
+    std::string connstr = server.connstr();
+    lcb_createopts_create(&crst, LCB_TYPE_BUCKET);
+    lcb_createopts_connstr(crst, connstr.c_str(), connstr.size());
+    lcb_create(&instance, crst);
+    lcb_createopts_destroy(crst);
+    lcb_connect(instance);
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+    if (lcb_get_bootstrap_status(instance) != LCB_SUCCESS) {
+        state.SkipWithError("cannot bootstrap from the KV server");
+        lcb_destroy(instance);
+        return;
+    }
+    lcb_install_callback(instance, LCB_CALLBACK_GET, kvbench_callback);
+    lcb_install_callback(instance, LCB_CALLBACK_STORE, kvbench_callback);
+
+    bool upsert = state.range(0) != 0;
+    auto nbatch = static_cast<size_t>(state.range(1));
+    std::vector<std::string> keys = bench_keys(nbatch, 16);
+    std::string value(128, 'v');
+    size_t nfailed = 0;
+
+    lcb_CMDSTORE *scmd = nullptr;
+    lcb_cmdstore_create(&scmd, LCB_STORE_UPSERT);
+    lcb_cmdstore_value(scmd, value.c_str(), value.size());
+    for (const auto &key : keys) {
+        lcb_cmdstore_key(scmd, key.c_str(), key.size());
+        lcb_store(instance, &nfailed, scmd);
+    }
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+    nfailed = 0;
+
+    lcb_CMDGET *gcmd = nullptr;
+    lcb_cmdget_create(&gcmd);
+    for (auto _ : state) {
+        for (const auto &key : keys) {
+            if (upsert) {
+                lcb_cmdstore_key(scmd, key.c_str(), key.size());
+                lcb_store(instance, &nfailed, scmd);
+            } else {
+                lcb_cmdget_key(gcmd, key.c_str(), key.size());
+                lcb_get(instance, &nfailed, gcmd);
+            }
+        }
+        lcb_wait(instance, LCB_WAIT_DEFAULT);
+    }
+    lcb_cmdget_destroy(gcmd);
+    lcb_cmdstore_destroy(scmd);
+    lcb_destroy(instance);
+
+    state.SetItemsProcessed(state.iterations() * nbatch);
+    state.counters["failed"] = static_cast<double>(nfailed);
+    state.SetLabel(bench_profile());
+}
+BENCHMARK(BM_KVServer)
+    ->Args({0, BENCH_BATCH, 0})
+    ->Args({1, BENCH_BATCH, 0})
+    ->Args({0, 1, 0})
+    ->Args({0, BENCH_BATCH, 1})
+    ->UseRealTime();
@@ -0,0 +1,161 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "bench.h"
+#include "packetutils.h"
+#include "internal.h"
+
+static void BM_MapKey(benchmark::State &state)
+{
+    BenchQueue cq;
+    std::vector<std::string> keys = bench_keys(1024, state.range(0));
+    size_t ii = 0;
+    for (auto _ : state) {
+        lcb_KEYBUF keybuf{};
+        keybuf.type = LCB_KV_COPY;
+        keybuf.contig.bytes = keys[ii].data();
+        keybuf.contig.nbytes = keys[ii].size();
+        int vbid, srvix;
+        mcreq_map_key(&cq, &keybuf, MCREQ_PKT_BASESIZE, &vbid, &srvix);
+        benchmark::DoNotOptimize(srvix);
+        ii = (ii + 1) % keys.size();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MapKey)->Arg(16)->Arg(250);
+
+/* mcreq_basic_packet() with the header and the enqueueing the library does for every KV command */
+static void BM_BasicPacket(benchmark::State &state)
+{
+    BenchQueue cq;
+    std::vector<std::string> keys = bench_keys(BENCH_BATCH, state.range(0));
+    for (auto _ : state) {
+        for (const auto &key : keys) {
+            mc_PIPELINE *pipeline = nullptr;
+            benchmark::DoNotOptimize(cq.get(key, &pipeline));
+        }
+        state.PauseTiming();
+        cq.drain();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * BENCH_BATCH);
+}
+BENCHMARK(BM_BasicPacket)->Arg(16)->Arg(250);
+
+/* netbuf_start_flush() and the end of the flush over a batch of packets, as written by a socket */
+static void BM_Flush(benchmark::State &state)
+{
+    BenchQueue cq(1);
+    mc_PIPELINE *pipeline = cq.pipelines[0];
+    std::vector<std::string> keys = bench_keys(BENCH_BATCH);
+    auto niov = static_cast<int>(state.range(0));
+    std::vector<nb_IOV> iov(niov);
+    for (auto _ : state) {
+        state.PauseTiming();
+        for (const auto &key : keys) {
+            mc_PIPELINE *unused = nullptr;
+            cq.get(key, &unused);
+        }
+        state.ResumeTiming();
+
+        unsigned nb;
+        while ((nb = mcreq_flush_iov_fill(pipeline, iov.data(), niov, nullptr)) > 0) {
+            mcreq_flush_done(pipeline, nb, nb);
+        }
+
+        state.PauseTiming();
+        BenchQueue::drain(pipeline);
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * BENCH_BATCH);
+}
+BENCHMARK(BM_Flush)->Arg(1)->Arg(16)->Arg(64);
+
+extern "C" {
+static void get_callback(lcb_INSTANCE *, int, const lcb_RESPGET *resp)
+{
+    size_t *ncalled = nullptr;
+    lcb_respget_cookie(resp, reinterpret_cast<void **>(&ncalled));
+    (*ncalled)++;
+}
+}
+
+/* Builds the response to a GET, with flags and a value of the given size */
+static std::string get_response(uint32_t opaque, size_t nvalue)
+{
+    protocol_binary_response_header hdr{};
+    hdr.response.magic = PROTOCOL_BINARY_RES;
+    hdr.response.opcode = PROTOCOL_BINARY_CMD_GET;
+    hdr.response.extlen = 4;
+    hdr.response.bodylen = htonl(static_cast<uint32_t>(4 + nvalue));
+    hdr.response.opaque = opaque;
+    std::string res(reinterpret_cast<const char *>(hdr.bytes), sizeof(hdr.bytes));
+    res.append(4, '\0');
+    res.append(nvalue, 'v');
+    return res;
+}
+
+/* Parsing of GET responses out of the read buffer, and mcreq_dispatch_response() up to the user callback */
+static void BM_DispatchResponse(benchmark::State &state)
+{
+    lcb_INSTANCE *instance = nullptr;
+    lcb_create(&instance, nullptr);
+    lcb_install_callback(instance, LCB_CALLBACK_GET, reinterpret_cast<lcb_RESPCALLBACK>(get_callback));
+    size_t ncalled = 0;
+    {
+        BenchQueue cq(1, instance);
+        mc_PIPELINE *pipeline = cq.pipelines[0];
+        /* the instance never bootstraps, but responses carry the bucket name from its configuration */
+        instance->cmdq.config = cq.config;
+        std::vector<std::string> keys = bench_keys(BENCH_BATCH);
+        auto nvalue = static_cast<size_t>(state.range(0));
+        rdb_IOROPE ior;
+        rdb_init(&ior, rdb_bigalloc_new());
+
+        for (auto _ : state) {
+            state.PauseTiming();
+            std::string input;
+            for (const auto &key : keys) {
+                mc_PIPELINE *unused = nullptr;
+                mc_PACKET *pkt = cq.get(key, &unused, &ncalled);
+                input += get_response(pkt->opaque, nvalue);
+            }
+            BenchQueue::flush(pipeline);
+            bench_feed(&ior, input.data(), input.size());
+            state.ResumeTiming();
+
+            for (size_t ii = 0; ii < keys.size(); ii++) {
+                lcb::MemcachedResponse res;
+                unsigned required;
+                res.load(&ior, &required);
+                mc_PACKET *request = mcreq_pipeline_remove(pipeline, res.opaque());
+                mcreq_dispatch_response(pipeline, request, &res, LCB_SUCCESS);
+                mcreq_packet_handled(pipeline, request);
+                res.release(&ior);
+            }
+        }
+        rdb_cleanup(&ior);
+        instance->cmdq.config = nullptr;
+    }
+    lcb_destroy(instance);
+    if (ncalled != state.iterations() * BENCH_BATCH) {
+        state.SkipWithError("not every response reached the callback");
+    }
+    state.SetItemsProcessed(state.iterations() * BENCH_BATCH);
+    state.SetLabel(bench_profile());
+}
+BENCHMARK(BM_DispatchResponse)->Arg(16)->Arg(4096);
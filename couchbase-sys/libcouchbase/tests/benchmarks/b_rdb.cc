@@ -0,0 +1,50 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "bench.h"
+
+/*
+ * rdb_refread_ex() of a packet body spread over chunks of the read buffer,
+ * pinning the segments as a zero-copy response would, and consuming it.
+ */
+static void BM_RefreadEx(benchmark::State &state)
+{
+    rdb_IOROPE ior;
+    rdb_init(&ior, rdb_chunkalloc_new(static_cast<unsigned>(state.range(0))));
+    auto npacket = static_cast<unsigned>(state.range(1));
+    std::string packet(npacket, 'x');
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        bench_feed(&ior, packet.data(), packet.size());
+        state.ResumeTiming();
+
+        nb_IOV iov[64];
+        rdb_ROPESEG *segs[64];
+        int nseg = rdb_refread_ex(&ior, iov, segs, 64, npacket);
+        for (int ii = 0; ii < nseg; ii++) {
+            rdb_seg_ref(segs[ii]);
+        }
+        rdb_consumed(&ior, npacket);
+        for (int ii = 0; ii < nseg; ii++) {
+            rdb_seg_unref(segs[ii]);
+        }
+    }
+    rdb_cleanup(&ior);
+    state.SetBytesProcessed(state.iterations() * npacket);
+}
+BENCHMARK(BM_RefreadEx)->Args({16384, 256})->Args({16384, 65536})->Args({4096, 65536});
@@ -0,0 +1,178 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCB_BENCH_H
+#define LCB_BENCH_H
+
+#include "config.h"
+#include <benchmark/benchmark.h>
+#include <string>
+#include <vector>
+
+#include "mc/mcreq.h"
+#include "mc/mcreq-flush-inl.h"
+#include "mcserver/mcserver.h"
+#include "sllist-inl.h"
+#include "internalstructs.h"
+#include "rdb/rope.h"
+
+/**
+ * Label of the benchmarks of the whole KV path, so that the results of a
+ * default build can be told from those of a build without its hooks, see the
+ * LCB_NO_TRACING and LCB_NO_METRICS options
+ */
+inline const char *bench_profile()
+{
+#if defined(LCB_NO_TRACING) && defined(LCB_NO_METRICS)
+    return "lean";
+#elif defined(LCB_NO_TRACING) || defined(LCB_NO_METRICS)
+    return "partly lean";
+#else
+    return "instrumented";
+#endif
+}
+
+/** Number of packets every batch benchmark encodes, flushes or dispatches between two pauses of the timer */
+#define BENCH_BATCH 256
+
+/**
+ * A command queue with fake pipelines, which are never connected: packets
+ * are "written" by completing the flush, and responses are injected with
+ * mcreq_dispatch_response(). This isolates the hot path of the library from
+ * the sockets and the event loop.
+ */
+struct BenchQueue : mc_CMDQUEUE {
+    explicit BenchQueue(unsigned npipelines = 4, lcb_INSTANCE *instance = nullptr)
+    {
+        std::vector<mc_PIPELINE *> pll;
+        config = lcbvb_create();
+        for (unsigned ii = 0; ii < npipelines; ii++) {
+            mc_PIPELINE *pipeline = new lcb::Server();
+            mcreq_pipeline_init(pipeline);
+            pll.push_back(pipeline);
+        }
+        lcbvb_genconfig(config, npipelines, npipelines > 1 ? 1 : 0, 1024);
+        mcreq_queue_init(this);
+        this->cqdata = instance;
+        mcreq_queue_add_pipelines(this, pll.data(), npipelines, 1, config);
+    }
+
+    ~BenchQueue()
+    {
+        for (unsigned ii = 0; ii < npipelines; ii++) {
+            drain(pipelines[ii]);
+            mcreq_pipeline_cleanup(pipelines[ii]);
+            delete static_cast<lcb::Server *>(pipelines[ii]);
+        }
+        mcreq_queue_cleanup(this);
+        lcbvb_destroy(config);
+    }
+
+    BenchQueue(const BenchQueue &) = delete;
+    BenchQueue &operator=(const BenchQueue &) = delete;
+
+    /**
+     * Encodes a GET request for the key, and schedules it on its pipeline
+     * @return the packet, or nullptr if it could not be allocated
+     */
+    mc_PACKET *get(const std::string &key, mc_PIPELINE **pipeline, void *cookie = nullptr)
+    {
+        protocol_binary_request_header hdr{};
+        lcb_KEYBUF keybuf{};
+        mc_PACKET *pkt = nullptr;
+        keybuf.type = LCB_KV_COPY;
+        keybuf.contig.bytes = key.data();
+        keybuf.contig.nbytes = key.size();
+        if (mcreq_basic_packet(this, &keybuf, 0, &hdr, 0, 0, &pkt, pipeline, 0) != LCB_SUCCESS) {
+            return nullptr;
+        }
+        hdr.request.magic = PROTOCOL_BINARY_REQ;
+        hdr.request.opcode = PROTOCOL_BINARY_CMD_GET;
+        hdr.request.datatype = PROTOCOL_BINARY_RAW_BYTES;
+        hdr.request.bodylen = htonl(static_cast<lcb_uint32_t>(key.size()));
+        hdr.request.opaque = pkt->opaque;
+        memcpy(SPAN_BUFFER(&pkt->kh_span), hdr.bytes, sizeof(hdr.bytes));
+        pkt->u_rdata.reqdata.cookie = cookie;
+        pkt->u_rdata.reqdata.start = gethrtime();
+        mcreq_enqueue_packet(*pipeline, pkt);
+        return pkt;
+    }
+
+    /** Completes the flush of everything scheduled on the pipeline, as if it was written to the socket */
+    static void flush(mc_PIPELINE *pipeline)
+    {
+        nb_IOV iov[64];
+        unsigned nb;
+        while ((nb = mcreq_flush_iov_fill(pipeline, iov, 64, nullptr)) > 0) {
+            mcreq_flush_done(pipeline, nb, nb);
+        }
+    }
+
+    /** Flushes and releases all packets of the pipeline */
+    static void drain(mc_PIPELINE *pipeline)
+    {
+        flush(pipeline);
+        sllist_iterator iter;
+        SLLIST_ITERFOR(&pipeline->requests, &iter)
+        {
+            mc_PACKET *pkt = SLLIST_ITEM(iter.cur, mc_PACKET, slnode);
+            sllist_iter_remove(&pipeline->requests, &iter);
+            mcreq_packet_handled(pipeline, pkt);
+        }
+    }
+
+    void drain()
+    {
+        for (unsigned ii = 0; ii < npipelines; ii++) {
+            drain(pipelines[ii]);
+        }
+    }
+
+    lcbvb_CONFIG *config;
+};
+
+/** Generates the keys used by the benchmarks */
+static inline std::vector<std::string> bench_keys(size_t n, size_t size = 16)
+{
+    std::vector<std::string> keys;
+    for (size_t ii = 0; ii < n; ii++) {
+        std::string key = "key_" + std::to_string(ii);
+        key.resize(std::max(size, key.size()), 'k');
+        keys.push_back(key);
+    }
+    return keys;
+}
+
+/** Copies data into the read buffers of the rope, as if it was received from a socket */
+static inline void bench_feed(rdb_IOROPE *ior, const char *data, size_t ndata)
+{
+    while (ndata > 0) {
+        nb_IOV iov[32];
+        unsigned niov = rdb_rdstart(ior, iov, 32);
+        unsigned nfed = 0;
+        for (unsigned ii = 0; ii < niov && ndata > 0; ii++) {
+            size_t ncopy = std::min(ndata, static_cast<size_t>(iov[ii].iov_len));
+            memcpy(iov[ii].iov_base, data, ncopy);
+            data += ncopy;
+            ndata -= ncopy;
+            nfed += static_cast<unsigned>(ncopy);
+        }
+        rdb_rdend(ior, nfed);
+    }
+}
+
+#endif
@@ -63,6 +63,12 @@ const char default_plugins_string[] = "select"
 #endif
 #ifdef HAVE_LIBUV
                                       ";libuv"
+#endif
+#ifdef LCB_EMBED_PLUGIN_EPOLL
+                                      ";epoll"
+#endif
+#ifdef LCB_EMBED_PLUGIN_URING
+                                      ";uring"
 #endif
     ;
 #define PATHSEP "/"
@@ -4,6 +4,9 @@
  * core `lcbio` functionality.
  */
 
+#ifndef LCB_TEST_IOSERVER_H
+#define LCB_TEST_IOSERVER_H
+
 #ifndef NOMINMAX
 #define NOMINMAX
 #endif
@@ -543,3 +546,5 @@ class TestServer
 };
 
 } // namespace LCBTest
+
+#endif
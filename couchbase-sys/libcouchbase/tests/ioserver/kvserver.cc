@@ -0,0 +1,589 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "kvserver.h"
+#include <cmath>
+#include <libcouchbase/couchbase.h>
+#include <libcouchbase/vbucket.h>
+#include "contrib/lcb-jsoncpp/lcb-jsoncpp.h"
+
+using namespace LCBTest;
+
+#define NUM_SHARDS 16
+
+static uint64_t swap64(uint64_t v)
+{
+    uint64_t rv = 0;
+    const auto *bytes = reinterpret_cast<const uint8_t *>(&v);
+    for (int ii = 0; ii < 8; ii++) {
+        rv = (rv << 8) | bytes[ii];
+    }
+    return rv; /* v was in network order */
+}
+
+static uint64_t hton64(uint64_t v)
+{
+    uint64_t rv;
+    auto *bytes = reinterpret_cast<uint8_t *>(&rv);
+    for (int ii = 7; ii >= 0; ii--) {
+        bytes[ii] = static_cast<uint8_t>(v & 0xff);
+        v >>= 8;
+    }
+    return rv;
+}
+
+class KVServer::Connection
+{
+  public:
+    Connection(KVServer *server, SockFD *sock) : parent(server), datasock(sock)
+    {
+        datasock->setNodelay(true);
+        thr = new Thread(runfunc, this);
+    }
+
+    ~Connection()
+    {
+        datasock->close();
+        delete thr;
+        delete datasock;
+    }
+
+    void close()
+    {
+        datasock->close();
+    }
+
+    KVServer *parent;
+    SockFD *datasock;
+    Thread *thr;
+
+  private:
+    static void runfunc(void *arg)
+    {
+        auto *conn = reinterpret_cast<Connection *>(arg);
+        conn->parent->serve(conn);
+    }
+};
+
+void KVServer::runfunc(void *arg)
+{
+    reinterpret_cast<KVServer *>(arg)->run();
+}
+
+KVServer::KVServer(const Options &opts) : options(opts), shards(NUM_SHARDS)
+{
+    lsn = SockFD::newListener();
+
+    lcbvb_SERVER server;
+    memset(&server, 0, sizeof server);
+    server.hostname = const_cast<char *>("127.0.0.1");
+    server.svc.data = getPort();
+    lcbvb_CONFIG *vbc = lcbvb_create();
+    lcbvb_genconfig_ex(vbc, options.bucket.c_str(), nullptr, &server, 1, 0, options.nvbuckets);
+    char *json = lcbvb_save_json(vbc);
+    config.assign(json);
+    free(json);
+    lcbvb_destroy(vbc);
+
+    thr = new Thread(runfunc, this);
+}
+
+KVServer::~KVServer()
+{
+    closed = true;
+    lsn->close();
+    delete thr;
+
+    mutex.lock();
+    for (auto *conn : conns) {
+        conn->close();
+    }
+    mutex.unlock();
+    for (auto *conn : conns) {
+        delete conn;
+    }
+    delete lsn;
+}
+
+std::string KVServer::connstr()
+{
+    return "couchbase://127.0.0.1:" + std::to_string(getPort()) + "=mcd/" + options.bucket + "?bootstrap_on=cccp";
+}
+
+KVServer::Stats KVServer::stats() const
+{
+    Stats res{};
+    res.connections = nconnections;
+    res.commands = ncommands;
+    res.bytes_in = nbytes_in;
+    res.bytes_out = nbytes_out;
+    res.nmv = nnmv;
+    res.tmpfail = ntmpfail;
+    res.auth_ok = nauth_ok;
+    res.auth_failed = nauth_failed;
+    return res;
+}
+
+void KVServer::clear()
+{
+    for (auto &shard : shards) {
+        shard.mutex.lock();
+        shard.docs.clear();
+        shard.mutex.unlock();
+    }
+}
+
+void KVServer::run()
+{
+    while (!closed) {
+        fd_set fds;
+        struct timeval tmout = {0, 100000};
+        FD_ZERO(&fds);
+        FD_SET(*lsn, &fds);
+        if (select(*lsn + 1, &fds, nullptr, nullptr, &tmout) != 1) {
+            continue;
+        }
+        int newsock = accept(*lsn, nullptr, nullptr);
+        if (newsock == -1) {
+            break;
+        }
+        mutex.lock();
+        if (closed) {
+            ::closesocket(newsock);
+        } else {
+            nconnections++;
+            conns.push_back(new Connection(this, new SockFD(newsock)));
+        }
+        mutex.unlock();
+    }
+}
+
+bool KVServer::inject(double ratio, uint64_t index) const
+{
+    if (ratio <= 0) {
+        return false;
+    }
+    return std::floor(index * ratio) != std::floor((index - 1) * ratio);
+}
+
+void KVServer::serve(Connection *conn)
+{
+    std::vector<char> in;
+    std::string out;
+    char buf[65536];
+    uint64_t nbatches = 0;
+
+    while (!closed) {
+        ssize_t nr = conn->datasock->recv(buf, sizeof(buf));
+        if (nr <= 0) {
+            break;
+        }
+        nbytes_in += nr;
+        in.insert(in.end(), buf, buf + nr);
+
+        size_t off = 0;
+        while (in.size() - off >= sizeof(protocol_binary_request_header)) {
+            uint32_t bodylen;
+            memcpy(&bodylen, &in[off + 8], sizeof(bodylen));
+            size_t npacket = sizeof(protocol_binary_request_header) + ntohl(bodylen);
+            if (in.size() - off < npacket) {
+                break;
+            }
+            handle(&in[off], out);
+            off += npacket;
+        }
+        in.erase(in.begin(), in.begin() + off);
+
+        if (out.empty()) {
+            continue;
+        }
+        nbatches++;
+        if (inject(options.slow_ratio, nbatches)) {
+            usleep(options.slow_us);
+        } else if (options.latency_us) {
+            usleep(options.latency_us);
+        }
+        size_t nsent = 0;
+        while (nsent < out.size()) {
+            size_t nw = conn->datasock->send(out.data() + nsent, out.size() - nsent);
+            if (nw == static_cast<size_t>(-1)) {
+                return;
+            }
+            nsent += nw;
+        }
+        nbytes_out += out.size();
+        out.clear();
+    }
+}
+
+static void respond(std::string &out, const protocol_binary_request_header &req, uint16_t status,
+                    const std::string &ext = std::string(), const std::string &value = std::string(), uint64_t cas = 0,
+                    uint8_t datatype = PROTOCOL_BINARY_RAW_BYTES)
+{
+    protocol_binary_response_header res;
+    memset(&res, 0, sizeof(res));
+    res.response.magic = PROTOCOL_BINARY_RES;
+    res.response.opcode = req.request.opcode;
+    res.response.extlen = static_cast<uint8_t>(ext.size());
+    res.response.datatype = datatype;
+    res.response.status = htons(status);
+    res.response.bodylen = htonl(static_cast<uint32_t>(ext.size() + value.size()));
+    res.response.opaque = req.request.opaque;
+    res.response.cas = hton64(cas);
+    out.append(reinterpret_cast<const char *>(res.bytes), sizeof(res.bytes));
+    out.append(ext);
+    out.append(value);
+}
+
+KVServer::Shard &KVServer::shardFor(const char *key, size_t nkey, uint16_t *vbid)
+{
+    size_t hash = std::hash<std::string>()(std::string(key, nkey));
+    if (vbid != nullptr) {
+        *vbid = static_cast<uint16_t>(hash % options.nvbuckets);
+    }
+    return shards[hash % shards.size()];
+}
+
+void KVServer::handle(const char *packet, std::string &out)
+{
+    protocol_binary_request_header req;
+    memcpy(&req, packet, sizeof(req));
+    ncommands++;
+
+    size_t nframing = 0;
+    size_t nkey = ntohs(req.request.keylen);
+    if (req.request.magic == PROTOCOL_BINARY_AREQ) {
+        nframing = reinterpret_cast<const uint8_t *>(packet)[2];
+        nkey = reinterpret_cast<const uint8_t *>(packet)[3];
+    }
+    const char *ext = packet + sizeof(req) + nframing;
+    const char *key = ext + req.request.extlen;
+    const char *value = key + nkey;
+    size_t nvalue = ntohl(req.request.bodylen) - nframing - req.request.extlen - nkey;
+    uint64_t cas = swap64(req.request.cas);
+
+    switch (req.request.opcode) {
+        case PROTOCOL_BINARY_CMD_HELLO: {
+            std::string features;
+            for (uint16_t feature : {PROTOCOL_BINARY_FEATURE_SELECT_BUCKET, PROTOCOL_BINARY_FEATURE_TCPNODELAY,
+                                     PROTOCOL_BINARY_FEATURE_UNORDERED_EXECUTION}) {
+                uint16_t nfeature = htons(feature);
+                features.append(reinterpret_cast<const char *>(&nfeature), sizeof(nfeature));
+            }
+            respond(out, req, PROTOCOL_BINARY_RESPONSE_SUCCESS, std::string(), features);
+            return;
+        }
+        case PROTOCOL_BINARY_CMD_SASL_LIST_MECHS:
+            /* without mechanisms, the client skips authentication */
+            respond(out, req, PROTOCOL_BINARY_RESPONSE_SUCCESS, std::string(), options.sasl_mechs);
+            return;
+        case PROTOCOL_BINARY_CMD_SASL_AUTH:
+            /* any credentials are accepted, as long as the mechanism is offered */
+            if (std::string(key, nkey) == "PLAIN" && options.sasl_mechs.find("PLAIN") != std::string::npos) {
+                nauth_ok++;
+                respond(out, req, PROTOCOL_BINARY_RESPONSE_SUCCESS);
+            } else {
+                nauth_failed++;
+                respond(out, req, PROTOCOL_BINARY_RESPONSE_AUTH_ERROR);
+            }
+            return;
+        case PROTOCOL_BINARY_CMD_SELECT_BUCKET:
+            respond(out, req,
+                    std::string(key, nkey) == options.bucket ? PROTOCOL_BINARY_RESPONSE_SUCCESS
+                                                             : PROTOCOL_BINARY_RESPONSE_EACCESS);
+            return;
+        case PROTOCOL_BINARY_CMD_GET_CLUSTER_CONFIG:
+            respond(out, req, PROTOCOL_BINARY_RESPONSE_SUCCESS, std::string(), config, 0,
+                    PROTOCOL_BINARY_DATATYPE_JSON);
+            return;
+        case PROTOCOL_BINARY_CMD_NOOP:
+            respond(out, req, PROTOCOL_BINARY_RESPONSE_SUCCESS);
+            return;
+        case PROTOCOL_BINARY_CMD_GET:
+        case PROTOCOL_BINARY_CMD_SET:
+        case PROTOCOL_BINARY_CMD_ADD:
+        case PROTOCOL_BINARY_CMD_REPLACE:
+        case PROTOCOL_BINARY_CMD_DELETE:
+        case PROTOCOL_BINARY_CMD_SUBDOC_MULTI_LOOKUP:
+        case PROTOCOL_BINARY_CMD_SUBDOC_MULTI_MUTATION:
+            break;
+        default:
+            respond(out, req, PROTOCOL_BINARY_RESPONSE_UNKNOWN_COMMAND);
+            return;
+    }
+
+    uint64_t index = ++ndata;
+    if (inject(options.nmv_ratio, index)) {
+        nnmv++;
+        respond(out, req, PROTOCOL_BINARY_RESPONSE_NOT_MY_VBUCKET, std::string(), config, 0,
+                PROTOCOL_BINARY_DATATYPE_JSON);
+        return;
+    }
+    if (inject(options.tmpfail_ratio, index)) {
+        ntmpfail++;
+        respond(out, req, PROTOCOL_BINARY_RESPONSE_ETMPFAIL);
+        return;
+    }
+
+    if (req.request.opcode == PROTOCOL_BINARY_CMD_SUBDOC_MULTI_LOOKUP ||
+        req.request.opcode == PROTOCOL_BINARY_CMD_SUBDOC_MULTI_MUTATION) {
+        handleSubdoc(req, key, nkey, ext, ntohl(req.request.bodylen) - nframing, out);
+        return;
+    }
+
+    Shard &shard = shardFor(key, nkey);
+    std::string skey(key, nkey);
+    shard.mutex.lock();
+    auto it = shard.docs.find(skey);
+    switch (req.request.opcode) {
+        case PROTOCOL_BINARY_CMD_GET:
+            if (it == shard.docs.end()) {
+                respond(out, req, PROTOCOL_BINARY_RESPONSE_KEY_ENOENT);
+            } else {
+                uint32_t flags = htonl(it->second.flags);
+                respond(out, req, PROTOCOL_BINARY_RESPONSE_SUCCESS,
+                        std::string(reinterpret_cast<const char *>(&flags), sizeof(flags)), it->second.value,
+                        it->second.cas, it->second.datatype);
+            }
+            break;
+
+        case PROTOCOL_BINARY_CMD_DELETE:
+            if (it == shard.docs.end()) {
+                respond(out, req, PROTOCOL_BINARY_RESPONSE_KEY_ENOENT);
+            } else if (cas != 0 && cas != it->second.cas) {
+                respond(out, req, PROTOCOL_BINARY_RESPONSE_KEY_EEXISTS);
+            } else {
+                shard.docs.erase(it);
+                respond(out, req, PROTOCOL_BINARY_RESPONSE_SUCCESS, std::string(), std::string(), next_cas++);
+            }
+            break;
+
+        default: {
+            bool exists = it != shard.docs.end();
+            if ((req.request.opcode == PROTOCOL_BINARY_CMD_ADD && exists) ||
+                (exists && cas != 0 && cas != it->second.cas)) {
+                respond(out, req, PROTOCOL_BINARY_RESPONSE_KEY_EEXISTS);
+                break;
+            }
+            if (!exists && (req.request.opcode == PROTOCOL_BINARY_CMD_REPLACE || cas != 0)) {
+                respond(out, req, PROTOCOL_BINARY_RESPONSE_KEY_ENOENT);
+                break;
+            }
+            Document &doc = shard.docs[skey];
+            doc.value.assign(value, nvalue);
+            doc.flags = 0;
+            if (req.request.extlen >= 4) {
+                memcpy(&doc.flags, ext, sizeof(doc.flags));
+                doc.flags = ntohl(doc.flags);
+            }
+            doc.datatype = req.request.datatype;
+            doc.cas = next_cas++;
+            respond(out, req, PROTOCOL_BINARY_RESPONSE_SUCCESS, std::string(), std::string(), doc.cas);
+            break;
+        }
+    }
+    shard.mutex.unlock();
+}
+
+static std::string to_json(const Json::Value &value)
+{
+    std::string res = Json::FastWriter().write(value);
+    if (!res.empty() && res.back() == '\n') {
+        res.pop_back();
+    }
+    return res;
+}
+
+/** Resolves a path like "a.b[2].c", creating the missing dictionaries if create is set */
+static Json::Value *resolve_path(Json::Value &root, const std::string &path, bool create, std::string *last = nullptr)
+{
+    Json::Value *cur = &root;
+    size_t pos = 0;
+    while (pos < path.size()) {
+        if (path[pos] == '[') {
+            size_t end = path.find(']', pos);
+            if (end == std::string::npos || !cur->isArray()) {
+                return nullptr;
+            }
+            auto idx = static_cast<Json::ArrayIndex>(std::stoul(path.substr(pos + 1, end - pos - 1)));
+            if (idx >= cur->size()) {
+                return nullptr;
+            }
+            cur = &(*cur)[idx];
+            pos = end + 1;
+            if (pos < path.size() && path[pos] == '.') {
+                pos++;
+            }
+            continue;
+        }
+        size_t end = path.find_first_of(".[", pos);
+        std::string name = path.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+        pos = end == std::string::npos ? path.size() : (path[end] == '.' ? end + 1 : end);
+        if (!cur->isObject()) {
+            return nullptr;
+        }
+        if (last != nullptr && pos >= path.size()) {
+            *last = name;
+            return cur; /* the parent of the last component */
+        }
+        if (!cur->isMember(name)) {
+            if (!create) {
+                return nullptr;
+            }
+            (*cur)[name] = Json::Value(Json::objectValue);
+        }
+        cur = &(*cur)[name];
+    }
+    return cur;
+}
+
+void KVServer::handleSubdoc(const protocol_binary_request_header &req, const char *key, size_t nkey,
+                            const char *body, size_t nbody, std::string &out)
+{
+    uint8_t docflags = 0;
+    if (req.request.extlen == 1 || req.request.extlen == 5) {
+        docflags = static_cast<uint8_t>(body[req.request.extlen - 1]);
+    }
+    const char *spec = body + req.request.extlen + nkey;
+    const char *end = body + nbody;
+    bool lookup = req.request.opcode == PROTOCOL_BINARY_CMD_SUBDOC_MULTI_LOOKUP;
+
+    Shard &shard = shardFor(key, nkey);
+    std::string skey(key, nkey);
+    shard.mutex.lock();
+    auto it = shard.docs.find(skey);
+    if (it == shard.docs.end() && (lookup || (docflags & 0x03) == 0)) {
+        shard.mutex.unlock();
+        respond(out, req, PROTOCOL_BINARY_RESPONSE_KEY_ENOENT);
+        return;
+    }
+
+    Json::Value root(Json::objectValue);
+    if (it != shard.docs.end() && !Json::Reader().parse(it->second.value, root, false)) {
+        shard.mutex.unlock();
+        respond(out, req, PROTOCOL_BINARY_RESPONSE_SUBDOC_DOC_NOTJSON);
+        return;
+    }
+
+    std::string results;
+    uint16_t status = PROTOCOL_BINARY_RESPONSE_SUCCESS;
+    uint8_t index = 0;
+    bool replace_doc = false;
+    std::string new_doc;
+    while (spec < end) {
+        uint8_t op = static_cast<uint8_t>(spec[0]);
+        uint16_t npath;
+        memcpy(&npath, spec + 2, sizeof(npath));
+        npath = ntohs(npath);
+        uint32_t nval = 0;
+        size_t nhdr = 4;
+        if (!lookup) {
+            memcpy(&nval, spec + 4, sizeof(nval));
+            nval = ntohl(nval);
+            nhdr = 8;
+        }
+        std::string path(spec + nhdr, npath);
+        std::string val(spec + nhdr + npath, nval);
+        spec += nhdr + npath + nval;
+
+        uint16_t rc = PROTOCOL_BINARY_RESPONSE_SUCCESS;
+        std::string result;
+        if (lookup) {
+            Json::Value *found = path.empty() ? &root : resolve_path(root, path, false);
+            if (op == PROTOCOL_BINARY_CMD_GET) {
+                result = it->second.value;
+            } else if (found == nullptr) {
+                rc = PROTOCOL_BINARY_RESPONSE_SUBDOC_PATH_ENOENT;
+            } else if (op == PROTOCOL_BINARY_CMD_SUBDOC_GET) {
+                result = to_json(*found);
+            } else if (op == PROTOCOL_BINARY_CMD_SUBDOC_GET_COUNT) {
+                result = std::to_string(found->size());
+            } else if (op != PROTOCOL_BINARY_CMD_SUBDOC_EXISTS) {
+                rc = PROTOCOL_BINARY_RESPONSE_SUBDOC_PATH_EINVAL;
+            }
+            uint16_t nrc = htons(rc);
+            uint32_t nresult = htonl(static_cast<uint32_t>(result.size()));
+            results.append(reinterpret_cast<const char *>(&nrc), sizeof(nrc));
+            results.append(reinterpret_cast<const char *>(&nresult), sizeof(nresult));
+            results.append(result);
+            if (rc != PROTOCOL_BINARY_RESPONSE_SUCCESS) {
+                status = PROTOCOL_BINARY_RESPONSE_SUBDOC_MULTI_PATH_FAILURE;
+            }
+        } else {
+            Json::Value parsed;
+            std::string name;
+            if (op == PROTOCOL_BINARY_CMD_SET) {
+                replace_doc = true;
+                new_doc = val;
+            } else if (op == PROTOCOL_BINARY_CMD_DELETE) {
+                replace_doc = true;
+                new_doc.clear();
+            } else if (op != PROTOCOL_BINARY_CMD_SUBDOC_DELETE && !Json::Reader().parse(val, parsed, false)) {
+                rc = PROTOCOL_BINARY_RESPONSE_SUBDOC_PATH_EINVAL;
+            } else {
+                bool create = (op == PROTOCOL_BINARY_CMD_SUBDOC_DICT_UPSERT || op == PROTOCOL_BINARY_CMD_SUBDOC_DICT_ADD) &&
+                              (spec[-(int)(nhdr + npath + nval) + 1] & 0x01) != 0;
+                Json::Value *parent = resolve_path(root, path, create, &name);
+                if (parent == nullptr) {
+                    rc = PROTOCOL_BINARY_RESPONSE_SUBDOC_PATH_ENOENT;
+                } else if (op == PROTOCOL_BINARY_CMD_SUBDOC_DICT_UPSERT) {
+                    (*parent)[name] = parsed;
+                } else if (op == PROTOCOL_BINARY_CMD_SUBDOC_DICT_ADD) {
+                    if (parent->isMember(name)) {
+                        rc = PROTOCOL_BINARY_RESPONSE_SUBDOC_PATH_EEXISTS;
+                    } else {
+                        (*parent)[name] = parsed;
+                    }
+                } else if (!parent->isMember(name)) {
+                    rc = PROTOCOL_BINARY_RESPONSE_SUBDOC_PATH_ENOENT;
+                } else if (op == PROTOCOL_BINARY_CMD_SUBDOC_REPLACE) {
+                    (*parent)[name] = parsed;
+                } else if (op == PROTOCOL_BINARY_CMD_SUBDOC_DELETE) {
+                    parent->removeMember(name);
+                } else {
+                    rc = PROTOCOL_BINARY_RESPONSE_SUBDOC_PATH_EINVAL;
+                }
+            }
+            if (rc != PROTOCOL_BINARY_RESPONSE_SUCCESS) {
+                /* mutations are atomic, report the first failing spec only */
+                uint16_t nrc = htons(rc);
+                results.assign(1, static_cast<char>(index));
+                results.append(reinterpret_cast<const char *>(&nrc), sizeof(nrc));
+                status = PROTOCOL_BINARY_RESPONSE_SUBDOC_MULTI_PATH_FAILURE;
+                break;
+            }
+        }
+        index++;
+    }
+
+    uint64_t cas = it == shard.docs.end() ? 0 : it->second.cas;
+    if (!lookup && status == PROTOCOL_BINARY_RESPONSE_SUCCESS) {
+        Document &doc = shard.docs[skey];
+        if (replace_doc) {
+            doc.value = new_doc;
+        } else {
+            doc.value = to_json(root);
+        }
+        doc.datatype = PROTOCOL_BINARY_DATATYPE_JSON;
+        if (it == shard.docs.end()) {
+            doc.flags = 0;
+        }
+        doc.cas = cas = next_cas++;
+    }
+    shard.mutex.unlock();
+    respond(out, req, status, std::string(), results, cas);
+}
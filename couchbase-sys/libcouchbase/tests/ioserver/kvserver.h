@@ -0,0 +1,144 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/**
+ * @file
+ * A fake key-value node, serving the memcached binary protocol from memory,
+ * so that the throughput of the client can be measured without a cluster.
+ */
+
+#ifndef LCB_TEST_KVSERVER_H
+#define LCB_TEST_KVSERVER_H
+
+#include "ioserver.h"
+#include <atomic>
+#include <memcached/protocol_binary.h>
+#include <unordered_map>
+
+namespace LCBTest
+{
+
+/**
+ * In-process key-value node. It accepts connections on 127.0.0.1, takes the
+ * client through HELLO, SASL (no mechanisms, or PLAIN), SELECT_BUCKET and CCCP
+ * bootstrap with a configuration in which it owns every vBucket, and then
+ * serves GET, SET/ADD/REPLACE, DELETE, NOOP and the multi-path subdocument
+ * commands from a hash table.
+ *
+ * Every connection is handled by its own thread, which answers all the
+ * requests it has read in one write, so the server keeps up with the client
+ * unless latency or errors are injected (see Options).
+ *
+ * Errors are injected deterministically: with a ratio of 0.01, exactly every
+ * 100th data command receives the error.
+ */
+class KVServer
+{
+  public:
+    struct Options {
+        std::string bucket{"default"};
+        unsigned nvbuckets{64};
+        /** Delay before every batch of responses is written, in microseconds */
+        unsigned latency_us{0};
+        /** Ratio of batches which are delayed by slow_us instead */
+        double slow_ratio{0};
+        unsigned slow_us{0};
+        /** Ratio of data commands failed with NOT_MY_VBUCKET (with the configuration as body) */
+        double nmv_ratio{0};
+        /** Ratio of data commands failed with ETMPFAIL */
+        double tmpfail_ratio{0};
+        /** Mechanisms listed by SASL_LIST_MECHS, only PLAIN is implemented */
+        std::string sasl_mechs{};
+    };
+
+    struct Stats {
+        uint64_t connections;
+        uint64_t commands;
+        uint64_t bytes_in;
+        uint64_t bytes_out;
+        uint64_t nmv;
+        uint64_t tmpfail;
+        uint64_t auth_ok;
+        uint64_t auth_failed;
+    };
+
+    KVServer() : KVServer(Options()) {}
+    explicit KVServer(const Options &options);
+    ~KVServer();
+
+    uint16_t getPort()
+    {
+        return lsn->getLocalPort();
+    }
+
+    /** @return a connection string for the bucket, bootstrapping over CCCP from this server only */
+    std::string connstr();
+
+    Stats stats() const;
+
+    /** Removes all documents */
+    void clear();
+
+  private:
+    class Connection;
+    struct Document {
+        std::string value;
+        uint32_t flags;
+        uint64_t cas;
+        uint8_t datatype;
+    };
+    struct Shard {
+        Mutex mutex;
+        std::unordered_map<std::string, Document> docs;
+    };
+
+    friend class Connection;
+    static void runfunc(void *arg);
+    void run();
+    void serve(Connection *conn);
+    void handle(const char *packet, std::string &out);
+    void handleSubdoc(const protocol_binary_request_header &req, const char *key, size_t nkey, const char *body,
+                      size_t nbody, std::string &out);
+    Shard &shardFor(const char *key, size_t nkey, uint16_t *vbid = nullptr);
+    bool inject(double ratio, uint64_t index) const;
+
+    Options options;
+    std::string config;
+    SockFD *lsn;
+    Thread *thr;
+    std::atomic<bool> closed{false};
+    Mutex mutex;
+    std::list<Connection *> conns;
+    std::vector<Shard> shards;
+    std::atomic<uint64_t> next_cas{1};
+    std::atomic<uint64_t> ndata{0};
+    std::atomic<uint64_t> nauth_ok{0};
+    std::atomic<uint64_t> nauth_failed{0};
+
+    std::atomic<uint64_t> nconnections{0};
+    std::atomic<uint64_t> ncommands{0};
+    std::atomic<uint64_t> nbytes_in{0};
+    std::atomic<uint64_t> nbytes_out{0};
+    std::atomic<uint64_t> nnmv{0};
+    std::atomic<uint64_t> ntmpfail{0};
+
+    KVServer(const KVServer &);
+};
+
+} // namespace LCBTest
+
+#endif
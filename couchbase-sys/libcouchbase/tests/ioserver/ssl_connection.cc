@@ -30,7 +30,6 @@ class SslSocket : public SockFD
 
   private:
     SSL *ssl;
-    SSL_CTX *ctx;
     SockFD *sfd;
     bool ok{};
 };
@@ -105,9 +104,14 @@ static void genCertificate(SSL_CTX *ctx) {
     EVP_PKEY_free(pkey);
 }
 
-SslSocket::SslSocket(SockFD *inner) : SockFD(inner->getFD())
+// All connections share one context, so that the session tickets it issues
+// can be used to resume later connections.
+static SSL_CTX *serverContext()
 {
-    sfd = inner;
+    static SSL_CTX *ctx = nullptr;
+    if (ctx != nullptr) {
+        return ctx;
+    }
     ctx = SSL_CTX_new(SSLv23_server_method());
     assert(ctx != nullptr);
 
@@ -117,8 +121,13 @@ SslSocket::SslSocket(SockFD *inner) : SockFD(inner->getFD())
     SSL_CTX_set_options(ctx, SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3);
     SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, nullptr);
     SSL_CTX_load_verify_locations(ctx, nullptr, nullptr);
+    return ctx;
+}
 
-    ssl = SSL_new(ctx);
+SslSocket::SslSocket(SockFD *inner) : SockFD(inner->getFD())
+{
+    sfd = inner;
+    ssl = SSL_new(serverContext());
     assert(ssl != nullptr);
     SSL_set_accept_state(ssl);
     SSL_set_fd(ssl, sfd->getFD());
@@ -143,7 +152,6 @@ void SslSocket::close()
 SslSocket::~SslSocket()
 {
     SSL_free(ssl);
-    SSL_CTX_free(ctx);
     delete sfd;
 }
 
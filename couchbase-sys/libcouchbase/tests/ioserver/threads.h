@@ -2,6 +2,9 @@
  * @file
  * Simple cross-platform thread abstraction
  */
+
+#ifndef LCB_TEST_THREADS_H
+#define LCB_TEST_THREADS_H
 #ifndef _WIN32
 #include <pthread.h>
 #endif
@@ -68,3 +71,5 @@ class Condvar
     pthread_cond_t cond;
 #endif
 };
+
+#endif
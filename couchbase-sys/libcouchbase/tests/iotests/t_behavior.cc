@@ -32,6 +32,8 @@
 #define EXPECTED_DEFAULT LCB_IO_OPS_LIBEVENT
 #if defined(HAVE_LIBEVENT) || defined(HAVE_LIBEVENT2)
 #define EXPECTED_EFFECTIVE EXPECTED_DEFAULT
+#elif defined(LCB_EMBED_PLUGIN_EPOLL)
+#define EXPECTED_EFFECTIVE LCB_IO_OPS_EPOLL
 #else
 #define EXPECTED_EFFECTIVE LCB_IO_OPS_SELECT
 #endif
@@ -59,6 +61,9 @@ class PluginMap
         kv["select"] = LCB_IO_OPS_SELECT;
         kv["libevent"] = LCB_IO_OPS_LIBEVENT;
         kv["libev"] = LCB_IO_OPS_LIBEV;
+#ifdef LCB_EMBED_PLUGIN_EPOLL
+        kv["epoll"] = LCB_IO_OPS_EPOLL;
+#endif
 #ifdef _WIN32
         kv["iocp"] = LCB_IO_OPS_WINIOCP;
         kv["winsock"] = LCB_IO_OPS_WINSOCK;
@@ -225,3 +225,44 @@ TEST_F(ConfmonTest, testBootstrapMethods)
     ASSERT_TRUE(instance->confmon->is_refreshing());
     instance->confmon->stop();
 }
+
+TEST_F(ConfmonTest, testParallelBootstrap)
+{
+    HandleWrap hw;
+    lcb_INSTANCE *instance;
+    MockEnvironment *mock = MockEnvironment::getInstance();
+
+    if (mock->isRealCluster()) {
+        return;
+    }
+
+    mock->createConnection(hw, &instance);
+    instance->settings->config_node_timeout = LCB_MS2US(5000);
+    instance->settings->bootstrap_parallelism = 2;
+
+    Confmon *mon = new Confmon(instance->settings, instance->iotable, instance);
+
+    struct listener2 lsn;
+    lsn.io = instance->iotable;
+    lsn.reset();
+    mon->add_listener(&lsn);
+
+    // The first node never answers, and would hold the bootstrap for the whole node timeout
+    lcb::Hostlist hl;
+    hl.add("192.0.2.1", 11210);
+    hl.add("localhost", mock->getMcPorts()[0]);
+    Provider *cccp = mon->get_provider(CLCONFIG_CCCP);
+    cccp->enable(instance);
+    cccp->configure_nodes(hl);
+
+    hrtime_t begin = gethrtime();
+    mon->prepare();
+    mon->start();
+    lsn.expected_events.insert(CLCONFIG_EVENT_GOT_NEW_CONFIG);
+    runConfmonTest(lsn.io, mon);
+
+    ASSERT_EQ(1, lsn.call_count);
+    ASSERT_EQ(CLCONFIG_CCCP, lsn.last_source);
+    ASSERT_LT(gethrtime() - begin, LCB_US2NS(instance->settings->config_node_timeout));
+    delete mon;
+}
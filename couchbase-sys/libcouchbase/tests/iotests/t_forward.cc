@@ -133,3 +133,43 @@ TEST_F(ForwardTests, testIncomplete)
     lcb_set_pktflushed_callback(instance, pktflush_callback);
     lcb_set_pktfwd_callback(instance, pktfwd_callback);
 }
+
+TEST_F(ForwardTests, testFragmentedHeaderWithoutValue)
+{
+    lcb_INSTANCE *instance;
+    HandleWrap hw;
+    createConnection(hw, &instance);
+    lcb_set_pktflushed_callback(instance, pktflush_callback);
+    lcb_set_pktfwd_callback(instance, pktfwd_callback);
+
+    ForwardCookie fc;
+    std::string key("Hello");
+    GetRequest req(key);
+    req.magic(PROTOCOL_BINARY_REQ);
+    req.op(PROTOCOL_BINARY_CMD_GET);
+    req.serialize(fc.orig);
+
+    // The key is split between two buffers, so the whole packet is copied
+    lcb_IOV iov[2];
+    iov[0].iov_base = &fc.orig[0];
+    iov[0].iov_len = 26;
+    iov[1].iov_base = &fc.orig[26];
+    iov[1].iov_len = fc.orig.size() - 26;
+
+    lcb_CMDPKTFWD cmd = {0};
+    cmd.vb.vtype = LCB_KV_IOV;
+    cmd.vb.u_buf.multi.iov = iov;
+    cmd.vb.u_buf.multi.niov = 2;
+    cmd.vb.u_buf.multi.total_length = fc.orig.size();
+
+    lcb_sched_enter(instance);
+    ASSERT_EQ(LCB_SUCCESS, lcb_pktfwd3(instance, &fc, &cmd));
+    // ...and the buffers are released right away
+    ASSERT_TRUE(fc.flushed);
+    lcb_sched_leave(instance);
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+    ASSERT_TRUE(fc.called);
+    for (unsigned ii = 0; ii < fc.bkbuf.size(); ++ii) {
+        lcb_backbuf_unref(fc.bkbuf[ii]);
+    }
+}
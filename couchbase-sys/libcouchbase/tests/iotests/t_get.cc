@@ -17,6 +17,7 @@
 #include "config.h"
 #include <libcouchbase/couchbase.h>
 #include <libcouchbase/utils.h>
+#include <libcouchbase/pktfwd.h>
 #include <map>
 #include "iotests.h"
 #include "logging.h"
@@ -85,6 +86,66 @@ TEST_F(GetUnitTest, testGetMiss)
     EXPECT_EQ(2, numcallbacks);
 }
 
+extern "C" {
+static void testGetMissContextCallback(lcb_INSTANCE *, lcb_CALLBACK_TYPE, const lcb_RESPGET *resp)
+{
+    int *counter;
+    lcb_respget_cookie(resp, (void **)&counter);
+    EXPECT_EQ(LCB_ERR_DOCUMENT_NOT_FOUND, lcb_respget_status(resp));
+    const lcb_KEY_VALUE_ERROR_CONTEXT *ctx = nullptr;
+    EXPECT_EQ(LCB_SUCCESS, lcb_respget_error_context(resp, &ctx));
+
+    const char *endpoint = nullptr;
+    size_t endpoint_len = 0;
+    EXPECT_EQ(LCB_SUCCESS, lcb_errctx_kv_endpoint(ctx, &endpoint, &endpoint_len));
+    EXPECT_NE(0, endpoint_len);
+
+    const char *bucket = nullptr;
+    size_t bucket_len = 0;
+    EXPECT_EQ(LCB_SUCCESS, lcb_errctx_kv_bucket(ctx, &bucket, &bucket_len));
+    EXPECT_NE(0, bucket_len);
+
+    /* reading again returns the same, already formatted, value */
+    const char *endpoint_again = nullptr;
+    size_t endpoint_again_len = 0;
+    EXPECT_EQ(LCB_SUCCESS, lcb_errctx_kv_endpoint(ctx, &endpoint_again, &endpoint_again_len));
+    EXPECT_EQ(std::string(endpoint, endpoint_len), std::string(endpoint_again, endpoint_again_len));
+    ++(*counter);
+}
+}
+
+/**
+ * @test
+ * Get Miss, error context
+ *
+ * @pre
+ * Request a non-existent key
+ *
+ * @post
+ * The bucket and the endpoint of the error context, which are only formatted
+ * when read, are available from within the callback
+ */
+TEST_F(GetUnitTest, testGetMissErrorContext)
+{
+    HandleWrap hw;
+    lcb_INSTANCE *instance;
+    createConnection(hw, &instance);
+
+    (void)lcb_install_callback(instance, LCB_CALLBACK_GET, (lcb_RESPCALLBACK)testGetMissContextCallback);
+    int numcallbacks = 0;
+    std::string key("testGetMissErrorContext");
+    removeKey(instance, key);
+
+    lcb_CMDGET *cmd;
+    lcb_cmdget_create(&cmd);
+    lcb_cmdget_key(cmd, key.c_str(), key.size());
+    EXPECT_EQ(LCB_SUCCESS, lcb_get(instance, &numcallbacks, cmd));
+    lcb_cmdget_destroy(cmd);
+
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+    EXPECT_EQ(1, numcallbacks);
+}
+
 extern "C" {
 static void testGetHitGetCallback(lcb_INSTANCE *, lcb_CALLBACK_TYPE, const lcb_RESPGET *resp)
 {
@@ -423,6 +484,39 @@ TEST_F(GetUnitTest, testGetReplica)
     ASSERT_EQ(1, rck.hits_active);
     ASSERT_EQ(nreplicas, rck.hits_replicas);
 
+    // Test with the "Freshest" mode, a single response once enough copies were read
+    for (uint64_t min_cas : {uint64_t(0), mcCmd.cas}) {
+        rck.remaining = 1;
+        rck.hits_active = rck.hits_replicas = 0;
+        lcb_cmdgetreplica_create(&rcmd, LCB_REPLICA_MODE_FRESHEST);
+        lcb_cmdgetreplica_key(rcmd, key.c_str(), key.size());
+        lcb_cmdgetreplica_min_cas(rcmd, min_cas);
+        lcb_sched_enter(instance);
+        err = lcb_getreplica(instance, &rck, rcmd);
+        lcb_cmdgetreplica_destroy(rcmd);
+        ASSERT_EQ(LCB_SUCCESS, err);
+        lcb_sched_leave(instance);
+        lcb_wait(instance, LCB_WAIT_DEFAULT);
+        ASSERT_EQ(0, rck.remaining);
+        ASSERT_EQ(1, rck.hits_active + rck.hits_replicas);
+    }
+
+    // Test with the "Fastest" mode, a single copy read from one node
+    for (int ii = 0; ii < 4; ii++) {
+        rck.remaining = 1;
+        rck.hits_active = rck.hits_replicas = 0;
+        lcb_cmdgetreplica_create(&rcmd, LCB_REPLICA_MODE_FASTEST);
+        lcb_cmdgetreplica_key(rcmd, key.c_str(), key.size());
+        lcb_sched_enter(instance);
+        err = lcb_getreplica(instance, &rck, rcmd);
+        lcb_cmdgetreplica_destroy(rcmd);
+        ASSERT_EQ(LCB_SUCCESS, err);
+        lcb_sched_leave(instance);
+        lcb_wait(instance, LCB_WAIT_DEFAULT);
+        ASSERT_EQ(0, rck.remaining);
+        ASSERT_EQ(1, rck.hits_active + rck.hits_replicas);
+    }
+
     MockMutationCommand purgeCmd(MockCommand::PURGE, key);
     purgeCmd.onMaster = true;
     purgeCmd.replicaCount = nreplicas;
@@ -689,6 +783,271 @@ TEST_F(GetUnitTest, testFailoverAndGetReplica)
 }
 
 // FIXME: revisit the test, re-enable it after migration to caves
+struct HedgedGetCookie {
+    unsigned calls{};
+    lcb_STATUS rc{LCB_ERR_GENERIC};
+    std::string value;
+};
+
+extern "C" {
+static void hedged_get_callback(lcb_INSTANCE *, lcb_CALLBACK_TYPE, const lcb_RESPGET *resp)
+{
+    HedgedGetCookie *hck;
+    lcb_respget_cookie(resp, (void **)&hck);
+    hck->calls++;
+    hck->rc = lcb_respget_status(resp);
+    if (hck->rc == LCB_SUCCESS) {
+        const char *value;
+        size_t nvalue;
+        lcb_respget_value(resp, &value, &nvalue);
+        hck->value.assign(value, nvalue);
+    }
+}
+}
+
+/**
+ * @test Hedged get
+ * @pre Schedule hedged gets for an existing and a missing key, with a delay
+ * small enough for the replicas to be read as well
+ * @post Each get is answered exactly once, with the value or
+ * @c LCB_ERR_DOCUMENT_NOT_FOUND
+ */
+TEST_F(GetUnitTest, testHedgedGet)
+{
+    SKIP_UNLESS_MOCK()
+    HandleWrap hw;
+    lcb_INSTANCE *instance;
+    createConnection(hw, &instance);
+    if (lcb_get_num_replicas(instance) < 1) {
+        MockEnvironment::printSkipMessage(__FILE__, __LINE__, "needs replicas");
+        return;
+    }
+    std::string key("testHedgedGetKey"), missing("testHedgedGetMissing");
+    storeKey(instance, key, "hedged");
+    removeKey(instance, missing);
+
+    lcb_install_callback(instance, LCB_CALLBACK_GET, (lcb_RESPCALLBACK)hedged_get_callback);
+    HedgedGetCookie hit, miss;
+    lcb_CMDGET *cmd;
+    lcb_cmdget_create(&cmd);
+    ASSERT_EQ(LCB_SUCCESS, lcb_cmdget_hedge(cmd, 1));
+    lcb_cmdget_key(cmd, key.c_str(), key.size());
+    ASSERT_EQ(LCB_SUCCESS, lcb_get(instance, &hit, cmd));
+    lcb_cmdget_key(cmd, missing.c_str(), missing.size());
+    ASSERT_EQ(LCB_SUCCESS, lcb_get(instance, &miss, cmd));
+    lcb_cmdget_destroy(cmd);
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+
+    ASSERT_EQ(1, hit.calls);
+    ASSERT_EQ(LCB_SUCCESS, hit.rc);
+    ASSERT_EQ("hedged", hit.value);
+    ASSERT_EQ(1, miss.calls);
+    ASSERT_EQ(LCB_ERR_DOCUMENT_NOT_FOUND, miss.rc);
+
+    lcb_cmdget_create(&cmd);
+    ASSERT_EQ(LCB_SUCCESS, lcb_cmdget_hedge(cmd, 0));
+    ASSERT_EQ(LCB_ERR_INVALID_ARGUMENT, lcb_cmdget_locktime(cmd, 10));
+    ASSERT_EQ(LCB_ERR_INVALID_ARGUMENT, lcb_cmdget_expiry(cmd, 10));
+    lcb_cmdget_destroy(cmd);
+}
+
+/**
+ * @test Near cache
+ * @pre Enable the near cache, read a key twice, then store it and read it
+ * once more
+ * @post The second get is answered by the cache, the third reads the new
+ * value from the cluster
+ */
+TEST_F(GetUnitTest, testNearCache)
+{
+    SKIP_UNLESS_MOCK()
+    HandleWrap hw;
+    lcb_INSTANCE *instance;
+    createConnection(hw, &instance);
+    int enabled = 1;
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_METRICS, &enabled));
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_setu32(instance, LCB_CNTL_NEAR_CACHE_SIZE, 16));
+    lcb_METRICS *metrics = nullptr;
+    lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_METRICS, &metrics);
+
+    std::string key("testNearCacheKey");
+    storeKey(instance, key, "cached");
+
+    lcb_install_callback(instance, LCB_CALLBACK_GET, (lcb_RESPCALLBACK)hedged_get_callback);
+    lcb_CMDGET *cmd;
+    lcb_cmdget_create(&cmd);
+    lcb_cmdget_near_cache(cmd, 1);
+    lcb_cmdget_key(cmd, key.c_str(), key.size());
+
+    HedgedGetCookie first, second, third;
+    ASSERT_EQ(LCB_SUCCESS, lcb_get(instance, &first, cmd));
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+    ASSERT_EQ(LCB_SUCCESS, lcb_get(instance, &second, cmd));
+    ASSERT_EQ(0, second.calls);
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+    ASSERT_EQ(1, second.calls);
+    ASSERT_EQ(LCB_SUCCESS, second.rc);
+    ASSERT_EQ("cached", second.value);
+    ASSERT_EQ(1U, metrics->near_cache_hits);
+    ASSERT_EQ(1U, metrics->near_cache_misses);
+
+    storeKey(instance, key, "mutated");
+    ASSERT_EQ(LCB_SUCCESS, lcb_get(instance, &third, cmd));
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+    ASSERT_EQ(1, third.calls);
+    ASSERT_EQ("mutated", third.value);
+    ASSERT_EQ(2U, metrics->near_cache_misses);
+    lcb_cmdget_destroy(cmd);
+}
+
+/**
+ * @test Coalesced gets
+ * @pre Enable get coalescing and schedule three gets of the same key at once
+ * @post Each get is answered with the value, but only one was sent
+ */
+TEST_F(GetUnitTest, testCoalescedGet)
+{
+    SKIP_UNLESS_MOCK()
+    HandleWrap hw;
+    lcb_INSTANCE *instance;
+    createConnection(hw, &instance);
+    int enabled = 1;
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_METRICS, &enabled));
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_GET_COALESCE, &enabled));
+    lcb_METRICS *metrics = nullptr;
+    lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_METRICS, &metrics);
+
+    std::string key("testCoalescedGetKey");
+    storeKey(instance, key, "coalesced");
+
+    lcb_install_callback(instance, LCB_CALLBACK_GET, (lcb_RESPCALLBACK)hedged_get_callback);
+    lcb_CMDGET *cmd;
+    lcb_cmdget_create(&cmd);
+    lcb_cmdget_key(cmd, key.c_str(), key.size());
+    HedgedGetCookie cookies[3];
+    for (auto &cookie : cookies) {
+        ASSERT_EQ(LCB_SUCCESS, lcb_get(instance, &cookie, cmd));
+    }
+    lcb_cmdget_destroy(cmd);
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+
+    for (const auto &cookie : cookies) {
+        ASSERT_EQ(1, cookie.calls);
+        ASSERT_EQ(LCB_SUCCESS, cookie.rc);
+        ASSERT_EQ("coalesced", cookie.value);
+    }
+    ASSERT_EQ(2U, metrics->gets_coalesced);
+}
+
+struct BatchGetCookie : HedgedGetCookie {
+    lcb_BACKBUF buf{};
+    const char *kept{};
+    size_t nkept{};
+};
+
+extern "C" {
+static void batch_callback(lcb_INSTANCE *, const lcb_RESPBATCH *batch)
+{
+    for (size_t ii = 0; ii < lcb_respbatch_size(batch); ++ii) {
+        lcb_CALLBACK_TYPE type;
+        lcb_respbatch_type(batch, ii, &type);
+        EXPECT_EQ(LCB_CALLBACK_GET, type);
+        BatchGetCookie *bck;
+        lcb_respbatch_cookie(batch, ii, (void **)&bck);
+        bck->calls++;
+        bck->rc = LCB_SUCCESS;
+        lcb_respbatch_value(batch, ii, &bck->kept, &bck->nkept);
+        EXPECT_EQ(LCB_SUCCESS, lcb_respbatch_backbuf(batch, ii, &bck->buf));
+    }
+    const char *value;
+    size_t nvalue;
+    EXPECT_EQ(LCB_ERR_INVALID_ARGUMENT, lcb_respbatch_value(batch, lcb_respbatch_size(batch), &value, &nvalue));
+}
+}
+
+/**
+ * @test Batched responses
+ * @pre Install a batch callback and get a stored key several times and a missing one
+ * @post The hits are passed to the batch callback, their values stay valid once retained,
+ *       and the miss is passed to the get callback
+ */
+TEST_F(GetUnitTest, testBatchCallback)
+{
+    SKIP_UNLESS_MOCK()
+    HandleWrap hw;
+    lcb_INSTANCE *instance;
+    createConnection(hw, &instance);
+
+    std::string key("testBatchCallbackKey"), missing("testBatchCallbackMissing");
+    storeKey(instance, key, "batched");
+    removeKey(instance, missing);
+
+    lcb_install_callback(instance, LCB_CALLBACK_GET, (lcb_RESPCALLBACK)hedged_get_callback);
+    ASSERT_EQ(nullptr, lcb_set_batch_callback(instance, batch_callback));
+    lcb_CMDGET *cmd;
+    lcb_cmdget_create(&cmd);
+    lcb_cmdget_key(cmd, key.c_str(), key.size());
+    BatchGetCookie hits[8];
+    for (auto &hit : hits) {
+        ASSERT_EQ(LCB_SUCCESS, lcb_get(instance, &hit, cmd));
+    }
+    HedgedGetCookie miss;
+    lcb_cmdget_key(cmd, missing.c_str(), missing.size());
+    ASSERT_EQ(LCB_SUCCESS, lcb_get(instance, &miss, cmd));
+    lcb_cmdget_destroy(cmd);
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+
+    for (auto &hit : hits) {
+        ASSERT_EQ(1, hit.calls);
+        ASSERT_EQ("batched", std::string(hit.kept, hit.nkept));
+        lcb_backbuf_unref(hit.buf);
+    }
+    ASSERT_EQ(1, miss.calls);
+    ASSERT_EQ(LCB_ERR_DOCUMENT_NOT_FOUND, miss.rc);
+}
+
+/**
+ * @test Skipped touches
+ * @pre Set a touch skip window and get-and-touch the same key twice with the same expiry,
+ *      then once more after storing it
+ * @post All gets return the value, only the second one was sent without the touch
+ */
+TEST_F(GetUnitTest, testTouchSkipWindow)
+{
+    SKIP_UNLESS_MOCK()
+    HandleWrap hw;
+    lcb_INSTANCE *instance;
+    createConnection(hw, &instance);
+    int enabled = 1;
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_METRICS, &enabled));
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_setu32(instance, LCB_CNTL_TOUCH_SKIP_WINDOW, LCB_MS2US(60000)));
+    lcb_METRICS *metrics = nullptr;
+    lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_METRICS, &metrics);
+
+    std::string key("testTouchSkipWindowKey");
+    storeKey(instance, key, "touched");
+
+    lcb_install_callback(instance, LCB_CALLBACK_GET, (lcb_RESPCALLBACK)hedged_get_callback);
+    lcb_CMDGET *cmd;
+    lcb_cmdget_create(&cmd);
+    lcb_cmdget_key(cmd, key.c_str(), key.size());
+    lcb_cmdget_expiry(cmd, 600);
+
+    HedgedGetCookie cookies[3];
+    for (int ii = 0; ii < 3; ii++) {
+        if (ii == 2) {
+            storeKey(instance, key, "touched");
+        }
+        ASSERT_EQ(LCB_SUCCESS, lcb_get(instance, &cookies[ii], cmd));
+        lcb_wait(instance, LCB_WAIT_DEFAULT);
+        ASSERT_EQ(1, cookies[ii].calls);
+        ASSERT_EQ(LCB_SUCCESS, cookies[ii].rc);
+        ASSERT_EQ("touched", cookies[ii].value);
+    }
+    lcb_cmdget_destroy(cmd);
+    ASSERT_EQ(1U, metrics->touches_skipped);
+}
+
 TEST_F(GetUnitTest, DISABLED_testFailoverAndMultiGet)
 {
     SKIP_UNLESS_MOCK()
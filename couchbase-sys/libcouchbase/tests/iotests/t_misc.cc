@@ -338,6 +338,45 @@ TEST_F(MockUnitTest, testAsyncDestroy)
     ASSERT_EQ(1, ctx.count);
 }
 
+extern "C" {
+static void cancelled_store_callback(lcb_INSTANCE *, int, const lcb_RESPSTORE *resp)
+{
+    lcb_STATUS *rc;
+    lcb_respstore_cookie(resp, (void **)&rc);
+    *rc = lcb_respstore_status(resp);
+}
+}
+
+TEST_F(MockUnitTest, testFastDestroy)
+{
+    lcb_INSTANCE *instance;
+    createConnection(&instance);
+    lcbio_pTABLE iot = instance->iotable;
+
+    int enabled = 1;
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_FASTDESTROY, &enabled));
+    lcb_install_callback(instance, LCB_CALLBACK_STORE, (lcb_RESPCALLBACK)cancelled_store_callback);
+
+    lcb_STATUS rc = LCB_SUCCESS;
+    lcb_CMDSTORE *cmd;
+    lcb_cmdstore_create(&cmd, LCB_STORE_UPSERT);
+    lcb_cmdstore_key(cmd, "key", strlen("key"));
+    lcb_cmdstore_value(cmd, "value", strlen("value"));
+    ASSERT_EQ(LCB_SUCCESS, lcb_store(instance, &rc, cmd));
+    lcb_cmdstore_destroy(cmd);
+
+    // The command is still pending, and must be cancelled instead of drained
+    async_ctx ctx{};
+    ctx.table = iot;
+    lcb_set_destroy_callback(instance, dtor_callback);
+    lcb_destroy_async(instance, &ctx);
+    lcbio_table_ref(iot);
+    lcb_run_loop(instance);
+    lcbio_table_unref(iot);
+    ASSERT_EQ(1, ctx.count);
+    ASSERT_STATUS_EQ(LCB_ERR_REQUEST_CANCELED, rc);
+}
+
 TEST_F(MockUnitTest, testGetHostInfo)
 {
     lcb_INSTANCE *instance;
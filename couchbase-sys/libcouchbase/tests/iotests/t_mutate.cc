@@ -1041,3 +1041,114 @@ TEST_F(MutateUnitTest, testMutateInPreservesExpiry)
         ASSERT_EQ(0, res.expiry);
     }
 }
+
+/**
+ * @test Coalesced upserts
+ * @pre Schedule three coalesced upserts of the same key at once
+ * @post Each upsert succeeds with the CAS of the last value, which is the only one written
+ */
+TEST_F(MutateUnitTest, testCoalescedUpsert)
+{
+    SKIP_UNLESS_MOCK()
+    HandleWrap hw;
+    lcb_INSTANCE *instance;
+    createConnection(hw, &instance);
+    int enabled = 1;
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_METRICS, &enabled));
+    lcb_METRICS *metrics = nullptr;
+    lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_METRICS, &metrics);
+    lcb_install_callback(instance, LCB_CALLBACK_STORE, reinterpret_cast<lcb_RESPCALLBACK>(preserve_expiry_upsert));
+
+    lcb_CMDSTORE *cmd;
+    lcb_cmdstore_create(&cmd, LCB_STORE_INSERT);
+    ASSERT_STATUS_EQ(LCB_ERR_INVALID_ARGUMENT, lcb_cmdstore_coalesce(cmd, 1));
+    lcb_cmdstore_destroy(cmd);
+
+    std::string key("testCoalescedUpsert");
+    std::string values[] = {"first", "second", "last"};
+    store_result results[3];
+    for (size_t ii = 0; ii < 3; ii++) {
+        lcb_cmdstore_create(&cmd, LCB_STORE_UPSERT);
+        lcb_cmdstore_key(cmd, key.c_str(), key.size());
+        lcb_cmdstore_value(cmd, values[ii].c_str(), values[ii].size());
+        ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cmdstore_coalesce(cmd, 1));
+        ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_store(instance, &results[ii], cmd));
+        lcb_cmdstore_destroy(cmd);
+    }
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+
+    for (const auto &res : results) {
+        ASSERT_TRUE(res.called);
+        ASSERT_STATUS_EQ(LCB_SUCCESS, res.rc);
+        ASSERT_NE(0, res.cas);
+        ASSERT_EQ(results[2].cas, res.cas);
+    }
+    ASSERT_EQ(2U, metrics->upserts_coalesced);
+
+    Item itm;
+    getKey(instance, key, itm);
+    ASSERT_EQ("last", itm.val);
+    ASSERT_EQ(results[2].cas, itm.cas);
+}
+
+/**
+ * @test Coalesced upserts with different options
+ * @pre Schedule coalesced upserts of the same key with a CAS, and with
+ * different flags
+ * @post None of them is replaced: the second upsert with the stale CAS fails,
+ * and each upsert with new flags is written with its flags
+ */
+TEST_F(MutateUnitTest, testCoalescedUpsertOptions)
+{
+    SKIP_UNLESS_MOCK()
+    HandleWrap hw;
+    lcb_INSTANCE *instance;
+    createConnection(hw, &instance);
+    int enabled = 1;
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_METRICS, &enabled));
+    lcb_METRICS *metrics = nullptr;
+    lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_METRICS, &metrics);
+    lcb_install_callback(instance, LCB_CALLBACK_STORE, reinterpret_cast<lcb_RESPCALLBACK>(preserve_expiry_upsert));
+
+    std::string key("testCoalescedUpsertOptions");
+    storeKey(instance, key, "initial");
+    Item itm;
+    getKey(instance, key, itm);
+
+    lcb_CMDSTORE *cmd;
+    store_result cas_results[2];
+    for (auto &res : cas_results) {
+        lcb_cmdstore_create(&cmd, LCB_STORE_UPSERT);
+        lcb_cmdstore_key(cmd, key.c_str(), key.size());
+        lcb_cmdstore_value(cmd, "value", 5);
+        lcb_cmdstore_cas(cmd, itm.cas);
+        ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cmdstore_coalesce(cmd, 1));
+        ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_store(instance, &res, cmd));
+        lcb_cmdstore_destroy(cmd);
+    }
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+    ASSERT_STATUS_EQ(LCB_SUCCESS, cas_results[0].rc);
+    ASSERT_STATUS_EQ(LCB_ERR_CAS_MISMATCH, cas_results[1].rc);
+
+    std::string values[] = {"first", "second"};
+    std::uint32_t flags[] = {1, 2};
+    store_result results[2];
+    for (size_t ii = 0; ii < 2; ii++) {
+        lcb_cmdstore_create(&cmd, LCB_STORE_UPSERT);
+        lcb_cmdstore_key(cmd, key.c_str(), key.size());
+        lcb_cmdstore_value(cmd, values[ii].c_str(), values[ii].size());
+        lcb_cmdstore_flags(cmd, flags[ii]);
+        ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_cmdstore_coalesce(cmd, 1));
+        ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_store(instance, &results[ii], cmd));
+        lcb_cmdstore_destroy(cmd);
+    }
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+    ASSERT_STATUS_EQ(LCB_SUCCESS, results[0].rc);
+    ASSERT_STATUS_EQ(LCB_SUCCESS, results[1].rc);
+    ASSERT_NE(results[0].cas, results[1].cas);
+    ASSERT_EQ(0U, metrics->upserts_coalesced);
+
+    getKey(instance, key, itm);
+    ASSERT_EQ("second", itm.val);
+    ASSERT_EQ(2U, itm.flags);
+}
@@ -31,10 +31,10 @@ using std::vector;
 // the plan
 void lcb_n1qlcache_getplan(lcb_QUERY_CACHE_ *cache, const std::string &key, std::string &out)
 {
-    const Plan *plan = cache->get_entry(key);
-    if (plan != nullptr) {
+    Plan plan;
+    if (cache->get_entry(key, plan)) {
         Json::Value tmp(Json::objectValue);
-        plan->apply_plan(tmp, out);
+        plan.apply_plan(tmp, out);
     }
 }
 
@@ -868,3 +868,42 @@ TEST_F(MockUnitTest, testNegativeIndex)
     lcb_cmdget_destroy(gcmd);
     // That's it
 }
+
+TEST_F(MockUnitTest, testIdleConnectionReplaced)
+{
+    SKIP_UNLESS_MOCK()
+
+    lcb_INSTANCE *instance;
+    lcb_CREATEOPTS *cropts = nullptr;
+    MockEnvironment *mock = MockEnvironment::getInstance();
+    mock->makeConnectParams(cropts, nullptr);
+    doLcbCreate(&instance, cropts, mock);
+    lcb_createopts_destroy(cropts);
+
+    int enabled = 1;
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_METRICS, &enabled));
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_setu32(instance, LCB_CNTL_KV_IDLE_TIMEOUT, LCB_MS2US(200)));
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_setu32(instance, LCB_CNTL_OP_TIMEOUT, LCB_MS2US(10000)));
+    ASSERT_EQ(LCB_SUCCESS, lcb_connect(instance));
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_get_bootstrap_status(instance));
+
+    std::string key("testIdleConnectionReplaced");
+    storeKey(instance, key, "before");
+
+    // The nodes stop replying for longer than the idle timeout, like a half-open connection would
+    mock->hiccupNodes(2000, 1);
+    storeKey(instance, key, "after");
+    mock->hiccupNodes(0, 0);
+
+    lcb_METRICS *metrics = nullptr;
+    lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_METRICS, &metrics);
+    lcb_SIZE nprobes = 0, nreconnects = 0;
+    for (lcb_SIZE ii = 0; ii < metrics->nservers; ii++) {
+        nprobes += metrics->servers[ii]->idle_probes;
+        nreconnects += metrics->servers[ii]->idle_reconnects;
+    }
+    ASSERT_LE(1, nprobes);
+    ASSERT_LE(1, nreconnects);
+    lcb_destroy(instance);
+}
@@ -46,6 +46,34 @@ static void statKey_callback(lcb_INSTANCE *, int, const lcb_RESPSTATS *resp)
     lcb_respstats_cookie(resp, (void **)&mm);
     (*mm)[std::string(server, server_len)] = true;
 }
+
+struct AggregatedStats {
+    std::map<std::string, size_t> nstats{};
+    size_t nfinal{0};
+};
+
+static void aggregatedStatsCallback(lcb_INSTANCE *, int, const lcb_RESPSTATS *resp)
+{
+    AggregatedStats *result;
+    lcb_respstats_cookie(resp, (void **)&result);
+    EXPECT_EQ(LCB_SUCCESS, lcb_respstats_status(resp));
+    const char *server;
+    size_t server_len;
+    lcb_respstats_server(resp, &server, &server_len);
+    size_t nstats;
+    lcb_respstats_nstats(resp, &nstats);
+    if (server == nullptr) {
+        EXPECT_EQ(0, nstats);
+        result->nfinal++;
+        return;
+    }
+    const char *key, *value;
+    size_t key_len, value_len;
+    EXPECT_EQ(LCB_SUCCESS, lcb_respstats_stat(resp, 0, &key, &key_len, &value, &value_len));
+    EXPECT_LT(0, key_len);
+    EXPECT_EQ(LCB_ERR_INVALID_ARGUMENT, lcb_respstats_stat(resp, nstats, &key, &key_len, &value, &value_len));
+    result->nstats[std::string(server, server_len)] = nstats;
+}
 }
 
 /**
@@ -72,6 +100,42 @@ TEST_F(ServeropsUnitTest, testServerStats)
     EXPECT_LT(1, numcallbacks);
 }
 
+/**
+ * @test Aggregated server statistics
+ * @pre Schedule an aggregated statistics command twice, the second time
+ * accepting cached statistics
+ * @post Each server responds once with all of its statistics, followed by the
+ * final response. The second command is answered from the cache.
+ */
+TEST_F(ServeropsUnitTest, testAggregatedStats)
+{
+    SKIP_UNLESS_MOCK()
+    lcb_INSTANCE *instance;
+    HandleWrap hw;
+    createConnection(hw, &instance);
+    lcb_install_callback(instance, LCB_CALLBACK_STATS, (lcb_RESPCALLBACK)aggregatedStatsCallback);
+
+    lcb_CMDSTATS *cmd;
+    lcb_cmdstats_create(&cmd);
+    lcb_cmdstats_max_age(cmd, LCB_MS2US(60000));
+    ASSERT_EQ(LCB_ERR_INVALID_ARGUMENT, lcb_stats(instance, nullptr, cmd));
+    lcb_cmdstats_aggregate(cmd, 1);
+
+    AggregatedStats first, second;
+    ASSERT_EQ(LCB_SUCCESS, lcb_stats(instance, &first, cmd));
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+    ASSERT_EQ(1, first.nfinal);
+    ASSERT_EQ(lcb_get_num_nodes(instance), first.nstats.size());
+
+    ASSERT_EQ(LCB_SUCCESS, lcb_stats(instance, &second, cmd));
+    ASSERT_EQ(0, second.nfinal);
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+    lcb_cmdstats_destroy(cmd);
+    ASSERT_EQ(1, second.nfinal);
+    ASSERT_EQ(first.nstats, second.nstats);
+    ASSERT_FALSE(instance->stats_cache == nullptr);
+}
+
 TEST_F(ServeropsUnitTest, testKeyStats)
 {
     SKIP_UNLESS_MOCK(); // FIXME: works on 5.5.0, fails on 6.0.0
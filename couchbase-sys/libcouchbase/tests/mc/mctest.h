@@ -27,12 +27,12 @@
 
 struct CQWrap : mc_CMDQUEUE {
     lcbvb_CONFIG *config;
-    CQWrap()
+    explicit CQWrap(unsigned groupsize_ = 1)
     {
         mc_PIPELINE **pll;
-        pll = (mc_PIPELINE **)malloc(sizeof(*pll) * NUM_PIPELINES);
+        pll = (mc_PIPELINE **)malloc(sizeof(*pll) * NUM_PIPELINES * groupsize_);
         config = lcbvb_create();
-        for (unsigned ii = 0; ii < NUM_PIPELINES; ii++) {
+        for (unsigned ii = 0; ii < NUM_PIPELINES * groupsize_; ii++) {
             mc_PIPELINE *pipeline = new lcb::Server();
             mcreq_pipeline_init(pipeline);
             pll[ii] = pipeline;
@@ -41,13 +41,13 @@ struct CQWrap : mc_CMDQUEUE {
         this->cqdata = nullptr; /* instance pointer */
         mcreq_queue_init(this);
         this->seq = 100;
-        mcreq_queue_add_pipelines(this, pll, NUM_PIPELINES, config);
+        mcreq_queue_add_pipelines(this, pll, NUM_PIPELINES, groupsize_, config);
         free(pll);
     }
 
     ~CQWrap()
     {
-        for (int ii = 0; ii < NUM_PIPELINES; ii++) {
+        for (unsigned ii = 0; ii < MCREQ_NPIPELINES_ALL(this); ii++) {
             mc_PIPELINE *pipeline = pipelines[ii];
             EXPECT_NE(0, netbuf_is_clean(&pipeline->nbmgr));
             EXPECT_NE(0, netbuf_is_clean(&pipeline->reqpool));
@@ -60,7 +60,7 @@ struct CQWrap : mc_CMDQUEUE {
 
     void clearPipelines()
     {
-        for (unsigned ii = 0; ii < npipelines; ii++) {
+        for (unsigned ii = 0; ii < MCREQ_NPIPELINES_ALL(this); ii++) {
             mc_PIPELINE *pipeline = pipelines[ii];
             sllist_iterator iter;
             SLLIST_ITERFOR(&pipeline->requests, &iter)
@@ -75,7 +75,7 @@ struct CQWrap : mc_CMDQUEUE {
 
     void setBufFreeCallback(mcreq_bufdone_fn cb)
     {
-        for (unsigned ii = 0; ii < npipelines; ii++) {
+        for (unsigned ii = 0; ii < MCREQ_NPIPELINES_ALL(this); ii++) {
             pipelines[ii]->buf_done_callback = cb;
         }
     }
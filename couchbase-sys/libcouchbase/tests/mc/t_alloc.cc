@@ -16,6 +16,8 @@
  */
 
 #include "mctest.h"
+#include "mc/slab.h"
+#include <vector>
 
 class McAlloc : public ::testing::Test
 {
@@ -52,7 +54,7 @@ TEST_F(McAlloc, testPacketFreeAlloc)
 
     // Check to see that we can also detach a packet and use it after the
     // other resources have been released
-    copied = mcreq_renew_packet(packet);
+    copied = mcreq_renew_packet(&pipeline, packet);
 
     mcreq_wipe_packet(&pipeline, packet);
     mcreq_release_packet(&pipeline, packet);
@@ -84,7 +86,7 @@ TEST_F(McAlloc, testExdataAlloc)
     mc_PACKET *packet = mcreq_allocate_packet(&pipeline);
     mcreq_reserve_header(&pipeline, packet, 24);
 
-    copy1 = mcreq_renew_packet(packet);
+    copy1 = mcreq_renew_packet(&pipeline, packet);
     ASSERT_FALSE((copy1->flags & MCREQ_F_DETACHED) == 0);
 
     dummy_datum dd;
@@ -97,7 +99,7 @@ TEST_F(McAlloc, testExdataAlloc)
     ASSERT_FALSE(epd == nullptr);
     ASSERT_TRUE(epd == &dd.base);
 
-    copy2 = mcreq_renew_packet(copy1);
+    copy2 = mcreq_renew_packet(nullptr, copy1);
     epd = mcreq_epkt_find((mc_EXPACKET *)copy1, "Dummy");
     ASSERT_TRUE(epd == nullptr);
     epd = mcreq_epkt_find((mc_EXPACKET *)copy2, "Dummy");
@@ -113,6 +115,123 @@ TEST_F(McAlloc, testExdataAlloc)
     mcreq_pipeline_cleanup(&pipeline);
 }
 
+TEST_F(McAlloc, testDetachedSlabReuse)
+{
+    mc_PIPELINE pipeline;
+    setupPipeline(&pipeline);
+    const mc_SLABSTATS *stats = mcreq_slab_stats(pipeline.slab);
+
+    mc_PACKET *packet = mcreq_allocate_packet(&pipeline);
+    mcreq_reserve_header(&pipeline, packet, 24);
+
+    // The packet structure and its header
+    mc_PACKET *copy = mcreq_renew_packet(&pipeline, packet);
+    ASSERT_EQ(2, stats->allocs);
+    ASSERT_EQ(0, stats->reused);
+    ASSERT_EQ(2, stats->outstanding);
+
+    // Retrying a detached packet should recycle the blocks of the previous copy
+    mc_PACKET *retry = mcreq_renew_packet(nullptr, copy);
+    mcreq_wipe_packet(nullptr, copy);
+    mcreq_release_packet(nullptr, copy);
+    ASSERT_EQ(2, stats->outstanding);
+    ASSERT_NE(0, stats->cached_bytes);
+
+    copy = mcreq_renew_packet(nullptr, retry);
+    ASSERT_EQ(2, stats->reused);
+    mcreq_wipe_packet(nullptr, retry);
+    mcreq_release_packet(nullptr, retry);
+
+    mcreq_wipe_packet(&pipeline, packet);
+    mcreq_release_packet(&pipeline, packet);
+
+    // The slab must outlive its pipeline while blocks are still allocated
+    mcreq_pipeline_cleanup(&pipeline);
+    memset(SPAN_BUFFER(&copy->kh_span), 0xff, copy->kh_span.size);
+    mcreq_wipe_packet(nullptr, copy);
+    mcreq_release_packet(nullptr, copy);
+}
+
+TEST_F(McAlloc, testSetCidInPlace)
+{
+    mc_PIPELINE pipeline;
+    setupPipeline(&pipeline);
+    const mc_SLABSTATS *stats = mcreq_slab_stats(pipeline.slab);
+
+    mc_PACKET *packet = mcreq_allocate_packet(&pipeline);
+    lcb_KEYBUF keybuf{LCB_KV_COPY, {"Hello", 5}};
+    mcreq_reserve_key(&pipeline, packet, 24, &keybuf, 0);
+    protocol_binary_request_header hdr{};
+    hdr.request.magic = PROTOCOL_BINARY_REQ;
+    hdr.request.keylen = htons(5);
+    hdr.request.bodylen = htonl(5);
+    mcreq_write_hdr(packet, &hdr);
+
+    // Detaching the packet reserves room for the collection id
+    mc_PACKET *copy = mcreq_set_cid(&pipeline, packet, 8);
+    ASSERT_EQ(2, stats->allocs);
+    ASSERT_EQ(24 + 1 + 5, copy->kh_span.size);
+
+    // The longest collection id still fits, and the key follows it
+    copy = mcreq_set_cid(&pipeline, copy, 0xfffffff0);
+    ASSERT_EQ(2, stats->allocs);
+    mcreq_read_hdr(copy, &hdr);
+    ASSERT_EQ(5 + 5, ntohs(hdr.request.keylen));
+    ASSERT_EQ(5 + 5, ntohl(hdr.request.bodylen));
+    const char *key = SPAN_BUFFER(&copy->kh_span) + 24;
+    uint32_t cid = 0;
+    ASSERT_EQ(5, leb128_decode(reinterpret_cast<const uint8_t *>(key), 10, &cid));
+    ASSERT_EQ(0xfffffff0, cid);
+    ASSERT_EQ(0, memcmp(key + 5, "Hello", 5));
+
+    copy = mcreq_set_cid(&pipeline, copy, 0);
+    ASSERT_EQ(24 + 1 + 5, copy->kh_span.size);
+    ASSERT_EQ(0, memcmp(SPAN_BUFFER(&copy->kh_span) + 25, "Hello", 5));
+    ASSERT_EQ(2, stats->allocs);
+
+    mcreq_wipe_packet(nullptr, copy);
+    mcreq_release_packet(nullptr, copy);
+    mcreq_pipeline_cleanup(&pipeline);
+}
+
+TEST_F(McAlloc, testSlabClasses)
+{
+    mc_SLAB *slab = mcreq_slab_new();
+    const mc_SLABSTATS *stats = mcreq_slab_stats(slab);
+
+    void *small = mcreq_slab_alloc(slab, 1);
+    void *large = mcreq_slab_alloc(slab, MCREQ_SLAB_MAXSIZE + 1);
+    ASSERT_EQ(slab, mcreq_slab_of(small));
+    ASSERT_EQ(1, stats->oversized);
+    mcreq_slab_free(small);
+    mcreq_slab_free(large);
+    ASSERT_EQ(MCREQ_SLAB_MINSIZE, stats->cached_bytes);
+
+    // Sizes within the same class share blocks
+    void *reused = mcreq_slab_alloc(slab, MCREQ_SLAB_MINSIZE);
+    ASSERT_EQ(small, reused);
+    ASSERT_EQ(1, stats->reused);
+    mcreq_slab_free(reused);
+
+    // Blocks beyond the cache limit are freed right away
+    std::vector<void *> blocks;
+    for (size_t ii = 0; ii <= MCREQ_SLAB_MAXCACHE / MCREQ_SLAB_MAXSIZE; ii++) {
+        blocks.push_back(mcreq_slab_alloc(slab, MCREQ_SLAB_MAXSIZE));
+    }
+    for (auto *block : blocks) {
+        mcreq_slab_free(block);
+    }
+    ASSERT_GE(MCREQ_SLAB_MAXCACHE, stats->cached_bytes);
+    ASSERT_EQ(0, stats->outstanding);
+
+    // Unowned blocks are plain allocations
+    void *unowned = mcreq_slab_alloc(nullptr, 10);
+    ASSERT_EQ(nullptr, mcreq_slab_of(unowned));
+    mcreq_slab_free(unowned);
+
+    mcreq_slab_unref(slab);
+}
+
 TEST_F(McAlloc, testKeyAlloc)
 {
     CQWrap q;
@@ -0,0 +1,216 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2020 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "mctest.h"
+#include "mc/compress.h"
+#include "metrics/metrics-internal.h"
+#include <map>
+#include <snappy.h>
+#include <string>
+
+namespace
+{
+std::map<std::string, std::vector<uint64_t>> recorded;
+
+void record_value(const lcbmetrics_VALUERECORDER *recorder, uint64_t value)
+{
+    void *name = nullptr;
+    lcbmetrics_valuerecorder_cookie(recorder, &name);
+    recorded[static_cast<const char *>(name)].push_back(value);
+}
+
+const lcbmetrics_VALUERECORDER *find_recorder(const lcbmetrics_METER *, const char *name, const lcbmetrics_TAG *,
+                                              size_t)
+{
+    static std::map<std::string, lcbmetrics_VALUERECORDER *> recorders;
+    lcbmetrics_VALUERECORDER *&recorder = recorders[name];
+    if (recorder == nullptr) {
+        lcbmetrics_valuerecorder_create(&recorder, const_cast<char *>(recorders.find(name)->first.c_str()));
+        lcbmetrics_valuerecorder_record_value_callback(recorder, record_value);
+    }
+    return recorder;
+}
+} // namespace
+
+class McCompress : public ::testing::Test
+{
+  protected:
+    mc_CMDQUEUE cQueue{};
+    mc_PIPELINE pipeline{};
+    lcb_settings *settings{nullptr};
+
+    void SetUp() override
+    {
+        mcreq_queue_init(&cQueue);
+        mcreq_pipeline_init(&pipeline);
+        pipeline.parent = &cQueue;
+        settings = lcb_settings_new();
+        settings->compress_adaptive = 1;
+        settings->op_metrics_enabled = 1;
+        lcbmetrics_METER *meter = nullptr;
+        lcbmetrics_meter_create(&meter, nullptr);
+        lcbmetrics_meter_value_recorder_callback(meter, find_recorder);
+        settings->meter = meter;
+        recorded.clear();
+    }
+
+    void TearDown() override
+    {
+        lcb_settings_unref(settings);
+        mcreq_pipeline_cleanup(&pipeline);
+        mcreq_queue_cleanup(&cQueue);
+    }
+
+    int compress(const std::string &key, const std::string &value)
+    {
+        mc_PACKET *pkt = mcreq_allocate_packet(&pipeline);
+        mcreq_reserve_header(&pipeline, pkt, 24);
+        lcb_VALBUF vbuf{LCB_KV_COPY, {{value.c_str(), value.size()}}};
+        int should_compress = 1;
+        EXPECT_EQ(0, mcreq_compress_value(&pipeline, pkt, &vbuf, settings, key.c_str(), key.size(), 0,
+                                          &should_compress));
+        mcreq_wipe_packet(&pipeline, pkt);
+        mcreq_release_packet(&pipeline, pkt);
+        return should_compress;
+    }
+};
+
+TEST_F(McCompress, testSkipIncompressibleClass)
+{
+    std::string noise;
+    uint32_t seed = 42;
+    for (size_t ii = 0; ii < 4096; ii++) {
+        seed = seed * 1103515245 + 12345;
+        noise.push_back(static_cast<char>(seed >> 16));
+    }
+    std::string text(4096, 'a');
+
+    for (size_t ii = 0; ii < LCB_COMPRESS_MIN_SAMPLES; ii++) {
+        ASSERT_EQ(0, compress("image::" + std::to_string(ii), noise));
+    }
+    ASSERT_EQ(LCB_COMPRESS_MIN_SAMPLES, recorded[METRICS_COMPRESSION_DURATION_METER_NAME].size());
+    ASSERT_TRUE(recorded[METRICS_COMPRESSION_SKIPPED_METER_NAME].empty());
+
+    /* the class is skipped now, until it is sampled again */
+    for (size_t ii = 1; ii < LCB_COMPRESS_RESAMPLE_INTERVAL; ii++) {
+        ASSERT_EQ(0, compress("image::x", noise));
+    }
+    ASSERT_EQ(LCB_COMPRESS_RESAMPLE_INTERVAL - 1, recorded[METRICS_COMPRESSION_SKIPPED_METER_NAME].size());
+    ASSERT_EQ(4096, recorded[METRICS_COMPRESSION_SKIPPED_METER_NAME][0]);
+    ASSERT_EQ(LCB_COMPRESS_MIN_SAMPLES, recorded[METRICS_COMPRESSION_DURATION_METER_NAME].size());
+    ASSERT_EQ(0, compress("image::x", noise));
+    ASSERT_EQ(LCB_COMPRESS_MIN_SAMPLES + 1, recorded[METRICS_COMPRESSION_DURATION_METER_NAME].size());
+
+    /* other prefixes are not affected */
+    ASSERT_EQ(1, compress("doc::1", text));
+    ASSERT_EQ(LCB_COMPRESS_MIN_SAMPLES + 2, recorded[METRICS_COMPRESSION_SAVED_METER_NAME].size());
+    ASSERT_LT(0, recorded[METRICS_COMPRESSION_SAVED_METER_NAME].back());
+}
+
+TEST_F(McCompress, testClassRecovers)
+{
+    std::string noise;
+    uint32_t seed = 7;
+    for (size_t ii = 0; ii < 1024; ii++) {
+        seed = seed * 1103515245 + 12345;
+        noise.push_back(static_cast<char>(seed >> 16));
+    }
+    std::string text(1024, 'z');
+
+    for (size_t ii = 0; ii < LCB_COMPRESS_MIN_SAMPLES; ii++) {
+        compress("blob:1", noise);
+    }
+    size_t ncompressed = 0;
+    for (size_t ii = 0; ii < 20 * LCB_COMPRESS_RESAMPLE_INTERVAL; ii++) {
+        ncompressed += compress("blob:1", text);
+    }
+    /* the resamples pull the average below the threshold again */
+    ASSERT_LT(10 * LCB_COMPRESS_RESAMPLE_INTERVAL, ncompressed);
+    ASSERT_EQ(1, compress("blob:1", text));
+}
+
+TEST_F(McCompress, testValueSpanInPlace)
+{
+    settings->compress_adaptive = 0;
+    std::string noise;
+    uint32_t seed = 3;
+    for (size_t ii = 0; ii < 3000; ii++) {
+        seed = seed * 1103515245 + 12345;
+        noise.push_back(static_cast<char>(seed >> 16));
+    }
+    std::string text;
+    for (size_t ii = 0; ii < 100; ii++) {
+        text += "{\"name\":\"value " + std::to_string(ii) + "\"}";
+    }
+
+    struct {
+        lcb_KVBUFTYPE vtype;
+        const std::string *value;
+        int compressed;
+    } cases[] = {{LCB_KV_COPY, &noise, 0},    {LCB_KV_IOVCOPY, &noise, 0}, {LCB_KV_COPY, &text, 1},
+                 {LCB_KV_IOVCOPY, &text, 1}, {LCB_KV_IOV, &text, 1},      {LCB_KV_IOV, &noise, 0}};
+
+    for (const auto &test : cases) {
+        const std::string &value = *test.value;
+        lcb_IOV iov[3] = {{const_cast<char *>(value.data()), 100},
+                          {const_cast<char *>(value.data()) + 100, 1},
+                          {const_cast<char *>(value.data()) + 101, value.size() - 101}};
+        lcb_VALBUF vbuf{test.vtype, {{value.data(), value.size()}}};
+        if (test.vtype != LCB_KV_COPY) {
+            vbuf.u_buf.multi.iov = iov;
+            vbuf.u_buf.multi.niov = 3;
+            vbuf.u_buf.multi.total_length = 0;
+        }
+
+        mc_PACKET *pkt = mcreq_allocate_packet(&pipeline);
+        mcreq_reserve_header(&pipeline, pkt, 24);
+        int should_compress = 1;
+        ASSERT_EQ(0, mcreq_compress_value(&pipeline, pkt, &vbuf, settings, "k", 1, 0, &should_compress));
+        ASSERT_EQ(test.compressed, should_compress);
+
+        if (pkt->flags & MCREQ_F_VALUE_IOV) {
+            ASSERT_EQ(0, test.compressed);
+            ASSERT_EQ(value.size(), pkt->u_value.multi.total_length);
+        } else if (test.compressed) {
+            std::string inflated;
+            ASSERT_TRUE(
+                snappy::Uncompress(SPAN_BUFFER(&pkt->u_value.single), pkt->u_value.single.size, &inflated));
+            ASSERT_EQ(value, inflated);
+        } else {
+            ASSERT_EQ(value, std::string(SPAN_BUFFER(&pkt->u_value.single), pkt->u_value.single.size));
+        }
+        mcreq_wipe_packet(&pipeline, pkt);
+        mcreq_release_packet(&pipeline, pkt);
+    }
+}
+
+TEST_F(McCompress, testInflateInto)
+{
+    std::string text(10000, 'x');
+    std::string compressed;
+    snappy::Compress(text.data(), text.size(), &compressed);
+
+    size_t nbytes = 0;
+    ASSERT_EQ(0, mcreq_inflated_length(compressed.data(), compressed.size(), &nbytes));
+    ASSERT_EQ(text.size(), nbytes);
+    std::vector<char> dst(nbytes);
+    ASSERT_EQ(0, mcreq_inflate_into(compressed.data(), compressed.size(), dst.data()));
+    ASSERT_EQ(text, std::string(dst.data(), dst.size()));
+
+    ASSERT_NE(0, mcreq_inflated_length("\xff\xff\xff\xff\xff\xff", 6, &nbytes));
+    ASSERT_NE(0, mcreq_inflate_into(compressed.data(), compressed.size() / 2, dst.data()));
+}
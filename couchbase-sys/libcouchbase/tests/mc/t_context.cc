@@ -17,6 +17,7 @@
 
 #include "mctest.h"
 #include "mc/mcreq-flush-inl.h"
+#include <set>
 
 class McContext : public ::testing::Test
 {
@@ -116,3 +117,91 @@ TEST_F(McContext, testFailedContext)
         ASSERT_EQ(0, mcreq_flush_iov_fill(pl, iov, 1, NULL));
     }
 }
+
+TEST_F(McContext, testGroupedPipelines)
+{
+    CQWrap cq(3);
+    std::set<mc_PIPELINE *> used;
+
+    ASSERT_EQ(NUM_PIPELINES, cq.npipelines);
+    ASSERT_EQ(3U, cq.groupsize);
+
+    mcreq_sched_enter(&cq);
+
+    for (int ii = 0; ii < 100; ii++) {
+        PacketWrap pw, again;
+        char kbuf[128];
+        snprintf(kbuf, sizeof(kbuf), "Key_%d", ii);
+        pw.setCopyKey(kbuf);
+        again.setCopyKey(kbuf);
+
+        ASSERT_TRUE(pw.reservePacket(&cq));
+        ASSERT_TRUE(again.reservePacket(&cq));
+
+        // Packets of the same key use the same member of the master's group
+        int vbid, srvix;
+        mcreq_map_key(&cq, &pw.keybuf, 24, &vbid, &srvix);
+        ASSERT_EQ(pw.pipeline, again.pipeline);
+        ASSERT_EQ(srvix, pw.pipeline->index);
+        ASSERT_EQ(pw.pipeline, cq.pipelines[pw.pipeline->slot]);
+        used.insert(pw.pipeline);
+
+        pw.setHeaderSize();
+        pw.copyHeader();
+        mcreq_sched_add(pw.pipeline, pw.pkt);
+        again.setHeaderSize();
+        again.copyHeader();
+        mcreq_sched_add(again.pipeline, again.pkt);
+    }
+    ASSERT_GT(used.size(), (size_t)NUM_PIPELINES);
+
+    mcreq_sched_fail(&cq);
+    for (unsigned ii = 0; ii < MCREQ_NPIPELINES_ALL(&cq); ii++) {
+        ASSERT_TRUE(SLLIST_IS_EMPTY(&cq.pipelines[ii]->requests));
+        ASSERT_TRUE(SLLIST_IS_EMPTY(&cq.pipelines[ii]->ctxqueued));
+    }
+}
+
+extern "C" {
+static void buf_done_counter(mc_PIPELINE *, const void *cookie, void *, void *)
+{
+    CtxCookie *ctx = (CtxCookie *)cookie;
+    ctx->ncalled++;
+}
+}
+
+TEST_F(McContext, testFailedContextReleasesUserBuffers)
+{
+    CQWrap cq;
+    CtxCookie cookie;
+    char value[] = "user allocated value";
+    lcb_IOV iov[2] = {{value, 4}, {value + 4, sizeof(value) - 4}};
+
+    cq.setBufFreeCallback(buf_done_counter);
+    mcreq_sched_enter(&cq);
+
+    for (int ii = 0; ii < 20; ii++) {
+        PacketWrap pw;
+        char kbuf[128];
+        snprintf(kbuf, sizeof(kbuf), "Key_%d", ii);
+        pw.setCopyKey(kbuf);
+
+        ASSERT_TRUE(pw.reservePacket(&cq));
+
+        lcb_VALBUF vb{};
+        vb.vtype = LCB_KV_IOV;
+        vb.u_buf.multi.iov = iov;
+        vb.u_buf.multi.niov = 2;
+        ASSERT_EQ(LCB_SUCCESS, mcreq_reserve_value(pw.pipeline, pw.pkt, &vb));
+        ASSERT_NE(0, pw.pkt->flags & MCREQ_F_VALUE_NOCOPY);
+
+        pw.setHeaderSize();
+        pw.copyHeader();
+        pw.setCookie(&cookie);
+        mcreq_sched_add(pw.pipeline, pw.pkt);
+    }
+
+    ASSERT_EQ(0, cookie.ncalled);
+    mcreq_sched_fail(&cq);
+    ASSERT_EQ(20, cookie.ncalled);
+}
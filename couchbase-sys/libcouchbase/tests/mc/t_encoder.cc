@@ -0,0 +1,56 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2024 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "mctest.h"
+#include "mc/encoder.hh"
+
+class McEncoder : public ::testing::Test
+{
+};
+
+TEST_F(McEncoder, testMatchesGenericHeader)
+{
+    CQWrap cq;
+    mc_PIPELINE *pipeline = cq.pipelines[0];
+    mc_PACKET *packet = mcreq_allocate_packet(pipeline);
+    ASSERT_TRUE(packet != nullptr);
+    mcreq_reserve_header(pipeline, packet, sizeof(protocol_binary_request_header) + 4);
+
+    protocol_binary_request_header hdr{};
+    hdr.request.magic = PROTOCOL_BINARY_REQ;
+    hdr.request.keylen = htons(5);
+    hdr.request.vbucket = htons(42);
+    hdr.request.extlen = 4;
+
+    protocol_binary_request_header expected = hdr;
+    expected.request.opcode = PROTOCOL_BINARY_CMD_GAT;
+    expected.request.datatype = PROTOCOL_BINARY_RAW_BYTES;
+    expected.request.bodylen = htonl(4 + 5);
+    expected.request.opaque = packet->opaque;
+    expected.request.cas = 0;
+
+    std::uint32_t expiry = htonl(300);
+    lcb::mc::RequestEncoder<PROTOCOL_BINARY_CMD_GAT, 4>::encode(packet, hdr, 0, 0, &expiry);
+
+    ASSERT_EQ(0, memcmp(expected.bytes, hdr.bytes, sizeof(hdr.bytes)));
+    const char *buf = SPAN_BUFFER(&packet->kh_span);
+    ASSERT_EQ(0, memcmp(expected.bytes, buf, sizeof(expected.bytes)));
+    ASSERT_EQ(0, memcmp(&expiry, buf + sizeof(expected.bytes), sizeof(expiry)));
+
+    mcreq_wipe_packet(pipeline, packet);
+    mcreq_release_packet(pipeline, packet);
+}
@@ -100,6 +100,31 @@ TEST_F(McFlush, testFlushedUnhandled)
     ASSERT_EQ(1, cookie.ncalled);
 }
 
+TEST_F(McFlush, testFlushedTimestamp)
+{
+    CQWrap cq;
+    PacketWrap pw;
+    pw.setContigKey("1234");
+    ASSERT_TRUE(pw.reservePacket(&cq));
+    pw.setHeaderSize();
+    pw.copyHeader();
+    mcreq_enqueue_packet(pw.pipeline, pw.pkt);
+    ASSERT_EQ(0, MCREQ_PKT_RDATA(pw.pkt)->flushed);
+
+    nb_IOV iovs[10];
+    unsigned toFlush = mcreq_flush_iov_fill(pw.pipeline, iovs, 10, nullptr);
+    mcreq_flush_done_ex(pw.pipeline, 8, toFlush, 0, 42);
+    // Partially written packets are not flushed yet
+    ASSERT_EQ(0, MCREQ_PKT_RDATA(pw.pkt)->flushed);
+
+    toFlush = mcreq_flush_iov_fill(pw.pipeline, iovs, 10, nullptr);
+    mcreq_flush_done_ex(pw.pipeline, toFlush, toFlush, 0, 43);
+    ASSERT_EQ(43, MCREQ_PKT_RDATA(pw.pkt)->flushed);
+
+    ASSERT_EQ(pw.pkt, mcreq_pipeline_remove(pw.pipeline, pw.pkt->opaque));
+    mcreq_packet_handled(pw.pipeline, pw.pkt);
+}
+
 TEST_F(McFlush, testFlushCopy)
 {
     CQWrap cq;
@@ -199,3 +224,161 @@ TEST_F(McFlush, testPartialFlush)
     mcreq_packet_handled(pw.pipeline, pw.pkt);
     ASSERT_EQ(1, cookie.ncalled);
 }
+
+TEST_F(McFlush, testLargePacketsYield)
+{
+    CQWrap cq;
+    lcb_SERVERMETRICS metrics{};
+    PacketWrap large, same, small;
+
+    large.setContigKey("doc");
+    ASSERT_TRUE(large.reservePacket(&cq));
+    mc_PIPELINE *pl = large.pipeline;
+    pl->large_threshold = 64;
+    pl->metrics = &metrics;
+    ASSERT_EQ(LCB_SUCCESS, mcreq_reserve_value2(pl, large.pkt, 100));
+    large.setHeaderSize();
+    large.copyHeader();
+    mcreq_enqueue_packet(pl, large.pkt);
+
+    // Operations on the same document stay behind it
+    same.setContigKey("doc");
+    ASSERT_TRUE(same.reservePacket(&cq));
+    ASSERT_EQ(pl, same.pipeline);
+    same.setHeaderSize();
+    same.copyHeader();
+    mcreq_enqueue_packet(pl, same.pkt);
+
+    // Another document of the same server goes ahead of them
+    std::string key;
+    for (int ii = 0, vbid, srvix = -1; srvix != pl->index; ii++) {
+        key = "k" + std::to_string(ii);
+        lcbvb_map_key(cq.config, key.c_str(), key.size(), &vbid, &srvix);
+    }
+    small.setContigKey(key.c_str());
+    ASSERT_TRUE(small.reservePacket(&cq));
+    ASSERT_EQ(pl, small.pipeline);
+    small.setHeaderSize();
+    small.copyHeader();
+    mcreq_enqueue_packet(pl, small.pkt);
+    ASSERT_EQ(2, metrics.packets_held);
+    ASSERT_EQ(127 + 27, metrics.bytes_held);
+    ASSERT_EQ(1, metrics.packets_overtaking);
+
+    nb_IOV iovs[10];
+    unsigned toFlush = mcreq_flush_iov_fill(pl, iovs, 10, nullptr);
+    ASSERT_EQ(mcreq_get_size(small.pkt), toFlush);
+    ASSERT_EQ(small.pktbuf, iovs[0].iov_base);
+    mcreq_flush_done(pl, toFlush, toFlush);
+
+    // Released once everything before it has been flushed
+    toFlush = mcreq_flush_iov_fill(pl, iovs, 10, nullptr);
+    ASSERT_EQ(127, toFlush);
+    ASSERT_EQ(large.pktbuf, iovs[0].iov_base);
+    ASSERT_EQ(1, metrics.packets_held);
+    mcreq_flush_done(pl, toFlush, toFlush);
+
+    toFlush = mcreq_flush_iov_fill(pl, iovs, 10, nullptr);
+    ASSERT_EQ(27, toFlush);
+    ASSERT_EQ(same.pktbuf, iovs[0].iov_base);
+    mcreq_flush_done(pl, toFlush, toFlush);
+    ASSERT_EQ(0, mcreq_flush_iov_fill(pl, iovs, 10, nullptr));
+    ASSERT_EQ(0, metrics.packets_held);
+    ASSERT_EQ(0, metrics.bytes_held);
+
+    for (PacketWrap *pw : {&large, &same, &small}) {
+        ASSERT_NE(0, pw->pkt->flags & MCREQ_F_FLUSHED);
+        mcreq_pipeline_remove(pl, pw->pkt->opaque);
+        mcreq_packet_handled(pl, pw->pkt);
+    }
+    pl->metrics = nullptr;
+}
+
+TEST_F(McFlush, testInflightAccounting)
+{
+    CQWrap cq;
+    PacketWrap pws[2];
+    const char *keys[] = {"1234", "5678"};
+    uint64_t nbytes;
+    uint32_t nops;
+
+    for (unsigned ii = 0; ii < 2; ii++) {
+        pws[ii].setContigKey(keys[ii]);
+        ASSERT_TRUE(pws[ii].reservePacket(&cq));
+        pws[ii].setHeaderSize();
+        pws[ii].copyHeader();
+        mcreq_enqueue_packet(pws[ii].pipeline, pws[ii].pkt);
+        ASSERT_NE(0, pws[ii].pipeline->inflight_ops);
+    }
+    mcreq_queue_inflight(&cq, &nbytes, &nops);
+    ASSERT_EQ(56, nbytes);
+    ASSERT_EQ(2, nops);
+
+    for (auto &pw : pws) {
+        nb_IOV iovs[10];
+        unsigned toFlush = mcreq_flush_iov_fill(pw.pipeline, iovs, 10, nullptr);
+        mcreq_flush_done(pw.pipeline, toFlush, toFlush);
+    }
+    for (unsigned ii = 0; ii < 2; ii++) {
+        ASSERT_EQ(pws[ii].pkt, mcreq_pipeline_remove(pws[ii].pipeline, pws[ii].pkt->opaque));
+        mcreq_packet_handled(pws[ii].pipeline, pws[ii].pkt);
+        mcreq_queue_inflight(&cq, &nbytes, &nops);
+        ASSERT_EQ(28 * (1 - ii), nbytes);
+        ASSERT_EQ(1 - ii, nops);
+    }
+}
+
+TEST_F(McFlush, testRemoveOutOfOrder)
+{
+    CQWrap cq;
+    const unsigned npkts = 300;
+    PacketWrap pws[npkts];
+    uint32_t opaques[npkts];
+
+    for (unsigned ii = 0; ii < npkts; ii++) {
+        pws[ii].setContigKey(std::to_string(ii).c_str());
+        ASSERT_TRUE(pws[ii].reservePacket(&cq));
+        pws[ii].setHeaderSize();
+        pws[ii].copyHeader();
+        mcreq_enqueue_packet(pws[ii].pipeline, pws[ii].pkt);
+        opaques[ii] = pws[ii].pkt->opaque;
+    }
+    for (unsigned ii = 0; ii < cq.npipelines; ii++) {
+        nb_IOV iovs[64];
+        unsigned toFlush;
+        while ((toFlush = mcreq_flush_iov_fill(cq.pipelines[ii], iovs, 64, nullptr)) != 0) {
+            mcreq_flush_done(cq.pipelines[ii], toFlush, toFlush);
+        }
+    }
+
+    // Every other packet, leaving holes in the list and in the index
+    for (unsigned ii = 0; ii < npkts; ii++) {
+        if (ii % 2) {
+            ASSERT_EQ(pws[ii].pkt, mcreq_pipeline_remove(pws[ii].pipeline, pws[ii].pkt->opaque));
+            mcreq_packet_handled(pws[ii].pipeline, pws[ii].pkt);
+        }
+    }
+    for (unsigned ii = 0; ii < npkts; ii++) {
+        ASSERT_EQ(ii % 2 ? nullptr : pws[ii].pkt, mcreq_pipeline_find(pws[ii].pipeline, opaques[ii]));
+    }
+    // The others are still linked in the order they were enqueued
+    for (unsigned ii = 0; ii < cq.npipelines; ii++) {
+        sllist_node *ll;
+        uint32_t last = 0;
+        SLLIST_ITERBASIC(&cq.pipelines[ii]->requests, ll)
+        {
+            mc_PACKET *pkt = SLLIST_ITEM(ll, mc_PACKET, slnode);
+            ASSERT_LT(last, pkt->opaque);
+            last = pkt->opaque;
+        }
+    }
+
+    for (unsigned ii = 0; ii < npkts; ii += 2) {
+        ASSERT_EQ(pws[ii].pkt, mcreq_pipeline_remove(pws[ii].pipeline, pws[ii].pkt->opaque));
+        mcreq_packet_handled(pws[ii].pipeline, pws[ii].pkt);
+    }
+    for (unsigned ii = 0; ii < cq.npipelines; ii++) {
+        ASSERT_TRUE(SLLIST_IS_EMPTY(&cq.pipelines[ii]->requests));
+        ASSERT_EQ(0, cq.pipelines[ii]->inflight_ops);
+    }
+}
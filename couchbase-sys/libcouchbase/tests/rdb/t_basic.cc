@@ -114,6 +114,33 @@ TEST_F(RopeTest, testConsolidatedReadAhead)
     ASSERT_EQ(*(char *)iovs[2].iov_base, '8');
 }
 
+TEST_F(RopeTest, testReservedReadAhead)
+{
+    IORope ior(rdb_chunkalloc_new(16));
+    ior.rdsize = 16;
+
+    std::string hdr(24, 'h'), body(1000, 'b');
+    ior.feed(hdr + body.substr(0, 40));
+    ASSERT_LT(1, rdb_get_contigsize(&ior));
+    ASSERT_GT(64, rdb_get_contigsize(&ior));
+
+    // Everything received so far is moved, the rest is read right behind it
+    rdb_rdreserve(&ior, hdr.size() + body.size());
+    ASSERT_EQ(64, rdb_get_contigsize(&ior));
+    rdb_ROPESEG *seg = rdb_get_first_segment(&ior);
+    ior.feed(body.substr(40));
+
+    ASSERT_EQ(hdr.size() + body.size(), rdb_get_contigsize(&ior));
+    ASSERT_EQ(seg, rdb_get_first_segment(&ior));
+    ASSERT_EQ(hdr + body, std::string(rdb_get_consolidated(&ior, hdr.size() + body.size()), hdr.size() + body.size()));
+
+    // Nothing to do once complete
+    rdb_rdreserve(&ior, hdr.size() + body.size());
+    ASSERT_EQ(seg, rdb_get_first_segment(&ior));
+    rdb_consumed(&ior, hdr.size() + body.size());
+    ASSERT_EQ(0, rdb_get_nused(&ior));
+}
+
 // When I was integrating this into LCBIO, I realized this scenario. Trying to
 // figure out what the intended outcome is.
 // Apparently this cannot work because we can't consume a buffer which is also
@@ -0,0 +1,117 @@
+#include "rdbtest.h"
+#include <rdb/poolalloc.h>
+class PoolallocTest : public ::testing::Test
+{
+};
+
+TEST_F(PoolallocTest, testSizeClasses)
+{
+    RdbAllocator a(rdb_poolalloc_new(1024 * 1024));
+    rdb_POOLALLOC *pa = (rdb_POOLALLOC *)a._inner;
+
+    rdb_ROPESEG *seg = a.alloc(1);
+    ASSERT_EQ(RDB_POOLALLOC_MINSIZE, seg->nalloc);
+    a.free(seg);
+
+    seg = a.alloc(RDB_POOLALLOC_MINSIZE + 1);
+    ASSERT_EQ(RDB_POOLALLOC_MINSIZE * 2, seg->nalloc);
+    seg = a.realloc(seg, RDB_POOLALLOC_MINSIZE * 3);
+    ASSERT_EQ(RDB_POOLALLOC_MINSIZE * 4, seg->nalloc);
+    a.free(seg);
+
+    seg = a.alloc(RDB_POOLALLOC_MAXSIZE + 1);
+    ASSERT_EQ(RDB_POOLALLOC_MAXSIZE + 1, seg->nalloc);
+    a.free(seg);
+    ASSERT_EQ(1, pa->total_toobig);
+    ASSERT_EQ(RDB_POOLALLOC_MINSIZE * 5, pa->retained);
+
+    rdb_poolalloc_dump(pa, stdout);
+    a.release();
+}
+
+TEST_F(PoolallocTest, testSharedReuse)
+{
+    rdb_ALLOCATOR *pool = rdb_poolalloc_new(1024 * 1024);
+    rdb_POOLALLOC *pa = (rdb_POOLALLOC *)pool;
+    RdbAllocator a(rdb_poolalloc_ref(pool));
+    RdbAllocator b(rdb_poolalloc_ref(pool));
+
+    rdb_ROPESEG *seg = a.alloc(4000);
+    a.free(seg);
+    a.release();
+
+    // Released by one user, reused by another
+    rdb_ROPESEG *newseg = b.alloc(3000);
+    ASSERT_EQ(seg, newseg);
+    ASSERT_EQ(1, pa->total_reused);
+    ASSERT_EQ(0, pa->retained);
+
+    // Outlives all users and the owner
+    pool->a_release(pool);
+    b.release();
+    ASSERT_EQ(newseg->allocator, pool);
+    b.free(newseg);
+}
+
+TEST_F(PoolallocTest, testRetainedCap)
+{
+    RdbAllocator a(rdb_poolalloc_new(RDB_POOLALLOC_MINSIZE * 4));
+    rdb_POOLALLOC *pa = (rdb_POOLALLOC *)a._inner;
+    std::vector< rdb_ROPESEG * > segs;
+
+    for (unsigned ii = 0; ii < 8; ii++) {
+        segs.push_back(a.alloc(RDB_POOLALLOC_MINSIZE));
+    }
+    for (unsigned ii = 0; ii < segs.size(); ii++) {
+        a.free(segs[ii]);
+    }
+
+    ASSERT_EQ(RDB_POOLALLOC_MINSIZE * 4, pa->retained);
+    ASSERT_EQ(4, LCB_CLIST_SIZE(&pa->bufs[0]));
+    ASSERT_EQ(4, pa->total_discarded);
+    a.release();
+}
+
+TEST_F(PoolallocTest, testRope)
+{
+    rdb_ALLOCATOR *pool = rdb_poolalloc_new(1024 * 1024);
+    {
+        IORope ior(rdb_poolalloc_ref(pool));
+        std::string s(1000, '*');
+        rdb_copywrite(&ior, (void *)s.c_str(), s.size());
+        ASSERT_EQ(s, ior.stlstr(s.size()));
+        rdb_consumed(&ior, s.size());
+    }
+    ASSERT_NE(0, ((rdb_POOLALLOC *)pool)->retained);
+    pool->a_release(pool);
+}
+
+TEST_F(PoolallocTest, testTrim)
+{
+    RdbAllocator a(rdb_poolalloc_new(1024 * 1024));
+    rdb_POOLALLOC *pa = (rdb_POOLALLOC *)a._inner;
+    std::vector< rdb_ROPESEG * > segs;
+
+    for (unsigned ii = 0; ii < 4; ii++) {
+        segs.push_back(a.alloc(RDB_POOLALLOC_MINSIZE));
+    }
+    segs.push_back(a.alloc(RDB_POOLALLOC_MINSIZE * 4));
+    for (unsigned ii = 0; ii < segs.size(); ii++) {
+        a.free(segs[ii]);
+    }
+    ASSERT_EQ(RDB_POOLALLOC_MINSIZE * 8, pa->retained);
+
+    // Segments were handed out since the previous trim
+    ASSERT_EQ(0, rdb_trim(a._inner, 0));
+    ASSERT_EQ(RDB_POOLALLOC_MINSIZE * 8, pa->retained);
+
+    // The largest segments are freed first
+    ASSERT_EQ(RDB_POOLALLOC_MINSIZE * 4, rdb_trim(a._inner, RDB_POOLALLOC_MINSIZE * 4));
+    ASSERT_EQ(4, LCB_CLIST_SIZE(&pa->bufs[0]));
+    ASSERT_EQ(0, LCB_CLIST_SIZE(&pa->bufs[2]));
+
+    ASSERT_EQ(RDB_POOLALLOC_MINSIZE * 3, rdb_trim(a._inner, RDB_POOLALLOC_MINSIZE));
+    ASSERT_EQ(RDB_POOLALLOC_MINSIZE, pa->retained);
+    ASSERT_EQ(RDB_POOLALLOC_MINSIZE * 7, pa->total_trimmed);
+    a.release();
+}
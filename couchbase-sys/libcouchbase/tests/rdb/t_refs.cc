@@ -111,3 +111,24 @@ TEST_F(RefTest, testRefConsolidate)
     rp3.unrefSegment(0);
     delete ior;
 }
+
+TEST_F(RefTest, testSegContains)
+{
+    IORope *ior = new IORope(rdb_chunkalloc_new(8));
+    ior->feed("12345678");
+
+    nb_IOV iovs[4];
+    rdb_ROPESEG *segs[4];
+    unsigned nseg = rdb_refread_ex(ior, iovs, segs, 4, 8);
+    ASSERT_EQ(1, nseg);
+
+    const char *base = (const char *)iovs[0].iov_base;
+    ASSERT_TRUE(rdb_seg_contains(segs[0], base, 8));
+    ASSERT_TRUE(rdb_seg_contains(segs[0], base + 2, 4));
+    ASSERT_TRUE(rdb_seg_contains(segs[0], base + 8, 0));
+    ASSERT_FALSE(rdb_seg_contains(segs[0], base + 4, 8));
+
+    char other[8];
+    ASSERT_FALSE(rdb_seg_contains(segs[0], other, sizeof(other)));
+    delete ior;
+}
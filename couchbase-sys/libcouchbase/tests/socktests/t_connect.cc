@@ -0,0 +1,131 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "socktest.h"
+#include <hostlist.h>
+using namespace LCBTest;
+
+#ifndef _WIN32
+#include <fcntl.h>
+
+/**
+ * A listener which never accepts, and whose queue is full: the connections to
+ * it stay pending until they time out.
+ */
+class Blackhole
+{
+  public:
+    Blackhole()
+    {
+        sockaddr_in addr{};
+        socklen_t len = sizeof(addr);
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        lfd = socket(AF_INET, SOCK_STREAM, 0);
+        bind(lfd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+        listen(lfd, 0);
+        getsockname(lfd, reinterpret_cast<sockaddr *>(&addr), &len);
+        port = ntohs(addr.sin_port);
+
+        for (int &fd : fillers) {
+            fd = socket(AF_INET, SOCK_STREAM, 0);
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+            connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+        }
+    }
+
+    ~Blackhole()
+    {
+        for (int fd : fillers) {
+            close(fd);
+        }
+        close(lfd);
+    }
+
+    int lfd;
+    int fillers[4]{};
+    int port{0};
+};
+
+struct RaceResult {
+    Loop *loop;
+    lcbio_SOCKET *sock{nullptr};
+    lcb_STATUS err{LCB_ERR_GENERIC};
+    int ncalls{0};
+};
+
+extern "C" {
+static void race_callback(lcbio_SOCKET *sock, void *arg, lcb_STATUS err, lcbio_OSERR)
+{
+    auto *res = static_cast<RaceResult *>(arg);
+    res->ncalls++;
+    res->err = err;
+    if (sock != nullptr) {
+        lcbio_ref(sock);
+        res->sock = sock;
+    }
+    res->loop->stop();
+}
+}
+
+class SockConnectTest : public SockTest
+{
+  protected:
+    /** Connects to a list of the blackhole followed by the test server */
+    RaceResult race(uint32_t delay, unsigned mstmo)
+    {
+        Blackhole blackhole;
+        lcb::Hostlist hosts;
+        lcb_host_t host = {"127.0.0.1", "", 0};
+        strcpy(host.port, std::to_string(blackhole.port).c_str());
+        hosts.add(host);
+        loop->populateHost(&host);
+        hosts.add(host);
+
+        loop->settings->connect_attempt_delay = delay;
+        RaceResult res;
+        res.loop = loop;
+        hrtime_t begin = gethrtime();
+        lcbio_connect_hl(loop->iot, loop->settings, &hosts, 1, LCB_MS2US(mstmo), race_callback, &res);
+        loop->start();
+        elapsed = LCB_NS2US(gethrtime() - begin);
+        return res;
+    }
+
+    hrtime_t elapsed{0};
+};
+
+TEST_F(SockConnectTest, testRaceHosts)
+{
+    RaceResult res = race(LCB_MS2US(20), 5000);
+    ASSERT_EQ(1, res.ncalls);
+    ASSERT_EQ(LCB_SUCCESS, res.err);
+    ASSERT_FALSE(res.sock == nullptr);
+    ASSERT_EQ(loop->server->getPortString(), res.sock->info->ep_remote.port);
+    ASSERT_LT(elapsed, LCB_MS2US(2000));
+    lcbio_unref(res.sock);
+}
+
+TEST_F(SockConnectTest, testSequential)
+{
+    /* without the race, only the first host is tried */
+    RaceResult res = race(0, 200);
+    ASSERT_EQ(1, res.ncalls);
+    ASSERT_EQ(LCB_ERR_TIMEOUT, res.err);
+    ASSERT_TRUE(res.sock == nullptr);
+}
+#endif
@@ -0,0 +1,472 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "socktest.h"
+#include <ioserver/kvserver.h>
+#include <cstdio>
+#include <vector>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+using namespace LCBTest;
+using std::string;
+
+struct KVResult {
+    lcb_STATUS rc{LCB_ERR_GENERIC};
+    string value;
+    uint64_t cas{0};
+    size_t nfields{0};
+    lcb_STATUS field_rc[4]{};
+    string field_value[4];
+};
+
+extern "C" {
+static void kv_callback(lcb_INSTANCE *, int cbtype, const lcb_RESPBASE *rb)
+{
+    KVResult *res = nullptr;
+    const char *value = nullptr;
+    size_t nvalue = 0;
+    switch (cbtype) {
+        case LCB_CALLBACK_GET: {
+            const auto *resp = reinterpret_cast<const lcb_RESPGET *>(rb);
+            lcb_respget_cookie(resp, reinterpret_cast<void **>(&res));
+            res->rc = lcb_respget_status(resp);
+            lcb_respget_value(resp, &value, &nvalue);
+            lcb_respget_cas(resp, &res->cas);
+            break;
+        }
+        case LCB_CALLBACK_STORE: {
+            const auto *resp = reinterpret_cast<const lcb_RESPSTORE *>(rb);
+            lcb_respstore_cookie(resp, reinterpret_cast<void **>(&res));
+            res->rc = lcb_respstore_status(resp);
+            lcb_respstore_cas(resp, &res->cas);
+            break;
+        }
+        case LCB_CALLBACK_REMOVE: {
+            const auto *resp = reinterpret_cast<const lcb_RESPREMOVE *>(rb);
+            lcb_respremove_cookie(resp, reinterpret_cast<void **>(&res));
+            res->rc = lcb_respremove_status(resp);
+            break;
+        }
+        case LCB_CALLBACK_SDLOOKUP:
+        case LCB_CALLBACK_SDMUTATE: {
+            const auto *resp = reinterpret_cast<const lcb_RESPSUBDOC *>(rb);
+            lcb_respsubdoc_cookie(resp, reinterpret_cast<void **>(&res));
+            res->rc = lcb_respsubdoc_status(resp);
+            res->nfields = lcb_respsubdoc_result_size(resp);
+            for (size_t ii = 0; ii < res->nfields && ii < 4; ii++) {
+                res->field_rc[ii] = lcb_respsubdoc_result_status(resp, ii);
+                lcb_respsubdoc_result_value(resp, ii, &value, &nvalue);
+                res->field_value[ii].assign(value == nullptr ? "" : value, nvalue);
+            }
+            {
+                /* The single pass decoder agrees with the per-spec accessors */
+                lcb_SUBDOC_RESULT results[4];
+                const char *body = nullptr;
+                size_t nresults = lcb_respsubdoc_results(resp, results, 4, &body);
+                EXPECT_EQ(std::min<size_t>(res->nfields, 4), nresults);
+                for (size_t ii = 0; ii < nresults; ii++) {
+                    EXPECT_EQ(res->field_rc[ii], results[ii].status);
+                    EXPECT_EQ(res->field_value[ii], string(body + results[ii].offset, results[ii].length));
+                }
+            }
+            return;
+        }
+        default:
+            return;
+    }
+    if (value != nullptr) {
+        res->value.assign(value, nvalue);
+    }
+}
+}
+
+class KVServerTest : public ::testing::Test
+{
+  protected:
+    lcb_STATUS bootstrap(KVServer &server, const string &params = "")
+    {
+        lcb_CREATEOPTS *options = nullptr;
+        string connstr = server.connstr() + params;
+        lcb_createopts_create(&options, LCB_TYPE_BUCKET);
+        lcb_createopts_connstr(options, connstr.c_str(), connstr.size());
+        EXPECT_EQ(LCB_SUCCESS, lcb_create(&instance, options));
+        lcb_createopts_destroy(options);
+        EXPECT_EQ(LCB_SUCCESS, lcb_connect(instance));
+        lcb_wait(instance, LCB_WAIT_DEFAULT);
+        return lcb_get_bootstrap_status(instance);
+    }
+
+    void connect(KVServer &server, const string &params = "")
+    {
+        ASSERT_EQ(LCB_SUCCESS, bootstrap(server, params));
+        lcb_install_callback(instance, LCB_CALLBACK_GET, kv_callback);
+        lcb_install_callback(instance, LCB_CALLBACK_STORE, kv_callback);
+        lcb_install_callback(instance, LCB_CALLBACK_REMOVE, kv_callback);
+        lcb_install_callback(instance, LCB_CALLBACK_SDLOOKUP, kv_callback);
+        lcb_install_callback(instance, LCB_CALLBACK_SDMUTATE, kv_callback);
+    }
+
+    void TearDown() override
+    {
+        if (instance != nullptr) {
+            lcb_destroy(instance);
+        }
+    }
+
+    KVResult store(const string &key, const string &value, lcb_STORE_OPERATION op = LCB_STORE_UPSERT,
+                   uint64_t cas = 0)
+    {
+        KVResult res;
+        lcb_CMDSTORE *cmd = nullptr;
+        lcb_cmdstore_create(&cmd, op);
+        lcb_cmdstore_key(cmd, key.c_str(), key.size());
+        lcb_cmdstore_value(cmd, value.c_str(), value.size());
+        lcb_cmdstore_cas(cmd, cas);
+        EXPECT_EQ(LCB_SUCCESS, lcb_store(instance, &res, cmd));
+        lcb_cmdstore_destroy(cmd);
+        lcb_wait(instance, LCB_WAIT_DEFAULT);
+        return res;
+    }
+
+    KVResult get(const string &key)
+    {
+        KVResult res;
+        lcb_CMDGET *cmd = nullptr;
+        lcb_cmdget_create(&cmd);
+        lcb_cmdget_key(cmd, key.c_str(), key.size());
+        EXPECT_EQ(LCB_SUCCESS, lcb_get(instance, &res, cmd));
+        lcb_cmdget_destroy(cmd);
+        lcb_wait(instance, LCB_WAIT_DEFAULT);
+        return res;
+    }
+
+    KVResult remove(const string &key)
+    {
+        KVResult res;
+        lcb_CMDREMOVE *cmd = nullptr;
+        lcb_cmdremove_create(&cmd);
+        lcb_cmdremove_key(cmd, key.c_str(), key.size());
+        EXPECT_EQ(LCB_SUCCESS, lcb_remove(instance, &res, cmd));
+        lcb_cmdremove_destroy(cmd);
+        lcb_wait(instance, LCB_WAIT_DEFAULT);
+        return res;
+    }
+
+    KVResult subdoc(const string &key, lcb_SUBDOCSPECS *specs)
+    {
+        KVResult res;
+        lcb_CMDSUBDOC *cmd = nullptr;
+        lcb_cmdsubdoc_create(&cmd);
+        lcb_cmdsubdoc_key(cmd, key.c_str(), key.size());
+        lcb_cmdsubdoc_specs(cmd, specs);
+        EXPECT_EQ(LCB_SUCCESS, lcb_subdoc(instance, &res, cmd));
+        lcb_cmdsubdoc_destroy(cmd);
+        lcb_subdocspecs_destroy(specs);
+        lcb_wait(instance, LCB_WAIT_DEFAULT);
+        return res;
+    }
+
+    lcb_INSTANCE *instance{nullptr};
+};
+
+TEST_F(KVServerTest, testBasic)
+{
+    KVServer server;
+    connect(server);
+
+    ASSERT_EQ(LCB_ERR_DOCUMENT_NOT_FOUND, get("key").rc);
+    KVResult stored = store("key", "value");
+    ASSERT_EQ(LCB_SUCCESS, stored.rc);
+    ASSERT_NE(0, stored.cas);
+
+    KVResult res = get("key");
+    ASSERT_EQ(LCB_SUCCESS, res.rc);
+    ASSERT_EQ("value", res.value);
+    ASSERT_EQ(stored.cas, res.cas);
+
+    ASSERT_EQ(LCB_ERR_DOCUMENT_EXISTS, store("key", "other", LCB_STORE_INSERT).rc);
+    ASSERT_EQ(LCB_ERR_CAS_MISMATCH, store("key", "other", LCB_STORE_REPLACE, stored.cas + 1000).rc);
+    ASSERT_EQ(LCB_SUCCESS, store("key", "other", LCB_STORE_REPLACE, stored.cas).rc);
+    ASSERT_EQ("other", get("key").value);
+
+    ASSERT_EQ(LCB_SUCCESS, remove("key").rc);
+    ASSERT_EQ(LCB_ERR_DOCUMENT_NOT_FOUND, remove("key").rc);
+    ASSERT_EQ(LCB_ERR_DOCUMENT_NOT_FOUND, store("key", "value", LCB_STORE_REPLACE).rc);
+
+    KVServer::Stats stats = server.stats();
+    ASSERT_EQ(1, stats.connections);
+    ASSERT_LT(0, stats.bytes_in);
+    ASSERT_LT(0, stats.bytes_out);
+}
+
+TEST_F(KVServerTest, testSubdoc)
+{
+    KVServer server;
+    connect(server);
+    ASSERT_EQ(LCB_SUCCESS, store("doc", R"({"name":"lcb","tags":["a","b"],"nested":{"n":1}})").rc);
+
+    lcb_SUBDOCSPECS *specs = nullptr;
+    lcb_subdocspecs_create(&specs, 4);
+    lcb_subdocspecs_get(specs, 0, 0, "name", 4);
+    lcb_subdocspecs_get(specs, 1, 0, "nested.n", 8);
+    lcb_subdocspecs_get_count(specs, 2, 0, "tags", 4);
+    lcb_subdocspecs_exists(specs, 3, 0, "missing", 7);
+    KVResult res = subdoc("doc", specs);
+    ASSERT_EQ(LCB_SUCCESS, res.rc);
+    ASSERT_EQ(4, res.nfields);
+    ASSERT_EQ("\"lcb\"", res.field_value[0]);
+    ASSERT_EQ("1", res.field_value[1]);
+    ASSERT_EQ("2", res.field_value[2]);
+    ASSERT_EQ(LCB_ERR_SUBDOC_PATH_NOT_FOUND, res.field_rc[3]);
+
+    lcb_subdocspecs_create(&specs, 2);
+    lcb_subdocspecs_dict_upsert(specs, 0, 0, "nested.n", 8, "2", 1);
+    lcb_subdocspecs_remove(specs, 1, 0, "name", 4);
+    ASSERT_EQ(LCB_SUCCESS, subdoc("doc", specs).rc);
+    ASSERT_EQ(R"({"nested":{"n":2},"tags":["a","b"]})", get("doc").value);
+
+    lcb_subdocspecs_create(&specs, 1);
+    lcb_subdocspecs_dict_add(specs, 0, 0, "tags", 4, "[]", 2);
+    res = subdoc("doc", specs);
+    ASSERT_EQ(LCB_ERR_SUBDOC_PATH_EXISTS, res.field_rc[0]);
+}
+
+TEST_F(KVServerTest, testErrorInjection)
+{
+    KVServer::Options options;
+    options.tmpfail_ratio = 0.5;
+    KVServer server(options);
+    connect(server);
+
+    /* every second data command fails and is retried, so of the 39 commands sent 19 fail */
+    for (int ii = 0; ii < 10; ii++) {
+        string key = "key" + std::to_string(ii);
+        ASSERT_EQ(LCB_SUCCESS, store(key, "value").rc);
+        ASSERT_EQ("value", get(key).value);
+    }
+    ASSERT_EQ(19, server.stats().tmpfail);
+}
+
+TEST_F(KVServerTest, testSaslPipelined)
+{
+    KVServer::Options options;
+    options.sasl_mechs = "PLAIN";
+    KVServer server(options);
+
+    /* the forced mechanism is sent along with SASL_LIST_MECHS, and SELECT_BUCKET right after it */
+    connect(server, "&sasl_mech_force=PLAIN");
+    ASSERT_EQ(LCB_SUCCESS, store("key", "value").rc);
+    ASSERT_EQ("value", get("key").value);
+
+    KVServer::Stats stats = server.stats();
+    ASSERT_LE(1, stats.auth_ok);
+    ASSERT_EQ(0, stats.auth_failed);
+}
+
+TEST_F(KVServerTest, testSaslMechUnavailable)
+{
+    KVServer::Options options;
+    options.sasl_mechs = "SCRAM-SHA512";
+    KVServer server(options);
+
+    /* the early SASL_AUTH is refused, and the server list does not have the mechanism */
+    ASSERT_NE(LCB_SUCCESS, bootstrap(server, "&sasl_mech_force=PLAIN"));
+    KVServer::Stats stats = server.stats();
+    ASSERT_EQ(0, stats.auth_ok);
+    ASSERT_LE(1, stats.auth_failed);
+}
+
+TEST_F(KVServerTest, testConnectionsPerNode)
+{
+    KVServer server;
+    connect(server, "&kv_connections_per_node=4");
+
+    /* operations on the same key keep their order, whichever connection carries them */
+    const int nkeys = 64;
+    std::vector<KVResult> first(nkeys), second(nkeys), fetched(nkeys);
+    lcb_sched_enter(instance);
+    for (int ii = 0; ii < nkeys; ii++) {
+        string key = "key_" + std::to_string(ii);
+        string value = "value_" + std::to_string(ii);
+        lcb_CMDSTORE *scmd = nullptr;
+        lcb_cmdstore_create(&scmd, LCB_STORE_UPSERT);
+        lcb_cmdstore_key(scmd, key.c_str(), key.size());
+        lcb_cmdstore_value(scmd, "old", 3);
+        ASSERT_EQ(LCB_SUCCESS, lcb_store(instance, &first[ii], scmd));
+        lcb_cmdstore_value(scmd, value.c_str(), value.size());
+        ASSERT_EQ(LCB_SUCCESS, lcb_store(instance, &second[ii], scmd));
+        lcb_cmdstore_destroy(scmd);
+
+        lcb_CMDGET *gcmd = nullptr;
+        lcb_cmdget_create(&gcmd);
+        lcb_cmdget_key(gcmd, key.c_str(), key.size());
+        ASSERT_EQ(LCB_SUCCESS, lcb_get(instance, &fetched[ii], gcmd));
+        lcb_cmdget_destroy(gcmd);
+    }
+    lcb_sched_leave(instance);
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+
+    for (int ii = 0; ii < nkeys; ii++) {
+        ASSERT_EQ(LCB_SUCCESS, first[ii].rc);
+        ASSERT_EQ(LCB_SUCCESS, second[ii].rc);
+        ASSERT_LT(first[ii].cas, second[ii].cas);
+        ASSERT_EQ(LCB_SUCCESS, fetched[ii].rc);
+        ASSERT_EQ("value_" + std::to_string(ii), fetched[ii].value);
+    }
+    ASSERT_EQ(4, server.stats().connections);
+}
+
+TEST_F(KVServerTest, testCoalescedUpsert)
+{
+    KVServer server;
+    connect(server, "&write_coalesce_window=20ms");
+
+    /* lcb_wait() waits for the upserts held back for the window, and each of them is answered */
+    string values[] = {"first", "second", "last"};
+    KVResult results[4];
+    uint64_t ncommands = server.stats().commands;
+    lcb_CMDSTORE *cmd = nullptr;
+    lcb_cmdstore_create(&cmd, LCB_STORE_UPSERT);
+    lcb_cmdstore_key(cmd, "key", 3);
+    ASSERT_EQ(LCB_SUCCESS, lcb_cmdstore_coalesce(cmd, 1));
+    for (size_t ii = 0; ii < 3; ii++) {
+        lcb_cmdstore_value(cmd, values[ii].c_str(), values[ii].size());
+        ASSERT_EQ(LCB_SUCCESS, lcb_store(instance, &results[ii], cmd));
+    }
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+    ASSERT_EQ(ncommands + 1, server.stats().commands);
+    for (size_t ii = 0; ii < 3; ii++) {
+        ASSERT_EQ(LCB_SUCCESS, results[ii].rc);
+        ASSERT_NE(0, results[ii].cas);
+        ASSERT_EQ(results[2].cas, results[ii].cas);
+    }
+    ASSERT_EQ("last", get("key").value);
+
+    /* an upsert with other flags sends the held one first */
+    results[0] = results[1] = KVResult();
+    lcb_cmdstore_value(cmd, "value", 5);
+    ASSERT_EQ(LCB_SUCCESS, lcb_store(instance, &results[0], cmd));
+    lcb_cmdstore_flags(cmd, 1);
+    lcb_cmdstore_value(cmd, "flagged", 7);
+    ASSERT_EQ(LCB_SUCCESS, lcb_store(instance, &results[1], cmd));
+    lcb_cmdstore_destroy(cmd);
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+    ASSERT_EQ(LCB_SUCCESS, results[0].rc);
+    ASSERT_EQ(LCB_SUCCESS, results[1].rc);
+    ASSERT_LT(results[0].cas, results[1].cas);
+    ASSERT_EQ("flagged", get("key").value);
+}
+
+struct StreamedValue {
+    unsigned chunks{0};
+    string value;
+};
+
+extern "C" {
+static void value_sink_callback(lcb_INSTANCE *instance, void *, const char *chunk, size_t nchunk)
+{
+    auto *streamed = reinterpret_cast<StreamedValue *>(const_cast<void *>(lcb_get_cookie(instance)));
+    streamed->chunks++;
+    streamed->value.append(chunk, nchunk);
+}
+}
+
+TEST_F(KVServerTest, testStreamedGet)
+{
+    KVServer server;
+    /* bound the reads, so that the value is not read whole at once from the loopback */
+    connect(server, "&read_chunk_size=65536");
+    StreamedValue streamed;
+    lcb_set_cookie(instance, &streamed);
+    ASSERT_EQ(nullptr, lcb_set_value_sink_callback(instance, value_sink_callback));
+
+    string large(8 * 1024 * 1024, 'v');
+    for (size_t ii = 0; ii < large.size(); ii += 1000) {
+        large[ii] = static_cast<char>('a' + ii % 26);
+    }
+    ASSERT_EQ(LCB_SUCCESS, store("large", large).rc);
+    ASSERT_EQ(LCB_SUCCESS, store("small", "value").rc);
+
+    /* the reply right behind the streamed value is read as usual */
+    KVResult res[3];
+    lcb_CMDGET *cmd = nullptr;
+    lcb_cmdget_create(&cmd);
+    lcb_cmdget_stream_value(cmd, 1);
+    lcb_sched_enter(instance);
+    lcb_cmdget_key(cmd, "large", 5);
+    ASSERT_EQ(LCB_SUCCESS, lcb_get(instance, &res[0], cmd));
+    lcb_cmdget_stream_value(cmd, 0);
+    lcb_cmdget_key(cmd, "small", 5);
+    ASSERT_EQ(LCB_SUCCESS, lcb_get(instance, &res[1], cmd));
+    lcb_sched_leave(instance);
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+
+    ASSERT_EQ(LCB_SUCCESS, res[0].rc);
+    ASSERT_EQ("", res[0].value);
+    ASSERT_LT(1U, streamed.chunks);
+    ASSERT_EQ(large, streamed.value);
+    ASSERT_EQ(LCB_SUCCESS, res[1].rc);
+    ASSERT_EQ("value", res[1].value);
+
+    /* a value read whole is passed to the sink as well */
+    streamed = StreamedValue();
+    lcb_cmdget_stream_value(cmd, 1);
+    ASSERT_EQ(LCB_SUCCESS, lcb_get(instance, &res[2], cmd));
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+    lcb_cmdget_destroy(cmd);
+    ASSERT_EQ(LCB_SUCCESS, res[2].rc);
+    ASSERT_EQ("", res[2].value);
+    ASSERT_EQ(1U, streamed.chunks);
+    ASSERT_EQ("value", streamed.value);
+}
+
+#ifndef _WIN32
+TEST_F(KVServerTest, testStoreFromFile)
+{
+    KVServer server;
+    connect(server);
+
+    char path[] = "/tmp/lcb-value-XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_NE(-1, fd);
+    unlink(path);
+    string contents(3 * 1024 * 1024, 'f');
+    for (size_t ii = 0; ii < contents.size(); ii += 777) {
+        contents[ii] = static_cast<char>('a' + ii % 26);
+    }
+    ASSERT_EQ(ssize_t(contents.size()), write(fd, contents.data(), contents.size()));
+
+    /* a region which does not start on a page boundary */
+    const size_t offset = 5000, length = 2 * 1024 * 1024 + 3;
+    lcb_CMDSTORE *cmd = nullptr;
+    lcb_cmdstore_create(&cmd, LCB_STORE_UPSERT);
+    lcb_cmdstore_key(cmd, "file", 4);
+    ASSERT_EQ(LCB_ERR_INVALID_ARGUMENT, lcb_cmdstore_value_file(cmd, fd, offset, contents.size()));
+    ASSERT_EQ(LCB_ERR_INVALID_ARGUMENT, lcb_cmdstore_value_file(cmd, fd, offset, 0));
+    ASSERT_EQ(LCB_SUCCESS, lcb_cmdstore_value_file(cmd, fd, offset, length));
+    /* the mapping does not need the descriptor */
+    close(fd);
+
+    KVResult res;
+    ASSERT_EQ(LCB_SUCCESS, lcb_store(instance, &res, cmd));
+    lcb_cmdstore_destroy(cmd);
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+    ASSERT_EQ(LCB_SUCCESS, res.rc);
+    ASSERT_EQ(contents.substr(offset, length), get("file").value);
+}
+#endif
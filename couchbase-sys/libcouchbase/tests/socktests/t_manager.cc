@@ -160,3 +160,70 @@ TEST_F(SockMgrTest, testMaxIdle)
         delete otherSocks[ii];
     }
 }
+
+struct StopTimer : Timer {
+    explicit StopTimer(Loop *l) : Timer(l->iot), loop(l) {}
+    void expired()
+    {
+        loop->stop();
+    }
+    Loop *loop;
+};
+
+TEST_F(SockMgrTest, testRefreshKept)
+{
+    lcb_host_t host = {0};
+    loop->populateHost(&host);
+    std::string key = std::string(host.host) + ":" + host.port;
+
+    loop->sockpool->get_options().tmoidle = LCB_MS2US(20);
+    loop->sockpool->get_options().tmrefresh = LCB_MS2US(50);
+    loop->sockpool->set_target(key, 1, LCB_MS2US(1000));
+
+    ESocket *sock1 = new ESocket();
+    loop->connectPooled(sock1);
+    lcb_U64 id1 = sock1->sock->id;
+    delete sock1;
+
+    // Let the surplus connection expire, and the kept connection go stale and be replaced
+    StopTimer stop(loop);
+    stop.schedule(200);
+    loop->start();
+
+    ESocket *sock2 = new ESocket();
+    loop->connectPooled(sock2);
+    ASSERT_NE(id1, sock2->sock->id);
+    delete sock2;
+
+    Json::Value node;
+    loop->sockpool->toJSON(0, node);
+    const Json::Value &stats = node["pools"][key];
+    ASSERT_LE(1, stats["refreshed"].asInt());
+    ASSERT_EQ(2, stats["lease_latency"]["total_count"].asInt());
+    loop->sockpool->clear_targets();
+}
+
+TEST_F(SockMgrTest, testTrim)
+{
+    lcb_host_t host = {0};
+    loop->populateHost(&host);
+    std::string key = std::string(host.host) + ":" + host.port;
+
+    ESocket *sock1 = new ESocket();
+    loop->connectPooled(sock1);
+    ESocket *sock2 = new ESocket();
+    loop->connectPooled(sock2);
+    delete sock1;
+    delete sock2;
+
+    // Connections were requested since the previous trim
+    ASSERT_EQ(0, loop->sockpool->trim());
+    ASSERT_EQ(2, loop->sockpool->trim());
+    ASSERT_EQ(0, loop->sockpool->trim());
+
+    Json::Value node;
+    loop->sockpool->toJSON(0, node);
+    const Json::Value &stats = node["pools"][key];
+    ASSERT_EQ(0, stats["idle"].asInt());
+    ASSERT_EQ(2, stats["trimmed"].asInt());
+}
@@ -195,6 +195,34 @@ TEST_F(SockPutexTest, testBasic)
     ASSERT_EQ(rf.getString(), expected);
 }
 
+TEST_F(SockPutexTest, testBatched)
+{
+    lcb_IOMETRICS metrics = {};
+    RecvFuture rf(100);
+    for (int ii = 0; ii < 100; ii++) {
+        buflist->append("@");
+    }
+
+    loop->settings->io_batch_writes = 1;
+    sock.ctx->sock->metrics = &metrics;
+    sock.conn->setRecv(&rf);
+    lcbio_ctx_wwant(sock.ctx);
+    sock.schedule();
+    MyBreakCondition mbc(buflist, &rf);
+    loop->setBreakCondition(&mbc);
+    loop->start();
+    rf.wait();
+    sock.ctx->sock->metrics = nullptr;
+    loop->settings->io_batch_writes = 0;
+
+    string expected(100, '@');
+    ASSERT_EQ(rf.getString(), expected);
+    ASSERT_EQ(100, metrics.bytes_sent);
+    ASSERT_LT(0, metrics.io_send_calls);
+    // Written without waiting for the socket to become writable
+    ASSERT_EQ(0, metrics.io_watch_calls);
+}
+
 TEST_F(SockPutexTest, testBig)
 {
     const size_t rchunk = 1000, niters = 1000, expected = rchunk * niters;
@@ -192,4 +192,60 @@ TEST_F(SockReadTest, testChunkedIter)
     ASSERT_EQ(toSend, string(cra.buffer.begin(), cra.buffer.end()));
     sf.wait();
 }
+
+lcb_SIZE histogram_total(const lcb_SIZE *histogram)
+{
+    lcb_SIZE total = 0;
+    for (unsigned ii = 0; ii < LCB_IOMETRICS_NBUCKETS; ii++) {
+        total += histogram[ii];
+    }
+    return total;
+}
+
+TEST_F(SockReadTest, testIoStatistics)
+{
+    ESocket sock;
+    loop->connect(&sock);
+    lcb_IOMETRICS metrics = {};
+    lcbio_set_metrics(sock.ctx->sock, &metrics);
+    lcb_STATUS rc = lcbio_kstats_enable(sock.ctx->sock);
+#ifdef __linux__
+    if (IOT_IS_EVENT(sock.ctx->io)) {
+        ASSERT_EQ(LCB_SUCCESS, rc);
+    }
+#endif
+
+    string request("ping");
+    RecvFuture rf(request.size());
+    sock.conn->setRecv(&rf);
+    sock.put(request);
+    sock.schedule();
+    FutureBreakCondition fbc(&rf);
+    loop->setBreakCondition(&fbc);
+    loop->start();
+    rf.wait();
+
+    string reply("pong!");
+    SendFuture sf(reply);
+    ReadBreakCondition rbc(&sock, reply.size());
+    sock.reqrd(reply.size());
+    sock.schedule();
+    sock.conn->setSend(&sf);
+    loop->setBreakCondition(&rbc);
+    loop->start();
+    sf.wait();
+    lcbio_set_metrics(sock.ctx->sock, nullptr);
+
+    // 4 and 5 bytes are in the bucket of the values of bit length 3
+    ASSERT_EQ(1, histogram_total(metrics.send_bytes));
+    ASSERT_EQ(1, metrics.send_bytes[3]);
+    ASSERT_EQ(histogram_total(metrics.recv_bytes), metrics.recv_bytes[3] + metrics.recv_bytes[1]);
+    ASSERT_LE(1, metrics.recv_bytes[3]);
+    if (rc == LCB_SUCCESS) {
+        ASSERT_LE(1, histogram_total(metrics.recv_calls_per_event));
+        ASSERT_EQ(1, histogram_total(metrics.send_queue_bytes));
+        ASSERT_LE(1, histogram_total(metrics.rx_kernel_us));
+        ASSERT_EQ(1, histogram_total(metrics.tx_kernel_us));
+    }
+}
 } // namespace
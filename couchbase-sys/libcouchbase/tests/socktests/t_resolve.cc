@@ -0,0 +1,173 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "socktest.h"
+#include <lcbio/resolve.h>
+using namespace LCBTest;
+using lcb::io::AddrList;
+using lcb::io::Resolver;
+
+struct Lookup {
+    Loop *loop{nullptr};
+    int ncalls{0};
+    int eai{-1};
+    std::shared_ptr<AddrList> addrs;
+    bool stop{true};
+};
+
+extern "C" {
+static void lookup_callback(void *arg, int eai, const std::shared_ptr<AddrList> &addrs)
+{
+    auto *lookup = static_cast<Lookup *>(arg);
+    lookup->ncalls++;
+    lookup->eai = eai;
+    lookup->addrs = addrs;
+    if (lookup->stop) {
+        lookup->loop->stop();
+    }
+}
+
+static void noop_wakeup(void *) {}
+}
+
+class SockResolveTest : public SockTest
+{
+  protected:
+    void SetUp() override
+    {
+        SockTest::SetUp();
+        resolver = new Resolver(loop->iot, loop->settings);
+
+        /* the resolver only looks up asynchronously if the table can be woken up */
+        lcb_WAKEUP *wakeup = nullptr;
+        if (lcbio_wakeup_new(loop->iot, noop_wakeup, nullptr, &wakeup) == LCB_SUCCESS) {
+            lcb_wakeup_destroy(wakeup);
+            async = true;
+        }
+    }
+
+    void TearDown() override
+    {
+        if (resolver != nullptr) {
+            loop->settings->resolver = nullptr;
+            resolver->shutdown();
+            resolver->unref();
+        }
+        SockTest::TearDown();
+    }
+
+    Resolver *resolver{nullptr};
+    bool async{false};
+};
+
+TEST_F(SockResolveTest, testNumeric)
+{
+    lcb_host_t host = {"127.0.0.1", "11210", 0};
+    Lookup lookup;
+    int eai = -1;
+    std::shared_ptr<AddrList> addrs;
+    bool cached = true;
+
+    ASSERT_TRUE(resolver->resolve(&host, AF_INET, lookup_callback, &lookup, &eai, &addrs, &cached));
+    ASSERT_EQ(0, eai);
+    ASSERT_FALSE(cached);
+    ASSERT_NE(nullptr, addrs->head());
+    ASSERT_EQ(AF_INET, addrs->head()->ai_family);
+    ASSERT_EQ(0, lookup.ncalls);
+}
+
+TEST_F(SockResolveTest, testAsyncAndCache)
+{
+    lcb_host_t host = {"localhost", "11210", 0};
+    Lookup first, second;
+    first.loop = second.loop = loop;
+    second.stop = false;
+    int eai = -1;
+    std::shared_ptr<AddrList> addrs;
+    bool cached = false;
+
+    if (!async) {
+        std::cerr << "Skipping " << __FILE__ << ":" << __LINE__ << " (lookups are synchronous on this IO plugin)"
+                  << std::endl;
+        return;
+    }
+
+    // Both wait for the same lookup, the canceled one is not notified
+    Lookup canceled;
+    ASSERT_FALSE(resolver->resolve(&host, AF_INET, lookup_callback, &canceled, &eai, &addrs, &cached));
+    ASSERT_FALSE(resolver->resolve(&host, AF_INET, lookup_callback, &second, &eai, &addrs, &cached));
+    ASSERT_FALSE(resolver->resolve(&host, AF_INET, lookup_callback, &first, &eai, &addrs, &cached));
+    resolver->cancel(&canceled);
+    loop->start();
+    ASSERT_EQ(1, first.ncalls);
+    ASSERT_EQ(0, first.eai);
+    ASSERT_NE(nullptr, first.addrs->head());
+    ASSERT_EQ(1, second.ncalls);
+    ASSERT_EQ(first.addrs, second.addrs);
+    ASSERT_EQ(0, canceled.ncalls);
+
+    ASSERT_TRUE(resolver->resolve(&host, AF_INET, lookup_callback, &first, &eai, &addrs, &cached));
+    ASSERT_TRUE(cached);
+    ASSERT_EQ(first.addrs, addrs);
+
+    resolver->invalidate(&host, AF_INET);
+    ASSERT_FALSE(resolver->resolve(&host, AF_INET, lookup_callback, &first, &eai, &addrs, &cached));
+    loop->start();
+    ASSERT_EQ(2, first.ncalls);
+
+    loop->settings->dns_cache_ttl = 0;
+    resolver->invalidate(&host, AF_INET);
+    ASSERT_FALSE(resolver->resolve(&host, AF_INET, lookup_callback, &first, &eai, &addrs, &cached));
+    loop->start();
+    ASSERT_FALSE(resolver->resolve(&host, AF_INET, lookup_callback, &first, &eai, &addrs, &cached));
+    loop->start();
+    ASSERT_EQ(4, first.ncalls);
+}
+
+TEST_F(SockResolveTest, testUnknownHost)
+{
+    lcb_host_t host = {"nonexistent.invalid", "11210", 0};
+    Lookup lookup;
+    lookup.loop = loop;
+    int eai = -1;
+    std::shared_ptr<AddrList> addrs;
+    bool cached = false;
+
+    if (!async) {
+        ASSERT_TRUE(resolver->resolve(&host, AF_INET, lookup_callback, &lookup, &eai, &addrs, &cached));
+        ASSERT_NE(0, eai);
+        ASSERT_EQ(0, lookup.ncalls);
+        return;
+    }
+    ASSERT_FALSE(resolver->resolve(&host, AF_INET, lookup_callback, &lookup, &eai, &addrs, &cached));
+    loop->start();
+    ASSERT_EQ(1, lookup.ncalls);
+    ASSERT_NE(0, lookup.eai);
+}
+
+TEST_F(SockResolveTest, testConnect)
+{
+    loop->settings->resolver = resolver;
+    lcb_host_t host;
+    loop->populateHost(&host);
+    strcpy(host.host, "localhost");
+
+    ESocket sock;
+    loop->connect(&sock, &host);
+    ASSERT_FALSE(sock.sock == nullptr);
+    sock.close();
+}
@@ -91,6 +91,95 @@ TEST_F(SSLTest, testBasic)
     sock.close();
 }
 
+TEST_F(SSLTest, testBig)
+{
+    // More than fits into the buffers between SSL and the socket at once
+    ESocket sock;
+    loop->connect(&sock);
+    ASSERT_FALSE(sock.sock == nullptr);
+
+    string sendStr;
+    for (size_t ii = 0; sendStr.size() < 1024 * 1024; ii++) {
+        sendStr += std::to_string(ii) + ",";
+    }
+    RecvFuture rf(sendStr.size());
+    FutureBreakCondition wbc(&rf);
+    sock.conn->setRecv(&rf);
+    sock.put(sendStr);
+    sock.schedule();
+    loop->setBreakCondition(&wbc);
+    loop->start();
+    rf.wait();
+    ASSERT_TRUE(rf.isOk());
+    ASSERT_EQ(rf.getString(), sendStr);
+
+    string recvStr(sendStr.rbegin(), sendStr.rend());
+    SendFuture sf(recvStr);
+    ReadBreakCondition rbc(&sock, recvStr.size());
+    sock.conn->setSend(&sf);
+    sock.reqrd(recvStr.size());
+    sock.schedule();
+    loop->setBreakCondition(&rbc);
+    loop->start();
+    sf.wait();
+    ASSERT_TRUE(sf.isOk());
+    ASSERT_EQ(sock.getReceived(), recvStr);
+
+    sock.close();
+}
+
+static void exchange(Loop *loop, ESocket *sock)
+{
+    string sendStr("Hello World");
+    RecvFuture rf(sendStr.size());
+    FutureBreakCondition wbc(&rf);
+    sock->conn->setRecv(&rf);
+    sock->put(sendStr);
+    sock->schedule();
+    loop->setBreakCondition(&wbc);
+    loop->start();
+    rf.wait();
+    ASSERT_TRUE(rf.isOk());
+
+    string recvStr("Goodbye World!");
+    SendFuture sf(recvStr);
+    ReadBreakCondition rbc(sock, recvStr.size());
+    sock->conn->setSend(&sf);
+    sock->reqrd(recvStr.size());
+    sock->schedule();
+    loop->setBreakCondition(&rbc);
+    loop->start();
+    sf.wait();
+    ASSERT_TRUE(sf.isOk());
+    ASSERT_EQ(sock->getReceived(), recvStr);
+}
+
+TEST_F(SSLTest, testResume)
+{
+    ESocket first;
+    loop->connect(&first);
+    ASSERT_FALSE(first.sock == nullptr);
+    exchange(loop, &first);
+    ASSERT_FALSE(lcbio_ssl_resumed(first.sock));
+    first.close();
+
+    // The second connection to the same endpoint offers the session of the first one
+    ESocket second;
+    loop->connect(&second);
+    ASSERT_FALSE(second.sock == nullptr);
+    exchange(loop, &second);
+    ASSERT_TRUE(lcbio_ssl_resumed(second.sock));
+    second.close();
+
+    loop->settings->ssl_session_cache = 0;
+    ESocket third;
+    loop->connect(&third);
+    ASSERT_FALSE(third.sock == nullptr);
+    exchange(loop, &third);
+    ASSERT_FALSE(lcbio_ssl_resumed(third.sock));
+    third.close();
+}
+
 #else
 class SSLTest : public ::testing::Test
 {
@@ -97,3 +97,44 @@ TEST_F(SockWriteTest, testBrokenMultiWrites)
         cf.wait();
     }
 }
+
+static void countRelease(void *arg)
+{
+    (*static_cast<int *>(arg))++;
+}
+
+/**
+ * Referenced buffers are written in order with the copied data around them,
+ * and released once written
+ */
+TEST_F(SockWriteTest, testNocopyWrite)
+{
+    ESocket sock;
+    loop->connect(&sock);
+
+    string world("World");
+    string big(1024 * 1024 * 2, '*');
+    int released = 0;
+    string expected = "Hello " + world + big + "!";
+    RecvFuture rf(expected.size());
+    sock.conn->setRecv(&rf);
+
+    lcb_IOV iov[2];
+    iov[0].iov_base = &world[0];
+    iov[0].iov_len = world.size();
+    iov[1].iov_base = &big[0];
+    iov[1].iov_len = big.size();
+
+    sock.put("Hello ");
+    lcbio_ctx_putv_nocopy(sock.ctx, iov, 2, countRelease, &released);
+    sock.put("!");
+    sock.schedule();
+
+    FutureBreakCondition wbc(&rf);
+    loop->setBreakCondition(&wbc);
+    loop->start();
+    rf.wait();
+    ASSERT_TRUE(rf.isOk());
+    ASSERT_EQ(expected, rf.getString());
+    ASSERT_EQ(1, released);
+}
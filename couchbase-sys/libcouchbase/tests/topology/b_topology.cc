@@ -0,0 +1,308 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/**
+ * @file
+ * Behaviour of the client through topology changes of the mock cluster.
+ *
+ * A steady KV load (alternating upserts and gets, a fixed number of them in
+ * flight) runs while a script fails over, removes and adds nodes. Every event
+ * opens a window, and for each window the operations completed in it, their
+ * latency percentiles, the errors and the time to recovery are printed, so
+ * that changes to the retry queue, the configuration handling and the
+ * remapping of the pipelines can be compared. The mock moves vBuckets only
+ * when a node is removed or added with a rebalance, which is how vBucket moves
+ * are exercised here.
+ *
+ * Run with "make topology-benchmarks && bin/topology-benchmarks".
+ */
+
+#include "config.h"
+#include "iotests/iotests.h"
+#include "internal.h"
+#include <lcbio/iotable.h>
+
+#include <algorithm>
+#include <functional>
+#include <map>
+
+/** Operations kept in flight */
+#define TOPOLOGY_CONCURRENCY 64
+/** Number of distinct keys of the load */
+#define TOPOLOGY_NKEYS 1024
+/**
+ * An operation failing, or slower than this multiple of the 99th percentile
+ * before the first event, means the client has not recovered yet
+ */
+#define TOPOLOGY_SLOW_FACTOR 10
+
+namespace
+{
+
+struct Event {
+    std::string name;
+    /** Time of the event since the load started, in milliseconds */
+    uint32_t at_ms;
+    std::function<void(MockEnvironment *)> action;
+};
+
+struct Window {
+    std::string name;
+    hrtime_t start;
+    /** Completion time since the start of the window and latency of every operation, in microseconds */
+    std::vector<std::pair<uint64_t, uint64_t>> ops;
+    std::map<lcb_STATUS, size_t> errors;
+    /** Completion time of the last failed operation since the start of the window, in microseconds */
+    uint64_t last_error_us;
+};
+
+class LoadGenerator;
+
+struct Operation {
+    LoadGenerator *gen;
+    hrtime_t start;
+};
+
+struct Trigger {
+    LoadGenerator *gen;
+    const Event *event;
+    lcbio_pTIMER timer;
+};
+
+class LoadGenerator
+{
+  public:
+    LoadGenerator(lcb_INSTANCE *instance, MockEnvironment *mock) : instance(instance), mock(mock), value(128, 'v')
+    {
+        for (size_t ii = 0; ii < TOPOLOGY_NKEYS; ii++) {
+            keys.push_back("topology-" + std::to_string(ii));
+        }
+        ops.resize(TOPOLOGY_CONCURRENCY);
+        lcb_install_callback(instance, LCB_CALLBACK_GET, callback);
+        lcb_install_callback(instance, LCB_CALLBACK_STORE, callback);
+    }
+
+    /** Run the load until `end_ms`, firing the events of the script on the way */
+    void run(const std::vector<Event> &script, uint32_t end_ms)
+    {
+        hrtime_t now = gethrtime();
+        deadline = now + LCB_MS2NS(end_ms);
+        open("baseline", now);
+
+        std::vector<Trigger> triggers(script.size());
+        for (size_t ii = 0; ii < script.size(); ii++) {
+            triggers[ii] = Trigger{this, &script[ii], lcbio_timer_new(instance->iotable, &triggers[ii], fire)};
+            lcb_loop_ref(instance);
+            lcbio_timer_rearm(triggers[ii].timer, LCB_MS2US(script[ii].at_ms));
+        }
+        for (auto &op : ops) {
+            op = Operation{this, 0};
+            schedule(&op);
+        }
+        lcb_wait(instance, LCB_WAIT_DEFAULT);
+        for (auto &trigger : triggers) {
+            lcbio_timer_destroy(trigger.timer);
+        }
+    }
+
+    void report() const
+    {
+        uint64_t threshold = percentile(windows.front(), 99) * TOPOLOGY_SLOW_FACTOR;
+        printf("%-28s %8s %7s %9s %9s %9s %9s %12s\n", "window", "ops", "errors", "p50_us", "p99_us", "p99.9_us",
+               "max_us", "recovery_ms");
+        for (const auto &window : windows) {
+            size_t nerrors = 0;
+            for (const auto &error : window.errors) {
+                nerrors += error.second;
+            }
+            uint64_t recovery_us = window.last_error_us;
+            for (const auto &op : window.ops) {
+                if (op.second > threshold) {
+                    recovery_us = std::max(recovery_us, op.first);
+                }
+            }
+            printf("%-28s %8zu %7zu %9llu %9llu %9llu %9llu %12.1f\n", window.name.c_str(), window.ops.size(), nerrors,
+                   (unsigned long long)percentile(window, 50), (unsigned long long)percentile(window, 99),
+                   (unsigned long long)percentile(window, 99.9), (unsigned long long)percentile(window, 100),
+                   recovery_us / 1000.0);
+            for (const auto &error : window.errors) {
+                printf("%-28s %8s %7zu %s\n", "", "", error.second, lcb_strerror_short(error.first));
+            }
+        }
+    }
+
+  private:
+    static void fire(void *cookie)
+    {
+        auto *trigger = static_cast<Trigger *>(cookie);
+        LoadGenerator *gen = trigger->gen;
+        /* the mock commands are synchronous, the operations in flight complete once they return */
+        trigger->event->action(gen->mock);
+        gen->open(trigger->event->name, gethrtime());
+        lcb_loop_unref(gen->instance);
+    }
+
+    static void callback(lcb_INSTANCE *, int cbtype, const lcb_RESPBASE *rb)
+    {
+        Operation *op = nullptr;
+        lcb_STATUS rc;
+        if (cbtype == LCB_CALLBACK_GET) {
+            const auto *resp = reinterpret_cast<const lcb_RESPGET *>(rb);
+            lcb_respget_cookie(resp, reinterpret_cast<void **>(&op));
+            rc = lcb_respget_status(resp);
+        } else {
+            const auto *resp = reinterpret_cast<const lcb_RESPSTORE *>(rb);
+            lcb_respstore_cookie(resp, reinterpret_cast<void **>(&op));
+            rc = lcb_respstore_status(resp);
+        }
+        op->gen->complete(op, rc);
+    }
+
+    void open(const std::string &name, hrtime_t now)
+    {
+        windows.push_back(Window{name, now, {}, {}, 0});
+    }
+
+    void complete(Operation *op, lcb_STATUS rc)
+    {
+        hrtime_t now = gethrtime();
+        Window &window = windows.back();
+        uint64_t at_us = LCB_NS2US(now - window.start);
+        window.ops.emplace_back(at_us, LCB_NS2US(now - op->start));
+        /* a get may precede the first upsert of its key, or follow the loss of its node */
+        if (rc != LCB_SUCCESS && rc != LCB_ERR_DOCUMENT_NOT_FOUND) {
+            window.errors[rc]++;
+            window.last_error_us = at_us;
+        }
+        if (now < deadline) {
+            schedule(op);
+        }
+    }
+
+    void schedule(Operation *op)
+    {
+        const std::string &key = keys[next++ % keys.size()];
+        lcb_STATUS rc;
+        op->start = gethrtime();
+        if (next % 2) {
+            lcb_CMDSTORE *cmd;
+            lcb_cmdstore_create(&cmd, LCB_STORE_UPSERT);
+            lcb_cmdstore_key(cmd, key.c_str(), key.size());
+            lcb_cmdstore_value(cmd, value.c_str(), value.size());
+            rc = lcb_store(instance, op, cmd);
+            lcb_cmdstore_destroy(cmd);
+        } else {
+            lcb_CMDGET *cmd;
+            lcb_cmdget_create(&cmd);
+            lcb_cmdget_key(cmd, key.c_str(), key.size());
+            rc = lcb_get(instance, op, cmd);
+            lcb_cmdget_destroy(cmd);
+        }
+        if (rc != LCB_SUCCESS) {
+            windows.back().errors[rc]++;
+        }
+    }
+
+    /** @return the latency below which `pct` per cent of the operations of the window completed */
+    static uint64_t percentile(const Window &window, double pct)
+    {
+        if (window.ops.empty()) {
+            return 0;
+        }
+        std::vector<uint64_t> latencies;
+        latencies.reserve(window.ops.size());
+        for (const auto &op : window.ops) {
+            latencies.push_back(op.second);
+        }
+        std::sort(latencies.begin(), latencies.end());
+        auto rank = static_cast<size_t>(pct / 100 * (latencies.size() - 1));
+        return latencies[rank];
+    }
+
+    lcb_INSTANCE *instance;
+    MockEnvironment *mock;
+    std::vector<std::string> keys;
+    std::string value;
+    std::vector<Operation> ops;
+    std::vector<Window> windows;
+    size_t next{0};
+    hrtime_t deadline{0};
+};
+
+} // namespace
+
+class TopologyBenchmark : public ::testing::Test
+{
+  protected:
+    /** Run the script against a fresh cluster of four nodes with one replica and print the report */
+    static void run(const char *title, const std::vector<Event> &script, uint32_t end_ms)
+    {
+        const char *argv[] = {"--replicas", "1", "--nodes", "4", nullptr};
+        MockEnvironment mock(argv);
+        if (mock.isRealCluster()) {
+            MockEnvironment::printSkipMessage(__FILE__, __LINE__, "needs the mock to change the topology");
+            return;
+        }
+
+        HandleWrap hw;
+        lcb_INSTANCE *instance;
+        mock.createConnection(hw, &instance);
+        ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_connect(instance));
+        lcb_wait(instance, LCB_WAIT_DEFAULT);
+        ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_get_bootstrap_status(instance));
+
+        LoadGenerator gen(instance, &mock);
+        gen.run(script, end_ms);
+        printf("\n%s\n", title);
+        gen.report();
+    }
+};
+
+TEST_F(TopologyBenchmark, failover)
+{
+    run("failover of a node, which comes back later",
+        {
+            {"failover node 1", 2000, [](MockEnvironment *mock) { mock->failoverNode(1, "default", false); }},
+            {"respawn node 1", 6000, [](MockEnvironment *mock) { mock->respawnNode(1); }},
+        },
+        10000);
+}
+
+TEST_F(TopologyBenchmark, rebalance)
+{
+    run("removal of a node with its vBuckets moved to the others, and back",
+        {
+            {"remove node 2", 2000, [](MockEnvironment *mock) { mock->failoverNode(2, "default", true); }},
+            {"add node 2", 6000, [](MockEnvironment *mock) { mock->respawnNode(2); }},
+        },
+        10000);
+}
+
+TEST_F(TopologyBenchmark, cascade)
+{
+    run("two nodes removed in quick succession, and both added back",
+        {
+            {"remove node 1", 2000, [](MockEnvironment *mock) { mock->failoverNode(1, "default", true); }},
+            {"remove node 3", 2500, [](MockEnvironment *mock) { mock->failoverNode(3, "default", true); }},
+            {"add nodes 1 and 3", 6000,
+             [](MockEnvironment *mock) {
+                 mock->respawnNode(1);
+                 mock->respawnNode(3);
+             }},
+        },
+        10000);
+}
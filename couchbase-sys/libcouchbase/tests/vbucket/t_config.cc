@@ -26,6 +26,10 @@
 #include "contrib/cJSON/cJSON.h"
 #include "jsparse/parser.h"
 
+extern "C" {
+#include "vbucket/hash.h"
+}
+
 using std::map;
 using std::string;
 using std::vector;
@@ -156,6 +160,50 @@ TEST_F(ConfigTest, testGeneration)
     free(js);
 }
 
+static int reference_k2vb(const string &key, unsigned nvb)
+{
+    uint32_t crc = UINT32_MAX;
+    for (size_t ii = 0; ii < key.size(); ii++) {
+        crc ^= (unsigned char)key[ii];
+        for (int jj = 0; jj < 8; jj++) {
+            crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+        }
+    }
+    return (int)((((~crc) >> 16) & 0x7fff) % nvb);
+}
+
+TEST_F(ConfigTest, testMapKeysBatch)
+{
+    lcbvb_CONFIG *cfg = lcbvb_create();
+    lcbvb_genconfig(cfg, 4, 1, 1024);
+
+    vector<string> keys;
+    vector<const void *> kptrs;
+    vector<lcb_SIZE> klens;
+    for (size_t ii = 0; ii < 300; ii++) {
+        string key;
+        for (size_t jj = 0; jj < ii; jj++) {
+            key += (char)('!' + (ii * 31 + jj * 7) % 90);
+        }
+        keys.push_back(key);
+    }
+    for (size_t ii = 0; ii < keys.size(); ii++) {
+        kptrs.push_back(keys[ii].c_str());
+        klens.push_back(keys[ii].size());
+    }
+
+    vector<int> vbids(keys.size()), srvixs(keys.size());
+    ASSERT_EQ(0, lcbvb_map_keys_batch(cfg, &kptrs[0], &klens[0], keys.size(), &vbids[0], &srvixs[0]));
+    for (size_t ii = 0; ii < keys.size(); ii++) {
+        int vbid = -1, srvix = -1;
+        ASSERT_EQ(reference_k2vb(keys[ii], cfg->nvb), lcbvb_k2vb(cfg, keys[ii].c_str(), keys[ii].size()));
+        lcbvb_map_key(cfg, keys[ii].c_str(), keys[ii].size(), &vbid, &srvix);
+        ASSERT_EQ(vbid, vbids[ii]);
+        ASSERT_EQ(srvix, srvixs[ii]);
+    }
+    lcbvb_destroy(cfg);
+}
+
 TEST_F(ConfigTest, testAltMap)
 {
     lcbvb_CONFIG *cfg = lcbvb_create();
@@ -177,6 +225,62 @@ TEST_F(ConfigTest, testAltMap)
     lcbvb_destroy(cfg);
 }
 
+TEST_F(ConfigTest, testStreamedMaps)
+{
+    lcbvb_CONFIG *orig = lcbvb_create();
+    lcbvb_genconfig(orig, 4, 2, 1024);
+    char *js = lcbvb_save_json(orig);
+
+    // The forward map is not serialized, so add a copy of the current one
+    string withff(js);
+    size_t begin = withff.find("\"vBucketMap\":");
+    ASSERT_NE(string::npos, begin);
+    size_t end = withff.find("]]", begin);
+    ASSERT_NE(string::npos, end);
+    string ffmap = withff.substr(begin, end + 2 - begin);
+    ffmap.replace(0, strlen("\"vBucketMap\""), "\"vBucketMapForward\"");
+    withff.insert(begin, ffmap + ",");
+
+    lcbvb_CONFIG *cfg = lcbvb_create();
+    ASSERT_EQ(0, lcbvb_load_json(cfg, withff.c_str()));
+    ASSERT_EQ(orig->nvb, cfg->nvb);
+    ASSERT_EQ(4, cfg->nsrv);
+    ASSERT_TRUE(cfg->ffvbuckets != NULL);
+    for (unsigned ii = 0; ii < cfg->nvb; ii++) {
+        for (unsigned jj = 0; jj < 3; jj++) {
+            ASSERT_EQ(orig->vbuckets[ii].servers[jj], cfg->vbuckets[ii].servers[jj]);
+            ASSERT_EQ(orig->vbuckets[ii].servers[jj], cfg->ffvbuckets[ii].servers[jj]);
+        }
+    }
+    lcbvb_destroy(cfg);
+
+    // Values the extractor does not handle are left to the DOM parser
+    string fallback(js);
+    size_t pos = fallback.find("\"vBucketMap\"");
+    ASSERT_NE(string::npos, pos);
+    pos = fallback.find("[[", pos);
+    ASSERT_NE(string::npos, pos);
+    pos = fallback.find_first_of("0123456789", pos);
+    fallback.insert(pos + 1, ".0");
+    cfg = lcbvb_create();
+    ASSERT_EQ(0, lcbvb_load_json(cfg, fallback.c_str()));
+    ASSERT_EQ(orig->nvb, cfg->nvb);
+    ASSERT_EQ(orig->vbuckets[0].servers[0], cfg->vbuckets[0].servers[0]);
+    lcbvb_destroy(cfg);
+
+    // Out of bounds server indexes are still rejected
+    string bad(js);
+    pos = bad.find("\"vBucketMap\"");
+    pos = bad.find("[[", pos);
+    bad.replace(pos + 2, 1, "9");
+    cfg = lcbvb_create();
+    ASSERT_EQ(-1, lcbvb_load_json(cfg, bad.c_str()));
+    lcbvb_destroy(cfg);
+
+    free(js);
+    lcbvb_destroy(orig);
+}
+
 TEST_F(ConfigTest, testGetReplicaNode)
 {
     lcbvb_CONFIG *cfg = lcbvb_create();
@@ -343,6 +447,46 @@ TEST_F(ConfigTest, testNondataNodes)
     lcbvb_destroy(cfg_old);
 }
 
+TEST_F(ConfigTest, testServerGroups)
+{
+    const size_t nservers = 4;
+    vector<lcbvb_SERVER> servers;
+    servers.resize(nservers);
+    for (size_t ii = 0; ii < nservers; ++ii) {
+        lcbvb_SERVER &server = servers[ii];
+        memset(&server, 0, sizeof server);
+        server.svc.data = 1000 + ii;
+        server.svc.n1ql = 3000 + ii;
+        server.hostname = const_cast<char *>("dummy.host.ru");
+        server.server_group = const_cast<char *>(ii == 2 ? "zone b" : "zone a");
+    }
+    lcbvb_CONFIG *cfg = lcbvb_create();
+    ASSERT_EQ(0, lcbvb_genconfig_ex(cfg, "default", NULL, &servers[0], servers.size(), 1, 64));
+    ASSERT_STREQ("zone b", lcbvb_get_server_group(cfg, 2));
+    ASSERT_EQ(NULL, lcbvb_get_server_group(cfg, nservers));
+
+    // the group survives serialization
+    char *js = lcbvb_save_json(cfg);
+    lcbvb_CONFIG *cfg2 = lcbvb_create();
+    ASSERT_EQ(0, lcbvb_load_json(cfg2, js));
+    ASSERT_STREQ("zone b", lcbvb_get_server_group(cfg2, 2));
+    ASSERT_STREQ("zone a", lcbvb_get_server_group(cfg2, 0));
+    free(js);
+    lcbvb_destroy(cfg2);
+
+    vector<int> used(nservers, 0);
+    for (size_t ii = 0; ii < 16; ++ii) {
+        ASSERT_EQ(2, lcbvb_get_randhost_group(cfg, LCBVB_SVCTYPE_QUERY, LCBVB_SVCMODE_PLAIN, &used[0], "zone b"));
+    }
+    // falls back to the other groups once the preferred one is exhausted
+    used[2] = 1;
+    int ix = lcbvb_get_randhost_group(cfg, LCBVB_SVCTYPE_QUERY, LCBVB_SVCMODE_PLAIN, &used[0], "zone b");
+    ASSERT_TRUE(ix >= 0 && ix != 2);
+    ix = lcbvb_get_randhost_group(cfg, LCBVB_SVCTYPE_QUERY, LCBVB_SVCMODE_PLAIN, &used[0], "zone c");
+    ASSERT_TRUE(ix >= 0 && ix != 2);
+    lcbvb_destroy(cfg);
+}
+
 TEST_F(ConfigTest, testKetamaUniformity)
 {
     string txt = getConfigFile("memd_45.json");
@@ -394,6 +538,37 @@ TEST_F(ConfigTest, testKetamaCompliance)
     lcbvb_destroy(vbc);
 }
 
+TEST_F(ConfigTest, testKetamaTreeLookup)
+{
+    string txt = getConfigFile("memd_ketama_config.json");
+    lcbvb_CONFIG *vbc = lcbvb_parse_json(txt.c_str());
+    ASSERT_TRUE(vbc != NULL);
+    ASSERT_EQ(LCBVB_DIST_KETAMA, vbc->dtype);
+    lcbvb_replace_host(vbc, "192.168.1.104");
+    ASSERT_TRUE(vbc->continuum != NULL);
+
+    for (unsigned ii = 0; ii < 10000; ++ii) {
+        std::stringstream ss;
+        ss << "Key_" << ii;
+        string key = ss.str();
+
+        // reference: the first point of the sorted continuum not below the hash
+        uint32_t digest = vb__hash_ketama(key.c_str(), key.size());
+        int expected = vbc->continuum[0].index;
+        for (unsigned jj = 0; jj < vbc->ncontinuum; ++jj) {
+            if (vbc->continuum[jj].point >= digest) {
+                expected = vbc->continuum[jj].index;
+                break;
+            }
+        }
+
+        int vbid, srvix;
+        lcbvb_map_key(vbc, key.c_str(), key.size(), &vbid, &srvix);
+        ASSERT_EQ(expected, srvix) << key;
+    }
+    lcbvb_destroy(vbc);
+}
+
 TEST_F(ConfigTest, testPresentNodesextMissingNodesKetama)
 {
     // Scenario when a node is in nodesext but not nodes
@@ -457,3 +632,64 @@ TEST_F(ConfigTest, testLargeRevision)
         ASSERT_EQ(18446744073709551615UL, json["max_uint64"].asUInt64());
     }
 }
+
+TEST_F(ConfigTest, testGetJsonRevision)
+{
+    int64_t epoch = 0, rev = 0;
+    ASSERT_EQ(0, lcbvb_get_json_revision("{\"nodes\":[{\"rev\":1}],\"rev\":1234,\"name\":\"x\",\"revEpoch\":7}", &epoch,
+                                         &rev));
+    ASSERT_EQ(7, epoch);
+    ASSERT_EQ(1234, rev);
+
+    string txt = getConfigFile("terse_30.json");
+    lcbvb_CONFIG *cfg = lcbvb_create();
+    ASSERT_EQ(0, lcbvb_load_json(cfg, txt.c_str()));
+    ASSERT_EQ(0, lcbvb_get_json_revision(txt.c_str(), &epoch, &rev));
+    ASSERT_EQ(cfg->revepoch, epoch);
+    ASSERT_EQ(cfg->revid, rev);
+    lcbvb_destroy(cfg);
+
+    ASSERT_EQ(0, lcbvb_get_json_revision("{}", &epoch, &rev));
+    ASSERT_EQ(-1, epoch);
+    ASSERT_EQ(-1, rev);
+    ASSERT_EQ(-1, lcbvb_get_json_revision("[1]", &epoch, &rev));
+    ASSERT_EQ(-1, lcbvb_get_json_revision("INVALIDJSON", &epoch, &rev));
+}
+
+TEST_F(ConfigTest, testBinaryRoundTrip)
+{
+    lcbvb_CONFIG *orig = lcbvb_create();
+    lcbvb_genconfig(orig, 4, 2, 1024);
+    lcbvb_genffmap(orig);
+
+    lcb_SIZE nbuf = 0;
+    char *buf = lcbvb_save_binary(orig, &nbuf);
+    ASSERT_TRUE(buf != NULL);
+    ASSERT_EQ(0, memcmp(buf, LCBVB_BINARY_MAGIC, sizeof(LCBVB_BINARY_MAGIC)));
+
+    lcbvb_CONFIG *cfg = lcbvb_create();
+    ASSERT_EQ(0, lcbvb_load_binary(cfg, buf, nbuf)) << lcbvb_get_error(cfg);
+    ASSERT_EQ(orig->nvb, cfg->nvb);
+    ASSERT_EQ(orig->nsrv, cfg->nsrv);
+    ASSERT_EQ(orig->nrepl, cfg->nrepl);
+    ASSERT_EQ(orig->revid, cfg->revid);
+    ASSERT_EQ(0, memcmp(orig->vbuckets, cfg->vbuckets, orig->nvb * sizeof(lcbvb_VBUCKET)));
+    ASSERT_TRUE(cfg->ffvbuckets != NULL);
+    ASSERT_EQ(0, memcmp(orig->ffvbuckets, cfg->ffvbuckets, orig->nvb * sizeof(lcbvb_VBUCKET)));
+    for (unsigned ii = 0; ii < cfg->nsrv; ii++) {
+        ASSERT_STREQ(orig->servers[ii].authority, cfg->servers[ii].authority);
+    }
+    int vbid, srvix, vbid_orig, srvix_orig;
+    lcbvb_map_key(orig, "Hello", 5, &vbid_orig, &srvix_orig);
+    lcbvb_map_key(cfg, "Hello", 5, &vbid, &srvix);
+    ASSERT_EQ(vbid_orig, vbid);
+    ASSERT_EQ(srvix_orig, srvix);
+    lcbvb_destroy(cfg);
+
+    cfg = lcbvb_create();
+    ASSERT_EQ(-1, lcbvb_load_binary(cfg, buf, nbuf - 1));
+    lcbvb_destroy(cfg);
+
+    free(buf);
+    lcbvb_destroy(orig);
+}
@@ -0,0 +1,807 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2024 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/**
+ * cbc import and cbc export.
+ *
+ * The input is shared by all threads and read one record at a time, so the
+ * memory used does not depend on its size. Every thread has its own instance
+ * and keeps a window of operations in flight, scheduling the next record from
+ * the callback of each one which completes.
+ */
+
+#define NOMINMAX
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "common/options.h"
+#include "cbc-handlers.h"
+#include "contrib/lcb-jsoncpp/lcb-jsoncpp.h"
+#include <libcouchbase/utils.h>
+
+using namespace cbc;
+
+using std::map;
+using std::string;
+using std::vector;
+
+/** Common flags of JSON documents, so that the SDKs decode them as such */
+#define BULK_JSON_FLAGS 0x02000000
+
+/** The output of each thread is handed to the shared file in chunks of about this size */
+#define BULK_FLUSH_SIZE 65536
+
+namespace
+{
+bool readLine(std::istream &input, string &line)
+{
+    if (!std::getline(input, line)) {
+        return false;
+    }
+    if (!line.empty() && line[line.size() - 1] == '\r') {
+        line.erase(line.size() - 1);
+    }
+    return true;
+}
+
+/** Returns false if a quoted field is not terminated */
+bool splitCsv(const string &record, vector<string> &fields)
+{
+    string field;
+    bool quoted = false;
+
+    fields.clear();
+    for (size_t ii = 0; ii < record.size(); ++ii) {
+        char c = record[ii];
+        if (quoted) {
+            if (c != '"') {
+                field += c;
+            } else if (ii + 1 < record.size() && record[ii + 1] == '"') {
+                field += '"';
+                ++ii;
+            } else {
+                quoted = false;
+            }
+        } else if (c == '"') {
+            quoted = true;
+        } else if (c == ',') {
+            fields.push_back(field);
+            field.clear();
+        } else {
+            field += c;
+        }
+    }
+    fields.push_back(field);
+    return !quoted;
+}
+
+void appendCsvField(string &out, const string &field)
+{
+    if (field.find_first_of(",\"\r\n") == string::npos) {
+        out += field;
+        return;
+    }
+    out += '"';
+    for (char c : field) {
+        if (c == '"') {
+            out += '"';
+        }
+        out += c;
+    }
+    out += '"';
+}
+
+/** A CSV field as a number or a boolean if it reads as one, as a string otherwise */
+Json::Value inferType(const string &field)
+{
+    if (field == "true" || field == "false") {
+        return Json::Value(field == "true");
+    }
+    if (field.empty() || field.find_first_of("xX") != string::npos) {
+        return Json::Value(field);
+    }
+    char *end = nullptr;
+    errno = 0;
+    long long ival = strtoll(field.c_str(), &end, 10);
+    if (*end == '\0' && errno == 0) {
+        return Json::Value(static_cast<Json::Int64>(ival));
+    }
+    double dval = strtod(field.c_str(), &end);
+    if (*end == '\0' && std::isfinite(dval)) {
+        return Json::Value(dval);
+    }
+    return Json::Value(field);
+}
+
+bool keyOf(const Json::Value &doc, const string &field, string &key)
+{
+    const Json::Value &value = doc[field];
+    if (value.isString()) {
+        key = value.asString();
+    } else if (value.isInt64()) {
+        key = std::to_string(value.asInt64());
+    } else if (value.isUInt64()) {
+        key = std::to_string(value.asUInt64());
+    } else {
+        return false;
+    }
+    return !key.empty();
+}
+
+/** Records of a file or of the standard input, shared by the threads */
+class RecordSource
+{
+  public:
+    RecordSource(const string &path, bool csv) : csv_(csv)
+    {
+        if (path != "-") {
+            file_.open(path.c_str(), std::ios::in | std::ios::binary);
+            if (!file_.is_open()) {
+                throw BadArg("Cannot open " + path);
+            }
+            input_ = &file_;
+        }
+        if (csv_) {
+            string header;
+            size_t line;
+            if (!read(header, line) || !splitCsv(header, columns_)) {
+                throw BadArg(path + ": missing CSV header");
+            }
+        }
+    }
+
+    bool next(string &record, size_t &line)
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        return read(record, line);
+    }
+
+    bool csv() const
+    {
+        return csv_;
+    }
+
+    const vector<string> &columns() const
+    {
+        return columns_;
+    }
+
+  private:
+    bool read(string &record, size_t &line)
+    {
+        while (readLine(*input_, record)) {
+            line = ++nlines_;
+            /* a quoted CSV field may hold line breaks */
+            while (csv_ && std::count(record.begin(), record.end(), '"') % 2 != 0) {
+                string more;
+                if (!readLine(*input_, more)) {
+                    break;
+                }
+                ++nlines_;
+                record += '\n';
+                record += more;
+            }
+            if (!record.empty()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool csv_;
+    std::ifstream file_;
+    std::istream *input_{&std::cin};
+    std::mutex mutex_;
+    size_t nlines_{0};
+    vector<string> columns_;
+};
+
+/** A file, or the standard output, written by all threads */
+class RecordSink
+{
+  public:
+    explicit RecordSink(const string &path)
+    {
+        if (path != "-") {
+            file_.open(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+            if (!file_.is_open()) {
+                throw BadArg("Cannot open " + path);
+            }
+            output_ = &file_;
+        }
+    }
+
+    ~RecordSink()
+    {
+        output_->flush();
+    }
+
+    void write(const string &chunk)
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        output_->write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+    }
+
+  private:
+    std::ofstream file_;
+    std::ostream *output_{&std::cout};
+    std::mutex mutex_;
+};
+
+struct BulkSettings {
+    string keyField;
+    string scope;
+    /** Empty for the default collection */
+    string collection;
+};
+
+struct ImportSettings : BulkSettings {
+    lcb_STORE_OPERATION operation{LCB_STORE_UPSERT};
+    lcb_DURABILITY_LEVEL durability{LCB_DURABILITYLEVEL_NONE};
+    unsigned expiry{0};
+    bool inferTypes{false};
+};
+
+struct ExportSettings : BulkSettings {
+    bool csv{false};
+    vector<string> fields;
+};
+} // namespace
+
+namespace cbc
+{
+class BulkWorker
+{
+  public:
+    BulkWorker(lcb_INSTANCE *instance, size_t window) : instance_(instance), window_(window) {}
+
+    virtual ~BulkWorker()
+    {
+        lcb_destroy(instance_);
+    }
+
+    void run()
+    {
+        fill();
+        lcb_wait(instance_, LCB_WAIT_DEFAULT);
+        finish();
+    }
+
+    void succeeded(size_t nbytes = 0)
+    {
+        ok_++;
+        bytes_ += nbytes;
+    }
+
+    void failed(const string &what, const string &reason)
+    {
+        fprintf(stderr, "%-20s %s\n", what.c_str(), reason.c_str());
+        failed_++;
+        errors_[reason]++;
+    }
+
+    /** Called once an operation scheduled by the worker has completed */
+    void completed()
+    {
+        inflight_--;
+        fill();
+    }
+
+    size_t ok_{0};
+    size_t failed_{0};
+    size_t bytes_{0};
+    map<string, size_t> errors_;
+
+  protected:
+    /** Schedules the operation of the next record, returns false once the input is exhausted */
+    virtual bool scheduleNext() = 0;
+
+    virtual void finish() {}
+
+    void scheduled(size_t nbytes = 0)
+    {
+        inflight_++;
+        bytes_ += nbytes;
+    }
+
+    lcb_INSTANCE *instance_;
+
+  private:
+    void fill()
+    {
+        if (exhausted_) {
+            return;
+        }
+        lcb_sched_enter(instance_);
+        while (!exhausted_ && inflight_ < window_) {
+            exhausted_ = !scheduleNext();
+        }
+        lcb_sched_leave(instance_);
+    }
+
+    size_t window_;
+    size_t inflight_{0};
+    bool exhausted_{false};
+};
+} // namespace cbc
+
+namespace
+{
+class ImportWorker : public BulkWorker
+{
+  public:
+    ImportWorker(lcb_INSTANCE *instance, size_t window, RecordSource &source, const ImportSettings &settings)
+        : BulkWorker(instance, window), source_(source), settings_(settings)
+    {
+    }
+
+  protected:
+    bool scheduleNext() override
+    {
+        string record;
+        size_t line;
+        if (!source_.next(record, line)) {
+            return false;
+        }
+
+        string key, value;
+        string error = source_.csv() ? fromCsv(record, key, value) : fromJson(record, key, value);
+        if (!error.empty()) {
+            failed("line " + std::to_string(line), error);
+            return true;
+        }
+
+        lcb_CMDSTORE *cmd;
+        lcb_cmdstore_create(&cmd, settings_.operation);
+        lcb_cmdstore_key(cmd, key.c_str(), key.size());
+        if (!settings_.collection.empty()) {
+            lcb_cmdstore_collection(cmd, settings_.scope.c_str(), settings_.scope.size(), settings_.collection.c_str(),
+                                    settings_.collection.size());
+        }
+        lcb_cmdstore_value(cmd, value.c_str(), value.size());
+        lcb_cmdstore_flags(cmd, BULK_JSON_FLAGS);
+        lcb_cmdstore_datatype(cmd, LCB_VALUE_F_JSON);
+        if (settings_.expiry != 0) {
+            lcb_cmdstore_expiry(cmd, settings_.expiry);
+        }
+        if (settings_.durability != LCB_DURABILITYLEVEL_NONE) {
+            lcb_cmdstore_durability(cmd, settings_.durability);
+        }
+        lcb_STATUS rc = lcb_store(instance_, this, cmd);
+        lcb_cmdstore_destroy(cmd);
+        if (rc == LCB_SUCCESS) {
+            scheduled(value.size());
+        } else {
+            failed(key, lcb_strerror_short(rc));
+        }
+        return true;
+    }
+
+  private:
+    string fromJson(const string &record, string &key, string &value)
+    {
+        Json::Value doc;
+        if (!reader_.parse(record, doc, false) || !doc.isObject()) {
+            return "not a JSON object";
+        }
+        if (!keyOf(doc, settings_.keyField, key)) {
+            return "no key in field \"" + settings_.keyField + "\"";
+        }
+        value = record;
+        return "";
+    }
+
+    string fromCsv(const string &record, string &key, string &value)
+    {
+        const vector<string> &columns = source_.columns();
+        if (!splitCsv(record, fields_)) {
+            return "unterminated quoted field";
+        }
+        if (fields_.size() != columns.size()) {
+            return "expected " + std::to_string(columns.size()) + " fields, got " + std::to_string(fields_.size());
+        }
+        Json::Value doc(Json::objectValue);
+        for (size_t ii = 0; ii < columns.size(); ++ii) {
+            doc[columns[ii]] = settings_.inferTypes ? inferType(fields_[ii]) : Json::Value(fields_[ii]);
+        }
+        if (!keyOf(doc, settings_.keyField, key)) {
+            return "no key in field \"" + settings_.keyField + "\"";
+        }
+        value = writer_.write(doc);
+        return "";
+    }
+
+    RecordSource &source_;
+    const ImportSettings &settings_;
+    Json::Reader reader_;
+    Json::FastWriter writer_;
+    vector<string> fields_;
+};
+
+class ExportWorker : public BulkWorker
+{
+  public:
+    ExportWorker(lcb_INSTANCE *instance, size_t window, RecordSource &keys, RecordSink &sink,
+                 const ExportSettings &settings)
+        : BulkWorker(instance, window), keys_(keys), sink_(sink), settings_(settings)
+    {
+    }
+
+    void write(const string &key, const char *value, size_t nvalue)
+    {
+        Json::Value doc;
+        if (!reader_.parse(value, value + nvalue, doc, false) || !doc.isObject()) {
+            failed(key, "not a JSON object");
+            return;
+        }
+        if (settings_.csv) {
+            appendCsv(key, doc);
+        } else {
+            appendJson(key, doc, value, nvalue);
+        }
+        succeeded(nvalue);
+        if (buffer_.size() >= BULK_FLUSH_SIZE) {
+            finish();
+        }
+    }
+
+  protected:
+    bool scheduleNext() override
+    {
+        string key;
+        size_t line;
+        if (!keys_.next(key, line)) {
+            return false;
+        }
+
+        lcb_CMDGET *cmd;
+        lcb_cmdget_create(&cmd);
+        lcb_cmdget_key(cmd, key.c_str(), key.size());
+        if (!settings_.collection.empty()) {
+            lcb_cmdget_collection(cmd, settings_.scope.c_str(), settings_.scope.size(), settings_.collection.c_str(),
+                                  settings_.collection.size());
+        }
+        lcb_STATUS rc = lcb_get(instance_, this, cmd);
+        lcb_cmdget_destroy(cmd);
+        if (rc == LCB_SUCCESS) {
+            scheduled();
+        } else {
+            failed(key, lcb_strerror_short(rc));
+        }
+        return true;
+    }
+
+    void finish() override
+    {
+        sink_.write(buffer_);
+        buffer_.clear();
+    }
+
+  private:
+    /** Documents which already fit on a line are written as they are, with their key added if missing */
+    void appendJson(const string &key, Json::Value &doc, const char *value, size_t nvalue)
+    {
+        const char *end = value + nvalue;
+        bool hasKey = doc.isMember(settings_.keyField);
+        if (std::find(value, end, '\n') != end || std::find(value, end, '\r') != end) {
+            if (!hasKey) {
+                doc[settings_.keyField] = key;
+            }
+            buffer_ += writer_.write(doc);
+        } else if (hasKey) {
+            buffer_.append(value, nvalue);
+        } else {
+            const char *brace = std::find(value, end, '{');
+            buffer_ += '{';
+            buffer_ += Json::valueToQuotedString(settings_.keyField.c_str());
+            buffer_ += ':';
+            buffer_ += Json::valueToQuotedString(key.c_str());
+            if (!doc.empty()) {
+                buffer_ += ',';
+            }
+            buffer_.append(brace + 1, end);
+        }
+        buffer_ += '\n';
+    }
+
+    void appendCsv(const string &key, const Json::Value &doc)
+    {
+        appendCsvField(buffer_, key);
+        for (const auto &field : settings_.fields) {
+            const Json::Value &value = doc[field];
+            buffer_ += ',';
+            if (value.isString()) {
+                appendCsvField(buffer_, value.asString());
+            } else if (!value.isNull()) {
+                appendCsvField(buffer_, writer_.write(value));
+            }
+        }
+        buffer_ += '\n';
+    }
+
+    RecordSource &keys_;
+    RecordSink &sink_;
+    const ExportSettings &settings_;
+    Json::Reader reader_;
+    Json::FastWriter writer_;
+    string buffer_;
+};
+} // namespace
+
+extern "C" {
+static void bulk_store_callback(lcb_INSTANCE *, int, const lcb_RESPSTORE *resp)
+{
+    ImportWorker *worker;
+    lcb_respstore_cookie(resp, reinterpret_cast<void **>(&worker));
+    lcb_STATUS rc = lcb_respstore_status(resp);
+    if (rc == LCB_SUCCESS) {
+        worker->succeeded();
+    } else {
+        const char *key;
+        size_t nkey;
+        lcb_respstore_key(resp, &key, &nkey);
+        worker->failed(string(key, nkey), lcb_strerror_short(rc));
+    }
+    worker->completed();
+}
+
+static void bulk_get_callback(lcb_INSTANCE *, int, const lcb_RESPGET *resp)
+{
+    ExportWorker *worker;
+    lcb_respget_cookie(resp, reinterpret_cast<void **>(&worker));
+    const char *key;
+    size_t nkey;
+    lcb_respget_key(resp, &key, &nkey);
+    lcb_STATUS rc = lcb_respget_status(resp);
+    if (rc == LCB_SUCCESS) {
+        const char *value;
+        size_t nvalue;
+        lcb_respget_value(resp, &value, &nvalue);
+        worker->write(string(key, nkey), value, nvalue);
+    } else {
+        worker->failed(string(key, nkey), lcb_strerror_short(rc));
+    }
+    worker->completed();
+}
+}
+
+void BulkHandler::addOptions()
+{
+    Handler::addOptions();
+    parser.addOption(o_format);
+    parser.addOption(o_keyField);
+    parser.addOption(o_threads);
+    parser.addOption(o_window);
+    parser.addOption(o_scope);
+    parser.addOption(o_collection);
+}
+
+bool BulkHandler::useCsv(const string &path)
+{
+    if (o_format.passed()) {
+        string s = o_format.const_result();
+        std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+        if (s == "csv") {
+            return true;
+        } else if (s == "jsonl") {
+            return false;
+        }
+        throw BadArg(string("Format must be one of jsonl, csv. Got ") + s);
+    }
+    return path.size() > 4 && path.compare(path.size() - 4, 4, ".csv") == 0;
+}
+
+lcb_INSTANCE *BulkHandler::connect()
+{
+    lcb_CREATEOPTS *cropts = nullptr;
+    lcb_INSTANCE *created = nullptr;
+    params.fillCropts(cropts);
+    lcb_STATUS err = lcb_create(&created, cropts);
+    lcb_createopts_destroy(cropts);
+    if (err != LCB_SUCCESS) {
+        throw LcbError(err, "Failed to create instance");
+    }
+    params.doCtls(created);
+    err = lcb_connect(created);
+    if (err == LCB_SUCCESS) {
+        lcb_wait(created, LCB_WAIT_DEFAULT);
+        err = lcb_get_bootstrap_status(created);
+    }
+    if (err != LCB_SUCCESS) {
+        lcb_destroy(created);
+        throw LcbError(err, "Failed to bootstrap instance");
+    }
+    return created;
+}
+
+size_t BulkHandler::window(lcb_INSTANCE *connection)
+{
+    lcb_S32 nodes = lcb_get_num_nodes(connection);
+    return static_cast<size_t>(o_window.result()) * (nodes > 0 ? nodes : 1);
+}
+
+void BulkHandler::checkOptions()
+{
+    if (o_threads.result() == 0) {
+        throw BadArg("--num-threads must be above zero");
+    }
+    if (o_window.result() == 0) {
+        throw BadArg("--window must be above zero");
+    }
+}
+
+void BulkHandler::runWorkers(vector<std::unique_ptr<BulkWorker>> &workers, const char *verb)
+{
+    auto start = std::chrono::steady_clock::now();
+    vector<std::thread> threads;
+    for (auto &worker : workers) {
+        threads.emplace_back(&BulkWorker::run, worker.get());
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    size_t ok = 0, failed = 0, bytes = 0;
+    map<string, size_t> errors;
+    for (auto &worker : workers) {
+        ok += worker->ok_;
+        failed += worker->failed_;
+        bytes += worker->bytes_;
+        for (const auto &error : worker->errors_) {
+            errors[error.first] += error.second;
+        }
+    }
+    if (elapsed <= 0) {
+        elapsed = 1e-9;
+    }
+    double mb = bytes / 1048576.0;
+    fprintf(stderr, "%s %lu documents (%.2f MB) in %.2f s: %.0f docs/s, %.2f MB/s\n", verb, (unsigned long)ok, mb,
+            elapsed, ok / elapsed, mb / elapsed);
+    if (failed != 0) {
+        fprintf(stderr, "%lu failed:\n", (unsigned long)failed);
+        for (const auto &error : errors) {
+            fprintf(stderr, "  %-40s %lu\n", error.first.c_str(), (unsigned long)error.second);
+        }
+        throw std::runtime_error(string(verb) + " with errors");
+    }
+}
+
+lcb_STORE_OPERATION ImportHandler::mode()
+{
+    string s = o_mode.const_result();
+    std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+    if (s == "upsert") {
+        return LCB_STORE_UPSERT;
+    } else if (s == "replace") {
+        return LCB_STORE_REPLACE;
+    } else if (s == "insert") {
+        return LCB_STORE_INSERT;
+    }
+    throw BadArg(string("Mode must be one of upsert, insert, replace. Got ") + s);
+}
+
+void ImportHandler::addOptions()
+{
+    BulkHandler::addOptions();
+    parser.addOption(o_mode);
+    parser.addOption(o_exp);
+    parser.addOption(o_durability);
+    parser.addOption(o_inferTypes);
+}
+
+void ImportHandler::run()
+{
+    checkOptions();
+    string path = getLoneArg(false);
+    if (path.empty()) {
+        path = "-";
+    }
+
+    ImportSettings settings;
+    settings.keyField = o_keyField.result();
+    settings.scope = o_scope.result();
+    if (o_collection.passed()) {
+        settings.collection = o_collection.result();
+    }
+    settings.operation = mode();
+    settings.durability = durability();
+    settings.expiry = o_exp.result();
+    settings.inferTypes = o_inferTypes.result();
+
+    RecordSource source(path, useCsv(path));
+    if (source.csv()) {
+        const vector<string> &columns = source.columns();
+        if (std::find(columns.begin(), columns.end(), settings.keyField) == columns.end()) {
+            throw BadArg("The CSV header has no \"" + settings.keyField + "\" column, see --key-field");
+        }
+    }
+
+    vector<std::unique_ptr<BulkWorker>> workers;
+    for (unsigned ii = 0; ii < o_threads.result(); ++ii) {
+        lcb_INSTANCE *connection = connect();
+        lcb_install_callback(connection, LCB_CALLBACK_STORE, (lcb_RESPCALLBACK)bulk_store_callback);
+        workers.emplace_back(new ImportWorker(connection, window(connection), source, settings));
+    }
+    runWorkers(workers, "Imported");
+}
+
+void ExportHandler::addOptions()
+{
+    BulkHandler::addOptions();
+    parser.addOption(o_output);
+    parser.addOption(o_fields);
+}
+
+void ExportHandler::run()
+{
+    checkOptions();
+    string path = getLoneArg(false);
+    if (path.empty()) {
+        path = "-";
+    }
+    const string &output = o_output.const_result();
+
+    ExportSettings settings;
+    settings.keyField = o_keyField.result();
+    settings.scope = o_scope.result();
+    if (o_collection.passed()) {
+        settings.collection = o_collection.result();
+    }
+    settings.csv = useCsv(output);
+    if (o_fields.passed()) {
+        vector<string> fields;
+        splitCsv(o_fields.const_result(), fields);
+        for (const auto &field : fields) {
+            if (!field.empty()) {
+                settings.fields.push_back(field);
+            }
+        }
+    }
+    if (settings.csv && settings.fields.empty()) {
+        throw BadArg("Exporting to CSV requires the --fields to write");
+    }
+
+    RecordSource keys(path, false);
+    RecordSink sink(output);
+    if (settings.csv) {
+        string header;
+        appendCsvField(header, settings.keyField);
+        for (const auto &field : settings.fields) {
+            header += ',';
+            appendCsvField(header, field);
+        }
+        header += '\n';
+        sink.write(header);
+    }
+
+    vector<std::unique_ptr<BulkWorker>> workers;
+    for (unsigned ii = 0; ii < o_threads.result(); ++ii) {
+        lcb_INSTANCE *connection = connect();
+        lcb_install_callback(connection, LCB_CALLBACK_GET, (lcb_RESPCALLBACK)bulk_get_callback);
+        workers.emplace_back(new ExportWorker(connection, window(connection), keys, sink, settings));
+    }
+    runWorkers(workers, "Exported");
+}
@@ -24,6 +24,9 @@
 #include <list>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
 
 #include <libcouchbase/couchbase.h>
 #include <libcouchbase/metrics.h>
@@ -36,6 +39,7 @@
 
 #include "common/options.h"
 #include "common/histogram.h"
+#include "common/report.h"
 #include "gen/lexer.h"
 
 #include "linenoise/linenoise.h"
@@ -596,7 +600,509 @@ void generator_loop(Worker *worker, size_t num_items)
     }
 }
 
+/**
+ * Load profile of a phase run by the instance pool: the target rate of operations over the duration of the phase.
+ */
+struct Phase {
+    enum Type { PHASE_STEADY, PHASE_RAMP, PHASE_SPIKE, PHASE_FAILOVER };
+
+    std::string name{};
+    Type type{PHASE_STEADY};
+    double duration{10};    /**< seconds */
+    double rate{0};         /**< operations per second over the pool, 0 for no limit (steady and failover only) */
+    double from{0};         /**< rate at the beginning of a ramp */
+    double peak{0};         /**< rate during the middle third of a spike */
+    std::string node{};     /**< node to fail over (otpNode, e.g. ns_1@10.0.0.2) */
+    double failover_at{0};  /**< seconds into the phase when the failover is requested */
+
+    bool unlimited() const
+    {
+        return rate == 0 && (type == PHASE_STEADY || type == PHASE_FAILOVER);
+    }
+
+    double rate_at(double elapsed) const
+    {
+        switch (type) {
+            case PHASE_RAMP:
+                return from + (rate - from) * std::min(elapsed / duration, 1.0);
+            case PHASE_SPIKE:
+                if (elapsed >= duration / 3 && elapsed < 2 * duration / 3) {
+                    return peak;
+                }
+                return rate;
+            default:
+                return rate;
+        }
+    }
+
+    static const char *type_name(Type type)
+    {
+        switch (type) {
+            case PHASE_RAMP:
+                return "ramp";
+            case PHASE_SPIKE:
+                return "spike";
+            case PHASE_FAILOVER:
+                return "failover";
+            default:
+                return "steady";
+        }
+    }
+};
+
+class InstancePool;
+struct PoolThread;
+
+struct PoolInstance {
+    lcb_INSTANCE *instance{nullptr};
+    PoolThread *thread{nullptr};
+    size_t inflight{0};
+};
+
+/** One thread of the pool, driving its share of the instances through a single event loop */
+struct PoolThread {
+    explicit PoolThread(size_t idx) : index(idx) {}
+
+    size_t index;
+    std::thread thr{};
+    lcb_io_opt_t io{nullptr};
+    std::vector<PoolInstance> instances{};
+    std::unique_ptr<KeyGenerator> keygen{};
+    std::unique_ptr<ValueGenerator> valgen{};
+    Workload workload{current_workload};
+    size_t next{0};    /**< round-robin position in instances */
+    size_t pending{0}; /**< operations in flight over all instances */
+    std::string error{};
+
+    /* cumulative over all phases, the pool subtracts the counts at the beginning of a phase */
+    LatencyBuckets latency[3]; /**< by Workload::op_type */
+    std::atomic<lcb_U64> ops{0};
+    std::atomic<lcb_U64> errors{0};
+    std::atomic<lcb_U64> timeouts{0};
+};
+
+struct PoolOp {
+    PoolInstance *inst;
+    Workload::op_type type;
+    lcb_U64 start;
+};
+
+static void pool_complete(PoolOp *op, lcb_STATUS rc)
+{
+    PoolThread *thr = op->inst->thread;
+    op->inst->inflight--;
+    thr->pending--;
+    thr->ops++;
+    /* reads and deletes of keys which have not been written yet are not failures of the cluster */
+    if (rc != LCB_SUCCESS && rc != LCB_ERR_DOCUMENT_NOT_FOUND) {
+        thr->errors++;
+        if (rc == LCB_ERR_TIMEOUT) {
+            thr->timeouts++;
+        }
+    }
+    thr->latency[op->type].record(lcb_nstime() - op->start);
+    delete op;
+}
+
+extern "C" {
+static void pool_store_callback(lcb_INSTANCE *, int, const lcb_RESPSTORE *resp)
+{
+    PoolOp *op = nullptr;
+    lcb_respstore_cookie(resp, reinterpret_cast<void **>(&op));
+    pool_complete(op, lcb_respstore_status(resp));
+}
+static void pool_get_callback(lcb_INSTANCE *, int, const lcb_RESPGET *resp)
+{
+    PoolOp *op = nullptr;
+    lcb_respget_cookie(resp, reinterpret_cast<void **>(&op));
+    pool_complete(op, lcb_respget_status(resp));
+}
+static void pool_remove_callback(lcb_INSTANCE *, int, const lcb_RESPREMOVE *resp)
+{
+    PoolOp *op = nullptr;
+    lcb_respremove_cookie(resp, reinterpret_cast<void **>(&op));
+    pool_complete(op, lcb_respremove_status(resp));
+}
+static void pool_http_callback(lcb_INSTANCE *, int, const lcb_RESPHTTP *resp)
+{
+    uint16_t status = 0;
+    const char *body = nullptr;
+    size_t nbody = 0;
+    lcb_resphttp_http_status(resp, &status);
+    lcb_resphttp_body(resp, &body, &nbody);
+    std::cout << "# failover request completed: " << lcb_strerror_short(lcb_resphttp_status(resp)) << ", HTTP "
+              << status;
+    if (nbody > 0) {
+        std::cout << ", " << std::string(body, nbody);
+    }
+    std::cout << std::endl;
+}
+}
+
+/**
+ * Runs many instances, spread over a few threads, to reproduce the fan-in of a large number of application
+ * instances from a single process. Every thread creates its instances on a shared event loop and drives them
+ * through the phases passed to run(), which blocks until the phase is over and prints the latency histograms of
+ * the phase, merged over all threads.
+ */
+class InstancePool
+{
+  public:
+    InstancePool(size_t num_instances, size_t num_threads, size_t inflight) : inflight_(inflight)
+    {
+        for (size_t ii = 0; ii < num_threads; ii++) {
+            threads_.emplace_back(new PoolThread(ii));
+        }
+        for (size_t ii = 0; ii < num_instances; ii++) {
+            threads_[ii % num_threads]->instances.emplace_back();
+        }
+        for (auto &thr : threads_) {
+            thr->thr = std::thread(&InstancePool::thread_loop, this, thr.get());
+        }
+
+        std::string error;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait(lock, [this] { return connected_ == threads_.size(); });
+        }
+        for (auto &thr : threads_) {
+            if (!thr->error.empty()) {
+                error = thr->error;
+            }
+        }
+        if (!error.empty()) {
+            shutdown();
+            throw std::runtime_error(error);
+        }
+    }
+
+    ~InstancePool()
+    {
+        shutdown();
+    }
+
+    size_t num_instances() const
+    {
+        size_t res = 0;
+        for (const auto &thr : threads_) {
+            res += thr->instances.size();
+        }
+        return res;
+    }
+
+    size_t num_threads() const
+    {
+        return threads_.size();
+    }
+
+    void run(const Phase &phase)
+    {
+        std::vector<lcb_U64> before[3];
+        lcb_U64 ops_before = 0, errors_before = 0, timeouts_before = 0;
+        for (auto &thr : threads_) {
+            for (size_t ii = 0; ii < 3; ii++) {
+                thr->latency[ii].addTo(before[ii]);
+            }
+            ops_before += thr->ops;
+            errors_before += thr->errors;
+            timeouts_before += thr->timeouts;
+            thr->workload = current_workload;
+        }
+
+        std::cout << "# phase " << phase.name << " (" << Phase::type_name(phase.type) << ") started for "
+                  << phase.duration << "s" << std::endl;
+        lcb_U64 start = lcb_nstime();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            phase_ = &phase;
+            phase_start_ = start;
+            finished_ = 0;
+            generation_++;
+        }
+        cond_.notify_all();
+
+        lcb_U64 last_ops = ops_before, last_errors = errors_before, last_time = start;
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!cond_.wait_for(lock, std::chrono::seconds(1), [this] { return finished_ == threads_.size(); })) {
+            lock.unlock();
+            lcb_U64 now = lcb_nstime(), ops = 0, errors = 0;
+            for (auto &thr : threads_) {
+                ops += thr->ops;
+                errors += thr->errors;
+            }
+            double elapsed = (now - start) / 1e9;
+            std::cout << "# " << phase.name << " " << std::fixed << std::setprecision(0) << elapsed
+                      << "s: " << (ops - last_ops) / ((now - last_time) / 1e9) << " ops/sec";
+            if (!phase.unlimited()) {
+                std::cout << " (target " << phase.rate_at(elapsed) << ")";
+            }
+            std::cout << ", " << errors - last_errors << " errors" << std::defaultfloat << std::endl;
+            last_ops = ops;
+            last_errors = errors;
+            last_time = now;
+            lock.lock();
+        }
+        lock.unlock();
+
+        double elapsed = (lcb_nstime() - start) / 1e9;
+        std::vector<lcb_U64> after[3];
+        lcb_U64 ops = 0, errors = 0, timeouts = 0;
+        for (auto &thr : threads_) {
+            for (size_t ii = 0; ii < 3; ii++) {
+                thr->latency[ii].addTo(after[ii]);
+            }
+            ops += thr->ops;
+            errors += thr->errors;
+            timeouts += thr->timeouts;
+        }
+        ops -= ops_before;
+        std::cout << "# phase " << phase.name << " (" << Phase::type_name(phase.type) << ", " << num_instances()
+                  << " instances on " << threads_.size() << " threads): " << ops << " ops, " << std::fixed
+                  << std::setprecision(1) << ops / elapsed << " ops/sec, " << errors - errors_before << " errors ("
+                  << timeouts - timeouts_before << " timeouts)" << std::defaultfloat << std::endl;
+        std::cout << "#   " << std::left << std::setw(8) << "op" << std::right << std::setw(12) << "count"
+                  << std::setw(10) << "p50" << std::setw(10) << "p90" << std::setw(10) << "p99" << std::setw(10)
+                  << "p99.9" << std::setw(10) << "max" << "  (us)" << std::endl;
+        static const char *names[] = {"write", "read", "delete"};
+        for (size_t ii = 0; ii < 3; ii++) {
+            lcb_U64 count = 0;
+            for (size_t jj = 0; jj < after[ii].size(); jj++) {
+                count += after[ii][jj] - before[ii][jj];
+            }
+            if (count == 0) {
+                continue;
+            }
+            std::cout << "#   " << std::left << std::setw(8) << names[ii] << std::right << std::setw(12) << count;
+            for (double pct : {50.0, 90.0, 99.0, 99.9, 100.0}) {
+                std::cout << std::setw(10) << LatencyBuckets::percentile(after[ii], pct, &before[ii]);
+            }
+            std::cout << std::endl;
+        }
+    }
+
+  private:
+    void connect(PoolThread *thr)
+    {
+        do_or_die(lcb_create_io_ops(&thr->io, nullptr), "Failed to create IO plugin");
+        for (auto &inst : thr->instances) {
+            lcb_CREATEOPTS *cropts = nullptr;
+            config.fillCropts(cropts);
+            lcb_createopts_io(cropts, thr->io);
+            lcb_STATUS rc = lcb_create(&inst.instance, cropts);
+            lcb_createopts_destroy(cropts);
+            do_or_die(rc, "Failed to create connection");
+            inst.thread = thr;
+            config.doCtls(inst.instance);
+            lcb_install_callback(inst.instance, LCB_CALLBACK_STORE, (lcb_RESPCALLBACK)pool_store_callback);
+            lcb_install_callback(inst.instance, LCB_CALLBACK_GET, (lcb_RESPCALLBACK)pool_get_callback);
+            lcb_install_callback(inst.instance, LCB_CALLBACK_REMOVE, (lcb_RESPCALLBACK)pool_remove_callback);
+            lcb_install_callback(inst.instance, LCB_CALLBACK_HTTP, (lcb_RESPCALLBACK)pool_http_callback);
+            do_or_die(lcb_connect(inst.instance), "Failed to connect to cluster");
+        }
+        /* the instances share the event loop, so they all bootstrap concurrently while waiting for each one */
+        for (auto &inst : thr->instances) {
+            do_or_die(lcb_wait(inst.instance, LCB_WAIT_DEFAULT), "Failed to wait for connection bootstrap");
+            do_or_die(lcb_get_bootstrap_status(inst.instance), "Failed to bootstrap");
+        }
+        if (!thr->instances.empty()) {
+            thr->keygen.reset(new DistributedKeyGenerator(thr->instances[0].instance));
+            thr->valgen.reset(new BoundedValueGenerator());
+        }
+    }
+
+    void thread_loop(PoolThread *thr)
+    {
+        try {
+            connect(thr);
+        } catch (std::exception &err) {
+            thr->error = err.what();
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            connected_++;
+        }
+        cond_.notify_all();
+
+        unsigned seen = 0;
+        while (true) {
+            const Phase *phase;
+            lcb_U64 start;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cond_.wait(lock, [this, seen] { return stopping_ || generation_ != seen; });
+                if (stopping_) {
+                    break;
+                }
+                seen = generation_;
+                phase = phase_;
+                start = phase_start_;
+            }
+            if (thr->error.empty() && !thr->instances.empty()) {
+                drive(thr, *phase, start);
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                finished_++;
+            }
+            cond_.notify_all();
+        }
+
+        for (auto &inst : thr->instances) {
+            if (inst.instance != nullptr) {
+                lcb_destroy(inst.instance);
+                inst.instance = nullptr;
+            }
+        }
+        if (thr->io != nullptr) {
+            lcb_destroy_io_ops(thr->io);
+            thr->io = nullptr;
+        }
+    }
+
+    void drive(PoolThread *thr, const Phase &phase, lcb_U64 start)
+    {
+        lcb_U64 end = start + static_cast<lcb_U64>(phase.duration * 1e9);
+        lcb_U64 last = start;
+        double credit = 0;
+        bool failover_requested = phase.node.empty() || thr->index != 0;
+
+        while (true) {
+            lcb_U64 now = lcb_nstime();
+            if (now >= end) {
+                break;
+            }
+            double elapsed = (now - start) / 1e9;
+            if (!failover_requested && elapsed >= phase.failover_at) {
+                request_failover(thr->instances[0].instance, phase.node);
+                failover_requested = true;
+            }
+
+            size_t budget = std::numeric_limits<size_t>::max();
+            if (!phase.unlimited()) {
+                double rate = phase.rate_at(elapsed) / threads_.size();
+                credit += rate * (now - last) / 1e9;
+                /* do not make up for the time the instances were saturated with a burst */
+                credit = std::min(credit, std::max(1.0, rate / 100));
+                budget = static_cast<size_t>(credit);
+            }
+            last = now;
+
+            size_t scheduled = schedule(thr, budget);
+            if (!phase.unlimited()) {
+                credit -= scheduled;
+            }
+            lcb_tick_nowait(thr->instances[0].instance);
+            if (scheduled == 0 && thr->pending == 0) {
+                usleep(100);
+            }
+        }
+        for (auto &inst : thr->instances) {
+            lcb_wait(inst.instance, LCB_WAIT_DEFAULT);
+        }
+    }
+
+    size_t schedule(PoolThread *thr, size_t budget)
+    {
+        size_t scheduled = 0, idle = 0;
+        while (scheduled < budget && idle < thr->instances.size()) {
+            PoolInstance &inst = thr->instances[thr->next];
+            thr->next = (thr->next + 1) % thr->instances.size();
+            if (inst.inflight >= inflight_ || !issue(thr, inst)) {
+                idle++;
+                continue;
+            }
+            idle = 0;
+            scheduled++;
+        }
+        return scheduled;
+    }
+
+    bool issue(PoolThread *thr, PoolInstance &inst)
+    {
+        auto *op = new PoolOp{&inst, thr->workload.next(), lcb_nstime()};
+        const std::string &key = thr->keygen->next();
+        lcb_STATUS rc = LCB_SUCCESS;
+        switch (op->type) {
+            case Workload::op_write: {
+                const std::string &value = thr->valgen->next();
+                lcb_CMDSTORE *cmd = nullptr;
+                lcb_cmdstore_create(&cmd, LCB_STORE_UPSERT);
+                lcb_cmdstore_key(cmd, key.data(), key.size());
+                lcb_cmdstore_value(cmd, value.data(), value.size());
+                lcb_cmdstore_durability(cmd, durability_level);
+                rc = lcb_store(inst.instance, op, cmd);
+                lcb_cmdstore_destroy(cmd);
+            } break;
+            case Workload::op_read: {
+                lcb_CMDGET *cmd = nullptr;
+                lcb_cmdget_create(&cmd);
+                lcb_cmdget_key(cmd, key.data(), key.size());
+                rc = lcb_get(inst.instance, op, cmd);
+                lcb_cmdget_destroy(cmd);
+            } break;
+            case Workload::op_delete: {
+                lcb_CMDREMOVE *cmd = nullptr;
+                lcb_cmdremove_create(&cmd);
+                lcb_cmdremove_key(cmd, key.data(), key.size());
+                lcb_cmdremove_durability(cmd, durability_level);
+                rc = lcb_remove(inst.instance, op, cmd);
+                lcb_cmdremove_destroy(cmd);
+            } break;
+        }
+        if (rc != LCB_SUCCESS) {
+            delete op;
+            thr->errors++;
+            return false;
+        }
+        inst.inflight++;
+        thr->pending++;
+        return true;
+    }
+
+    static void request_failover(lcb_INSTANCE *instance, const std::string &node)
+    {
+        std::string body = "otpNode=" + node;
+        lcb_CMDHTTP *cmd = nullptr;
+        lcb_cmdhttp_create(&cmd, LCB_HTTP_TYPE_MANAGEMENT);
+        lcb_cmdhttp_method(cmd, LCB_HTTP_METHOD_POST);
+        lcb_cmdhttp_path(cmd, "/controller/failOver", strlen("/controller/failOver"));
+        lcb_cmdhttp_content_type(cmd, "application/x-www-form-urlencoded",
+                                 strlen("application/x-www-form-urlencoded"));
+        lcb_cmdhttp_body(cmd, body.data(), body.size());
+        lcb_STATUS rc = lcb_http(instance, nullptr, cmd);
+        lcb_cmdhttp_destroy(cmd);
+        std::cout << "# requesting failover of " << node << ": " << lcb_strerror_short(rc) << std::endl;
+    }
+
+    void shutdown()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cond_.notify_all();
+        for (auto &thr : threads_) {
+            if (thr->thr.joinable()) {
+                thr->thr.join();
+            }
+        }
+    }
+
+    size_t inflight_;
+    std::vector<std::unique_ptr<PoolThread>> threads_{};
+
+    std::mutex mutex_{};
+    std::condition_variable cond_{};
+    size_t connected_{0};
+    bool stopping_{false};
+    unsigned generation_{0};
+    const Phase *phase_{nullptr};
+    lcb_U64 phase_start_{0};
+    size_t finished_{0};
+};
+
 std::map<std::string, Worker *> workers;
+static std::unique_ptr<InstancePool> pool;
 
 static const char *handlers_sorted[] = {"help",            // HelpHandler
                                         "create",          // CreateHandler
@@ -610,6 +1116,8 @@ static const char *handlers_sorted[] = {"help",            // HelpHandler
                                         "value-pool-size", // ValuePoolSizeHandler
                                         "value-size-max",  // ValueSizeMaxHandler
                                         "value-size-min",  // ValueSizeMinHandler
+                                        "pool",            // PoolHandler
+                                        "phase",           // PhaseHandler
                                         nullptr};
 
 static void command_completion(const char *buf, linenoiseCompletions *lc)
@@ -760,6 +1268,10 @@ class DestroyHandler : public Handler
             workers.erase(id);
             std::cout << "# worker " << id << " has been destroyed" << std::endl;
         }
+        if (pool) {
+            pool.reset();
+            std::cout << "# instance pool has been destroyed" << std::endl;
+        }
     }
 };
 
@@ -993,6 +1505,107 @@ class DurabilityLevelHandler : public Handler
   private:
 };
 
+
+class PoolHandler : public Handler
+{
+  public:
+    HANDLER_DESCRIPTION("Create pool of instances driven by a few threads, for the phase command")
+    PoolHandler() : Handler("pool") {}
+
+  protected:
+    void execute(bm_COMMAND &cmd) override
+    {
+        if (cmd.options.empty()) {
+            if (pool) {
+                std::cout << "# pool of " << pool->num_instances() << " instance(s) on " << pool->num_threads()
+                          << " thread(s)" << std::endl;
+            } else {
+                std::cout << "# no instance pool, use --instances to create one" << std::endl;
+            }
+            return;
+        }
+        size_t num_instances = 1, num_threads = std::max(1u, std::thread::hardware_concurrency()), inflight = 1;
+        if (cmd.options.count("instances")) {
+            num_instances = std::stoull(cmd.options["instances"]);
+        }
+        if (cmd.options.count("threads")) {
+            num_threads = std::stoull(cmd.options["threads"]);
+        }
+        if (cmd.options.count("inflight")) {
+            inflight = std::stoull(cmd.options["inflight"]);
+        }
+        if (num_instances == 0 || num_threads == 0 || inflight == 0) {
+            throw std::runtime_error("Number of instances, threads and operations in flight must be positive");
+        }
+        num_threads = std::min(num_threads, num_instances);
+        pool.reset();
+        pool.reset(new InstancePool(num_instances, num_threads, inflight));
+        std::cout << "# pool of " << num_instances << " instance(s) on " << num_threads
+                  << " thread(s) has been created and connected" << std::endl;
+    }
+};
+
+class PhaseHandler : public Handler
+{
+  public:
+    HANDLER_DESCRIPTION("Run load phase (steady, ramp, spike or failover) on the instance pool")
+    PhaseHandler() : Handler("phase") {}
+
+  protected:
+    void execute(bm_COMMAND &cmd) override
+    {
+        if (!pool) {
+            throw std::runtime_error("Create instance pool first, e.g. pool --instances=1000 --threads=8");
+        }
+        Phase phase;
+        phase.name = cmd.args.empty() ? "phase" : cmd.args[0];
+        std::string type = cmd.options.count("type") ? cmd.options["type"] : "steady";
+        if (type == "steady") {
+            phase.type = Phase::PHASE_STEADY;
+        } else if (type == "ramp") {
+            phase.type = Phase::PHASE_RAMP;
+        } else if (type == "spike") {
+            phase.type = Phase::PHASE_SPIKE;
+        } else if (type == "failover") {
+            phase.type = Phase::PHASE_FAILOVER;
+        } else {
+            throw std::runtime_error("Unknown phase type. Use one of: steady, ramp, spike, failover");
+        }
+        if (cmd.options.count("duration")) {
+            phase.duration = std::stod(cmd.options["duration"]);
+        }
+        if (cmd.options.count("rate")) {
+            phase.rate = std::stod(cmd.options["rate"]);
+        }
+        if (cmd.options.count("from")) {
+            phase.from = std::stod(cmd.options["from"]);
+        }
+        if (cmd.options.count("peak")) {
+            phase.peak = std::stod(cmd.options["peak"]);
+        }
+        if (cmd.options.count("node")) {
+            phase.node = cmd.options["node"];
+        }
+        phase.failover_at = phase.duration / 4;
+        if (cmd.options.count("at")) {
+            phase.failover_at = std::stod(cmd.options["at"]);
+        }
+        if (phase.duration <= 0 || phase.rate < 0 || phase.from < 0) {
+            throw std::runtime_error("Phase duration must be positive, and rates must not be negative");
+        }
+        if (phase.type == Phase::PHASE_RAMP && phase.rate == 0 && phase.from == 0) {
+            throw std::runtime_error("Ramp needs target --rate (and optionally --from)");
+        }
+        if (phase.type == Phase::PHASE_SPIKE && (phase.rate == 0 || phase.peak <= phase.rate)) {
+            throw std::runtime_error("Spike needs --rate and a higher --peak");
+        }
+        if (!phase.node.empty() && phase.type != Phase::PHASE_FAILOVER) {
+            throw std::runtime_error("Only failover phase accepts --node");
+        }
+        pool->run(phase);
+    }
+};
+
 } // namespace gen
 
 static void setupHandlers()
@@ -1011,6 +1624,8 @@ static void setupHandlers()
     handlers["value-size-min"] = new gen::ValueSizeMinHandler();
     handlers["value-size-max"] = new gen::ValueSizeMaxHandler();
     handlers["workload"] = new gen::WorkloadHandler();
+    handlers["pool"] = new gen::PoolHandler();
+    handlers["phase"] = new gen::PhaseHandler();
 }
 
 bool cleaning = false;
@@ -18,6 +18,7 @@
 #ifndef CBC_HANDLERS_H
 #define CBC_HANDLERS_H
 #include "config.h"
+#include <memory>
 #include "common/options.h"
 #include "common/histogram.h"
 
@@ -1013,5 +1014,92 @@ class CollectionGetCIDHandler : public Handler
     cliopts::StringOption o_scope;
 };
 
+class BulkWorker;
+
+/**
+ * Common part of import and export: each thread gets its own instance, and
+ * keeps a window of operations in flight which is refilled as they complete.
+ */
+class BulkHandler : public Handler
+{
+  public:
+    explicit BulkHandler(const char *name)
+        : Handler(name), o_format("format"), o_keyField("key-field"), o_threads("num-threads"), o_window("window"),
+          o_scope("scope"), o_collection("collection")
+    {
+        o_format.abbrev('F').argdesc("jsonl|csv").description("Format of the documents (default: from the file name)");
+        o_keyField.abbrev('k').description("Field of the documents holding their keys").setDefault("id");
+        o_threads.abbrev('t').description("Number of threads, each with its own instance").setDefault(1);
+        o_window.abbrev('w').description("Operations in flight per node, for each thread").setDefault(32);
+        o_scope.description("Name of the collection scope").setDefault("_default");
+        o_collection.description("Name of the collection");
+    }
+
+  protected:
+    void addOptions() override;
+    void checkOptions();
+    bool useCsv(const std::string &path);
+    lcb_INSTANCE *connect();
+    size_t window(lcb_INSTANCE *connection);
+    void runWorkers(std::vector<std::unique_ptr<BulkWorker>> &workers, const char *verb);
+
+    cliopts::StringOption o_format;
+    cliopts::StringOption o_keyField;
+    cliopts::UIntOption o_threads;
+    cliopts::UIntOption o_window;
+    cliopts::StringOption o_scope;
+    cliopts::StringOption o_collection;
+};
+
+class ImportHandler : public BulkHandler
+{
+  public:
+    HANDLER_DESCRIPTION("Store the documents of a JSONL or CSV file")
+    HANDLER_USAGE("[OPTIONS...] [FILE]")
+    ImportHandler()
+        : BulkHandler("import"), o_mode("mode"), o_exp("expiry"), o_durability("durability"),
+          o_inferTypes("infer-types")
+    {
+        o_mode.abbrev('M').argdesc("upsert|insert|replace").description("Mode to use when storing");
+        o_mode.setDefault("upsert");
+        o_exp.abbrev('e').description("Expiry for the documents");
+        o_durability.abbrev('d').description("Durability level").setDefault("none");
+        o_inferTypes.description("Store numbers and booleans of CSV fields as such rather than as strings");
+    }
+
+    lcb_STORE_OPERATION mode();
+    DURABILITY_GETTER()
+
+  protected:
+    void addOptions() override;
+    void run() override;
+
+  private:
+    cliopts::StringOption o_mode;
+    cliopts::UIntOption o_exp;
+    cliopts::StringOption o_durability;
+    cliopts::BoolOption o_inferTypes;
+};
+
+class ExportHandler : public BulkHandler
+{
+  public:
+    HANDLER_DESCRIPTION("Write the documents of a list of keys to a JSONL or CSV file")
+    HANDLER_USAGE("[OPTIONS...] [KEYS-FILE]")
+    ExportHandler() : BulkHandler("export"), o_output("output"), o_fields("fields")
+    {
+        o_output.abbrev('o').description("File to write the documents to").setDefault("-");
+        o_fields.abbrev('f').description("Comma-separated fields to write as the columns of CSV");
+    }
+
+  protected:
+    void addOptions() override;
+    void run() override;
+
+  private:
+    cliopts::StringOption o_output;
+    cliopts::StringOption o_fields;
+};
+
 } // namespace cbc
 #endif
@@ -29,12 +29,14 @@
 #include <random>
 #include <algorithm>
 #include <stdexcept>
+#include <atomic>
+#include <sstream>
 #ifndef WIN32
 #include <pthread.h>
 #include <unistd.h> // isatty()
 #endif
 #include "common/options.h"
-#include "common/histogram.h"
+#include "common/report.h"
 #include "contrib/lcb-jsoncpp/lcb-jsoncpp.h"
 
 using namespace cbc;
@@ -57,73 +59,66 @@ static void do_or_die(lcb_STATUS rc)
     }
 }
 
+/** Report of --report, with the single operation type "query" */
+static BenchReport report;
+
 struct Query {
     std::string payload{};
     bool prepare{false};
+    /** Position in the query file, which indexes the per-statement metrics */
+    size_t index{0};
+    std::string statement{};
+};
+
+/**
+ * Counters and latencies of one thread. Only the thread itself writes them (with relaxed atomics) and the reporter
+ * merges those of all threads, so workers never wait for each other or for the display.
+ */
+struct ThreadMetrics {
+    /** Latency breakdown of one statement of the query file */
+    struct Statement {
+        /** Time the request waited in the query service before it executed (elapsedTime - executionTime) */
+        LatencyBuckets queue{};
+        LatencyBuckets first_row{};
+        LatencyBuckets total{};
+    };
+
+    explicit ThreadMetrics(size_t nstatements) : statements(nstatements) {}
+
+    std::atomic<lcb_U64> rows{0};
+    std::atomic<lcb_U64> queries{0};
+    std::atomic<lcb_U64> errors{0};
+    std::vector<Statement> statements;
 };
 
 class Metrics
 {
   public:
-    Metrics() : n_rows(0), n_queries(0), n_errors(0), last_update(time(nullptr)), hg(nullptr)
+    Metrics() : last_update(time(nullptr)), timings(false)
     {
-#ifndef _WIN32
-        if (pthread_mutex_init(&m_lock, nullptr) != 0) {
-            abort();
-        }
-#endif
         start_time = last_update;
     }
 
-    size_t nerrors() const
+    void add_thread(const ThreadMetrics *tm)
     {
-        return n_errors;
+        threads.push_back(tm);
     }
 
-    void update_row(size_t n = 1)
-    {
-        n_rows += n;
-        update_display();
-    }
-    void update_done(size_t n = 1)
+    /** Number of errors so far, to label the entries of the error log */
+    size_t next_error_index()
     {
-        n_queries += n;
-        update_display();
-    }
-    void update_error(size_t n = 1)
-    {
-        n_errors += n;
-        update_display();
-    }
-
-    void update_timings(lcb_U64 duration)
-    {
-        if (hg != nullptr) {
-            hg->record(duration);
-        }
+        return ++n_errlog;
     }
 
-#ifndef _WIN32
     static bool is_tty()
     {
+#ifndef _WIN32
         return isatty(STDOUT_FILENO);
-    }
-    void lock()
-    {
-        pthread_mutex_lock(&m_lock);
-    }
-    void unlock()
-    {
-        pthread_mutex_unlock(&m_lock);
-    }
 #else
-    void lock() {}
-    void unlock() {}
-    static bool is_tty()
-    {
         return false;
-    }
 #endif
+    }
+
     static void prepare_screen()
     {
         if (is_tty() && use_ansi_codes) {
@@ -133,14 +128,11 @@ class Metrics
 
     void prepare_timings()
     {
-        if (hg == nullptr) {
-            hg = new Histogram();
-            hg->installStandalone(stdout);
-        }
+        timings = true;
     }
 
-  private:
-    void update_display()
+    /** Merges the counters of all threads and prints the rates since the previous update. Called by the reporter. */
+    void update_display(const vector<Query> &queries)
     {
         time_t now = time(nullptr);
         time_t duration = now - last_update;
@@ -151,12 +143,19 @@ class Metrics
 
         last_update = now;
 
+        lcb_U64 n_rows = 0, n_queries = 0, n_errors = 0;
+        for (const auto *tm : threads) {
+            n_rows += tm->rows.load(std::memory_order_relaxed);
+            n_queries += tm->queries.load(std::memory_order_relaxed);
+            n_errors += tm->errors.load(std::memory_order_relaxed);
+        }
+
         const char *prefix;
         const char *final_suffix;
 
         // Only use "ticker" style updates if we're a TTY and we have no
         // following timings.
-        if (use_ansi_codes && is_tty() && hg == nullptr) {
+        if (use_ansi_codes && is_tty() && !timings) {
             // Move up 3 cursors
             printf("\x1B[2A");
             prefix = "\x1B[K";
@@ -170,34 +169,90 @@ class Metrics
             final_suffix = "\n";
         }
 
-        printf("%sQUERIES/SEC: %lu\n", prefix, (unsigned long)(n_queries / duration));
-        printf("%sROWS/SEC:    %lu\n", prefix, (unsigned long)(n_rows / duration));
+        printf("%sQUERIES/SEC: %lu\n", prefix, (unsigned long)((n_queries - last_queries) / duration));
+        printf("%sROWS/SEC:    %lu\n", prefix, (unsigned long)((n_rows - last_rows) / duration));
         printf("%sERRORS:      %lu%s", prefix, (unsigned long)n_errors, final_suffix);
 
-        if (hg != nullptr) {
-            hg->write();
+        if (timings) {
+            print_statements(queries, stdout);
         }
         fflush(stdout);
 
-        n_queries = 0;
-        n_rows = 0;
+        last_queries = n_queries;
+        last_rows = n_rows;
+    }
+
+    /** @return the merged histogram of the total latency of a statement, see LatencyBuckets::addTo() */
+    vector<lcb_U64> total_latency(size_t index) const
+    {
+        vector<lcb_U64> counts;
+        for (const auto *tm : threads) {
+            tm->statements[index].total.addTo(counts);
+        }
+        return counts;
+    }
+
+    /** Prints the latency breakdown of each statement over the whole run */
+    void print_statements(const vector<Query> &queries, FILE *out) const
+    {
+        fprintf(out, "%-40s %10s %17s %17s %17s\n", "STATEMENT", "QUERIES", "QUEUE p50/p99", "FIRST ROW p50/p99",
+                "TOTAL p50/p99");
+        for (const auto &query : queries) {
+            vector<lcb_U64> queue, first_row, total;
+            for (const auto *tm : threads) {
+                const ThreadMetrics::Statement &st = tm->statements[query.index];
+                st.queue.addTo(queue);
+                st.first_row.addTo(first_row);
+                st.total.addTo(total);
+            }
+            lcb_U64 count = 0;
+            for (lcb_U64 n : total) {
+                count += n;
+            }
+            string label = query.statement.size() > 40 ? query.statement.substr(0, 37) + "..." : query.statement;
+            fprintf(out, "%-40s %10llu %17s %17s %17s\n", label.c_str(), (unsigned long long)count,
+                    format_percentiles(queue).c_str(), format_percentiles(first_row).c_str(),
+                    format_percentiles(total).c_str());
+        }
     }
 
-    size_t n_rows;
-    size_t n_queries;
-    size_t n_errors;
+    static string format_us(lcb_U64 us)
+    {
+        char buf[32];
+        if (us < 10000) {
+            snprintf(buf, sizeof(buf), "%lluus", (unsigned long long)us);
+        } else if (us < 10000000) {
+            snprintf(buf, sizeof(buf), "%llums", (unsigned long long)(us / 1000));
+        } else {
+            snprintf(buf, sizeof(buf), "%llus", (unsigned long long)(us / 1000000));
+        }
+        return buf;
+    }
+
+    static string format_percentiles(const vector<lcb_U64> &counts)
+    {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%s/%s", format_us(LatencyBuckets::percentile(counts, 50)).c_str(),
+                 format_us(LatencyBuckets::percentile(counts, 99)).c_str());
+        return buf;
+    }
+
+  private:
+    vector<const ThreadMetrics *> threads{};
+    std::atomic<size_t> n_errlog{0};
+    lcb_U64 last_rows{0};
+    lcb_U64 last_queries{0};
     time_t last_update;
     time_t start_time;
-    cbc::Histogram *hg;
-#ifndef _WIN32
-    pthread_mutex_t m_lock{};
-#endif
+    bool timings;
 };
 
 class Configuration
 {
   public:
-    Configuration() : o_file("queryfile"), o_threads("num-threads"), o_errlog("error-log"), m_errlog(nullptr)
+    Configuration()
+        : o_file("queryfile"), o_threads("num-threads"), o_errlog("error-log"), o_duration("duration"),
+          o_preparedVsAdhoc("prepared-vs-adhoc"), m_errlog(nullptr)
     {
         o_file.mandatory(true);
         o_file.description("Path to a file containing all the queries to execute. "
@@ -211,6 +266,12 @@ class Configuration
         o_errlog.description("Path to a file containing failed queries");
         o_errlog.abbrev('e');
         o_errlog.setDefault("");
+
+        o_duration.description("Stop after this many seconds (0 runs until interrupted)");
+        o_duration.setDefault(0);
+
+        o_preparedVsAdhoc.description("Run the queries for --duration seconds as adhoc queries, then as prepared "
+                                      "statements, and compare the latencies of each statement");
     }
 
     ~Configuration()
@@ -225,11 +286,17 @@ class Configuration
         parser.addOption(o_file);
         parser.addOption(o_threads);
         parser.addOption(o_errlog);
+        parser.addOption(o_duration);
+        parser.addOption(o_preparedVsAdhoc);
         m_params.addToParser(parser);
+        m_report.addToParser(parser);
     }
 
     void processOptions()
     {
+        if (o_preparedVsAdhoc.result() && o_duration.result() == 0) {
+            throw std::runtime_error("--prepared-vs-adhoc requires --duration");
+        }
         std::ifstream ifs(o_file.const_result().c_str());
         if (!ifs.is_open()) {
             int ec_save = errno;
@@ -249,6 +316,8 @@ class Configuration
                     continue;
                 }
                 Query query{};
+                query.index = m_queries.size();
+                query.statement = json.get("statement", "").asString();
                 Json::Value options = json.get("n1qlback", Json::nullValue);
                 if (options.isObject()) {
                     Json::Value should_prepare = options.get("prepare", Json::nullValue);
@@ -292,6 +361,22 @@ class Configuration
     {
         return o_threads.result();
     }
+    unsigned duration()
+    {
+        return o_duration.result();
+    }
+    bool prepared_vs_adhoc()
+    {
+        return o_preparedVsAdhoc.result();
+    }
+    bool timings()
+    {
+        return m_params.useTimings();
+    }
+    ReportParams &reportParams()
+    {
+        return m_report;
+    }
     std::ofstream *errlog()
     {
         return m_errlog;
@@ -308,6 +393,9 @@ class Configuration
     UIntOption o_threads;
     ConnParams m_params;
     StringOption o_errlog;
+    UIntOption o_duration;
+    BoolOption o_preparedVsAdhoc;
+    ReportParams m_report;
     std::ofstream *m_errlog;
     Metrics m_metrics{};
 };
@@ -319,13 +407,82 @@ extern "C" {
 static void *pthrfunc(void *);
 }
 
+/** Parses a duration of the query service metrics, such as "1.5ms" or "1m2.5s" */
+static bool parse_service_duration(const string &str, lcb_U64 &ns)
+{
+    const char *p = str.c_str();
+    double total = 0;
+    while (*p != '\0') {
+        char *end = nullptr;
+        double value = strtod(p, &end);
+        if (end == p) {
+            return false;
+        }
+        p = end;
+        double unit;
+        if (strncmp(p, "ns", 2) == 0) {
+            unit = 1;
+            p += 2;
+        } else if (strncmp(p, "us", 2) == 0) {
+            unit = 1e3;
+            p += 2;
+        } else if (strncmp(p, "\xC2\xB5s", 3) == 0) { // "µs"
+            unit = 1e3;
+            p += 3;
+        } else if (strncmp(p, "ms", 2) == 0) {
+            unit = 1e6;
+            p += 2;
+        } else if (*p == 's') {
+            unit = 1e9;
+            p += 1;
+        } else if (*p == 'm') {
+            unit = 60e9;
+            p += 1;
+        } else if (*p == 'h') {
+            unit = 3600e9;
+            p += 1;
+        } else {
+            return false;
+        }
+        total += value * unit;
+    }
+    ns = static_cast<lcb_U64>(total);
+    return true;
+}
+
+/**
+ * Time the request waited in the query service before it started to execute, derived from the metrics in the meta
+ * data of the final response
+ */
+static bool queue_time(const char *meta, size_t nmeta, lcb_U64 &ns)
+{
+    Json::Value json;
+    if (!parse_json(string(meta, nmeta), json) || !json.isObject()) {
+        return false;
+    }
+    const Json::Value &metrics = json["metrics"];
+    lcb_U64 elapsed, execution;
+    if (!metrics.isObject() || !parse_service_duration(metrics["elapsedTime"].asString(), elapsed) ||
+        !parse_service_duration(metrics["executionTime"].asString(), execution)) {
+        return false;
+    }
+    ns = elapsed > execution ? elapsed - execution : 0;
+    return true;
+}
+
 class ThreadContext;
 struct QueryContext {
     lcb_U64 begin;
     bool received;      // whether any row was received
+    size_t nbytes;      // size of the rows received
     ThreadContext *ctx; // Parent
 
-    explicit QueryContext(ThreadContext *tctx) : begin(lcb_nstime()), received(false), ctx(tctx) {}
+    const Query &query;
+
+    QueryContext(ThreadContext *tctx, const Query &q)
+        : begin(lcb_nstime()), received(false), nbytes(0), ctx(tctx), query(q)
+    {
+    }
 };
 
 class ThreadContext
@@ -356,14 +513,14 @@ class ThreadContext
         assert(m_thr != nullptr);
         void *arg = nullptr;
         pthread_join(*m_thr, &arg);
+        delete m_thr;
+        m_thr = nullptr;
     }
 
     ~ThreadContext()
     {
         if (m_thr != nullptr) {
             join();
-            delete m_thr;
-            m_thr = nullptr;
         }
         lcb_cmdquery_destroy(m_cmd);
     }
@@ -377,17 +534,28 @@ class ThreadContext
 
     void handle_response(const lcb_RESPQUERY *resp, QueryContext *ctx)
     {
+        ThreadMetrics::Statement &stmt = m_metrics.statements[ctx->query.index];
         if (!ctx->received) {
-            lcb_U64 duration = lcb_nstime() - ctx->begin;
-            m_metrics.lock();
-            m_metrics.update_timings(duration);
-            m_metrics.unlock();
-
+            stmt.first_row.record(lcb_nstime() - ctx->begin);
             ctx->received = true;
         }
 
         if (lcb_respquery_is_final(resp)) {
             lcb_STATUS rc = lcb_respquery_status(resp);
+            lcb_U64 duration = lcb_nstime() - ctx->begin;
+            stmt.total.record(duration);
+            if (rc == LCB_SUCCESS) {
+                const char *p;
+                size_t n;
+                lcb_respquery_row(resp, &p, &n);
+                lcb_U64 queue_ns;
+                if (queue_time(p, n, queue_ns)) {
+                    stmt.queue.record(queue_ns);
+                }
+            }
+            if (report.isOpen()) {
+                report.record(0, duration, rc == LCB_SUCCESS, ctx->nbytes);
+            }
             if (rc != LCB_SUCCESS) {
                 if (m_errlog != nullptr) {
                     const char *p;
@@ -406,13 +574,26 @@ class ThreadContext
             }
         } else {
             last_nrow++;
+            if (report.isOpen()) {
+                const char *p;
+                size_t n;
+                lcb_respquery_row(resp, &p, &n);
+                ctx->nbytes += n;
+            }
         }
     }
 
+    /** Stops the thread once the query it runs completes */
+    void cancel()
+    {
+        m_cancelled = true;
+    }
+
     ThreadContext(Metrics &metrics, lcb_INSTANCE *instance, const vector<Query> &initial_queries, std::ofstream *errlog)
-        : m_instance(instance), last_nrow(0), m_cmd(nullptr), m_metrics(metrics), m_cancelled(false), m_thr(nullptr),
-          m_errlog(errlog)
+        : m_instance(instance), last_nrow(0), m_cmd(nullptr), m_metrics(initial_queries.size()), m_cancelled(false),
+          m_thr(nullptr), m_errlog(errlog), m_reporter(metrics)
     {
+        m_reporter.add_thread(&m_metrics);
         lcb_cmdquery_create(&m_cmd);
         lcb_cmdquery_callback(m_cmd, n1qlcb);
 
@@ -426,11 +607,8 @@ class ThreadContext
   private:
     void log_error(lcb_STATUS err, const char *info, size_t ninfo)
     {
-        size_t erridx;
-        m_metrics.lock();
-        m_metrics.update_error();
-        erridx = m_metrics.nerrors();
-        m_metrics.unlock();
+        m_metrics.errors.fetch_add(1, std::memory_order_relaxed);
+        size_t erridx = m_reporter.next_error_index();
 
         if (m_errlog != nullptr) {
             std::stringstream ss;
@@ -453,18 +631,22 @@ class ThreadContext
         lcb_cmdquery_adhoc(m_cmd, !query.prepare);
 
         // Set up our context
-        QueryContext qctx(this);
+        QueryContext qctx(this, query);
 
         lcb_STATUS rc = lcb_query(m_instance, &qctx, m_cmd);
+        if (report.isOpen()) {
+            report.addBytesOut(0, query.payload.size());
+        }
         if (rc != LCB_SUCCESS) {
+            if (report.isOpen()) {
+                report.record(0, lcb_nstime() - qctx.begin, false);
+            }
             log_error(rc, query.payload.c_str(), query.payload.size());
             lcb_tick_nowait(m_instance);
         } else {
             lcb_wait(m_instance, LCB_WAIT_DEFAULT);
-            m_metrics.lock();
-            m_metrics.update_row(last_nrow);
-            m_metrics.update_done(1);
-            m_metrics.unlock();
+            m_metrics.rows.fetch_add(last_nrow, std::memory_order_relaxed);
+            m_metrics.queries.fetch_add(1, std::memory_order_relaxed);
         }
     }
 
@@ -472,7 +654,7 @@ class ThreadContext
     vector<Query> m_queries;
     size_t last_nrow;
     lcb_CMDQUERY *m_cmd;
-    Metrics &m_metrics;
+    ThreadMetrics m_metrics;
     volatile bool m_cancelled;
 #ifndef _WIN32
     pthread_t *m_thr;
@@ -480,6 +662,7 @@ class ThreadContext
     void *m_thr;
 #endif
     std::ofstream *m_errlog;
+    Metrics &m_reporter;
 };
 
 static void n1qlcb(lcb_INSTANCE *, int, const lcb_RESPQUERY *resp)
@@ -514,6 +697,114 @@ static bool instance_has_n1ql(lcb_INSTANCE *instance)
     return hix > -1;
 }
 
+/** Runs the queries on one thread per instance until --duration elapses (or forever), then prints the statements */
+static void run_queries(Configuration &config, const vector<lcb_INSTANCE *> &instances, const vector<Query> &queries,
+                        Metrics &metrics)
+{
+    vector<ThreadContext *> threads;
+    for (auto *instance : instances) {
+        threads.push_back(new ThreadContext(metrics, instance, queries, config.errlog()));
+    }
+
+    Metrics::prepare_screen();
+
+    for (auto &thread : threads) {
+        thread->start();
+    }
+#ifndef _WIN32
+    // The workers only count, this thread merges and displays their metrics
+    lcb_U64 end = lcb_nstime() + config.duration() * 1000000000ULL;
+    lcb_U64 next_flush = lcb_nstime() + 1000000000ULL;
+    while (config.duration() == 0 || lcb_nstime() < end) {
+        usleep(100000);
+        if (lcb_nstime() >= next_flush) {
+            metrics.update_display(queries);
+            report.flush();
+            next_flush += 1000000000ULL;
+        }
+    }
+    for (auto &thread : threads) {
+        thread->cancel();
+    }
+#endif
+    for (auto &thread : threads) {
+        thread->join();
+    }
+    printf("\n");
+    metrics.print_statements(queries, stdout);
+    for (auto &thread : threads) {
+        delete thread;
+    }
+}
+
+static lcb_QUERY_CACHE_STATS query_cache_stats(const vector<lcb_INSTANCE *> &instances)
+{
+    lcb_QUERY_CACHE_STATS total{};
+    for (auto *instance : instances) {
+        lcb_QUERY_CACHE_STATS stats{};
+        do_or_die(lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_QUERY_CACHE_STATS, &stats));
+        total.size += stats.size;
+        total.hits += stats.hits;
+        total.misses += stats.misses;
+        total.prepares += stats.prepares;
+        total.evictions += stats.evictions;
+    }
+    return total;
+}
+
+static string format_delta(lcb_U64 from, lcb_U64 to)
+{
+    char buf[32];
+    if (from == 0) {
+        return "-";
+    }
+    snprintf(buf, sizeof(buf), "%+.1f%%", (double(to) - double(from)) * 100 / double(from));
+    return buf;
+}
+
+/** Runs the queries as adhoc queries, then as prepared statements, and prints the difference */
+static void compare_prepared(Configuration &config, const vector<lcb_INSTANCE *> &instances)
+{
+    vector<Query> adhoc = config.queries();
+    vector<Query> prepared = config.queries();
+    for (auto &query : adhoc) {
+        query.prepare = false;
+    }
+    for (auto &query : prepared) {
+        query.prepare = true;
+    }
+    Metrics adhoc_metrics, prepared_metrics;
+    if (config.timings()) {
+        adhoc_metrics.prepare_timings();
+        prepared_metrics.prepare_timings();
+    }
+
+    printf("Running adhoc queries for %us\n", config.duration());
+    run_queries(config, instances, adhoc, adhoc_metrics);
+    lcb_QUERY_CACHE_STATS before = query_cache_stats(instances);
+    printf("\nRunning prepared statements for %us\n", config.duration());
+    run_queries(config, instances, prepared, prepared_metrics);
+    lcb_QUERY_CACHE_STATS after = query_cache_stats(instances);
+
+    printf("\n%-40s %17s %17s %9s %9s\n", "STATEMENT", "ADHOC p50/p99", "PREPARED p50/p99", "p50", "p99");
+    for (const auto &query : config.queries()) {
+        vector<lcb_U64> a = adhoc_metrics.total_latency(query.index);
+        vector<lcb_U64> b = prepared_metrics.total_latency(query.index);
+        lcb_U64 a50 = LatencyBuckets::percentile(a, 50), a99 = LatencyBuckets::percentile(a, 99);
+        lcb_U64 b50 = LatencyBuckets::percentile(b, 50), b99 = LatencyBuckets::percentile(b, 99);
+        string label = query.statement.size() > 40 ? query.statement.substr(0, 37) + "..." : query.statement;
+        printf("%-40s %17s %17s %9s %9s\n", label.c_str(),
+               (Metrics::format_us(a50) + "/" + Metrics::format_us(a99)).c_str(),
+               (Metrics::format_us(b50) + "/" + Metrics::format_us(b99)).c_str(), format_delta(a50, b50).c_str(),
+               format_delta(a99, b99).c_str());
+    }
+    printf("\nQuery cache (all instances): PREPARE round trips: %llu, hits: %llu, misses: %llu, evictions: %llu, "
+           "statements cached: %llu\n",
+           (unsigned long long)(after.prepares - before.prepares), (unsigned long long)(after.hits - before.hits),
+           (unsigned long long)(after.misses - before.misses),
+           (unsigned long long)(after.evictions - before.evictions), (unsigned long long)after.size);
+}
+
 static void real_main(int argc, char **argv)
 {
     Configuration config;
@@ -522,12 +813,12 @@ static void real_main(int argc, char **argv)
     config.addToParser(parser);
     parser.parse(argc, argv);
 
-    vector<ThreadContext *> threads;
     vector<lcb_INSTANCE *> instances;
 
     lcb_CREATEOPTS *cropts = nullptr;
     config.set_cropts(cropts);
     config.processOptions();
+    config.reportParams().open(report, {"query"});
 
     for (size_t ii = 0; ii < config.nthreads(); ii++) {
         lcb_INSTANCE *instance;
@@ -539,24 +830,22 @@ static void real_main(int argc, char **argv)
         if (ii == 0 && !instance_has_n1ql(instance)) {
             throw std::runtime_error("Cluster does not support N1QL!");
         }
-
-        auto *cx = new ThreadContext(config.metrics(), instance, config.queries(), config.errlog());
-        threads.push_back(cx);
         instances.push_back(instance);
     }
     lcb_createopts_destroy(cropts);
 
-    Metrics::prepare_screen();
-
-    for (auto &thread : threads) {
-        thread->start();
-    }
-    for (auto &thread : threads) {
-        thread->join();
+    if (config.prepared_vs_adhoc()) {
+        compare_prepared(config, instances);
+    } else {
+        run_queries(config, instances, config.queries(), config.metrics());
     }
+    bool regressed = config.reportParams().finish(report);
     for (auto &instance : instances) {
         lcb_destroy(instance);
     }
+    if (regressed) {
+        throw std::runtime_error("Performance regressed compared to the baseline");
+    }
 }
 
 int main(int argc, char **argv)
@@ -27,6 +27,7 @@
 #include <cstdlib>
 #include <fstream>
 #include <csignal>
+#include <atomic>
 #ifndef WIN32
 #include <pthread.h>
 #include <libcouchbase/metrics.h>
@@ -39,11 +40,22 @@
 #include <memcached/protocol_binary.h>
 #include "common/options.h"
 #include "common/histogram.h"
+#include "common/report.h"
 
 #include "docgen/seqgen.h"
 #include "docgen/docgen.h"
+#include "docgen/corpus.h"
+#include "docgen/workload.h"
 #include "internalstructs.h"
 #include "internal.h"
+#include "capi/cmd_noop.hh"
+#include "lcbio/iotable.h"
+
+#ifdef LCB_USE_HDR_HISTOGRAM
+#include <hdr_histogram.h>
+#include <hdr_histogram_log.h>
+#include <hdr_interval_recorder.h>
+#endif
 
 using namespace std;
 using namespace cbc;
@@ -106,7 +118,10 @@ class Configuration
           o_templatePairs("template"), o_subdoc("subdoc"), o_noop("noop"), o_sdPathCount("pathcount"),
           o_populateOnly("populate-only"), o_upsertExptime("expiry"), o_getExptime("get-expiry"),
           o_collection("collection"), o_durability("durability"), o_persist("persist-to"), o_replicate("replicate-to"),
-          o_lock("lock"), o_randSpace("rand-space-per-thread")
+          o_lock("lock"), o_randSpace("rand-space-per-thread"), o_openLoop("open-loop"), o_latencyLog("latency-log"),
+          o_workload("workload"), o_concurrency("concurrency"), o_stepDuration("step-duration"), o_corpus("corpus"),
+          o_populateDepth("populate-depth"), o_populatePartition("populate-partition"),
+          o_populateSkipExisting("populate-skip-existing")
     {
         o_multiSize.setDefault(100).abbrev('B').description("Number of operations to batch");
         o_numItems.setDefault(1000).abbrev('I').description("Number of items to operate on");
@@ -146,6 +161,28 @@ class Configuration
         o_lock.description("Lock keys for updates for given time (will not lock when set to zero)").setDefault(0);
         o_randSpace.description("When set and --sequential is not set, threads will perform operations on different key"
                                 " spaces").setDefault(false);
+        o_openLoop.description("Start operations on a fixed schedule given by --rate-limit, whether or not the previous "
+                               "ones completed, and measure latency from the scheduled start time").setDefault(false);
+        o_latencyLog.description("Write the latencies of every second as an HdrHistogram interval log to this file");
+        o_workload.description("Read the key distribution, operation mix and value sizes from this file (see the "
+                               "manual page). Overrides --set-pct, --sequential and --subdoc");
+        o_concurrency.description("Keep this many operations in flight per thread, starting a new one whenever one "
+                                  "completes. A comma separated list runs each depth for --step-duration and reports "
+                                  "the throughput of each")
+            .argdesc("DEPTH[,DEPTH...]");
+        o_stepDuration.description("Seconds to run each depth of --concurrency for, if more than one is given")
+            .setDefault(10);
+        o_corpus.description("Send the values of this file, one per line, by reference rather than generating them "
+                             "(see the manual page). Overrides --docs, --template, --min-size and --max-size");
+        o_populateDepth.description("Populate by keeping this many stores in flight per node and thread, starting a "
+                                    "new one whenever one completes, rather than in batches of --batch-size")
+            .setDefault(0);
+        o_populatePartition.description("Only populate this slice of the items, so that several processes can share "
+                                        "the population")
+            .argdesc("INDEX/COUNT");
+        o_populateSkipExisting.description("Skip the population if the bucket already holds --num-items items, and "
+                                           "otherwise insert the items rather than overwrite them")
+            .setDefault(false);
         params.getTimings().description("Enable command timings (second time to dump timings automatically)");
     }
 
@@ -176,13 +213,25 @@ class Configuration
             maxCycles = o_numCycles.result();
         }
 
+        populateBegin = o_startAt;
+        populateEnd = o_startAt + o_numItems;
+        if (o_populatePartition.passed()) {
+            unsigned index = 0, count = 0;
+            if (sscanf(o_populatePartition.result().c_str(), "%u/%u", &index, &count) != 2 || index >= count) {
+                throw std::runtime_error("invalid --populate-partition: need INDEX/COUNT, with INDEX below COUNT");
+            }
+            populateBegin = o_startAt + (uint64_t)o_numItems * index / count;
+            populateEnd = o_startAt + (uint64_t)o_numItems * (index + 1) / count;
+        }
+
         if (o_populateOnly.passed()) {
             // Determine how many iterations are required.
             if (o_numCycles.passed()) {
                 throw std::runtime_error("--num-cycles incompatible with --populate-only");
             }
-            size_t est = (o_numItems / o_numThreads) / o_multiSize;
-            while (est * o_numThreads * o_multiSize < o_numItems) {
+            size_t items = populateEnd - populateBegin;
+            size_t est = (items / o_numThreads) / o_multiSize;
+            while (est * o_numThreads * o_multiSize < items) {
                 est++;
             }
             maxCycles = est;
@@ -224,7 +273,14 @@ class Configuration
             }
         }
 
-        if (specs.empty()) {
+        if (o_corpus.passed()) {
+            if (!userdocs.empty() || !specs.empty()) {
+                throw std::runtime_error("--corpus cannot be combined with --docs or --template");
+            }
+            auto *corpus = new CorpusDocGenerator(o_corpus.result());
+            fprintf(stderr, "Loaded %lu values from the corpus\n", (unsigned long)corpus->size());
+            docgen.reset(corpus);
+        } else if (specs.empty()) {
             if (o_writeJson.result()) {
                 docgen.reset(new JsonDocGenerator(o_minSize.result(), o_maxSize.result(), o_randomBody.numSpecified(),
                                                   o_randomBodyPoolSize.result()));
@@ -258,6 +314,38 @@ class Configuration
         if (o_collection.passed()) {
             collections = o_collection.result();
         }
+
+        if (o_workload.passed()) {
+            workload.reset(new WorkloadSpec(WorkloadSpec::parse(o_workload.result())));
+            if (lockTime) {
+                throw std::runtime_error("--lock cannot be combined with --workload");
+            }
+            if (!workload->valueSizes.empty()) {
+                if (o_writeJson.result() || !userdocs.empty() || !specs.empty() || o_corpus.passed()) {
+                    throw std::runtime_error("valuesize of the workload requires raw documents (no --json, --docs, "
+                                             "--template or --corpus)");
+                }
+                docgen.reset(new RawDocGenerator(workload->sizeTable(), o_randomBody.numSpecified()));
+            }
+            if (workload->distribution == WorkloadSpec::ZIPFIAN || workload->distribution == WorkloadSpec::LATEST) {
+                zipf.reset(new ZipfianTable(o_numItems.result(), workload->zipfianConstant));
+            }
+        }
+
+        if (o_openLoop.result() && o_rateLimit.result() == 0) {
+            throw std::runtime_error("--open-loop requires --rate-limit");
+        }
+        if (o_concurrency.passed()) {
+            if (o_openLoop.result()) {
+                throw std::runtime_error("--concurrency cannot be combined with --open-loop");
+            }
+            concurrency = parseConcurrency(o_concurrency.result());
+        }
+#ifndef LCB_USE_HDR_HISTOGRAM
+        if (o_latencyLog.passed()) {
+            throw std::runtime_error("--latency-log requires libcouchbase to be built with HdrHistogram");
+        }
+#endif
     }
 
     void addOptions(Parser &parser)
@@ -292,7 +380,17 @@ class Configuration
         parser.addOption(o_replicate);
         parser.addOption(o_lock);
         parser.addOption(o_randSpace);
+        parser.addOption(o_openLoop);
+        parser.addOption(o_latencyLog);
+        parser.addOption(o_workload);
+        parser.addOption(o_concurrency);
+        parser.addOption(o_stepDuration);
+        parser.addOption(o_corpus);
+        parser.addOption(o_populateDepth);
+        parser.addOption(o_populatePartition);
+        parser.addOption(o_populateSkipExisting);
         params.addToParser(parser);
+        reportParams.addToParser(parser);
         depr.addOptions(parser);
     }
 
@@ -354,6 +452,11 @@ class Configuration
     {
         return o_writeJson.result();
     }
+    /** Whether the values are taken from the --corpus mapping, which outlives every operation */
+    bool valuesByReference()
+    {
+        return o_corpus.passed();
+    }
     unsigned firstKeyOffset()
     {
         return o_startAt;
@@ -382,6 +485,44 @@ class Configuration
     {
         return o_randSpace;
     }
+    bool isOpenLoop()
+    {
+        return o_openLoop.result();
+    }
+    bool hasLatencyLog()
+    {
+        return o_latencyLog.passed();
+    }
+    string getLatencyLog()
+    {
+        return o_latencyLog.result();
+    }
+    lcb_U64 getStepDuration()
+    {
+        return o_stepDuration.result() * 1000000000ULL;
+    }
+    bool populateOnly()
+    {
+        return o_populateOnly.passed();
+    }
+    uint32_t getPopulateDepth()
+    {
+        return o_populateDepth.result();
+    }
+    bool populateSkipExisting()
+    {
+        return o_populateSkipExisting.result();
+    }
+    /** Store operation of the population: existing keys are kept with --populate-skip-existing */
+    lcb_STORE_OPERATION populateStoreOperation()
+    {
+        return o_populateSkipExisting.result() ? LCB_STORE_INSERT : LCB_STORE_UPSERT;
+    }
+    /** Number of items populated by all the threads, as each of them gets an equal share of the slice */
+    size_t populateTotal()
+    {
+        return (populateEnd - populateBegin) / o_numThreads * o_numThreads;
+    }
 
     uint32_t opsPerCycle{};
     uint32_t sdOpsPerCmd{};
@@ -389,15 +530,42 @@ class Configuration
     string prefix;
     volatile int maxCycles{};
     bool shouldPopulate{};
+    /** Slice of the key space to populate, [populateBegin, populateEnd), narrowed by --populate-partition */
+    uint32_t populateBegin{};
+    uint32_t populateEnd{};
     ConnParams params;
+    ReportParams reportParams;
     std::unique_ptr<DocGeneratorBase> docgen;
     vector<string> collections{};
     lcb_DURABILITY_LEVEL durabilityLevel{LCB_DURABILITYLEVEL_NONE};
     int replicateTo{};
     int persistTo{};
     int lockTime{};
+    std::unique_ptr<WorkloadSpec> workload;
+    std::unique_ptr<ZipfianTable> zipf;
+    /** Depths of --concurrency, empty unless passed */
+    vector<uint32_t> concurrency{};
 
   private:
+    static vector<uint32_t> parseConcurrency(const string &input)
+    {
+        vector<uint32_t> depths;
+        size_t begin = 0;
+        while (begin <= input.size()) {
+            size_t end = input.find(',', begin);
+            if (end == string::npos) {
+                end = input.size();
+            }
+            unsigned long depth = strtoul(input.c_str() + begin, nullptr, 10);
+            if (depth == 0) {
+                throw std::runtime_error("invalid --concurrency: depths must be numbers above zero");
+            }
+            depths.push_back(depth);
+            begin = end + 1;
+        }
+        return depths;
+    }
+
     UIntOption o_multiSize;
     UIntOption o_numItems;
     StringOption o_keyPrefix;
@@ -439,6 +607,15 @@ class Configuration
 
     IntOption o_lock;
     BoolOption o_randSpace;
+    BoolOption o_openLoop;
+    StringOption o_latencyLog;
+    StringOption o_workload;
+    StringOption o_concurrency;
+    UIntOption o_stepDuration;
+    StringOption o_corpus;
+    UIntOption o_populateDepth;
+    StringOption o_populatePartition;
+    BoolOption o_populateSkipExisting;
     DeprecatedOptions depr;
 } config;
 
@@ -456,11 +633,145 @@ void log(const char *format, ...)
     va_end(args);
 }
 
+#define OPFLAGS_LOCKED 0x01
+
+/*
+ * Every operation carries the time it was meant to start in its cookie: the microseconds of lcb_nstime(), shifted
+ * left to leave room for OPFLAGS_LOCKED. Only differences of two stamps are used, so the wrap-around where uintptr_t
+ * is 32 bits wide does not matter.
+ */
+static void *stampCookie(lcb_U64 start_ns, uintptr_t flags = 0)
+{
+    return reinterpret_cast<void *>(((uintptr_t)(start_ns / 1000) << 1) | flags);
+}
+
+static lcb_U64 cookieLatency(const void *cookie)
+{
+    uintptr_t now = (uintptr_t)(lcb_nstime() / 1000) << 1;
+    return (now - (reinterpret_cast<uintptr_t>(cookie) & ~(uintptr_t)OPFLAGS_LOCKED)) >> 1;
+}
+
+/** Report of --report, the operation types are indexed by NextOp::Mode */
+static BenchReport report;
+static const std::vector<std::string> reportOps = {"upsert",  "get",     "subdoc-upsert", "subdoc-get", "noop",
+                                                   "counter", "touch",   "replica-get",   "exists"};
+
+static size_t iovBytes(const vector<lcb_IOV> &iov)
+{
+    size_t total = 0;
+    for (const auto &frag : iov) {
+        total += frag.iov_len;
+    }
+    return total;
+}
+
+/** Set the value of a store, which is written to the socket without copying it if it comes from the corpus */
+static void setStoreValue(lcb_CMDSTORE *scmd, const vector<lcb_IOV> &iov)
+{
+    if (config.valuesByReference()) {
+        lcb_cmdstore_value_iov_nocopy(scmd, iov.data(), iov.size());
+    } else {
+        lcb_cmdstore_value_iov(scmd, iov.data(), iov.size());
+    }
+}
+
+#ifdef LCB_USE_HDR_HISTOGRAM
+/** An hour, anything slower is recorded as that */
+static const int64_t HIGHEST_US = 3600LL * 1000000;
+
+/**
+ * Latencies (in microseconds) of all threads, written as one HdrHistogram interval log entry per second.
+ */
+class LatencyLog
+{
+  public:
+    ~LatencyLog()
+    {
+        if (file != nullptr) {
+            fclose(file);
+            hdr_interval_recorder_destroy(&recorder);
+            hdr_close(spare);
+            hdr_close(total);
+        }
+    }
+
+    bool open(const string &path)
+    {
+        if (hdr_log_writer_init(&writer) != 0) {
+            log("HdrHistogram was built without log support (zlib is missing)");
+            return false;
+        }
+        file = fopen(path.c_str(), "w");
+        if (file == nullptr) {
+            perror(path.c_str());
+            return false;
+        }
+        hdr_interval_recorder_init_all(&recorder, 1, HIGHEST_US, 3);
+        hdr_init(1, HIGHEST_US, 3, &spare);
+        hdr_init(1, HIGHEST_US, 3, &total);
+        hdr_gettime(&interval_start);
+        hdr_log_write_header(&writer, file, "cbc-pillowfight latencies, in microseconds", &interval_start);
+        return true;
+    }
+
+    bool isOpen() const
+    {
+        return file != nullptr;
+    }
+
+    void record(lcb_U64 latency_us)
+    {
+        hdr_interval_recorder_record_value_atomic(&recorder, std::min<int64_t>(latency_us, HIGHEST_US));
+    }
+
+    /** Writes the latencies recorded since the previous call as one interval */
+    void flush()
+    {
+        hdr_timespec now;
+        hdr_gettime(&now);
+        spare = hdr_interval_recorder_sample_and_recycle(&recorder, spare);
+        hdr_log_write(&writer, file, &interval_start, &now, spare);
+        fflush(file);
+        hdr_add(total, spare);
+        interval_start = now;
+    }
+
+    void summary() const
+    {
+        fprintf(stderr, "Latency (us): p50: %lld, p99: %lld, p99.9: %lld, max: %lld, count: %lld\n",
+                (long long)hdr_value_at_percentile(total, 50), (long long)hdr_value_at_percentile(total, 99),
+                (long long)hdr_value_at_percentile(total, 99.9), (long long)hdr_max(total),
+                (long long)total->total_count);
+    }
+
+  private:
+    FILE *file{nullptr};
+    hdr_log_writer writer{};
+    hdr_interval_recorder recorder{};
+    hdr_histogram *spare{nullptr};
+    hdr_histogram *total{nullptr};
+    hdr_timespec interval_start{};
+} latencies;
+
+static void recordLatency(const void *cookie)
+{
+    if (latencies.isOpen()) {
+        latencies.record(cookieLatency(cookie));
+    }
+}
+#else
+static void recordLatency(const void *) {}
+#endif
+
 extern "C" {
 static void noopCallback(lcb_INSTANCE *, int, const lcb_RESPNOOP *);
 static void subdocCallback(lcb_INSTANCE *, int, const lcb_RESPSUBDOC *);
 static void getCallback(lcb_INSTANCE *, int, const lcb_RESPGET *);
 static void storeCallback(lcb_INSTANCE *, int, const lcb_RESPSTORE *);
+static void counterCallback(lcb_INSTANCE *, int, const lcb_RESPCOUNTER *);
+static void touchCallback(lcb_INSTANCE *, int, const lcb_RESPTOUCH *);
+static void getReplicaCallback(lcb_INSTANCE *, int, const lcb_RESPGETREPLICA *);
+static void existsCallback(lcb_INSTANCE *, int, const lcb_RESPEXISTS *);
 }
 
 class ThreadContext;
@@ -541,7 +852,7 @@ struct NextOp {
     vector<lcb_IOV> m_valuefrags;
     vector<SubdocSpec> m_specs;
     // The mode here is for future use with subdoc
-    enum Mode { STORE, GET, SDSTORE, SDGET, NOOP };
+    enum Mode { STORE, GET, SDSTORE, SDGET, NOOP, COUNTER, TOUCH, GET_REPLICA, EXISTS };
     Mode m_mode;
     uint64_t m_cas;
 };
@@ -557,6 +868,8 @@ class OpGenerator
     virtual void setValue(NextOp &op) = 0;
     virtual void populateIov(uint32_t, vector<lcb_IOV> &) = 0;
     virtual bool inPopulation() const = 0;
+    /** Number of population operations which are still to be generated */
+    virtual size_t populationLeft() const = 0;
     virtual void checkin(uint32_t) = 0;
     virtual const char *getStageString() const = 0;
 
@@ -582,6 +895,11 @@ class NoopGenerator : public OpGenerator
         return false;
     }
 
+    size_t populationLeft() const override
+    {
+        return 0;
+    }
+
     void checkin(uint32_t) override {}
 
     const char *getStageString() const override
@@ -605,6 +923,7 @@ class KeyGenerator : public OpGenerator
 
         m_gensequence.reset(new SeqGenerator(config.firstKeyOffset(), config.getNumItems() + config.firstKeyOffset(),
                                          config.getNumThreads(), ix));
+        m_genpopulate.reset(new SeqGenerator(config.populateBegin, config.populateEnd, config.getNumThreads(), ix));
 
         if (m_in_population) {
             m_force_sequential = true;
@@ -613,7 +932,11 @@ class KeyGenerator : public OpGenerator
         }
 
         m_local_genstate = config.docgen->createState(config.getNumThreads(), ix);
-        if (config.isSubdoc()) {
+        if (config.workload) {
+            m_workload.reset(new WorkloadGenerator(*config.workload, config.zipf.get(), config.getNumItems(),
+                                                   config.getRandomSeed() + ix));
+        }
+        if (config.isSubdoc() || (config.workload && config.workload->usesSubdoc())) {
             m_mode_read = NextOp::SDGET;
             m_mode_write = NextOp::SDSTORE;
             m_sdgenstate = config.docgen->createSubdocState(config.getNumThreads(), ix);
@@ -642,7 +965,7 @@ class KeyGenerator : public OpGenerator
         bool store_override = false;
 
         if (m_in_population) {
-            if (m_gencount++ < m_gensequence->maxItems()) {
+            if (m_gencount++ < m_genpopulate->maxItems()) {
                 store_override = true;
             } else {
                 printf("Thread %d has finished populating.\n", m_id);
@@ -651,7 +974,15 @@ class KeyGenerator : public OpGenerator
             }
         }
 
-        if (m_in_population || !config.lockTime) {
+        if (m_workload && !m_in_population) {
+            setWorkloadOp(op);
+            generateKey(op);
+            return;
+        }
+
+        if (m_in_population) {
+            op.m_seqno = m_genpopulate->next();
+        } else if (!config.lockTime) {
             op.m_seqno = (m_force_sequential ? m_gensequence : m_genrandom)->next();
         } else {
             op.m_seqno = (m_force_sequential ? m_gensequence : m_genrandom)->checkout();
@@ -689,6 +1020,11 @@ class KeyGenerator : public OpGenerator
         return m_in_population;
     }
 
+    size_t populationLeft() const override
+    {
+        return m_in_population ? m_genpopulate->maxItems() - m_gencount : 0;
+    }
+
     void checkin(uint32_t seqno) override
     {
         (m_force_sequential ? m_gensequence : m_genrandom)->checkin(seqno);
@@ -704,6 +1040,44 @@ class KeyGenerator : public OpGenerator
     }
 
   private:
+    void setWorkloadOp(NextOp &op)
+    {
+        WorkloadSpec::Op wop = m_workload->nextOp();
+        op.m_seqno = config.firstKeyOffset() + m_workload->nextKey(wop == WorkloadSpec::UPSERT);
+        switch (wop) {
+            case WorkloadSpec::GET:
+                op.m_mode = NextOp::GET;
+                break;
+            case WorkloadSpec::UPSERT:
+                op.m_mode = NextOp::STORE;
+                setValue(op);
+                break;
+            case WorkloadSpec::SUBDOC_GET:
+                op.m_mode = NextOp::SDGET;
+                op.m_specs.resize(config.sdOpsPerCmd);
+                m_sdgenstate->populateLookup(op.m_seqno, op.m_specs);
+                break;
+            case WorkloadSpec::SUBDOC_UPSERT:
+                op.m_mode = NextOp::SDSTORE;
+                op.m_specs.resize(config.sdOpsPerCmd);
+                m_sdgenstate->populateMutate(op.m_seqno, op.m_specs);
+                break;
+            case WorkloadSpec::COUNTER:
+                op.m_mode = NextOp::COUNTER;
+                break;
+            case WorkloadSpec::TOUCH:
+                op.m_mode = NextOp::TOUCH;
+                break;
+            case WorkloadSpec::REPLICA_GET:
+                op.m_mode = NextOp::GET_REPLICA;
+                break;
+            case WorkloadSpec::EXISTS:
+            default:
+                op.m_mode = NextOp::EXISTS;
+                break;
+        }
+    }
+
     static bool shouldStore(uint32_t seqno)
     {
         if (config.setprc == 0) {
@@ -733,6 +1107,7 @@ class KeyGenerator : public OpGenerator
 
     std::unique_ptr<SeqGenerator> m_genrandom;
     std::unique_ptr<SeqGenerator> m_gensequence;
+    std::unique_ptr<SeqGenerator> m_genpopulate;
     size_t m_gencount;
 
     bool m_force_sequential;
@@ -741,10 +1116,9 @@ class KeyGenerator : public OpGenerator
     NextOp::Mode m_mode_write;
     std::unique_ptr<GeneratorState> m_local_genstate;
     std::unique_ptr<SubdocGeneratorState> m_sdgenstate;
+    std::unique_ptr<WorkloadGenerator> m_workload;
 };
 
-#define OPFLAGS_LOCKED 0x01
-
 class ThreadContext
 {
   public:
@@ -780,7 +1154,7 @@ class ThreadContext
 
         lcb_sched_enter(instance);
         for (size_t ii = 0; ii < config.opsPerCycle; ++ii) {
-            hasItems = scheduleNextOperation();
+            hasItems = scheduleNextOperation(lcb_nstime());
         }
         if (hasItems) {
             error = LCB_SUCCESS;
@@ -793,49 +1167,57 @@ class ThreadContext
     }
 
     void purgeRetryQueue()
+    {
+        while (!retryq.empty()) {
+            lcb_sched_enter(instance);
+            scheduleRetries();
+            lcb_sched_leave(instance);
+            lcb_wait(instance, LCB_WAIT_DEFAULT);
+            if (error != LCB_SUCCESS) {
+                log("Operation(s) failed: %s", lcb_strerror_long(error));
+            }
+        }
+    }
+
+    void scheduleRetries()
     {
         NextOp opinfo;
         InstanceCookie *cookie = InstanceCookie::get(instance);
+        unsigned exptime = config.getExptimeForUpsert();
 
         while (!retryq.empty()) {
-            unsigned exptime = config.getExptimeForUpsert();
-            lcb_sched_enter(instance);
-            while (!retryq.empty()) {
-                opinfo = retryq.front();
-                retryq.pop();
-                lcb_CMDSTORE *scmd;
-                lcb_cmdstore_create(&scmd, LCB_STORE_UPSERT);
-                lcb_cmdstore_expiry(scmd, exptime);
-                if (config.writeJson()) {
-                    lcb_cmdstore_datatype(scmd, LCB_VALUE_F_JSON);
-                }
-                lcb_cmdstore_key(scmd, opinfo.m_key.c_str(), opinfo.m_key.size());
-                if (config.useCollections()) {
-                    if (!opinfo.m_collection.empty() || !opinfo.m_scope.empty()) {
-                        lcb_cmdstore_collection(scmd, opinfo.m_scope.c_str(), opinfo.m_scope.size(),
-                                                opinfo.m_collection.c_str(), opinfo.m_collection.size());
-                    }
+            opinfo = retryq.front();
+            retryq.pop();
+            lcb_CMDSTORE *scmd;
+            lcb_cmdstore_create(&scmd, config.populateStoreOperation());
+            lcb_cmdstore_expiry(scmd, exptime);
+            if (config.writeJson()) {
+                lcb_cmdstore_datatype(scmd, LCB_VALUE_F_JSON);
+            }
+            lcb_cmdstore_key(scmd, opinfo.m_key.c_str(), opinfo.m_key.size());
+            if (config.useCollections()) {
+                if (!opinfo.m_collection.empty() || !opinfo.m_scope.empty()) {
+                    lcb_cmdstore_collection(scmd, opinfo.m_scope.c_str(), opinfo.m_scope.size(),
+                                            opinfo.m_collection.c_str(), opinfo.m_collection.size());
                 }
+            }
 
-                lcb_cmdstore_value_iov(scmd, &opinfo.m_valuefrags[0], opinfo.m_valuefrags.size());
-                if (config.durabilityLevel != LCB_DURABILITYLEVEL_NONE) {
-                    lcb_cmdstore_durability(scmd, config.durabilityLevel);
-                } else if (config.persistTo > 0 || config.replicateTo > 0) {
-                    lcb_cmdstore_durability_observe(scmd, config.persistTo, config.replicateTo);
-                }
-                error = lcb_store(instance, nullptr, scmd);
-                lcb_cmdstore_destroy(scmd);
-                cookie->stats.retried++;
+            setStoreValue(scmd, opinfo.m_valuefrags);
+            if (config.durabilityLevel != LCB_DURABILITYLEVEL_NONE) {
+                lcb_cmdstore_durability(scmd, config.durabilityLevel);
+            } else if (config.persistTo > 0 || config.replicateTo > 0) {
+                lcb_cmdstore_durability_observe(scmd, config.persistTo, config.replicateTo);
             }
-            lcb_sched_leave(instance);
-            lcb_wait(instance, LCB_WAIT_DEFAULT);
-            if (error != LCB_SUCCESS) {
-                log("Operation(s) failed: %s", lcb_strerror_long(error));
+            error = lcb_store(instance, stampCookie(lcb_nstime()), scmd);
+            lcb_cmdstore_destroy(scmd);
+            if (report.isOpen()) {
+                report.addBytesOut(NextOp::STORE, iovBytes(opinfo.m_valuefrags));
             }
+            cookie->stats.retried++;
         }
     }
 
-    bool scheduleNextOperation()
+    bool scheduleNextOperation(lcb_U64 start_ns)
     {
         NextOp opinfo;
         unsigned exptime = config.getExptimeForUpsert();
@@ -850,11 +1232,12 @@ class ThreadContext
                     lcb_cmdget_create(&gcmd);
                     lcb_cmdget_key(gcmd, opinfo.m_key.c_str(), opinfo.m_key.size());
                     lcb_cmdget_locktime(gcmd, config.lockTime);
-                    error = lcb_get(instance, (void *)OPFLAGS_LOCKED, gcmd);
+                    error = lcb_get(instance, stampCookie(start_ns, OPFLAGS_LOCKED), gcmd);
                     lcb_cmdget_destroy(gcmd);
                 } else {
                     lcb_CMDSTORE *scmd;
-                    lcb_cmdstore_create(&scmd, LCB_STORE_UPSERT);
+                    lcb_cmdstore_create(&scmd,
+                                        gen->inPopulation() ? config.populateStoreOperation() : LCB_STORE_UPSERT);
                     lcb_cmdstore_expiry(scmd, exptime);
                     if (config.writeJson()) {
                         lcb_cmdstore_datatype(scmd, LCB_VALUE_F_JSON);
@@ -866,14 +1249,17 @@ class ThreadContext
                                                     opinfo.m_collection.c_str(), opinfo.m_collection.size());
                         }
                     }
-                    lcb_cmdstore_value_iov(scmd, &opinfo.m_valuefrags[0], opinfo.m_valuefrags.size());
+                    setStoreValue(scmd, opinfo.m_valuefrags);
                     if (config.durabilityLevel != LCB_DURABILITYLEVEL_NONE) {
                         lcb_cmdstore_durability(scmd, config.durabilityLevel);
                     } else if (config.persistTo > 0 || config.replicateTo > 0) {
                         lcb_cmdstore_durability_observe(scmd, config.persistTo, config.replicateTo);
                     }
-                    error = lcb_store(instance, nullptr, scmd);
+                    error = lcb_store(instance, stampCookie(start_ns), scmd);
                     lcb_cmdstore_destroy(scmd);
+                    if (report.isOpen()) {
+                        report.addBytesOut(NextOp::STORE, iovBytes(opinfo.m_valuefrags));
+                    }
                 }
                 break;
             }
@@ -890,7 +1276,7 @@ class ThreadContext
                 if (useGat) {
                     lcb_cmdget_expiry(gcmd, getExptime);
                 }
-                error = lcb_get(instance, this, gcmd);
+                error = lcb_get(instance, stampCookie(start_ns), gcmd);
                 lcb_cmdget_destroy(gcmd);
                 break;
             }
@@ -898,11 +1284,13 @@ class ThreadContext
             case NextOp::SDGET: {
                 lcb_SUBDOCSPECS *specs;
                 bool mutate = false;
+                size_t bytes_out = 0;
                 lcb_subdocspecs_create(&specs, opinfo.m_specs.size());
                 for (size_t ii = 0; ii < opinfo.m_specs.size(); ii++) {
                     SubdocSpec &spec = opinfo.m_specs[ii];
                     if (spec.mutate) {
                         mutate = true;
+                        bytes_out += spec.value.size();
                         lcb_subdocspecs_dict_upsert(specs, ii, 0, spec.path.c_str(), spec.path.size(),
                                                     spec.value.c_str(), spec.value.size());
                     } else {
@@ -925,18 +1313,85 @@ class ThreadContext
                     lcb_cmdsubdoc_durability(sdcmd, config.durabilityLevel);
                 }
                 lcb_cmdsubdoc_specs(sdcmd, specs);
-                error = lcb_subdoc(instance, nullptr, sdcmd);
+                error = lcb_subdoc(instance, stampCookie(start_ns), sdcmd);
                 lcb_subdocspecs_destroy(specs);
                 lcb_cmdsubdoc_destroy(sdcmd);
+                if (report.isOpen() && bytes_out > 0) {
+                    report.addBytesOut(opinfo.m_mode, bytes_out);
+                }
                 break;
             }
             case NextOp::NOOP: {
                 lcb_CMDNOOP *ncmd;
                 lcb_cmdnoop_create(&ncmd);
-                error = lcb_noop(instance, nullptr, ncmd);
+                error = lcb_noop(instance, stampCookie(start_ns), ncmd);
                 lcb_cmdnoop_destroy(ncmd);
                 break;
             }
+            case NextOp::COUNTER: {
+                // Counters live next to the documents, as they cannot be applied to the generated values
+                string key = opinfo.m_key + "-counter";
+                lcb_CMDCOUNTER *ccmd;
+                lcb_cmdcounter_create(&ccmd);
+                lcb_cmdcounter_key(ccmd, key.c_str(), key.size());
+                if (config.useCollections()) {
+                    if (!opinfo.m_collection.empty() || !opinfo.m_scope.empty()) {
+                        lcb_cmdcounter_collection(ccmd, opinfo.m_scope.c_str(), opinfo.m_scope.size(),
+                                                  opinfo.m_collection.c_str(), opinfo.m_collection.size());
+                    }
+                }
+                lcb_cmdcounter_delta(ccmd, 1);
+                lcb_cmdcounter_initial(ccmd, 0);
+                if (config.durabilityLevel != LCB_DURABILITYLEVEL_NONE) {
+                    lcb_cmdcounter_durability(ccmd, config.durabilityLevel);
+                }
+                error = lcb_counter(instance, stampCookie(start_ns), ccmd);
+                lcb_cmdcounter_destroy(ccmd);
+                break;
+            }
+            case NextOp::TOUCH: {
+                lcb_CMDTOUCH *tcmd;
+                lcb_cmdtouch_create(&tcmd);
+                lcb_cmdtouch_key(tcmd, opinfo.m_key.c_str(), opinfo.m_key.size());
+                if (config.useCollections()) {
+                    if (!opinfo.m_collection.empty() || !opinfo.m_scope.empty()) {
+                        lcb_cmdtouch_collection(tcmd, opinfo.m_scope.c_str(), opinfo.m_scope.size(),
+                                                opinfo.m_collection.c_str(), opinfo.m_collection.size());
+                    }
+                }
+                lcb_cmdtouch_expiry(tcmd, exptime);
+                error = lcb_touch(instance, stampCookie(start_ns), tcmd);
+                lcb_cmdtouch_destroy(tcmd);
+                break;
+            }
+            case NextOp::GET_REPLICA: {
+                lcb_CMDGETREPLICA *rcmd;
+                lcb_cmdgetreplica_create(&rcmd, LCB_REPLICA_MODE_ANY);
+                lcb_cmdgetreplica_key(rcmd, opinfo.m_key.c_str(), opinfo.m_key.size());
+                if (config.useCollections()) {
+                    if (!opinfo.m_collection.empty() || !opinfo.m_scope.empty()) {
+                        lcb_cmdgetreplica_collection(rcmd, opinfo.m_scope.c_str(), opinfo.m_scope.size(),
+                                                     opinfo.m_collection.c_str(), opinfo.m_collection.size());
+                    }
+                }
+                error = lcb_getreplica(instance, stampCookie(start_ns), rcmd);
+                lcb_cmdgetreplica_destroy(rcmd);
+                break;
+            }
+            case NextOp::EXISTS: {
+                lcb_CMDEXISTS *ecmd;
+                lcb_cmdexists_create(&ecmd);
+                lcb_cmdexists_key(ecmd, opinfo.m_key.c_str(), opinfo.m_key.size());
+                if (config.useCollections()) {
+                    if (!opinfo.m_collection.empty() || !opinfo.m_scope.empty()) {
+                        lcb_cmdexists_collection(ecmd, opinfo.m_scope.c_str(), opinfo.m_scope.size(),
+                                                 opinfo.m_collection.c_str(), opinfo.m_collection.size());
+                    }
+                }
+                error = lcb_exists(instance, stampCookie(start_ns), ecmd);
+                lcb_cmdexists_destroy(ecmd);
+                break;
+            }
         }
 
         if (error != LCB_SUCCESS) {
@@ -949,7 +1404,21 @@ class ThreadContext
 
     bool run()
     {
+        if (config.getPopulateDepth() > 0 && gen->inPopulation()) {
+            runPopulation();
+            if (config.populateOnly()) {
+                return true;
+            }
+        }
         do {
+            if (config.isOpenLoop() && !gen->inPopulation()) {
+                runOpenLoop();
+                break;
+            }
+            if (!config.concurrency.empty() && !gen->inPopulation()) {
+                runFixedConcurrency();
+                break;
+            }
             singleLoop();
 
             if (config.numTimings() > 1) {
@@ -976,8 +1445,33 @@ class ThreadContext
             gen->setValue(op);
         }
         retryq.push(op);
+        if (concurrencyRunning || populationRunning) {
+            // The operation stays in flight, nothing else would pick the retry up
+            scheduleRetries();
+        }
+    }
+
+    /**
+     * Called once an operation completed, with the cookie it was scheduled with
+     * @param bytes_in number of value bytes received
+     */
+    void complete(const void *stamp, NextOp::Mode mode, lcb_STATUS rc, size_t bytes_in = 0)
+    {
+        recordLatency(stamp);
+        if (report.isOpen()) {
+            report.record(mode, cookieLatency(stamp) * 1000, rc == LCB_SUCCESS, bytes_in);
+        }
+        if (populationRunning) {
+            populationCompleted();
+        } else if (concurrencyRunning) {
+            concurrencyCompleted();
+        }
     }
 
+    /** Operations completed (and how long it took) at each depth of --concurrency */
+    vector<size_t> depthOps{};
+    vector<lcb_U64> depthNs{};
+
     void populateIov(uint32_t seq, vector<lcb_IOV> &iov_out)
     {
         gen->populateIov(seq, iov_out);
@@ -998,6 +1492,10 @@ class ThreadContext
     friend void subdocCallback(lcb_INSTANCE *, int, const lcb_RESPSUBDOC *);
     friend void getCallback(lcb_INSTANCE *, int, const lcb_RESPGET *);
     friend void storeCallback(lcb_INSTANCE *, int, const lcb_RESPSTORE *);
+    friend void counterCallback(lcb_INSTANCE *, int, const lcb_RESPCOUNTER *);
+    friend void touchCallback(lcb_INSTANCE *, int, const lcb_RESPTOUCH *);
+    friend void getReplicaCallback(lcb_INSTANCE *, int, const lcb_RESPGETREPLICA *);
+    friend void existsCallback(lcb_INSTANCE *, int, const lcb_RESPEXISTS *);
 
     Histogram histogram;
 
@@ -1007,6 +1505,185 @@ class ThreadContext
     }
 
   private:
+    /**
+     * Runs the workload without waiting for the operations to complete: an lcb timer starts the operations which are
+     * due every `1 / --rate-limit` seconds, so that a slow response delays neither the following operations nor
+     * their latency measurements.
+     */
+    void runOpenLoop()
+    {
+        lcbio_TABLE *iot = instance->iotable;
+        openLoopTimer = iot->timer.create(iot->p);
+        openLoopInterval = 1000000000ULL / config.getRateLimit();
+        openLoopNext = lcb_nstime();
+        openLoopScheduled = 0;
+        if (openLoopTick()) {
+            lcb_run_loop(instance);
+        }
+        iot->timer.cancel(iot->p, openLoopTimer);
+        iot->timer.destroy(iot->p, openLoopTimer);
+        openLoopTimer = nullptr;
+
+        // Collect what is still in flight
+        lcb_wait(instance, LCB_WAIT_DEFAULT);
+        purgeRetryQueue();
+    }
+
+    /**
+     * Keeps a fixed number of operations in flight: every completed operation starts the next one. With several
+     * depths, each of them runs for --step-duration, while the completed operations are counted per depth.
+     */
+    void runFixedConcurrency()
+    {
+        depthOps.assign(config.concurrency.size(), 0);
+        depthNs.assign(config.concurrency.size(), 0);
+        depthIndex = 0;
+        depthStart = lcb_nstime();
+        inflight = 0;
+        completedInCycle = 0;
+        concurrencyRunning = true;
+        concurrencyDone = false;
+        fillConcurrency();
+        if (inflight > 0) {
+            lcb_run_loop(instance);
+        }
+        concurrencyRunning = false;
+        purgeRetryQueue();
+    }
+
+    void fillConcurrency()
+    {
+        lcb_sched_enter(instance);
+        while (!concurrencyDone && inflight < config.concurrency[depthIndex]) {
+            if (!scheduleNextOperation(lcb_nstime())) {
+                if (inflight == 0) {
+                    // Nothing would ever complete to try again
+                    finishDepth(lcb_nstime());
+                    concurrencyDone = true;
+                }
+                break;
+            }
+            inflight++;
+        }
+        lcb_sched_leave(instance);
+    }
+
+    void concurrencyCompleted()
+    {
+        inflight--;
+        if (!concurrencyDone) {
+            depthOps[depthIndex]++;
+            lcb_U64 now = lcb_nstime();
+            if (++completedInCycle == config.opsPerCycle) {
+                completedInCycle = 0;
+                if (config.isLoopDone(++niter)) {
+                    finishDepth(now);
+                    concurrencyDone = true;
+                }
+            }
+            if (!concurrencyDone && config.concurrency.size() > 1 && now - depthStart >= config.getStepDuration()) {
+                finishDepth(now);
+                if (++depthIndex == config.concurrency.size()) {
+                    depthIndex--;
+                    concurrencyDone = true;
+                } else {
+                    depthStart = now;
+                }
+            }
+        }
+        if (concurrencyDone) {
+            if (inflight == 0) {
+                lcb_stop_loop(instance);
+            }
+            return;
+        }
+        fillConcurrency();
+    }
+
+    void finishDepth(lcb_U64 now)
+    {
+        depthNs[depthIndex] = now - depthStart;
+    }
+
+    /**
+     * Populates with --populate-depth stores in flight for each node of the cluster: every completed store starts the
+     * next one until the share of the thread is stored, so that the population is not held up by the slowest store
+     * of each batch.
+     */
+    void runPopulation()
+    {
+        lcb_S32 nodes = lcb_get_num_nodes(instance);
+        populationWindow = config.getPopulateDepth() * (nodes > 0 ? nodes : 1);
+        inflight = 0;
+        populationRunning = true;
+        fillPopulation();
+        if (inflight > 0) {
+            lcb_run_loop(instance);
+        }
+        populationRunning = false;
+        purgeRetryQueue();
+    }
+
+    void fillPopulation()
+    {
+        lcb_sched_enter(instance);
+        while (inflight < populationWindow && gen->populationLeft() > 0) {
+            if (!scheduleNextOperation(lcb_nstime())) {
+                break;
+            }
+            inflight++;
+        }
+        lcb_sched_leave(instance);
+    }
+
+    void populationCompleted()
+    {
+        inflight--;
+        fillPopulation();
+        if (inflight == 0) {
+            lcb_stop_loop(instance);
+        }
+    }
+
+    static void openLoopTimerCallback(lcb_socket_t, short, void *arg)
+    {
+        auto *ctx = static_cast<ThreadContext *>(arg);
+        if (!ctx->openLoopTick()) {
+            lcb_stop_loop(ctx->instance);
+        }
+    }
+
+    /** Returns false once the workload is over */
+    bool openLoopTick()
+    {
+        lcb_U64 now = lcb_nstime();
+        bool done = config.isLoopDone(niter);
+
+        lcb_sched_enter(instance);
+        // Start everything that is due, but at most a batch at a time to keep reading the responses while behind
+        for (size_t ii = 0; !done && openLoopNext <= now && ii < config.opsPerCycle; ++ii) {
+            scheduleNextOperation(openLoopNext);
+            openLoopNext += openLoopInterval;
+            if (++openLoopScheduled == config.opsPerCycle) {
+                openLoopScheduled = 0;
+                done = config.isLoopDone(++niter);
+            }
+        }
+        scheduleRetries();
+        lcb_sched_leave(instance);
+
+        if (config.numTimings() > 1) {
+            InstanceCookie::dumpTimings(instance, gen->getStageString());
+        }
+        if (done) {
+            return false;
+        }
+        lcbio_TABLE *iot = instance->iotable;
+        lcb_U32 delay_us = openLoopNext > now ? (openLoopNext - now) / 1000 : 0;
+        iot->timer.schedule(iot->p, openLoopTimer, delay_us, this, openLoopTimerCallback);
+        return true;
+    }
+
     static void rateLimitThrottle()
     {
         lcb_U64 now = lcb_nstime();
@@ -1028,6 +1705,18 @@ class ThreadContext
     }
 
     std::unique_ptr<OpGenerator> gen;
+    void *openLoopTimer{nullptr};
+    lcb_U64 openLoopInterval{0};
+    lcb_U64 openLoopNext{0};
+    size_t openLoopScheduled{0};
+    bool concurrencyRunning{false};
+    bool concurrencyDone{false};
+    bool populationRunning{false};
+    uint32_t populationWindow{0};
+    size_t depthIndex{0};
+    lcb_U64 depthStart{0};
+    uint32_t inflight{0};
+    size_t completedInCycle{0};
     size_t niter;
     lcb_STATUS error{LCB_SUCCESS};
     lcb_INSTANCE *instance{nullptr};
@@ -1056,6 +1745,18 @@ static void updateOpsPerSecDisplay()
     }
 }
 
+/** Items stored by the population of all the threads */
+static std::atomic<size_t> populatedItems{0};
+
+static void reportPopulation(lcb_U64 start_ns)
+{
+    size_t done = populatedItems;
+    size_t total = config.populateTotal();
+    double elapsed = (lcb_nstime() - start_ns) / 1e9;
+    fprintf(stderr, "Populated %lu/%lu items (%.1f%%) at %.0f items/sec\n", (unsigned long)done,
+            (unsigned long)total, total ? 100.0 * done / total : 100.0, elapsed > 0 ? done / elapsed : 0);
+}
+
 static void updateStats(InstanceCookie *cookie, lcb_STATUS rc)
 {
     cookie->stats.total++;
@@ -1081,10 +1782,17 @@ static void noopCallback(lcb_INSTANCE *instance, int, const lcb_RESPNOOP *resp)
     lcb_STATUS rc = lcb_respnoop_status(resp);
     tc->setError(rc);
     updateStats(cookie, rc);
+
+    // The NOOP goes to every node, the last response completes it
+    if (resp->rflags & LCB_RESP_F_FINAL) {
+        void *stamp;
+        lcb_respnoop_cookie(resp, &stamp);
+        tc->complete(stamp, NextOp::NOOP, rc);
+    }
     updateOpsPerSecDisplay();
 }
 
-static void subdocCallback(lcb_INSTANCE *instance, int, const lcb_RESPSUBDOC *resp)
+static void subdocCallback(lcb_INSTANCE *instance, int cbtype, const lcb_RESPSUBDOC *resp)
 {
     InstanceCookie *cookie = InstanceCookie::get(instance);
     ThreadContext *tc = cookie->getContext();
@@ -1097,6 +1805,15 @@ static void subdocCallback(lcb_INSTANCE *instance, int, const lcb_RESPSUBDOC *re
     lcb_respsubdoc_key(resp, &p, &n);
     (void)n;
     tc->checkin(std::strtol(p, nullptr, 10));
+
+    void *stamp;
+    lcb_respsubdoc_cookie(resp, &stamp);
+    size_t bytes_in = 0;
+    for (size_t ii = 0; ii < lcb_respsubdoc_result_size(resp); ii++) {
+        lcb_respsubdoc_result_value(resp, ii, &p, &n);
+        bytes_in += n;
+    }
+    tc->complete(stamp, cbtype == LCB_CALLBACK_SDMUTATE ? NextOp::SDSTORE : NextOp::SDGET, rc, bytes_in);
     updateOpsPerSecDisplay();
 }
 
@@ -1129,9 +1846,9 @@ static void getCallback(lcb_INSTANCE *instance, int, const lcb_RESPGET *resp)
 
     auto stripped_key = config.strip_key_prefix(key);
     uint32_t seqno = std::stoul(stripped_key);
-    uintptr_t flags = 0;
-    lcb_respget_cookie(resp, (void **)&flags);
-    if (flags & OPFLAGS_LOCKED) {
+    void *stamp;
+    lcb_respget_cookie(resp, &stamp);
+    if (reinterpret_cast<uintptr_t>(stamp) & OPFLAGS_LOCKED) {
         if (rc == LCB_SUCCESS) {
             vector<lcb_IOV> valuefrags;
             tc->populateIov(seqno, valuefrags);
@@ -1151,14 +1868,19 @@ static void getCallback(lcb_INSTANCE *instance, int, const lcb_RESPGET *resp)
                     lcb_cmdstore_collection(scmd, scope.c_str(), scope.size(), collection.c_str(), collection.size());
                 }
             }
-            lcb_cmdstore_value_iov(scmd, &valuefrags[0], valuefrags.size());
+            setStoreValue(scmd, valuefrags);
             if (config.durabilityLevel != LCB_DURABILITYLEVEL_NONE) {
                 lcb_cmdstore_durability(scmd, config.durabilityLevel);
             } else if (config.persistTo > 0 || config.replicateTo > 0) {
                 lcb_cmdstore_durability_observe(scmd, config.persistTo, config.replicateTo);
             }
-            lcb_store(instance, nullptr, scmd);
+            // The update completes the operation, so it measures from the same start
+            lcb_store(instance, reinterpret_cast<void *>(reinterpret_cast<uintptr_t>(stamp) & ~(uintptr_t)OPFLAGS_LOCKED),
+                      scmd);
             lcb_cmdstore_destroy(scmd);
+            if (report.isOpen()) {
+                report.addBytesOut(NextOp::STORE, iovBytes(valuefrags));
+            }
 
             done = false;
         } else if (rc == LCB_ERR_TEMPORARY_FAILURE) {
@@ -1174,7 +1896,9 @@ static void getCallback(lcb_INSTANCE *instance, int, const lcb_RESPGET *resp)
     }
 
     if (done) {
+        lcb_respget_value(resp, &p, &n);
         tc->checkin(seqno);
+        tc->complete(stamp, NextOp::GET, rc, rc == LCB_SUCCESS ? n : 0);
     }
     updateOpsPerSecDisplay();
 }
@@ -1184,8 +1908,12 @@ static void storeCallback(lcb_INSTANCE *instance, int, const lcb_RESPSTORE *resp
     InstanceCookie *cookie = InstanceCookie::get(instance);
     ThreadContext *tc = cookie->getContext();
     lcb_STATUS rc = lcb_respstore_status(resp);
-    tc->setError(rc);
     updateStats(cookie, rc);
+    if (rc == LCB_ERR_DOCUMENT_EXISTS && config.populateSkipExisting() && tc->inPopulation()) {
+        // Inserted by an earlier population, which is as good as stored
+        rc = LCB_SUCCESS;
+    }
+    tc->setError(rc);
 
     const char *p;
     size_t n;
@@ -1226,13 +1954,85 @@ static void storeCallback(lcb_INSTANCE *instance, int, const lcb_RESPSTORE *resp
         tc->retry(op);
     } else {
         tc->checkin(seqno);
+        if (rc == LCB_SUCCESS && tc->inPopulation()) {
+            populatedItems++;
+        }
+
+        void *stamp;
+        lcb_respstore_cookie(resp, &stamp);
+        tc->complete(stamp, NextOp::STORE, rc);
+    }
+
+    updateOpsPerSecDisplay();
+}
+
+static void counterCallback(lcb_INSTANCE *instance, int, const lcb_RESPCOUNTER *resp)
+{
+    InstanceCookie *cookie = InstanceCookie::get(instance);
+    ThreadContext *tc = cookie->getContext();
+    lcb_STATUS rc = lcb_respcounter_status(resp);
+    tc->setError(rc);
+    updateStats(cookie, rc);
+
+    void *stamp;
+    lcb_respcounter_cookie(resp, &stamp);
+    tc->complete(stamp, NextOp::COUNTER, rc);
+    updateOpsPerSecDisplay();
+}
+
+static void touchCallback(lcb_INSTANCE *instance, int, const lcb_RESPTOUCH *resp)
+{
+    InstanceCookie *cookie = InstanceCookie::get(instance);
+    ThreadContext *tc = cookie->getContext();
+    lcb_STATUS rc = lcb_resptouch_status(resp);
+    tc->setError(rc);
+    updateStats(cookie, rc);
+
+    void *stamp;
+    lcb_resptouch_cookie(resp, &stamp);
+    tc->complete(stamp, NextOp::TOUCH, rc);
+    updateOpsPerSecDisplay();
+}
+
+static void getReplicaCallback(lcb_INSTANCE *instance, int, const lcb_RESPGETREPLICA *resp)
+{
+    if (!lcb_respgetreplica_is_final(resp)) {
+        return;
+    }
+    InstanceCookie *cookie = InstanceCookie::get(instance);
+    ThreadContext *tc = cookie->getContext();
+    lcb_STATUS rc = lcb_respgetreplica_status(resp);
+    tc->setError(rc);
+    updateStats(cookie, rc);
+
+    void *stamp;
+    lcb_respgetreplica_cookie(resp, &stamp);
+    size_t bytes_in = 0;
+    if (rc == LCB_SUCCESS) {
+        const char *value;
+        lcb_respgetreplica_value(resp, &value, &bytes_in);
     }
+    tc->complete(stamp, NextOp::GET_REPLICA, rc, bytes_in);
+    updateOpsPerSecDisplay();
+}
+
+static void existsCallback(lcb_INSTANCE *instance, int, const lcb_RESPEXISTS *resp)
+{
+    InstanceCookie *cookie = InstanceCookie::get(instance);
+    ThreadContext *tc = cookie->getContext();
+    lcb_STATUS rc = lcb_respexists_status(resp);
+    tc->setError(rc);
+    updateStats(cookie, rc);
 
+    void *stamp;
+    lcb_respexists_cookie(resp, &stamp);
+    tc->complete(stamp, NextOp::EXISTS, rc);
     updateOpsPerSecDisplay();
 }
 
 std::list<InstanceCookie> cookies;
 std::list<ThreadContext> contexts;
+static std::atomic<size_t> nrunning{0};
 
 extern "C" {
 typedef void (*handler_t)(int);
@@ -1373,10 +2173,51 @@ static void *thread_worker(void *arg)
 {
     auto *ctx = static_cast<ThreadContext *>(arg);
     ctx->run();
+    nrunning--;
     return nullptr;
 }
 }
 
+static void countItemsCallback(lcb_INSTANCE *, int, const lcb_RESPSTATS *resp)
+{
+    const char *key, *value;
+    size_t key_len, value_len;
+    lcb_respstats_key(resp, &key, &key_len);
+    lcb_respstats_value(resp, &value, &value_len);
+    if (lcb_respstats_status(resp) != LCB_SUCCESS || key == nullptr || value == nullptr ||
+        string(key, key_len) != "curr_items") {
+        return;
+    }
+    uint64_t *items;
+    lcb_respstats_cookie(resp, (void **)&items);
+    *items += strtoull(string(value, value_len).c_str(), nullptr, 10);
+}
+
+/**
+ * Whether the bucket holds --num-items items already, from the sum of the "curr_items" statistic of its nodes. This
+ * only counts the items rather than check the keys, which would cost as much as populating them.
+ */
+static bool isPopulated(lcb_INSTANCE *instance)
+{
+    uint64_t items = 0;
+    lcb_RESPCALLBACK previous =
+        lcb_install_callback(instance, LCB_CALLBACK_STATS, (lcb_RESPCALLBACK)countItemsCallback);
+    lcb_CMDSTATS *cmd;
+    lcb_cmdstats_create(&cmd);
+    lcb_STATUS rc = lcb_stats(instance, &items, cmd);
+    lcb_cmdstats_destroy(cmd);
+    if (rc == LCB_SUCCESS) {
+        lcb_wait(instance, LCB_WAIT_DEFAULT);
+    }
+    lcb_install_callback(instance, LCB_CALLBACK_STATS, previous);
+    if (rc != LCB_SUCCESS) {
+        log("Failed to count the items: %s", lcb_strerror_short(rc));
+        return false;
+    }
+    log("Found %llu items in the bucket", (unsigned long long)items);
+    return items >= config.getNumItems();
+}
+
 int main(int argc, char **argv)
 {
     int exit_code = EXIT_SUCCESS;
@@ -1388,6 +2229,12 @@ int main(int argc, char **argv)
         config.addOptions(parser);
         parser.parse(argc, argv, false);
         config.processOptions();
+#ifdef LCB_USE_HDR_HISTOGRAM
+        if (config.hasLatencyLog() && !latencies.open(config.getLatencyLog())) {
+            exit(EXIT_FAILURE);
+        }
+#endif
+        config.reportParams.open(report, reportOps);
     } catch (std::string &e) {
         std::cerr << e << std::endl;
         exit(EXIT_FAILURE);
@@ -1427,6 +2274,10 @@ int main(int argc, char **argv)
         lcb_install_callback(instance, LCB_CALLBACK_SDMUTATE, (lcb_RESPCALLBACK)subdocCallback);
         lcb_install_callback(instance, LCB_CALLBACK_SDLOOKUP, (lcb_RESPCALLBACK)subdocCallback);
         lcb_install_callback(instance, LCB_CALLBACK_NOOP, (lcb_RESPCALLBACK)noopCallback);
+        lcb_install_callback(instance, LCB_CALLBACK_COUNTER, (lcb_RESPCALLBACK)counterCallback);
+        lcb_install_callback(instance, LCB_CALLBACK_TOUCH, (lcb_RESPCALLBACK)touchCallback);
+        lcb_install_callback(instance, LCB_CALLBACK_GETREPLICA, (lcb_RESPCALLBACK)getReplicaCallback);
+        lcb_install_callback(instance, LCB_CALLBACK_EXISTS, (lcb_RESPCALLBACK)existsCallback);
 #ifndef WIN32
         lcb_install_callback(instance, LCB_CALLBACK_DIAG, (lcb_RESPCALLBACK)diag_callback);
         {
@@ -1453,15 +2304,77 @@ int main(int argc, char **argv)
             exit(EXIT_FAILURE);
         }
 
+        if (ii == 0 && config.shouldPopulate && config.populateSkipExisting() && isPopulated(instance)) {
+            log("Skipping population");
+            config.shouldPopulate = false;
+            if (config.populateOnly()) {
+                return exit_code;
+            }
+        }
+
         contexts.emplace_back(instance, ii);
         auto* ctx = &contexts.back();
         cookie->setContext(ctx);
+        nrunning++;
         start_worker(ctx);
     }
 
+#ifdef LCB_USE_HDR_HISTOGRAM
+    bool flushLatencies = latencies.isOpen();
+#else
+    bool flushLatencies = false;
+#endif
+    bool showProgress = config.shouldPopulate;
+    if (flushLatencies || report.isOpen() || showProgress) {
+        lcb_U64 start = lcb_nstime();
+        lcb_U64 next_flush = start + 1000000000ULL;
+        while (nrunning > 0) {
+            usleep(100000);
+            if (lcb_nstime() >= next_flush) {
+                if (showProgress) {
+                    reportPopulation(start);
+                    showProgress = populatedItems < config.populateTotal();
+                }
+#ifdef LCB_USE_HDR_HISTOGRAM
+                if (flushLatencies) {
+                    latencies.flush();
+                }
+#endif
+                report.flush();
+                next_flush += 1000000000ULL;
+            }
+        }
+    }
     for (auto &context : contexts) {
         join_worker(context);
     }
+#ifdef LCB_USE_HDR_HISTOGRAM
+    if (latencies.isOpen()) {
+        latencies.flush();
+        latencies.summary();
+    }
+#endif
+    try {
+        if (config.reportParams.finish(report)) {
+            exit_code = EXIT_FAILURE;
+        }
+    } catch (std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        exit_code = EXIT_FAILURE;
+    }
+    if (!config.concurrency.empty()) {
+        fprintf(stderr, "%10s %10s %12s\n", "Depth", "In flight", "Ops/sec");
+        for (size_t ii = 0; ii < config.concurrency.size(); ++ii) {
+            double ops_sec = 0;
+            for (auto &context : contexts) {
+                if (ii < context.depthNs.size() && context.depthNs[ii] > 0) {
+                    ops_sec += context.depthOps[ii] * 1e9 / context.depthNs[ii];
+                }
+            }
+            fprintf(stderr, "%10u %10u %12.0f\n", config.concurrency[ii], config.concurrency[ii] * (unsigned)nthreads,
+                    ops_sec);
+        }
+    }
     if (config.numTimings() > 0) {
         dump_metrics();
     }
@@ -25,6 +25,10 @@
 #include <cstdio>
 #include <cerrno>
 #include <csignal>
+#include <vector>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
 #include "common/options.h"
 #include "common/histogram.h"
 
@@ -52,24 +56,44 @@ static void good_or_die(lcb_STATUS rc, const char *msg = "")
     }
 }
 
-static lcb_INSTANCE *instance = nullptr;
+/**
+ * One event loop thread with its own instance. Client connections are accepted by the main thread and handed to the
+ * workers round-robin, through the pipe of the worker, which also carries the commands below.
+ */
+struct worker {
+    lcb_INSTANCE *instance{nullptr};
+    struct event_base *evbase{nullptr};
+    struct event *notify{nullptr};
+    int pipefd[2]{-1, -1};
+    pthread_t thread{};
+    Histogram hg{};
+};
+
+/** Commands sent to a worker instead of a client descriptor */
+#define WORKER_STOP (-1)
+#define WORKER_DIAG (-2)
+
+static std::vector<worker *> workers;
+static size_t next_worker = 0;
 static struct event_base *evbase = nullptr;
-static Histogram hg;
 
 static char app_client_string[] = "cbc-proxy";
 static char app_version[] = "cbc-proxy/" LCB_VERSION_STRING;
 
-#define LOGARGS(lvl) (instance)->settings, "proxy", LCB_LOG_##lvl, __FILE__, __LINE__
+#define LOGARGS(instance, lvl) (instance)->settings, "proxy", LCB_LOG_##lvl, __FILE__, __LINE__
+#define CL_LOGARGS(cl, lvl) LOGARGS((cl)->w->instance, lvl)
 #define CL_LOGFMT "<%s:%s> (cl=%p,fd=%d) "
 #define CL_LOGID(cl) (cl)->host, (cl)->port, (void *)(cl), (cl)->fd
 
 class Configuration
 {
   public:
-    Configuration() : o_trace("trace"), o_port("port")
+    Configuration() : o_trace("trace"), o_port("port"), o_threads("threads")
     {
         o_trace.abbrev('t').description("Show packet trace on INFO log level");
         o_port.abbrev('p').description("Port for proxy").setDefault(11211);
+        o_threads.description("Number of event loop threads, each with its own connections to the cluster")
+            .setDefault(1);
     }
 
     ~Configuration() = default;
@@ -79,15 +103,21 @@ class Configuration
         m_params.addToParser(parser);
         parser.addOption(o_trace);
         parser.addOption(o_port);
+        parser.addOption(o_threads);
     }
 
-    void processOptions() {}
+    void processOptions()
+    {
+        if (o_threads.result() == 0) {
+            throw std::runtime_error("--threads must be at least 1");
+        }
+    }
 
     void fillCropts(lcb_CREATEOPTS *&opts)
     {
         m_params.fillCropts(opts);
     }
-    lcb_STATUS doCtls()
+    lcb_STATUS doCtls(lcb_INSTANCE *instance)
     {
         return m_params.doCtls(instance);
     }
@@ -110,10 +140,16 @@ class Configuration
         return o_port.result();
     }
 
+    unsigned threads()
+    {
+        return o_threads.result();
+    }
+
   private:
     ConnParams m_params;
     BoolOption o_trace;
     UIntOption o_port;
+    UIntOption o_threads;
 };
 
 static Configuration config;
@@ -122,17 +158,27 @@ static struct evconnlistener *listener = nullptr;
 
 static void cleanup()
 {
-    if (instance) {
-        if (config.shouldDump()) {
-            lcb_dump(instance, stderr, LCB_DUMP_ALL);
+    for (auto *w : workers) {
+        if (w->instance) {
+            if (config.shouldDump()) {
+                lcb_dump(w->instance, stderr, LCB_DUMP_ALL);
+            }
+            if (config.useTimings()) {
+                w->hg.write();
+            }
+            lcb_destroy(w->instance);
         }
-        if (config.useTimings()) {
-            hg.write();
+        if (w->notify) {
+            event_free(w->notify);
         }
-        if (instance) {
-            lcb_destroy(instance);
+        if (w->evbase) {
+            event_base_free(w->evbase);
         }
+        close(w->pipefd[0]);
+        close(w->pipefd[1]);
+        delete w;
     }
+    workers.clear();
     if (listener) {
         evconnlistener_free(listener);
     }
@@ -142,6 +188,7 @@ static void cleanup()
 }
 
 struct client {
+    worker *w;
     int fd;
     struct bufferevent *bev;
     char host[NI_MAXHOST + 1];
@@ -226,19 +273,53 @@ static void dump_bytes(const struct client *cl, const char *msg, const void *ptr
         ss << "|";
     }
     ss << "\n    +--------+-------------------------------------------------+----------------+";
-    lcb_log(LOGARGS(INFO), CL_LOGFMT "%s", CL_LOGID(cl), ss.str().c_str());
+    lcb_log(CL_LOGARGS(cl, INFO), CL_LOGFMT "%s", CL_LOGID(cl), ss.str().c_str());
+}
+
+static void release_backbuf(const void *, size_t, void *backbuf)
+{
+    lcb_backbuf_unref(reinterpret_cast<lcb_BACKBUF>(backbuf));
+}
+
+/**
+ * Packet forwarded without copying it. Its bytes were moved out of the input of the client into `buf`, which the
+ * library reads from until it calls the lcb_pktflushed_callback. The response may come before or after that.
+ */
+struct fwd_packet {
+    client *cl;
+    struct evbuffer *buf;
+    int refcount;
+};
+
+static void fwd_packet_unref(fwd_packet *fwd)
+{
+    if (--fwd->refcount == 0) {
+        evbuffer_free(fwd->buf);
+        delete fwd;
+    }
+}
+
+static void pktflushed_callback(lcb_INSTANCE *, const void *cookie)
+{
+    fwd_packet_unref((fwd_packet *)cookie);
 }
 
 static void pktfwd_callback(lcb_INSTANCE *, const void *cookie, lcb_STATUS err, lcb_PKTFWDRESP *resp)
 {
     good_or_die(err, "Failed to forward a packet");
 
-    auto *cl = (struct client *)cookie;
+    auto *fwd = (fwd_packet *)cookie;
+    struct client *cl = fwd->cl;
+    fwd_packet_unref(fwd);
     struct evbuffer *output = bufferevent_get_output(cl->bev);
     for (unsigned ii = 0; ii < resp->nitems; ii++) {
         dump_bytes(cl, "response", resp->iovs[ii].iov_base, resp->iovs[ii].iov_len);
-        evbuffer_expand(output, resp->iovs[ii].iov_len);
-        evbuffer_add(output, resp->iovs[ii].iov_base, resp->iovs[ii].iov_len);
+        // Hand the read buffer of the library to the output without copying it, it is released once written
+        lcb_backbuf_ref(resp->bufs[ii]);
+        if (evbuffer_add_reference(output, resp->iovs[ii].iov_base, resp->iovs[ii].iov_len, release_backbuf,
+                                   resp->bufs[ii]) != 0) {
+            lcb_backbuf_unref(resp->bufs[ii]);
+        }
     }
 }
 
@@ -328,17 +409,14 @@ static void fts_callback(lcb_INSTANCE *, int, const lcb_RESPSEARCH *resp)
 }
 }
 
-static void conn_readcb(struct bufferevent *bev, void *cookie)
+/** Handles one complete packet, @return false if the packet is incomplete */
+static bool handle_packet(client *cl, struct evbuffer *input)
 {
-    auto *cl = (client *)cookie;
-    struct evbuffer *input;
-    size_t len;
-
-    input = bufferevent_get_input(bev);
-    len = evbuffer_get_length(input);
+    lcb_INSTANCE *instance = cl->w->instance;
+    size_t len = evbuffer_get_length(input);
     if (len < 24) {
-        lcb_log(LOGARGS(DEBUG), CL_LOGFMT "not enough data for header", CL_LOGID(cl));
-        return;
+        lcb_log(CL_LOGARGS(cl, DEBUG), CL_LOGFMT "not enough data for header", CL_LOGID(cl));
+        return false;
     }
 
     protocol_binary_request_header header;
@@ -346,20 +424,31 @@ static void conn_readcb(struct bufferevent *bev, void *cookie)
     lcb_U32 bodylen = ntohl(header.request.bodylen);
 
     size_t pktlen = sizeof(header) + bodylen;
-    len = evbuffer_get_length(input);
     if (len < pktlen) {
-        lcb_log(LOGARGS(DEBUG), CL_LOGFMT "not enough data for packet", CL_LOGID(cl));
-        return;
+        lcb_log(CL_LOGARGS(cl, DEBUG), CL_LOGFMT "not enough data for packet", CL_LOGID(cl));
+        return false;
+    }
+    // Move the packet out of the input buffer: whole chains of the buffer change hands, only the parts of the chains
+    // shared with the neighbouring packets are copied. The header, extras and key are made contiguous, which is what
+    // the library needs to forward the rest of the packet in place
+    size_t hdrlen = sizeof(header) + header.request.extlen + ntohs(header.request.keylen);
+    if (hdrlen > pktlen) {
+        hdrlen = pktlen;
+    }
+    struct evbuffer *pktbuf = evbuffer_new();
+    if (pktbuf == nullptr || evbuffer_remove_buffer(input, pktbuf, pktlen) != (int)pktlen) {
+        die("Failed to take the packet out of the input buffer");
     }
-    void *pkt = malloc(pktlen);
+    char *pkt = (char *)evbuffer_pullup(pktbuf, hdrlen);
     if (pkt == nullptr) {
-        lcb_log(LOGARGS(ERROR), CL_LOGFMT "unable allocate buffer for the packet", CL_LOGID(cl));
-        return;
+        die("Failed to allocate buffer for the packet header");
     }
-    evbuffer_remove(input, pkt, pktlen);
 
     lcb_sched_enter(instance);
-    dump_bytes(cl, "request", pkt, pktlen);
+    if (config.isTrace()) {
+        dump_bytes(cl, "request", evbuffer_pullup(pktbuf, -1), pktlen);
+        pkt = (char *)evbuffer_pullup(pktbuf, hdrlen);
+    }
     switch (header.request.opcode) {
         case PROTOCOL_BINARY_CMD_VERSION: {
             protocol_binary_response_header hdr{};
@@ -373,15 +462,15 @@ static void conn_readcb(struct bufferevent *bev, void *cookie)
             evbuffer_add(output, hdr.bytes, sizeof(hdr.bytes));
             dump_bytes(cl, "response", app_version, sizeof(app_version));
             evbuffer_add(output, app_version, sizeof(app_version));
-            return;
-        } break;
+            goto DONE;
+        }
         case PROTOCOL_BINARY_CMD_STAT: {
-            lcb_U8 extlen = ntohs(header.request.extlen);
+            lcb_U8 extlen = header.request.extlen;
             lcb_U16 keylen = ntohs(header.request.keylen);
             if (keylen < 6) {
                 goto FWD;
             }
-            char *key = (char *)pkt + sizeof(header) + extlen;
+            char *key = pkt + sizeof(header) + extlen;
             lcb_STATUS rc;
             if (memcmp(key, "query ", 6) == 0) {
                 lcb_CMDQUERY *cmd;
@@ -389,7 +478,7 @@ static void conn_readcb(struct bufferevent *bev, void *cookie)
 
                 rc = lcb_cmdquery_statement(cmd, key + 6, keylen - 6);
                 if (rc != LCB_SUCCESS) {
-                    lcb_log(LOGARGS(INFO), CL_LOGFMT "failed to set statement for QUERY", CL_LOGID(cl));
+                    lcb_log(CL_LOGARGS(cl, INFO), CL_LOGFMT "failed to set statement for QUERY", CL_LOGID(cl));
                     goto FWD;
                 }
                 lcb_cmdquery_timeout(cmd, LCB_MS2US(400));
@@ -399,7 +488,7 @@ static void conn_readcb(struct bufferevent *bev, void *cookie)
                 rc = lcb_query(instance, cl, cmd);
                 lcb_cmdquery_destroy(cmd);
                 if (rc != LCB_SUCCESS) {
-                    lcb_log(LOGARGS(INFO), CL_LOGFMT "failed to schedule QUERY command", CL_LOGID(cl));
+                    lcb_log(CL_LOGARGS(cl, INFO), CL_LOGFMT "failed to schedule QUERY command", CL_LOGID(cl));
                     goto FWD;
                 }
                 goto DONE;
@@ -413,7 +502,7 @@ static void conn_readcb(struct bufferevent *bev, void *cookie)
                 lcb_cmdsearch_destroy(cmd);
                 cl->cnt = 0;
                 if (rc != LCB_SUCCESS) {
-                    lcb_log(LOGARGS(INFO), CL_LOGFMT "failed to schedule SEARCH command", CL_LOGID(cl));
+                    lcb_log(CL_LOGARGS(cl, INFO), CL_LOGFMT "failed to schedule SEARCH command", CL_LOGID(cl));
                     goto FWD;
                 }
                 goto DONE;
@@ -421,14 +510,39 @@ static void conn_readcb(struct bufferevent *bev, void *cookie)
         } break;
     }
 FWD : {
+    int nvecs = evbuffer_peek(pktbuf, -1, nullptr, nullptr, 0);
+    std::vector<struct evbuffer_iovec> vecs(nvecs);
+    evbuffer_peek(pktbuf, -1, nullptr, vecs.data(), nvecs);
+    std::vector<lcb_IOV> iovs(nvecs);
+    for (int ii = 0; ii < nvecs; ii++) {
+        iovs[ii].iov_base = vecs[ii].iov_base;
+        iovs[ii].iov_len = vecs[ii].iov_len;
+    }
+
+    // Released by both the response and the flush of the buffers
+    auto *fwd = new fwd_packet{cl, pktbuf, 2};
     lcb_CMDPKTFWD cmd = {0};
-    cmd.vb.vtype = LCB_KV_COPY;
-    cmd.vb.u_buf.contig.bytes = pkt;
-    cmd.vb.u_buf.contig.nbytes = pktlen;
-    good_or_die(lcb_pktfwd3(instance, cl, &cmd), "Failed to forward packet");
+    cmd.vb.vtype = LCB_KV_IOV;
+    cmd.vb.u_buf.multi.iov = iovs.data();
+    cmd.vb.u_buf.multi.niov = nvecs;
+    cmd.vb.u_buf.multi.total_length = pktlen;
+    good_or_die(lcb_pktfwd3(instance, fwd, &cmd), "Failed to forward packet");
+    lcb_sched_leave(instance);
+    return true;
 }
 DONE:
     lcb_sched_leave(instance);
+    evbuffer_free(pktbuf);
+    return true;
+}
+
+
+static void conn_readcb(struct bufferevent *bev, void *cookie)
+{
+    auto *cl = (client *)cookie;
+    struct evbuffer *input = bufferevent_get_input(bev);
+    while (handle_packet(cl, input)) {
+    }
 }
 
 static void conn_eventcb(struct bufferevent *bev, short events, void *cookie)
@@ -436,34 +550,81 @@ static void conn_eventcb(struct bufferevent *bev, short events, void *cookie)
     auto *cl = (client *)cookie;
 
     if (events & BEV_EVENT_EOF) {
-        lcb_log(LOGARGS(INFO), CL_LOGFMT "connection closed", CL_LOGID(cl));
+        lcb_log(CL_LOGARGS(cl, INFO), CL_LOGFMT "connection closed", CL_LOGID(cl));
         bufferevent_free(bev);
         delete cl;
     } else if (events & BEV_EVENT_ERROR) {
-        lcb_log(LOGARGS(ERROR), CL_LOGFMT "got an error on the connection: %s\n", CL_LOGID(cl), strerror(errno));
+        lcb_log(CL_LOGARGS(cl, ERROR), CL_LOGFMT "got an error on the connection: %s\n", CL_LOGID(cl),
+                strerror(errno));
         bufferevent_free(bev);
         delete cl;
     } else {
-        lcb_log(LOGARGS(DEBUG), CL_LOGFMT "ignore event 0x%02x", CL_LOGID(cl), events);
+        lcb_log(CL_LOGARGS(cl, DEBUG), CL_LOGFMT "ignore event 0x%02x", CL_LOGID(cl), events);
     }
 }
 
-static void listener_cb(struct evconnlistener *, evutil_socket_t fd, struct sockaddr *addr, int naddr, void *)
+static void add_client(worker *w, evutil_socket_t fd)
 {
     struct bufferevent *bev;
-    bev = bufferevent_socket_new(evbase, fd, BEV_OPT_CLOSE_ON_FREE);
+    bev = bufferevent_socket_new(w->evbase, fd, BEV_OPT_CLOSE_ON_FREE);
 
     if (!bev) {
         die("Error constructing bufferevent");
     }
 
     auto *cl = new client();
+    cl->w = w;
     cl->fd = fd;
     cl->bev = bev;
-    getnameinfo(addr, naddr, cl->host, sizeof(cl->host), cl->port, sizeof(cl->port), NI_NUMERICHOST | NI_NUMERICSERV);
+    struct sockaddr_storage addr {
+    };
+    socklen_t naddr = sizeof(addr);
+    getpeername(fd, (struct sockaddr *)&addr, &naddr);
+    getnameinfo((struct sockaddr *)&addr, naddr, cl->host, sizeof(cl->host), cl->port, sizeof(cl->port),
+                NI_NUMERICHOST | NI_NUMERICSERV);
     bufferevent_setcb(bev, conn_readcb, nullptr, conn_eventcb, cl);
     bufferevent_enable(bev, EV_READ | EV_WRITE);
-    lcb_log(LOGARGS(INFO), CL_LOGFMT "new client connection", CL_LOGID(cl));
+    lcb_log(CL_LOGARGS(cl, INFO), CL_LOGFMT "new client connection", CL_LOGID(cl));
+}
+
+static void diag_instance(lcb_INSTANCE *instance)
+{
+    lcb_CMDDIAG *req;
+    lcb_cmddiag_create(&req);
+    lcb_cmddiag_prettify(req, true);
+    lcb_cmddiag_report_id(req, app_client_string, strlen(app_client_string));
+    lcb_diag(instance, nullptr, req);
+    lcb_cmddiag_destroy(req);
+}
+
+/** Reads the descriptors and commands sent to the worker, on its own thread */
+static void worker_notify_cb(evutil_socket_t fd, short, void *cookie)
+{
+    auto *w = (worker *)cookie;
+    int msg;
+    while (read(fd, &msg, sizeof(msg)) == sizeof(msg)) {
+        if (msg == WORKER_STOP) {
+            event_base_loopbreak(w->evbase);
+        } else if (msg == WORKER_DIAG) {
+            diag_instance(w->instance);
+        } else {
+            add_client(w, msg);
+        }
+    }
+}
+
+static void notify_worker(worker *w, int msg)
+{
+    if (write(w->pipefd[1], &msg, sizeof(msg)) != sizeof(msg)) {
+        die("Failed to notify worker thread");
+    }
+}
+
+static void listener_cb(struct evconnlistener *, evutil_socket_t fd, struct sockaddr *, int, void *)
+{
+    worker *w = workers[next_worker];
+    next_worker = (next_worker + 1) % workers.size();
+    notify_worker(w, fd);
 }
 
 static void setup_listener()
@@ -475,29 +636,23 @@ static void setup_listener()
     sin.sin_family = AF_INET;
     sin.sin_port = htons(config.port());
 
-    listener = evconnlistener_new_bind(evbase, listener_cb, nullptr, LEV_OPT_REUSEABLE | LEV_OPT_CLOSE_ON_FREE, -1,
-                                       (struct sockaddr *)&sin, sizeof(sin));
+    unsigned flags = LEV_OPT_REUSEABLE | LEV_OPT_CLOSE_ON_FREE;
+#ifdef LEV_OPT_REUSEABLE_PORT
+    // SO_REUSEPORT, so that several proxy processes may listen on the same port
+    flags |= LEV_OPT_REUSEABLE_PORT;
+#endif
+    listener = evconnlistener_new_bind(evbase, listener_cb, nullptr, flags, -1, (struct sockaddr *)&sin, sizeof(sin));
     if (!listener) {
         die("Failed to create proxy listener");
     }
-    lcb_log(LOGARGS(INFO), "Listening incoming proxy connections on port %d", config.port());
-}
-
-static void bootstrap_callback(lcb_INSTANCE *, lcb_STATUS err)
-{
-    good_or_die(err, "Failed to bootstrap");
-    lcb_log(LOGARGS(INFO), "connected to Couchbase Server");
-    setup_listener();
+    lcb_log(LOGARGS(workers[0]->instance, INFO), "Listening incoming proxy connections on port %d using %d threads",
+            config.port(), (int)workers.size());
 }
 
-static int terminating = 0;
-static void sigint_handler(int)
+static void sigint_cb(evutil_socket_t, short, void *)
 {
-    lcb_log(LOGARGS(INFO), "terminating the server");
-    if (!terminating) {
-        event_base_loopbreak(evbase);
-        terminating = 1;
-    }
+    lcb_log(LOGARGS(workers[0]->instance, INFO), "terminating the server");
+    event_base_loopbreak(evbase);
 }
 
 static void diag_callback(lcb_INSTANCE *, int, const lcb_RESPDIAG *resp)
@@ -515,40 +670,45 @@ static void diag_callback(lcb_INSTANCE *, int, const lcb_RESPDIAG *resp)
     }
 }
 
-static void sigquit_handler(int)
+static void sigquit_cb(evutil_socket_t, short, void *)
 {
-    lcb_CMDDIAG *req;
-    lcb_cmddiag_create(&req);
-    lcb_cmddiag_prettify(req, true);
-    lcb_cmddiag_report_id(req, app_client_string, strlen(app_client_string));
-    lcb_diag(instance, nullptr, req);
-    lcb_cmddiag_destroy(req);
+    for (auto *w : workers) {
+        notify_worker(w, WORKER_DIAG);
+    }
 }
 
-static void real_main(int argc, char **argv)
+extern "C" {
+static void *worker_run(void *cookie)
 {
-    Parser parser;
+    auto *w = (worker *)cookie;
+    event_base_dispatch(w->evbase);
+    return nullptr;
+}
+}
 
-    config.addToParser(parser);
-    parser.parse(argc, argv);
-    config.processOptions();
+/** Creates a worker and bootstraps its instance, before its thread starts */
+static worker *create_worker()
+{
+    auto *w = new worker();
+    workers.push_back(w);
 
     lcb_CREATEOPTS *cropts = nullptr;
     config.fillCropts(cropts);
 
-    /* bind to external libevent loop */
-    evbase = event_base_new();
+    /* bind to the libevent loop of the worker */
+    w->evbase = event_base_new();
     struct lcb_create_io_ops_st ciops {
     };
     ciops.v.v0.type = LCB_IO_OPS_LIBEVENT;
-    ciops.v.v0.cookie = evbase;
+    ciops.v.v0.cookie = w->evbase;
     lcb_io_opt_t ioops = nullptr;
     good_or_die(lcb_create_io_ops(&ioops, &ciops), "Failed to create and IO ops structure for libevent");
     lcb_createopts_io(cropts, ioops);
 
-    good_or_die(lcb_create(&instance, cropts), "Failed to create connection");
+    good_or_die(lcb_create(&w->instance, cropts), "Failed to create connection");
     lcb_createopts_destroy(cropts);
-    config.doCtls();
+    lcb_INSTANCE *instance = w->instance;
+    config.doCtls(instance);
     lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_CLIENT_STRING, app_client_string);
     lcb_cntl_string(instance, "select_bucket", "off");
     lcb_cntl_string(instance, "compression", "off");
@@ -557,31 +717,65 @@ static void real_main(int argc, char **argv)
     lcb_cntl_string(instance, "enable_mutation_tokens", "off");
     lcb_cntl_string(instance, "enable_durable_write", "off");
     lcb_cntl_string(instance, "enable_unordered_execution", "off");
-    lcb_set_bootstrap_callback(instance, bootstrap_callback);
     lcb_set_pktfwd_callback(instance, pktfwd_callback);
+    lcb_set_pktflushed_callback(instance, pktflushed_callback);
     lcb_install_callback(instance, LCB_CALLBACK_DIAG, (lcb_RESPCALLBACK)diag_callback);
 
     good_or_die(lcb_connect(instance), "Failed to connect to cluster");
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+    good_or_die(lcb_get_bootstrap_status(instance), "Failed to bootstrap");
+    lcb_log(LOGARGS(instance, INFO), "connected to Couchbase Server");
     if (config.useTimings()) {
-        hg.install(instance, stdout);
+        w->hg.install(instance, stdout);
+    }
+
+    if (pipe(w->pipefd) != 0) {
+        die("Failed to create worker pipe");
     }
+    evutil_make_socket_nonblocking(w->pipefd[0]);
+    w->notify = event_new(w->evbase, w->pipefd[0], EV_READ | EV_PERSIST, worker_notify_cb, w);
+    event_add(w->notify, nullptr);
+    return w;
+}
+
+static void real_main(int argc, char **argv)
+{
+    Parser parser;
+
+    config.addToParser(parser);
+    parser.parse(argc, argv);
+    config.processOptions();
+
     std::atexit(cleanup);
+    for (unsigned ii = 0; ii < config.threads(); ii++) {
+        create_worker();
+    }
 
-    /* setup CTRL-C handler */
-    struct sigaction action {
-    };
-    sigemptyset(&action.sa_mask);
-    action.sa_handler = sigint_handler;
-    action.sa_flags = 0;
-    sigaction(SIGINT, &action, nullptr);
+    evbase = event_base_new();
+    setup_listener();
+
+    /* setup CTRL-C and CTRL-\ handlers */
+    struct event *sigint = evsignal_new(evbase, SIGINT, sigint_cb, nullptr);
+    struct event *sigquit = evsignal_new(evbase, SIGQUIT, sigquit_cb, nullptr);
+    event_add(sigint, nullptr);
+    event_add(sigquit, nullptr);
 
-    /* setup CTRL-\ handler */
-    sigemptyset(&action.sa_mask);
-    action.sa_handler = sigquit_handler;
-    action.sa_flags = 0;
-    sigaction(SIGQUIT, &action, nullptr);
+    for (auto *w : workers) {
+        if (pthread_create(&w->thread, nullptr, worker_run, w) != 0) {
+            die("Failed to start worker thread");
+        }
+    }
 
     event_base_dispatch(evbase);
+
+    for (auto *w : workers) {
+        notify_worker(w, WORKER_STOP);
+    }
+    for (auto *w : workers) {
+        pthread_join(w->thread, nullptr);
+    }
+    event_free(sigint);
+    event_free(sigquit);
 }
 
 int main(int argc, char **argv)
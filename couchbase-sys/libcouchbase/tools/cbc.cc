@@ -1210,6 +1210,8 @@ static const char *iops_to_string(lcb_io_ops_type_t type)
             return "libuv";
         case LCB_IO_OPS_SELECT:
             return "select";
+        case LCB_IO_OPS_EPOLL:
+            return "epoll";
         case LCB_IO_OPS_WINIOCP:
             return "iocp";
         case LCB_IO_OPS_INVALID:
@@ -1250,7 +1252,7 @@ void VersionHandler::run()
         size_t ii;
         char buf[256] = {0}, *p = buf;
         lcb_io_ops_type_t known_io[] = {LCB_IO_OPS_WINIOCP, LCB_IO_OPS_LIBEVENT, LCB_IO_OPS_LIBUV, LCB_IO_OPS_LIBEV,
-                                        LCB_IO_OPS_SELECT};
+                                        LCB_IO_OPS_EPOLL, LCB_IO_OPS_SELECT};
 
         for (ii = 0; ii < sizeof(known_io) / sizeof(known_io[0]); ii++) {
             struct lcb_create_io_ops_st cio = {0};
@@ -2303,6 +2305,8 @@ static const char *optionsOrder[] = {"help",
                                      "lock",
                                      "unlock",
                                      "cp",
+                                     "import",
+                                     "export",
                                      "rm",
                                      "stats",
                                      "version",
@@ -2424,6 +2428,8 @@ static void setupHandlers()
     handlers_s["collection-manifest"] = new CollectionGetManifestHandler();
     handlers_s["collection-id"] = new CollectionGetCIDHandler();
     handlers_s["exists"] = new ExistsHandler();
+    handlers_s["import"] = new ImportHandler();
+    handlers_s["export"] = new ExportHandler();
 
     map<string, Handler *>::iterator ii;
     for (ii = handlers_s.begin(); ii != handlers_s.end(); ++ii) {
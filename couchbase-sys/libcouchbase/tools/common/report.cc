@@ -0,0 +1,371 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "report.h"
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+
+using namespace cbc;
+
+/*
+ * Latencies are counted in log-linear buckets of microseconds: exact below 128us, and 64 buckets per power of two
+ * above (an error below 1%), up to 2^40us.
+ */
+#define BUCKET_SUB_BITS 6
+#define BUCKET_LINEAR (2 << BUCKET_SUB_BITS)
+#define BUCKET_MAX_BITS 40
+#define BUCKET_COUNT (BUCKET_LINEAR + (BUCKET_MAX_BITS - BUCKET_SUB_BITS - 1) * (1 << BUCKET_SUB_BITS))
+
+static size_t bucket_index(lcb_U64 us)
+{
+    if (us >= (1ULL << BUCKET_MAX_BITS)) {
+        us = (1ULL << BUCKET_MAX_BITS) - 1;
+    }
+    if (us < BUCKET_LINEAR) {
+        return us;
+    }
+    int exp = 0;
+    while ((us >> (exp + 1)) != 0) {
+        exp++;
+    }
+    size_t mantissa = (us >> (exp - BUCKET_SUB_BITS)) - (1 << BUCKET_SUB_BITS);
+    return BUCKET_LINEAR + (exp - BUCKET_SUB_BITS - 1) * (1 << BUCKET_SUB_BITS) + mantissa;
+}
+
+static lcb_U64 bucket_value(size_t index)
+{
+    if (index < BUCKET_LINEAR) {
+        return index;
+    }
+    size_t exp = (index - BUCKET_LINEAR) / (1 << BUCKET_SUB_BITS) + BUCKET_SUB_BITS + 1;
+    size_t mantissa = (index - BUCKET_LINEAR) % (1 << BUCKET_SUB_BITS);
+    lcb_U64 width = 1ULL << (exp - BUCKET_SUB_BITS);
+    return (((1ULL << BUCKET_SUB_BITS) + mantissa) * width) + width / 2;
+}
+
+LatencyBuckets::LatencyBuckets() : buckets(new std::atomic<lcb_U64>[BUCKET_COUNT]()) {}
+
+void LatencyBuckets::record(lcb_U64 latency_ns)
+{
+    buckets[bucket_index(latency_ns / 1000)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void LatencyBuckets::addTo(std::vector<lcb_U64> &counts) const
+{
+    counts.resize(BUCKET_COUNT, 0);
+    for (size_t ii = 0; ii < BUCKET_COUNT; ii++) {
+        counts[ii] += buckets[ii].load(std::memory_order_relaxed);
+    }
+}
+
+lcb_U64 LatencyBuckets::percentile(const std::vector<lcb_U64> &counts, double pct, const std::vector<lcb_U64> *since)
+{
+    lcb_U64 total = 0;
+    for (size_t ii = 0; ii < counts.size(); ii++) {
+        total += counts[ii] - (since ? (*since)[ii] : 0);
+    }
+    if (total == 0) {
+        return 0;
+    }
+    auto wanted = static_cast<lcb_U64>(total * pct / 100.0 + 0.5);
+    if (wanted == 0) {
+        wanted = 1;
+    }
+    lcb_U64 seen = 0;
+    for (size_t ii = 0; ii < counts.size(); ii++) {
+        seen += counts[ii] - (since ? (*since)[ii] : 0);
+        if (seen >= wanted) {
+            return bucket_value(ii);
+        }
+    }
+    return bucket_value(counts.size() - 1);
+}
+
+struct BenchReport::Stats {
+    std::atomic<lcb_U64> count;
+    std::atomic<lcb_U64> errors;
+    std::atomic<lcb_U64> bytes_in;
+    std::atomic<lcb_U64> bytes_out;
+    LatencyBuckets latency;
+};
+
+struct BenchReport::Snapshot {
+    struct Op {
+        lcb_U64 count{0};
+        lcb_U64 errors{0};
+        lcb_U64 bytes_in{0};
+        lcb_U64 bytes_out{0};
+        std::vector<lcb_U64> buckets{};
+    };
+    lcb_U64 time_ns{0};
+    std::vector<Op> ops{};
+};
+
+namespace
+{
+struct Interval {
+    lcb_U64 count;
+    lcb_U64 errors;
+    lcb_U64 bytes_in;
+    lcb_U64 bytes_out;
+    double ops_per_sec;
+    lcb_U64 p50;
+    lcb_U64 p99;
+    lcb_U64 p999;
+};
+} // namespace
+
+BenchReport::BenchReport() = default;
+
+BenchReport::~BenchReport()
+{
+    if (file != nullptr) {
+        fclose(file);
+    }
+}
+
+void BenchReport::open(const std::string &path, Format fmt, const std::vector<std::string> &ops)
+{
+    file = fopen(path.c_str(), "w");
+    if (file == nullptr) {
+        throw std::runtime_error(path + ": " + strerror(errno));
+    }
+    format = fmt;
+    names = ops;
+    stats.reset(new Stats[ops.size()]());
+    start_ns = lcb_nstime();
+    previous.reset(new Snapshot(snapshot()));
+    first.reset(new Snapshot(*previous));
+    if (format == FORMAT_CSV) {
+        fprintf(file, "type,time,op,count,ops_per_sec,errors,p50_us,p99_us,p999_us,bytes_in,bytes_out\n");
+    }
+}
+
+void BenchReport::record(size_t op, lcb_U64 latency_ns, bool ok, size_t bytes_in)
+{
+    Stats &st = stats[op];
+    st.count.fetch_add(1, std::memory_order_relaxed);
+    if (!ok) {
+        st.errors.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (bytes_in) {
+        st.bytes_in.fetch_add(bytes_in, std::memory_order_relaxed);
+    }
+    st.latency.record(latency_ns);
+}
+
+void BenchReport::addBytesOut(size_t op, size_t bytes_out)
+{
+    stats[op].bytes_out.fetch_add(bytes_out, std::memory_order_relaxed);
+}
+
+BenchReport::Snapshot BenchReport::snapshot() const
+{
+    Snapshot snap;
+    snap.time_ns = lcb_nstime();
+    snap.ops.resize(names.size());
+    for (size_t ii = 0; ii < names.size(); ii++) {
+        const Stats &st = stats[ii];
+        Snapshot::Op &op = snap.ops[ii];
+        // Read the buckets before the count, so that the buckets never hold less than counted
+        st.latency.addTo(op.buckets);
+        op.count = st.count.load(std::memory_order_relaxed);
+        op.errors = st.errors.load(std::memory_order_relaxed);
+        op.bytes_in = st.bytes_in.load(std::memory_order_relaxed);
+        op.bytes_out = st.bytes_out.load(std::memory_order_relaxed);
+    }
+    return snap;
+}
+
+void BenchReport::write(const char *kind, const Snapshot &from, const Snapshot &to)
+{
+    double seconds = (to.time_ns - from.time_ns) / 1e9;
+    double time = (to.time_ns - start_ns) / 1e9;
+
+    Json::Value json;
+    json["type"] = kind;
+    json["time"] = time;
+    json["duration"] = seconds;
+    for (size_t ii = 0; ii < names.size(); ii++) {
+        const Snapshot::Op &a = from.ops[ii];
+        const Snapshot::Op &b = to.ops[ii];
+        Interval iv{};
+        iv.count = b.count - a.count;
+        iv.bytes_out = b.bytes_out - a.bytes_out;
+        if (iv.count == 0 && iv.bytes_out == 0) {
+            continue;
+        }
+        iv.errors = b.errors - a.errors;
+        iv.bytes_in = b.bytes_in - a.bytes_in;
+        iv.ops_per_sec = seconds > 0 ? iv.count / seconds : 0;
+        iv.p50 = LatencyBuckets::percentile(b.buckets, 50, &a.buckets);
+        iv.p99 = LatencyBuckets::percentile(b.buckets, 99, &a.buckets);
+        iv.p999 = LatencyBuckets::percentile(b.buckets, 99.9, &a.buckets);
+
+        if (format == FORMAT_CSV) {
+            fprintf(file, "%s,%.3f,%s,%llu,%.1f,%llu,%llu,%llu,%llu,%llu,%llu\n", kind, time, names[ii].c_str(),
+                    (unsigned long long)iv.count, iv.ops_per_sec, (unsigned long long)iv.errors,
+                    (unsigned long long)iv.p50, (unsigned long long)iv.p99, (unsigned long long)iv.p999,
+                    (unsigned long long)iv.bytes_in, (unsigned long long)iv.bytes_out);
+        } else {
+            Json::Value &op = json["ops"][names[ii]];
+            op["count"] = (Json::UInt64)iv.count;
+            op["ops_per_sec"] = iv.ops_per_sec;
+            op["errors"] = (Json::UInt64)iv.errors;
+            op["p50_us"] = (Json::UInt64)iv.p50;
+            op["p99_us"] = (Json::UInt64)iv.p99;
+            op["p999_us"] = (Json::UInt64)iv.p999;
+            op["bytes_in"] = (Json::UInt64)iv.bytes_in;
+            op["bytes_out"] = (Json::UInt64)iv.bytes_out;
+        }
+    }
+    if (format == FORMAT_JSON) {
+        std::string line = Json::FastWriter().write(json);
+        if (line.empty() || line[line.size() - 1] != '\n') {
+            line += '\n';
+        }
+        fputs(line.c_str(), file);
+    }
+    fflush(file);
+}
+
+void BenchReport::flush()
+{
+    if (file == nullptr) {
+        return;
+    }
+    Snapshot now = snapshot();
+    write("interval", *previous, now);
+    *previous = std::move(now);
+}
+
+void BenchReport::finish()
+{
+    if (file == nullptr) {
+        return;
+    }
+    flush();
+    last.reset(new Snapshot(*previous));
+    write("summary", *first, *last);
+}
+
+size_t BenchReport::compare(const std::string &baseline, double threshold_pct, FILE *out) const
+{
+    std::ifstream ifs(baseline.c_str());
+    if (!ifs.is_open()) {
+        throw std::runtime_error(baseline + ": " + strerror(errno));
+    }
+    Json::Value base;
+    std::string line;
+    while (std::getline(ifs, line)) {
+        Json::Value json;
+        if (parse_json(line, json) && json.isObject() && json["type"].asString() == "summary") {
+            base = json;
+        }
+    }
+    if (!base.isObject()) {
+        throw std::runtime_error(baseline + ": no summary found (the baseline must be a JSON report of a finished run)");
+    }
+    if (!last) {
+        throw std::runtime_error("the run has no summary to compare");
+    }
+
+    double seconds = (last->time_ns - first->time_ns) / 1e9;
+    size_t regressions = 0;
+    for (size_t ii = 0; ii < names.size(); ii++) {
+        const Json::Value &bop = base["ops"][names[ii]];
+        if (!bop.isObject()) {
+            continue;
+        }
+        const Snapshot::Op &a = first->ops[ii];
+        const Snapshot::Op &b = last->ops[ii];
+        lcb_U64 count = b.count - a.count;
+        double ops_per_sec = seconds > 0 ? count / seconds : 0;
+        lcb_U64 p99 = LatencyBuckets::percentile(b.buckets, 99, &a.buckets);
+
+        double base_ops = bop["ops_per_sec"].asDouble();
+        double base_p99 = bop["p99_us"].asDouble();
+        double ops_change = base_ops > 0 ? (ops_per_sec - base_ops) * 100 / base_ops : 0;
+        double p99_change = base_p99 > 0 ? (p99 - base_p99) * 100 / base_p99 : 0;
+        bool regressed = false;
+        if (-ops_change > threshold_pct) {
+            regressed = true;
+            fprintf(out, "REGRESSION %s: throughput %.1f ops/sec vs %.1f (%+.1f%%)\n", names[ii].c_str(), ops_per_sec,
+                    base_ops, ops_change);
+        }
+        if (p99_change > threshold_pct) {
+            regressed = true;
+            fprintf(out, "REGRESSION %s: p99 %lluus vs %.0fus (%+.1f%%)\n", names[ii].c_str(),
+                    (unsigned long long)p99, base_p99, p99_change);
+        }
+        if (regressed) {
+            regressions++;
+        } else {
+            fprintf(out, "OK %s: throughput %+.1f%%, p99 %+.1f%%\n", names[ii].c_str(), ops_change, p99_change);
+        }
+    }
+    return regressions;
+}
+
+ReportParams::ReportParams()
+    : o_report("report"), o_format("report-format"), o_compare("compare"), o_threshold("compare-threshold")
+{
+    o_report.description("Write throughput, latency percentiles, errors and bytes per operation type and second to "
+                         "this file");
+    o_format.description("Format of --report: \"json\" (one object per line) or \"csv\"").setDefault("json");
+    o_compare.description("Compare the summary of the run with the one of this JSON report, and exit with an error "
+                          "if an operation type regressed");
+    o_threshold.description("Percentage by which throughput may drop, or p99 latency grow, before --compare reports "
+                            "a regression")
+        .setDefault(10);
+}
+
+void ReportParams::addToParser(cliopts::Parser &parser)
+{
+    parser.addOption(o_report);
+    parser.addOption(o_format);
+    parser.addOption(o_compare);
+    parser.addOption(o_threshold);
+}
+
+void ReportParams::open(BenchReport &report, const std::vector<std::string> &ops)
+{
+    BenchReport::Format format;
+    if (o_format.result() == "json") {
+        format = BenchReport::FORMAT_JSON;
+    } else if (o_format.result() == "csv") {
+        format = BenchReport::FORMAT_CSV;
+    } else {
+        throw BadArg("Invalid --report-format \"" + o_format.result() + "\". Allowed values: \"json\", \"csv\"");
+    }
+    if (o_compare.passed() && !o_report.passed()) {
+        throw BadArg("--compare requires --report");
+    }
+    if (o_report.passed()) {
+        report.open(o_report.result(), format, ops);
+    }
+}
+
+bool ReportParams::finish(BenchReport &report)
+{
+    report.finish();
+    if (!o_compare.passed()) {
+        return false;
+    }
+    return report.compare(o_compare.result(), o_threshold.result(), stderr) > 0;
+}
@@ -0,0 +1,155 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef CBC_REPORT_H
+#define CBC_REPORT_H
+
+#include <libcouchbase/couchbase.h>
+#include <libcouchbase/utils.h>
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "options.h"
+
+namespace cbc
+{
+
+/**
+ * Lock-free latency histogram in log-linear buckets of microseconds: exact below 128us, and within 1% above.
+ * record() may be called from any thread, readers take copies of the counts with addTo().
+ */
+class LatencyBuckets
+{
+  public:
+    LatencyBuckets();
+
+    void record(lcb_U64 latency_ns);
+    /** Adds the current counts to @p counts, e.g. to merge the histograms of several threads */
+    void addTo(std::vector<lcb_U64> &counts) const;
+
+    /**
+     * @param counts filled by addTo()
+     * @param pct percentile to find, 0-100
+     * @param since earlier counts to subtract, for the percentile of an interval
+     * @return the latency in microseconds, 0 if nothing was counted
+     */
+    static lcb_U64 percentile(const std::vector<lcb_U64> &counts, double pct,
+                              const std::vector<lcb_U64> *since = nullptr);
+
+  private:
+    std::unique_ptr<std::atomic<lcb_U64>[]> buckets;
+};
+
+/**
+ * Benchmark statistics per operation type (throughput, latency percentiles, errors and bytes), written once per
+ * interval as JSON lines or CSV for scripts to consume.
+ *
+ * record() and addBytesOut() may be called from any thread. flush() and finish() are meant to be called from a
+ * single reporting thread: they only read the cumulative counters and keep the previous snapshot to derive the
+ * interval, so recording never takes a lock.
+ */
+class BenchReport
+{
+  public:
+    enum Format { FORMAT_JSON, FORMAT_CSV };
+
+    BenchReport();
+    ~BenchReport();
+
+    /**
+     * @param path file to write to
+     * @param format JSON lines or CSV
+     * @param ops names of the operation types, record() refers to them by index
+     */
+    void open(const std::string &path, Format format, const std::vector<std::string> &ops);
+    bool isOpen() const
+    {
+        return file != nullptr;
+    }
+
+    /**
+     * @param op index of the operation type
+     * @param latency_ns how long the operation took
+     * @param ok whether the operation succeeded
+     * @param bytes_in number of value bytes received
+     */
+    void record(size_t op, lcb_U64 latency_ns, bool ok, size_t bytes_in = 0);
+    /** Counts value bytes sent, usually when the operation is scheduled */
+    void addBytesOut(size_t op, size_t bytes_out);
+
+    /** Writes the interval since the previous flush() */
+    void flush();
+    /** Writes the summary over the whole run, which --compare reads back */
+    void finish();
+
+    /**
+     * Compares the summary of this run with the one of a previous run (a JSON report) and prints the operation
+     * types whose throughput dropped, or whose p99 latency grew, by more than threshold_pct percent.
+     *
+     * @return the number of regressions
+     */
+    size_t compare(const std::string &baseline, double threshold_pct, FILE *out) const;
+
+  private:
+    struct Stats;
+    struct Snapshot;
+
+    void write(const char *kind, const Snapshot &from, const Snapshot &to);
+    Snapshot snapshot() const;
+
+    FILE *file{nullptr};
+    Format format{FORMAT_JSON};
+    lcb_U64 start_ns{0};
+    std::vector<std::string> names{};
+    std::unique_ptr<Stats[]> stats{};
+    std::unique_ptr<Snapshot> previous{};
+    std::unique_ptr<Snapshot> first{};
+    std::unique_ptr<Snapshot> last{};
+};
+
+/** Command line options of BenchReport, shared by the tools which write one */
+class ReportParams
+{
+  public:
+    ReportParams();
+    void addToParser(cliopts::Parser &parser);
+
+    /**
+     * Opens the report if --report was passed
+     * @throws std::runtime_error on invalid options
+     */
+    void open(BenchReport &report, const std::vector<std::string> &ops);
+
+    /**
+     * Writes the summary and runs the comparison if --compare was passed.
+     * @return whether the run regressed
+     */
+    bool finish(BenchReport &report);
+
+  private:
+    cliopts::StringOption o_report;
+    cliopts::StringOption o_format;
+    cliopts::StringOption o_compare;
+    cliopts::UIntOption o_threshold;
+};
+
+} // namespace cbc
+
+#endif
@@ -0,0 +1,170 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef CBC_PILLOWFIGHT_CORPUS_H
+#define CBC_PILLOWFIGHT_CORPUS_H
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <fstream>
+#include <sstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Pillowfight
+{
+
+/* DocGeneratorBase comes from docgen.h, which has to be included first */
+
+/**
+ * Values of a pre-built corpus file, one value per line (e.g. documents
+ * exported with `jq -c`). Empty lines are skipped.
+ *
+ * The file is mapped into memory and its lines are indexed once, when it is
+ * loaded. The values are then handed out by reference: nothing is generated
+ * or copied per operation, and the stores pass them to
+ * lcb_cmdstore_value_iov_nocopy() straight from the mapping, which lives as
+ * long as the generator.
+ */
+class CorpusDocGenerator : public DocGeneratorBase
+{
+  public:
+    explicit CorpusDocGenerator(const std::string &path)
+    {
+        load(path);
+        const char *end = m_data + m_size;
+        for (const char *line = m_data; line < end;) {
+            const char *eol = static_cast<const char *>(memchr(line, '\n', end - line));
+            if (eol == nullptr) {
+                eol = end;
+            }
+            size_t len = eol - line;
+            if (len > 0 && line[len - 1] == '\r') {
+                len--;
+            }
+            if (len > 0) {
+                lcb_IOV value;
+                value.iov_base = const_cast<char *>(line);
+                value.iov_len = len;
+                m_values.push_back(value);
+            }
+            line = eol + 1;
+        }
+        if (m_values.empty()) {
+            throw std::runtime_error("No values in the corpus " + path);
+        }
+    }
+
+    ~CorpusDocGenerator() override
+    {
+#ifndef _WIN32
+        if (m_size > 0) {
+            munmap(const_cast<char *>(m_data), m_size);
+        }
+#endif
+    }
+
+    /** @return the number of values */
+    size_t size() const
+    {
+        return m_values.size();
+    }
+
+    class MyState : public GeneratorState
+    {
+      public:
+        MyState(const CorpusDocGenerator *parent) : m_parent(parent) {}
+
+        void populateIov(uint32_t seq, std::vector< lcb_IOV > &iov_out)
+        {
+            iov_out.resize(1);
+            iov_out[0] = m_parent->m_values[seq % m_parent->m_values.size()];
+        }
+
+      private:
+        const CorpusDocGenerator *m_parent;
+    };
+
+    std::unique_ptr<GeneratorState> createState(int, int) const
+    {
+        return std::unique_ptr<GeneratorState>(new MyState(this));
+    }
+
+  private:
+    CorpusDocGenerator(const CorpusDocGenerator &);
+    CorpusDocGenerator &operator=(const CorpusDocGenerator &);
+
+#ifdef _WIN32
+    /* no mapping, the file is read instead */
+    void load(const std::string &path)
+    {
+        std::ifstream ifs(path.c_str(), std::ios::binary);
+        if (!ifs.is_open()) {
+            throw std::runtime_error("Cannot open the corpus " + path);
+        }
+        std::stringstream ss;
+        ss << ifs.rdbuf();
+        m_buf = ss.str();
+        m_data = m_buf.data();
+        m_size = m_buf.size();
+    }
+    std::string m_buf;
+#else
+    void load(const std::string &path)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd == -1) {
+            throw std::runtime_error("Cannot open the corpus " + path + ": " + strerror(errno));
+        }
+        struct stat st {
+        };
+        if (fstat(fd, &st) == -1) {
+            int err = errno;
+            close(fd);
+            throw std::runtime_error("Cannot stat the corpus " + path + ": " + strerror(err));
+        }
+        m_size = st.st_size;
+        if (m_size > 0) {
+            void *addr = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr == MAP_FAILED) {
+                int err = errno;
+                close(fd);
+                throw std::runtime_error("Cannot map the corpus " + path + ": " + strerror(err));
+            }
+            m_data = static_cast<const char *>(addr);
+        }
+        close(fd);
+    }
+#endif
+
+    const char *m_data{nullptr};
+    size_t m_size{0};
+    std::vector< lcb_IOV > m_values;
+};
+
+} // namespace Pillowfight
+
+#endif
@@ -153,6 +153,18 @@ class RawDocGenerator : public DocGeneratorBase
         }
     }
 
+    /**
+     * @param sizes The sizes to use. A document takes the size at its sequence number (modulo the number of sizes),
+     *  so sizes may be repeated to weigh them.
+     */
+    RawDocGenerator(const std::vector< size_t > &sizes, int rnd) : m_sizes(sizes)
+    {
+        m_buf.insert(0, *std::max_element(sizes.begin(), sizes.end()), '#');
+        if (rnd) {
+            random_fill(m_buf, rnd);
+        }
+    }
+
     class MyState : public GeneratorState
     {
       public:
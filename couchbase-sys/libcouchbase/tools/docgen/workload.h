@@ -0,0 +1,347 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef CBC_PILLOWFIGHT_WORKLOAD_H
+#define CBC_PILLOWFIGHT_WORKLOAD_H
+
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Pillowfight
+{
+
+/**
+ * Workload specification, read from a file of `name=value` lines (YCSB style):
+ *
+ *     # uniform, zipfian, hotspot or latest
+ *     keydistribution=zipfian
+ *     zipfian.constant=0.99
+ *     hotspot.datafraction=0.2
+ *     hotspot.opnfraction=0.8
+ *     # relative weights of the operations
+ *     get=60
+ *     upsert=20
+ *     subdoc-get=0
+ *     subdoc-upsert=0
+ *     counter=5
+ *     touch=5
+ *     replica-get=5
+ *     exists=5
+ *     # value sizes and their relative weights
+ *     valuesize=128:70,1024:25,16384:5
+ */
+class WorkloadSpec
+{
+  public:
+    enum Distribution { UNIFORM, ZIPFIAN, HOTSPOT, LATEST };
+    enum Op { GET, UPSERT, SUBDOC_GET, SUBDOC_UPSERT, COUNTER, TOUCH, REPLICA_GET, EXISTS, NUM_OPS };
+
+    static WorkloadSpec parse(const std::string &path)
+    {
+        std::ifstream ifs(path.c_str());
+        if (!ifs.is_open()) {
+            throw std::runtime_error("cannot open workload file: " + path);
+        }
+
+        WorkloadSpec spec;
+        std::string line;
+        while (std::getline(ifs, line)) {
+            line = trim(line);
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+            size_t eq = line.find('=');
+            if (eq == std::string::npos) {
+                throw std::runtime_error("invalid workload line (need name=value): " + line);
+            }
+            spec.set(trim(line.substr(0, eq)), trim(line.substr(eq + 1)));
+        }
+
+        unsigned total = 0;
+        for (unsigned weight : spec.opWeights) {
+            total += weight;
+        }
+        if (total == 0) {
+            throw std::runtime_error("workload has no operations with a weight above zero");
+        }
+        return spec;
+    }
+
+    static const char *opName(Op op)
+    {
+        static const char *names[] = {"get",     "upsert", "subdoc-get",  "subdoc-upsert",
+                                      "counter", "touch",  "replica-get", "exists"};
+        return names[op];
+    }
+
+    bool usesSubdoc() const
+    {
+        return opWeights[SUBDOC_GET] > 0 || opWeights[SUBDOC_UPSERT] > 0;
+    }
+
+    /**
+     * Expands the value size weights to a table where each size appears in proportion to its weight, so that
+     * selecting sizes by sequence number (as RawDocGenerator does) follows the distribution.
+     */
+    std::vector<size_t> sizeTable() const
+    {
+        std::vector<size_t> table;
+        for (const auto &size : valueSizes) {
+            table.insert(table.end(), size.second, size.first);
+        }
+        return table;
+    }
+
+    Distribution distribution{UNIFORM};
+    double zipfianConstant{0.99};
+    double hotspotDataFraction{0.2};
+    double hotspotOpnFraction{0.8};
+    unsigned opWeights[NUM_OPS]{};
+    /** Pairs of value size and weight, empty to use --min-size and --max-size */
+    std::vector<std::pair<size_t, unsigned>> valueSizes{};
+
+  private:
+    static std::string trim(const std::string &str)
+    {
+        size_t begin = str.find_first_not_of(" \t\r\n");
+        if (begin == std::string::npos) {
+            return std::string();
+        }
+        size_t end = str.find_last_not_of(" \t\r\n");
+        return str.substr(begin, end - begin + 1);
+    }
+
+    static double parseFraction(const std::string &name, const std::string &value)
+    {
+        char *end = nullptr;
+        double res = std::strtod(value.c_str(), &end);
+        if (end == value.c_str() || *end != '\0' || res < 0 || res > 1) {
+            throw std::runtime_error(name + " must be a number between 0 and 1");
+        }
+        return res;
+    }
+
+    static unsigned long parseNumber(const std::string &name, const std::string &value)
+    {
+        char *end = nullptr;
+        unsigned long res = std::strtoul(value.c_str(), &end, 10);
+        if (end == value.c_str() || *end != '\0') {
+            throw std::runtime_error(name + " must be a number: " + value);
+        }
+        return res;
+    }
+
+    void set(const std::string &name, const std::string &value)
+    {
+        if (name == "keydistribution") {
+            if (value == "uniform") {
+                distribution = UNIFORM;
+            } else if (value == "zipfian") {
+                distribution = ZIPFIAN;
+            } else if (value == "hotspot") {
+                distribution = HOTSPOT;
+            } else if (value == "latest") {
+                distribution = LATEST;
+            } else {
+                throw std::runtime_error("unknown keydistribution: " + value);
+            }
+            return;
+        }
+        if (name == "zipfian.constant") {
+            zipfianConstant = parseFraction(name, value);
+            if (zipfianConstant == 0 || zipfianConstant == 1) {
+                throw std::runtime_error("zipfian.constant must be between 0 and 1 (exclusive)");
+            }
+            return;
+        }
+        if (name == "hotspot.datafraction") {
+            hotspotDataFraction = parseFraction(name, value);
+            return;
+        }
+        if (name == "hotspot.opnfraction") {
+            hotspotOpnFraction = parseFraction(name, value);
+            return;
+        }
+        if (name == "valuesize") {
+            valueSizes.clear();
+            size_t begin = 0;
+            while (begin < value.size()) {
+                size_t end = value.find(',', begin);
+                if (end == std::string::npos) {
+                    end = value.size();
+                }
+                std::string entry = trim(value.substr(begin, end - begin));
+                size_t colon = entry.find(':');
+                size_t size = parseNumber(name, entry.substr(0, colon));
+                unsigned weight = colon == std::string::npos ? 1 : parseNumber(name, entry.substr(colon + 1));
+                if (size == 0) {
+                    throw std::runtime_error("valuesize sizes must be above zero");
+                }
+                if (weight > 0) {
+                    valueSizes.emplace_back(size, weight);
+                }
+                begin = end + 1;
+            }
+            return;
+        }
+        for (int ii = 0; ii < NUM_OPS; ii++) {
+            if (name == opName(static_cast<Op>(ii))) {
+                opWeights[ii] = parseNumber(name, value);
+                return;
+            }
+        }
+        throw std::runtime_error("unknown workload setting: " + name);
+    }
+};
+
+/**
+ * Zipfian distribution over [0, n) as generated by YCSB (Gray et al., "Quickly Generating Billion-Record Synthetic
+ * Databases"). Rank 0 is the most popular. The constants are computed once, in O(n), and shared by all threads.
+ */
+class ZipfianTable
+{
+  public:
+    ZipfianTable(uint32_t items, double constant) : n(items), theta(constant)
+    {
+        zetan = zeta(items, theta);
+        double zeta2 = zeta(2, theta);
+        alpha = 1.0 / (1.0 - theta);
+        eta = (1 - std::pow(2.0 / n, 1 - theta)) / (1 - zeta2 / zetan);
+        half_pow_theta = 1 + std::pow(0.5, theta);
+    }
+
+    /** @param u uniformly distributed in [0, 1) */
+    uint32_t rank(double u) const
+    {
+        double uz = u * zetan;
+        if (uz < 1.0) {
+            return 0;
+        }
+        if (uz < half_pow_theta) {
+            return 1;
+        }
+        auto res = static_cast<uint32_t>(n * std::pow(eta * u - eta + 1, alpha));
+        return res < n ? res : n - 1;
+    }
+
+  private:
+    static double zeta(uint32_t items, double theta)
+    {
+        double sum = 0;
+        for (uint32_t ii = 1; ii <= items; ii++) {
+            sum += 1 / std::pow(ii, theta);
+        }
+        return sum;
+    }
+
+    uint32_t n;
+    double theta;
+    double zetan;
+    double alpha;
+    double eta;
+    double half_pow_theta;
+};
+
+/**
+ * Per-thread generator of the operations (and their keys) of a workload. Keys are offsets in [0, items).
+ */
+class WorkloadGenerator
+{
+  public:
+    WorkloadGenerator(const WorkloadSpec &spec, const ZipfianTable *zipf, uint32_t items, uint32_t seed)
+        : m_spec(spec), m_zipf(zipf), m_items(items), m_latest(items - 1), m_rng(seed)
+    {
+        unsigned total = 0;
+        for (int ii = 0; ii < WorkloadSpec::NUM_OPS; ii++) {
+            total += spec.opWeights[ii];
+            m_cumulative[ii] = total;
+        }
+    }
+
+    WorkloadSpec::Op nextOp()
+    {
+        std::uniform_int_distribution<unsigned> dist(0, m_cumulative[WorkloadSpec::NUM_OPS - 1] - 1);
+        unsigned pick = dist(m_rng);
+        int ii = 0;
+        while (pick >= m_cumulative[ii]) {
+            ii++;
+        }
+        return static_cast<WorkloadSpec::Op>(ii);
+    }
+
+    /**
+     * @param write whether the key is for a mutation. With the `latest` distribution writes go to new (the
+     * following) keys, and reads favour the keys written last.
+     */
+    uint32_t nextKey(bool write)
+    {
+        switch (m_spec.distribution) {
+            case WorkloadSpec::ZIPFIAN:
+                // Scatter the popular ranks over the key space, like YCSB's scrambled zipfian, so that they do not
+                // all land next to each other
+                return scramble(m_zipf->rank(uniform()));
+            case WorkloadSpec::HOTSPOT: {
+                auto hot = static_cast<uint32_t>(m_items * m_spec.hotspotDataFraction);
+                if (hot > 0 && (hot == m_items || uniform() < m_spec.hotspotOpnFraction)) {
+                    return static_cast<uint32_t>(uniform() * hot);
+                }
+                return hot + static_cast<uint32_t>(uniform() * (m_items - hot));
+            }
+            case WorkloadSpec::LATEST:
+                if (write) {
+                    m_latest = (m_latest + 1) % m_items;
+                    return m_latest;
+                }
+                return (m_latest + m_items - m_zipf->rank(uniform())) % m_items;
+            case WorkloadSpec::UNIFORM:
+            default:
+                return static_cast<uint32_t>(uniform() * m_items);
+        }
+    }
+
+  private:
+    double uniform()
+    {
+        return std::uniform_real_distribution<double>(0, 1)(m_rng);
+    }
+
+    uint32_t scramble(uint32_t rank) const
+    {
+        // FNV-1a over the bytes of the rank
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        for (int ii = 0; ii < 4; ii++) {
+            hash ^= (rank >> (ii * 8)) & 0xff;
+            hash *= 0x100000001b3ULL;
+        }
+        return static_cast<uint32_t>(hash % m_items);
+    }
+
+    const WorkloadSpec &m_spec;
+    const ZipfianTable *m_zipf;
+    uint32_t m_items;
+    uint32_t m_latest;
+    unsigned m_cumulative[WorkloadSpec::NUM_OPS]{};
+    std::mt19937 m_rng;
+};
+} // namespace Pillowfight
+#endif
@@ -0,0 +1,151 @@
+//! Overhead of the Rust side of a key-value operation, step by step.
+//!
+//! Run with `cargo bench --features bench-internals`. Criterion reports the time per
+//! operation of every step, and the allocations per operation are counted by the global
+//! allocator below and printed before the measurements.
+
+use couchbase::bench;
+use couchbase::GetOptions;
+use criterion::{black_box, criterion_group, criterion_main, BatchSize, Criterion};
+use serde_derive::{Deserialize, Serialize};
+use std::alloc::{GlobalAlloc, Layout, System};
+use std::collections::HashMap;
+use std::sync::atomic::{AtomicUsize, Ordering};
+
+/// Counts the allocations of the process.
+struct CountingAlloc;
+
+static ALLOCATIONS: AtomicUsize = AtomicUsize::new(0);
+
+unsafe impl GlobalAlloc for CountingAlloc {
+    unsafe fn alloc(&self, layout: Layout) -> *mut u8 {
+        ALLOCATIONS.fetch_add(1, Ordering::Relaxed);
+        System.alloc(layout)
+    }
+
+    unsafe fn dealloc(&self, ptr: *mut u8, layout: Layout) {
+        System.dealloc(ptr, layout)
+    }
+
+    unsafe fn realloc(&self, ptr: *mut u8, layout: Layout, new_size: usize) -> *mut u8 {
+        ALLOCATIONS.fetch_add(1, Ordering::Relaxed);
+        System.realloc(ptr, layout, new_size)
+    }
+}
+
+#[global_allocator]
+static GLOBAL: CountingAlloc = CountingAlloc;
+
+/// A typical small JSON document.
+#[derive(Debug, Serialize, Deserialize)]
+struct Airline {
+    id: u32,
+    name: String,
+    iata: Option<String>,
+    icao: Option<String>,
+    callsign: Option<String>,
+    country: String,
+    tags: Vec<String>,
+    attributes: HashMap<String, i64>,
+}
+
+fn airline() -> Airline {
+    let mut attributes = HashMap::new();
+    attributes.insert("fleet".into(), 112);
+    attributes.insert("founded".into(), 1957);
+    Airline {
+        id: 10123,
+        name: "Texas Wings".into(),
+        iata: Some("TQ".into()),
+        icao: Some("TXW".into()),
+        callsign: Some("TXW".into()),
+        country: "United States".into(),
+        tags: vec!["regional".into(), "cargo".into()],
+        attributes,
+    }
+}
+
+/// Prints the allocations per run of `f`, averaged over many runs after a warmup.
+fn report_allocations<F: FnMut()>(name: &str, mut f: F) {
+    const RUNS: usize = 10_000;
+    for _ in 0..RUNS {
+        f();
+    }
+    let before = ALLOCATIONS.load(Ordering::Relaxed);
+    for _ in 0..RUNS {
+        f();
+    }
+    let allocations = ALLOCATIONS.load(Ordering::Relaxed) - before;
+    println!(
+        "{:<24} {:>6.2} allocations/op",
+        name,
+        allocations as f64 / RUNS as f64
+    );
+}
+
+fn hot_paths(c: &mut Criterion) {
+    let doc = airline();
+    let value = bench::encode_content(&doc);
+    let large = vec![b'v'; 64 * 1024];
+
+    report_allocations("encode_get", || {
+        bench::encode_get(
+            "airline_10123",
+            "inventory",
+            "airline",
+            GetOptions::default(),
+        )
+    });
+    report_allocations("cookie_round_trip", bench::cookie_round_trip);
+    report_allocations("decode_get", || {
+        black_box(bench::decode_get(&value, 1, 0x02000006));
+    });
+    report_allocations("encode_content", || {
+        black_box(bench::encode_content(&doc));
+    });
+    report_allocations("decode_content", || {
+        let result = bench::decode_get(&value, 1, 0x02000006);
+        black_box(result.content::<Airline>().unwrap());
+    });
+    report_allocations("complete_get", || {
+        black_box(bench::complete_get(bench::decode_get(&value, 1, 0)));
+    });
+
+    c.bench_function("encode_get", |b| {
+        b.iter(|| {
+            bench::encode_get(
+                "airline_10123",
+                "inventory",
+                "airline",
+                GetOptions::default(),
+            )
+        })
+    });
+    c.bench_function("cookie_round_trip", |b| b.iter(bench::cookie_round_trip));
+    c.bench_function("decode_get", |b| {
+        b.iter(|| bench::decode_get(black_box(&value), 1, 0x02000006))
+    });
+    c.bench_function("decode_get_64k", |b| {
+        b.iter(|| bench::decode_get(black_box(&large), 1, 0x03000000))
+    });
+    c.bench_function("encode_content", |b| {
+        b.iter(|| bench::encode_content(black_box(&doc)))
+    });
+    c.bench_function("decode_content", |b| {
+        b.iter_batched(
+            || bench::decode_get(&value, 1, 0x02000006),
+            |result| result.content::<Airline>().unwrap(),
+            BatchSize::SmallInput,
+        )
+    });
+    c.bench_function("complete_get", |b| {
+        b.iter_batched(
+            || bench::decode_get(&value, 1, 0),
+            bench::complete_get,
+            BatchSize::SmallInput,
+        )
+    });
+}
+
+criterion_group!(benches, hot_paths);
+criterion_main!(benches);
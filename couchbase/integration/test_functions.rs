@@ -12,6 +12,10 @@ pub fn tests(config: Arc<TestConfig>) -> Vec<TestFn> {
             "test_upsert_get",
             Box::pin(kv::test_upsert_get(config.clone())),
         ),
+        TestFn::new(
+            "test_upsert_raw_get",
+            Box::pin(kv::test_upsert_raw_get(config.clone())),
+        ),
         TestFn::new(
             "test_upsert_replace_get",
             Box::pin(kv::test_upsert_replace_get(config.clone())),
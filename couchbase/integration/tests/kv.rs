@@ -1,7 +1,7 @@
 use couchbase::{
-    ClientVerifiedDurability, CouchbaseError, DurabilityLevel, GetAndLockOptions, GetOptions,
-    GetSpecOptions, LookupInOptions, LookupInSpec, PersistTo, RemoveOptions, ReplaceOptions,
-    ReplicateTo, UpsertOptions,
+    ClientVerifiedDurability, CouchbaseError, DocumentFormat, DurabilityLevel, GetAndLockOptions,
+    GetOptions, GetSpecOptions, LookupInOptions, LookupInSpec, PersistTo, RawContent,
+    RemoveOptions, ReplaceOptions, ReplicateTo, UpsertOptions,
 };
 
 use crate::util::{BeerDocument, TestConfig};
@@ -36,6 +36,43 @@ pub async fn test_upsert_get(config: Arc<TestConfig>) -> TestResult<bool> {
     Ok(false)
 }
 
+pub async fn test_upsert_raw_get(config: Arc<TestConfig>) -> TestResult<bool> {
+    if !config.supports_feature(util::TestFeature::KeyValue) {
+        return Ok(true);
+    }
+
+    let collection = config.collection();
+    let key = Uuid::new_v4().to_string();
+    let content = vec![0x00u8, 0xff, 0x10, 0x7f];
+
+    let result = collection
+        .upsert_raw(
+            &key,
+            RawContent::binary(content.clone()),
+            UpsertOptions::default(),
+        )
+        .await?;
+    assert_ne!(0, result.cas());
+
+    let result = collection.get(&key, GetOptions::default()).await?;
+    assert_eq!(DocumentFormat::Binary, result.format());
+    assert_eq!(content, result.into_content_bytes());
+
+    collection
+        .replace_raw(
+            &key,
+            RawContent::string("Hello Rust!"),
+            ReplaceOptions::default(),
+        )
+        .await?;
+
+    let result = collection.get(&key, GetOptions::default()).await?;
+    assert_eq!(DocumentFormat::String, result.format());
+    assert_eq!("Hello Rust!", result.content_as_str()?);
+
+    Ok(false)
+}
+
 pub async fn test_upsert_replace_get(config: Arc<TestConfig>) -> TestResult<bool> {
     if !config.supports_feature(util::TestFeature::KeyValue) {
         return Ok(true);
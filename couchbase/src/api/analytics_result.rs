@@ -1,5 +1,5 @@
+use crate::io::RowReceiver;
 use crate::{CouchbaseError, CouchbaseResult, ErrorContext};
-use futures::channel::mpsc::UnboundedReceiver;
 use futures::channel::oneshot::Receiver;
 use futures::{Stream, StreamExt};
 use serde::de::DeserializeOwned;
@@ -8,12 +8,12 @@ use serde_json::Value;
 
 #[derive(Debug)]
 pub struct AnalyticsResult {
-    rows: Option<UnboundedReceiver<Vec<u8>>>,
+    rows: Option<RowReceiver>,
     meta: Option<Receiver<AnalyticsMetaData>>,
 }
 
 impl AnalyticsResult {
-    pub fn new(rows: UnboundedReceiver<Vec<u8>>, meta: Receiver<AnalyticsMetaData>) -> Self {
+    pub(crate) fn new(rows: RowReceiver, meta: Receiver<AnalyticsMetaData>) -> Self {
         Self {
             rows: Some(rows),
             meta: Some(meta),
@@ -1,11 +1,13 @@
+use crate::api::sequence::IdSequence;
 use crate::io::request::{CounterRequest, MutateRequest, MutateRequestType, Request};
 use crate::io::Core;
 use crate::{
     AppendOptions, CouchbaseError, CouchbaseResult, CounterOptions, CounterResult,
     DecrementOptions, DurabilityLevel, ErrorContext, IncrementOptions, MutationResult,
-    PrependOptions,
+    PrependOptions, SequenceOptions,
 };
 use futures::channel::oneshot;
+use futures::future::join_all;
 use std::convert::TryFrom;
 use std::sync::Arc;
 
@@ -42,6 +44,8 @@ impl BinaryCollection {
         self.core.send(Request::Mutate(MutateRequest {
             id: id.into(),
             content,
+            flags: 0,
+            json: false,
             sender,
             bucket: self.bucket_name.clone(),
             ty: MutateRequestType::Append { options },
@@ -62,6 +66,8 @@ impl BinaryCollection {
         self.core.send(Request::Mutate(MutateRequest {
             id: id.into(),
             content,
+            flags: 0,
+            json: false,
             sender,
             bucket: self.bucket_name.clone(),
             ty: MutateRequestType::Prepend { options },
@@ -111,6 +117,7 @@ impl BinaryCollection {
                 expiry: options.expiry,
                 delta,
                 durability: options.durability,
+                initial: None,
             },
             scope: self.scope_name.clone(),
             collection: self.name.clone(),
@@ -160,10 +167,154 @@ impl BinaryCollection {
                 expiry: options.expiry,
                 delta,
                 durability: options.durability,
+                initial: None,
             },
             scope: self.scope_name.clone(),
             collection: self.name.clone(),
         }));
         receiver.await.unwrap()
     }
+
+    /// Increments multiple counters at once.
+    ///
+    /// All requests are handed to the IO layer as a single batch, which schedules them
+    /// grouped by the node they belong to. The results are returned in the same order as
+    /// the ids.
+    pub async fn increment_multi<I, S>(
+        &self,
+        ids: I,
+        options: impl Into<Option<IncrementOptions>>,
+    ) -> Vec<CouchbaseResult<CounterResult>>
+    where
+        I: IntoIterator<Item = S>,
+        S: Into<String>,
+    {
+        let options = unwrap_or_default!(options.into());
+        let delta = match options.delta {
+            Some(d) => i64::try_from(d).ok(),
+            None => Some(1),
+        };
+        self.counter_multi(
+            ids,
+            CounterOptions {
+                timeout: options.timeout,
+                cas: options.cas,
+                expiry: options.expiry,
+                delta: delta.unwrap_or_default(),
+                durability: options.durability,
+                initial: None,
+            },
+            delta.is_some(),
+            "increment",
+        )
+        .await
+    }
+
+    /// Decrements multiple counters at once, see `increment_multi`.
+    pub async fn decrement_multi<I, S>(
+        &self,
+        ids: I,
+        options: impl Into<Option<DecrementOptions>>,
+    ) -> Vec<CouchbaseResult<CounterResult>>
+    where
+        I: IntoIterator<Item = S>,
+        S: Into<String>,
+    {
+        let options = unwrap_or_default!(options.into());
+        let delta = match options.delta {
+            Some(d) => i64::try_from(d).ok().map(|d| -d),
+            None => Some(-1),
+        };
+        self.counter_multi(
+            ids,
+            CounterOptions {
+                timeout: options.timeout,
+                cas: options.cas,
+                expiry: options.expiry,
+                delta: delta.unwrap_or_default(),
+                durability: options.durability,
+                initial: None,
+            },
+            delta.is_some(),
+            "decrement",
+        )
+        .await
+    }
+
+    /// Opens a sequence of ids backed by the counter document `id`, see `IdSequence`.
+    ///
+    /// The counter is created by the first block reserved if it does not exist yet.
+    pub fn sequence<S: Into<String>>(
+        &self,
+        id: S,
+        options: impl Into<Option<SequenceOptions>>,
+    ) -> IdSequence {
+        IdSequence::new(
+            self.core.clone(),
+            id.into(),
+            self.bucket_name.clone(),
+            self.scope_name.clone(),
+            self.name.clone(),
+            unwrap_or_default!(options.into()),
+        )
+    }
+
+    async fn counter_multi<I, S>(
+        &self,
+        ids: I,
+        options: CounterOptions,
+        valid_delta: bool,
+        op: &str,
+    ) -> Vec<CouchbaseResult<CounterResult>>
+    where
+        I: IntoIterator<Item = S>,
+        S: Into<String>,
+    {
+        // Same checks as for a single counter, reported for every id.
+        if let Some(DurabilityLevel::ClientVerified(_)) = options.durability {
+            let msg = format!("cannot use client verified durability with {}", op);
+            return ids
+                .into_iter()
+                .map(|_| {
+                    Err(CouchbaseError::InvalidArgument {
+                        ctx: ErrorContext::from(("durability", msg.as_str())),
+                    })
+                })
+                .collect();
+        }
+        if !valid_delta {
+            return ids
+                .into_iter()
+                .map(|_| {
+                    Err(CouchbaseError::Generic {
+                        ctx: ErrorContext::default(),
+                    })
+                })
+                .collect();
+        }
+
+        let mut requests = vec![];
+        let mut receivers = vec![];
+        for id in ids {
+            let (sender, receiver) = oneshot::channel();
+            requests.push(Request::Counter(CounterRequest {
+                id: id.into(),
+                sender,
+                bucket: self.bucket_name.clone(),
+                options: options.clone(),
+                scope: self.scope_name.clone(),
+                collection: self.name.clone(),
+            }));
+            receivers.push(receiver);
+        }
+        if !requests.is_empty() {
+            self.core.send(Request::Batch(requests));
+        }
+
+        join_all(receivers)
+            .await
+            .into_iter()
+            .map(|r| r.unwrap())
+            .collect()
+    }
 }
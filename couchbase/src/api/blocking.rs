@@ -0,0 +1,518 @@
+//! A blocking client, which drives libcouchbase on the calling thread.
+//!
+//! Every operation schedules its request and runs the libcouchbase event loop until
+//! the response arrived, so there is neither an async runtime nor an IO thread which
+//! requests and responses need to be handed over to. A `Cluster` and everything opened
+//! from it can only be used on the thread which connected it, use one `Cluster` per
+//! thread to scale out.
+//!
+//! The key-value API mirrors the one of the async `Collection`.
+//!
+//! ```no_run
+//! use couchbase::blocking::Cluster;
+//!
+//! let cluster = Cluster::connect("couchbase://127.0.0.1", "Administrator", "password");
+//! let collection = cluster.bucket("travel-sample").default_collection();
+//! let result = collection.get("airline_10", None);
+//! ```
+use crate::api::cluster::resolve_options;
+use crate::io::{Core, InlineDriver};
+use crate::{
+    AppendOptions, ClusterOptions, CouchbaseResult, CounterResult, DecrementOptions, ExistsOptions,
+    ExistsResult, GetAndLockOptions, GetAndTouchOptions, GetAnyReplicaOptions,
+    GetFastestReplicaOptions, GetFreshestReplicaOptions, GetOptions, GetReplicaResult, GetResult,
+    IdSequence as AsyncIdSequence, IncrementOptions, InsertOptions, LookupInOptions,
+    LookupInResult, LookupInSpec, MutateInOptions, MutateInResult, MutateInSpec, MutationResult,
+    PrependOptions, RawContent, RemoveOptions, ReplaceOptions, SequenceOptions, TouchOptions,
+    UnlockOptions, UpsertOptions,
+};
+use serde::Serialize;
+use std::cell::RefCell;
+use std::future::Future;
+use std::rc::Rc;
+use std::sync::Arc;
+use std::time::Duration;
+
+/// Shared by all the handles opened from a `Cluster`, which ties them to its thread.
+type Driver = Rc<RefCell<InlineDriver>>;
+
+fn block_on<F: Future>(driver: &Driver, future: F) -> F::Output {
+    driver.borrow_mut().block_on(future)
+}
+
+/// Connect to a Couchbase cluster, driving it on the current thread
+#[derive(Debug)]
+pub struct Cluster {
+    inner: crate::Cluster,
+    driver: Driver,
+}
+
+impl Cluster {
+    /// Connect to a couchbase cluster
+    ///
+    /// The cluster is bootstrapped before this returns.
+    ///
+    /// # Arguments
+    ///
+    /// * `connection_string` - the connection string containing the bootstrap hosts
+    /// * `username` - the name of the user, used for authentication
+    /// * `password` - the password of the user
+    pub fn connect<S: Into<String>>(connection_string: S, username: S, password: S) -> Self {
+        Self::new(
+            connection_string.into(),
+            Some(username.into()),
+            Some(password.into()),
+            false,
+        )
+    }
+
+    /// Connect to a couchbase cluster with custom options
+    ///
+    /// The options which configure the IO threads, such as `io_threads` or
+    /// `zero_copy_threshold`, do not apply since there are none.
+    pub fn connect_with_options(
+        connection_string: impl Into<String>,
+        opts: ClusterOptions,
+    ) -> Self {
+        let (connection_string, username, password, io_config) =
+            resolve_options(connection_string.into(), opts);
+        Self::new(connection_string, username, password, io_config.preconnect)
+    }
+
+    fn new(
+        connection_string: String,
+        username: Option<String>,
+        password: Option<String>,
+        preconnect: bool,
+    ) -> Self {
+        let driver = InlineDriver::new(connection_string, username, password, preconnect);
+        let core = Arc::new(Core::inline(driver.queue()));
+        Self {
+            inner: crate::Cluster::from_core(core),
+            driver: Rc::new(RefCell::new(driver)),
+        }
+    }
+
+    /// Open and connect to a couchbase `Bucket`
+    ///
+    /// The bucket is connected before this returns.
+    ///
+    /// # Arguments
+    ///
+    /// * `name` - the name of the bucket
+    pub fn bucket<S: Into<String>>(&self, name: S) -> Bucket {
+        let inner = self.inner.bucket(name);
+        self.driver.borrow_mut().run();
+        Bucket {
+            inner,
+            driver: self.driver.clone(),
+        }
+    }
+}
+
+/// Provides bucket-level access to collections
+#[derive(Debug)]
+pub struct Bucket {
+    inner: crate::Bucket,
+    driver: Driver,
+}
+
+impl Bucket {
+    /// Opens the `default` collection (also used when a cluster with no collection support is used)
+    pub fn default_collection(&self) -> Collection {
+        Collection::new(self.inner.default_collection(), self.driver.clone())
+    }
+
+    /// The name of the bucket
+    pub fn name(&self) -> &str {
+        self.inner.name()
+    }
+
+    /// Opens a custom collection inside the `default` scope
+    ///
+    /// # Arguments
+    ///
+    /// * `name` - the collection name
+    pub fn collection<S: Into<String>>(&self, name: S) -> Collection {
+        Collection::new(self.inner.collection(name), self.driver.clone())
+    }
+
+    /// Opens a custom scope
+    ///
+    /// # Arguments
+    ///
+    /// * `name` - the scope name
+    pub fn scope<S: Into<String>>(&self, name: S) -> Scope {
+        Scope {
+            inner: self.inner.scope(name),
+            driver: self.driver.clone(),
+        }
+    }
+}
+
+/// Scopes provide access to a group of collections
+#[derive(Debug)]
+pub struct Scope {
+    inner: crate::Scope,
+    driver: Driver,
+}
+
+impl Scope {
+    /// The name of the scope
+    pub fn name(&self) -> &str {
+        self.inner.name()
+    }
+
+    /// Opens a custom collection inside the current scope
+    ///
+    /// # Arguments
+    ///
+    /// * `name` - the collection name
+    pub fn collection(&self, name: impl Into<String>) -> Collection {
+        Collection::new(self.inner.collection(name), self.driver.clone())
+    }
+}
+
+/// Blocking API to access Key/Value operations, see the async `Collection`
+#[derive(Debug)]
+pub struct Collection {
+    inner: crate::Collection,
+    driver: Driver,
+}
+
+impl Collection {
+    fn new(inner: crate::Collection, driver: Driver) -> Self {
+        Self { inner, driver }
+    }
+
+    /// See `crate::Collection::coalesce_upserts`.
+    pub fn coalesce_upserts(self, enable: bool) -> Self {
+        Self {
+            inner: self.inner.coalesce_upserts(enable),
+            driver: self.driver,
+        }
+    }
+
+    /// The name of the collection
+    pub fn name(&self) -> &str {
+        self.inner.name()
+    }
+
+    pub fn get(
+        &self,
+        id: impl Into<String>,
+        options: impl Into<Option<GetOptions>>,
+    ) -> CouchbaseResult<GetResult> {
+        block_on(&self.driver, self.inner.get(id, options))
+    }
+
+    pub fn get_multi<I, S>(
+        &self,
+        ids: I,
+        options: impl Into<Option<GetOptions>>,
+    ) -> Vec<CouchbaseResult<GetResult>>
+    where
+        I: IntoIterator<Item = S>,
+        S: Into<String>,
+    {
+        block_on(&self.driver, self.inner.get_multi(ids, options))
+    }
+
+    pub fn get_any_replica(
+        &self,
+        id: impl Into<String>,
+        options: impl Into<Option<GetAnyReplicaOptions>>,
+    ) -> CouchbaseResult<GetReplicaResult> {
+        block_on(&self.driver, self.inner.get_any_replica(id, options))
+    }
+
+    pub fn get_fastest_replica(
+        &self,
+        id: impl Into<String>,
+        options: impl Into<Option<GetFastestReplicaOptions>>,
+    ) -> CouchbaseResult<GetReplicaResult> {
+        block_on(&self.driver, self.inner.get_fastest_replica(id, options))
+    }
+
+    pub fn get_freshest_replica(
+        &self,
+        id: impl Into<String>,
+        options: impl Into<Option<GetFreshestReplicaOptions>>,
+    ) -> CouchbaseResult<GetReplicaResult> {
+        block_on(&self.driver, self.inner.get_freshest_replica(id, options))
+    }
+
+    pub fn get_and_lock(
+        &self,
+        id: impl Into<String>,
+        lock_time: Duration,
+        options: impl Into<Option<GetAndLockOptions>>,
+    ) -> CouchbaseResult<GetResult> {
+        block_on(
+            &self.driver,
+            self.inner.get_and_lock(id, lock_time, options),
+        )
+    }
+
+    pub fn get_and_touch(
+        &self,
+        id: impl Into<String>,
+        expiry: Duration,
+        options: impl Into<Option<GetAndTouchOptions>>,
+    ) -> CouchbaseResult<GetResult> {
+        block_on(&self.driver, self.inner.get_and_touch(id, expiry, options))
+    }
+
+    pub fn get_and_touch_multi<I, S>(
+        &self,
+        ids: I,
+        expiry: Duration,
+        options: impl Into<Option<GetAndTouchOptions>>,
+    ) -> Vec<CouchbaseResult<GetResult>>
+    where
+        I: IntoIterator<Item = S>,
+        S: Into<String>,
+    {
+        block_on(
+            &self.driver,
+            self.inner.get_and_touch_multi(ids, expiry, options),
+        )
+    }
+
+    pub fn exists(
+        &self,
+        id: impl Into<String>,
+        options: impl Into<Option<ExistsOptions>>,
+    ) -> CouchbaseResult<ExistsResult> {
+        block_on(&self.driver, self.inner.exists(id, options))
+    }
+
+    pub fn upsert<T>(
+        &self,
+        id: impl Into<String>,
+        content: T,
+        options: impl Into<Option<UpsertOptions>>,
+    ) -> CouchbaseResult<MutationResult>
+    where
+        T: Serialize,
+    {
+        block_on(&self.driver, self.inner.upsert(id, content, options))
+    }
+
+    pub fn upsert_multi<I, S, T>(
+        &self,
+        items: I,
+        options: impl Into<Option<UpsertOptions>>,
+    ) -> Vec<CouchbaseResult<MutationResult>>
+    where
+        I: IntoIterator<Item = (S, T)>,
+        S: Into<String>,
+        T: Serialize,
+    {
+        block_on(&self.driver, self.inner.upsert_multi(items, options))
+    }
+
+    pub fn insert<T>(
+        &self,
+        id: impl Into<String>,
+        content: T,
+        options: impl Into<Option<InsertOptions>>,
+    ) -> CouchbaseResult<MutationResult>
+    where
+        T: Serialize,
+    {
+        block_on(&self.driver, self.inner.insert(id, content, options))
+    }
+
+    pub fn replace<T>(
+        &self,
+        id: impl Into<String>,
+        content: T,
+        options: impl Into<Option<ReplaceOptions>>,
+    ) -> CouchbaseResult<MutationResult>
+    where
+        T: Serialize,
+    {
+        block_on(&self.driver, self.inner.replace(id, content, options))
+    }
+
+    pub fn upsert_raw(
+        &self,
+        id: impl Into<String>,
+        content: RawContent,
+        options: impl Into<Option<UpsertOptions>>,
+    ) -> CouchbaseResult<MutationResult> {
+        block_on(&self.driver, self.inner.upsert_raw(id, content, options))
+    }
+
+    pub fn insert_raw(
+        &self,
+        id: impl Into<String>,
+        content: RawContent,
+        options: impl Into<Option<InsertOptions>>,
+    ) -> CouchbaseResult<MutationResult> {
+        block_on(&self.driver, self.inner.insert_raw(id, content, options))
+    }
+
+    pub fn replace_raw(
+        &self,
+        id: impl Into<String>,
+        content: RawContent,
+        options: impl Into<Option<ReplaceOptions>>,
+    ) -> CouchbaseResult<MutationResult> {
+        block_on(&self.driver, self.inner.replace_raw(id, content, options))
+    }
+
+    pub fn remove(
+        &self,
+        id: impl Into<String>,
+        options: impl Into<Option<RemoveOptions>>,
+    ) -> CouchbaseResult<MutationResult> {
+        block_on(&self.driver, self.inner.remove(id, options))
+    }
+
+    pub fn touch(
+        &self,
+        id: impl Into<String>,
+        expiry: Duration,
+        options: impl Into<Option<TouchOptions>>,
+    ) -> CouchbaseResult<MutationResult> {
+        block_on(&self.driver, self.inner.touch(id, expiry, options))
+    }
+
+    pub fn touch_multi<I, S>(
+        &self,
+        ids: I,
+        expiry: Duration,
+        options: impl Into<Option<TouchOptions>>,
+    ) -> Vec<CouchbaseResult<MutationResult>>
+    where
+        I: IntoIterator<Item = S>,
+        S: Into<String>,
+    {
+        block_on(&self.driver, self.inner.touch_multi(ids, expiry, options))
+    }
+
+    pub fn unlock(
+        &self,
+        id: impl Into<String>,
+        cas: u64,
+        options: impl Into<Option<UnlockOptions>>,
+    ) -> CouchbaseResult<()> {
+        block_on(&self.driver, self.inner.unlock(id, cas, options))
+    }
+
+    pub fn lookup_in(
+        &self,
+        id: impl Into<String>,
+        specs: impl IntoIterator<Item = LookupInSpec>,
+        options: impl Into<Option<LookupInOptions>>,
+    ) -> CouchbaseResult<LookupInResult> {
+        block_on(&self.driver, self.inner.lookup_in(id, specs, options))
+    }
+
+    pub fn mutate_in(
+        &self,
+        id: impl Into<String>,
+        specs: impl IntoIterator<Item = MutateInSpec>,
+        options: impl Into<Option<MutateInOptions>>,
+    ) -> CouchbaseResult<MutateInResult> {
+        block_on(&self.driver, self.inner.mutate_in(id, specs, options))
+    }
+
+    pub fn binary(&self) -> BinaryCollection {
+        BinaryCollection {
+            inner: self.inner.binary(),
+            driver: self.driver.clone(),
+        }
+    }
+}
+
+/// Blocking API for the operations on binary documents, see the async `BinaryCollection`
+pub struct BinaryCollection {
+    inner: crate::BinaryCollection,
+    driver: Driver,
+}
+
+impl BinaryCollection {
+    pub fn append<S: Into<String>>(
+        &self,
+        id: S,
+        content: Vec<u8>,
+        options: impl Into<Option<AppendOptions>>,
+    ) -> CouchbaseResult<MutationResult> {
+        block_on(&self.driver, self.inner.append(id, content, options))
+    }
+
+    pub fn prepend<S: Into<String>>(
+        &self,
+        id: S,
+        content: Vec<u8>,
+        options: impl Into<Option<PrependOptions>>,
+    ) -> CouchbaseResult<MutationResult> {
+        block_on(&self.driver, self.inner.prepend(id, content, options))
+    }
+
+    pub fn increment<S: Into<String>>(
+        &self,
+        id: S,
+        options: impl Into<Option<IncrementOptions>>,
+    ) -> CouchbaseResult<CounterResult> {
+        block_on(&self.driver, self.inner.increment(id, options))
+    }
+
+    pub fn decrement<S: Into<String>>(
+        &self,
+        id: S,
+        options: impl Into<Option<DecrementOptions>>,
+    ) -> CouchbaseResult<CounterResult> {
+        block_on(&self.driver, self.inner.decrement(id, options))
+    }
+
+    pub fn increment_multi<I, S>(
+        &self,
+        ids: I,
+        options: impl Into<Option<IncrementOptions>>,
+    ) -> Vec<CouchbaseResult<CounterResult>>
+    where
+        I: IntoIterator<Item = S>,
+        S: Into<String>,
+    {
+        block_on(&self.driver, self.inner.increment_multi(ids, options))
+    }
+
+    pub fn decrement_multi<I, S>(
+        &self,
+        ids: I,
+        options: impl Into<Option<DecrementOptions>>,
+    ) -> Vec<CouchbaseResult<CounterResult>>
+    where
+        I: IntoIterator<Item = S>,
+        S: Into<String>,
+    {
+        block_on(&self.driver, self.inner.decrement_multi(ids, options))
+    }
+
+    pub fn sequence<S: Into<String>>(
+        &self,
+        id: S,
+        options: impl Into<Option<SequenceOptions>>,
+    ) -> IdSequence {
+        IdSequence {
+            inner: self.inner.sequence(id, options),
+            driver: self.driver.clone(),
+        }
+    }
+}
+
+/// Blocking API for the sequences of ids, see the async `IdSequence`
+pub struct IdSequence {
+    inner: AsyncIdSequence,
+    driver: Driver,
+}
+
+impl IdSequence {
+    pub fn next(&self) -> CouchbaseResult<u64> {
+        block_on(&self.driver, self.inner.next())
+    }
+}
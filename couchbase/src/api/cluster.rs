@@ -1,12 +1,17 @@
 use crate::api::bucket::Bucket;
 use crate::io::request::{AnalyticsRequest, QueryRequest, Request, SearchRequest};
-use crate::io::Core;
+#[cfg(all(feature = "tokio", unix))]
+use crate::io::ReactorDriver;
+use crate::io::{Core, IoConfig};
 use crate::{
     AnalyticsIndexManager, AnalyticsOptions, AnalyticsResult, Authenticator, BucketManager,
-    CouchbaseError, CouchbaseResult, ErrorContext, QueryIndexManager, QueryOptions, QueryResult,
-    SearchIndexManager, SearchOptions, SearchQuery, SearchResult, UserManager,
+    CouchbaseError, CouchbaseResult, ErrorContext, PartitionedQueryResult, QueryIndexManager,
+    QueryOptions, QueryResult, SearchIndexManager, SearchOptions, SearchQuery, SearchResult,
+    UserManager,
 };
 use futures::channel::oneshot;
+use futures::future::join_all;
+use serde_json::Value;
 use std::fmt;
 use std::fmt::{Debug, Display, Formatter};
 use std::sync::Arc;
@@ -46,6 +51,7 @@ impl Cluster {
                 connection_string.into(),
                 Some(username.into()),
                 Some(password.into()),
+                IoConfig::default(),
             )),
         }
     }
@@ -55,36 +61,58 @@ impl Cluster {
         connection_string: impl Into<String>,
         opts: ClusterOptions,
     ) -> Self {
-        let mut connection_string = connection_string.into();
-        let to_append = opts.to_conn_string();
-        if !to_append.is_empty() {}
-        if connection_string.contains('?') {
-            connection_string = format!("{}&{}", connection_string, to_append);
-        } else {
-            connection_string = format!("{}?{}", connection_string, to_append);
-        }
-        let mut username = opts.username;
-        let mut password = opts.password;
-        if let Some(auth) = opts.authenticator {
-            if let Some(u) = auth.username() {
-                username = Some(u.clone());
-            }
-            if let Some(p) = auth.password() {
-                password = Some(p.clone());
-            }
-            if let Some(path) = auth.certificate_path() {
-                connection_string = format!("{}&certpath={}", connection_string, path.clone());
-            }
-            if let Some(path) = auth.key_path() {
-                connection_string = format!("{}&keypath={}", connection_string, path.clone());
-            }
+        let (connection_string, username, password, io_config) =
+            resolve_options(connection_string.into(), opts);
+        Cluster {
+            core: Arc::new(Core::new(connection_string, username, password, io_config)),
         }
+    }
 
+    /// Connect to a couchbase cluster, driving it from a task on the current thread
+    ///
+    /// Instead of being handed to an IO thread, requests are sent and their responses
+    /// read by a task on the tokio runtime, which watches the sockets of libcouchbase.
+    /// The task is spawned with `tokio::task::spawn_local`, so this must be called from
+    /// within a `tokio::task::LocalSet`, and it stops once the `Cluster` and everything
+    /// opened from it have been dropped and the outstanding requests completed.
+    ///
+    /// The options which configure the IO threads, such as `io_threads` or
+    /// `zero_copy_threshold`, do not apply since there are none.
+    ///
+    /// # Examples
+    ///
+    /// ```no_run
+    /// # async fn run() {
+    /// let local = tokio::task::LocalSet::new();
+    /// local
+    ///     .run_until(async {
+    ///         let opts = couchbase::ClusterOptions::default()
+    ///             .username("username")
+    ///             .password("password");
+    ///         let cluster = couchbase::Cluster::connect_local("127.0.0.1", opts);
+    ///         let collection = cluster.bucket("default").default_collection();
+    ///         let result = collection.get("foo", None).await;
+    ///     })
+    ///     .await;
+    /// # }
+    /// ```
+    #[cfg(all(feature = "tokio", unix))]
+    pub fn connect_local(connection_string: impl Into<String>, opts: ClusterOptions) -> Self {
+        let (connection_string, username, password, io_config) =
+            resolve_options(connection_string.into(), opts);
+        let (driver, queue) =
+            ReactorDriver::new(connection_string, username, password, io_config.preconnect);
+        tokio::task::spawn_local(driver);
         Cluster {
-            core: Arc::new(Core::new(connection_string, username, password)),
+            core: Arc::new(Core::reactor(queue)),
         }
     }
 
+    /// Wraps a core created by another frontend, such as the blocking `Cluster`.
+    pub(crate) fn from_core(core: Arc<Core>) -> Self {
+        Cluster { core }
+    }
+
     /// Open and connect to a couchbase `Bucket`
     ///
     /// # Arguments
@@ -157,6 +185,83 @@ impl Cluster {
         receiver.await.unwrap()
     }
 
+    /// Executes a N1QL query split into partitions, which run in parallel
+    ///
+    /// The statement is run once for every partition, with the named parameters of the
+    /// partition added to those of the options. Every query goes to the query node with the
+    /// fewest queries in flight, so the partitions are spread across the cluster and a large
+    /// export is not bound by the throughput of a single query node.
+    ///
+    /// # Arguments
+    ///
+    /// * `statement` - the N1QL statement, with named parameters selecting the partition
+    /// * `partitions` - the named parameters of each partition, each serializing to an object
+    /// * `options` - allows to pass in custom options, shared by all partitions
+    ///
+    /// # Examples
+    ///
+    /// Export a bucket in two halves.
+    /// ```no_run
+    /// # let cluster = couchbase::Cluster::connect("127.0.0.1", "username", "password");
+    /// let partitions = vec![
+    ///     serde_json::json!({"lo": "", "hi": "m"}),
+    ///     serde_json::json!({"lo": "m", "hi": "\u{10ffff}"}),
+    /// ];
+    /// let result = cluster.query_partitioned(
+    ///     "select * from bucket where meta().id >= $lo and meta().id < $hi",
+    ///     partitions,
+    ///     couchbase::QueryOptions::default(),
+    /// );
+    /// ```
+    ///
+    /// If any partition fails to start, the first error is returned. See the
+    /// [PartitionedQueryResult](struct.PartitionedQueryResult.html) for how the rows and the
+    /// per-partition metadata can be consumed.
+    pub async fn query_partitioned<T>(
+        &self,
+        statement: impl Into<String>,
+        partitions: impl IntoIterator<Item = T>,
+        options: impl Into<Option<QueryOptions>>,
+    ) -> CouchbaseResult<PartitionedQueryResult>
+    where
+        T: serde::Serialize,
+    {
+        let statement = statement.into();
+        let options = unwrap_or_default!(options.into());
+
+        let mut receivers = vec![];
+        for partition in partitions {
+            let params = match serde_json::to_value(partition) {
+                Ok(Value::Object(params)) => params,
+                _ => {
+                    let mut ctx = ErrorContext::default();
+                    ctx.insert("partition", "must serialize to an object".into());
+                    return Err(CouchbaseError::InvalidArgument { ctx });
+                }
+            };
+
+            let mut partition_options = options.clone();
+            partition_options
+                .named_parameters
+                .get_or_insert_with(Default::default)
+                .extend(params);
+            let (sender, receiver) = oneshot::channel();
+            self.core.send(Request::Query(QueryRequest {
+                statement: statement.clone(),
+                options: partition_options,
+                sender,
+                scope: None,
+            }));
+            receivers.push(receiver);
+        }
+
+        let mut results = vec![];
+        for result in join_all(receivers).await {
+            results.push(result.unwrap()?);
+        }
+        Ok(PartitionedQueryResult::new(results))
+    }
+
     /// Executes an analytics query
     ///
     /// # Arguments
@@ -352,6 +457,21 @@ impl Cluster {
         SearchIndexManager::new(self.core.clone())
     }
 
+    /// Describes the IO threads of the cluster, including the CPUs they are pinned to
+    /// (see `ClusterOptions::io_affinity`).
+    ///
+    /// # Examples
+    ///
+    /// ```no_run
+    /// let cluster = couchbase::Cluster::connect("127.0.0.1", "username", "password");
+    /// for thread in cluster.io_threads() {
+    ///     println!("{} runs on {:?}", thread.name(), thread.cpus());
+    /// }
+    /// ```
+    pub fn io_threads(&self) -> Vec<IoThreadReport> {
+        self.core.io_threads()
+    }
+
     /// Returns a reference to the underlying core.
     ///
     /// Note that this API is unsupported and not stable, so you need to opt in via the
@@ -362,6 +482,79 @@ impl Cluster {
     }
 }
 
+/// Resolves the options into the connection string, the credentials and the IO settings
+/// a `Core` is created with.
+pub(crate) fn resolve_options(
+    mut connection_string: String,
+    opts: ClusterOptions,
+) -> (String, Option<String>, Option<String>, IoConfig) {
+    let to_append = opts.to_conn_string();
+    if !to_append.is_empty() {}
+    if connection_string.contains('?') {
+        connection_string = format!("{}&{}", connection_string, to_append);
+    } else {
+        connection_string = format!("{}?{}", connection_string, to_append);
+    }
+    let mut username = opts.username;
+    let mut password = opts.password;
+    if let Some(auth) = opts.authenticator {
+        if let Some(u) = auth.username() {
+            username = Some(u.clone());
+        }
+        if let Some(p) = auth.password() {
+            password = Some(p.clone());
+        }
+        if let Some(path) = auth.certificate_path() {
+            connection_string = format!("{}&certpath={}", connection_string, path.clone());
+        }
+        if let Some(path) = auth.key_path() {
+            connection_string = format!("{}&keypath={}", connection_string, path.clone());
+        }
+    }
+
+    let mut io_config = IoConfig::default();
+    if let Some(io_threads) = opts.io_threads {
+        io_config.io_threads = io_threads;
+    }
+    io_config.zero_copy_threshold = opts.zero_copy_threshold;
+    io_config.row_buffer_budget = opts.row_buffer_budget;
+    io_config.io_affinity = opts.io_affinity;
+    io_config.preconnect = opts.preconnect;
+    (connection_string, username, password, io_config)
+}
+
+/// Where the IO threads run, see `ClusterOptions::io_affinity`.
+#[derive(Debug, Clone)]
+pub enum IoAffinity {
+    /// Each IO thread is pinned to a single CPU, given by its id.
+    Cpus(Vec<usize>),
+    /// Each IO thread is pinned to the CPUs of a NUMA node, given by its id.
+    NumaNodes(Vec<usize>),
+}
+
+/// Describes an IO thread, see `Cluster::io_threads`.
+#[derive(Debug, Clone)]
+pub struct IoThreadReport {
+    name: String,
+    cpus: Vec<usize>,
+}
+
+impl IoThreadReport {
+    pub(crate) fn new(name: String, cpus: Vec<usize>) -> Self {
+        Self { name, cpus }
+    }
+
+    /// The name of the thread, as shown by debuggers and `top -H`.
+    pub fn name(&self) -> &str {
+        &self.name
+    }
+
+    /// The CPUs the thread is pinned to, empty if it may run on any.
+    pub fn cpus(&self) -> &[usize] {
+        &self.cpus
+    }
+}
+
 #[derive(Debug, Default)]
 pub struct TimeoutOptions {
     pub(crate) kv_connect_timeout: Option<Duration>,
@@ -518,6 +711,21 @@ pub struct ClusterOptions {
     pub(crate) password: Option<String>,
     pub(crate) timeouts: Option<TimeoutOptions>,
     pub(crate) security: Option<SecurityOptions>,
+    pub(crate) io_threads: Option<usize>,
+    pub(crate) zero_copy_threshold: Option<usize>,
+    pub(crate) row_buffer_budget: Option<usize>,
+    pub(crate) health_probe_interval: Option<Duration>,
+    pub(crate) io_affinity: Option<IoAffinity>,
+    pub(crate) preconnect: bool,
+    pub(crate) near_cache: Option<(u32, Duration)>,
+    pub(crate) coalesce_gets: bool,
+    pub(crate) negative_cache: Option<u32>,
+    pub(crate) touch_skip_window: Option<Duration>,
+    pub(crate) write_coalesce_window: Option<Duration>,
+    pub(crate) config_poll_max_interval: Option<Duration>,
+    pub(crate) preferred_server_group: Option<String>,
+    pub(crate) kv_inflight_budget: Option<(usize, u32)>,
+    pub(crate) circuit_breaker: bool,
 }
 
 impl Default for ClusterOptions {
@@ -528,6 +736,21 @@ impl Default for ClusterOptions {
             password: None,
             timeouts: None,
             security: None,
+            io_threads: None,
+            zero_copy_threshold: None,
+            row_buffer_budget: None,
+            health_probe_interval: None,
+            io_affinity: None,
+            preconnect: false,
+            near_cache: None,
+            coalesce_gets: false,
+            negative_cache: None,
+            touch_skip_window: None,
+            write_coalesce_window: None,
+            config_poll_max_interval: None,
+            preferred_server_group: None,
+            kv_inflight_budget: None,
+            circuit_breaker: false,
         }
     }
 }
@@ -558,6 +781,174 @@ impl ClusterOptions {
         self
     }
 
+    /// The number of IO threads (each owning its own libcouchbase instances) to spawn.
+    ///
+    /// Key-value requests are routed by document id so that all operations on a given key
+    /// always land on the same thread and keep their ordering. Defaults to 1.
+    pub fn io_threads(mut self, io_threads: usize) -> Self {
+        self.io_threads = Some(io_threads.max(1));
+        self
+    }
+
+    /// Document values of at least `size` bytes returned by `get` and the replica reads are
+    /// handed out without copying them out of the network buffer they were read into.
+    ///
+    /// The buffer stays pinned until the result is dropped, so this is best used for large
+    /// documents which are decoded and then dropped quickly. Disabled by default.
+    ///
+    /// Values of at least `size` bytes passed to the store operations (`upsert`, `insert`,
+    /// `replace`, `append` and `prepend`) are likewise written to the socket as they are,
+    /// instead of being copied into the network buffers first.
+    pub fn zero_copy_threshold(mut self, size: usize) -> Self {
+        self.zero_copy_threshold = Some(size);
+        self
+    }
+
+    /// Bounds the rows of a query, analytics or search result which are buffered in memory
+    /// but not yet consumed to roughly `bytes`.
+    ///
+    /// Once the budget is exceeded the result stops being read from the network, and it
+    /// continues once the application consumed half of the buffered rows. Note that a
+    /// result which is neither consumed nor dropped then holds on to its connection.
+    /// Unbounded by default.
+    pub fn row_buffer_budget(mut self, bytes: usize) -> Self {
+        self.row_buffer_budget = Some(bytes);
+        self
+    }
+
+    /// Sends a lightweight probe every `interval` over the key-value connections which
+    /// have not received anything since the previous probe.
+    ///
+    /// The measured round trip times let hedged gets (see `GetOptions::hedge`) pick a
+    /// delay before the first requests completed, and skip replicas on nodes whose last
+    /// probe timed out. Disabled by default.
+    pub fn health_probe_interval(mut self, interval: Duration) -> Self {
+        self.health_probe_interval = Some(interval);
+        self
+    }
+
+    /// Pins the IO threads to the given CPUs or NUMA nodes, so they run next to the NIC
+    /// and the application threads they serve.
+    ///
+    /// IO thread `i` gets the `i`-th entry of the list, wrapping around. A thread pinned
+    /// to a NUMA node may run on any CPU of the node, and the network buffers of its
+    /// instances are allocated from the memory of the node. NUMA nodes are only supported
+    /// on Linux, where the CPUs of a node are read from sysfs. Unpinned by default.
+    ///
+    /// The placement of the threads is reported by `Cluster::io_threads`.
+    pub fn io_affinity(mut self, affinity: IoAffinity) -> Self {
+        self.io_affinity = Some(affinity);
+        self
+    }
+
+    /// Lets an opened bucket connect to all of its key-value nodes before it takes
+    /// requests, so that the first requests to each node do not pay for the connection.
+    ///
+    /// Buckets are opened in the background either way, in parallel with each other, and
+    /// requests sent in the meantime are held back until the bucket is ready. A node which
+    /// cannot be reached does not hold the bucket back, it is connected on demand as
+    /// usual. Disabled by default.
+    pub fn preconnect(mut self, enable: bool) -> Self {
+        self.preconnect = enable;
+        self
+    }
+
+    /// Keeps up to `size` recently read documents for gets which accept them (see
+    /// `GetOptions::near_cache`), for up to `ttl` each.
+    ///
+    /// Mutations through this cluster drop the cached value of their document right away,
+    /// mutations by other clients are only seen once it expired. Disabled by default.
+    pub fn near_cache(mut self, size: u32, ttl: Duration) -> Self {
+        self.near_cache = Some((size, ttl));
+        self
+    }
+
+    /// Lets gets of a document which is already being read wait for the reply of the
+    /// earlier get instead of sending a request of their own.
+    ///
+    /// Bursts of reads of the same document then cost a single request. Gets with an
+    /// expiry, a lock or a hedge are always sent. Disabled by default.
+    pub fn coalesce_gets(mut self, enable: bool) -> Self {
+        self.coalesce_gets = enable;
+        self
+    }
+
+    /// Remembers about `size` keys which were recently found missing, so that gets and
+    /// exists checks which accept the near cache fail with `DocumentNotFound` right away.
+    ///
+    /// Keys are remembered for the TTL given to `near_cache` (1 second by default), and
+    /// forgotten when the document is mutated through this cluster. Disabled by default.
+    pub fn negative_cache(mut self, size: u32) -> Self {
+        self.negative_cache = Some(size);
+        self
+    }
+
+    /// Sends a get-and-touch of a document as a plain get when the same expiry was
+    /// already set on it less than `window` ago, sparing the server the rewrite.
+    ///
+    /// Up to 1024 recently touched documents are remembered, and forgotten when they are
+    /// mutated through this cluster. Disabled by default.
+    pub fn touch_skip_window(mut self, window: Duration) -> Self {
+        self.touch_skip_window = Some(window);
+        self
+    }
+
+    /// Holds the upserts of collections with `Collection::coalesce_upserts` for `window`
+    /// before sending them, so that further upserts of the same document replace them.
+    ///
+    /// With a zero window, the default, upserts only replace each other until the
+    /// connection next sends its pending requests.
+    pub fn write_coalesce_window(mut self, window: Duration) -> Self {
+        self.write_coalesce_window = Some(window);
+        self
+    }
+
+    /// Lets the interval between the background polls of the cluster configuration grow
+    /// up to `interval` while the topology is stable and every node notifies its changes.
+    ///
+    /// The interval goes back to its minimum as soon as the configuration changes or an
+    /// operation hits a node which no longer owns its document. Polls are also spread a
+    /// little across clients. Polls at a fixed interval by default.
+    pub fn config_poll_max_interval(mut self, interval: Duration) -> Self {
+        self.config_poll_max_interval = Some(interval);
+        self
+    }
+
+    /// Prefers the nodes of the server group (availability zone) `group` for reads which
+    /// may be served by several nodes.
+    ///
+    /// `get_any_replica` tries a replica in the group first, and query, search, analytics
+    /// and view requests go to nodes of the group which run the service. Other nodes are
+    /// only used when the group has none available. No preference by default.
+    pub fn preferred_server_group(mut self, group: impl Into<String>) -> Self {
+        self.preferred_server_group = Some(group.into());
+        self
+    }
+
+    /// Limits the key-value operations in flight to `max_bytes` of requests and `max_ops`
+    /// operations, so that a slow node cannot make requests pile up without bound.
+    ///
+    /// Operations beyond the budget fail right away with `ClientOverloaded`, which the
+    /// application can answer by shedding load. A limit of `0` disables it; both are
+    /// disabled by default.
+    pub fn kv_inflight_budget(mut self, max_bytes: usize, max_ops: u32) -> Self {
+        self.kv_inflight_budget = Some((max_bytes, max_ops));
+        self
+    }
+
+    /// Fails requests to a node right away with `CircuitBreakerOpen` once most of the
+    /// recent requests to it timed out or lost their connection, instead of letting every
+    /// new one wait for its timeout.
+    ///
+    /// `get_any_replica` reads from the other replicas first, and query, search, analytics
+    /// and view requests go to the other nodes of the service. After 5 seconds a few
+    /// requests are sent to the node again, and it is used as usual as soon as one of them
+    /// succeeds. Disabled by default.
+    pub fn circuit_breaker(mut self, enabled: bool) -> Self {
+        self.circuit_breaker = enabled;
+        self
+    }
+
     pub(crate) fn to_conn_string(&self) -> String {
         let mut opts = vec![];
         if let Some(t) = &self.timeouts {
@@ -566,6 +957,67 @@ impl ClusterOptions {
         if let Some(t) = &self.security {
             opts.push(t.to_string());
         }
+        if let Some(t) = self.health_probe_interval {
+            opts.push(format!(
+                "health_probe_interval={}",
+                duration_to_conn_str_format(t)
+            ));
+        }
+
+        if let Some((size, ttl)) = self.near_cache {
+            opts.push(format!(
+                "near_cache_size={}&near_cache_ttl={}",
+                size,
+                duration_to_conn_str_format(ttl)
+            ));
+        }
+
+        if self.coalesce_gets {
+            opts.push(String::from("get_coalesce=true"));
+        }
+
+        if let Some(size) = self.negative_cache {
+            opts.push(format!("negative_cache_size={}", size));
+        }
+
+        if let Some(t) = self.touch_skip_window {
+            opts.push(format!(
+                "touch_skip_window={}",
+                duration_to_conn_str_format(t)
+            ));
+        }
+
+        if let Some(t) = self.write_coalesce_window {
+            opts.push(format!(
+                "write_coalesce_window={}",
+                duration_to_conn_str_format(t)
+            ));
+        }
+
+        if let Some(t) = self.config_poll_max_interval {
+            opts.push(format!(
+                "config_poll_max_interval={}",
+                duration_to_conn_str_format(t)
+            ));
+        }
+
+        if let Some(group) = &self.preferred_server_group {
+            opts.push(format!(
+                "preferred_server_group={}",
+                urlencoding::encode(group)
+            ));
+        }
+
+        if let Some((max_bytes, max_ops)) = self.kv_inflight_budget {
+            opts.push(format!(
+                "kv_inflight_bytes_max={}&kv_inflight_ops_max={}",
+                max_bytes, max_ops
+            ));
+        }
+
+        if self.circuit_breaker {
+            opts.push(String::from("circuit_breaker=true"));
+        }
 
         if opts.is_empty() {
             String::from("")
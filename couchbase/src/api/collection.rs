@@ -1,18 +1,21 @@
 use crate::api::keyvalue_options::*;
 use crate::api::keyvalue_results::*;
+use crate::api::projection::{Projection, DEFAULT_FULL_GET_ABOVE, MAX_LOOKUP_SPECS};
 use crate::api::subdoc::*;
 use crate::api::subdoc_options::*;
 use crate::api::subdoc_results::*;
+use crate::api::transcoding::{DocumentFormat, RawContent};
 use crate::io::request::*;
 use crate::io::{Core, LOOKUPIN_MACRO_EXPIRYTIME};
 use crate::CouchbaseError::Generic;
 use crate::{BinaryCollection, CouchbaseError, CouchbaseResult, ErrorContext};
 use chrono::NaiveDateTime;
 use futures::channel::oneshot;
+use futures::future::join_all;
 use futures::FutureExt;
 use futures::{pin_mut, select};
 use serde::Serialize;
-use serde_json::to_vec;
+use std::cell::Cell;
 use std::convert::TryFrom;
 use std::fmt;
 use std::fmt::{Debug, Display, Formatter};
@@ -26,6 +29,7 @@ pub struct Collection {
     name: String,
     scope_name: String,
     bucket_name: String,
+    coalesce_upserts: bool,
 }
 
 impl Collection {
@@ -40,9 +44,23 @@ impl Collection {
             name,
             scope_name,
             bucket_name,
+            coalesce_upserts: false,
         }
     }
 
+    /// Lets upserts of a document through this collection replace each other until they
+    /// are sent, see `ClusterOptions::write_coalesce_window`. Only the last value is
+    /// written, and all the upserts it replaced complete with its CAS.
+    ///
+    /// Meant for documents overwritten many times per second where only the latest value
+    /// matters, such as presence or last-seen timestamps. Upserts with a CAS or a
+    /// durability requirement are always sent, and an upsert only replaces one with the
+    /// same options. Disabled by default.
+    pub fn coalesce_upserts(mut self, enable: bool) -> Self {
+        self.coalesce_upserts = enable;
+        self
+    }
+
     /// The name of the collection
     pub fn name(&self) -> &str {
         self.name.as_str()
@@ -54,12 +72,118 @@ impl Collection {
         options: impl Into<Option<GetOptions>>,
     ) -> CouchbaseResult<GetResult> {
         let options = unwrap_or_default!(options.into());
+        if options.project.is_some() {
+            return self.get_projected(id.into(), options).await;
+        }
         if options.with_expiry {
             return self.get_with_expiry(id).await;
         }
         return self.get_direct(id, options).await;
     }
 
+    async fn get_projected(
+        &self,
+        id: String,
+        mut options: GetOptions,
+    ) -> CouchbaseResult<GetResult> {
+        let paths = options.project.take().unwrap_or_default();
+        let projection = Projection::new(&paths)?;
+        let full_get_above = options
+            .project_full_get_above
+            .unwrap_or(DEFAULT_FULL_GET_ABOVE);
+        if projection.whole_document() || paths.len() > full_get_above {
+            return self.get_projected_locally(id, &projection, options).await;
+        }
+
+        let mut specs = Vec::with_capacity(paths.len() + 1);
+        if options.with_expiry {
+            specs.push(LookupInSpec::get(
+                LOOKUPIN_MACRO_EXPIRYTIME,
+                GetSpecOptions::default().xattr(true),
+            ));
+        }
+        specs.extend(
+            paths
+                .iter()
+                .map(|path| LookupInSpec::get(path.as_str(), GetSpecOptions::default())),
+        );
+
+        // All the lookups are sent before waiting for the first one.
+        let mut receivers =
+            Vec::with_capacity((specs.len() + MAX_LOOKUP_SPECS - 1) / MAX_LOOKUP_SPECS);
+        let mut specs = specs.into_iter().peekable();
+        while specs.peek().is_some() {
+            let (sender, receiver) = oneshot::channel();
+            self.core.send(Request::LookupIn(LookupInRequest {
+                id: id.clone(),
+                specs: specs.by_ref().take(MAX_LOOKUP_SPECS).collect(),
+                sender,
+                bucket: self.bucket_name.clone(),
+                options: LookupInOptions {
+                    timeout: options.timeout,
+                    ..Default::default()
+                },
+                scope: self.scope_name.clone(),
+                collection: self.name.clone(),
+            }));
+            receivers.push(receiver);
+        }
+        let mut results = Vec::with_capacity(receivers.len());
+        for result in join_all(receivers).await {
+            results.push(result.unwrap()?);
+        }
+
+        let cas = results[0].cas();
+        if results.iter().any(|result| result.cas() != cas) {
+            // The document was mutated between the lookups.
+            return self.get_projected_locally(id, &projection, options).await;
+        }
+        let first = options.with_expiry as usize;
+        let mut values = Vec::with_capacity(paths.len());
+        for spec in first..first + paths.len() {
+            let result = &results[spec / MAX_LOOKUP_SPECS];
+            values.push(match result.raw(spec % MAX_LOOKUP_SPECS) {
+                Ok(value) => Some(value),
+                Err(CouchbaseError::PathNotFound { .. })
+                | Err(CouchbaseError::PathMismatch { .. }) => None,
+                Err(e) => return Err(e),
+            });
+        }
+
+        let mut result = GetResult::new(projection.assemble(&values), cas, 0);
+        if options.with_expiry {
+            result.set_expiry_time(NaiveDateTime::from_timestamp(
+                results[0].content::<i64>(0)?,
+                0,
+            ));
+        }
+        Ok(result)
+    }
+
+    /// Reads the whole document and projects it, for the projections not worth the lookups
+    /// and the documents mutated while they were looked up.
+    async fn get_projected_locally(
+        &self,
+        id: String,
+        projection: &Projection,
+        options: GetOptions,
+    ) -> CouchbaseResult<GetResult> {
+        let document = if options.with_expiry {
+            self.get_with_expiry(id).await?
+        } else {
+            self.get_direct(id, options).await?
+        };
+        let mut result = GetResult::new(
+            projection.pick(document.content_as_bytes())?,
+            document.cas,
+            document.flags,
+        );
+        if let Some(expiry) = document.expiry_time {
+            result.set_expiry_time(expiry);
+        }
+        Ok(result)
+    }
+
     async fn get_with_expiry(&self, id: impl Into<String>) -> CouchbaseResult<GetResult> {
         let (sender, receiver) = oneshot::channel();
 
@@ -109,6 +233,58 @@ impl Collection {
         receiver.await.unwrap()
     }
 
+    /// Fetches multiple documents at once.
+    ///
+    /// The ids are handed to the IO layer as a single request, whose gets are written to
+    /// the network together rather than one by one. The results are collected in the same
+    /// order as the ids and returned with a single wakeup once the last one has arrived.
+    pub async fn get_multi<I, S>(
+        &self,
+        ids: I,
+        options: impl Into<Option<GetOptions>>,
+    ) -> Vec<CouchbaseResult<GetResult>>
+    where
+        I: IntoIterator<Item = S>,
+        S: Into<String>,
+    {
+        let options = unwrap_or_default!(options.into());
+        if options.project.is_some() {
+            let futures = ids
+                .into_iter()
+                .map(|id| self.get_projected(id.into(), options.clone()))
+                .collect::<Vec<_>>();
+            return join_all(futures).await;
+        }
+        if options.with_expiry {
+            // Needs a lookup_in per document, which has to be post-processed anyways.
+            let futures = ids
+                .into_iter()
+                .map(|id| self.get_with_expiry(id))
+                .collect::<Vec<_>>();
+            return join_all(futures).await;
+        }
+
+        let ids: Vec<(usize, String)> = ids
+            .into_iter()
+            .enumerate()
+            .map(|(index, id)| (index, id.into()))
+            .collect();
+        if ids.is_empty() {
+            return vec![];
+        }
+
+        let (sender, receiver) = oneshot::channel();
+        self.core.send(Request::GetMulti(GetMultiRequest {
+            gather: GetMultiGather::new(ids.len(), sender),
+            ids,
+            bucket: self.bucket_name.clone(),
+            scope: self.scope_name.clone(),
+            collection: self.name.clone(),
+            options,
+        }));
+        receiver.await.unwrap()
+    }
+
     pub async fn get_any_replica(
         &self,
         id: impl Into<String>,
@@ -122,6 +298,7 @@ impl Collection {
             id: id.clone(),
             options: GetReplicaOptions {
                 timeout: options.timeout,
+                ..Default::default()
             },
             bucket: self.bucket_name.clone(),
             sender: get_replica_sender,
@@ -139,6 +316,10 @@ impl Collection {
                 options: GetOptions {
                     timeout: options.timeout,
                     with_expiry: false,
+                    hedge: None,
+                    near_cache: false,
+                    project: None,
+                    project_full_get_above: None,
                 },
             },
         }));
@@ -153,13 +334,13 @@ impl Collection {
             let result = select! {
                 res = get_receiver=> {
                     match res.unwrap() {
-                        Ok(gr) => Ok(GetReplicaResult::new(gr.content, gr.cas, gr.flags, false)),
+                        Ok(gr) => Ok(GetReplicaResult::from_buffer(gr.content, gr.cas, gr.flags, false)),
                         Err(e) => {Err(e)}
                     }
                 },
                 res = get_replica_receiver => {
                     match res.unwrap() {
-                        Ok(gr) => Ok(GetReplicaResult::new(gr.content, gr.cas, gr.flags, false)),
+                        Ok(gr) => Ok(GetReplicaResult::from_buffer(gr.content, gr.cas, gr.flags, false)),
                         Err(e) => {Err(e)}
                     }
                 }
@@ -174,6 +355,58 @@ impl Collection {
         }
     }
 
+    /// Reads the document from the one node, active or replica, which is expected to
+    /// answer first given its recent read latencies and the requests queued for it.
+    ///
+    /// The value may not reflect the latest mutation.
+    pub async fn get_fastest_replica(
+        &self,
+        id: impl Into<String>,
+        options: impl Into<Option<GetFastestReplicaOptions>>,
+    ) -> CouchbaseResult<GetReplicaResult> {
+        let options = unwrap_or_default!(options.into());
+        let (sender, receiver) = oneshot::channel();
+        self.core.send(Request::GetReplica(GetReplicaRequest {
+            id: id.into(),
+            options: GetReplicaOptions {
+                timeout: options.timeout,
+                ..Default::default()
+            },
+            bucket: self.bucket_name.clone(),
+            sender,
+            scope: self.scope_name.clone(),
+            collection: self.name.clone(),
+            mode: ReplicaMode::Fastest,
+        }));
+        receiver.await.unwrap()
+    }
+
+    /// Reads the active copy and all the replicas at once and returns the copy with
+    /// the highest CAS, as soon as one has at least `min_cas` or once a quorum of
+    /// copies was read. The requests to the slower nodes are cancelled.
+    pub async fn get_freshest_replica(
+        &self,
+        id: impl Into<String>,
+        options: impl Into<Option<GetFreshestReplicaOptions>>,
+    ) -> CouchbaseResult<GetReplicaResult> {
+        let options = unwrap_or_default!(options.into());
+        let (sender, receiver) = oneshot::channel();
+        self.core.send(Request::GetReplica(GetReplicaRequest {
+            id: id.into(),
+            options: GetReplicaOptions {
+                timeout: options.timeout,
+                min_cas: options.min_cas,
+                quorum: options.quorum,
+            },
+            bucket: self.bucket_name.clone(),
+            sender,
+            scope: self.scope_name.clone(),
+            collection: self.name.clone(),
+            mode: ReplicaMode::Freshest,
+        }));
+        receiver.await.unwrap()
+    }
+
     pub async fn get_and_lock(
         &self,
         id: impl Into<String>,
@@ -212,6 +445,51 @@ impl Collection {
         receiver.await.unwrap()
     }
 
+    /// Fetches multiple documents at once while setting the same expiry on all of them.
+    ///
+    /// All requests are handed to the IO layer as a single batch, which schedules them
+    /// grouped by the node they belong to. The results are returned in the same order as
+    /// the ids.
+    pub async fn get_and_touch_multi<I, S>(
+        &self,
+        ids: I,
+        expiry: Duration,
+        options: impl Into<Option<GetAndTouchOptions>>,
+    ) -> Vec<CouchbaseResult<GetResult>>
+    where
+        I: IntoIterator<Item = S>,
+        S: Into<String>,
+    {
+        let options = unwrap_or_default!(options.into());
+
+        let mut requests = vec![];
+        let mut receivers = vec![];
+        for id in ids {
+            let (sender, receiver) = oneshot::channel();
+            requests.push(Request::Get(GetRequest {
+                id: id.into(),
+                ty: GetRequestType::GetAndTouch {
+                    options: options.clone(),
+                    expiry,
+                },
+                bucket: self.bucket_name.clone(),
+                sender,
+                scope: self.scope_name.clone(),
+                collection: self.name.clone(),
+            }));
+            receivers.push(receiver);
+        }
+        if !requests.is_empty() {
+            self.core.send(Request::Batch(requests));
+        }
+
+        join_all(receivers)
+            .await
+            .into_iter()
+            .map(|r| r.unwrap())
+            .collect()
+    }
+
     pub async fn exists(
         &self,
         id: impl Into<String>,
@@ -239,11 +517,78 @@ impl Collection {
     where
         T: Serialize,
     {
-        let options = unwrap_or_default!(options.into());
+        let mut options = unwrap_or_default!(options.into());
+        options.coalesce = self.coalesce_upserts;
         self.mutate(id, content, MutateRequestType::Upsert { options })
             .await
     }
 
+    /// Upserts multiple documents at once.
+    ///
+    /// All requests are handed to the IO layer as a single batch, so they are written to
+    /// the network together rather than one by one. The results are returned in the same
+    /// order as the input.
+    pub async fn upsert_multi<I, S, T>(
+        &self,
+        items: I,
+        options: impl Into<Option<UpsertOptions>>,
+    ) -> Vec<CouchbaseResult<MutationResult>>
+    where
+        I: IntoIterator<Item = (S, T)>,
+        S: Into<String>,
+        T: Serialize,
+    {
+        let mut options = unwrap_or_default!(options.into());
+        options.coalesce = self.coalesce_upserts;
+
+        let mut requests = vec![];
+        let mut receivers = vec![];
+        let mut failures = vec![];
+        for (idx, (id, content)) in items.into_iter().enumerate() {
+            let serialized = match serialize_content(&content) {
+                Ok(v) => v,
+                Err(e) => {
+                    failures.push((
+                        idx,
+                        CouchbaseError::EncodingFailure {
+                            ctx: ErrorContext::default(),
+                            source: e.into(),
+                        },
+                    ));
+                    continue;
+                }
+            };
+            let (sender, receiver) = oneshot::channel();
+            requests.push(Request::Mutate(MutateRequest {
+                id: id.into(),
+                content: serialized,
+                flags: DocumentFormat::Json.flags(),
+                json: true,
+                sender,
+                bucket: self.bucket_name.clone(),
+                ty: MutateRequestType::Upsert {
+                    options: options.clone(),
+                },
+                scope: self.scope_name.clone(),
+                collection: self.name.clone(),
+            }));
+            receivers.push(receiver);
+        }
+        if !requests.is_empty() {
+            self.core.send(Request::Batch(requests));
+        }
+
+        let mut results: Vec<CouchbaseResult<MutationResult>> = join_all(receivers)
+            .await
+            .into_iter()
+            .map(|r| r.unwrap())
+            .collect();
+        for (idx, err) in failures {
+            results.insert(idx, Err(err));
+        }
+        results
+    }
+
     pub async fn insert<T>(
         &self,
         id: impl Into<String>,
@@ -272,6 +617,44 @@ impl Collection {
             .await
     }
 
+    /// Upserts content which is stored as it is, bypassing serde.
+    ///
+    /// See `RawContent` for the formats it can be tagged with.
+    pub async fn upsert_raw(
+        &self,
+        id: impl Into<String>,
+        content: RawContent,
+        options: impl Into<Option<UpsertOptions>>,
+    ) -> CouchbaseResult<MutationResult> {
+        let options = unwrap_or_default!(options.into());
+        self.mutate_content(id, content, MutateRequestType::Upsert { options })
+            .await
+    }
+
+    /// Inserts content which is stored as it is, bypassing serde.
+    pub async fn insert_raw(
+        &self,
+        id: impl Into<String>,
+        content: RawContent,
+        options: impl Into<Option<InsertOptions>>,
+    ) -> CouchbaseResult<MutationResult> {
+        let options = unwrap_or_default!(options.into());
+        self.mutate_content(id, content, MutateRequestType::Insert { options })
+            .await
+    }
+
+    /// Replaces a document with content which is stored as it is, bypassing serde.
+    pub async fn replace_raw(
+        &self,
+        id: impl Into<String>,
+        content: RawContent,
+        options: impl Into<Option<ReplaceOptions>>,
+    ) -> CouchbaseResult<MutationResult> {
+        let options = unwrap_or_default!(options.into());
+        self.mutate_content(id, content, MutateRequestType::Replace { options })
+            .await
+    }
+
     async fn mutate<T>(
         &self,
         id: impl Into<String>,
@@ -281,7 +664,7 @@ impl Collection {
     where
         T: Serialize,
     {
-        let serialized = match to_vec(&content) {
+        let serialized = match serialize_content(&content) {
             Ok(v) => v,
             Err(e) => {
                 return Err(CouchbaseError::EncodingFailure {
@@ -291,10 +674,22 @@ impl Collection {
             }
         };
 
+        self.mutate_content(id, RawContent::json(serialized), ty)
+            .await
+    }
+
+    async fn mutate_content(
+        &self,
+        id: impl Into<String>,
+        content: RawContent,
+        ty: MutateRequestType,
+    ) -> CouchbaseResult<MutationResult> {
         let (sender, receiver) = oneshot::channel();
         self.core.send(Request::Mutate(MutateRequest {
             id: id.into(),
-            content: serialized,
+            content: content.bytes,
+            flags: content.flags,
+            json: content.json,
             sender,
             bucket: self.bucket_name.clone(),
             ty,
@@ -358,6 +753,49 @@ impl Collection {
         receiver.await.unwrap()
     }
 
+    /// Touches multiple documents at once, setting the same expiry on all of them.
+    ///
+    /// All requests are handed to the IO layer as a single batch, which schedules them
+    /// grouped by the node they belong to. The results are returned in the same order as
+    /// the ids.
+    pub async fn touch_multi<I, S>(
+        &self,
+        ids: I,
+        expiry: Duration,
+        options: impl Into<Option<TouchOptions>>,
+    ) -> Vec<CouchbaseResult<MutationResult>>
+    where
+        I: IntoIterator<Item = S>,
+        S: Into<String>,
+    {
+        let options = unwrap_or_default!(options.into());
+
+        let mut requests = vec![];
+        let mut receivers = vec![];
+        for id in ids {
+            let (sender, receiver) = oneshot::channel();
+            requests.push(Request::Touch(TouchRequest {
+                id: id.into(),
+                sender,
+                bucket: self.bucket_name.clone(),
+                options: options.clone(),
+                scope: self.scope_name.clone(),
+                collection: self.name.clone(),
+                expiry,
+            }));
+            receivers.push(receiver);
+        }
+        if !requests.is_empty() {
+            self.core.send(Request::Batch(requests));
+        }
+
+        join_all(receivers)
+            .await
+            .into_iter()
+            .map(|r| r.unwrap())
+            .collect()
+    }
+
     pub async fn unlock(
         &self,
         id: impl Into<String>,
@@ -428,12 +866,32 @@ impl Collection {
     }
 }
 
-#[derive(Debug)]
+/// Documents larger than this cannot be stored, so they do not size the next buffer.
+const MAX_CONTENT_SIZE_HINT: usize = 20 * 1024 * 1024;
+
+thread_local! {
+    /// Size of the last document serialized on this thread.
+    static CONTENT_SIZE_HINT: Cell<usize> = Cell::new(0);
+}
+
+/// Serializes a document into a buffer sized after the previous one, so that documents
+/// of a similar size are written in one go instead of growing (and copying) the buffer
+/// several times. The buffer is then handed to the IO layer as is, which passes large
+/// values on to libcouchbase without copying them again.
+pub(crate) fn serialize_content<T: Serialize>(content: &T) -> serde_json::Result<Vec<u8>> {
+    let hint = CONTENT_SIZE_HINT.with(Cell::get);
+    let mut serialized = Vec::with_capacity(hint + hint / 8);
+    serde_json::to_writer(&mut serialized, content)?;
+    CONTENT_SIZE_HINT.with(|h| h.set(serialized.len().min(MAX_CONTENT_SIZE_HINT)));
+    Ok(serialized)
+}
+
+#[derive(Debug, Clone)]
 pub struct MutationState {
     pub(crate) tokens: Vec<MutationToken>,
 }
 
-#[derive(Debug)]
+#[derive(Debug, Clone)]
 pub struct MutationToken {
     partition_uuid: u64,
     sequence_number: u64,
@@ -41,6 +41,16 @@ pub enum CouchbaseError {
     AuthenticationFailure { ctx: ErrorContext },
     #[snafu(display("A temporary failure occurred: {}", ctx))]
     TemporaryFailure { ctx: ErrorContext },
+    #[snafu(display(
+        "Too many operations are in flight, retry once some completed: {}",
+        ctx
+    ))]
+    ClientOverloaded { ctx: ErrorContext },
+    #[snafu(display(
+        "Too many recent requests to the node failed, the request was not sent: {}",
+        ctx
+    ))]
+    CircuitBreakerOpen { ctx: ErrorContext },
     #[snafu(display("Server-side parsing of the request failed: {}", ctx))]
     ParsingFailure { ctx: ErrorContext },
     #[snafu(display("The bucket is not found: {}", ctx))]
@@ -1,10 +1,16 @@
 use crate::DurabilityLevel;
 use std::time::Duration;
 
-#[derive(Debug, Default)]
+#[derive(Debug, Default, Clone)]
 pub struct GetOptions {
     pub(crate) timeout: Option<Duration>,
     pub(crate) with_expiry: bool,
+    /// Microseconds to wait for the active node before reading the replicas,
+    /// 0 for the 95th percentile of recent get latencies.
+    pub(crate) hedge: Option<u32>,
+    pub(crate) near_cache: bool,
+    pub(crate) project: Option<Vec<String>>,
+    pub(crate) project_full_get_above: Option<usize>,
 }
 
 impl GetOptions {
@@ -13,17 +19,70 @@ impl GetOptions {
         self.with_expiry = with;
         self
     }
+
+    /// Reads the document from the replicas as well if the active node has not
+    /// replied within `delay`, and returns whichever value arrives first.
+    ///
+    /// A value read from a replica may not reflect the latest mutation.
+    pub fn hedge(mut self, delay: Duration) -> Self {
+        self.hedge = Some(delay.as_micros().max(1).min(u32::MAX as u128) as u32);
+        self
+    }
+
+    /// Like `hedge`, but waits for the 95th percentile of the latencies of recent
+    /// gets, so that only the slowest gets are also sent to the replicas.
+    pub fn hedge_adaptive(mut self) -> Self {
+        self.hedge = Some(0);
+        self
+    }
+
+    /// Accepts a recently read value from the near cache (see `ClusterOptions::near_cache`)
+    /// instead of contacting the cluster.
+    ///
+    /// The value may be stale by up to the TTL of the cache if the document is mutated
+    /// by another client. Documents recently found missing fail with `DocumentNotFound`
+    /// right away if `ClusterOptions::negative_cache` is set.
+    pub fn near_cache(mut self, enable: bool) -> Self {
+        self.near_cache = enable;
+        self
+    }
+
+    /// Only reads the given paths of the document (`name`, `address.city`, `tags[0]`...),
+    /// through subdoc lookups of up to 16 paths each, sent together. The content of the
+    /// result is an object holding just these paths, at the same place as in the document.
+    ///
+    /// Paths missing from the document are left out of the result, and so are the array
+    /// elements which were not projected: `tags[2]` alone reads as `{"tags":[...]}`.
+    pub fn project<I, S>(mut self, paths: I) -> Self
+    where
+        I: IntoIterator<Item = S>,
+        S: Into<String>,
+    {
+        self.project = Some(paths.into_iter().map(Into::into).collect());
+        self
+    }
+
+    /// Reads the whole document and projects it locally when more than `paths` paths
+    /// are projected, as the lookups then cost more than the document. Defaults to 32.
+    pub fn project_full_get_above(mut self, paths: usize) -> Self {
+        self.project_full_get_above = Some(paths);
+        self
+    }
 }
 
 #[derive(Debug)]
 pub(crate) enum ReplicaMode {
     Any,
     All,
+    Freshest,
+    Fastest,
 }
 
 #[derive(Debug, Default)]
 pub(crate) struct GetReplicaOptions {
     pub(crate) timeout: Option<Duration>,
+    pub(crate) min_cas: Option<u64>,
+    pub(crate) quorum: Option<u32>,
 }
 
 #[derive(Debug, Default)]
@@ -36,6 +95,40 @@ impl GetAnyReplicaOptions {
 }
 
 #[derive(Debug, Default)]
+pub struct GetFastestReplicaOptions {
+    pub(crate) timeout: Option<Duration>,
+}
+
+impl GetFastestReplicaOptions {
+    timeout!();
+}
+
+#[derive(Debug, Default)]
+pub struct GetFreshestReplicaOptions {
+    pub(crate) timeout: Option<Duration>,
+    pub(crate) min_cas: Option<u64>,
+    pub(crate) quorum: Option<u32>,
+}
+
+impl GetFreshestReplicaOptions {
+    timeout!();
+
+    /// Returns as soon as a copy has at least this CAS, e.g. the one of a
+    /// mutation which has to be read back.
+    pub fn min_cas(mut self, cas: u64) -> Self {
+        self.min_cas = Some(cas);
+        self
+    }
+
+    /// The number of copies to read before returning the freshest one, a
+    /// majority of the copies by default.
+    pub fn quorum(mut self, quorum: u32) -> Self {
+        self.quorum = Some(quorum);
+        self
+    }
+}
+
+#[derive(Debug, Default, Clone)]
 pub struct GetAndTouchOptions {
     pub(crate) timeout: Option<Duration>,
 }
@@ -53,12 +146,14 @@ impl GetAndLockOptions {
     timeout!();
 }
 
-#[derive(Debug, Default)]
+#[derive(Debug, Default, Clone)]
 pub struct UpsertOptions {
     pub(crate) timeout: Option<Duration>,
     pub(crate) expiry: Option<Duration>,
     pub(crate) preserve_expiry: bool,
     pub(crate) durability: Option<DurabilityLevel>,
+    /// Set for the upserts of a collection with `Collection::coalesce_upserts`.
+    pub(crate) coalesce: bool,
 }
 
 impl UpsertOptions {
@@ -119,7 +214,7 @@ impl RemoveOptions {
     }
 }
 
-#[derive(Debug, Default)]
+#[derive(Debug, Default, Clone)]
 pub struct TouchOptions {
     pub(crate) timeout: Option<Duration>,
 }
@@ -131,10 +226,18 @@ impl TouchOptions {
 #[derive(Debug, Default)]
 pub struct ExistsOptions {
     pub(crate) timeout: Option<Duration>,
+    pub(crate) near_cache: bool,
 }
 
 impl ExistsOptions {
     timeout!();
+
+    /// Reports a key recently found missing as missing without contacting the cluster
+    /// (see `ClusterOptions::negative_cache`).
+    pub fn near_cache(mut self, enable: bool) -> Self {
+        self.near_cache = enable;
+        self
+    }
 }
 
 #[derive(Debug, Default)]
@@ -221,13 +324,54 @@ impl DecrementOptions {
     }
 }
 
-#[derive(Debug, Default)]
+#[derive(Debug, Default, Clone)]
 pub(crate) struct CounterOptions {
     pub(crate) timeout: Option<Duration>,
     pub(crate) cas: Option<u64>,
     pub(crate) expiry: Option<Duration>,
     pub(crate) delta: i64,
     pub(crate) durability: Option<DurabilityLevel>,
+    /// Value a missing counter is created with. Counting a missing counter fails without it.
+    pub(crate) initial: Option<u64>,
+}
+
+#[derive(Debug, Clone)]
+pub struct SequenceOptions {
+    pub(crate) timeout: Option<Duration>,
+    pub(crate) min_block: u64,
+    pub(crate) max_block: u64,
+    pub(crate) block_interval: Duration,
+}
+
+impl Default for SequenceOptions {
+    fn default() -> Self {
+        Self {
+            timeout: None,
+            min_block: 16,
+            max_block: 65536,
+            block_interval: Duration::from_secs(1),
+        }
+    }
+}
+
+impl SequenceOptions {
+    timeout!();
+
+    /// Bounds of the number of ids reserved at once, 16 to 65536 by default. The sequence
+    /// starts with blocks of `min` ids.
+    pub fn block_size(mut self, min: u64, max: u64) -> Self {
+        self.min_block = min.max(1);
+        self.max_block = max.max(self.min_block);
+        self
+    }
+
+    /// How long a block should last at the current rate of consumption, 1 second by
+    /// default. Blocks are doubled when used up in less than half of it, and halved when
+    /// they last more than twice as long.
+    pub fn block_interval(mut self, interval: Duration) -> Self {
+        self.block_interval = interval;
+        self
+    }
 }
 
 #[derive(Debug, Default)]
@@ -1,3 +1,5 @@
+use crate::api::transcoding::DocumentFormat;
+use crate::io::ValueBuffer;
 use crate::{CouchbaseError, CouchbaseResult, ErrorContext, MutationToken, ServiceType};
 use chrono::NaiveDateTime;
 use std::collections::HashMap;
@@ -5,7 +7,7 @@ use std::fmt;
 use std::time::Duration;
 
 pub struct GetResult {
-    pub(crate) content: Vec<u8>,
+    pub(crate) content: ValueBuffer,
     pub(crate) cas: u64,
     pub(crate) flags: u32,
     pub(crate) expiry_time: Option<NaiveDateTime>,
@@ -13,6 +15,10 @@ pub struct GetResult {
 
 impl GetResult {
     pub fn new(content: Vec<u8>, cas: u64, flags: u32) -> Self {
+        Self::from_buffer(content.into(), cas, flags)
+    }
+
+    pub(crate) fn from_buffer(content: ValueBuffer, cas: u64, flags: u32) -> Self {
         Self {
             content,
             cas,
@@ -33,7 +39,7 @@ impl GetResult {
     where
         T: serde::Deserialize<'a>,
     {
-        match serde_json::from_slice(self.content.as_slice()) {
+        match serde_json::from_slice(&self.content) {
             Ok(v) => Ok(v),
             Err(e) => Err(CouchbaseError::DecodingFailure {
                 ctx: ErrorContext::default(),
@@ -42,6 +48,32 @@ impl GetResult {
         }
     }
 
+    /// The format the document was stored with, according to its flags.
+    pub fn format(&self) -> DocumentFormat {
+        DocumentFormat::from_flags(self.flags)
+    }
+
+    /// The content as it was stored, without decoding it.
+    pub fn content_as_bytes(&self) -> &[u8] {
+        &self.content
+    }
+
+    /// Takes the content as it was stored, without copying it if it is owned already.
+    pub fn into_content_bytes(self) -> Vec<u8> {
+        self.content.into_vec()
+    }
+
+    /// The content as a string, as stored by `RawContent::string`.
+    pub fn content_as_str(&self) -> CouchbaseResult<&str> {
+        match std::str::from_utf8(&self.content) {
+            Ok(v) => Ok(v),
+            Err(e) => Err(CouchbaseError::DecodingFailure {
+                ctx: ErrorContext::default(),
+                source: std::io::Error::new(std::io::ErrorKind::InvalidData, e),
+            }),
+        }
+    }
+
     // TODO: Pretty unconvinced that this returns the correct type, forcing users to use chrono here.
     pub fn expiry_time(&self) -> Option<&NaiveDateTime> {
         self.expiry_time.as_ref()
@@ -63,7 +95,7 @@ impl fmt::Debug for GetResult {
 }
 
 pub struct GetReplicaResult {
-    pub(crate) content: Vec<u8>,
+    pub(crate) content: ValueBuffer,
     pub(crate) cas: u64,
     pub(crate) flags: u32,
     pub(crate) is_replica: bool,
@@ -71,6 +103,15 @@ pub struct GetReplicaResult {
 
 impl GetReplicaResult {
     pub fn new(content: Vec<u8>, cas: u64, flags: u32, is_replica: bool) -> Self {
+        Self::from_buffer(content.into(), cas, flags, is_replica)
+    }
+
+    pub(crate) fn from_buffer(
+        content: ValueBuffer,
+        cas: u64,
+        flags: u32,
+        is_replica: bool,
+    ) -> Self {
         Self {
             content,
             cas,
@@ -87,7 +128,7 @@ impl GetReplicaResult {
     where
         T: serde::Deserialize<'a>,
     {
-        match serde_json::from_slice(self.content.as_slice()) {
+        match serde_json::from_slice(&self.content) {
             Ok(v) => Ok(v),
             Err(e) => Err(CouchbaseError::DecodingFailure {
                 ctx: ErrorContext::default(),
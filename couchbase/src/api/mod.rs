@@ -5,6 +5,7 @@ pub mod analytics_options;
 pub mod analytics_result;
 pub mod authenticator;
 pub mod binary_collection;
+pub mod blocking;
 pub mod bucket;
 pub mod buckets;
 pub mod cluster;
@@ -14,6 +15,7 @@ pub mod error;
 pub mod keyvalue_options;
 pub mod keyvalue_results;
 pub mod options;
+pub(crate) mod projection;
 pub mod query_indexes;
 pub mod query_options;
 pub mod query_result;
@@ -23,9 +25,11 @@ pub mod search;
 pub mod search_indexes;
 pub mod search_options;
 pub mod search_result;
+pub mod sequence;
 pub mod subdoc;
 pub mod subdoc_options;
 pub mod subdoc_results;
+pub mod transcoding;
 pub mod users;
 pub mod view_indexes;
 pub mod view_options;
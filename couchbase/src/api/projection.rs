@@ -0,0 +1,300 @@
+//! Projection of the documents read by `Collection::get` (see `GetOptions::project`).
+//!
+//! The paths are compiled once into a tree mirroring the shape of the projected object.
+//! The values looked up for them are then written into a single buffer, sized up front,
+//! as a sparse JSON object which only holds the projected paths.
+
+use crate::{CouchbaseError, CouchbaseResult, ErrorContext};
+use serde_json::Value;
+
+/// Most paths carried by a single lookup_in.
+pub(crate) const MAX_LOOKUP_SPECS: usize = 16;
+
+/// Number of paths above which the whole document is read instead, by default.
+pub(crate) const DEFAULT_FULL_GET_ABOVE: usize = 32;
+
+#[derive(Debug, Clone, PartialEq)]
+enum Segment {
+    Field(String),
+    Index(i64),
+}
+
+#[derive(Debug)]
+enum Node {
+    /// The value looked up for the path at this index.
+    Value(usize),
+    /// Members, by JSON-encoded name.
+    Object(Vec<(String, Node)>),
+    /// Elements, by index in the document.
+    Array(Vec<(i64, Node)>),
+}
+
+#[derive(Debug)]
+pub(crate) struct Projection {
+    paths: Vec<Vec<Segment>>,
+    root: Node,
+}
+
+impl Projection {
+    pub(crate) fn new(paths: &[String]) -> CouchbaseResult<Self> {
+        let paths = paths
+            .iter()
+            .map(|path| parse_path(path))
+            .collect::<CouchbaseResult<Vec<_>>>()?;
+        let mut root = Node::Object(Vec::new());
+        for (index, path) in paths.iter().enumerate() {
+            if path.is_empty() {
+                root = Node::Value(index);
+                break;
+            }
+            insert(&mut root, path, index);
+        }
+        Ok(Self { paths, root })
+    }
+
+    /// Whether one of the paths is the whole document.
+    pub(crate) fn whole_document(&self) -> bool {
+        matches!(self.root, Node::Value(_))
+    }
+
+    /// Writes the projected object from the values of the paths, in the order they were
+    /// given, `None` for the paths missing from the document.
+    pub(crate) fn assemble(&self, values: &[Option<&[u8]>]) -> Vec<u8> {
+        let size = size(&self.root, values);
+        let mut out = Vec::with_capacity(size.unwrap_or(2));
+        if size.is_some() {
+            write(&self.root, values, &mut out);
+        } else {
+            out.extend_from_slice(b"{}");
+        }
+        out
+    }
+
+    /// Picks the projected paths out of a whole document, for the projections which are
+    /// not read through lookups.
+    pub(crate) fn pick(&self, document: &[u8]) -> CouchbaseResult<Vec<u8>> {
+        if self.whole_document() {
+            return Ok(document.to_vec());
+        }
+        let document: Value = serde_json::from_slice(document)
+            .map_err(CouchbaseError::decoding_failure_from_serde)?;
+        let values = self
+            .paths
+            .iter()
+            .map(|path| lookup(&document, path).map(|value| value.to_string().into_bytes()))
+            .collect::<Vec<_>>();
+        let values = values
+            .iter()
+            .map(|value| value.as_deref())
+            .collect::<Vec<_>>();
+        Ok(self.assemble(&values))
+    }
+}
+
+fn invalid_path(path: &str) -> CouchbaseError {
+    CouchbaseError::InvalidArgument {
+        ctx: ErrorContext::from(("project", format!("Invalid path {}", path).as_str())),
+    }
+}
+
+/// Splits a subdoc path (`a.b[2].c`, with backquoted names) into its segments.
+fn parse_path(path: &str) -> CouchbaseResult<Vec<Segment>> {
+    let mut segments = Vec::new();
+    let mut name = String::new();
+    // Whether a segment has to be closed by a `.` or `[` before the next name starts
+    let mut after_index = false;
+    let mut chars = path.chars().peekable();
+    while let Some(c) = chars.next() {
+        match c {
+            '`' => {
+                if after_index {
+                    return Err(invalid_path(path));
+                }
+                loop {
+                    match chars.next() {
+                        Some('`') if chars.peek() == Some(&'`') => {
+                            chars.next();
+                            name.push('`');
+                        }
+                        Some('`') => break,
+                        Some(c) => name.push(c),
+                        None => return Err(invalid_path(path)),
+                    }
+                }
+            }
+            '.' => {
+                if name.is_empty() && !after_index {
+                    return Err(invalid_path(path));
+                }
+                if !name.is_empty() {
+                    segments.push(Segment::Field(std::mem::take(&mut name)));
+                }
+                after_index = false;
+            }
+            '[' => {
+                if !name.is_empty() {
+                    segments.push(Segment::Field(std::mem::take(&mut name)));
+                } else if segments.is_empty() {
+                    // The projection of a document is an object
+                    return Err(invalid_path(path));
+                }
+                let mut digits = String::new();
+                loop {
+                    match chars.next() {
+                        Some(']') => break,
+                        Some(c) => digits.push(c),
+                        None => return Err(invalid_path(path)),
+                    }
+                }
+                let index = digits.parse().map_err(|_| invalid_path(path))?;
+                segments.push(Segment::Index(index));
+                after_index = true;
+            }
+            c => {
+                if after_index {
+                    return Err(invalid_path(path));
+                }
+                name.push(c);
+            }
+        }
+    }
+    if !name.is_empty() {
+        segments.push(Segment::Field(name));
+    } else if path.ends_with('.') {
+        return Err(invalid_path(path));
+    }
+    Ok(segments)
+}
+
+/// Adds the path at `index` under `node`. A path already covered by a shorter one is part
+/// of its value, and replaces the deeper paths otherwise.
+fn insert(node: &mut Node, segments: &[Segment], index: usize) {
+    let (segment, rest) = match segments.split_first() {
+        Some(split) => split,
+        None => {
+            *node = Node::Value(index);
+            return;
+        }
+    };
+    let empty = || match rest.first() {
+        Some(Segment::Index(_)) => Node::Array(Vec::new()),
+        _ => Node::Object(Vec::new()),
+    };
+    let child = match (node, segment) {
+        (Node::Object(members), Segment::Field(name)) => {
+            let key = serde_json::to_string(name).unwrap();
+            let position = match members.iter().position(|(k, _)| *k == key) {
+                Some(position) => position,
+                None => {
+                    members.push((key, empty()));
+                    members.len() - 1
+                }
+            };
+            &mut members[position].1
+        }
+        (Node::Array(elements), Segment::Index(i)) => {
+            let position = match elements.iter().position(|(k, _)| k == i) {
+                Some(position) => position,
+                None => {
+                    elements.push((*i, empty()));
+                    elements.len() - 1
+                }
+            };
+            &mut elements[position].1
+        }
+        // Either covered by a shorter path, or conflicting with the type of the container
+        // implied by another path, in which case one of the two is missing anyways.
+        _ => return,
+    };
+    insert(child, rest, index)
+}
+
+/// Bytes taken by `node` in the projected object, `None` if none of its paths exist.
+fn size(node: &Node, values: &[Option<&[u8]>]) -> Option<usize> {
+    match node {
+        Node::Value(index) => values[*index].map(|value| value.len()),
+        Node::Object(members) => container_size(
+            members
+                .iter()
+                .map(|(key, child)| size(child, values).map(|size| key.len() + 1 + size)),
+        ),
+        Node::Array(elements) => {
+            container_size(elements.iter().map(|(_, child)| size(child, values)))
+        }
+    }
+}
+
+fn container_size(children: impl Iterator<Item = Option<usize>>) -> Option<usize> {
+    let (count, total) = children
+        .flatten()
+        .fold((0, 0), |(count, total), size| (count + 1, total + size));
+    if count == 0 {
+        None
+    } else {
+        // Brackets and separators
+        Some(total + count + 1)
+    }
+}
+
+fn present(node: &Node, values: &[Option<&[u8]>]) -> bool {
+    match node {
+        Node::Value(index) => values[*index].is_some(),
+        Node::Object(members) => members.iter().any(|(_, child)| present(child, values)),
+        Node::Array(elements) => elements.iter().any(|(_, child)| present(child, values)),
+    }
+}
+
+fn write(node: &Node, values: &[Option<&[u8]>], out: &mut Vec<u8>) {
+    match node {
+        Node::Value(index) => out.extend_from_slice(values[*index].unwrap()),
+        Node::Object(members) => {
+            out.push(b'{');
+            let mut first = true;
+            for (key, child) in members.iter().filter(|(_, child)| present(child, values)) {
+                if !first {
+                    out.push(b',');
+                }
+                first = false;
+                out.extend_from_slice(key.as_bytes());
+                out.push(b':');
+                write(child, values, out);
+            }
+            out.push(b'}');
+        }
+        Node::Array(elements) => {
+            // Sparse: the elements are written in the order of their paths, without gaps
+            out.push(b'[');
+            let mut first = true;
+            for (_, child) in elements.iter().filter(|(_, child)| present(child, values)) {
+                if !first {
+                    out.push(b',');
+                }
+                first = false;
+                write(child, values, out);
+            }
+            out.push(b']');
+        }
+    }
+}
+
+/// Navigates a parsed document, as the server would for a lookup.
+fn lookup<'a>(mut value: &'a Value, path: &[Segment]) -> Option<&'a Value> {
+    for segment in path {
+        value = match (value, segment) {
+            (Value::Object(members), Segment::Field(name)) => members.get(name)?,
+            (Value::Array(elements), Segment::Index(i)) => {
+                let i = if *i < 0 {
+                    elements.len() as i64 + *i
+                } else {
+                    *i
+                };
+                if i < 0 {
+                    return None;
+                }
+                elements.get(i as usize)?
+            }
+            _ => return None,
+        };
+    }
+    Some(value)
+}
@@ -3,12 +3,14 @@ use serde_derive::Serialize;
 use serde_json::Value;
 use std::time::Duration;
 
-#[derive(Debug, Default, Serialize)]
+#[derive(Debug, Default, Clone, Serialize)]
 pub struct QueryOptions {
     #[serde(skip_serializing_if = "Option::is_none")]
     pub(crate) scan_consistency: Option<QueryScanConsistency>,
     #[serde(skip)]
     pub(crate) adhoc: Option<bool>,
+    #[serde(skip)]
+    pub(crate) max_rows: Option<usize>,
     #[serde(skip_serializing_if = "Option::is_none")]
     #[serde(serialize_with = "crate::convert_duration_for_golang")]
     pub(crate) timeout: Option<Duration>,
@@ -31,6 +33,8 @@ pub struct QueryOptions {
     pub(crate) metrics: Option<bool>,
     #[serde(skip_serializing_if = "Option::is_none")]
     pub(crate) profile: Option<QueryProfile>,
+    #[serde(skip)]
+    pub(crate) skip_meta_data: bool,
     #[serde(skip_serializing_if = "Option::is_none")]
     #[serde(serialize_with = "crate::convert_mutation_state")]
     pub(crate) consistent_with: Option<MutationState>,
@@ -64,6 +68,16 @@ impl QueryOptions {
         self
     }
 
+    /// Stops the query once this many rows have been received, closing the connection
+    /// instead of reading the rest of the results the server streams.
+    ///
+    /// The metadata of a query stopped this way has no metrics, and its status is
+    /// `QueryStatus::Stopped`.
+    pub fn max_rows(mut self, max_rows: usize) -> Self {
+        self.max_rows = Some(max_rows);
+        self
+    }
+
     pub fn client_context_id(mut self, client_context_id: String) -> Self {
         self.client_context_id = Some(client_context_id);
         self
@@ -109,6 +123,20 @@ impl QueryOptions {
         self
     }
 
+    /// Drops the metadata of the result instead of keeping it around, for callers which
+    /// only read the rows.
+    ///
+    /// This also asks the server for neither metrics nor a profile, and
+    /// `QueryResult::meta_data` then fails.
+    pub fn skip_meta_data(mut self, skip: bool) -> Self {
+        self.skip_meta_data = skip;
+        if skip {
+            self.metrics = Some(false);
+            self.profile = Some(QueryProfile::Off);
+        }
+        self
+    }
+
     pub fn consistent_with(mut self, consistent_with: MutationState) -> Self {
         self.consistent_with = Some(consistent_with);
         self
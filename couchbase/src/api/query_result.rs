@@ -1,20 +1,33 @@
+use crate::io::RowReceiver;
 use crate::{CouchbaseError, CouchbaseResult, ErrorContext};
-use futures::channel::mpsc::UnboundedReceiver;
+use futures::channel::oneshot;
 use futures::channel::oneshot::Receiver;
-use futures::{Stream, StreamExt};
+use futures::future::join_all;
+use futures::stream::select_all;
+use futures::{Future, Stream, StreamExt};
 use serde::de::DeserializeOwned;
 use serde_derive::Deserialize;
 use serde_json::Value;
+use std::collections::VecDeque;
+use std::fmt;
+use std::pin::Pin;
+use std::sync::{mpsc, Arc, Mutex};
+use std::task::{Context, Poll};
+use std::thread;
 use std::time::Duration;
 
+/// The metadata of a query as the server sent it, `None` if it was skipped (see
+/// `QueryOptions::skip_meta_data`).
+pub(crate) type RawQueryMetaData = Option<Vec<u8>>;
+
 #[derive(Debug)]
 pub struct QueryResult {
-    rows: Option<UnboundedReceiver<Vec<u8>>>,
-    meta: Option<Receiver<QueryMetaData>>,
+    rows: Option<RowReceiver>,
+    meta: Option<Receiver<RawQueryMetaData>>,
 }
 
 impl QueryResult {
-    pub(crate) fn new(rows: UnboundedReceiver<Vec<u8>>, meta: Receiver<QueryMetaData>) -> Self {
+    pub(crate) fn new(rows: RowReceiver, meta: Receiver<RawQueryMetaData>) -> Self {
         Self {
             rows: Some(rows),
             meta: Some(meta),
@@ -25,19 +38,41 @@ impl QueryResult {
     where
         T: DeserializeOwned,
     {
-        self.rows.take().expect("Can not consume rows twice!").map(
-            |v| match serde_json::from_slice(v.as_slice()) {
-                Ok(decoded) => Ok(decoded),
-                Err(e) => Err(CouchbaseError::DecodingFailure {
-                    ctx: ErrorContext::default(),
-                    source: e.into(),
-                }),
-            },
+        self.rows
+            .take()
+            .expect("Can not consume rows twice!")
+            .map(|v| decode_row(v.as_slice()))
+    }
+
+    /// Like `rows`, but decodes the rows on `workers` background threads.
+    ///
+    /// Rows which arrived together are decoded in batches, several batches at once, and
+    /// are still yielded in the order the server returned them. This pays off for large
+    /// result sets whose rows are costly to decode. The threads exit once the stream is
+    /// dropped.
+    pub fn rows_parallel<T>(&mut self, workers: usize) -> impl Stream<Item = CouchbaseResult<T>>
+    where
+        T: DeserializeOwned + Send + 'static,
+    {
+        ParallelRows::new(
+            self.rows.take().expect("Can not consume rows twice!"),
+            workers.max(1),
         )
     }
 
+    /// Decodes the metadata once all rows arrived.
+    ///
+    /// The metadata is kept as the server sent it until this is called, so results whose
+    /// metadata is never looked at do not pay for decoding it. The signature and the
+    /// profile are only decoded when they are accessed.
     pub async fn meta_data(&mut self) -> CouchbaseResult<QueryMetaData> {
-        self.meta
+        QueryMetaData::from_raw(self.raw_meta_data().await?)
+    }
+
+    /// The metadata as the server sent it (a JSON object), once all rows arrived.
+    pub async fn raw_meta_data(&mut self) -> CouchbaseResult<Vec<u8>> {
+        let raw = self
+            .meta
             .take()
             .expect("Can not consume metadata twice!")
             .await
@@ -45,7 +80,178 @@ impl QueryResult {
                 let mut ctx = ErrorContext::default();
                 ctx.insert("error", Value::String(e.to_string()));
                 CouchbaseError::RequestCanceled { ctx }
-            })
+            })?;
+        raw.ok_or_else(|| {
+            let mut ctx = ErrorContext::default();
+            ctx.insert(
+                "cause",
+                Value::String("The metadata was skipped, see QueryOptions::skip_meta_data".into()),
+            );
+            CouchbaseError::Generic { ctx }
+        })
+    }
+}
+
+fn decode_row<T: DeserializeOwned>(row: &[u8]) -> CouchbaseResult<T> {
+    serde_json::from_slice(row).map_err(|e| CouchbaseError::DecodingFailure {
+        ctx: ErrorContext::default(),
+        source: e.into(),
+    })
+}
+
+/// Maximum number of rows decoded by a worker in one go.
+const DECODE_BATCH_ROWS: usize = 64;
+
+type DecodeJob = Box<dyn FnOnce() + Send>;
+
+/// Hands the rows to a pool of decoding threads and yields the decoded rows in order.
+struct ParallelRows<T> {
+    /// `None` once all rows have been taken out.
+    rows: Option<RowReceiver>,
+    jobs: mpsc::Sender<DecodeJob>,
+    /// The batches handed to the workers, oldest first.
+    in_flight: VecDeque<oneshot::Receiver<Vec<CouchbaseResult<T>>>>,
+    ready: std::vec::IntoIter<CouchbaseResult<T>>,
+    max_in_flight: usize,
+}
+
+// Nothing is ever pinned in place.
+impl<T> Unpin for ParallelRows<T> {}
+
+impl<T: DeserializeOwned + Send + 'static> ParallelRows<T> {
+    fn new(rows: RowReceiver, workers: usize) -> Self {
+        let (jobs, queue) = mpsc::channel::<DecodeJob>();
+        let queue = Arc::new(Mutex::new(queue));
+        for idx in 0..workers {
+            let queue = queue.clone();
+            thread::Builder::new()
+                .name(format!("couchbase-rows-{}", idx))
+                .spawn(move || loop {
+                    // Not matched on directly, so that the lock is released before decoding.
+                    let job = queue.lock().unwrap().recv();
+                    match job {
+                        Ok(job) => job(),
+                        Err(_) => break,
+                    }
+                })
+                .expect("Could not spawn row decoding thread");
+        }
+        Self {
+            rows: Some(rows),
+            jobs,
+            in_flight: VecDeque::new(),
+            ready: Vec::new().into_iter(),
+            max_in_flight: workers * 2,
+        }
+    }
+
+    fn dispatch(&mut self, batch: Vec<Vec<u8>>) {
+        let (tx, rx) = oneshot::channel();
+        let job: DecodeJob = Box::new(move || {
+            let _ = tx.send(batch.iter().map(|row| decode_row(row)).collect());
+        });
+        if let Err(mpsc::SendError(job)) = self.jobs.send(job) {
+            // All workers are gone, decode right here instead.
+            job();
+        }
+        self.in_flight.push_back(rx);
+    }
+
+    /// Takes the rows which already arrived out of the channel and hands them to the
+    /// workers, as long as not too many batches are waiting to be consumed.
+    fn fill(&mut self, cx: &mut Context<'_>) {
+        let mut batch = Vec::new();
+        while self.in_flight.len() < self.max_in_flight {
+            let rows = match &mut self.rows {
+                Some(rows) => rows,
+                None => break,
+            };
+            match Pin::new(rows).poll_next(cx) {
+                Poll::Ready(Some(row)) => {
+                    batch.push(row);
+                    if batch.len() == DECODE_BATCH_ROWS {
+                        self.dispatch(std::mem::take(&mut batch));
+                    }
+                }
+                Poll::Ready(None) => self.rows = None,
+                Poll::Pending => break,
+            }
+        }
+        if !batch.is_empty() {
+            self.dispatch(batch);
+        }
+    }
+}
+
+impl<T: DeserializeOwned + Send + 'static> Stream for ParallelRows<T> {
+    type Item = CouchbaseResult<T>;
+
+    fn poll_next(self: Pin<&mut Self>, cx: &mut Context<'_>) -> Poll<Option<Self::Item>> {
+        let this = self.get_mut();
+        loop {
+            if let Some(row) = this.ready.next() {
+                return Poll::Ready(Some(row));
+            }
+            this.fill(cx);
+            let batch = match this.in_flight.front_mut() {
+                Some(batch) => batch,
+                None if this.rows.is_none() => return Poll::Ready(None),
+                None => return Poll::Pending,
+            };
+            match Pin::new(batch).poll(cx) {
+                Poll::Ready(decoded) => {
+                    this.in_flight.pop_front();
+                    match decoded {
+                        Ok(decoded) => this.ready = decoded.into_iter(),
+                        Err(e) => {
+                            let mut ctx = ErrorContext::default();
+                            ctx.insert("error", Value::String(e.to_string()));
+                            return Poll::Ready(Some(Err(CouchbaseError::RequestCanceled { ctx })));
+                        }
+                    }
+                }
+                Poll::Pending => return Poll::Pending,
+            }
+        }
+    }
+}
+
+/// The result of a query run by `Cluster::query_partitioned`, one `QueryResult` per partition.
+#[derive(Debug)]
+pub struct PartitionedQueryResult {
+    partitions: Vec<QueryResult>,
+}
+
+impl PartitionedQueryResult {
+    pub(crate) fn new(partitions: Vec<QueryResult>) -> Self {
+        Self { partitions }
+    }
+
+    pub fn partition_count(&self) -> usize {
+        self.partitions.len()
+    }
+
+    /// The rows of all partitions, in the order they arrive.
+    pub fn rows<T>(&mut self) -> impl Stream<Item = CouchbaseResult<T>>
+    where
+        T: DeserializeOwned,
+    {
+        select_all(
+            self.partitions
+                .iter_mut()
+                .map(|partition| Box::pin(partition.rows::<T>())),
+        )
+    }
+
+    /// The metadata (including the metrics) of every partition, in the order the
+    /// partitions were given.
+    pub async fn meta_data(&mut self) -> Vec<CouchbaseResult<QueryMetaData>> {
+        join_all(
+            self.partitions
+                .iter_mut()
+                .map(|partition| partition.meta_data()),
+        )
+        .await
     }
 }
 
@@ -73,6 +279,12 @@ pub enum QueryStatus {
     Unknown,
 }
 
+impl QueryStatus {
+    fn stopped() -> Self {
+        QueryStatus::Stopped
+    }
+}
+
 #[derive(Debug, Deserialize)]
 pub struct QueryWarning {
     code: i32,
@@ -86,13 +298,44 @@ pub struct QueryMetaData {
     #[serde(rename = "clientContextID")]
     client_context_id: String,
     metrics: Option<QueryMetrics>,
+    // Missing if the query was cut short by `QueryOptions::max_rows`
+    #[serde(default = "QueryStatus::stopped")]
     status: QueryStatus,
     warnings: Option<Vec<QueryWarning>>,
-    signature: Option<Value>,
-    profile: Option<Value>,
+    // The signature and the profile, which can be large, are decoded from here on access
+    #[serde(skip)]
+    raw: RawMeta,
+}
+
+/// The signature of a query, decoded on its own from the metadata.
+#[derive(Deserialize)]
+struct MetaSignature<T> {
+    signature: Option<T>,
+}
+
+/// The profile of a query, decoded on its own from the metadata.
+#[derive(Deserialize)]
+struct MetaProfile<T> {
+    profile: Option<T>,
+}
+
+#[derive(Default)]
+struct RawMeta(Vec<u8>);
+
+impl fmt::Debug for RawMeta {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        write!(f, "<{} bytes>", self.0.len())
+    }
 }
 
 impl QueryMetaData {
+    fn from_raw(raw: Vec<u8>) -> CouchbaseResult<Self> {
+        let mut meta: QueryMetaData =
+            serde_json::from_slice(&raw).map_err(CouchbaseError::decoding_failure_from_serde)?;
+        meta.raw = RawMeta(raw);
+        Ok(meta)
+    }
+
     pub fn metrics(&self) -> Option<&QueryMetrics> {
         self.metrics.as_ref()
     }
@@ -117,20 +360,20 @@ impl QueryMetaData {
     where
         T: DeserializeOwned,
     {
-        Some(
-            serde_json::from_value(self.signature.clone()?)
-                .map_err(CouchbaseError::decoding_failure_from_serde),
-        )
+        match serde_json::from_slice::<MetaSignature<T>>(&self.raw.0) {
+            Ok(meta) => meta.signature.map(Ok),
+            Err(e) => Some(Err(CouchbaseError::decoding_failure_from_serde(e))),
+        }
     }
 
     pub fn profile<T>(&self) -> Option<CouchbaseResult<T>>
     where
         T: DeserializeOwned,
     {
-        Some(
-            serde_json::from_value(self.signature.clone()?)
-                .map_err(CouchbaseError::decoding_failure_from_serde),
-        )
+        match serde_json::from_slice::<MetaProfile<T>>(&self.raw.0) {
+            Ok(meta) => meta.profile.map(Ok),
+            Err(e) => Some(Err(CouchbaseError::decoding_failure_from_serde(e))),
+        }
     }
 }
 
@@ -76,6 +76,8 @@ pub struct SearchOptions {
     #[serde(skip_serializing_if = "Option::is_none")]
     #[serde(flatten)]
     pub(crate) raw: Option<serde_json::Map<String, Value>>,
+    #[serde(skip)]
+    pub(crate) project: Vec<String>,
     // The query and index are not part of the public API, but added here
     // as a convenience so we can convert the whole block into the
     // JSON payload the search engine expects. DO NOT ADD A PUBLIC
@@ -117,6 +119,21 @@ impl SearchOptions {
         self
     }
 
+    /// Reduces every returned row to the given members while the response is
+    /// streamed in, e.g. `["id", "score", "fields.title"]`.
+    ///
+    /// Members which are not kept (such as `locations`, `fragments` or stored
+    /// fields that are not needed) are skipped without being parsed. Stored
+    /// fields still have to be requested through `fields`.
+    pub fn project<I, T>(mut self, paths: I) -> Self
+    where
+        I: IntoIterator<Item = T>,
+        T: Into<String>,
+    {
+        self.project = paths.into_iter().map(Into::into).collect();
+        self
+    }
+
     pub fn scan_consistency(mut self, level: SearchScanConsistency) -> Self {
         self.consistency = Some(SearchCtl {
             ctl: SearchCtlConsistency {
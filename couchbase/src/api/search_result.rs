@@ -1,5 +1,5 @@
+use crate::io::RowReceiver;
 use crate::{CouchbaseError, CouchbaseResult, ErrorContext};
-use futures::channel::mpsc::UnboundedReceiver;
 use futures::channel::oneshot::Receiver;
 use futures::{Stream, StreamExt};
 use serde::de::DeserializeOwned;
@@ -247,8 +247,11 @@ impl TryFrom<&Value> for SearchRowLocations {
 
 #[derive(Debug, Deserialize)]
 pub struct SearchRow {
+    #[serde(default)]
     index: String,
+    #[serde(default)]
     id: String,
+    #[serde(default)]
     score: f32,
     fields: Option<Value>,
     locations: Option<SearchRowLocations>,
@@ -517,14 +520,14 @@ impl TermSearchFacetResult {
 
 #[derive(Debug)]
 pub struct SearchResult {
-    rows: Option<UnboundedReceiver<Vec<u8>>>,
+    rows: Option<RowReceiver>,
     meta: Option<Receiver<SearchMetaData>>,
     facets: Option<Receiver<Value>>,
 }
 
 impl SearchResult {
-    pub fn new(
-        rows: UnboundedReceiver<Vec<u8>>,
+    pub(crate) fn new(
+        rows: RowReceiver,
         meta: Receiver<SearchMetaData>,
         facets: Receiver<Value>,
     ) -> Self {
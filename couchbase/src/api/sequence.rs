@@ -0,0 +1,127 @@
+use crate::io::request::{CounterRequest, Request};
+use crate::io::Core;
+use crate::{CouchbaseResult, CounterOptions, CounterResult, SequenceOptions};
+use futures::channel::oneshot;
+use futures::lock::Mutex;
+use std::sync::Arc;
+use std::time::Instant;
+
+/// The next block is reserved once the current one is down to this fraction.
+const LOW_WATERMARK_DIVISOR: u64 = 4;
+
+/// Unique ids handed out from a counter document, see `BinaryCollection::sequence`.
+///
+/// Rather than incrementing the counter for every id, the sequence reserves blocks of ids
+/// with a single increment by the size of the block, and hands them out locally. The next
+/// block is requested in the background once a quarter of the current one is left, so
+/// that `next` only waits for the network when the ids are used up faster than a block
+/// can be reserved. The size of the blocks follows the rate at which ids are used.
+///
+/// Every id is unique across all the sequences of the same counter, and the ids of one
+/// sequence increase. They are not gapless though: the ids left in the blocks of a
+/// sequence are lost when it is dropped, and sequences sharing a counter interleave.
+pub struct IdSequence {
+    core: Arc<Core>,
+    id: String,
+    bucket_name: String,
+    scope_name: String,
+    collection_name: String,
+    options: SequenceOptions,
+    state: Mutex<SequenceState>,
+}
+
+struct SequenceState {
+    /// Next id to hand out, from the block ending before `end`.
+    next: u64,
+    end: u64,
+    /// Size of the next block to reserve.
+    block: u64,
+    /// Block being reserved, with its size.
+    pending: Option<(u64, oneshot::Receiver<CouchbaseResult<CounterResult>>)>,
+    /// When the previous block was reserved.
+    reserved_at: Option<Instant>,
+}
+
+impl IdSequence {
+    pub(crate) fn new(
+        core: Arc<Core>,
+        id: String,
+        bucket_name: String,
+        scope_name: String,
+        collection_name: String,
+        options: SequenceOptions,
+    ) -> Self {
+        let block = options.min_block;
+        Self {
+            core,
+            id,
+            bucket_name,
+            scope_name,
+            collection_name,
+            options,
+            state: Mutex::new(SequenceState {
+                next: 0,
+                end: 0,
+                block,
+                pending: None,
+                reserved_at: None,
+            }),
+        }
+    }
+
+    /// The next id of the sequence.
+    pub async fn next(&self) -> CouchbaseResult<u64> {
+        let mut state = self.state.lock().await;
+        if state.next == state.end {
+            if state.pending.is_none() {
+                self.reserve(&mut state);
+            }
+            // Left pending if this future is dropped, for the next caller to pick up.
+            let result = (&mut state.pending.as_mut().unwrap().1).await;
+            let (block, _) = state.pending.take().unwrap();
+            let last = result.unwrap()?.content();
+            state.next = last - block + 1;
+            state.end = last + 1;
+        }
+
+        let id = state.next;
+        state.next += 1;
+        if state.pending.is_none() && state.end - state.next <= state.block / LOW_WATERMARK_DIVISOR
+        {
+            self.reserve(&mut state);
+        }
+        Ok(id)
+    }
+
+    /// Sends the increment reserving the next block, sized from the time the previous
+    /// one took to use up.
+    fn reserve(&self, state: &mut SequenceState) {
+        let now = Instant::now();
+        if let Some(reserved_at) = state.reserved_at {
+            let elapsed = now.duration_since(reserved_at);
+            if elapsed < self.options.block_interval / 2 {
+                state.block = (state.block * 2).min(self.options.max_block);
+            } else if elapsed > self.options.block_interval * 2 {
+                state.block = (state.block / 2).max(self.options.min_block);
+            }
+        }
+        state.reserved_at = Some(now);
+
+        let (sender, receiver) = oneshot::channel();
+        self.core.send(Request::Counter(CounterRequest {
+            id: self.id.clone(),
+            sender,
+            bucket: self.bucket_name.clone(),
+            options: CounterOptions {
+                timeout: self.options.timeout,
+                delta: state.block as i64,
+                // Created as if this block was reserved from 0.
+                initial: Some(state.block),
+                ..Default::default()
+            },
+            scope: self.scope_name.clone(),
+            collection: self.collection_name.clone(),
+        }));
+        state.pending = Some((state.block, receiver));
+    }
+}
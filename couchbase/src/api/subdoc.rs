@@ -371,7 +371,7 @@ impl Debug for LookupinMacro {
     }
 }
 
-#[derive(Debug)]
+#[derive(Debug, Clone, PartialEq, Eq, Hash)]
 pub enum LookupInSpec {
     Get { path: String, xattr: bool },
     Exists { path: String, xattr: bool },
@@ -1,22 +1,26 @@
 use crate::io::couchbase_error_from_lcb_status;
+use crate::io::ValueBuffer;
 use crate::{CouchbaseError, CouchbaseResult, ErrorContext};
 use std::convert::TryInto;
+use std::ops::Range;
 
+/// A single subdocument result, its value being the `value` range of the result body.
 #[derive(Debug)]
 pub(crate) struct SubDocField {
     pub status: u32,
-    pub value: Vec<u8>,
+    pub value: Range<usize>,
 }
 
 #[derive(Debug)]
 pub struct MutateInResult {
     content: Vec<SubDocField>,
+    body: ValueBuffer,
     cas: u64,
 }
 
 impl MutateInResult {
-    pub(crate) fn new(content: Vec<SubDocField>, cas: u64) -> Self {
-        Self { content, cas }
+    pub(crate) fn new(content: Vec<SubDocField>, body: ValueBuffer, cas: u64) -> Self {
+        Self { content, body, cas }
     }
 
     pub fn cas(&self) -> u64 {
@@ -27,15 +31,16 @@ impl MutateInResult {
 #[derive(Debug)]
 pub struct LookupInResult {
     content: Vec<SubDocField>,
+    body: ValueBuffer,
     cas: u64,
 }
 
 impl LookupInResult {
-    pub(crate) fn new(content: Vec<SubDocField>, cas: u64) -> Self {
-        Self { content, cas }
+    pub(crate) fn new(content: Vec<SubDocField>, body: ValueBuffer, cas: u64) -> Self {
+        Self { content, body, cas }
     }
 
-    pub(crate) fn raw(&self, index: usize) -> CouchbaseResult<&Vec<u8>> {
+    pub(crate) fn raw(&self, index: usize) -> CouchbaseResult<&[u8]> {
         let content = match self.content.get(index) {
             Some(c) => c,
             None => {
@@ -55,7 +60,7 @@ impl LookupInResult {
             }
         }
 
-        Ok(&content.value)
+        Ok(&self.body[content.value.clone()])
     }
 
     pub fn cas(&self) -> u64 {
@@ -68,7 +73,7 @@ impl LookupInResult {
     {
         let content = self.raw(index)?;
 
-        serde_json::from_slice(content.as_slice())
+        serde_json::from_slice(content)
             .map_err(CouchbaseError::decoding_failure_from_serde)
     }
 
@@ -0,0 +1,102 @@
+/// The format of a document is kept in the top byte of its flags, following the
+/// "common flags" convention the SDKs share.
+const FORMAT_SHIFT: u32 = 24;
+const FORMAT_JSON: u32 = 0x02;
+const FORMAT_BINARY: u32 = 0x03;
+const FORMAT_STRING: u32 = 0x04;
+
+/// Format of the content of a document, as recorded in its flags.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum DocumentFormat {
+    Json,
+    Binary,
+    String,
+    /// Flags set by a client which does not follow the common flags.
+    Unknown,
+}
+
+impl DocumentFormat {
+    /// The flags a document of this format is stored with.
+    pub fn flags(self) -> u32 {
+        match self {
+            DocumentFormat::Json => FORMAT_JSON << FORMAT_SHIFT,
+            DocumentFormat::Binary => FORMAT_BINARY << FORMAT_SHIFT,
+            DocumentFormat::String => FORMAT_STRING << FORMAT_SHIFT,
+            DocumentFormat::Unknown => 0,
+        }
+    }
+
+    /// Reads the format from the flags of a document. Documents stored without any
+    /// flags, as legacy clients do, are taken as JSON.
+    pub fn from_flags(flags: u32) -> Self {
+        if flags == 0 {
+            return DocumentFormat::Json;
+        }
+        match flags >> FORMAT_SHIFT {
+            FORMAT_JSON => DocumentFormat::Json,
+            FORMAT_BINARY => DocumentFormat::Binary,
+            FORMAT_STRING => DocumentFormat::String,
+            _ => DocumentFormat::Unknown,
+        }
+    }
+}
+
+/// Content which is stored as it is, without going through serde, see
+/// `Collection::upsert_raw`.
+///
+/// The buffer is moved into the request, large ones are passed on to libcouchbase
+/// without being copied.
+#[derive(Debug, Clone)]
+pub struct RawContent {
+    pub(crate) bytes: Vec<u8>,
+    pub(crate) flags: u32,
+    pub(crate) json: bool,
+}
+
+impl RawContent {
+    /// Binary content, such as a blob or a compressed payload.
+    pub fn binary(bytes: impl Into<Vec<u8>>) -> Self {
+        Self {
+            bytes: bytes.into(),
+            flags: DocumentFormat::Binary.flags(),
+            json: false,
+        }
+    }
+
+    /// Content which already is serialized JSON, passed through without validating it.
+    pub fn json(bytes: impl Into<Vec<u8>>) -> Self {
+        Self {
+            bytes: bytes.into(),
+            flags: DocumentFormat::Json.flags(),
+            json: true,
+        }
+    }
+
+    /// A string, stored as it is rather than as a JSON string literal.
+    pub fn string(content: impl Into<String>) -> Self {
+        Self {
+            bytes: content.into().into_bytes(),
+            flags: DocumentFormat::String.flags(),
+            json: false,
+        }
+    }
+
+    /// Content stored the way legacy clients do, without flags: the server
+    /// detects on its own whether it is JSON.
+    pub fn legacy(bytes: impl Into<Vec<u8>>) -> Self {
+        Self {
+            bytes: bytes.into(),
+            flags: 0,
+            json: false,
+        }
+    }
+
+    /// Content with the given flags, for formats of other clients.
+    pub fn with_flags(bytes: impl Into<Vec<u8>>, flags: u32) -> Self {
+        Self {
+            bytes: bytes.into(),
+            flags,
+            json: DocumentFormat::from_flags(flags) == DocumentFormat::Json && flags != 0,
+        }
+    }
+}
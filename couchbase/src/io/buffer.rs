@@ -0,0 +1,55 @@
+use std::fmt;
+use std::ops::Deref;
+
+#[cfg(feature = "libcouchbase")]
+use crate::io::lcb::RetainedBuffer;
+
+/// The raw value of a document as handed over from the IO layer.
+///
+/// Small values are copied into an owned `Vec<u8>`, large ones can (if enabled through
+/// `ClusterOptions::zero_copy_threshold`) keep pointing into the network buffer they
+/// were read into, which is released once the buffer is dropped.
+pub(crate) enum ValueBuffer {
+    Owned(Vec<u8>),
+    #[cfg(feature = "libcouchbase")]
+    Retained(RetainedBuffer),
+}
+
+impl ValueBuffer {
+    /// Turns the buffer into an owned vector, copying only if it is not owned already.
+    pub fn into_vec(self) -> Vec<u8> {
+        match self {
+            Self::Owned(v) => v,
+            #[cfg(feature = "libcouchbase")]
+            Self::Retained(r) => r.to_vec(),
+        }
+    }
+}
+
+impl Deref for ValueBuffer {
+    type Target = [u8];
+
+    fn deref(&self) -> &[u8] {
+        match self {
+            Self::Owned(v) => v.as_slice(),
+            #[cfg(feature = "libcouchbase")]
+            Self::Retained(r) => r,
+        }
+    }
+}
+
+impl From<Vec<u8>> for ValueBuffer {
+    fn from(v: Vec<u8>) -> Self {
+        Self::Owned(v)
+    }
+}
+
+impl fmt::Debug for ValueBuffer {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        match self {
+            Self::Owned(v) => write!(f, "Owned({} bytes)", v.len()),
+            #[cfg(feature = "libcouchbase")]
+            Self::Retained(r) => write!(f, "Retained({} bytes)", r.len()),
+        }
+    }
+}
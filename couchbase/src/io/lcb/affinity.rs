@@ -0,0 +1,60 @@
+use crate::api::cluster::IoAffinity;
+use log::warn;
+use std::fs;
+use std::os::raw::c_int;
+
+/// Returns the CPUs the IO thread with the given index is to run on, empty if it may run
+/// anywhere.
+pub fn cpus_for_thread(affinity: &IoAffinity, index: usize) -> Vec<usize> {
+    match affinity {
+        IoAffinity::Cpus(cpus) if !cpus.is_empty() => vec![cpus[index % cpus.len()]],
+        IoAffinity::NumaNodes(nodes) if !nodes.is_empty() => {
+            numa_node_cpus(nodes[index % nodes.len()])
+        }
+        _ => vec![],
+    }
+}
+
+/// Reads the CPUs of a NUMA node from sysfs.
+fn numa_node_cpus(node: usize) -> Vec<usize> {
+    let path = format!("/sys/devices/system/node/node{}/cpulist", node);
+    match fs::read_to_string(&path) {
+        Ok(list) => parse_cpu_list(&list),
+        Err(e) => {
+            warn!("Could not read the CPUs of NUMA node {}: {}", node, e);
+            vec![]
+        }
+    }
+}
+
+/// Parses a kernel CPU list such as `0-3,8-11,16`.
+fn parse_cpu_list(list: &str) -> Vec<usize> {
+    let mut cpus = vec![];
+    for range in list.trim().split(',').filter(|r| !r.is_empty()) {
+        let mut bounds = range.splitn(2, '-').map(|b| b.parse::<usize>());
+        match (bounds.next(), bounds.next()) {
+            (Some(Ok(cpu)), None) => cpus.push(cpu),
+            (Some(Ok(first)), Some(Ok(last))) => cpus.extend(first..=last),
+            _ => warn!("Ignoring malformed CPU range {}", range),
+        }
+    }
+    cpus
+}
+
+/// Restricts the calling thread to `cpus`.
+///
+/// Memory the thread allocates afterwards, such as the network buffers of the instances it
+/// creates, is then placed on the NUMA node of those CPUs by the kernel's first touch
+/// policy.
+pub fn pin_current_thread(cpus: &[usize]) -> Result<(), c_int> {
+    match unsafe { pin_current_thread_c(cpus.as_ptr(), cpus.len()) } {
+        0 => Ok(()),
+        e => Err(e),
+    }
+}
+
+extern "C" {
+    /// Defined in `utils.c`, since the affinity API is a set of C macros.
+    #[link_name = "pin_current_thread"]
+    fn pin_current_thread_c(cpus: *const usize, ncpus: usize) -> c_int;
+}
@@ -0,0 +1,70 @@
+//! Entry points into the libcouchbase backend for the benchmarks in `benches/`.
+//!
+//! Only compiled with the `bench-internals` feature and not part of the API. Each of
+//! them runs one step of the path of a key-value operation on the calling thread, as
+//! the lcb thread would, without a connected instance: the steps which need one (the
+//! scheduling and the network) are measured by the C benchmarks of libcouchbase.
+
+use crate::api::collection::serialize_content;
+use crate::api::error::CouchbaseResult;
+use crate::io::lcb::completions::{complete, flush};
+use crate::io::lcb::cookies::CookieId;
+use crate::io::lcb::encode::get_command;
+use crate::io::request::{GetRequest, GetRequestType};
+use crate::io::ValueBuffer;
+use crate::{GetOptions, GetResult};
+use couchbase_sys::lcb_cmdget_destroy;
+use futures::channel::oneshot;
+use futures::executor::block_on;
+use serde::Serialize;
+
+/// Builds the `lcb_CMDGET` of a get along with its cookie, as `encode_get` does before
+/// scheduling it, and releases both.
+pub fn encode_get(id: &str, scope: &str, collection: &str, options: GetOptions) {
+    let (sender, _receiver) = oneshot::channel();
+    let request = GetRequest {
+        id: id.into(),
+        bucket: "default".into(),
+        scope: scope.into(),
+        collection: collection.into(),
+        sender,
+        ty: GetRequestType::Get { options },
+    };
+    let (command, cookie) = get_command(request).expect("get command");
+    unsafe {
+        lcb_cmdget_destroy(command);
+    }
+    cookie.release();
+}
+
+/// Stores the sender of a get in the cookie slab and takes it out again, as the
+/// response callback does.
+pub fn cookie_round_trip() {
+    let (sender, _receiver) = oneshot::channel::<CouchbaseResult<GetResult>>();
+    let cookie = CookieId::new(sender);
+    cookie
+        .take::<oneshot::Sender<CouchbaseResult<GetResult>>>()
+        .expect("cookie");
+}
+
+/// Builds the result of a get from the value read from the network, as `get_callback`
+/// does for values which are copied out of the network buffer.
+pub fn decode_get(value: &[u8], cas: u64, flags: u32) -> GetResult {
+    GetResult::from_buffer(ValueBuffer::Owned(value.to_vec()), cas, flags)
+}
+
+/// Serializes the content of a mutation, as `Collection::upsert` does.
+pub fn encode_content<T: Serialize>(content: &T) -> Vec<u8> {
+    serialize_content(content).expect("serializable content")
+}
+
+/// Hands a result from the lcb thread to the future awaiting it: queues it, sends it
+/// once the event loop would have returned, and receives it.
+pub fn complete_get(result: GetResult) -> GetResult {
+    let (sender, receiver) = oneshot::channel();
+    complete(sender, Ok(result), "get");
+    flush();
+    block_on(receiver)
+        .expect("sent result")
+        .expect("successful result")
+}
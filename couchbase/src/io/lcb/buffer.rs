@@ -0,0 +1,123 @@
+use crate::io::lcb::{IoRequest, LoopWaker};
+
+use couchbase_sys::*;
+use crossbeam_channel::Sender;
+use std::mem::ManuallyDrop;
+use std::ops::Deref;
+use std::slice::from_raw_parts;
+use std::sync::{Arc, Mutex};
+
+/// Serializes releasing buffers once their lcb thread is gone, since the segment and
+/// allocator refcounts are not atomic.
+static ORPHAN_RELEASE_LOCK: Mutex<()> = Mutex::new(());
+
+/// A pinned libcouchbase network buffer (`lcb_BACKBUF`).
+///
+/// A buffer which is dropped rather than released on its lcb thread is released as
+/// orphaned, since it can only be dropped elsewhere once that thread is gone.
+#[derive(Debug)]
+pub struct BackBuf(lcb_BACKBUF);
+
+// The segment is only ever touched by the lcb thread that pinned it, or under the
+// `ORPHAN_RELEASE_LOCK` once that thread terminated.
+unsafe impl Send for BackBuf {}
+
+impl BackBuf {
+    /// Releases the pin, must be called on the lcb thread owning the buffer.
+    pub unsafe fn release(self) {
+        let buf = ManuallyDrop::new(self);
+        lcb_backbuf_unref(buf.0);
+    }
+
+    /// Releases a buffer whose lcb thread already shut down.
+    fn release_orphaned(&mut self) {
+        let _guard = ORPHAN_RELEASE_LOCK.lock().unwrap();
+        unsafe { lcb_backbuf_unref(self.0) }
+    }
+}
+
+impl Drop for BackBuf {
+    fn drop(&mut self) {
+        self.release_orphaned();
+    }
+}
+
+/// Hands pinned buffers back to the lcb thread they belong to.
+#[derive(Clone)]
+pub struct BufferReleaser {
+    queue_tx: Sender<IoRequest>,
+    waker: Arc<LoopWaker>,
+    min_size: usize,
+}
+
+impl BufferReleaser {
+    pub fn new(queue_tx: Sender<IoRequest>, waker: Arc<LoopWaker>, min_size: usize) -> Self {
+        Self {
+            queue_tx,
+            waker,
+            min_size,
+        }
+    }
+
+    /// Values smaller than this are cheaper to copy than to pin.
+    pub fn min_size(&self) -> usize {
+        self.min_size
+    }
+
+    fn release(&self, buf: BackBuf) {
+        // If the lcb thread is gone, the buffer is released as orphaned when the
+        // rejected request is dropped.
+        if self.queue_tx.send(IoRequest::ReleaseBuffer(buf)).is_ok() {
+            self.waker.wake();
+        }
+    }
+}
+
+/// A document value which still lives in the libcouchbase network buffer it has been
+/// read into.
+///
+/// The buffer is pinned until this is dropped, at which point it is handed back to its
+/// lcb thread for release.
+pub struct RetainedBuffer {
+    ptr: *const u8,
+    len: usize,
+    backbuf: Option<BackBuf>,
+    releaser: BufferReleaser,
+}
+
+// The memory is immutable while pinned and only released through the owning lcb thread.
+unsafe impl Send for RetainedBuffer {}
+unsafe impl Sync for RetainedBuffer {}
+
+impl RetainedBuffer {
+    /// Wraps an already pinned `backbuf` which contains `len` bytes at `ptr`.
+    pub unsafe fn new(
+        ptr: *const u8,
+        len: usize,
+        backbuf: lcb_BACKBUF,
+        releaser: BufferReleaser,
+    ) -> Self {
+        Self {
+            ptr,
+            len,
+            backbuf: Some(BackBuf(backbuf)),
+            releaser,
+        }
+    }
+}
+
+impl Deref for RetainedBuffer {
+    type Target = [u8];
+
+    fn deref(&self) -> &[u8] {
+        unsafe { from_raw_parts(self.ptr, self.len) }
+    }
+}
+
+impl Drop for RetainedBuffer {
+    fn drop(&mut self) {
+        if let Some(buf) = self.backbuf.take() {
+            self.releaser.release(buf);
+        }
+    }
+}
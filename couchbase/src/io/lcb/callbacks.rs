@@ -6,7 +6,8 @@ use crate::{
     SearchResult, SubDocField,
 };
 use couchbase_sys::*;
-use log::{debug, trace};
+use futures::channel::oneshot::Sender;
+use log::{debug, trace, warn};
 use serde_json::Value;
 use std::ffi::CStr;
 use std::os::raw::{c_char, c_int, c_uint, c_void};
@@ -16,20 +17,44 @@ use std::str;
 use std::time::Duration;
 
 use crate::io::lcb::{
-    bucket_name_for_instance, wrapped_vsnprintf, AnalyticsCookie, QueryCookie, SearchCookie,
+    bucket_name_for_instance, wrapped_vsnprintf, AnalyticsCookie, MutateCookie, QueryCookie,
+    SearchCookie,
 };
 
-use crate::io::lcb::instance::decrement_outstanding_requests;
+use crate::io::lcb::completions::complete;
+use crate::io::lcb::cookies::{CookieId, CookieKind, GetMultiSlot, KvCookie};
+use crate::io::lcb::instance::{
+    buffer_releaser, decrement_outstanding_requests, instance_opened, instance_preconnected,
+};
+use crate::io::lcb::rows::RowHandle;
+use crate::io::lcb::RetainedBuffer;
+use crate::io::ValueBuffer;
 use crate::{CounterResult, EndpointPingReport, MutationToken, ServiceType, ViewResult, ViewRow};
+use std::cell::RefCell;
 use std::collections::HashMap;
 use std::convert::TryInto;
 
+thread_local! {
+    /// Buffer libcouchbase inflated the value of the current get response into,
+    /// handed over to the result by `value_buffer`.
+    static INFLATED: RefCell<Option<Vec<u8>>> = RefCell::new(None);
+}
+
 fn decode_and_own_str(ptr: *const c_char, len: usize) -> String {
     str::from_utf8(unsafe { from_raw_parts(ptr as *const u8, len) })
         .unwrap()
         .into()
 }
 
+/// Takes the cookie of a key-value response out of its slot.
+fn take_cookie<T: CookieKind>(cookie_ptr: *mut c_void) -> Option<T> {
+    let cookie = CookieId::from_ptr(cookie_ptr).take();
+    if cookie.is_none() {
+        warn!("Received a response whose cookie is gone. This is a bug!");
+    }
+    cookie
+}
+
 pub unsafe extern "C" fn store_callback(
     instance: *mut lcb_INSTANCE,
     _cbtype: i32,
@@ -40,9 +65,16 @@ pub unsafe extern "C" fn store_callback(
 
     let mut cookie_ptr: *mut c_void = ptr::null_mut();
     lcb_respstore_cookie(store_res, &mut cookie_ptr);
-    let sender = Box::from_raw(
-        cookie_ptr as *mut futures::channel::oneshot::Sender<CouchbaseResult<MutationResult>>,
-    );
+    // A value still referenced by the packet keeps the cookie until it has been flushed.
+    let sender = match CookieId::from_ptr(cookie_ptr)
+        .update(|cookie: &mut MutateCookie| (cookie.sender.take(), cookie.value.is_none()))
+    {
+        Some(Some(sender)) => sender,
+        _ => {
+            warn!("Received a store response whose cookie is gone. This is a bug!");
+            return;
+        }
+    };
 
     let mut lcb_ctx: *const lcb_KEY_VALUE_ERROR_CONTEXT = ptr::null();
     lcb_respstore_error_context(store_res, &mut lcb_ctx);
@@ -80,10 +112,15 @@ pub unsafe extern "C" fn store_callback(
             build_kv_error_context(lcb_ctx),
         ))
     };
-    match sender.send(result) {
-        Ok(_) => {}
-        Err(e) => trace!("Failed to send store result because of {:?}", e),
-    }
+    complete(sender, result, "store");
+}
+
+/// Called once libcouchbase does not reference a value stored without copying anymore.
+pub unsafe extern "C" fn pktflushed_callback(_instance: *mut lcb_INSTANCE, cookie: *const c_void) {
+    // If the response is still outstanding, it releases the cookie.
+    let value = CookieId::from_ptr(cookie)
+        .update(|cookie: &mut MutateCookie| (cookie.value.take(), cookie.sender.is_none()));
+    drop(value);
 }
 
 pub unsafe extern "C" fn remove_callback(
@@ -96,9 +133,10 @@ pub unsafe extern "C" fn remove_callback(
 
     let mut cookie_ptr: *mut c_void = ptr::null_mut();
     lcb_respremove_cookie(remove_res, &mut cookie_ptr);
-    let sender = Box::from_raw(
-        cookie_ptr as *mut futures::channel::oneshot::Sender<CouchbaseResult<MutationResult>>,
-    );
+    let sender: Sender<CouchbaseResult<MutationResult>> = match take_cookie(cookie_ptr) {
+        Some(sender) => sender,
+        None => return,
+    };
 
     let mut lcb_ctx: *const lcb_KEY_VALUE_ERROR_CONTEXT = ptr::null();
     lcb_respremove_error_context(remove_res, &mut lcb_ctx);
@@ -136,10 +174,7 @@ pub unsafe extern "C" fn remove_callback(
             build_kv_error_context(lcb_ctx),
         ))
     };
-    match sender.send(result) {
-        Ok(_) => {}
-        Err(e) => trace!("Failed to send remove result because of {:?}", e),
-    }
+    complete(sender, result, "remove");
 }
 
 pub unsafe extern "C" fn touch_callback(
@@ -152,9 +187,10 @@ pub unsafe extern "C" fn touch_callback(
 
     let mut cookie_ptr: *mut c_void = ptr::null_mut();
     lcb_resptouch_cookie(touch_res, &mut cookie_ptr);
-    let sender = Box::from_raw(
-        cookie_ptr as *mut futures::channel::oneshot::Sender<CouchbaseResult<MutationResult>>,
-    );
+    let sender: Sender<CouchbaseResult<MutationResult>> = match take_cookie(cookie_ptr) {
+        Some(sender) => sender,
+        None => return,
+    };
 
     let mut lcb_ctx: *const lcb_KEY_VALUE_ERROR_CONTEXT = ptr::null();
     lcb_resptouch_error_context(touch_res, &mut lcb_ctx);
@@ -192,10 +228,7 @@ pub unsafe extern "C" fn touch_callback(
             build_kv_error_context(lcb_ctx),
         ))
     };
-    match sender.send(result) {
-        Ok(_) => {}
-        Err(e) => trace!("Failed to send touch result because of {:?}", e),
-    }
+    complete(sender, result, "touch");
 }
 
 pub unsafe extern "C" fn unlock_callback(
@@ -208,8 +241,10 @@ pub unsafe extern "C" fn unlock_callback(
 
     let mut cookie_ptr: *mut c_void = ptr::null_mut();
     lcb_respunlock_cookie(unlock_res, &mut cookie_ptr);
-    let sender =
-        Box::from_raw(cookie_ptr as *mut futures::channel::oneshot::Sender<CouchbaseResult<()>>);
+    let sender: Sender<CouchbaseResult<()>> = match take_cookie(cookie_ptr) {
+        Some(sender) => sender,
+        None => return,
+    };
 
     let mut lcb_ctx: *const lcb_KEY_VALUE_ERROR_CONTEXT = ptr::null();
     lcb_respunlock_error_context(unlock_res, &mut lcb_ctx);
@@ -223,10 +258,53 @@ pub unsafe extern "C" fn unlock_callback(
             build_kv_error_context(lcb_ctx),
         ))
     };
-    match sender.send(result) {
-        Ok(_) => {}
-        Err(e) => trace!("Failed to send unlock result because of {:?}", e),
+    complete(sender, result, "unlock");
+}
+
+/// Provides the buffer for a compressed value, so it is inflated straight into the
+/// `Vec` of the result instead of being inflated and then copied.
+pub unsafe extern "C" fn inflate_callback(
+    _instance: *mut lcb_INSTANCE,
+    _cookie: *mut c_void,
+    nbytes: usize,
+) -> *mut c_void {
+    let mut buf = vec![0u8; nbytes];
+    let ptr = buf.as_mut_ptr();
+    INFLATED.with(|inflated| *inflated.borrow_mut() = Some(buf));
+    ptr as *mut c_void
+}
+
+/// Builds the buffer for a document value. Inflated values are taken over as they are,
+/// others are held either by pinning the network buffer (if zero-copy values are
+/// enabled and the value is large enough) or by copying them.
+unsafe fn value_buffer<F>(
+    instance: *mut lcb_INSTANCE,
+    value_ptr: *const c_char,
+    value_len: usize,
+    pin: F,
+) -> ValueBuffer
+where
+    F: FnOnce(*mut lcb_BACKBUF) -> lcb_STATUS,
+{
+    if let Some(buf) = INFLATED.with(|inflated| inflated.borrow_mut().take()) {
+        if buf.as_ptr() == value_ptr as *const u8 && buf.len() == value_len {
+            return ValueBuffer::Owned(buf);
+        }
     }
+    if let Some(releaser) = buffer_releaser(instance) {
+        if value_len >= releaser.min_size() {
+            let mut backbuf: lcb_BACKBUF = ptr::null_mut();
+            if pin(&mut backbuf) == lcb_STATUS_LCB_SUCCESS {
+                return ValueBuffer::Retained(RetainedBuffer::new(
+                    value_ptr as *const u8,
+                    value_len,
+                    backbuf,
+                    releaser,
+                ));
+            }
+        }
+    }
+    ValueBuffer::Owned(from_raw_parts(value_ptr as *const u8, value_len).to_vec())
 }
 
 pub unsafe extern "C" fn get_callback(
@@ -238,9 +316,15 @@ pub unsafe extern "C" fn get_callback(
     let get_res = res as *const lcb_RESPGET;
     let mut cookie_ptr: *mut c_void = ptr::null_mut();
     lcb_respget_cookie(get_res, &mut cookie_ptr);
-    let sender = Box::from_raw(
-        cookie_ptr as *mut futures::channel::oneshot::Sender<CouchbaseResult<GetResult>>,
-    );
+    // Gets of a get_multi share the callback, their result goes to the slot of their id.
+    let id = CookieId::from_ptr(cookie_ptr);
+    let cookie = match id.take::<Sender<CouchbaseResult<GetResult>>>() {
+        Some(sender) => KvCookie::Get(sender),
+        None => match take_cookie::<GetMultiSlot>(cookie_ptr) {
+            Some(slot) => KvCookie::GetMulti(slot),
+            None => return,
+        },
+    };
 
     let status = lcb_respget_status(get_res);
     let result = if status == lcb_STATUS_LCB_SUCCESS {
@@ -251,8 +335,10 @@ pub unsafe extern "C" fn get_callback(
         lcb_respget_cas(get_res, &mut cas);
         lcb_respget_flags(get_res, &mut flags);
         lcb_respget_value(get_res, &mut value_ptr, &mut value_len);
-        let value = from_raw_parts(value_ptr as *const u8, value_len);
-        Ok(GetResult::new(value.to_vec(), cas, flags))
+        let value = value_buffer(instance, value_ptr, value_len, |buf| {
+            lcb_respget_backbuf(get_res, buf)
+        });
+        Ok(GetResult::from_buffer(value, cas, flags))
     } else {
         let mut lcb_ctx: *const lcb_KEY_VALUE_ERROR_CONTEXT = ptr::null();
         lcb_respget_error_context(get_res, &mut lcb_ctx);
@@ -262,9 +348,10 @@ pub unsafe extern "C" fn get_callback(
         ))
     };
 
-    match sender.send(result) {
-        Ok(_) => {}
-        Err(e) => trace!("Failed to send get result because of {:?}", e),
+    match cookie {
+        KvCookie::GetMulti(slot) => slot.fill(result),
+        KvCookie::Get(sender) => complete(sender, result, "get"),
+        _ => unreachable!(),
     }
 }
 
@@ -276,10 +363,6 @@ pub unsafe extern "C" fn get_replica_callback(
     let getreplica_res = res as *const lcb_RESPGETREPLICA;
     let mut cookie_ptr: *mut c_void = ptr::null_mut();
     lcb_respgetreplica_cookie(getreplica_res, &mut cookie_ptr);
-    let sender = Box::from_raw(
-        cookie_ptr as *mut futures::channel::oneshot::Sender<CouchbaseResult<GetReplicaResult>>,
-    );
-
     let status = lcb_respgetreplica_status(getreplica_res);
     let result = if status == lcb_STATUS_LCB_SUCCESS {
         let mut cas: u64 = 0;
@@ -290,13 +373,10 @@ pub unsafe extern "C" fn get_replica_callback(
         lcb_respgetreplica_flags(getreplica_res, &mut flags);
         lcb_respgetreplica_value(getreplica_res, &mut value_ptr, &mut value_len);
         let is_active = lcb_respgetreplica_is_active(getreplica_res) != 0;
-        let value = from_raw_parts(value_ptr as *const u8, value_len);
-        Ok(GetReplicaResult::new(
-            value.to_vec(),
-            cas,
-            flags,
-            !is_active,
-        ))
+        let value = value_buffer(instance, value_ptr, value_len, |buf| {
+            lcb_respgetreplica_backbuf(getreplica_res, buf)
+        });
+        Ok(GetReplicaResult::from_buffer(value, cas, flags, !is_active))
     } else {
         let mut lcb_ctx: *const lcb_KEY_VALUE_ERROR_CONTEXT = ptr::null();
         lcb_respgetreplica_error_context(getreplica_res, &mut lcb_ctx);
@@ -306,11 +386,14 @@ pub unsafe extern "C" fn get_replica_callback(
         ))
     };
     if result.is_ok() || (result.is_err() && lcb_respgetreplica_is_final(getreplica_res) != 0) {
-        match sender.send(result) {
-            Ok(_) => {}
-            Err(e) => trace!("Failed to send getreplica result because of {:?}", e),
+        // With ReplicaMode::All the first success completes the request, the slot of the
+        // cookie is released by then and the responses of the other replicas find nothing.
+        let sender: Option<Sender<CouchbaseResult<GetReplicaResult>>> =
+            CookieId::from_ptr(cookie_ptr).take();
+        if let Some(sender) = sender {
+            complete(sender, result, "getreplica");
+            decrement_outstanding_requests(instance);
         }
-        decrement_outstanding_requests(instance);
     }
 }
 
@@ -323,9 +406,10 @@ pub unsafe extern "C" fn exists_callback(
     let exists_res = res as *const lcb_RESPEXISTS;
     let mut cookie_ptr: *mut c_void = ptr::null_mut();
     lcb_respexists_cookie(exists_res, &mut cookie_ptr);
-    let sender = Box::from_raw(
-        cookie_ptr as *mut futures::channel::oneshot::Sender<CouchbaseResult<ExistsResult>>,
-    );
+    let sender: Sender<CouchbaseResult<ExistsResult>> = match take_cookie(cookie_ptr) {
+        Some(sender) => sender,
+        None => return,
+    };
 
     let status = lcb_respexists_status(exists_res);
     let result = if status == lcb_STATUS_LCB_SUCCESS {
@@ -345,10 +429,69 @@ pub unsafe extern "C" fn exists_callback(
             build_kv_error_context(lcb_ctx),
         ))
     };
-    match sender.send(result) {
-        Ok(_) => {}
-        Err(e) => trace!("Failed to send exists result because of {:?}", e),
+    complete(sender, result, "exists");
+}
+
+/// Results decoded into an array on the stack, as many as the server allows specs.
+const INLINE_SUBDOC_RESULTS: usize = 16;
+
+/// Collects the results of a subdocument response. All values live in the same packet,
+/// so instead of copying each of them they are held as one buffer spanning from the first
+/// to the last value, and the fields only record their range within it.
+///
+/// The results of all specs are decoded by libcouchbase in a single pass.
+unsafe fn subdoc_fields(
+    instance: *mut lcb_INSTANCE,
+    subdoc_res: *const lcb_RESPSUBDOC,
+) -> (Vec<SubDocField>, ValueBuffer) {
+    let total_size = lcb_respsubdoc_result_size(subdoc_res);
+    let mut inline: [lcb_SUBDOC_RESULT; INLINE_SUBDOC_RESULTS] = std::mem::zeroed();
+    let mut spilled;
+    let results: &mut [lcb_SUBDOC_RESULT] = if total_size <= INLINE_SUBDOC_RESULTS {
+        &mut inline[..total_size]
+    } else {
+        spilled = vec![std::mem::zeroed(); total_size];
+        &mut spilled
+    };
+    let mut body: *const c_char = ptr::null();
+    let decoded =
+        lcb_respsubdoc_results(subdoc_res, results.as_mut_ptr(), results.len(), &mut body);
+    let results = &results[..decoded];
+
+    let mut start: usize = usize::MAX;
+    let mut end: usize = 0;
+    for result in results.iter().filter(|result| result.length > 0) {
+        start = start.min(result.offset as usize);
+        end = end.max(result.offset as usize + result.length as usize);
     }
+
+    if end == 0 {
+        let fields = results
+            .iter()
+            .map(|result| SubDocField {
+                status: result.status.try_into().unwrap(),
+                value: 0..0,
+            })
+            .collect();
+        return (fields, ValueBuffer::Owned(Vec::new()));
+    }
+
+    let body = value_buffer(instance, body.add(start), end - start, |buf| {
+        lcb_respsubdoc_backbuf(subdoc_res, buf)
+    });
+    let fields = results
+        .iter()
+        .map(|result| SubDocField {
+            status: result.status.try_into().unwrap(),
+            value: if result.length > 0 {
+                let offset = result.offset as usize - start;
+                offset..offset + result.length as usize
+            } else {
+                0..0
+            },
+        })
+        .collect();
+    (fields, body)
 }
 
 pub unsafe extern "C" fn lookup_in_callback(
@@ -360,28 +503,17 @@ pub unsafe extern "C" fn lookup_in_callback(
     let subdoc_res = res as *const lcb_RESPSUBDOC;
     let mut cookie_ptr: *mut c_void = ptr::null_mut();
     lcb_respsubdoc_cookie(subdoc_res, &mut cookie_ptr);
-    let sender = Box::from_raw(
-        cookie_ptr as *mut futures::channel::oneshot::Sender<CouchbaseResult<LookupInResult>>,
-    );
+    let sender: Sender<CouchbaseResult<LookupInResult>> = match take_cookie(cookie_ptr) {
+        Some(sender) => sender,
+        None => return,
+    };
 
     let status = lcb_respsubdoc_status(subdoc_res);
     let result = if status == lcb_STATUS_LCB_SUCCESS {
-        let total_size = lcb_respsubdoc_result_size(subdoc_res);
-        let mut fields = vec![];
-        for i in 0..total_size {
-            let status = lcb_respsubdoc_result_status(subdoc_res, i);
-            let mut value_len: usize = 0;
-            let mut value_ptr: *const c_char = ptr::null();
-            lcb_respsubdoc_result_value(subdoc_res, i, &mut value_ptr, &mut value_len);
-            let value = from_raw_parts(value_ptr as *const u8, value_len);
-            fields.push(SubDocField {
-                status: status.try_into().unwrap(),
-                value: value.into(),
-            });
-        }
+        let (fields, body) = subdoc_fields(instance, subdoc_res);
         let mut cas: u64 = 0;
         lcb_respsubdoc_cas(subdoc_res, &mut cas);
-        Ok(LookupInResult::new(fields, cas))
+        Ok(LookupInResult::new(fields, body, cas))
     } else {
         let mut lcb_ctx: *const lcb_KEY_VALUE_ERROR_CONTEXT = ptr::null();
         lcb_respsubdoc_error_context(subdoc_res, &mut lcb_ctx);
@@ -390,10 +522,7 @@ pub unsafe extern "C" fn lookup_in_callback(
             build_kv_error_context(lcb_ctx),
         ))
     };
-    match sender.send(result) {
-        Ok(_) => {}
-        Err(e) => trace!("Failed to send lookup in result because of {:?}", e),
-    }
+    complete(sender, result, "lookup in");
 }
 
 pub unsafe extern "C" fn mutate_in_callback(
@@ -405,28 +534,17 @@ pub unsafe extern "C" fn mutate_in_callback(
     let subdoc_res = res as *const lcb_RESPSUBDOC;
     let mut cookie_ptr: *mut c_void = ptr::null_mut();
     lcb_respsubdoc_cookie(subdoc_res, &mut cookie_ptr);
-    let sender = Box::from_raw(
-        cookie_ptr as *mut futures::channel::oneshot::Sender<CouchbaseResult<MutateInResult>>,
-    );
+    let sender: Sender<CouchbaseResult<MutateInResult>> = match take_cookie(cookie_ptr) {
+        Some(sender) => sender,
+        None => return,
+    };
 
     let status = lcb_respsubdoc_status(subdoc_res);
     let result = if status == lcb_STATUS_LCB_SUCCESS {
-        let total_size = lcb_respsubdoc_result_size(subdoc_res);
-        let mut fields = vec![];
-        for i in 0..total_size {
-            let status = lcb_respsubdoc_result_status(subdoc_res, i);
-            let mut value_len: usize = 0;
-            let mut value_ptr: *const c_char = ptr::null();
-            lcb_respsubdoc_result_value(subdoc_res, i, &mut value_ptr, &mut value_len);
-            let value = from_raw_parts(value_ptr as *const u8, value_len);
-            fields.push(SubDocField {
-                status: status.try_into().unwrap(),
-                value: value.into(),
-            });
-        }
+        let (fields, body) = subdoc_fields(instance, subdoc_res);
         let mut cas: u64 = 0;
         lcb_respsubdoc_cas(subdoc_res, &mut cas);
-        Ok(MutateInResult::new(fields, cas))
+        Ok(MutateInResult::new(fields, body, cas))
     } else {
         let mut lcb_ctx: *const lcb_KEY_VALUE_ERROR_CONTEXT = ptr::null();
         lcb_respsubdoc_error_context(subdoc_res, &mut lcb_ctx);
@@ -435,10 +553,7 @@ pub unsafe extern "C" fn mutate_in_callback(
             build_kv_error_context(lcb_ctx),
         ))
     };
-    match sender.send(result) {
-        Ok(_) => {}
-        Err(e) => trace!("Failed to send mutate in result because of {:?}", e),
-    }
+    complete(sender, result, "mutate in");
 }
 
 pub unsafe extern "C" fn counter_callback(
@@ -451,9 +566,10 @@ pub unsafe extern "C" fn counter_callback(
 
     let mut cookie_ptr: *mut c_void = ptr::null_mut();
     lcb_respcounter_cookie(counter_res, &mut cookie_ptr);
-    let sender = Box::from_raw(
-        cookie_ptr as *mut futures::channel::oneshot::Sender<CouchbaseResult<CounterResult>>,
-    );
+    let sender: Sender<CouchbaseResult<CounterResult>> = match take_cookie(cookie_ptr) {
+        Some(sender) => sender,
+        None => return,
+    };
 
     let mut lcb_ctx: *const lcb_KEY_VALUE_ERROR_CONTEXT = ptr::null();
     lcb_respcounter_error_context(counter_res, &mut lcb_ctx);
@@ -494,10 +610,7 @@ pub unsafe extern "C" fn counter_callback(
             build_kv_error_context(lcb_ctx),
         ))
     };
-    match sender.send(result) {
-        Ok(_) => {}
-        Err(e) => trace!("Failed to send remove result because of {:?}", e),
-    }
+    complete(sender, result, "counter");
 }
 
 fn build_kv_error_context(lcb_ctx: *const lcb_KEY_VALUE_ERROR_CONTEXT) -> ErrorContext {
@@ -683,10 +796,13 @@ pub unsafe extern "C" fn query_callback(
         cookie.rows_sender.close_channel();
 
         if status == 0 {
-            match cookie
-                .meta_sender
-                .send(serde_json::from_slice(row).unwrap())
-            {
+            // Decoded by the application if it asks for it, not here on the IO thread.
+            let raw = if cookie.skip_meta {
+                None
+            } else {
+                Some(row.to_vec())
+            };
+            match cookie.meta_sender.send(raw) {
                 Ok(_) => {}
                 Err(e) => trace!("Failed to send query meta data because of {:?}", e),
             }
@@ -694,7 +810,12 @@ pub unsafe extern "C" fn query_callback(
 
         decrement_outstanding_requests(instance);
     } else {
-        match cookie.rows_sender.unbounded_send(row.to_vec()) {
+        let handle = || {
+            let mut handle = ptr::null_mut();
+            lcb_respquery_handle(res, &mut handle);
+            RowHandle::Query(handle)
+        };
+        match cookie.rows_sender.send(instance, row.to_vec(), handle) {
             Ok(_) => {}
             Err(e) => trace!("Failed to send query row because of {:?}", e),
         }
@@ -759,7 +880,12 @@ pub unsafe extern "C" fn analytics_callback(
 
         decrement_outstanding_requests(instance);
     } else {
-        match cookie.rows_sender.unbounded_send(row.to_vec()) {
+        let handle = || {
+            let mut handle = ptr::null_mut();
+            lcb_respanalytics_handle(res, &mut handle);
+            RowHandle::Analytics(handle)
+        };
+        match cookie.rows_sender.send(instance, row.to_vec(), handle) {
             Ok(_) => {}
             Err(e) => trace!("Failed to send analytics row because of {:?}", e),
         }
@@ -814,9 +940,9 @@ pub unsafe extern "C" fn search_callback(
         cookie.rows_sender.close_channel();
 
         if status == 0 {
-            let meta = serde_json::from_slice::<Value>(row).unwrap();
-            if let Some(f) = meta.as_object().unwrap().get("facets") {
-                match cookie.facet_sender.send(f.clone()) {
+            let mut meta = serde_json::from_slice::<Value>(row).unwrap();
+            if let Some(f) = meta.as_object_mut().unwrap().remove("facets") {
+                match cookie.facet_sender.send(f) {
                     Ok(_) => {}
                     Err(e) => trace!("Failed to send search meta data ecause of {:?}", e),
                 }
@@ -833,7 +959,12 @@ pub unsafe extern "C" fn search_callback(
 
         decrement_outstanding_requests(instance);
     } else {
-        match cookie.rows_sender.unbounded_send(row.to_vec()) {
+        let handle = || {
+            let mut handle = ptr::null_mut();
+            lcb_respsearch_handle(res, &mut handle);
+            RowHandle::Search(handle)
+        };
+        match cookie.rows_sender.send(instance, row.to_vec(), handle) {
             Ok(_) => {}
             Err(e) => trace!("Failed to send search row because of {:?}", e),
         }
@@ -943,6 +1074,8 @@ pub fn couchbase_error_from_lcb_status(status: lcb_STATUS, ctx: ErrorContext) ->
         lcb_STATUS_LCB_ERR_INTERNAL_SERVER_FAILURE => CouchbaseError::InternalServerFailure { ctx },
         lcb_STATUS_LCB_ERR_AUTHENTICATION_FAILURE => CouchbaseError::AuthenticationFailure { ctx },
         lcb_STATUS_LCB_ERR_TEMPORARY_FAILURE => CouchbaseError::TemporaryFailure { ctx },
+        lcb_STATUS_LCB_ERR_CLIENT_OVERLOADED => CouchbaseError::ClientOverloaded { ctx },
+        lcb_STATUS_LCB_ERR_CIRCUIT_BREAKER_OPEN => CouchbaseError::CircuitBreakerOpen { ctx },
         lcb_STATUS_LCB_ERR_PARSING_FAILURE => CouchbaseError::ParsingFailure { ctx },
         lcb_STATUS_LCB_ERR_BUCKET_NOT_FOUND => CouchbaseError::BucketNotFound { ctx },
         lcb_STATUS_LCB_ERR_COLLECTION_NOT_FOUND => CouchbaseError::CollectionNotFound { ctx },
@@ -1081,12 +1214,22 @@ pub unsafe extern "C" fn logger_callback(
     log::log!(level, "{}", decoded.to_str().unwrap());
 }
 
+pub unsafe extern "C" fn bootstrap_callback(instance: *mut lcb_INSTANCE, err: lcb_STATUS) {
+    debug!(
+        "Libcouchbase notified of completed bootstrap attempt for bucket {:?} (status: 0x{:x})",
+        bucket_name_for_instance(instance),
+        &err
+    );
+    instance_opened(instance, err);
+}
+
 pub unsafe extern "C" fn open_callback(instance: *mut lcb_INSTANCE, err: lcb_STATUS) {
     debug!(
         "Libcouchbase notified of completed bucket open attempt for bucket {:?} (status: 0x{:x})",
         bucket_name_for_instance(instance),
         &err
     );
+    instance_opened(instance, err);
 }
 
 pub unsafe extern "C" fn http_callback(
@@ -1131,9 +1274,15 @@ pub unsafe extern "C" fn ping_callback(
     let ping_res = res as *const lcb_RESPPING;
     let mut cookie_ptr: *mut c_void = ptr::null_mut();
     lcb_respping_cookie(ping_res, &mut cookie_ptr);
-    let sender = Box::from_raw(
-        cookie_ptr as *mut futures::channel::oneshot::Sender<CouchbaseResult<PingResult>>,
-    );
+    if cookie_ptr.is_null() {
+        // Sent to connect to the key-value nodes, see `start_preconnect`.
+        instance_preconnected(instance, lcb_respping_status(ping_res));
+        return;
+    }
+    let sender: Sender<CouchbaseResult<PingResult>> = match take_cookie(cookie_ptr) {
+        Some(sender) => sender,
+        None => return,
+    };
 
     let mut services: HashMap<ServiceType, Vec<EndpointPingReport>> = HashMap::new();
 
@@ -1229,8 +1378,5 @@ pub unsafe extern "C" fn ping_callback(
             ErrorContext::default(),
         ))
     };
-    match sender.send(result) {
-        Ok(_) => {}
-        Err(e) => trace!("Failed to send exists result because of {:?}", e),
-    }
+    complete(sender, result, "ping");
 }
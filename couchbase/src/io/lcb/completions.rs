@@ -0,0 +1,59 @@
+//! Completions of key-value operations, handed to the application once per event loop
+//! iteration.
+//!
+//! Completing a future wakes the task awaiting it, which is a cross-thread wakeup (and
+//! often a syscall) if that task's executor thread is idle. Rather than waking tasks one
+//! by one while the responses are parsed, the results are queued and sent in one go
+//! once the event loop returns, so a task awaiting several of them finds them all ready
+//! and executors which are already awake are not signalled again.
+
+use couchbase_sys::*;
+use futures::channel::oneshot::Sender;
+use log::trace;
+use std::cell::{Cell, RefCell};
+use std::fmt::Debug;
+use std::ptr;
+
+thread_local! {
+    static PENDING: RefCell<Vec<Box<dyn FnOnce()>>> = RefCell::new(Vec::new());
+    /// The event loop of this lcb thread, stopped once there is something to send.
+    static WAKEUP: Cell<*mut lcb_WAKEUP> = Cell::new(ptr::null_mut());
+}
+
+/// Sets the wakeup handle whose loop is stopped to send the queued results. Without one,
+/// the results are sent after every `lcb_tick_nowait`.
+pub fn set_wakeup(wakeup: *mut lcb_WAKEUP) {
+    WAKEUP.with(|w| w.set(wakeup));
+}
+
+/// Queues `result` to be sent through `sender` by the next `flush`.
+pub fn complete<T: Debug + 'static>(sender: Sender<T>, result: T, what: &'static str) {
+    let first = PENDING.with(|pending| {
+        let mut pending = pending.borrow_mut();
+        pending.push(Box::new(move || {
+            if let Err(e) = sender.send(result) {
+                trace!("Failed to send {} result because of {:?}", what, e);
+            }
+        }));
+        pending.len() == 1
+    });
+    if first {
+        let wakeup = WAKEUP.with(Cell::get);
+        if !wakeup.is_null() {
+            unsafe { lcb_wakeup_stop(wakeup) };
+        }
+    }
+}
+
+/// Sends all queued results, must be called whenever the event loop returned.
+pub fn flush() {
+    loop {
+        let batch = PENDING.with(|pending| pending.replace(Vec::new()));
+        if batch.is_empty() {
+            return;
+        }
+        for send in batch {
+            send();
+        }
+    }
+}
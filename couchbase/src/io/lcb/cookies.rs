@@ -0,0 +1,277 @@
+//! Cookies of the key-value operations handed to libcouchbase.
+//!
+//! Rather than boxing the sender of every operation, the cookies live in a slab owned
+//! by the lcb thread. The pointer passed to libcouchbase is not an address but the id of
+//! the slot, tagged with its generation, so a slot can be reused right after its
+//! response has been handled, and a stale id (e.g. of a request whose response already
+//! arrived) finds nothing instead of another request's cookie.
+
+use crate::api::error::{CouchbaseError, CouchbaseResult};
+use crate::io::lcb::completions::complete;
+use crate::io::lcb::MutateCookie;
+use crate::io::request::GetMultiGather;
+use crate::{
+    CounterResult, ExistsResult, GetReplicaResult, GetResult, LookupInResult, MutateInResult,
+    MutationResult, PingResult,
+};
+use futures::channel::oneshot::Sender;
+use log::debug;
+use std::cell::RefCell;
+use std::os::raw::c_void;
+use std::rc::Rc;
+use std::sync::Arc;
+
+/// The cookie of a key-value operation, stored inline in its slot.
+pub(super) enum KvCookie {
+    Get(Sender<CouchbaseResult<GetResult>>),
+    GetMulti(GetMultiSlot),
+    GetReplica(Sender<CouchbaseResult<GetReplicaResult>>),
+    Exists(Sender<CouchbaseResult<ExistsResult>>),
+    Mutation(Sender<CouchbaseResult<MutationResult>>),
+    Unlock(Sender<CouchbaseResult<()>>),
+    Counter(Sender<CouchbaseResult<CounterResult>>),
+    LookupIn(Sender<CouchbaseResult<LookupInResult>>),
+    MutateIn(Sender<CouchbaseResult<MutateInResult>>),
+    Ping(Sender<CouchbaseResult<PingResult>>),
+    Store(MutateCookie),
+}
+
+impl KvCookie {
+    /// Completes the operation with an error.
+    pub fn fail(self, err: CouchbaseError) {
+        let sent = match self {
+            KvCookie::Get(sender) => sender.send(Err(err)).is_ok(),
+            KvCookie::GetMulti(slot) => {
+                slot.fill(Err(err));
+                true
+            }
+            KvCookie::GetReplica(sender) => sender.send(Err(err)).is_ok(),
+            KvCookie::Exists(sender) => sender.send(Err(err)).is_ok(),
+            KvCookie::Mutation(sender) => sender.send(Err(err)).is_ok(),
+            KvCookie::Unlock(sender) => sender.send(Err(err)).is_ok(),
+            KvCookie::Counter(sender) => sender.send(Err(err)).is_ok(),
+            KvCookie::LookupIn(sender) => sender.send(Err(err)).is_ok(),
+            KvCookie::MutateIn(sender) => sender.send(Err(err)).is_ok(),
+            KvCookie::Ping(sender) => sender.send(Err(err)).is_ok(),
+            KvCookie::Store(mut cookie) => match cookie.sender.take() {
+                Some(sender) => sender.send(Err(err)).is_ok(),
+                None => true,
+            },
+        };
+        if !sent {
+            debug!("Failed to notify request of failure, because the listener has been already dropped.");
+        }
+    }
+}
+
+/// The results of the ids of a `GetMultiRequest` scheduled by this lcb thread, handed to
+/// the gather in one go once all of them have arrived.
+pub(super) struct GetMultiPart {
+    results: Vec<(usize, CouchbaseResult<GetResult>)>,
+    remaining: usize,
+    gather: Arc<GetMultiGather>,
+}
+
+impl GetMultiPart {
+    pub fn new(len: usize, gather: Arc<GetMultiGather>) -> Self {
+        Self {
+            results: Vec::with_capacity(len),
+            remaining: len,
+            gather,
+        }
+    }
+}
+
+/// The cookie of one id of a `GetMultiRequest`.
+pub(super) struct GetMultiSlot {
+    part: Rc<RefCell<GetMultiPart>>,
+    index: usize,
+}
+
+impl GetMultiSlot {
+    pub fn new(part: Rc<RefCell<GetMultiPart>>, index: usize) -> Self {
+        Self { part, index }
+    }
+
+    /// Stores the result of this id. The last one of the part completes it, and the last
+    /// part completes the request with a single wakeup.
+    pub fn fill(self, result: CouchbaseResult<GetResult>) {
+        let mut part = self.part.borrow_mut();
+        part.results.push((self.index, result));
+        part.remaining -= 1;
+        if part.remaining > 0 {
+            return;
+        }
+        let results = std::mem::take(&mut part.results);
+        if let Some((sender, results)) = part.gather.finish_part(results) {
+            complete(sender, results, "get_multi");
+        }
+    }
+}
+
+/// A type which is stored as one of the `KvCookie` variants.
+pub(super) trait CookieKind: Sized {
+    fn into_cookie(self) -> KvCookie;
+    fn from_cookie(cookie: KvCookie) -> Option<Self>;
+    fn as_mut(cookie: &mut KvCookie) -> Option<&mut Self>;
+}
+
+macro_rules! cookie_kind {
+    ($variant:ident, $ty:ty) => {
+        impl CookieKind for $ty {
+            fn into_cookie(self) -> KvCookie {
+                KvCookie::$variant(self)
+            }
+
+            fn from_cookie(cookie: KvCookie) -> Option<Self> {
+                match cookie {
+                    KvCookie::$variant(inner) => Some(inner),
+                    _ => None,
+                }
+            }
+
+            fn as_mut(cookie: &mut KvCookie) -> Option<&mut Self> {
+                match cookie {
+                    KvCookie::$variant(inner) => Some(inner),
+                    _ => None,
+                }
+            }
+        }
+    };
+}
+
+cookie_kind!(Get, Sender<CouchbaseResult<GetResult>>);
+cookie_kind!(GetMulti, GetMultiSlot);
+cookie_kind!(GetReplica, Sender<CouchbaseResult<GetReplicaResult>>);
+cookie_kind!(Exists, Sender<CouchbaseResult<ExistsResult>>);
+cookie_kind!(Mutation, Sender<CouchbaseResult<MutationResult>>);
+cookie_kind!(Unlock, Sender<CouchbaseResult<()>>);
+cookie_kind!(Counter, Sender<CouchbaseResult<CounterResult>>);
+cookie_kind!(LookupIn, Sender<CouchbaseResult<LookupInResult>>);
+cookie_kind!(MutateIn, Sender<CouchbaseResult<MutateInResult>>);
+cookie_kind!(Ping, Sender<CouchbaseResult<PingResult>>);
+cookie_kind!(Store, MutateCookie);
+
+/// The lower half of an id is the index of the slot, the upper half its generation.
+const INDEX_BITS: u32 = (std::mem::size_of::<usize>() * 4) as u32;
+const INDEX_MASK: usize = (1 << INDEX_BITS) - 1;
+
+struct Slot {
+    /// Bumped whenever the slot is released, never 0 so that no id is a null pointer.
+    generation: usize,
+    cookie: Option<KvCookie>,
+}
+
+#[derive(Default)]
+struct CookieSlab {
+    slots: Vec<Slot>,
+    free: Vec<usize>,
+}
+
+impl CookieSlab {
+    fn insert(&mut self, cookie: KvCookie) -> usize {
+        let index = match self.free.pop() {
+            Some(index) => index,
+            None => {
+                debug_assert!(self.slots.len() < INDEX_MASK);
+                self.slots.push(Slot {
+                    generation: 1,
+                    cookie: None,
+                });
+                self.slots.len() - 1
+            }
+        };
+        let slot = &mut self.slots[index];
+        slot.cookie = Some(cookie);
+        (slot.generation << INDEX_BITS) | index
+    }
+
+    fn get_mut(&mut self, id: usize) -> Option<&mut KvCookie> {
+        let slot = self.slots.get_mut(id & INDEX_MASK)?;
+        if slot.generation != id >> INDEX_BITS {
+            return None;
+        }
+        slot.cookie.as_mut()
+    }
+
+    fn remove(&mut self, id: usize) -> Option<KvCookie> {
+        let index = id & INDEX_MASK;
+        let slot = self.slots.get_mut(index)?;
+        if slot.generation != id >> INDEX_BITS || slot.cookie.is_none() {
+            return None;
+        }
+        slot.generation = (slot.generation + 1) & INDEX_MASK;
+        if slot.generation == 0 {
+            slot.generation = 1;
+        }
+        self.free.push(index);
+        slot.cookie.take()
+    }
+}
+
+thread_local! {
+    /// The cookies of the operations scheduled by this lcb thread.
+    static COOKIES: RefCell<CookieSlab> = RefCell::new(CookieSlab::default());
+}
+
+/// Id of the slot holding the cookie of an operation, passed to libcouchbase as the
+/// cookie pointer.
+///
+/// Ids are only valid on the lcb thread which created them.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub(super) struct CookieId(usize);
+
+impl CookieId {
+    /// Stores a cookie in a free slot.
+    pub fn new<T: CookieKind>(cookie: T) -> Self {
+        CookieId(COOKIES.with(|slab| slab.borrow_mut().insert(cookie.into_cookie())))
+    }
+
+    pub fn from_ptr(ptr: *const c_void) -> Self {
+        CookieId(ptr as usize)
+    }
+
+    pub fn as_ptr(self) -> *mut c_void {
+        self.0 as *mut c_void
+    }
+
+    /// Takes the cookie out of its slot and releases the slot. Returns `None` if the
+    /// slot has been released already, or holds a cookie of another kind.
+    pub fn take<T: CookieKind>(self) -> Option<T> {
+        COOKIES
+            .with(|slab| {
+                let mut slab = slab.borrow_mut();
+                let found = slab
+                    .get_mut(self.0)
+                    .map_or(false, |cookie| T::as_mut(cookie).is_some());
+                if found {
+                    slab.remove(self.0)
+                } else {
+                    None
+                }
+            })
+            .and_then(T::from_cookie)
+    }
+
+    /// Takes the cookie out of its slot whatever its kind, and releases the slot.
+    pub fn release(self) -> Option<KvCookie> {
+        COOKIES.with(|slab| slab.borrow_mut().remove(self.0))
+    }
+
+    /// Runs `f` on the cookie while it stays in its slot. The slot is released if `f`
+    /// returns true along with its result.
+    pub fn update<T: CookieKind, R, F>(self, f: F) -> Option<R>
+    where
+        F: FnOnce(&mut T) -> (R, bool),
+    {
+        COOKIES.with(|slab| {
+            let mut slab = slab.borrow_mut();
+            let (result, done) = f(slab.get_mut(self.0).and_then(T::as_mut)?);
+            if done {
+                // Dropping the emptied cookie does not reenter the slab.
+                slab.remove(self.0);
+            }
+            Some(result)
+        })
+    }
+}
@@ -1,20 +1,28 @@
 use crate::io::lcb::callbacks::{
     analytics_callback, query_callback, search_callback, view_callback,
 };
-use crate::io::lcb::{AnalyticsCookie, HttpCookie, QueryCookie, SearchCookie, ViewCookie};
+use crate::io::lcb::cookies::{CookieId, GetMultiPart, GetMultiSlot};
+use crate::io::lcb::instance::{add_outstanding_requests, buffer_releaser, row_throttle};
+use crate::io::lcb::rows::row_channel;
+use crate::io::lcb::{
+    AnalyticsCookie, HttpCookie, MutateCookie, QueryCookie, SearchCookie, ViewCookie,
+};
 use crate::io::request::*;
 use crate::{
-    CouchbaseResult, DurabilityLevel, ErrorContext, LookupInSpec, MutateInSpec, ReplicaMode,
-    ServiceType, StoreSemantics,
+    DurabilityLevel, ErrorContext, LookupInSpec, MutateInSpec, ReplicaMode, ServiceType,
+    StoreSemantics,
 };
-use futures::channel::oneshot::Sender;
 use log::{debug, warn};
 use serde_json::Value;
+use std::cell::{Cell, RefCell};
+use std::rc::Rc;
+use std::collections::HashMap;
 use std::convert::TryInto;
+use std::time::{Duration, Instant};
 
 use couchbase_sys::*;
 use std::ffi::{CStr, CString};
-use std::os::raw::c_void;
+use std::os::raw::{c_char, c_void};
 use std::ptr;
 use uuid::Uuid;
 
@@ -23,6 +31,30 @@ use super::callbacks::couchbase_error_from_lcb_status;
 #[derive(Debug)]
 pub struct EncodeFailure(lcb_STATUS);
 
+thread_local! {
+    /// When the requests being encoded on this IO thread were submitted.
+    static SUBMITTED: Cell<Option<Instant>> = Cell::new(None);
+}
+
+/// Sets when the requests encoded from now on were submitted, see `timeout_us`.
+pub(crate) fn set_submitted(submitted: Instant) {
+    SUBMITTED.with(|s| s.set(Some(submitted)));
+}
+
+/// The timeout of a request in microseconds.
+///
+/// libcouchbase counts it from when the request is scheduled, so the time the
+/// request waited for the IO thread is taken off. A budget used up already still
+/// gives one microsecond, as zero selects the default timeout.
+fn timeout_us(timeout: Duration) -> u32 {
+    let waited = SUBMITTED
+        .with(|s| s.get())
+        .map(|submitted| submitted.elapsed())
+        .unwrap_or_default();
+    let remaining = timeout.checked_sub(waited).unwrap_or_default();
+    remaining.as_micros().max(1).min(u32::MAX as u128) as u32
+}
+
 /// Helper method to turn a string into a tuple of CString and its length.
 #[inline]
 pub fn into_cstring<T: Into<Vec<u8>>>(input: T) -> (usize, CString) {
@@ -33,6 +65,55 @@ pub fn into_cstring<T: Into<Vec<u8>>>(input: T) -> (usize, CString) {
     )
 }
 
+/// A string or byte slice handed to libcouchbase along with its length.
+///
+/// The setters of the commands copy what they keep, so the bytes only need to outlive
+/// the call and there is no point in copying them into a `CString` first (which would
+/// also reject values containing a NUL byte).
+#[derive(Clone, Copy)]
+pub struct LcbStr<'a>(&'a [u8]);
+
+impl LcbStr<'_> {
+    #[inline]
+    pub fn as_ptr(&self) -> *const c_char {
+        self.0.as_ptr() as *const c_char
+    }
+}
+
+/// Helper method to borrow a string as a tuple of its length and its bytes.
+#[inline]
+pub fn lcb_str<T: AsRef<[u8]> + ?Sized>(input: &T) -> (usize, LcbStr<'_>) {
+    let input = input.as_ref();
+    (input.len(), LcbStr(input))
+}
+
+/// Buffers of serialized payloads larger than this are not kept for the next request.
+const PAYLOAD_RETAIN_MAX: usize = 64 * 1024;
+
+thread_local! {
+    /// Serialized query, analytics and search payloads, reused across requests.
+    static PAYLOAD: RefCell<Vec<u8>> = RefCell::new(Vec::new());
+}
+
+/// Serializes `options` into the payload buffer of this thread and runs `f` on it.
+fn with_payload<T, R, F>(options: &T, f: F) -> R
+where
+    T: serde::Serialize,
+    F: FnOnce(&[u8]) -> R,
+{
+    PAYLOAD.with(|payload| {
+        let mut payload = payload.borrow_mut();
+        payload.clear();
+        serde_json::to_writer(&mut *payload, options).unwrap();
+        let result = f(&payload);
+        if payload.capacity() > PAYLOAD_RETAIN_MAX {
+            payload.clear();
+            payload.shrink_to_fit();
+        }
+        result
+    })
+}
+
 impl TryInto<lcb_DURABILITY_LEVEL> for DurabilityLevel {
     type Error = EncodeFailure;
 
@@ -60,29 +141,27 @@ impl From<ReplicaMode> for lcb_REPLICA_MODE {
         match rm {
             ReplicaMode::Any => lcb_REPLICA_MODE_LCB_REPLICA_MODE_ANY,
             ReplicaMode::All => lcb_REPLICA_MODE_LCB_REPLICA_MODE_ALL,
+            ReplicaMode::Freshest => lcb_REPLICA_MODE_LCB_REPLICA_MODE_FRESHEST,
+            ReplicaMode::Fastest => lcb_REPLICA_MODE_LCB_REPLICA_MODE_FASTEST,
         }
     }
 }
 
 /// Verifies the libcouchbase return status code and fails the original request.
-fn verify<T>(
-    status: lcb_STATUS,
-    sender: *mut Sender<CouchbaseResult<T>>,
-) -> Result<(), EncodeFailure> {
+fn verify(status: lcb_STATUS, cookie: CookieId) -> Result<(), EncodeFailure> {
     if status != lcb_STATUS_LCB_SUCCESS {
-        if sender.is_null() {
-            warn!("Failed to notify request of encode failure because the pointer is null. This is a bug!");
-            return Ok(());
-        }
-        let sender = unsafe { Box::from_raw(sender) };
+        let cookie = match cookie.release() {
+            Some(cookie) => cookie,
+            None => {
+                warn!("Failed to notify request of encode failure because its cookie is gone. This is a bug!");
+                return Err(EncodeFailure(status));
+            }
+        };
         let mut ctx = ErrorContext::default();
         if let Ok(msg) = unsafe { CStr::from_ptr(lcb_strerror_short(status)) }.to_str() {
             ctx.insert("msg", Value::String(msg.to_string()));
         }
-        let err = couchbase_error_from_lcb_status(status, ctx);
-        if sender.send(Err(err)).is_err() {
-            debug!("Failed to notify request of encode failure, because the listener has been already dropped.");
-        }
+        cookie.fail(couchbase_error_from_lcb_status(status, ctx));
         return Err(EncodeFailure(status));
     }
     Ok(())
@@ -207,10 +286,102 @@ fn verify_http(status: lcb_STATUS, sender: *mut HttpCookie) -> Result<(), Encode
 /// at the ty (type) enum of the get request. If one of them is used their inner
 /// duration is passed down to libcouchbase either as a locktime or the expiry.
 pub fn encode_get(instance: *mut lcb_INSTANCE, request: GetRequest) -> Result<(), EncodeFailure> {
-    let (id_len, id) = into_cstring(request.id);
-    let cookie = Box::into_raw(Box::new(request.sender));
-    let (scope_len, scope) = into_cstring(request.scope);
-    let (collection_len, collection) = into_cstring(request.collection);
+    let (command, cookie) = get_command(request)?;
+    unsafe {
+        verify(lcb_get(instance, cookie.as_ptr(), command), cookie)?;
+        verify(lcb_cmdget_destroy(command), cookie)?;
+    }
+    Ok(())
+}
+
+/// Encodes multiple `GetRequest`s and schedules them with `lcb_get_multi`, which
+/// groups them by the server they map to. Requests which cannot be encoded are failed
+/// right away.
+pub fn encode_get_multi(instance: *mut lcb_INSTANCE, requests: Vec<GetRequest>) {
+    let mut commands: Vec<*const lcb_CMDGET> = Vec::with_capacity(requests.len());
+    let mut cookies: Vec<*mut c_void> = Vec::with_capacity(requests.len());
+    for request in requests {
+        match get_command(request) {
+            Ok((command, cookie)) => {
+                commands.push(command);
+                cookies.push(cookie.as_ptr());
+            }
+            Err(e) => warn!("Failed to encode request because of {:?}", e),
+        }
+    }
+    if commands.is_empty() {
+        return;
+    }
+
+    // Commands lcb rejects are completed through the callback while being scheduled.
+    add_outstanding_requests(instance, commands.len());
+    unsafe {
+        lcb_get_multi(
+            instance,
+            ptr::null_mut(),
+            commands.as_ptr(),
+            cookies.as_ptr(),
+            commands.len(),
+            None,
+        );
+        for command in commands {
+            lcb_cmdget_destroy(command as *mut lcb_CMDGET);
+        }
+    }
+}
+
+/// Schedules the gets of one part of a `GetMultiRequest`, each of which stores its result
+/// into the part shared by their cookies. Ids which cannot be encoded get their error
+/// right away.
+pub fn encode_get_multi_part(instance: *mut lcb_INSTANCE, request: GetMultiRequest) {
+    let part = Rc::new(RefCell::new(GetMultiPart::new(
+        request.ids.len(),
+        request.gather,
+    )));
+    let ty = GetRequestType::Get {
+        options: request.options,
+    };
+    let mut scheduled = 0;
+    for (index, id) in request.ids {
+        let cookie = CookieId::new(GetMultiSlot::new(part.clone(), index));
+        let result = build_get_command(&id, &request.scope, &request.collection, &ty, cookie)
+            .and_then(|command| unsafe {
+                verify(lcb_get(instance, cookie.as_ptr(), command), cookie)?;
+                verify(lcb_cmdget_destroy(command), cookie)
+            });
+        match result {
+            Ok(_) => scheduled += 1,
+            Err(e) => warn!("Failed to encode request because of {:?}", e),
+        }
+    }
+    add_outstanding_requests(instance, scheduled);
+}
+
+/// Builds the `lcb_CMDGET` of a `GetRequest`, returning it along with its cookie.
+pub(super) fn get_command(
+    request: GetRequest,
+) -> Result<(*mut lcb_CMDGET, CookieId), EncodeFailure> {
+    let cookie = CookieId::new(request.sender);
+    let command = build_get_command(
+        &request.id,
+        &request.scope,
+        &request.collection,
+        &request.ty,
+        cookie,
+    )?;
+    Ok((command, cookie))
+}
+
+fn build_get_command(
+    id: &str,
+    scope: &str,
+    collection: &str,
+    ty: &GetRequestType,
+    cookie: CookieId,
+) -> Result<*mut lcb_CMDGET, EncodeFailure> {
+    let (id_len, id) = lcb_str(id);
+    let (scope_len, scope) = lcb_str(scope);
+    let (collection_len, collection) = lcb_str(collection);
 
     let mut command: *mut lcb_CMDGET = ptr::null_mut();
     unsafe {
@@ -227,14 +398,20 @@ pub fn encode_get(instance: *mut lcb_INSTANCE, request: GetRequest) -> Result<()
             cookie,
         )?;
 
-        match request.ty {
+        match ty {
             GetRequestType::Get { options } => {
                 if let Some(timeout) = options.timeout {
                     verify(
-                        lcb_cmdget_timeout(command, timeout.as_micros() as u32),
+                        lcb_cmdget_timeout(command, timeout_us(timeout)),
                         cookie,
                     )?;
                 }
+                if let Some(delay) = options.hedge {
+                    verify(lcb_cmdget_hedge(command, delay), cookie)?;
+                }
+                if options.near_cache {
+                    verify(lcb_cmdget_near_cache(command, 1), cookie)?;
+                }
             }
             GetRequestType::GetAndLock { lock_time, options } => {
                 verify(
@@ -244,7 +421,7 @@ pub fn encode_get(instance: *mut lcb_INSTANCE, request: GetRequest) -> Result<()
 
                 if let Some(timeout) = options.timeout {
                     verify(
-                        lcb_cmdget_timeout(command, timeout.as_micros() as u32),
+                        lcb_cmdget_timeout(command, timeout_us(timeout)),
                         cookie,
                     )?;
                 }
@@ -254,17 +431,14 @@ pub fn encode_get(instance: *mut lcb_INSTANCE, request: GetRequest) -> Result<()
 
                 if let Some(timeout) = options.timeout {
                     verify(
-                        lcb_cmdget_timeout(command, timeout.as_micros() as u32),
+                        lcb_cmdget_timeout(command, timeout_us(timeout)),
                         cookie,
                     )?;
                 }
             }
         };
-
-        verify(lcb_get(instance, cookie as *mut c_void, command), cookie)?;
-        verify(lcb_cmdget_destroy(command), cookie)?;
     }
-    Ok(())
+    Ok(command)
 }
 
 /// Encodes a `GetReplicaRequest` into its libcouchbase `lcb_CMDGETREPLICA` representation.
@@ -273,10 +447,10 @@ pub fn encode_get_replica(
     instance: *mut lcb_INSTANCE,
     request: GetReplicaRequest,
 ) -> Result<(), EncodeFailure> {
-    let (id_len, id) = into_cstring(request.id);
-    let cookie = Box::into_raw(Box::new(request.sender));
-    let (scope_len, scope) = into_cstring(request.scope);
-    let (collection_len, collection) = into_cstring(request.collection);
+    let (id_len, id) = lcb_str(&request.id);
+    let cookie = CookieId::new(request.sender);
+    let (scope_len, scope) = lcb_str(&request.scope);
+    let (collection_len, collection) = lcb_str(&request.collection);
 
     let mut command: *mut lcb_CMDGETREPLICA = ptr::null_mut();
     unsafe {
@@ -298,15 +472,18 @@ pub fn encode_get_replica(
 
         if let Some(timeout) = request.options.timeout {
             verify(
-                lcb_cmdgetreplica_timeout(command, timeout.as_micros() as u32),
+                lcb_cmdgetreplica_timeout(command, timeout_us(timeout)),
                 cookie,
             )?;
         }
+        if let Some(cas) = request.options.min_cas {
+            verify(lcb_cmdgetreplica_min_cas(command, cas), cookie)?;
+        }
+        if let Some(quorum) = request.options.quorum {
+            verify(lcb_cmdgetreplica_quorum(command, quorum), cookie)?;
+        }
 
-        verify(
-            lcb_getreplica(instance, cookie as *mut c_void, command),
-            cookie,
-        )?;
+        verify(lcb_getreplica(instance, cookie.as_ptr(), command), cookie)?;
         verify(lcb_cmdgetreplica_destroy(command), cookie)?;
     }
 
@@ -318,10 +495,10 @@ pub fn encode_exists(
     instance: *mut lcb_INSTANCE,
     request: ExistsRequest,
 ) -> Result<(), EncodeFailure> {
-    let (id_len, id) = into_cstring(request.id);
-    let cookie = Box::into_raw(Box::new(request.sender));
-    let (scope_len, scope) = into_cstring(request.scope);
-    let (collection_len, collection) = into_cstring(request.collection);
+    let (id_len, id) = lcb_str(&request.id);
+    let cookie = CookieId::new(request.sender);
+    let (scope_len, scope) = lcb_str(&request.scope);
+    let (collection_len, collection) = lcb_str(&request.collection);
 
     let mut command: *mut lcb_CMDEXISTS = ptr::null_mut();
     unsafe {
@@ -340,12 +517,16 @@ pub fn encode_exists(
 
         if let Some(timeout) = request.options.timeout {
             verify(
-                lcb_cmdexists_timeout(command, timeout.as_micros() as u32),
+                lcb_cmdexists_timeout(command, timeout_us(timeout)),
                 cookie,
             )?;
         }
 
-        verify(lcb_exists(instance, cookie as *mut c_void, command), cookie)?;
+        if request.options.near_cache {
+            verify(lcb_cmdexists_near_cache(command, 1), cookie)?;
+        }
+
+        verify(lcb_exists(instance, cookie.as_ptr(), command), cookie)?;
         verify(lcb_cmdexists_destroy(command), cookie)?;
     }
 
@@ -360,11 +541,30 @@ pub fn encode_mutate(
     instance: *mut lcb_INSTANCE,
     request: MutateRequest,
 ) -> Result<(), EncodeFailure> {
-    let (id_len, id) = into_cstring(request.id);
-    let (value_len, value) = into_cstring(request.content);
-    let cookie = Box::into_raw(Box::new(request.sender));
-    let (scope_len, scope) = into_cstring(request.scope);
-    let (collection_len, collection) = into_cstring(request.collection);
+    let (id_len, id) = lcb_str(&request.id);
+    let (flags, json) = (request.flags, request.json);
+    // Large values are handed to libcouchbase without copying them, the cookie owns
+    // them until the packet has been flushed.
+    let borrow_value = buffer_releaser(instance)
+        .map(|r| request.content.len() >= r.min_size())
+        .unwrap_or(false);
+    let (content, borrowed) = if borrow_value {
+        (None, Some(request.content))
+    } else {
+        (Some(request.content), None)
+    };
+    let value = content.as_ref().map(|content| lcb_str(content));
+    // The heap buffer of the value stays put when the cookie moves into its slot.
+    let borrowed_iov = borrowed.as_ref().map(|borrowed| lcb_IOV {
+        iov_base: borrowed.as_ptr() as *mut c_void,
+        iov_len: borrowed.len(),
+    });
+    let cookie = CookieId::new(MutateCookie {
+        sender: Some(request.sender),
+        value: borrowed,
+    });
+    let (scope_len, scope) = lcb_str(&request.scope);
+    let (collection_len, collection) = lcb_str(&request.collection);
 
     let mut command: *mut lcb_CMDSTORE = ptr::null_mut();
     unsafe {
@@ -377,7 +577,7 @@ pub fn encode_mutate(
                 )?;
                 if let Some(timeout) = options.timeout {
                     verify(
-                        lcb_cmdstore_timeout(command, timeout.as_micros() as u32),
+                        lcb_cmdstore_timeout(command, timeout_us(timeout)),
                         cookie,
                     )?;
                 }
@@ -390,6 +590,9 @@ pub fn encode_mutate(
                 if options.preserve_expiry {
                     verify(lcb_cmdstore_preserve_expiry(command, 1), cookie)?;
                 }
+                if options.coalesce {
+                    verify(lcb_cmdstore_coalesce(command, 1), cookie)?;
+                }
                 durability = options.durability;
             }
             MutateRequestType::Insert { options } => {
@@ -399,7 +602,7 @@ pub fn encode_mutate(
                 )?;
                 if let Some(timeout) = options.timeout {
                     verify(
-                        lcb_cmdstore_timeout(command, timeout.as_micros() as u32),
+                        lcb_cmdstore_timeout(command, timeout_us(timeout)),
                         cookie,
                     )?;
                 }
@@ -421,7 +624,7 @@ pub fn encode_mutate(
                 }
                 if let Some(timeout) = options.timeout {
                     verify(
-                        lcb_cmdstore_timeout(command, timeout.as_micros() as u32),
+                        lcb_cmdstore_timeout(command, timeout_us(timeout)),
                         cookie,
                     )?;
                 }
@@ -446,7 +649,7 @@ pub fn encode_mutate(
                 }
                 if let Some(timeout) = options.timeout {
                     verify(
-                        lcb_cmdstore_timeout(command, timeout.as_micros() as u32),
+                        lcb_cmdstore_timeout(command, timeout_us(timeout)),
                         cookie,
                     )?;
                 }
@@ -462,7 +665,7 @@ pub fn encode_mutate(
                 }
                 if let Some(timeout) = options.timeout {
                     verify(
-                        lcb_cmdstore_timeout(command, timeout.as_micros() as u32),
+                        lcb_cmdstore_timeout(command, timeout_us(timeout)),
                         cookie,
                     )?;
                 }
@@ -491,10 +694,25 @@ pub fn encode_mutate(
         }
 
         verify(lcb_cmdstore_key(command, id.as_ptr(), id_len), cookie)?;
-        verify(
-            lcb_cmdstore_value(command, value.as_ptr(), value_len),
-            cookie,
-        )?;
+        match &value {
+            Some((value_len, value)) => verify(
+                lcb_cmdstore_value(command, value.as_ptr(), *value_len),
+                cookie,
+            )?,
+            None => {
+                let iov = borrowed_iov.as_ref().unwrap();
+                verify(lcb_cmdstore_value_iov_nocopy(command, iov, 1), cookie)?
+            }
+        }
+        if flags != 0 {
+            verify(lcb_cmdstore_flags(command, flags), cookie)?;
+        }
+        if json {
+            verify(
+                lcb_cmdstore_datatype(command, lcb_VALUEFLAGS_LCB_VALUE_F_JSON as u8),
+                cookie,
+            )?;
+        }
         verify(
             lcb_cmdstore_collection(
                 command,
@@ -506,7 +724,7 @@ pub fn encode_mutate(
             cookie,
         )?;
 
-        verify(lcb_store(instance, cookie as *mut c_void, command), cookie)?;
+        verify(lcb_store(instance, cookie.as_ptr(), command), cookie)?;
         verify(lcb_cmdstore_destroy(command), cookie)?;
     }
 
@@ -518,10 +736,10 @@ pub fn encode_remove(
     instance: *mut lcb_INSTANCE,
     request: RemoveRequest,
 ) -> Result<(), EncodeFailure> {
-    let (id_len, id) = into_cstring(request.id);
-    let cookie = Box::into_raw(Box::new(request.sender));
-    let (scope_len, scope) = into_cstring(request.scope);
-    let (collection_len, collection) = into_cstring(request.collection);
+    let (id_len, id) = lcb_str(&request.id);
+    let cookie = CookieId::new(request.sender);
+    let (scope_len, scope) = lcb_str(&request.scope);
+    let (collection_len, collection) = lcb_str(&request.collection);
 
     let mut command: *mut lcb_CMDREMOVE = ptr::null_mut();
     unsafe {
@@ -555,12 +773,12 @@ pub fn encode_remove(
         }
         if let Some(timeout) = request.options.timeout {
             verify(
-                lcb_cmdremove_timeout(command, timeout.as_micros() as u32),
+                lcb_cmdremove_timeout(command, timeout_us(timeout)),
                 cookie,
             )?;
         }
 
-        verify(lcb_remove(instance, cookie as *mut c_void, command), cookie)?;
+        verify(lcb_remove(instance, cookie.as_ptr(), command), cookie)?;
         verify(lcb_cmdremove_destroy(command), cookie)?;
     }
 
@@ -572,10 +790,57 @@ pub fn encode_touch(
     instance: *mut lcb_INSTANCE,
     request: TouchRequest,
 ) -> Result<(), EncodeFailure> {
-    let (id_len, id) = into_cstring(request.id);
-    let cookie = Box::into_raw(Box::new(request.sender));
-    let (scope_len, scope) = into_cstring(request.scope);
-    let (collection_len, collection) = into_cstring(request.collection);
+    let (command, cookie) = touch_command(request)?;
+    unsafe {
+        verify(lcb_touch(instance, cookie.as_ptr(), command), cookie)?;
+        verify(lcb_cmdtouch_destroy(command), cookie)?;
+    }
+
+    Ok(())
+}
+
+/// Encodes multiple `TouchRequest`s and schedules them with `lcb_touch_multi`, which
+/// groups them by the server they map to. Requests which cannot be encoded are failed
+/// right away.
+pub fn encode_touch_multi(instance: *mut lcb_INSTANCE, requests: Vec<TouchRequest>) {
+    let mut commands: Vec<*const lcb_CMDTOUCH> = Vec::with_capacity(requests.len());
+    let mut cookies: Vec<*mut c_void> = Vec::with_capacity(requests.len());
+    for request in requests {
+        match touch_command(request) {
+            Ok((command, cookie)) => {
+                commands.push(command);
+                cookies.push(cookie.as_ptr());
+            }
+            Err(e) => warn!("Failed to encode request because of {:?}", e),
+        }
+    }
+    if commands.is_empty() {
+        return;
+    }
+
+    // Commands lcb rejects are completed through the callback while being scheduled.
+    add_outstanding_requests(instance, commands.len());
+    unsafe {
+        lcb_touch_multi(
+            instance,
+            ptr::null_mut(),
+            commands.as_ptr(),
+            cookies.as_ptr(),
+            commands.len(),
+            None,
+        );
+        for command in commands {
+            lcb_cmdtouch_destroy(command as *mut lcb_CMDTOUCH);
+        }
+    }
+}
+
+/// Builds the `lcb_CMDTOUCH` of a `TouchRequest`, returning it along with its cookie.
+fn touch_command(request: TouchRequest) -> Result<(*mut lcb_CMDTOUCH, CookieId), EncodeFailure> {
+    let (id_len, id) = lcb_str(&request.id);
+    let cookie = CookieId::new(request.sender);
+    let (scope_len, scope) = lcb_str(&request.scope);
+    let (collection_len, collection) = lcb_str(&request.collection);
 
     let mut command: *mut lcb_CMDTOUCH = ptr::null_mut();
     unsafe {
@@ -598,16 +863,13 @@ pub fn encode_touch(
 
         if let Some(timeout) = request.options.timeout {
             verify(
-                lcb_cmdtouch_timeout(command, timeout.as_micros() as u32),
+                lcb_cmdtouch_timeout(command, timeout_us(timeout)),
                 cookie,
             )?;
         }
-
-        verify(lcb_touch(instance, cookie as *mut c_void, command), cookie)?;
-        verify(lcb_cmdtouch_destroy(command), cookie)?;
     }
 
-    Ok(())
+    Ok((command, cookie))
 }
 
 /// Encodes an `UnlockRequest` into its libcouchbase `lcb_CMDUNLOCK` representation.
@@ -615,10 +877,10 @@ pub fn encode_unlock(
     instance: *mut lcb_INSTANCE,
     request: UnlockRequest,
 ) -> Result<(), EncodeFailure> {
-    let (id_len, id) = into_cstring(request.id);
-    let cookie = Box::into_raw(Box::new(request.sender));
-    let (scope_len, scope) = into_cstring(request.scope);
-    let (collection_len, collection) = into_cstring(request.collection);
+    let (id_len, id) = lcb_str(&request.id);
+    let cookie = CookieId::new(request.sender);
+    let (scope_len, scope) = lcb_str(&request.scope);
+    let (collection_len, collection) = lcb_str(&request.collection);
 
     let mut command: *mut lcb_CMDUNLOCK = ptr::null_mut();
     unsafe {
@@ -638,12 +900,12 @@ pub fn encode_unlock(
         )?;
         if let Some(timeout) = request.options.timeout {
             verify(
-                lcb_cmdunlock_timeout(command, timeout.as_micros() as u32),
+                lcb_cmdunlock_timeout(command, timeout_us(timeout)),
                 cookie,
             )?;
         }
 
-        verify(lcb_unlock(instance, cookie as *mut c_void, command), cookie)?;
+        verify(lcb_unlock(instance, cookie.as_ptr(), command), cookie)?;
         verify(lcb_cmdunlock_destroy(command), cookie)?;
     }
 
@@ -658,10 +920,59 @@ pub fn encode_counter(
     instance: *mut lcb_INSTANCE,
     request: CounterRequest,
 ) -> Result<(), EncodeFailure> {
-    let (id_len, id) = into_cstring(request.id);
-    let cookie = Box::into_raw(Box::new(request.sender));
-    let (scope_len, scope) = into_cstring(request.scope);
-    let (collection_len, collection) = into_cstring(request.collection);
+    let (command, cookie) = counter_command(request)?;
+    unsafe {
+        verify(lcb_counter(instance, cookie.as_ptr(), command), cookie)?;
+        verify(lcb_cmdcounter_destroy(command), cookie)?;
+    }
+
+    Ok(())
+}
+
+/// Encodes multiple `CounterRequest`s and schedules them with `lcb_counter_multi`, which
+/// groups them by the server they map to. Requests which cannot be encoded are failed
+/// right away.
+pub fn encode_counter_multi(instance: *mut lcb_INSTANCE, requests: Vec<CounterRequest>) {
+    let mut commands: Vec<*const lcb_CMDCOUNTER> = Vec::with_capacity(requests.len());
+    let mut cookies: Vec<*mut c_void> = Vec::with_capacity(requests.len());
+    for request in requests {
+        match counter_command(request) {
+            Ok((command, cookie)) => {
+                commands.push(command);
+                cookies.push(cookie.as_ptr());
+            }
+            Err(e) => warn!("Failed to encode request because of {:?}", e),
+        }
+    }
+    if commands.is_empty() {
+        return;
+    }
+
+    // Commands lcb rejects are completed through the callback while being scheduled.
+    add_outstanding_requests(instance, commands.len());
+    unsafe {
+        lcb_counter_multi(
+            instance,
+            ptr::null_mut(),
+            commands.as_ptr(),
+            cookies.as_ptr(),
+            commands.len(),
+            None,
+        );
+        for command in commands {
+            lcb_cmdcounter_destroy(command as *mut lcb_CMDCOUNTER);
+        }
+    }
+}
+
+/// Builds the `lcb_CMDCOUNTER` of a `CounterRequest`, returning it along with its cookie.
+fn counter_command(
+    request: CounterRequest,
+) -> Result<(*mut lcb_CMDCOUNTER, CookieId), EncodeFailure> {
+    let (id_len, id) = lcb_str(&request.id);
+    let cookie = CookieId::new(request.sender);
+    let (scope_len, scope) = lcb_str(&request.scope);
+    let (collection_len, collection) = lcb_str(&request.collection);
 
     let mut command: *mut lcb_CMDCOUNTER = ptr::null_mut();
     unsafe {
@@ -695,7 +1006,7 @@ pub fn encode_counter(
         }
         if let Some(timeout) = request.options.timeout {
             verify(
-                lcb_cmdcounter_timeout(command, timeout.as_micros() as u32),
+                lcb_cmdcounter_timeout(command, timeout_us(timeout)),
                 cookie,
             )?;
         }
@@ -706,15 +1017,14 @@ pub fn encode_counter(
             )?;
         }
 
+        if let Some(initial) = request.options.initial {
+            verify(lcb_cmdcounter_initial(command, initial), cookie)?;
+        }
+
         verify(lcb_cmdcounter_delta(command, request.options.delta), cookie)?;
-        verify(
-            lcb_counter(instance, cookie as *mut c_void, command),
-            cookie,
-        )?;
-        verify(lcb_cmdcounter_destroy(command), cookie)?;
     }
 
-    Ok(())
+    Ok((command, cookie))
 }
 
 /// Encodes a `QueryRequest` into its libcouchbase `lcb_CMDQUERY` representation.
@@ -723,32 +1033,39 @@ pub fn encode_query(
     mut request: QueryRequest,
 ) -> Result<(), EncodeFailure> {
     request.options.statement = Some(request.statement);
-    let (payload_len, payload) = into_cstring(serde_json::to_vec(&request.options).unwrap());
 
     let (meta_sender, meta_receiver) = futures::channel::oneshot::channel();
-    let (rows_sender, rows_receiver) = futures::channel::mpsc::unbounded();
+    let (rows_sender, rows_receiver) = row_channel(row_throttle(instance));
     let cookie = Box::into_raw(Box::new(QueryCookie {
         sender: Some(request.sender),
         meta_sender,
         meta_receiver: Some(meta_receiver),
         rows_sender,
         rows_receiver: Some(rows_receiver),
+        skip_meta: request.options.skip_meta_data,
     }));
 
     let mut command: *mut lcb_CMDQUERY = ptr::null_mut();
     unsafe {
         verify_query(lcb_cmdquery_create(&mut command), cookie)?;
-        verify_query(
-            lcb_cmdquery_payload(command, payload.as_ptr(), payload_len),
-            cookie,
-        )?;
+        with_payload(&request.options, |payload| {
+            let (payload_len, payload) = lcb_str(payload);
+            verify_query(
+                lcb_cmdquery_payload(command, payload.as_ptr(), payload_len),
+                cookie,
+            )
+        })?;
 
         if let Some(a) = request.options.adhoc {
             verify_query(lcb_cmdquery_adhoc(command, a.into()), cookie)?;
         }
 
+        if let Some(n) = request.options.max_rows {
+            verify_query(lcb_cmdquery_max_rows(command, n), cookie)?;
+        }
+
         if let Some(s) = request.scope {
-            let (scope_len, scope) = into_cstring(s);
+            let (scope_len, scope) = lcb_str(&s);
             verify_query(
                 lcb_cmdquery_scope_name(command, scope.as_ptr(), scope_len),
                 cookie,
@@ -769,10 +1086,9 @@ pub fn encode_analytics(
     mut request: AnalyticsRequest,
 ) -> Result<(), EncodeFailure> {
     request.options.statement = Some(request.statement);
-    let (payload_len, payload) = into_cstring(serde_json::to_vec(&request.options).unwrap());
 
     let (meta_sender, meta_receiver) = futures::channel::oneshot::channel();
-    let (rows_sender, rows_receiver) = futures::channel::mpsc::unbounded();
+    let (rows_sender, rows_receiver) = row_channel(row_throttle(instance));
     let cookie = Box::into_raw(Box::new(AnalyticsCookie {
         sender: Some(request.sender),
         meta_sender,
@@ -784,16 +1100,19 @@ pub fn encode_analytics(
     let mut command: *mut lcb_CMDANALYTICS = ptr::null_mut();
     unsafe {
         verify_analytics(lcb_cmdanalytics_create(&mut command), cookie)?;
-        verify_analytics(
-            lcb_cmdanalytics_payload(command, payload.as_ptr(), payload_len),
-            cookie,
-        )?;
+        with_payload(&request.options, |payload| {
+            let (payload_len, payload) = lcb_str(payload);
+            verify_analytics(
+                lcb_cmdanalytics_payload(command, payload.as_ptr(), payload_len),
+                cookie,
+            )
+        })?;
         verify_analytics(
             lcb_cmdanalytics_callback(command, Some(analytics_callback)),
             cookie,
         )?;
         if let Some(s) = request.scope {
-            let (scope_len, scope) = into_cstring(s);
+            let (scope_len, scope) = lcb_str(&s);
             verify_analytics(
                 lcb_cmdanalytics_scope_name(command, scope.as_ptr(), scope_len),
                 cookie,
@@ -816,11 +1135,10 @@ pub fn encode_search(
 ) -> Result<(), EncodeFailure> {
     request.options.index = Some(request.index);
     request.options.query = Some(request.query);
-
-    let (payload_len, payload) = into_cstring(serde_json::to_vec(&request.options).unwrap());
+    let project = std::mem::take(&mut request.options.project);
 
     let (meta_sender, meta_receiver) = futures::channel::oneshot::channel();
-    let (rows_sender, rows_receiver) = futures::channel::mpsc::unbounded();
+    let (rows_sender, rows_receiver) = row_channel(row_throttle(instance));
     let (facet_sender, facet_receiver) = futures::channel::oneshot::channel();
     let cookie = Box::into_raw(Box::new(SearchCookie {
         sender: Some(request.sender),
@@ -835,14 +1153,24 @@ pub fn encode_search(
     let mut command: *mut lcb_CMDSEARCH = ptr::null_mut();
     unsafe {
         verify_search(lcb_cmdsearch_create(&mut command), cookie)?;
-        verify_search(
-            lcb_cmdsearch_payload(command, payload.as_ptr(), payload_len),
-            cookie,
-        )?;
+        with_payload(&request.options, |payload| {
+            let (payload_len, payload) = lcb_str(payload);
+            verify_search(
+                lcb_cmdsearch_payload(command, payload.as_ptr(), payload_len),
+                cookie,
+            )
+        })?;
         verify_search(
             lcb_cmdsearch_callback(command, Some(search_callback)),
             cookie,
         )?;
+        for path in &project {
+            let (path_len, path) = lcb_str(path);
+            verify_search(
+                lcb_cmdsearch_project(command, path.as_ptr(), path_len),
+                cookie,
+            )?;
+        }
         verify_search(lcb_search(instance, cookie as *mut c_void, command), cookie)?;
         verify_search(lcb_cmdsearch_destroy(command), cookie)?;
     }
@@ -852,9 +1180,9 @@ pub fn encode_search(
 
 /// Encodes a `ViewRequest` into its libcouchbase `lcb_CMDVIEW` representation.
 pub fn encode_view(instance: *mut lcb_INSTANCE, request: ViewRequest) -> Result<(), EncodeFailure> {
-    let (ddoc_name_len, ddoc_name) = into_cstring(request.design_document);
-    let (view_name_len, view_name) = into_cstring(request.view_name);
-    let (payload_len, payload) = into_cstring(request.options);
+    let (ddoc_name_len, ddoc_name) = lcb_str(&request.design_document);
+    let (view_name_len, view_name) = lcb_str(&request.view_name);
+    let (payload_len, payload) = lcb_str(&request.options);
 
     let (meta_sender, meta_receiver) = futures::channel::oneshot::channel();
     let (rows_sender, rows_receiver) = futures::channel::mpsc::unbounded();
@@ -907,23 +1235,41 @@ enum EncodedLookupSpec {
     },
 }
 
-/// Encodes a `LookupInRequest` into its libcouchbase `lcb_CMDSUBDOC` representation.
-pub fn encode_lookup_in(
-    instance: *mut lcb_INSTANCE,
-    request: LookupInRequest,
-) -> Result<(), EncodeFailure> {
-    let (id_len, id) = into_cstring(request.id);
-    let cookie = Box::into_raw(Box::new(request.sender));
-    let (scope_len, scope) = into_cstring(request.scope);
-    let (collection_len, collection) = into_cstring(request.collection);
+/// An `lcb_SUBDOCTEMPLATE`, destroyed when dropped.
+///
+/// Commands using a template hold a reference of their own, so dropping it
+/// once the command has been scheduled is fine.
+struct SubdocTemplate(*mut lcb_SUBDOCTEMPLATE);
+
+impl Drop for SubdocTemplate {
+    fn drop(&mut self) {
+        unsafe {
+            lcb_subdoctemplate_destroy(self.0);
+        }
+    }
+}
 
-    let lookup_specs = request
-        .specs
-        .into_iter()
+/// Upper bound of the lookup_in templates cached per IO thread.
+const LOOKUP_TEMPLATE_CACHE_SIZE: usize = 128;
+
+thread_local! {
+    /// Compiled lookup_in specs, keyed by the specs they were compiled from,
+    /// so that repeated lookups of the same paths skip encoding them again.
+    static LOOKUP_TEMPLATES: RefCell<HashMap<Vec<LookupInSpec>, SubdocTemplate>> =
+        RefCell::new(HashMap::new());
+}
+
+/// Compiles the specs of a lookup_in into a template.
+fn compile_lookup_template(
+    lookup_specs: &[LookupInSpec],
+    cookie: CookieId,
+) -> Result<SubdocTemplate, EncodeFailure> {
+    let lookup_specs = lookup_specs
+        .iter()
         .map(|spec| match spec {
             LookupInSpec::Get { path, xattr } => {
-                let flags = make_subdoc_flags(None, xattr, false);
-                let (path_len, path) = into_cstring(path);
+                let flags = make_subdoc_flags(None, *xattr, false);
+                let (path_len, path) = into_cstring(path.as_str());
                 EncodedLookupSpec::Get {
                     path_len,
                     path,
@@ -931,8 +1277,8 @@ pub fn encode_lookup_in(
                 }
             }
             LookupInSpec::Exists { path, xattr } => {
-                let flags = make_subdoc_flags(None, xattr, false);
-                let (path_len, path) = into_cstring(path);
+                let flags = make_subdoc_flags(None, *xattr, false);
+                let (path_len, path) = into_cstring(path.as_str());
                 EncodedLookupSpec::Exists {
                     path_len,
                     path,
@@ -940,8 +1286,8 @@ pub fn encode_lookup_in(
                 }
             }
             LookupInSpec::Count { path, xattr } => {
-                let flags = make_subdoc_flags(None, xattr, false);
-                let (path_len, path) = into_cstring(path);
+                let flags = make_subdoc_flags(None, *xattr, false);
+                let (path_len, path) = into_cstring(path.as_str());
                 EncodedLookupSpec::Count {
                     path_len,
                     path,
@@ -951,8 +1297,8 @@ pub fn encode_lookup_in(
         })
         .collect::<Vec<_>>();
 
-    let mut command: *mut lcb_CMDSUBDOC = ptr::null_mut();
     let mut specs: *mut lcb_SUBDOCSPECS = ptr::null_mut();
+    let mut template: *mut lcb_SUBDOCTEMPLATE = ptr::null_mut();
     unsafe {
         verify(
             lcb_subdocspecs_create(&mut specs, lookup_specs.len()),
@@ -994,6 +1340,44 @@ pub fn encode_lookup_in(
             }
         }
 
+        let status = lcb_subdoctemplate_create(&mut template, specs);
+        lcb_subdocspecs_destroy(specs);
+        verify(status, cookie)?;
+    }
+
+    Ok(SubdocTemplate(template))
+}
+
+/// Encodes a `LookupInRequest` into its libcouchbase `lcb_CMDSUBDOC` representation.
+pub fn encode_lookup_in(
+    instance: *mut lcb_INSTANCE,
+    request: LookupInRequest,
+) -> Result<(), EncodeFailure> {
+    let (id_len, id) = lcb_str(&request.id);
+    let cookie = CookieId::new(request.sender);
+    let (scope_len, scope) = lcb_str(&request.scope);
+    let (collection_len, collection) = lcb_str(&request.collection);
+
+    // The template is either borrowed from the cache, or owned here if the
+    // cache is full and dropped once the command has been scheduled.
+    let lookup_specs = request.specs;
+    let (template, _uncached) = LOOKUP_TEMPLATES.with(|templates| {
+        let mut templates = templates.borrow_mut();
+        if let Some(template) = templates.get(&lookup_specs) {
+            return Ok((template.0, None));
+        }
+        let template = compile_lookup_template(&lookup_specs, cookie)?;
+        let ptr = template.0;
+        if templates.len() < LOOKUP_TEMPLATE_CACHE_SIZE {
+            templates.insert(lookup_specs, template);
+            Ok((ptr, None))
+        } else {
+            Ok((ptr, Some(template)))
+        }
+    })?;
+
+    let mut command: *mut lcb_CMDSUBDOC = ptr::null_mut();
+    unsafe {
         verify(lcb_cmdsubdoc_create(&mut command), cookie)?;
         verify(lcb_cmdsubdoc_key(command, id.as_ptr(), id_len), cookie)?;
         verify(
@@ -1009,7 +1393,7 @@ pub fn encode_lookup_in(
 
         if let Some(timeout) = request.options.timeout {
             verify(
-                lcb_cmdsubdoc_timeout(command, timeout.as_micros() as u32),
+                lcb_cmdsubdoc_timeout(command, timeout_us(timeout)),
                 cookie,
             )?;
         }
@@ -1020,9 +1404,8 @@ pub fn encode_lookup_in(
             )?;
         }
 
-        verify(lcb_cmdsubdoc_specs(command, specs), cookie)?;
-        verify(lcb_subdoc(instance, cookie as *mut c_void, command), cookie)?;
-        verify(lcb_subdocspecs_destroy(specs), cookie)?;
+        verify(lcb_cmdsubdoc_template(command, template), cookie)?;
+        verify(lcb_subdoc(instance, cookie.as_ptr(), command), cookie)?;
         verify(lcb_cmdsubdoc_destroy(command), cookie)?;
     }
 
@@ -1140,10 +1523,10 @@ pub fn encode_mutate_in(
     instance: *mut lcb_INSTANCE,
     request: MutateInRequest,
 ) -> Result<(), EncodeFailure> {
-    let (id_len, id) = into_cstring(request.id);
-    let cookie = Box::into_raw(Box::new(request.sender));
-    let (scope_len, scope) = into_cstring(request.scope);
-    let (collection_len, collection) = into_cstring(request.collection);
+    let (id_len, id) = lcb_str(&request.id);
+    let cookie = CookieId::new(request.sender);
+    let (scope_len, scope) = lcb_str(&request.scope);
+    let (collection_len, collection) = lcb_str(&request.collection);
 
     let mutate_specs = request
         .specs
@@ -1486,7 +1869,7 @@ pub fn encode_mutate_in(
 
         if let Some(timeout) = request.options.timeout {
             verify(
-                lcb_cmdsubdoc_timeout(command, timeout.as_micros() as u32),
+                lcb_cmdsubdoc_timeout(command, timeout_us(timeout)),
                 cookie,
             )?;
         }
@@ -1518,7 +1901,7 @@ pub fn encode_mutate_in(
         }
 
         verify(lcb_cmdsubdoc_specs(command, specs), cookie)?;
-        verify(lcb_subdoc(instance, cookie as *mut c_void, command), cookie)?;
+        verify(lcb_subdoc(instance, cookie.as_ptr(), command), cookie)?;
         verify(lcb_subdocspecs_destroy(specs), cookie)?;
         verify(lcb_cmdsubdoc_destroy(command), cookie)?;
     }
@@ -1570,7 +1953,7 @@ pub fn encode_generic_management_request(
 
         if let Some(timeout) = request.timeout {
             verify_http(
-                lcb_cmdhttp_timeout(command, timeout.as_micros() as u32),
+                lcb_cmdhttp_timeout(command, timeout_us(timeout)),
                 cookie,
             )?;
         }
@@ -1595,7 +1978,7 @@ pub fn encode_generic_management_request(
 
 /// Encodes a `PingRequest` into its libcouchbase `lcb_CMDPING` representation.
 pub fn encode_ping(instance: *mut lcb_INSTANCE, request: PingRequest) -> Result<(), EncodeFailure> {
-    let cookie = Box::into_raw(Box::new(request.sender));
+    let cookie = CookieId::new(request.sender);
 
     let report_id = request
         .options
@@ -1611,7 +1994,7 @@ pub fn encode_ping(instance: *mut lcb_INSTANCE, request: PingRequest) -> Result<
             cookie,
         )?;
         verify(lcb_cmdping_all(command), cookie)?;
-        verify(lcb_ping(instance, cookie as *mut c_void, command), cookie)?;
+        verify(lcb_ping(instance, cookie.as_ptr(), command), cookie)?;
         verify(lcb_cmdping_destroy(command), cookie)?;
     }
 
@@ -0,0 +1,143 @@
+use crate::io::lcb::completions;
+use crate::io::lcb::instance::LcbInstances;
+use crate::io::lcb::IoRequest;
+use crate::io::request::Request;
+use futures::pin_mut;
+use futures::task::noop_waker;
+use log::{debug, warn};
+use std::fmt;
+use std::future::Future;
+use std::mem;
+use std::sync::{Arc, Mutex};
+use std::task::{Context, Poll};
+use std::time::Instant;
+
+/// Requests waiting for the `InlineDriver` which owns them to be driven.
+///
+/// Requests may be queued from any thread, but they are only sent once the thread owning
+/// the driver blocks on an operation.
+#[derive(Debug)]
+pub struct InlineQueue {
+    requests: Mutex<Vec<IoRequest>>,
+    connection_string: String,
+    username: Option<String>,
+    password: Option<String>,
+}
+
+impl InlineQueue {
+    pub fn send(&self, request: Request) {
+        self.push(IoRequest::Data(request, Instant::now()))
+    }
+
+    pub fn open_bucket(&self, name: String) {
+        self.push(IoRequest::OpenBucket {
+            name,
+            connection_string: self.connection_string.clone(),
+            username: self.username.clone(),
+            password: self.password.clone(),
+        })
+    }
+
+    fn push(&self, request: IoRequest) {
+        self.requests.lock().unwrap().push(request)
+    }
+
+    fn take(&self) -> Vec<IoRequest> {
+        mem::take(&mut *self.requests.lock().unwrap())
+    }
+}
+
+/// Drives libcouchbase on the thread which owns it instead of on IO threads.
+///
+/// There is no handoff between threads: requests are scheduled, `lcb_wait` runs the event
+/// loop until they completed and the results are handed to the waiting future, all on
+/// the calling thread.
+pub struct InlineDriver {
+    instances: LcbInstances,
+    queue: Arc<InlineQueue>,
+}
+
+impl InlineDriver {
+    pub fn new(
+        connection_string: String,
+        username: Option<String>,
+        password: Option<String>,
+        preconnect: bool,
+    ) -> Self {
+        debug!("Using libcouchbase inline transport");
+        // Neither zero-copy values nor row budgets, both are released through the IO queue
+        // from other threads.
+        let mut instances = LcbInstances::new(None, None, None, preconnect);
+        match instances.create_instance(
+            connection_string.clone().into_bytes(),
+            username.clone().map(String::into_bytes),
+            password.clone().map(String::into_bytes),
+            None,
+        ) {
+            Ok(i) => instances.set_unbound(i),
+            Err(e) => warn!("Could not open libcouchbase instance {}", e),
+        };
+
+        Self {
+            instances,
+            queue: Arc::new(InlineQueue {
+                requests: Mutex::new(vec![]),
+                connection_string,
+                username,
+                password,
+            }),
+        }
+    }
+
+    /// The queue the `Core` of this driver sends its requests to.
+    pub fn queue(&self) -> Arc<InlineQueue> {
+        self.queue.clone()
+    }
+
+    /// Runs `future` to completion, driving the requests it sends on this thread.
+    ///
+    /// The futures of the API only wait for the responses to their requests, so they are
+    /// polled again once the instances went idle rather than when woken up.
+    pub fn block_on<F: Future>(&mut self, future: F) -> F::Output {
+        pin_mut!(future);
+        let waker = noop_waker();
+        let mut cx = Context::from_waker(&waker);
+        loop {
+            if let Poll::Ready(output) = future.as_mut().poll(&mut cx) {
+                return output;
+            }
+            if !self.run() {
+                panic!("Blocking operation is waiting for a response to no request");
+            }
+        }
+    }
+
+    /// Sends the queued requests and runs the event loop until all the outstanding ones
+    /// completed.
+    ///
+    /// Returns false if there was nothing to drive.
+    pub fn run(&mut self) -> bool {
+        let requests = self.queue.take();
+        if requests.is_empty() && !self.instances.have_outstanding_requests() {
+            return false;
+        }
+        for request in requests {
+            if let Err(e) = self.instances.handle_request(request) {
+                warn!("Failed to handle request because of {}", e);
+            }
+        }
+        if let Err(e) = self.instances.wait() {
+            warn!("Failed to run the libcouchbase event loop because of {}", e);
+        }
+        completions::flush();
+        true
+    }
+}
+
+impl fmt::Debug for InlineDriver {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        f.debug_struct("InlineDriver")
+            .field("queue", &self.queue)
+            .finish()
+    }
+}
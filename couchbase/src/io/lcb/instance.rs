@@ -1,13 +1,21 @@
 use crate::api::error::{CouchbaseError, ErrorContext};
+use crate::io::lcb::buffer::BufferReleaser;
 use crate::io::lcb::callbacks::*;
-use crate::io::lcb::encode::into_cstring;
-use crate::io::lcb::{encode_request, IoRequest};
-use crate::io::request::Request;
+use crate::io::lcb::encode::{
+    encode_counter_multi, encode_get_multi, encode_get_multi_part, encode_touch_multi,
+    into_cstring, set_submitted,
+};
+use crate::io::lcb::rows::RowThrottle;
+use crate::io::lcb::{
+    bucket_name_for_instance, couchbase_error_from_lcb_status, encode_request, IoRequest,
+};
+use crate::io::request::{GetRequestType, Request};
 use couchbase_sys::*;
 use log::{debug, warn};
 use serde_json::Value;
 use std::collections::HashMap;
 use std::ffi::CString;
+use std::mem;
 use std::os::raw::c_void;
 use std::ptr;
 
@@ -18,15 +26,28 @@ pub struct LcbInstance {
 }
 
 impl LcbInstance {
+    /// Creates a new instance and starts bootstrapping it, connected to `bucket` if given.
+    ///
+    /// This does not wait for the bootstrap: requests received in the meantime are held
+    /// back until it completed (see `OpenState`), so that instances of several buckets
+    /// bootstrap in parallel without stalling the event loop.
+    ///
+    /// If `io` is not null, the instance is created on that (shared) IO plugin instead of
+    /// getting its own, so one event loop drives all instances of a thread.
     pub fn new<S: Into<Vec<u8>>>(
         connection_string: S,
         username: Option<S>,
         password: Option<S>,
+        bucket: Option<String>,
+        io: lcb_io_opt_t,
+        releaser: Option<BufferReleaser>,
+        throttle: Option<RowThrottle>,
+        preconnect: bool,
     ) -> Result<Self, lcb_STATUS> {
         let mut inner: *mut lcb_INSTANCE = ptr::null_mut();
         let mut create_options: *mut lcb_CREATEOPTS = ptr::null_mut();
         let mut logger: *mut lcb_LOGGER = ptr::null_mut();
-        let instance_cookie = Box::new(InstanceCookie::new());
+        let instance_cookie = Box::new(InstanceCookie::new(releaser, throttle, preconnect));
 
         let (connection_string_len, connection_string) = into_cstring(connection_string);
         let (username_len, username) = match username {
@@ -52,12 +73,23 @@ impl LcbInstance {
             check_lcb_status(lcb_logger_create(&mut logger, ptr::null_mut()))?;
             check_lcb_status(lcb_logger_callback(logger, Some(logger_callback)))?;
             check_lcb_status(lcb_createopts_logger(create_options, logger))?;
+            if !io.is_null() {
+                check_lcb_status(lcb_createopts_io(create_options, io))?;
+            }
 
             check_lcb_status(lcb_createopts_connstr(
                 create_options,
                 connection_string.as_ptr(),
                 connection_string_len,
             ))?;
+            if let Some(bucket) = bucket {
+                let (bucket_len, bucket) = into_cstring(bucket);
+                check_lcb_status(lcb_createopts_bucket(
+                    create_options,
+                    bucket.as_ptr(),
+                    bucket_len,
+                ))?;
+            }
 
             if username_len > 0 && password_len > 0 {
                 check_lcb_status(lcb_createopts_credentials(
@@ -93,7 +125,6 @@ impl LcbInstance {
             lcb_set_cookie(inner, Box::into_raw(instance_cookie) as *const c_void);
 
             check_lcb_status(lcb_connect(inner))?;
-            check_lcb_status(lcb_wait(inner, lcb_WAITFLAGS_LCB_WAIT_DEFAULT))?;
         }
 
         Ok(Self { inner })
@@ -169,7 +200,10 @@ impl LcbInstance {
             Some(counter_callback),
         );
 
+        lcb_set_pktflushed_callback(instance, Some(pktflushed_callback));
+        lcb_set_bootstrap_callback(instance, Some(bootstrap_callback));
         lcb_set_open_callback(instance, Some(open_callback));
+        lcb_set_inflate_callback(instance, Some(inflate_callback));
     }
 
     /// Returns true if there is at least one oustanding request.
@@ -183,13 +217,9 @@ impl LcbInstance {
         outstanding
     }
 
-    fn increment_outstanding_requests(&mut self) {
-        let mut instance_cookie = unsafe {
-            let instance_cookie_ptr: *const c_void = lcb_get_cookie(self.inner);
-            Box::from_raw(instance_cookie_ptr as *mut InstanceCookie)
-        };
-        instance_cookie.increment_outstanding();
-        Box::into_raw(instance_cookie);
+    /// Returns true once the instance bootstrapped and is ready to take requests.
+    pub fn is_ready(&self) -> bool {
+        with_cookie(self.inner, |c| matches!(c.state, OpenState::Ready))
     }
 
     /// Makes progress on the instance without blocking.
@@ -197,29 +227,47 @@ impl LcbInstance {
         check_lcb_status(unsafe { lcb_tick_nowait(self.inner) })
     }
 
+    /// Runs the event loop until all the operations scheduled on the instance completed.
+    pub fn wait(&mut self) -> Result<(), lcb_STATUS> {
+        check_lcb_status(unsafe { lcb_wait(self.inner, lcb_WAITFLAGS_LCB_WAIT_DEFAULT) })
+    }
+
+    /// Starts opening the bucket on the (bootstrapped) instance, requests are held back
+    /// until it is open.
     pub fn bind_to_bucket(&mut self, name: String) -> Result<(), lcb_STATUS> {
         debug!("Starting bucket bind for {}", &name);
-        let (name_len, c_name) = into_cstring(name.clone());
-        unsafe {
-            check_lcb_status(lcb_open(self.inner, c_name.as_ptr(), name_len))?;
-        }
-
-        // We need a blocking wait here for now (until lcb fixes it in CCBC-1025), because
-        // right now if we nowait a incoming request can race with the open and will end
-        // up being never completed...
-        // self.tick_nowait()?;
-        unsafe {
-            lcb_wait(self.inner, lcb_WAITFLAGS_LCB_WAIT_DEFAULT);
+        let (name_len, c_name) = into_cstring(name);
+        // Before lcb_open, so requests racing with the open (CCBC-1025) are held back.
+        with_cookie(self.inner, |c| c.state = OpenState::Connecting);
+        let status = unsafe { lcb_open(self.inner, c_name.as_ptr(), name_len) };
+        if status != lcb_STATUS_LCB_SUCCESS {
+            instance_opened(self.inner, status);
         }
+        check_lcb_status(status)
+    }
 
-        debug!("Finished bucket bind for {}", &name);
-        Ok(())
+    /// Shares the cluster map of the bucket with the other instances in `group`, see
+    /// `LCB_CNTL_SHARED_CONFIG`.
+    pub fn share_config(&mut self, group: String) -> Result<(), lcb_STATUS> {
+        let (_, c_group) = into_cstring(group);
+        check_lcb_status(unsafe {
+            lcb_cntl(
+                self.inner,
+                LCB_CNTL_SET as i32,
+                LCB_CNTL_SHARED_CONFIG as i32,
+                c_group.as_ptr() as *mut c_void,
+            )
+        })
     }
 
+    /// Schedules the request, or holds it back until the instance is ready.
     pub fn handle_request(&mut self, request: Request) {
-        match encode_request(self.inner, request) {
-            Ok(_) => self.increment_outstanding_requests(),
-            Err(e) => warn!("Failed to encode request because of {:?}", e),
+        match with_cookie(self.inner, |c| c.state) {
+            OpenState::Ready => schedule_request(self.inner, request),
+            OpenState::Failed(status) => request.fail(&|| open_error(status)),
+            OpenState::Connecting | OpenState::Preconnecting => {
+                with_cookie(self.inner, |c| c.deferred.push(request))
+            }
         }
     }
 }
@@ -233,6 +281,183 @@ impl Drop for LcbInstance {
     }
 }
 
+/// Hands the request to libcouchbase.
+fn schedule_request(instance: *mut lcb_INSTANCE, request: Request) {
+    match request {
+        Request::Batch(requests) => {
+            // Scheduling all of them in one context means libcouchbase only flushes
+            // each pipeline once when leaving it instead of once per request.
+            unsafe { lcb_sched_enter(instance) };
+            // Counters, touches and get-and-touches go through the multi-key commands
+            // instead, which also group them by the server they map to.
+            let mut counters = vec![];
+            let mut touches = vec![];
+            let mut get_and_touches = vec![];
+            for request in requests {
+                match request {
+                    Request::Counter(r) => counters.push(r),
+                    Request::Touch(r) => touches.push(r),
+                    Request::Get(r) if matches!(r.ty, GetRequestType::GetAndTouch { .. }) => {
+                        get_and_touches.push(r)
+                    }
+                    request => schedule_request(instance, request),
+                }
+            }
+            if !counters.is_empty() {
+                encode_counter_multi(instance, counters);
+            }
+            if !touches.is_empty() {
+                encode_touch_multi(instance, touches);
+            }
+            if !get_and_touches.is_empty() {
+                encode_get_multi(instance, get_and_touches);
+            }
+            unsafe { lcb_sched_leave(instance) };
+        }
+        Request::GetMulti(request) => {
+            unsafe { lcb_sched_enter(instance) };
+            encode_get_multi_part(instance, request);
+            unsafe { lcb_sched_leave(instance) };
+        }
+        request => match encode_request(instance, request) {
+            Ok(_) => add_outstanding_requests(instance, 1),
+            Err(e) => warn!("Failed to encode request because of {:?}", e),
+        },
+    }
+}
+
+/// The error requests fail with if their instance could not be opened.
+fn open_error(status: lcb_STATUS) -> CouchbaseError {
+    let mut ctx = ErrorContext::default();
+    ctx.insert(
+        "cause",
+        Value::String("The libcouchbase instance could not be bootstrapped".into()),
+    );
+    couchbase_error_from_lcb_status(status, ctx)
+}
+
+/// Called once the instance bootstrapped or opened its bucket, or failed to.
+///
+/// Bucket instances report both, only the first one counts.
+pub fn instance_opened(instance: *mut lcb_INSTANCE, status: lcb_STATUS) {
+    if !with_cookie(instance, |c| matches!(c.state, OpenState::Connecting)) {
+        return;
+    }
+    if status != lcb_STATUS_LCB_SUCCESS {
+        let deferred = with_cookie(instance, |c| {
+            c.state = OpenState::Failed(status);
+            mem::take(&mut c.deferred)
+        });
+        for request in deferred {
+            request.fail(&|| open_error(status));
+        }
+        return;
+    }
+
+    let preconnect = with_cookie(instance, |c| c.preconnect);
+    if preconnect && bucket_name_for_instance(instance).is_some() && start_preconnect(instance) {
+        with_cookie(instance, |c| c.state = OpenState::Preconnecting);
+    } else {
+        instance_ready(instance);
+    }
+}
+
+/// Called once the connections to all key-value nodes were attempted, see
+/// `start_preconnect`.
+pub fn instance_preconnected(instance: *mut lcb_INSTANCE, status: lcb_STATUS) {
+    if status != lcb_STATUS_LCB_SUCCESS {
+        // The nodes which could not be reached are connected on demand as usual.
+        debug!(
+            "Could not connect to all key-value nodes ahead of time: {}",
+            status
+        );
+    }
+    if with_cookie(instance, |c| matches!(c.state, OpenState::Preconnecting)) {
+        instance_ready(instance);
+    }
+}
+
+/// Pings all key-value nodes, which makes libcouchbase connect to each of them.
+fn start_preconnect(instance: *mut lcb_INSTANCE) -> bool {
+    let mut command: *mut lcb_CMDPING = ptr::null_mut();
+    let status = unsafe {
+        lcb_cmdping_create(&mut command);
+        lcb_cmdping_kv(command, 1);
+        // The missing cookie tells the ping callback that this is no application ping.
+        let status = lcb_ping(instance, ptr::null_mut(), command);
+        lcb_cmdping_destroy(command);
+        status
+    };
+    if status != lcb_STATUS_LCB_SUCCESS {
+        debug!(
+            "Could not start connecting to the key-value nodes: {}",
+            status
+        );
+        return false;
+    }
+    add_outstanding_requests(instance, 1);
+    true
+}
+
+/// Marks the instance as ready and schedules the requests held back until then.
+fn instance_ready(instance: *mut lcb_INSTANCE) {
+    let deferred = with_cookie(instance, |c| {
+        c.state = OpenState::Ready;
+        mem::take(&mut c.deferred)
+    });
+    debug!(
+        "Instance of bucket {:?} is ready, scheduling {} held back request(s)",
+        bucket_name_for_instance(instance),
+        deferred.len()
+    );
+    for request in deferred {
+        schedule_request(instance, request);
+    }
+}
+
+/// Runs `f` on the cookie of the instance.
+fn with_cookie<R>(instance: *mut lcb_INSTANCE, f: impl FnOnce(&mut InstanceCookie) -> R) -> R {
+    let mut instance_cookie = unsafe {
+        let instance_cookie_ptr: *const c_void = lcb_get_cookie(instance);
+        Box::from_raw(instance_cookie_ptr as *mut InstanceCookie)
+    };
+    let result = f(&mut instance_cookie);
+    Box::into_raw(instance_cookie);
+    result
+}
+
+/// Returns the releaser for pinned network buffers if zero-copy values are enabled.
+pub fn buffer_releaser(instance: *mut lcb_INSTANCE) -> Option<BufferReleaser> {
+    let instance_cookie = unsafe {
+        let instance_cookie_ptr: *const c_void = lcb_get_cookie(instance);
+        Box::from_raw(instance_cookie_ptr as *mut InstanceCookie)
+    };
+    let releaser = instance_cookie.releaser.clone();
+    Box::into_raw(instance_cookie);
+    releaser
+}
+
+/// Returns the throttle for streamed rows if a row buffer budget is configured.
+pub fn row_throttle(instance: *mut lcb_INSTANCE) -> Option<RowThrottle> {
+    let instance_cookie = unsafe {
+        let instance_cookie_ptr: *const c_void = lcb_get_cookie(instance);
+        Box::from_raw(instance_cookie_ptr as *mut InstanceCookie)
+    };
+    let throttle = instance_cookie.throttle.clone();
+    Box::into_raw(instance_cookie);
+    throttle
+}
+
+/// Accounts for requests which are scheduled in one go by the multi-key encoders.
+pub fn add_outstanding_requests(instance: *mut lcb_INSTANCE, count: usize) {
+    let mut instance_cookie = unsafe {
+        let instance_cookie_ptr: *const c_void = lcb_get_cookie(instance);
+        Box::from_raw(instance_cookie_ptr as *mut InstanceCookie)
+    };
+    instance_cookie.add_outstanding(count);
+    Box::into_raw(instance_cookie);
+}
+
 pub fn decrement_outstanding_requests(instance: *mut lcb_INSTANCE) {
     let mut instance_cookie = unsafe {
         let instance_cookie_ptr: *const c_void = lcb_get_cookie(instance);
@@ -242,30 +467,61 @@ pub fn decrement_outstanding_requests(instance: *mut lcb_INSTANCE) {
     Box::into_raw(instance_cookie);
 }
 
+/// Whether an instance can take requests.
+#[derive(Debug, Clone, Copy)]
+enum OpenState {
+    /// Bootstrapping or opening its bucket, requests are held back.
+    Connecting,
+    /// Connecting to all key-value nodes before it reports ready, requests are held back.
+    Preconnecting,
+    Ready,
+    /// The bootstrap failed with the given status, requests fail right away.
+    Failed(lcb_STATUS),
+}
+
 /// A stateful cookie associated with a single instance.
 ///
 /// This cookie is available everywhere the instance is used, so it can
 /// be used to track instance-global state.
-#[derive(Debug)]
 struct InstanceCookie {
     outstanding: usize,
+    releaser: Option<BufferReleaser>,
+    throttle: Option<RowThrottle>,
+    state: OpenState,
+    // Requests received before the instance was ready
+    deferred: Vec<Request>,
+    // Set if the instance connects to all key-value nodes before it reports ready
+    preconnect: bool,
 }
 
 impl InstanceCookie {
-    pub fn new() -> Self {
-        Self { outstanding: 0 }
+    pub fn new(
+        releaser: Option<BufferReleaser>,
+        throttle: Option<RowThrottle>,
+        preconnect: bool,
+    ) -> Self {
+        Self {
+            outstanding: 0,
+            releaser,
+            throttle,
+            state: OpenState::Connecting,
+            deferred: vec![],
+            preconnect,
+        }
     }
 
-    pub fn increment_outstanding(&mut self) {
-        self.outstanding += 1
+    pub fn add_outstanding(&mut self, count: usize) {
+        self.outstanding += count
     }
 
     pub fn decrement_outstanding(&mut self) {
         self.outstanding -= 1
     }
 
+    /// Held back requests count as well, since they wait for the bootstrap to progress.
     pub fn has_outstanding(&self) -> bool {
         self.outstanding > 0
+            || matches!(self.state, OpenState::Connecting | OpenState::Preconnecting)
     }
 }
 
@@ -274,15 +530,120 @@ impl InstanceCookie {
 /// Each libcouchbase `lcb_insstance` can only handle a single bucket at a time.
 /// In order to handle multiple, we need to multiplex them in rust so that the
 /// higher level API can use as many as it needs.
-#[derive(Default)]
 pub struct LcbInstances {
     // The global (gcccp, unbound) instance if present
     global: Option<LcbInstance>,
     // All the instances that are already bound to a bucket
     bound: HashMap<String, LcbInstance>,
+    // The IO plugin shared by all instances, null if each instance owns its own
+    io: lcb_io_opt_t,
+    // Allows other threads to interrupt the shared event loop, null if not supported
+    wakeup: *mut lcb_WAKEUP,
+    // Set if values should be handed out without copying them
+    releaser: Option<BufferReleaser>,
+    // Set if streamed rows are bounded by a buffer budget
+    throttle: Option<RowThrottle>,
+    // Prefix of the groups in which the bucket instances share their cluster map with
+    // those of the other IO threads, if there are several
+    config_group: Option<String>,
+    // Set if bucket instances connect to all key-value nodes before they take requests
+    preconnect: bool,
 }
 
 impl LcbInstances {
+    /// Creates an empty set of instances.
+    ///
+    /// This tries to set up a shared IO plugin together with a wakeup handle, so that
+    /// the owning thread can block in the event loop instead of polling. If that is not
+    /// supported on this platform or plugin, each instance gets its own IO as before.
+    pub fn new(
+        releaser: Option<BufferReleaser>,
+        throttle: Option<RowThrottle>,
+        config_group: Option<String>,
+        preconnect: bool,
+    ) -> Self {
+        let mut io: lcb_io_opt_t = ptr::null_mut();
+        let mut wakeup: *mut lcb_WAKEUP = ptr::null_mut();
+        unsafe {
+            if lcb_create_io_ops(&mut io, ptr::null()) == lcb_STATUS_LCB_SUCCESS {
+                let status = lcb_wakeup_create(io, &mut wakeup);
+                if status != lcb_STATUS_LCB_SUCCESS {
+                    debug!(
+                        "Event loop wakeup not available ({}), falling back to polling",
+                        status
+                    );
+                    lcb_destroy_io_ops(io);
+                    io = ptr::null_mut();
+                    wakeup = ptr::null_mut();
+                }
+            } else {
+                io = ptr::null_mut();
+            }
+        }
+
+        Self {
+            global: None,
+            bound: HashMap::new(),
+            io,
+            wakeup,
+            releaser,
+            throttle,
+            config_group,
+            preconnect,
+        }
+    }
+
+    /// Creates an empty set of instances sharing the IO plugin `io`, which is destroyed
+    /// along with them.
+    ///
+    /// The event loop of such a plugin is run by its owner, so there is no wakeup handle.
+    pub fn with_io(io: lcb_io_opt_t, preconnect: bool) -> Self {
+        Self {
+            global: None,
+            bound: HashMap::new(),
+            io,
+            wakeup: ptr::null_mut(),
+            releaser: None,
+            throttle: None,
+            config_group: None,
+            preconnect,
+        }
+    }
+
+    /// Returns the wakeup handle of the shared event loop, or null if not available.
+    pub fn wakeup(&self) -> *mut lcb_WAKEUP {
+        self.wakeup
+    }
+
+    /// Creates a new instance on the shared IO plugin (if any), connected to `bucket` if
+    /// given.
+    pub fn create_instance<S: Into<Vec<u8>>>(
+        &self,
+        connection_string: S,
+        username: Option<S>,
+        password: Option<S>,
+        bucket: Option<String>,
+    ) -> Result<LcbInstance, lcb_STATUS> {
+        LcbInstance::new(
+            connection_string,
+            username,
+            password,
+            bucket,
+            self.io,
+            self.releaser.clone(),
+            self.throttle.clone(),
+            self.preconnect,
+        )
+    }
+
+    /// Blocks in the shared event loop until `lcb_wakeup_signal` is called on the
+    /// wakeup handle.
+    ///
+    /// Must only be called if `wakeup()` is not null.
+    pub fn run_until_woken(&mut self) {
+        unsafe { lcb_wakeup_run(self.wakeup) }
+    }
+
     pub fn set_unbound(&mut self, instance: LcbInstance) {
         self.global = Some(instance);
     }
@@ -291,17 +652,32 @@ impl LcbInstances {
         self.bound.insert(bucket, instance);
     }
 
+    /// Returns true if there is an unbound instance which can open a bucket right away.
     pub fn has_unbound_instance(&self) -> bool {
-        self.global.is_some()
+        self.global.as_ref().map_or(false, LcbInstance::is_ready)
     }
 
     pub fn bind_unbound_to_bucket(&mut self, bucket: String) -> Result<(), lcb_STATUS> {
         let mut instance = self.global.take().unwrap();
         instance.bind_to_bucket(bucket.clone())?;
+        self.join_config_group(&bucket, &mut instance);
         self.set_bound(bucket, instance);
         Ok(())
     }
 
+    /// Lets a newly bound instance share its cluster map with the instances of the
+    /// other IO threads bound to the same bucket.
+    fn join_config_group(&self, bucket: &str, instance: &mut LcbInstance) {
+        if let Some(prefix) = &self.config_group {
+            if let Err(e) = instance.share_config(format!("{}/{}", prefix, bucket)) {
+                warn!(
+                    "Could not share the configuration of bucket {}: {}",
+                    bucket, e
+                );
+            }
+        }
+    }
+
     pub fn have_outstanding_requests(&self) -> bool {
         if let Some(i) = &self.global {
             if i.has_outstanding_requests() {
@@ -320,7 +696,8 @@ impl LcbInstances {
 
     pub fn handle_request(&mut self, request: IoRequest) -> Result<bool, lcb_STATUS> {
         match request {
-            IoRequest::Data(r) => {
+            IoRequest::Data(r, submitted) => {
+                set_submitted(submitted);
                 let instance = match r.bucket() {
                     Some(b) => self.bound.get_mut(b),
                     None => {
@@ -334,19 +711,23 @@ impl LcbInstances {
                 match instance {
                     Some(i) => i.handle_request(r),
                     None => {
-                        let mut ctx = ErrorContext::default();
-                        ctx.insert(
-                            "cause",
-                            Value::String(
-                                "No active libcouchbase instance found to handle the request! Did bootstrap fail?"
-                                    .into(),
-                            ),
-                        );
-                        r.fail(CouchbaseError::RequestCanceled { ctx });
+                        r.fail(&|| {
+                            let mut ctx = ErrorContext::default();
+                            ctx.insert(
+                                "cause",
+                                Value::String(
+                                    "No active libcouchbase instance found to handle the request! Did bootstrap fail?"
+                                        .into(),
+                                ),
+                            );
+                            CouchbaseError::RequestCanceled { ctx }
+                        });
                         warn!("Cannot dispatch operation because no open bucket found!");
                     }
                 };
             }
+            IoRequest::ReleaseBuffer(buf) => unsafe { buf.release() },
+            IoRequest::ResumeRows(budget) => budget.resume_now(),
             IoRequest::Shutdown => return Ok(true),
             IoRequest::OpenBucket {
                 name,
@@ -358,9 +739,16 @@ impl LcbInstances {
                     if self.has_unbound_instance() {
                         self.bind_unbound_to_bucket(name)?
                     } else {
-                        match LcbInstance::new(connection_string, username, password) {
+                        // Bootstraps in parallel with the other instances, rather than
+                        // waiting for the unbound instance to be ready.
+                        match self.create_instance(
+                            connection_string,
+                            username,
+                            password,
+                            Some(name.clone()),
+                        ) {
                             Ok(mut i) => {
-                                i.bind_to_bucket(name.clone())?;
+                                self.join_config_group(&name, &mut i);
                                 self.set_bound(name, i);
                             }
                             Err(e) => {
@@ -385,6 +773,40 @@ impl LcbInstances {
 
         Ok(())
     }
+
+    /// Runs the event loop until all the outstanding operations of every instance
+    /// completed.
+    pub fn wait(&mut self) -> Result<(), lcb_STATUS> {
+        if let Some(i) = &mut self.global {
+            if i.has_outstanding_requests() {
+                i.wait()?;
+            }
+        }
+
+        for i in self.bound.values_mut() {
+            if i.has_outstanding_requests() {
+                i.wait()?;
+            }
+        }
+
+        Ok(())
+    }
+}
+
+impl Drop for LcbInstances {
+    fn drop(&mut self) {
+        // All instances need to be gone before the IO they share is torn down.
+        self.global.take();
+        self.bound.clear();
+        unsafe {
+            if !self.wakeup.is_null() {
+                lcb_wakeup_destroy(self.wakeup);
+            }
+            if !self.io.is_null() {
+                lcb_destroy_io_ops(self.io);
+            }
+        }
+    }
 }
 
 #[allow(non_upper_case_globals)]
@@ -1,6 +1,24 @@
+mod affinity;
+#[cfg(feature = "bench-internals")]
+pub mod bench;
+mod buffer;
 mod callbacks;
+mod completions;
+mod cookies;
 mod encode;
+mod inline;
 mod instance;
+#[cfg(all(feature = "tokio", unix))]
+mod reactor;
+mod rows;
+#[cfg(all(feature = "tokio", unix))]
+mod tokio_io;
+
+pub(crate) use buffer::RetainedBuffer;
+pub(crate) use inline::{InlineDriver, InlineQueue};
+#[cfg(all(feature = "tokio", unix))]
+pub(crate) use reactor::{ReactorDriver, ReactorQueue};
+pub(crate) use rows::RowReceiver;
 
 pub(crate) use callbacks::couchbase_error_from_lcb_status;
 pub(crate) use encode::{
@@ -9,52 +27,190 @@ pub(crate) use encode::{
 };
 
 use crate::api::error::CouchbaseResult;
+use crate::api::query_result::RawQueryMetaData;
 use crate::{
-    AnalyticsMetaData, AnalyticsResult, GenericManagementResult, QueryMetaData, QueryResult,
-    SearchMetaData, SearchResult, ViewMetaData, ViewResult, ViewRow,
+    AnalyticsMetaData, AnalyticsResult, GenericManagementResult, IoThreadReport, MutationResult,
+    QueryResult, SearchMetaData, SearchResult, ViewMetaData, ViewResult, ViewRow,
 };
 
 use encode::EncodeFailure;
 
-use crate::io::request::Request;
-use instance::{LcbInstance, LcbInstances};
+use crate::io::request::{GetMultiRequest, Request};
+use crate::io::IoConfig;
+use buffer::{BackBuf, BufferReleaser};
+use instance::LcbInstances;
+use rows::{RowBudget, RowSender, RowThrottle};
 
 use couchbase_sys::*;
-use crossbeam_channel::RecvTimeoutError;
 use crossbeam_channel::{unbounded, Receiver, Sender};
+use crossbeam_channel::{RecvTimeoutError, SendError, TryRecvError};
 use log::{debug, warn};
 use std::ffi::CStr;
+use std::fmt;
 use std::os::raw::{c_char, c_int, c_uint, c_void};
+use std::sync::atomic::{AtomicBool, AtomicUsize, Ordering};
+use std::sync::{Arc, RwLock};
 use std::thread::JoinHandle;
-use std::time::Duration;
+use std::time::{Duration, Instant};
 use std::{ptr, thread};
 
+/// Numbers the shared configuration groups of the `IoCore`s of this process.
+static NEXT_CONFIG_GROUP: AtomicUsize = AtomicUsize::new(0);
+
 #[derive(Debug)]
 pub struct IoCore {
-    thread_handle: Option<JoinHandle<()>>,
-    queue_tx: Sender<IoRequest>,
+    shards: Vec<IoShard>,
+    next_shard: AtomicUsize,
     connection_string: String,
     username: Option<String>,
     password: Option<String>,
 }
 
+/// A single lcb event loop thread together with the queue used to feed it.
+///
+/// Every shard owns its own set of `LcbInstances`. The only state shared between them
+/// is the cluster map of each bucket, which libcouchbase keeps in a shared
+/// configuration group.
+#[derive(Debug)]
+struct IoShard {
+    thread_handle: Option<JoinHandle<()>>,
+    name: String,
+    /// The CPUs the thread is pinned to, empty if it runs on any.
+    cpus: Arc<RwLock<Vec<usize>>>,
+    queue_tx: Sender<IoRequest>,
+    waker: Arc<LoopWaker>,
+}
+
+impl IoShard {
+    fn send(&self, request: IoRequest) -> Result<(), SendError<IoRequest>> {
+        self.queue_tx.send(request)?;
+        self.waker.wake();
+        Ok(())
+    }
+}
+
+/// Wrapper so the wakeup handle can be shared with the threads submitting requests.
+struct WakeupPtr(*mut lcb_WAKEUP);
+
+// lcb_wakeup_signal is the one lcb function which is safe to call from any thread.
+unsafe impl Send for WakeupPtr {}
+unsafe impl Sync for WakeupPtr {}
+
+/// Wakes up an lcb thread blocked in its event loop when new requests are queued.
+///
+/// Signals are coalesced: only the first request after the loop drained its queue
+/// pays for the syscall.
+#[derive(Default)]
+struct LoopWaker {
+    wakeup: RwLock<Option<WakeupPtr>>,
+    notified: AtomicBool,
+}
+
+impl LoopWaker {
+    fn wake(&self) {
+        if !self.notified.swap(true, Ordering::AcqRel) {
+            if let Some(w) = &*self.wakeup.read().unwrap() {
+                unsafe {
+                    lcb_wakeup_signal(w.0);
+                }
+            }
+        }
+    }
+}
+
+impl fmt::Debug for LoopWaker {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        f.debug_struct("LoopWaker")
+            .field("notified", &self.notified.load(Ordering::Relaxed))
+            .finish()
+    }
+}
+
 impl IoCore {
     pub fn new(
         connection_string: String,
         username: Option<String>,
         password: Option<String>,
+        config: IoConfig,
     ) -> Self {
-        debug!("Using libcouchbase IO transport");
+        let io_threads = config.io_threads.max(1);
+        debug!(
+            "Using libcouchbase IO transport with {} IO thread(s)",
+            io_threads
+        );
+        // With several IO threads, each of them opens every bucket. Their instances of a
+        // bucket share one cluster map instead of each fetching and polling it.
+        let config_group = if io_threads > 1 {
+            Some(format!(
+                "couchbase-rs-{}",
+                NEXT_CONFIG_GROUP.fetch_add(1, Ordering::Relaxed)
+            ))
+        } else {
+            None
+        };
 
-        let (queue_tx, queue_rx) = unbounded();
+        let shards = (0..io_threads)
+            .map(|idx| {
+                let (queue_tx, queue_rx) = unbounded();
+                let waker = Arc::new(LoopWaker::default());
+
+                let cstring = connection_string.clone();
+                let uname = username.clone();
+                let pwd = password.clone();
+                let loop_waker = waker.clone();
+                let releaser = config
+                    .zero_copy_threshold
+                    .map(|size| BufferReleaser::new(queue_tx.clone(), waker.clone(), size));
+                let throttle = config
+                    .row_buffer_budget
+                    .map(|size| RowThrottle::new(queue_tx.clone(), waker.clone(), size));
+                let group = config_group.clone();
+                let preconnect = config.preconnect;
+                let name = format!("couchbase-lcb-{}", idx);
+                let thread_name = name.clone();
+                let affinity = config
+                    .io_affinity
+                    .as_ref()
+                    .map(|a| affinity::cpus_for_thread(a, idx))
+                    .unwrap_or_default();
+                let cpus = Arc::new(RwLock::new(vec![]));
+                let pinned = cpus.clone();
+                let thread_handle = thread::Builder::new()
+                    .name(name.clone())
+                    .spawn(move || {
+                        // Pinned before any instance is created, so their buffers are
+                        // allocated on the NUMA node of the thread.
+                        if !affinity.is_empty() {
+                            match affinity::pin_current_thread(&affinity) {
+                                Ok(()) => {
+                                    debug!("Pinned {} to CPUs {:?}", thread_name, affinity);
+                                    *pinned.write().unwrap() = affinity;
+                                }
+                                Err(e) => warn!(
+                                    "Could not pin {} to CPUs {:?} (errno {})",
+                                    thread_name, affinity, e
+                                ),
+                            }
+                        }
+                        run_lcb_loop(
+                            queue_rx, loop_waker, releaser, throttle, group, preconnect, cstring,
+                            uname, pwd,
+                        )
+                    })
+                    .expect("Could not spawn lcb thread");
+                IoShard {
+                    thread_handle: Some(thread_handle),
+                    name,
+                    cpus,
+                    queue_tx,
+                    waker,
+                }
+            })
+            .collect();
 
-        let cstring = connection_string.clone();
-        let uname = username.clone();
-        let pwd = password.clone();
-        let thread_handle = thread::spawn(move || run_lcb_loop(queue_rx, cstring, uname, pwd));
         Self {
-            thread_handle: Some(thread_handle),
-            queue_tx,
+            shards,
+            next_shard: AtomicUsize::new(0),
             connection_string,
             username,
             password,
@@ -62,54 +218,216 @@ impl IoCore {
     }
 
     pub fn send(&self, request: Request) {
-        self.queue_tx
-            .send(IoRequest::Data(request))
+        let request = match request {
+            Request::Batch(requests) => return self.send_batch(requests),
+            Request::GetMulti(request) => return self.send_get_multi(request),
+            request => request,
+        };
+
+        let shard = match request.key() {
+            Some(key) => shard_for_key(key.as_bytes(), self.shards.len()),
+            None => self.next_shard.fetch_add(1, Ordering::Relaxed) % self.shards.len(),
+        };
+        self.shards[shard]
+            .send(IoRequest::Data(request, Instant::now()))
             .expect("Could not send request")
     }
 
-    pub fn open_bucket(&self, name: String) {
-        self.queue_tx
-            .send(IoRequest::OpenBucket {
-                name,
-                connection_string: self.connection_string.clone(),
-                username: self.username.clone(),
-                password: self.password.clone(),
+    /// Splits a batch into one (flat) batch per shard, so that each shard can still
+    /// schedule its part of the batch together.
+    fn send_batch(&self, requests: Vec<Request>) {
+        let mut per_shard: Vec<Vec<Request>> = self.shards.iter().map(|_| Vec::new()).collect();
+        let mut pending = requests;
+        while let Some(request) = pending.pop() {
+            match request {
+                Request::Batch(inner) => pending.extend(inner),
+                r => {
+                    let shard = match r.key() {
+                        Some(key) => shard_for_key(key.as_bytes(), self.shards.len()),
+                        None => 0,
+                    };
+                    per_shard[shard].push(r);
+                }
+            }
+        }
+
+        for (shard, mut requests) in per_shard.into_iter().enumerate() {
+            if requests.is_empty() {
+                continue;
+            }
+            // Popping reversed the order, restore it so requests go out as submitted.
+            requests.reverse();
+            self.shards[shard]
+                .send(IoRequest::Data(Request::Batch(requests), Instant::now()))
+                .expect("Could not send request")
+        }
+    }
+
+    /// Splits a multi-get into one part per shard, each holding the ids which that shard
+    /// would have been sent on their own.
+    fn send_get_multi(&self, request: GetMultiRequest) {
+        let mut per_shard: Vec<Vec<(usize, String)>> =
+            self.shards.iter().map(|_| Vec::new()).collect();
+        for (index, id) in request.ids {
+            per_shard[shard_for_key(id.as_bytes(), self.shards.len())].push((index, id));
+        }
+
+        for (shard, ids) in per_shard.into_iter().enumerate() {
+            if ids.is_empty() {
+                continue;
+            }
+            let part = GetMultiRequest {
+                ids,
+                bucket: request.bucket.clone(),
+                scope: request.scope.clone(),
+                collection: request.collection.clone(),
+                options: request.options.clone(),
+                gather: request.gather.clone(),
+            };
+            self.shards[shard]
+                .send(IoRequest::Data(Request::GetMulti(part), Instant::now()))
+                .expect("Could not send request")
+        }
+    }
+
+    /// Describes the IO threads and where they run.
+    pub fn io_threads(&self) -> Vec<IoThreadReport> {
+        self.shards
+            .iter()
+            .map(|shard| {
+                IoThreadReport::new(shard.name.clone(), shard.cpus.read().unwrap().clone())
             })
-            .expect("Could not send open bucket request")
+            .collect()
+    }
+
+    pub fn open_bucket(&self, name: String) {
+        for shard in &self.shards {
+            shard
+                .send(IoRequest::OpenBucket {
+                    name: name.clone(),
+                    connection_string: self.connection_string.clone(),
+                    username: self.username.clone(),
+                    password: self.password.clone(),
+                })
+                .expect("Could not send open bucket request")
+        }
     }
 }
 
 impl Drop for IoCore {
     fn drop(&mut self) {
         debug!("Dropping LCB IoCore, sending shutdown signal");
-        self.queue_tx
-            .send(IoRequest::Shutdown)
-            .expect("Failure while shutting down!");
-        self.thread_handle
-            .take()
-            .unwrap()
-            .join()
-            .expect("Failure while waiting for lcb thread to die!");
-        debug!("LCB Thread completed, finishing Drop sequence");
+        for shard in &self.shards {
+            shard
+                .send(IoRequest::Shutdown)
+                .expect("Failure while shutting down!");
+        }
+        for shard in &mut self.shards {
+            shard
+                .thread_handle
+                .take()
+                .unwrap()
+                .join()
+                .expect("Failure while waiting for lcb thread to die!");
+        }
+        debug!("LCB Threads completed, finishing Drop sequence");
+    }
+}
+
+/// Maps a document id onto one of `num_shards` IO shards.
+///
+/// This uses the same CRC32 based hash libcouchbase applies to find the vBucket of a key,
+/// so all keys of a given vBucket always end up on the same shard, which preserves the
+/// per-key ordering of operations even with multiple IO threads.
+fn shard_for_key(key: &[u8], num_shards: usize) -> usize {
+    if num_shards <= 1 {
+        return 0;
     }
+    let vbid = ((crc32(key) >> 16) & 0x7fff) as usize % NUM_ROUTING_VBUCKETS;
+    vbid % num_shards
+}
+
+/// Server vBucket counts (1024, or 64 on some platforms) are multiples of this, so routing
+/// on it keeps every vBucket on a single shard regardless of the actual configuration.
+const NUM_ROUTING_VBUCKETS: usize = 64;
+
+fn crc32(key: &[u8]) -> u32 {
+    let mut crc = 0xffff_ffffu32;
+    for byte in key {
+        crc ^= *byte as u32;
+        for _ in 0..8 {
+            let mask = (!(crc & 1)).wrapping_add(1);
+            crc = (crc >> 1) ^ (0xedb8_8320 & mask);
+        }
+    }
+    !crc
 }
 
 fn run_lcb_loop(
     queue_rx: Receiver<IoRequest>,
+    waker: Arc<LoopWaker>,
+    releaser: Option<BufferReleaser>,
+    throttle: Option<RowThrottle>,
+    config_group: Option<String>,
+    preconnect: bool,
     connection_string: String,
     username: Option<String>,
     password: Option<String>,
 ) {
-    let mut instances = LcbInstances::default();
+    let mut instances = LcbInstances::new(releaser, throttle, config_group, preconnect);
 
     let user_bytes = username.map(|u| u.into_bytes());
     let pass_bytes = password.map(|p| p.into_bytes());
 
-    match LcbInstance::new(connection_string.into_bytes(), user_bytes, pass_bytes) {
+    match instances.create_instance(connection_string.into_bytes(), user_bytes, pass_bytes, None) {
         Ok(i) => instances.set_unbound(i),
         Err(e) => warn!("Could not open libcouchbase instance {}", e),
     };
 
+    if instances.wakeup().is_null() {
+        run_polling_loop(&queue_rx, &mut instances);
+    } else {
+        *waker.wakeup.write().unwrap() = Some(WakeupPtr(instances.wakeup()));
+        completions::set_wakeup(instances.wakeup());
+        run_event_loop(&queue_rx, &waker, &mut instances);
+        // Make sure nobody signals the handle after it has been destroyed.
+        waker.wakeup.write().unwrap().take();
+        completions::set_wakeup(ptr::null_mut());
+    }
+    rows::resume_paused();
+    drop(instances);
+    // Operations still outstanding failed while the instances were destroyed.
+    completions::flush();
+    // Buffers handed out to the application which come back from now on are released
+    // as orphaned when their request is dropped, along with the queue or on sending.
+}
+
+/// Blocks in the libcouchbase event loop and only returns to drain the request queue
+/// once the `LoopWaker` signals that new requests are available.
+fn run_event_loop(queue_rx: &Receiver<IoRequest>, waker: &LoopWaker, instances: &mut LcbInstances) {
+    'running: loop {
+        // Reset before draining, so requests queued from now on signal again.
+        waker.notified.store(false, Ordering::Release);
+        loop {
+            match queue_rx.try_recv() {
+                Ok(req) => {
+                    if instances.handle_request(req).unwrap() {
+                        // We got shut down, bail out.
+                        break 'running;
+                    }
+                }
+                Err(TryRecvError::Disconnected) => break 'running,
+                Err(TryRecvError::Empty) => break,
+            }
+        }
+
+        instances.run_until_woken();
+        completions::flush();
+    }
+}
+
+/// Fallback if the IO plugin cannot be woken up from another thread.
+fn run_polling_loop(queue_rx: &Receiver<IoRequest>, instances: &mut LcbInstances) {
     'running: loop {
         if instances.have_outstanding_requests() {
             while let Ok(req) = queue_rx.try_recv() {
@@ -136,6 +454,7 @@ fn run_lcb_loop(
         }
 
         instances.tick_nowait().unwrap();
+        completions::flush();
     }
 }
 
@@ -180,13 +499,18 @@ extern "C" {
 
 #[derive(Debug)]
 pub enum IoRequest {
-    Data(Request),
+    /// A request along with when it was submitted, which its timeout counts from.
+    Data(Request, Instant),
     OpenBucket {
         name: String,
         connection_string: String,
         username: Option<String>,
         password: Option<String>,
     },
+    /// Releases a network buffer which has been pinned for a `RetainedBuffer`.
+    ReleaseBuffer(BackBuf),
+    /// Resumes reading a streaming request once its consumer caught up.
+    ResumeRows(Arc<RowBudget>),
     Shutdown,
 }
 
@@ -208,31 +532,45 @@ fn encode_request(instance: *mut lcb_INSTANCE, request: Request) -> Result<(), E
         Request::Unlock(r) => encode::encode_unlock(instance, r)?,
         Request::Touch(r) => encode::encode_touch(instance, r)?,
         Request::GetReplica(r) => encode::encode_get_replica(instance, r)?,
+        Request::Batch(_) => unreachable!("Batches are unpacked before encoding"),
+        Request::GetMulti(_) => unreachable!("Multi-gets are scheduled by the instance"),
     }
 
     Ok(())
 }
 
+/// The cookie of a store, which may also own the value libcouchbase is writing
+/// to the socket without copying it.
+///
+/// It is freed by whichever comes last: the response, or the value not being
+/// referenced anymore (the packet flushed callback).
+struct MutateCookie {
+    sender: Option<futures::channel::oneshot::Sender<CouchbaseResult<MutationResult>>>,
+    value: Option<Vec<u8>>,
+}
+
 struct QueryCookie {
     sender: Option<futures::channel::oneshot::Sender<CouchbaseResult<QueryResult>>>,
-    rows_sender: futures::channel::mpsc::UnboundedSender<Vec<u8>>,
-    rows_receiver: Option<futures::channel::mpsc::UnboundedReceiver<Vec<u8>>>,
-    meta_sender: futures::channel::oneshot::Sender<QueryMetaData>,
-    meta_receiver: Option<futures::channel::oneshot::Receiver<QueryMetaData>>,
+    rows_sender: RowSender,
+    rows_receiver: Option<RowReceiver>,
+    meta_sender: futures::channel::oneshot::Sender<RawQueryMetaData>,
+    meta_receiver: Option<futures::channel::oneshot::Receiver<RawQueryMetaData>>,
+    // Set if the metadata is dropped rather than handed to the result
+    skip_meta: bool,
 }
 
 struct AnalyticsCookie {
     sender: Option<futures::channel::oneshot::Sender<CouchbaseResult<AnalyticsResult>>>,
-    rows_sender: futures::channel::mpsc::UnboundedSender<Vec<u8>>,
-    rows_receiver: Option<futures::channel::mpsc::UnboundedReceiver<Vec<u8>>>,
+    rows_sender: RowSender,
+    rows_receiver: Option<RowReceiver>,
     meta_sender: futures::channel::oneshot::Sender<AnalyticsMetaData>,
     meta_receiver: Option<futures::channel::oneshot::Receiver<AnalyticsMetaData>>,
 }
 
 struct SearchCookie {
     sender: Option<futures::channel::oneshot::Sender<CouchbaseResult<SearchResult>>>,
-    rows_sender: futures::channel::mpsc::UnboundedSender<Vec<u8>>,
-    rows_receiver: Option<futures::channel::mpsc::UnboundedReceiver<Vec<u8>>>,
+    rows_sender: RowSender,
+    rows_receiver: Option<RowReceiver>,
     meta_sender: futures::channel::oneshot::Sender<SearchMetaData>,
     meta_receiver: Option<futures::channel::oneshot::Receiver<SearchMetaData>>,
     facet_sender: futures::channel::oneshot::Sender<serde_json::Value>,
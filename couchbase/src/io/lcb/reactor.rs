@@ -0,0 +1,146 @@
+use crate::io::lcb::completions;
+use crate::io::lcb::instance::LcbInstances;
+use crate::io::lcb::tokio_io::TokioIo;
+use crate::io::lcb::IoRequest;
+use crate::io::request::Request;
+use futures::channel::mpsc::{unbounded, UnboundedReceiver, UnboundedSender};
+use futures::Stream;
+use log::{debug, trace, warn};
+use std::fmt;
+use std::future::Future;
+use std::pin::Pin;
+use std::task::{Context, Poll};
+use std::time::Instant;
+
+/// Requests waiting for the `ReactorDriver` which owns them to be driven.
+///
+/// Requests may be queued from any thread, the driver is woken up to send them.
+#[derive(Debug)]
+pub struct ReactorQueue {
+    requests: UnboundedSender<IoRequest>,
+    connection_string: String,
+    username: Option<String>,
+    password: Option<String>,
+}
+
+impl ReactorQueue {
+    pub fn send(&self, request: Request) {
+        self.push(IoRequest::Data(request, Instant::now()))
+    }
+
+    pub fn open_bucket(&self, name: String) {
+        self.push(IoRequest::OpenBucket {
+            name,
+            connection_string: self.connection_string.clone(),
+            username: self.username.clone(),
+            password: self.password.clone(),
+        })
+    }
+
+    fn push(&self, request: IoRequest) {
+        if let Err(e) = self.requests.unbounded_send(request) {
+            // Dropping the request cancels the future awaiting its response.
+            trace!("Could not send request to stopped driver: {}", e);
+        }
+    }
+}
+
+impl Drop for ReactorQueue {
+    fn drop(&mut self) {
+        // The driver stops once the outstanding requests completed.
+        let _ = self.requests.unbounded_send(IoRequest::Shutdown);
+    }
+}
+
+/// Drives libcouchbase from a task on the tokio runtime instead of on IO threads.
+///
+/// The sockets and timers of the instances are those of the runtime, see `TokioIo`, and
+/// requests are scheduled, sent and completed whenever the task is polled. The task must
+/// stay on the thread it started on (`tokio::task::spawn_local`), as libcouchbase and the
+/// per-thread state of the requests it completes are not thread safe.
+pub struct ReactorDriver {
+    io: TokioIo,
+    instances: Option<LcbInstances>,
+    requests: UnboundedReceiver<IoRequest>,
+    shutdown: bool,
+}
+
+impl ReactorDriver {
+    /// Creates the driver and the queue the `Core` sends its requests to.
+    pub fn new(
+        connection_string: String,
+        username: Option<String>,
+        password: Option<String>,
+        preconnect: bool,
+    ) -> (Self, ReactorQueue) {
+        debug!("Using libcouchbase tokio transport");
+        let io = TokioIo::new();
+        let mut instances = LcbInstances::with_io(io.io(), preconnect);
+        match instances.create_instance(
+            connection_string.clone().into_bytes(),
+            username.clone().map(String::into_bytes),
+            password.clone().map(String::into_bytes),
+            None,
+        ) {
+            Ok(i) => instances.set_unbound(i),
+            Err(e) => warn!("Could not open libcouchbase instance {}", e),
+        };
+
+        let (tx, rx) = unbounded();
+        let driver = Self {
+            io,
+            instances: Some(instances),
+            requests: rx,
+            shutdown: false,
+        };
+        let queue = ReactorQueue {
+            requests: tx,
+            connection_string,
+            username,
+            password,
+        };
+        (driver, queue)
+    }
+}
+
+impl Future for ReactorDriver {
+    type Output = ();
+
+    fn poll(mut self: Pin<&mut Self>, cx: &mut Context<'_>) -> Poll<()> {
+        let this = &mut *self;
+        let instances = match &mut this.instances {
+            Some(instances) => instances,
+            None => return Poll::Ready(()),
+        };
+
+        while !this.shutdown {
+            match Pin::new(&mut this.requests).poll_next(cx) {
+                Poll::Ready(Some(request)) => match instances.handle_request(request) {
+                    Ok(shutdown) => this.shutdown = shutdown,
+                    Err(e) => warn!("Failed to handle request because of {}", e),
+                },
+                Poll::Ready(None) => this.shutdown = true,
+                Poll::Pending => break,
+            }
+        }
+        this.io.poll(cx);
+        completions::flush();
+
+        if this.shutdown && !instances.have_outstanding_requests() {
+            debug!("Stopping libcouchbase tokio transport");
+            // Destroys the instances, then the IO plugin they share.
+            this.instances.take();
+            completions::flush();
+            return Poll::Ready(());
+        }
+        Poll::Pending
+    }
+}
+
+impl fmt::Debug for ReactorDriver {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        f.debug_struct("ReactorDriver")
+            .field("shutdown", &self.shutdown)
+            .finish()
+    }
+}
@@ -0,0 +1,290 @@
+use crate::io::lcb::{IoRequest, LoopWaker};
+
+use couchbase_sys::*;
+use crossbeam_channel::Sender;
+use futures::channel::mpsc::{unbounded, TrySendError, UnboundedReceiver, UnboundedSender};
+use futures::Stream;
+use std::cell::RefCell;
+use std::pin::Pin;
+use std::sync::atomic::{AtomicBool, AtomicUsize, Ordering};
+use std::sync::{Arc, Mutex, Weak};
+use std::task::{Context, Poll};
+
+thread_local! {
+    /// Budgets which paused their request on this lcb thread at some point.
+    static PAUSED: RefCell<Vec<Weak<RowBudget>>> = RefCell::new(Vec::new());
+}
+
+/// Resumes every request paused on this thread and stops pausing them again.
+///
+/// Needs to run before the instances are destroyed, since `lcb_wait` would otherwise
+/// wait forever for a request whose rows nobody consumes anymore.
+pub fn resume_paused() {
+    let paused = PAUSED.with(|p| p.replace(Vec::new()));
+    for budget in paused.iter().filter_map(Weak::upgrade) {
+        budget.closed.store(true, Ordering::SeqCst);
+        budget.paused.store(false, Ordering::SeqCst);
+        budget.resume_now();
+    }
+}
+
+/// The streaming request whose socket is paused once too many rows are buffered.
+#[derive(Debug, Clone, Copy)]
+pub enum RowHandle {
+    Query(*mut lcb_QUERY_HANDLE),
+    Analytics(*mut lcb_ANALYTICS_HANDLE),
+    Search(*mut lcb_SEARCH_HANDLE),
+}
+
+impl RowHandle {
+    unsafe fn pause(self, instance: *mut lcb_INSTANCE) -> lcb_STATUS {
+        match self {
+            Self::Query(h) => lcb_query_pause(instance, h),
+            Self::Analytics(h) => lcb_analytics_pause(instance, h),
+            Self::Search(h) => lcb_search_pause(instance, h),
+        }
+    }
+
+    unsafe fn resume(self, instance: *mut lcb_INSTANCE) -> lcb_STATUS {
+        match self {
+            Self::Query(h) => lcb_query_resume(instance, h),
+            Self::Analytics(h) => lcb_analytics_resume(instance, h),
+            Self::Search(h) => lcb_search_resume(instance, h),
+        }
+    }
+}
+
+#[derive(Debug, Clone, Copy)]
+struct PausedRequest {
+    instance: *mut lcb_INSTANCE,
+    handle: RowHandle,
+}
+
+/// Creates the budgets for the streaming requests of one lcb thread.
+#[derive(Debug, Clone)]
+pub struct RowThrottle {
+    queue_tx: Sender<IoRequest>,
+    waker: Arc<LoopWaker>,
+    budget: usize,
+}
+
+impl RowThrottle {
+    pub fn new(queue_tx: Sender<IoRequest>, waker: Arc<LoopWaker>, budget: usize) -> Self {
+        Self {
+            queue_tx,
+            waker,
+            budget,
+        }
+    }
+}
+
+/// Tracks how many bytes of rows are buffered between the lcb thread and the consumer
+/// of a single streaming request.
+///
+/// Once more than `budget` bytes are buffered the request stops reading from its
+/// socket, and it resumes once the consumer drained them below half of the budget.
+/// Rows which have already been read into the network buffer are still delivered while
+/// paused, so the budget can be exceeded by up to one read.
+#[derive(Debug)]
+pub struct RowBudget {
+    buffered: AtomicUsize,
+    budget: usize,
+    paused: AtomicBool,
+    closed: AtomicBool,
+    // Only set and dereferenced on the lcb thread, cleared once the request completed.
+    request: Mutex<Option<PausedRequest>>,
+    queue_tx: Sender<IoRequest>,
+    waker: Arc<LoopWaker>,
+}
+
+// The raw handles are only ever touched on the lcb thread owning the request.
+unsafe impl Send for RowBudget {}
+unsafe impl Sync for RowBudget {}
+
+impl RowBudget {
+    fn new(throttle: RowThrottle) -> Self {
+        Self {
+            buffered: AtomicUsize::new(0),
+            budget: throttle.budget,
+            paused: AtomicBool::new(false),
+            closed: AtomicBool::new(false),
+            request: Mutex::new(None),
+            queue_tx: throttle.queue_tx,
+            waker: throttle.waker,
+        }
+    }
+
+    fn low_watermark(&self) -> bool {
+        self.buffered.load(Ordering::SeqCst) <= self.budget / 2
+    }
+
+    /// Called on the lcb thread after a row has been handed to the consumer.
+    unsafe fn maybe_pause<F: FnOnce() -> RowHandle>(
+        self: &Arc<Self>,
+        instance: *mut lcb_INSTANCE,
+        handle: F,
+    ) {
+        if self.buffered.load(Ordering::SeqCst) <= self.budget
+            || self.paused.load(Ordering::SeqCst)
+            || self.closed.load(Ordering::SeqCst)
+        {
+            return;
+        }
+
+        let request = PausedRequest {
+            instance,
+            handle: handle(),
+        };
+        *self.request.lock().unwrap() = Some(request);
+        self.paused.store(true, Ordering::SeqCst);
+        request.handle.pause(instance);
+        PAUSED.with(|p| {
+            let mut p = p.borrow_mut();
+            p.retain(|b| b.strong_count() > 0);
+            p.push(Arc::downgrade(self));
+        });
+
+        // The consumer might have drained (or dropped) the rows before it could see
+        // the flag, in which case nobody else is going to resume.
+        if (self.low_watermark() || self.closed.load(Ordering::SeqCst))
+            && self.paused.swap(false, Ordering::SeqCst)
+        {
+            self.resume_now();
+        }
+    }
+
+    /// Called on the consumer side for every row taken out of the channel.
+    fn consumed(self: &Arc<Self>, len: usize) {
+        self.buffered.fetch_sub(len, Ordering::SeqCst);
+        if self.low_watermark() && self.paused.swap(false, Ordering::SeqCst) {
+            self.request_resume();
+        }
+    }
+
+    /// Called on the consumer side once it is not interested in more rows.
+    fn close(self: &Arc<Self>) {
+        self.closed.store(true, Ordering::SeqCst);
+        if self.paused.swap(false, Ordering::SeqCst) {
+            self.request_resume();
+        }
+    }
+
+    fn request_resume(self: &Arc<Self>) {
+        // If the lcb thread is gone there is nothing left to resume.
+        if self
+            .queue_tx
+            .send(IoRequest::ResumeRows(self.clone()))
+            .is_ok()
+        {
+            self.waker.wake();
+        }
+    }
+
+    /// Resumes reading, must be called on the lcb thread owning the request.
+    pub fn resume_now(&self) {
+        // Paused again in the meantime, the consumer will ask once it caught up.
+        if self.paused.load(Ordering::SeqCst) {
+            return;
+        }
+        if let Some(r) = *self.request.lock().unwrap() {
+            unsafe {
+                r.handle.resume(r.instance);
+            }
+        }
+    }
+
+    fn finish(&self) {
+        self.request.lock().unwrap().take();
+    }
+}
+
+/// Creates the channel rows of a streaming request are handed over through, accounting
+/// them against a budget if `throttle` is set.
+pub fn row_channel(throttle: Option<RowThrottle>) -> (RowSender, RowReceiver) {
+    let (tx, rx) = unbounded();
+    let budget = throttle.map(|t| Arc::new(RowBudget::new(t)));
+    (
+        RowSender {
+            inner: tx,
+            budget: budget.clone(),
+        },
+        RowReceiver { inner: rx, budget },
+    )
+}
+
+/// The lcb thread side of a row channel.
+#[derive(Debug)]
+pub struct RowSender {
+    inner: UnboundedSender<Vec<u8>>,
+    budget: Option<Arc<RowBudget>>,
+}
+
+impl RowSender {
+    /// Hands a row to the consumer, pausing the request through `handle` if the budget
+    /// is exhausted.
+    ///
+    /// Must be called on the lcb thread owning the request.
+    pub unsafe fn send<F: FnOnce() -> RowHandle>(
+        &self,
+        instance: *mut lcb_INSTANCE,
+        row: Vec<u8>,
+        handle: F,
+    ) -> Result<(), TrySendError<Vec<u8>>> {
+        let budget = match &self.budget {
+            Some(b) => b,
+            None => return self.inner.unbounded_send(row),
+        };
+
+        // Account before sending, the consumer might take the row out right away.
+        let len = row.len();
+        budget.buffered.fetch_add(len, Ordering::SeqCst);
+        match self.inner.unbounded_send(row) {
+            Ok(_) => {
+                budget.maybe_pause(instance, handle);
+                Ok(())
+            }
+            Err(e) => {
+                budget.buffered.fetch_sub(len, Ordering::SeqCst);
+                Err(e)
+            }
+        }
+    }
+
+    /// Signals the consumer that no more rows follow, the request must not be touched
+    /// afterwards.
+    pub fn close_channel(&self) {
+        self.inner.close_channel();
+        if let Some(b) = &self.budget {
+            b.finish();
+        }
+    }
+}
+
+/// The consumer side of a row channel, yielding the raw JSON rows.
+#[derive(Debug)]
+pub struct RowReceiver {
+    inner: UnboundedReceiver<Vec<u8>>,
+    budget: Option<Arc<RowBudget>>,
+}
+
+impl Stream for RowReceiver {
+    type Item = Vec<u8>;
+
+    fn poll_next(self: Pin<&mut Self>, cx: &mut Context<'_>) -> Poll<Option<Vec<u8>>> {
+        let this = self.get_mut();
+        let polled = Pin::new(&mut this.inner).poll_next(cx);
+        if let (Poll::Ready(Some(row)), Some(b)) = (&polled, &this.budget) {
+            b.consumed(row.len());
+        }
+        polled
+    }
+}
+
+impl Drop for RowReceiver {
+    fn drop(&mut self) {
+        self.inner.close();
+        if let Some(b) = &self.budget {
+            b.close();
+        }
+    }
+}
@@ -0,0 +1,420 @@
+//! A libcouchbase IO plugin (event model) on top of the tokio reactor.
+//!
+//! Sockets are watched through `AsyncFd` and timers are tokio `Sleep`s, so the instances
+//! created on the plugin make progress whenever the task owning it polls `TokioIo::poll`,
+//! on the runtime of the application rather than on an IO thread. The socket calls
+//! themselves are the default ones of libcouchbase.
+//!
+//! The plugin is not thread safe and must only be used by the task which owns it, on the
+//! thread it was created on.
+
+use couchbase_sys::*;
+use log::{debug, warn};
+use std::cell::RefCell;
+use std::collections::HashMap;
+use std::future::Future;
+use std::mem;
+use std::os::raw::{c_int, c_short, c_void};
+use std::os::unix::io::{AsRawFd, RawFd};
+use std::pin::Pin;
+use std::ptr;
+use std::task::{Context, Poll, Waker};
+use std::time::Duration;
+use tokio::io::unix::AsyncFd;
+use tokio::io::Interest;
+use tokio::time::{sleep, Instant, Sleep};
+
+/// The number of rounds of events handled per `poll` before the task yields.
+const POLL_BUDGET: usize = 64;
+
+/// A socket (or any other descriptor) watched on behalf of libcouchbase, which owns it.
+struct Watched(RawFd);
+
+impl AsRawFd for Watched {
+    fn as_raw_fd(&self) -> RawFd {
+        self.0
+    }
+}
+
+struct Timer {
+    sleep: Pin<Box<Sleep>>,
+    armed: bool,
+    callback: lcb_ioE_callback,
+    arg: *mut c_void,
+}
+
+struct Event {
+    sock: lcb_socket_t,
+    flags: c_short,
+    callback: lcb_ioE_callback,
+    arg: *mut c_void,
+}
+
+/// The timers and events libcouchbase created, by their handle.
+///
+/// Handles are never reused, so a handle destroyed by a callback just finds nothing.
+struct IoState {
+    timers: HashMap<usize, Timer>,
+    events: HashMap<usize, Event>,
+    watched: HashMap<RawFd, AsyncFd<Watched>>,
+    next_handle: usize,
+    /// The waker of the current `poll`, for timers scheduled by its callbacks.
+    waker: Option<Waker>,
+    close: lcb_ioE_close_fn,
+}
+
+impl IoState {
+    fn next_handle(&mut self) -> usize {
+        self.next_handle += 1;
+        self.next_handle
+    }
+
+    /// Registers `sock` with the reactor, unless it already is.
+    fn watch(&mut self, sock: lcb_socket_t) -> bool {
+        if self.watched.contains_key(&sock) {
+            return true;
+        }
+        match AsyncFd::with_interest(Watched(sock), Interest::READABLE | Interest::WRITABLE) {
+            Ok(fd) => {
+                self.watched.insert(sock, fd);
+                true
+            }
+            Err(e) => {
+                warn!("Could not register socket {} with the reactor: {}", sock, e);
+                false
+            }
+        }
+    }
+
+    /// Deregisters `sock` once no event refers to it anymore, so that the descriptor can
+    /// be closed (and its number reused).
+    fn unwatch_unused(&mut self, sock: lcb_socket_t) {
+        if !self.events.values().any(|e| e.sock == sock) {
+            self.watched.remove(&sock);
+        }
+    }
+}
+
+/// The IO plugin, shared by the instances created with `io()`.
+pub struct TokioIo {
+    io: lcb_io_opt_t,
+}
+
+impl TokioIo {
+    pub fn new() -> Self {
+        let mut defaults: lcb_bsd_procs = unsafe { mem::zeroed() };
+        unsafe { lcb_iops_wire_bsd_impl2(&mut defaults, LCB_IOPROCS_VERSION as c_int) };
+        let state = Box::new(RefCell::new(IoState {
+            timers: HashMap::new(),
+            events: HashMap::new(),
+            watched: HashMap::new(),
+            next_handle: 0,
+            waker: None,
+            close: defaults.close,
+        }));
+
+        let mut io: Box<lcb_io_opt_st> = Box::new(unsafe { mem::zeroed() });
+        io.version = 2;
+        io.destructor = Some(destroy_io);
+        io.v.v2.cookie = Box::into_raw(state) as *mut c_void;
+        io.v.v2.get_procs = Some(get_procs);
+        Self {
+            io: Box::into_raw(io),
+        }
+    }
+
+    /// The plugin to create the instances with, see `lcb_createopts_io`. It is destroyed
+    /// through `lcb_destroy_io_ops`, once they all have been destroyed.
+    pub fn io(&self) -> lcb_io_opt_t {
+        self.io
+    }
+
+    /// Runs the callbacks of the sockets which are ready and of the timers which expired,
+    /// until there are none left or the budget of this poll is spent.
+    ///
+    /// Readiness is reported by the reactor on edges, while libcouchbase expects it to be
+    /// level-triggered (it may not read or write until it would block). Readiness is thus
+    /// checked with `poll(2)` before it is reported, and cleared if it is stale.
+    pub fn poll(&self, cx: &mut Context<'_>) {
+        let state = unsafe { io_state(self.io) };
+        state.borrow_mut().waker = Some(cx.waker().clone());
+        for _ in 0..POLL_BUDGET {
+            if !run_timers(state, cx) & !run_events(state, cx) {
+                return;
+            }
+        }
+        // More work is ready, let the other tasks run first.
+        cx.waker().wake_by_ref();
+    }
+}
+
+impl Default for TokioIo {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+unsafe fn io_state<'a>(io: lcb_io_opt_t) -> &'a RefCell<IoState> {
+    &*((*io).v.v2.cookie as *const RefCell<IoState>)
+}
+
+/// Runs the callbacks of the expired timers, returns true if there were any.
+fn run_timers(state: &RefCell<IoState>, cx: &mut Context<'_>) -> bool {
+    let handles: Vec<usize> = state.borrow().timers.keys().copied().collect();
+    let mut ran = false;
+    for handle in handles {
+        let expired = {
+            let mut state = state.borrow_mut();
+            match state.timers.get_mut(&handle) {
+                Some(timer) if timer.armed => match timer.sleep.as_mut().poll(cx) {
+                    Poll::Ready(()) => {
+                        timer.armed = false;
+                        Some((timer.callback, timer.arg))
+                    }
+                    Poll::Pending => None,
+                },
+                _ => None,
+            }
+        };
+        if let Some((Some(callback), arg)) = expired {
+            unsafe { callback(-1, 0, arg) };
+            ran = true;
+        }
+    }
+    ran
+}
+
+/// Runs the callbacks of the sockets which are ready, returns true if there were any.
+fn run_events(state: &RefCell<IoState>, cx: &mut Context<'_>) -> bool {
+    let handles: Vec<usize> = state.borrow().events.keys().copied().collect();
+    let mut ran = false;
+    for handle in handles {
+        let ready = {
+            let state = state.borrow();
+            match state.events.get(&handle) {
+                Some(event) if event.flags != 0 => state
+                    .watched
+                    .get(&event.sock)
+                    .map(|fd| (event.sock, ready_flags(fd, event.flags, cx)))
+                    .filter(|(_, flags)| *flags != 0)
+                    .map(|(sock, flags)| (sock, flags, event.callback, event.arg)),
+                _ => None,
+            }
+        };
+        if let Some((sock, flags, Some(callback), arg)) = ready {
+            unsafe { callback(sock, flags, arg) };
+            ran = true;
+        }
+    }
+    ran
+}
+
+/// The events of `wanted` which `fd` is ready for, registering the waker for the others.
+fn ready_flags(fd: &AsyncFd<Watched>, wanted: c_short, cx: &mut Context<'_>) -> c_short {
+    let mut ready = 0;
+    if wanted & LCB_READ_EVENT as c_short != 0 {
+        while let Poll::Ready(Ok(mut guard)) = fd.poll_read_ready(cx) {
+            if is_ready(fd.as_raw_fd(), libc::POLLIN) {
+                ready |= LCB_READ_EVENT as c_short;
+                break;
+            }
+            guard.clear_ready();
+        }
+    }
+    if wanted & LCB_WRITE_EVENT as c_short != 0 {
+        while let Poll::Ready(Ok(mut guard)) = fd.poll_write_ready(cx) {
+            if is_ready(fd.as_raw_fd(), libc::POLLOUT) {
+                ready |= LCB_WRITE_EVENT as c_short;
+                break;
+            }
+            guard.clear_ready();
+        }
+    }
+    ready
+}
+
+/// Whether `fd` is ready for `events` right now. Errors and hang-ups count as ready, the
+/// socket call which libcouchbase makes next reports them.
+fn is_ready(fd: RawFd, events: c_short) -> bool {
+    let mut pfd = libc::pollfd {
+        fd,
+        events,
+        revents: 0,
+    };
+    unsafe { libc::poll(&mut pfd, 1, 0) > 0 }
+}
+
+unsafe extern "C" fn get_procs(
+    _version: c_int,
+    loop_procs: *mut lcb_loop_procs,
+    timer_procs: *mut lcb_timer_procs,
+    bsd_procs: *mut lcb_bsd_procs,
+    ev_procs: *mut lcb_ev_procs,
+    _completion_procs: *mut lcb_completion_procs,
+    iomodel: *mut lcb_iomodel_t,
+) {
+    *iomodel = lcb_iomodel_t_LCB_IOMODEL_EVENT;
+
+    (*loop_procs).start = Some(start_loop);
+    (*loop_procs).stop = Some(stop_loop);
+    (*loop_procs).tick = None;
+
+    (*timer_procs).create = Some(create_timer);
+    (*timer_procs).destroy = Some(destroy_timer);
+    (*timer_procs).cancel = Some(cancel_timer);
+    (*timer_procs).schedule = Some(schedule_timer);
+
+    (*ev_procs).create = Some(create_event);
+    (*ev_procs).destroy = Some(destroy_event);
+    (*ev_procs).cancel = Some(cancel_event);
+    (*ev_procs).watch = Some(watch_event);
+
+    lcb_iops_wire_bsd_impl2(bsd_procs, LCB_IOPROCS_VERSION as c_int);
+    (*bsd_procs).close = Some(close_socket);
+}
+
+unsafe extern "C" fn destroy_io(io: lcb_io_opt_t) {
+    let state = Box::from_raw((*io).v.v2.cookie as *mut RefCell<IoState>);
+    let state = state.into_inner();
+    if !state.timers.is_empty() || !state.events.is_empty() {
+        warn!(
+            "Destroying the tokio IO plugin with {} timer(s) and {} event(s) left",
+            state.timers.len(),
+            state.events.len()
+        );
+    }
+    drop(Box::from_raw(io));
+}
+
+/// The loop is the task owning the plugin, it cannot be run from within libcouchbase:
+/// `lcb_wait` returns right away, and everything it would wait for completes while the
+/// task is polled.
+unsafe extern "C" fn start_loop(_io: lcb_io_opt_t) {
+    debug!("Ignoring request to run the event loop, it is driven by its tokio task");
+}
+
+unsafe extern "C" fn stop_loop(_io: lcb_io_opt_t) {}
+
+unsafe extern "C" fn create_timer(io: lcb_io_opt_t) -> *mut c_void {
+    let mut state = io_state(io).borrow_mut();
+    let handle = state.next_handle();
+    state.timers.insert(
+        handle,
+        Timer {
+            sleep: Box::pin(sleep(Duration::from_secs(0))),
+            armed: false,
+            callback: None,
+            arg: ptr::null_mut(),
+        },
+    );
+    handle as *mut c_void
+}
+
+unsafe extern "C" fn destroy_timer(io: lcb_io_opt_t, timer: *mut c_void) {
+    io_state(io).borrow_mut().timers.remove(&(timer as usize));
+}
+
+unsafe extern "C" fn cancel_timer(io: lcb_io_opt_t, timer: *mut c_void) {
+    if let Some(timer) = io_state(io).borrow_mut().timers.get_mut(&(timer as usize)) {
+        timer.armed = false;
+    }
+}
+
+unsafe extern "C" fn schedule_timer(
+    io: lcb_io_opt_t,
+    timer: *mut c_void,
+    usecs: lcb_U32,
+    arg: *mut c_void,
+    callback: lcb_ioE_callback,
+) -> c_int {
+    let mut state = io_state(io).borrow_mut();
+    let waker = state.waker.clone();
+    match state.timers.get_mut(&(timer as usize)) {
+        Some(timer) => {
+            timer
+                .sleep
+                .as_mut()
+                .reset(Instant::now() + Duration::from_micros(usecs as u64));
+            timer.armed = true;
+            timer.callback = callback;
+            timer.arg = arg;
+            // Registers with the timer wheel, the task polls it again before it yields.
+            if let Some(waker) = waker {
+                let _ = timer.sleep.as_mut().poll(&mut Context::from_waker(&waker));
+            }
+            0
+        }
+        None => -1,
+    }
+}
+
+unsafe extern "C" fn create_event(io: lcb_io_opt_t) -> *mut c_void {
+    let mut state = io_state(io).borrow_mut();
+    let handle = state.next_handle();
+    state.events.insert(
+        handle,
+        Event {
+            sock: -1,
+            flags: 0,
+            callback: None,
+            arg: ptr::null_mut(),
+        },
+    );
+    handle as *mut c_void
+}
+
+unsafe extern "C" fn destroy_event(io: lcb_io_opt_t, event: *mut c_void) {
+    let mut state = io_state(io).borrow_mut();
+    if let Some(event) = state.events.remove(&(event as usize)) {
+        if event.sock >= 0 {
+            state.unwatch_unused(event.sock);
+        }
+    }
+}
+
+unsafe extern "C" fn cancel_event(io: lcb_io_opt_t, _sock: lcb_socket_t, event: *mut c_void) {
+    if let Some(event) = io_state(io).borrow_mut().events.get_mut(&(event as usize)) {
+        event.flags = 0;
+    }
+}
+
+unsafe extern "C" fn watch_event(
+    io: lcb_io_opt_t,
+    sock: lcb_socket_t,
+    event: *mut c_void,
+    flags: c_short,
+    arg: *mut c_void,
+    callback: lcb_ioE_callback,
+) -> c_int {
+    let mut state = io_state(io).borrow_mut();
+    if !state.watch(sock) {
+        return -1;
+    }
+    let previous = match state.events.get_mut(&(event as usize)) {
+        Some(event) => {
+            let previous = mem::replace(&mut event.sock, sock);
+            event.flags = flags & (LCB_READ_EVENT | LCB_WRITE_EVENT) as c_short;
+            event.callback = callback;
+            event.arg = arg;
+            previous
+        }
+        None => return -1,
+    };
+    if previous >= 0 && previous != sock {
+        state.unwatch_unused(previous);
+    }
+    0
+}
+
+/// Deregisters the socket before it is closed, so that a socket opened later under the
+/// same number is registered anew.
+unsafe extern "C" fn close_socket(io: lcb_io_opt_t, sock: lcb_socket_t) {
+    let close = {
+        let mut state = io_state(io).borrow_mut();
+        state.watched.remove(&sock);
+        state.close
+    };
+    if let Some(close) = close {
+        close(io, sock);
+    }
+}
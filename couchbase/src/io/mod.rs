@@ -1,4 +1,5 @@
 use crate::io::request::Request;
+use crate::{IoAffinity, IoThreadReport};
 
 #[cfg(feature = "libcouchbase")]
 mod lcb;
@@ -6,16 +7,65 @@ mod lcb;
 #[cfg(feature = "libcouchbase")]
 use crate::io::lcb::IoCore;
 
+use std::sync::Arc;
+mod buffer;
 pub mod request;
+#[cfg(feature = "bench-internals")]
+pub use lcb::bench;
+pub(crate) use buffer::ValueBuffer;
 pub(crate) use lcb::couchbase_error_from_lcb_status;
+pub(crate) use lcb::RowReceiver;
+pub(crate) use lcb::{InlineDriver, InlineQueue};
+#[cfg(all(feature = "tokio", unix))]
+pub(crate) use lcb::{ReactorDriver, ReactorQueue};
 pub(crate) use lcb::{
     LOOKUPIN_MACRO_CAS, LOOKUPIN_MACRO_EXPIRYTIME, LOOKUPIN_MACRO_FLAGS, MUTATION_MACRO_CAS,
     MUTATION_MACRO_SEQNO, MUTATION_MACRO_VALUE_CRC32C,
 };
 
+/// Tunables for the IO layer, set through `ClusterOptions`.
+#[derive(Debug, Clone)]
+pub struct IoConfig {
+    /// The number of IO threads to spawn.
+    pub(crate) io_threads: usize,
+    /// Values of at least this size are handed out without copying them out of the
+    /// network buffers, disabled if `None`.
+    pub(crate) zero_copy_threshold: Option<usize>,
+    /// The number of bytes of rows buffered per streaming request before reading from
+    /// the socket is paused, unbounded if `None`.
+    pub(crate) row_buffer_budget: Option<usize>,
+    /// The CPUs the IO threads are pinned to, unpinned if `None`.
+    pub(crate) io_affinity: Option<IoAffinity>,
+    /// Whether opened buckets connect to all key-value nodes before they take requests.
+    pub(crate) preconnect: bool,
+}
+
+impl Default for IoConfig {
+    fn default() -> Self {
+        Self {
+            io_threads: 1,
+            zero_copy_threshold: None,
+            row_buffer_budget: None,
+            io_affinity: None,
+            preconnect: false,
+        }
+    }
+}
+
 #[derive(Debug)]
 pub struct Core {
-    io_core: IoCore,
+    transport: Transport,
+}
+
+#[derive(Debug)]
+enum Transport {
+    /// Requests are handed to the IO threads.
+    Threads(IoCore),
+    /// Requests are driven by the thread owning the `InlineDriver` of the queue.
+    Inline(Arc<InlineQueue>),
+    /// Requests are driven by the tokio task running the `ReactorDriver` of the queue.
+    #[cfg(all(feature = "tokio", unix))]
+    Reactor(ReactorQueue),
 }
 
 impl Core {
@@ -23,17 +73,60 @@ impl Core {
         connection_string: String,
         username: Option<String>,
         password: Option<String>,
+        config: IoConfig,
     ) -> Self {
         Self {
-            io_core: IoCore::new(connection_string, username, password),
+            transport: Transport::Threads(IoCore::new(
+                connection_string,
+                username,
+                password,
+                config,
+            )),
+        }
+    }
+
+    /// Creates a core which does not spawn any thread, its requests are sent once the
+    /// `InlineDriver` owning `queue` blocks on them.
+    pub(crate) fn inline(queue: Arc<InlineQueue>) -> Self {
+        Self {
+            transport: Transport::Inline(queue),
+        }
+    }
+
+    /// Creates a core which does not spawn any thread, its requests are sent by the task
+    /// running the `ReactorDriver` owning `queue`.
+    #[cfg(all(feature = "tokio", unix))]
+    pub(crate) fn reactor(queue: ReactorQueue) -> Self {
+        Self {
+            transport: Transport::Reactor(queue),
         }
     }
 
     pub fn send(&self, request: Request) {
-        self.io_core.send(request)
+        match &self.transport {
+            Transport::Threads(io_core) => io_core.send(request),
+            Transport::Inline(queue) => queue.send(request),
+            #[cfg(all(feature = "tokio", unix))]
+            Transport::Reactor(queue) => queue.send(request),
+        }
+    }
+
+    /// Describes the IO threads, none if requests are driven inline or by a tokio task.
+    pub fn io_threads(&self) -> Vec<IoThreadReport> {
+        match &self.transport {
+            Transport::Threads(io_core) => io_core.io_threads(),
+            Transport::Inline(_) => vec![],
+            #[cfg(all(feature = "tokio", unix))]
+            Transport::Reactor(_) => vec![],
+        }
     }
 
     pub fn open_bucket(&self, name: String) {
-        self.io_core.open_bucket(name)
+        match &self.transport {
+            Transport::Threads(io_core) => io_core.open_bucket(name),
+            Transport::Inline(queue) => queue.open_bucket(name),
+            #[cfg(all(feature = "tokio", unix))]
+            Transport::Reactor(queue) => queue.open_bucket(name),
+        }
     }
 }
@@ -8,11 +8,13 @@ use crate::{
     SearchResult, ServiceType, ViewResult,
 };
 use futures::channel::oneshot::Sender;
+use std::sync::{Arc, Mutex};
 use std::time::Duration;
 
 #[derive(Debug)]
 pub enum Request {
     Get(GetRequest),
+    GetMulti(GetMultiRequest),
     Mutate(MutateRequest),
     Exists(ExistsRequest),
     Remove(RemoveRequest),
@@ -28,12 +30,16 @@ pub enum Request {
     Unlock(UnlockRequest),
     Touch(TouchRequest),
     GetReplica(GetReplicaRequest),
+    /// A group of key-value requests against the same bucket which are scheduled
+    /// together, so they are flushed to the network in as few writes as possible.
+    Batch(Vec<Request>),
 }
 
 impl Request {
     pub fn bucket(&self) -> Option<&String> {
         match self {
             Self::Get(r) => Some(&r.bucket),
+            Self::GetMulti(r) => Some(&r.bucket),
             Self::Mutate(r) => Some(&r.bucket),
             Self::Exists(r) => Some(&r.bucket),
             Self::Remove(r) => Some(&r.bucket),
@@ -43,28 +49,57 @@ impl Request {
             Self::Unlock(r) => Some(&r.bucket),
             Self::Touch(r) => Some(&r.bucket),
             Self::GetReplica(r) => Some(&r.bucket),
+            Self::Batch(r) => r.first().and_then(|r| r.bucket()),
             _ => None,
         }
     }
 
-    pub fn fail(self, reason: CouchbaseError) {
+    /// Returns the document id for key-value requests, which is used to route the request
+    /// to the same IO shard every time.
+    pub fn key(&self) -> Option<&String> {
         match self {
-            Self::Get(r) => r.sender.send(Err(reason)).unwrap(),
-            Self::Mutate(r) => r.sender.send(Err(reason)).unwrap(),
-            Self::Exists(r) => r.sender.send(Err(reason)).unwrap(),
-            Self::Remove(r) => r.sender.send(Err(reason)).unwrap(),
-            Self::MutateIn(r) => r.sender.send(Err(reason)).unwrap(),
-            Self::LookupIn(r) => r.sender.send(Err(reason)).unwrap(),
-            Self::Query(r) => r.sender.send(Err(reason)).unwrap(),
-            Self::Analytics(r) => r.sender.send(Err(reason)).unwrap(),
-            Self::Search(r) => r.sender.send(Err(reason)).unwrap(),
-            Self::View(r) => r.sender.send(Err(reason)).unwrap(),
-            Self::Ping(r) => r.sender.send(Err(reason)).unwrap(),
-            Self::GenericManagement(r) => r.sender.send(Err(reason)).unwrap(),
-            Self::Counter(r) => r.sender.send(Err(reason)).unwrap(),
-            Self::Unlock(r) => r.sender.send(Err(reason)).unwrap(),
-            Self::Touch(r) => r.sender.send(Err(reason)).unwrap(),
-            Self::GetReplica(r) => r.sender.send(Err(reason)).unwrap(),
+            Self::Get(r) => Some(&r.id),
+            Self::Mutate(r) => Some(&r.id),
+            Self::Exists(r) => Some(&r.id),
+            Self::Remove(r) => Some(&r.id),
+            Self::MutateIn(r) => Some(&r.id),
+            Self::LookupIn(r) => Some(&r.id),
+            Self::Counter(r) => Some(&r.id),
+            Self::Unlock(r) => Some(&r.id),
+            Self::Touch(r) => Some(&r.id),
+            Self::GetReplica(r) => Some(&r.id),
+            _ => None,
+        }
+    }
+
+    /// Fails the request with the error built by `reason`.
+    ///
+    /// Errors are not cloneable, so `reason` is called once for every request of a
+    /// batch, which all fail with the same kind of error.
+    pub fn fail(self, reason: &dyn Fn() -> CouchbaseError) {
+        match self {
+            Self::Get(r) => r.sender.send(Err(reason())).unwrap(),
+            Self::Mutate(r) => r.sender.send(Err(reason())).unwrap(),
+            Self::Exists(r) => r.sender.send(Err(reason())).unwrap(),
+            Self::Remove(r) => r.sender.send(Err(reason())).unwrap(),
+            Self::MutateIn(r) => r.sender.send(Err(reason())).unwrap(),
+            Self::LookupIn(r) => r.sender.send(Err(reason())).unwrap(),
+            Self::Query(r) => r.sender.send(Err(reason())).unwrap(),
+            Self::Analytics(r) => r.sender.send(Err(reason())).unwrap(),
+            Self::Search(r) => r.sender.send(Err(reason())).unwrap(),
+            Self::View(r) => r.sender.send(Err(reason())).unwrap(),
+            Self::Ping(r) => r.sender.send(Err(reason())).unwrap(),
+            Self::GenericManagement(r) => r.sender.send(Err(reason())).unwrap(),
+            Self::Counter(r) => r.sender.send(Err(reason())).unwrap(),
+            Self::Unlock(r) => r.sender.send(Err(reason())).unwrap(),
+            Self::Touch(r) => r.sender.send(Err(reason())).unwrap(),
+            Self::GetReplica(r) => r.sender.send(Err(reason())).unwrap(),
+            Self::GetMulti(r) => r.fail(reason),
+            Self::Batch(r) => {
+                for request in r {
+                    request.fail(reason);
+                }
+            }
         };
     }
 }
@@ -79,6 +114,90 @@ pub struct GetRequest {
     pub(crate) ty: GetRequestType,
 }
 
+/// Fetches several documents of the same collection at once, see `Collection::get_multi`.
+///
+/// The IO layer splits it into one part per shard, all of which write into the same
+/// `GetMultiGather`.
+#[derive(Debug)]
+pub struct GetMultiRequest {
+    /// The ids along with the index of their result.
+    pub(crate) ids: Vec<(usize, String)>,
+    pub(crate) bucket: String,
+    pub(crate) scope: String,
+    pub(crate) collection: String,
+    pub(crate) options: GetOptions,
+    pub(crate) gather: Arc<GetMultiGather>,
+}
+
+impl GetMultiRequest {
+    /// Fails every id of this part of the request with the error built by `reason`, see
+    /// `Request::fail`.
+    pub fn fail(self, reason: &dyn Fn() -> CouchbaseError) {
+        let results = self
+            .ids
+            .into_iter()
+            .map(|(index, _)| (index, Err(reason())))
+            .collect();
+        if let Some((sender, results)) = self.gather.finish_part(results) {
+            let _ = sender.send(results);
+        }
+    }
+}
+
+/// Assembles the results of a `GetMultiRequest` in the order of its ids. Each part of the
+/// request hands in all of its results at once, and the last one takes the sender.
+#[derive(Debug)]
+pub struct GetMultiGather {
+    state: Mutex<GatherState>,
+}
+
+#[derive(Debug)]
+struct GatherState {
+    results: Vec<Option<CouchbaseResult<GetResult>>>,
+    remaining: usize,
+    sender: Option<Sender<Vec<CouchbaseResult<GetResult>>>>,
+}
+
+impl GetMultiGather {
+    pub fn new(len: usize, sender: Sender<Vec<CouchbaseResult<GetResult>>>) -> Arc<Self> {
+        let mut results = Vec::with_capacity(len);
+        results.resize_with(len, || None);
+        Arc::new(Self {
+            state: Mutex::new(GatherState {
+                results,
+                remaining: len,
+                sender: Some(sender),
+            }),
+        })
+    }
+
+    /// Stores the results of a part, returning the sender along with all results once
+    /// every id has one.
+    pub fn finish_part(
+        &self,
+        results: Vec<(usize, CouchbaseResult<GetResult>)>,
+    ) -> Option<(
+        Sender<Vec<CouchbaseResult<GetResult>>>,
+        Vec<CouchbaseResult<GetResult>>,
+    )> {
+        let mut state = self.state.lock().unwrap();
+        state.remaining -= results.len();
+        for (index, result) in results {
+            state.results[index] = Some(result);
+        }
+        if state.remaining > 0 {
+            return None;
+        }
+        let sender = state.sender.take()?;
+        let results = state
+            .results
+            .drain(..)
+            .map(|r| r.expect("Every id of a get_multi has a result"))
+            .collect();
+        Some((sender, results))
+    }
+}
+
 #[derive(Debug)]
 pub enum GetRequestType {
     Get {
@@ -152,6 +271,10 @@ pub struct MutateRequest {
     pub(crate) id: String,
     pub(crate) bucket: String,
     pub(crate) content: Vec<u8>,
+    /// Flags stored along with the content, see `DocumentFormat`
+    pub(crate) flags: u32,
+    /// Whether the content is known to be JSON
+    pub(crate) json: bool,
     pub(crate) scope: String,
     pub(crate) collection: String,
     pub(crate) sender: Sender<CouchbaseResult<MutationResult>>,
@@ -1,3 +1,8 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#include <sched.h>
+#endif
+#include <errno.h>
 #include <stdio.h>
 #include <stdarg.h>
 
@@ -7,4 +12,31 @@
  */
 int wrapped_vsnprintf(char * buf, size_t size, const char *format, va_list ap) {
   return vsnprintf(buf, size, format, ap);
-}
\ No newline at end of file
+}
+
+/*
+ * Restricts the calling thread to the given CPUs. Returns 0 on success and an errno value
+ * otherwise, ENOSYS on platforms without thread affinity.
+ */
+int pin_current_thread(const size_t *cpus, size_t ncpus) {
+#ifdef __linux__
+  cpu_set_t set;
+  size_t i;
+
+  CPU_ZERO(&set);
+  for (i = 0; i < ncpus; i++) {
+    if (cpus[i] >= CPU_SETSIZE) {
+      return EINVAL;
+    }
+    CPU_SET(cpus[i], &set);
+  }
+  if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+    return errno;
+  }
+  return 0;
+#else
+  (void)cpus;
+  (void)ncpus;
+  return ENOSYS;
+#endif
+}
@@ -8,6 +8,7 @@ pub use api::analytics_options::*;
 pub use api::analytics_result::*;
 pub use api::authenticator::*;
 pub use api::binary_collection::*;
+pub use api::blocking;
 pub use api::bucket::*;
 pub use api::buckets::*;
 pub use api::cluster::*;
@@ -25,9 +26,11 @@ pub use api::search::*;
 pub use api::search_indexes::*;
 pub use api::search_options::*;
 pub use api::search_result::*;
+pub use api::sequence::*;
 pub use api::subdoc::*;
 pub use api::subdoc_options::*;
 pub use api::subdoc_results::*;
+pub use api::transcoding::*;
 pub use api::users::*;
 pub use api::view_indexes::*;
 pub use api::view_options::*;
@@ -35,5 +38,9 @@ pub use api::view_result::*;
 
 pub(crate) use api::options::*;
 
+#[cfg(feature = "bench-internals")]
+#[doc(hidden)]
+pub use io::bench;
+
 #[cfg(feature = "volatile")]
 pub use io::request::{GenericManagementRequest, Request};